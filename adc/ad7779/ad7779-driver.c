@@ -17,8 +17,10 @@
 #include <unistd.h>
 #include <signal.h>
 
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/threads.h>
+#include <sys/time.h>
 #include <sys/types.h>
 #include <sys/msg.h>
 #include <posix/utils.h>
@@ -31,6 +33,10 @@
 
 #define MAX_INIT_TRIES              (4)
 
+#if AD7779_BUFFER_CNT > ADC_RING_MAX_BUFS
+#error "AD7779_BUFFER_CNT exceeds ADC_RING_MAX_BUFS"
+#endif
+
 #ifndef AD7779_PRIO
 #define AD7779_PRIO 4
 #endif
@@ -41,7 +47,8 @@
  * To be defined in board_config.h if needed */
 /* #define AD7779_SUPPORT_ASYNC_REQS */
 
-#define MAX_PENDING_REQS 4
+#define MAX_PENDING_REQS 4  /* Preallocated, more are allocated on demand */
+#define MAX_CLIENTS      16
 #define READ_SIZE        (sizeof(uint32_t))
 
 
@@ -52,23 +59,51 @@ enum asyncState {
 };
 
 
-typedef struct {
+typedef struct async_req_s {
 	volatile sig_atomic_t state; /* one of asyncState, access is thread-safe */
+	int dynamic;                 /* allocated on demand, freed after response */
+	struct async_req_s *next;    /* pending list */
 	msg_t msg;
 	msg_rid_t rid;
 } async_req_t;
 
 
+/* Read cursor of a client process (adc_read_t reads) */
+typedef struct client_s {
+	pid_t pid;
+	uint32_t cursor; /* seq of the last buffer returned */
+	struct client_s *next;
+} client_t;
+
+
 static struct {
 	uint32_t port;
 	volatile sig_atomic_t enabled;
 	unsigned long prio;
 	addr_t buffer_paddr;
+	struct {
+		adc_ring_t *state;
+		addr_t paddr;
+		uint32_t cnt;  /* dma_count() at last update */
+		uint32_t seq;  /* Buffers completed, kept also without state page */
+	} ring;
+	/* Configuration change requested while acquisition is running, applied after a buffer completes */
+	struct {
+		adc_dev_ctl_t req;
+		int pending;
+		int res;
+#ifdef AD7779_SUPPORT_ASYNC_REQS
+		handle_t cond;
+#endif
+	} cfg;
 #ifdef AD7779_SUPPORT_ASYNC_REQS
 	struct {
 		handle_t lock;
 		handle_t cond;
-		async_req_t pending[MAX_PENDING_REQS];
+		async_req_t pool[MAX_PENDING_REQS];
+		async_req_t *pending;
+		client_t *clients;
+		unsigned int nclients;
 		uint8_t stack[2048] __attribute__((aligned(8)));
 	} async;
 #endif
@@ -82,12 +117,20 @@ static async_req_t *allocReq(void)
 #ifdef AD7779_SUPPORT_ASYNC_REQS
 	for (int i = 0; i < MAX_PENDING_REQS; ++i) {
 		/* NOTE: no need for mutex (allocReq called only by one thread), access to `state` is thread-safe */
-		if (ad7779_common.async.pending[i].state == stUnused) {
-			ad7779_common.async.pending[i].state = stUsed;
-			ret = &ad7779_common.async.pending[i];
+		if (ad7779_common.async.pool[i].state == stUnused) {
+			ad7779_common.async.pool[i].state = stUsed;
+			ret = &ad7779_common.async.pool[i];
 			break;
 		}
 	}
+
+	if (ret == NULL) {
+		ret = malloc(sizeof(*ret));
+		if (ret != NULL) {
+			ret->state = stUsed;
+			ret->dynamic = 1;
+		}
+	}
 #else
 	/* all requests are blocking/synchronous - use single req */
 	static async_req_t req_storage;
@@ -98,6 +141,175 @@ static async_req_t *allocReq(void)
 }
 
 
+static int ring_init(void)
+{
+	adc_ring_t *state;
+
+	state = mmap(NULL, _PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_UNCACHED | MAP_ANONYMOUS, -1, 0);
+	if (state == MAP_FAILED) {
+		return -ENOMEM;
+	}
+
+	memset((void *)state, 0, sizeof(*state));
+	state->num = AD7779_BUFFER_CNT;
+	state->size = AD7779_BUFFER_SIZE;
+
+	ad7779_common.ring.paddr = va2pa(state);
+	ad7779_common.ring.state = state;
+	ad7779_common.ring.cnt = 0;
+
+	return EOK;
+}
+
+
+static void ring_set_period(void)
+{
+	uint32_t rate;
+
+	if ((ad7779_common.ring.state == NULL) || (ad7779_get_sampling_rate(&rate) != AD7779_OK) || (rate == 0)) {
+		return;
+	}
+
+	/* Samples of all channels are stored as 32-bit words */
+	ad7779_common.ring.state->period_us = (uint64_t)AD7779_BUFFER_SIZE * 1000000 / (AD7779_NUM_OF_CHANNELS * sizeof(uint32_t) * rate);
+}
+
+
+/* Publishes buffers completed since last update, called after each successful dma_read() */
+static void ring_update(void)
+{
+	adc_ring_t *state = ad7779_common.ring.state;
+	uint32_t cnt, done, head, pending, lost, i;
+	time_t now;
+
+	cnt = dma_count();
+	/* Counter restarts from 0 after DMA reset */
+	done = (cnt >= ad7779_common.ring.cnt) ? (cnt - ad7779_common.ring.cnt) : cnt;
+	ad7779_common.ring.cnt = cnt;
+	ad7779_common.ring.seq += done;
+	if ((done == 0) || (state == NULL)) {
+		return;
+	}
+
+	gettime(&now, NULL);
+	head = state->head;
+
+	/* Newest buffer completed now, older ones are estimated one period apart */
+	for (i = 0; (i < done) && (i < AD7779_BUFFER_CNT); i++) {
+		state->ts[(head + done - 1 - i) % AD7779_BUFFER_CNT] = now - (time_t)i * state->period_us;
+	}
+
+	/* Count only buffers lost by this update */
+	pending = head - state->tail;
+	lost = (pending + done > AD7779_BUFFER_CNT - 1) ? (pending + done - (AD7779_BUFFER_CNT - 1)) : 0;
+	if (pending > AD7779_BUFFER_CNT - 1) {
+		lost -= pending - (AD7779_BUFFER_CNT - 1);
+	}
+	state->overrun += lost;
+
+	/* Timestamps have to be visible before the new head */
+	__sync_synchronize();
+	state->head = head + done;
+}
+
+
+static int cfg_apply(const adc_dev_ctl_t *dev_ctl)
+{
+	ad7779_chmode_t mode;
+	int res;
+
+	switch (dev_ctl->type) {
+		case adc_dev_ctl__set_config:
+			res = ad7779_set_sampling_rate(dev_ctl->config.sampling_rate);
+			if (res == AD7779_OK) {
+				res = ad7779_set_enabled_channels(dev_ctl->config.enabled_ch);
+			}
+			break;
+
+		case adc_dev_ctl__set_channel_config:
+			res = ad7779_set_channel_gain(dev_ctl->ch_config.channel, dev_ctl->ch_config.gain);
+			if (res == AD7779_OK) {
+				mode = dev_ctl->ch_config.ref_monitor_mode + dev_ctl->ch_config.meter_rx_mode;
+				res = ad7779_set_channel_mode(dev_ctl->ch_config.channel, mode);
+			}
+			break;
+
+		case adc_dev_ctl__set_channel_gain:
+			res = ad7779_set_channel_gain(dev_ctl->gain.channel, dev_ctl->gain.val);
+			break;
+
+		default:
+			res = AD7779_ARG_ERROR;
+			break;
+	}
+
+	if (res == AD7779_ARG_ERROR) {
+		return -EINVAL;
+	}
+
+	return (res != AD7779_OK) ? -EIO : EOK;
+}
+
+
+/* Applies the pending change right after a buffer completed, DMA keeps running.
+ * Registers are written while the next buffer is being filled, so the one after it
+ * is the first with the new settings only. */
+static void cfg_applyPending(void)
+{
+	adc_ring_t *state = ad7779_common.ring.state;
+
+	ad7779_common.cfg.res = cfg_apply(&ad7779_common.cfg.req);
+	ad7779_common.cfg.pending = 0;
+
+	if (ad7779_common.cfg.res != EOK) {
+		return;
+	}
+
+	if (ad7779_common.cfg.req.type == adc_dev_ctl__set_config) {
+		ring_set_period();
+	}
+
+	if (state != NULL) {
+		state->cfg_seq = ad7779_common.ring.seq + 2;
+		__sync_synchronize();
+		state->cfg_gen++;
+	}
+}
+
+
+/* Configuration change while acquisition is running, returns after it was applied */
+static int cfg_live(const adc_dev_ctl_t *dev_ctl)
+{
+	int res;
+
+#ifdef AD7779_SUPPORT_ASYNC_REQS
+	mutexLock(ad7779_common.async.lock);
+	ad7779_common.cfg.req = *dev_ctl;
+	ad7779_common.cfg.pending = 1;
+
+	/* read_thr applies it after its next dma_read(), wake it up if nobody is reading */
+	condSignal(ad7779_common.async.cond);
+	while (ad7779_common.cfg.pending != 0) {
+		condWait(ad7779_common.cfg.cond, ad7779_common.async.lock, 0);
+	}
+	res = ad7779_common.cfg.res;
+	mutexUnlock(ad7779_common.async.lock);
+#else
+	uint32_t data;
+
+	/* Requests are handled by this thread only, nobody else waits for the DMA interrupt now */
+	ad7779_common.cfg.req = *dev_ctl;
+	if (dma_read(&data, READ_SIZE) == EOK) {
+		ring_update();
+	}
+	cfg_applyPending();
+	res = ad7779_common.cfg.res;
+#endif
+
+	return res;
+}
+
+
 static int dev_init(void)
 {
 	int res;
@@ -138,6 +350,123 @@ static int dev_close(oid_t *oid, int flags)
 }
 
 
+#ifdef AD7779_SUPPORT_ASYNC_REQS
+static void freeReq(async_req_t *req)
+{
+	if (req->dynamic != 0) {
+		free(req);
+	}
+	else {
+		req->state = stUnused;
+	}
+}
+
+
+/* Must be called with async.lock taken */
+static client_t *client_get(pid_t pid, int create)
+{
+	client_t *c;
+
+	for (c = ad7779_common.async.clients; c != NULL; c = c->next) {
+		if (c->pid == pid) {
+			return c;
+		}
+	}
+
+	if ((create == 0) || (ad7779_common.async.nclients >= MAX_CLIENTS)) {
+		return NULL;
+	}
+
+	c = malloc(sizeof(*c));
+	if (c != NULL) {
+		c->pid = pid;
+		/* New client starts with the next buffer */
+		c->cursor = ad7779_common.ring.seq;
+		c->next = ad7779_common.async.clients;
+		ad7779_common.async.clients = c;
+		ad7779_common.async.nclients++;
+	}
+
+	return c;
+}
+
+
+/* Must be called with async.lock taken */
+static void client_remove(pid_t pid)
+{
+	client_t **c, *tmp;
+
+	for (c = &ad7779_common.async.clients; *c != NULL; c = &(*c)->next) {
+		if ((*c)->pid == pid) {
+			tmp = *c;
+			*c = tmp->next;
+			free(tmp);
+			ad7779_common.async.nclients--;
+			break;
+		}
+	}
+}
+
+
+/* Fills response with the next buffer for the client, returns 0 if there is none yet */
+static int client_next(client_t *c, adc_read_t *out)
+{
+	uint32_t avail = ad7779_common.ring.seq - c->cursor;
+
+	if (avail == 0) {
+		return 0;
+	}
+
+	/* Buffer being filled by DMA can't be returned, older than num - 1 are lost */
+	out->missed = (avail > AD7779_BUFFER_CNT - 1) ? (avail - (AD7779_BUFFER_CNT - 1)) : 0;
+	out->seq = c->cursor + out->missed + 1;
+	c->cursor = out->seq;
+
+	return 1;
+}
+
+
+/* Answers pending request if possible, must be called with async.lock taken.
+ * Returns 1 if the request was answered. */
+static int reqTryRespond(async_req_t *req, int irq, int err, uint32_t data)
+{
+	adc_read_t rd;
+	client_t *c;
+
+	if (err != EOK) {
+		req->msg.o.err = err;
+	}
+	else if (req->msg.o.size == sizeof(adc_read_t)) {
+		c = client_get(req->msg.pid, 1);
+		if (c == NULL) {
+			req->msg.o.err = -ENOMEM;
+		}
+		else if (client_next(c, &rd) == 0) {
+			return 0;
+		}
+		else {
+			memcpy(req->msg.o.data, &rd, sizeof(rd));
+			req->msg.o.err = EOK;
+		}
+	}
+	else {
+		/* Interrupt counter read, answered on next interrupt */
+		if (irq == 0) {
+			return 0;
+		}
+		req->msg.o.err = EOK;
+		if (req->msg.o.data != NULL) {
+			memcpy(req->msg.o.data, &data, READ_SIZE);
+		}
+	}
+
+	msgRespond(ad7779_common.port, &req->msg, req->rid);
+
+	return 1;
+}
+#endif /* AD7779_SUPPORT_ASYNC_REQS */
+
+
 static int dev_read(async_req_t *req, int *respond)
 {
 #ifdef AD7779_SUPPORT_ASYNC_REQS
@@ -148,15 +477,28 @@ static int dev_read(async_req_t *req, int *respond)
 		return -EIO;
 	}
 
-	if ((req->msg.o.data != NULL) && (req->msg.o.size != READ_SIZE)) {
+	if ((req->msg.o.data != NULL) && (req->msg.o.size != READ_SIZE) && (req->msg.o.size != sizeof(adc_read_t))) {
 		return -EIO;
 	}
 
-	/* NOTE: mutex not needed for data races, but ensures no reader would be added while servicing single read */
+	if ((req->msg.o.size == sizeof(adc_read_t)) && (req->msg.o.data == NULL)) {
+		return -EINVAL;
+	}
+
 	mutexLock(ad7779_common.async.lock);
 
+	/* Lagging client gets buffers that are already available without waiting */
+	if (reqTryRespond(req, 0, EOK, 0) != 0) {
+		mutexUnlock(ad7779_common.async.lock);
+		*respond = 0;
+		freeReq(req);
+		return EOK;
+	}
+
 	/* schedule async read */
 	req->state = stPendingRead;
+	req->next = ad7779_common.async.pending;
+	ad7779_common.async.pending = req;
 	*respond = 0;
 
 	condSignal(ad7779_common.async.cond);
@@ -164,7 +506,11 @@ static int dev_read(async_req_t *req, int *respond)
 
 	return EOK;
 #else
-	return dma_read(req->msg.o.data, req->msg.o.size);
+	int ret = dma_read(req->msg.o.data, req->msg.o.size);
+	if (ret == EOK) {
+		ring_update();
+	}
+	return ret;
 #endif /* AD7779_SUPPORT_ASYNC_REQS */
 }
 
@@ -178,6 +524,7 @@ static int dev_ctl(msg_t *msg)
 
 	switch (dev_ctl.type) {
 		case adc_dev_ctl__enable:
+			ring_set_period();
 			ad7779_common.enabled = 1;
 			dma_enable();
 			sai_rx_enable();
@@ -214,19 +561,13 @@ static int dev_ctl(msg_t *msg)
 			return EOK;
 
 		case adc_dev_ctl__set_config:
-			if (ad7779_common.enabled)
-				return -EBUSY;
-			res = ad7779_set_sampling_rate(dev_ctl.config.sampling_rate);
-			if (res == AD7779_ARG_ERROR)
-				return -EINVAL;
-			if (res != AD7779_OK)
-				return -EIO;
-			res = ad7779_set_enabled_channels(dev_ctl.config.enabled_ch);
-			if (res == AD7779_ARG_ERROR)
-				return -EINVAL;
-			if (res != AD7779_OK)
-				return -EIO;
-			return EOK;
+		case adc_dev_ctl__set_channel_config:
+		case adc_dev_ctl__set_channel_gain:
+			/* While running, changes are applied at a buffer boundary without stopping DMA */
+			if (ad7779_common.enabled) {
+				return cfg_live(&dev_ctl);
+			}
+			return cfg_apply(&dev_ctl);
 
 		case adc_dev_ctl__get_config:
 			res = ad7779_get_sampling_rate(&dev_ctl.config.sampling_rate);
@@ -248,26 +589,6 @@ static int dev_ctl(msg_t *msg)
 			memcpy(msg->o.raw, &dev_ctl, sizeof(adc_dev_ctl_t));
 			return EOK;
 
-		case adc_dev_ctl__set_channel_config:
-		{
-			res = ad7779_set_channel_gain(dev_ctl.ch_config.channel,
-				dev_ctl.ch_config.gain);
-			if (res == AD7779_ARG_ERROR)
-				return -EINVAL;
-			if (res != AD7779_OK)
-				return -EIO;
-
-			ad7779_chmode_t mode = dev_ctl.ch_config.ref_monitor_mode +
-				dev_ctl.ch_config.meter_rx_mode;
-
-			res = ad7779_set_channel_mode(dev_ctl.ch_config.channel, mode);
-			if (res == AD7779_ARG_ERROR)
-				return -EINVAL;
-			if (res != AD7779_OK)
-				return -EIO;
-			return EOK;
-		}
-
 		case adc_dev_ctl__get_channel_config:
 		{
 			uint8_t gain;
@@ -297,14 +618,6 @@ static int dev_ctl(msg_t *msg)
 			return EOK;
 		}
 
-		case adc_dev_ctl__set_channel_gain:
-			res = ad7779_set_channel_gain(dev_ctl.gain.channel, dev_ctl.gain.val);
-			if (res == AD7779_ARG_ERROR)
-				return -EINVAL;
-			if (res != AD7779_OK)
-				return -EIO;
-			return EOK;
-
 		case adc_dev_ctl__get_channel_gain:
 			res = ad7779_get_channel_gain(dev_ctl.gain.channel, &dev_ctl.gain.val);
 			if (res == AD7779_ARG_ERROR)
@@ -362,6 +675,15 @@ static int dev_ctl(msg_t *msg)
 			memcpy(msg->o.raw, &dev_ctl, sizeof(adc_dev_ctl_t));
 			return EOK;
 
+		case adc_dev_ctl__get_ring:
+			if (ad7779_common.ring.state == NULL) {
+				return -ENOSYS;
+			}
+			dev_ctl.ring.paddr = ad7779_common.ring.paddr;
+			dev_ctl.ring.size = _PAGE_SIZE;
+			memcpy(msg->o.raw, &dev_ctl, sizeof(adc_dev_ctl_t));
+			return EOK;
+
 		default:
 			log_error("dev_ctl: unknown type (%d)", dev_ctl.type);
 			return -ENOSYS;
@@ -373,35 +695,46 @@ static int dev_ctl(msg_t *msg)
 #ifdef AD7779_SUPPORT_ASYNC_REQS
 static void read_thr(void *arg)
 {
+	async_req_t **r, *req;
 	uint32_t data;
+	int ret;
 
 	mutexLock(ad7779_common.async.lock);
 	for (;;) {
-		if (condWait(ad7779_common.async.cond, ad7779_common.async.lock, 0) != 0) {
+		/* Keep reading while anybody waits, new requests may have arrived during dma_read() */
+		if ((ad7779_common.async.pending == NULL) && (ad7779_common.cfg.pending == 0) && (condWait(ad7779_common.async.cond, ad7779_common.async.lock, 0) != 0)) {
 			continue;
 		}
 
-		if (ad7779_common.enabled != 1) {
+		if ((ad7779_common.enabled != 1) || ((ad7779_common.async.pending == NULL) && (ad7779_common.cfg.pending == 0))) {
+			condWait(ad7779_common.async.cond, ad7779_common.async.lock, 0);
 			continue;
 		}
 
 		mutexUnlock(ad7779_common.async.lock);
-		int ret = dma_read(&data, READ_SIZE);
+		ret = dma_read(&data, READ_SIZE);
 
-		/* NOTE: mutex not needed for data races, but ensures no reader would be added while servicing single read
+		/* NOTE: mutex ensures no reader would be added while servicing single read
 		 * prevents interrupt double-read by the same process */
 		mutexLock(ad7779_common.async.lock);
 
-		for (int i = 0; i < MAX_PENDING_REQS; ++i) {
-			async_req_t *req = &ad7779_common.async.pending[i];
-			if (req->state == stPendingRead) {
-				req->msg.o.err = ret;
-				if ((req->msg.o.data != NULL) && (ret == EOK)) {
-					memcpy(req->msg.o.data, &data, READ_SIZE);
-				}
+		if (ret == EOK) {
+			ring_update();
+		}
+
+		if (ad7779_common.cfg.pending != 0) {
+			cfg_applyPending();
+			condSignal(ad7779_common.cfg.cond);
+		}
 
-				msgRespond(ad7779_common.port, &req->msg, req->rid);
-				req->state = stUnused;
+		for (r = &ad7779_common.async.pending; *r != NULL;) {
+			req = *r;
+			if (reqTryRespond(req, 1, ret, data) != 0) {
+				*r = req->next;
+				freeReq(req);
+			}
+			else {
+				r = &req->next;
 			}
 		}
 	}
@@ -439,6 +772,11 @@ static void msg_loop(void)
 
 			case mtClose:
 				msg->o.err = dev_close(&msg->oid, msg->i.openclose.flags);
+#ifdef AD7779_SUPPORT_ASYNC_REQS
+				mutexLock(ad7779_common.async.lock);
+				client_remove(msg->pid);
+				mutexUnlock(ad7779_common.async.lock);
+#endif
 				break;
 
 			case mtRead:
@@ -508,6 +846,11 @@ static int init(void)
 		return res;
 	}
 
+	if ((ad7779_common.ring.state == NULL) && (ring_init() < 0)) {
+		/* Not fatal, clients can still use read() per buffer */
+		log_error("failed to allocate ring state");
+	}
+
 	if ((res = dev_init()) < 0) {
 		log_error("device initialization failed");
 		sai_free();
@@ -588,6 +931,10 @@ int main(int argc, char *argv[])
 		log_error("conditional resource creation failed");
 		return 1;
 	}
+	if (condCreate(&ad7779_common.cfg.cond) != EOK) {
+		log_error("conditional resource creation failed");
+		return 1;
+	}
 
 	if (beginthread(read_thr, ad7779_common.prio, ad7779_common.async.stack, sizeof(ad7779_common.async.stack), NULL) < 0) {
 		log_error("read_thr startup failed");
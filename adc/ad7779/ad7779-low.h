@@ -37,6 +37,10 @@ void dma_disable(void);
 int dma_read(void *data, size_t len);
 
 
+/* Number of completed buffers as of last dma_read() */
+uint32_t dma_count(void);
+
+
 /* SAI api */
 int sai_init(void);
 
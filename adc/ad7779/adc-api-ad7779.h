@@ -39,9 +39,37 @@ typedef enum {
 	adc_dev_ctl__set_channel_config,
 	adc_dev_ctl__get_channel_config,
 	adc_dev_ctl__set_dout_drive_str,
-	adc_dev_ctl__get_dout_drive_str
+	adc_dev_ctl__get_dout_drive_str,
+	adc_dev_ctl__get_ring
 } adc_dev_ctl_type_t;
 
+#define ADC_RING_MAX_BUFS               (16)
+
+/* read() reply when called with sizeof(adc_read_t) buffer (driver with async requests support).
+ * Each client (process) has its own cursor, consecutive reads return consecutive buffers
+ * as long as they were not overwritten, a 4-byte read returns the DMA interrupt counter. */
+typedef struct {
+	uint32_t seq;    /* Buffer sequence number (adc_ring_t head after it completed), index is (seq - 1) % num */
+	uint32_t missed; /* Buffers overwritten before this client read them, since its previous read */
+} adc_read_t;
+
+/* Buffer ring state, shared page (adc_dev_ctl__get_ring) updated by the driver on each read.
+ * (head - tail) buffers starting at tail % num are ready, the consumer advances tail after processing.
+ * Buffer head % num is being filled by DMA, so at most num - 1 buffers may be held. */
+typedef struct {
+	volatile uint32_t head;      /* Buffers completed since driver start */
+	volatile uint32_t tail;      /* Buffers released by the consumer (written by the consumer) */
+	volatile uint32_t overrun;   /* Buffers overwritten before the consumer released them */
+	uint32_t num;                /* Number of buffers */
+	uint32_t size;               /* Single buffer size in bytes */
+	volatile uint32_t period_us; /* Time to fill one buffer at current sampling rate */
+	volatile uint64_t ts[ADC_RING_MAX_BUFS]; /* Buffer completion time (us, gettime), estimated from period_us
+	                                          * for buffers completed while nobody was reading */
+	volatile uint32_t cfg_gen; /* Number of configuration changes applied while acquisition was running */
+	volatile uint32_t cfg_seq; /* seq of the first buffer captured entirely with the configuration of cfg_gen,
+	                            * buffers since the previous change up to cfg_seq - 1 may hold samples of both */
+} adc_ring_t;
+
 typedef struct {
 	adc_dev_ctl_type_t type;
 
@@ -98,6 +126,12 @@ typedef struct {
 
 		/* DOUT pin drive strength */
 		uint8_t dout_drive_str;
+
+		/* ring state page */
+		struct {
+			addr_t paddr;
+			size_t size;
+		} ring;
 	};
 } adc_dev_ctl_t;
 
@@ -24,6 +24,7 @@ static struct {
 	} buffer;
 	sdma_buffer_desc_t *bd;
 	addr_t bd_phys_addr;
+	uint32_t cnt;
 } sdma_common;
 
 
@@ -159,16 +160,28 @@ void dma_disable(void)
 
 int dma_read(void *data, size_t len)
 {
+	uint32_t cnt;
+
 	if (data != NULL && len != sizeof(unsigned))
 		return -EIO;
 
-	if (sdma_wait_for_intr(&sdma_common.sdma, data) < 0)
+	if (sdma_wait_for_intr(&sdma_common.sdma, &cnt) < 0)
 		return -EIO;
 
+	sdma_common.cnt = cnt;
+	if (data != NULL)
+		memcpy(data, &cnt, sizeof(cnt));
+
 	return EOK;
 }
 
 
+uint32_t dma_count(void)
+{
+	return sdma_common.cnt;
+}
+
+
 int dma_init(size_t size, size_t count, addr_t *phys_addr)
 {
 	if (sdma_init(size, count, phys_addr) < 0) {
@@ -190,6 +190,12 @@ int dma_read(void *data, size_t len)
 }
 
 
+uint32_t dma_count(void)
+{
+	return edma_common.irq.cnt;
+}
+
+
 void dma_free(void)
 {
 	free_uncached(edma_common.buffer.ptr, edma_common.buffer.size * edma_common.buffer.count);
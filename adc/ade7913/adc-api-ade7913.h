@@ -21,6 +21,22 @@
 
 #define ADC_DEVICE_FILE_NAME "/dev/ade7913"
 
+#define ADE7913_RING_MAX_BUFS   16
+#define ADE7913_FRAME_INVALID   0xffffffffu
+
+/* Buffer ring state, shared page (ade7913_dev_ctl__get_ring) updated on each eDMA major loop.
+ * Frames seq - num + 1 ... seq - 1 may be read, buffer i holds frame[i] (ADE7913_FRAME_INVALID if
+ * its data was corrupted). Frame numbers skipped on desync are never produced and counted in lost.
+ * A buffer is reused after num - 1 further frames, re-check frame[buf] after copying the data out. */
+typedef struct {
+	volatile uint32_t seq;     /* Next frame number (frames produced and skipped since driver start) */
+	volatile uint32_t notsync; /* Desync events (TCD realigned after EFT/burst) */
+	volatile uint32_t lost;    /* Frame numbers skipped because of desync */
+	uint32_t num;              /* Number of buffers */
+	uint32_t size;             /* Single buffer size in bytes */
+	volatile uint32_t frame[ADE7913_RING_MAX_BUFS]; /* Frame number stored in buffer */
+} ade7913_ring_t;
+
 
 typedef struct {
 	enum {
@@ -33,6 +49,10 @@ typedef struct {
 		ade7913_dev_ctl__get_buffers,
 		ade7913_dev_ctl__pwr_off,
 		ade7913_dev_ctl__pwr_on,
+		ade7913_dev_ctl__get_ring,
+		ade7913_dev_ctl__wait_frame,
+		ade7913_dev_ctl__set_geometry,
+		ade7913_dev_ctl__get_geometry,
 	} type;
 
 	union {
@@ -49,6 +69,29 @@ typedef struct {
 			uint8_t devices;
 			uint8_t bits;
 		} config;
+
+		/* ring state page */
+		struct {
+			addr_t paddr;
+			size_t size;
+		} ring;
+
+		/* buffer ring geometry, set only while capture is disabled, buffers are re-allocated
+		 * (query ade7913_dev_ctl__get_buffers again), 0 keeps the current value */
+		struct {
+			uint32_t num;        /* in/out: number of buffers, power of 2, 2 to ADE7913_RING_MAX_BUFS */
+			uint32_t size;       /* in/out: single buffer size in bytes, multiple of devices * 16, max 2044 */
+			uint32_t latency_us; /* out: time to fill one buffer at the current sampling rate */
+			uint32_t irq_rate;   /* out: buffer interrupts per second (rounded down) */
+		} geometry;
+
+		/* wait for frame */
+		struct {
+			uint32_t seq;     /* in: first wanted frame, out: returned frame */
+			uint32_t buf;     /* out: buffer holding the frame */
+			uint32_t lost;    /* out: frames skipped between requested and returned */
+			uint32_t notsync; /* out: desync events since driver start */
+		} frame;
 	};
 } ade7913_dev_ctl_t;
 
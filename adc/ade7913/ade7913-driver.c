@@ -27,6 +27,7 @@
 #include <phoenix/arch/armv7m/imxrt/11xx/imxrt1170.h>
 
 #include <edma.h>
+#include <perfcnt.h>
 
 #include "ade7913.h"
 #include "adc-api-ade7913.h"
@@ -80,7 +81,8 @@
 #define ADE7913_PRIO 4
 #endif
 
-/* ADE7913_BUF_NUM - number of dma buffers, needs to be power of two */
+/* ADE7913_BUF_NUM - default number of dma buffers, needs to be power of two,
+ * geometry can be changed at runtime (ade7913_dev_ctl__set_geometry) */
 #ifndef ADE7913_BUF_NUM
 #define ADE7913_BUF_NUM 4
 #endif
@@ -91,11 +93,17 @@
  * so that in each filled buffer there will be same amount
  * of samples for each device.
  *
- * Single buffer len can't exceed 0x200 * sizeof(uint32_t) = 2048
+ * Single buffer len can't exceed 0x1ff * sizeof(uint32_t) = 2044
  * (SPI_RCV TCD `biter_elinkyes` can hold only 9-bit minor loop cnt)
  */
-#define ADC_BUFFER_SIZE (1920 * (ADE7913_BUF_NUM))
-_Static_assert((ADC_BUFFER_SIZE / ADE7913_BUF_NUM) <= (0x200 * sizeof(uint64_t)), "Single buffer size too large for SPI_RCV TCD");
+#ifndef ADE7913_BUF_SIZE
+#define ADE7913_BUF_SIZE 1920
+#endif
+
+#define BUF_MAX_SIZE (0x1ff * sizeof(uint32_t))
+
+_Static_assert(ADE7913_BUF_SIZE <= BUF_MAX_SIZE, "Single buffer size too large for SPI_RCV TCD");
+_Static_assert(ADE7913_BUF_NUM <= ADE7913_RING_MAX_BUFS, "Too many buffers for ring state");
 
 #define DREADY_DMA_CHANNEL  5
 #define SPI_RCV_DMA_CHANNEL 6
@@ -136,8 +144,8 @@ static const int spi_clk[] = { pctl_clk_lpspi1, pctl_clk_lpspi2, pctl_clk_lpspi3
 /* `04` triggers SPI read in Burst Mode, we need to keep SCLK running for next 14 bytes, (000000) would trigger ADE reset */
 static const uint32_t adc_read_cmd_lookup[4] = { 0xFFFFFF04, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF };
 
-_Static_assert(((ADC_BUFFER_SIZE / ADE7913_BUF_NUM) % (4 * sizeof(adc_read_cmd_lookup)) == 0), "Buffer size won't support 4 devices");
-_Static_assert(((ADC_BUFFER_SIZE / ADE7913_BUF_NUM) % (3 * sizeof(adc_read_cmd_lookup)) == 0), "Buffer size won't support 3 devices");
+_Static_assert((ADE7913_BUF_SIZE % (4 * sizeof(adc_read_cmd_lookup)) == 0), "Buffer size won't support 4 devices");
+_Static_assert((ADE7913_BUF_SIZE % (3 * sizeof(adc_read_cmd_lookup)) == 0), "Buffer size won't support 3 devices");
 /* divisible by 2 and 1 from the checks above */
 
 static uint32_t spi_write_cmd_lookup[4] = {
@@ -164,15 +172,21 @@ struct {
 	volatile struct edma_tcd_s *tcd_spircv_ptr;
 	volatile struct edma_tcd_s *tcd_seq_ptr;
 
-	volatile struct edma_tcd_s tcds[5 + 4 * 4 + ADE7913_BUF_NUM];
+	volatile struct edma_tcd_s tcds[5 + 4 * 4 + ADE7913_RING_MAX_BUFS];
 	volatile uint32_t edma_transfers;
 	addr_t buffer_paddr;
+	uint32_t buf_num;  /* Number of buffers, power of 2 */
+	uint32_t buf_size; /* Single buffer size in bytes */
+
+	ade7913_ring_t *ring;
+	addr_t ring_paddr;
 
 	handle_t edma_spi_rcv_cond, edma_spi_rcv_lock, edma_spi_ch_handle;
 	handle_t dready_cond;
 	oid_t oid;
 
 	int enabled;
+	int dma_running;
 
 #if DEBUG_NOTSYNC
 	volatile uint32_t edma_error;
@@ -183,12 +197,34 @@ struct {
 } common;
 
 
+PERFCNT_COUNTER(perf_frames, "ade7913.frames");
+PERFCNT_COUNTER(perf_notsync, "ade7913.notsync");
+PERFCNT_HISTOGRAM(perf_lost, "ade7913.lost");
+PERFCNT_COUNTER(perf_dreadyErr, "ade7913.dready_err");
+
+
+static size_t buffers_mapsize(uint32_t num, uint32_t size)
+{
+	return (num * size + _PAGE_SIZE - 1) / _PAGE_SIZE * _PAGE_SIZE;
+}
+
+
+static void ring_invalidate(void)
+{
+	int i;
+
+	for (i = 0; i < common.buf_num; ++i) {
+		common.ring->frame[i] = ADE7913_FRAME_INVALID;
+	}
+}
+
+
 static int edma_spi_rcv_irq_handler(unsigned int n, void *arg)
 {
 #if DEBUG_NOTSYNC
 	struct edma_tcd_s tcd;
 #endif /* DEBUG_NOTSYNC */
-	uint32_t reg, mux_copy[4];
+	uint32_t reg, prev, mux_copy[4];
 	int i, notsync = 0;
 
 	/*
@@ -238,7 +274,13 @@ static int edma_spi_rcv_irq_handler(unsigned int n, void *arg)
 #endif
 
 	if (notsync == 0) {
+		/* Buffer filled by this major loop, frame number is published before seq */
+		common.ring->frame[common.edma_transfers & (common.buf_num - 1)] = common.ring->seq;
+		__sync_synchronize();
+		++common.ring->seq;
+
 		++common.edma_transfers;
+		PERFCNT_INC(perf_frames);
 	}
 	else {
 #if DEBUG_NOTSYNC
@@ -255,9 +297,20 @@ static int edma_spi_rcv_irq_handler(unsigned int n, void *arg)
 		edma_channel_enable(SPI_RCV_DMA_CHANNEL);
 
 		/* adjust edma_transfers to be monotonic and point to next buf_num `0` */
-		/* WARN: if ADE7913_BUF_NUM is not a power of 2, change second line to edma_transfers -= edma_transfers % ADE7913_BUF_NUM */
-		common.edma_transfers += ADE7913_BUF_NUM;
-		common.edma_transfers &= ~(ADE7913_BUF_NUM - 1);
+		/* WARN: if buf_num is not a power of 2, change second line to edma_transfers -= edma_transfers % buf_num */
+		prev = common.edma_transfers;
+		common.edma_transfers += common.buf_num;
+		common.edma_transfers &= ~(common.buf_num - 1);
+
+		/* Shifted TCD could have written anywhere in the ring, frames up to the realigned position are lost */
+		ring_invalidate();
+		++common.ring->notsync;
+		common.ring->lost += common.edma_transfers - prev;
+		__sync_synchronize();
+		common.ring->seq += common.edma_transfers - prev;
+
+		PERFCNT_INC(perf_notsync);
+		PERFCNT_SAMPLE(perf_lost, common.edma_transfers - prev);
 	}
 
 	edma_clear_interrupt(SPI_RCV_DMA_CHANNEL);
@@ -273,6 +326,7 @@ static int edma_error_handler(unsigned int n, void *arg)
 	if (edma_error_channel() & mask) {
 		edma_clear_error(DREADY_DMA_CHANNEL);
 		edma_channel_enable(DREADY_DMA_CHANNEL);
+		PERFCNT_INC(perf_dreadyErr);
 #if DEBUG_NOTSYNC
 		common.edma_error = 1;
 #endif /* DEBUG_NOTSYNC */
@@ -530,6 +584,8 @@ static int adc_init(int hard)
 
 static void dma_stop(void)
 {
+	common.dma_running = 0;
+
 	/* Disable SPI eDMA receive request */
 	*(common.spi_ptr + spi_der) &= ~(1 << 1);
 
@@ -561,6 +617,8 @@ static void dma_start(void)
 
 	/* Enable SPI eDMA receive request */
 	*(common.spi_ptr + spi_der) |= (1 << 1);
+
+	common.dma_running = 1;
 }
 
 
@@ -635,17 +693,17 @@ static int dma_setup_tcds(void)
 	common.tcds[5].nbytes_mlnoffno = sizeof(uint32_t);
 	common.tcds[5].attr = (edma_get_tcd_attr_xsize(sizeof(uint32_t)) << 8) | edma_get_tcd_attr_xsize(sizeof(uint32_t));
 
-	common.tcds[5].biter_elinkyes = ADC_BUFFER_SIZE / common.tcds[5].nbytes_mlnoffno / (ADE7913_BUF_NUM);
+	common.tcds[5].biter_elinkyes = common.buf_size / common.tcds[5].nbytes_mlnoffno;
 	common.tcds[5].biter_elinkyes &= ~E_LINK_CH(0xff);
 	common.tcds[5].biter_elinkyes |= E_LINK_CH(SEQ_DMA_CHANNEL);
 	common.tcds[5].citer_elinkyes = common.tcds[5].biter_elinkyes;
 	common.tcds[5].csr = TCD_CSR_INTMAJOR_BIT | TCD_CSR_ESG_BIT | TCD_CSR_MAJORLINK_CH(SEQ_DMA_CHANNEL);
 
 	/* Clone SPI receive buffer setup and make it a ring buffer */
-	for (i = 1; i < ADE7913_BUF_NUM; ++i) {
+	for (i = 1; i < common.buf_num; ++i) {
 		edma_copy_tcd(&common.tcds[5 + i], &common.tcds[5]);
-		common.tcds[5 + i].daddr = (uint32_t)common.buff + i * ADC_BUFFER_SIZE / (ADE7913_BUF_NUM);
-		common.tcds[5 + i].dlast_sga = (uint32_t)&common.tcds[5 + ((i + 1) % (ADE7913_BUF_NUM))];
+		common.tcds[5 + i].daddr = (uint32_t)common.buff + i * common.buf_size;
+		common.tcds[5 + i].dlast_sga = (uint32_t)&common.tcds[5 + ((i + 1) % common.buf_num)];
 	}
 
 	/* Create chip-select sequencer triggered by /DREADY signal
@@ -666,7 +724,7 @@ static int dma_setup_tcds(void)
 	 * 4. After every minor loop iteration of SPI_RCV channel (4 bytes received) trigger SEQ_DMA_CHANNEL
 	 * 5. Every 4th SEQ_DMA_CHANNEL trigger (4 * 4 bytes received) will trigger DREADY_DMA_CHANNEL (move to next CS)
 	 *
-	 * 6. SPI_RCV_CHANNEL: every time (ADC_BUFFER_SIZE / ADE7913_BUF_NUM) bytes are read (major loop iteration) - trigger interrupt and to ADC SYNC in IRQ
+	 * 6. SPI_RCV_CHANNEL: every time buf_size bytes are read (major loop iteration) - trigger interrupt and to ADC SYNC in IRQ
 	 *
 	 */
 
@@ -705,6 +763,8 @@ static int dma_setup_tcds(void)
 	common.tcd_seq_ptr = &common.tcds[cs_seq];
 
 	common.edma_transfers = 0;
+	/* Frame numbers continue, old buffers contents are not valid anymore */
+	ring_invalidate();
 
 	res = edma_install_tcd(common.tcd_dready_ptr, DREADY_DMA_CHANNEL);
 	if (res != 0) {
@@ -736,7 +796,7 @@ int restart_sampling(void)
 
 	dma_stop();
 
-	memset(common.buff, 0, ADC_BUFFER_SIZE);
+	memset(common.buff, 0, common.buf_num * common.buf_size);
 
 	res = spi_init(&common.ade7913_spi, common.spi);
 	if (res < 0) {
@@ -781,7 +841,10 @@ static void edma_destroy(void)
 		resourceDestroy(common.edma_spi_rcv_lock);
 	}
 	if (common.buff != MAP_FAILED) {
-		munmap(common.buff, (ADC_BUFFER_SIZE + _PAGE_SIZE - 1) / _PAGE_SIZE * _PAGE_SIZE);
+		munmap(common.buff, buffers_mapsize(common.buf_num, common.buf_size));
+	}
+	if (common.ring != MAP_FAILED) {
+		munmap(common.ring, _PAGE_SIZE);
 	}
 }
 
@@ -795,6 +858,7 @@ static int edma_configure(void)
 	common.edma_spi_rcv_cond = (handle_t)-1;
 	common.dready_cond = (handle_t)-1;
 	common.buff = MAP_FAILED;
+	common.ring = MAP_FAILED;
 
 	res = edma_init(edma_error_handler);
 	if (res < 0) {
@@ -820,7 +884,9 @@ static int edma_configure(void)
 		return res;
 	}
 
-	common.buff = mmap(NULL, (ADC_BUFFER_SIZE + _PAGE_SIZE - 1) / _PAGE_SIZE * _PAGE_SIZE,
+	common.buf_num = ADE7913_BUF_NUM;
+	common.buf_size = ADE7913_BUF_SIZE;
+	common.buff = mmap(NULL, buffers_mapsize(common.buf_num, common.buf_size),
 		PROT_READ | PROT_WRITE, MAP_UNCACHED | MAP_ANONYMOUS, -1, common.buffer_paddr);
 
 	if (common.buff == MAP_FAILED) {
@@ -828,9 +894,20 @@ static int edma_configure(void)
 		return -ENOMEM;
 	}
 
-	memset(common.buff, 0, ADC_BUFFER_SIZE);
+	memset(common.buff, 0, common.buf_num * common.buf_size);
 	common.buffer_paddr = va2pa(common.buff);
 
+	common.ring = mmap(NULL, _PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_UNCACHED | MAP_ANONYMOUS, -1, 0);
+	if (common.ring == MAP_FAILED) {
+		log_error("Ring state allocation failed");
+		return -ENOMEM;
+	}
+
+	memset(common.ring, 0, sizeof(*common.ring));
+	common.ring->num = common.buf_num;
+	common.ring->size = common.buf_size;
+	common.ring_paddr = va2pa(common.ring);
+
 	/* Set request commands order */
 	for (i = 0; i < common.devcnt; ++i) {
 		devnum = (int)(common.order[i] - '0');
@@ -915,6 +992,138 @@ static int dev_read(void *data, size_t size)
 }
 
 
+/* Returns the oldest complete frame not older than *seq, waits if there is none yet */
+static int dev_wait_frame(uint32_t *seq, uint32_t *buf, uint32_t *lost)
+{
+	uint32_t head, frame, best = 0;
+	int i, found, res = EOK;
+
+	mutexLock(common.edma_spi_rcv_lock);
+	for (;;) {
+		head = common.ring->seq;
+		found = -1;
+
+		/* Buffer with frame head - num is being filled by DMA */
+		for (i = 0; i < common.buf_num; ++i) {
+			frame = common.ring->frame[i];
+			if ((frame == ADE7913_FRAME_INVALID) || (head - frame - 1 >= common.buf_num - 1) || ((int32_t)(frame - *seq) < 0)) {
+				continue;
+			}
+
+			if ((found < 0) || ((int32_t)(frame - best) < 0)) {
+				best = frame;
+				found = i;
+			}
+		}
+
+		if (found >= 0) {
+			break;
+		}
+
+		res = condWait(common.edma_spi_rcv_cond, common.edma_spi_rcv_lock, 1000000);
+		if (res < 0) {
+			break;
+		}
+	}
+	mutexUnlock(common.edma_spi_rcv_lock);
+
+	if (res < 0) {
+		return res;
+	}
+
+	*lost = best - *seq;
+	*seq = best;
+	*buf = (uint32_t)found;
+
+	return EOK;
+}
+
+
+static int dev_get_geometry(ade7913_dev_ctl_t *dev_ctl)
+{
+	uint32_t frames;
+	int rate;
+
+	if (ade7913_get_sampling_rate(&common.ade7913_spi, (int)(common.order[0] - '0'), &rate) < 0) {
+		return -EIO;
+	}
+
+	/* Each /DREADY produces one burst read record per device */
+	frames = common.buf_size / (common.devcnt * sizeof(adc_read_cmd_lookup));
+
+	dev_ctl->geometry.num = common.buf_num;
+	dev_ctl->geometry.size = common.buf_size;
+	dev_ctl->geometry.latency_us = (uint32_t)((uint64_t)frames * 1000000 / rate);
+	dev_ctl->geometry.irq_rate = rate / frames;
+
+	return EOK;
+}
+
+
+/* Re-allocates the DMA ring, capture has to be stopped */
+static int dev_set_geometry(uint32_t num, uint32_t size)
+{
+	uint32_t *buff;
+	addr_t paddr;
+	int res;
+
+	if (num == 0) {
+		num = common.buf_num;
+	}
+	if (size == 0) {
+		size = common.buf_size;
+	}
+
+	/* Ring index is masked, at least one buffer has to be held by the reader while the other is filled */
+	if ((num < 2) || (num > ADE7913_RING_MAX_BUFS) || ((num & (num - 1)) != 0)) {
+		return -EINVAL;
+	}
+
+	if ((size == 0) || (size > BUF_MAX_SIZE) || ((size % (common.devcnt * sizeof(adc_read_cmd_lookup))) != 0)) {
+		return -EINVAL;
+	}
+
+	if (common.dma_running) {
+		return -EBUSY;
+	}
+
+	if ((num == common.buf_num) && (size == common.buf_size)) {
+		return EOK;
+	}
+
+	buff = mmap(NULL, buffers_mapsize(num, size), PROT_READ | PROT_WRITE, MAP_UNCACHED | MAP_ANONYMOUS, -1, 0);
+	if (buff == MAP_FAILED) {
+		return -ENOMEM;
+	}
+
+	memset(buff, 0, num * size);
+	paddr = va2pa(buff);
+
+	munmap(common.buff, buffers_mapsize(common.buf_num, common.buf_size));
+	common.buff = buff;
+	common.buffer_paddr = paddr;
+
+	mutexLock(common.edma_spi_rcv_lock);
+	/* Frames of the old geometry are gone, seq continues */
+	ring_invalidate();
+	common.buf_num = num;
+	common.buf_size = size;
+	common.ring->num = num;
+	common.ring->size = size;
+	mutexUnlock(common.edma_spi_rcv_lock);
+
+	res = dma_setup_tcds();
+	if (res < 0) {
+		log_error("Failed to setup DMA TCDs");
+		return res;
+	}
+
+	log_info("Buffers: %u x %u B", num, size);
+
+	return EOK;
+}
+
+
 static int dev_ctl(msg_t *msg)
 {
 	ade7913_dev_ctl_t dev_ctl;
@@ -978,8 +1187,40 @@ static int dev_ctl(msg_t *msg)
 
 		case ade7913_dev_ctl__get_buffers:
 			dev_ctl.buffers.paddr = common.buffer_paddr;
-			dev_ctl.buffers.num = ADE7913_BUF_NUM;
-			dev_ctl.buffers.size = ADC_BUFFER_SIZE;
+			dev_ctl.buffers.num = common.buf_num;
+			dev_ctl.buffers.size = common.buf_num * common.buf_size;
+			memcpy(msg->o.raw, &dev_ctl, sizeof(ade7913_dev_ctl_t));
+			return EOK;
+
+		case ade7913_dev_ctl__get_ring:
+			dev_ctl.ring.paddr = common.ring_paddr;
+			dev_ctl.ring.size = _PAGE_SIZE;
+			memcpy(msg->o.raw, &dev_ctl, sizeof(ade7913_dev_ctl_t));
+			return EOK;
+
+		case ade7913_dev_ctl__wait_frame:
+			res = dev_wait_frame(&dev_ctl.frame.seq, &dev_ctl.frame.buf, &dev_ctl.frame.lost);
+			if (res < 0) {
+				return res;
+			}
+
+			dev_ctl.frame.notsync = common.ring->notsync;
+			memcpy(msg->o.raw, &dev_ctl, sizeof(ade7913_dev_ctl_t));
+			return EOK;
+
+		case ade7913_dev_ctl__set_geometry:
+			res = dev_set_geometry(dev_ctl.geometry.num, dev_ctl.geometry.size);
+			if (res < 0) {
+				return res;
+			}
+			/* fall-through */
+
+		case ade7913_dev_ctl__get_geometry:
+			res = dev_get_geometry(&dev_ctl);
+			if (res < 0) {
+				return res;
+			}
+
 			memcpy(msg->o.raw, &dev_ctl, sizeof(ade7913_dev_ctl_t));
 			return EOK;
 
@@ -1034,6 +1275,9 @@ static int msg_loop(void)
 				break;
 
 			case mtDevCtl:
+				if (perfcnt_devctl(&msg) == 0) {
+					break;
+				}
 				msg.o.err = dev_ctl(&msg);
 				break;
 
@@ -1053,6 +1297,11 @@ static int init(void)
 {
 	int res;
 
+	PERFCNT_REGISTER(perf_frames);
+	PERFCNT_REGISTER(perf_notsync);
+	PERFCNT_REGISTER(perf_lost);
+	PERFCNT_REGISTER(perf_dreadyErr);
+
 	do {
 		res = dev_init(ADC_DEVICE_FILE_NAME);
 		if (res < 0) {
@@ -0,0 +1,174 @@
+/*
+ * Phoenix-RTOS
+ *
+ * ADE7913 sample processing library
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ade7913-dsp.h"
+
+
+/*
+ * Records are read as aligned words (LPSPI byte swap keeps the stream order in memory),
+ * REV restores MSB first order and arithmetic shift sign-extends 24-bit samples.
+ * Samples are 24-bit so 16-bit SIMD lanes don't apply, products use SMULL/SMLAL.
+ */
+static inline void ade7913_dsp_decode(const uint32_t *rec, int32_t *iwv, int32_t *v1wv, int32_t *v2wv)
+{
+	uint32_t s0 = __builtin_bswap32(rec[0]);
+	uint32_t s1 = __builtin_bswap32(rec[1]);
+	uint32_t s2 = __builtin_bswap32(rec[2]);
+
+	*iwv = (int32_t)(s0 << 8) >> 8;
+	*v1wv = (int32_t)s1 >> 8;
+	*v2wv = (int32_t)((s1 << 24) | ((s2 >> 8) & 0x00ffff00u)) >> 8;
+}
+
+
+static inline int32_t ade7913_dsp_apply(int32_t x, const ade7913_dsp_cal_t *cal)
+{
+	return (int32_t)(((int64_t)(x + cal->offset) * cal->gain) >> 16);
+}
+
+
+static inline int ade7913_dsp_unpackCommon(const void *buf, size_t nframes, unsigned int devcnt, int32_t *const *out, const ade7913_dsp_cal_t *cal)
+{
+	const uint32_t *rec = buf;
+	int32_t smp[ADE7913_DSP_CHANNELS];
+	unsigned int dev, ch, idx;
+	size_t n;
+
+	if ((buf == NULL) || (out == NULL) || (devcnt == 0) || (devcnt > ADE7913_DSP_MAX_DEVICES) || (((uintptr_t)buf & 3) != 0)) {
+		return -EINVAL;
+	}
+
+	for (n = 0; n < nframes; n++) {
+		for (dev = 0; dev < devcnt; dev++) {
+			ade7913_dsp_decode(rec, &smp[ade7913_dsp_iwv], &smp[ade7913_dsp_v1wv], &smp[ade7913_dsp_v2wv]);
+			rec += ADE7913_DSP_RECORD_SIZE / sizeof(*rec);
+
+			for (ch = 0; ch < ADE7913_DSP_CHANNELS; ch++) {
+				idx = dev * ADE7913_DSP_CHANNELS + ch;
+				if (out[idx] != NULL) {
+					out[idx][n] = (cal != NULL) ? ade7913_dsp_apply(smp[ch], &cal[idx]) : smp[ch];
+				}
+			}
+		}
+	}
+
+	return 0;
+}
+
+
+int ade7913_dsp_unpack(const void *buf, size_t nframes, unsigned int devcnt, int32_t *const *out)
+{
+	return ade7913_dsp_unpackCommon(buf, nframes, devcnt, out, NULL);
+}
+
+
+int ade7913_dsp_unpack_cal(const void *buf, size_t nframes, unsigned int devcnt, int32_t *const *out, const ade7913_dsp_cal_t *cal)
+{
+	if (cal == NULL) {
+		return -EINVAL;
+	}
+
+	return ade7913_dsp_unpackCommon(buf, nframes, devcnt, out, cal);
+}
+
+
+void ade7913_dsp_scale(int32_t *samples, size_t n, const ade7913_dsp_cal_t *cal)
+{
+	size_t i;
+
+	/* Unrolled by 2 to keep both multipliers of the dual-issue pipeline busy */
+	for (i = 0; i + 1 < n; i += 2) {
+		samples[i] = ade7913_dsp_apply(samples[i], cal);
+		samples[i + 1] = ade7913_dsp_apply(samples[i + 1], cal);
+	}
+
+	if (i < n) {
+		samples[i] = ade7913_dsp_apply(samples[i], cal);
+	}
+}
+
+
+void ade7913_dsp_acc_rms(ade7913_dsp_acc_t *acc, const int32_t *samples, size_t n)
+{
+	int64_t sum0 = 0, sum1 = 0;
+	uint64_t sq0 = 0, sq1 = 0;
+	size_t i;
+
+	/* Independent accumulators avoid SMLAL dependency stalls */
+	for (i = 0; i + 1 < n; i += 2) {
+		sum0 += samples[i];
+		sum1 += samples[i + 1];
+		sq0 += (int64_t)samples[i] * samples[i];
+		sq1 += (int64_t)samples[i + 1] * samples[i + 1];
+	}
+
+	if (i < n) {
+		sum0 += samples[i];
+		sq0 += (int64_t)samples[i] * samples[i];
+	}
+
+	acc->sum += sum0 + sum1;
+	acc->sumsq += sq0 + sq1;
+	acc->count += n;
+}
+
+
+void ade7913_dsp_acc_energy(ade7913_dsp_acc_t *acc, const int32_t *v, const int32_t *i, size_t n)
+{
+	int64_t e0 = 0, e1 = 0;
+	size_t k;
+
+	for (k = 0; k + 1 < n; k += 2) {
+		e0 += (int64_t)v[k] * i[k];
+		e1 += (int64_t)v[k + 1] * i[k + 1];
+	}
+
+	if (k < n) {
+		e0 += (int64_t)v[k] * i[k];
+	}
+
+	acc->energy += e0 + e1;
+}
+
+
+uint32_t ade7913_dsp_rms(const ade7913_dsp_acc_t *acc)
+{
+	uint64_t val, res = 0, bit = (uint64_t)1 << 62;
+
+	if (acc->count == 0) {
+		return 0;
+	}
+
+	val = acc->sumsq / acc->count;
+
+	/* Integer square root */
+	while (bit > val) {
+		bit >>= 2;
+	}
+
+	while (bit != 0) {
+		if (val >= res + bit) {
+			val -= res + bit;
+			res = (res >> 1) + bit;
+		}
+		else {
+			res >>= 1;
+		}
+		bit >>= 2;
+	}
+
+	return (uint32_t)res;
+}
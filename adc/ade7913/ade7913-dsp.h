@@ -0,0 +1,92 @@
+/*
+ * Phoenix-RTOS
+ *
+ * ADE7913 sample processing library
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef ADE7913_DSP_H
+#define ADE7913_DSP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/*
+ * Driver buffers (ade7913_dev_ctl__get_buffers) hold consecutive frames, one per /DREADY,
+ * each frame is a 16-byte burst read record per device in chip select order:
+ * [0] command slot, [1-3] IWV, [4-6] V1WV, [7-9] V2WV (24-bit, MSB first),
+ * [10-11] ADC_CRC, [12] STATUS0, [13-14] CNT_SNAPSHOT, [15] unused
+ */
+#define ADE7913_DSP_RECORD_SIZE 16
+#define ADE7913_DSP_CHANNELS    3 /* IWV, V1WV, V2WV */
+#define ADE7913_DSP_MAX_DEVICES 4
+
+
+enum { ade7913_dsp_iwv = 0, ade7913_dsp_v1wv, ade7913_dsp_v2wv };
+
+
+/* Per channel calibration, y = ((x + offset) * gain) >> 16 */
+typedef struct {
+	int32_t offset;
+	int32_t gain; /* Q16.16, 0x10000 is unity */
+} ade7913_dsp_cal_t;
+
+
+/* Accumulator for RMS and energy, 64-bit sums of 24-bit full-scale products
+ * overflow after 2^16 samples, read and reset it at least once per that many samples */
+typedef struct {
+	int64_t sum;
+	uint64_t sumsq;
+	int64_t energy;
+	uint32_t count;
+} ade7913_dsp_acc_t;
+
+
+/* Returns number of frames in size bytes of buffer */
+static inline size_t ade7913_dsp_frames(size_t size, unsigned int devcnt)
+{
+	return size / (devcnt * ADE7913_DSP_RECORD_SIZE);
+}
+
+
+/* Deinterleaves and sign-extends samples of nframes frames, out[dev * ADE7913_DSP_CHANNELS + ch]
+ * receives channel ch of device dev (index in chip select order), NULL entries are skipped */
+extern int ade7913_dsp_unpack(const void *buf, size_t nframes, unsigned int devcnt, int32_t *const *out);
+
+
+/* Same as ade7913_dsp_unpack() with calibration cal[dev * ADE7913_DSP_CHANNELS + ch] applied */
+extern int ade7913_dsp_unpack_cal(const void *buf, size_t nframes, unsigned int devcnt, int32_t *const *out, const ade7913_dsp_cal_t *cal);
+
+
+/* Applies calibration to n samples in place */
+extern void ade7913_dsp_scale(int32_t *samples, size_t n, const ade7913_dsp_cal_t *cal);
+
+
+/* Adds n samples to sum and sum of squares */
+extern void ade7913_dsp_acc_rms(ade7913_dsp_acc_t *acc, const int32_t *samples, size_t n);
+
+
+/* Adds n products of voltage and current samples to energy */
+extern void ade7913_dsp_acc_energy(ade7913_dsp_acc_t *acc, const int32_t *v, const int32_t *i, size_t n);
+
+
+/* Returns RMS of accumulated samples (DC included) */
+extern uint32_t ade7913_dsp_rms(const ade7913_dsp_acc_t *acc);
+
+
+static inline void ade7913_dsp_acc_reset(ade7913_dsp_acc_t *acc)
+{
+	acc->sum = 0;
+	acc->sumsq = 0;
+	acc->energy = 0;
+	acc->count = 0;
+}
+
+
+#endif /* ADE7913_DSP_H */
@@ -20,12 +20,48 @@
 #include "zynqmp-can-if.h"
 #include "zynqmp-can-priv.h"
 
-int zynqmp_canSend(oid_t *oid, const zynqmp_canFrame *frames, uint8_t count, bool block, uint32_t *framesSent)
+int zynqmp_canOpen(oid_t *dev, oid_t *handle)
+{
+	msg_t msg = { 0 };
+	msg.type = mtOpen;
+	msg.oid = *dev;
+
+	int ret = msgSend(dev->port, &msg);
+	if (ret == 0) {
+		ret = msg.o.err;
+	}
+	if (ret < 0) {
+		return ret;
+	}
+
+	/* The driver returns the handle number, used as the object ID in further calls */
+	handle->port = dev->port;
+	handle->id = ret;
+
+	return 0;
+}
+
+int zynqmp_canClose(oid_t *handle)
+{
+	msg_t msg = { 0 };
+	msg.type = mtClose;
+	msg.oid = *handle;
+
+	int ret = msgSend(handle->port, &msg);
+	if (ret == 0) {
+		ret = msg.o.err;
+	}
+
+	return ret;
+}
+
+int zynqmp_canSend(oid_t *oid, const zynqmp_canFrame *frames, uint32_t count, bool block, uint32_t *framesSent)
 {
 	/* Allocate message on the stack */
 	msg_t msg = { 0 };
 	/* Use custom request type */
 	msg.type = mtDevCtl;
+	msg.oid = *oid;
 	/* Pass extra information about the request in the "raw" block */
 	zynqmp_canDriverReq *req = (zynqmp_canDriverReq *)msg.i.raw;
 	req->operation = zynqmp_canOpSend;
@@ -56,6 +92,7 @@ int zynqmp_canRecv(oid_t *oid, zynqmp_canFrame *buf, uint32_t bufLen, bool block
 	msg_t msg = { 0 };
 	/* Use custom request type */
 	msg.type = mtDevCtl;
+	msg.oid = *oid;
 	/* Pass extra information about the request in the "raw" block */
 	zynqmp_canDriverReq *req = (zynqmp_canDriverReq *)msg.i.raw;
 	req->operation = zynqmp_canOpRecv;
@@ -78,3 +115,64 @@ int zynqmp_canRecv(oid_t *oid, zynqmp_canFrame *buf, uint32_t bufLen, bool block
 
 	return ret;
 }
+
+int zynqmp_canSetFilter(oid_t *oid, uint8_t n, const zynqmp_canFilter *filter)
+{
+	msg_t msg = { 0 };
+	msg.type = mtDevCtl;
+	msg.oid = *oid;
+	zynqmp_canDriverReq *req = (zynqmp_canDriverReq *)msg.i.raw;
+	req->operation = zynqmp_canOpSetFilter;
+	req->filter = n;
+	/* No data disables the filter */
+	msg.i.data = (const void *)filter;
+	msg.i.size = (filter != NULL) ? sizeof(*filter) : 0;
+
+	int ret = msgSend(oid->port, &msg);
+	if (ret == 0) {
+		ret = msg.o.err;
+	}
+
+	return ret;
+}
+
+int zynqmp_canGetStats(oid_t *oid, zynqmp_canStats *stats)
+{
+	if (stats == NULL) {
+		return -EINVAL;
+	}
+
+	msg_t msg = { 0 };
+	msg.type = mtDevCtl;
+	msg.oid = *oid;
+	zynqmp_canDriverReq *req = (zynqmp_canDriverReq *)msg.i.raw;
+	req->operation = zynqmp_canOpGetStats;
+	msg.o.data = (void *)stats;
+	msg.o.size = sizeof(*stats);
+
+	int ret = msgSend(oid->port, &msg);
+	if (ret == 0) {
+		ret = msg.o.err;
+	}
+
+	return ret;
+}
+
+int zynqmp_canSetHandleFilter(oid_t *handle, const zynqmp_canFilter *filter)
+{
+	msg_t msg = { 0 };
+	msg.type = mtDevCtl;
+	msg.oid = *handle;
+	zynqmp_canDriverReq *req = (zynqmp_canDriverReq *)msg.i.raw;
+	req->operation = zynqmp_canOpSetHandleFilter;
+	/* No data removes the filter */
+	msg.i.data = (const void *)filter;
+	msg.i.size = (filter != NULL) ? sizeof(*filter) : 0;
+
+	int ret = msgSend(handle->port, &msg);
+	if (ret == 0) {
+		ret = msg.o.err;
+	}
+
+	return ret;
+}
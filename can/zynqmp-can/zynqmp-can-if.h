@@ -20,45 +20,105 @@
 /* Maximum possible CAN standard frame ID */
 #define ZYNQMP_CAN_ID_MAX (0x7ff)
 
+/* Maximum possible CAN extended frame ID */
+#define ZYNQMP_CAN_EXT_ID_MAX (0x1fffffff)
+
+/* Frame flags */
+#define ZYNQMP_CAN_FLAG_EXT    (1 << 0) /* Extended (29-bit) ID */
+#define ZYNQMP_CAN_FLAG_RTR    (1 << 1) /* Remote transmission request */
+#define ZYNQMP_CAN_FLAG_URGENT (1 << 2) /* TX only, send through the high priority TX buffer */
+
+/* Number of hardware acceptance filters */
+#define ZYNQMP_CAN_FILTERS (4)
+
 /* Structure used for passing CAN frames to and from the CAN driver */
 typedef struct {
-	uint16_t id;  /**< CAN 2.0 Standard ID [0x000 ... 0x7ff] */
-	uint16_t len; /**< CAN 2.0 Payload length [0 ... 8] */
+	uint32_t id;   /**< CAN 2.0 ID, standard [0x000 ... 0x7ff] or extended [0 ... 0x1fffffff] with ZYNQMP_CAN_FLAG_EXT */
+	uint8_t len;   /**< CAN 2.0 Payload length [0 ... 8] */
+	uint8_t flags; /**< Frame flags (ZYNQMP_CAN_FLAG_*) */
 	union {
 		uint8_t bytes[8];  /**< Payload represented as an array of bytes */
 		uint32_t words[2]; /**< Payload represented as an array of words */
 	} payload;             /**< CAN 2.0 Payload (up to 8 bytes) */
+	uint16_t timestamp;    /**< RX timestamp from the controller's free running 16-bit counter, ignored on TX */
 } zynqmp_canFrame;
 
+/* Acceptance filter, a frame passes when (frame.id & mask) == (id & mask) and its format matches */
+typedef struct {
+	uint32_t id;   /**< Filter ID */
+	uint32_t mask; /**< ID bits compared */
+	uint8_t flags; /**< ZYNQMP_CAN_FLAG_EXT to match extended frames, standard frames otherwise */
+} zynqmp_canFilter;
+
+/* Driver RX counters */
+typedef struct {
+	uint32_t rxFrames;         /**< Frames moved from the hardware RX FIFO to the RX ring */
+	uint32_t rxHwOverflows;    /**< Hardware RX FIFO overflow events (frames lost before reaching the ring) */
+	uint32_t rxRingOverflows;  /**< Frames dropped because the RX ring was full */
+	uint32_t rxQueueOverflows; /**< Frames dropped because the queue of the handle was full */
+} zynqmp_canStats;
+
+/**
+ * Open a receive handle
+ *
+ * Description: Each handle has its own receive queue and software filter, so independent clients
+ *              receive all frames passing their filters. Functions called with the device object
+ *              identifier (obtained with lookup) use a shared handle which receives all frames
+ *
+ * Parameters:
+ * - dev: Object identifier of the related device file (either /dev/can0 or /dev/can1)
+ * - handle: Pointer to store the object identifier of the handle, used in place of dev in other calls
+ *
+ * Return values:
+ * - 0: Operation successful
+ * - -ENFILE: No free handles
+ */
+int zynqmp_canOpen(oid_t *dev, oid_t *handle);
+
+/**
+ * Close a receive handle
+ *
+ * Parameters:
+ * - handle: Object identifier of the handle
+ *
+ * Return values:
+ * - 0: Operation successful
+ * - -ENOENT: Handle is not open
+ */
+int zynqmp_canClose(oid_t *handle);
+
 /**
  * Send CAN frames
  *
- * Description: This function attempts to flush the provided CAN frames into the 64 frame wide
- *              hardware TX FIFO buffer
+ * Description: This function queues the provided CAN frames in the driver's TX priority queue,
+ *              which refills the 64 frame wide hardware TX FIFO as it drains. Queued frames are sent
+ *              in bus arbitration order (lowest ID first), frames with the same ID in call order.
+ *              Frames flagged with ZYNQMP_CAN_FLAG_URGENT (or below the driver's -p ID limit) go
+ *              through the high priority TX buffer, bypassing the queue and the FIFO
  *
  * Parameters:
  * - oid: Object identifier of the related device file (either /dev/can0 or /dev/can1)
  * - frames: Pointer to an array of CAN frames to be sent
- * - count: Number of CAN frames in the provided array (accepts up to 64 frames)
+ * - count: Number of CAN frames in the provided array
  * - block: Determines whether the function will block if there is insufficient space in the TX FIFO
  * - framesSent: Pointer to store the number of frames sent (useful for non-blocking calls; can be NULL for blocking calls)
  *
  * Return values:
  * - 0: Operation successful
- * - -EINVAL: Invalid argument
- * - -EAGAIN: Blocking is disabled, and there is no space in the TX buffer
+ * - -EINVAL: Invalid argument (including a frame with an invalid ID or length)
+ * - -EAGAIN: Blocking is disabled, and there is no space in the TX queue
  */
-int zynqmp_canSend(oid_t *oid, const zynqmp_canFrame *frames, uint8_t count, bool block, uint32_t *framesSent);
+int zynqmp_canSend(oid_t *oid, const zynqmp_canFrame *frames, uint32_t count, bool block, uint32_t *framesSent);
 
 /**
  * Receive CAN frames
  *
- * Description: This function attempts to retrieve received CAN frames from the 64 frame wide
- *              hardware RX FIFO buffer. If the buffer is empty, it can block for the specified timeout,
- * 				or return immediately
+ * Description: This function attempts to retrieve received CAN frames from the queue of the handle,
+ *              which is filled from the 64 frame wide hardware RX FIFO on interrupt. If the queue is empty,
+ *              it can block for the specified timeout, or return immediately
  *
  * Parameters:
- * - oid: Object identifier of the related device file (either /dev/can0 or /dev/can1)
+ * - oid: Object identifier of the related device file or of a handle opened with zynqmp_canOpen
  * - buf: Pointer to the buffer where received frames will be stored
  * - bufLen: Length of the buffer (maximum number of CAN frames it can hold)
  * - block: Determines whether the function will block if there are no frames in RX buffer
@@ -69,7 +129,56 @@ int zynqmp_canSend(oid_t *oid, const zynqmp_canFrame *frames, uint8_t count, boo
  * - 0: Operation successful
  * - -ETIME: Timeout expired
  * - -EINVAL: Invalid argument
+ * - -ENOENT: Handle is not open
  */
 int zynqmp_canRecv(oid_t *oid, zynqmp_canFrame *buf, uint32_t bufLen, bool block, uint32_t timeoutUs, uint32_t *recvFrames);
 
+/**
+ * Configure an acceptance filter
+ *
+ * Description: Programs one of the hardware acceptance filters (AFMR/AFIR registers) and enables it in AFR.
+ *              A frame is stored when it matches any enabled filter, with all filters disabled every
+ *              frame is accepted. Hardware filters apply to all handles
+ *
+ * Parameters:
+ * - oid: Object identifier of the related device file (either /dev/can0 or /dev/can1)
+ * - n: Filter number [0 ... ZYNQMP_CAN_FILTERS - 1]
+ * - filter: Filter ID and mask, NULL disables the filter
+ *
+ * Return values:
+ * - 0: Operation successful
+ * - -EINVAL: Invalid argument
+ */
+int zynqmp_canSetFilter(oid_t *oid, uint8_t n, const zynqmp_canFilter *filter);
+
+/**
+ * Configure the software filter of a receive handle
+ *
+ * Description: Only frames passing the filter are put into the queue of the handle. Frames already
+ *              queued are dropped
+ *
+ * Parameters:
+ * - handle: Object identifier of the handle (or of the device file for the shared handle)
+ * - filter: Filter ID and mask, NULL makes the handle receive all frames
+ *
+ * Return values:
+ * - 0: Operation successful
+ * - -EINVAL: Invalid argument
+ * - -ENOENT: Handle is not open
+ */
+int zynqmp_canSetHandleFilter(oid_t *handle, const zynqmp_canFilter *filter);
+
+/**
+ * Read RX counters
+ *
+ * Parameters:
+ * - oid: Object identifier of the related device file or of a handle opened with zynqmp_canOpen
+ * - stats: Pointer to store the counters
+ *
+ * Return values:
+ * - 0: Operation successful
+ * - -EINVAL: Invalid argument
+ */
+int zynqmp_canGetStats(oid_t *oid, zynqmp_canStats *stats);
+
 #endif /* ZYNQMP_CAN_IF_H */
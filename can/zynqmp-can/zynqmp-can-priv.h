@@ -16,8 +16,11 @@
 
 /* Marker used in messages between the application and the server to distinguish operations */
 typedef enum {
-	zynqmp_canOpSend = 0, /**< Send CAN frames */
-	zynqmp_canOpRecv = 1, /**< Receive CAN frames */
+	zynqmp_canOpSend = 0,            /**< Send CAN frames */
+	zynqmp_canOpRecv = 1,            /**< Receive CAN frames */
+	zynqmp_canOpSetFilter = 2,       /**< Configure an acceptance filter */
+	zynqmp_canOpGetStats = 3,        /**< Read RX counters */
+	zynqmp_canOpSetHandleFilter = 4, /**< Configure the software filter of the receive handle */
 } zynqmp_canDriverOpCode;
 
 /* Information passed to the driver as a request */
@@ -25,6 +28,7 @@ typedef struct {
 	uint8_t operation;  /**< Operation code (see zynqmp_canDriverOpCode) */
 	uint8_t block;      /**< Boolean switch to enable or disable blocking behaviour */
 	uint32_t timeoutUs; /**< Timeout for the operation [microseconds] */
+	uint8_t filter;     /**< Acceptance filter number [0 ... 3] */
 } zynqmp_canDriverReq;
 
 /* Information returned by the driver */
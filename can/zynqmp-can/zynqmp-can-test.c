@@ -35,7 +35,7 @@ static struct {
 	uint8_t stack[_PAGE_SIZE] __attribute__((aligned(16)));
 	int run;                                   /**< flag to control the main loop */
 	handle_t mutex_stats_access;               /**< mutex for accessing frame statistics */
-	frameStats frame_stats[ZYNQMP_CAN_ID_MAX]; /**< Array to store statistics for each CAN ID */
+	frameStats frame_stats[ZYNQMP_CAN_ID_MAX + 1]; /**< Array to store statistics for each standard CAN ID */
 } common;
 
 /**
@@ -97,7 +97,7 @@ static void zynqmpCanTest_statsPrintThread(void *arg)
 		mutexLock(common.mutex_stats_access);
 
 		printf("   ID | Count | Frame content \n");
-		for (uint32_t i = 0; i < ZYNQMP_CAN_ID_MAX; i++) {
+		for (uint32_t i = 0; i <= ZYNQMP_CAN_ID_MAX; i++) {
 			if (common.frame_stats[i].receivedFramesCount != 0) {
 				printf("0x%3X |  %4i | ", i, common.frame_stats[i].receivedFramesCount);
 				zynqmpCanTest_decodeAndPrintFrame(&common.frame_stats[i].lastFrame);
@@ -204,8 +204,13 @@ static int zynqmpCanTest_SendNonBlocking(oid_t *oid)
 		return EXIT_FAILURE;
 	}
 
-	/* Send frames again using the whole buffer; it should fail to send all frames */
-	ret = zynqmp_canSend(oid, frames, (sizeof(frames) / sizeof(frames[0])), false, &framesSent);
+	/* Send frames again using the whole buffer until the driver TX queue fills up */
+	for (int i = 0; i < 16; i++) {
+		ret = zynqmp_canSend(oid, frames, (sizeof(frames) / sizeof(frames[0])), false, &framesSent);
+		if (ret != 0) {
+			break;
+		}
+	}
 	if (ret == -EAGAIN) {
 		printf("zynqmp-can-test: As expected, failed to send all frames, sent only %u frames\n", framesSent);
 		return EXIT_SUCCESS;
@@ -362,8 +367,11 @@ static int zynqmpCanTest_RecvLoop(oid_t *oid)
 			for (uint32_t i = 0; ((i < (sizeof(buf) / sizeof(buf[0]))) && (i < recv_frames)); i++) {
 				/* Access statistics data displayed by another thread */
 				mutexLock(common.mutex_stats_access);
-				/* Update statistics for all possible frames */
-				if (buf[i].id > ZYNQMP_CAN_ID_MAX) {
+				/* Update statistics for all possible standard frames */
+				if ((buf[i].flags & ZYNQMP_CAN_FLAG_EXT) != 0) {
+					/* Extended frames are not tracked */
+				}
+				else if (buf[i].id > ZYNQMP_CAN_ID_MAX) {
 					printf("zynqmp-can-test: Failed, CAN ID too large\n");
 				}
 				else {
@@ -384,6 +392,25 @@ static int zynqmpCanTest_RecvLoop(oid_t *oid)
 	return EXIT_SUCCESS;
 }
 
+/**
+ * Prints the driver RX counters.
+ */
+static int zynqmpCanTest_PrintStats(oid_t *oid)
+{
+	zynqmp_canStats stats;
+
+	int ret = zynqmp_canGetStats(oid, &stats);
+	if (ret != 0) {
+		printf("zynqmp-can-test: Failed to read statistics, error %i\n", ret);
+		return EXIT_FAILURE;
+	}
+
+	printf("rx frames: %u, hw fifo overflows: %u, ring overflows: %u\n",
+			stats.rxFrames, stats.rxHwOverflows, stats.rxRingOverflows);
+
+	return EXIT_SUCCESS;
+}
+
 /**
  * Main function to execute CAN test operations.
  */
@@ -425,6 +452,9 @@ int main(int argc, char **argv)
 	else if (strcmp("recvloop", argv[1]) == 0) {
 		return zynqmpCanTest_RecvLoop(&oid);
 	}
+	else if (strcmp("stats", argv[1]) == 0) {
+		return zynqmpCanTest_PrintStats(&oid);
+	}
 	else {
 		printf("Wrong command\n");
 		return EXIT_FAILURE;
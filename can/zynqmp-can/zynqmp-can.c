@@ -13,6 +13,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <unistd.h>
 #include <endian.h>
@@ -37,6 +38,39 @@
  */
 #define CAN_TX_FIFO_WATERMARK 4
 
+/**
+ * Size of the software RX ring (in frames, power of 2) filled from the interrupt handler.
+ * It has to absorb the traffic received between consecutive receive calls of the application.
+ */
+#ifndef CAN_RX_RING_SIZE
+#define CAN_RX_RING_SIZE 1024
+#endif
+
+/* Number of receive handles, handle 0 is used by clients which didn't open their own */
+#ifndef CAN_CLIENTS
+#define CAN_CLIENTS 8
+#endif
+
+/* Size of the per handle receive queue (in frames, power of 2) */
+#ifndef CAN_CLIENT_QUEUE_SIZE
+#define CAN_CLIENT_QUEUE_SIZE 256
+#endif
+
+/* Number of threads serving requests, blocking calls of one client don't stall the others */
+#ifndef CAN_SERVER_THREADS
+#define CAN_SERVER_THREADS 4
+#endif
+
+/* Size of the software TX priority queue (in frames) refilling the TX FIFO */
+#ifndef CAN_TX_QUEUE_SIZE
+#define CAN_TX_QUEUE_SIZE 256
+#endif
+
+/* Size of the queue for frames sent through the high priority TX buffer (in frames, power of 2) */
+#ifndef CAN_TX_URGENT_SIZE
+#define CAN_TX_URGENT_SIZE 16
+#endif
+
 /* Default CAN baud rate in kbps */
 #define CAN_BAUDRATE_KBPS_DEFAULT (1000)
 
@@ -84,13 +118,71 @@ typedef struct {
 	volatile uint32_t afir4;           /* Acceptance Filter 4 ID., Address offset: 0x80 */
 } can_periph_t;
 
+/* Interrupt status bits used by the driver */
+#define CAN_IXR_TXOK     (1 << 1)  /* Frame transmitted */
+#define CAN_IXR_RXOFLW   (1 << 6)  /* RX FIFO overflow */
+#define CAN_IXR_RXNEMP   (1 << 7)  /* RX FIFO not empty */
+#define CAN_IXR_TXFWMEMP (1 << 13) /* TX FIFO empty elements above watermark */
+#define CAN_IXR_TXFEMP   (1 << 14) /* TX FIFO empty */
+
+/* Status register bits used by the driver */
+#define CAN_SR_CONFIG (1 << 0)  /* Configuration mode */
+#define CAN_SR_TXBFLL (1 << 9)  /* High priority TX buffer full */
+#define CAN_SR_TXFLL  (1 << 10) /* TX FIFO full */
+#define CAN_SR_ACFBSY (1 << 11) /* Acceptance filter busy */
+
+/* Message object ID bits */
+#define CAN_ID_RTR (1 << 0)  /* Remote transmission request (extended frames) */
+#define CAN_ID_IDE (1 << 19) /* Identifier extension */
+#define CAN_ID_SRR (1 << 20) /* Substitute remote request, RTR for standard frames */
+
+/* Receive handle */
+typedef struct {
+	bool used;                                    /**< Handle is open */
+	bool filtered;                                /**< Software filter is set */
+	zynqmp_canFilter filter;                      /**< Software filter */
+	zynqmp_canFrame queue[CAN_CLIENT_QUEUE_SIZE]; /**< Frames waiting for the client */
+	uint32_t head;                                /**< Free running write index */
+	uint32_t tail;                                /**< Free running read index */
+	uint32_t overflows;                           /**< Frames dropped because the queue was full */
+} can_client_t;
+
+/* Entry of the TX priority queue */
+typedef struct {
+	uint32_t key;          /**< Encoded ID register value, lower wins arbitration on the bus */
+	uint32_t seq;          /**< Keeps the call order of frames with the same ID */
+	zynqmp_canFrame frame; /**< Queued frame */
+} can_txEntry_t;
+
 /* Data structure used by the driver */
 static struct {
 	volatile can_periph_t *base; /**< Pointer to the peripheral base address */
 	oid_t oid;                   /**< Object identifier for the related device file */
 	handle_t cond;               /**< Conditional variable for synchronizing interrupts */
+	handle_t evCond;             /**< Conditional variable broadcast to server threads after each interrupt */
 	handle_t inth;               /**< Interrupt handler object */
-	handle_t lock;               /**< Mutex used with the conditional variable for synchronization */
+	handle_t lock;               /**< Mutex used with the conditional variables for synchronization */
+
+	/* RX ring, written only by the interrupt handler (head) and read only under the lock (tail) */
+	zynqmp_canFrame rxRing[CAN_RX_RING_SIZE];
+	uint32_t rxHead;       /**< Free running write index */
+	uint32_t rxTail;       /**< Free running read index */
+	zynqmp_canStats stats; /**< RX counters, updated by the interrupt handler */
+
+	can_client_t clients[CAN_CLIENTS]; /**< Receive handles, protected by the lock */
+
+	/* TX queues, protected by the lock */
+	struct {
+		can_txEntry_t heap[CAN_TX_QUEUE_SIZE];      /**< Binary min-heap by arbitration priority */
+		uint32_t count;                             /**< Number of frames in the heap */
+		uint32_t seq;                               /**< Sequence number of the next queued frame */
+		zynqmp_canFrame urgent[CAN_TX_URGENT_SIZE]; /**< Frames for the high priority TX buffer */
+		uint32_t urgentHead;                        /**< Free running write index */
+		uint32_t urgentTail;                        /**< Free running read index */
+		int32_t urgentIdMax;                        /**< Standard IDs up to this value are urgent, -1 disables */
+	} tx;
+
+	uint8_t stacks[CAN_SERVER_THREADS][_PAGE_SIZE] __attribute__((aligned(16))); /**< Dispatcher and server threads stacks */
 } can;
 
 /* Immutable information about CAN peripheral instances */
@@ -132,6 +224,7 @@ static void zynqmpCan_CliHelp(const char *progname)
 		printf("%u (%s%%), ", timeCfg[i].baudrate_kbps, timeCfg[i].sample);
 	}
 	printf("\n");
+	printf("\t-p <id>        - Send standard frames with ID up to <id> through the high priority TX buffer\n");
 	printf("\t-h             - Print this message\n");
 }
 
@@ -197,27 +290,96 @@ static int zynqmpCan_resetPeriphal(int can_id)
 	return platformctl(&ctl);
 }
 
+/**
+ * Encodes a CAN ID into the message object ID register layout.
+ */
+static uint32_t zynqmpCan_encodeId(uint32_t id, uint8_t flags)
+{
+	if ((flags & ZYNQMP_CAN_FLAG_EXT) != 0) {
+		return (((id >> 18) & 0x7ff) << 21) | CAN_ID_SRR | CAN_ID_IDE | ((id & 0x3ffff) << 1) |
+				(((flags & ZYNQMP_CAN_FLAG_RTR) != 0) ? CAN_ID_RTR : 0);
+	}
+
+	return ((id & 0x7ff) << 21) | (((flags & ZYNQMP_CAN_FLAG_RTR) != 0) ? CAN_ID_SRR : 0);
+}
+
+/**
+ * Checks the frame ID and flags.
+ */
+static bool zynqmpCan_idValid(uint32_t id, uint8_t flags)
+{
+	return (id <= (((flags & ZYNQMP_CAN_FLAG_EXT) != 0) ? ZYNQMP_CAN_EXT_ID_MAX : ZYNQMP_CAN_ID_MAX));
+}
+
 /**
  * CAN interrupt handler.
- * Handles RX FIFO non-empty, TX FIFO empty, and TX FIFO watermark interrupts.
+ * Drains the hardware RX FIFO into the RX ring, handles TX FIFO empty and TX FIFO watermark interrupts.
  */
 static int zynqmpCan_irqHandler(unsigned int can_id, void *arg)
 {
 	uint32_t isr = can.base->isr;
+	uint32_t head, tail;
+
+	/* RX FIFO Non-empty IRQ occurred, move all frames to the RX ring */
+	if ((isr & CAN_IXR_RXNEMP) != 0) {
+		head = can.rxHead;
+		tail = __atomic_load_n(&can.rxTail, __ATOMIC_ACQUIRE);
+
+		do {
+			zynqmp_canFrame *frame = &can.rxRing[head & (CAN_RX_RING_SIZE - 1)];
+			uint32_t id = can.base->rxfifo_id;
+			uint32_t dlc = can.base->rxfifo_dlc;
+			uint32_t data1 = can.base->rxfifo_data1;
+			uint32_t data2 = can.base->rxfifo_data2;
+
+			/* Ring full, the frame is popped from the FIFO anyway to keep the interrupt from retriggering */
+			if ((head - tail) == CAN_RX_RING_SIZE) {
+				can.stats.rxRingOverflows++;
+			}
+			else {
+				if ((id & CAN_ID_IDE) != 0) {
+					frame->id = (((id >> 21) & 0x7ff) << 18) | ((id >> 1) & 0x3ffff);
+					frame->flags = ZYNQMP_CAN_FLAG_EXT | (((id & CAN_ID_RTR) != 0) ? ZYNQMP_CAN_FLAG_RTR : 0);
+				}
+				else {
+					frame->id = (id >> 21) & 0x7ff;
+					frame->flags = ((id & CAN_ID_SRR) != 0) ? ZYNQMP_CAN_FLAG_RTR : 0;
+				}
+				frame->len = (dlc >> 28) & 0xf;
+				frame->timestamp = dlc & 0xffff;
+				frame->payload.words[0] = be32toh(data1);
+				frame->payload.words[1] = be32toh(data2);
+				head++;
+				can.stats.rxFrames++;
+			}
+
+			/* Clears only if there is no more data in the FIFO */
+			can.base->icr = CAN_IXR_RXNEMP;
+		} while ((can.base->isr & CAN_IXR_RXNEMP) != 0);
+
+		__atomic_store_n(&can.rxHead, head, __ATOMIC_RELEASE);
+	}
+
+	/* RX FIFO overflow occurred, frames were lost in hardware */
+	if ((isr & CAN_IXR_RXOFLW) != 0) {
+		can.base->icr = CAN_IXR_RXOFLW;
+		can.stats.rxHwOverflows++;
+	}
 
-	/* RX FIFO Non-empty IRQ occurred */
-	if (isr & (1 << 7)) {
-		can.base->ier &= ~(1 << 7);
+	/* Frame transmitted, the high priority TX buffer might be free */
+	if ((isr & CAN_IXR_TXOK) != 0) {
+		can.base->icr = CAN_IXR_TXOK;
+		can.base->ier &= ~CAN_IXR_TXOK;
 	}
 
 	/* TX FIFO empty IRQ occurred */
-	if (isr & (1 << 14)) {
-		can.base->ier &= ~(1 << 14);
+	if ((isr & CAN_IXR_TXFEMP) != 0) {
+		can.base->ier &= ~CAN_IXR_TXFEMP;
 	}
 
 	/* TX FIFO empty elements above watermark IRQ occurred */
-	if (isr & (1 << 13)) {
-		can.base->ier &= ~(1 << 13);
+	if ((isr & CAN_IXR_TXFWMEMP) != 0) {
+		can.base->ier &= ~CAN_IXR_TXFWMEMP;
 	}
 
 	return 1;
@@ -268,6 +430,13 @@ static int zynqmpCan_init(unsigned int can_id, int baudrate)
 		resourceDestroy(can.cond);
 		return -1;
 	}
+	if (condCreate(&can.evCond) != 0) {
+		fprintf(stderr, "zynqmp-can: failed to create conditional variable\n");
+		munmap((void *)can.base, _PAGE_SIZE);
+		resourceDestroy(can.cond);
+		resourceDestroy(can.lock);
+		return -1;
+	}
 
 	/* Reset the CAN peripheral */
 	if (zynqmpCan_resetPeriphal(can_id) < 0) {
@@ -275,6 +444,7 @@ static int zynqmpCan_init(unsigned int can_id, int baudrate)
 		munmap((void *)can.base, _PAGE_SIZE);
 		resourceDestroy(can.cond);
 		resourceDestroy(can.lock);
+		resourceDestroy(can.evCond);
 		return -1;
 	}
 
@@ -285,6 +455,7 @@ static int zynqmpCan_init(unsigned int can_id, int baudrate)
 		munmap((void *)can.base, _PAGE_SIZE);
 		resourceDestroy(can.cond);
 		resourceDestroy(can.lock);
+		resourceDestroy(can.evCond);
 		return -1;
 	}
 #else
@@ -292,7 +463,7 @@ static int zynqmpCan_init(unsigned int can_id, int baudrate)
 #endif
 
 	/* Wait for configuration mode */
-	while ((can.base->sr & (1 << 0)) != 1) {
+	while ((can.base->sr & CAN_SR_CONFIG) == 0) {
 		usleep(100);
 	}
 
@@ -313,11 +484,14 @@ static int zynqmpCan_init(unsigned int can_id, int baudrate)
 		munmap((void *)can.base, _PAGE_SIZE);
 		resourceDestroy(can.cond);
 		resourceDestroy(can.lock);
+		resourceDestroy(can.evCond);
 		return -1;
 	}
 
-	/* Enable the controller */
+	/* Enable the controller, restart the RX timestamp counter and keep RX interrupts enabled */
 	can.base->srr = (1 << 1);
+	can.base->tcr = 1;
+	can.base->ier = CAN_IXR_RXNEMP | CAN_IXR_RXOFLW;
 
 	printf("zynqmp-can: Initialized CAN%u with baud rate: %u kbps, sample point: %s%%\n",
 			can_id,
@@ -328,8 +502,120 @@ static int zynqmpCan_init(unsigned int can_id, int baudrate)
 }
 
 /**
- * Sends CAN frames to the hardware TX FIFO.
- * Blocks if the FIFO is full and blocking is enabled.
+ * Writes a frame to the TX FIFO or to the high priority TX buffer registers.
+ */
+static void zynqmpCan_txWrite(volatile uint32_t *regs, const zynqmp_canFrame *frame)
+{
+	regs[0] = zynqmpCan_encodeId(frame->id, frame->flags);
+	regs[1] = (frame->len << 28);
+	regs[2] = be32toh(frame->payload.words[0]);
+	regs[3] = be32toh(frame->payload.words[1]);
+}
+
+/**
+ * Compares TX queue entries, returns true if a should be sent before b.
+ */
+static bool zynqmpCan_txBefore(const can_txEntry_t *a, const can_txEntry_t *b)
+{
+	if (a->key != b->key) {
+		return a->key < b->key;
+	}
+
+	return (int32_t)(a->seq - b->seq) < 0;
+}
+
+/**
+ * Adds a frame to the TX priority queue, which must not be full.
+ */
+static void zynqmpCan_txPush(const zynqmp_canFrame *frame)
+{
+	can_txEntry_t entry, *heap = can.tx.heap;
+	uint32_t i = can.tx.count++;
+
+	entry.key = zynqmpCan_encodeId(frame->id, frame->flags);
+	entry.seq = can.tx.seq++;
+	entry.frame = *frame;
+
+	while (i > 0) {
+		uint32_t parent = (i - 1) / 2;
+		if (!zynqmpCan_txBefore(&entry, &heap[parent])) {
+			break;
+		}
+		heap[i] = heap[parent];
+		i = parent;
+	}
+	heap[i] = entry;
+}
+
+/**
+ * Removes the first frame from the TX priority queue, which must not be empty.
+ */
+static void zynqmpCan_txPop(void)
+{
+	can_txEntry_t *heap = can.tx.heap;
+	can_txEntry_t *last = &heap[--can.tx.count];
+	uint32_t i = 0;
+
+	for (;;) {
+		uint32_t child = 2 * i + 1;
+		if (child >= can.tx.count) {
+			break;
+		}
+		if (((child + 1) < can.tx.count) && zynqmpCan_txBefore(&heap[child + 1], &heap[child])) {
+			child++;
+		}
+		if (!zynqmpCan_txBefore(&heap[child], last)) {
+			break;
+		}
+		heap[i] = heap[child];
+		i = child;
+	}
+	heap[i] = *last;
+}
+
+/**
+ * Moves queued frames to the hardware. Urgent frames go through the high priority TX buffer,
+ * which the controller transmits before the TX FIFO. Interrupts re-triggering the refill are
+ * enabled while frames are waiting. Must be called with the lock held.
+ */
+static void zynqmpCan_txRefill(void)
+{
+	while ((can.tx.urgentHead != can.tx.urgentTail) && ((can.base->sr & CAN_SR_TXBFLL) == 0)) {
+		zynqmpCan_txWrite(&can.base->txhpb_id, &can.tx.urgent[can.tx.urgentTail & (CAN_TX_URGENT_SIZE - 1)]);
+		can.tx.urgentTail++;
+	}
+	if (can.tx.urgentHead != can.tx.urgentTail) {
+		/* Clear and enable "Transmission OK" interrupt */
+		can.base->icr = CAN_IXR_TXOK;
+		can.base->ier |= CAN_IXR_TXOK;
+	}
+
+	while ((can.tx.count != 0) && ((can.base->sr & CAN_SR_TXFLL) == 0)) {
+		zynqmpCan_txWrite(&can.base->txfifo_id, &can.tx.heap[0].frame);
+		zynqmpCan_txPop();
+	}
+	if (can.tx.count != 0) {
+		/* Clear and enable "Transmit FIFO Watermark Empty" interrupt */
+		can.base->icr = CAN_IXR_TXFWMEMP;
+		can.base->ier |= CAN_IXR_TXFWMEMP;
+	}
+}
+
+/**
+ * Checks if the frame should be sent through the high priority TX buffer.
+ */
+static bool zynqmpCan_txUrgent(const zynqmp_canFrame *frame)
+{
+	if ((frame->flags & ZYNQMP_CAN_FLAG_URGENT) != 0) {
+		return true;
+	}
+
+	return ((frame->flags & ZYNQMP_CAN_FLAG_EXT) == 0) && ((int32_t)frame->id <= can.tx.urgentIdMax);
+}
+
+/**
+ * Queues CAN frames for transmission and moves them to the hardware as it frees up.
+ * Blocks if the software queue is full and blocking is enabled.
  */
 static int zynqmpCan_framesSent(zynqmp_canFrame *frames, uint32_t count, bool block, uint32_t *framesSent)
 {
@@ -337,49 +623,133 @@ static int zynqmpCan_framesSent(zynqmp_canFrame *frames, uint32_t count, bool bl
 	if (frames == NULL) {
 		return -EINVAL;
 	}
-	if ((count == 0) || (count > 64)) {
+	if (count == 0) {
 		return -EINVAL;
 	}
 
 	*framesSent = 0;
 
-	/* Flush all frames to the hardware TX FIFO */
 	for (uint32_t i = 0; i < count; i++) {
-		/* Check if TX FIFO is not full */
-		if ((can.base->sr & (1 << 10)) != 0) {
-			if (block) {
-				/* Wait for empty space in TX FIFO */
-				while ((can.base->sr & (1 << 10)) != 0) {
-					/* Clear and enable "Transmit FIFO Watermark Empty" interrupt */
-					can.base->icr = (1 << 13);
-					can.base->ier |= (1 << 13);
-					/* Wait for this interrupt to trigger */
-					condWait(can.cond, can.lock, 0);
-				}
+		bool urgent = zynqmpCan_txUrgent(&frames[i]);
+
+		if ((frames[i].len > 8) || !zynqmpCan_idValid(frames[i].id, frames[i].flags)) {
+			return -EINVAL;
+		}
+
+		/* Check if there is space in the queue */
+		for (bool refilled = false;; refilled = true) {
+			if (urgent && ((can.tx.urgentHead - can.tx.urgentTail) < CAN_TX_URGENT_SIZE)) {
+				break;
 			}
-			else {
-				/* Not enough space in the buffer */
+			if (!urgent && (can.tx.count < CAN_TX_QUEUE_SIZE)) {
+				break;
+			}
+			if (!refilled) {
+				/* Make room by moving frames queued so far to the hardware */
+				zynqmpCan_txRefill();
+				continue;
+			}
+			if (!block) {
+				/* Not enough space in the queue */
 				return -EAGAIN;
 			}
+			/* Wait for the dispatcher thread to refill the hardware */
+			condWait(can.evCond, can.lock, 0);
 		}
 
-		/* Write a single CAN frame into the hardware TX FIFO */
-		can.base->txfifo_id = (frames[i].id << 21);
-		can.base->txfifo_dlc = (frames[i].len << 28);
-		can.base->txfifo_data1 = be32toh(frames[i].payload.words[0]);
-		can.base->txfifo_data2 = be32toh(frames[i].payload.words[1]);
+		if (urgent) {
+			can.tx.urgent[can.tx.urgentHead & (CAN_TX_URGENT_SIZE - 1)] = frames[i];
+			can.tx.urgentHead++;
+		}
+		else {
+			zynqmpCan_txPush(&frames[i]);
+		}
 		(*framesSent)++;
+
+		/* Urgent frames are passed to the hardware immediately */
+		if (urgent) {
+			zynqmpCan_txRefill();
+		}
 	}
 
+	zynqmpCan_txRefill();
+
 	return 0;
 }
 
 /**
- * Receives CAN frames from the hardware RX FIFO.
- * Blocks if the FIFO is empty and a timeout is specified.
+ * Checks if the frame passes the software filter of the receive handle.
+ */
+static bool zynqmpCan_clientMatch(const can_client_t *client, const zynqmp_canFrame *frame)
+{
+	if (!client->filtered) {
+		return true;
+	}
+
+	if (((frame->flags ^ client->filter.flags) & ZYNQMP_CAN_FLAG_EXT) != 0) {
+		return false;
+	}
+
+	return (((frame->id ^ client->filter.id) & client->filter.mask) == 0);
+}
+
+/**
+ * Moves frames from the RX ring to the queues of all matching receive handles.
+ * Must be called with the lock held.
+ */
+static void zynqmpCan_dispatch(void)
+{
+	uint32_t head = __atomic_load_n(&can.rxHead, __ATOMIC_ACQUIRE);
+	uint32_t tail = can.rxTail;
+
+	for (; tail != head; tail++) {
+		const zynqmp_canFrame *frame = &can.rxRing[tail & (CAN_RX_RING_SIZE - 1)];
+
+		for (uint32_t i = 0; i < CAN_CLIENTS; i++) {
+			can_client_t *client = &can.clients[i];
+
+			if (!client->used || !zynqmpCan_clientMatch(client, frame)) {
+				continue;
+			}
+
+			if ((client->head - client->tail) == CAN_CLIENT_QUEUE_SIZE) {
+				client->overflows++;
+			}
+			else {
+				client->queue[client->head & (CAN_CLIENT_QUEUE_SIZE - 1)] = *frame;
+				client->head++;
+			}
+		}
+	}
+
+	__atomic_store_n(&can.rxTail, tail, __ATOMIC_RELEASE);
+}
+
+/**
+ * Dispatcher thread, the only waiter on the interrupt conditional variable.
+ * Distributes received frames, refills the TX hardware and wakes up server threads blocked in receive or send.
  */
-static int zynqmpCan_recvFrames(zynqmp_canFrame *buf, uint32_t bufLen, bool block, uint32_t timeoutUs, uint32_t *recvFrames)
+static void zynqmpCan_dispatchThread(void *arg)
 {
+	mutexLock(can.lock);
+
+	for (;;) {
+		/* Interrupts signaled while the thread is not waiting are not lost */
+		condWait(can.cond, can.lock, 0);
+		zynqmpCan_dispatch();
+		zynqmpCan_txRefill();
+		condBroadcast(can.evCond);
+	}
+}
+
+/**
+ * Receives CAN frames from the queue of the receive handle.
+ * Blocks if the queue is empty and blocking is enabled.
+ */
+static int zynqmpCan_recvFrames(can_client_t *client, zynqmp_canFrame *buf, uint32_t bufLen, bool block, uint32_t timeoutUs, uint32_t *recvFrames)
+{
+	time_t now, end = 0;
+
 	/* Validate arguments */
 	if ((buf == NULL) || (recvFrames == NULL)) {
 		return -EINVAL;
@@ -390,58 +760,240 @@ static int zynqmpCan_recvFrames(zynqmp_canFrame *buf, uint32_t bufLen, bool bloc
 
 	*recvFrames = 0;
 
-	/* Try clearing the interrupt (it will only clear if there is no data in FIFO) */
-	can.base->icr = (1 << 7);
-
-	/* If there is no data in RX FIFO then block if its desired */
-	if (((can.base->isr & (1 << 7)) == 0) && (block)) {
-		/* Wait for any data in RX FIFO */
-		while ((can.base->isr & (1 << 7)) == 0) {
-			/* Clear and enable "Receive FIFO Not Empty" interrupt */
-			can.base->icr = (1 << 7);
-			can.base->ier |= (1 << 7);
-			/* Wait for single "Receive FIFO Not Empty" IRQ */
-			int condRet = condWait(can.cond, can.lock, timeoutUs);
-			if (condRet == -ETIME) {
-				/* Timeout, disable "Receive FIFO Not Empty" interrupt */
-				can.base->ier &= ~(1 << 7);
-				return condRet;
-			}
-			else if (condRet == 0) {
-				/* Start reading frames */
-			}
-			else {
-				/* Unknown error, disable "Receive FIFO Not Empty" interrupt */
-				can.base->ier &= ~(1 << 7);
-				fprintf(stderr, "zynqmp-can: unknown condWait error %i\n", condRet);
-				return condRet;
+	/* Pick up frames the dispatcher thread hasn't processed yet */
+	zynqmpCan_dispatch();
+
+	if (timeoutUs != 0) {
+		gettime(&now, NULL);
+		end = now + timeoutUs;
+	}
+
+	/* If there is no data in the queue then block if its desired */
+	while ((client->head == client->tail) && (block)) {
+		time_t wait = 0;
+		if (timeoutUs != 0) {
+			gettime(&now, NULL);
+			if (now >= end) {
+				return -ETIME;
 			}
+			wait = end - now;
+		}
+
+		/* Woken up after every interrupt, frames for other handles included */
+		int condRet = condWait(can.evCond, can.lock, wait);
+		if ((condRet != 0) && (condRet != -ETIME)) {
+			fprintf(stderr, "zynqmp-can: unknown condWait error %i\n", condRet);
+			return condRet;
+		}
+
+		/* Handle closed by another thread in the meantime */
+		if (!client->used) {
+			return -ENOENT;
 		}
 	}
 
 	/* Read all received frames */
-	for (uint32_t i = 0; i < bufLen; i++) {
-		/* Try clearing the interrupt (it will only clear if there is no data) */
-		can.base->icr = (1 << 7);
+	while ((client->head != client->tail) && (*recvFrames < bufLen)) {
+		buf[*recvFrames] = client->queue[client->tail & (CAN_CLIENT_QUEUE_SIZE - 1)];
+		client->tail++;
+		(*recvFrames)++;
+	}
 
-		/* Check if there is still data in the RX FIFO (by reading pending IRQ status) */
-		if ((can.base->isr & (1 << 7)) == 0) {
-			break;
+	return 0;
+}
+
+/**
+ * Checks the ID and mask of a filter.
+ */
+static bool zynqmpCan_filterValid(const zynqmp_canFilter *filter)
+{
+	return zynqmpCan_idValid(filter->id, filter->flags) && zynqmpCan_idValid(filter->mask, filter->flags);
+}
+
+/**
+ * Configures one of the hardware acceptance filters.
+ * Frames with (id & mask) == (filter.id & filter.mask) and the same frame format (standard or extended)
+ * are accepted, NULL disables the filter. With all filters disabled every frame is accepted.
+ */
+static int zynqmpCan_setFilter(uint8_t n, const zynqmp_canFilter *filter)
+{
+	static const size_t afmr[ZYNQMP_CAN_FILTERS] = {
+		offsetof(can_periph_t, afmr1), offsetof(can_periph_t, afmr2), offsetof(can_periph_t, afmr3), offsetof(can_periph_t, afmr4)
+	};
+	volatile uint32_t *regs;
+	uint32_t mask;
+
+	if (n >= ZYNQMP_CAN_FILTERS) {
+		return -EINVAL;
+	}
+	if ((filter != NULL) && !zynqmpCan_filterValid(filter)) {
+		return -EINVAL;
+	}
+
+	/* Mask and ID registers can be written only while the filter is disabled and not busy */
+	can.base->afr &= ~(1u << n);
+	while ((can.base->sr & CAN_SR_ACFBSY) != 0) {
+		usleep(10);
+	}
+
+	if (filter != NULL) {
+		regs = (volatile uint32_t *)((volatile uint8_t *)can.base + afmr[n]);
+		/* Compare the IDE bit as well, so that only frames of the same format pass, SRR and RTR are ignored */
+		mask = zynqmpCan_encodeId(filter->mask, filter->flags & ZYNQMP_CAN_FLAG_EXT) & ~CAN_ID_SRR;
+		regs[0] = mask | CAN_ID_IDE;
+		regs[1] = zynqmpCan_encodeId(filter->id, filter->flags & ZYNQMP_CAN_FLAG_EXT);
+		can.base->afr |= (1u << n);
+	}
+
+	return 0;
+}
+
+/**
+ * Configures the software filter of the receive handle, NULL makes it accept all frames.
+ */
+static int zynqmpCan_setClientFilter(can_client_t *client, const zynqmp_canFilter *filter)
+{
+	if (filter == NULL) {
+		client->filtered = false;
+		return 0;
+	}
+	if (!zynqmpCan_filterValid(filter)) {
+		return -EINVAL;
+	}
+
+	client->filter = *filter;
+	client->filtered = true;
+
+	/* Drop queued frames, which might not match the new filter */
+	client->tail = client->head;
+
+	return 0;
+}
+
+/**
+ * Returns the receive handle for the object ID, or NULL if the handle is not open.
+ */
+static can_client_t *zynqmpCan_getClient(id_t id)
+{
+	if ((id >= CAN_CLIENTS) || !can.clients[id].used) {
+		return NULL;
+	}
+
+	return &can.clients[id];
+}
+
+/**
+ * Opens a new receive handle, its number is used as the object ID by the client.
+ */
+static int zynqmpCan_open(void)
+{
+	/* Handle 0 is reserved for clients using the device object ID */
+	for (uint32_t i = 1; i < CAN_CLIENTS; i++) {
+		can_client_t *client = &can.clients[i];
+		if (!client->used) {
+			client->filtered = false;
+			client->head = 0;
+			client->tail = 0;
+			client->overflows = 0;
+			client->used = true;
+			return i;
 		}
+	}
 
-		/* Read a frame from the FIFO */
-		buf[i].id = (can.base->rxfifo_id >> 21) & 0x7ff;
-		buf[i].len = (can.base->rxfifo_dlc >> 28) & 0xf;
-		buf[i].payload.words[0] = be32toh(can.base->rxfifo_data1);
-		buf[i].payload.words[1] = be32toh(can.base->rxfifo_data2);
-		(*recvFrames)++;
+	return -ENFILE;
+}
+
+/**
+ * Closes the receive handle.
+ */
+static int zynqmpCan_close(id_t id)
+{
+	can_client_t *client;
+
+	/* Closing the device object ID is a no-op */
+	if (id == 0) {
+		return 0;
+	}
+
+	client = zynqmpCan_getClient(id);
+	if (client == NULL) {
+		return -ENOENT;
 	}
 
+	client->used = false;
+	/* Wake up receive calls blocked on this handle */
+	condBroadcast(can.evCond);
+
 	return 0;
 }
 
 /**
- * Main thread for handling CAN operations.
+ * Handles CAN driver requests.
+ */
+static int zynqmpCan_devCtl(msg_t *msg)
+{
+	/* Decode extra information passed with the request */
+	zynqmp_canDriverReq *req = (zynqmp_canDriverReq *)msg->i.raw;
+	zynqmp_canDriverResp *resp = (zynqmp_canDriverResp *)msg->o.raw;
+	can_client_t *client;
+
+	/* Choose operation based on opcode */
+	switch (req->operation) {
+		case zynqmp_canOpSend: {
+			zynqmp_canFrame *frames = (zynqmp_canFrame *)msg->i.data;
+			uint32_t count = msg->i.size / sizeof(zynqmp_canFrame);
+			return zynqmpCan_framesSent(frames, count, req->block, &resp->framesReceivedSend);
+		}
+
+		case zynqmp_canOpRecv: {
+			zynqmp_canFrame *buf = (zynqmp_canFrame *)msg->o.data;
+			uint32_t bufLen = msg->o.size / sizeof(zynqmp_canFrame);
+			client = zynqmpCan_getClient(msg->oid.id);
+			if (client == NULL) {
+				resp->framesReceivedSend = 0;
+				return -ENOENT;
+			}
+			return zynqmpCan_recvFrames(client, buf, bufLen, req->block, req->timeoutUs, &resp->framesReceivedSend);
+		}
+
+		case zynqmp_canOpSetFilter:
+			if ((msg->i.data != NULL) && (msg->i.size != sizeof(zynqmp_canFilter))) {
+				return -EINVAL;
+			}
+			return zynqmpCan_setFilter(req->filter, (const zynqmp_canFilter *)msg->i.data);
+
+		case zynqmp_canOpSetHandleFilter:
+			if ((msg->i.data != NULL) && (msg->i.size != sizeof(zynqmp_canFilter))) {
+				return -EINVAL;
+			}
+			client = zynqmpCan_getClient(msg->oid.id);
+			if (client == NULL) {
+				return -ENOENT;
+			}
+			return zynqmpCan_setClientFilter(client, (const zynqmp_canFilter *)msg->i.data);
+
+		case zynqmp_canOpGetStats: {
+			zynqmp_canStats *stats = (zynqmp_canStats *)msg->o.data;
+			if ((stats == NULL) || (msg->o.size != sizeof(zynqmp_canStats))) {
+				return -EINVAL;
+			}
+			client = zynqmpCan_getClient(msg->oid.id);
+			if (client == NULL) {
+				return -ENOENT;
+			}
+			/* Counters are updated by the interrupt handler, a torn snapshot is acceptable */
+			memcpy(stats, &can.stats, sizeof(can.stats));
+			stats->rxQueueOverflows = client->overflows;
+			return 0;
+		}
+
+		default:
+			return -EINVAL;
+	}
+}
+
+/**
+ * Server thread for handling CAN operations.
  * Processes incoming messages and performs the requested operations.
  */
 static void zynqmpCan_thread(void *arg)
@@ -450,39 +1002,27 @@ static void zynqmpCan_thread(void *arg)
 	msg_rid_t rid;
 	uint32_t port = can.oid.port;
 
-	mutexLock(can.lock);
-
 	for (;;) {
 		/* Wait indefinitely for a message */
 		if (msgRecv(port, &msg, &rid) < 0) {
 			continue;
 		}
+
+		mutexLock(can.lock);
+
 		switch (msg.type) {
-			/* This driver supports only one way of communication with it */
-			case mtDevCtl: {
-				/* Decode extra information passed with the request */
-				zynqmp_canDriverReq *req = (zynqmp_canDriverReq *)msg.i.raw;
-				zynqmp_canDriverResp *resp = (zynqmp_canDriverResp *)msg.o.raw;
-
-				/* Choose operation based on opcode */
-				if (req->operation == zynqmp_canOpSend) {
-					zynqmp_canFrame *frames = (zynqmp_canFrame *)msg.i.data;
-					uint32_t count = msg.i.size / sizeof(zynqmp_canFrame);
-					msg.o.err = zynqmpCan_framesSent(frames, count, req->block, &resp->framesReceivedSend);
-				}
-				else if (req->operation == zynqmp_canOpRecv) {
-					zynqmp_canFrame *buf = (zynqmp_canFrame *)msg.o.data;
-					uint32_t bufLen = msg.o.size / sizeof(zynqmp_canFrame);
-					msg.o.err = zynqmpCan_recvFrames(buf, bufLen, req->block, req->timeoutUs, &resp->framesReceivedSend);
-				}
-				else {
-					msg.o.err = -EINVAL;
-				}
-			} break;
+			/* Frames are exchanged only using device control messages */
+			case mtDevCtl:
+				msg.o.err = zynqmpCan_devCtl(&msg);
+				break;
 
+			/* Each opened handle receives frames to its own queue */
 			case mtOpen:
+				msg.o.err = zynqmpCan_open();
+				break;
+
 			case mtClose:
-				msg.o.err = 0;
+				msg.o.err = zynqmpCan_close(msg.oid.id);
 				break;
 
 			case mtWrite:
@@ -493,10 +1033,11 @@ static void zynqmpCan_thread(void *arg)
 				break;
 			}
 		}
+
+		mutexUnlock(can.lock);
+
 		msgRespond(port, &msg, rid);
 	}
-
-	mutexUnlock(can.lock);
 }
 
 /**
@@ -510,10 +1051,11 @@ int main(int argc, char **argv)
 	/* Default arguments */
 	int can_id = 0;
 	int baudrate = CAN_BAUDRATE_KBPS_DEFAULT;
+	can.tx.urgentIdMax = -1;
 
 	/* Parse command-line arguments */
 	if (argc > 1) {
-		while ((c = getopt(argc, argv, "n:b:h")) != -1) {
+		while ((c = getopt(argc, argv, "n:b:p:h")) != -1) {
 			switch (c) {
 				case 'b': {
 					baudrate = atoi(optarg);
@@ -527,6 +1069,14 @@ int main(int argc, char **argv)
 					}
 				} break;
 
+				case 'p': {
+					can.tx.urgentIdMax = atoi(optarg);
+					if ((can.tx.urgentIdMax < 0) || (can.tx.urgentIdMax > ZYNQMP_CAN_ID_MAX)) {
+						fprintf(stderr, "zynqmp-can: invalid high priority ID limit\n");
+						return EXIT_FAILURE;
+					}
+				} break;
+
 				case 'h':
 					zynqmpCan_CliHelp(argv[0]);
 					return EXIT_SUCCESS;
@@ -558,7 +1108,20 @@ int main(int argc, char **argv)
 		return EXIT_FAILURE;
 	}
 
-	/* Start the message handling thread */
+	/* Handle 0 receives all frames for clients using the device object ID */
+	can.clients[0].used = true;
+
+	/* Start the dispatcher and message handling threads */
+	if (beginthread(zynqmpCan_dispatchThread, 3, can.stacks[0], sizeof(can.stacks[0]), NULL) < 0) {
+		fprintf(stderr, "zynqmp-can: cannot start dispatcher thread\n");
+		return EXIT_FAILURE;
+	}
+	for (int i = 1; i < CAN_SERVER_THREADS; i++) {
+		if (beginthread(zynqmpCan_thread, 4, can.stacks[i], sizeof(can.stacks[i]), NULL) < 0) {
+			fprintf(stderr, "zynqmp-can: cannot start server thread\n");
+			return EXIT_FAILURE;
+		}
+	}
 	zynqmpCan_thread(NULL);
 
 	return EXIT_SUCCESS;
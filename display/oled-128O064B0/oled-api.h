@@ -19,6 +19,7 @@
 #define OLED_DRIVER "/dev/oled"
 #define OLED_X_RES 128
 #define OLED_Y_RES 64
+#define OLED_PAGES (OLED_Y_RES / 8)
 
 typedef enum {
 	oled_write__rect,
@@ -26,9 +27,22 @@ typedef enum {
 	oled_write__text_abs,
 	oled_write__text_cont,
 	oled_write__clear,
-	oled_write__draw
+	oled_write__draw,
+	oled_write__map,
+	oled_write__flip
 } oled_write_type_t;
 
+
+/*
+ * Double buffered framebuffer in the panel layout: a byte holds 8 vertical pixels, LSB on top.
+ * Clients render into page[back] and flip, the new back buffer starts as a copy of the flipped frame.
+ * The driver runs on NOMMU targets, so the pointer returned by oled_write__map is directly usable.
+ */
+typedef struct {
+	uint8_t page[2][OLED_PAGES][OLED_X_RES];
+	volatile uint32_t back;
+} oled_fb_t;
+
 typedef struct {
 	oled_write_type_t type;
 
@@ -41,6 +55,7 @@ typedef struct {
 		const char *text;
 		uint8_t filled;
 		const uint64_t *data;
+		oled_fb_t **fb;
 	};
 } oled_write_t;
 
@@ -97,8 +97,15 @@ static int dev_write(const oled_write_t *cmd)
 			oledgraph_fillRect(cmd->x, cmd->y, cmd->w, cmd->h, 0);
 			break;
 		case oled_write__draw:
-			oledgraph_drawBuffer(cmd->x, cmd->y, cmd->w, cmd->h, 1);
+			oledgraph_drawBuffer(cmd->x, cmd->y, cmd->w, cmd->h, 0);
 			break;
+		case oled_write__map:
+			if (cmd->fb == NULL)
+				return -EINVAL;
+			*cmd->fb = oledgraph_mapFb();
+			break;
+		case oled_write__flip:
+			return oledgraph_flip();
 		default:
 			return -EINVAL;
 	}
@@ -159,6 +166,9 @@ int main(void)
 	if (dev_init())
 		return -EIO;
 
+	if (oledgraph_init(OLED128O064B0_PRIO) < 0)
+		return -ENOMEM;
+
 	/* Rotate by 180 degrees */
 	oledphy_sendCmd(0xc0);
 	oledphy_sendCmd(0xa0);
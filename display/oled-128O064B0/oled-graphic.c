@@ -16,6 +16,8 @@
 #include <unistd.h>
 #include <stdint.h>
 
+#include <sys/threads.h>
+
 #include "oled-phy.h"
 #include "oled-graphic.h"
 #include "fonts/font.h"
@@ -26,6 +28,11 @@
 
 #define CURSOR_COST 2
 
+/* Number of changed pages from which the whole frame is sent in one transfer */
+#ifndef OLED_FULL_FLUSH_PAGES
+#define OLED_FULL_FLUSH_PAGES 5
+#endif
+
 static void handle_control(int x, int y, int w, int h, int* cur_x, int* cur_y, int font, char c);
 
 
@@ -33,20 +40,61 @@ static void handle_character(int x, int y, int w, int h, int* cur_x, int* cur_y,
 
 
 struct {
-	uint64_t dev_buffer[128];
 	uint64_t buffer[128];
+	uint8_t frame[OLED_PAGES][OLED_X_RES]; /* buffer converted to panel layout */
+	uint8_t shown[OLED_PAGES][OLED_X_RES]; /* panel contents */
 	struct {
 		int cur_x;
 		int cur_y;
 	} scroll;
+
+	/* Pages of buffer changed since last draw, with changed column range */
+	struct {
+		uint8_t pages;
+		uint8_t x0[OLED_PAGES];
+		uint8_t x1[OLED_PAGES];
+	} dirty;
+
+	handle_t lock; /* Panel access */
+
+	oled_fb_t fb;
+	handle_t fblock;
+	handle_t fbcond;
+	volatile int flushing;
+	uint8_t stack[1024] __attribute__((aligned(8)));
 } g_common;
 
 
+static void markDirty(int x, int y, int w, int h)
+{
+	int page;
+
+	if ((w <= 0) || (h <= 0))
+		return;
+
+	for (page = y / 8; (page <= (y + h - 1) / 8) && (page < OLED_PAGES); ++page) {
+		if ((g_common.dirty.pages & (1 << page)) == 0) {
+			g_common.dirty.x0[page] = x;
+			g_common.dirty.x1[page] = x + w;
+			g_common.dirty.pages |= 1 << page;
+		}
+		else {
+			if (x < g_common.dirty.x0[page])
+				g_common.dirty.x0[page] = x;
+			if (x + w > g_common.dirty.x1[page])
+				g_common.dirty.x1[page] = x + w;
+		}
+	}
+}
+
+
 void oledgraph_fillRect(int x, int y, int w, int h, int filled)
 {
 	int i;
 	const uint64_t mask = (((uint64_t)-1) << y) &~ (((uint64_t)-1) << (y + h));
 
+	markDirty(x, y, w, h);
+
 	if (filled) {
 		for (i = x; i < x + w; ++i)
 			g_common.buffer[i] |=  mask;
@@ -62,6 +110,8 @@ void oledgraph_fillBitmap(int x, int y, int w, int h, const uint64_t map[w])
 {
 	int i;
 	const uint64_t mask = (((uint64_t)-1) << y) &~ (((uint64_t)-1) << (y + h));
+
+	markDirty(x, y, w, h);
 	for (i = 0; i < w; ++i) {
 		g_common.buffer[i + x] &= ~mask;
 		g_common.buffer[i + x] |= (map[i] << y);
@@ -96,6 +146,8 @@ static void buffer_move_updown(int x, int y, int w, int h, int move)
 	int i;
 	uint64_t tmp;
 	const uint64_t mask = (((uint64_t)-1) << y) &~ (((uint64_t)-1) << (y + h));
+
+	markDirty(x, y, w, h);
 	for(i = x; i < x + w; ++i) {
 		tmp = g_common.buffer[i];
 		g_common.buffer[i] &= ~mask;
@@ -192,28 +244,25 @@ void oledgraph_reset(int x, int y, int w, int h)
 }
 
 
-static int findRowStart(int row, int x, int endx)
+static int findRowStart(const uint8_t *row, const uint8_t *shown, int x, int endx)
 {
 	int col;
 	for (col = x; col < endx; ++col) {
-		if (BYTE_ELEM(g_common.buffer, row, col) !=
-			BYTE_ELEM(g_common.dev_buffer, row, col)) {
+		if (row[col] != shown[col]) {
 			return col;
 		}
 	}
 	return -1;
 }
 
-static int findRowEnd(int row, int x, int endx)
+static int findRowEnd(const uint8_t *row, const uint8_t *shown, int x, int endx)
 {
 	int col, i;
 
 	for (col = x; col < endx; ++col) {
-		if (BYTE_ELEM(g_common.buffer, row, col) ==
-			BYTE_ELEM(g_common.dev_buffer, row, col)) {
+		if (row[col] == shown[col]) {
 			for (i = 0; i + col < endx && i < CURSOR_COST; ++i) {
-				if (BYTE_ELEM(g_common.buffer, row, i + col) !=
-					BYTE_ELEM(g_common.dev_buffer, row, i + col)) {
+				if (row[i + col] != shown[i + col]) {
 					break;
 				}
 			}
@@ -225,52 +274,174 @@ static int findRowEnd(int row, int x, int endx)
 		}
 	}
 
-	return endx - 1;
+	return endx;
 }
 
 
-static void drawBufferRow(int row, int x, int w)
+static void sendSpan(int page, int startx, int endx)
+{
+	oledphy_sendCmd(startx & 0xf);
+	oledphy_sendCmd(((startx >> 4) & 0xf) | 0x10);
+	oledphy_sendDataBuf(&g_common.shown[page][startx], endx - startx);
+}
+
+
+static void drawPageRow(const uint8_t *row, int page, int x, int endx)
 {
-	int col = x;
-	int i;
 	int startx;
-	while (col < x + w) {
-		startx = findRowStart(row, col, x + w);
+
+	while (x < endx) {
+		startx = findRowStart(row, g_common.shown[page], x, endx);
 		if (startx < 0)
 			return;
 
-		col = findRowEnd(row, startx + 1, x + w);
-
-		oledphy_sendCmd(startx & 0xf);
-		oledphy_sendCmd(((startx >> 4) & 0xf) | 0x10);
-		for (i = startx; i < col; ++i)
-			oledphy_sendData(BYTE_ELEM(g_common.buffer, row, i));
+		x = findRowEnd(row, g_common.shown[page], startx + 1, endx);
+		memcpy(&g_common.shown[page][startx], &row[startx], x - startx);
+		sendSpan(page, startx, x);
 	}
 }
 
 
-void oledgraph_drawBuffer(int x, int y, int w, int h, int force)
+/* Whole panel in one transfer using horizontal addressing */
+static void drawFull(void)
 {
-	int i, j;
-	const int start_page = y / 8;
-	const int end_page = (y + h - 1) / 8;
+	oledphy_sendCmd(0x20);
+	oledphy_sendCmd(0);
+	oledphy_sendCmd(0x21);
+	oledphy_sendCmd(0);
+	oledphy_sendCmd(OLED_X_RES - 1);
+	oledphy_sendCmd(0x22);
+	oledphy_sendCmd(0);
+	oledphy_sendCmd(OLED_PAGES - 1);
+	oledphy_sendDataBulk(&g_common.shown[0][0], sizeof(g_common.shown));
+}
+
+
+/* Sends columns x..endx-1 of pages in mask from src, only changes unless forced. Panel lock has to be held */
+static void drawPages(const uint8_t src[OLED_PAGES][OLED_X_RES], unsigned int pages, int x, int endx, int force)
+{
+	int page;
+	uint8_t changed = 0;
+
+	for (page = 0; page < OLED_PAGES; ++page) {
+		if (((pages & (1 << page)) != 0) && ((force != 0) || (memcmp(&src[page][x], &g_common.shown[page][x], endx - x) != 0)))
+			changed |= 1 << page;
+	}
+
+	if (__builtin_popcount(changed) >= OLED_FULL_FLUSH_PAGES) {
+		for (page = 0; page < OLED_PAGES; ++page) {
+			if ((changed & (1 << page)) != 0)
+				memcpy(&g_common.shown[page][x], &src[page][x], endx - x);
+		}
+		drawFull();
+		return;
+	}
 
 	/* Page addressing */
 	oledphy_sendCmd(0x20);
 	oledphy_sendCmd(2);
 
-	for (i = start_page; i <= end_page; ++i) {
-		oledphy_sendCmd(i | 0xb0);
+	for (page = 0; page < OLED_PAGES; ++page) {
+		if ((changed & (1 << page)) == 0)
+			continue;
+
+		oledphy_sendCmd(page | 0xb0);
 		if (!force) {
-			drawBufferRow(i, x, w);
+			drawPageRow(src[page], page, x, endx);
 		}
 		else {
-			oledphy_sendCmd(x & 0xf);
-			oledphy_sendCmd(((x >> 4) & 0xf) | 0x10);
-			for (j = x; j < x + w; ++j)
-				oledphy_sendData(BYTE_ELEM(g_common.buffer, i, j));
+			memcpy(&g_common.shown[page][x], &src[page][x], endx - x);
+			sendSpan(page, x, endx);
 		}
 	}
+}
+
+
+void oledgraph_drawBuffer(int x, int y, int w, int h, int force)
+{
+	int i, j;
+	unsigned int pages = 0;
+	const int start_page = y / 8;
+	const int end_page = (y + h - 1) / 8;
+
+	for (i = start_page; i <= end_page; ++i) {
+		if (!force && (g_common.dirty.pages & (1 << i)) == 0)
+			continue;
+
+		for (j = x; j < x + w; ++j)
+			g_common.frame[i][j] = BYTE_ELEM(g_common.buffer, i, j);
+
+		pages |= 1 << i;
+		if (x <= g_common.dirty.x0[i] && x + w >= g_common.dirty.x1[i])
+			g_common.dirty.pages &= ~(1 << i);
+	}
+
+	if (pages == 0)
+		return;
+
+	mutexLock(g_common.lock);
+	drawPages((const uint8_t (*)[OLED_X_RES])g_common.frame, pages, x, x + w, force);
+	mutexUnlock(g_common.lock);
+}
+
+
+oled_fb_t *oledgraph_mapFb(void)
+{
+	return &g_common.fb;
+}
+
+
+int oledgraph_flip(void)
+{
+	uint32_t back;
+
+	mutexLock(g_common.fblock);
+	while (g_common.flushing != 0)
+		condWait(g_common.fbcond, g_common.fblock, 0);
+
+	back = g_common.fb.back ^ 1;
+	memcpy(g_common.fb.page[back], g_common.fb.page[back ^ 1], sizeof(g_common.fb.page[0]));
+	g_common.fb.back = back;
+	g_common.flushing = 1;
+	condBroadcast(g_common.fbcond);
+	mutexUnlock(g_common.fblock);
+
+	return 0;
+}
+
+
+static void flushThread(void *arg)
+{
+	(void)arg;
+
+	mutexLock(g_common.fblock);
+	for (;;) {
+		while (g_common.flushing == 0)
+			condWait(g_common.fbcond, g_common.fblock, 0);
+		mutexUnlock(g_common.fblock);
+
+		/* Client renders only into the back buffer */
+		mutexLock(g_common.lock);
+		drawPages((const uint8_t (*)[OLED_X_RES])g_common.fb.page[g_common.fb.back ^ 1], (1 << OLED_PAGES) - 1, 0, OLED_X_RES, 0);
+		mutexUnlock(g_common.lock);
+
+		mutexLock(g_common.fblock);
+		g_common.flushing = 0;
+		condBroadcast(g_common.fbcond);
+	}
+}
+
+
+int oledgraph_init(int prio)
+{
+	if (mutexCreate(&g_common.lock) < 0)
+		return -1;
+
+	if (mutexCreate(&g_common.fblock) < 0)
+		return -1;
+
+	if (condCreate(&g_common.fbcond) < 0)
+		return -1;
 
-	memcpy(g_common.dev_buffer, g_common.buffer, sizeof(g_common.dev_buffer));
+	return beginthread(flushThread, prio, g_common.stack, sizeof(g_common.stack), NULL);
 }
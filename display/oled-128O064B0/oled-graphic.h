@@ -16,6 +16,11 @@
 
 #include <stdint.h>
 
+#include "oled-api.h"
+
+
+int oledgraph_init(int prio);
+
 
 void oledgraph_fillRect(int x, int y, int w, int h, int filled);
 
@@ -37,4 +42,11 @@ void oledgraph_reset(int x, int y, int w, int h);
 
 void oledgraph_drawBuffer(int x, int y, int w, int h, int force);
 
+
+oled_fb_t *oledgraph_mapFb(void);
+
+
+/* Waits for the previous flip to be flushed, then flushes the back buffer in the background */
+int oledgraph_flip(void);
+
 #endif
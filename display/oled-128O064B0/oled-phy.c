@@ -22,6 +22,8 @@
 #include <imxrt-multi.h>
 #include <phoenix/arch/armv7m/imxrt/10xx/imxrt10xx.h>
 
+#include "oled-phy.h"
+
 
 #define SPI1_PATH         "/dev/spi1"
 #define PINS_PATH         "/dev/gpio3"
@@ -48,12 +50,13 @@ struct {
 
 	uint8_t *txBuff;
 	uint8_t rxBuff[X_RES];
-} oledphy_common;
+	int dc; /* Last D/C pin state, -1 if unknown */
+} oledphy_common = { .dc = -1 };
 
 
-static int oledphy_transmitSPI(uint8_t *data, uint8_t size)
+static int oledphy_transmitSPI(uint8_t *data, size_t size)
 {
-	if (size > X_RES)
+	if (size > OLEDPHY_BULK_MAX)
 		return -1;
 
 	msg_t msg;
@@ -138,11 +141,29 @@ static int oledphy_gpioSetDir(int gpio, int pin, int dir)
 }
 
 
+/* Skips the GPIO message if D/C is already in the requested state */
+static int oledphy_setDC(int state)
+{
+	int res;
+
+	if (oledphy_common.dc == state)
+		return EOK;
+
+	oledphy_common.dc = -1;
+	if ((res = oledphy_gpioSetPin(oledphy_common.gpioOid.id, DC_PIN, state)) < 0)
+		return res;
+
+	oledphy_common.dc = state;
+
+	return res;
+}
+
+
 int oledphy_sendCmd(uint8_t cmd)
 {
 	int res = EOK;
 
-	if ((res = oledphy_gpioSetPin(oledphy_common.gpioOid.id, DC_PIN, STATE_LOW)) < 0)
+	if ((res = oledphy_setDC(STATE_LOW)) < 0)
 		return res;
 
 	if ((res = oledphy_transmitSPI(&cmd, 1)) < 0)
@@ -155,7 +176,7 @@ int oledphy_sendData(uint8_t data)
 {
 	int res = EOK;
 
-	if ((res = oledphy_gpioSetPin(oledphy_common.gpioOid.id, DC_PIN, STATE_HIGH)) < 0)
+	if ((res = oledphy_setDC(STATE_HIGH)) < 0)
 		return res;
 
 	if ((res = oledphy_transmitSPI(&data, 1)) < 0)
@@ -165,13 +186,19 @@ int oledphy_sendData(uint8_t data)
 }
 
 int oledphy_sendDataBuf(uint8_t *data, uint8_t size)
+{
+	return oledphy_sendDataBulk(data, size);
+}
+
+
+int oledphy_sendDataBulk(const uint8_t *data, size_t size)
 {
 	int res = EOK;
 
-	if ((res = oledphy_gpioSetPin(oledphy_common.gpioOid.id, DC_PIN, STATE_HIGH)) < 0)
+	if ((res = oledphy_setDC(STATE_HIGH)) < 0)
 		return res;
 
-	if ((res = oledphy_transmitSPI(data, size)) < 0)
+	if ((res = oledphy_transmitSPI((uint8_t *)data, size)) < 0)
 		return res;
 
 	return res;
@@ -267,7 +294,7 @@ static int oledphy_initGPIO(void)
 	if ((res = oledphy_gpioSetDir(oledphy_common.gpioOid.id, DC_PIN, OUT_DIR)) < 0)
 		return res;
 
-	if ((res = oledphy_gpioSetPin(oledphy_common.gpioOid.id, DC_PIN, STATE_LOW)) < 0)
+	if ((res = oledphy_setDC(STATE_LOW)) < 0)
 		return res;
 
 
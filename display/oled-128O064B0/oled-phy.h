@@ -16,15 +16,22 @@
 #define _OLED_PHY_H_
 
 
+#include <stddef.h>
 #include <stdint.h>
 
 
+#define OLEDPHY_BULK_MAX 1024
+
+
 extern int oledphy_sendCmd(uint8_t cmd);
 
 extern int oledphy_sendData(uint8_t data);
 
 extern int oledphy_sendDataBuf(uint8_t *data, uint8_t size);
 
+/* Sends up to OLEDPHY_BULK_MAX bytes in one SPI transaction (DMA driven by the SPI server) */
+extern int oledphy_sendDataBulk(const uint8_t *data, size_t size);
+
 extern int oledphy_init(void);
 
 extern int oledphy_setPos(uint8_t x, uint8_t y);
@@ -14,6 +14,7 @@
 #include <errno.h>
 #include <stdlib.h>
 
+#include <sys/interrupt.h>
 #include <sys/mman.h>
 #include <sys/platform.h>
 
@@ -82,9 +83,181 @@ int grdma_descrAlloc(grdma_ctx_t *ctx, size_t size)
 }
 
 
+int grdma_poolInit(grdma_ctx_t *ctx, unsigned int cnt)
+{
+	int err;
+
+	if ((cnt == 0u) || (ctx->descr != NULL)) {
+		return -EINVAL;
+	}
+
+	ctx->slots = malloc(cnt * sizeof(*ctx->slots));
+	if (ctx->slots == NULL) {
+		return -ENOMEM;
+	}
+
+	err = grdma_descrAlloc(ctx, cnt * sizeof(grdma_descr_t));
+	if (err < 0) {
+		free(ctx->slots);
+		ctx->slots = NULL;
+		return err;
+	}
+
+	/* Use the whole mapping */
+	ctx->slotCnt = ctx->descrSize / sizeof(grdma_descr_t);
+	if (ctx->slotCnt > cnt) {
+		ctx->slotCnt = cnt;
+	}
+
+	for (unsigned int i = 0; i < ctx->slotCnt; i++) {
+		ctx->slots[i].next = ((i + 1) < ctx->slotCnt) ? (int)(i + 1) : -1;
+	}
+	ctx->freeHead = 0;
+	ctx->queueHead = -1;
+	ctx->queueTail = -1;
+
+	return EOK;
+}
+
+
+static int grdma_slotIdx(grdma_ctx_t *ctx, grdma_descr_t *descr)
+{
+	grdma_descr_t *pool = ctx->descr;
+
+	if ((descr < pool) || (descr >= (pool + ctx->slotCnt))) {
+		return -1;
+	}
+
+	return descr - pool;
+}
+
+
+grdma_descr_t *grdma_descrGet(grdma_ctx_t *ctx)
+{
+	int idx = ctx->freeHead;
+
+	if (idx < 0) {
+		return NULL;
+	}
+
+	ctx->freeHead = ctx->slots[idx].next;
+
+	return &((grdma_descr_t *)ctx->descr)[idx];
+}
+
+
+static void grdma_slotPut(grdma_ctx_t *ctx, int idx)
+{
+	ctx->slots[idx].next = ctx->freeHead;
+	ctx->freeHead = idx;
+}
+
+
+void grdma_descrPut(grdma_ctx_t *ctx, grdma_descr_t *descr)
+{
+	int idx = grdma_slotIdx(ctx, descr);
+
+	if (idx >= 0) {
+		grdma_slotPut(ctx, idx);
+	}
+}
+
+
+int grdma_enqueue(grdma_ctx_t *ctx, grdma_descr_t *descr, grdma_cb_t cb, void *arg)
+{
+	int idx = grdma_slotIdx(ctx, descr);
+	grdma_descr_t *tail;
+
+	if (idx < 0) {
+		return -EINVAL;
+	}
+
+	ctx->slots[idx].cb = cb;
+	ctx->slots[idx].arg = arg;
+	ctx->slots[idx].next = -1;
+	ctx->slots[idx].done = 0;
+
+	/* Both descriptor types have ctrl, next and sts at the same offsets (and the same WB bit) */
+	descr->data.ctrl |= GRDMA_DATA_WB;
+	descr->data.next = 0x1; /* Last descriptor */
+	descr->data.sts = 0;
+
+	if (ctx->queueTail < 0) {
+		ctx->queueHead = idx;
+		ctx->queueTail = idx;
+		grdma_setup(ctx, descr);
+		grdma_start(ctx);
+		return EOK;
+	}
+
+	tail = &((grdma_descr_t *)ctx->descr)[ctx->queueTail];
+	ctx->slots[ctx->queueTail].next = idx;
+	ctx->queueTail = idx;
+
+	/* Make the new descriptor visible before linking it */
+	__sync_synchronize();
+	tail->data.next = (uintptr_t)descr & ~0x1;
+
+	/* Core re-reads next pointer of the last descriptor if it already reached the end */
+	*(ctx->base + GRDMAC2_CTRL) |= CTRL_KICK;
+
+	return EOK;
+}
+
+
+unsigned int grdma_reap(grdma_ctx_t *ctx)
+{
+	grdma_descr_t *pool = ctx->descr;
+	unsigned int cnt = 0;
+	uint32_t sts;
+	int idx;
+
+	while ((idx = ctx->queueHead) >= 0) {
+		sts = pool[idx].data.sts;
+		if ((sts & GRDMA_STS_DONE) == 0) {
+			break;
+		}
+
+		if (ctx->slots[idx].done == 0) {
+			ctx->slots[idx].done = 1;
+			cnt++;
+			if (ctx->slots[idx].cb != NULL) {
+				ctx->slots[idx].cb(ctx->slots[idx].arg, sts);
+			}
+		}
+
+		/* Tail stays queued, the core may still read its next pointer */
+		if (idx == ctx->queueTail) {
+			break;
+		}
+
+		ctx->queueHead = ctx->slots[idx].next;
+		grdma_slotPut(ctx, idx);
+	}
+
+	return cnt;
+}
+
+
+static int grdma_irqHandler(unsigned int n, void *arg)
+{
+	(void)n;
+	(void)arg;
+
+	return 1;
+}
+
+
+int grdma_irqAttach(grdma_ctx_t *ctx, handle_t cond, handle_t *handle)
+{
+	return interrupt(ctx->irq, grdma_irqHandler, ctx, cond, handle);
+}
+
+
 void grdma_destroy(grdma_ctx_t *ctx)
 {
 	if (ctx != NULL) {
+		free(ctx->slots);
 		if (ctx->descr != NULL) {
 			(void)munmap(ctx->descr, ctx->descrSize);
 		}
@@ -136,5 +309,11 @@ grdma_ctx_t *grdma_init(unsigned int instance)
 	ctx->descr = NULL;
 	ctx->descrSize = 0u;
 
+	ctx->slots = NULL;
+	ctx->slotCnt = 0u;
+	ctx->freeHead = -1;
+	ctx->queueHead = -1;
+	ctx->queueTail = -1;
+
 	return ctx;
 }
@@ -17,6 +17,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <sys/types.h>
 
 
 /* Descriptor type: 0 - data, 1 - polling, 2 - triggering, 3 - poll on trigger */
@@ -62,11 +63,39 @@ typedef struct {
 } __attribute__((packed, aligned(4))) grdma_condDescr_t;
 
 
+/* Descriptor status word */
+#define GRDMA_STS_DONE (1 << 0) /* Descriptor completed */
+
+
+/* Pool descriptor, fits either descriptor type */
+typedef union {
+	grdma_dataDescr_t data;
+	grdma_condDescr_t cond;
+	uint32_t raw[8];
+} __attribute__((aligned(32))) grdma_descr_t;
+
+
+/* Called by grdma_reap() with descriptor status word */
+typedef void (*grdma_cb_t)(void *arg, uint32_t sts);
+
+
 typedef struct {
 	volatile uint32_t *base;
 	uint8_t irq;
 	void *descr;
 	size_t descrSize;
+
+	/* Descriptor pool and queue (grdma_poolInit) */
+	struct grdma_slot_s {
+		grdma_cb_t cb;
+		void *arg;
+		int next;  /* Next free or queued slot, -1 if none */
+		int done;  /* Completion already reported */
+	} *slots;
+	unsigned int slotCnt;
+	int freeHead;
+	int queueHead;
+	int queueTail;
 } grdma_ctx_t;
 
 
@@ -97,6 +126,34 @@ bool grdma_finished(grdma_ctx_t *ctx);
 grdma_ctx_t *grdma_init(unsigned int instance);
 
 
+/* Allocate descriptor pool of `cnt` descriptors (replaces grdma_descrAlloc for queue users) */
+int grdma_poolInit(grdma_ctx_t *ctx, unsigned int cnt);
+
+
+/* Take descriptor from the pool, NULL if the pool is empty */
+grdma_descr_t *grdma_descrGet(grdma_ctx_t *ctx);
+
+
+/* Return descriptor that was not enqueued to the pool */
+void grdma_descrPut(grdma_ctx_t *ctx, grdma_descr_t *descr);
+
+
+/* Append descriptor prepared by the caller (next field is overwritten) to the queue.
+ * Starts the channel if the queue is empty, otherwise extends the running chain without restart.
+ * Status write back is forced, `cb` (may be NULL) is called by grdma_reap() on completion.
+ * Queue functions are not thread-safe, caller serializes them.
+ */
+int grdma_enqueue(grdma_ctx_t *ctx, grdma_descr_t *descr, grdma_cb_t cb, void *arg);
+
+
+/* Report completed descriptors and return them to the pool, returns number completed */
+unsigned int grdma_reap(grdma_ctx_t *ctx);
+
+
+/* Signal `cond` on channel interrupt, descriptors need GRDMA_DATA_IE/GRDMA_COND_IE to raise it */
+int grdma_irqAttach(grdma_ctx_t *ctx, handle_t cond, handle_t *handle);
+
+
 /* Destroy GRDMA context */
 void grdma_destroy(grdma_ctx_t *ctx);
 
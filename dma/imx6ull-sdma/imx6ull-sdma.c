@@ -30,6 +30,8 @@
 
 #include <phoenix/arch/armv7a/imx6ull/imx6ull.h>
 
+#include <perfcnt.h>
+
 #include "sdma-api.h"
 
 #if 0
@@ -54,7 +56,8 @@
 #define NUM_OF_SDMA_CHANNELS    (32)
 #define NUM_OF_SDMA_REQUESTS    (48)
 
-#define NUM_OF_WORKER_THREADS   4 //(NUM_OF_SDMA_CHANNELS)
+/* Readers block a worker until the next interrupt of their channel, keep some spare for dev_ctl */
+#define NUM_OF_WORKER_THREADS   8
 #define WORKER_THD_PRIO         (3)
 #define WORKER_THD_STACK        (4096)
 
@@ -134,8 +137,11 @@ typedef struct {
 	sdma_buffer_desc_t *bd;
 	addr_t bd_paddr;
 
+	sdma_compl_ring_t *compl; /* Client completion ring (optional) */
+
 	id_t file_id;
 
+	handle_t lock; /* Protects intr_cond waits and counters, never held across hardware access */
 	handle_t intr_cond;
 	unsigned intr_cnt;
 	unsigned missed_intr_cnt;
@@ -163,7 +169,8 @@ struct driver_common_s
 	volatile sdma_arm_regs_t *regs;
 
 	handle_t intr_cond;
-	handle_t lock;
+	handle_t intr_lock; /* Dispatcher only */
+	handle_t lock; /* Serializes dev_ctl (channel 0, tmp buffer, shared registers) */
 
 	addr_t ocram_next;
 
@@ -178,6 +185,12 @@ struct driver_common_s
 	uint32_t active_mask;
 } common;
 
+PERFCNT_COUNTER(perf_irq, "sdma.irq");
+PERFCNT_COUNTER(perf_chirq, "sdma.chan_irq");
+PERFCNT_COUNTER(perf_missed, "sdma.missed");
+PERFCNT_COUNTER(perf_reads, "sdma.reads");
+PERFCNT_COUNTER(perf_timeouts, "sdma.read_timeouts");
+
 static void log_printf(int lvl, const char* fmt, ...)
 {
 	va_list arg;
@@ -340,11 +353,12 @@ static int __attribute__((unused)) sdma_program_memory_dump(uint16_t addr,
 	return sdma_run_channel0_cmd(size, SDMA_CMD_C0_GET_PM, buffer, addr);
 }
 
-static int __attribute__((unused)) sdma_program_memory_write(uint16_t addr,
-															 addr_t buffer,
-															 size_t size)
+/* size in bytes, program memory is addressed and transferred in 16-bit words */
+static int sdma_program_memory_write(uint16_t addr,
+									 addr_t buffer,
+									 size_t size)
 {
-	return sdma_run_channel0_cmd(size, SDMA_CMD_C0_SET_PM, buffer, addr);
+	return sdma_run_channel0_cmd(size / 2, SDMA_CMD_C0_SET_PM, buffer, addr);
 }
 
 static int sdma_data_memory_dump(uint16_t addr,
@@ -361,11 +375,31 @@ static int sdma_data_memory_write(uint16_t addr,
 	return sdma_run_channel0_cmd(size, SDMA_CMD_C0_SET_DM, buffer, addr);
 }
 
+static void sdma_compl_push(struct driver_common_s *cmn, unsigned channel_id)
+{
+	sdma_compl_ring_t *ring = cmn->channel[channel_id].compl;
+	uint32_t head = ring->head;
+
+	if (head - ring->tail >= SDMA_COMPL_RING_SIZE) {
+		ring->overflow++;
+		return;
+	}
+
+	ring->bd_idx[head & (SDMA_COMPL_RING_SIZE - 1)] =
+		(cmn->ccb[channel_id].current_bd - cmn->channel[channel_id].bd_paddr) / sizeof(sdma_buffer_desc_t);
+
+	/* Entry has to be visible before the client sees new head */
+	__sync_synchronize();
+	ring->head = head + 1;
+}
+
 static int sdma_intr(unsigned int intr, void *arg)
 {
 	uint32_t _INTR;
 	struct driver_common_s *cmn = (struct driver_common_s*)arg;
 
+	PERFCNT_INC(perf_irq);
+
 	while ((_INTR = cmn->regs->INTR) != 0) {
 
 		/* Clear interrupt flags */
@@ -377,16 +411,22 @@ static int sdma_intr(unsigned int intr, void *arg)
 			/* Check if channel is active and it's interrupt flag is set */
 			if (_INTR & (1 << i) && cmn->channel[i].active) {
 
-				/* Set BD_DONE in all buffer descriptors */
-				sdma_buffer_desc_t *current = cmn->channel[i].bd;
-				do {
-					if (!(current->flags & SDMA_BD_DONE))
-						current->flags |= SDMA_BD_DONE;
-				} while (!((current++)->flags & SDMA_BD_WRAP));
+				/* Set BD_DONE in all buffer descriptors (chains re-arm them on their own) */
+				if (cmn->channel[i].auto_bd_done) {
+					sdma_buffer_desc_t *current = cmn->channel[i].bd;
+					do {
+						if (!(current->flags & SDMA_BD_DONE))
+							current->flags |= SDMA_BD_DONE;
+					} while (!((current++)->flags & SDMA_BD_WRAP));
+				}
+
+				if (cmn->channel[i].compl != NULL)
+					sdma_compl_push(cmn, i);
 
 				/* Increase interrupt count to notify dispatcher that interrupt for
 				 * this channel occurred */
 				cmn->channel[i].intr_cnt++;
+				PERFCNT_INC(perf_chirq);
 			}
 		}
 	}
@@ -544,6 +584,8 @@ static int sdma_set_bd_array(uint8_t channel_id, addr_t paddr, unsigned cnt)
 	common.ccb[channel_id].base_bd = paddr;
 	common.ccb[channel_id].current_bd = paddr;
 
+	common.channel[channel_id].auto_bd_done = 1;
+
 	/* TODO: mmap buffers */
 
 	/* TODO: Error handlig (unmap what was already mapped) */
@@ -551,6 +593,32 @@ static int sdma_set_bd_array(uint8_t channel_id, addr_t paddr, unsigned cnt)
 	return 0;
 }
 
+static int sdma_set_compl_ring(uint8_t channel_id, addr_t paddr)
+{
+	sdma_compl_ring_t *ring = common.channel[channel_id].compl;
+
+	/* Detach first, so the interrupt handler doesn't touch unmapped ring */
+	common.channel[channel_id].compl = NULL;
+	if (ring != NULL)
+		munmap(ring, _PAGE_SIZE);
+
+	if (paddr == 0)
+		return 0;
+
+	if (paddr & (_PAGE_SIZE - 1))
+		return -EINVAL;
+
+	ring = mmap(NULL, _PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_DEVICE | MAP_PHYSMEM | MAP_ANONYMOUS, -1, paddr);
+	if (ring == MAP_FAILED) {
+		log_error("failed to map completion ring");
+		return -ENOMEM;
+	}
+
+	common.channel[channel_id].compl = ring;
+
+	return 0;
+}
+
 static int sdma_channel_configure(uint8_t channel_id, sdma_channel_config_t *cfg)
 {
 	int res;
@@ -587,10 +655,12 @@ static int sdma_channel_configure(uint8_t channel_id, sdma_channel_config_t *cfg
 
 	/* Clear sticky conditional variable and reset counters - dev_read() should
 	   count interrupts from 0 after reconfiguring SDMA. */
-	condWait(common.channel[channel_id].intr_cond, common.lock, 1);
+	mutexLock(common.channel[channel_id].lock);
+	condWait(common.channel[channel_id].intr_cond, common.channel[channel_id].lock, 1);
 	common.channel[channel_id].intr_cnt = 0;
 	common.channel[channel_id].read_cnt = 0;
 	common.channel[channel_id].missed_intr_cnt = 0;
+	mutexUnlock(common.channel[channel_id].lock);
 
 	return 0;
 }
@@ -652,20 +722,26 @@ static int dev_read(oid_t *oid, void *data, size_t size)
 	unsigned intr_cnt;
 	int res;
 
-	mutexLock(common.lock);
+	if (channel <= 0 || channel >= NUM_OF_SDMA_CHANNELS)
+		return -EINVAL;
 
-	res = condWait(common.channel[channel].intr_cond, common.lock, INTR_CHANNEL_TIMEOUT_US);
+	/* Only this channel's lock is taken, so a blocked reader doesn't delay
+	 * dev_ctl or interrupt dispatching for other channels */
+	mutexLock(common.channel[channel].lock);
+
+	res = condWait(common.channel[channel].intr_cond, common.channel[channel].lock, INTR_CHANNEL_TIMEOUT_US);
 	if (res == -ETIME) {
-		mutexUnlock(common.lock);
+		mutexUnlock(common.channel[channel].lock);
+		PERFCNT_INC(perf_timeouts);
 		log_error("dev_read: timeout");
 		return -EIO;
 	}
 
 	intr_cnt = common.channel[channel].intr_cnt;
-
-	mutexUnlock(common.lock);
-
 	common.channel[channel].read_cnt++;
+	PERFCNT_INC(perf_reads);
+
+	mutexUnlock(common.channel[channel].lock);
 
 	if (data != NULL && size == sizeof(unsigned)) {
 		memcpy(data, &intr_cnt, sizeof(unsigned));
@@ -745,6 +821,23 @@ static int dev_ctl(msg_t *msg)
 			memcpy(msg->o.raw, &dev_ctl, sizeof(sdma_dev_ctl_t));
 			return EOK;
 
+		case sdma_dev_ctl__auto_bd_done:
+			common.channel[channel].auto_bd_done = dev_ctl.auto_bd_done;
+			return EOK;
+
+		case sdma_dev_ctl__compl_ring:
+			return sdma_set_compl_ring(channel, dev_ctl.compl.paddr);
+
+		case sdma_dev_ctl__prog_mem_write:
+			/* ROM can't be overwritten, only RAM scripts are loaded */
+			if (msg->o.size != dev_ctl.mem.len || msg->o.size > common.tmp_size ||
+					(msg->o.size & 1) || dev_ctl.mem.addr < SDMA_PM_RAM_START) {
+				log_error("dev_ctl: invalid program memory write");
+				return -EINVAL;
+			}
+			memcpy(common.tmp, msg->o.data, msg->o.size);
+			return sdma_program_memory_write(dev_ctl.mem.addr, common.tmp_paddr, dev_ctl.mem.len);
+
 		default:
 			log_error("dev_ctl: unknown type (%d)", dev_ctl.type);
 			return -ENOSYS;
@@ -782,6 +875,8 @@ static void worker_thread(void *arg)
 				break;
 
 			case mtDevCtl:
+				if (perfcnt_devctl(&msg) == 0)
+					break;
 				mutexLock(common.lock);
 				msg.o.err = dev_ctl(&msg);
 				mutexUnlock(common.lock);
@@ -825,6 +920,12 @@ static int init(void)
 
 	common.ocram_next = OCRAM_BASE;
 
+	PERFCNT_REGISTER(perf_irq);
+	PERFCNT_REGISTER(perf_chirq);
+	PERFCNT_REGISTER(perf_missed);
+	PERFCNT_REGISTER(perf_reads);
+	PERFCNT_REGISTER(perf_timeouts);
+
 	if (common.use_syslog)
 		openlog("sdma-driver", LOG_NDELAY, LOG_DAEMON);
 
@@ -833,6 +934,11 @@ static int init(void)
 		return -1;
 	}
 
+	if (mutexCreate(&common.intr_lock) != EOK) {
+		log_error("failed to create mutex");
+		return -1;
+	}
+
 	if (condCreate(&common.intr_cond) != EOK) {
 		log_error("failed to create conditional variable");
 		return -1;
@@ -842,6 +948,10 @@ static int init(void)
 		common.channel[i].intr_cnt = 0;
 		common.channel[i].read_cnt = 0;
 		common.channel[i].missed_intr_cnt = 0;
+		if (mutexCreate(&common.channel[i].lock) != EOK) {
+			log_error("failed to create mutex for channel %d", i);
+			return -1;
+		}
 		if (condCreate(&common.channel[i].intr_cond) != EOK) {
 			log_error("failed to create conditional variable for channel %d", i);
 			return -1;
@@ -1077,10 +1187,13 @@ int main(int argc, char *argv[])
 	memset(intr_cnt, 0, sizeof(intr_cnt));
 
 	while (1) {
-		mutexLock(common.lock);
-		res = condWait(common.intr_cond, common.lock, INTR_WAIT_TIMEOUT_US);
+		mutexLock(common.intr_lock);
+		res = condWait(common.intr_cond, common.intr_lock, INTR_WAIT_TIMEOUT_US);
+		mutexUnlock(common.intr_lock);
 
 		if (res == -ETIME) {
+			/* Debug dump uses channel 0 */
+			mutexLock(common.lock);
 
 			/* If any channel is active (except channel 0) dump debug info.
 			   The channel nr 0 is used to configure SDMA, we don't expect interrupt event. */
@@ -1104,8 +1217,11 @@ int main(int argc, char *argv[])
 			if (intr_cnt[i] == cnt) /* No interrupts for this channel */
 				continue;
 
+			mutexLock(common.channel[i].lock);
+
 			if ((intr_cnt[i] + 1) != cnt) { /* More than one interrupt */
 				common.channel[i].missed_intr_cnt += cnt - intr_cnt[i] - 1;
+				PERFCNT_ADD(perf_missed, cnt - intr_cnt[i] - 1);
 #if 0
 				/* Enable only for debugging purposes. Printing here makes us miss even more interrupts. */
 				log_warn("missed interrupt for channel %d (%u vs %u)", i, intr_cnt[i], cnt);
@@ -1113,10 +1229,9 @@ int main(int argc, char *argv[])
 			}
 
 			condSignal(common.channel[i].intr_cond);
+			mutexUnlock(common.channel[i].lock);
 			intr_cnt[i] = cnt;
 		}
-
-		mutexUnlock(common.lock);
 	}
 
 	/* Should never be reached */
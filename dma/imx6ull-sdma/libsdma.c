@@ -222,3 +222,375 @@ int sdma_free_uncached(void *vaddr, size_t size)
 
 	return munmap(vaddr, n * _PAGE_SIZE);
 }
+
+
+int sdma_chain_init(sdma_chain_t *c, sdma_t *s, unsigned cnt, int ocram)
+{
+	if ((c == NULL) || (s == NULL) || (cnt == 0))
+		return -EINVAL;
+
+	c->bd = sdma_alloc_uncached(s, cnt * sizeof(sdma_buffer_desc_t), &c->bd_paddr, ocram);
+	if (c->bd == NULL)
+		return -ENOMEM;
+
+	/* All descriptors owned by the CPU, last one wraps */
+	memset(c->bd, 0, cnt * sizeof(sdma_buffer_desc_t));
+	c->bd[cnt - 1].flags = SDMA_BD_WRAP;
+
+	c->s = s;
+	c->cnt = cnt;
+	c->head = 0;
+	c->tail = 0;
+	c->used = 0;
+
+	return 0;
+}
+
+
+void sdma_chain_free(sdma_chain_t *c)
+{
+	if (c->bd != NULL)
+		sdma_free_uncached(c->bd, c->cnt * sizeof(sdma_buffer_desc_t));
+
+	c->bd = NULL;
+	c->cnt = 0;
+}
+
+
+int sdma_chain_configure(sdma_chain_t *c, sdma_trig_t trig, unsigned event, unsigned priority)
+{
+	sdma_channel_config_t cfg;
+	sdma_dev_ctl_t dev_ctl;
+	int res;
+
+	cfg.bd_paddr = c->bd_paddr;
+	cfg.bd_cnt = c->cnt;
+	cfg.trig = trig;
+	cfg.event = event;
+	cfg.priority = priority;
+
+	if ((res = sdma_channel_configure(c->s, &cfg)) < 0)
+		return res;
+
+	/* Descriptors are re-armed on submit only */
+	dev_ctl.type = sdma_dev_ctl__auto_bd_done;
+	dev_ctl.auto_bd_done = 0;
+
+	return sdma_dev_ctl(c->s, &dev_ctl, NULL, 0);
+}
+
+
+/* Number of buffer descriptors needed for a buffer (one per page, up to 0xffff bytes each) */
+static unsigned sdma_chain_bdcnt(uintptr_t va, size_t len)
+{
+	unsigned n = 0;
+	size_t chunk;
+
+	while (len > 0) {
+		chunk = _PAGE_SIZE - (va & (_PAGE_SIZE - 1));
+		if (chunk > len)
+			chunk = len;
+		if (chunk > 0xffff)
+			chunk = 0xffff;
+
+		va += chunk;
+		len -= chunk;
+		n++;
+	}
+
+	return n;
+}
+
+
+int sdma_chain_submit(sdma_chain_t *c, const struct iovec *iov, int iovcnt, uint8_t command, int intr)
+{
+	sdma_buffer_desc_t desc;
+	unsigned i, n = 0, first = c->head;
+	uint32_t word, first_word = 0;
+	uintptr_t va;
+	size_t len, chunk;
+	int k;
+
+	for (k = 0; k < iovcnt; k++)
+		n += sdma_chain_bdcnt((uintptr_t)iov[k].iov_base, iov[k].iov_len);
+
+	if (n == 0)
+		return 0;
+
+	if (n > c->cnt - c->used)
+		return -ENOSPC;
+
+	/* Fill descriptors, the first one is handed over to SDMA last so that the channel
+	 * doesn't run into a partially built chain */
+	for (k = 0, n = 0; k < iovcnt; k++) {
+		va = (uintptr_t)iov[k].iov_base;
+		len = iov[k].iov_len;
+
+		while (len > 0) {
+			chunk = _PAGE_SIZE - (va & (_PAGE_SIZE - 1));
+			if (chunk > len)
+				chunk = len;
+			if (chunk > 0xffff)
+				chunk = 0xffff;
+
+			i = c->head;
+			c->head = (c->head + 1) % c->cnt;
+
+			c->bd[i].buffer_addr = va2pa((void *)(va & ~(uintptr_t)(_PAGE_SIZE - 1))) + (va & (_PAGE_SIZE - 1));
+			c->bd[i].ext_buffer_addr = 0;
+
+			memset(&desc, 0, sizeof(desc));
+			desc.count = chunk;
+			desc.command = command;
+			desc.flags = SDMA_BD_DONE | SDMA_BD_CONT;
+			if (i == c->cnt - 1)
+				desc.flags |= SDMA_BD_WRAP;
+			if ((len == chunk) && (k == iovcnt - 1) && intr)
+				desc.flags |= SDMA_BD_INTR;
+			memcpy(&word, &desc, sizeof(word));
+
+			if (n++ == 0) {
+				first_word = word;
+			}
+			else {
+				__sync_synchronize();
+				*(volatile uint32_t *)&c->bd[i] = word;
+			}
+
+			va += chunk;
+			len -= chunk;
+		}
+	}
+
+	__sync_synchronize();
+	*(volatile uint32_t *)&c->bd[first] = first_word;
+	__sync_synchronize();
+
+	c->used += n;
+
+	/* Channel stops on a descriptor owned by the CPU, restart it (no-op if it's still running) */
+	if (sdma_enable(c->s) < 0)
+		return -EIO;
+
+	return n;
+}
+
+
+int sdma_chain_reap(sdma_chain_t *c)
+{
+	volatile sdma_buffer_desc_t *bd;
+	int err = 0;
+
+	while (c->used > 0) {
+		bd = &c->bd[c->tail];
+		if (bd->flags & SDMA_BD_DONE)
+			break;
+
+		if (bd->flags & SDMA_BD_ERR)
+			err = -EIO;
+
+		/* Keep wrap bit for the next round */
+		bd->flags &= SDMA_BD_WRAP;
+
+		c->tail = (c->tail + 1) % c->cnt;
+		c->used--;
+	}
+
+	return (err < 0) ? err : (int)c->used;
+}
+
+
+int sdma_compl_init(sdma_compl_t *c, sdma_t *s)
+{
+	sdma_dev_ctl_t dev_ctl;
+
+	if ((c == NULL) || (s == NULL))
+		return -EINVAL;
+
+	c->ring = sdma_alloc_uncached(s, sizeof(sdma_compl_ring_t), &c->paddr, 0);
+	if (c->ring == NULL)
+		return -ENOMEM;
+
+	memset((void *)c->ring, 0, sizeof(sdma_compl_ring_t));
+	c->s = s;
+
+	dev_ctl.type = sdma_dev_ctl__compl_ring;
+	dev_ctl.compl.paddr = c->paddr;
+
+	if (sdma_dev_ctl(s, &dev_ctl, NULL, 0) < 0) {
+		sdma_free_uncached(c->ring, sizeof(sdma_compl_ring_t));
+		c->ring = NULL;
+		return -EIO;
+	}
+
+	return 0;
+}
+
+
+void sdma_compl_free(sdma_compl_t *c)
+{
+	sdma_dev_ctl_t dev_ctl;
+
+	if (c->ring == NULL)
+		return;
+
+	/* Detach before freeing, driver writes to the ring from interrupt */
+	dev_ctl.type = sdma_dev_ctl__compl_ring;
+	dev_ctl.compl.paddr = 0;
+	sdma_dev_ctl(c->s, &dev_ctl, NULL, 0);
+
+	sdma_free_uncached(c->ring, sizeof(sdma_compl_ring_t));
+	c->ring = NULL;
+}
+
+
+unsigned sdma_compl_drain(sdma_compl_t *c, uint32_t *bd_idx, unsigned n)
+{
+	sdma_compl_ring_t *ring = c->ring;
+	uint32_t head = ring->head, tail = ring->tail;
+	unsigned i, cnt = head - tail;
+
+	if (cnt > n)
+		cnt = n;
+
+	/* Read entries only after head */
+	__sync_synchronize();
+
+	if (bd_idx != NULL) {
+		for (i = 0; i < cnt; i++)
+			bd_idx[i] = ring->bd_idx[(tail + i) & (SDMA_COMPL_RING_SIZE - 1)];
+	}
+
+	/* Entries are copied before the driver may reuse them */
+	__sync_synchronize();
+	ring->tail = tail + cnt;
+
+	return cnt;
+}
+
+
+int sdma_prog_mem_write(sdma_t *s, const void *data, size_t size, addr_t addr)
+{
+	sdma_dev_ctl_t dev_ctl;
+	size_t chunk;
+
+	if ((size & 1) || (addr < SDMA_PM_RAM_START))
+		return -EINVAL;
+
+	/* Driver transfers at most one page through its buffer */
+	while (size > 0) {
+		chunk = (size > _PAGE_SIZE) ? _PAGE_SIZE : size;
+
+		dev_ctl.type = sdma_dev_ctl__prog_mem_write;
+		dev_ctl.mem.addr = addr;
+		dev_ctl.mem.len = chunk;
+
+		if (sdma_dev_ctl(s, &dev_ctl, (void *)data, chunk) < 0)
+			return -EIO;
+
+		data = (const uint8_t *)data + chunk;
+		size -= chunk;
+		addr += chunk / 2;
+	}
+
+	return 0;
+}
+
+
+/* Script names in firmware address table order */
+static const char *const sdma_fw_script_names[] = {
+	"ap_2_ap", "ap_2_bp", "ap_2_ap_fixed", "bp_2_ap", "loopback_on_dsp_side", "mcu_interrupt_only",
+	"firi_2_per", "firi_2_mcu", "per_2_firi", "mcu_2_firi", "uart_2_per", "uart_2_mcu", "per_2_app",
+	"mcu_2_app", "per_2_per", "uartsh_2_per", "uartsh_2_mcu", "per_2_shp", "mcu_2_shp", "ata_2_mcu",
+	"mcu_2_ata", "app_2_per", "app_2_mcu", "shp_2_per", "shp_2_mcu", "mshc_2_mcu", "mcu_2_mshc",
+	"spdif_2_mcu", "mcu_2_spdif", "asrc_2_mcu", "ext_mem_2_ipu", "descrambler", "dptc_dvfs", "utra_addr",
+	"ram_code_start_addr", "mcu_2_ssish", "ssish_2_mcu", "hdmi_dma"
+};
+
+#define SDMA_FW_RAM_CODE_START_IDX   (34)
+#define SDMA_FW_VERSION_MAJOR_MAX    (4)
+
+static const struct {
+	const char *name;
+	sdma_script_t addr;
+} sdma_rom_scripts[] = {
+	{ "ap_2_ap", sdma_script__ap_2_ap },
+	{ "ap_2_mcu", sdma_script__ap_2_mcu },
+	{ "mcu_2_ap", sdma_script__mcu_2_ap },
+	{ "uart_2_mcu", sdma_script__uart_2_mcu },
+	{ "shp_2_mcu", sdma_script__shp_2_mcu },
+	{ "mcu_2_shp", sdma_script__mcu_2_shp },
+	{ "uartsh_2_mcu", sdma_script__uartsh_2_mcu },
+	{ "spdif_2_mcu", sdma_script__spdif_2_mcu },
+	{ "mcu_2_spdif", sdma_script__mcu_2_spdif },
+};
+
+
+int sdma_fw_load(sdma_t *s, const void *blob, size_t size, sdma_fw_t *fw)
+{
+	const uint8_t *data = blob;
+	sdma_fw_header_t _hdr, *hdr = &_hdr;
+	int32_t addrs[SDMA_FW_MAX_SCRIPTS];
+	unsigned i, n;
+	int res;
+
+	if (blob == NULL || size < sizeof(_hdr))
+		return -EINVAL;
+
+	/* Blob may be unaligned (e.g. embedded in a file), copy instead of dereferencing */
+	memcpy(&_hdr, blob, sizeof(_hdr));
+	if (hdr->magic != SDMA_FW_MAGIC)
+		return -EINVAL;
+
+	if (hdr->version_major == 0 || hdr->version_major > SDMA_FW_VERSION_MAJOR_MAX)
+		return -EINVAL;
+
+	if (hdr->script_addrs_start > size || hdr->num_script_addrs > (size - hdr->script_addrs_start) / sizeof(int32_t))
+		return -EINVAL;
+
+	if (hdr->ram_code_start > size || hdr->ram_code_size > size - hdr->ram_code_start || (hdr->ram_code_size & 1))
+		return -EINVAL;
+
+	n = (hdr->num_script_addrs > SDMA_FW_MAX_SCRIPTS) ? SDMA_FW_MAX_SCRIPTS : hdr->num_script_addrs;
+	memcpy(addrs, data + hdr->script_addrs_start, n * sizeof(int32_t));
+
+	if (n <= SDMA_FW_RAM_CODE_START_IDX || addrs[SDMA_FW_RAM_CODE_START_IDX] < SDMA_PM_RAM_START)
+		return -EINVAL;
+
+	res = sdma_prog_mem_write(s, data + hdr->ram_code_start, hdr->ram_code_size, addrs[SDMA_FW_RAM_CODE_START_IDX]);
+	if (res < 0)
+		return res;
+
+	if (fw != NULL) {
+		fw->version_major = hdr->version_major;
+		fw->version_minor = hdr->version_minor;
+		fw->num_script_addrs = n;
+		for (i = 0; i < SDMA_FW_MAX_SCRIPTS; i++)
+			fw->script_addrs[i] = (i < n) ? addrs[i] : -1;
+	}
+
+	return 0;
+}
+
+
+int sdma_script_lookup(const sdma_fw_t *fw, const char *name)
+{
+	unsigned i;
+
+	if (name == NULL)
+		return -EINVAL;
+
+	if (fw != NULL) {
+		for (i = 0; i < sizeof(sdma_fw_script_names) / sizeof(sdma_fw_script_names[0]) && i < fw->num_script_addrs; i++) {
+			if (i != SDMA_FW_RAM_CODE_START_IDX && fw->script_addrs[i] > 0 && strcmp(name, sdma_fw_script_names[i]) == 0)
+				return fw->script_addrs[i];
+		}
+	}
+
+	for (i = 0; i < sizeof(sdma_rom_scripts) / sizeof(sdma_rom_scripts[0]); i++) {
+		if (strcmp(name, sdma_rom_scripts[i].name) == 0)
+			return sdma_rom_scripts[i].addr;
+	}
+
+	return -ENOENT;
+}
@@ -54,6 +54,22 @@ typedef enum {
 	sdma_script__mcu_2_spdif     = 1134,
 } sdma_script_t;
 
+/* First program memory address of SDMA RAM (custom scripts are loaded there) */
+#define SDMA_PM_RAM_START                       (0x1800)
+
+/* Firmware blob header (same layout as i.MX SDMA firmware files), offsets in bytes from blob start */
+#define SDMA_FW_MAGIC                           (0x414d4453) /* "SDMA" */
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version_major;
+	uint32_t version_minor;
+	uint32_t script_addrs_start; /* Offset of script address table (int32_t, -1 or 0 if absent) */
+	uint32_t num_script_addrs;
+	uint32_t ram_code_start; /* Offset of RAM code */
+	uint32_t ram_code_size; /* RAM code size in bytes */
+} sdma_fw_header_t;
+
 struct __attribute__((packed)) sdma_buffer_desc_s {
 	uint32_t count:16; /* Size of the buffer */
 	uint32_t flags:8;
@@ -112,6 +128,19 @@ typedef struct {
 	unsigned priority;
 } sdma_channel_config_t;
 
+/* Completion ring shared between the driver (producer) and the client (consumer).
+ * Filled from the interrupt handler, so completions can be drained without
+ * an mtRead round trip per interrupt. Has to fit in one page. */
+#define SDMA_COMPL_RING_SIZE                    (64) /* Power of 2 */
+
+typedef struct {
+	volatile uint32_t head; /* Completions produced, written by the driver */
+	volatile uint32_t tail; /* Completions consumed, written by the client */
+	volatile uint32_t overflow; /* Completions dropped because the ring was full */
+	uint32_t reserved;
+	volatile uint32_t bd_idx[SDMA_COMPL_RING_SIZE]; /* Current buffer descriptor (CCB) at the interrupt */
+} sdma_compl_ring_t;
+
 typedef enum {
 	sdma_dev_ctl__channel_cfg,
 	sdma_dev_ctl__data_mem_write,
@@ -121,14 +150,17 @@ typedef enum {
 	sdma_dev_ctl__enable,
 	sdma_dev_ctl__disable,
 	sdma_dev_ctl__trigger,
-	sdma_dev_ctl__ocram_alloc
+	sdma_dev_ctl__ocram_alloc,
+	sdma_dev_ctl__auto_bd_done,
+	sdma_dev_ctl__compl_ring,
+	sdma_dev_ctl__prog_mem_write
 } sdma_dev_ctl_type_t;
 
 typedef struct {
 	sdma_dev_ctl_type_t type;
 
 	union {
-		/* mem read/write */
+		/* mem read/write (program memory: addr in 16-bit words, len in bytes) */
 		struct {
 			uint16_t addr;
 			uint16_t len;
@@ -140,6 +172,14 @@ typedef struct {
 			size_t size;
 			addr_t paddr;
 		} alloc;
+
+		/* Set BD_DONE in all buffer descriptors on interrupt (set by channel cfg) */
+		int auto_bd_done;
+
+		/* Physical address of sdma_compl_ring_t (page aligned), 0 detaches the ring */
+		struct {
+			addr_t paddr;
+		} compl;
 	};
 } sdma_dev_ctl_t;
 
@@ -14,12 +14,42 @@
 #ifndef IMX6ULL_SDMA_LIB_H
 #define IMX6ULL_SDMA_LIB_H
 
+#include <sys/uio.h>
+
 #include "sdma-api.h"
 
 typedef struct {
 	oid_t oid;
 } sdma_t;
 
+/* Ring of buffer descriptors built from iovecs and recycled after SDMA completes them */
+typedef struct {
+	sdma_t *s;
+	sdma_buffer_desc_t *bd; /* Uncached buffer descriptor array */
+	addr_t bd_paddr;
+	unsigned cnt;  /* Number of buffer descriptors */
+	unsigned head; /* Next buffer descriptor to fill */
+	unsigned tail; /* Oldest buffer descriptor owned by SDMA */
+	unsigned used; /* Number of buffer descriptors owned by SDMA */
+} sdma_chain_t;
+
+#define SDMA_FW_MAX_SCRIPTS     (48)
+
+/* Loaded firmware, script addresses indexed as in i.MX SDMA firmware files */
+typedef struct {
+	uint32_t version_major;
+	uint32_t version_minor;
+	unsigned num_script_addrs;
+	int32_t script_addrs[SDMA_FW_MAX_SCRIPTS];
+} sdma_fw_t;
+
+/* Completion ring filled by the driver on every channel interrupt */
+typedef struct {
+	sdma_t *s;
+	sdma_compl_ring_t *ring;
+	addr_t paddr;
+} sdma_compl_t;
+
 int sdma_open(sdma_t *s, const char *dev_name);
 int sdma_close(sdma_t *s);
 
@@ -41,4 +71,44 @@ int sdma_wait_for_intr(sdma_t *s, uint32_t *cnt);
 void *sdma_alloc_uncached(sdma_t *s, size_t size, addr_t *paddr, int ocram);
 int sdma_free_uncached(void *vaddr, size_t size);
 
+int sdma_chain_init(sdma_chain_t *c, sdma_t *s, unsigned cnt, int ocram);
+void sdma_chain_free(sdma_chain_t *c);
+
+/* Configures channel to process the chain (context has to be set by the caller) */
+int sdma_chain_configure(sdma_chain_t *c, sdma_trig_t trig, unsigned event, unsigned priority);
+
+/* Queues transfer to/from iov buffers and (re)starts the channel. Buffers must stay valid until
+ * completion and be uncached (e.g. from sdma_alloc_uncached()). Returns number of buffer descriptors used,
+ * -ENOSPC if there are not enough free descriptors (call sdma_chain_reap() first) */
+int sdma_chain_submit(sdma_chain_t *c, const struct iovec *iov, int iovcnt, uint8_t command, int intr);
+
+/* Recycles buffer descriptors completed by SDMA, returns number of descriptors still in flight,
+ * -EIO if any completed descriptor reported an error */
+int sdma_chain_reap(sdma_chain_t *c);
+
+/* Writes SDMA RAM program memory, addr in 16-bit words (>= SDMA_PM_RAM_START), size in bytes (even) */
+int sdma_prog_mem_write(sdma_t *s, const void *data, size_t size, addr_t addr);
+
+/* Validates and loads firmware blob (sdma_fw_header_t) into SDMA RAM, fills fw (may be NULL).
+ * Returns -EINVAL on malformed blob or unsupported major version */
+int sdma_fw_load(sdma_t *s, const void *blob, size_t size, sdma_fw_t *fw);
+
+/* Returns program address of named script (e.g. "mcu_2_app", "shp_2_mcu"), looked up in
+ * loaded firmware first (fw may be NULL) and then in ROM scripts, -ENOENT if unknown */
+int sdma_script_lookup(const sdma_fw_t *fw, const char *name);
+
+/* Allocates completion ring and attaches it to the channel */
+int sdma_compl_init(sdma_compl_t *c, sdma_t *s);
+void sdma_compl_free(sdma_compl_t *c);
+
+/* Takes up to n completions without IPC, stores buffer descriptor indices in bd_idx (may be NULL).
+ * Returns number of completions taken, 0 if the ring is empty (use sdma_wait_for_intr() to block) */
+unsigned sdma_compl_drain(sdma_compl_t *c, uint32_t *bd_idx, unsigned n);
+
+/* Returns number of completions dropped because the ring was full */
+static inline uint32_t sdma_compl_overflow(const sdma_compl_t *c)
+{
+	return c->ring->overflow;
+}
+
 #endif /* IMX6ULL_SDMA_LIB_H */
@@ -14,6 +14,7 @@
 #ifndef IMXRT_EDMA_H
 #define IMXRT_EDMA_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #define EDMA_NUM_OF_CHANNELS        (32)
@@ -79,4 +80,52 @@ void edma_clear_error(unsigned channel);
 
 void edma_software_request_start(int channel);
 
+/* Channel allocation */
+
+#define EDMA_CHANNEL_ANY            (-1)
+
+/* Channel priority flags (DCHPRIn) */
+#define EDMA_PRIO_PREEMPTIBLE       (1 << 7) /* ECP: can be preempted by higher priority channel */
+#define EDMA_PRIO_NO_PREEMPT_OTHERS (1 << 6) /* DPA: can't preempt lower priority channels */
+
+/*
+ * Allocates channel (EDMA_CHANNEL_ANY picks the highest free one), returns channel number or -EBUSY.
+ * Channels with DMAMUX or hardware requests enabled are treated as used by other processes,
+ * drivers with hardcoded channels should reserve them with explicit channel number.
+ */
+int edma_channel_alloc(int channel);
+void edma_channel_free(unsigned channel);
+
+/* Priority 0-15 and EDMA_PRIO_* flags, has effect only with fixed channel arbitration (edma_init() sets round robin) */
+int edma_channel_set_priority(unsigned channel, uint8_t priority, uint8_t flags);
+
+/*
+ * Installs completion callback, called from interrupt context on major loop completion with err != 0
+ * if channel error flag is set (errors alone are reported by edma_init() error_isr). NULL removes the callback.
+ */
+int edma_channel_set_callback(unsigned channel, void (*cb)(unsigned channel, int err, void *arg), void *arg);
+
+/* Memory to memory transfers */
+
+typedef struct {
+	void *dst;
+	const void *src;
+	size_t len;
+} edma_sg_t;
+
+/*
+ * Builds TCD chain for scatter-gather copy, tcds have to be 32-byte aligned and stay valid until
+ * completion. Returns number of TCDs used or -ENOSPC. Buffers have to be cache-coherent (clean source,
+ * invalidate destination) - the library does no cache maintenance.
+ */
+int edma_sg_prepare(volatile struct edma_tcd_s *tcds, unsigned ntcds, const edma_sg_t *sg, unsigned cnt);
+
+/* Starts chain prepared by edma_sg_prepare() on allocated channel, completion is reported by callback */
+int edma_sg_start(unsigned channel, volatile struct edma_tcd_s *tcds);
+
+/* Asynchronous single buffer copy, uses up to ntcds TCDs */
+int edma_memcpy(unsigned channel, volatile struct edma_tcd_s *tcds, unsigned ntcds, void *dst, const void *src, size_t len);
+
+int edma_channel_is_done(unsigned channel);
+
 #endif /* IMXRT_EDMA_H */
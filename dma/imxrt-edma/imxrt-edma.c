@@ -11,6 +11,7 @@
  * %LICENSE%
  */
 
+#include <errno.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <sys/interrupt.h>
@@ -106,6 +107,14 @@ struct dmamux_regs_s {
 static volatile struct dmamux_regs_s* dmamux_regs;
 static volatile struct edma_regs_s* edma_regs;
 
+/* Channels allocated in this process and their completion callbacks */
+static struct {
+	uint32_t used;
+	uint32_t irq_installed; /* Per IRQ line (channel % 16) */
+	void (*cb[EDMA_NUM_OF_CHANNELS])(unsigned channel, int err, void *arg);
+	void *arg[EDMA_NUM_OF_CHANNELS];
+} edma_alloc;
+
 void dmamux_set_source(uint8_t channel, uint8_t source)
 {
 	/*
@@ -330,3 +339,226 @@ uint32_t edma_error_channel(void)
 {
 	return edma_regs->err;
 }
+
+/* TCD CSR bits */
+#define TCD_CSR_START     (1 << 0)
+#define TCD_CSR_INTMAJOR  (1 << 1)
+#define TCD_CSR_DREQ      (1 << 3)
+#define TCD_CSR_ESG       (1 << 4)
+#define TCD_CSR_DONE      (1 << 7)
+
+/* Max minor loop byte count with minor loop mapping enabled and no offsets (NBYTES_MLOFFNO) */
+#define TCD_NBYTES_MAX    (0x3fffffff)
+
+static int edma_channel_is_free(unsigned channel)
+{
+	if ((edma_alloc.used & (1u << channel)) != 0)
+		return 0;
+
+	/* Configured by another process (or a driver with hardcoded channels) */
+	return !dmamux_channel_is_enabled(channel) && !(edma_regs->erq & (1u << channel));
+}
+
+int edma_channel_alloc(int channel)
+{
+	uint32_t mask, prev;
+	int i;
+
+	if (channel >= EDMA_NUM_OF_CHANNELS)
+		return -EINVAL;
+
+	for (i = EDMA_NUM_OF_CHANNELS - 1; i >= 0; i--) {
+		if (channel != EDMA_CHANNEL_ANY)
+			i = channel;
+
+		mask = 1u << i;
+		if (edma_channel_is_free(i)) {
+			prev = __atomic_fetch_or(&edma_alloc.used, mask, __ATOMIC_ACQ_REL);
+			if ((prev & mask) == 0)
+				return i;
+		}
+
+		if (channel != EDMA_CHANNEL_ANY)
+			break;
+	}
+
+	return -EBUSY;
+}
+
+void edma_channel_free(unsigned channel)
+{
+	if (channel >= EDMA_NUM_OF_CHANNELS)
+		return;
+
+	edma_channel_disable(channel);
+	edma_alloc.cb[channel] = NULL;
+	__atomic_fetch_and(&edma_alloc.used, ~(1u << channel), __ATOMIC_ACQ_REL);
+}
+
+int edma_channel_set_priority(unsigned channel, uint8_t priority, uint8_t flags)
+{
+	volatile uint8_t *dchpri;
+
+	if (channel >= EDMA_NUM_OF_CHANNELS || priority > 0xf)
+		return -EINVAL;
+
+	/* DCHPRIn registers are byte-swapped within each word */
+	dchpri = &edma_regs->dchpri3 + ((channel & ~3u) | (3 - (channel & 3)));
+	*dchpri = (*dchpri & 0x30) | (flags & (EDMA_PRIO_PREEMPTIBLE | EDMA_PRIO_NO_PREEMPT_OTHERS)) | priority;
+
+	return 0;
+}
+
+static int edma_alloc_irq_handler(unsigned int n, void *arg)
+{
+	unsigned line = (uintptr_t)arg, channel;
+	int err;
+
+	/* Line is shared by channels n and n + 16 */
+	for (channel = line; channel < EDMA_NUM_OF_CHANNELS; channel += 16) {
+		if (edma_alloc.cb[channel] == NULL)
+			continue;
+
+		err = (edma_regs->err & (1u << channel)) != 0;
+		if (!err && !(edma_regs->_int & (1u << channel)))
+			continue;
+
+		edma_clear_interrupt(channel);
+		if (err)
+			edma_clear_error(channel);
+
+		edma_alloc.cb[channel](channel, err, edma_alloc.arg[channel]);
+	}
+
+	return 0;
+}
+
+int edma_channel_set_callback(unsigned channel, void (*cb)(unsigned channel, int err, void *arg), void *arg)
+{
+	handle_t handle;
+	unsigned line;
+
+	if (channel >= EDMA_NUM_OF_CHANNELS || (edma_alloc.used & (1u << channel)) == 0)
+		return -EINVAL;
+
+	edma_alloc.cb[channel] = NULL;
+	edma_alloc.arg[channel] = arg;
+	edma_alloc.cb[channel] = cb;
+
+	line = channel % 16;
+	if (cb != NULL && (__atomic_fetch_or(&edma_alloc.irq_installed, 1u << line, __ATOMIC_ACQ_REL) & (1u << line)) == 0)
+		interrupt(EDMA_CHANNEL_IRQ(line), edma_alloc_irq_handler, (void *)(uintptr_t)line, 0, &handle);
+
+	return 0;
+}
+
+/* Returns largest transfer size (1, 2, 4, 8, 32) both addresses and length are aligned to */
+static unsigned edma_xfer_size(uintptr_t dst, uintptr_t src, size_t len)
+{
+	uintptr_t align = dst | src | len;
+
+	if ((align & 0x1f) == 0)
+		return 32;
+	if ((align & 0x7) == 0)
+		return 8;
+	if ((align & 0x3) == 0)
+		return 4;
+	if ((align & 0x1) == 0)
+		return 2;
+
+	return 1;
+}
+
+int edma_sg_prepare(volatile struct edma_tcd_s *tcds, unsigned ntcds, const edma_sg_t *sg, unsigned cnt)
+{
+	unsigned i, n = 0, xsize;
+	uintptr_t dst, src;
+	size_t len, chunk;
+
+	if (((uintptr_t)tcds & TCD_REQUIRED_ALIGNMENT_MASK) != 0)
+		return -EINVAL;
+
+	for (i = 0; i < cnt; i++) {
+		dst = (uintptr_t)sg[i].dst;
+		src = (uintptr_t)sg[i].src;
+		len = sg[i].len;
+
+		while (len > 0) {
+			if (n == ntcds)
+				return -ENOSPC;
+
+			/*
+			 * Software start (SSRT or CSR.START) runs a single minor loop,
+			 * so the whole chunk goes into NBYTES with one major iteration
+			 */
+			xsize = edma_xfer_size(dst, src, len);
+			chunk = len;
+			if (chunk > TCD_NBYTES_MAX)
+				chunk = TCD_NBYTES_MAX & ~(size_t)(xsize - 1);
+
+			tcds[n].saddr = src;
+			tcds[n].soff = xsize;
+			tcds[n].attr = (edma_get_tcd_attr_xsize(xsize) << 8) | edma_get_tcd_attr_xsize(xsize);
+			tcds[n].nbytes_mlno = chunk;
+			tcds[n].slast = 0;
+			tcds[n].daddr = dst;
+			tcds[n].doff = xsize;
+			tcds[n].citer_elinkno = 1;
+			tcds[n].biter_elinkno = 1;
+			tcds[n].dlast_sga = 0;
+			/* Following TCDs start on their own when loaded */
+			tcds[n].csr = (n == 0) ? 0 : TCD_CSR_START;
+
+			if (n > 0) {
+				tcds[n - 1].dlast_sga = (uint32_t)&tcds[n];
+				tcds[n - 1].csr |= TCD_CSR_ESG;
+			}
+
+			dst += chunk;
+			src += chunk;
+			len -= chunk;
+			n++;
+		}
+	}
+
+	if (n == 0)
+		return -EINVAL;
+
+	tcds[n - 1].csr |= TCD_CSR_INTMAJOR | TCD_CSR_DREQ;
+
+	return n;
+}
+
+int edma_sg_start(unsigned channel, volatile struct edma_tcd_s *tcds)
+{
+	if (channel >= EDMA_NUM_OF_CHANNELS || (edma_alloc.used & (1u << channel)) == 0)
+		return -EINVAL;
+
+	/* Memory to memory: software requests only */
+	dmamux_channel_disable(channel);
+	edma_channel_disable(channel);
+	edma_clear_error(channel);
+	edma_install_tcd(tcds, channel);
+	edma_software_request_start(channel);
+
+	return 0;
+}
+
+int edma_memcpy(unsigned channel, volatile struct edma_tcd_s *tcds, unsigned ntcds, void *dst, const void *src, size_t len)
+{
+	edma_sg_t sg = { .dst = dst, .src = src, .len = len };
+	int res;
+
+	if ((res = edma_sg_prepare(tcds, ntcds, &sg, 1)) < 0)
+		return res;
+
+	return edma_sg_start(channel, tcds);
+}
+
+int edma_channel_is_done(unsigned channel)
+{
+	if (channel >= EDMA_NUM_OF_CHANNELS)
+		return -EINVAL;
+
+	return !!(edma_regs->tcd[channel].csr & TCD_CSR_DONE);
+}
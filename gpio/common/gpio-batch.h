@@ -0,0 +1,83 @@
+/*
+ * Phoenix-RTOS
+ *
+ * GPIO batched operations, common for GPIO servers
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _PHOENIX_GPIO_BATCH_H
+#define _PHOENIX_GPIO_BATCH_H
+
+#include <stdint.h>
+
+#include <sys/msg.h>
+#include <sys/types.h>
+
+
+/* Devctl type, the first word of msg.i.raw, recognized by all GPIO servers */
+#define GPIO_DEVCTL_BATCH 0x47420000
+
+/* Maximum number of operations in one batch */
+#define GPIO_BATCH_MAX 64
+
+/* Maximum sequencing delay [us], the server busy waits holding its lock */
+#define GPIO_BATCH_DELAY_MAX 10000
+
+
+enum {
+	gpio_batch_write = 0, /* port = (port & ~mask) | (val & mask) */
+	gpio_batch_read,      /* port state appended to results */
+	gpio_batch_dir_write, /* dir = (dir & ~mask) | (val & mask), 1 - output */
+	gpio_batch_dir_read,  /* dir appended to results */
+	gpio_batch_delay,     /* busy wait for val [us] */
+};
+
+
+/* Single operation, bank is the port number as in the device name (e.g. /dev/gpio1) */
+typedef struct {
+	uint8_t op;
+	uint8_t bank;
+	uint16_t reserved;
+	uint32_t mask;
+	uint32_t val;
+} __attribute__((packed)) gpio_batchOp_t;
+
+
+typedef struct {
+	unsigned int type; /* GPIO_DEVCTL_BATCH */
+} __attribute__((packed)) gpio_devctl_batch_t;
+
+
+/* Executes ops in order in a single message, under one server lock. The batch is validated before
+ * anything is applied, read results (one per read op) are stored in results. Returns 0 or a negative error */
+extern int gpiobatch_exec(oid_t *oid, const gpio_batchOp_t *ops, unsigned int n, uint32_t *results, unsigned int nresults);
+
+
+/* Server side, hardware access callbacks of the GPIO server */
+typedef struct {
+	unsigned int bankMin;
+	unsigned int bankMax;
+	int (*read)(void *arg, unsigned int bank, uint32_t *val);
+	int (*write)(void *arg, unsigned int bank, uint32_t mask, uint32_t val);
+	int (*readDir)(void *arg, unsigned int bank, uint32_t *val);
+	int (*writeDir)(void *arg, unsigned int bank, uint32_t mask, uint32_t val);
+} gpio_batchHw_t;
+
+
+/* Returns 1 if the devctl message is a batch request */
+static inline int gpiobatch_isBatch(const msg_t *msg)
+{
+	return (((const gpio_devctl_batch_t *)msg->i.raw)->type == GPIO_DEVCTL_BATCH) ? 1 : 0;
+}
+
+
+/* Validates and executes the batch request, the caller holds its lock. Returns value for msg.o.err */
+extern int gpiobatch_handle(const gpio_batchHw_t *hw, void *arg, msg_t *msg);
+
+
+#endif /* _PHOENIX_GPIO_BATCH_H */
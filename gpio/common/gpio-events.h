@@ -0,0 +1,113 @@
+/*
+ * Phoenix-RTOS
+ *
+ * GPIO pin interrupt events, common for GPIO servers
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _PHOENIX_GPIO_EVENTS_H
+#define _PHOENIX_GPIO_EVENTS_H
+
+#include <stdint.h>
+
+#include <sys/msg.h>
+#include <sys/types.h>
+
+
+/* Maximum number of banks of a GPIO server */
+#define GPIOEV_BANKS 8
+
+/* Pins per bank */
+#define GPIOEV_PINS 32
+
+/* Pin interrupt mode disabling the interrupt, other modes are defined by the server */
+#define GPIOEV_IRQ_OFF 0
+
+
+/* Pin interrupt event */
+typedef struct {
+	time_t time;  /* Event time [us], gettime() time base */
+	uint8_t bank; /* Bank number as used by the server */
+	uint8_t pin;  /* Pin number */
+	uint8_t val;  /* Pin state sampled in the interrupt */
+	uint8_t lost; /* Events were dropped before this one */
+} gpio_event_t;
+
+
+/* Pin edges wait result, beginning of msg.o.raw */
+typedef struct {
+	uint32_t val; /* Number of edges since the last wait */
+	time_t time;  /* Time of the last edge [us] */
+} __attribute__((packed)) gpioev_wait_t;
+
+
+/* Hardware callbacks of the GPIO server, called with gpioev_t lock held */
+typedef struct {
+	int (*irqSet)(void *arg, unsigned int bank, unsigned int pin, unsigned int mode); /* Programs pin interrupt mode */
+	void (*irqRearm)(void *arg, unsigned int bank, unsigned int pin);                /* Re-enables pin level interrupt */
+	void (*kick)(void *arg);                                                          /* Makes the interrupt thread recompute its timeout */
+} gpioev_hw_t;
+
+
+typedef struct _gpioev_waiter_t gpioev_waiter_t;
+typedef struct _gpioev_client_t gpioev_client_t;
+
+
+typedef struct {
+	const gpioev_hw_t *hw;
+	void *arg;
+	uint32_t port;         /* Server port deferred requests are responded on */
+	unsigned int nbanks;   /* Banks are indexed from 0 */
+	unsigned int bankBase; /* Bank number reported in events for bank index 0 */
+
+	handle_t lock; /* Protects fields below */
+	uint32_t enabled[GPIOEV_BANKS];             /* Pins with interrupt enabled */
+	uint32_t waited[GPIOEV_BANKS];              /* Pins used by gpioev_waitPin(), interrupt stays enabled */
+	uint8_t mode[GPIOEV_BANKS][GPIOEV_PINS];    /* Pins interrupt mode */
+	uint8_t users[GPIOEV_BANKS][GPIOEV_PINS];   /* Clients subscribed to the pin */
+	uint32_t edges[GPIOEV_BANKS][GPIOEV_PINS];  /* Edges not yet reported by gpioev_waitPin() */
+	time_t time[GPIOEV_BANKS][GPIOEV_PINS];     /* Time of the last edge */
+	gpioev_waiter_t *waiters;
+	gpioev_waiter_t *readers;
+	gpioev_client_t *clients;
+} gpioev_t;
+
+
+/* Initializes events state of a server with nbanks banks, responses are sent on port */
+extern int gpioev_init(gpioev_t *ev, const gpioev_hw_t *hw, void *arg, uint32_t port, unsigned int nbanks, unsigned int bankBase);
+
+
+/* Subscribes process to pin events in the server defined mode, GPIOEV_IRQ_OFF unsubscribes. Pin and mode are validated by the caller */
+extern int gpioev_irqConfig(gpioev_t *ev, pid_t pid, unsigned int bank, unsigned int pin, unsigned int mode);
+
+
+/* Reads events of msg->pid into msg->o.data (timeout [us], 0 - none). Returns 1 if the response has been deferred */
+extern int gpioev_readEvents(gpioev_t *ev, msg_t *msg, msg_rid_t rid, uint32_t nonblock, uint32_t timeout);
+
+
+/* Waits for pin edges, the pin interrupt is enabled in mode unless already used (timeout [us], 0 - none).
+ * Returns 1 if the response has been deferred */
+extern int gpioev_waitPin(gpioev_t *ev, msg_t *msg, msg_rid_t rid, unsigned int bank, unsigned int pin, unsigned int mode, uint32_t timeout);
+
+
+/* Interrupt thread side, called with ev->lock held */
+
+
+/* Returns time to the nearest request timeout [us], 0 - none */
+extern time_t _gpioev_timeout(gpioev_t *ev, time_t now);
+
+
+/* Queues events of bank pins set in pending to the subscribed clients */
+extern void _gpioev_push(gpioev_t *ev, unsigned int bank, uint32_t pending, uint32_t data, time_t time, int lost);
+
+
+/* Responds deferred requests which got events or timed out */
+extern void _gpioev_respond(gpioev_t *ev, time_t now);
+
+
+#endif /* _PHOENIX_GPIO_EVENTS_H */
@@ -0,0 +1,133 @@
+/*
+ * Phoenix-RTOS
+ *
+ * GPIO batched operations, common for GPIO servers
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <errno.h>
+#include <stddef.h>
+
+#include <sys/msg.h>
+#include <sys/threads.h>
+#include <sys/types.h>
+
+#include <gpio-batch.h>
+
+
+int gpiobatch_exec(oid_t *oid, const gpio_batchOp_t *ops, unsigned int n, uint32_t *results, unsigned int nresults)
+{
+	msg_t msg = { 0 };
+	gpio_devctl_batch_t *in = (gpio_devctl_batch_t *)msg.i.raw;
+	int err;
+
+	if ((oid == NULL) || (ops == NULL) || (n == 0) || (n > GPIO_BATCH_MAX)) {
+		return -EINVAL;
+	}
+
+	msg.type = mtDevCtl;
+	msg.oid = *oid;
+	in->type = GPIO_DEVCTL_BATCH;
+	msg.i.data = (void *)ops;
+	msg.i.size = n * sizeof(*ops);
+	msg.o.data = results;
+	msg.o.size = (results != NULL) ? nresults * sizeof(*results) : 0;
+
+	err = msgSend(oid->port, &msg);
+	if (err < 0) {
+		return err;
+	}
+
+	return msg.o.err;
+}
+
+
+static void gpiobatch_delay(uint32_t us)
+{
+	time_t start, now;
+
+	gettime(&start, NULL);
+	do {
+		gettime(&now, NULL);
+	} while ((now - start) < us);
+}
+
+
+int gpiobatch_handle(const gpio_batchHw_t *hw, void *arg, msg_t *msg)
+{
+	const gpio_batchOp_t *ops = msg->i.data;
+	uint32_t *results = msg->o.data;
+	unsigned int i, n, nread = 0, nresults;
+	int err = EOK;
+
+	if ((ops == NULL) || (msg->i.size == 0) || ((msg->i.size % sizeof(*ops)) != 0)) {
+		return -EINVAL;
+	}
+
+	n = msg->i.size / sizeof(*ops);
+	nresults = (results != NULL) ? msg->o.size / sizeof(*results) : 0;
+	if (n > GPIO_BATCH_MAX) {
+		return -EINVAL;
+	}
+
+	/* Nothing is applied unless the whole batch is valid */
+	for (i = 0; i < n; i++) {
+		switch (ops[i].op) {
+			case gpio_batch_read:
+			case gpio_batch_dir_read:
+				if (nread++ >= nresults) {
+					return -EINVAL;
+				}
+				/* fall-through */
+			case gpio_batch_write:
+			case gpio_batch_dir_write:
+				if ((ops[i].bank < hw->bankMin) || (ops[i].bank > hw->bankMax)) {
+					return -EINVAL;
+				}
+				break;
+
+			case gpio_batch_delay:
+				if (ops[i].val > GPIO_BATCH_DELAY_MAX) {
+					return -EINVAL;
+				}
+				break;
+
+			default:
+				return -EINVAL;
+		}
+	}
+
+	for (i = 0, nread = 0; (i < n) && (err == EOK); i++) {
+		switch (ops[i].op) {
+			case gpio_batch_write:
+				err = hw->write(arg, ops[i].bank, ops[i].mask, ops[i].val);
+				break;
+
+			case gpio_batch_read:
+				err = hw->read(arg, ops[i].bank, &results[nread++]);
+				break;
+
+			case gpio_batch_dir_write:
+				err = hw->writeDir(arg, ops[i].bank, ops[i].mask, ops[i].val);
+				break;
+
+			case gpio_batch_dir_read:
+				err = hw->readDir(arg, ops[i].bank, &results[nread++]);
+				break;
+
+			case gpio_batch_delay:
+				gpiobatch_delay(ops[i].val);
+				break;
+
+			default:
+				break;
+		}
+	}
+
+	return err;
+}
@@ -0,0 +1,462 @@
+/*
+ * Phoenix-RTOS
+ *
+ * GPIO pin interrupt events, common for GPIO servers
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/msg.h>
+#include <sys/threads.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+#include <gpio-events.h>
+
+
+/* Interrupt events queue per client process (power of 2) */
+#ifndef GPIOEV_QUEUE_SIZE
+#define GPIOEV_QUEUE_SIZE 64
+#endif
+
+
+/* Client waiting for a pin edge or for events, responded from the interrupt thread */
+struct _gpioev_waiter_t {
+	gpioev_waiter_t *next;
+	gpioev_client_t *client; /* Events reader, NULL for pin edge wait */
+	unsigned int bank;
+	unsigned int pin;
+	time_t end; /* Timeout, 0 - none */
+	msg_rid_t rid;
+	msg_t msg;
+};
+
+
+/* Process subscribed to pin interrupt events */
+struct _gpioev_client_t {
+	gpioev_client_t *next;
+	pid_t pid;
+	uint32_t pins[GPIOEV_BANKS];
+	gpio_event_t queue[GPIOEV_QUEUE_SIZE];
+	unsigned int head;
+	unsigned int tail;
+	int lost; /* Events dropped since the last queued one */
+};
+
+
+int gpioev_init(gpioev_t *ev, const gpioev_hw_t *hw, void *arg, uint32_t port, unsigned int nbanks, unsigned int bankBase)
+{
+	if (nbanks > GPIOEV_BANKS) {
+		return -EINVAL;
+	}
+
+	memset(ev, 0, sizeof(*ev));
+	ev->hw = hw;
+	ev->arg = arg;
+	ev->port = port;
+	ev->nbanks = nbanks;
+	ev->bankBase = bankBase;
+
+	return mutexCreate(&ev->lock);
+}
+
+
+/* Sets pin interrupt mode unless the pin is used with another one */
+static int _gpioev_pinGet(gpioev_t *ev, unsigned int bank, unsigned int pin, unsigned int mode, unsigned int owned)
+{
+	uint32_t bit = 1u << pin;
+	int err;
+
+	if ((ev->enabled[bank] & bit) != 0) {
+		if (ev->mode[bank][pin] == mode) {
+			return EOK;
+		}
+
+		/* Only the sole user may change the mode */
+		if (((ev->waited[bank] & bit) != 0) || (ev->users[bank][pin] > owned)) {
+			return -EBUSY;
+		}
+	}
+
+	err = ev->hw->irqSet(ev->arg, bank, pin, mode);
+	if (err < 0) {
+		return err;
+	}
+	ev->enabled[bank] |= bit;
+	ev->mode[bank][pin] = mode;
+
+	return EOK;
+}
+
+
+static void _gpioev_pinPut(gpioev_t *ev, unsigned int bank, unsigned int pin)
+{
+	uint32_t bit = 1u << pin;
+
+	ev->users[bank][pin]--;
+	if ((ev->users[bank][pin] == 0) && ((ev->waited[bank] & bit) == 0)) {
+		(void)ev->hw->irqSet(ev->arg, bank, pin, GPIOEV_IRQ_OFF);
+		ev->enabled[bank] &= ~bit;
+		ev->mode[bank][pin] = GPIOEV_IRQ_OFF;
+	}
+}
+
+
+static gpioev_client_t *_gpioev_clientGet(gpioev_t *ev, pid_t pid, int create)
+{
+	gpioev_client_t *c;
+
+	for (c = ev->clients; c != NULL; c = c->next) {
+		if (c->pid == pid) {
+			return c;
+		}
+	}
+
+	if (create == 0) {
+		return NULL;
+	}
+
+	c = calloc(1, sizeof(*c));
+	if (c != NULL) {
+		c->pid = pid;
+		c->next = ev->clients;
+		ev->clients = c;
+	}
+
+	return c;
+}
+
+
+static int _gpioev_clientIdle(gpioev_t *ev, const gpioev_client_t *client)
+{
+	unsigned int i;
+
+	for (i = 0; i < ev->nbanks; i++) {
+		if (client->pins[i] != 0) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+
+/* Removes client without subscriptions, its pending reads fail */
+static void _gpioev_clientRemove(gpioev_t *ev, gpioev_client_t *client)
+{
+	gpioev_client_t **c;
+	gpioev_waiter_t *w, **prev = &ev->readers;
+
+	while ((w = *prev) != NULL) {
+		if (w->client != client) {
+			prev = &w->next;
+			continue;
+		}
+		*prev = w->next;
+		w->msg.o.err = -ENOENT;
+		msgRespond(ev->port, &w->msg, w->rid);
+		free(w);
+	}
+
+	for (c = &ev->clients; *c != NULL; c = &(*c)->next) {
+		if (*c == client) {
+			*c = client->next;
+			free(client);
+			break;
+		}
+	}
+}
+
+
+int gpioev_irqConfig(gpioev_t *ev, pid_t pid, unsigned int bank, unsigned int pin, unsigned int mode)
+{
+	gpioev_client_t *client;
+	uint32_t bit = 1u << pin;
+	int err = EOK;
+
+	if ((bank >= ev->nbanks) || (pin >= GPIOEV_PINS)) {
+		return -EINVAL;
+	}
+
+	mutexLock(ev->lock);
+	client = _gpioev_clientGet(ev, pid, (mode != GPIOEV_IRQ_OFF) ? 1 : 0);
+
+	if (mode == GPIOEV_IRQ_OFF) {
+		if ((client != NULL) && ((client->pins[bank] & bit) != 0)) {
+			client->pins[bank] &= ~bit;
+			_gpioev_pinPut(ev, bank, pin);
+			if (_gpioev_clientIdle(ev, client) != 0) {
+				_gpioev_clientRemove(ev, client);
+			}
+		}
+	}
+	else if (client == NULL) {
+		err = -ENOMEM;
+	}
+	else {
+		err = _gpioev_pinGet(ev, bank, pin, mode, ((client->pins[bank] & bit) != 0) ? 1 : 0);
+		if ((err == EOK) && ((client->pins[bank] & bit) == 0)) {
+			client->pins[bank] |= bit;
+			ev->users[bank][pin]++;
+		}
+		else if (_gpioev_clientIdle(ev, client) != 0) {
+			_gpioev_clientRemove(ev, client);
+		}
+	}
+	mutexUnlock(ev->lock);
+
+	return err;
+}
+
+
+/* Copies queued events to the reader buffer, returns number of events */
+static int _gpioev_clientRead(gpioev_t *ev, gpioev_client_t *client, msg_t *msg)
+{
+	gpio_event_t *events = msg->o.data;
+	unsigned int n = msg->o.size / sizeof(gpio_event_t), cnt = 0;
+
+	for (; (client->tail != client->head) && (cnt < n); client->tail++, cnt++) {
+		events[cnt] = client->queue[client->tail & (GPIOEV_QUEUE_SIZE - 1)];
+		/* Level interrupt is enabled again once reported */
+		ev->hw->irqRearm(ev->arg, events[cnt].bank - ev->bankBase, events[cnt].pin);
+	}
+
+	return cnt;
+}
+
+
+static void _gpioev_clientPush(gpioev_client_t *client, const gpio_event_t *evt)
+{
+	gpio_event_t *e;
+
+	if ((client->head - client->tail) == GPIOEV_QUEUE_SIZE) {
+		client->lost = 1;
+		return;
+	}
+
+	e = &client->queue[client->head & (GPIOEV_QUEUE_SIZE - 1)];
+	*e = *evt;
+	e->lost |= client->lost;
+	client->lost = 0;
+	client->head++;
+}
+
+
+static void _gpioev_waiterAdd(gpioev_t *ev, gpioev_waiter_t **list, gpioev_waiter_t *w, uint32_t timeout)
+{
+	time_t now;
+
+	w->end = 0;
+	if (timeout != 0) {
+		gettime(&now, NULL);
+		w->end = now + timeout;
+	}
+
+	w->next = *list;
+	*list = w;
+
+	/* Interrupt thread recomputes its timeout */
+	if (timeout != 0) {
+		ev->hw->kick(ev->arg);
+	}
+}
+
+
+int gpioev_readEvents(gpioev_t *ev, msg_t *msg, msg_rid_t rid, uint32_t nonblock, uint32_t timeout)
+{
+	gpioev_client_t *client;
+	gpioev_waiter_t *w;
+
+	if ((msg->o.data == NULL) || (msg->o.size < sizeof(gpio_event_t))) {
+		msg->o.err = -EINVAL;
+		return 0;
+	}
+
+	mutexLock(ev->lock);
+	client = _gpioev_clientGet(ev, msg->pid, 0);
+	if (client == NULL) {
+		mutexUnlock(ev->lock);
+		msg->o.err = -ENOENT;
+		return 0;
+	}
+
+	if ((client->tail != client->head) || (nonblock != 0)) {
+		msg->o.err = _gpioev_clientRead(ev, client, msg);
+		mutexUnlock(ev->lock);
+		return 0;
+	}
+
+	w = malloc(sizeof(*w));
+	if (w == NULL) {
+		mutexUnlock(ev->lock);
+		msg->o.err = -ENOMEM;
+		return 0;
+	}
+
+	w->client = client;
+	w->rid = rid;
+	w->msg = *msg;
+	_gpioev_waiterAdd(ev, &ev->readers, w, timeout);
+	mutexUnlock(ev->lock);
+
+	return 1;
+}
+
+
+static void _gpioev_respondWait(gpioev_t *ev, msg_t *msg, msg_rid_t rid, unsigned int bank, unsigned int pin)
+{
+	gpioev_wait_t *out = (gpioev_wait_t *)msg->o.raw;
+
+	out->val = ev->edges[bank][pin];
+	out->time = ev->time[bank][pin];
+	msg->o.err = EOK;
+	ev->edges[bank][pin] = 0;
+
+	msgRespond(ev->port, msg, rid);
+	ev->hw->irqRearm(ev->arg, bank, pin);
+}
+
+
+int gpioev_waitPin(gpioev_t *ev, msg_t *msg, msg_rid_t rid, unsigned int bank, unsigned int pin, unsigned int mode, uint32_t timeout)
+{
+	gpioev_waiter_t *w;
+	int err;
+
+	if ((bank >= ev->nbanks) || (pin >= GPIOEV_PINS) || (mode == GPIOEV_IRQ_OFF)) {
+		msg->o.err = -EINVAL;
+		return 0;
+	}
+
+	mutexLock(ev->lock);
+	if ((ev->enabled[bank] & (1u << pin)) == 0) {
+		err = _gpioev_pinGet(ev, bank, pin, mode, 0);
+		if (err < 0) {
+			mutexUnlock(ev->lock);
+			msg->o.err = err;
+			return 0;
+		}
+	}
+	/* Edges are counted for the pin from now on, whatever mode it uses */
+	ev->waited[bank] |= 1u << pin;
+
+	/* Edges occurred since the last wait */
+	if (ev->edges[bank][pin] != 0) {
+		_gpioev_respondWait(ev, msg, rid, bank, pin);
+		mutexUnlock(ev->lock);
+		return 1;
+	}
+
+	w = malloc(sizeof(*w));
+	if (w == NULL) {
+		mutexUnlock(ev->lock);
+		msg->o.err = -ENOMEM;
+		return 0;
+	}
+
+	w->client = NULL;
+	w->bank = bank;
+	w->pin = pin;
+	w->rid = rid;
+	w->msg = *msg;
+	_gpioev_waiterAdd(ev, &ev->waiters, w, timeout);
+	mutexUnlock(ev->lock);
+
+	return 1;
+}
+
+
+static time_t gpioev_nearestEnd(gpioev_waiter_t *w, time_t now, time_t timeout)
+{
+	for (; w != NULL; w = w->next) {
+		if ((w->end != 0) && ((timeout == 0) || ((w->end - now) < timeout))) {
+			timeout = (w->end > now) ? (w->end - now) : 1;
+		}
+	}
+
+	return timeout;
+}
+
+
+time_t _gpioev_timeout(gpioev_t *ev, time_t now)
+{
+	return gpioev_nearestEnd(ev->waiters, now, gpioev_nearestEnd(ev->readers, now, 0));
+}
+
+
+void _gpioev_push(gpioev_t *ev, unsigned int bank, uint32_t pending, uint32_t data, time_t time, int lost)
+{
+	gpioev_client_t *c;
+	gpio_event_t evt;
+	unsigned int j;
+
+	for (j = 0; j < GPIOEV_PINS; j++) {
+		if ((pending & (1u << j)) == 0) {
+			continue;
+		}
+
+		ev->edges[bank][j]++;
+		ev->time[bank][j] = time;
+
+		evt.time = time;
+		evt.bank = bank + ev->bankBase;
+		evt.pin = j;
+		evt.val = ((data & (1u << j)) != 0) ? 1 : 0;
+		evt.lost = (lost != 0) ? 1 : 0;
+
+		for (c = ev->clients; c != NULL; c = c->next) {
+			if ((c->pins[bank] & (1u << j)) != 0) {
+				_gpioev_clientPush(c, &evt);
+			}
+		}
+	}
+}
+
+
+void _gpioev_respond(gpioev_t *ev, time_t now)
+{
+	gpioev_waiter_t *w, **prev;
+
+	prev = &ev->waiters;
+	while ((w = *prev) != NULL) {
+		if (ev->edges[w->bank][w->pin] != 0) {
+			_gpioev_respondWait(ev, &w->msg, w->rid, w->bank, w->pin);
+		}
+		else if ((w->end != 0) && (now >= w->end)) {
+			w->msg.o.err = -ETIME;
+			msgRespond(ev->port, &w->msg, w->rid);
+		}
+		else {
+			prev = &w->next;
+			continue;
+		}
+
+		*prev = w->next;
+		free(w);
+	}
+
+	prev = &ev->readers;
+	while ((w = *prev) != NULL) {
+		if (w->client->tail != w->client->head) {
+			w->msg.o.err = _gpioev_clientRead(ev, w->client, &w->msg);
+		}
+		else if ((w->end != 0) && (now >= w->end)) {
+			w->msg.o.err = -ETIME;
+		}
+		else {
+			prev = &w->next;
+			continue;
+		}
+
+		*prev = w->next;
+		msgRespond(ev->port, &w->msg, w->rid);
+		free(w);
+	}
+}
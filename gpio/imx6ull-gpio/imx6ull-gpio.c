@@ -25,8 +25,12 @@
 #include <sys/msg.h>
 #include <sys/file.h>
 #include <sys/platform.h>
+#include <sys/interrupt.h>
+#include <sys/time.h>
 #include <posix/utils.h>
 #include <phoenix/arch/armv7a/imx6ull/imx6ull.h>
+#include <gpio-batch.h>
+#include <gpio-events.h>
 
 #include "imx6ull-gpio.h"
 
@@ -37,6 +41,21 @@ enum { gpio1 = 0, gpio2, gpio3, gpio4, gpio5, dir1, dir2, dir3, dir4, dir5 };
 enum { dr = 0, gdir, psr, icr1, icr2, imr, isr, edge };
 
 
+/* GPIO1 pins 0-15 combined interrupt, followed by pins 16-31 and the next ports */
+#define GPIO_IRQ_BASE (32 + 66)
+
+/* Interrupt status snapshots between the ISR and the interrupt thread (power of 2) */
+#define GPIO_ISR_EVENTS 32
+
+
+typedef struct {
+	uint32_t pending;
+	uint32_t data;
+	uint8_t bank;
+	uint8_t lost;
+} isrevent_t;
+
+
 struct {
 	struct {
 		volatile uint32_t *base;
@@ -44,6 +63,21 @@ struct {
 	} gpio[5];
 
 	uint32_t port;
+
+	struct {
+		/* Written by the ISR (head, lost) and by the interrupt thread (tail) */
+		isrevent_t events[GPIO_ISR_EVENTS];
+		unsigned int head;
+		unsigned int tail;
+		uint8_t lost;
+		volatile uint32_t level[5]; /* Pins with level interrupt, masked by the ISR */
+
+		handle_t cond; /* Signaled by the ISR, waited on with ev.lock */
+		gpioev_t ev;   /* Pin interrupt events and deferred requests */
+
+		handle_t inth[10];
+		char stack[2048] __attribute__((aligned(8)));
+	} irq;
 } common;
 
 
@@ -51,6 +85,147 @@ static const addr_t paddr[] = { 0x0209c000, 0x020a0000, 0x020a4000, 0x020a8000,
 static const int clocks[] = { pctl_clk_gpio1, pctl_clk_gpio2, pctl_clk_gpio3, pctl_clk_gpio4, pctl_clk_gpio5 };
 
 
+static int gpio_isr(unsigned int n, void *arg)
+{
+	unsigned int i = (uintptr_t)arg, head = common.irq.head;
+	volatile uint32_t *base = common.gpio[i].base;
+	uint32_t status;
+	isrevent_t *evt;
+
+	/* Both lines of the port share the handler, the other one may have taken the status already */
+	status = *(base + isr) & *(base + imr);
+	if (status == 0)
+		return -1;
+
+	*(base + isr) = status;
+
+	/* Level interrupts stay masked until the event is read */
+	if ((status & common.irq.level[i]) != 0)
+		*(base + imr) &= ~(status & common.irq.level[i]);
+
+	if ((head - __atomic_load_n(&common.irq.tail, __ATOMIC_ACQUIRE)) == GPIO_ISR_EVENTS) {
+		common.irq.lost = 1;
+		return 1;
+	}
+
+	evt = &common.irq.events[head & (GPIO_ISR_EVENTS - 1)];
+	evt->pending = status;
+	evt->data = *(base + psr);
+	evt->bank = i;
+	evt->lost = common.irq.lost;
+	common.irq.lost = 0;
+	__atomic_store_n(&common.irq.head, head + 1, __ATOMIC_RELEASE);
+
+	return 1;
+}
+
+
+/* Programs pin interrupt, ISR may mask a level pin concurrently - a stale IMR write only rearms it early */
+static int gpio_irqSet(void *arg, unsigned int bank, unsigned int pin, unsigned int mode)
+{
+	volatile uint32_t *base = common.gpio[bank].base;
+	volatile uint32_t *icr = base + ((pin < 16) ? icr1 : icr2);
+	unsigned int shift = (pin % 16) * 2;
+	uint32_t bit = 1u << pin;
+
+	mutexLock(common.gpio[bank].lock);
+	*(base + imr) &= ~bit;
+
+	if ((mode == gpio_irq_low) || (mode == gpio_irq_high))
+		common.irq.level[bank] |= bit;
+	else
+		common.irq.level[bank] &= ~bit;
+
+	if (mode != gpio_irq_off) {
+		if (mode == gpio_irq_both) {
+			*(base + edge) |= bit;
+		}
+		else {
+			*(base + edge) &= ~bit;
+			*icr = (*icr & ~(3u << shift)) | ((mode - 1) << shift);
+		}
+
+		*(base + isr) = bit;
+		*(base + imr) |= bit;
+	}
+	mutexUnlock(common.gpio[bank].lock);
+
+	return EOK;
+}
+
+
+static void gpio_irqRearm(void *arg, unsigned int bank, unsigned int pin)
+{
+	uint32_t bit = 1u << pin;
+
+	if ((common.irq.level[bank] & bit) == 0)
+		return;
+
+	mutexLock(common.gpio[bank].lock);
+	*(common.gpio[bank].base + imr) |= bit;
+	mutexUnlock(common.gpio[bank].lock);
+}
+
+
+static void gpio_irqKick(void *arg)
+{
+	condSignal(common.irq.cond);
+}
+
+
+static const gpioev_hw_t evhw = {
+	.irqSet = gpio_irqSet,
+	.irqRearm = gpio_irqRearm,
+	.kick = gpio_irqKick,
+};
+
+
+static void irqthread(void *arg)
+{
+	gpioev_t *ev = &common.irq.ev;
+	const isrevent_t *e;
+	unsigned int head, tail;
+	time_t now;
+
+	mutexLock(ev->lock);
+	for (;;) {
+		gettime(&now, NULL);
+		if (__atomic_load_n(&common.irq.head, __ATOMIC_ACQUIRE) == common.irq.tail)
+			condWait(common.irq.cond, ev->lock, _gpioev_timeout(ev, now));
+
+		/* The ISR can't read time, events are stamped when collected */
+		gettime(&now, NULL);
+		head = __atomic_load_n(&common.irq.head, __ATOMIC_ACQUIRE);
+		for (tail = common.irq.tail; tail != head; ++tail) {
+			e = &common.irq.events[tail & (GPIO_ISR_EVENTS - 1)];
+			_gpioev_push(ev, e->bank, e->pending, e->data, now, e->lost);
+		}
+		__atomic_store_n(&common.irq.tail, tail, __ATOMIC_RELEASE);
+
+		_gpioev_respond(ev, now);
+	}
+}
+
+
+static int irqinit(void)
+{
+	int i;
+
+	if (gpioev_init(&common.irq.ev, &evhw, NULL, common.port, 5, 1) < 0 || condCreate(&common.irq.cond) < 0)
+		return -ENOMEM;
+
+	for (i = 0; i < sizeof(common.gpio) / sizeof(common.gpio[0]); ++i) {
+		*(common.gpio[i].base + imr) = 0;
+		*(common.gpio[i].base + isr) = 0xffffffff;
+
+		interrupt(GPIO_IRQ_BASE + 2 * i, gpio_isr, (void *)(uintptr_t)i, common.irq.cond, &common.irq.inth[2 * i]);
+		interrupt(GPIO_IRQ_BASE + 2 * i + 1, gpio_isr, (void *)(uintptr_t)i, common.irq.cond, &common.irq.inth[2 * i + 1]);
+	}
+
+	return beginthread(irqthread, 3, common.irq.stack, sizeof(common.irq.stack), NULL);
+}
+
+
 int init(void)
 {
 	int i, err;
@@ -108,6 +283,11 @@ int init(void)
 		}
 	}
 
+	if (irqinit() < 0) {
+		printf("gpiodrv: Could not initialize interrupts\n");
+		return -1;
+	}
+
 	return 0;
 }
 
@@ -170,6 +350,79 @@ int gpiosetdir(int d, uint32_t dir, uint32_t mask)
 }
 
 
+static int batchread(void *arg, unsigned int bank, uint32_t *val)
+{
+	return gpioread(gpio1 + bank - 1, val);
+}
+
+
+static int batchwrite(void *arg, unsigned int bank, uint32_t mask, uint32_t val)
+{
+	return gpiowrite(gpio1 + bank - 1, val, mask);
+}
+
+
+static int batchgetdir(void *arg, unsigned int bank, uint32_t *val)
+{
+	return gpiogetdir(dir1 + bank - 1, val);
+}
+
+
+static int batchsetdir(void *arg, unsigned int bank, uint32_t mask, uint32_t val)
+{
+	return gpiosetdir(dir1 + bank - 1, val, mask);
+}
+
+
+static const gpio_batchHw_t batchhw = {
+	.bankMin = 1,
+	.bankMax = 5,
+	.read = batchread,
+	.write = batchwrite,
+	.readDir = batchgetdir,
+	.writeDir = batchsetdir,
+};
+
+
+/* Returns 1 if the response has been deferred */
+static int devctl(msg_t *msg, msg_rid_t rid)
+{
+	const gpio_devctl_t *in = (const gpio_devctl_t *)msg->i.raw;
+	unsigned int bank = msg->oid.id - gpio1;
+
+	if (msg->oid.id < gpio1 || msg->oid.id > gpio5) {
+		msg->o.err = -EINVAL;
+		return 0;
+	}
+
+	switch (in->i.type) {
+		case gpio_devctl_irq_config:
+			if ((in->i.pin > 31) || (in->i.val > gpio_irq_both)) {
+				msg->o.err = -EINVAL;
+				break;
+			}
+			msg->o.err = gpioev_irqConfig(&common.irq.ev, msg->pid, bank, in->i.pin, in->i.val);
+			break;
+
+		case gpio_devctl_wait_pin:
+			if ((in->i.pin > 31) || (in->i.val < gpio_irq_rising) || (in->i.val > gpio_irq_both)) {
+				msg->o.err = -EINVAL;
+				break;
+			}
+			return gpioev_waitPin(&common.irq.ev, msg, rid, bank, in->i.pin, in->i.val, in->i.timeout);
+
+		case gpio_devctl_read_events:
+			return gpioev_readEvents(&common.irq.ev, msg, rid, in->i.val & 1, in->i.timeout);
+
+		default:
+			msg->o.err = -ENOSYS;
+			break;
+	}
+
+	return 0;
+}
+
+
 void thread(void *arg)
 {
 	msg_t msg;
@@ -248,6 +501,14 @@ void thread(void *arg)
 				}
 				break;
 
+			case mtDevCtl:
+				/* Single server thread, the batch isn't interleaved with other requests */
+				if (gpiobatch_isBatch(&msg))
+					msg.o.err = gpiobatch_handle(&batchhw, NULL, &msg);
+				else if (devctl(&msg, rid) > 0)
+					continue;
+				break;
+
 			default:
 				msg.o.err = -ENOSYS;
 				break;
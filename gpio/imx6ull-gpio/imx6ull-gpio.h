@@ -14,6 +14,10 @@
 #ifndef _GPIODRV_H_
 #define _GPIODRV_H_
 
+#include <stdint.h>
+#include <sys/types.h>
+#include <gpio-events.h> /* gpio_event_t, bank is the port number (1 - 5), time is the time the event was collected */
+
 typedef union {
 	unsigned int val;
 	struct {
@@ -22,4 +26,38 @@ typedef union {
 	} __attribute__((packed)) w;
 } gpiodata_t;
 
+
+/* Devctl types, sent to a port file (e.g. /dev/gpio2/port) */
+enum {
+	gpio_devctl_irq_config = 0x100, /* input: pin, val (gpio_irq_* mode) */
+	gpio_devctl_wait_pin,           /* input: pin, val (gpio_irq_* edge mode), timeout; output: val (edges), time */
+	gpio_devctl_read_events,        /* input: val (1 - don't block), timeout; output: data (gpio_event_t) */
+};
+
+
+/* Pin interrupt modes, ICR field values + 1 */
+enum {
+	gpio_irq_off = 0,
+	gpio_irq_low,     /* Level, rearmed when the event is read */
+	gpio_irq_high,    /* Level, rearmed when the event is read */
+	gpio_irq_rising,
+	gpio_irq_falling,
+	gpio_irq_both,    /* EDGE_SEL */
+};
+
+
+typedef union {
+	struct {
+		unsigned int type; /* Devctl type */
+		uint32_t pin;      /* Pin number */
+		uint32_t val;      /* Mode or flags */
+		uint32_t timeout;  /* Wait timeout [us], 0 - none (-ETIME on expiry) */
+	} i;
+
+	struct {
+		uint32_t val; /* Number of edges since the last wait (wait_pin) */
+		time_t time;  /* Time of the last edge [us] (wait_pin) */
+	} o;
+} __attribute__((packed)) gpio_devctl_t;
+
 #endif
@@ -17,6 +17,7 @@
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/msg.h>
+#include <sys/interrupt.h>
 #include <sys/threads.h>
 #include <posix/idtree.h>
 #include <posix/utils.h>
@@ -31,6 +32,16 @@
 #define PWM_NCHAN      8
 #define PWM_RELOAD     PWM_NCHAN
 
+/* TTC input clock, cpu_1x on Zynq7000 */
+#define TTC_CLK_DEFAULT 111111111
+
+#define STREAM_RATE_MAX 100000
+#define STREAM_LOWAT    (ZYNQ_PWM_STREAM_FRAMES / 4) /* Free frames needed to wake a blocked writer */
+#define STREAM_PRIORITY 1
+
+/* Triple Timer Counter, timer 0 of the block. 16-bit on Zynq7000, the counter setup fits both */
+enum { ttc_clk = 0, ttc_cnt = 3, ttc_val = 6, ttc_interval = 9, ttc_isr = 21, ttc_ier = 24 };
+
 
 typedef struct {
 	oid_t oid;
@@ -41,6 +52,35 @@ typedef struct {
 static struct {
 	volatile uint32_t *base;
 	pwm_chan_t channel[PWM_NCHAN];
+
+	struct {
+		volatile uint32_t *ttc;
+		unsigned int irq;
+		uint32_t clk;
+
+		handle_t lock;
+		handle_t cond;
+		handle_t inth;
+
+		/* Free running indices, head is written by the server, tail by the ISR */
+		volatile uint32_t head;
+		volatile uint32_t tail;
+		uint32_t frame[ZYNQ_PWM_STREAM_FRAMES][PWM_NCHAN];
+
+		volatile uint32_t played;
+		volatile uint32_t underruns;
+		volatile uint8_t state;
+		volatile uint8_t primed;
+		uint8_t mask;
+		uint8_t nch;
+		uint32_t rate;
+
+		/* Blocked writer, responded to by the stream thread */
+		volatile int pending;
+		msg_t msg;
+		msg_rid_t rid;
+		size_t offs;
+	} stream;
 } pwm_common;
 
 
@@ -68,12 +108,263 @@ static void pwm_setReload(uint32_t reload)
 }
 
 
+static int pwm_streamIsr(unsigned int n, void *arg)
+{
+	uint32_t tail = pwm_common.stream.tail, head = pwm_common.stream.head;
+	uint32_t *frame;
+	unsigned int ch, i;
+	int ret = -1;
+
+	(void)n;
+	(void)arg;
+
+	/* Clear on read */
+	(void)*(pwm_common.stream.ttc + ttc_isr);
+
+	if (tail != head) {
+		frame = pwm_common.stream.frame[tail % ZYNQ_PWM_STREAM_FRAMES];
+		for (ch = 0, i = 0; ch < PWM_NCHAN; ++ch) {
+			if ((pwm_common.stream.mask & (1u << ch)) != 0) {
+				pwm_write(&pwm_common.channel[ch], frame[i++]);
+			}
+		}
+
+		pwm_common.stream.tail = tail + 1;
+		pwm_common.stream.played++;
+		pwm_common.stream.primed = 1;
+
+		if ((pwm_common.stream.pending != 0) && (ZYNQ_PWM_STREAM_FRAMES - (head - tail - 1) >= STREAM_LOWAT)) {
+			ret = 1;
+		}
+	}
+	else if (pwm_common.stream.state == zynqpwm_streamDraining) {
+		*(pwm_common.stream.ttc + ttc_cnt) = 0x1;
+		pwm_common.stream.state = zynqpwm_streamStopped;
+		ret = 1;
+	}
+	else if (pwm_common.stream.primed != 0) {
+		/* Last duty cycle is held until new frames arrive */
+		pwm_common.stream.underruns++;
+	}
+
+	return ret;
+}
+
+
+/* Copies whole frames from the pending writer, returns non-zero when it is done */
+static int _pwm_streamFill(void)
+{
+	msg_t *msg = &pwm_common.stream.msg;
+	size_t fsz = pwm_common.stream.nch * sizeof(uint32_t);
+	uint32_t head = pwm_common.stream.head;
+
+	while ((pwm_common.stream.offs + fsz <= msg->i.size) && (head - pwm_common.stream.tail < ZYNQ_PWM_STREAM_FRAMES)) {
+		memcpy(pwm_common.stream.frame[head % ZYNQ_PWM_STREAM_FRAMES], (const uint8_t *)msg->i.data + pwm_common.stream.offs, fsz);
+		pwm_common.stream.offs += fsz;
+		++head;
+	}
+
+	__sync_synchronize();
+	pwm_common.stream.head = head;
+
+	return (pwm_common.stream.offs == msg->i.size) ? 1 : 0;
+}
+
+
+static void _pwm_streamRespond(void)
+{
+	zynqpwm_omsg_t *optr = (zynqpwm_omsg_t *)pwm_common.stream.msg.o.raw;
+
+	optr->err = (pwm_common.stream.offs != 0) ? (int)pwm_common.stream.offs : -EAGAIN;
+	pwm_common.stream.pending = 0;
+	msgRespond(pwm_common.channel[0].oid.port, &pwm_common.stream.msg, pwm_common.stream.rid);
+}
+
+
+static void _pwm_streamHalt(void)
+{
+	*(pwm_common.stream.ttc + ttc_cnt) = 0x1;
+	pwm_common.stream.state = zynqpwm_streamStopped;
+	pwm_common.stream.head = pwm_common.stream.tail;
+}
+
+
+static void pwm_streamThread(void *arg)
+{
+	(void)arg;
+
+	mutexLock(pwm_common.stream.lock);
+	for (;;) {
+		condWait(pwm_common.stream.cond, pwm_common.stream.lock, 0);
+
+		if (pwm_common.stream.pending != 0) {
+			if ((_pwm_streamFill() != 0) || (pwm_common.stream.state == zynqpwm_streamStopped)) {
+				_pwm_streamRespond();
+			}
+		}
+	}
+}
+
+
+static int pwm_streamStart(uint8_t mask, uint32_t rate)
+{
+	uint32_t ticks;
+	unsigned int ps = 0;
+
+	if ((mask == 0) || (rate == 0) || (rate > STREAM_RATE_MAX)) {
+		return -EINVAL;
+	}
+
+	if (pwm_common.stream.state != zynqpwm_streamStopped) {
+		return -EBUSY;
+	}
+
+	/* Prescaler divides by 2^(ps + 1), interval has to fit 16 bits */
+	ticks = pwm_common.stream.clk / rate;
+	while (ticks > 0xffff) {
+		ticks >>= 1;
+		++ps;
+	}
+
+	if ((ticks < 2) || (ps > 16)) {
+		return -EINVAL;
+	}
+
+	pwm_common.stream.mask = mask;
+	pwm_common.stream.nch = __builtin_popcount(mask);
+	pwm_common.stream.rate = rate;
+	pwm_common.stream.head = 0;
+	pwm_common.stream.tail = 0;
+	pwm_common.stream.played = 0;
+	pwm_common.stream.underruns = 0;
+	pwm_common.stream.primed = 0;
+	pwm_common.stream.state = zynqpwm_streamRunning;
+
+	*(pwm_common.stream.ttc + ttc_cnt) = 0x1;
+	*(pwm_common.stream.ttc + ttc_clk) = (ps != 0) ? (((ps - 1) << 1) | 0x1) : 0;
+	*(pwm_common.stream.ttc + ttc_interval) = ticks - 1;
+	(void)*(pwm_common.stream.ttc + ttc_isr);
+	*(pwm_common.stream.ttc + ttc_ier) = 0x1;
+	/* Interval mode, reset and start */
+	*(pwm_common.stream.ttc + ttc_cnt) = (1 << 4) | (1 << 1);
+
+	return EOK;
+}
+
+
+/* Returns non-zero if the response is deferred */
+static int pwm_streamDevCtl(msg_t *msg, msg_rid_t rid)
+{
+	zynqpwm_imsg_t *iptr = (zynqpwm_imsg_t *)msg->i.raw;
+	zynqpwm_omsg_t *optr = (zynqpwm_omsg_t *)msg->o.raw;
+	int deferred = 0;
+
+	if (pwm_common.stream.ttc == NULL) {
+		optr->err = -ENODEV;
+		return 0;
+	}
+
+	mutexLock(pwm_common.stream.lock);
+	switch (iptr->type) {
+		case zynqpwm_msgStreamStart:
+			optr->err = pwm_streamStart(iptr->mask, iptr->rate);
+			break;
+
+		case zynqpwm_msgStreamWrite:
+			if (pwm_common.stream.state != zynqpwm_streamRunning) {
+				optr->err = -EINVAL;
+			}
+			else if (pwm_common.stream.pending != 0) {
+				optr->err = -EBUSY;
+			}
+			else if ((msg->i.data == NULL) || (msg->i.size == 0) || ((msg->i.size % (pwm_common.stream.nch * sizeof(uint32_t))) != 0)) {
+				optr->err = -EINVAL;
+			}
+			else {
+				pwm_common.stream.msg = *msg;
+				pwm_common.stream.rid = rid;
+				pwm_common.stream.offs = 0;
+
+				if ((_pwm_streamFill() == 0) && (iptr->flag != 0)) {
+					pwm_common.stream.pending = 1;
+					deferred = 1;
+				}
+				else {
+					optr->err = (pwm_common.stream.offs != 0) ? (int)pwm_common.stream.offs : -EAGAIN;
+				}
+			}
+			break;
+
+		case zynqpwm_msgStreamStop:
+			if (pwm_common.stream.state == zynqpwm_streamRunning) {
+				if ((iptr->flag != 0) && (pwm_common.stream.pending == 0)) {
+					pwm_common.stream.state = zynqpwm_streamDraining;
+				}
+				else {
+					_pwm_streamHalt();
+				}
+			}
+			else if ((pwm_common.stream.state == zynqpwm_streamDraining) && (iptr->flag == 0)) {
+				_pwm_streamHalt();
+			}
+
+			if ((pwm_common.stream.state == zynqpwm_streamStopped) && (pwm_common.stream.pending != 0)) {
+				_pwm_streamRespond();
+			}
+			optr->err = EOK;
+			break;
+
+		case zynqpwm_msgStreamStatus:
+			optr->status.rate = pwm_common.stream.rate;
+			optr->status.queued = pwm_common.stream.head - pwm_common.stream.tail;
+			optr->status.played = pwm_common.stream.played;
+			optr->status.underruns = pwm_common.stream.underruns;
+			optr->status.mask = pwm_common.stream.mask;
+			optr->status.state = pwm_common.stream.state;
+			optr->err = EOK;
+			break;
+
+		default:
+			optr->err = -EINVAL;
+			break;
+	}
+	mutexUnlock(pwm_common.stream.lock);
+
+	return deferred;
+}
+
+
+static int pwm_streamInit(uintptr_t ttcaddr)
+{
+	pwm_common.stream.ttc = mmap(NULL, _PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_DEVICE | MAP_PHYSMEM | MAP_ANONYMOUS, -1, ttcaddr);
+	if (pwm_common.stream.ttc == MAP_FAILED) {
+		pwm_common.stream.ttc = NULL;
+		return -ENOMEM;
+	}
+
+	/* Disabled till the stream is started */
+	*(pwm_common.stream.ttc + ttc_cnt) = 0x1;
+	*(pwm_common.stream.ttc + ttc_ier) = 0;
+	(void)*(pwm_common.stream.ttc + ttc_isr);
+
+	if ((mutexCreate(&pwm_common.stream.lock) < 0) || (condCreate(&pwm_common.stream.cond) < 0)) {
+		return -ENOMEM;
+	}
+
+	if (beginthread(pwm_streamThread, STREAM_PRIORITY, malloc(1024), 1024, NULL) < 0) {
+		return -ENOMEM;
+	}
+
+	return interrupt(pwm_common.stream.irq, pwm_streamIsr, NULL, pwm_common.stream.cond, &pwm_common.stream.inth);
+}
+
+
 static void pwm_thread(void *arg)
 {
 	msg_t msg;
 	msg_rid_t rid;
 	uint32_t val;
-	int ret;
+	int ret, deferred;
 	char buff[16];
 	zynqpwm_imsg_t *iptr = (zynqpwm_imsg_t *)msg.i.raw;
 	zynqpwm_omsg_t *optr = (zynqpwm_omsg_t *)msg.o.raw;
@@ -86,6 +377,8 @@ static void pwm_thread(void *arg)
 			continue;
 		}
 
+		deferred = 0;
+
 		switch (msg.type) {
 			case mtOpen:
 			case mtClose:
@@ -160,7 +453,8 @@ static void pwm_thread(void *arg)
 					}
 				}
 				else {
-					ret = -EINVAL;
+					deferred = pwm_streamDevCtl(&msg, rid);
+					break;
 				}
 
 				optr->err = ret;
@@ -171,7 +465,9 @@ static void pwm_thread(void *arg)
 				break;
 		}
 
-		msgRespond(pwm_common.channel[0].oid.port, &msg, rid);
+		if (deferred == 0) {
+			msgRespond(pwm_common.channel[0].oid.port, &msg, rid);
+		}
 	}
 }
 
@@ -183,6 +479,9 @@ static void pwm_usage(const char *progname)
 	printf("\t-b base_addr - base address of PWM8X IP\n");
 	printf("\t-r reload    - reload value (0-0xffffffff, default 0x%x)\n", RELOAD_DEFAULT);
 	printf("\t-p priority  - server thread priority (default %d)\n", PRIORITY);
+	printf("\t-t ttc_addr  - base address of TTC used to pace streaming (optional)\n");
+	printf("\t-i irq       - interrupt of TTC timer 0 (required with -t)\n");
+	printf("\t-c clock     - TTC input clock in Hz (default %d)\n", TTC_CLK_DEFAULT);
 	printf("\t-h           - this message\n");
 }
 
@@ -190,7 +489,7 @@ static void pwm_usage(const char *progname)
 int main(int argc, char *argv[])
 {
 	int opt;
-	uintptr_t baseaddr = 0;
+	uintptr_t baseaddr = 0, ttcaddr = 0;
 	char dev[16];
 	oid_t oid;
 	uint32_t reload = RELOAD_DEFAULT;
@@ -212,7 +511,7 @@ int main(int argc, char *argv[])
 		}
 	}
 
-	while ((opt = getopt(argc, argv, "b:r:h")) >= 0) {
+	while ((opt = getopt(argc, argv, "b:r:p:t:i:c:h")) >= 0) {
 		switch (opt) {
 			case 'b':
 				baseaddr = (uintptr_t)strtoul(optarg, NULL, 0);
@@ -233,6 +532,18 @@ int main(int argc, char *argv[])
 				prio = (int)strtol(optarg, NULL, 0);
 				break;
 
+			case 't':
+				ttcaddr = (uintptr_t)strtoul(optarg, NULL, 0);
+				break;
+
+			case 'i':
+				pwm_common.stream.irq = (unsigned int)strtoul(optarg, NULL, 0);
+				break;
+
+			case 'c':
+				pwm_common.stream.clk = (uint32_t)strtoul(optarg, NULL, 0);
+				break;
+
 			case 'h':
 				pwm_usage(argv[0]);
 				return EXIT_SUCCESS;
@@ -258,6 +569,22 @@ int main(int argc, char *argv[])
 
 	pwm_setReload(reload);
 
+	if (ttcaddr != 0) {
+		if (pwm_common.stream.irq == 0) {
+			fprintf(stderr, "pwm: no TTC interrupt specified\n");
+			return EXIT_FAILURE;
+		}
+
+		if (pwm_common.stream.clk == 0) {
+			pwm_common.stream.clk = TTC_CLK_DEFAULT;
+		}
+
+		if (pwm_streamInit(ttcaddr) < 0) {
+			fprintf(stderr, "pwm: failed to initialize streaming\n");
+			return EXIT_FAILURE;
+		}
+	}
+
 	if (portCreate(&oid.port) < 0) {
 		fprintf(stderr, "pwm: failed to create port\n");
 		return EXIT_FAILURE;
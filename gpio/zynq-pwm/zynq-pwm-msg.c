@@ -70,3 +70,91 @@ int zynqpwm_get(oid_t *oid, uint32_t compval[ZYNQ_PWM_CHANNELS])
 
 	return ret;
 }
+
+
+static int zynqpwm_streamMsg(oid_t *oid, msg_t *msg)
+{
+	int ret;
+	zynqpwm_omsg_t *o = (zynqpwm_omsg_t *)msg->o.raw;
+
+	msg->type = mtDevCtl;
+	msg->oid = *oid;
+	msg->o.data = NULL;
+	msg->o.size = 0;
+
+	ret = msgSend(oid->port, msg);
+	if (ret >= 0) {
+		ret = o->err;
+	}
+
+	return ret;
+}
+
+
+int zynqpwm_streamStart(oid_t *oid, uint8_t mask, uint32_t rate)
+{
+	msg_t msg;
+	zynqpwm_imsg_t *i = (zynqpwm_imsg_t *)msg.i.raw;
+
+	msg.i.data = NULL;
+	msg.i.size = 0;
+	i->type = zynqpwm_msgStreamStart;
+	i->mask = mask;
+	i->rate = rate;
+
+	return zynqpwm_streamMsg(oid, &msg);
+}
+
+
+int zynqpwm_streamWrite(oid_t *oid, const uint32_t *samples, size_t nsamples, int block)
+{
+	int ret;
+	msg_t msg;
+	zynqpwm_imsg_t *i = (zynqpwm_imsg_t *)msg.i.raw;
+
+	msg.i.data = samples;
+	msg.i.size = nsamples * sizeof(*samples);
+	i->type = zynqpwm_msgStreamWrite;
+	i->flag = (block != 0) ? 1 : 0;
+
+	ret = zynqpwm_streamMsg(oid, &msg);
+	if (ret > 0) {
+		ret /= sizeof(*samples);
+	}
+
+	return ret;
+}
+
+
+int zynqpwm_streamStop(oid_t *oid, int drain)
+{
+	msg_t msg;
+	zynqpwm_imsg_t *i = (zynqpwm_imsg_t *)msg.i.raw;
+
+	msg.i.data = NULL;
+	msg.i.size = 0;
+	i->type = zynqpwm_msgStreamStop;
+	i->flag = (drain != 0) ? 1 : 0;
+
+	return zynqpwm_streamMsg(oid, &msg);
+}
+
+
+int zynqpwm_streamStatus(oid_t *oid, zynqpwm_streamStatus_t *status)
+{
+	int ret;
+	msg_t msg;
+	zynqpwm_imsg_t *i = (zynqpwm_imsg_t *)msg.i.raw;
+	zynqpwm_omsg_t *o = (zynqpwm_omsg_t *)msg.o.raw;
+
+	msg.i.data = NULL;
+	msg.i.size = 0;
+	i->type = zynqpwm_msgStreamStatus;
+
+	ret = zynqpwm_streamMsg(oid, &msg);
+	if (ret >= 0) {
+		*status = o->status;
+	}
+
+	return ret;
+}
@@ -14,12 +14,29 @@
 #ifndef ZYNQ_PWM_MSG_H
 #define ZYNQ_PWM_MSG_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <sys/msg.h>
 
 
 #define ZYNQ_PWM_CHANNELS 8
 
+/* Stream ring capacity in frames, one frame holds a sample for each channel in the stream mask */
+#define ZYNQ_PWM_STREAM_FRAMES 1024
+
+
+enum { zynqpwm_streamStopped = 0, zynqpwm_streamRunning, zynqpwm_streamDraining };
+
+
+typedef struct {
+	uint32_t rate;      /* Frames per second */
+	uint32_t queued;    /* Frames waiting in the ring */
+	uint32_t played;    /* Frames written to the PWM since start */
+	uint32_t underruns; /* Timer ticks that found the ring empty after the first frame */
+	uint8_t mask;
+	uint8_t state;
+} zynqpwm_streamStatus_t;
+
 
 int zynqpwm_set(oid_t *oid, uint32_t compval[ZYNQ_PWM_CHANNELS], uint8_t mask);
 
@@ -27,4 +44,22 @@ int zynqpwm_set(oid_t *oid, uint32_t compval[ZYNQ_PWM_CHANNELS], uint8_t mask);
 int zynqpwm_get(oid_t *oid, uint32_t compval[ZYNQ_PWM_CHANNELS]);
 
 
+/* Starts timer paced playback of channels in mask at rate frames per second, the ring is emptied */
+int zynqpwm_streamStart(oid_t *oid, uint8_t mask, uint32_t rate);
+
+
+/*
+ * Queues whole frames of popcount(mask) samples each, lowest channel first.
+ * nsamples has to be a multiple of the frame size, returns number of samples queued.
+ */
+int zynqpwm_streamWrite(oid_t *oid, const uint32_t *samples, size_t nsamples, int block);
+
+
+/* Stops the stream at once, or after the queued frames are played if drain is set */
+int zynqpwm_streamStop(oid_t *oid, int drain);
+
+
+int zynqpwm_streamStatus(oid_t *oid, zynqpwm_streamStatus_t *status);
+
+
 #endif
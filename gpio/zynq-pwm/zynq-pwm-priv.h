@@ -17,18 +17,29 @@
 #include <stdint.h>
 #include <sys/msg.h>
 
+#include "zynq-pwm-msg.h"
+
 
 typedef struct {
 	enum { zynqpwm_msgSet,
-		zynqpwm_msgGet } type;
+		zynqpwm_msgGet,
+		zynqpwm_msgStreamStart,
+		zynqpwm_msgStreamWrite,
+		zynqpwm_msgStreamStop,
+		zynqpwm_msgStreamStatus } type;
 	uint32_t compval[8];
 	uint8_t mask;
+	uint8_t flag; /* block for write, drain for stop */
+	uint32_t rate;
 } zynqpwm_imsg_t;
 
 
 typedef struct {
 	int err;
-	uint32_t compval[8];
+	union {
+		uint32_t compval[8];
+		zynqpwm_streamStatus_t status;
+	};
 } zynqpwm_omsg_t;
 
 
@@ -13,13 +13,17 @@
 
 #include <errno.h>
 #include <stdlib.h>
+#include <unistd.h>
 
+#include <sys/interrupt.h>
 #include <sys/mman.h>
 #include <sys/platform.h>
+#include <sys/threads.h>
 
 #include <phoenix/arch/armv7a/zynq7000/zynq7000.h>
 #include <board_config.h>
 
+#include "zynq7000-gpio-msg.h"
 #include "gpio.h"
 
 
@@ -41,6 +45,31 @@
 #define GPIO_DIRM1 145
 #define GPIO_OEN1  146
 
+/* GPIO interrupt registers, bank 1 registers are 16 words apart */
+#define GPIO_INT_MASK0 131
+#define GPIO_INT_EN0   132
+#define GPIO_INT_DIS0  133
+#define GPIO_INT_STAT0 134
+#define GPIO_INT_TYPE0 135
+#define GPIO_INT_POL0  136
+#define GPIO_INT_ANY0  137
+
+#define GPIO_INT_BANK 16
+
+/* GPIO interrupt number */
+#define GPIO_IRQ 52
+
+/* Cortex-A9 global timer, counts in the ISR are converted to gettime() time */
+#define GTIMER_PAGE 0xf8f00000
+#define GTIMER_CNTL (0x200 / 4)
+#define GTIMER_CNTH (0x204 / 4)
+#define GTIMER_CTRL (0x208 / 4)
+
+/* Interrupt events queued by the ISR (power of 2) */
+#ifndef GPIO_IRQ_EVENTS
+#define GPIO_IRQ_EVENTS 64
+#endif
+
 
 /* GPIO pins */
 const int gpioPins[GPIO_BANKS][GPIO_PINS] = {
@@ -67,11 +96,90 @@ const int gpioPins[GPIO_BANKS][GPIO_PINS] = {
 };
 
 
+typedef struct {
+	uint32_t pending[GPIO_BANKS];
+	uint32_t data[GPIO_BANKS];
+	uint64_t cnt;
+	uint32_t lost;
+} gpio_isrEvent_t;
+
+
 static struct {
-	volatile uint32_t *base; /* GPIO registers base address */
+	volatile uint32_t *base;   /* GPIO registers base address */
+	volatile uint32_t *gtimer; /* Global timer registers, NULL if not available */
+
+	/* Written by the ISR (head, lost) and by gpio_irqWait() (tail) */
+	gpio_isrEvent_t events[GPIO_IRQ_EVENTS];
+	unsigned int head;
+	unsigned int tail;
+	uint32_t lost;
+
+	volatile uint32_t level[GPIO_BANKS]; /* Pins with level interrupt */
+	int kick;                            /* gpio_irqWait() should return */
+
+	uint64_t cnt0; /* Global timer count at time0 */
+	time_t time0;
+	uint64_t freq; /* Global timer frequency [Hz] */
+
+	handle_t lock;
+	handle_t cond;
+	handle_t inth;
 } gpio_common;
 
 
+static uint64_t gpio_gtimerRead(void)
+{
+	uint32_t hi, lo;
+
+	do {
+		hi = *(gpio_common.gtimer + GTIMER_CNTH);
+		lo = *(gpio_common.gtimer + GTIMER_CNTL);
+	} while (hi != *(gpio_common.gtimer + GTIMER_CNTH));
+
+	return ((uint64_t)hi << 32) | lo;
+}
+
+
+static int gpio_isr(unsigned int n, void *arg)
+{
+	unsigned int i, head = gpio_common.head;
+	uint32_t status[GPIO_BANKS];
+	gpio_isrEvent_t *evt;
+	int ret = -1;
+
+	for (i = 0; i < GPIO_BANKS; i++) {
+		status[i] = *(gpio_common.base + GPIO_INT_STAT0 + i * GPIO_INT_BANK) & ~*(gpio_common.base + GPIO_INT_MASK0 + i * GPIO_INT_BANK);
+		if (status[i] != 0) {
+			/* Edge interrupts are cleared by writing 1, level interrupts are masked until rearmed */
+			*(gpio_common.base + GPIO_INT_STAT0 + i * GPIO_INT_BANK) = status[i];
+			*(gpio_common.base + GPIO_INT_DIS0 + i * GPIO_INT_BANK) = status[i] & gpio_common.level[i];
+			ret = 1;
+		}
+	}
+
+	if (ret < 0) {
+		return ret;
+	}
+
+	if ((head - __atomic_load_n(&gpio_common.tail, __ATOMIC_ACQUIRE)) == GPIO_IRQ_EVENTS) {
+		gpio_common.lost++;
+		return ret;
+	}
+
+	evt = &gpio_common.events[head & (GPIO_IRQ_EVENTS - 1)];
+	evt->cnt = (gpio_common.gtimer != NULL) ? gpio_gtimerRead() : 0;
+	evt->pending[0] = status[0];
+	evt->pending[1] = status[1];
+	evt->data[0] = *(gpio_common.base + GPIO_RODATA0);
+	evt->data[1] = *(gpio_common.base + GPIO_RODATA1);
+	evt->lost = gpio_common.lost;
+	gpio_common.lost = 0;
+	__atomic_store_n(&gpio_common.head, head + 1, __ATOMIC_RELEASE);
+
+	return ret;
+}
+
+
 static int gpio_checkPin(unsigned int bank, unsigned int pin)
 {
 	if ((bank >= GPIO_BANKS) || (pin >= GPIO_PINS)) {
@@ -203,6 +311,173 @@ int gpio_writePin(unsigned int bank, unsigned int pin, uint32_t val)
 }
 
 
+int gpio_irqConfig(unsigned int bank, unsigned int pin, unsigned int mode)
+{
+	volatile uint32_t *base;
+	uint32_t bit = 1 << pin;
+	int err;
+
+	err = gpio_checkPin(bank, pin);
+	if (err < 0) {
+		return err;
+	}
+
+	if (mode > gpio_irq_low) {
+		return -EINVAL;
+	}
+
+	base = gpio_common.base + bank * GPIO_INT_BANK;
+
+	mutexLock(gpio_common.lock);
+	*(base + GPIO_INT_DIS0) = bit;
+
+	switch (mode) {
+		case gpio_irq_rising:
+		case gpio_irq_falling:
+			*(base + GPIO_INT_TYPE0) |= bit;
+			*(base + GPIO_INT_ANY0) &= ~bit;
+			break;
+
+		case gpio_irq_both:
+			*(base + GPIO_INT_TYPE0) |= bit;
+			*(base + GPIO_INT_ANY0) |= bit;
+			break;
+
+		case gpio_irq_high:
+		case gpio_irq_low:
+			*(base + GPIO_INT_TYPE0) &= ~bit;
+			break;
+
+		default:
+			break;
+	}
+
+	if ((mode == gpio_irq_rising) || (mode == gpio_irq_high)) {
+		*(base + GPIO_INT_POL0) |= bit;
+	}
+	else {
+		*(base + GPIO_INT_POL0) &= ~bit;
+	}
+
+	if ((mode == gpio_irq_high) || (mode == gpio_irq_low)) {
+		gpio_common.level[bank] |= bit;
+	}
+	else {
+		gpio_common.level[bank] &= ~bit;
+	}
+
+	*(base + GPIO_INT_STAT0) = bit;
+	if (mode != gpio_irq_off) {
+		*(base + GPIO_INT_EN0) = bit;
+	}
+	mutexUnlock(gpio_common.lock);
+
+	return EOK;
+}
+
+
+void gpio_irqRearm(unsigned int bank, unsigned int pin)
+{
+	if ((gpio_common.level[bank] & (1 << pin)) != 0) {
+		*(gpio_common.base + GPIO_INT_EN0 + bank * GPIO_INT_BANK) = 1 << pin;
+	}
+}
+
+
+static time_t gpio_cntToTime(uint64_t cnt)
+{
+	uint64_t delta = cnt - gpio_common.cnt0;
+
+	return gpio_common.time0 + (time_t)((delta / gpio_common.freq) * 1000000 + ((delta % gpio_common.freq) * 1000000) / gpio_common.freq);
+}
+
+
+int gpio_irqWait(gpio_irqEvent_t *events, unsigned int n, time_t timeout)
+{
+	gpio_isrEvent_t *evt;
+	unsigned int i, cnt = 0, head, tail;
+	time_t now;
+	int err;
+
+	mutexLock(gpio_common.lock);
+	for (;;) {
+		head = __atomic_load_n(&gpio_common.head, __ATOMIC_ACQUIRE);
+		tail = gpio_common.tail;
+		if (head != tail) {
+			break;
+		}
+
+		err = condWait(gpio_common.cond, gpio_common.lock, timeout);
+		if ((err == -ETIME) || (gpio_common.kick != 0)) {
+			gpio_common.kick = 0;
+			mutexUnlock(gpio_common.lock);
+			return 0;
+		}
+	}
+
+	gettime(&now, NULL);
+	for (; (tail != head) && (cnt < n); tail++, cnt++) {
+		evt = &gpio_common.events[tail & (GPIO_IRQ_EVENTS - 1)];
+		for (i = 0; i < GPIO_BANKS; i++) {
+			events[cnt].pending[i] = evt->pending[i];
+			events[cnt].data[i] = evt->data[i];
+		}
+		events[cnt].lost = evt->lost;
+		/* Without the global timer the event is timestamped here */
+		events[cnt].time = (gpio_common.gtimer != NULL) ? gpio_cntToTime(evt->cnt) : now;
+	}
+	__atomic_store_n(&gpio_common.tail, tail, __ATOMIC_RELEASE);
+	mutexUnlock(gpio_common.lock);
+
+	return cnt;
+}
+
+
+void gpio_irqKick(void)
+{
+	mutexLock(gpio_common.lock);
+	gpio_common.kick = 1;
+	condSignal(gpio_common.cond);
+	mutexUnlock(gpio_common.lock);
+}
+
+
+/* Maps the global timer and calibrates it against gettime() */
+static void gpio_initTimer(void)
+{
+	volatile uint32_t *page;
+	uint64_t cnt1;
+	time_t time1;
+
+	page = mmap(NULL, _PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_DEVICE | MAP_PHYSMEM | MAP_ANONYMOUS, -1, GTIMER_PAGE);
+	if (page == MAP_FAILED) {
+		return;
+	}
+
+	/* Start the timer if the kernel doesn't use it */
+	if ((*(page + GTIMER_CTRL) & 1) == 0) {
+		*(page + GTIMER_CTRL) = 1;
+	}
+	gpio_common.gtimer = page;
+
+	gettime(&gpio_common.time0, NULL);
+	gpio_common.cnt0 = gpio_gtimerRead();
+	usleep(100000);
+	gettime(&time1, NULL);
+	cnt1 = gpio_gtimerRead();
+
+	if (time1 <= gpio_common.time0) {
+		gpio_common.gtimer = NULL;
+		munmap((void *)page, _PAGE_SIZE);
+		return;
+	}
+
+	gpio_common.freq = ((cnt1 - gpio_common.cnt0) * 1000000) / (uint64_t)(time1 - gpio_common.time0);
+	gpio_common.cnt0 = cnt1;
+	gpio_common.time0 = time1;
+}
+
+
 static int gpio_setPin(unsigned int pin)
 {
 	platformctl_t pctl;
@@ -297,5 +572,29 @@ int gpio_init(void)
 	*(gpio_common.base + GPIO_OEN0) = 0xffffffff;
 	*(gpio_common.base + GPIO_OEN1) = 0xffffffff;
 
+	/* Disable all interrupts, they are enabled on demand */
+	*(gpio_common.base + GPIO_INT_DIS0) = 0xffffffff;
+	*(gpio_common.base + GPIO_INT_DIS0 + GPIO_INT_BANK) = 0xffffffff;
+
+	err = mutexCreate(&gpio_common.lock);
+	if (err < 0) {
+		return err;
+	}
+
+	err = condCreate(&gpio_common.cond);
+	if (err < 0) {
+		resourceDestroy(gpio_common.lock);
+		return err;
+	}
+
+	gpio_initTimer();
+
+	err = interrupt(GPIO_IRQ, gpio_isr, NULL, gpio_common.cond, &gpio_common.inth);
+	if (err < 0) {
+		resourceDestroy(gpio_common.cond);
+		resourceDestroy(gpio_common.lock);
+		return err;
+	}
+
 	return EOK;
 }
@@ -15,12 +15,22 @@
 #define _ZYNQ7000_GPIO_H_
 
 #include <stdint.h>
+#include <sys/types.h>
 
 
 #define GPIO_BANKS 2  /* Number of GPIO banks */
 #define GPIO_PINS  32 /* Max number of pins per bank */
 
 
+/* GPIO interrupt event */
+typedef struct {
+	uint32_t pending[GPIO_BANKS]; /* Pins which triggered */
+	uint32_t data[GPIO_BANKS];    /* Pins state read in the ISR */
+	time_t time;                  /* Interrupt time [us], gettime() time base */
+	uint32_t lost;                /* Events dropped before this one */
+} gpio_irqEvent_t;
+
+
 /* GPIO pins configuration */
 extern const int gpioPins[GPIO_BANKS][GPIO_PINS];
 
@@ -49,6 +59,22 @@ extern int gpio_readDir(unsigned int bank, uint32_t *dir);
 extern int gpio_writeDir(unsigned int bank, uint32_t dir, uint32_t mask);
 
 
+/* Configures GPIO pin interrupt (gpio_irq_* mode), level interrupts are disabled after triggering */
+extern int gpio_irqConfig(unsigned int bank, unsigned int pin, unsigned int mode);
+
+
+/* Re-enables GPIO pin level interrupt */
+extern void gpio_irqRearm(unsigned int bank, unsigned int pin);
+
+
+/* Waits for GPIO interrupts (timeout [us], 0 - no timeout), returns number of events, 0 on timeout */
+extern int gpio_irqWait(gpio_irqEvent_t *events, unsigned int n, time_t timeout);
+
+
+/* Makes pending gpio_irqWait() return */
+extern void gpio_irqKick(void);
+
+
 /* Initializes GPIO controller */
 extern int gpio_init(void);
 
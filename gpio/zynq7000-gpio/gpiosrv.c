@@ -18,10 +18,14 @@
 
 #include <sys/msg.h>
 #include <sys/threads.h>
+#include <sys/time.h>
 #include <sys/types.h>
 
 #include <posix/utils.h>
 
+#include <gpio-batch.h>
+#include <gpio-events.h>
+
 #include "zynq7000-gpio-msg.h"
 #include "gpio.h"
 
@@ -29,6 +33,9 @@
 /* Default server thread priority */
 #define PRIORITY 2
 
+/* Interrupt events collected from the controller at once */
+#define GPIOSRV_IRQ_EVENTS 8
+
 
 /* GPIO oid.id encoding */
 #define GPIO_BANK_BIT 7 /* Bank */
@@ -41,7 +48,104 @@
 #define GPIO_PIN  (31 << 0)
 
 
-static void gpiosrv_devctl(msg_t *msg)
+static struct {
+	uint32_t port;
+	gpioev_t ev; /* Pin interrupt events and deferred requests */
+	char stack[2048] __attribute__((aligned(8)));
+} gpiosrv_common;
+
+
+static int gpiosrv_irqSet(void *arg, unsigned int bank, unsigned int pin, unsigned int mode)
+{
+	return gpio_irqConfig(bank, pin, mode);
+}
+
+
+static void gpiosrv_irqRearm(void *arg, unsigned int bank, unsigned int pin)
+{
+	gpio_irqRearm(bank, pin);
+}
+
+
+static void gpiosrv_irqKick(void *arg)
+{
+	gpio_irqKick();
+}
+
+
+static const gpioev_hw_t gpiosrv_evHw = {
+	.irqSet = gpiosrv_irqSet,
+	.irqRearm = gpiosrv_irqRearm,
+	.kick = gpiosrv_irqKick,
+};
+
+
+static void gpiosrv_irqthr(void *arg)
+{
+	gpio_irqEvent_t events[GPIOSRV_IRQ_EVENTS];
+	gpioev_t *ev = &gpiosrv_common.ev;
+	unsigned int i;
+	time_t now, timeout;
+	int n, k;
+
+	for (;;) {
+		mutexLock(ev->lock);
+		gettime(&now, NULL);
+		timeout = _gpioev_timeout(ev, now);
+		mutexUnlock(ev->lock);
+
+		n = gpio_irqWait(events, GPIOSRV_IRQ_EVENTS, timeout);
+
+		mutexLock(ev->lock);
+		for (k = 0; k < n; k++) {
+			for (i = 0; i < GPIO_BANKS; i++) {
+				_gpioev_push(ev, i, events[k].pending[i], events[k].data[i], events[k].time, events[k].lost);
+			}
+		}
+
+		gettime(&now, NULL);
+		_gpioev_respond(ev, now);
+		mutexUnlock(ev->lock);
+	}
+}
+
+
+static int gpiosrv_batchRead(void *arg, unsigned int bank, uint32_t *val)
+{
+	return gpio_readPort(bank, val);
+}
+
+
+static int gpiosrv_batchWrite(void *arg, unsigned int bank, uint32_t mask, uint32_t val)
+{
+	return gpio_writePort(bank, val, mask);
+}
+
+
+static int gpiosrv_batchReadDir(void *arg, unsigned int bank, uint32_t *val)
+{
+	return gpio_readDir(bank, val);
+}
+
+
+static int gpiosrv_batchWriteDir(void *arg, unsigned int bank, uint32_t mask, uint32_t val)
+{
+	return gpio_writeDir(bank, val, mask);
+}
+
+
+static const gpio_batchHw_t gpiosrv_batchHw = {
+	.bankMin = 0,
+	.bankMax = GPIO_BANKS - 1,
+	.read = gpiosrv_batchRead,
+	.write = gpiosrv_batchWrite,
+	.readDir = gpiosrv_batchReadDir,
+	.writeDir = gpiosrv_batchWriteDir,
+};
+
+
+/* Returns 1 if the response has been deferred */
+static int gpiosrv_devctl(msg_t *msg, msg_rid_t rid)
 {
 	gpio_devctl_t *in = (gpio_devctl_t *)msg->i.raw;
 	gpio_devctl_t *out = (gpio_devctl_t *)msg->o.raw;
@@ -49,6 +153,12 @@ static void gpiosrv_devctl(msg_t *msg)
 	unsigned int pin = msg->oid.id & GPIO_PIN;
 	uint32_t val;
 
+	/* Pins are accessed only from the message thread, so the batch isn't interleaved with other requests */
+	if (gpiobatch_isBatch(msg) != 0) {
+		msg->o.err = gpiobatch_handle(&gpiosrv_batchHw, NULL, msg);
+		return 0;
+	}
+
 	switch (in->i.type) {
 		case gpio_devctl_read_pin:
 			msg->o.err = gpio_readPin(bank, pin, &val);
@@ -77,10 +187,30 @@ static void gpiosrv_devctl(msg_t *msg)
 			msg->o.err = gpio_writeDir(bank, in->i.val, in->i.mask);
 			break;
 
+		case gpio_devctl_wait_pin:
+			if ((pin >= GPIO_PINS) || (gpioPins[bank][pin] < 0)) {
+				msg->o.err = -EINVAL;
+				break;
+			}
+			return gpioev_waitPin(&gpiosrv_common.ev, msg, rid, bank, pin, (in->i.val != 0) ? gpio_irq_rising : gpio_irq_falling, 0);
+
+		case gpio_devctl_irq_config:
+			if ((pin >= GPIO_PINS) || (gpioPins[bank][pin] < 0) || (in->i.val > gpio_irq_low)) {
+				msg->o.err = -EINVAL;
+				break;
+			}
+			msg->o.err = gpioev_irqConfig(&gpiosrv_common.ev, msg->pid, bank, pin, in->i.val);
+			break;
+
+		case gpio_devctl_read_events:
+			return gpioev_readEvents(&gpiosrv_common.ev, msg, rid, in->i.mask, in->i.val);
+
 		default:
 			msg->o.err = -ENOSYS;
 			break;
 	}
+
+	return 0;
 }
 
 
@@ -110,7 +240,9 @@ static void gpiosrv_msgthr(void *arg)
 				break;
 
 			case mtDevCtl:
-				gpiosrv_devctl(&msg);
+				if (gpiosrv_devctl(&msg, rid) > 0) {
+					continue;
+				}
 				break;
 
 			case mtRead:
@@ -271,6 +403,19 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	gpiosrv_common.port = oid.port;
+	err = gpioev_init(&gpiosrv_common.ev, &gpiosrv_evHw, NULL, oid.port, GPIO_BANKS, 0);
+	if (err < 0) {
+		printf("zynq7000-gpio: failed to initialize interrupt events, err: %s\n", strerror(err));
+		return EXIT_FAILURE;
+	}
+
+	err = beginthread(gpiosrv_irqthr, prio, gpiosrv_common.stack, sizeof(gpiosrv_common.stack), NULL);
+	if (err < 0) {
+		printf("zynq7000-gpio: failed to start interrupt thread, err: %s\n", strerror(err));
+		return EXIT_FAILURE;
+	}
+
 	priority(prio);
 	gpiosrv_msgthr((void *)oid.port);
 
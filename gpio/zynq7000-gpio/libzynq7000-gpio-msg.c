@@ -163,3 +163,86 @@ int gpiomsg_writeDir(oid_t *dir, uint32_t val, uint32_t mask)
 
 	return msg.o.err;
 }
+
+
+int gpiomsg_waitPin(oid_t *pin, uint32_t rising, uint32_t *cnt, time_t *time)
+{
+	msg_t msg = { 0 };
+	gpio_devctl_t *idevctl = (gpio_devctl_t *)msg.i.raw;
+	gpio_devctl_t *odevctl = (gpio_devctl_t *)msg.o.raw;
+	int err;
+
+	if (pin == NULL) {
+		return -EINVAL;
+	}
+
+	msg.type = mtDevCtl;
+	idevctl->i.type = gpio_devctl_wait_pin;
+	msg.oid = *pin;
+	idevctl->i.val = rising;
+
+	err = msgSend(pin->port, &msg);
+	if (err < 0) {
+		return err;
+	}
+
+	if (cnt != NULL) {
+		*cnt = odevctl->o.val;
+	}
+	if (time != NULL) {
+		*time = odevctl->o.time;
+	}
+
+	return msg.o.err;
+}
+
+
+int gpiomsg_irqConfig(oid_t *pin, unsigned int mode)
+{
+	msg_t msg = { 0 };
+	gpio_devctl_t *idevctl = (gpio_devctl_t *)msg.i.raw;
+	int err;
+
+	if (pin == NULL) {
+		return -EINVAL;
+	}
+
+	msg.type = mtDevCtl;
+	idevctl->i.type = gpio_devctl_irq_config;
+	msg.oid = *pin;
+	idevctl->i.val = mode;
+
+	err = msgSend(pin->port, &msg);
+	if (err < 0) {
+		return err;
+	}
+
+	return msg.o.err;
+}
+
+
+int gpiomsg_readEvents(oid_t *oid, gpio_event_t *events, unsigned int n, uint32_t timeout, int block)
+{
+	msg_t msg = { 0 };
+	gpio_devctl_t *idevctl = (gpio_devctl_t *)msg.i.raw;
+	int err;
+
+	if ((oid == NULL) || (events == NULL) || (n == 0)) {
+		return -EINVAL;
+	}
+
+	msg.type = mtDevCtl;
+	idevctl->i.type = gpio_devctl_read_events;
+	msg.oid = *oid;
+	idevctl->i.val = timeout;
+	idevctl->i.mask = (block != 0) ? 0 : 1;
+	msg.o.data = events;
+	msg.o.size = n * sizeof(*events);
+
+	err = msgSend(oid->port, &msg);
+	if (err < 0) {
+		return err;
+	}
+
+	return msg.o.err;
+}
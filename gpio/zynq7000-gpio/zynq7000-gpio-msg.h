@@ -19,6 +19,8 @@
 #include <sys/msg.h>
 #include <sys/types.h>
 
+#include <gpio-events.h> /* gpio_event_t, bank is the bank number (0 - 1), time is the interrupt time */
+
 
 enum {
 	gpio_devctl_read_pin = 0, /* input: - */
@@ -27,6 +29,20 @@ enum {
 	gpio_devctl_write_port,   /* input: val, mask */
 	gpio_devctl_read_dir,     /* input: - */
 	gpio_devctl_write_dir,    /* input: val, mask */
+	gpio_devctl_wait_pin,     /* input: val (edge: 0 - falling, 1 - rising) */
+	gpio_devctl_irq_config,   /* input: val (gpio_irq_* mode) */
+	gpio_devctl_read_events,  /* input: val (timeout [us], 0 - none), mask (1 - don't block), output: data (gpio_event_t) */
+};
+
+
+/* Pin interrupt modes */
+enum {
+	gpio_irq_off = 0,
+	gpio_irq_rising,
+	gpio_irq_falling,
+	gpio_irq_both,
+	gpio_irq_high, /* Level, rearmed when the event is read */
+	gpio_irq_low,  /* Level, rearmed when the event is read */
 };
 
 
@@ -38,7 +54,8 @@ typedef union {
 	} i;
 
 	struct {
-		uint32_t val; /* Returned value */
+		uint32_t val;   /* Returned value (number of edges for wait_pin) */
+		time_t time;    /* Time of the last edge [us] (wait_pin) */
 	} o;
 } __attribute__((packed)) gpio_devctl_t;
 
@@ -67,4 +84,19 @@ extern int gpiomsg_readDir(oid_t *dir, uint32_t *val);
 extern int gpiomsg_writeDir(oid_t *dir, uint32_t val, uint32_t mask);
 
 
+/* Waits for GPIO pin edge, returns number of edges since the last wait and time of the last one.
+ * The pin interrupt is enabled on the first call and edges are counted between calls. */
+extern int gpiomsg_waitPin(oid_t *pin, uint32_t rising, uint32_t *cnt, time_t *time);
+
+
+/* Subscribes the calling process to GPIO pin interrupt events (gpio_irq_* mode, gpio_irq_off unsubscribes).
+ * Each process has its own event queue, pins shared by several processes must use the same mode. */
+extern int gpiomsg_irqConfig(oid_t *pin, unsigned int mode);
+
+
+/* Reads GPIO interrupt events of the calling process, returns number of events read.
+ * Blocks until at least one event is available or timeout [us] expires (0 - no timeout, -ETIME returned). */
+extern int gpiomsg_readEvents(oid_t *oid, gpio_event_t *events, unsigned int n, uint32_t timeout, int block);
+
+
 #endif
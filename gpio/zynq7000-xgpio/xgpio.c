@@ -11,25 +11,55 @@
  * %LICENSE%
  */
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <sys/types.h>
 #include <sys/msg.h>
 #include <sys/threads.h>
 #include <posix/idtree.h>
 #include <posix/utils.h>
 #include <sys/mman.h>
+#include <sys/interrupt.h>
+#include <sys/time.h>
 
 #define ROOTFS_WAIT 1
 #define PRIORITY    2
 
+/* ISR event queue length, power of 2 */
+#ifndef XGPIO_EVENTS
+#define XGPIO_EVENTS 64
+#endif
+
+/* Max blocked readers of the events file */
+#ifndef XGPIO_READERS
+#define XGPIO_READERS 4
+#endif
+
 /* Registers */
 #define GPIO1_DATA 0
 #define GPIO1_DIR  1
 #define GPIO2_DATA 2
 #define GPIO2_DIR  3
+#define GPIO_GIER  (0x11c / 4)
+#define GPIO_ISR   (0x120 / 4)
+#define GPIO_IER   (0x128 / 4)
+
+/* Cortex-A9 global timer, used to timestamp events in the ISR */
+#define GTIMER_PAGE 0xf8f00000
+#define GTIMER_CNTL (0x200 / 4)
+#define GTIMER_CNTH (0x204 / 4)
+#define GTIMER_CTRL (0x208 / 4)
+
+/* Device ids outside of the channel encoding */
+#define GPIO_SPECIAL (1 << 8)
+enum { gpio_devEvents = 0, gpio_devPort64, gpio_devIrq0, gpio_devIrq1 };
+
+/* Request queued by gpio_readEvents(), response comes with the next event */
+#define GPIO_DEFERRED 1
 
 
 typedef struct {
@@ -40,12 +70,300 @@ typedef struct {
 } gpio_info_t;
 
 
+/* Record returned by reads of /dev/xgpio/events */
+typedef struct {
+	uint64_t time;    /* Event time [us], gettime() time base */
+	uint32_t data[2]; /* Channel 1 and 2 data sampled in the ISR */
+	uint8_t channels; /* Bit n set: channel n+1 interrupt */
+	uint8_t lost;     /* Events dropped before this one */
+	uint8_t reserved[6];
+} gpio_event_t;
+
+
+typedef struct {
+	uint64_t cnt;
+	uint32_t data[2];
+	uint8_t pending;
+	uint8_t lost;
+} gpio_isrEvent_t;
+
+
+typedef struct {
+	msg_t msg;
+	msg_rid_t rid;
+} gpio_reader_t;
+
+
 static struct {
 	oid_t oid;
 	volatile uint32_t *base;
+	volatile uint32_t *gtimer; /* Global timer registers, NULL if not available */
+
+	/* Written by the ISR (head, lost) and by gpio_takeEvents() (tail) */
+	gpio_isrEvent_t events[XGPIO_EVENTS];
+	unsigned int head;
+	unsigned int tail;
+	uint8_t lost;
+
+	uint64_t cnt0; /* Global timer count at time0 */
+	time_t time0;
+	uint64_t freq; /* Global timer frequency [Hz] */
+
+	/* Blocked events readers, protected by lock */
+	gpio_reader_t readers[XGPIO_READERS];
+	unsigned int nreaders;
+
+	handle_t lock;
+	handle_t cond;
+	handle_t inth;
+	int irq;
+
+	char stack[1024] __attribute__((aligned(8)));
 } gpio_common;
 
 
+static uint64_t gpio_gtimerRead(void)
+{
+	uint32_t hi, lo;
+
+	do {
+		hi = *(gpio_common.gtimer + GTIMER_CNTH);
+		lo = *(gpio_common.gtimer + GTIMER_CNTL);
+	} while (hi != *(gpio_common.gtimer + GTIMER_CNTH));
+
+	return ((uint64_t)hi << 32) | lo;
+}
+
+
+static time_t gpio_cntToTime(uint64_t cnt)
+{
+	uint64_t delta = cnt - gpio_common.cnt0;
+
+	return gpio_common.time0 + (time_t)((delta / gpio_common.freq) * 1000000 + ((delta % gpio_common.freq) * 1000000) / gpio_common.freq);
+}
+
+
+static int gpio_isr(unsigned int n, void *arg)
+{
+	unsigned int head = gpio_common.head;
+	gpio_isrEvent_t *evt;
+	uint32_t status;
+
+	(void)n;
+	(void)arg;
+
+	status = *(gpio_common.base + GPIO_ISR) & *(gpio_common.base + GPIO_IER) & 0x3;
+	if (status == 0) {
+		return -1;
+	}
+
+	/* Toggle on write, clears the pending bits */
+	*(gpio_common.base + GPIO_ISR) = status;
+
+	if ((head - __atomic_load_n(&gpio_common.tail, __ATOMIC_ACQUIRE)) == XGPIO_EVENTS) {
+		if (gpio_common.lost < 0xff) {
+			gpio_common.lost++;
+		}
+		return 1;
+	}
+
+	evt = &gpio_common.events[head & (XGPIO_EVENTS - 1)];
+	evt->cnt = (gpio_common.gtimer != NULL) ? gpio_gtimerRead() : 0;
+	evt->data[0] = *(gpio_common.base + GPIO1_DATA);
+	evt->data[1] = *(gpio_common.base + GPIO2_DATA);
+	evt->pending = (uint8_t)status;
+	evt->lost = gpio_common.lost;
+	gpio_common.lost = 0;
+	__atomic_store_n(&gpio_common.head, head + 1, __ATOMIC_RELEASE);
+
+	return 1;
+}
+
+
+/* Moves up to n queued events to the caller, returns number of events */
+static unsigned int gpio_takeEvents(gpio_event_t *events, unsigned int n)
+{
+	unsigned int cnt = 0, head, tail = gpio_common.tail;
+	gpio_isrEvent_t *evt;
+	time_t now = 0;
+
+	head = __atomic_load_n(&gpio_common.head, __ATOMIC_ACQUIRE);
+
+	if ((gpio_common.gtimer == NULL) && (head != tail)) {
+		gettime(&now, NULL);
+	}
+
+	for (; (cnt < n) && (tail != head); cnt++, tail++) {
+		evt = &gpio_common.events[tail & (XGPIO_EVENTS - 1)];
+		events[cnt].time = (gpio_common.gtimer != NULL) ? (uint64_t)gpio_cntToTime(evt->cnt) : (uint64_t)now;
+		events[cnt].data[0] = evt->data[0];
+		events[cnt].data[1] = evt->data[1];
+		events[cnt].channels = evt->pending;
+		events[cnt].lost = evt->lost;
+		memset(events[cnt].reserved, 0, sizeof(events[cnt].reserved));
+	}
+
+	__atomic_store_n(&gpio_common.tail, tail, __ATOMIC_RELEASE);
+
+	return cnt;
+}
+
+
+static int gpio_irqEnable(int channel, int enable)
+{
+	uint32_t ier;
+
+	if ((channel < 0) || (channel > 1)) {
+		return -EINVAL;
+	}
+
+	if (gpio_common.irq < 0) {
+		return -ENODEV;
+	}
+
+	mutexLock(gpio_common.lock);
+	ier = *(gpio_common.base + GPIO_IER);
+	if (enable != 0) {
+		/* Drop a stale pending bit, the first event should be a fresh change */
+		if ((*(gpio_common.base + GPIO_ISR) & (1U << channel)) != 0) {
+			*(gpio_common.base + GPIO_ISR) = 1U << channel;
+		}
+		ier |= 1U << channel;
+	}
+	else {
+		ier &= ~(1U << channel);
+	}
+	*(gpio_common.base + GPIO_IER) = ier;
+	*(gpio_common.base + GPIO_GIER) = (ier != 0) ? (1U << 31) : 0;
+	mutexUnlock(gpio_common.lock);
+
+	return EOK;
+}
+
+
+/* Called with lock held */
+static int gpio_readEvents(msg_t *msg, msg_rid_t rid)
+{
+	unsigned int n = msg->o.size / sizeof(gpio_event_t);
+
+	if ((msg->o.data == NULL) || (n == 0)) {
+		return -EINVAL;
+	}
+
+	if (gpio_common.irq < 0) {
+		return -ENODEV;
+	}
+
+	/* Serve readers in order, don't overtake the blocked ones */
+	if (gpio_common.nreaders == 0) {
+		n = gpio_takeEvents(msg->o.data, n);
+		if (n != 0) {
+			return (int)(n * sizeof(gpio_event_t));
+		}
+	}
+
+	if ((msg->i.io.mode & O_NONBLOCK) != 0) {
+		return -EAGAIN;
+	}
+
+	if (gpio_common.nreaders == XGPIO_READERS) {
+		return -EBUSY;
+	}
+
+	gpio_common.readers[gpio_common.nreaders].msg = *msg;
+	gpio_common.readers[gpio_common.nreaders].rid = rid;
+	gpio_common.nreaders++;
+
+	return GPIO_DEFERRED;
+}
+
+
+static void gpio_eventThread(void *arg)
+{
+	gpio_reader_t *reader;
+	unsigned int n;
+
+	(void)arg;
+
+	mutexLock(gpio_common.lock);
+	for (;;) {
+		while ((gpio_common.nreaders == 0) || (__atomic_load_n(&gpio_common.head, __ATOMIC_ACQUIRE) == gpio_common.tail)) {
+			condWait(gpio_common.cond, gpio_common.lock, 0);
+		}
+
+		reader = &gpio_common.readers[0];
+		n = gpio_takeEvents(reader->msg.o.data, reader->msg.o.size / sizeof(gpio_event_t));
+		reader->msg.o.err = (int)(n * sizeof(gpio_event_t));
+		msgRespond(gpio_common.oid.port, &reader->msg, reader->rid);
+
+		gpio_common.nreaders--;
+		memmove(&gpio_common.readers[0], &gpio_common.readers[1], gpio_common.nreaders * sizeof(gpio_reader_t));
+	}
+}
+
+
+static void gpio_initTimer(void)
+{
+	volatile uint32_t *page;
+	uint64_t cnt1;
+	time_t time1;
+
+	page = mmap(NULL, _PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_DEVICE | MAP_PHYSMEM | MAP_ANONYMOUS, -1, GTIMER_PAGE);
+	if (page == MAP_FAILED) {
+		return;
+	}
+
+	/* Start the timer if the kernel doesn't use it */
+	if ((*(page + GTIMER_CTRL) & 1) == 0) {
+		*(page + GTIMER_CTRL) = 1;
+	}
+	gpio_common.gtimer = page;
+
+	gettime(&gpio_common.time0, NULL);
+	gpio_common.cnt0 = gpio_gtimerRead();
+	usleep(100000);
+	gettime(&time1, NULL);
+	cnt1 = gpio_gtimerRead();
+
+	if (time1 <= gpio_common.time0) {
+		gpio_common.gtimer = NULL;
+		munmap((void *)page, _PAGE_SIZE);
+		return;
+	}
+
+	gpio_common.freq = ((cnt1 - gpio_common.cnt0) * 1000000) / (uint64_t)(time1 - gpio_common.time0);
+	gpio_common.cnt0 = cnt1;
+	gpio_common.time0 = time1;
+}
+
+
+static int gpio_initIrq(unsigned int irq)
+{
+	int err;
+
+	/* Interrupts off until enabled through xgpioN/irq */
+	*(gpio_common.base + GPIO_GIER) = 0;
+	*(gpio_common.base + GPIO_IER) = 0;
+	*(gpio_common.base + GPIO_ISR) = *(gpio_common.base + GPIO_ISR);
+
+	gpio_initTimer();
+
+	err = interrupt(irq, gpio_isr, NULL, gpio_common.cond, &gpio_common.inth);
+	if (err < 0) {
+		return err;
+	}
+
+	err = beginthread(gpio_eventThread, PRIORITY, gpio_common.stack, sizeof(gpio_common.stack), NULL);
+	if (err < 0) {
+		return err;
+	}
+
+	gpio_common.irq = (int)irq;
+
+	return EOK;
+}
+
+
 static void gpio_encodeOid(const gpio_info_t *info, oid_t *oid)
 {
 	oid->id = info->channel << 7;
@@ -170,6 +488,89 @@ static int gpio_readPin(int channel, int pin, uint32_t *val)
 }
 
 
+static int gpio_readText(msg_t *msg, uint64_t val)
+{
+	char buff[24];
+	int ret;
+
+	if (msg->o.data == NULL || msg->o.size == 0) {
+		return 0;
+	}
+
+	ret = sprintf(buff, "%llu\n", (unsigned long long)val);
+	++ret;
+	if (ret <= msg->i.io.offs) {
+		/* EOF */
+		return 0;
+	}
+
+	strncpy(msg->o.data, buff + msg->i.io.offs, msg->o.size);
+	((char *)msg->o.data)[msg->o.size - 1] = '\0';
+	ret -= msg->i.io.offs;
+
+	return (ret < (int)msg->o.size) ? ret : msg->o.size;
+}
+
+
+static int gpio_special(msg_t *msg, msg_rid_t rid)
+{
+	char buff[24];
+	uint64_t val;
+	uint32_t lo, hi;
+	int ret, dev = (int)(msg->oid.id & 0xff);
+
+	switch (msg->type) {
+		case mtRead:
+			if (dev == gpio_devEvents) {
+				mutexLock(gpio_common.lock);
+				ret = gpio_readEvents(msg, rid);
+				mutexUnlock(gpio_common.lock);
+				return ret;
+			}
+
+			if (dev == gpio_devPort64) {
+				/* Both channels sampled back to back */
+				lo = *(gpio_common.base + GPIO1_DATA);
+				hi = *(gpio_common.base + GPIO2_DATA);
+				return gpio_readText(msg, ((uint64_t)hi << 32) | lo);
+			}
+
+			if (gpio_common.irq < 0) {
+				return gpio_readText(msg, 0);
+			}
+
+			return gpio_readText(msg, (*(gpio_common.base + GPIO_IER) >> (dev - gpio_devIrq0)) & 1);
+
+		case mtWrite:
+			if (dev == gpio_devEvents) {
+				return -EINVAL;
+			}
+
+			if (msg->i.data == NULL || msg->i.size == 0) {
+				return 0;
+			}
+
+			strncpy(buff, msg->i.data, msg->i.size < sizeof(buff) ? msg->i.size : sizeof(buff));
+			buff[sizeof(buff) - 1] = '\0';
+			val = strtoull(buff, NULL, 0);
+
+			if (dev == gpio_devPort64) {
+				*(gpio_common.base + GPIO1_DATA) = (uint32_t)val;
+				*(gpio_common.base + GPIO2_DATA) = (uint32_t)(val >> 32);
+				ret = EOK;
+			}
+			else {
+				ret = gpio_irqEnable(dev - gpio_devIrq0, (val != 0) ? 1 : 0);
+			}
+
+			return (ret < 0) ? ret : (int)msg->i.size;
+
+		default:
+			return -ENOSYS;
+	}
+}
+
+
 static void gpio_thread(void *arg)
 {
 	msg_t msg;
@@ -186,6 +587,17 @@ static void gpio_thread(void *arg)
 			continue;
 		}
 
+		if (((msg.type == mtRead) || (msg.type == mtWrite)) && ((msg.oid.id & GPIO_SPECIAL) != 0)) {
+			ret = gpio_special(&msg, rid);
+			if (ret == GPIO_DEFERRED) {
+				/* Responded by gpio_eventThread() */
+				continue;
+			}
+			msg.o.err = ret;
+			msgRespond(gpio_common.oid.port, &msg, rid);
+			continue;
+		}
+
 		switch (msg.type) {
 			case mtOpen:
 			case mtClose:
@@ -272,6 +684,7 @@ static void gpio_usage(const char *progname)
 	printf("Usage: %s [OPTIONS]\n", progname);
 	printf("Options:\n");
 	printf("\t-b base_addr - base address of XGPIO IP\n");
+	printf("\t-i irq       - XGPIO IP interrupt line, enables events\n");
 	printf("\t-p priority  - server thread priority (default %d)\n", PRIORITY);
 	printf("\t-h           - this message\n");
 }
@@ -285,6 +698,17 @@ int main(int argc, char *argv[])
 	oid_t oid;
 	gpio_info_t info;
 	int prio = PRIORITY;
+	int irq = -1;
+	static const struct {
+		int id;
+		const char *name;
+	} specials[] = {
+		{ gpio_devEvents, "xgpio/events" },
+		{ gpio_devPort64, "xgpio/port64" },
+		{ gpio_devIrq0, "xgpio0/irq" },
+		{ gpio_devIrq1, "xgpio1/irq" },
+	};
+	unsigned int i;
 
 	if (ROOTFS_WAIT != 0) {
 		oid_t rootfs;
@@ -301,7 +725,7 @@ int main(int argc, char *argv[])
 		}
 	}
 
-	while ((opt = getopt(argc, argv, "b:p:h")) >= 0) {
+	while ((opt = getopt(argc, argv, "b:i:p:h")) >= 0) {
 		switch (opt) {
 			case 'b':
 				baseaddr = (uintptr_t)strtoul(optarg, NULL, 0);
@@ -312,6 +736,14 @@ int main(int argc, char *argv[])
 				}
 				break;
 
+			case 'i':
+				irq = (int)strtol(optarg, NULL, 0);
+				if (irq <= 0) {
+					fprintf(stderr, "xgpio: failed to parse interrupt %s\n", optarg);
+					return EXIT_FAILURE;
+				}
+				break;
+
 			case 'p':
 				/* Ignore conversion errors */
 				prio = (int)strtol(optarg, NULL, 0);
@@ -340,6 +772,18 @@ int main(int argc, char *argv[])
 		return EXIT_FAILURE;
 	}
 
+	gpio_common.irq = -1;
+
+	if ((mutexCreate(&gpio_common.lock) < 0) || (condCreate(&gpio_common.cond) < 0)) {
+		fprintf(stderr, "xgpio: failed to create synchronization primitives\n");
+		return EXIT_FAILURE;
+	}
+
+	if ((irq > 0) && (gpio_initIrq((unsigned int)irq) < 0)) {
+		fprintf(stderr, "xgpio: failed to attach interrupt %d\n", irq);
+		return EXIT_FAILURE;
+	}
+
 	if (portCreate(&oid.port) < 0) {
 		fprintf(stderr, "xgpio: failed to create port\n");
 		return EXIT_FAILURE;
@@ -380,6 +824,14 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	for (i = 0; i < sizeof(specials) / sizeof(specials[0]); ++i) {
+		oid.id = GPIO_SPECIAL | specials[i].id;
+		if (create_dev(&oid, specials[i].name) < 0) {
+			fprintf(stderr, "xgpio: failed to register device %s\n", specials[i].name);
+			return EXIT_FAILURE;
+		}
+	}
+
 	printf("xgpio: initialized\n");
 
 	priority(prio);
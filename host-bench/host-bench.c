@@ -0,0 +1,446 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Host benchmark of driver hot paths against simulated registers
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "../tty/libtty/fifo.h"
+#include "../tty/libtty/libtty-lf-fifo.h"
+#include "../sensors/simsensor_common/event_queue.h"
+
+
+#define BENCH_DEF_OPS   100000 /* Default number of operations per path */
+#define BENCH_DEF_LEN   64     /* Default bytes moved by a single operation */
+#define BENCH_FIFO_SIZE 4096   /* Size of the benchmarked byte fifos, power of 2 */
+#define BENCH_MAX_LEN   (BENCH_FIFO_SIZE / 2)
+#define BENCH_EVQ_SIZE  32     /* Event queue capacity, as sensors client queues */
+#define BENCH_MAX_PATHS 8
+
+/* Simulated UART: status register with the rx ready bit, data register popping the rx fifo */
+#define SIM_UART_SR   0
+#define SIM_UART_DR   1
+#define SIM_UART_RXNE (1u << 5)
+
+
+typedef struct {
+	const char *name;
+	int (*init)(void);
+	void (*op)(void);
+	void (*done)(void);
+} bench_path_t;
+
+
+static struct {
+	unsigned int nops;
+	unsigned int len;
+	uint64_t *lat;
+	unsigned long limits[BENCH_MAX_PATHS];
+
+	/* Allocations done while counting is set */
+	volatile int counting;
+	unsigned long allocs;
+	unsigned long allocBytes;
+
+	uint8_t buf[BENCH_MAX_LEN];
+	uint8_t data[BENCH_FIFO_SIZE];
+	union {
+		fifo_t fifo;
+		uint8_t raw[sizeof(fifo_t) + BENCH_FIFO_SIZE];
+	} fifo;
+	lf_fifo_t lf;
+	event_queue_t evq;
+	sensor_event_t evt;
+
+	volatile uint32_t regs[2];
+	unsigned int rxpending;
+} bench_common;
+
+
+#ifdef __GLIBC__
+
+/* Allocation counting wrappers, hot paths are expected not to allocate at all */
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+
+void *malloc(size_t size)
+{
+	if (bench_common.counting != 0) {
+		bench_common.allocs++;
+		bench_common.allocBytes += size;
+	}
+
+	return __libc_malloc(size);
+}
+
+
+void *calloc(size_t n, size_t size)
+{
+	if (bench_common.counting != 0) {
+		bench_common.allocs++;
+		bench_common.allocBytes += n * size;
+	}
+
+	return __libc_calloc(n, size);
+}
+
+
+void *realloc(void *ptr, size_t size)
+{
+	if (bench_common.counting != 0) {
+		bench_common.allocs++;
+		bench_common.allocBytes += size;
+	}
+
+	return __libc_realloc(ptr, size);
+}
+
+#define BENCH_ALLOCS 1
+#else
+#define BENCH_ALLOCS 0
+#endif
+
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#define BENCH_UNIT "cyc"
+
+static inline uint64_t bench_now(void)
+{
+	return __rdtsc();
+}
+
+#else
+
+#define BENCH_UNIT "ns"
+
+static inline uint64_t bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#endif
+
+
+/* tty: libtty write path - bulk copy into the fifo, then drained by the tx irq */
+
+static int bench_fifoInit(void)
+{
+	fifo_init(&bench_common.fifo.fifo, BENCH_FIFO_SIZE);
+
+	return 0;
+}
+
+
+static void bench_fifoOp(void)
+{
+	unsigned int i;
+
+	fifo_write_bulk(&bench_common.fifo.fifo, bench_common.buf, bench_common.len);
+	for (i = 0; i < bench_common.len; i++) {
+		bench_common.regs[SIM_UART_DR] = fifo_pop_back(&bench_common.fifo.fifo);
+	}
+}
+
+
+/* tty: uart rx irq pushing bytes from the simulated data register into the lock-free fifo, the thread pops them in bulk */
+
+static int bench_uartRxInit(void)
+{
+	lf_fifo_init(&bench_common.lf, bench_common.data, BENCH_FIFO_SIZE);
+
+	return 0;
+}
+
+
+static inline uint32_t bench_uartRead(unsigned int reg)
+{
+	/* Register read side effects of the simulated device */
+	if (reg == SIM_UART_DR) {
+		bench_common.rxpending--;
+		bench_common.regs[SIM_UART_SR] = (bench_common.rxpending != 0) ? SIM_UART_RXNE : 0;
+	}
+
+	return bench_common.regs[reg];
+}
+
+
+static void bench_uartRxOp(void)
+{
+	bench_common.rxpending = bench_common.len;
+	bench_common.regs[SIM_UART_SR] = SIM_UART_RXNE;
+	bench_common.regs[SIM_UART_DR] = 0x55;
+
+	while ((bench_uartRead(SIM_UART_SR) & SIM_UART_RXNE) != 0) {
+		lf_fifo_push(&bench_common.lf, (uint8_t)bench_uartRead(SIM_UART_DR));
+	}
+
+	lf_fifo_pop_bulk(&bench_common.lf, bench_common.buf, bench_common.len);
+}
+
+
+/* sensors: client event queue publish on a full queue, the oldest event is dropped */
+
+static int bench_evqInit(void)
+{
+	unsigned int i;
+
+	if (eventQueue_init(&bench_common.evq, BENCH_EVQ_SIZE) < 0) {
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < BENCH_EVQ_SIZE; i++) {
+		eventQueue_enqueue(&bench_common.evq, &bench_common.evt);
+	}
+
+	return 0;
+}
+
+
+static void bench_evqOp(void)
+{
+	sensor_event_t evt;
+
+	if (eventQueue_full(&bench_common.evq)) {
+		eventQueue_dequeue(&bench_common.evq, &evt);
+	}
+	bench_common.evt.timestamp++;
+	eventQueue_enqueue(&bench_common.evq, &bench_common.evt);
+}
+
+
+static void bench_evqDone(void)
+{
+	eventQueue_free(&bench_common.evq);
+}
+
+
+static const bench_path_t bench_paths[] = {
+	{ "tty-fifo", bench_fifoInit, bench_fifoOp, NULL },
+	{ "tty-uart-rx", bench_uartRxInit, bench_uartRxOp, NULL },
+	{ "sensors-evq", bench_evqInit, bench_evqOp, bench_evqDone },
+};
+
+#define NPATHS (sizeof(bench_paths) / sizeof(bench_paths[0]))
+
+
+static int bench_cmplat(const void *a, const void *b)
+{
+	uint64_t la = *(const uint64_t *)a, lb = *(const uint64_t *)b;
+
+	return (la > lb) - (la < lb);
+}
+
+
+static int bench_run(unsigned int idx)
+{
+	const bench_path_t *path = &bench_paths[idx];
+	uint64_t start, overhead;
+	unsigned int i, n = bench_common.nops;
+	int err;
+
+	err = path->init();
+	if (err < 0) {
+		printf("{\"path\":\"%s\",\"err\":%d}\n", path->name, err);
+		return err;
+	}
+
+	/* Warm up caches and branch predictors, the timer overhead is subtracted from the results */
+	overhead = UINT64_MAX;
+	for (i = 0; i < 1000; i++) {
+		path->op();
+		start = bench_now();
+		bench_common.lat[0] = bench_now() - start;
+		if (bench_common.lat[0] < overhead) {
+			overhead = bench_common.lat[0];
+		}
+	}
+
+	bench_common.allocs = 0;
+	bench_common.allocBytes = 0;
+	bench_common.counting = 1;
+	for (i = 0; i < n; i++) {
+		start = bench_now();
+		path->op();
+		bench_common.lat[i] = bench_now() - start;
+	}
+	bench_common.counting = 0;
+
+	if (path->done != NULL) {
+		path->done();
+	}
+
+	for (i = 0; i < n; i++) {
+		bench_common.lat[i] = (bench_common.lat[i] > overhead) ? bench_common.lat[i] - overhead : 0;
+	}
+	qsort(bench_common.lat, n, sizeof(bench_common.lat[0]), bench_cmplat);
+
+	printf("{\"path\":\"%s\",\"len\":%u,\"ops\":%u,\"unit\":\"%s\",\"min\":%llu,\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,\"max\":%llu",
+		path->name, bench_common.len, n, BENCH_UNIT,
+		(unsigned long long)bench_common.lat[0],
+		(unsigned long long)bench_common.lat[n / 2],
+		(unsigned long long)bench_common.lat[(n * 9ULL) / 10],
+		(unsigned long long)bench_common.lat[(n * 99ULL) / 100],
+		(unsigned long long)bench_common.lat[n - 1]);
+	if (BENCH_ALLOCS != 0) {
+		printf(",\"allocs\":%lu,\"alloc_bytes\":%lu}\n", bench_common.allocs, bench_common.allocBytes);
+	}
+	else {
+		printf("}\n");
+	}
+
+	if ((bench_common.limits[idx] != 0) && (bench_common.lat[n / 2] > bench_common.limits[idx])) {
+		fprintf(stderr, "host-bench: %s p50 %llu %s over the limit %lu\n", path->name,
+			(unsigned long long)bench_common.lat[n / 2], BENCH_UNIT, bench_common.limits[idx]);
+		return -ERANGE;
+	}
+
+	return 0;
+}
+
+
+static int bench_pathIdx(const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < NPATHS; i++) {
+		if (strcmp(name, bench_paths[i].name) == 0) {
+			return i;
+		}
+	}
+
+	fprintf(stderr, "host-bench: unknown path %s\n", name);
+
+	return -EINVAL;
+}
+
+
+static void bench_usage(const char *prog)
+{
+	unsigned int i;
+
+	printf("Usage: %s [options]\n", prog);
+	printf("\t-n <ops>     - operations per path (default %u)\n", BENCH_DEF_OPS);
+	printf("\t-s <len>     - bytes moved by a single operation (default %u, max %u)\n", BENCH_DEF_LEN, BENCH_MAX_LEN);
+	printf("\t-t <paths>   - comma separated paths (default all)\n");
+	printf("\t-l <limits>  - comma separated path=p50 limits, fails if exceeded\n");
+	printf("\t-A           - fails if a path allocates memory\n");
+	printf("\t-h           - shows this help message\n");
+	printf("Paths:");
+	for (i = 0; i < NPATHS; i++) {
+		printf(" %s", bench_paths[i].name);
+	}
+	printf("\n");
+}
+
+
+int main(int argc, char **argv)
+{
+	unsigned int paths = (1u << NPATHS) - 1, i;
+	int c, idx, noalloc = 0, err = EXIT_SUCCESS;
+	char *tok, *arg, *val;
+
+	bench_common.nops = BENCH_DEF_OPS;
+	bench_common.len = BENCH_DEF_LEN;
+
+	while ((c = getopt(argc, argv, "n:s:t:l:Ah")) != -1) {
+		switch (c) {
+			case 'n':
+				bench_common.nops = strtoul(optarg, NULL, 0);
+				break;
+
+			case 's':
+				bench_common.len = strtoul(optarg, NULL, 0);
+				break;
+
+			case 't':
+				paths = 0;
+				for (arg = optarg; (tok = strtok(arg, ",")) != NULL; arg = NULL) {
+					idx = bench_pathIdx(tok);
+					if (idx < 0) {
+						return EXIT_FAILURE;
+					}
+					paths |= 1u << idx;
+				}
+				break;
+
+			case 'l':
+				for (arg = optarg; (tok = strtok(arg, ",")) != NULL; arg = NULL) {
+					val = strchr(tok, '=');
+					if (val == NULL) {
+						fprintf(stderr, "host-bench: invalid limit %s\n", tok);
+						return EXIT_FAILURE;
+					}
+					*val++ = '\0';
+					idx = bench_pathIdx(tok);
+					if (idx < 0) {
+						return EXIT_FAILURE;
+					}
+					bench_common.limits[idx] = strtoul(val, NULL, 0);
+				}
+				break;
+
+			case 'A':
+				noalloc = 1;
+				break;
+
+			case 'h':
+			default:
+				bench_usage(argv[0]);
+				return EXIT_SUCCESS;
+		}
+	}
+
+	if ((bench_common.nops == 0) || (bench_common.len == 0) || (bench_common.len > BENCH_MAX_LEN)) {
+		bench_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	bench_common.lat = malloc(bench_common.nops * sizeof(bench_common.lat[0]));
+	if (bench_common.lat == NULL) {
+		fprintf(stderr, "host-bench: out of memory\n");
+		return EXIT_FAILURE;
+	}
+
+	for (i = 0; i < NPATHS; i++) {
+		if ((paths & (1u << i)) == 0) {
+			continue;
+		}
+
+		if (bench_run(i) < 0) {
+			err = EXIT_FAILURE;
+		}
+		else if ((noalloc != 0) && (bench_common.allocs != 0)) {
+			fprintf(stderr, "host-bench: %s allocates memory\n", bench_paths[i].name);
+			err = EXIT_FAILURE;
+		}
+	}
+
+	free(bench_common.lat);
+
+	return err;
+}
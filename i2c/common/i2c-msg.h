@@ -7,7 +7,8 @@
 enum {
 	i2c_devctl_bus_write, /* input params: dev_addr, *data, len */
 	i2c_devctl_bus_read,  /* input params: dev_addr, *data, len */
-	i2c_devctl_reg_read   /* input params: dev_addr, reg_addr, *data, len */
+	i2c_devctl_reg_read,  /* input params: dev_addr, reg_addr, *data, len */
+	i2c_devctl_rdwr       /* input params: msgs, count, write data in i.data, read data in o.data */
 };
 
 typedef struct {
@@ -18,4 +19,27 @@ typedef struct {
 	} i;
 } __attribute__((packed)) i2c_devctl_t;
 
+
+#define I2C_MSG_RD (1u << 0) /* read message, write otherwise */
+
+#define I2C_RDWR_MSGS_MAX 12
+
+/* Single message of combined transfer, each one begins with (repeated) START */
+typedef struct {
+	uint8_t dev_addr;
+	uint8_t flags;
+	uint16_t len;
+} __attribute__((packed)) i2c_msg_t;
+
+
+/* Messages are transferred in order with single STOP at the end,
+ * data of write messages is concatenated in i.data, data of read messages in o.data */
+typedef struct {
+	struct {
+		unsigned int type;
+		uint8_t count;
+		i2c_msg_t msgs[I2C_RDWR_MSGS_MAX];
+	} i;
+} __attribute__((packed)) i2c_devctl_rdwr_t;
+
 #endif /* _PHOENIX_I2C_MSG_H */
@@ -2,6 +2,7 @@
 #define _PHOENIX_I2C_H
 
 #include <stdint.h>
+#include <i2c-msg.h>
 
 
 /* initialises peripheral, returns 0 on success <0 on error */
@@ -27,4 +28,10 @@ extern int i2c_busRead(uint8_t dev_addr, uint8_t *data_out, uint32_t len);
 /* Performs i2c regiester read operation from the given slave device */
 extern int i2c_regRead(uint8_t dev_addr, uint8_t reg_addr, uint8_t *data_out, uint32_t len);
 
+
+/* Performs combined transfer of up to I2C_RDWR_MSGS_MAX messages (repeated START between them).
+ * Data of write messages is taken in order from wdata, data of read messages is stored in order in rdata.
+ * Not all drivers support it (-ENOSYS / -EINVAL is returned then) */
+extern int i2c_transfer(const i2c_msg_t *msgs, unsigned int count, const uint8_t *wdata, uint32_t wlen, uint8_t *rdata, uint32_t rlen);
+
 #endif /* _PHOENIX_I2C_H */
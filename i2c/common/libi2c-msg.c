@@ -15,6 +15,7 @@
 #include <sys/types.h>
 
 #include <stdio.h>
+#include <string.h>
 #include <errno.h>
 #include <unistd.h>
 
@@ -128,3 +129,35 @@ int i2c_regRead(uint8_t dev_addr, uint8_t reg_addr, uint8_t *data_out, uint32_t
 
 	return msg.o.err;
 }
+
+
+/* Performs combined transfer of multiple messages */
+int i2c_transfer(const i2c_msg_t *msgs, unsigned int count, const uint8_t *wdata, uint32_t wlen, uint8_t *rdata, uint32_t rlen)
+{
+	msg_t msg;
+	int res;
+	i2c_devctl_rdwr_t *in = (i2c_devctl_rdwr_t *)msg.i.raw;
+
+	if (!common.initialized)
+		return -EIO;
+
+	if ((count == 0) || (count > I2C_RDWR_MSGS_MAX))
+		return -EINVAL;
+
+	msg.type = mtDevCtl;
+
+	msg.i.data = (uint8_t *)wdata; /* FIXME: dropping const because of broken msg_t declaration */
+	msg.i.size = wlen;
+	msg.o.data = rdata;
+	msg.o.size = rlen;
+	msg.oid.port = common.i2c_oid.port;
+
+	in->i.type = i2c_devctl_rdwr;
+	in->i.count = count;
+	memcpy(in->i.msgs, msgs, count * sizeof(*msgs));
+
+	if ((res = msgSend(common.i2c_oid.port, &msg)) < 0)
+		return res;
+
+	return msg.o.err;
+}
@@ -0,0 +1,285 @@
+/*
+ * Phoenix-RTOS
+ *
+ * I2C bus benchmark
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <bench.h>
+#include <i2c.h>
+
+
+#define BENCH_DEF_LEN  16    /* Default data bytes per transaction */
+#define BENCH_DEF_OPS  1000  /* Default number of transactions per test */
+#define BENCH_MAX_LEN  4096  /* Max data bytes per transaction */
+#define BENCH_HIST     12    /* Latency histogram buckets, powers of 2 from 64 us */
+
+
+/* Benchmark tests */
+enum { READ, REGREAD, XFER, WRITE, NTESTS };
+
+
+static const char *const bench_names[NTESTS] = { "read", "regread", "xfer", "write" };
+
+
+static struct {
+	/* Configuration */
+	unsigned int bus;     /* I2C bus number (/dev/i2cX) */
+	uint8_t addr;         /* Device address */
+	uint32_t reg;         /* Register address */
+	unsigned int regw;    /* Register address width for xfer and write tests (bytes) */
+	size_t len;           /* Data bytes per transaction */
+	unsigned int nops;    /* Number of transactions per test */
+	unsigned int gap;     /* Delay between transactions (us) */
+
+	uint8_t buff[BENCH_MAX_LEN + 4];
+	uint32_t *lat;        /* Successful transactions latencies (us) */
+} bench_common;
+
+
+/* Register address, MSB first */
+static void bench_regaddr(uint8_t *buff)
+{
+	unsigned int i;
+
+	for (i = 0; i < bench_common.regw; i++) {
+		buff[i] = (bench_common.reg >> (8 * (bench_common.regw - 1 - i))) & 0xff;
+	}
+}
+
+
+static int bench_op(int test)
+{
+	i2c_msg_t msgs[2];
+
+	switch (test) {
+		case READ:
+			return i2c_busRead(bench_common.addr, bench_common.buff, bench_common.len);
+
+		case REGREAD:
+			return i2c_regRead(bench_common.addr, bench_common.reg, bench_common.buff, bench_common.len);
+
+		case XFER:
+			/* Register address write and data read with repeated START, buff holds both */
+			msgs[0].dev_addr = bench_common.addr;
+			msgs[0].flags = 0;
+			msgs[0].len = bench_common.regw;
+			msgs[1].dev_addr = bench_common.addr;
+			msgs[1].flags = I2C_MSG_RD;
+			msgs[1].len = bench_common.len;
+			bench_regaddr(bench_common.buff + BENCH_MAX_LEN);
+			return i2c_transfer(msgs, 2, bench_common.buff + BENCH_MAX_LEN, bench_common.regw, bench_common.buff, bench_common.len);
+
+		default:
+			/* Register address followed by data */
+			bench_regaddr(bench_common.buff);
+			return i2c_busWrite(bench_common.addr, bench_common.buff, bench_common.regw + bench_common.len);
+	}
+}
+
+
+static int bench_run(int test)
+{
+	unsigned int i, ok = 0, eio = 0, etime = 0, ebusy = 0, eother = 0;
+	unsigned int hist[BENCH_HIST] = { 0 };
+	uint64_t start, t, usec = 0;
+	bench_report_t r;
+	char addr[5];
+	double bps;
+	int ret, first = 0;
+
+	if (test == WRITE) {
+		for (i = 0; i < bench_common.len; i++) {
+			bench_common.buff[bench_common.regw + i] = i & 0xff;
+		}
+	}
+
+	for (i = 0; i < bench_common.nops; i++) {
+		if ((i != 0) && (bench_common.gap != 0)) {
+			usleep(bench_common.gap);
+		}
+
+		start = bench_nowUs();
+		ret = bench_op(test);
+		t = bench_nowUs() - start;
+
+		if (ret < 0) {
+			if (first == 0) {
+				first = ret;
+			}
+
+			switch (ret) {
+				case -EIO: eio++; break;
+				case -ETIMEDOUT: etime++; break;
+				case -EBUSY: ebusy++; break;
+				default: eother++; break;
+			}
+			continue;
+		}
+
+		bench_common.lat[ok++] = (uint32_t)t;
+		usec += t;
+
+		hist[bench_histBucket((uint32_t)t, 64, BENCH_HIST)]++;
+	}
+
+	snprintf(addr, sizeof(addr), "0x%02x", bench_common.addr);
+
+	bench_reportBegin(&r);
+	bench_reportUint(&r, "bus", bench_common.bus);
+	bench_reportStr(&r, "addr", addr);
+	bench_reportStr(&r, "test", bench_names[test]);
+
+	if (ok == 0) {
+		bench_reportInt(&r, "err", first);
+		bench_reportUint(&r, "eio", eio);
+		bench_reportUint(&r, "etimedout", etime);
+		bench_reportUint(&r, "ebusy", ebusy);
+		bench_reportUint(&r, "eother", eother);
+		bench_reportEnd(&r);
+		return first;
+	}
+
+	bench_sort(bench_common.lat, ok);
+
+	/* Payload rate while the bus was busy with successful transactions, gaps are not counted */
+	if (usec == 0) {
+		usec = 1;
+	}
+	bps = (double)ok * bench_common.len * 1000000 / usec;
+
+	bench_reportUint(&r, "len", bench_common.len);
+	bench_reportUint(&r, "ops", bench_common.nops);
+	bench_reportUint(&r, "ok", ok);
+	bench_reportUint(&r, "eio", eio);
+	bench_reportUint(&r, "etimedout", etime);
+	bench_reportUint(&r, "ebusy", ebusy);
+	bench_reportUint(&r, "eother", eother);
+	bench_reportDouble(&r, "bps", bps, 0);
+	bench_reportLatency(&r, "", "us", bench_common.lat, ok);
+	bench_reportArray(&r, "hist", hist, BENCH_HIST);
+	bench_reportEnd(&r);
+
+	return (ok == bench_common.nops) ? 0 : first;
+}
+
+
+static void bench_usage(const char *prog)
+{
+	printf("Usage: %s [options] <bus> <addr>\n", prog);
+	printf("\t-l <len>    - data bytes per transaction (default %u, max %u)\n", BENCH_DEF_LEN, BENCH_MAX_LEN);
+	printf("\t-n <ops>    - transactions per test (default %u)\n", BENCH_DEF_OPS);
+	printf("\t-r <reg>    - register address (default 0)\n");
+	printf("\t-a <width>  - register address width in bytes for xfer/write tests, 1-4 (default 1)\n");
+	printf("\t-g <us>     - delay between transactions (default 0)\n");
+	printf("\t-t <tests>  - comma separated tests: read,regread,xfer,write (default read tests)\n");
+	printf("\t-w          - allow write test, writes data at the register address\n");
+	printf("\t-h          - shows this help message\n");
+}
+
+
+int main(int argc, char **argv)
+{
+	unsigned int tests = (1 << READ) | (1 << REGREAD) | (1 << XFER);
+	int c, i, wr = 0, err = EXIT_SUCCESS;
+	const char *bad;
+
+	bench_common.len = BENCH_DEF_LEN;
+	bench_common.nops = BENCH_DEF_OPS;
+	bench_common.regw = 1;
+
+	while ((c = getopt(argc, argv, "l:n:r:a:g:t:wh")) != -1) {
+		switch (c) {
+			case 'l':
+				bench_common.len = strtoul(optarg, NULL, 0);
+				break;
+
+			case 'n':
+				bench_common.nops = strtoul(optarg, NULL, 0);
+				break;
+
+			case 'r':
+				bench_common.reg = strtoul(optarg, NULL, 0);
+				break;
+
+			case 'a':
+				bench_common.regw = strtoul(optarg, NULL, 0);
+				break;
+
+			case 'g':
+				bench_common.gap = strtoul(optarg, NULL, 0);
+				break;
+
+			case 't':
+				if (bench_parseTests(optarg, bench_names, NTESTS, &tests, &bad) < 0) {
+					fprintf(stderr, "i2c-bench: unknown test %s\n", bad);
+					return EXIT_FAILURE;
+				}
+				break;
+
+			case 'w':
+				wr = 1;
+				break;
+
+			case 'h':
+			default:
+				bench_usage(argv[0]);
+				return EXIT_SUCCESS;
+		}
+	}
+
+	if (optind != argc - 2) {
+		bench_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	bench_common.bus = strtoul(argv[optind], NULL, 0);
+	bench_common.addr = strtoul(argv[optind + 1], NULL, 0) & 0x7f;
+
+	if ((tests & (1 << WRITE)) && !wr) {
+		fprintf(stderr, "i2c-bench: write test requires -w option\n");
+		return EXIT_FAILURE;
+	}
+
+	if ((bench_common.len == 0) || (bench_common.len > BENCH_MAX_LEN) || (bench_common.nops == 0) ||
+			(bench_common.regw == 0) || (bench_common.regw > 4)) {
+		fprintf(stderr, "i2c-bench: invalid length, number of transactions or register width\n");
+		return EXIT_FAILURE;
+	}
+
+	if (((tests & (1 << REGREAD)) != 0) && (bench_common.reg > 0xff)) {
+		fprintf(stderr, "i2c-bench: regread test supports 8-bit register addresses only, use xfer\n");
+		return EXIT_FAILURE;
+	}
+
+	if (i2c_init(bench_common.bus) < 0) {
+		fprintf(stderr, "i2c-bench: failed to open /dev/i2c%u\n", bench_common.bus);
+		return EXIT_FAILURE;
+	}
+
+	bench_common.lat = malloc(bench_common.nops * sizeof(bench_common.lat[0]));
+	if (bench_common.lat == NULL) {
+		fprintf(stderr, "i2c-bench: out of memory\n");
+		return EXIT_FAILURE;
+	}
+
+	for (i = 0; i < NTESTS; i++) {
+		if (((tests & (1 << i)) != 0) && (bench_run(i) < 0)) {
+			err = EXIT_FAILURE;
+		}
+	}
+
+	free(bench_common.lat);
+
+	return err;
+}
@@ -12,6 +12,7 @@
  */
 
 #include <sys/msg.h>
+#include <sys/threads.h>
 #include <posix/utils.h>
 
 #include <stdio.h>
@@ -24,9 +25,20 @@
 #include <i2c-msg.h>
 
 
+/* Next request is received and validated while the previous one is on the bus */
+#define THREADS_NO       2
+#define THREAD_PRIORITY  3
+#define THREAD_STACKSZ   2048
+
+static struct {
+	char stack[THREADS_NO - 1][THREAD_STACKSZ] __attribute__((aligned(8)));
+} common;
+
+
 static int dev_ctl(msg_t *msg)
 {
 	i2c_devctl_t *in = (i2c_devctl_t *)msg->i.raw;
+	i2c_devctl_rdwr_t *rdwr = (i2c_devctl_rdwr_t *)msg->i.raw;
 
 	switch (in->i.type) {
 		case i2c_devctl_bus_write:
@@ -38,6 +50,9 @@ static int dev_ctl(msg_t *msg)
 		case i2c_devctl_reg_read:
 			return i2c_regRead(in->i.dev_addr, in->i.reg_addr, msg->o.data, msg->o.size);
 
+		case i2c_devctl_rdwr:
+			return i2c_transfer(rdwr->i.msgs, rdwr->i.count, msg->i.data, msg->i.size, msg->o.data, msg->o.size);
+
 		default:
 			return -EINVAL;
 	}
@@ -95,6 +110,7 @@ int main(int argc, char **argv)
 	unsigned int dev_no;
 	uint32_t port;
 	char devname[sizeof("i2cX")];
+	int i;
 
 	if (argc != 2) {
 		print_usage(argv[0]);
@@ -121,6 +137,13 @@ int main(int argc, char **argv)
 		return 3;
 	}
 
+	for (i = 0; i < THREADS_NO - 1; i++) {
+		if (beginthread(thread, THREAD_PRIORITY, common.stack[i], THREAD_STACKSZ, (void *)port) < 0) {
+			printf("i2c: could not start thread\n");
+			return 4;
+		}
+	}
+
 	puts("i2c: initialized");
 	thread((void *)port);
 
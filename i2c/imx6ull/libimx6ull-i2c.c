@@ -57,6 +57,12 @@ static const i2c_pctl_t i2c_pctl_isel[4][2] = {
 
 static const unsigned i2c_int_no[] = { 32 + 36, 32 + 37, 32 + 38, 32 + 35 };
 
+/* transfer timeout, ~90 us per byte at 100 kHz */
+#define XFER_TIMEOUT_US      1000
+#define XFER_TIMEOUT_BYTE_US 200
+
+enum { xfer_idle = 0, xfer_addr, xfer_write, xfer_read };
+
 
 static struct {
 	volatile uint16_t *base;
@@ -65,13 +71,26 @@ static struct {
 
 	handle_t cond;
 	handle_t inth;
-	handle_t lock;
+	handle_t lock;  /* cond and interrupt lock */
+	handle_t xlock; /* serializes transfers of concurrent callers */
+
+	/* transfer state, owned by the interrupt handler while state != xfer_idle */
+	struct {
+		volatile int state;
+		const i2c_msg_t *msgs;
+		unsigned int count;
+		unsigned int idx; /* current message */
+		uint32_t pos;     /* current byte of the message */
+		const uint8_t *wdata;
+		uint8_t *rdata;
+		volatile int done;
+		int err;
+	} xfer;
 } i2c = { 0 };
 
 /* Not implemented:
  *  - slave mode
  *  - multi-master mode (arbitration lost status flag inspection)
- *  - register readout could be written by generating RESTART event instead of STOP / START (beneficial in multi-master mode)
  */
 
 
@@ -149,76 +168,134 @@ static int waitBusBusy(int for_busy)
 }
 
 
-static int i2c_intr(unsigned int intr, void *data)
+static int i2c_xferEnd(int err)
 {
-	/* clear interrupt */
-	*(i2c.base + i2sr) &= ~(1 << 1);
+	i2c.xfer.err = err;
+	i2c.xfer.state = xfer_idle;
+	i2c.xfer.done = 1;
 
 	return 1;
 }
 
 
-static int i2c_trxComplete(void)
+/* Runs the whole transfer, advanced on every IIF. Returns >= 0 (wakes up the waiting thread) only once it has finished */
+static int i2c_intr(unsigned int intr, void *data)
 {
-	const time_t timeout_us = 100; /* 100 us */
-	int ret = 0;
-
-	mutexLock(i2c.lock);
-
-	/* wait for transfer complete interrupt - with timeout */
-	while (!(*(i2c.base + i2sr) & (1 << 7))) {
-		if ((ret = condWait(i2c.cond, i2c.lock, timeout_us)) == -ETIME) {
-			ret = -ETIMEDOUT;
-			break;
-		}
-	}
+	uint16_t sr = *(i2c.base + i2sr);
+	const i2c_msg_t *msg;
 
-	/* clear interrupt second time - sticky conditionals */
-	*(i2c.base + i2sr) &= ~(1 << 1);
+	/* clear interrupt and arbitration lost flag */
+	*(i2c.base + i2sr) &= ~((1 << 4) | (1 << 1));
 
-	mutexUnlock(i2c.lock);
-	return ret;
-}
-
-
-static int i2c_acked(void)
-{
-	if (*(i2c.base + i2sr) & (1 << 0))
-		return -EIO;
+	if (i2c.xfer.state == xfer_idle)
+		return -1;
 
-	return 0;
-}
+	/* arbitration lost - controller has already left master mode */
+	if (sr & (1 << 4))
+		return i2c_xferEnd(-EBUSY);
+
+	msg = &i2c.xfer.msgs[i2c.xfer.idx];
+
+	switch (i2c.xfer.state) {
+		case xfer_addr:
+		case xfer_write:
+			if (sr & (1 << 0)) {
+				/* not ACKed - generate STOP */
+				*(i2c.base + i2cr) &= ~((1 << 5) | (1 << 4));
+				return i2c_xferEnd(-EIO);
+			}
+
+			if ((i2c.xfer.state == xfer_addr) && (msg->flags & I2C_MSG_RD) && (msg->len > 0)) {
+				/* setup bus for data readout - disable TX, enable ACKing for every byte except the last one */
+				if (msg->len == 1)
+					*(i2c.base + i2cr) = (*(i2c.base + i2cr) & ~(1 << 4)) | (1 << 3);
+				else
+					*(i2c.base + i2cr) &= ~((1 << 4) | (1 << 3));
+
+				/* RM: dummy read to enter read mode */
+				(void)*(i2c.base + i2dr);
+				i2c.xfer.state = xfer_read;
+				return -1;
+			}
+
+			if (!(msg->flags & I2C_MSG_RD) && (i2c.xfer.pos < msg->len)) {
+				i2c.xfer.state = xfer_write;
+				*(i2c.base + i2dr) = i2c.xfer.wdata[i2c.xfer.pos++];
+				return -1;
+			}
+			break;
 
+		case xfer_read:
+			if (i2c.xfer.pos == msg->len - 1) {
+				/* we must generate STOP (or switch to TX for repeated START) before reading i2dr to avoid generating another clock cycle */
+				if (i2c.xfer.idx == i2c.xfer.count - 1)
+					*(i2c.base + i2cr) &= ~((1 << 5) | (1 << 4));
+				else
+					*(i2c.base + i2cr) |= (1 << 4);
+			}
+			else if (i2c.xfer.pos == msg->len - 2) {
+				/* we must set TXAK before receiving next-to-last byte to acknowledge the whole message */
+				*(i2c.base + i2cr) |= (1 << 3);
+			}
+
+			i2c.xfer.rdata[i2c.xfer.pos++] = *(i2c.base + i2dr);
+			if (i2c.xfer.pos < msg->len)
+				return -1;
+			break;
 
-/* writes 1 byte and waits for completion / ack */
-static int writeByte(uint8_t byte)
-{
-	int ret = 0;
+		default:
+			break;
+	}
 
-	*(i2c.base + i2sr) = 0; /* clear previous interrupts */
-	*(i2c.base + i2dr) = byte;
+	/* message done */
+	if (msg->flags & I2C_MSG_RD)
+		i2c.xfer.rdata += msg->len;
+	else
+		i2c.xfer.wdata += msg->len;
+
+	i2c.xfer.pos = 0;
+	if (++i2c.xfer.idx == i2c.xfer.count) {
+		/* generate STOP: disable master mode, disable TX (might be done twice without any issue) */
+		*(i2c.base + i2cr) &= ~((1 << 5) | (1 << 4));
+		return i2c_xferEnd(0);
+	}
 
-	/* wait for byte to be sent */
-	ret = i2c_trxComplete();
-	if (ret < 0)
-		return ret;
+	/* generate repeated START (TX mode is required) and send next DEVICE request */
+	msg++;
+	*(i2c.base + i2cr) |= (1 << 4) | (1 << 2);
+	*(i2c.base + i2dr) = (msg->dev_addr << 1) | ((msg->flags & I2C_MSG_RD) ? i2c_cmd_read : i2c_cmd_write);
+	i2c.xfer.state = xfer_addr;
 
-	return i2c_acked();
+	return -1;
 }
 
 
-/* Performs i2c generic write operation to the given slave device. */
-int i2c_busWrite(uint8_t dev_addr, const uint8_t *data, uint32_t len)
+static int _i2c_xfer(const i2c_msg_t *msgs, unsigned int count, const uint8_t *wdata, uint8_t *rdata)
 {
+	time_t timeout_us = XFER_TIMEOUT_US;
 	unsigned int i;
 	int ret;
 
-	if (!i2c.initialized)
-		return -EIO;
+	for (i = 0; i < count; ++i)
+		timeout_us += (msgs[i].len + 1) * XFER_TIMEOUT_BYTE_US;
+
+	mutexLock(i2c.xlock);
 
 	/* single-master mode, bus should always be idle when we're not transferring */
-	if (isBusBusy())
+	if (isBusBusy()) {
+		mutexUnlock(i2c.xlock);
 		return -EBUSY;
+	}
+
+	i2c.xfer.msgs = msgs;
+	i2c.xfer.count = count;
+	i2c.xfer.idx = 0;
+	i2c.xfer.pos = 0;
+	i2c.xfer.wdata = wdata;
+	i2c.xfer.rdata = rdata;
+	i2c.xfer.done = 0;
+
+	*(i2c.base + i2sr) = 0; /* clear previous interrupts */
 
 	/* generate START: enable master mode, enable TX, enable interrupt */
 	*(i2c.base + i2cr) |= (1 << 6) | (1 << 5) | (1 << 4);
@@ -226,107 +303,113 @@ int i2c_busWrite(uint8_t dev_addr, const uint8_t *data, uint32_t len)
 	/* wait for the bus to be busy */
 	ret = waitBusBusy(1);
 
-	/* send first byte - DEVICE WRITE request */
-	if (ret == 0)
-		ret = writeByte((dev_addr << 1) | i2c_cmd_write);
+	if (ret == 0) {
+		mutexLock(i2c.lock);
+
+		/* send first byte - DEVICE request, the rest is done in the interrupt */
+		i2c.xfer.state = xfer_addr;
+		*(i2c.base + i2dr) = (msgs[0].dev_addr << 1) | ((msgs[0].flags & I2C_MSG_RD) ? i2c_cmd_read : i2c_cmd_write);
 
-	/* send data */
-	for (i = 0; (ret == 0) && (i < len); ++i)
-		ret = writeByte(data[i]);
+		while (!i2c.xfer.done) {
+			if (condWait(i2c.cond, i2c.lock, timeout_us) == -ETIME) {
+				break;
+			}
+		}
 
-	/* generate STOP: disable master mode, disable TX */
+		if (i2c.xfer.done) {
+			ret = i2c.xfer.err;
+		}
+		else {
+			i2c.xfer.state = xfer_idle;
+			ret = -ETIMEDOUT;
+		}
+
+		mutexUnlock(i2c.lock);
+	}
+
+	/* generate STOP: disable master mode, disable TX, disable interrupt (might be done twice without any issue) */
 	*(i2c.base + i2cr) &= ~((1 << 6) | (1 << 5) | (1 << 4));
 
 	/* wait for the bus to be idle */
 	waitBusBusy(0); /* don't overwrite possible error in ret */
 
+	mutexUnlock(i2c.xlock);
+
 	return ret;
 }
 
 
-static int _doRead(uint8_t dev_addr, uint8_t *data_out, uint32_t len)
+/* Performs i2c generic write operation to the given slave device. */
+int i2c_busWrite(uint8_t dev_addr, const uint8_t *data, uint32_t len)
 {
-	unsigned int i;
-	uint16_t temp;
-	int ret;
-
-	/* send first byte - DEVICE READ request */
-	ret = writeByte((dev_addr << 1) | i2c_cmd_read);
-	if (ret < 0)
-		return ret;
-
-	/* setup bus for data readout - disable TX, enable ACKing for every byte except the last one */
-	temp = *(i2c.base + i2cr) & ~((1 << 4) | (1 << 3));
-	if (len <= 1)
-		temp |= (1 << 3);
-	*(i2c.base + i2cr) = temp;
-
-	/* RM: dummy read to enter read mode */
-	(void)*(i2c.base + i2dr);
+	const i2c_msg_t msg = { .dev_addr = dev_addr, .flags = 0, .len = len };
 
-	/* read data */
-	for (i = 0; (ret == 0) && (i < len); ++i) {
-		ret = i2c_trxComplete();
-		if (ret < 0)
-			break;
+	if (!i2c.initialized)
+		return -EIO;
 
-		if (i == len - 1) {
-			/* we must generate STOP before reading i2dr to avoid generating another clock cycle */
-			*(i2c.base + i2cr) &= ~((1 << 5) | (1 << 4));
-		}
-		else if (i == len - 2) {
-			/* we must set TXAK before receiving next-to-last byte to acknowledge the whole message */
-			*(i2c.base + i2cr) |= (1 << 3);
-		}
+	if (len > 0xffff)
+		return -EINVAL;
 
-		data_out[i] = *(i2c.base + i2dr);
-	}
-
-	return ret;
+	return _i2c_xfer(&msg, 1, data, NULL);
 }
 
 
 /* Performs i2c generic read operation from the given slave device. */
 int i2c_busRead(uint8_t dev_addr, uint8_t *data_out, uint32_t len)
 {
-	int ret;
+	const i2c_msg_t msg = { .dev_addr = dev_addr, .flags = I2C_MSG_RD, .len = len };
 
 	if (!i2c.initialized)
 		return -EIO;
 
-	/* single-master mode, bus should always be idle when we're not transferring */
-	if (isBusBusy())
-		return -EBUSY;
+	if (len > 0xffff)
+		return -EINVAL;
 
-	/* generate START: enable master mode, enable TX for sending register address */
-	*(i2c.base + i2cr) |= (1 << 6) | (1 << 5) | (1 << 4);
+	return _i2c_xfer(&msg, 1, NULL, data_out);
+}
 
-	/* wait for the bus to be busy */
-	ret = waitBusBusy(1);
 
-	if (ret >= 0)
-		ret = _doRead(dev_addr, data_out, len);
+/* Performs i2c regiester read operation from the given slave device */
+int i2c_regRead(uint8_t dev_addr, uint8_t reg_addr, uint8_t *data_out, uint32_t len)
+{
+	const i2c_msg_t msgs[2] = {
+		{ .dev_addr = dev_addr, .flags = 0, .len = 1 },
+		{ .dev_addr = dev_addr, .flags = I2C_MSG_RD, .len = len }
+	};
 
-	/* generate STOP: disable master mode, disable TX (might be done twice without any issue) */
-	*(i2c.base + i2cr) &= ~((1 << 6) | (1 << 5) | (1 << 4));
+	if (!i2c.initialized)
+		return -EIO;
 
-	/* wait for the bus to be idle */
-	waitBusBusy(0); /* don't overwrite possible error in ret */
+	if (len > 0xffff)
+		return -EINVAL;
 
-	return ret;
+	return _i2c_xfer(msgs, 2, &reg_addr, data_out);
 }
 
 
-/* Performs i2c regiester read operation from the given slave device */
-int i2c_regRead(uint8_t dev_addr, uint8_t reg_addr, uint8_t *data_out, uint32_t len)
+/* Performs combined transfer of multiple messages */
+int i2c_transfer(const i2c_msg_t *msgs, unsigned int count, const uint8_t *wdata, uint32_t wlen, uint8_t *rdata, uint32_t rlen)
 {
-	int ret;
+	uint32_t wtotal = 0, rtotal = 0;
+	unsigned int i;
 
-	ret = i2c_busWrite(dev_addr, &reg_addr, 1);
-	if (ret < 0)
-		return ret;
+	if (!i2c.initialized)
+		return -EIO;
+
+	if ((count == 0) || (count > I2C_RDWR_MSGS_MAX))
+		return -EINVAL;
+
+	for (i = 0; i < count; ++i) {
+		if (msgs[i].flags & I2C_MSG_RD)
+			rtotal += msgs[i].len;
+		else
+			wtotal += msgs[i].len;
+	}
+
+	if ((wtotal > wlen) || (rtotal > rlen))
+		return -EINVAL;
 
-	return i2c_busRead(dev_addr, data_out, len);
+	return _i2c_xfer(msgs, count, wdata, rdata);
 }
 
 
@@ -357,6 +440,13 @@ int i2c_init(unsigned int dev_no)
 		return -3;
 	}
 
+	if (mutexCreate(&i2c.xlock) != EOK) {
+		munmap((void *)i2c.base, _PAGE_SIZE);
+		resourceDestroy(i2c.cond);
+		resourceDestroy(i2c.lock);
+		return -3;
+	}
+
 	interrupt(i2c_int_no[i2c.dev_no - 1], i2c_intr, NULL, i2c.cond, &i2c.inth);
 
 	/* disable i2c - soft reset */
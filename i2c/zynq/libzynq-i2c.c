@@ -48,6 +48,8 @@
 
 #define I2C_FIFO_DEPTH     16
 #define I2C_TRANS_SIZE_MAX 255
+/* Transfer size register reload chunk, multiple of the data interrupt level (FIFO depth - 2) */
+#define I2C_TRANS_SIZE     252
 
 typedef struct {
 	unsigned int irq;     /* I2C controller IRQ */
@@ -208,27 +210,12 @@ static int i2c_trxComplete(void)
 }
 
 
-int i2c_busWrite(uint8_t dev_addr, const uint8_t *data, uint32_t len)
+/* Leaves HOLD set, the bus is released (STOP) or a repeated START follows after it */
+static int i2c_doWrite(uint8_t dev_addr, const uint8_t *data, uint32_t len)
 {
 	unsigned int fifoAvail;
 	int i, ret = EOK, sz = 0, start = 0;
 
-	if (i2c.initialized == 0) {
-		return -EIO;
-	}
-
-	if (data == NULL) {
-		return -EINVAL;
-	}
-
-	if (len == 0) {
-		return 0;
-	}
-
-	if (i2c_isBusBusy() == 1) {
-		return -EBUSY;
-	}
-
 	/* clear FIFO, enable ACK, master mode, master transmitter */
 	*(i2c.base + I2C_CR) |= (1 << 6) | (1 << 3) | (1 << 1);
 	*(i2c.base + I2C_CR) &= ~1;
@@ -262,6 +249,32 @@ int i2c_busWrite(uint8_t dev_addr, const uint8_t *data, uint32_t len)
 		}
 	}
 
+	return ret;
+}
+
+
+int i2c_busWrite(uint8_t dev_addr, const uint8_t *data, uint32_t len)
+{
+	int ret;
+
+	if (i2c.initialized == 0) {
+		return -EIO;
+	}
+
+	if (data == NULL) {
+		return -EINVAL;
+	}
+
+	if (len == 0) {
+		return 0;
+	}
+
+	if (i2c_isBusBusy() == 1) {
+		return -EBUSY;
+	}
+
+	ret = i2c_doWrite(dev_addr, data, len);
+
 	/* HOLD = 0 - terminate the transfer. It generates a STOP condition. */
 	*(i2c.base + I2C_CR) &= ~(1 << 4);
 
@@ -272,45 +285,71 @@ int i2c_busWrite(uint8_t dev_addr, const uint8_t *data, uint32_t len)
 }
 
 
-static int i2c_transferRead(uint8_t dev_addr, uint8_t *buff, uint32_t sz)
+/* hold - keep the bus after the last byte for a repeated START.
+ * Whole read is a single transfer: HOLD stretches the clock while FIFO is full and the transfer size
+ * register is reloaded before it runs out (controller NACKs once it reaches 0 regardless of HOLD) */
+static int i2c_doRead(uint8_t dev_addr, uint8_t *data_out, uint32_t len, int hold)
 {
-	int ret = EOK, i, tmp;
+	int ret = EOK, reload;
+	uint32_t curr, left = len;
+
+	/* clear FIFO, enable ACK, master mode, master receiver */
+	*(i2c.base + I2C_CR) |= (1 << 6) | (1 << 3) | 0x3;
+
+	i2c_clearIrqSt();
 
-	if (sz > I2C_FIFO_DEPTH) {
+	if ((hold != 0) || (len > I2C_FIFO_DEPTH)) {
 		*(i2c.base + I2C_CR) |= (1 << 4);
 	}
 
-	/* set data count to receive */
-	*(i2c.base + I2C_TRANS_SZ) = sz;
+	/* bytes covered by the transfer size register, not read from FIFO yet */
+	curr = (len > I2C_TRANS_SIZE) ? I2C_TRANS_SIZE : len;
+	*(i2c.base + I2C_TRANS_SZ) = curr;
 
 	/* set slave address and start transmission */
 	*(i2c.base + I2C_ADDR) = dev_addr;
 
-	while (sz > 0 && *(i2c.base + I2C_TRANS_SZ) != 0) {
-		/* arbitration lost, rx underflow, enable timeout, data, completion Irq */
-		*(i2c.base + I2C_IER) = (1 << 9) | (1 << 7) | (1 << 3) | (1 << 2) | (1 << 1) | 0x1;
+	while (left > 0) {
+		/* FIFO left full after a reload doesn't generate another data irq */
+		if ((*(i2c.base + I2C_SR) & (1 << 5)) == 0) {
+			/* arbitration lost, rx underflow, enable timeout, data, completion Irq */
+			*(i2c.base + I2C_IER) = (1 << 9) | (1 << 7) | (1 << 3) | (1 << 2) | (1 << 1) | 0x1;
 
-		ret = i2c_trxComplete();
-		if (ret < 0) {
-			break;
+			ret = i2c_trxComplete();
+			if (ret < 0) {
+				break;
+			}
 		}
 
-		/* data irq is generated when there are two free locations available in the FIFO */
-		if (sz >= (I2C_FIFO_DEPTH - 2)) {
-			for (i = 0; i < I2C_FIFO_DEPTH - 2; ++i) {
-				*(buff++) = *(i2c.base + I2C_DATA);
-				sz--;
+		reload = 0;
+		while ((*(i2c.base + I2C_SR) & (1 << 5)) != 0) {
+			*(data_out++) = *(i2c.base + I2C_DATA);
+			left--;
+			curr--;
+
+			/* the rest fits in FIFO, STOP can be generated after the last byte */
+			if ((hold == 0) && (left <= I2C_FIFO_DEPTH)) {
+				*(i2c.base + I2C_CR) &= ~(1 << 4);
 			}
 
-			/* set data count to receive */
-			*(i2c.base + I2C_TRANS_SZ) = sz;
+			if ((left > curr) && (curr == I2C_FIFO_DEPTH + 1)) {
+				reload = 1;
+				break;
+			}
 		}
-		/* transfer complete irq */
-		else {
-			tmp = sz - *(i2c.base + I2C_TRANS_SZ);
-			for (i = 0; i < tmp; ++i) {
-				*(buff++) = *(i2c.base + I2C_DATA);
-				--sz;
+
+		if (reload != 0) {
+			/* wait for the FIFO to fill up, then only 1 byte is left in the transfer size register */
+			while (*(i2c.base + I2C_TRANS_SZ) != (curr - I2C_FIFO_DEPTH)) {
+			}
+
+			if ((left - I2C_FIFO_DEPTH) > I2C_TRANS_SIZE) {
+				*(i2c.base + I2C_TRANS_SZ) = I2C_TRANS_SIZE;
+				curr = I2C_TRANS_SIZE + I2C_FIFO_DEPTH;
+			}
+			else {
+				*(i2c.base + I2C_TRANS_SZ) = left - I2C_FIFO_DEPTH;
+				curr = left;
 			}
 		}
 	}
@@ -321,7 +360,7 @@ static int i2c_transferRead(uint8_t dev_addr, uint8_t *buff, uint32_t sz)
 
 int i2c_busRead(uint8_t dev_addr, uint8_t *data_out, uint32_t len)
 {
-	int ret = EOK, sz = 0, bytes2Read;
+	int ret;
 
 	if (i2c.initialized == 0) {
 		return -EIO;
@@ -339,22 +378,7 @@ int i2c_busRead(uint8_t dev_addr, uint8_t *data_out, uint32_t len)
 		return -EBUSY;
 	}
 
-	/* clear FIFO, enable ACK, master mode, master receiver */
-	*(i2c.base + I2C_CR) |= (1 << 6) | (1 << 3) | 0x3;
-
-	i2c_clearIrqSt();
-
-	do {
-		bytes2Read = (len - sz >= I2C_TRANS_SIZE_MAX) ? I2C_TRANS_SIZE_MAX : (len - sz);
-
-		ret = i2c_transferRead(dev_addr, data_out, bytes2Read);
-		if (ret < 0) {
-			break;
-		}
-
-		data_out += bytes2Read;
-		sz += bytes2Read;
-	} while (sz < len);
+	ret = i2c_doRead(dev_addr, data_out, len, 0);
 
 	/* HOLD = 0 - terminate the transfer */
 	*(i2c.base + I2C_CR) &= ~(1 << 4);
@@ -368,14 +392,80 @@ int i2c_busRead(uint8_t dev_addr, uint8_t *data_out, uint32_t len)
 
 int i2c_regRead(uint8_t dev_addr, uint8_t reg_addr, uint8_t *data_out, uint32_t len)
 {
-	int ret;
+	const i2c_msg_t msgs[2] = {
+		{ .dev_addr = dev_addr, .flags = 0, .len = sizeof(reg_addr) },
+		{ .dev_addr = dev_addr, .flags = I2C_MSG_RD, .len = len }
+	};
+
+	if ((len == 0) || (len > 0xffff)) {
+		return -EINVAL;
+	}
+
+	return i2c_transfer(msgs, 2, &reg_addr, sizeof(reg_addr), data_out, len);
+}
+
+
+int i2c_transfer(const i2c_msg_t *msgs, unsigned int count, const uint8_t *wdata, uint32_t wlen, uint8_t *rdata, uint32_t rlen)
+{
+	uint32_t wtotal = 0, rtotal = 0;
+	unsigned int i;
+	int ret = EOK;
+
+	if (i2c.initialized == 0) {
+		return -EIO;
+	}
+
+	if ((count == 0) || (count > I2C_RDWR_MSGS_MAX)) {
+		return -EINVAL;
+	}
+
+	for (i = 0; i < count; i++) {
+		/* HOLD can't be used without data in FIFO */
+		if (msgs[i].len == 0) {
+			return -EINVAL;
+		}
+
+		if ((msgs[i].flags & I2C_MSG_RD) != 0) {
+#if defined(__CPU_ZYNQ7000)
+			/* r1p10 controller erratum: HOLD after a receive doesn't produce a valid repeated START */
+			if (i != count - 1) {
+				return -ENOSYS;
+			}
+#endif
+			rtotal += msgs[i].len;
+		}
+		else {
+			wtotal += msgs[i].len;
+		}
+	}
+
+	if (((wtotal != 0) && ((wdata == NULL) || (wtotal > wlen))) || ((rtotal != 0) && ((rdata == NULL) || (rtotal > rlen)))) {
+		return -EINVAL;
+	}
 
-	ret = i2c_busWrite(dev_addr, &reg_addr, sizeof(reg_addr));
-	if (ret < 0) {
-		return ret;
+	if (i2c_isBusBusy() == 1) {
+		return -EBUSY;
+	}
+
+	/* HOLD stays set between messages, next address write generates repeated START */
+	for (i = 0; (ret >= 0) && (i < count); i++) {
+		if ((msgs[i].flags & I2C_MSG_RD) != 0) {
+			ret = i2c_doRead(msgs[i].dev_addr, rdata, msgs[i].len, (i != count - 1));
+			rdata += msgs[i].len;
+		}
+		else {
+			ret = i2c_doWrite(msgs[i].dev_addr, wdata, msgs[i].len);
+			wdata += msgs[i].len;
+		}
 	}
 
-	return i2c_busRead(dev_addr, data_out, len);
+	/* HOLD = 0 - terminate the transfer. It generates a STOP condition. */
+	*(i2c.base + I2C_CR) &= ~(1 << 4);
+
+	/* disable interrupts */
+	*(i2c.base + I2C_IDR) = (1 << 9) | (1 << 7) | (1 << 6) | (1 << 3) | (1 << 2) | (1 << 1) | 0x1;
+
+	return ret;
 }
 
 
@@ -27,6 +27,7 @@
 static int dev_ctl(msg_t *msg)
 {
 	i2c_devctl_t *in = (i2c_devctl_t *)msg->i.raw;
+	i2c_devctl_rdwr_t *rdwr = (i2c_devctl_rdwr_t *)msg->i.raw;
 
 	switch (in->i.type) {
 		case i2c_devctl_bus_write:
@@ -38,6 +39,9 @@ static int dev_ctl(msg_t *msg)
 		case i2c_devctl_reg_read:
 			return i2c_regRead(in->i.dev_addr, in->i.reg_addr, msg->o.data, msg->o.size);
 
+		case i2c_devctl_rdwr:
+			return i2c_transfer(rdwr->i.msgs, rdwr->i.count, msg->i.data, msg->i.size, msg->o.data, msg->o.size);
+
 		default:
 			return -EINVAL;
 	}
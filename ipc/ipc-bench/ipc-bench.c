@@ -0,0 +1,441 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Server IPC round-trip benchmark
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/msg.h>
+#include <sys/threads.h>
+
+#include <bench.h>
+
+
+#define BENCH_DEF_OPS  10000            /* Default number of requests per result */
+#define BENCH_DEF_CONC 1                /* Default number of concurrent clients */
+#define BENCH_MAX_CONC 32               /* Max number of concurrent clients */
+#define BENCH_MAX_LEN  (64 * 1024)      /* Max payload length */
+#define BENCH_STACKSZ  (2 * _PAGE_SIZE) /* Client and null server thread stack size */
+
+
+/* Benchmark tests */
+enum { GETATTR, DEVCTL, READ, WRITE, NTESTS };
+
+
+static const char *const bench_names[NTESTS] = { "getattr", "devctl", "read", "write" };
+
+
+static const size_t bench_defSizes[] = { 0, 16, 64, 256, 1024, 4096 };
+
+
+typedef struct {
+	char *buff;         /* Payload buffer */
+	int err;            /* First error */
+	char stack[BENCH_STACKSZ] __attribute__((aligned(8)));
+} bench_worker_t;
+
+
+static struct {
+	/* Configuration */
+	const char *path;             /* Server path, NULL for the null server */
+	oid_t oid;
+	unsigned int conc;            /* Concurrent clients */
+	unsigned int nops;            /* Requests per result */
+	off_t offs;                   /* read/write offset */
+	size_t sizes[16];             /* Payload lengths */
+	unsigned int nsizes;
+	unsigned char raw[sizeof(((msg_t *)0)->i.raw)]; /* devctl request */
+	size_t rawlen;
+
+	/* Current test */
+	int test;
+	size_t len;
+	bench_counter_t reqs;
+	uint32_t *lat;                /* Requests round-trip latencies (ns) */
+
+	/* Null server */
+	bench_worker_t srv[BENCH_MAX_CONC];
+} bench_common;
+
+
+/* Responds to everything without touching the payload, the baseline cost of a round trip */
+static void bench_nullServer(void *arg)
+{
+	msg_t msg;
+	msg_rid_t rid;
+
+	(void)arg;
+
+	for (;;) {
+		if (msgRecv(bench_common.oid.port, &msg, &rid) < 0) {
+			continue;
+		}
+
+		switch (msg.type) {
+			case mtRead:
+				msg.o.err = msg.o.size;
+				break;
+
+			case mtWrite:
+				msg.o.err = msg.i.size;
+				break;
+
+			case mtGetAttr:
+				msg.o.attr.val = 0;
+				msg.o.err = EOK;
+				break;
+
+			default:
+				msg.o.err = EOK;
+				break;
+		}
+
+		msgRespond(bench_common.oid.port, &msg, rid);
+	}
+}
+
+
+static int bench_request(bench_worker_t *w)
+{
+	msg_t msg;
+	int err;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.oid = bench_common.oid;
+
+	switch (bench_common.test) {
+		case GETATTR:
+			msg.type = mtGetAttr;
+			msg.i.attr.type = atSize;
+			break;
+
+		case DEVCTL:
+			msg.type = mtDevCtl;
+			memcpy(msg.i.raw, bench_common.raw, bench_common.rawlen);
+			msg.i.data = w->buff;
+			msg.i.size = bench_common.len;
+			msg.o.data = w->buff;
+			msg.o.size = bench_common.len;
+			break;
+
+		case READ:
+			msg.type = mtRead;
+			msg.i.io.offs = bench_common.offs;
+			msg.i.io.len = bench_common.len;
+			msg.o.data = w->buff;
+			msg.o.size = bench_common.len;
+			break;
+
+		default:
+			msg.type = mtWrite;
+			msg.i.io.offs = bench_common.offs;
+			msg.i.io.len = bench_common.len;
+			msg.i.data = w->buff;
+			msg.i.size = bench_common.len;
+			break;
+	}
+
+	if ((err = msgSend(bench_common.oid.port, &msg)) < 0) {
+		return err;
+	}
+
+	/* Error replies are a valid round trip for devctl, the request format is up to the server */
+	if ((bench_common.test != DEVCTL) && (msg.o.err < 0)) {
+		return msg.o.err;
+	}
+
+	return 0;
+}
+
+
+static void bench_worker(void *arg)
+{
+	bench_worker_t *w = (bench_worker_t *)arg;
+	uint64_t start;
+	int req, err;
+
+	while ((req = bench_counterNext(&bench_common.reqs)) >= 0) {
+		start = bench_nowNs();
+		err = bench_request(w);
+		bench_common.lat[req] = (uint32_t)(bench_nowNs() - start);
+
+		if (err < 0) {
+			w->err = err;
+			break;
+		}
+	}
+
+	endthread();
+}
+
+
+static int bench_run(int test, size_t len, bench_worker_t *workers)
+{
+	bench_report_t r;
+	uint64_t start, nsec;
+	unsigned int i, n = bench_common.nops;
+	double mps;
+	int err = 0;
+
+	bench_common.test = test;
+	bench_common.len = len;
+	bench_counterReset(&bench_common.reqs, n);
+
+	start = bench_nowNs();
+	for (i = 0; i < bench_common.conc; i++) {
+		workers[i].err = 0;
+		if ((err = beginthread(bench_worker, 4, workers[i].stack, sizeof(workers[i].stack), &workers[i])) < 0) {
+			break;
+		}
+	}
+
+	while (i > 0) {
+		threadJoin(-1, 0);
+		i--;
+	}
+	nsec = bench_nowNs() - start;
+
+	for (i = 0; (err == 0) && (i < bench_common.conc); i++) {
+		err = workers[i].err;
+	}
+
+	bench_reportBegin(&r);
+	bench_reportStr(&r, "dev", (bench_common.path != NULL) ? bench_common.path : "null");
+	bench_reportStr(&r, "test", bench_names[test]);
+	bench_reportUint(&r, "len", len);
+
+	if (err < 0) {
+		bench_reportInt(&r, "err", err);
+		bench_reportEnd(&r);
+		return err;
+	}
+
+	bench_sort(bench_common.lat, n);
+
+	if (nsec == 0) {
+		nsec = 1;
+	}
+	mps = (double)n * 1000 * 1000 * 1000 / nsec;
+
+	bench_reportUint(&r, "conc", bench_common.conc);
+	bench_reportUint(&r, "ops", n);
+	bench_reportU64(&r, "usec", nsec / 1000);
+	bench_reportDouble(&r, "mps", mps, 0);
+	bench_reportDouble(&r, "bps", mps * len, 0);
+	bench_reportLatency(&r, "", "ns", bench_common.lat, n);
+	bench_reportEnd(&r);
+
+	return 0;
+}
+
+
+static int bench_parseRaw(const char *hex)
+{
+	unsigned int byte;
+	size_t len = strlen(hex);
+
+	if (((len % 2) != 0) || ((len / 2) > sizeof(bench_common.raw))) {
+		return -EINVAL;
+	}
+
+	for (bench_common.rawlen = 0; bench_common.rawlen < len / 2; bench_common.rawlen++) {
+		if (sscanf(hex + 2 * bench_common.rawlen, "%2x", &byte) != 1) {
+			return -EINVAL;
+		}
+		bench_common.raw[bench_common.rawlen] = (unsigned char)byte;
+	}
+
+	return 0;
+}
+
+
+static void bench_usage(const char *prog)
+{
+	printf("Usage: %s [options] <path>|-S\n", prog);
+	printf("\t-S          - benchmark in-process null server instead of <path>\n");
+	printf("\t-c <conc>   - concurrent clients (default %u, max %u)\n", BENCH_DEF_CONC, BENCH_MAX_CONC);
+	printf("\t-n <ops>    - requests per result (default %u)\n", BENCH_DEF_OPS);
+	printf("\t-s <sizes>  - comma separated payload lengths (default 0,16,64,256,1024,4096), max %u\n", BENCH_MAX_LEN);
+	printf("\t-o <offs>   - read/write offset (default 0)\n");
+	printf("\t-d <hex>    - devctl request bytes copied to msg.i.raw, enables devctl test\n");
+	printf("\t-t <tests>  - comma separated tests: getattr,devctl,read,write (default getattr,read)\n");
+	printf("\t-w          - allow write test, data at the offset is overwritten\n");
+	printf("\t-h          - shows this help message\n");
+}
+
+
+int main(int argc, char **argv)
+{
+	bench_worker_t *workers;
+	unsigned int tests = (1 << GETATTR) | (1 << READ), j;
+	int c, i, wr = 0, null = 0, err = EXIT_SUCCESS;
+	const char *bad;
+	char *tok, *arg;
+	size_t maxlen;
+
+	bench_common.conc = BENCH_DEF_CONC;
+	bench_common.nops = BENCH_DEF_OPS;
+	bench_common.nsizes = sizeof(bench_defSizes) / sizeof(bench_defSizes[0]);
+	memcpy(bench_common.sizes, bench_defSizes, sizeof(bench_defSizes));
+
+	while ((c = getopt(argc, argv, "Sc:n:s:o:d:t:wh")) != -1) {
+		switch (c) {
+			case 'S':
+				null = 1;
+				break;
+
+			case 'c':
+				bench_common.conc = strtoul(optarg, NULL, 0);
+				break;
+
+			case 'n':
+				bench_common.nops = strtoul(optarg, NULL, 0);
+				break;
+
+			case 's':
+				bench_common.nsizes = 0;
+				for (arg = optarg; (tok = strtok(arg, ",")) != NULL; arg = NULL) {
+					if (bench_common.nsizes == sizeof(bench_common.sizes) / sizeof(bench_common.sizes[0])) {
+						fprintf(stderr, "ipc-bench: too many sizes\n");
+						return EXIT_FAILURE;
+					}
+					bench_common.sizes[bench_common.nsizes++] = strtoul(tok, NULL, 0);
+				}
+				break;
+
+			case 'o':
+				bench_common.offs = strtoull(optarg, NULL, 0);
+				break;
+
+			case 'd':
+				if (bench_parseRaw(optarg) < 0) {
+					fprintf(stderr, "ipc-bench: invalid devctl request\n");
+					return EXIT_FAILURE;
+				}
+				tests |= 1 << DEVCTL;
+				break;
+
+			case 't':
+				if (bench_parseTests(optarg, bench_names, NTESTS, &tests, &bad) < 0) {
+					fprintf(stderr, "ipc-bench: unknown test %s\n", bad);
+					return EXIT_FAILURE;
+				}
+				break;
+
+			case 'w':
+				wr = 1;
+				break;
+
+			case 'h':
+			default:
+				bench_usage(argv[0]);
+				return EXIT_SUCCESS;
+		}
+	}
+
+	if ((null == 0) && (optind != argc - 1)) {
+		bench_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	/* The null server doesn't interpret requests, everything is safe */
+	if ((null == 0) && ((tests & (1 << WRITE)) != 0) && (wr == 0)) {
+		fprintf(stderr, "ipc-bench: write test requires -w option\n");
+		return EXIT_FAILURE;
+	}
+
+	/* A devctl without the request bytes could mean anything to the server */
+	if ((null == 0) && ((tests & (1 << DEVCTL)) != 0) && (bench_common.rawlen == 0)) {
+		fprintf(stderr, "ipc-bench: devctl test requires -d option\n");
+		return EXIT_FAILURE;
+	}
+
+	if ((bench_common.conc == 0) || (bench_common.conc > BENCH_MAX_CONC) || (bench_common.nops == 0) || (bench_common.nsizes == 0)) {
+		fprintf(stderr, "ipc-bench: invalid arguments\n");
+		return EXIT_FAILURE;
+	}
+
+	for (j = 0, maxlen = 0; j < bench_common.nsizes; j++) {
+		if (bench_common.sizes[j] > BENCH_MAX_LEN) {
+			fprintf(stderr, "ipc-bench: payload length above %u\n", BENCH_MAX_LEN);
+			return EXIT_FAILURE;
+		}
+		if (bench_common.sizes[j] > maxlen) {
+			maxlen = bench_common.sizes[j];
+		}
+	}
+
+	if (null != 0) {
+		bench_common.path = NULL;
+		if (portCreate(&bench_common.oid.port) < 0) {
+			fprintf(stderr, "ipc-bench: failed to create port\n");
+			return EXIT_FAILURE;
+		}
+		bench_common.oid.id = 0;
+
+		/* One server thread per client, so that the server never queues requests */
+		for (j = 0; j < bench_common.conc; j++) {
+			if (beginthread(bench_nullServer, 4, bench_common.srv[j].stack, sizeof(bench_common.srv[j].stack), NULL) < 0) {
+				fprintf(stderr, "ipc-bench: failed to start null server\n");
+				return EXIT_FAILURE;
+			}
+		}
+	}
+	else {
+		bench_common.path = argv[optind];
+		if (lookup(bench_common.path, NULL, &bench_common.oid) < 0) {
+			fprintf(stderr, "ipc-bench: failed to find %s\n", bench_common.path);
+			return EXIT_FAILURE;
+		}
+	}
+
+	bench_common.lat = malloc(bench_common.nops * sizeof(bench_common.lat[0]));
+	workers = calloc(bench_common.conc, sizeof(*workers));
+	if ((bench_common.lat == NULL) || (workers == NULL) || (bench_counterInit(&bench_common.reqs) < 0)) {
+		fprintf(stderr, "ipc-bench: out of memory\n");
+		free(bench_common.lat);
+		free(workers);
+		return EXIT_FAILURE;
+	}
+
+	for (j = 0; j < bench_common.conc; j++) {
+		if ((workers[j].buff = calloc(1, (maxlen != 0) ? maxlen : 1)) == NULL) {
+			fprintf(stderr, "ipc-bench: out of memory\n");
+			return EXIT_FAILURE;
+		}
+	}
+
+	for (i = 0; i < NTESTS; i++) {
+		if ((tests & (1 << i)) == 0) {
+			continue;
+		}
+
+		/* Payload length doesn't apply to getattr */
+		if (i == GETATTR) {
+			if (bench_run(i, 0, workers) < 0) {
+				err = EXIT_FAILURE;
+			}
+			continue;
+		}
+
+		for (j = 0; j < bench_common.nsizes; j++) {
+			if (bench_run(i, bench_common.sizes[j], workers) < 0) {
+				err = EXIT_FAILURE;
+			}
+		}
+	}
+
+	return err;
+}
@@ -0,0 +1,220 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Benchmark tools helpers - timing, latency statistics and JSON reports
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/threads.h>
+
+#include "bench.h"
+
+
+#define BENCH_KEYSZ 32
+
+
+uint64_t bench_nowNs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000 * 1000 * 1000 + ts.tv_nsec;
+}
+
+
+uint64_t bench_nowUs(void)
+{
+	return bench_nowNs() / 1000;
+}
+
+
+static int bench_cmplat(const void *a, const void *b)
+{
+	uint32_t la = *(const uint32_t *)a, lb = *(const uint32_t *)b;
+
+	return (la > lb) - (la < lb);
+}
+
+
+void bench_sort(uint32_t *lat, unsigned int n)
+{
+	qsort(lat, n, sizeof(lat[0]), bench_cmplat);
+}
+
+
+uint32_t bench_percentile(const uint32_t *lat, unsigned int n, unsigned int p)
+{
+	if (n == 0) {
+		return 0;
+	}
+
+	return lat[(uint64_t)(n - 1) * p / 100];
+}
+
+
+unsigned int bench_histBucket(uint32_t val, uint32_t base, unsigned int nbuckets)
+{
+	unsigned int b;
+
+	for (b = 0; (b < nbuckets - 1) && (val >= (base << b)); b++) {
+	}
+
+	return b;
+}
+
+
+int bench_parseTests(char *list, const char *const *names, unsigned int n, unsigned int *mask, const char **bad)
+{
+	unsigned int i;
+	char *tok, *arg;
+
+	*mask = 0;
+	for (arg = list; (tok = strtok(arg, ",")) != NULL; arg = NULL) {
+		for (i = 0; i < n; i++) {
+			if (strcmp(tok, names[i]) == 0) {
+				*mask |= 1u << i;
+				break;
+			}
+		}
+
+		if (i == n) {
+			*bad = tok;
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+
+int bench_counterInit(bench_counter_t *c)
+{
+	c->next = 0;
+	c->n = 0;
+
+	return mutexCreate(&c->lock);
+}
+
+
+void bench_counterDone(bench_counter_t *c)
+{
+	resourceDestroy(c->lock);
+}
+
+
+void bench_counterReset(bench_counter_t *c, unsigned int n)
+{
+	c->next = 0;
+	c->n = n;
+}
+
+
+int bench_counterNext(bench_counter_t *c)
+{
+	int ret = -1;
+
+	mutexLock(c->lock);
+	if (c->next < c->n) {
+		ret = (int)c->next++;
+	}
+	mutexUnlock(c->lock);
+
+	return ret;
+}
+
+
+void bench_reportBegin(bench_report_t *r)
+{
+	r->fields = 0;
+	printf("{");
+}
+
+
+void bench_reportEnd(bench_report_t *r)
+{
+	(void)r;
+
+	printf("}\n");
+}
+
+
+static void bench_reportKey(bench_report_t *r, const char *key)
+{
+	printf("%s\"%s\":", (r->fields++ == 0) ? "" : ",", key);
+}
+
+
+void bench_reportStr(bench_report_t *r, const char *key, const char *val)
+{
+	bench_reportKey(r, key);
+	printf("\"%s\"", val);
+}
+
+
+void bench_reportInt(bench_report_t *r, const char *key, int val)
+{
+	bench_reportKey(r, key);
+	printf("%d", val);
+}
+
+
+void bench_reportUint(bench_report_t *r, const char *key, unsigned int val)
+{
+	bench_reportKey(r, key);
+	printf("%u", val);
+}
+
+
+void bench_reportU64(bench_report_t *r, const char *key, uint64_t val)
+{
+	bench_reportKey(r, key);
+	printf("%llu", (unsigned long long)val);
+}
+
+
+void bench_reportDouble(bench_report_t *r, const char *key, double val, int prec)
+{
+	bench_reportKey(r, key);
+	printf("%.*f", prec, val);
+}
+
+
+void bench_reportArray(bench_report_t *r, const char *key, const unsigned int *vals, unsigned int n)
+{
+	unsigned int i;
+
+	bench_reportKey(r, key);
+	printf("[");
+	for (i = 0; i < n; i++) {
+		printf("%s%u", (i == 0) ? "" : ",", vals[i]);
+	}
+	printf("]");
+}
+
+
+void bench_reportLatency(bench_report_t *r, const char *prefix, const char *unit, const uint32_t *lat, unsigned int n)
+{
+	static const struct {
+		const char *name;
+		unsigned int p;
+	} stats[] = { { "min", 0 }, { "p50", 50 }, { "p90", 90 }, { "p99", 99 }, { "max", 100 } };
+	char key[BENCH_KEYSZ];
+	unsigned int i;
+
+	for (i = 0; i < sizeof(stats) / sizeof(stats[0]); i++) {
+		snprintf(key, sizeof(key), "%s%s_%s", prefix, stats[i].name, unit);
+		bench_reportUint(r, key, bench_percentile(lat, n, stats[i].p));
+	}
+}
@@ -0,0 +1,106 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Benchmark tools helpers - timing, latency statistics and JSON reports
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef LIBBENCH_H
+#define LIBBENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/threads.h>
+
+
+/* Monotonic time [ns] */
+extern uint64_t bench_nowNs(void);
+
+
+/* Monotonic time [us] */
+extern uint64_t bench_nowUs(void);
+
+
+/* Sorts n latencies in ascending order */
+extern void bench_sort(uint32_t *lat, unsigned int n);
+
+
+/* Returns p-th percentile (0 - 100) of n sorted latencies */
+extern uint32_t bench_percentile(const uint32_t *lat, unsigned int n, unsigned int p);
+
+
+/* Returns histogram bucket of val, bucket b holds values below base << b, the last one everything above */
+extern unsigned int bench_histBucket(uint32_t val, uint32_t base, unsigned int nbuckets);
+
+
+/* Parses comma separated test names into a bit mask (bit i - names[i]), list is modified.
+ * Returns 0 or -EINVAL with the unknown name in bad */
+extern int bench_parseTests(char *list, const char *const *names, unsigned int n, unsigned int *mask, const char **bad);
+
+
+/* Request counter shared by worker threads */
+typedef struct {
+	handle_t lock;
+	unsigned int next; /* Next request index */
+	unsigned int n;    /* Number of requests */
+} bench_counter_t;
+
+
+extern int bench_counterInit(bench_counter_t *c);
+
+
+extern void bench_counterDone(bench_counter_t *c);
+
+
+/* Sets number of requests to issue, called with no workers running */
+extern void bench_counterReset(bench_counter_t *c, unsigned int n);
+
+
+/* Returns next request index or -1 if all requests were issued */
+extern int bench_counterNext(bench_counter_t *c);
+
+
+/*
+ * Report is one JSON object per line, written to stdout field by field.
+ * Fields are emitted in call order, tools keep the order fixed so that reports can be diffed.
+ */
+typedef struct {
+	unsigned int fields;
+} bench_report_t;
+
+
+extern void bench_reportBegin(bench_report_t *r);
+
+
+extern void bench_reportEnd(bench_report_t *r);
+
+
+extern void bench_reportStr(bench_report_t *r, const char *key, const char *val);
+
+
+extern void bench_reportInt(bench_report_t *r, const char *key, int val);
+
+
+extern void bench_reportUint(bench_report_t *r, const char *key, unsigned int val);
+
+
+extern void bench_reportU64(bench_report_t *r, const char *key, uint64_t val);
+
+
+/* Fixed point number with prec fractional digits */
+extern void bench_reportDouble(bench_report_t *r, const char *key, double val, int prec);
+
+
+extern void bench_reportArray(bench_report_t *r, const char *key, const unsigned int *vals, unsigned int n);
+
+
+/* Emits <prefix>min_<unit>, p50, p90, p99 and max of n sorted latencies */
+extern void bench_reportLatency(bench_report_t *r, const char *prefix, const char *unit, const uint32_t *lat, unsigned int n);
+
+
+#endif /* LIBBENCH_H */
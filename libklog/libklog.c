@@ -15,6 +15,7 @@
 #include <fcntl.h>
 #include <paths.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <string.h>
 #include <sys/msg.h>
 #include <sys/threads.h>
@@ -29,23 +30,235 @@
 
 #define ERROR_MSG "libklog: Fatal error, exiting\n"
 
+/* Multiple kmsg reads are coalesced into one ttywrite() call */
+#ifndef LIBKLOG_BUF_SIZE
+#define LIBKLOG_BUF_SIZE 1024
+#endif
+
+/* Don't start another read with less space left, it could truncate a message */
+#ifndef LIBKLOG_READ_MIN
+#define LIBKLOG_READ_MIN 128
+#endif
+
+/* Console bandwidth given to kernel messages in bytes per second, 0 - unlimited */
+#ifndef LIBKLOG_RATE
+#define LIBKLOG_RATE 0
+#endif
+
+#ifndef LIBKLOG_BURST
+#define LIBKLOG_BURST (4 * LIBKLOG_BUF_SIZE)
+#endif
+
+/* Messages waiting for the console, kernel log is drained regardless of console speed */
+#ifndef LIBKLOG_RING_SIZE
+#define LIBKLOG_RING_SIZE 2048
+#endif
+
+/* Only messages with "<level>" prefix lower or equal to console level are printed */
+#ifndef LIBKLOG_CONSOLE_LEVEL
+#define LIBKLOG_CONSOLE_LEVEL 4 /* warning */
+#endif
+
+/* Level of lines without prefix (all kernel messages) */
+#ifndef LIBKLOG_DEFAULT_LEVEL
+#define LIBKLOG_DEFAULT_LEVEL 4
+#endif
+
+/* Non-blocking console retry interval when its buffer is full */
+#ifndef LIBKLOG_DRAIN_RETRY_US
+#define LIBKLOG_DRAIN_RETRY_US 10000
+#endif
+
+enum { line_start = 0, line_print, line_skip };
+
 static struct {
 	char __attribute__((aligned(8))) stack[2048];
+	char __attribute__((aligned(8))) dstack[1536];
+	char buf[LIBKLOG_BUF_SIZE];
 	libklog_write_t ttywrite;
+	libklog_writeNb_t ttywriteNb;
 	struct __errno_t e;
 	volatile int enabled;
 	handle_t cond;
 	handle_t lock;
 	oid_t ctrl;
+
+	/* Console ring, protected by lock */
+	char ring[LIBKLOG_RING_SIZE];
+	size_t head;
+	size_t tail;
+	handle_t dcond;
+
+	volatile int level;
+	int line;
+
+	/* Rate limiting, protected by lock */
+	unsigned int rate;
+	unsigned int burst;
+	unsigned int tokens;
+	time_t refill;
+	size_t dropped;
 } libklog_common;
 
 
 extern int sys_open(const char *filename, int oflag, ...);
 
 
+/* Returns how much of len may be written now, counts the rest as dropped */
+static size_t libklog_ratelimit(size_t len)
+{
+	time_t now;
+	uint64_t add;
+
+	mutexLock(libklog_common.lock);
+	if (libklog_common.rate == 0) {
+		mutexUnlock(libklog_common.lock);
+		return len;
+	}
+
+	gettime(&now, NULL);
+	add = ((uint64_t)(now - libklog_common.refill) * libklog_common.rate) / 1000000;
+	if (add != 0) {
+		/* Keep the remainder of partial token periods */
+		libklog_common.refill += (add * 1000000) / libklog_common.rate;
+		add += libklog_common.tokens;
+		libklog_common.tokens = (add > libklog_common.burst) ? libklog_common.burst : (unsigned int)add;
+	}
+
+	if (libklog_common.tokens < len) {
+		/* Drop whole chunks, partial messages are worse than missing ones */
+		libklog_common.dropped += len;
+		len = 0;
+	}
+	else {
+		libklog_common.tokens -= len;
+	}
+	mutexUnlock(libklog_common.lock);
+
+	return len;
+}
+
+
+static void _libklog_push(const char *data, size_t len)
+{
+	size_t offs, chunk;
+
+	if (LIBKLOG_RING_SIZE - (libklog_common.head - libklog_common.tail) < len) {
+		libklog_common.dropped += len;
+		return;
+	}
+
+	offs = libklog_common.head % LIBKLOG_RING_SIZE;
+	chunk = (len > LIBKLOG_RING_SIZE - offs) ? LIBKLOG_RING_SIZE - offs : len;
+	memcpy(libklog_common.ring + offs, data, chunk);
+	memcpy(libklog_common.ring, data + chunk, len - chunk);
+
+	if (libklog_common.head == libklog_common.tail) {
+		condSignal(libklog_common.dcond);
+	}
+	libklog_common.head += len;
+}
+
+
+/* Queues data for the console, preceded by the summary of dropped messages */
+static void libklog_push(const char *data, size_t len)
+{
+	char msg[48];
+	int n;
+
+	mutexLock(libklog_common.lock);
+	if (libklog_common.dropped != 0) {
+		n = snprintf(msg, sizeof(msg), "\nlibklog: %zu bytes dropped\n", libklog_common.dropped);
+		if (LIBKLOG_RING_SIZE - (libklog_common.head - libklog_common.tail) >= n + len) {
+			libklog_common.dropped = 0;
+			_libklog_push(msg, n);
+		}
+	}
+	_libklog_push(data, len);
+	mutexUnlock(libklog_common.lock);
+}
+
+
+/* Removes lines above console level in place, returns new length */
+static size_t libklog_filter(char *buf, size_t len)
+{
+	size_t i = 0, out = 0, start;
+	int level, eol;
+
+	while (i < len) {
+		if (libklog_common.line == line_start) {
+			level = LIBKLOG_DEFAULT_LEVEL;
+			if ((buf[i] == '<') && (i + 2 < len) && (buf[i + 1] >= '0') && (buf[i + 1] <= '7') && (buf[i + 2] == '>')) {
+				level = buf[i + 1] - '0';
+				i += 3;
+			}
+			libklog_common.line = (level <= libklog_common.level) ? line_print : line_skip;
+		}
+
+		start = i;
+		while ((i < len) && (buf[i] != '\n')) {
+			i++;
+		}
+
+		eol = (i < len) ? 1 : 0;
+		i += eol;
+
+		if (libklog_common.line == line_print) {
+			memmove(buf + out, buf + start, i - start);
+			out += i - start;
+		}
+
+		if (eol != 0) {
+			libklog_common.line = line_start;
+		}
+	}
+
+	return out;
+}
+
+
+static void drainthr(void *arg)
+{
+	size_t offs, len;
+	ssize_t ret;
+
+	mutexLock(libklog_common.lock);
+	for (;;) {
+		while (libklog_common.head == libklog_common.tail) {
+			condWait(libklog_common.dcond, libklog_common.lock, 0);
+		}
+
+		offs = libklog_common.tail % LIBKLOG_RING_SIZE;
+		len = libklog_common.head - libklog_common.tail;
+		if (len > LIBKLOG_RING_SIZE - offs) {
+			len = LIBKLOG_RING_SIZE - offs;
+		}
+		mutexUnlock(libklog_common.lock);
+
+		/* Only this thread waits for the console */
+		if (libklog_common.ttywriteNb != NULL) {
+			ret = libklog_common.ttywriteNb(libklog_common.ring + offs, len);
+			if (ret <= 0) {
+				ret = 0;
+				usleep(LIBKLOG_DRAIN_RETRY_US);
+			}
+		}
+		else {
+			libklog_common.ttywrite(libklog_common.ring + offs, len);
+			ret = len;
+		}
+
+		mutexLock(libklog_common.lock);
+		libklog_common.tail += ret;
+	}
+}
+
+
 static void pumpthr(void *arg)
 {
-	char buf[256];
+	char *buf = libklog_common.buf;
+	struct pollfd pfd;
+	size_t len;
 	int fd, ret;
 	oid_t dev;
 	char *name;
@@ -98,16 +311,29 @@ static void pumpthr(void *arg)
 		}
 	}
 
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+
 	while (1) {
-		ret = read(fd, buf, sizeof(buf));
+		ret = read(fd, buf, LIBKLOG_BUF_SIZE);
 		if (ret <= 0) {
 			if ((ret == 0) || (errno == EINTR) || (errno == EPIPE)) {
 				continue;
 			}
 			else {
-				libklog_common.ttywrite(ERROR_MSG, sizeof(ERROR_MSG));
+				libklog_push(ERROR_MSG, sizeof(ERROR_MSG) - 1);
+				break;
+			}
+		}
+
+		/* Collect messages that are already waiting */
+		len = ret;
+		while ((LIBKLOG_BUF_SIZE - len >= LIBKLOG_READ_MIN) && (poll(&pfd, 1, 0) > 0) && ((pfd.revents & POLLIN) != 0)) {
+			ret = read(fd, buf + len, LIBKLOG_BUF_SIZE - len);
+			if (ret <= 0) {
 				break;
 			}
+			len += ret;
 		}
 
 		/* Just stop here while dmesg on the console is disabled */
@@ -119,7 +345,10 @@ static void pumpthr(void *arg)
 			mutexUnlock(libklog_common.lock);
 		}
 
-		libklog_common.ttywrite(buf, ret);
+		len = libklog_filter(buf, len);
+		if ((len != 0) && (libklog_ratelimit(len) != 0)) {
+			libklog_push(buf, len);
+		}
 	}
 
 	close(fd);
@@ -128,6 +357,23 @@ static void pumpthr(void *arg)
 }
 
 
+void libklog_setRate(unsigned int rate, unsigned int burst)
+{
+	mutexLock(libklog_common.lock);
+	libklog_common.rate = rate;
+	libklog_common.burst = (burst < LIBKLOG_BUF_SIZE) ? LIBKLOG_BUF_SIZE : burst;
+	libklog_common.tokens = libklog_common.burst;
+	gettime(&libklog_common.refill, NULL);
+	mutexUnlock(libklog_common.lock);
+}
+
+
+void libklog_setLevel(int level)
+{
+	libklog_common.level = level;
+}
+
+
 void libklog_enable(int enable)
 {
 	if (enable == 0) {
@@ -230,13 +476,20 @@ int libklog_ctrlRegister(oid_t *oid)
 }
 
 
-static int libklog_initHelper(libklog_write_t clbk, int createDevs)
+static int libklog_initHelper(libklog_write_t clbk, libklog_writeNb_t clbkNb, int createDevs)
 {
 	oid_t dev;
 	int err;
 
 	libklog_common.ttywrite = clbk;
+	libklog_common.ttywriteNb = clbkNb;
 	libklog_common.enabled = 1;
+	libklog_common.level = LIBKLOG_CONSOLE_LEVEL;
+	libklog_common.line = line_start;
+	libklog_common.rate = LIBKLOG_RATE;
+	libklog_common.burst = (LIBKLOG_BURST < LIBKLOG_BUF_SIZE) ? LIBKLOG_BUF_SIZE : LIBKLOG_BURST;
+	libklog_common.tokens = libklog_common.burst;
+	gettime(&libklog_common.refill, NULL);
 
 	err = mutexCreate(&libklog_common.lock);
 	if (err < 0) {
@@ -249,6 +502,13 @@ static int libklog_initHelper(libklog_write_t clbk, int createDevs)
 		return err;
 	}
 
+	err = condCreate(&libklog_common.dcond);
+	if (err < 0) {
+		resourceDestroy(libklog_common.lock);
+		resourceDestroy(libklog_common.cond);
+		return err;
+	}
+
 	if (createDevs != 0) {
 		/* kmsg device is handled inside kernel */
 		dev.port = 0;
@@ -257,14 +517,22 @@ static int libklog_initHelper(libklog_write_t clbk, int createDevs)
 		if (err < 0) {
 			resourceDestroy(libklog_common.lock);
 			resourceDestroy(libklog_common.cond);
+			resourceDestroy(libklog_common.dcond);
 			return err;
 		}
 	}
 
-	/* Pump klog messages from kernel buffer to tty driver */
-	if (beginthread(pumpthr, 4, libklog_common.stack, sizeof(libklog_common.stack), (void *)(addr_t)createDevs) != 0) {
+	/* Write queued messages to tty driver */
+	if (beginthread(drainthr, 4, libklog_common.dstack, sizeof(libklog_common.dstack), NULL) != 0) {
 		resourceDestroy(libklog_common.lock);
 		resourceDestroy(libklog_common.cond);
+		resourceDestroy(libklog_common.dcond);
+		return -ENOMEM;
+	}
+
+	/* Pump klog messages from kernel buffer to the queue */
+	if (beginthread(pumpthr, 4, libklog_common.stack, sizeof(libklog_common.stack), (void *)(addr_t)createDevs) != 0) {
+		/* drain thread is idle forever, resources stay */
 		return -ENOMEM;
 	}
 
@@ -274,11 +542,23 @@ static int libklog_initHelper(libklog_write_t clbk, int createDevs)
 
 int libklog_initNoDev(libklog_write_t clbk)
 {
-	return libklog_initHelper(clbk, 0);
+	return libklog_initHelper(clbk, NULL, 0);
 }
 
 
 int libklog_init(libklog_write_t clbk)
 {
-	return libklog_initHelper(clbk, 1);
+	return libklog_initHelper(clbk, NULL, 1);
+}
+
+
+int libklog_initNbNoDev(libklog_writeNb_t clbk)
+{
+	return libklog_initHelper(NULL, clbk, 0);
+}
+
+
+int libklog_initNb(libklog_writeNb_t clbk)
+{
+	return libklog_initHelper(NULL, clbk, 1);
 }
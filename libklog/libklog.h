@@ -16,18 +16,31 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <sys/types.h>
 #include <sys/msg.h>
 
 
 typedef void (*libklog_write_t)(const char *buf, size_t size);
 
 
+/* Mustn't block, returns number of bytes accepted */
+typedef ssize_t (*libklog_writeNb_t)(const char *buf, size_t size);
+
+
 int libklog_ctrlHandle(uint32_t port, msg_t *msg, msg_rid_t rid);
 
 
 void libklog_enable(int enable);
 
 
+/* Limit kernel messages to rate bytes per second with burst bytes of slack, rate 0 - unlimited */
+void libklog_setRate(unsigned int rate, unsigned int burst);
+
+
+/* Print only messages with level lower or equal to level (kernel messages have LIBKLOG_DEFAULT_LEVEL) */
+void libklog_setLevel(int level);
+
+
 int libklog_ctrlRegister(oid_t *oid);
 
 
@@ -37,4 +50,11 @@ int libklog_initNoDev(libklog_write_t clbk);
 int libklog_init(libklog_write_t clbk);
 
 
+/* Callbacks are called from libklog drain thread, non-blocking variant is retried until data is accepted */
+int libklog_initNbNoDev(libklog_writeNb_t clbk);
+
+
+int libklog_initNb(libklog_writeNb_t clbk);
+
+
 #endif /* _LIBKLOG_H_ */
@@ -0,0 +1,184 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Performance counters tool
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/msg.h>
+
+#include "perfcnt.h"
+
+
+static struct {
+	oid_t oid;
+	uint32_t prev[PERFCNT_MAX];
+} tool_common;
+
+
+static int perfcnt_query(uint32_t cmd, uint32_t idx, perfcnt_info_t *info)
+{
+	msg_t msg = {
+		.type = mtDevCtl,
+		.oid = tool_common.oid,
+	};
+	perfcnt_devctl_t ctl = {
+		.magic = PERFCNT_DEVCTL,
+		.cmd = cmd,
+		.idx = idx,
+	};
+	int res;
+
+	memcpy(msg.i.raw, &ctl, sizeof(ctl));
+	msg.o.data = info;
+	msg.o.size = (info != NULL) ? sizeof(*info) : 0;
+
+	res = msgSend(tool_common.oid.port, &msg);
+	if (res < 0) {
+		return res;
+	}
+
+	return msg.o.err;
+}
+
+
+static void perfcnt_printHist(const perfcnt_info_t *info)
+{
+	uint32_t i;
+
+	for (i = 0; i < info->nbins; ++i) {
+		if (info->bins[i] == 0) {
+			continue;
+		}
+
+		if (i == 0) {
+			printf("    %10u : %u\n", 0U, info->bins[i]);
+		}
+		else if (i == info->nbins - 1) {
+			printf("   >=%10u : %u\n", 1U << (i - 1), info->bins[i]);
+		}
+		else {
+			printf("    %10u : %u\n", 1U << (i - 1), info->bins[i]);
+		}
+	}
+}
+
+
+static int perfcnt_dump(int delta)
+{
+	perfcnt_info_t info;
+	uint32_t idx;
+	int res;
+
+	for (idx = 0; idx < PERFCNT_MAX; ++idx) {
+		res = perfcnt_query(perfcnt_get, idx, &info);
+		if (res == -ENOENT) {
+			break;
+		}
+		else if (res < 0) {
+			fprintf(stderr, "perfcnt: query failed (%d)\n", res);
+			return res;
+		}
+
+		info.name[sizeof(info.name) - 1] = '\0';
+		if (delta != 0) {
+			printf("%-24s %10u (+%u)\n", info.name, info.count, info.count - tool_common.prev[idx]);
+		}
+		else {
+			printf("%-24s %10u\n", info.name, info.count);
+		}
+		tool_common.prev[idx] = info.count;
+
+		perfcnt_printHist(&info);
+	}
+
+	if (idx == 0) {
+		printf("no counters\n");
+	}
+
+	return 0;
+}
+
+
+static void usage(const char *progname)
+{
+	printf("Usage: %s [-r] [-w seconds] <device>\n", progname);
+	printf("\t-r          reset counters after reading them\n");
+	printf("\t-w seconds  print counters periodically with increments since the previous read\n");
+	printf("\t-h          this help\n");
+}
+
+
+int main(int argc, char **argv)
+{
+	int c, reset = 0, interval = 0, pass;
+
+	while ((c = getopt(argc, argv, "rw:h")) != -1) {
+		switch (c) {
+			case 'r':
+				reset = 1;
+				break;
+
+			case 'w':
+				interval = atoi(optarg);
+				if (interval <= 0) {
+					usage(argv[0]);
+					return EXIT_FAILURE;
+				}
+				break;
+
+			case 'h':
+				usage(argv[0]);
+				return EXIT_SUCCESS;
+
+			default:
+				usage(argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	if (optind != argc - 1) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (lookup(argv[optind], NULL, &tool_common.oid) < 0) {
+		fprintf(stderr, "perfcnt: can't find %s\n", argv[optind]);
+		return EXIT_FAILURE;
+	}
+
+	for (pass = 0;; ++pass) {
+		if (perfcnt_dump(pass) < 0) {
+			return EXIT_FAILURE;
+		}
+
+		if ((reset != 0) && (perfcnt_query(perfcnt_reset, PERFCNT_ALL, NULL) < 0)) {
+			fprintf(stderr, "perfcnt: reset failed\n");
+			return EXIT_FAILURE;
+		}
+
+		if (interval == 0) {
+			break;
+		}
+
+		if (reset != 0) {
+			memset(tool_common.prev, 0, sizeof(tool_common.prev));
+		}
+
+		sleep(interval);
+		printf("\n");
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,149 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Per-process performance counters exposed through devctl
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "perfcnt.h"
+
+#if PERFCNT
+
+
+static struct {
+	perfcnt_t *table[PERFCNT_MAX];
+	unsigned int reserved; /* slots handed out, a slot may still be NULL while being filled */
+} perfcnt_common;
+
+
+int perfcnt_register(perfcnt_t *cnt)
+{
+	unsigned int idx = __atomic_fetch_add(&perfcnt_common.reserved, 1, __ATOMIC_RELAXED);
+
+	if (idx >= PERFCNT_MAX) {
+		return -ENOSPC;
+	}
+
+	__atomic_store_n(&perfcnt_common.table[idx], cnt, __ATOMIC_RELEASE);
+
+	return EOK;
+}
+
+
+static perfcnt_t *perfcnt_at(uint32_t idx)
+{
+	if ((idx >= PERFCNT_MAX) || (idx >= __atomic_load_n(&perfcnt_common.reserved, __ATOMIC_RELAXED))) {
+		return NULL;
+	}
+
+	return __atomic_load_n(&perfcnt_common.table[idx], __ATOMIC_ACQUIRE);
+}
+
+
+static void perfcnt_clear(perfcnt_t *cnt)
+{
+	unsigned int i;
+
+	__atomic_store_n(&cnt->count, 0, __ATOMIC_RELAXED);
+
+	if (cnt->bins != NULL) {
+		for (i = 0; i < PERFCNT_BINS; ++i) {
+			__atomic_store_n(&cnt->bins[i], 0, __ATOMIC_RELAXED);
+		}
+	}
+}
+
+
+static int perfcnt_info(const perfcnt_devctl_t *ctl, void *data, size_t size)
+{
+	perfcnt_info_t *info = data;
+	perfcnt_t *cnt;
+	unsigned int i;
+
+	if ((info == NULL) || (size < sizeof(*info))) {
+		return -EINVAL;
+	}
+
+	cnt = perfcnt_at(ctl->idx);
+	if (cnt == NULL) {
+		/* Registration in progress looks the same as the end of the table */
+		return -ENOENT;
+	}
+
+	memset(info, 0, sizeof(*info));
+	strncpy(info->name, cnt->name, sizeof(info->name) - 1);
+	info->count = __atomic_load_n(&cnt->count, __ATOMIC_RELAXED);
+
+	if (cnt->bins != NULL) {
+		info->nbins = PERFCNT_BINS;
+		for (i = 0; i < PERFCNT_BINS; ++i) {
+			info->bins[i] = __atomic_load_n(&cnt->bins[i], __ATOMIC_RELAXED);
+		}
+	}
+
+	return EOK;
+}
+
+
+static int perfcnt_resetCnt(const perfcnt_devctl_t *ctl)
+{
+	perfcnt_t *cnt;
+	uint32_t i;
+
+	if (ctl->idx != PERFCNT_ALL) {
+		cnt = perfcnt_at(ctl->idx);
+		if (cnt == NULL) {
+			return -ENOENT;
+		}
+		perfcnt_clear(cnt);
+		return EOK;
+	}
+
+	for (i = 0; (cnt = perfcnt_at(i)) != NULL; ++i) {
+		perfcnt_clear(cnt);
+	}
+
+	return EOK;
+}
+
+
+int perfcnt_devctl(msg_t *msg)
+{
+	perfcnt_devctl_t ctl;
+
+	if (msg->type != mtDevCtl) {
+		return -1;
+	}
+
+	memcpy(&ctl, msg->i.raw, sizeof(ctl));
+	if (ctl.magic != PERFCNT_DEVCTL) {
+		return -1;
+	}
+
+	switch (ctl.cmd) {
+		case perfcnt_get:
+			msg->o.err = perfcnt_info(&ctl, msg->o.data, msg->o.size);
+			break;
+
+		case perfcnt_reset:
+			msg->o.err = perfcnt_resetCnt(&ctl);
+			break;
+
+		default:
+			msg->o.err = -EINVAL;
+			break;
+	}
+
+	return 0;
+}
+
+
+#endif
@@ -0,0 +1,126 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Per-process performance counters exposed through devctl
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef LIBPERFCNT_H
+#define LIBPERFCNT_H
+
+#include <stdint.h>
+#include <sys/msg.h>
+
+
+/* Counters are cheap enough (one relaxed atomic add) to stay in release builds */
+#ifndef PERFCNT
+#define PERFCNT 1
+#endif
+
+/* Number of counters a single process can register */
+#ifndef PERFCNT_MAX
+#define PERFCNT_MAX 32
+#endif
+
+#define PERFCNT_BINS   16
+#define PERFCNT_NAMESZ 24
+
+/* Request tag in msg.i.raw, distinguishes perfcnt requests from driver devctls */
+#define PERFCNT_DEVCTL 0x544e4350 /* "PCNT" */
+
+/* idx value for perfcnt_reset resetting all counters */
+#define PERFCNT_ALL 0xffffffffU
+
+
+enum { perfcnt_get = 0, perfcnt_reset };
+
+
+/* msg.i.raw */
+typedef struct {
+	uint32_t magic; /* PERFCNT_DEVCTL */
+	uint32_t cmd;
+	uint32_t idx;
+} perfcnt_devctl_t;
+
+
+/* msg.o.data of perfcnt_get, -ENOENT past the last registered counter */
+typedef struct {
+	char name[PERFCNT_NAMESZ];
+	uint32_t count;              /* events (counter) or samples (histogram) */
+	uint32_t nbins;              /* 0 for plain counters */
+	uint32_t bins[PERFCNT_BINS]; /* bins[0] holds 0, bins[i] holds [2^(i-1), 2^i), last one is open */
+} perfcnt_info_t;
+
+
+typedef struct {
+	const char *name;
+	uint32_t count;
+	uint32_t *bins;
+} perfcnt_t;
+
+
+#if PERFCNT
+
+
+#define PERFCNT_COUNTER(var, nm) static perfcnt_t var = { .name = (nm) }
+
+#define PERFCNT_HISTOGRAM(var, nm) \
+	static uint32_t var##_bins[PERFCNT_BINS]; \
+	static perfcnt_t var = { .name = (nm), .bins = var##_bins }
+
+#define PERFCNT_REGISTER(var) ((void)perfcnt_register(&(var)))
+
+#define PERFCNT_ADD(var, n)    ((void)__atomic_fetch_add(&(var).count, (uint32_t)(n), __ATOMIC_RELAXED))
+#define PERFCNT_INC(var)       PERFCNT_ADD(var, 1)
+#define PERFCNT_SAMPLE(var, v) perfcnt_sample(&(var), (uint32_t)(v))
+
+
+static inline void perfcnt_sample(perfcnt_t *cnt, uint32_t v)
+{
+	unsigned int bin = (v == 0) ? 0 : (32 - __builtin_clz(v));
+
+	if (bin >= PERFCNT_BINS) {
+		bin = PERFCNT_BINS - 1;
+	}
+
+	(void)__atomic_fetch_add(&cnt->bins[bin], 1, __ATOMIC_RELAXED);
+	(void)__atomic_fetch_add(&cnt->count, 1, __ATOMIC_RELAXED);
+}
+
+
+/* Safe to call from any thread, counters can't be unregistered */
+int perfcnt_register(perfcnt_t *cnt);
+
+
+/* Handles perfcnt requests, returns 0 and fills msg->o.err if msg was one, -1 otherwise */
+int perfcnt_devctl(msg_t *msg);
+
+
+#else
+
+
+#define PERFCNT_COUNTER(var, nm)
+#define PERFCNT_HISTOGRAM(var, nm)
+#define PERFCNT_REGISTER(var)  ((void)0)
+#define PERFCNT_ADD(var, n)    ((void)0)
+#define PERFCNT_INC(var)       ((void)0)
+#define PERFCNT_SAMPLE(var, v) ((void)0)
+
+
+static inline int perfcnt_devctl(msg_t *msg)
+{
+	(void)msg;
+
+	return -1;
+}
+
+
+#endif
+
+
+#endif
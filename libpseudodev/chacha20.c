@@ -0,0 +1,104 @@
+/*
+ * Phoenix-RTOS
+ *
+ * ChaCha20 keystream generator with fast key erasure
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * %LICENSE%
+ */
+
+#include <string.h>
+#include "chacha20.h"
+
+
+#define CHACHA_ROTL(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+
+#define CHACHA_QR(a, b, c, d) \
+	do { \
+		a += b; d ^= a; d = CHACHA_ROTL(d, 16); \
+		c += d; b ^= c; b = CHACHA_ROTL(b, 12); \
+		a += b; d ^= a; d = CHACHA_ROTL(d, 8); \
+		c += d; b ^= c; b = CHACHA_ROTL(b, 7); \
+	} while (0)
+
+
+void chacha20_block(chacha20_t *ctx, uint32_t out[16])
+{
+	uint32_t in[16], x[16];
+	int i;
+
+	in[0] = 0x61707865;
+	in[1] = 0x3320646e;
+	in[2] = 0x79622d32;
+	in[3] = 0x6b206574;
+	memcpy(&in[4], ctx->key, sizeof(ctx->key));
+	in[12] = ctx->counter;
+	memcpy(&in[13], ctx->nonce, sizeof(ctx->nonce));
+
+	if (++ctx->counter == 0) {
+		ctx->nonce[0]++;
+	}
+
+	memcpy(x, in, sizeof(x));
+
+	for (i = 0; i < 10; i++) {
+		CHACHA_QR(x[0], x[4], x[8], x[12]);
+		CHACHA_QR(x[1], x[5], x[9], x[13]);
+		CHACHA_QR(x[2], x[6], x[10], x[14]);
+		CHACHA_QR(x[3], x[7], x[11], x[15]);
+		CHACHA_QR(x[0], x[5], x[10], x[15]);
+		CHACHA_QR(x[1], x[6], x[11], x[12]);
+		CHACHA_QR(x[2], x[7], x[8], x[13]);
+		CHACHA_QR(x[3], x[4], x[9], x[14]);
+	}
+
+	for (i = 0; i < 16; i++) {
+		out[i] = x[i] + in[i];
+	}
+
+	memset(x, 0, sizeof(x));
+	memset(in, 0, sizeof(in));
+}
+
+
+void chacha20_rekey(chacha20_t *ctx)
+{
+	uint32_t block[16];
+
+	chacha20_block(ctx, block);
+	memcpy(ctx->key, block, sizeof(ctx->key));
+	memset(block, 0, sizeof(block));
+}
+
+
+void chacha20_generate(chacha20_t *ctx, uint8_t *buf, size_t len)
+{
+	uint32_t block[16];
+	size_t offs, chunk;
+
+	for (offs = 0; offs < len; offs += chunk) {
+		chacha20_block(ctx, block);
+		chunk = (len - offs < sizeof(block)) ? len - offs : sizeof(block);
+		memcpy(buf + offs, block, chunk);
+	}
+	memset(block, 0, sizeof(block));
+
+	chacha20_rekey(ctx);
+}
+
+
+void chacha20_mix(chacha20_t *ctx, const uint8_t *data, size_t len)
+{
+	size_t i;
+
+	while (len > 0) {
+		for (i = 0; (i < sizeof(ctx->key)) && (i < len); i++) {
+			((uint8_t *)ctx->key)[i] ^= data[i];
+		}
+
+		data += i;
+		len -= i;
+		chacha20_rekey(ctx);
+	}
+}
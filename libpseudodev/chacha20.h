@@ -0,0 +1,44 @@
+/*
+ * Phoenix-RTOS
+ *
+ * ChaCha20 keystream generator with fast key erasure
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * %LICENSE%
+ */
+
+#ifndef CHACHA20_H
+#define CHACHA20_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+#define CHACHA20_KEY_WORDS 8
+
+
+typedef struct {
+	uint32_t key[CHACHA20_KEY_WORDS];
+	uint32_t nonce[3];
+	uint32_t counter;
+} chacha20_t;
+
+
+/* RFC 8439 block function, advances the block counter (overflow carries to nonce[0]) */
+void chacha20_block(chacha20_t *ctx, uint32_t out[16]);
+
+
+/* Fast key erasure - replaces the key with the next block, previous output can't be recovered from the state */
+void chacha20_rekey(chacha20_t *ctx);
+
+
+/* Fills buf with keystream, then rekeys */
+void chacha20_generate(chacha20_t *ctx, uint8_t *buf, size_t len);
+
+
+/* XORs data into the key, rekeying after each key-sized chunk */
+void chacha20_mix(chacha20_t *ctx, const uint8_t *data, size_t len);
+
+
+#endif /* end of CHACHA20_H */
@@ -10,19 +10,33 @@
  */
 
 #include <errno.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/msg.h>
 #include <sys/file.h>
+#include <sys/threads.h>
 #include <sys/time.h>
 #include "pseudodev.h"
+#include "chacha20.h"
 
 
 static struct {
-	unsigned int randSeed;
+	chacha20_t gen;
+	handle_t lock;
 } pseudo_common;
 
 
+static ssize_t pseudo_random(uint8_t *buf, size_t count)
+{
+	mutexLock(pseudo_common.lock);
+	chacha20_generate(&pseudo_common.gen, buf, count);
+	mutexUnlock(pseudo_common.lock);
+
+	return (ssize_t)count;
+}
+
+
 static int pseudo_open(int id, int flags)
 {
 	(void)flags;
@@ -71,12 +85,7 @@ static ssize_t pseudo_read(int id, void *buf, size_t count)
 			return (ssize_t)count;
 
 		case pseudo_idRandom:
-			for (size_t ofs = 0; ofs < count; ofs += sizeof(pseudo_common.randSeed)) {
-				int res = rand_r(&pseudo_common.randSeed);
-				memcpy((unsigned char *)buf + ofs, &res,
-					((count - ofs) > sizeof(res)) ? sizeof(res) : count - ofs);
-			}
-			return (ssize_t)count;
+			return pseudo_random(buf, count);
 
 		default:
 			break;
@@ -88,12 +97,14 @@ static ssize_t pseudo_read(int id, void *buf, size_t count)
 
 static ssize_t pseudo_write(int id, const void *buf, size_t count)
 {
-	(void)buf;
-
 	switch (id) {
 		case pseudo_idNull:
 		case pseudo_idZero:
+			return (ssize_t)count;
+
 		case pseudo_idRandom:
+			/* Written data is mixed into the state, it can't make it any worse */
+			pseudo_seed(buf, count);
 			return (ssize_t)count;
 
 		case pseudo_idFull:
@@ -134,10 +145,27 @@ int pseudo_handleMsg(msg_t *msg, int id)
 }
 
 
-void pseudo_init(void)
+void pseudo_seed(const void *data, size_t len)
+{
+	mutexLock(pseudo_common.lock);
+	chacha20_mix(&pseudo_common.gen, data, len);
+	mutexUnlock(pseudo_common.lock);
+}
+
+
+int pseudo_init(void)
 {
 	time_t now;
+	int err;
+
+	err = mutexCreate(&pseudo_common.lock);
+	if (err < 0) {
+		return err;
+	}
+
+	/* Weak until pseudo_seed() is called with entropy from hardware */
 	gettime(&now, NULL);
+	chacha20_mix(&pseudo_common.gen, (const uint8_t *)&now, sizeof(now));
 
-	pseudo_common.randSeed = (unsigned int)now;
+	return EOK;
 }
@@ -23,7 +23,12 @@ enum { pseudo_idNull = 0, pseudo_idZero, pseudo_idFull, pseudo_idRandom };
 int pseudo_handleMsg(msg_t *msg, int id);
 
 
-void pseudo_init(void);
+/* Mix entropy into /dev/urandom generator state */
+void pseudo_seed(const void *data, size_t len);
+
+
+/* Returns 0 or a negative error */
+int pseudo_init(void);
 
 
 #endif /* end of PSEUDO_H */
@@ -92,22 +92,61 @@ static struct {
 	librtt_cacheOp_t invalFn;
 	librtt_cacheOp_t cleanFn;
 	unsigned int lastRd[LIBRTT_TXCHANNELS];
+	struct {
+		/* writers in flight [31:24] | reserved position [23:0] */
+		volatile uint32_t state;
+		volatile uint32_t dropped;
+		volatile uint32_t pending; /* drops not reported yet */
+	} trace[LIBRTT_TXCHANNELS];
 } librtt_common = { 0 };
 
 
-static void performCacheOp(librtt_cacheOp_t op, volatile unsigned char *buf, unsigned int sz, unsigned int rd, unsigned int wr)
+#define LIBRTT_TRACE_POS_MASK 0x00ffffffU
+#define LIBRTT_TRACE_ONE      0x01000000U
+
+
+/* Apply cache operation to len bytes of the ring starting at offs, wrapping at most once */
+static void performCacheOp(librtt_cacheOp_t op, volatile unsigned char *buf, unsigned int sz, unsigned int offs, size_t len)
 {
-	if ((rd == wr) || (op == NULL)) {
+	size_t first;
+
+	if ((len == 0) || (op == NULL)) {
 		return;
 	}
 
-	if (wr < rd) {
-		op((void *)(buf + rd), sz - rd);
-		op((void *)buf, wr + 1);
+	first = sz - offs;
+	if (len > first) {
+		op((void *)(buf + offs), first);
+		op((void *)buf, len - first);
+	}
+	else {
+		op((void *)(buf + offs), len);
+	}
+}
+
+
+/* Copy len bytes into the ring at wr as at most two spans, returns new wr */
+static unsigned int librtt_copyToRing(volatile unsigned char *dst, unsigned int sz, unsigned int wr, const unsigned char *src, size_t len)
+{
+	size_t first;
+
+	/* Only the last sz bytes survive an overwrite */
+	if (len > sz) {
+		src += len - sz;
+		wr = (wr + len - sz) & (sz - 1);
+		len = sz;
+	}
+
+	first = sz - wr;
+	if (len > first) {
+		memcpy((void *)(dst + wr), src, first);
+		memcpy((void *)dst, src + first, len - first);
 	}
 	else {
-		op((void *)(buf + rd), wr - rd + 1);
+		memcpy((void *)(dst + wr), src, len);
 	}
+
+	return (wr + len) & (sz - 1);
 }
 
 
@@ -143,27 +182,36 @@ ssize_t librtt_read(unsigned int ch, void *buf, size_t count)
 	ch += rtt->txChannels;
 	volatile unsigned char *srcBuf = rtt->channel[ch].ptr;
 	unsigned char *dstBuf = (unsigned char *)buf;
-	unsigned int sz = rtt->channel[ch].sz - 1;
-	unsigned int rd = rtt->channel[ch].rd & sz;
-	unsigned int wr = rtt->channel[ch].wr & sz;
-	size_t todo = count;
+	unsigned int sz = rtt->channel[ch].sz;
+	unsigned int rd = rtt->channel[ch].rd & (sz - 1);
+	unsigned int wr = rtt->channel[ch].wr & (sz - 1);
+	size_t len = (wr - rd) & (sz - 1);
+	size_t first;
 
-	performCacheOp(librtt_common.invalFn, (void *)srcBuf, sz + 1, rd, wr);
-	while ((todo != 0) && (rd != wr)) {
-		*dstBuf++ = srcBuf[rd];
-		rd = (rd + 1) & sz;
-		todo--;
+	if (len > count) {
+		len = count;
+	}
+
+	performCacheOp(librtt_common.invalFn, srcBuf, sz, rd, len);
+
+	first = sz - rd;
+	if (len > first) {
+		memcpy(dstBuf, (void *)(srcBuf + rd), first);
+		memcpy(dstBuf + first, (void *)srcBuf, len - first);
+	}
+	else {
+		memcpy(dstBuf, (void *)(srcBuf + rd), len);
 	}
 
 	dataMemoryBarrier();
 
-	rtt->channel[ch].rd = rd;
+	rtt->channel[ch].rd = (rd + len) & (sz - 1);
 
-	return count - todo;
+	return len;
 }
 
 
-ssize_t librtt_write(unsigned int ch, const void *buf, size_t count, int allowOverwrite)
+ssize_t librtt_writev(unsigned int ch, const struct iovec *iov, int iovcnt, int allowOverwrite)
 {
 	volatile struct rtt_desc *rtt = librtt_common.rtt;
 
@@ -173,36 +221,51 @@ ssize_t librtt_write(unsigned int ch, const void *buf, size_t count, int allowOv
 
 	dataMemoryBarrier();
 
-	const unsigned char *srcBuf = (const unsigned char *)buf;
 	volatile unsigned char *dstBuf = rtt->channel[ch].ptr;
-	unsigned int sz = rtt->channel[ch].sz - 1;
-	unsigned int rd = (rtt->channel[ch].rd + sz) & sz;
-	unsigned int wr = rtt->channel[ch].wr & sz;
-	size_t todo = count;
+	unsigned int sz = rtt->channel[ch].sz;
+	unsigned int rd = (rtt->channel[ch].rd + sz - 1) & (sz - 1);
+	unsigned int start = rtt->channel[ch].wr & (sz - 1);
+	unsigned int wr = start;
+	size_t space = (rd - wr) & (sz - 1);
+	size_t total = 0, len;
+	int n;
+
+	for (n = 0; n < iovcnt; n++) {
+		len = iov[n].iov_len;
+		if ((allowOverwrite == 0) && (len > space - total)) {
+			len = space - total;
+		}
 
-	while ((todo != 0) && (rd != wr)) {
-		dstBuf[wr] = *srcBuf++;
-		wr = (wr + 1) & sz;
-		todo--;
-	}
+		wr = librtt_copyToRing(dstBuf, sz, wr, iov[n].iov_base, len);
+		total += len;
 
-	if ((rd == wr) && (allowOverwrite != 0)) {
-		while (todo != 0) {
-			dstBuf[wr] = *srcBuf++;
-			wr = (wr + 1) & sz;
-			todo--;
+		if (len != iov[n].iov_len) {
+			break;
 		}
+	}
 
+	if (total > space) {
+		/* Overwritten - the whole ring is dirty, unread data is dropped */
+		performCacheOp(librtt_common.cleanFn, dstBuf, sz, 0, sz);
 		rtt->channel[ch].rd = wr;
 	}
-
-	performCacheOp(librtt_common.cleanFn, (void *)dstBuf, sz + 1, rd, wr);
+	else {
+		performCacheOp(librtt_common.cleanFn, dstBuf, sz, start, total);
+	}
 
 	dataMemoryBarrier();
 
 	rtt->channel[ch].wr = wr;
 
-	return count - todo;
+	return total;
+}
+
+
+ssize_t librtt_write(unsigned int ch, const void *buf, size_t count, int allowOverwrite)
+{
+	const struct iovec iov = { .iov_base = (void *)buf, .iov_len = count };
+
+	return librtt_writev(ch, &iov, 1, allowOverwrite);
 }
 
 
@@ -274,6 +337,131 @@ void librtt_txReset(unsigned int ch)
 }
 
 
+int librtt_traceInit(unsigned int ch)
+{
+	volatile struct rtt_desc *rtt = librtt_common.rtt;
+
+	if (librtt_checkTx(ch) < 0) {
+		return -ENODEV;
+	}
+
+	/* Ring distances have to fit in the reserved position */
+	if (rtt->channel[ch].sz > (LIBRTT_TRACE_POS_MASK + 1) / 2) {
+		return -EINVAL;
+	}
+
+	librtt_common.trace[ch].state = rtt->channel[ch].wr & (rtt->channel[ch].sz - 1);
+	librtt_common.trace[ch].dropped = 0;
+	librtt_common.trace[ch].pending = 0;
+
+	return 0;
+}
+
+
+/* Copies the record into the ring, publishes wr once no other writer is in the middle of its copy */
+static int librtt_traceWrite(unsigned int ch, const uint32_t *rec, size_t len)
+{
+	volatile struct rtt_desc *rtt = librtt_common.rtt;
+	volatile unsigned char *dstBuf = rtt->channel[ch].ptr;
+	volatile uint32_t *state = &librtt_common.trace[ch].state;
+	unsigned int sz = rtt->channel[ch].sz;
+	unsigned int cur, pos, now;
+	uint32_t st, nst;
+
+	st = *state;
+	do {
+		pos = st & (sz - 1);
+		if (((pos - (rtt->channel[ch].rd & (sz - 1))) & (sz - 1)) + len > sz - 1) {
+			return -ENOSPC;
+		}
+
+		if ((st >> 24) == 0xff) {
+			return -EAGAIN;
+		}
+
+		nst = (st & ~LIBRTT_TRACE_POS_MASK) + LIBRTT_TRACE_ONE + ((st + len) & LIBRTT_TRACE_POS_MASK);
+	} while (__atomic_compare_exchange_n(state, &st, nst, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED) == 0);
+
+	(void)librtt_copyToRing(dstBuf, sz, pos, (const unsigned char *)rec, len);
+	performCacheOp(librtt_common.cleanFn, dstBuf, sz, pos, len);
+
+	st = __atomic_sub_fetch(state, LIBRTT_TRACE_ONE, __ATOMIC_ACQ_REL);
+	if ((st >> 24) != 0) {
+		/* Last writer to finish publishes */
+		return 0;
+	}
+
+	pos = st & (sz - 1);
+	cur = rtt->channel[ch].wr;
+	for (;;) {
+		/* Don't move wr backwards if a later writer has already published */
+		now = *state & (sz - 1);
+		if ((cur == pos) || (((now - pos) & (sz - 1)) > ((now - cur) & (sz - 1)))) {
+			break;
+		}
+
+		if (__atomic_compare_exchange_n(&rtt->channel[ch].wr, &cur, pos, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED) != 0) {
+			break;
+		}
+	}
+
+	return 0;
+}
+
+
+int librtt_trace(unsigned int ch, uint16_t id, unsigned int flags, uint32_t ts, unsigned int nargs, const uint32_t *args)
+{
+	uint32_t rec[2 + LIBRTT_TRACE_MAXARGS];
+	uint32_t lost;
+	unsigned int n;
+
+	if (librtt_checkTx(ch) < 0) {
+		return -ENODEV;
+	}
+
+	if (nargs > LIBRTT_TRACE_MAXARGS) {
+		return -EINVAL;
+	}
+
+	/* Report lost records first, so the decoder knows where the gap is */
+	lost = __atomic_exchange_n(&librtt_common.trace[ch].pending, 0, __ATOMIC_ACQ_REL);
+	if (lost != 0) {
+		rec[0] = LIBRTT_TRACE_ID_DROP | (1U << 16) | ((flags & 0x1f) << 19);
+		rec[1] = ts;
+		rec[2] = lost;
+		if (librtt_traceWrite(ch, rec, 3 * sizeof(uint32_t)) < 0) {
+			__atomic_add_fetch(&librtt_common.trace[ch].pending, lost + 1, __ATOMIC_RELAXED);
+			__atomic_add_fetch(&librtt_common.trace[ch].dropped, 1, __ATOMIC_RELAXED);
+			return -ENOSPC;
+		}
+	}
+
+	rec[0] = id | (nargs << 16) | ((flags & 0x1f) << 19);
+	rec[1] = ts;
+	for (n = 0; n < nargs; n++) {
+		rec[2 + n] = args[n];
+	}
+
+	if (librtt_traceWrite(ch, rec, (2 + nargs) * sizeof(uint32_t)) < 0) {
+		__atomic_add_fetch(&librtt_common.trace[ch].pending, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&librtt_common.trace[ch].dropped, 1, __ATOMIC_RELAXED);
+		return -ENOSPC;
+	}
+
+	return 0;
+}
+
+
+unsigned int librtt_traceDropped(unsigned int ch)
+{
+	if (librtt_checkTx(ch) < 0) {
+		return 0;
+	}
+
+	return librtt_common.trace[ch].dropped;
+}
+
+
 int librtt_txCheckReaderAttached(unsigned int ch)
 {
 	if (librtt_checkTx(ch) < 0) {
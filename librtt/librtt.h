@@ -14,7 +14,9 @@
 #ifndef LIBRTT_H
 #define LIBRTT_H
 
+#include <stdint.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 /* Size of the common descriptor for RTT channels */
 #define LIBRTT_DESC_SIZE 256
@@ -54,6 +56,10 @@ ssize_t librtt_read(unsigned int ch, void *buf, size_t count);
 ssize_t librtt_write(unsigned int ch, const void *buf, size_t count, int allowOverwrite);
 
 
+/* Non-blocking gathered write to channel, all buffers are published at once */
+ssize_t librtt_writev(unsigned int ch, const struct iovec *iov, int iovcnt, int allowOverwrite);
+
+
 /* Check for available data in rx */
 ssize_t librtt_rxAvail(unsigned int ch);
 
@@ -74,4 +80,32 @@ void librtt_rxReset(unsigned int ch);
 void librtt_txReset(unsigned int ch);
 
 
+/*
+ * Binary trace records, little endian 32-bit words:
+ * word 0: id[15:0] | nargs[18:16] | flags[23:19]
+ * word 1: timestamp
+ * word 2..: args
+ */
+
+#define LIBRTT_TRACE_MAXARGS 4
+
+/* Record written from interrupt context */
+#define LIBRTT_TRACE_IRQ (1U << 0)
+
+/* Emitted after records were lost, arg 0 holds their number */
+#define LIBRTT_TRACE_ID_DROP 0xffffU
+
+
+/* Prepare TX channel for trace records, it mustn't be used by other write functions afterwards */
+int librtt_traceInit(unsigned int ch);
+
+
+/* Lock-free record write, safe from interrupts and multiple threads, drops the record if the channel is full */
+int librtt_trace(unsigned int ch, uint16_t id, unsigned int flags, uint32_t ts, unsigned int nargs, const uint32_t *args);
+
+
+/* Number of records lost since the channel was initialized */
+unsigned int librtt_traceDropped(unsigned int ch);
+
+
 #endif /* end of LIBRTT_H */
@@ -0,0 +1,98 @@
+#!/usr/bin/env python3
+#
+# Phoenix-RTOS
+#
+# Decoder of librtt binary trace records
+#
+# Reads the raw channel stream from a file or an RTT TCP server
+# (e.g. openocd "rtt server start <port> <channel>") and prints one line per record.
+#
+# Copyright 2024 Phoenix Systems
+#
+# This file is part of Phoenix-RTOS.
+#
+# %LICENSE%
+#
+
+import argparse
+import socket
+import struct
+import sys
+
+TRACE_IRQ = 1 << 0
+TRACE_ID_DROP = 0xFFFF
+
+# Default names match multi/imxrt-multi/trace.h
+EVENTS = {
+    1: "irq",
+    2: "uart_irq",
+    3: "spi_xfer",
+    4: "spi_dma",
+    TRACE_ID_DROP: "DROPPED",
+}
+
+
+def stream(args):
+    if args.connect:
+        host, port = args.connect.rsplit(":", 1)
+        sock = socket.create_connection((host, int(port)))
+        while True:
+            data = sock.recv(4096)
+            if not data:
+                return
+            yield data
+    else:
+        f = sys.stdin.buffer if args.file == "-" else open(args.file, "rb")
+        while True:
+            data = f.read(4096)
+            if not data:
+                return
+            yield data
+
+
+def decode(chunks, events):
+    buf = b""
+    ts = 0
+    for chunk in chunks:
+        buf += chunk
+        while len(buf) >= 8:
+            hdr, stamp = struct.unpack_from("<II", buf)
+            nargs = (hdr >> 16) & 0x7
+            size = 8 + 4 * nargs
+            if len(buf) < size:
+                break
+
+            ev = hdr & 0xFFFF
+            flags = (hdr >> 19) & 0x1F
+            argv = struct.unpack_from("<%dI" % nargs, buf, 8)
+            buf = buf[size:]
+
+            # Interrupt records are not timestamped, they happened after the preceding one
+            if (flags & TRACE_IRQ) == 0:
+                ts = stamp
+
+            name = events.get(ev, "ev%d" % ev)
+            ctx = "irq" if (flags & TRACE_IRQ) else "thr"
+            print("%12.6f %s %-10s %s" % (ts / 1e6, ctx, name, " ".join("0x%x" % a for a in argv)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode librtt binary trace records")
+    parser.add_argument("file", nargs="?", default="-", help="raw channel dump, '-' for stdin")
+    parser.add_argument("-c", "--connect", metavar="HOST:PORT", help="read from RTT TCP server")
+    parser.add_argument("-e", "--event", action="append", default=[], metavar="ID=NAME", help="additional event name")
+    args = parser.parse_args()
+
+    events = dict(EVENTS)
+    for e in args.event:
+        ev, name = e.split("=", 1)
+        events[int(ev, 0)] = name
+
+    try:
+        decode(stream(args), events)
+    except (KeyboardInterrupt, BrokenPipeError):
+        pass
+
+
+if __name__ == "__main__":
+    main()
@@ -18,6 +18,8 @@
 #include <sys/platform.h>
 #include <sys/types.h>
 #include <sys/threads.h>
+#include <sys/time.h>
+#include <unistd.h>
 #include <posix/utils.h>
 
 #include <phoenix/arch/sparcv8leon/sparcv8leon.h>
@@ -27,6 +29,13 @@
 
 #define ADC_DEFAULT_SR (200 * 1000) /* 200 kSps */
 
+/* Sampling mode ring of samples filled by the interrupt, power of 2 */
+#ifndef ADC_RING_SIZE
+#define ADC_RING_SIZE 256
+#endif
+
+#define ADC_PERIOD_MIN 50 /* us */
+
 /* ADC registers */
 #define ADC_CTRL      0  /* Control register : 0x00 */
 #define ADC_SAMP_CTRL 1  /* Sampling control register : 0x04 */
@@ -61,6 +70,17 @@ typedef struct {
 	handle_t mutex;
 	handle_t irqLock;
 	handle_t cond;
+
+	/* Sampling mode */
+	volatile uint32_t period; /* 0 - stopped */
+	volatile time_t trigTime;
+	volatile unsigned int head;
+	volatile unsigned int tail;
+	uint32_t seq;
+	handle_t startCond;
+	int sampler;
+	adc_sample_t ring[ADC_RING_SIZE];
+	char stack[1024] __attribute__((aligned(8)));
 } adc_dev_t;
 
 
@@ -88,12 +108,26 @@ static struct {
 static int adc_irqHandler(unsigned int n, void *arg)
 {
 	int dev = (int)arg;
-	volatile uint32_t *adc_base = adc_common.adc[dev].vbase;
+	adc_dev_t *adc = &adc_common.adc[dev];
+	volatile uint32_t *adc_base = adc->vbase;
 
 	(void)n;
 
 	if ((*(adc_base + ADC_IRQ) & ADC_IRQ_CONV_END) != 0) {
 		*(adc_base + ADC_IRQ) = ADC_IRQ_CONV_END;
+
+		if (adc->period != 0) {
+			/* Sample is lost (seq gap) when the ring is full */
+			if ((adc->head - adc->tail) < ADC_RING_SIZE) {
+				adc_sample_t *sample = &adc->ring[adc->head & (ADC_RING_SIZE - 1)];
+				sample->timestamp = adc->trigTime;
+				sample->value = *(adc_base + ADC_STATUS) & ADC_STS_VAL;
+				sample->seq = adc->seq;
+				adc->head++;
+			}
+			adc->seq++;
+		}
+
 		return 1;
 	}
 
@@ -101,12 +135,133 @@ static int adc_irqHandler(unsigned int n, void *arg)
 }
 
 
-static void adc_convert(int dev, uint32_t *value)
+/* Triggers conversions every period, results are collected by adc_irqHandler */
+static void adc_samplerThread(void *arg)
+{
+	adc_dev_t *adc = (adc_dev_t *)arg;
+	time_t now, next;
+
+	mutexLock(adc->mutex);
+	for (;;) {
+		while (adc->period == 0) {
+			condWait(adc->startCond, adc->mutex, 0);
+		}
+
+		gettime(&next, NULL);
+		while (adc->period != 0) {
+			gettime(&now, NULL);
+			adc->trigTime = now;
+			*(adc->vbase + ADC_CTRL) |= ADC_CONV_START;
+
+			next += adc->period;
+			if (next <= now) {
+				/* Missed trigger time, resynchronize */
+				next = now + adc->period;
+			}
+
+			mutexUnlock(adc->mutex);
+			usleep(next - now);
+			mutexLock(adc->mutex);
+		}
+	}
+}
+
+
+static int adc_samplingStart(int dev, uint32_t period)
+{
+	adc_dev_t *adc = &adc_common.adc[dev];
+	int err = EOK;
+
+	if (period < ADC_PERIOD_MIN) {
+		return -EINVAL;
+	}
+
+	mutexLock(adc->mutex);
+
+	if (adc->sampler == 0) {
+		if (beginthread(adc_samplerThread, 2, adc->stack, sizeof(adc->stack), adc) < 0) {
+			err = -ENOMEM;
+		}
+		else {
+			adc->sampler = 1;
+		}
+	}
+
+	if (err == EOK) {
+		if (adc->period == 0) {
+			mutexLock(adc->irqLock);
+			adc->head = 0;
+			adc->tail = 0;
+			adc->seq = 0;
+			mutexUnlock(adc->irqLock);
+		}
+		adc->period = period;
+		condSignal(adc->startCond);
+	}
+
+	mutexUnlock(adc->mutex);
+
+	return err;
+}
+
+
+static void adc_samplingStop(int dev)
+{
+	adc_dev_t *adc = &adc_common.adc[dev];
+
+	mutexLock(adc->mutex);
+	adc->period = 0;
+	mutexUnlock(adc->mutex);
+
+	/* Wake up readers waiting for samples */
+	mutexLock(adc->irqLock);
+	condBroadcast(adc->cond);
+	mutexUnlock(adc->irqLock);
+}
+
+
+/* Returns nSamples samples, less only if sampling is stopped */
+static int adc_readSamples(int dev, adc_sample_t *buf, size_t size, uint32_t nSamples)
+{
+	adc_dev_t *adc = &adc_common.adc[dev];
+	unsigned int i, cnt;
+
+	if ((buf == NULL) || (nSamples > (size / sizeof(adc_sample_t))) || (nSamples > ADC_RING_SIZE)) {
+		return -EINVAL;
+	}
+
+	mutexLock(adc->irqLock);
+	while (((adc->head - adc->tail) < nSamples) && (adc->period != 0)) {
+		condWait(adc->cond, adc->irqLock, 0);
+	}
+
+	cnt = adc->head - adc->tail;
+	if (cnt > nSamples) {
+		cnt = nSamples;
+	}
+
+	for (i = 0; i < cnt; i++) {
+		buf[i] = adc->ring[(adc->tail + i) & (ADC_RING_SIZE - 1)];
+	}
+	adc->tail += cnt;
+	mutexUnlock(adc->irqLock);
+
+	return cnt;
+}
+
+
+static int adc_convert(int dev, uint32_t *value)
 {
 	volatile uint32_t *adc_base = adc_common.adc[dev].vbase;
 
 	mutexLock(adc_common.adc[dev].mutex);
 
+	if (adc_common.adc[dev].period != 0) {
+		/* Sampling mode takes over conversions */
+		mutexUnlock(adc_common.adc[dev].mutex);
+		return -EBUSY;
+	}
+
 	/* Start conversion */
 	*(adc_base + ADC_CTRL) |= ADC_CONV_START;
 
@@ -120,6 +275,8 @@ static void adc_convert(int dev, uint32_t *value)
 	*value = *(adc_base + ADC_STATUS) & ADC_STS_VAL;
 
 	mutexUnlock(adc_common.adc[dev].mutex);
+
+	return EOK;
 }
 
 
@@ -154,6 +311,19 @@ static void adc_handleDevCtl(msg_t *msg, int dev)
 			msg->o.err = EOK;
 			break;
 
+		case adc_start:
+			msg->o.err = adc_samplingStart(dev, idevctl->adc.start.period);
+			break;
+
+		case adc_stop:
+			adc_samplingStop(dev);
+			msg->o.err = EOK;
+			break;
+
+		case adc_read:
+			msg->o.err = adc_readSamples(dev, msg->o.data, msg->o.size, idevctl->adc.read.nSamples);
+			break;
+
 		default:
 			msg->o.err = -EINVAL;
 			break;
@@ -201,8 +371,7 @@ void adc_handleMsg(msg_t *msg, int dev)
 				msg->o.err = -EINVAL;
 				break;
 			}
-			adc_convert(dev, (uint32_t *)msg->o.data);
-			msg->o.err = EOK;
+			msg->o.err = adc_convert(dev, (uint32_t *)msg->o.data);
 			break;
 
 		case mtDevCtl:
@@ -300,6 +469,14 @@ int adc_init(void)
 			return -1;
 		}
 
+		if (condCreate(&adc_common.adc[i].startCond) < 0) {
+			munmap((void *)adc_common.adc[i].vbase, _PAGE_SIZE);
+			resourceDestroy(adc_common.adc[i].cond);
+			resourceDestroy(adc_common.adc[i].mutex);
+			resourceDestroy(adc_common.adc[i].irqLock);
+			return -1;
+		}
+
 		adc_common.adc[i].vbase += ((uintptr_t)adc_info[i].base - base) / sizeof(uintptr_t);
 
 		adc_configure(i, &defaultConf);
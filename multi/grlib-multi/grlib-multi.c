@@ -398,12 +398,15 @@ int main(void)
 		return EXIT_FAILURE;
 	}
 
-	libklog_init(uart_klogClbk);
+	libklog_initNb(uart_klogClbk);
 	oid_t kmsgctrl = { .port = oid.port, .id = id_kmsgctrl };
 	libklog_ctrlRegister(&kmsgctrl);
 
 #if PSEUDODEV
-	pseudo_init();
+	if (pseudo_init() < 0) {
+		multi_cleanup("Failed to initialize pseudo devices\n");
+		return EXIT_FAILURE;
+	}
 #endif
 
 	if (multi_createDevs() < 0) {
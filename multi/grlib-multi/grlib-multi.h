@@ -119,13 +119,27 @@ typedef struct {
 } adc_config_t;
 
 
+/* Sample returned by adc_read, seq gaps mean samples lost on ring overrun */
+typedef struct {
+	uint64_t timestamp; /* us, time of the conversion start */
+	uint32_t value;
+	uint32_t seq;
+} adc_sample_t;
+
+
 typedef struct {
 	/* clang-format off */
-	enum { adc_config = 0 } type;
+	enum { adc_config = 0, adc_start, adc_stop, adc_read } type;
 	/* clang-format on */
 
 	union {
 		adc_config_t config;
+		struct {
+			uint32_t period; /* sampling period in us */
+		} start;
+		struct {
+			uint32_t nSamples; /* blocks until available, adc_sample_t written to o.data */
+		} read;
 	};
 } adc_t;
 
@@ -135,6 +149,12 @@ typedef struct {
 #define SPW_RX_MIN_BUFSZ 4
 #define SPW_TX_MIN_BUFSZ 8
 
+/* Lent RX packets (spw_rxLend), client maps SPW_RX_POOL_CNT * SPW_RX_POOL_BUFSZ bytes
+ * of uncached physical memory at the address returned by spw_rxMap */
+#define SPW_RX_LEND_BUFSZ 8
+#define SPW_RX_POOL_BUFSZ 1024
+#define SPW_RX_POOL_CNT   128
+
 /* DMA configuration */
 #define SPW_DMA_CFG_LE  (1 << 16) /* Disable TX when link error occurs */
 #define SPW_DMA_CFG_SP  (1 << 15) /* Remove 2nd (and 1st) byte (protocol id) of each packet */
@@ -188,7 +208,7 @@ typedef struct {
 
 typedef struct {
 	/* clang-format off */
-	enum { spw_config = 0, spw_rxConfig, spw_rx, spw_tx } type;
+	enum { spw_config = 0, spw_rxConfig, spw_rx, spw_tx, spw_rxRing, spw_rxLend, spw_rxRelease, spw_rxMap } type;
 	/* clang-format on */
 	union {
 		spw_config_t config;
@@ -198,13 +218,13 @@ typedef struct {
 		struct {
 			size_t firstDesc;
 			size_t nPackets;
-		} rx;
+		} rx; /* also rxLend and rxRelease */
 		struct {
 			size_t nPackets;
 			bool async;
 		} tx;
 	} task;
-
+	unsigned int chan; /* DMA channel */
 } spw_t;
 
 
@@ -272,4 +292,20 @@ static inline size_t multi_spwDeserializeRxMsg(const uint8_t *buf, spw_rxPacket_
 }
 
 
+static inline size_t multi_spwDeserializeRxLend(const uint8_t *buf, uint8_t *pool, spw_rxPacket_t *packet)
+{
+	/* RX lend msg layout (single packet):
+	 * | flags (inc. dataLen)  | data offset in pool |
+	 * |        4 B            |         4 B         |
+	 */
+
+	uint32_t offs = (buf[4] << 24) | (buf[5] << 16) | (buf[6] << 8) | buf[7];
+
+	packet->flags = (buf[0] << 24) | (buf[1] << 16) | (buf[2] << 8) | buf[3];
+	packet->buf = pool + offs;
+
+	return SPW_RX_LEND_BUFSZ;
+}
+
+
 #endif
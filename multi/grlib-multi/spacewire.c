@@ -44,11 +44,14 @@
 #define SPW_CLK_DIV   3
 #define SPW_DST_KEY   4
 #define SPW_TIME      5
-#define DMA_CTRL      8
-#define DMA_RX_LEN    9
-#define DMA_TX_DESC   10
-#define DMA_RX_DESC   11
-#define DMA_ADDR      12
+
+/* GRSPW2 DMA channel registers, relative to SPW_DMA_BASE(n) */
+#define SPW_DMA_BASE(n) (8 + 8 * (n))
+#define DMA_CTRL        0
+#define DMA_RX_LEN      1
+#define DMA_TX_DESC     2
+#define DMA_RX_DESC     3
+#define DMA_ADDR        4
 
 /* SPW CTRL bits */
 #define SPW_CTRL_RA  (1u << 31) /* RMAP available */
@@ -93,11 +96,23 @@
 
 #define DMA_CTRL_USR_MSK (DMA_CTRL_LE | DMA_CTRL_SP | DMA_CTRL_SA | DMA_CTRL_ENA | DMA_CTRL_NS)
 
-#define SPW_RX_DESC_CNT 128
+#define SPW_RX_DESC_CNT SPW_RX_POOL_CNT
 #define SPW_TX_DESC_CNT 64
 
 /* Sensible maximum value */
-#define MAX_PACKET_LEN 1024
+#define MAX_PACKET_LEN SPW_RX_POOL_BUFSZ
+
+/* Number of DMA channels used (if implemented by the core), each has its own rings */
+#ifndef SPW_DMA_CHANNELS
+#define SPW_DMA_CHANNELS 1
+#endif
+
+#define SPW_DMA_CH_MAX 4
+
+/* TX interrupt is requested every N descriptors and for the last one of a request */
+#ifndef SPW_TX_IRQ_COALESCE
+#define SPW_TX_IRQ_COALESCE 8
+#endif
 
 
 /* RX descriptor ctrl bits:
@@ -164,29 +179,47 @@ typedef struct {
 
 
 typedef struct {
-	volatile uint32_t *vbase;
-	uint8_t addr;
+	volatile uint32_t *vbase; /* channel registers */
 	uint8_t txDescFree;
 
 	size_t sentDesc;
 	size_t lastTxDesc;
 	size_t nextRxDesc;
+	size_t txIrqCnt;
+
+	bool rxRing; /* descriptors are re-armed as soon as they are read or released */
 
 	bool txWaited[SPW_TX_DESC_CNT];
 	bool rxAcknowledged[SPW_RX_DESC_CNT];
+	bool rxLent[SPW_RX_DESC_CNT];
 
-	handle_t ctrlLock;
 	handle_t txLock;
 	handle_t txIrqLock;
 	handle_t rxLock;
 	handle_t rxConfLock;
-	handle_t cond;
+	handle_t cond; /* broadcast by spw_irqThread */
 	handle_t rxAckCond;
 
 	volatile uint8_t (*txBuff)[MAX_PACKET_LEN];
 	volatile uint8_t (*rxBuff)[MAX_PACKET_LEN];
 	volatile spw_txDesc_t *txDesc;
 	volatile spw_rxDesc_t *rxDesc;
+} spw_chan_t;
+
+
+typedef struct {
+	volatile uint32_t *vbase;
+	uint8_t addr;
+	unsigned int nch;
+	volatile int irqPending;
+
+	handle_t ctrlLock;
+	handle_t irqLock;
+	handle_t cond; /* signalled by the interrupt */
+
+	spw_chan_t chan[SPW_DMA_CH_MAX];
+
+	char stack[1024] __attribute__((aligned(8)));
 } spw_dev_t;
 
 
@@ -212,23 +245,24 @@ static struct {
 /* Auxiliary functions */
 
 
-static int spw_buffersAlloc(spw_dev_t *dev)
+static int spw_buffersAlloc(spw_chan_t *ch)
 {
 	size_t descSz = PAGE_ALIGN(sizeof(spw_txDesc_t) * SPW_TX_DESC_CNT + sizeof(spw_rxDesc_t) * SPW_RX_DESC_CNT);
-	dev->txDesc = mmap(NULL, descSz, PROT_READ | PROT_WRITE, MAP_UNCACHED | MAP_ANONYMOUS, -1, 0);
-	if (dev->txDesc == MAP_FAILED) {
+	ch->txDesc = mmap(NULL, descSz, PROT_READ | PROT_WRITE, MAP_UNCACHED | MAP_ANONYMOUS, -1, 0);
+	if (ch->txDesc == MAP_FAILED) {
 		return -ENOMEM;
 	}
 
-	dev->rxDesc = (void *)((addr_t)dev->txDesc + sizeof(spw_txDesc_t) * SPW_TX_DESC_CNT);
+	ch->rxDesc = (void *)((addr_t)ch->txDesc + sizeof(spw_txDesc_t) * SPW_TX_DESC_CNT);
 
-	dev->rxBuff = mmap(NULL, MAX_PACKET_LEN * SPW_RX_DESC_CNT, PROT_READ | PROT_WRITE, MAP_UNCACHED | MAP_ANONYMOUS, -1, 0);
-	if (dev->rxBuff == MAP_FAILED) {
+	/* Contiguous as it's lent to clients as a whole */
+	ch->rxBuff = mmap(NULL, MAX_PACKET_LEN * SPW_RX_DESC_CNT, PROT_READ | PROT_WRITE, MAP_UNCACHED | MAP_ANONYMOUS | MAP_CONTIGUOUS, -1, 0);
+	if (ch->rxBuff == MAP_FAILED) {
 		return -ENOMEM;
 	}
 
-	dev->txBuff = mmap(NULL, MAX_PACKET_LEN * SPW_TX_DESC_CNT, PROT_READ | PROT_WRITE, MAP_UNCACHED | MAP_ANONYMOUS, -1, 0);
-	if (dev->txBuff == MAP_FAILED) {
+	ch->txBuff = mmap(NULL, MAX_PACKET_LEN * SPW_TX_DESC_CNT, PROT_READ | PROT_WRITE, MAP_UNCACHED | MAP_ANONYMOUS, -1, 0);
+	if (ch->txBuff == MAP_FAILED) {
 		return -ENOMEM;
 	}
 
@@ -236,17 +270,17 @@ static int spw_buffersAlloc(spw_dev_t *dev)
 }
 
 
-static void spw_buffersFree(spw_dev_t *dev)
+static void spw_buffersFree(spw_chan_t *ch)
 {
-	if (dev->txBuff != MAP_FAILED) {
-		(void)munmap((void *)dev->txBuff, MAX_PACKET_LEN * SPW_TX_DESC_CNT);
+	if (ch->txBuff != MAP_FAILED) {
+		(void)munmap((void *)ch->txBuff, MAX_PACKET_LEN * SPW_TX_DESC_CNT);
 	}
-	if (dev->rxBuff != MAP_FAILED) {
-		(void)munmap((void *)dev->rxBuff, MAX_PACKET_LEN * SPW_RX_DESC_CNT);
+	if (ch->rxBuff != MAP_FAILED) {
+		(void)munmap((void *)ch->rxBuff, MAX_PACKET_LEN * SPW_RX_DESC_CNT);
 	}
-	if (dev->txDesc != MAP_FAILED) {
+	if (ch->txDesc != MAP_FAILED) {
 		size_t descSz = PAGE_ALIGN(sizeof(spw_txDesc_t) * SPW_TX_DESC_CNT + sizeof(spw_rxDesc_t) * SPW_RX_DESC_CNT);
-		(void)munmap((void *)dev->txDesc, descSz);
+		(void)munmap((void *)ch->txDesc, descSz);
 	}
 }
 
@@ -276,6 +310,53 @@ static size_t spw_rxPacketToMsg(const uint32_t flags, const size_t rxLen, const
 }
 
 
+static size_t spw_rxPacketToLendMsg(const uint32_t flags, const size_t desc, uint8_t *buf)
+{
+	uint32_t offs = desc * MAX_PACKET_LEN;
+
+	buf[0] = flags >> 24;
+	buf[1] = (flags >> 16) & 0xffu;
+	buf[2] = (flags >> 8) & 0xffu;
+	buf[3] = flags & 0xffu;
+	buf[4] = offs >> 24;
+	buf[5] = (offs >> 16) & 0xffu;
+	buf[6] = (offs >> 8) & 0xffu;
+	buf[7] = offs & 0xffu;
+
+	return SPW_RX_LEND_BUFSZ;
+}
+
+
+static uint32_t spw_txDescIrq(spw_chan_t *ch, bool last)
+{
+	if (last || (++ch->txIrqCnt >= SPW_TX_IRQ_COALESCE)) {
+		ch->txIrqCnt = 0;
+		return TX_DESC_IE;
+	}
+
+	return 0;
+}
+
+
+/* Has to be called with rxLock taken */
+static void spw_rxArm(spw_chan_t *ch, size_t idx)
+{
+	volatile spw_rxDesc_t *desc = &ch->rxDesc[idx];
+
+	/* Interrupt after each packet received */
+	desc->ctrl = RX_DESC_IE;
+	if (idx == SPW_RX_DESC_CNT - 1) {
+		/* Wrap around */
+		desc->ctrl |= RX_DESC_WR;
+	}
+
+	desc->addr = va2pa((void *)ch->rxBuff[idx]);
+
+	/* Everything is set up, enable descriptor */
+	desc->ctrl |= RX_DESC_EN;
+}
+
+
 /* Interrupt handling */
 
 
@@ -285,58 +366,91 @@ static int spw_irqHandler(unsigned int n, void *arg)
 
 	spw_dev_t *dev = (spw_dev_t *)arg;
 
-	/* TX IRQ */
-	while (dev->sentDesc != dev->lastTxDesc) {
-		if (dev->txDesc[dev->sentDesc].ctrl & TX_DESC_EN) {
-			/* Not sent yet */
-			break;
-		}
+	for (unsigned int i = 0; i < dev->nch; i++) {
+		spw_chan_t *ch = &dev->chan[i];
+
+		/* TX IRQ */
+		while (ch->sentDesc != ch->lastTxDesc) {
+			if (ch->txDesc[ch->sentDesc].ctrl & TX_DESC_EN) {
+				/* Not sent yet */
+				break;
+			}
 
-		dev->sentDesc = (dev->sentDesc + 1) % SPW_TX_DESC_CNT;
-		dev->txDescFree++;
+			ch->sentDesc = (ch->sentDesc + 1) % SPW_TX_DESC_CNT;
+			ch->txDescFree++;
+		}
 	}
 
 	/* For RX IRQ only cond in kernel is signalled */
+	dev->irqPending = 1;
 
 	return 1;
 }
 
 
+/* Wakes up waiters of all channels, they share one interrupt */
+static void spw_irqThread(void *arg)
+{
+	spw_dev_t *dev = (spw_dev_t *)arg;
+
+	(void)mutexLock(dev->irqLock);
+	for (;;) {
+		while (dev->irqPending == 0) {
+			(void)condWait(dev->cond, dev->irqLock, 0);
+		}
+		dev->irqPending = 0;
+		(void)mutexUnlock(dev->irqLock);
+
+		for (unsigned int i = 0; i < dev->nch; i++) {
+			spw_chan_t *ch = &dev->chan[i];
+
+			(void)mutexLock(ch->txIrqLock);
+			(void)condBroadcast(ch->cond);
+			(void)mutexUnlock(ch->txIrqLock);
+
+			(void)mutexLock(ch->rxLock);
+			(void)condBroadcast(ch->cond);
+			(void)mutexUnlock(ch->rxLock);
+		}
+
+		(void)mutexLock(dev->irqLock);
+	}
+}
+
+
 /* Operations on device */
 
 
 /* Blocks execution until all packets are transmitted. */
-static int spw_transmitWait(spw_dev_t *dev, const uint8_t *buf, const size_t nPackets)
+static int spw_transmitWait(spw_chan_t *ch, const uint8_t *buf, const size_t nPackets)
 {
 	if (nPackets > SPW_TX_DESC_CNT) {
 		return -EINVAL;
 	}
 
-	(void)mutexLock(dev->txLock);
+	(void)mutexLock(ch->txLock);
 
 	TRACE("nPackets: %d", nPackets);
 
 	/* Setup descriptors */
-	size_t firstDesc = dev->lastTxDesc;
-	const size_t lastDesc = (dev->lastTxDesc + nPackets) % SPW_TX_DESC_CNT;
-	bool wrapped = (lastDesc <= firstDesc);
+	size_t firstDesc = ch->lastTxDesc;
+	const size_t lastDesc = (ch->lastTxDesc + nPackets - 1) % SPW_TX_DESC_CNT;
 
 	for (size_t cnt = 0; cnt < nPackets; cnt++) {
-		(void)mutexLock(dev->txIrqLock);
-		while ((dev->txDescFree == 0) || dev->txWaited[dev->lastTxDesc]) {
+		(void)mutexLock(ch->txIrqLock);
+		while ((ch->txDescFree == 0) || ch->txWaited[ch->lastTxDesc]) {
 			/* Wait for free descriptor or for packet to be acknowledged */
-			(void)condWait(dev->cond, dev->txIrqLock, 0);
+			(void)condWait(ch->cond, ch->txIrqLock, 0);
 		}
-		dev->txDescFree--;
-		(void)mutexUnlock(dev->txIrqLock);
+		ch->txDescFree--;
+		(void)mutexUnlock(ch->txIrqLock);
 
-		volatile spw_txDesc_t *desc = &dev->txDesc[dev->lastTxDesc];
+		volatile spw_txDesc_t *desc = &ch->txDesc[ch->lastTxDesc];
 
 		spw_txPacket_t packet;
 		buf += spw_txMsgToPacket(buf, &packet);
-		/* Interrupt after each packet transmitted */
-		desc->ctrl = (packet.flags & TX_DESC_USR_MSK) | TX_DESC_IE;
-		if (dev->lastTxDesc == SPW_TX_DESC_CNT - 1) {
+		desc->ctrl = (packet.flags & TX_DESC_USR_MSK) | spw_txDescIrq(ch, cnt == nPackets - 1);
+		if (ch->lastTxDesc == SPW_TX_DESC_CNT - 1) {
 			/* Wrap around */
 			desc->ctrl |= TX_DESC_WR;
 		}
@@ -347,72 +461,67 @@ static int spw_transmitWait(spw_dev_t *dev, const uint8_t *buf, const size_t nPa
 		/* Everything is set up, enable descriptor */
 		desc->ctrl |= TX_DESC_EN;
 
-		dev->txWaited[dev->lastTxDesc] = true;
+		ch->txWaited[ch->lastTxDesc] = true;
 
 		/* Start transmission */
-		dev->vbase[DMA_CTRL] |= DMA_CTRL_TE;
+		ch->vbase[DMA_CTRL] |= DMA_CTRL_TE;
 
-		dev->lastTxDesc = (dev->lastTxDesc + 1) % SPW_TX_DESC_CNT;
+		ch->lastTxDesc = (ch->lastTxDesc + 1) % SPW_TX_DESC_CNT;
 	}
 
 	TRACE("Packets set up");
 
-	/* Wait for transmission to finish */
-	while ((firstDesc <= lastDesc) || wrapped) {
-		if ((dev->txDesc[firstDesc].ctrl & TX_DESC_EN) == 0) {
-			dev->txWaited[firstDesc] = false;
-			size_t next = (firstDesc + 1) % SPW_TX_DESC_CNT;
-			if ((next == 0) && wrapped) {
-				wrapped = false;
-			}
-			firstDesc = next;
-		}
-		else {
-			(void)mutexLock(dev->txIrqLock);
-			(void)condWait(dev->cond, dev->txIrqLock, 0);
-			(void)mutexUnlock(dev->txIrqLock);
-		}
+	/* Wait for transmission to finish - descriptors are processed in order,
+	 * the last one always has an interrupt requested */
+	(void)mutexLock(ch->txIrqLock);
+	while ((ch->txDesc[lastDesc].ctrl & TX_DESC_EN) != 0) {
+		(void)condWait(ch->cond, ch->txIrqLock, 0);
+	}
+	(void)mutexUnlock(ch->txIrqLock);
+
+	for (size_t cnt = 0; cnt < nPackets; cnt++) {
+		ch->txWaited[firstDesc] = false;
+		firstDesc = (firstDesc + 1) % SPW_TX_DESC_CNT;
 	}
 
 	TRACE("Packets sent");
 
-	(void)mutexUnlock(dev->txLock);
+	(void)mutexUnlock(ch->txLock);
 
 	return nPackets;
 }
 
 
 /* Starts transmission and returns */
-static int spw_transmitAsync(spw_dev_t *dev, const uint8_t *buf, const size_t nPackets)
+static int spw_transmitAsync(spw_chan_t *ch, const uint8_t *buf, const size_t nPackets)
 {
-	(void)mutexLock(dev->txLock);
+	(void)mutexLock(ch->txLock);
 
 	TRACE("nPackets: %d", nPackets);
 
 	/* Setup descriptors */
 	for (size_t cnt = 0; cnt < nPackets; cnt++) {
-		(void)mutexLock(dev->txIrqLock);
-		while ((dev->txDescFree == 0) || dev->txWaited[dev->lastTxDesc]) {
+		(void)mutexLock(ch->txIrqLock);
+		while ((ch->txDescFree == 0) || ch->txWaited[ch->lastTxDesc]) {
 			/* Wait for free descriptor or for packet to be acknowledged */
-			(void)condWait(dev->cond, dev->txIrqLock, 0);
+			(void)condWait(ch->cond, ch->txIrqLock, 0);
 		}
-		dev->txDescFree--;
-		(void)mutexUnlock(dev->txIrqLock);
+		ch->txDescFree--;
+		(void)mutexUnlock(ch->txIrqLock);
 
-		volatile spw_txDesc_t *desc = &dev->txDesc[dev->lastTxDesc];
+		volatile spw_txDesc_t *desc = &ch->txDesc[ch->lastTxDesc];
 
 		spw_txPacket_t packet;
 		buf += spw_txMsgToPacket(buf, &packet);
-		/* Interrupt after each packet transmitted */
-		desc->ctrl = (packet.flags & TX_DESC_USR_MSK) | TX_DESC_IE;
-		if (dev->lastTxDesc == SPW_TX_DESC_CNT - 1) {
+		desc->ctrl = (packet.flags & TX_DESC_USR_MSK) | spw_txDescIrq(ch, cnt == nPackets - 1);
+		if (ch->lastTxDesc == SPW_TX_DESC_CNT - 1) {
 			/* Wrap around */
 			desc->ctrl |= TX_DESC_WR;
 		}
 		desc->packetLen = packet.dataLen;
 
 		uint8_t hdrLen = packet.flags & TX_DESC_HDR_LEN;
-		volatile void *txBuff = dev->txBuff[dev->lastTxDesc];
+		volatile void *txBuff = ch->txBuff[ch->lastTxDesc];
 
 		memcpy((char *)txBuff, packet.hdr, hdrLen);
 		memcpy((char *)txBuff + hdrLen, packet.data, packet.dataLen);
@@ -423,23 +532,23 @@ static int spw_transmitAsync(spw_dev_t *dev, const uint8_t *buf, const size_t nP
 		/* Everything is set up, enable descriptor */
 		desc->ctrl |= TX_DESC_EN;
 
-		dev->txWaited[dev->lastTxDesc] = false;
+		ch->txWaited[ch->lastTxDesc] = false;
 
 		/* Start transmission */
-		dev->vbase[DMA_CTRL] |= DMA_CTRL_TE;
+		ch->vbase[DMA_CTRL] |= DMA_CTRL_TE;
 
-		dev->lastTxDesc = (dev->lastTxDesc + 1) % SPW_TX_DESC_CNT;
+		ch->lastTxDesc = (ch->lastTxDesc + 1) % SPW_TX_DESC_CNT;
 	}
 
 	TRACE("Packets set up");
 
-	(void)mutexUnlock(dev->txLock);
+	(void)mutexUnlock(ch->txLock);
 
 	return nPackets;
 }
 
 
-static int spw_transmit(spw_dev_t *dev, const uint8_t *buf, const size_t bufsz, const size_t nPackets, bool async)
+static int spw_transmit(spw_chan_t *ch, const uint8_t *buf, const size_t bufsz, const size_t nPackets, bool async)
 {
 	if ((buf == NULL) || (bufsz < SPW_TX_MIN_BUFSZ)) {
 		return -EINVAL;
@@ -449,60 +558,107 @@ static int spw_transmit(spw_dev_t *dev, const uint8_t *buf, const size_t bufsz,
 		return 0;
 	}
 
-	return async ? spw_transmitAsync(dev, buf, nPackets) : spw_transmitWait(dev, buf, nPackets);
+	return async ? spw_transmitAsync(ch, buf, nPackets) : spw_transmitWait(ch, buf, nPackets);
 }
 
 
 /* Configure RX DMA descriptors */
-static int spw_rxConfigure(spw_dev_t *dev, size_t *firstDesc, const size_t nPackets)
+static int spw_rxConfigure(spw_chan_t *ch, size_t *firstDesc, const size_t nPackets)
 {
 	if (nPackets > SPW_RX_DESC_CNT) {
 		return -EINVAL;
 	}
 
-	(void)mutexLock2(dev->rxConfLock, dev->rxLock);
+	(void)mutexLock2(ch->rxConfLock, ch->rxLock);
+
+	if (ch->rxRing) {
+		/* All descriptors are owned by the ring */
+		(void)mutexUnlock(ch->rxLock);
+		(void)mutexUnlock(ch->rxConfLock);
+		return -EBUSY;
+	}
 
 	TRACE("nPackets: %d", nPackets);
 
 	for (size_t cnt = 0; cnt < nPackets; cnt++) {
-		while (!dev->rxAcknowledged[dev->nextRxDesc]) {
-			(void)condWait(dev->rxAckCond, dev->rxLock, 0);
+		while (!ch->rxAcknowledged[ch->nextRxDesc]) {
+			(void)condWait(ch->rxAckCond, ch->rxLock, 0);
 		}
 
-		dev->rxAcknowledged[dev->nextRxDesc] = false;
+		ch->rxAcknowledged[ch->nextRxDesc] = false;
 
-		volatile spw_rxDesc_t *desc = &dev->rxDesc[dev->nextRxDesc];
+		memset((void *)ch->rxBuff[ch->nextRxDesc], 0, sizeof(ch->rxBuff[ch->nextRxDesc]));
+		spw_rxArm(ch, ch->nextRxDesc);
 
-		/* Interrupt after each packet received */
-		desc->ctrl = RX_DESC_IE;
-		if (dev->nextRxDesc == SPW_RX_DESC_CNT - 1) {
-			/* Wrap around */
-			desc->ctrl |= RX_DESC_WR;
-		}
+		ch->nextRxDesc = (ch->nextRxDesc + 1) % SPW_RX_DESC_CNT;
+	}
 
-		memset((void *)dev->rxBuff[dev->nextRxDesc], 0, sizeof(dev->rxBuff[dev->nextRxDesc]));
-		desc->addr = va2pa((void *)dev->rxBuff[dev->nextRxDesc]);
+	*firstDesc = (ch->nextRxDesc + SPW_RX_DESC_CNT - nPackets) % SPW_RX_DESC_CNT;
 
-		/* Everything is set up, enable descriptor */
-		desc->ctrl |= RX_DESC_EN;
+	/* Enable receiver */
+	ch->vbase[DMA_CTRL] |= (DMA_CTRL_RE | DMA_CTRL_RD);
+
+	(void)mutexUnlock(ch->rxLock);
+	(void)mutexUnlock(ch->rxConfLock);
 
-		dev->nextRxDesc = (dev->nextRxDesc + 1) % SPW_RX_DESC_CNT;
+	return nPackets;
+}
+
+
+/* Arm all descriptors once, packets are then read (or lent) and released continuously */
+static int spw_rxRingStart(spw_chan_t *ch, size_t *firstDesc)
+{
+	int err = spw_rxConfigure(ch, firstDesc, SPW_RX_DESC_CNT);
+
+	if (err >= 0) {
+		(void)mutexLock(ch->rxLock);
+		ch->rxRing = true;
+		(void)mutexUnlock(ch->rxLock);
 	}
 
-	*firstDesc = (dev->nextRxDesc + SPW_RX_DESC_CNT - nPackets) % SPW_RX_DESC_CNT;
+	return err;
+}
 
-	/* Enable receiver */
-	dev->vbase[DMA_CTRL] |= (DMA_CTRL_RE | DMA_CTRL_RD);
 
-	(void)mutexUnlock(dev->rxLock);
-	(void)mutexUnlock(dev->rxConfLock);
+/* Has to be called with rxLock taken */
+static void spw_rxDone(spw_chan_t *ch, size_t idx)
+{
+	if (ch->rxRing) {
+		spw_rxArm(ch, idx);
+		ch->vbase[DMA_CTRL] |= (DMA_CTRL_RE | DMA_CTRL_RD);
+	}
+	else {
+		ch->rxAcknowledged[idx] = true;
+		condSignal(ch->rxAckCond);
+	}
+}
+
+
+/* Return lent RX buffers */
+static int spw_rxReturn(spw_chan_t *ch, size_t firstDesc, const size_t nPackets)
+{
+	if ((nPackets > SPW_RX_DESC_CNT) || (firstDesc >= SPW_RX_DESC_CNT)) {
+		return -EINVAL;
+	}
+
+	(void)mutexLock(ch->rxLock);
+
+	for (size_t cnt = 0; cnt < nPackets; cnt++) {
+		if (ch->rxLent[firstDesc]) {
+			ch->rxLent[firstDesc] = false;
+			spw_rxDone(ch, firstDesc);
+		}
+		firstDesc = (firstDesc + 1) % SPW_RX_DESC_CNT;
+	}
+
+	(void)mutexUnlock(ch->rxLock);
 
 	return nPackets;
 }
 
 
-/* Read from RX buffers */
-static int spw_rxRead(spw_dev_t *dev, size_t firstDesc, uint8_t *buf, size_t bufsz, const size_t nPackets)
+/* Read from RX buffers, lent packets are left in place until spw_rxRelease */
+static int spw_rxRead(spw_chan_t *ch, size_t firstDesc, uint8_t *buf, size_t bufsz, const size_t nPackets, bool lend)
 {
 	if (nPackets > SPW_RX_DESC_CNT) {
 		return -EINVAL;
@@ -514,19 +670,25 @@ static int spw_rxRead(spw_dev_t *dev, size_t firstDesc, uint8_t *buf, size_t buf
 
 	TRACE("first: %u last: %u nPackets: %u", firstDesc, lastDesc, nPackets);
 
-	(void)mutexLock(dev->rxLock);
+	(void)mutexLock(ch->rxLock);
 
 	while ((firstDesc < lastDesc) || wrapped) {
-		if ((dev->rxDesc[firstDesc].ctrl & RX_DESC_EN) == 0) {
-			uint32_t flags = dev->rxDesc[firstDesc].ctrl & RX_DESC_USR_MSK;
-			size_t rxLen = flags & RX_DESC_LEN;
-			if ((rxLen + SPW_RX_MIN_BUFSZ) > bufsz) {
+		if ((ch->rxDesc[firstDesc].ctrl & RX_DESC_EN) == 0) {
+			uint32_t flags = ch->rxDesc[firstDesc].ctrl & RX_DESC_USR_MSK;
+			size_t rxLen = lend ? SPW_RX_LEND_BUFSZ : ((flags & RX_DESC_LEN) + SPW_RX_MIN_BUFSZ);
+			if (rxLen > bufsz) {
 				/* Buffer too small */
 				break;
 			}
-			/* Copy packet to user buffer */
-			rxLen = spw_rxPacketToMsg(flags, rxLen, (const uint8_t *)dev->rxBuff[firstDesc], buf);
-			dev->rxAcknowledged[firstDesc] = true;
+			if (lend) {
+				rxLen = spw_rxPacketToLendMsg(flags, firstDesc, buf);
+				ch->rxLent[firstDesc] = true;
+			}
+			else {
+				/* Copy packet to user buffer */
+				rxLen = spw_rxPacketToMsg(flags, flags & RX_DESC_LEN, (const uint8_t *)ch->rxBuff[firstDesc], buf);
+				spw_rxDone(ch, firstDesc);
+			}
 			size_t next = (firstDesc + 1) % SPW_RX_DESC_CNT;
 			if ((next == 0) && wrapped) {
 				wrapped = false;
@@ -535,26 +697,27 @@ static int spw_rxRead(spw_dev_t *dev, size_t firstDesc, uint8_t *buf, size_t buf
 			buf += rxLen;
 			bufsz -= rxLen;
 			cnt++;
-			condSignal(dev->rxAckCond);
 		}
 		else {
-			(void)condWait(dev->cond, dev->rxLock, 0);
+			(void)condWait(ch->cond, ch->rxLock, 0);
 		}
 	}
 
-	(void)mutexUnlock(dev->rxLock);
+	(void)mutexUnlock(ch->rxLock);
 
 	return cnt;
 }
 
 
-static int spw_configure(spw_dev_t *dev, const spw_config_t *config)
+/* Incoming packets go to the first channel matching their logical address:
+ * its own (with SPW_DMA_CFG_ENA) or the node address */
+static int spw_configure(spw_dev_t *dev, spw_chan_t *ch, const spw_config_t *config)
 {
 	(void)mutexLock(dev->ctrlLock);
 
 	dev->vbase[SPW_NODE_ADDR] = (config->node.mask << 8) | config->node.addr;
-	dev->vbase[DMA_ADDR] = (config->dma.mask << 8) | config->dma.addr;
-	dev->vbase[DMA_CTRL] = (dev->vbase[DMA_CTRL] & ~DMA_CTRL_USR_MSK) | (config->dma.flags & DMA_CTRL_USR_MSK);
+	ch->vbase[DMA_ADDR] = (config->dma.mask << 8) | config->dma.addr;
+	ch->vbase[DMA_CTRL] = (ch->vbase[DMA_CTRL] & ~DMA_CTRL_USR_MSK) | (config->dma.flags & DMA_CTRL_USR_MSK);
 
 	(void)mutexUnlock(dev->ctrlLock);
 
@@ -574,11 +737,18 @@ static void spw_handleDevCtl(msg_t *msg, int dev)
 
 	const multi_i_t *idevctl = (multi_i_t *)msg->i.raw;
 	multi_o_t *odevctl = (multi_o_t *)msg->o.raw;
-	spw_dev_t *spw = &spw_common.dev[dev];
+	spw_dev_t *spwdev = &spw_common.dev[dev];
+
+	if (idevctl->spw.chan >= spwdev->nch) {
+		msg->o.err = -EINVAL;
+		return;
+	}
+
+	spw_chan_t *spw = &spwdev->chan[idevctl->spw.chan];
 
 	switch (idevctl->spw.type) {
 		case spw_config:
-			msg->o.err = spw_configure(spw, &idevctl->spw.task.config);
+			msg->o.err = spw_configure(spwdev, spw, &idevctl->spw.task.config);
 			break;
 
 		case spw_rxConfig:
@@ -586,7 +756,24 @@ static void spw_handleDevCtl(msg_t *msg, int dev)
 			break;
 
 		case spw_rx:
-			msg->o.err = spw_rxRead(spw, idevctl->spw.task.rx.firstDesc, msg->o.data, msg->o.size, idevctl->spw.task.rx.nPackets);
+			msg->o.err = spw_rxRead(spw, idevctl->spw.task.rx.firstDesc, msg->o.data, msg->o.size, idevctl->spw.task.rx.nPackets, false);
+			break;
+
+		case spw_rxRing:
+			msg->o.err = spw_rxRingStart(spw, &odevctl->val);
+			break;
+
+		case spw_rxLend:
+			msg->o.err = spw_rxRead(spw, idevctl->spw.task.rx.firstDesc, msg->o.data, msg->o.size, idevctl->spw.task.rx.nPackets, true);
+			break;
+
+		case spw_rxRelease:
+			msg->o.err = spw_rxReturn(spw, idevctl->spw.task.rx.firstDesc, idevctl->spw.task.rx.nPackets);
+			break;
+
+		case spw_rxMap:
+			odevctl->val = va2pa((void *)spw->rxBuff);
+			msg->o.err = EOK;
 			break;
 
 		case spw_tx:
@@ -673,107 +860,164 @@ static int spw_cguInit(int dev)
 static void spw_defaultConfig(spw_dev_t *dev)
 {
 	dev->vbase[SPW_CTRL] |= SPW_CTRL_LS;
-	dev->vbase[DMA_CTRL] |= DMA_CTRL_RI | DMA_CTRL_TI;
-	dev->vbase[DMA_RX_LEN] = MAX_PACKET_LEN;
-	dev->vbase[DMA_TX_DESC] = va2pa((void *)dev->txDesc);
-	dev->vbase[DMA_RX_DESC] = va2pa((void *)dev->rxDesc);
+
+	for (unsigned int i = 0; i < dev->nch; i++) {
+		spw_chan_t *ch = &dev->chan[i];
+
+		ch->vbase[DMA_CTRL] |= DMA_CTRL_RI | DMA_CTRL_TI;
+		ch->vbase[DMA_RX_LEN] = MAX_PACKET_LEN;
+		ch->vbase[DMA_TX_DESC] = va2pa((void *)ch->txDesc);
+		ch->vbase[DMA_RX_DESC] = va2pa((void *)ch->rxDesc);
+	}
 }
 
 
-static int spw_createResources(spw_dev_t *dev, addr_t pbase)
+static void spw_chanReset(spw_chan_t *ch)
 {
-	dev->vbase = MAP_FAILED;
-	dev->ctrlLock = (handle_t)-1;
-	dev->txLock = (handle_t)-1;
-	dev->rxLock = (handle_t)-1;
-	dev->txIrqLock = (handle_t)-1;
-	dev->rxConfLock = (handle_t)-1;
-	dev->cond = (handle_t)-1;
-	dev->rxAckCond = (handle_t)-1;
+	ch->txLock = (handle_t)-1;
+	ch->rxLock = (handle_t)-1;
+	ch->txIrqLock = (handle_t)-1;
+	ch->rxConfLock = (handle_t)-1;
+	ch->cond = (handle_t)-1;
+	ch->rxAckCond = (handle_t)-1;
 	for (size_t i = 0; i < SPW_RX_DESC_CNT; i++) {
-		dev->rxAcknowledged[i] = true;
+		ch->rxAcknowledged[i] = true;
 	}
-	dev->rxBuff = MAP_FAILED;
-	dev->txBuff = MAP_FAILED;
-	dev->rxDesc = MAP_FAILED;
-	dev->txDesc = MAP_FAILED;
+	ch->rxBuff = MAP_FAILED;
+	ch->txBuff = MAP_FAILED;
+	ch->rxDesc = MAP_FAILED;
+	ch->txDesc = MAP_FAILED;
+	ch->txDescFree = SPW_TX_DESC_CNT;
+}
 
-	uintptr_t base = (pbase & ~(_PAGE_SIZE - 1));
-	dev->vbase = mmap(NULL, _PAGE_SIZE, PROT_WRITE | PROT_READ, MAP_DEVICE | MAP_PHYSMEM | MAP_ANONYMOUS, -1, (off_t)base);
-	if (dev->vbase == MAP_FAILED) {
+
+static int spw_chanCreateResources(spw_chan_t *ch)
+{
+	if (spw_buffersAlloc(ch) < 0) {
 		return -1;
 	}
 
-	if (spw_buffersAlloc(dev) < 0) {
+	if (mutexCreate(&ch->txLock) < 0) {
 		return -1;
 	}
 
-	if (mutexCreate(&dev->ctrlLock) < 0) {
+	if (mutexCreate(&ch->rxLock) < 0) {
 		return -1;
 	}
 
-	if (mutexCreate(&dev->txLock) < 0) {
+	if (mutexCreate(&ch->txIrqLock) < 0) {
 		return -1;
 	}
 
-	if (mutexCreate(&dev->rxLock) < 0) {
+	if (mutexCreate(&ch->rxConfLock) < 0) {
 		return -1;
 	}
 
-	if (mutexCreate(&dev->txIrqLock) < 0) {
+	if (condCreate(&ch->cond) < 0) {
 		return -1;
 	}
 
-	if (mutexCreate(&dev->rxConfLock) < 0) {
+	if (condCreate(&ch->rxAckCond) < 0) {
 		return -1;
 	}
 
-	if (condCreate(&dev->cond) < 0) {
+	return 0;
+}
+
+
+static void spw_chanCleanupResources(spw_chan_t *ch)
+{
+	if (ch->rxAckCond != (handle_t)-1) {
+		resourceDestroy(ch->rxAckCond);
+	}
+
+	if (ch->cond != (handle_t)-1) {
+		resourceDestroy(ch->cond);
+	}
+
+	if (ch->rxConfLock != (handle_t)-1) {
+		resourceDestroy(ch->rxConfLock);
+	}
+
+	if (ch->txIrqLock != (handle_t)-1) {
+		resourceDestroy(ch->txIrqLock);
+	}
+
+	if (ch->rxLock != (handle_t)-1) {
+		resourceDestroy(ch->rxLock);
+	}
+
+	if (ch->txLock != (handle_t)-1) {
+		resourceDestroy(ch->txLock);
+	}
+
+	spw_buffersFree(ch);
+}
+
+
+static int spw_createResources(spw_dev_t *dev, addr_t pbase)
+{
+	dev->vbase = MAP_FAILED;
+	dev->ctrlLock = (handle_t)-1;
+	dev->irqLock = (handle_t)-1;
+	dev->cond = (handle_t)-1;
+	dev->nch = 0;
+	for (unsigned int i = 0; i < SPW_DMA_CH_MAX; i++) {
+		spw_chanReset(&dev->chan[i]);
+	}
+
+	uintptr_t base = (pbase & ~(_PAGE_SIZE - 1));
+	dev->vbase = mmap(NULL, _PAGE_SIZE, PROT_WRITE | PROT_READ, MAP_DEVICE | MAP_PHYSMEM | MAP_ANONYMOUS, -1, (off_t)base);
+	if (dev->vbase == MAP_FAILED) {
 		return -1;
 	}
 
-	if (condCreate(&dev->rxAckCond) < 0) {
+	if (mutexCreate(&dev->ctrlLock) < 0) {
+		return -1;
+	}
+
+	if (mutexCreate(&dev->irqLock) < 0) {
+		return -1;
+	}
+
+	if (condCreate(&dev->cond) < 0) {
 		return -1;
 	}
 
 	dev->vbase += (pbase - base) / sizeof(uintptr_t);
 
+	/* Number of channels implemented by the core */
+	dev->nch = min(((dev->vbase[SPW_CTRL] & SPW_CTRL_NCH) >> 27) + 1, SPW_DMA_CHANNELS);
+
+	for (unsigned int i = 0; i < dev->nch; i++) {
+		dev->chan[i].vbase = dev->vbase + SPW_DMA_BASE(i);
+		if (spw_chanCreateResources(&dev->chan[i]) < 0) {
+			return -1;
+		}
+	}
+
 	return 0;
 }
 
 
 static void spw_cleanupResources(spw_dev_t *dev)
 {
-	if (dev->rxAckCond != (handle_t)-1) {
-		resourceDestroy(dev->rxAckCond);
+	for (unsigned int i = 0; i < SPW_DMA_CH_MAX; i++) {
+		spw_chanCleanupResources(&dev->chan[i]);
 	}
 
 	if (dev->cond != (handle_t)-1) {
 		resourceDestroy(dev->cond);
 	}
 
-	if (dev->rxConfLock != (handle_t)-1) {
-		resourceDestroy(dev->rxConfLock);
-	}
-
-	if (dev->txIrqLock != (handle_t)-1) {
-		resourceDestroy(dev->txIrqLock);
-	}
-
-	if (dev->rxLock != (handle_t)-1) {
-		resourceDestroy(dev->rxLock);
-	}
-
-	if (dev->txLock != (handle_t)-1) {
-		resourceDestroy(dev->txLock);
+	if (dev->irqLock != (handle_t)-1) {
+		resourceDestroy(dev->irqLock);
 	}
 
 	if (dev->ctrlLock != (handle_t)-1) {
 		resourceDestroy(dev->ctrlLock);
 	}
 
-	spw_buffersFree(dev);
-
 	if (dev->vbase != MAP_FAILED) {
 		(void)munmap((void *)dev->vbase, _PAGE_SIZE);
 	}
@@ -819,7 +1063,10 @@ int spw_init(void)
 			return -1;
 		}
 
-		spw_common.dev[i].txDescFree = SPW_TX_DESC_CNT;
+		if (beginthread(spw_irqThread, 2, spw_common.dev[i].stack, sizeof(spw_common.dev[i].stack), &spw_common.dev[i]) < 0) {
+			spw_cleanupResources(&spw_common.dev[i]);
+			return -1;
+		}
 
 		(void)interrupt(spw_info[i].irq, spw_irqHandler, &spw_common.dev[i], spw_common.dev[i].cond, NULL);
 
@@ -24,10 +24,40 @@
 
 #include <phoenix/arch/sparcv8leon/sparcv8leon.h>
 
+#include <grdmac2.h>
+
 #include "spi.h"
 #include "grlib-multi.h"
 
 
+#ifndef SPI0_DMA
+#define SPI0_DMA 0
+#endif
+
+#ifndef SPI1_DMA
+#define SPI1_DMA 0
+#endif
+
+/* GRDMAC2 instance shared by SPI devices */
+#ifndef SPI_DMA_INSTANCE
+#define SPI_DMA_INSTANCE 1
+#endif
+
+/* Transfers longer than this go through DMA (if enabled for the device) */
+#ifndef SPI_DMA_THRESHOLD
+#define SPI_DMA_THRESHOLD 64
+#endif
+
+#if (SPI0_DMA || SPI1_DMA) && (!defined(DMA_MAX_CNT) || (SPI_DMA_INSTANCE >= DMA_MAX_CNT))
+#error "Unsupported SPI DMA configuration"
+#endif
+
+/* Words staged per descriptor chain, fits one page with RX words */
+#define SPI_DMA_BATCH 256
+
+#define SPI_DMA_CHUNK_DESCR 6
+
+
 #define WORD_LEN 8u /* bits */
 
 #define SPI_IOMUX_OPT 0x7u
@@ -48,6 +78,7 @@
 #define SPI_MODE_MASTER  (1 << 25)
 
 /* Event register */
+#define SPI_EVENT_TIP   (1u << 31)
 #define SPI_EVENT_TX_NF (1 << 8)
 #define SPI_EVENT_RX_NE (1 << 9)
 #define SPI_EVENT_LAST  (1 << 14)
@@ -70,7 +101,22 @@ static struct {
 		handle_t irqLock;
 		handle_t cond;
 		handle_t inth;
+		int useDma;
 	} dev[SPI_CNT];
+
+	struct {
+		grdma_ctx_t *ctx;
+		struct {
+			uint32_t tx[SPI_DMA_BATCH];
+			uint32_t rx[SPI_DMA_BATCH];
+			uint32_t cmdLast;
+			uint32_t evtLast;
+		} *buf; /* uncached */
+		volatile int done;
+		handle_t lock;
+		handle_t cond;
+		handle_t inth;
+	} dma;
 } spi_common;
 
 
@@ -186,15 +232,147 @@ static void spi_rxByte(volatile uint32_t *spi_base, uint8_t endian, uint8_t *rxB
 }
 
 
-static int spi_xfer(int dev, uint8_t slavemsk, const uint8_t *txBuff, uint8_t *rxBuff, size_t len)
+/* Short transfers, keeps the FIFO full while draining RX */
+static void spi_pioXfer(int dev, const uint8_t *txBuff, uint8_t *rxBuff, size_t len)
 {
-	size_t txWords = 0, chunk = 0, wrote = 0;
+	size_t txWords = 0, rxWords = 0;
 	volatile uint32_t *spi_base = spi_common.dev[dev].vbase;
+	uint8_t byteOrder = spi_common.dev[dev].byteOrder;
 
-	(void)mutexLock(spi_common.dev[dev].mutex);
+	while (rxWords < len) {
+		while ((txWords < len) && ((txWords - rxWords) < spi_common.dev[dev].fifosz) &&
+				((*(spi_base + SPI_EVENT) & SPI_EVENT_TX_NF) != 0)) {
+			spi_txByte(spi_base, byteOrder, txBuff[txWords++]);
+		}
+
+		while ((rxWords < txWords) && ((*(spi_base + SPI_EVENT) & SPI_EVENT_RX_NE) != 0)) {
+			spi_rxByte(spi_base, byteOrder, &rxBuff[rxWords++]);
+		}
+	}
+}
+
+
+static void spi_dmaCallback(void *arg, uint32_t sts)
+{
+	(void)arg;
+	(void)sts;
+
+	spi_common.dma.done = 1;
+}
 
-	/* Set slave select */
-	*(spi_base + SPI_SLVSEL) = ~slavemsk;
+
+static void spi_dmaData(grdma_descr_t *descr, uint32_t ctrl, const volatile void *src, volatile void *dest, size_t size)
+{
+	descr->data.ctrl = GRDMA_DATA_EN | GRDMA_DESC_TYPE(0) | GRDMA_DATA_SZ(size) | ctrl;
+	descr->data.src = va2pa((void *)src);
+	descr->data.dest = va2pa((void *)dest);
+}
+
+
+/* Per FIFO sized chunk: TX words with LAST command before the final one,
+ * poll for the LAST event, clear it and read RX words */
+static int spi_dmaChunk(int dev, size_t pos, size_t cnt, bool last)
+{
+	volatile uint32_t *spi_base = spi_common.dev[dev].vbase;
+	grdma_ctx_t *ctx = spi_common.dma.ctx;
+	grdma_descr_t *descr[SPI_DMA_CHUNK_DESCR];
+	unsigned int n = 0, i;
+
+	for (i = 0; i < SPI_DMA_CHUNK_DESCR; i++) {
+		descr[i] = grdma_descrGet(ctx);
+		if (descr[i] == NULL) {
+			while (i > 0) {
+				grdma_descrPut(ctx, descr[--i]);
+			}
+			return -ENOMEM;
+		}
+	}
+
+	if (cnt > 1) {
+		spi_dmaData(descr[n++], GRDMA_DATA_DF, &spi_common.dma.buf->tx[pos], spi_base + SPI_TX, (cnt - 1) * sizeof(uint32_t));
+	}
+	spi_dmaData(descr[n++], GRDMA_DATA_SF | GRDMA_DATA_DF, &spi_common.dma.buf->cmdLast, spi_base + SPI_COMMAND, sizeof(uint32_t));
+	spi_dmaData(descr[n++], GRDMA_DATA_DF, &spi_common.dma.buf->tx[pos + cnt - 1], spi_base + SPI_TX, sizeof(uint32_t));
+
+	descr[n]->cond.ctrl = GRDMA_COND_EN | GRDMA_DESC_TYPE(1) | GRDMA_COND_INTRV(0xff) | GRDMA_COND_CNT(0xff);
+	descr[n]->cond.nextFail = va2pa((void *)descr[n]) & ~0x1;
+	descr[n]->cond.poll = va2pa((void *)(spi_base + SPI_EVENT));
+	descr[n]->cond.expData = SPI_EVENT_LAST;
+	descr[n]->cond.mask = SPI_EVENT_LAST;
+	n++;
+
+	spi_dmaData(descr[n++], GRDMA_DATA_SF | GRDMA_DATA_DF, &spi_common.dma.buf->evtLast, spi_base + SPI_EVENT, sizeof(uint32_t));
+	spi_dmaData(descr[n++], GRDMA_DATA_SF | (last ? GRDMA_DATA_IE : 0), spi_base + SPI_RX, &spi_common.dma.buf->rx[pos], cnt * sizeof(uint32_t));
+
+	for (i = 0; i < n; i++) {
+		(void)grdma_enqueue(ctx, descr[i], ((i == n - 1) && last) ? spi_dmaCallback : NULL, NULL);
+	}
+
+	while (i < SPI_DMA_CHUNK_DESCR) {
+		grdma_descrPut(ctx, descr[i++]);
+	}
+
+	return EOK;
+}
+
+
+static int spi_dmaXfer(int dev, const uint8_t *txBuff, uint8_t *rxBuff, size_t len)
+{
+	volatile uint32_t *spi_base = spi_common.dev[dev].vbase;
+	uint8_t byteOrder = spi_common.dev[dev].byteOrder;
+	size_t batch, pos, cnt, i;
+	int err = EOK;
+
+	(void)mutexLock(spi_common.dma.lock);
+
+	/* LAST event is polled by the DMA */
+	*(spi_base + SPI_MASK) = 0;
+
+	while ((len > 0) && (err == EOK)) {
+		batch = min(len, SPI_DMA_BATCH);
+
+		for (i = 0; i < batch; i++) {
+			spi_common.dma.buf->tx[i] = (byteOrder == spi_lsb) ? txBuff[i] : ((uint32_t)txBuff[i] << 24);
+		}
+
+		spi_common.dma.done = 0;
+		for (pos = 0; (pos < batch) && (err == EOK); pos += cnt) {
+			cnt = min(batch - pos, spi_common.dev[dev].fifosz);
+			err = spi_dmaChunk(dev, pos, cnt, (pos + cnt) == batch);
+		}
+
+		if (err < 0) {
+			/* Pool is sized for a whole batch, not expected */
+			break;
+		}
+
+		(void)grdma_reap(spi_common.dma.ctx);
+		while (spi_common.dma.done == 0) {
+			(void)condWait(spi_common.dma.cond, spi_common.dma.lock, 10 * 1000);
+			(void)grdma_reap(spi_common.dma.ctx);
+		}
+
+		for (i = 0; i < batch; i++) {
+			rxBuff[i] = (byteOrder == spi_lsb) ? ((spi_common.dma.buf->rx[i] >> 8) & 0xff) : ((spi_common.dma.buf->rx[i] >> 16) & 0xff);
+		}
+
+		txBuff += batch;
+		rxBuff += batch;
+		len -= batch;
+	}
+
+	*(spi_base + SPI_MASK) = SPI_MASK_LAST;
+
+	(void)mutexUnlock(spi_common.dma.lock);
+
+	return err;
+}
+
+
+static void spi_irqXfer(int dev, const uint8_t *txBuff, uint8_t *rxBuff, size_t len)
+{
+	size_t txWords = 0, chunk = 0, wrote = 0;
+	volatile uint32_t *spi_base = spi_common.dev[dev].vbase;
 
 	while (txWords < len) {
 		(void)mutexLock(spi_common.dev[dev].irqLock);
@@ -231,12 +409,35 @@ static int spi_xfer(int dev, uint8_t slavemsk, const uint8_t *txBuff, uint8_t *r
 			}
 		}
 	}
+}
+
+
+static int spi_xfer(int dev, uint8_t slavemsk, const uint8_t *txBuff, uint8_t *rxBuff, size_t len)
+{
+	volatile uint32_t *spi_base = spi_common.dev[dev].vbase;
+	int err = EOK;
+
+	(void)mutexLock(spi_common.dev[dev].mutex);
+
+	/* Set slave select */
+	*(spi_base + SPI_SLVSEL) = ~slavemsk;
+
+	if (len <= SPI_DMA_THRESHOLD) {
+		spi_pioXfer(dev, txBuff, rxBuff, len);
+	}
+	else if (spi_common.dev[dev].useDma != 0) {
+		err = spi_dmaXfer(dev, txBuff, rxBuff, len);
+	}
+	else {
+		spi_irqXfer(dev, txBuff, rxBuff, len);
+	}
+
 	/* Clear slave select */
 	*(spi_base + SPI_SLVSEL) = 0xfu;
 
 	(void)mutexUnlock(spi_common.dev[dev].mutex);
 
-	return 0;
+	return err;
 }
 
 
@@ -329,6 +530,65 @@ int spi_createDevs(oid_t *oid)
 }
 
 
+static int spi_dmaInit(void)
+{
+	static const int useDma[] = { SPI0_DMA, SPI1_DMA };
+	unsigned int i, fifosz = 0, chunks;
+
+	for (i = 0; i < SPI_CNT; i++) {
+		if ((i < (sizeof(useDma) / sizeof(useDma[0]))) && (useDma[i] != 0) && ((fifosz == 0) || (spi_common.dev[i].fifosz < fifosz))) {
+			fifosz = spi_common.dev[i].fifosz;
+		}
+	}
+
+	if (fifosz == 0) {
+		return 0;
+	}
+
+	spi_common.dma.buf = mmap(NULL, _PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_UNCACHED | MAP_ANONYMOUS | MAP_CONTIGUOUS, -1, 0);
+	if (spi_common.dma.buf == MAP_FAILED) {
+		return -1;
+	}
+	spi_common.dma.buf->cmdLast = SPI_COMM_LAST;
+	spi_common.dma.buf->evtLast = SPI_EVENT_LAST;
+
+	spi_common.dma.ctx = grdma_init(SPI_DMA_INSTANCE);
+	if (spi_common.dma.ctx == NULL) {
+		munmap(spi_common.dma.buf, _PAGE_SIZE);
+		return -1;
+	}
+
+	/* Whole batch and the previous chain tail, which stays queued */
+	chunks = (SPI_DMA_BATCH + fifosz - 1) / fifosz;
+	if (grdma_poolInit(spi_common.dma.ctx, SPI_DMA_CHUNK_DESCR * chunks + 1) < 0) {
+		grdma_destroy(spi_common.dma.ctx);
+		munmap(spi_common.dma.buf, _PAGE_SIZE);
+		return -1;
+	}
+
+	if (mutexCreate(&spi_common.dma.lock) < 0) {
+		grdma_destroy(spi_common.dma.ctx);
+		munmap(spi_common.dma.buf, _PAGE_SIZE);
+		return -1;
+	}
+
+	if (condCreate(&spi_common.dma.cond) < 0) {
+		resourceDestroy(spi_common.dma.lock);
+		grdma_destroy(spi_common.dma.ctx);
+		munmap(spi_common.dma.buf, _PAGE_SIZE);
+		return -1;
+	}
+
+	(void)grdma_irqAttach(spi_common.dma.ctx, spi_common.dma.cond, &spi_common.dma.inth);
+
+	for (i = 0; (i < SPI_CNT) && (i < (sizeof(useDma) / sizeof(useDma[0]))); i++) {
+		spi_common.dev[i].useDma = useDma[i];
+	}
+
+	return 0;
+}
+
+
 int spi_init(void)
 {
 	struct {
@@ -400,5 +660,8 @@ int spi_init(void)
 		interrupt(spi_info[i].irq, spi_irqHandler, (void *)i, spi_common.dev[i].cond, &spi_common.dev[i].inth);
 	}
 
+	/* Transfers fall back to interrupt mode without DMA */
+	(void)spi_dmaInit();
+
 	return 0;
 }
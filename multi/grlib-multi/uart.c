@@ -17,7 +17,6 @@
 #include <endian.h>
 #include <libtty.h>
 #include <stdlib.h>
-#include <stdatomic.h>
 
 #include <sys/debug.h>
 #include <sys/file.h>
@@ -80,8 +79,8 @@
 
 #define UART_CLK SYSCLK_FREQ
 
-#define DMA_RECEIVE_SIZE    64 /* Should be a power of 2 for modulo operation */
-#define DMA_RECEIVE_IRQSIZE 16
+#define DMA_RECEIVE_SIZE    256 /* Should be a power of 2 for modulo operation */
+#define DMA_RECEIVE_IRQSIZE 32
 
 
 typedef struct {
@@ -96,9 +95,8 @@ typedef struct {
 	/* DMA */
 	grdma_ctx_t *dmaCtx;
 	volatile unsigned char *dmaRxBuf;
-	volatile atomic_size_t nextPos;
-	volatile atomic_size_t irqCnt;
-	size_t lastPos;
+	size_t lastPos;   /* Consumer index */
+	time_t rxTimeout; /* Partial data flush period (us) */
 
 	uint8_t stack[UART_STACKSZ] __attribute__((aligned(8)));
 } uart_t;
@@ -151,37 +149,72 @@ static int uart_interrupt(unsigned int n, void *arg)
 
 static int uart_dmaInterrupt(unsigned int n, void *arg)
 {
-	uart_t *uart = (uart_t *)arg;
-	uart_dmaDescr_t *done = &((uart_dmaDescr_t *)uart->dmaCtx->descr)[uart->nextPos];
 	(void)n;
+	(void)arg;
 
-	uart->nextPos = (uart->nextPos + DMA_RECEIVE_IRQSIZE) % DMA_RECEIVE_SIZE;
+	/* Descriptors are released by the consumer, just wake it up */
+	return 1;
+}
 
-	for (size_t i = 0; i < DMA_RECEIVE_IRQSIZE; i++) {
-		/* Clear descriptor statuses */
-		done[i].condDescr.sts = 0;
-		done[i].dataDescr.sts = 0;
-	}
 
-	uart->irqCnt = 1 + (uart->irqCnt % 4);
+/* Returns number of bytes received past the consumer index. DMA completes descriptors in ring order
+ * and the consumer clears them after use, so completed descriptors form a prefix - binary search it */
+static size_t uart_dmaAvail(const uart_t *uart)
+{
+	const uart_dmaDescr_t *descr = (const uart_dmaDescr_t *)uart->dmaCtx->descr;
+	size_t lo = 0, hi = DMA_RECEIVE_SIZE, mid;
 
-	return 1;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if ((descr[(uart->lastPos + mid) % DMA_RECEIVE_SIZE].dataDescr.sts & GRDMA_STS_DONE) != 0) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
+
+	return lo;
 }
 
 
-static size_t uart_dmaGetPos(const uart_t *uart)
+/* Hands received spans over to libtty, returns number of bytes consumed */
+static size_t uart_dmaRx(uart_t *uart)
 {
-	uart_dmaDescr_t *done = (uart_dmaDescr_t *)uart->dmaCtx->descr;
-	const size_t pos = uart->nextPos;
+	uart_dmaDescr_t *descr = (uart_dmaDescr_t *)uart->dmaCtx->descr;
+	size_t avail, len, total = 0;
+	int wake = 0, wakeHelper;
+
+	/* Second pass picks up the part after ring wrap and data received in the meantime */
+	for (int pass = 0; pass < 2; pass++) {
+		avail = uart_dmaAvail(uart);
+		if (avail == 0) {
+			break;
+		}
+
+		len = DMA_RECEIVE_SIZE - uart->lastPos;
+		if (len > avail) {
+			len = avail;
+		}
+
+		libtty_putchars(&uart->tty, (const unsigned char *)&uart->dmaRxBuf[uart->lastPos], len, &wakeHelper);
+		wake |= wakeHelper;
 
-	for (size_t i = 0; i < (uart->irqCnt * DMA_RECEIVE_IRQSIZE); i++) {
-		size_t next = (pos + i) % DMA_RECEIVE_SIZE;
-		if ((done[next].dataDescr.sts & 0x1) == 0) {
-			return next;
+		/* Release descriptors */
+		for (size_t i = 0; i < len; i++) {
+			descr[uart->lastPos + i].condDescr.sts = 0;
+			descr[uart->lastPos + i].dataDescr.sts = 0;
 		}
+
+		uart->lastPos = (uart->lastPos + len) % DMA_RECEIVE_SIZE;
+		total += len;
+	}
+
+	if (wake != 0) {
+		libtty_wake_reader(&uart->tty);
 	}
 
-	return pos;
+	return total;
 }
 
 
@@ -237,40 +270,12 @@ static void uart_dmaThread(void *arg)
 	mutexLock(uart->lock);
 
 	for (;;) {
-		size_t pos = uart_dmaGetPos(uart);
-		while ((libtty_txready(&uart->tty) == 0) && (uart->lastPos == pos)) {
-			(void)condWait(uart->cond, uart->lock, 50000);
-			pos = uart_dmaGetPos(uart);
+		/* Interrupt comes every DMA_RECEIVE_IRQSIZE bytes, partial data is flushed on timeout */
+		while ((uart_dmaRx(uart) == 0) && (libtty_txready(&uart->tty) == 0)) {
+			(void)condWait(uart->cond, uart->lock, uart->rxTimeout);
 		}
 
 		int wake = 0;
-		if (uart->lastPos != pos) {
-			libtty_putchar_lock(&uart->tty);
-			do {
-				int wakeHelper;
-				libtty_putchar_unlocked(&uart->tty, uart->dmaRxBuf[uart->lastPos], &wakeHelper);
-				uart->lastPos = (uart->lastPos + 1) % DMA_RECEIVE_SIZE;
-				wake |= wakeHelper;
-			} while (uart->lastPos != pos);
-
-			/* Unroll one loop to speed up RX */
-			pos = uart_dmaGetPos(uart);
-			if (uart->lastPos != pos) {
-				do {
-					int wakeHelper;
-					libtty_putchar_unlocked(&uart->tty, uart->dmaRxBuf[uart->lastPos], &wakeHelper);
-					uart->lastPos = (uart->lastPos + 1) % DMA_RECEIVE_SIZE;
-					wake |= wakeHelper;
-				} while (uart->lastPos != pos);
-			}
-			libtty_putchar_unlock(&uart->tty);
-
-			if (wake != 0) {
-				libtty_wake_reader(&uart->tty);
-			}
-		}
-
-		wake = 0;
 		while ((libtty_txready(&uart->tty) != 0) && ((*(uart->vbase + UART_STATUS) & TX_FIFO_FULL) == 0)) {
 			*(uart->vbase + UART_DATA) = libtty_popchar(&uart->tty);
 			wake = 1;
@@ -286,9 +291,16 @@ static void uart_dmaThread(void *arg)
 static void uart_setBaudrate(void *data, speed_t speed)
 {
 	uart_t *uart = (uart_t *)data;
-	uint32_t scaler = (UART_CLK / (libtty_baudrate_to_int(speed) * 8 + 7));
+	int baudrate = libtty_baudrate_to_int(speed);
+	uint32_t scaler = (UART_CLK / (baudrate * 8 + 7));
 
 	*(uart->vbase + UART_SCALER) = scaler;
+
+	/* Time of DMA_RECEIVE_IRQSIZE characters (10 bits each), at least 1 ms */
+	uart->rxTimeout = (baudrate > 0) ? ((time_t)DMA_RECEIVE_IRQSIZE * 10 * 1000 * 1000) / baudrate : 0;
+	if (uart->rxTimeout < 1000) {
+		uart->rxTimeout = 1000;
+	}
 }
 
 
@@ -416,9 +428,7 @@ static int uart_dmaSetup(uart_t *uart)
 	}
 
 	uart->dmaCtx = ctx;
-	uart->nextPos = 0;
 	uart->lastPos = 0;
-	uart->irqCnt = 1;
 
 	uart_dmaDescr_t *descr = ctx->descr;
 
@@ -607,9 +617,9 @@ void uart_handleMsg(msg_t *msg, int dev)
 }
 
 
-void uart_klogClbk(const char *data, size_t size)
+ssize_t uart_klogClbk(const char *data, size_t size)
 {
-	libtty_write(&uart_common.uart[UART_CONSOLE_USER].tty, data, size, 0);
+	return libtty_write(&uart_common.uart[UART_CONSOLE_USER].tty, data, size, O_NONBLOCK);
 }
 
 
@@ -16,12 +16,13 @@
 
 
 #include <sys/msg.h>
+#include <sys/types.h>
 
 
 void uart_handleMsg(msg_t *msg, int dev);
 
 
-void uart_klogClbk(const char *data, size_t size);
+ssize_t uart_klogClbk(const char *data, size_t size);
 
 
 int uart_createDevs(oid_t *oid);
@@ -25,6 +25,7 @@
 
 #include "common.h"
 #include "cm4.h"
+#include "cm4/lib/bulk.h"
 
 #ifndef CM4_MU_CHANNELS
 #define CM4_MU_CHANNELS 4
@@ -73,6 +74,21 @@
 #define CM4_MEMORY_START ((void *)0x20200000)
 #define CM4_MEMORY_SIZE  (256 * 1024)
 
+/* Shared memory bulk channel, has to be excluded from the M4 image memory */
+#ifndef CM4_BULK_OFFS
+#define CM4_BULK_OFFS (CM4_MEMORY_SIZE - CM4_BULK_SIZE)
+#endif
+
+#if CM4_BULK_SIZE
+#if ((CM4_BULK_OFFS % CM4_BULK_LINE) != 0) || ((CM4_BULK_OFFS + CM4_BULK_SIZE) > CM4_MEMORY_SIZE)
+#error "CM4_BULK_OFFS has to be cache line aligned and the area has to fit in CM4 memory"
+#endif
+
+#if CM4_BULK_SIZE < (CM4_BULK_HDRSZ + 2 * CM4_BULK_LINE)
+#error "CM4_BULK_SIZE too small"
+#endif
+#endif
+
 
 /* clang-format off */
 enum { atr0 = 0, atr1, atr2, atr3, arr0, arr1, arr2, arr3, asr, acr };
@@ -115,6 +131,20 @@ struct {
 
 	handle_t lock;
 	uint8_t data[CM4_MU_TOTAL_FIFO_SIZE];
+
+#if CM4_BULK_SIZE
+	struct {
+		volatile cm4_bulkHdr_t *hdr;
+		volatile uint8_t *base;
+		handle_t rx_lock;
+		handle_t tx_lock;
+		handle_t cond;
+		struct {
+			uint8_t busy : 1;
+			uint8_t nonblock : 1;
+		} state;
+	} bulk;
+#endif
 } m4_common;
 
 
@@ -222,7 +252,7 @@ static inline int fifo_pushPacket(lf_fifo_t *fifo, packet_t *packet)
 static int mu_irqHandler(unsigned int n, void *arg)
 {
 	uint32_t sr;
-	int chan;
+	int chan, ret = -1;
 	packet_t packet;
 
 	(void)n;
@@ -230,6 +260,12 @@ static int mu_irqHandler(unsigned int n, void *arg)
 
 	sr = *(m4_common.mu + asr);
 
+	/* General purpose interrupt 0 - bulk channel doorbell, wakes the waiting reader */
+	if ((sr & (1u << 31)) != 0) {
+		*(m4_common.mu + asr) = 1u << 31;
+		ret = 0;
+	}
+
 	/* TX */
 	for (chan = 0; chan < CM4_MU_CHANNELS; ++chan) {
 		if ((sr & (1 << (23 - chan))) != 0) {
@@ -250,7 +286,7 @@ static int mu_irqHandler(unsigned int n, void *arg)
 		}
 	}
 
-	return -1;
+	return ret;
 }
 
 
@@ -414,6 +450,304 @@ static int cleanInvalDCache(void *addr, unsigned int sz)
 }
 
 
+#if CM4_BULK_SIZE
+
+/* Index of the other core has to be invalidated before reading */
+static uint32_t bulkGetIdx(volatile cm4_bulkIdx_t *idx)
+{
+	cleanInvalDCache((void *)idx, sizeof(*idx));
+	return idx->val;
+}
+
+
+static void bulkSetIdx(volatile cm4_bulkIdx_t *idx, uint32_t val)
+{
+	__asm__ volatile ("dmb");
+	idx->val = val;
+	cleanInvalDCache((void *)idx, sizeof(*idx));
+}
+
+
+static void bulkDoorbell(void)
+{
+	/* Request general purpose interrupt 0 on M4 side, it's already pending otherwise */
+	if ((*(m4_common.mu + acr) & (1u << 19)) == 0) {
+		*(m4_common.mu + acr) |= 1u << 19;
+	}
+}
+
+
+static void bulkReset(void)
+{
+	volatile cm4_bulkHdr_t *hdr = m4_common.bulk.hdr;
+	uint32_t size;
+
+	/* Largest power of 2 for both rings */
+	for (size = CM4_BULK_LINE; (2 * size * 2) <= (CM4_BULK_SIZE - CM4_BULK_HDRSZ); size *= 2) {
+	}
+
+	hdr->ring[cm4_bulkTx].head.val = 0;
+	hdr->ring[cm4_bulkTx].tail.val = 0;
+	hdr->ring[cm4_bulkTx].offs = CM4_BULK_HDRSZ;
+	hdr->ring[cm4_bulkTx].size = size;
+	hdr->ring[cm4_bulkRx].head.val = 0;
+	hdr->ring[cm4_bulkRx].tail.val = 0;
+	hdr->ring[cm4_bulkRx].offs = CM4_BULK_HDRSZ + size;
+	hdr->ring[cm4_bulkRx].size = size;
+	hdr->magic = CM4_BULK_MAGIC;
+
+	cleanInvalDCache((void *)hdr, CM4_BULK_HDRSZ);
+}
+
+
+/* Returns contiguous free space in M7 -> M4 ring */
+static size_t bulkTxSpan(volatile uint8_t **ptr)
+{
+	volatile cm4_bulkRing_t *ring = &m4_common.bulk.hdr->ring[cm4_bulkTx];
+	uint32_t head = ring->head.val, offs = head & (ring->size - 1);
+	size_t len = ring->size - (head - bulkGetIdx(&ring->tail));
+
+	if (len > ring->size - offs) {
+		len = ring->size - offs;
+	}
+
+	*ptr = m4_common.bulk.base + ring->offs + offs;
+
+	return len;
+}
+
+
+static int bulkTxCommit(size_t len)
+{
+	volatile cm4_bulkRing_t *ring = &m4_common.bulk.hdr->ring[cm4_bulkTx];
+	volatile uint8_t *ptr;
+	uint32_t head = ring->head.val;
+
+	if ((len == 0) || (len > bulkTxSpan(&ptr))) {
+		return -EINVAL;
+	}
+
+	cleanInvalDCache((void *)ptr, len);
+	bulkSetIdx(&ring->head, head + len);
+
+	/* Batched doorbell - M4 may be waiting only if it has drained the ring */
+	if (bulkGetIdx(&ring->tail) == head) {
+		bulkDoorbell();
+	}
+
+	return EOK;
+}
+
+
+/* Returns contiguous data in M4 -> M7 ring */
+static size_t bulkRxSpan(volatile uint8_t **ptr)
+{
+	volatile cm4_bulkRing_t *ring = &m4_common.bulk.hdr->ring[cm4_bulkRx];
+	uint32_t tail = ring->tail.val, offs = tail & (ring->size - 1);
+	size_t len = bulkGetIdx(&ring->head) - tail;
+
+	if (len > ring->size - offs) {
+		len = ring->size - offs;
+	}
+
+	*ptr = m4_common.bulk.base + ring->offs + offs;
+	if (len != 0) {
+		cleanInvalDCache((void *)*ptr, len);
+	}
+
+	return len;
+}
+
+
+static int bulkRxRelease(size_t len)
+{
+	volatile cm4_bulkRing_t *ring = &m4_common.bulk.hdr->ring[cm4_bulkRx];
+	volatile uint8_t *ptr;
+	uint32_t tail = ring->tail.val;
+
+	if ((len == 0) || (len > bulkRxSpan(&ptr))) {
+		return -EINVAL;
+	}
+
+	bulkSetIdx(&ring->tail, tail + len);
+
+	/* M4 may be waiting for space only if the ring was full */
+	if ((bulkGetIdx(&ring->head) - tail) == ring->size) {
+		bulkDoorbell();
+	}
+
+	return EOK;
+}
+
+
+static ssize_t bulkRead(unsigned char *buff, size_t bufflen)
+{
+	volatile uint8_t *ptr;
+	size_t n, total = 0;
+
+	if (buff == NULL) {
+		return -EINVAL;
+	}
+
+	mutexLock(m4_common.bulk.rx_lock);
+	while ((total < bufflen) && ((n = bulkRxSpan(&ptr)) != 0)) {
+		if (n > bufflen - total) {
+			n = bufflen - total;
+		}
+
+		memcpy(buff + total, (void *)ptr, n);
+		bulkRxRelease(n);
+		total += n;
+	}
+	mutexUnlock(m4_common.bulk.rx_lock);
+
+	if ((total == 0) && (m4_common.bulk.state.nonblock == 1)) {
+		return -EAGAIN;
+	}
+
+	return (ssize_t)total;
+}
+
+
+static ssize_t bulkWrite(const unsigned char *buff, size_t bufflen)
+{
+	volatile uint8_t *ptr;
+	size_t n, total = 0;
+
+	if (buff == NULL) {
+		return -EINVAL;
+	}
+
+	mutexLock(m4_common.bulk.tx_lock);
+	while ((total < bufflen) && ((n = bulkTxSpan(&ptr)) != 0)) {
+		if (n > bufflen - total) {
+			n = bufflen - total;
+		}
+
+		memcpy((void *)ptr, buff + total, n);
+		bulkTxCommit(n);
+		total += n;
+	}
+	mutexUnlock(m4_common.bulk.tx_lock);
+
+	if ((total == 0) && (m4_common.bulk.state.nonblock == 1)) {
+		return -EAGAIN;
+	}
+
+	return (ssize_t)total;
+}
+
+
+/* Zero-copy buffer lending, the caller accesses the shared memory directly */
+static void bulkDevctl(msg_t *msg)
+{
+	multi_i_t *iptr = (multi_i_t *)msg->i.raw;
+	cm4_bulkBuf_t *buf = msg->o.data;
+	volatile uint8_t *ptr;
+	size_t len;
+	time_t timeout;
+
+	switch (iptr->cm4.type) {
+		case CM4_BULK_ACQUIRE:
+		case CM4_BULK_PEEK:
+			if ((buf == NULL) || (msg->o.size != sizeof(*buf))) {
+				msg->o.err = -EINVAL;
+				break;
+			}
+
+			if (iptr->cm4.type == CM4_BULK_ACQUIRE) {
+				mutexLock(m4_common.bulk.tx_lock);
+				len = bulkTxSpan(&ptr);
+				mutexUnlock(m4_common.bulk.tx_lock);
+			}
+			else {
+				mutexLock(m4_common.bulk.rx_lock);
+				len = bulkRxSpan(&ptr);
+				mutexUnlock(m4_common.bulk.rx_lock);
+			}
+
+			buf->addr = (void *)ptr;
+			buf->len = len;
+			msg->o.err = EOK;
+			break;
+
+		case CM4_BULK_COMMIT:
+			mutexLock(m4_common.bulk.tx_lock);
+			msg->o.err = bulkTxCommit(iptr->cm4.len);
+			mutexUnlock(m4_common.bulk.tx_lock);
+			break;
+
+		case CM4_BULK_RELEASE:
+			mutexLock(m4_common.bulk.rx_lock);
+			msg->o.err = bulkRxRelease(iptr->cm4.len);
+			mutexUnlock(m4_common.bulk.rx_lock);
+			break;
+
+		case CM4_BULK_WAIT:
+			timeout = iptr->cm4.len;
+			msg->o.err = EOK;
+
+			mutexLock(m4_common.bulk.rx_lock);
+			while (bulkRxSpan(&ptr) == 0) {
+				if ((timeout == 0) || (condWait(m4_common.bulk.cond, m4_common.bulk.rx_lock, timeout) < 0)) {
+					msg->o.err = -ETIMEDOUT;
+					break;
+				}
+			}
+			mutexUnlock(m4_common.bulk.rx_lock);
+			break;
+
+		default:
+			msg->o.err = -ENOSYS;
+			break;
+	}
+}
+
+
+static void bulkHandleMsg(msg_t *msg)
+{
+	switch (msg->type) {
+		case mtOpen:
+			mutexLock(m4_common.lock);
+			if (m4_common.bulk.state.busy == 1) {
+				msg->o.err = -EBUSY;
+			}
+			else {
+				m4_common.bulk.state.busy = 1;
+				m4_common.bulk.state.nonblock = ((msg->i.openclose.flags & O_NONBLOCK) != 0) ? 1 : 0;
+				msg->o.err = EOK;
+			}
+			mutexUnlock(m4_common.lock);
+			break;
+
+		case mtClose:
+			mutexLock(m4_common.lock);
+			msg->o.err = (m4_common.bulk.state.busy == 0) ? -EBADF : EOK;
+			m4_common.bulk.state.busy = 0;
+			mutexUnlock(m4_common.lock);
+			break;
+
+		case mtRead:
+			msg->o.err = bulkRead(msg->o.data, msg->o.size);
+			break;
+
+		case mtWrite:
+			msg->o.err = bulkWrite(msg->i.data, msg->i.size);
+			break;
+
+		case mtDevCtl:
+			bulkDevctl(msg);
+			break;
+
+		default:
+			msg->o.err = -ENOSYS;
+			break;
+	}
+}
+
+#endif
+
+
 static int loadFromFile(const char *path)
 {
 	unsigned char buff[64]; /* Can't be big due to small multi stacks */
@@ -452,6 +786,10 @@ static int loadFromFile(const char *path)
 
 	fclose(f);
 
+#if CM4_BULK_SIZE
+	bulkReset();
+#endif
+
 	return (int)total;
 }
 
@@ -468,6 +806,10 @@ static int loadFromBuff(const void *buff, size_t bufflen)
 
 	cleanInvalDCache((void *)m4_common.m4memory, bufflen);
 
+#if CM4_BULK_SIZE
+	bulkReset();
+#endif
+
 	return (int)bufflen;
 }
 
@@ -504,6 +846,16 @@ static int resetCore(void)
 		setRXirq(chan, 1);
 	}
 
+#if CM4_BULK_SIZE
+	mutexLock(m4_common.bulk.rx_lock);
+	mutexLock(m4_common.bulk.tx_lock);
+	bulkReset();
+	mutexUnlock(m4_common.bulk.tx_lock);
+	mutexUnlock(m4_common.bulk.rx_lock);
+
+	*(m4_common.mu + acr) |= 1u << 31;
+#endif
+
 	/* Reset CM4 core */
 
 	pctl.action = pctl_set;
@@ -566,6 +918,13 @@ static void devctl(msg_t *msg)
 
 void cm4_handleMsg(msg_t *msg)
 {
+#if CM4_BULK_SIZE
+	if (msg->oid.id == id_cm4_bulk) {
+		bulkHandleMsg(msg);
+		return;
+	}
+#endif
+
 	switch (msg->type) {
 		case mtOpen:
 			msg->o.err = chanOpen(msg->oid.id - id_cm4_0, msg->i.openclose.flags);
@@ -619,7 +978,21 @@ void cm4_init(void)
 		mutexCreate(&m4_common.channel[chan].tx_lock);
 	}
 
+#if CM4_BULK_SIZE
+	m4_common.bulk.base = (volatile uint8_t *)m4_common.m4memory + CM4_BULK_OFFS;
+	m4_common.bulk.hdr = (volatile cm4_bulkHdr_t *)m4_common.bulk.base;
+	mutexCreate(&m4_common.bulk.rx_lock);
+	mutexCreate(&m4_common.bulk.tx_lock);
+	condCreate(&m4_common.bulk.cond);
+	bulkReset();
+
+	interrupt(mu_irq, mu_irqHandler, NULL, m4_common.bulk.cond, NULL);
+
+	/* Doorbell from M4 */
+	*(m4_common.mu + acr) |= 1u << 31;
+#else
 	interrupt(mu_irq, mu_irqHandler, NULL, 0, NULL);
+#endif
 
 	for (chan = 0; chan < CM4_MU_CHANNELS; ++chan) {
 		setRXirq(chan, 1);
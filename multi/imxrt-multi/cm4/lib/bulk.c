@@ -0,0 +1,165 @@
+/*
+ * Phoenix-RTOS
+ *
+ * i.MX RT117x M7 <-> M4 shared memory bulk channel
+ *
+ * Copyright 2024 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+
+#include "bulk.h"
+#include "mu.h"
+#include "string.h"
+
+
+static struct {
+	uint8_t *base;
+	cm4_bulkRing_t *rx; /* M7 -> M4 */
+	cm4_bulkRing_t *tx; /* M4 -> M7 */
+} common;
+
+
+static inline void bulk_barrier(void)
+{
+	__asm__ volatile ("dmb");
+}
+
+
+int bulk_init(void *base)
+{
+	cm4_bulkHdr_t *hdr = base;
+
+	if (hdr->magic != CM4_BULK_MAGIC)
+		return -1;
+
+	common.base = base;
+	common.rx = &hdr->ring[cm4_bulkTx];
+	common.tx = &hdr->ring[cm4_bulkRx];
+
+	return 0;
+}
+
+
+int bulk_acquire(void **buff)
+{
+	uint32_t head, len, offs;
+
+	if (common.base == NULL)
+		return -1;
+
+	head = common.tx->head.val;
+	len = common.tx->size - (head - common.tx->tail.val);
+	offs = head & (common.tx->size - 1);
+
+	if (len > common.tx->size - offs)
+		len = common.tx->size - offs;
+
+	*buff = common.base + common.tx->offs + offs;
+
+	return len;
+}
+
+
+void bulk_commit(int len)
+{
+	uint32_t head = common.tx->head.val;
+
+	if (len <= 0)
+		return;
+
+	bulk_barrier();
+	common.tx->head.val = head + len;
+	bulk_barrier();
+
+	/* M7 may be waiting only if it has seen the ring empty */
+	if (common.tx->tail.val == head)
+		mu_doorbellRing();
+}
+
+
+int bulk_peek(const void **buff)
+{
+	uint32_t tail, len, offs;
+
+	if (common.base == NULL)
+		return -1;
+
+	tail = common.rx->tail.val;
+	len = common.rx->head.val - tail;
+	offs = tail & (common.rx->size - 1);
+
+	if (len > common.rx->size - offs)
+		len = common.rx->size - offs;
+
+	bulk_barrier();
+	*buff = common.base + common.rx->offs + offs;
+
+	return len;
+}
+
+
+void bulk_release(int len)
+{
+	uint32_t tail = common.rx->tail.val;
+
+	if (len <= 0)
+		return;
+
+	bulk_barrier();
+	common.rx->tail.val = tail + len;
+	bulk_barrier();
+
+	/* M7 may be waiting for space only if the ring was full */
+	if (common.rx->head.val - tail == common.rx->size)
+		mu_doorbellRing();
+}
+
+
+int bulk_read(void *buff, int len)
+{
+	const void *src;
+	uint8_t *dst = buff;
+	int n, total = 0;
+
+	while (total < len) {
+		n = bulk_peek(&src);
+		if (n <= 0)
+			break;
+
+		if (n > len - total)
+			n = len - total;
+
+		memcpy(dst + total, (void *)src, n);
+		bulk_release(n);
+		total += n;
+	}
+
+	return total;
+}
+
+
+int bulk_write(const void *buff, int len)
+{
+	void *dst;
+	const uint8_t *src = buff;
+	int n, total = 0;
+
+	while (total < len) {
+		n = bulk_acquire(&dst);
+		if (n <= 0)
+			break;
+
+		if (n > len - total)
+			n = len - total;
+
+		memcpy(dst, (void *)(src + total), n);
+		bulk_commit(n);
+		total += n;
+	}
+
+	return total;
+}
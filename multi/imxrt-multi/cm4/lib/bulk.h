@@ -0,0 +1,83 @@
+/*
+ * Phoenix-RTOS
+ *
+ * i.MX RT117x M7 <-> M4 shared memory bulk channel
+ *
+ * Copyright 2024 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef BULK_H_
+#define BULK_H_
+
+#include <stdint.h>
+
+
+/* Layout shared with the M7 side (imxrt-multi), which initializes it before starting the core */
+
+#define CM4_BULK_MAGIC 0x314b4c42 /* "BLK1" */
+
+/* M7 data cache line, fields written by different cores can't share one */
+#define CM4_BULK_LINE 32
+
+
+enum { cm4_bulkTx = 0, cm4_bulkRx }; /* Direction as seen by M7 */
+
+
+typedef struct {
+	volatile uint32_t val;
+	uint32_t pad[CM4_BULK_LINE / 4 - 1];
+} cm4_bulkIdx_t;
+
+
+/* head and tail are free running, size is a power of 2 */
+typedef struct {
+	cm4_bulkIdx_t head; /* written by producer */
+	cm4_bulkIdx_t tail; /* written by consumer */
+	uint32_t offs;      /* data offset from the start of the area */
+	uint32_t size;
+	uint32_t pad[CM4_BULK_LINE / 4 - 2];
+} cm4_bulkRing_t;
+
+
+typedef struct {
+	uint32_t magic;
+	uint32_t pad[CM4_BULK_LINE / 4 - 1];
+	cm4_bulkRing_t ring[2];
+} cm4_bulkHdr_t;
+
+
+/* sizeof(cm4_bulkHdr_t), ring data follows the header */
+#define CM4_BULK_HDRSZ (7 * CM4_BULK_LINE)
+
+
+/* M4 API, producer rings the MU doorbell only when the ring was empty (or full for consumer) */
+
+
+/* base is the start of the area as seen by M4 */
+int bulk_init(void *base);
+
+
+int bulk_read(void *buff, int len);
+
+
+int bulk_write(const void *buff, int len);
+
+
+/* Zero-copy access, returns contiguous space/data length */
+int bulk_acquire(void **buff);
+
+
+void bulk_commit(int len);
+
+
+int bulk_peek(const void **buff);
+
+
+void bulk_release(int len);
+
+
+#endif
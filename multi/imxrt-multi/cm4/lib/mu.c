@@ -46,6 +46,8 @@ static struct {
 		fifo_t rx;
 		fifo_t tx;
 	} channel[CHANNEL_NO];
+
+	volatile int doorbell;
 } common;
 
 
@@ -125,6 +127,12 @@ static void mu_irqHandler(int n)
 
 	(void)n;
 
+	/* General purpose interrupt 0 - doorbell */
+	if (*(common.base + bsr) & (1u << 31)) {
+		*(common.base + bsr) = 1u << 31;
+		common.doorbell = 1;
+	}
+
 	/* TX */
 	for (chan = 0; chan < CHANNEL_NO; ++chan) {
 		if (*(common.base + bsr) & (1 << (23 - chan))) {
@@ -188,12 +196,33 @@ int mu_write(int channel, const void *buff, int len)
 }
 
 
+int mu_doorbellPending(void)
+{
+	int ret;
+
+	cm4_enterCritical();
+	ret = common.doorbell;
+	common.doorbell = 0;
+	cm4_exitCritical();
+
+	return ret;
+}
+
+
+void mu_doorbellRing(void)
+{
+	/* Request general purpose interrupt 0 on M7 side, ignore if previous one is still pending */
+	if (!(*(common.base + bcr) & (1 << 19)))
+		*(common.base + bcr) |= 1 << 19;
+}
+
+
 void mu_init(void)
 {
 	common.base = (void *)0x40c4c000;
 
 	interrupt_register(mu_irq, mu_irqHandler, -1);
 
-	/* Enable RX IRQ */
-	*(common.base + bcr) |= 0xf << 24;
+	/* Enable RX and general purpose 0 (doorbell) IRQ */
+	*(common.base + bcr) |= (0xf << 24) | (1u << 31);
 }
@@ -26,6 +26,13 @@ int mu_read(int channel, void *buff, int len);
 int mu_write(int channel, const void *buff, int len);
 
 
+/* Returns and clears doorbell rung by M7 */
+int mu_doorbellPending(void);
+
+
+void mu_doorbellRing(void);
+
+
 void mu_init(void);
 
 
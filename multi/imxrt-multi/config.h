@@ -35,12 +35,58 @@
 #define IMXRT_MULTI_PRIO 2
 #endif
 
+/*
+ * Message workers: GPIO, SPI and I2C classes with threads get their own port,
+ * classes without threads and the remaining devices are served by MULTI workers.
+ * Can be changed with -w class:threads[:prio] within MULTI_WORKERS_MAX threads.
+ */
+#ifndef MULTI_THREADS_NO
+#define MULTI_THREADS_NO 2
+#elif MULTI_THREADS_NO < 1
+#error "MULTI_THREADS_NO must be at least 1"
+#endif
+
+#ifndef MULTI_GPIO_THREADS_NO
+#define MULTI_GPIO_THREADS_NO 0
+#endif
+
+#ifndef MULTI_GPIO_PRIO
+#define MULTI_GPIO_PRIO IMXRT_MULTI_PRIO
+#endif
+
+#ifndef MULTI_SPI_THREADS_NO
+#define MULTI_SPI_THREADS_NO 0
+#endif
+
+#ifndef MULTI_SPI_PRIO
+#define MULTI_SPI_PRIO IMXRT_MULTI_PRIO
+#endif
+
+#ifndef MULTI_I2C_THREADS_NO
+#define MULTI_I2C_THREADS_NO 0
+#endif
+
+#ifndef MULTI_I2C_PRIO
+#define MULTI_I2C_PRIO IMXRT_MULTI_PRIO
+#endif
+
+#ifndef MULTI_WORKERS_MAX
+#define MULTI_WORKERS_MAX (MULTI_THREADS_NO + MULTI_GPIO_THREADS_NO + MULTI_SPI_THREADS_NO + MULTI_I2C_THREADS_NO)
+#endif
+
 /* UART */
 
 #ifndef UART_BUFSIZE
 #define UART_BUFSIZE 512
 #endif
 
+/* Traffic statistics and RX latency histogram (UART_GETSTATS devctl) */
+#ifndef UART_STATS
+#define UART_STATS 0
+#elif !ISBOOLEAN(UART_STATS)
+#error "UART_STATS must have a value of 0, 1, or be undefined"
+#endif
+
 
 #ifndef UART1
 #define UART1 0
@@ -91,9 +137,16 @@
 #define UART1_BAUDRATE 115200
 #endif
 
+#ifndef UART1_DMA
+#define UART1_DMA 0
+#elif !ISBOOLEAN(UART1_DMA)
+#error "UART1_DMA must have a value of 0, 1, or be undefined"
+#endif
+
 #else
 #define UART1_BAUDRATE 0
 #define UART1_BUFSIZE  0
+#define UART1_DMA      0
 #endif /* #if UART1 */
 
 
@@ -146,9 +199,16 @@
 #define UART2_BAUDRATE 115200
 #endif
 
+#ifndef UART2_DMA
+#define UART2_DMA 0
+#elif !ISBOOLEAN(UART2_DMA)
+#error "UART2_DMA must have a value of 0, 1, or be undefined"
+#endif
+
 #else
 #define UART2_BAUDRATE 0
 #define UART2_BUFSIZE  0
+#define UART2_DMA      0
 #endif /* #if UART2 */
 
 
@@ -201,9 +261,16 @@
 #define UART3_BAUDRATE 115200
 #endif
 
+#ifndef UART3_DMA
+#define UART3_DMA 0
+#elif !ISBOOLEAN(UART3_DMA)
+#error "UART3_DMA must have a value of 0, 1, or be undefined"
+#endif
+
 #else
 #define UART3_BAUDRATE 0
 #define UART3_BUFSIZE  0
+#define UART3_DMA      0
 #endif /* #if UART3 */
 
 
@@ -256,9 +323,16 @@
 #define UART4_BAUDRATE 115200
 #endif
 
+#ifndef UART4_DMA
+#define UART4_DMA 0
+#elif !ISBOOLEAN(UART4_DMA)
+#error "UART4_DMA must have a value of 0, 1, or be undefined"
+#endif
+
 #else
 #define UART4_BAUDRATE 0
 #define UART4_BUFSIZE  0
+#define UART4_DMA      0
 #endif /* #if UART4 */
 
 
@@ -311,9 +385,16 @@
 #define UART5_BAUDRATE 115200
 #endif
 
+#ifndef UART5_DMA
+#define UART5_DMA 0
+#elif !ISBOOLEAN(UART5_DMA)
+#error "UART5_DMA must have a value of 0, 1, or be undefined"
+#endif
+
 #else
 #define UART5_BAUDRATE 0
 #define UART5_BUFSIZE  0
+#define UART5_DMA      0
 #endif /* #if UART5 */
 
 
@@ -366,9 +447,16 @@
 #define UART6_BAUDRATE 115200
 #endif
 
+#ifndef UART6_DMA
+#define UART6_DMA 0
+#elif !ISBOOLEAN(UART6_DMA)
+#error "UART6_DMA must have a value of 0, 1, or be undefined"
+#endif
+
 #else
 #define UART6_BAUDRATE 0
 #define UART6_BUFSIZE  0
+#define UART6_DMA      0
 #endif /* #if UART6 */
 
 
@@ -421,9 +509,16 @@
 #define UART7_BAUDRATE 115200
 #endif
 
+#ifndef UART7_DMA
+#define UART7_DMA 0
+#elif !ISBOOLEAN(UART7_DMA)
+#error "UART7_DMA must have a value of 0, 1, or be undefined"
+#endif
+
 #else
 #define UART7_BAUDRATE 0
 #define UART7_BUFSIZE  0
+#define UART7_DMA      0
 #endif /* #if UART7 */
 
 
@@ -476,9 +571,16 @@
 #define UART8_BAUDRATE 115200
 #endif
 
+#ifndef UART8_DMA
+#define UART8_DMA 0
+#elif !ISBOOLEAN(UART8_DMA)
+#error "UART8_DMA must have a value of 0, 1, or be undefined"
+#endif
+
 #else
 #define UART8_BAUDRATE 0
 #define UART8_BUFSIZE  0
+#define UART8_DMA      0
 #endif /* #if UART8 */
 
 
@@ -534,9 +636,16 @@
 #define UART9_BAUDRATE 115200
 #endif
 
+#ifndef UART9_DMA
+#define UART9_DMA 0
+#elif !ISBOOLEAN(UART9_DMA)
+#error "UART9_DMA must have a value of 0, 1, or be undefined"
+#endif
+
 #else
 #define UART9_BAUDRATE 0
 #define UART9_BUFSIZE  0
+#define UART9_DMA      0
 #endif /* #if UART9 */
 
 
@@ -589,9 +698,16 @@
 #define UART10_BAUDRATE 115200
 #endif
 
+#ifndef UART10_DMA
+#define UART10_DMA 0
+#elif !ISBOOLEAN(UART10_DMA)
+#error "UART10_DMA must have a value of 0, 1, or be undefined"
+#endif
+
 #else
 #define UART10_BAUDRATE 0
 #define UART10_BUFSIZE  0
+#define UART10_DMA      0
 #endif /* #if UART10 */
 
 
@@ -644,9 +760,16 @@
 #define UART11_BAUDRATE 115200
 #endif
 
+#ifndef UART11_DMA
+#define UART11_DMA 0
+#elif !ISBOOLEAN(UART11_DMA)
+#error "UART11_DMA must have a value of 0, 1, or be undefined"
+#endif
+
 #else
 #define UART11_BAUDRATE 0
 #define UART11_BUFSIZE  0
+#define UART11_DMA      0
 #endif /* #if UART11 */
 
 
@@ -699,9 +822,16 @@
 #define UART12_BAUDRATE 115200
 #endif
 
+#ifndef UART12_DMA
+#define UART12_DMA 0
+#elif !ISBOOLEAN(UART12_DMA)
+#error "UART12_DMA must have a value of 0, 1, or be undefined"
+#endif
+
 #else
 #define UART12_BAUDRATE 0
 #define UART12_BUFSIZE  0
+#define UART12_DMA      0
 #endif /* #if UART12 */
 
 
@@ -710,15 +840,19 @@
 #define UART9           0
 #define UART9_BUFSIZE   0
 #define UART9_BAUDRATE  0
+#define UART9_DMA       0
 #define UART10          0
 #define UART10_BUFSIZE  0
 #define UART10_BAUDRATE 0
+#define UART10_DMA      0
 #define UART11          0
 #define UART11_BUFSIZE  0
 #define UART11_BAUDRATE 0
+#define UART11_DMA      0
 #define UART12          0
 #define UART12_BUFSIZE  0
 #define UART12_BAUDRATE 0
+#define UART12_DMA      0
 
 #endif /* #ifdef __CPU_IMXRT117X */
 
@@ -752,6 +886,23 @@
 	UART11_BUFSIZE, \
 	UART12_BUFSIZE
 
+#define UART_DMAS \
+	UART1_DMA, \
+	UART2_DMA, \
+	UART3_DMA, \
+	UART4_DMA, \
+	UART5_DMA, \
+	UART6_DMA, \
+	UART7_DMA, \
+	UART8_DMA, \
+	UART9_DMA, \
+	UART10_DMA, \
+	UART11_DMA, \
+	UART12_DMA
+
+#define UART_DMA (UART1_DMA || UART2_DMA || UART3_DMA || UART4_DMA || UART5_DMA || UART6_DMA || \
+	UART7_DMA || UART8_DMA || UART9_DMA || UART10_DMA || UART11_DMA || UART12_DMA)
+
 /* clang-format on */
 
 #ifndef UART_CONSOLE
@@ -858,6 +1009,34 @@
 #error "RTT1_BLOCKING must have a value of 0, 1, or be undefined"
 #endif
 
+/* Raw binary channel - bypasses libtty, reads and writes go directly to the RTT buffers without blocking */
+#ifndef RTT0_RAW
+#define RTT0_RAW 0
+#elif !ISBOOLEAN(RTT0_RAW)
+#error "RTT0_RAW must have a value of 0, 1, or be undefined"
+#endif
+
+#ifndef RTT1_RAW
+#define RTT1_RAW 0
+#elif !ISBOOLEAN(RTT1_RAW)
+#error "RTT1_RAW must have a value of 0, 1, or be undefined"
+#endif
+
+/* Binary trace events channel, see trace.h */
+#ifndef RTT_TRACE
+#define RTT_TRACE
+#elif !ISEMPTY(RTT_TRACE)
+#if (RTT_TRACE < 0) || (RTT_TRACE > 1)
+#error "Invalid value for RTT_TRACE"
+#elif ((RTT_TRACE == 0) && RTT0) || ((RTT_TRACE == 1) && RTT1)
+#error "RTT_TRACE channel can't be used as tty"
+#endif
+#endif
+
+#ifndef RTT_TRACE_BUF_SIZE
+#define RTT_TRACE_BUF_SIZE 4096
+#endif
+
 
 #ifndef RTT_CONSOLE_USER
 #define RTT_CONSOLE_USER
@@ -929,6 +1108,14 @@
 #define SPI1_PCS3 SPI1_PCS3_DEFAULT
 #endif
 
+#ifndef SPI1_DMA
+#define SPI1_DMA 0
+#elif !ISBOOLEAN(SPI1_DMA)
+#error "SPI1_DMA must have a value of 0, 1, or be undefined"
+#endif
+
+#else
+#define SPI1_DMA 0
 #endif /* #if SPI1 */
 
 
@@ -986,6 +1173,14 @@
 #define SPI2_PCS3 SPI2_PCS3_DEFAULT
 #endif
 
+#ifndef SPI2_DMA
+#define SPI2_DMA 0
+#elif !ISBOOLEAN(SPI2_DMA)
+#error "SPI2_DMA must have a value of 0, 1, or be undefined"
+#endif
+
+#else
+#define SPI2_DMA 0
 #endif /* #if SPI2 */
 
 
@@ -1043,6 +1238,14 @@
 #define SPI3_PCS3 SPI3_PCS3_DEFAULT
 #endif
 
+#ifndef SPI3_DMA
+#define SPI3_DMA 0
+#elif !ISBOOLEAN(SPI3_DMA)
+#error "SPI3_DMA must have a value of 0, 1, or be undefined"
+#endif
+
+#else
+#define SPI3_DMA 0
 #endif /* #if SPI3 */
 
 
@@ -1100,6 +1303,14 @@
 #define SPI4_PCS3 SPI4_PCS3_DEFAULT
 #endif
 
+#ifndef SPI4_DMA
+#define SPI4_DMA 0
+#elif !ISBOOLEAN(SPI4_DMA)
+#error "SPI4_DMA must have a value of 0, 1, or be undefined"
+#endif
+
+#else
+#define SPI4_DMA 0
 #endif /* #if SPI4 */
 
 
@@ -1160,6 +1371,14 @@
 #define SPI5_PCS3 SPI5_PCS3_DEFAULT
 #endif
 
+#ifndef SPI5_DMA
+#define SPI5_DMA 0
+#elif !ISBOOLEAN(SPI5_DMA)
+#error "SPI5_DMA must have a value of 0, 1, or be undefined"
+#endif
+
+#else
+#define SPI5_DMA 0
 #endif /* #if SPI5 */
 
 
@@ -1217,6 +1436,14 @@
 #define SPI6_PCS3 SPI6_PCS3_DEFAULT
 #endif
 
+#ifndef SPI6_DMA
+#define SPI6_DMA 0
+#elif !ISBOOLEAN(SPI6_DMA)
+#error "SPI6_DMA must have a value of 0, 1, or be undefined"
+#endif
+
+#else
+#define SPI6_DMA 0
 #endif /* #if SPI6 */
 
 
@@ -1224,9 +1451,13 @@
 
 #define SPI5 0
 #define SPI6 0
+#define SPI5_DMA 0
+#define SPI6_DMA 0
 
 #endif /* #ifdef __CPU_IMXRT117X */
 
+#define SPI_DMA (SPI1_DMA || SPI2_DMA || SPI3_DMA || SPI4_DMA || SPI5_DMA || SPI6_DMA)
+
 
 /* I2C */
 
@@ -1318,6 +1549,44 @@
 #define I2C6_SPEED i2c_speed_slow
 #endif
 
+#ifndef I2C1_DMA
+#define I2C1_DMA 0
+#elif !ISBOOLEAN(I2C1_DMA)
+#error "I2C1_DMA must have a value of 0, 1, or be undefined"
+#endif
+
+#ifndef I2C2_DMA
+#define I2C2_DMA 0
+#elif !ISBOOLEAN(I2C2_DMA)
+#error "I2C2_DMA must have a value of 0, 1, or be undefined"
+#endif
+
+#ifndef I2C3_DMA
+#define I2C3_DMA 0
+#elif !ISBOOLEAN(I2C3_DMA)
+#error "I2C3_DMA must have a value of 0, 1, or be undefined"
+#endif
+
+#ifndef I2C4_DMA
+#define I2C4_DMA 0
+#elif !ISBOOLEAN(I2C4_DMA)
+#error "I2C4_DMA must have a value of 0, 1, or be undefined"
+#endif
+
+#ifndef I2C5_DMA
+#define I2C5_DMA 0
+#elif !ISBOOLEAN(I2C5_DMA)
+#error "I2C5_DMA must have a value of 0, 1, or be undefined"
+#endif
+
+#ifndef I2C6_DMA
+#define I2C6_DMA 0
+#elif !ISBOOLEAN(I2C6_DMA)
+#error "I2C6_DMA must have a value of 0, 1, or be undefined"
+#endif
+
+#define I2C_DMA (I2C1_DMA || I2C2_DMA || I2C3_DMA || I2C4_DMA || I2C5_DMA || I2C6_DMA)
+
 
 /* TRNG */
 
@@ -1327,6 +1596,27 @@
 #define TRNG 0
 #endif
 
+/* Entropy pool refilled in background for /dev/random, 0 - read TRNG directly */
+#ifndef TRNG_POOL_SIZE
+#define TRNG_POOL_SIZE 512
+#endif
+
+#ifndef TRNG_POOL_PRIO
+#define TRNG_POOL_PRIO (IMXRT_MULTI_PRIO + 1)
+#endif
+
+/* ChaCha20 DRBG seeded from TRNG serves /dev/urandom */
+#ifndef TRNG_DRBG
+#define TRNG_DRBG 1
+#elif !ISBOOLEAN(TRNG_DRBG)
+#error "TRNG_DRBG must have a value of 0, 1, or be undefined"
+#endif
+
+/* Bytes generated between DRBG reseeds */
+#ifndef TRNG_DRBG_RESEED
+#define TRNG_DRBG_RESEED (1024 * 1024)
+#endif
+
 #endif /* #ifndef __CPU_IMXRT117X */
 
 /* Temperature */
@@ -1341,11 +1631,44 @@
 #error "PCT2075_DEV_ADDR must be defined"
 #endif
 
+/* Background sampling period, reads are served from the last sample */
+#ifndef PCT2075_SAMPLE_MS
+#define PCT2075_SAMPLE_MS 1000
+#endif
+
+/* OS output wired to a GPIO pin (muxed by the board), its combined GPIO interrupt number */
+#ifdef PCT2075_OS_IRQ
+#if !defined(PCT2075_OS_PORT) || !defined(PCT2075_OS_PIN)
+#error "PCT2075_OS_PORT and PCT2075_OS_PIN must be defined"
+#endif
+
+/* Over-temperature shutdown and hysteresis thresholds in miliCelsius */
+#ifndef PCT2075_TOS
+#define PCT2075_TOS 80000
+#endif
+
+#ifndef PCT2075_THYST
+#define PCT2075_THYST 75000
+#endif
+#endif
+
 /* libdummyfs */
 #ifndef BUILTIN_DUMMYFS
 #define BUILTIN_DUMMYFS 0
 #endif
 
+/* Built-in filesystem message workers */
+#ifndef DUMMYFS_THREADS_NO
+#define DUMMYFS_THREADS_NO 2
+#elif DUMMYFS_THREADS_NO < 1
+#error "DUMMYFS_THREADS_NO must be at least 1"
+#endif
+
+/* Cached lookups of hot (device) paths, 0 - disabled */
+#ifndef DUMMYFS_LOOKUP_CACHE
+#define DUMMYFS_LOOKUP_CACHE 16
+#endif
+
 /* Cortex M4 */
 
 #ifdef __CPU_IMXRT117X
@@ -1354,6 +1677,11 @@
 #define CM4 1
 #endif
 
+/* Shared memory bulk channel (cpuM4bulk) size, 0 - disabled */
+#ifndef CM4_BULK_SIZE
+#define CM4_BULK_SIZE 0
+#endif
+
 #endif
 
 #endif
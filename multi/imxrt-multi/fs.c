@@ -21,19 +21,127 @@
 #include <sys/msg.h>
 #include <sys/threads.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <phoenix/sysinfo.h>
 
 #include <dummyfs.h>
+#include <perfcnt.h>
 
 #define MSGTHR_STACKSZ 4096
 
+/* Longest cached lookup path */
+#define LOOKUP_NAMESZ 32
+
+
+typedef struct {
+	oid_t dir;
+	char name[LOOKUP_NAMESZ];
+	int len; /* Lookup result, 0 - unused entry */
+	oid_t fil;
+	oid_t dev;
+} fs_lookup_t;
+
+
 struct {
-	char stack[MSGTHR_STACKSZ] __attribute__((aligned(8)));
+	char stacks[DUMMYFS_THREADS_NO][MSGTHR_STACKSZ] __attribute__((aligned(8)));
 	unsigned port;
+
+#if DUMMYFS_LOOKUP_CACHE
+	handle_t lock;
+	fs_lookup_t lookups[DUMMYFS_LOOKUP_CACHE];
+	unsigned int next; /* Entry replaced next */
+	unsigned int gen;  /* Bumped on each namespace change */
+#endif
 } fs_common;
 
 
+#if DUMMYFS_LOOKUP_CACHE
+
+PERFCNT_COUNTER(perf_lookupHit, "fs.lookup_hit");
+PERFCNT_COUNTER(perf_lookupMiss, "fs.lookup_miss");
+
+/*
+ * Device paths are looked up on every open, namespace changes are rare so any of them drops the whole cache.
+ * Called after the change is done, the generation keeps a lookup that raced with it from caching its result.
+ */
+static void fs_lookupFlush(void)
+{
+	unsigned int i;
+
+	mutexLock(fs_common.lock);
+	fs_common.gen++;
+	for (i = 0; i < DUMMYFS_LOOKUP_CACHE; i++)
+		fs_common.lookups[i].len = 0;
+	mutexUnlock(fs_common.lock);
+}
+
+
+static int fs_lookup(void *ctx, oid_t *dir, const char *data, size_t size, oid_t *fil, oid_t *dev)
+{
+	fs_lookup_t *entry;
+	size_t namelen;
+	unsigned int i, gen;
+	int err;
+
+	namelen = (data != NULL) ? strnlen(data, size) : size;
+	if ((namelen == 0) || (namelen >= LOOKUP_NAMESZ) || (namelen == size))
+		return dummyfs_lookup(ctx, dir, (char *)data, fil, dev);
+
+	mutexLock(fs_common.lock);
+	for (i = 0; i < DUMMYFS_LOOKUP_CACHE; i++) {
+		entry = &fs_common.lookups[i];
+		if ((entry->len != 0) && (entry->dir.port == dir->port) && (entry->dir.id == dir->id) && (strcmp(entry->name, data) == 0)) {
+			*fil = entry->fil;
+			*dev = entry->dev;
+			err = entry->len;
+			mutexUnlock(fs_common.lock);
+			PERFCNT_INC(perf_lookupHit);
+			return err;
+		}
+	}
+	gen = fs_common.gen;
+	mutexUnlock(fs_common.lock);
+	PERFCNT_INC(perf_lookupMiss);
+
+	err = dummyfs_lookup(ctx, dir, (char *)data, fil, dev);
+	if (err <= 0)
+		return err;
+
+	mutexLock(fs_common.lock);
+	if (gen != fs_common.gen) {
+		mutexUnlock(fs_common.lock);
+		return err;
+	}
+
+	entry = &fs_common.lookups[fs_common.next];
+	fs_common.next = (fs_common.next + 1) % DUMMYFS_LOOKUP_CACHE;
+
+	entry->dir = *dir;
+	memcpy(entry->name, data, namelen + 1);
+	entry->fil = *fil;
+	entry->dev = *dev;
+	entry->len = err;
+	mutexUnlock(fs_common.lock);
+
+	return err;
+}
+
+#else
+
+static void fs_lookupFlush(void)
+{
+}
+
+
+static int fs_lookup(void *ctx, oid_t *dir, const char *data, size_t size, oid_t *fil, oid_t *dev)
+{
+	return dummyfs_lookup(ctx, dir, (char *)data, fil, dev);
+}
+
+#endif
+
+
 static int syspage_create(void *ctx, oid_t *root)
 {
 	oid_t sysoid = { 0 };
@@ -95,14 +203,17 @@ static void msgthr(void *ctx)
 
 			case mtCreate:
 				msg.o.err = dummyfs_create(ctx, &msg.oid, msg.i.data, &msg.o.create.oid, msg.i.create.mode, msg.i.create.type, &msg.i.create.dev);
+				fs_lookupFlush();
 				break;
 
 			case mtDestroy:
 				msg.o.err = dummyfs_destroy(ctx, &msg.oid);
+				fs_lookupFlush();
 				break;
 
 			case mtSetAttr:
 				msg.o.err = dummyfs_setattr(ctx, &msg.oid, msg.i.attr.type, msg.i.attr.val, msg.i.data, msg.i.size);
+				fs_lookupFlush();
 				break;
 
 			case mtGetAttr:
@@ -120,15 +231,17 @@ static void msgthr(void *ctx)
 			}
 
 			case mtLookup:
-				msg.o.err = dummyfs_lookup(ctx, &msg.oid, msg.i.data, &msg.o.lookup.fil, &msg.o.lookup.dev);
+				msg.o.err = fs_lookup(ctx, &msg.oid, msg.i.data, msg.i.size, &msg.o.lookup.fil, &msg.o.lookup.dev);
 				break;
 
 			case mtLink:
 				msg.o.err = dummyfs_link(ctx, &msg.oid, msg.i.data, &msg.i.ln.oid);
+				fs_lookupFlush();
 				break;
 
 			case mtUnlink:
 				msg.o.err = dummyfs_unlink(ctx, &msg.oid, msg.i.data);
+				fs_lookupFlush();
 				break;
 
 			case mtReaddir:
@@ -148,6 +261,15 @@ int fs_init(void)
 {
 	void *ctx;
 	oid_t root = { 0 };
+	int i;
+
+#if DUMMYFS_LOOKUP_CACHE
+	if (mutexCreate(&fs_common.lock) != EOK)
+		return -1;
+
+	PERFCNT_REGISTER(perf_lookupHit);
+	PERFCNT_REGISTER(perf_lookupMiss);
+#endif
 
 	if (portCreate(&fs_common.port) != 0)
 		return -1;
@@ -170,12 +292,18 @@ int fs_init(void)
 		return -1;
 	}
 
-	if (beginthread(msgthr, IMXRT_MULTI_PRIO, fs_common.stack, MSGTHR_STACKSZ, ctx) != EOK) {
+	if (beginthread(msgthr, IMXRT_MULTI_PRIO, fs_common.stacks[0], MSGTHR_STACKSZ, ctx) != EOK) {
 		dummyfs_unmount(ctx);
 		portDestroy(fs_common.port);
 		return -1;
 	}
 
+	/* Additional workers are optional, lookups are still served if they fail to start */
+	for (i = 1; i < DUMMYFS_THREADS_NO; i++) {
+		if (beginthread(msgthr, IMXRT_MULTI_PRIO, fs_common.stacks[i], MSGTHR_STACKSZ, ctx) != EOK)
+			break;
+	}
+
 	return EOK;
 }
 
@@ -18,6 +18,8 @@
 #include <sys/platform.h>
 #include <sys/threads.h>
 
+#include <gpio-batch.h>
+
 #include "common.h"
 #include "gpio.h"
 
@@ -34,22 +36,27 @@ struct {
 } gpio_common;
 
 
-int gpio_setPort(int port, uint32_t mask, uint32_t val)
+static void _gpio_setReg(int port, int reg, uint32_t mask, uint32_t val)
 {
 	unsigned int set, clr, t;
 
-	if ((port <= 0) || (port > GPIO_PORTS)) {
-		return -EINVAL;
-	}
-
-	port -= 1;
 	set = val & mask;
 	clr = ~val & mask;
 
 	/* DR_SET & DR_CLEAR registers are not functional */
+	t = *(gpio_common.base[port - 1] + reg) & ~clr;
+	*(gpio_common.base[port - 1] + reg) = t | set;
+}
+
+
+int gpio_setPort(int port, uint32_t mask, uint32_t val)
+{
+	if ((port <= 0) || (port > GPIO_PORTS)) {
+		return -EINVAL;
+	}
+
 	mutexLock(gpio_common.lock);
-	t = *(gpio_common.base[port] + gpio_dr) & ~clr;
-	*(gpio_common.base[port] + gpio_dr) = t | set;
+	_gpio_setReg(port, gpio_dr, mask, val);
 	mutexUnlock(gpio_common.lock);
 	return EOK;
 }
@@ -69,19 +76,12 @@ int gpio_getPort(int port, uint32_t *val)
 
 int gpio_setDir(int port, uint32_t mask, uint32_t val)
 {
-	unsigned int set, clr, t;
-
 	if ((port <= 0) || (port > GPIO_PORTS)) {
 		return -EINVAL;
 	}
 
-	port -= 1;
-	set = val & mask;
-	clr = ~val & mask;
-
 	mutexLock(gpio_common.lock);
-	t = *(gpio_common.base[port] + gpio_gdir) & ~clr;
-	*(gpio_common.base[port] + gpio_gdir) = t | set;
+	_gpio_setReg(port, gpio_gdir, mask, val);
 	mutexUnlock(gpio_common.lock);
 	return EOK;
 }
@@ -99,6 +99,72 @@ int gpio_getDir(int port, uint32_t *val)
 }
 
 
+/* Batch callbacks, called with the lock held and ports already validated */
+int gpio_irqConfig(int port, unsigned int pin, int enable)
+{
+	if ((port < 1) || (port > GPIO_PORTS) || (pin > 31)) {
+		return -EINVAL;
+	}
+
+	mutexLock(gpio_common.lock);
+	_gpio_setReg(port, gpio_imr, 1u << pin, 0);
+	_gpio_setReg(port, gpio_edge_sel, 1u << pin, 1u << pin);
+	*(gpio_common.base[port - 1] + gpio_isr) = 1u << pin;
+	if (enable != 0) {
+		_gpio_setReg(port, gpio_imr, 1u << pin, 1u << pin);
+	}
+	mutexUnlock(gpio_common.lock);
+
+	return EOK;
+}
+
+
+uint32_t gpio_irqAck(int port, uint32_t mask)
+{
+	uint32_t pending = *(gpio_common.base[port - 1] + gpio_isr) & mask;
+
+	*(gpio_common.base[port - 1] + gpio_isr) = pending;
+
+	return pending;
+}
+
+
+static int gpio_batchRead(void *arg, unsigned int bank, uint32_t *val)
+{
+	return gpio_getPort(bank, val);
+}
+
+
+static int gpio_batchWrite(void *arg, unsigned int bank, uint32_t mask, uint32_t val)
+{
+	_gpio_setReg(bank, gpio_dr, mask, val);
+	return EOK;
+}
+
+
+static int gpio_batchReadDir(void *arg, unsigned int bank, uint32_t *val)
+{
+	return gpio_getDir(bank, val);
+}
+
+
+static int gpio_batchWriteDir(void *arg, unsigned int bank, uint32_t mask, uint32_t val)
+{
+	_gpio_setReg(bank, gpio_gdir, mask, val);
+	return EOK;
+}
+
+
+static const gpio_batchHw_t gpio_batchHw = {
+	.bankMin = 1,
+	.bankMax = GPIO_PORTS,
+	.read = gpio_batchRead,
+	.write = gpio_batchWrite,
+	.readDir = gpio_batchReadDir,
+	.writeDir = gpio_batchWriteDir,
+};
+
+
 static void gpio_handleDevCtl(msg_t *msg, int port)
 {
 	multi_i_t *imsg = (multi_i_t *)msg->i.raw;
@@ -106,6 +172,14 @@ static void gpio_handleDevCtl(msg_t *msg, int port)
 
 	msg->o.err = EOK;
 
+	/* All ports are updated under one lock, so other threads see the batch as atomic */
+	if (gpiobatch_isBatch(msg)) {
+		mutexLock(gpio_common.lock);
+		msg->o.err = gpiobatch_handle(&gpio_batchHw, NULL, msg);
+		mutexUnlock(gpio_common.lock);
+		return;
+	}
+
 	switch (imsg->gpio.type) {
 		case gpio_set_port:
 			msg->o.err = gpio_setPort(port, imsg->gpio.port.mask, imsg->gpio.port.val);
@@ -187,5 +261,8 @@ int gpio_init(void)
 	for (i = 0; i < sizeof(gpio_common.base) / sizeof(gpio_common.base[0]); ++i)
 		gpio_common.base[i] = (void *)addresses[i];
 
+	if (mutexCreate(&gpio_common.lock) < 0)
+		return -1;
+
 	return 0;
 }
@@ -35,4 +35,12 @@ int gpio_setDir(int port, uint32_t mask, uint32_t val);
 int gpio_getDir(int port, uint32_t *val);
 
 
+/* Any edge interrupt on pin, caller registers handler for the port's combined IRQ */
+int gpio_irqConfig(int port, unsigned int pin, int enable);
+
+
+/* Interrupt context safe, returns and clears pending pins from mask */
+uint32_t gpio_irqAck(int port, uint32_t mask);
+
+
 #endif
@@ -12,12 +12,17 @@
  */
 
 #include <stdbool.h>
+#include <string.h>
+#include <sys/mman.h>
 #include <sys/msg.h>
+#include <sys/platform.h>
 #include <sys/threads.h>
 #include <sys/interrupt.h>
 #include <i2c-msg.h>
 #include <errno.h>
 
+#include <edma.h>
+
 #include "common.h"
 #include "trace.h"
 
@@ -49,14 +54,15 @@ static const struct {
 	uint8_t pos;
 	uint8_t speed;
 	uint8_t pushpull;
+	uint8_t dma;
 } i2cPreConfig[] = {
-	{ I2C1_BASE, I2C1_CLK, I2C1_IRQ, I2C1, I2C1_POS, I2C1_SPEED, I2C1_PUSHPULL },
-	{ I2C2_BASE, I2C2_CLK, I2C2_IRQ, I2C2, I2C2_POS, I2C2_SPEED, I2C2_PUSHPULL },
-	{ I2C3_BASE, I2C3_CLK, I2C3_IRQ, I2C3, I2C3_POS, I2C3_SPEED, I2C3_PUSHPULL },
-	{ I2C4_BASE, I2C4_CLK, I2C4_IRQ, I2C4, I2C4_POS, I2C4_SPEED, I2C4_PUSHPULL },
+	{ I2C1_BASE, I2C1_CLK, I2C1_IRQ, I2C1, I2C1_POS, I2C1_SPEED, I2C1_PUSHPULL, I2C1_DMA },
+	{ I2C2_BASE, I2C2_CLK, I2C2_IRQ, I2C2, I2C2_POS, I2C2_SPEED, I2C2_PUSHPULL, I2C2_DMA },
+	{ I2C3_BASE, I2C3_CLK, I2C3_IRQ, I2C3, I2C3_POS, I2C3_SPEED, I2C3_PUSHPULL, I2C3_DMA },
+	{ I2C4_BASE, I2C4_CLK, I2C4_IRQ, I2C4, I2C4_POS, I2C4_SPEED, I2C4_PUSHPULL, I2C4_DMA },
 #ifdef __CPU_IMXRT117X
-	{ I2C5_BASE, I2C5_CLK, I2C5_IRQ, I2C5, I2C5_POS, I2C5_SPEED, I2C5_PUSHPULL },
-	{ I2C6_BASE, I2C6_CLK, I2C6_IRQ, I2C6, I2C6_POS, I2C6_SPEED, I2C6_PUSHPULL },
+	{ I2C5_BASE, I2C5_CLK, I2C5_IRQ, I2C5, I2C5_POS, I2C5_SPEED, I2C5_PUSHPULL, I2C5_DMA },
+	{ I2C6_BASE, I2C6_CLK, I2C6_IRQ, I2C6, I2C6_POS, I2C6_SPEED, I2C6_PUSHPULL, I2C6_DMA },
 #endif
 };
 
@@ -64,6 +70,19 @@ static const struct {
 
 #define FIFO_SIZE 4
 
+/* TX FIFO is refilled when half empty, so the bus doesn't stall meanwhile */
+#define FIFO_TXWATER 1
+
+/* Single receive command reads up to 256 bytes */
+#define CMD_RX_MAX 256
+
+/* Reads of all messages in transfer are done with DMA if their total length fits in range */
+#define I2C_DMA_MINLEN 16
+#define I2C_DMA_BUFSZ  1024
+
+#define TCD_CSR_INTMAJOR (1 << 1)
+#define TCD_CSR_DREQ     (1 << 3)
+
 #define STATUS_PIN_LOW_TIMEOUT  (1u << 13)
 #define STATUS_FIFO_ERROR       (1u << 12)
 #define STATUS_ARBITRATION_LOST (1u << 11)
@@ -101,9 +120,35 @@ static struct periph_info {
 	int irqNo;
 
 	volatile int state;
+
+#if I2C_DMA
+	struct {
+		uint8_t *buf;
+		int chan;
+		volatile int done;
+		volatile int err;
+	} dma;
+#endif
 } i2c_common[I2C_CNT];
 
 
+/* Transfer described by message list, commands are generated on the fly */
+struct i2c_xfer {
+	const i2c_msg_t *msgs;
+	unsigned int count;
+	const uint8_t *wdata;
+	uint8_t *rdata;
+	uint32_t rxLeft;
+
+	unsigned int msg;
+	uint32_t offs;
+	bool started;
+	bool stopQueued;
+	bool stopDone;
+	bool dma;
+};
+
+
 static int i2c_irqRoutine(unsigned int n, void *arg)
 {
 	TRACE_IRQ();
@@ -199,7 +244,7 @@ static int i2c_setupMaster(int pos, uint8_t speed, uint8_t pushpull)
 	*(base + mccr0) = mccr0Val;
 
 	/* Set tx and rx watermarks */
-	*(base + mfcr) = 0u;
+	*(base + mfcr) = FIFO_TXWATER;
 
 	/* Enable I2C */
 	*(base + mcr) |= 1u;
@@ -274,155 +319,414 @@ static int _i2c_waitForInterrupt(int pos, uint32_t bitWait)
 }
 
 
-static inline int _i2c_waitForFifo(int pos, bool receive)
+static int _i2c_beginTransaction(int pos)
 {
-	if (_i2c_getFifoAvailable(i2c_common[pos].base, receive) == 0) {
-		return _i2c_waitForInterrupt(pos, receive ? STATUS_RXFIFO_WM : STATUS_TXFIFO_WM);
-	}
-	else {
-		return EOK;
+	volatile uint32_t *base = i2c_common[pos].base;
+	if (_i2c_checkBusBusy(base)) {
+		return -EBUSY;
 	}
+
+	/* Clear all flag */
+	*(base + msr) = 0x7f << 8u;
+
+	/* Turn off auto-stop option */
+	*(base + mcfgr1) &= ~(1u << 8u);
+	return EOK;
 }
 
 
-static inline int _i2c_putIntoFifo(int pos, uint16_t command)
+static int _i2c_finishTransaction(int pos, int ret)
 {
-	int ret = _i2c_waitForFifo(pos, false);
-	if (ret != EOK) {
-		return ret;
+	if (ret == RET_STOP) {
+		TRACE("unexpected STOP");
+		ret = -EIO;
 	}
 
-	*(i2c_common[pos].base + mtdr) = command;
-	common_dataBarrier();
-	return EOK;
+	if (ret == -ETIMEDOUT) {
+		mutexLock(i2c_common[pos].irqMutex);
+		i2c_common[pos].state = i2c_stateReady;
+		/* cond may have been signalled before we turned off IRQ - try to take it to ensure it's
+		 * not signalled for next use */
+		condWait(i2c_common[pos].irqCond, i2c_common[pos].irqMutex, 1);
+		mutexUnlock(i2c_common[pos].irqMutex);
+	}
+
+	/* Reset FIFOs */
+	*(i2c_common[pos].base + mcr) |= (1u << 9u) | (1u << 8u);
+	return ret;
 }
 
 
-static inline int _i2c_transmit(int pos, const uint8_t *data, uint32_t len)
+/* Returns next command of the transfer, -1 if all of them (including STOP) have been queued */
+static int _i2c_nextCmd(struct i2c_xfer *x)
 {
-	while (len > 0) {
-		int ret = _i2c_putIntoFifo(pos, *data);
-		if (ret != EOK) {
-			return ret;
+	const i2c_msg_t *m;
+	uint32_t n;
+
+	for (; x->msg < x->count; x->msg++, x->offs = 0, x->started = false) {
+		m = &x->msgs[x->msg];
+
+		if (!x->started) {
+			x->started = true;
+			return (int)cmd_start | (m->dev_addr << 1u) | (((m->flags & I2C_MSG_RD) != 0) ? 1 : 0);
+		}
+
+		if (x->offs < m->len) {
+			if ((m->flags & I2C_MSG_RD) != 0) {
+				n = m->len - x->offs;
+				if (n > CMD_RX_MAX) {
+					n = CMD_RX_MAX;
+				}
+				x->offs += n;
+				return (int)cmd_rxdata | (n - 1);
+			}
+
+			x->offs++;
+			return (int)cmd_txdata | *x->wdata++;
 		}
+	}
 
-		data++;
-		len--;
+	if (!x->stopQueued) {
+		x->stopQueued = true;
+		return (int)cmd_stop;
 	}
 
-	return EOK;
+	return -1;
 }
 
 
-static int _i2c_receive(int pos, uint8_t *data, uint32_t len)
+static void _i2c_drainRx(volatile uint32_t *base, struct i2c_xfer *x)
 {
-	volatile uint32_t *base = i2c_common[pos].base;
-	while (len > 0) {
-		uint32_t rxNow = (len > 256) ? 256 : len;
-		len -= rxNow;
-		int ret = _i2c_putIntoFifo(pos, (uint16_t)cmd_rxdata | (rxNow - 1));
-		if (ret != EOK) {
-			return ret;
+	uint32_t n = _i2c_getFifoAvailable(base, true);
+
+	for (; (n > 0) && (x->rxLeft > 0); n--, x->rxLeft--) {
+		*x->rdata++ = *(base + mrdr) & 0xff;
+	}
+}
+
+
+#if I2C_DMA
+
+static uint8_t i2c_dmaSource(int dev)
+{
+#ifdef __CPU_IMXRT117X
+	return 13 + dev;
+#else
+	return 17 + dev;
+#endif
+}
+
+
+static int i2c_dmaErrorIntr(unsigned int n, void *arg)
+{
+	uint32_t err = edma_error_channel();
+	int pos;
+
+	for (pos = 0; pos < I2C_CNT; pos++) {
+		if ((i2c_common[pos].dma.buf != NULL) && ((err & (1uL << i2c_common[pos].dma.chan)) != 0)) {
+			edma_clear_error(i2c_common[pos].dma.chan);
+			i2c_common[pos].dma.err = 1;
 		}
+	}
+
+	return 0;
+}
+
+
+static int i2c_dmaIrqRoutine(unsigned int n, void *arg)
+{
+	struct periph_info *periph = arg;
+
+	edma_clear_interrupt(periph->dma.chan);
+	periph->dma.done = 1;
+
+	return 0;
+}
+
 
-		while (rxNow > 0) {
-			int ret = _i2c_waitForFifo(pos, true);
-			if (ret != EOK) {
-				return ret;
+static void _i2c_dmaStart(int pos, uint32_t len)
+{
+	volatile struct edma_tcd_s tcd;
+
+	/* Low byte of MRDR, completion is signalled after the last byte */
+	tcd.saddr = (uint32_t)(i2c_common[pos].base + mrdr);
+	tcd.soff = 0;
+	tcd.attr = (edma_get_tcd_attr_xsize(1) << 8) | edma_get_tcd_attr_xsize(1);
+	tcd.nbytes_mlno = 1;
+	tcd.slast = 0;
+	tcd.daddr = (uint32_t)i2c_common[pos].dma.buf;
+	tcd.doff = 1;
+	tcd.citer_elinkno = len;
+	tcd.biter_elinkno = len;
+	tcd.dlast_sga = 0;
+	tcd.csr = TCD_CSR_INTMAJOR | TCD_CSR_DREQ;
+	edma_install_tcd(&tcd, i2c_common[pos].dma.chan);
+
+	i2c_common[pos].dma.done = 0;
+	i2c_common[pos].dma.err = 0;
+	edma_channel_enable(i2c_common[pos].dma.chan);
+
+	/* Request on every received byte */
+	*(i2c_common[pos].base + mfcr) = FIFO_TXWATER;
+	*(i2c_common[pos].base + mder) = 1u << 1u;
+}
+
+
+/* Wait for RX DMA completion, I2C errors abort the wait */
+static int _i2c_waitForDma(int pos, struct i2c_xfer *x)
+{
+	volatile uint32_t *base = i2c_common[pos].base;
+	int ret = EOK;
+
+	mutexLock(i2c_common[pos].irqMutex);
+	while ((ret == EOK) && (i2c_common[pos].dma.done == 0)) {
+		i2c_common[pos].state = i2c_stateBusy;
+		common_dataBarrier();
+		*(base + mier) = STATUS_ERRORS;
+
+		/* DMA errors are reported without signalling the cond */
+		while ((i2c_common[pos].dma.done == 0) && (i2c_common[pos].dma.err == 0) && (i2c_common[pos].state != i2c_stateReady)) {
+			if (condWait(i2c_common[pos].irqCond, i2c_common[pos].irqMutex, 10 * 1000) < 0) {
+				ret = -ETIMEDOUT;
+				break;
 			}
+		}
+
+		*(base + mier) = 0;
 
-			*data = *(base + mrdr) & 0xff;
-			common_dataBarrier();
-			data++;
-			rxNow--;
+		if (i2c_common[pos].dma.err != 0) {
+			ret = -EIO;
+		}
+		else if ((ret == EOK) && (i2c_common[pos].state == i2c_stateReady)) {
+			ret = _i2c_getAndClearStatus(base);
+			if ((ret == RET_STOP) && x->stopQueued) {
+				/* Last byte may still be in flight */
+				x->stopDone = true;
+				ret = EOK;
+			}
 		}
 	}
+	mutexUnlock(i2c_common[pos].irqMutex);
 
-	return EOK;
+	return ret;
 }
 
 
-static inline int _i2c_start(int pos, uint8_t dev_addr, bool receive)
+static void _i2c_dmaFinish(int pos, struct i2c_xfer *x, bool ok)
 {
-	uint16_t cmd = (uint16_t)cmd_start | (uint16_t)(dev_addr << 1u) | (receive ? 1u : 0u);
-	return _i2c_putIntoFifo(pos, cmd);
+	*(i2c_common[pos].base + mder) = 0;
+
+	if (ok) {
+		memcpy(x->rdata, i2c_common[pos].dma.buf, x->rxLeft);
+		x->rdata += x->rxLeft;
+		x->rxLeft = 0;
+	}
+	else {
+		edma_channel_disable(i2c_common[pos].dma.chan);
+	}
 }
 
 
-static int _i2c_beginTransaction(int pos)
+static int i2c_dmaInit(int pos, int dev)
 {
-	volatile uint32_t *base = i2c_common[pos].base;
-	if (_i2c_checkBusBusy(base)) {
-		return -EBUSY;
+	int res;
+
+	i2c_common[pos].dma.buf = mmap(NULL, (I2C_DMA_BUFSZ + _PAGE_SIZE - 1) & ~(_PAGE_SIZE - 1), PROT_READ | PROT_WRITE, MAP_UNCACHED | MAP_ANONYMOUS, -1, 0);
+	if (i2c_common[pos].dma.buf == MAP_FAILED) {
+		i2c_common[pos].dma.buf = NULL;
+		return -ENOMEM;
 	}
 
-	/* Clear all flag */
-	*(base + msr) = 0x7f << 8u;
+	if ((res = edma_channel_alloc(EDMA_CHANNEL_ANY)) < 0) {
+		munmap(i2c_common[pos].dma.buf, (I2C_DMA_BUFSZ + _PAGE_SIZE - 1) & ~(_PAGE_SIZE - 1));
+		i2c_common[pos].dma.buf = NULL;
+		return res;
+	}
+	i2c_common[pos].dma.chan = res;
+
+	dmamux_set_source(i2c_common[pos].dma.chan, i2c_dmaSource(dev));
+	dmamux_channel_enable(i2c_common[pos].dma.chan);
+
+	interrupt(EDMA_CHANNEL_IRQ(i2c_common[pos].dma.chan), i2c_dmaIrqRoutine, &i2c_common[pos], i2c_common[pos].irqCond, NULL);
 
-	/* Turn off auto-stop option */
-	*(base + mcfgr1) &= ~(1u << 8u);
 	return EOK;
 }
 
+#endif
+
 
-static int _i2c_finishTransaction(int pos, int ret)
+/*
+ * Runs whole transfer: command FIFO is preloaded and refilled from the message list,
+ * wakeups happen only on FIFO watermarks (or DMA completion) instead of every byte.
+ */
+static int _i2c_transfer(int pos, const i2c_msg_t *msgs, unsigned int count, const uint8_t *wdata, uint8_t *rdata)
 {
+	volatile uint32_t *base = i2c_common[pos].base;
+	struct i2c_xfer x = { .msgs = msgs, .count = count, .wdata = wdata, .rdata = rdata };
+	uint32_t wait, rxWater;
+	unsigned int i;
+	int cmd, ret;
+
+	for (i = 0; i < count; i++) {
+		if ((msgs[i].flags & I2C_MSG_RD) != 0) {
+			/* Receive command has to read at least one byte */
+			if (msgs[i].len == 0) {
+				return -EINVAL;
+			}
+			x.rxLeft += msgs[i].len;
+		}
+	}
+
+	ret = _i2c_beginTransaction(pos);
 	if (ret != EOK) {
-		if (ret == RET_STOP) {
-			TRACE("unexpected STOP");
+		return ret;
+	}
+
+#if I2C_DMA
+	if ((i2c_common[pos].dma.buf != NULL) && (x.rxLeft >= I2C_DMA_MINLEN) && (x.rxLeft <= I2C_DMA_BUFSZ)) {
+		x.dma = true;
+		_i2c_dmaStart(pos, x.rxLeft);
+	}
+#endif
+
+	cmd = _i2c_nextCmd(&x);
+	for (;;) {
+		while ((cmd >= 0) && (_i2c_getFifoAvailable(base, false) > 0)) {
+			*(base + mtdr) = cmd;
+			cmd = _i2c_nextCmd(&x);
+		}
+		common_dataBarrier();
+
+		if (!x.dma) {
+			_i2c_drainRx(base, &x);
+		}
+
+		if ((cmd < 0) && ((x.rxLeft == 0) || x.dma)) {
+			break;
+		}
+
+		if (x.stopDone) {
+			/* Bus stopped with data still missing */
 			ret = -EIO;
+			break;
 		}
 
-		if (ret == -ETIMEDOUT) {
-			mutexLock(i2c_common[pos].irqMutex);
-			i2c_common[pos].state = i2c_stateReady;
-			/* cond may have been signalled before we turned off IRQ - try to take it to ensure it's
-			 * not signalled for next use */
-			condWait(i2c_common[pos].irqCond, i2c_common[pos].irqMutex, 1);
-			mutexUnlock(i2c_common[pos].irqMutex);
+		wait = 0;
+		if (cmd >= 0) {
+			wait |= STATUS_TXFIFO_WM;
 		}
 
-		/* Reset FIFOs */
-		*(i2c_common[pos].base + mcr) |= (1u << 9u) | (1u << 8u);
-		return ret;
+		if (!x.dma && (x.rxLeft > 0)) {
+			rxWater = ((x.rxLeft < FIFO_SIZE) ? x.rxLeft : FIFO_SIZE) - 1;
+			*(base + mfcr) = (rxWater << 16u) | FIFO_TXWATER;
+			wait |= STATUS_RXFIFO_WM;
+		}
+
+		ret = _i2c_waitForInterrupt(pos, wait);
+		if ((ret == RET_STOP) && x.stopQueued) {
+			/* Remaining data is already in RX FIFO */
+			x.stopDone = true;
+			ret = EOK;
+		}
+
+		if (ret != EOK) {
+			break;
+		}
+	}
+
+#if I2C_DMA
+	if (x.dma) {
+		if (ret == EOK) {
+			ret = _i2c_waitForDma(pos, &x);
+		}
+		_i2c_dmaFinish(pos, &x, ret == EOK);
 	}
+#endif
+
+	*(base + mfcr) = FIFO_TXWATER;
 
-	ret = _i2c_putIntoFifo(pos, (uint16_t)cmd_stop);
 	if (ret != EOK) {
-		return ret;
+		return _i2c_finishTransaction(pos, ret);
+	}
+
+	/* Flags are cleared on every wakeup, wait for STOP unless it has been seen */
+	while (!x.stopDone) {
+		ret = _i2c_waitForInterrupt(pos, STATUS_END);
+		if (ret == RET_STOP) {
+			break;
+		}
+		else if (ret != EOK) {
+			return _i2c_finishTransaction(pos, ret);
+		}
 	}
 
-	ret = _i2c_waitForInterrupt(pos, STATUS_END);
-	return ret == RET_STOP ? EOK : ret;
+	return EOK;
 }
 
 
 static int _i2c_busWrite(int pos, uint8_t dev_addr, const uint8_t *data, uint32_t len)
 {
-	int ret = _i2c_beginTransaction(pos);
-	ret = (ret == EOK) ? _i2c_start(pos, dev_addr, false) : ret;
-	ret = (ret == EOK) ? _i2c_transmit(pos, data, len) : ret;
-	return _i2c_finishTransaction(pos, ret);
+	i2c_msg_t msg = { .dev_addr = dev_addr, .flags = 0, .len = len };
+
+	if (len > UINT16_MAX) {
+		return -EINVAL;
+	}
+
+	return _i2c_transfer(pos, &msg, 1, data, NULL);
 }
 
+
 static int _i2c_busRead(int pos, uint8_t dev_addr, uint8_t *data, uint32_t len)
 {
-	int ret = _i2c_beginTransaction(pos);
-	ret = (ret == EOK) ? _i2c_start(pos, dev_addr, true) : ret;
-	ret = (ret == EOK) ? _i2c_receive(pos, data, len) : ret;
-	return _i2c_finishTransaction(pos, ret);
+	i2c_msg_t msg = { .dev_addr = dev_addr, .flags = I2C_MSG_RD, .len = len };
+
+	if (len > UINT16_MAX) {
+		return -EINVAL;
+	}
+
+	return _i2c_transfer(pos, &msg, 1, NULL, data);
 }
 
 
 /* Performs i2c regiester read operation from the given slave device */
 static int _i2c_regRead(int pos, uint8_t dev_addr, uint8_t reg_addr, uint8_t *data_out, uint32_t len)
 {
-	int ret = _i2c_beginTransaction(pos);
-	ret = (ret == EOK) ? _i2c_start(pos, dev_addr, false) : ret;
-	ret = (ret == EOK) ? _i2c_transmit(pos, &reg_addr, 1) : ret;
-	ret = (ret == EOK) ? _i2c_start(pos, dev_addr, true) : ret;
-	ret = (ret == EOK) ? _i2c_receive(pos, data_out, len) : ret;
-	return _i2c_finishTransaction(pos, ret);
+	i2c_msg_t msgs[2] = {
+		{ .dev_addr = dev_addr, .flags = 0, .len = 1 },
+		{ .dev_addr = dev_addr, .flags = I2C_MSG_RD, .len = len },
+	};
+
+	if (len > UINT16_MAX) {
+		return -EINVAL;
+	}
+
+	return _i2c_transfer(pos, msgs, 2, &reg_addr, data_out);
+}
+
+
+static int _i2c_rdwr(int pos, const i2c_msg_t *msgs, unsigned int count, const uint8_t *wdata, size_t wlen, uint8_t *rdata, size_t rlen)
+{
+	size_t wtotal = 0, rtotal = 0;
+	unsigned int i;
+
+	if ((count == 0) || (count > I2C_RDWR_MSGS_MAX)) {
+		return -EINVAL;
+	}
+
+	for (i = 0; i < count; i++) {
+		if ((msgs[i].flags & I2C_MSG_RD) != 0) {
+			rtotal += msgs[i].len;
+		}
+		else {
+			wtotal += msgs[i].len;
+		}
+	}
+
+	if (((wtotal != 0) && ((wdata == NULL) || (wtotal > wlen))) || ((rtotal != 0) && ((rdata == NULL) || (rtotal > rlen)))) {
+		return -EINVAL;
+	}
+
+	return _i2c_transfer(pos, msgs, count, wdata, rdata);
 }
 
 
@@ -435,15 +739,25 @@ static int i2c_devctl(int pos, msg_t *msg)
 	switch (ctl->i.type) {
 		case i2c_devctl_bus_write:
 			ret = _i2c_busWrite(pos, ctl->i.dev_addr, msg->i.data, msg->i.size);
+			break;
 
 		case i2c_devctl_bus_read:
 			ret = _i2c_busRead(pos, ctl->i.dev_addr, msg->o.data, msg->o.size);
+			break;
 
 		case i2c_devctl_reg_read:
 			ret = _i2c_regRead(pos, ctl->i.dev_addr, ctl->i.reg_addr, msg->o.data, msg->o.size);
+			break;
+
+		case i2c_devctl_rdwr: {
+			i2c_devctl_rdwr_t *rdwr = (i2c_devctl_rdwr_t *)msg->i.raw;
+			ret = _i2c_rdwr(pos, rdwr->i.msgs, rdwr->i.count, msg->i.data, msg->i.size, msg->o.data, msg->o.size);
+			break;
+		}
 
 		default:
 			ret = -ENOSYS;
+			break;
 	}
 
 	mutexUnlock(i2c_common[pos].mutex);
@@ -531,6 +845,20 @@ int multi_i2c_regRead(unsigned bus, uint8_t dev_addr, uint8_t reg_addr, uint8_t
 }
 
 
+int multi_i2c_transfer(unsigned bus, const i2c_msg_t *msgs, unsigned int count, const uint8_t *wdata, uint32_t wlen, uint8_t *rdata, uint32_t rlen)
+{
+	if (bus >= N_PERIPHERALS) {
+		return -EINVAL;
+	}
+
+	unsigned pos = i2cPreConfig[bus].pos;
+	mutexLock(i2c_common[pos].mutex);
+	int ret = _i2c_rdwr(pos, msgs, count, wdata, wlen, rdata, rlen);
+	mutexUnlock(i2c_common[pos].mutex);
+	return ret;
+}
+
+
 static int i2c_getMuxData(int mux, int *mode, int *isel, int *daisy)
 {
 	switch (mux) {
@@ -642,6 +970,9 @@ int i2c_init(void)
 {
 	TRACE();
 	int pos, dev;
+#if I2C_DMA
+	bool dmaInit = false;
+#endif
 
 	i2c_initPins();
 
@@ -691,6 +1022,18 @@ int i2c_init(void)
 
 		/* Attach ISR */
 		interrupt(i2c_common[pos].irqNo, i2c_irqRoutine, &i2c_common[pos], i2c_common[pos].irqCond, &i2c_common[pos].irqHandle);
+
+#if I2C_DMA
+		if (i2cPreConfig[dev].dma != 0) {
+			if (!dmaInit && (edma_init(i2c_dmaErrorIntr) < 0)) {
+				return -EFAULT;
+			}
+			dmaInit = true;
+
+			/* Fall back to FIFO transfers if DMA is not available */
+			(void)i2c_dmaInit(pos, dev);
+		}
+#endif
 		pos++;
 	}
 
@@ -15,6 +15,7 @@
 #define _I2C_H_
 
 #include <sys/msg.h>
+#include <i2c-msg.h>
 
 
 void i2c_handleMsg(msg_t *msg, int dev);
@@ -32,4 +33,8 @@ int multi_i2c_busRead(unsigned bus, uint8_t dev_addr, uint8_t *data_out, uint32_
 int multi_i2c_regRead(unsigned bus, uint8_t dev_addr, uint8_t reg_addr, uint8_t *data_out, uint32_t len);
 
 
+/* Combined transfer, see i2c_devctl_rdwr */
+int multi_i2c_transfer(unsigned bus, const i2c_msg_t *msgs, unsigned int count, const uint8_t *wdata, uint32_t wlen, uint8_t *rdata, uint32_t rlen);
+
+
 #endif
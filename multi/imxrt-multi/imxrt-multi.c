@@ -13,7 +13,9 @@
 
 
 #include <errno.h>
+#include <getopt.h>
 #include <libklog.h>
+#include <perfcnt.h>
 #include <paths.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -48,15 +50,26 @@
 #include "pct2075.h"
 #endif
 
-#define MULTI_THREADS_NO 2
 #define UART_THREADS_NO 2
 
 #define STACKSZ 1024
 
 
+/* Message worker classes, class_other is served by multi_port */
+enum { class_gpio = 0, class_spi, class_i2c, class_other, class_count };
+
+
+static const char *const classNames[class_count] = { "gpio", "spi", "i2c", "other" };
+
+
 struct {
 	uint32_t uart_port;
-	char stack[MULTI_THREADS_NO + UART_THREADS_NO - 1][STACKSZ] __attribute__ ((aligned(8)));
+	struct {
+		uint32_t port;
+		unsigned int threads;
+		int prio;
+	} cls[class_count];
+	char stack[MULTI_WORKERS_MAX + UART_THREADS_NO - 1][STACKSZ] __attribute__ ((aligned(8)));
 } common;
 
 
@@ -118,6 +131,7 @@ static void multi_dispatchMsg(msg_t *msg)
 		case id_cm4_1:
 		case id_cm4_2:
 		case id_cm4_3:
+		case id_cm4_bulk:
 			cm4_handleMsg(msg);
 			break;
 #endif
@@ -140,10 +154,14 @@ static void multi_dispatchMsg(msg_t *msg)
 #endif
 
 #if PSEUDODEV
+		case id_pseudoRandom:
+#if TRNG && TRNG_DRBG
+			trng_handleMsg(msg);
+			break;
+#endif
 		case id_pseudoNull:
 		case id_pseudoZero:
 		case id_pseudoFull:
-		case id_pseudoRandom:
 			if (pseudo_handleMsg(msg, multi2pseudo(id)) < 0) {
 				msg->o.err = -EPERM;
 			}
@@ -365,7 +383,7 @@ static int createDevFiles(void)
 	/* GPIOs */
 	for (i = 1; i <= GPIO_PORTS; ++i) {
 		sprintf(name, "gpio%d", i);
-		if (mkFile(&dir, id_gpio1 + i - 1, name, multi_port) < 0) {
+		if (mkFile(&dir, id_gpio1 + i - 1, name, common.cls[class_gpio].port) < 0) {
 			return -1;
 		}
 	}
@@ -373,25 +391,25 @@ static int createDevFiles(void)
 	/* SPIs */
 
 #if SPI1
-	if (mkFile(&dir, id_spi1, "spi1", multi_port) < 0) {
+	if (mkFile(&dir, id_spi1, "spi1", common.cls[class_spi].port) < 0) {
 		return -1;
 	}
 #endif
 
 #if SPI2
-	if (mkFile(&dir, id_spi2, "spi2", multi_port) < 0) {
+	if (mkFile(&dir, id_spi2, "spi2", common.cls[class_spi].port) < 0) {
 		return -1;
 	}
 #endif
 
 #if SPI3
-	if (mkFile(&dir, id_spi3, "spi3", multi_port) < 0) {
+	if (mkFile(&dir, id_spi3, "spi3", common.cls[class_spi].port) < 0) {
 		return -1;
 	}
 #endif
 
 #if SPI4
-	if (mkFile(&dir, id_spi4, "spi4", multi_port) < 0) {
+	if (mkFile(&dir, id_spi4, "spi4", common.cls[class_spi].port) < 0) {
 		return -1;
 	}
 #endif
@@ -399,13 +417,13 @@ static int createDevFiles(void)
 #ifdef __CPU_IMXRT117X
 
 #if SPI5
-	if (mkFile(&dir, id_spi5, "spi5", multi_port) < 0) {
+	if (mkFile(&dir, id_spi5, "spi5", common.cls[class_spi].port) < 0) {
 		return -1;
 	}
 #endif
 
 #if SPI6
-	if (mkFile(&dir, id_spi6, "spi6", multi_port) < 0) {
+	if (mkFile(&dir, id_spi6, "spi6", common.cls[class_spi].port) < 0) {
 		return -1;
 	}
 #endif
@@ -418,6 +436,12 @@ static int createDevFiles(void)
 			return -1;
 		}
 	}
+
+#if CM4_BULK_SIZE
+	if (mkFile(&dir, id_cm4_bulk, "cpuM4bulk", multi_port) < 0) {
+		return -1;
+	}
+#endif
 #endif
 
 #endif
@@ -425,25 +449,25 @@ static int createDevFiles(void)
 
 /* I2Cs */
 #if I2C1
-	if (mkFile(&dir, id_i2c1, "i2c1", multi_port) < 0) {
+	if (mkFile(&dir, id_i2c1, "i2c1", common.cls[class_i2c].port) < 0) {
 		return -1;
 	}
 #endif
 
 #if I2C2
-	if (mkFile(&dir, id_i2c2, "i2c2", multi_port) < 0) {
+	if (mkFile(&dir, id_i2c2, "i2c2", common.cls[class_i2c].port) < 0) {
 		return -1;
 	}
 #endif
 
 #if I2C3
-	if (mkFile(&dir, id_i2c3, "i2c3", multi_port) < 0) {
+	if (mkFile(&dir, id_i2c3, "i2c3", common.cls[class_i2c].port) < 0) {
 		return -1;
 	}
 #endif
 
 #if I2C4
-	if (mkFile(&dir, id_i2c4, "i2c4", multi_port) < 0) {
+	if (mkFile(&dir, id_i2c4, "i2c4", common.cls[class_i2c].port) < 0) {
 		return -1;
 	}
 #endif
@@ -452,13 +476,13 @@ static int createDevFiles(void)
 #ifdef __CPU_IMXRT117X
 
 #if I2C5
-	if (mkFile(&dir, id_i2c5, "i2c5", multi_port) < 0) {
+	if (mkFile(&dir, id_i2c5, "i2c5", common.cls[class_i2c].port) < 0) {
 		return -1;
 	}
 #endif
 
 #if I2C6
-	if (mkFile(&dir, id_i2c6, "i2c6", multi_port) < 0) {
+	if (mkFile(&dir, id_i2c6, "i2c6", common.cls[class_i2c].port) < 0) {
 		return -1;
 	}
 #endif
@@ -492,11 +516,17 @@ static int createDevFiles(void)
 
 static void multi_thread(void *arg)
 {
+	uint32_t port = (uint32_t)(uintptr_t)arg;
 	msg_t msg;
 	msg_rid_t rid;
 
 	while (1) {
-		while (msgRecv(multi_port, &msg, &rid) < 0) {
+		while (msgRecv(port, &msg, &rid) < 0) {
+		}
+
+		if (perfcnt_devctl(&msg) == 0) {
+			msgRespond(port, &msg, rid);
+			continue;
 		}
 
 		switch (msg.type) {
@@ -522,7 +552,7 @@ static void multi_thread(void *arg)
 				break;
 		}
 
-		msgRespond(multi_port, &msg, rid);
+		msgRespond(port, &msg, rid);
 	}
 }
 
@@ -541,6 +571,11 @@ static void uart_thread(void *arg)
 			continue;
 		}
 
+		if (perfcnt_devctl(&msg) == 0) {
+			msgRespond(common.uart_port, &msg, rid);
+			continue;
+		}
+
 		switch (msg.type) {
 			case mtRead:
 			case mtWrite:
@@ -582,16 +617,113 @@ extern int posixsrv_start(void);
 #endif
 
 
-int main(void)
+static int multi_parseWorkers(const char *arg)
 {
-	int i;
+	const char *sep = strchr(arg, ':');
+	char *end;
+	unsigned long threads;
+	long prio;
+	int cls;
+
+	if (sep == NULL) {
+		return -EINVAL;
+	}
+
+	for (cls = 0; cls < class_count; cls++) {
+		if ((strlen(classNames[cls]) == (size_t)(sep - arg)) && (strncmp(arg, classNames[cls], sep - arg) == 0)) {
+			break;
+		}
+	}
+
+	if (cls == class_count) {
+		return -EINVAL;
+	}
+
+	threads = strtoul(sep + 1, &end, 10);
+	if ((end == sep + 1) || ((cls == class_other) && (threads == 0))) {
+		return -EINVAL;
+	}
+
+	prio = common.cls[cls].prio;
+	if (*end == ':') {
+		sep = end + 1;
+		prio = strtol(sep, &end, 10);
+		if ((end == sep) || (prio < 0) || (prio > 7)) {
+			return -EINVAL;
+		}
+	}
+
+	if (*end != '\0') {
+		return -EINVAL;
+	}
+
+	common.cls[cls].threads = threads;
+	common.cls[cls].prio = prio;
+
+	return 0;
+}
+
+
+static void usage(const char *progname)
+{
+	printf("usage: %s [-w class:threads[:prio]]...\n", progname);
+	printf("\t-w  message workers of class gpio, spi, i2c or other (%d threads at most)\n", MULTI_WORKERS_MAX);
+}
+
+
+int main(int argc, char *argv[])
+{
+	int i, c, cls;
+	unsigned int j, total;
 	oid_t oid;
 
+	common.cls[class_gpio].threads = MULTI_GPIO_THREADS_NO;
+	common.cls[class_gpio].prio = MULTI_GPIO_PRIO;
+	common.cls[class_spi].threads = MULTI_SPI_THREADS_NO;
+	common.cls[class_spi].prio = MULTI_SPI_PRIO;
+	common.cls[class_i2c].threads = MULTI_I2C_THREADS_NO;
+	common.cls[class_i2c].prio = MULTI_I2C_PRIO;
+	common.cls[class_other].threads = MULTI_THREADS_NO;
+	common.cls[class_other].prio = IMXRT_MULTI_PRIO;
+
+	while ((c = getopt(argc, argv, "w:")) != -1) {
+		switch (c) {
+			case 'w':
+				if (multi_parseWorkers(optarg) < 0) {
+					usage(argv[0]);
+					return EXIT_FAILURE;
+				}
+				break;
+
+			default:
+				usage(argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	for (cls = 0, total = 0; cls < class_count; cls++) {
+		total += common.cls[cls].threads;
+	}
+
+	if (total > MULTI_WORKERS_MAX) {
+		printf("imxrt-multi: %u message workers requested, %d available\n", total, MULTI_WORKERS_MAX);
+		return EXIT_FAILURE;
+	}
+
 	priority(IMXRT_MULTI_PRIO);
 
 	portCreate(&common.uart_port);
 	portCreate(&multi_port);
 
+	for (cls = 0; cls < class_count; cls++) {
+		if ((cls != class_other) && (common.cls[cls].threads != 0)) {
+			portCreate(&common.cls[cls].port);
+		}
+		else {
+			common.cls[cls].port = multi_port;
+		}
+	}
+
 #if BUILTIN_DUMMYFS
 	fs_init();
 #else
@@ -606,21 +738,24 @@ int main(void)
 	rtt_init();
 	spi_init();
 	i2c_init();
+#if PCT2075
+	pct2075_init();
+#endif
 
 	oid.port = common.uart_port;
 	oid.id = id_console;
 	create_dev(&oid, _PATH_CONSOLE);
 
 #if !ISEMPTY(RTT_CONSOLE_USER)
-	libklog_init(rtt_klogCblk);
+	libklog_initNb(rtt_klogCblk);
 #else
-	libklog_init(uart_klogCblk);
+	libklog_initNb(uart_klogCblk);
 #endif
 	oid_t kmsgctrl = { .port = common.uart_port, .id = id_kmsgctrl };
 	libklog_ctrlRegister(&kmsgctrl);
 
 #if TRNG
-	trng_init();
+	int trngErr = trng_init();
 #endif
 
 #if CM4
@@ -632,15 +767,31 @@ int main(void)
 #endif
 
 #if PSEUDODEV
-	pseudo_init();
+	if (pseudo_init() < 0) {
+		printf("imxrt-multi: failed to initialize pseudo devices\n");
+		return EXIT_FAILURE;
+	}
+#if TRNG
+	if (trngErr == EOK) {
+		uint8_t seed[32];
+		int seedLen = trng_getEntropy(seed, sizeof(seed));
+		if (seedLen > 0) {
+			pseudo_seed(seed, seedLen);
+		}
+		memset(seed, 0, sizeof(seed));
+	}
+#endif
 #endif
 
 	for (i = 0; i < UART_THREADS_NO; ++i) {
 		beginthread(uart_thread, IMXRT_MULTI_PRIO, common.stack[i], STACKSZ, (void *)i);
 	}
 
-	for (; i < (MULTI_THREADS_NO + UART_THREADS_NO - 1); ++i) {
-		beginthread(multi_thread, IMXRT_MULTI_PRIO, common.stack[i], STACKSZ, (void *)i);
+	/* Main thread becomes the last class_other worker */
+	for (cls = 0; cls < class_count; cls++) {
+		for (j = (cls == class_other) ? 1 : 0; j < common.cls[cls].threads; ++j, ++i) {
+			beginthread(multi_thread, common.cls[cls].prio, common.stack[i], STACKSZ, (void *)(uintptr_t)common.cls[cls].port);
+		}
 	}
 
 	if (createDevFiles() < 0) {
@@ -648,7 +799,8 @@ int main(void)
 		return EXIT_FAILURE;
 	}
 
-	multi_thread((void *)i);
+	priority(common.cls[class_other].prio);
+	multi_thread((void *)(uintptr_t)multi_port);
 
 	/* never reached */
 	return EXIT_FAILURE;
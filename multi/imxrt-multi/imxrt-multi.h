@@ -14,7 +14,9 @@
 #ifndef _IMXRT_MULTI_H_
 #define _IMXRT_MULTI_H_
 
+#include <stdint.h>
 #include <stdlib.h>
+#include <sys/ioctl.h>
 
 
 /* IDs of special files OIDs */
@@ -29,7 +31,7 @@ enum { id_console = 0, id_uart1, id_uart2, id_uart3, id_uart4, id_uart5, id_uart
 	id_i2c1, id_i2c2, id_i2c3, id_i2c4,
 #ifdef __CPU_IMXRT117X
 	id_i2c5, id_i2c6,
-	id_cm4_0, id_cm4_1, id_cm4_2, id_cm4_3,
+	id_cm4_0, id_cm4_1, id_cm4_2, id_cm4_3, id_cm4_bulk,
 #endif
 	id_trng, id_pseudoNull, id_pseudoZero, id_pseudoFull, id_pseudoRandom, id_kmsgctrl, id_temp1,
 	id_rtt0, id_rtt1,
@@ -40,6 +42,50 @@ enum { id_console = 0, id_uart1, id_uart2, id_uart3, id_uart4, id_uart5, id_uart
 #pragma pack(push, 8)
 
 
+/* UART */
+
+
+#define UART_STATS_LAT_BUCKETS 8
+
+
+typedef struct {
+	uint32_t irqs;       /* UART and DMA channel interrupts */
+	uint32_t rxBytes;    /* Bytes passed to libtty */
+	uint32_t txBytes;    /* Bytes passed to the transmitter */
+	uint32_t hwOverruns; /* Receiver FIFO overruns */
+	uint32_t swOverruns; /* Bytes lost on overflow of the fifo between ISR and thread */
+	uint32_t rxFifoMax;  /* Max number of bytes drained by the thread at once */
+	/*
+	 * Age of the oldest byte of each drained batch, estimated from the batch length and character time.
+	 * Bucket i counts batches younger than (128 << i) us, the last one also the older ones.
+	 */
+	uint32_t rxLatency[UART_STATS_LAT_BUCKETS];
+} uart_stats_t;
+
+
+/* Returns statistics, only overruns are counted if built without UART_STATS */
+#define UART_GETSTATS _IOR('u', 0x01, uart_stats_t)
+/* Clears statistics */
+#define UART_CLRSTATS _IO('u', 0x02)
+
+
+
+/* TRNG */
+
+
+typedef struct {
+	uint32_t poolSize;    /* Entropy pool capacity, 0 if built without it */
+	uint32_t poolAvail;   /* Bytes currently in the pool */
+	uint32_t poolMisses;  /* /dev/random reads served directly from TRNG */
+	uint32_t hwErrors;    /* TRNG generation errors */
+	uint32_t drbgSeeded;  /* /dev/urandom DRBG has been seeded */
+	uint32_t drbgReseeds; /* DRBG (re)seeds from TRNG */
+} trng_status_t;
+
+
+#define TRNG_GETSTATUS _IOR('r', 0x01, trng_status_t)
+
+
 /* GPIO */
 
 
@@ -70,8 +116,29 @@ enum { spi_msb = 0, spi_lsb = 1};
 enum { spi_mode_0 = 0, spi_mode_1, spi_mode_2, spi_mode_3 };
 
 
+/* Keep CS asserted after batch transaction, next one has to use the same CS */
+#define SPI_BATCH_CSHOLD (1 << 0)
+
+/* No TX data (zeros are sent) or RX data is discarded */
+#define SPI_BATCH_NODATA ((unsigned int)-1)
+
+
+/*
+ * spi_batch descriptor, i.data starts with an array of them followed by TX data.
+ * txOffs is relative to i.data, rxOffs to o.data.
+ */
+typedef struct {
+	unsigned int txOffs;
+	unsigned int rxOffs;
+	unsigned int len;
+	unsigned int delayUs; /* After transaction, CS is deasserted first unless SPI_BATCH_CSHOLD is set */
+	unsigned char cs;
+	unsigned char flags;
+} spi_batch_t;
+
+
 typedef struct {
-	enum { spi_config = 0, spi_transaction } type;
+	enum { spi_config = 0, spi_transaction, spi_batch } type;
 
 	union {
 		struct {
@@ -86,6 +153,10 @@ typedef struct {
 			unsigned int frameSize;
 			unsigned char cs;
 		} transaction;
+
+		struct {
+			unsigned int count;
+		} batch;
 	};
 
 } spi_t;
@@ -109,6 +180,19 @@ enum i2c_speeds {
 #define CM4_RUN_CORE   2
 #define CM4_RESET_CORE 3
 
+/* Bulk channel (cpuM4bulk), zero-copy access to shared memory rings */
+#define CM4_BULK_ACQUIRE 4 /* o.data: cm4_bulkBuf_t with contiguous free TX space */
+#define CM4_BULK_COMMIT  5 /* cm4.len: bytes written to acquired space */
+#define CM4_BULK_PEEK    6 /* o.data: cm4_bulkBuf_t with contiguous RX data */
+#define CM4_BULK_RELEASE 7 /* cm4.len: bytes consumed from peeked data */
+#define CM4_BULK_WAIT    8 /* cm4.len: timeout [us], waits for RX data */
+
+
+typedef struct {
+	void *addr;
+	size_t len;
+} cm4_bulkBuf_t;
+
 
 /* MULTI */
 
@@ -118,6 +202,10 @@ typedef struct {
 		gpio_t gpio;
 		spi_t spi;
 		int cm4_type;
+		struct {
+			int type;
+			unsigned int len;
+		} cm4;
 	};
 } multi_i_t;
 
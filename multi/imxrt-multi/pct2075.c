@@ -17,13 +17,36 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <poll.h>
+#include <sys/interrupt.h>
+#include <sys/threads.h>
 
 #include "common.h"
+#include "gpio.h"
 #include "i2c.h"
+#include "pct2075.h"
 #if PCT2075
 
 
 static const uint8_t TEMP_REG_ADDR = 0x00u; /* stored temperature value - 16bit */
+#ifdef PCT2075_OS_IRQ
+static const uint8_t THYST_REG_ADDR = 0x02u; /* hysteresis - 16bit, 9 bits used */
+static const uint8_t TOS_REG_ADDR = 0x03u;   /* overtemperature shutdown - 16bit, 9 bits used */
+#endif
+
+
+static struct {
+	handle_t lock;
+	handle_t cond;
+	int32_t temp;
+	int err;
+	time_t stamp; /* time of the last sample */
+	int alert;
+#ifdef PCT2075_OS_IRQ
+	handle_t irqHandle;
+#endif
+	char stack[1024] __attribute__((aligned(8)));
+} pct2075_common;
 
 
 /* Get temperature in miliCelsius */
@@ -46,6 +69,120 @@ static int pct2075_getTemp(int32_t *tempOut)
 }
 
 
+/* Returns cached sample if it's not older than two sampling periods, reads the sensor otherwise */
+static int pct2075_getCached(int32_t *tempOut)
+{
+	time_t now;
+	int ret;
+
+	gettime(&now, NULL);
+
+	mutexLock(pct2075_common.lock);
+	if ((pct2075_common.err == EOK) && (now - pct2075_common.stamp < 2 * PCT2075_SAMPLE_MS * 1000LL)) {
+		*tempOut = pct2075_common.temp;
+		mutexUnlock(pct2075_common.lock);
+		return EOK;
+	}
+	mutexUnlock(pct2075_common.lock);
+
+	ret = pct2075_getTemp(tempOut);
+
+	mutexLock(pct2075_common.lock);
+	pct2075_common.err = ret;
+	if (ret == EOK) {
+		pct2075_common.temp = *tempOut;
+		pct2075_common.stamp = now;
+	}
+	mutexUnlock(pct2075_common.lock);
+
+	return ret;
+}
+
+
+#ifdef PCT2075_OS_IRQ
+static int pct2075_osIntr(unsigned int n, void *arg)
+{
+	return (gpio_irqAck(PCT2075_OS_PORT, 1u << PCT2075_OS_PIN) != 0) ? 0 : -1;
+}
+
+
+static int pct2075_writeLimit(uint8_t reg, int32_t mC)
+{
+	/* 0.5 C resolution, left adjusted */
+	int16_t raw = (int16_t)((mC / 500) << 7);
+	uint8_t buf[3] = { reg, (uint8_t)((uint16_t)raw >> 8), (uint8_t)raw };
+
+	return multi_i2c_busWrite(PCT2075_BUS_NUM - 1, PCT2075_DEV_ADDR, buf, sizeof(buf));
+}
+#endif
+
+
+static void pct2075_thread(void *arg)
+{
+	int32_t temp;
+	time_t now;
+	int ret;
+#ifdef PCT2075_OS_IRQ
+	uint32_t val;
+#endif
+
+	mutexLock(pct2075_common.lock);
+	for (;;) {
+		mutexUnlock(pct2075_common.lock);
+		ret = pct2075_getTemp(&temp);
+		gettime(&now, NULL);
+		mutexLock(pct2075_common.lock);
+
+		pct2075_common.err = ret;
+		if (ret == EOK) {
+			pct2075_common.temp = temp;
+			pct2075_common.stamp = now;
+		}
+
+#ifdef PCT2075_OS_IRQ
+		/* OS output is active low in comparator mode, asserted from Tos until below Thyst */
+		if (gpio_getPort(PCT2075_OS_PORT, &val) == EOK) {
+			pct2075_common.alert = ((val & (1u << PCT2075_OS_PIN)) == 0) ? 1 : 0;
+		}
+#endif
+
+		/* Woken up early on OS pin change */
+		condWait(pct2075_common.cond, pct2075_common.lock, PCT2075_SAMPLE_MS * 1000);
+	}
+}
+
+
+int pct2075_init(void)
+{
+	if (PCT2075_BUS_NUM <= 0) {
+		return -EINVAL;
+	}
+
+	if (mutexCreate(&pct2075_common.lock) < 0) {
+		return -ENOMEM;
+	}
+
+	if (condCreate(&pct2075_common.cond) < 0) {
+		resourceDestroy(pct2075_common.lock);
+		return -ENOMEM;
+	}
+
+	pct2075_common.err = -EAGAIN;
+
+#ifdef PCT2075_OS_IRQ
+	if ((pct2075_writeLimit(TOS_REG_ADDR, PCT2075_TOS) < 0) || (pct2075_writeLimit(THYST_REG_ADDR, PCT2075_THYST) < 0)) {
+		return -EIO;
+	}
+
+	gpio_setDir(PCT2075_OS_PORT, 1u << PCT2075_OS_PIN, 0);
+	interrupt(PCT2075_OS_IRQ, pct2075_osIntr, NULL, pct2075_common.cond, &pct2075_common.irqHandle);
+	gpio_irqConfig(PCT2075_OS_PORT, PCT2075_OS_PIN, 1);
+#endif
+
+	return beginthread(pct2075_thread, IMXRT_MULTI_PRIO, pct2075_common.stack, sizeof(pct2075_common.stack), NULL);
+}
+
+
 void pct2075_handleMsg(msg_t *msg)
 {
 	switch (msg->type) {
@@ -63,7 +200,7 @@ void pct2075_handleMsg(msg_t *msg)
 			}
 			else {
 				int32_t temp;
-				int ret = pct2075_getTemp(&temp);
+				int ret = pct2075_getCached(&temp);
 				if (ret == EOK) {
 					ret = snprintf(msg->o.data, msg->o.size, "%d\n", temp);
 					if ((ret > 0) && ((size_t)ret > msg->o.size)) {
@@ -74,6 +211,18 @@ void pct2075_handleMsg(msg_t *msg)
 				msg->o.err = ret;
 			}
 			break;
+		case mtGetAttr:
+			if (msg->i.attr.type == atPollStatus) {
+				/* POLLPRI while over temperature */
+				mutexLock(pct2075_common.lock);
+				msg->o.attr.val = POLLIN | POLLRDNORM | ((pct2075_common.alert != 0) ? POLLPRI : 0);
+				mutexUnlock(pct2075_common.lock);
+				msg->o.err = EOK;
+			}
+			else {
+				msg->o.err = -EINVAL;
+			}
+			break;
 		default:
 			msg->o.err = -ENOSYS;
 			break;
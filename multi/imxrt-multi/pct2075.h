@@ -22,4 +22,8 @@
 void pct2075_handleMsg(msg_t *msg);
 
 
+/* Starts background sampling, requires i2c and gpio initialized */
+int pct2075_init(void);
+
+
 #endif /* _PCT2075_H_ */
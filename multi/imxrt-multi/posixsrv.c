@@ -22,8 +22,9 @@
 #define POSIXSRV_PRIO IMXRT_MULTI_PRIO
 #endif
 
+/* Request workers besides the event and timeout threads */
 #ifndef POSIXSRV_THREADS_NO
-#define POSIXSRV_THREADS_NO 1
+#define POSIXSRV_THREADS_NO 2
 #endif
 
 
@@ -21,6 +21,7 @@
 #include <sys/mman.h>
 #include <sys/threads.h>
 #include <sys/file.h>
+#include <poll.h>
 
 #include <librtt.h>
 
@@ -40,6 +41,12 @@
 #define RTT_RATE_MAX_US          32768
 #define RTT_RATE_MIN_US          2048
 
+/* Data moved in one poll above which the interval is tightened faster */
+#define RTT_BUSY_THRESHOLD (RTT_RX_BUF_SIZE / 2)
+
+/* RX chunk copied from RTT buffer to libtty at once */
+#define RTT_RX_CHUNK 64
+
 /* Doesn't need to be large, data will mostly be stored in RTT buffers */
 #define TTY_BUF_SIZE 64
 
@@ -66,6 +73,9 @@ static const int rttConfig[] = { RTT0, RTT1 };
 static const int rttBlocking[] = { RTT0_BLOCKING, RTT1_BLOCKING };
 
 
+static const int rttRaw[] = { RTT0_RAW, RTT1_RAW };
+
+
 static const int rttPos[] = { RTT0_POS, RTT1_POS };
 
 
@@ -78,6 +88,77 @@ static inline ssize_t rtt_txAvailMode(unsigned int chn)
 }
 
 
+/* Copies spans between RTT buffers and libtty, returns number of bytes moved */
+static size_t rtt_pump(rtt_t *uart, int *timeout, int pollingRate)
+{
+	unsigned char buf[RTT_RX_CHUNK];
+	const uint8_t *span;
+	size_t moved = 0, len;
+	ssize_t n, onTx = rtt_txAvailMode(uart->chn);
+	int drop;
+
+	if (rttBlocking[uart->chn] == 0) {
+		/* Do nothing, in this case the remaining code is unnecessary */
+	}
+	else if (librtt_txCheckReaderAttached(uart->chn) != 0) {
+		*timeout = RTT_NO_PICKUP_TIMEOUT_US;
+	}
+	else if (onTx == 0) {
+		if (*timeout == 0) {
+			onTx = 1;
+		}
+		else {
+			*timeout = max(0, *timeout - pollingRate);
+		}
+	}
+
+	if ((librtt_rxAvail(uart->chn) == 0) && ((onTx == 0) || (libtty_txready(&uart->tty_common) == 0))) {
+		return 0;
+	}
+
+	/* Data that can't be written is dropped unless we wait for the reader */
+	drop = (rttBlocking[uart->chn] == 0) || (*timeout == 0);
+
+	mutexLock(uart->lock);
+	const unsigned char mask = ((uart->tty_common.term.c_cflag & CSIZE) == CS7) ? 0x7f : 0xff;
+	while ((n = librtt_read(uart->chn, buf, sizeof(buf))) > 0) {
+		if (mask != 0xff) {
+			for (ssize_t i = 0; i < n; i++) {
+				buf[i] &= mask;
+			}
+		}
+
+		libtty_putchars(&uart->tty_common, buf, n, NULL);
+		moved += n;
+	}
+
+	while ((onTx > 0) && ((len = libtty_tx_span(&uart->tty_common, &span)) != 0)) {
+		n = librtt_write(uart->chn, span, len, 0);
+		if (n < 0) {
+			n = 0;
+		}
+
+		if (((size_t)n < len) && (drop != 0)) {
+			uart->diag_txSkipped += len - n;
+			n = len;
+		}
+
+		if (n == 0) {
+			break;
+		}
+
+		libtty_tx_consume(&uart->tty_common, n, NULL);
+		moved += n;
+
+		onTx = (drop != 0) ? 1 : rtt_txAvailMode(uart->chn);
+	}
+
+	mutexUnlock(uart->lock);
+
+	return moved;
+}
+
+
 static void rtt_thread(void *arg)
 {
 	int timeout[RTT_ACTIVE_CNT];
@@ -86,57 +167,16 @@ static void rtt_thread(void *arg)
 	int idleTimeout = 0;
 
 	for (;;) {
-		unsigned chnsIdle = 0;
+		size_t moved = 0;
 		for (int chn_idx = 0; chn_idx < RTT_ACTIVE_CNT; chn_idx++) {
 			rtt_t *uart = &rtt_common.uarts[chn_idx];
-			unsigned char data;
-			ssize_t onRx = librtt_rxAvail(uart->chn);
-			ssize_t onTx = rtt_txAvailMode(uart->chn);
-			int txReady = libtty_txready(&uart->tty_common);
-
-			if (rttBlocking[uart->chn] == 0) {
-				/* Do nothing, in this case the remaining code is unnecessary */
-			}
-			else if (librtt_txCheckReaderAttached(uart->chn) != 0) {
-				timeout[chn_idx] = RTT_NO_PICKUP_TIMEOUT_US;
+			if (rttRaw[uart->chn] == 0) {
+				moved += rtt_pump(uart, &timeout[chn_idx], pollingRate);
 			}
-			else if (onTx == 0) {
-				if (timeout[chn_idx] == 0) {
-					onTx = 1;
-				}
-				else {
-					timeout[chn_idx] = max(0, timeout[chn_idx] - pollingRate);
-				}
-			}
-
-			if ((onRx == 0) && ((txReady == 0) || (onTx == 0))) {
-				chnsIdle++;
-				continue;
-			}
-
-			mutexLock(uart->lock);
-			const unsigned char mask = ((uart->tty_common.term.c_cflag & CSIZE) == CS7) ? 0x7f : 0xff;
-			while (onRx > 0) {
-				librtt_read(uart->chn, &data, 1);
-				libtty_putchar(&uart->tty_common, data & mask, NULL);
-				onRx = librtt_rxAvail(uart->chn);
-			}
-
-			while ((onTx > 0) && (txReady != 0)) {
-				data = libtty_getchar(&uart->tty_common, NULL);
-				ssize_t written = librtt_write(uart->chn, &data, 1, 0);
-				if (written <= 0) {
-					uart->diag_txSkipped++;
-				}
-
-				onTx = (timeout[chn_idx] == 0) ? 1 : rtt_txAvailMode(uart->chn);
-				txReady = libtty_txready(&uart->tty_common);
-			}
-
-			mutexUnlock(uart->lock);
 		}
 
-		if (chnsIdle == RTT_ACTIVE_CNT) {
+		/* Back off gradually when idle, tighten quickly under traffic */
+		if (moved == 0) {
 			if (idleTimeout == 0) {
 				pollingRate = RTT_RATE_IDLE_US;
 			}
@@ -151,7 +191,7 @@ static void rtt_thread(void *arg)
 			}
 
 			idleTimeout = RTT_IDLE_TIMEOUT_US;
-			pollingRate = max(RTT_RATE_MIN_US, pollingRate / 2);
+			pollingRate = max(RTT_RATE_MIN_US, pollingRate / ((moved >= RTT_BUSY_THRESHOLD) ? 4 : 2));
 		}
 
 		usleep(pollingRate);
@@ -176,6 +216,10 @@ static int rtt_initOne(rtt_t *uart, int chn, unsigned char *buf)
 	}
 
 	ret = (ret == 0) ? mutexCreate(&uart->lock) : ret;
+	if (rttRaw[chn] != 0) {
+		return ret;
+	}
+
 	/* TODO: calculate approx. baud rate based on buffer size and polling rate */
 	ret = (ret == 0) ? libtty_init(&uart->tty_common, &callbacks, TTY_BUF_SIZE, libtty_int_to_baudrate(115200)) : ret;
 
@@ -273,18 +317,82 @@ int rtt_init(void)
 		}
 	}
 
+#if !ISEMPTY(RTT_TRACE)
+	/* Trace buffer follows tty buffers, channel is left alone if initialized by plo */
+	if (doInit != 0) {
+		ret = ((nextBuf + RTT_TRACE_BUF_SIZE - (unsigned char *)rttMemPtr) <= bufSz) ? librtt_initChannel(1, RTT_TRACE, nextBuf, RTT_TRACE_BUF_SIZE) : -ENOMEM;
+	}
+	ret = (ret == 0) ? librtt_traceInit(RTT_TRACE) : ret;
+	if (ret != 0) {
+		librtt_done();
+		return ret;
+	}
+#endif
+
 	ret = beginthread(rtt_thread, IMXRT_MULTI_PRIO, rtt_common.stack, sizeof(rtt_common.stack), NULL);
 	return ret;
 }
 
-void rtt_klogCblk(const char *data, size_t size)
+ssize_t rtt_klogCblk(const char *data, size_t size)
 {
 #if !ISEMPTY(RTT_CONSOLE_USER)
-	libtty_write(&rtt_common.uarts[rttPos[RTT_CONSOLE_USER]].tty_common, data, size, 0);
+	if (rttRaw[RTT_CONSOLE_USER] != 0) {
+		return librtt_write(RTT_CONSOLE_USER, data, size, 1);
+	}
+
+	return libtty_write(&rtt_common.uarts[rttPos[RTT_CONSOLE_USER]].tty_common, data, size, O_NONBLOCK);
+#else
+	return size;
 #endif
 }
 
 
+/* Raw channels don't block - partial transfers, -EAGAIN if nothing could be done */
+static void rtt_handleRawMsg(msg_t *msg, rtt_t *uart)
+{
+	ssize_t ret;
+	int events;
+
+	switch (msg->type) {
+		case mtWrite:
+			mutexLock(uart->lock);
+			ret = librtt_write(uart->chn, msg->i.data, msg->i.size, (rttBlocking[uart->chn] == 0) ? 1 : 0);
+			mutexUnlock(uart->lock);
+			msg->o.err = ((ret == 0) && (msg->i.size != 0)) ? -EAGAIN : ret;
+			break;
+
+		case mtRead:
+			mutexLock(uart->lock);
+			ret = librtt_read(uart->chn, msg->o.data, msg->o.size);
+			mutexUnlock(uart->lock);
+			msg->o.err = ((ret == 0) && (msg->o.size != 0)) ? -EAGAIN : ret;
+			break;
+
+		case mtGetAttr:
+			if (msg->i.attr.type != atPollStatus) {
+				msg->o.err = -ENOSYS;
+				break;
+			}
+
+			events = 0;
+			if (librtt_rxAvail(uart->chn) > 0) {
+				events |= POLLIN | POLLRDNORM;
+			}
+			if ((rttBlocking[uart->chn] == 0) || (librtt_txAvail(uart->chn) > 0)) {
+				events |= POLLOUT | POLLWRNORM;
+			}
+
+			msg->o.attr.val = events;
+			msg->o.err = EOK;
+			break;
+
+		default:
+			msg->o.err = -ENOSYS;
+			break;
+	}
+}
+
+
 int rtt_handleMsg(msg_t *msg, int dev)
 {
 	unsigned long request;
@@ -301,6 +409,11 @@ int rtt_handleMsg(msg_t *msg, int dev)
 
 	uart = &rtt_common.uarts[rttPos[dev]];
 
+	if (rttRaw[dev] != 0) {
+		rtt_handleRawMsg(msg, uart);
+		return EOK;
+	}
+
 	switch (msg->type) {
 		case mtWrite:
 			msg->o.err = libtty_write(&uart->tty_common, msg->i.data, msg->i.size, msg->i.io.mode);
@@ -26,7 +26,7 @@ int rtt_init(void);
 int rtt_handleMsg(msg_t *msg, int dev);
 
 
-void rtt_klogCblk(const char *data, size_t size);
+ssize_t rtt_klogCblk(const char *data, size_t size);
 
 
 #endif /* _RTT_H_ */
@@ -14,12 +14,19 @@
 
 #include <errno.h>
 #include <stdint.h>
+#include <string.h>
 #include <sys/interrupt.h>
+#include <sys/mman.h>
 #include <sys/msg.h>
+#include <sys/platform.h>
 #include <sys/threads.h>
+#include <unistd.h>
+
+#include <edma.h>
 
 #include "common.h"
 #include "spi.h"
+#include "trace.h"
 
 #define SPI1_POS 0
 #define SPI2_POS (SPI1_POS + SPI1)
@@ -34,6 +41,28 @@
 #define WORD_SIZE sizeof(uint32_t)
 #define MAX_FIFOSZ_BYTES 16 * WORD_SIZE
 
+/* TCR continuous transfer and continuing command bits */
+#define TCR_CONT  (1 << 21)
+#define TCR_CONTC (1 << 20)
+
+/* Shorter transfers are not worth DMA setup */
+#ifndef SPI_DMA_MINLEN
+#define SPI_DMA_MINLEN 32
+#endif
+
+/* Uncached RX bounce buffer, longer transfers are done in rounds */
+#ifndef SPI_DMA_BUFSZ
+#define SPI_DMA_BUFSZ 1024
+#endif
+
+#if SPI_DMA_BUFSZ > 0x7fff
+#error "SPI_DMA_BUFSZ exceeds eDMA major loop count"
+#endif
+
+/* TCD CSR bits */
+#define TCD_CSR_INTMAJOR (1 << 1)
+#define TCD_CSR_DREQ     (1 << 3)
+
 
 enum { spi_verid = 0, spi_param, spi_cr = 0x4, spi_sr, spi_ier, spi_der, spi_cfgr0, spi_cfgr1, spi_dmr0 = 0xc,
 	   spi_dmr1, spi_ccr = 0x10, spi_fcr = 0x16, spi_fsr, spi_tcr, spi_tdr, spi_rsr = 0x1c, spi_rdr };
@@ -50,13 +79,30 @@ struct {
 	volatile uint32_t *base;
 
 	uint32_t tcr;
+	int cont; /* PCS kept asserted after previous transfer */
+
+#if SPI_DMA
+	struct {
+		uint8_t *buf; /* RX bounce buffer followed by zero word sent if there is no TX data, NULL if DMA is not used */
+		int rxChan;
+		int txChan;
+		volatile int err;
+	} dma;
+#endif
 } spi_common[SPI_CNT];
 
 
-static const int spiConfig[] = { SPI1, SPI2, SPI3, SPI4 , SPI5, SPI6};
+#if SPI_DMA
+static const int spiDma[] = { SPI1_DMA, SPI2_DMA, SPI3_DMA, SPI4_DMA, SPI5_DMA, SPI6_DMA };
+#endif
+
+
+/* SPI number to spi_common[] index, -1 if disabled, checked and translated with a single load on every request */
+#define SPI_IDX(n) ((SPI##n) ? SPI##n##_POS : -1)
 
+static const int8_t spiPos[] = { SPI_IDX(1), SPI_IDX(2), SPI_IDX(3), SPI_IDX(4), SPI_IDX(5), SPI_IDX(6) };
 
-static const int spiPos[] = { SPI1_POS, SPI2_POS, SPI3_POS, SPI4_POS , SPI5_POS, SPI6_POS};
+#undef SPI_IDX
 
 
 static inline uint32_t spi_deserializeWord(const uint8_t *buff)
@@ -118,6 +164,12 @@ static void spi_txBytes(int spi, const uint8_t *txBuff, int bytesNumber)
 {
 	uint32_t word;
 
+	if (txBuff == NULL) {
+		for (; bytesNumber > 0; bytesNumber -= WORD_SIZE)
+			*(spi_common[spi].base + spi_tdr) = 0;
+		return;
+	}
+
 	while (bytesNumber / WORD_SIZE) {
 		*(spi_common[spi].base + spi_tdr) = spi_deserializeWord(txBuff);
 		txBuff += WORD_SIZE;
@@ -137,6 +189,12 @@ static void spi_rxBytes(int spi, uint8_t *rxBuff, int bytesNumber)
 {
 	uint32_t word;
 
+	if (rxBuff == NULL) {
+		for (; bytesNumber > 0; bytesNumber -= WORD_SIZE)
+			(void)*(spi_common[spi].base + spi_rdr);
+		return;
+	}
+
 	/* Get data from RX Fifo */
 	while (bytesNumber / WORD_SIZE) {
 		word = *(spi_common[spi].base + spi_rdr);
@@ -153,31 +211,14 @@ static void spi_rxBytes(int spi, uint8_t *rxBuff, int bytesNumber)
 }
 
 
-static int spi_performTranscation(int spi, unsigned char cs, const uint8_t *txBuff, uint8_t *rxBuff, int len)
+/* Transfers single frame of up to MAX_FRAME_SZ bits, TCR has to be written already */
+static int spi_pioFrame(int spi, const uint8_t *txBuff, uint8_t *rxBuff, int len)
 {
 	int size = len;
 	int rxTotalBytes = 0;
 	int txFifoBytes, rxFifoBytes;
 	uint32_t txWordsCnt, rxWordsCnt;
 
-	if (!spiConfig[spi])
-		return -EINVAL;
-
-	if ((len * 8) > MAX_FRAME_SZ)
-		return -EINVAL;
-
-	spi = spiPos[spi];
-
-	mutexLock(spi_common[spi].mutex);
-
-	/* Initialize Transmit Command Register */
-	*(spi_common[spi].base + spi_tcr) = (spi_common[spi].tcr & ~(0x7ff)) | ((cs & 0x3) << 24) | (len * 8 - 1);
-
-	/* Wait until Transmit Command will be taken from  TX fifo */
-	txWordsCnt = *(spi_common[spi].base + spi_fsr) & 0x1f;
-	while (txWordsCnt)
-		txWordsCnt = ((*(spi_common[spi].base + spi_fsr)) & 0x1f);
-
 	while (size > 0) {
 		if (size <= MAX_FIFOSZ_BYTES)
 			txFifoBytes = size;
@@ -190,7 +231,8 @@ static int spi_performTranscation(int spi, unsigned char cs, const uint8_t *txBu
 
 		/* Fill transmit FIFO */
 		spi_txBytes(spi, txBuff, txFifoBytes);
-		txBuff += txFifoBytes;
+		if (txBuff != NULL)
+			txBuff += txFifoBytes;
 		size -= txFifoBytes;
 
 		/* Transfer data into slave */
@@ -206,7 +248,8 @@ static int spi_performTranscation(int spi, unsigned char cs, const uint8_t *txBu
 			rxFifoBytes = len - rxTotalBytes;
 
 		spi_rxBytes(spi, rxBuff, rxFifoBytes);
-		rxBuff += rxFifoBytes;
+		if (rxBuff != NULL)
+			rxBuff += rxFifoBytes;
 		rxTotalBytes += rxFifoBytes;
 	}
 
@@ -224,17 +267,305 @@ static int spi_performTranscation(int spi, unsigned char cs, const uint8_t *txBu
 		}
 	}
 
+	return rxTotalBytes;
+}
+
+
+static void spi_writeTcr(int spi, uint32_t tcr)
+{
+	uint32_t txWordsCnt;
+
+	*(spi_common[spi].base + spi_tcr) = tcr;
+
+	/* Wait until Transmit Command will be taken from  TX fifo */
+	txWordsCnt = *(spi_common[spi].base + spi_fsr) & 0x1f;
+	while (txWordsCnt)
+		txWordsCnt = ((*(spi_common[spi].base + spi_fsr)) & 0x1f);
+}
+
+
+#if SPI_DMA
+
+static int spi_dmaSource(int spi, int tx)
+{
+#ifdef __CPU_IMXRT117X
+	/* LPSPI1-6 requests are consecutive RX/TX pairs */
+	return 36 + 2 * spi + ((tx != 0) ? 1 : 0);
+#else
+	/* LPSPI1/3 requests start at 13, LPSPI2/4 at 77 */
+	return (((spi & 1) != 0) ? 77 : 13) + 2 * (spi / 2) + ((tx != 0) ? 1 : 0);
+#endif
+}
+
+
+static int spi_dmaErrorIntr(unsigned int n, void *arg)
+{
+	uint32_t err = edma_error_channel();
+	int i;
+
+	for (i = 0; i < SPI_CNT; i++) {
+		if (spi_common[i].dma.buf == NULL) {
+			continue;
+		}
+
+		if ((err & ((1uL << spi_common[i].dma.rxChan) | (1uL << spi_common[i].dma.txChan))) != 0) {
+			edma_clear_error(spi_common[i].dma.rxChan);
+			edma_clear_error(spi_common[i].dma.txChan);
+			spi_common[i].dma.err = 1;
+		}
+	}
+
+	return 0;
+}
+
+
+static int spi_dmaIrqHandler(unsigned int n, void *arg)
+{
+	int spi = (int)arg;
+
+	edma_clear_interrupt(spi_common[spi].dma.rxChan);
+	spi_common[spi].ready = 1;
+	TRACE_EVENT_IRQ(trace_evSpiDma, spi);
+
+	return 1;
+}
+
+
+static void spi_dmaRound(int spi, const uint8_t *txBuff, size_t len)
+{
+	volatile struct edma_tcd_s tcd;
+	uint8_t *zero = spi_common[spi].dma.buf + SPI_DMA_BUFSZ;
+
+	/* RX into bounce buffer, completion is signalled when the last frame has been received */
+	tcd.saddr = (uint32_t)(spi_common[spi].base + spi_rdr);
+	tcd.soff = 0;
+	tcd.attr = (edma_get_tcd_attr_xsize(1) << 8) | edma_get_tcd_attr_xsize(1);
+	tcd.nbytes_mlno = 1;
+	tcd.slast = 0;
+	tcd.daddr = (uint32_t)spi_common[spi].dma.buf;
+	tcd.doff = 1;
+	tcd.citer_elinkno = len;
+	tcd.biter_elinkno = len;
+	tcd.dlast_sga = 0;
+	tcd.csr = TCD_CSR_INTMAJOR | TCD_CSR_DREQ;
+	edma_install_tcd(&tcd, spi_common[spi].dma.rxChan);
+
+	tcd.saddr = (uint32_t)((txBuff != NULL) ? txBuff : zero);
+	tcd.soff = (txBuff != NULL) ? 1 : 0;
+	tcd.daddr = (uint32_t)(spi_common[spi].base + spi_tdr);
+	tcd.doff = 0;
+	tcd.csr = TCD_CSR_DREQ;
+	edma_install_tcd(&tcd, spi_common[spi].dma.txChan);
+
+	mutexLock(spi_common[spi].irqLock);
+	spi_common[spi].ready = 0;
+
+	edma_channel_enable(spi_common[spi].dma.rxChan);
+	edma_channel_enable(spi_common[spi].dma.txChan);
+
+	/* Errors are reported without interrupt signalling the cond */
+	while ((spi_common[spi].ready == 0) && (spi_common[spi].dma.err == 0))
+		condWait(spi_common[spi].cond, spi_common[spi].irqLock, 10 * 1000);
+
+	mutexUnlock(spi_common[spi].irqLock);
+}
+
+
+/* Transfer as a stream of 8-bit frames with PCS kept asserted */
+static int spi_dmaTransaction(int spi, unsigned char cs, const uint8_t *txBuff, uint8_t *rxBuff, int len, int hold)
+{
+	platformctl_t pctl;
+	int offs, n;
+
+	if (txBuff != NULL) {
+		pctl.action = pctl_set;
+		pctl.type = pctl_cleanInvalDCache;
+		pctl.cleanInvalDCache.addr = (void *)txBuff;
+		pctl.cleanInvalDCache.sz = len;
+		platformctl(&pctl);
+	}
+
+	spi_common[spi].dma.err = 0;
+
+	/* Flush FIFOs, set watermarks for single frame DMA requests */
+	*(spi_common[spi].base + spi_cr) |= (1 << 9) | (1 << 8);
+	*(spi_common[spi].base + spi_fcr) = (*(spi_common[spi].base + spi_fcr) & ~(0xf << 16)) & ~0xf;
+
+	spi_writeTcr(spi, (spi_common[spi].tcr & ~(0x7ff)) | ((cs & 0x3) << 24) | TCR_CONT | ((spi_common[spi].cont != 0) ? TCR_CONTC : 0) | 7);
+
+	*(spi_common[spi].base + spi_der) = (1 << 1) | 1;
+
+	for (offs = 0; (offs < len) && (spi_common[spi].dma.err == 0); offs += n) {
+		n = len - offs;
+		if (n > SPI_DMA_BUFSZ)
+			n = SPI_DMA_BUFSZ;
+
+		spi_dmaRound(spi, (txBuff != NULL) ? (txBuff + offs) : NULL, n);
+
+		if ((rxBuff != NULL) && (spi_common[spi].dma.err == 0))
+			memcpy(rxBuff + offs, spi_common[spi].dma.buf, n);
+	}
+
+	*(spi_common[spi].base + spi_der) = 0;
+
+	/* End continuous transfer - deassert PCS */
+	spi_common[spi].cont = (hold != 0) && (spi_common[spi].dma.err == 0);
+	if (spi_common[spi].cont == 0)
+		spi_writeTcr(spi, (spi_common[spi].tcr & ~(0x7ff | TCR_CONT | TCR_CONTC)) | ((cs & 0x3) << 24) | 7);
+
+	if (spi_common[spi].dma.err != 0) {
+		edma_channel_disable(spi_common[spi].dma.txChan);
+		edma_channel_disable(spi_common[spi].dma.rxChan);
+		*(spi_common[spi].base + spi_cr) |= (1 << 9) | (1 << 8);
+		return -EIO;
+	}
+
+	return len;
+}
+
+
+static int spi_dmaInit(int spi, int dev)
+{
+	int res;
+
+	spi_common[spi].dma.buf = mmap(NULL, (SPI_DMA_BUFSZ + WORD_SIZE + _PAGE_SIZE - 1) & ~(_PAGE_SIZE - 1), PROT_READ | PROT_WRITE, MAP_UNCACHED | MAP_ANONYMOUS, -1, 0);
+	if (spi_common[spi].dma.buf == MAP_FAILED) {
+		spi_common[spi].dma.buf = NULL;
+		return -ENOMEM;
+	}
+	memset(spi_common[spi].dma.buf + SPI_DMA_BUFSZ, 0, WORD_SIZE);
+
+	if ((res = edma_channel_alloc(EDMA_CHANNEL_ANY)) < 0)
+		return res;
+	spi_common[spi].dma.rxChan = res;
+
+	if ((res = edma_channel_alloc(EDMA_CHANNEL_ANY)) < 0)
+		return res;
+	spi_common[spi].dma.txChan = res;
+
+	dmamux_set_source(spi_common[spi].dma.rxChan, spi_dmaSource(dev, 0));
+	dmamux_channel_enable(spi_common[spi].dma.rxChan);
+	dmamux_set_source(spi_common[spi].dma.txChan, spi_dmaSource(dev, 1));
+	dmamux_channel_enable(spi_common[spi].dma.txChan);
+
+	interrupt(EDMA_CHANNEL_IRQ(spi_common[spi].dma.rxChan), spi_dmaIrqHandler, (void *)spi, spi_common[spi].cond, NULL);
+
+	return EOK;
+}
+
+#endif
+
+
+/* Has to be called with spi_common[spi].mutex held, hold keeps PCS asserted for the next transfer */
+static int _spi_transfer(int spi, unsigned char cs, const uint8_t *txBuff, uint8_t *rxBuff, int len, int hold)
+{
+	int res = 0, offs, n, chained;
+	uint32_t tcr = 0;
+
+#if SPI_DMA
+	/* LSB first is applied to whole frames by PIO path, DMA sends 8-bit frames */
+	if ((spi_common[spi].dma.buf != NULL) && (len >= SPI_DMA_MINLEN) && ((spi_common[spi].tcr & (1 << 23)) == 0))
+		return spi_dmaTransaction(spi, cs, txBuff, rxBuff, len, hold);
+#endif
+
+	/* Longer transfers are chained from MAX_FRAME_SZ frames with PCS kept asserted */
+	chained = (spi_common[spi].cont != 0) || (hold != 0) || ((len * 8) > MAX_FRAME_SZ);
+
+	for (offs = 0; offs < len; offs += n) {
+		n = len - offs;
+		if ((n * 8) > MAX_FRAME_SZ)
+			n = MAX_FRAME_SZ / 8;
+
+		/* Initialize Transmit Command Register */
+		tcr = (spi_common[spi].tcr & ~(0x7ff)) | ((cs & 0x3) << 24) | (n * 8 - 1);
+		if (chained)
+			tcr |= TCR_CONT | (((offs != 0) || (spi_common[spi].cont != 0)) ? TCR_CONTC : 0);
+		spi_writeTcr(spi, tcr);
+
+		res += spi_pioFrame(spi, (txBuff != NULL) ? (txBuff + offs) : NULL, (rxBuff != NULL) ? (rxBuff + offs) : NULL, n);
+	}
+
+	/* End continuous transfer - deassert PCS */
+	if (chained && (hold == 0))
+		spi_writeTcr(spi, tcr & ~(TCR_CONT | TCR_CONTC));
+
+	spi_common[spi].cont = hold;
+
+	return res;
+}
+
+
+static int spi_performTranscation(int spi, unsigned char cs, const uint8_t *txBuff, uint8_t *rxBuff, int len)
+{
+	int res;
+
+	spi = spiPos[spi];
+	if ((spi < 0) || (len <= 0))
+		return -EINVAL;
+
+	mutexLock(spi_common[spi].mutex);
+	res = _spi_transfer(spi, cs, txBuff, rxBuff, len, 0);
 	mutexUnlock(spi_common[spi].mutex);
+	TRACE_EVENT(trace_evSpiXfer, spi, len, res);
 
-	return rxTotalBytes;
+	return res;
+}
+
+
+static int spi_performBatch(int spi, const spi_batch_t *batch, unsigned int count, const uint8_t *txData, size_t txSize, uint8_t *rxData, size_t rxSize)
+{
+	unsigned int i;
+	int res = 0, err = 0;
+
+	spi = spiPos[spi];
+	if (spi < 0)
+		return -EINVAL;
+
+	if ((count == 0) || (txData == NULL) || (count > txSize / sizeof(*batch)))
+		return -EINVAL;
+
+	/* Validate whole batch first, so it's not aborted halfway */
+	for (i = 0; i < count; i++) {
+		if ((batch[i].len == 0) || (batch[i].len > INT32_MAX))
+			return -EINVAL;
+
+		if ((batch[i].txOffs != SPI_BATCH_NODATA) && ((batch[i].txOffs > txSize) || (batch[i].len > txSize - batch[i].txOffs)))
+			return -EINVAL;
+
+		if ((batch[i].rxOffs != SPI_BATCH_NODATA) && ((rxData == NULL) || (batch[i].rxOffs > rxSize) || (batch[i].len > rxSize - batch[i].rxOffs)))
+			return -EINVAL;
+
+		if (((batch[i].flags & SPI_BATCH_CSHOLD) != 0) && (i + 1 < count) && (batch[i + 1].cs != batch[i].cs))
+			return -EINVAL;
+	}
+
+	mutexLock(spi_common[spi].mutex);
+
+	for (i = 0; i < count; i++) {
+		err = _spi_transfer(spi, batch[i].cs,
+			(batch[i].txOffs != SPI_BATCH_NODATA) ? (txData + batch[i].txOffs) : NULL,
+			(batch[i].rxOffs != SPI_BATCH_NODATA) ? (rxData + batch[i].rxOffs) : NULL,
+			batch[i].len, ((batch[i].flags & SPI_BATCH_CSHOLD) != 0) && (i + 1 < count));
+		if (err < 0)
+			break;
+
+		res += batch[i].len;
+
+		if (batch[i].delayUs != 0)
+			usleep(batch[i].delayUs);
+	}
+
+	mutexUnlock(spi_common[spi].mutex);
+
+	return (err < 0) ? err : res;
 }
 
 
 static int spi_configure(uint32_t spi, uint32_t bdiv, uint32_t prescaler, uint32_t endian, uint32_t mode, uint32_t cs)
 {
-	int i;
+	int i = spiPos[spi];
 
-	if (!spiConfig[spi])
+	if (i < 0)
 		return -EINVAL;
 
 	if (bdiv > 255)
@@ -243,8 +574,6 @@ static int spi_configure(uint32_t spi, uint32_t bdiv, uint32_t prescaler, uint32
 	if (prescaler >= 8)
 		return -EINVAL;
 
-	i = spiPos[spi];
-
 	mutexLock(spi_common[i].mutex);
 
 	/* Disable module */
@@ -300,6 +629,10 @@ static void spi_handleDevCtl(msg_t *msg, int dev)
 			msg->o.err = spi_performTranscation(dev, idevctl->spi.transaction.cs, txBuff, rxBuff, idevctl->spi.transaction.frameSize);
 			break;
 
+		case spi_batch:
+			msg->o.err = spi_performBatch(dev, (const spi_batch_t *)txBuff, idevctl->spi.batch.count, txBuff, msg->i.size, rxBuff, msg->o.size);
+			break;
+
 		default:
 			msg->o.err = -ENOSYS;
 			break;
@@ -803,6 +1136,9 @@ static void spi_initPins(void)
 int spi_init(void)
 {
 	int i, spi;
+#if SPI_DMA
+	int dmaInit = 0;
+#endif
 
 	static const struct {
 		volatile uint32_t *base;
@@ -821,8 +1157,9 @@ int spi_init(void)
 
 	spi_initPins();
 
-	for (i = 0, spi = 0; spi < sizeof(spiInfo) / sizeof(spiInfo[0]); ++spi) {
-		if (!spiConfig[spi])
+	for (spi = 0; spi < sizeof(spiInfo) / sizeof(spiInfo[0]); ++spi) {
+		i = spiPos[spi];
+		if (i < 0)
 			continue;
 
 #ifdef __CPU_IMXRT117X
@@ -852,9 +1189,19 @@ int spi_init(void)
 
 		interrupt(spi_common[i].irq, spi_irqHandler, (void *)i, spi_common[i].cond, &spi_common[i].inth);
 
+#if SPI_DMA
+		if (spiDma[spi] != 0) {
+			if ((dmaInit == 0) && (edma_init(spi_dmaErrorIntr) < 0))
+				return -EFAULT;
+			dmaInit = 1;
+
+			if (spi_dmaInit(i, spi) < 0)
+				return -ENOMEM;
+		}
+#endif
+
 		/* Disable module */
 		*(spi_common[i].base + spi_cr) = 0;
-		++i;
 	}
 
 	return 0;
@@ -15,10 +15,57 @@
 #define _MULTI_TRACE_H_
 
 #include <stdio.h>
+#include <stdint.h>
+#include <sys/threads.h>
+#include <librtt.h>
+
+#include "config.h"
+
+
+/* Binary trace event ids, keep in sync with librtt/tools/rtt-trace.py */
+enum {
+	trace_evIrq = 1, /* line */
+	trace_evUartIrq, /* uart, status */
+	trace_evSpiXfer, /* spi, len, result */
+	trace_evSpiDma,  /* spi */
+};
+
+
+#if !ISEMPTY(RTT_TRACE)
+
+#define TRACE_NARGS_(_0, _1, _2, _3, _4, n, ...) n
+#define TRACE_NARGS(...)                         TRACE_NARGS_(0, ##__VA_ARGS__, 4, 3, 2, 1, 0)
+
+
+static inline uint32_t trace_timestamp(void)
+{
+	time_t now;
+
+	gettime(&now, NULL);
+
+	return (uint32_t)now;
+}
+
+
+/* Thread context, timestamp in us */
+#define TRACE_EVENT(id, ...) \
+	(void)librtt_trace(RTT_TRACE, (id), 0, trace_timestamp(), TRACE_NARGS(__VA_ARGS__), (const uint32_t[]) { 0, ##__VA_ARGS__ } + 1)
+
+/* Interrupt context can't read time, decoder takes the timestamp of the preceding record */
+#define TRACE_EVENT_IRQ(id, ...) \
+	(void)librtt_trace(RTT_TRACE, (id), LIBRTT_TRACE_IRQ, 0, TRACE_NARGS(__VA_ARGS__), (const uint32_t[]) { 0, ##__VA_ARGS__ } + 1)
+
+#else
+
+#define TRACE_EVENT(id, ...)
+#define TRACE_EVENT_IRQ(id, ...)
+
+#endif
+
 
 #ifdef TRACE_ENABLE
 #define TRACE(fmt, ...) printf("%s:" fmt "\n", __FUNCTION__, ##__VA_ARGS__)
-#define TRACE_IRQ()     /* TODO: use rtt_write from librtt */
+#define TRACE_IRQ()     TRACE_EVENT_IRQ(trace_evIrq, __LINE__)
 #else
 #define TRACE(fmt, ...)
 #define TRACE_IRQ()
@@ -16,6 +16,11 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/threads.h>
+#include <posix/utils.h>
+#include <chacha20.h>
 
 #include "common.h"
 #include "trng.h"
@@ -36,8 +41,36 @@ enum { mctl = 0, scmisc, pkrrng, pkrmax, sdctl, sblim, frqmin, frqcnt, scmc, scr
 
 #define TRNG_ENT_COUNT 16
 
+/* Polling period of background refill */
+#define TRNG_POLL_US 200
+
+
 struct {
 	volatile uint32_t *base;
+	handle_t hwLock;
+	uint32_t hwErrors;
+
+#if TRNG_POOL_SIZE
+	struct {
+		uint8_t buf[TRNG_POOL_SIZE];
+		size_t head;
+		size_t tail;
+		uint32_t misses;
+		handle_t lock;
+		handle_t cond;
+		char stack[1024] __attribute__((aligned(8)));
+	} pool;
+#endif
+
+#if TRNG_DRBG
+	struct {
+		chacha20_t gen;
+		size_t sinceReseed;
+		int seeded;
+		uint32_t reseeds;
+		handle_t lock;
+	} drbg;
+#endif
 } trng_common;
 
 
@@ -58,7 +91,8 @@ static uint32_t trng_readEnt(int index)
 }
 
 
-static int trng_read(char *data, size_t size)
+/* Has to be called with hwLock held, background refill sleeps while waiting for generation */
+static int _trng_readHw(char *data, size_t size, int sleep)
 {
 	uint32_t val;
 	uint32_t mctlVal;
@@ -67,12 +101,18 @@ static int trng_read(char *data, size_t size)
 
 	while (offs < size) {
 		/* Wait for valid entropy or error */
-		do {
-			mctlVal = *(trng_common.base + mctl);
-		} while ((mctlVal & (TRNG_MCTL_VAL | TRNG_MCTL_ERR)) == 0);
-
-		if (mctlVal & TRNG_MCTL_ERR)
+		while (((mctlVal = *(trng_common.base + mctl)) & (TRNG_MCTL_VAL | TRNG_MCTL_ERR)) == 0) {
+			if (sleep != 0)
+				usleep(TRNG_POLL_US);
+		}
+
+		if (mctlVal & TRNG_MCTL_ERR) {
+			/* Clear error and restart generation */
+			trng_common.hwErrors++;
+			*(trng_common.base + mctl) |= TRNG_MCTL_ERR;
+			(void)trng_readEnt(TRNG_ENT_COUNT - 1);
 			return offs;
+		}
 
 		val = trng_readEnt(index);
 		chunk = (size - offs < sizeof(val)) ? size - offs : sizeof(val);
@@ -89,15 +129,223 @@ static int trng_read(char *data, size_t size)
 }
 
 
+#if TRNG_POOL_SIZE
+
+static size_t trng_poolGet(uint8_t *data, size_t size)
+{
+	size_t n, offs, chunk;
+
+	mutexLock(trng_common.pool.lock);
+
+	n = trng_common.pool.head - trng_common.pool.tail;
+	if (n > size)
+		n = size;
+
+	for (offs = 0; offs < n; offs += chunk) {
+		chunk = TRNG_POOL_SIZE - ((trng_common.pool.tail + offs) % TRNG_POOL_SIZE);
+		if (chunk > n - offs)
+			chunk = n - offs;
+		memcpy(data + offs, &trng_common.pool.buf[(trng_common.pool.tail + offs) % TRNG_POOL_SIZE], chunk);
+	}
+
+	/* Entropy is used once - wipe it */
+	for (offs = 0; offs < n; offs++)
+		trng_common.pool.buf[(trng_common.pool.tail + offs) % TRNG_POOL_SIZE] = 0;
+
+	trng_common.pool.tail += n;
+
+	if (n != 0)
+		condSignal(trng_common.pool.cond);
+
+	mutexUnlock(trng_common.pool.lock);
+
+	return n;
+}
+
+
+static void trng_poolThread(void *arg)
+{
+	uint32_t ent[TRNG_ENT_COUNT];
+	size_t offs, n;
+	int len;
+
+	(void)arg;
+
+	for (;;) {
+		mutexLock(trng_common.pool.lock);
+		while ((trng_common.pool.head - trng_common.pool.tail) >= TRNG_POOL_SIZE)
+			condWait(trng_common.pool.cond, trng_common.pool.lock, 0);
+		mutexUnlock(trng_common.pool.lock);
+
+		/* Whole entropy set, the hardware restarts generation after reading all of it */
+		mutexLock(trng_common.hwLock);
+		len = _trng_readHw((char *)ent, sizeof(ent), 1);
+		mutexUnlock(trng_common.hwLock);
+
+		if (len <= 0)
+			continue;
+
+		mutexLock(trng_common.pool.lock);
+		n = TRNG_POOL_SIZE - (trng_common.pool.head - trng_common.pool.tail);
+		if (n > (size_t)len)
+			n = len;
+
+		for (offs = 0; offs < n; offs++, trng_common.pool.head++)
+			trng_common.pool.buf[trng_common.pool.head % TRNG_POOL_SIZE] = ((uint8_t *)ent)[offs];
+		mutexUnlock(trng_common.pool.lock);
+
+		memset(ent, 0, sizeof(ent));
+	}
+}
+
+#endif
+
+
+/* Entropy for /dev/random, served from the pool if possible */
+static int trng_read(char *data, size_t size, int partial)
+{
+	size_t offs = 0;
+	int res;
+
+#if TRNG_POOL_SIZE
+	offs = trng_poolGet((uint8_t *)data, size);
+	if ((offs != 0) && (partial != 0))
+		return offs;
+
+	if (offs < size) {
+		mutexLock(trng_common.pool.lock);
+		trng_common.pool.misses++;
+		mutexUnlock(trng_common.pool.lock);
+	}
+#endif
+
+	if (offs < size) {
+		mutexLock(trng_common.hwLock);
+		res = _trng_readHw(data + offs, size - offs, 0);
+		mutexUnlock(trng_common.hwLock);
+		offs += res;
+	}
+
+	return offs;
+}
+
+
+#if TRNG_DRBG
+
+/* Mixes fresh TRNG output into the key, blocks only when not seeded yet */
+static void trng_drbgReseed(void)
+{
+	uint32_t seed[CHACHA20_KEY_WORDS] = { 0 };
+	size_t len;
+	int i;
+
+#if TRNG_POOL_SIZE
+	/* Any amount of fresh entropy only adds to the key, don't wait for the rest */
+	if (trng_common.drbg.seeded != 0)
+		len = trng_poolGet((uint8_t *)seed, sizeof(seed));
+	else
+#endif
+		len = trng_read((char *)seed, sizeof(seed), 0);
+
+	if ((len == 0) || ((trng_common.drbg.seeded == 0) && (len < sizeof(seed)))) {
+		/* Keep generating with the current key, try again with the next request */
+		memset(seed, 0, sizeof(seed));
+		return;
+	}
+
+	for (i = 0; i < CHACHA20_KEY_WORDS; i++)
+		trng_common.drbg.gen.key[i] ^= seed[i];
+
+	memset(seed, 0, sizeof(seed));
+	trng_common.drbg.gen.counter = 0;
+	trng_common.drbg.gen.nonce[1]++;
+	trng_common.drbg.sinceReseed = 0;
+	trng_common.drbg.seeded = 1;
+	trng_common.drbg.reseeds++;
+}
+
+
+static int trng_drbgRead(uint8_t *data, size_t size)
+{
+	mutexLock(trng_common.drbg.lock);
+
+	if ((trng_common.drbg.seeded == 0) || (trng_common.drbg.sinceReseed >= TRNG_DRBG_RESEED))
+		trng_drbgReseed();
+
+	if (trng_common.drbg.seeded == 0) {
+		mutexUnlock(trng_common.drbg.lock);
+		return -EIO;
+	}
+
+	/* Key is replaced after the output, previous output can't be recovered from the state */
+	chacha20_generate(&trng_common.drbg.gen, data, size);
+
+	trng_common.drbg.sinceReseed += size;
+
+	mutexUnlock(trng_common.drbg.lock);
+
+	return size;
+}
+
+#endif
+
+
+static void trng_getStatus(trng_status_t *st)
+{
+	memset(st, 0, sizeof(*st));
+
+#if TRNG_POOL_SIZE
+	mutexLock(trng_common.pool.lock);
+	st->poolSize = TRNG_POOL_SIZE;
+	st->poolAvail = trng_common.pool.head - trng_common.pool.tail;
+	st->poolMisses = trng_common.pool.misses;
+	mutexUnlock(trng_common.pool.lock);
+#endif
+
+	st->hwErrors = trng_common.hwErrors;
+
+#if TRNG_DRBG
+	mutexLock(trng_common.drbg.lock);
+	st->drbgSeeded = trng_common.drbg.seeded;
+	st->drbgReseeds = trng_common.drbg.reseeds;
+	mutexUnlock(trng_common.drbg.lock);
+#endif
+}
+
+
 int trng_handleMsg(msg_t *msg)
 {
+	trng_status_t st;
+	unsigned long request;
+	const void *out_data = NULL;
+	int err;
+
 	switch (msg->type) {
 		case mtOpen:
 		case mtClose:
 			msg->o.err = EOK;
 			break;
 		case mtRead:
-			msg->o.err = trng_read(msg->o.data, msg->o.size);
+#if TRNG_DRBG
+			if (msg->oid.id == id_pseudoRandom) {
+				msg->o.err = trng_drbgRead(msg->o.data, msg->o.size);
+				break;
+			}
+#endif
+			msg->o.err = trng_read(msg->o.data, msg->o.size, 1);
+			break;
+
+		case mtDevCtl:
+			(void)ioctl_unpack(msg, &request, NULL);
+			if (request == TRNG_GETSTATUS) {
+				trng_getStatus(&st);
+				out_data = &st;
+				err = EOK;
+			}
+			else {
+				err = -EINVAL;
+			}
+			ioctl_setResponse(msg, request, err, out_data);
 			break;
 
 		default:
@@ -109,6 +357,12 @@ int trng_handleMsg(msg_t *msg)
 }
 
 
+int trng_getEntropy(void *data, size_t size)
+{
+	return trng_read(data, size, 0);
+}
+
+
 int trng_init(void)
 {
 	trng_common.base = TRNG_BASE;
@@ -129,5 +383,24 @@ int trng_init(void)
 	/* Start generation */
 	(void)trng_readEnt(TRNG_ENT_COUNT - 1);
 
+	if (mutexCreate(&trng_common.hwLock) != EOK)
+		return -ENOMEM;
+
+#if TRNG_DRBG
+	if (mutexCreate(&trng_common.drbg.lock) != EOK)
+		return -ENOMEM;
+#endif
+
+#if TRNG_POOL_SIZE
+	if (mutexCreate(&trng_common.pool.lock) != EOK)
+		return -ENOMEM;
+
+	if (condCreate(&trng_common.pool.cond) != EOK)
+		return -ENOMEM;
+
+	if (beginthread(trng_poolThread, TRNG_POOL_PRIO, trng_common.pool.stack, sizeof(trng_common.pool.stack), NULL) < 0)
+		return -ENOMEM;
+#endif
+
 	return EOK;
 }
@@ -23,4 +23,8 @@ int trng_handleMsg(msg_t *msg);
 int trng_init(void);
 
 
+/* Raw entropy for seeding other generators, returns number of bytes read */
+int trng_getEntropy(void *data, size_t size);
+
+
 #endif
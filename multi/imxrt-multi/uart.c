@@ -20,16 +20,20 @@
 #include <sys/file.h>
 #include <sys/interrupt.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/msg.h>
+#include <sys/platform.h>
 #include <sys/threads.h>
 
 #include <libtty.h>
 #include <libtty-lf-fifo.h>
 #include <libklog.h>
+#include <edma.h>
 
 #include "gpio.h"
 #include "common.h"
 #include "uart.h"
+#include "trace.h"
 
 
 #define UART1_POS  0
@@ -52,6 +56,22 @@
 #define UART_RXFIFOSIZE 128
 #endif
 
+/* Circular RX buffer of UARTs in DMA mode */
+#ifndef UART_DMA_RXBUFSZ
+#define UART_DMA_RXBUFSZ 512
+#endif
+
+#if UART_DMA_RXBUFSZ > 0x7fff
+#error "UART_DMA_RXBUFSZ exceeds eDMA major loop count"
+#endif
+
+/* TCD CSR bits */
+#define TCD_CSR_INTMAJOR (1 << 1)
+#define TCD_CSR_INTHALF  (1 << 2)
+#define TCD_CSR_DREQ     (1 << 3)
+
+#define TCD_CITER_MAX 0x7fff
+
 
 typedef struct {
 	uint16_t port;
@@ -81,11 +101,31 @@ typedef struct uart_s {
 	lf_fifo_t rxFifoCtx;
 	uint8_t rxFifoData[UART_RXFIFOSIZE];
 
+#if UART_DMA
+	struct {
+		uint8_t *rxBuf; /* uncached, written by RX channel in circular mode, NULL if DMA is not used */
+		size_t rxTail;
+		size_t txLen; /* length of the span being sent by TX channel */
+		int rxChan;
+		int txChan;
+	} dma;
+#endif
+
 	/* statistics */
 	struct {
-		/* NOTE: to read statistics use debugger */
+		/* NOTE: read with UART_GETSTATS devctl (DMA errors with debugger) */
 		size_t hw_overrunCntr;
 		size_t sw_overrunCntr;
+#if UART_DMA
+		size_t dma_errCntr;
+#endif
+#if UART_STATS
+		uint32_t irqs;
+		uint32_t rxBytes;
+		uint32_t txBytes;
+		uint32_t rxFifoMax;
+		uint32_t rxLatency[UART_STATS_LAT_BUCKETS];
+#endif
 	} stat;
 } uart_t;
 
@@ -95,118 +135,83 @@ struct {
 } uart_common;
 
 
+/* Enabled UARTs only, indexed like uart_common.uarts[] */
 static const struct {
 	volatile uint32_t *base;
 	int clk;
-	unsigned irq;
-	int active;
-	int pos;
+	uint16_t irq;
+	uint8_t dev;
 	uart_halfDuplexAction_t halfDuplexAction;
-} uart_preConfig[] = {
-	{
-		UART1_BASE,
-		UART1_CLK,
-		UART1_IRQ,
-		UART1,
-		UART1_POS,
-		{ UART1_HALF_DUPLEX_GPIO },
-	},
-	{
-		UART2_BASE,
-		UART2_CLK,
-		UART2_IRQ,
-		UART2,
-		UART2_POS,
-		{ UART2_HALF_DUPLEX_GPIO },
-	},
-	{
-		UART3_BASE,
-		UART3_CLK,
-		UART3_IRQ,
-		UART3,
-		UART3_POS,
-		{ UART3_HALF_DUPLEX_GPIO },
-	},
-	{
-		UART4_BASE,
-		UART4_CLK,
-		UART4_IRQ,
-		UART4,
-		UART4_POS,
-		{ UART4_HALF_DUPLEX_GPIO },
-	},
-	{
-		UART5_BASE,
-		UART5_CLK,
-		UART5_IRQ,
-		UART5,
-		UART5_POS,
-		{ UART5_HALF_DUPLEX_GPIO },
-	},
-	{
-		UART6_BASE,
-		UART6_CLK,
-		UART6_IRQ,
-		UART6,
-		UART6_POS,
-		{ UART6_HALF_DUPLEX_GPIO },
-	},
-	{
-		UART7_BASE,
-		UART7_CLK,
-		UART7_IRQ,
-		UART7,
-		UART7_POS,
-		{ UART7_HALF_DUPLEX_GPIO },
-	},
-	{
-		UART8_BASE,
-		UART8_CLK,
-		UART8_IRQ,
-		UART8,
-		UART8_POS,
-		{ UART8_HALF_DUPLEX_GPIO },
-	},
+} uart_desc[UART_CNT] = {
+#define UART_DESC(n) { UART##n##_BASE, UART##n##_CLK, UART##n##_IRQ, (n) - 1, { UART##n##_HALF_DUPLEX_GPIO } }
+#if UART1
+	UART_DESC(1),
+#endif
+#if UART2
+	UART_DESC(2),
+#endif
+#if UART3
+	UART_DESC(3),
+#endif
+#if UART4
+	UART_DESC(4),
+#endif
+#if UART5
+	UART_DESC(5),
+#endif
+#if UART6
+	UART_DESC(6),
+#endif
+#if UART7
+	UART_DESC(7),
+#endif
+#if UART8
+	UART_DESC(8),
+#endif
+#ifdef __CPU_IMXRT117X
+#if UART9
+	UART_DESC(9),
+#endif
+#if UART10
+	UART_DESC(10),
+#endif
+#if UART11
+	UART_DESC(11),
+#endif
+#if UART12
+	UART_DESC(12),
+#endif
+#endif
+#undef UART_DESC
+};
+
+
+/* Device number to uart_common.uarts[] index, -1 if disabled */
+#define UART_IDX(n) ((UART##n) ? UART##n##_POS : -1)
+
+static const int8_t uart_pos[] = {
+	UART_IDX(1), UART_IDX(2), UART_IDX(3), UART_IDX(4), UART_IDX(5), UART_IDX(6), UART_IDX(7), UART_IDX(8),
 #ifdef __CPU_IMXRT117X
-	{
-		UART9_BASE,
-		UART9_CLK,
-		UART9_IRQ,
-		UART9,
-		UART9_POS,
-		{ UART9_HALF_DUPLEX_GPIO },
-	},
-	{
-		UART10_BASE,
-		UART10_CLK,
-		UART10_IRQ,
-		UART10,
-		UART10_POS,
-		{ UART10_HALF_DUPLEX_GPIO },
-	},
-	{
-		UART11_BASE,
-		UART11_CLK,
-		UART11_IRQ,
-		UART11,
-		UART11_POS,
-		{ UART11_HALF_DUPLEX_GPIO },
-	},
-	{
-		UART12_BASE,
-		UART12_CLK,
-		UART12_IRQ,
-		UART12,
-		UART12_POS,
-		{ UART12_HALF_DUPLEX_GPIO },
-	},
+	UART_IDX(9), UART_IDX(10), UART_IDX(11), UART_IDX(12),
 #endif
 };
 
+#undef UART_IDX
+
 
 enum { veridr = 0, paramr, globalr, pincfgr, baudr, statr, ctrlr, datar, matchr, modirr, fifor, waterr };
 
 
+#if UART_STATS
+#define UART_STAT_ADD(uart, field, n) \
+	do { \
+		(uart)->stat.field += (n); \
+	} while (0)
+#else
+#define UART_STAT_ADD(uart, field, n)
+#endif
+
+
 static inline int uart_getRXcount(uart_t *uart)
 {
 	return (*(uart->base + waterr) >> 24) & 0xff;
@@ -226,11 +231,79 @@ static int uart_performHalfDuplexAction(const uart_halfDuplexAction_t *action, i
 }
 
 
+#if UART_STATS
+
+static void uart_statRx(uart_t *uart, size_t n)
+{
+	tcflag_t cflag = uart->tty_common.term.c_cflag;
+	int baud = libtty_baudrate_to_int(uart->tty_common.term.c_ospeed);
+	unsigned int bits, i;
+	uint32_t us;
+
+	if (n == 0) {
+		return;
+	}
+
+	uart->stat.rxBytes += n;
+	if (n > uart->stat.rxFifoMax) {
+		uart->stat.rxFifoMax = n;
+	}
+
+	if (baud <= 0) {
+		return;
+	}
+
+	/* Start, data, parity and stop bits */
+	bits = 1 + (((cflag & CSIZE) == CS7) ? 7 : 8) + (((cflag & PARENB) != 0) ? 1 : 0) + (((cflag & CSTOPB) != 0) ? 2 : 1);
+
+	/* The oldest byte has been waiting at least for reception of the rest of the batch */
+	us = (uint32_t)(((uint64_t)n * bits * 1000000u) / (unsigned int)baud);
+	for (i = 0; (i < UART_STATS_LAT_BUCKETS - 1) && (us >= (128u << i)); i++) {
+	}
+	uart->stat.rxLatency[i]++;
+}
+
+#endif
+
+
+static void uart_getStats(uart_t *uart, uart_stats_t *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+
+	stats->hwOverruns = uart->stat.hw_overrunCntr;
+	stats->swOverruns = uart->stat.sw_overrunCntr;
+#if UART_STATS
+	stats->irqs = uart->stat.irqs;
+	stats->rxBytes = uart->stat.rxBytes;
+	stats->txBytes = uart->stat.txBytes;
+	stats->rxFifoMax = uart->stat.rxFifoMax;
+	memcpy(stats->rxLatency, uart->stat.rxLatency, sizeof(stats->rxLatency));
+#endif
+}
+
+
+static void uart_clrStats(uart_t *uart)
+{
+	uart->stat.hw_overrunCntr = 0;
+	uart->stat.sw_overrunCntr = 0;
+#if UART_STATS
+	uart->stat.irqs = 0;
+	uart->stat.rxBytes = 0;
+	uart->stat.txBytes = 0;
+	uart->stat.rxFifoMax = 0;
+	memset(uart->stat.rxLatency, 0, sizeof(uart->stat.rxLatency));
+#endif
+}
+
+
 static int uart_handleIntr(unsigned int n, void *arg)
 {
 	uart_t *uart = (uart_t *)arg;
 	uint32_t status = *(uart->base + statr);
 
+	UART_STAT_ADD(uart, irqs, 1);
+	TRACE_EVENT_IRQ(trace_evUartIrq, n, status);
+
 	/* Disable interrupts, enabled in uart_intrThread */
 	*(uart->base + ctrlr) &= ~((1 << 27) | (1 << 26) | (1 << 25) | (1 << 23) | (1 << 22) | (1 << 21));
 
@@ -260,8 +333,12 @@ static void uart_intrThread(void *arg)
 {
 	uart_t *uart = (uart_t *)arg;
 	uint8_t mask;
-	uint8_t c;
+	uint8_t buf[32];
+	unsigned int i, n;
 	int rxActive = 1;
+#if UART_STATS
+	size_t batch;
+#endif
 
 	for (;;) {
 		/* wait for character or transmit data */
@@ -305,10 +382,24 @@ static void uart_intrThread(void *arg)
 
 		mutexUnlock(uart->lock);
 
-		/* RX */
-		while (lf_fifo_pop(&uart->rxFifoCtx, &c) != 0) {
-			libtty_putchar(&uart->tty_common, c & mask, NULL);
+		/* RX - pass chars in batches to take tty lock and wake up reader once per batch */
+#if UART_STATS
+		batch = 0;
+#endif
+		while ((n = lf_fifo_pop_bulk(&uart->rxFifoCtx, buf, sizeof(buf))) != 0) {
+			if (mask != 0xff) {
+				for (i = 0; i < n; i++) {
+					buf[i] &= mask;
+				}
+			}
+			libtty_putchars(&uart->tty_common, buf, n, NULL);
+#if UART_STATS
+			batch += n;
+#endif
 		}
+#if UART_STATS
+		uart_statRx(uart, batch);
+#endif
 
 		/* TX */
 		if (libtty_txready(&uart->tty_common) && uart_getTXcount(uart) < uart->txFifoSz) {
@@ -320,12 +411,272 @@ static void uart_intrThread(void *arg)
 
 			do {
 				*(uart->base + datar) = libtty_getchar(&uart->tty_common, NULL);
+				UART_STAT_ADD(uart, txBytes, 1);
 			} while (libtty_txready(&uart->tty_common) && uart_getTXcount(uart) < uart->txFifoSz);
 		}
 	}
 }
 
 
+#if UART_DMA
+
+static int uart_dmaSource(int dev, int tx)
+{
+#ifdef __CPU_IMXRT117X
+	/* LPUART1-12 requests are consecutive TX/RX pairs */
+	return 8 + 2 * dev + ((tx != 0) ? 0 : 1);
+#else
+	/* Odd LPUARTs start at 2, even ones at 66 */
+	return (((dev & 1) != 0) ? 66 : 2) + 2 * (dev / 2) + ((tx != 0) ? 0 : 1);
+#endif
+}
+
+
+static int uart_dmaErrorIntr(unsigned int n, void *arg)
+{
+	uint32_t err = edma_error_channel();
+	int i;
+
+	for (i = 0; i < UART_CNT; i++) {
+		uart_t *uart = &uart_common.uarts[i];
+		if (uart->dma.rxBuf == NULL) {
+			continue;
+		}
+
+		if ((err & (1uL << uart->dma.rxChan)) != 0) {
+			edma_clear_error(uart->dma.rxChan);
+			uart->stat.dma_errCntr++;
+		}
+
+		if ((err & (1uL << uart->dma.txChan)) != 0) {
+			edma_clear_error(uart->dma.txChan);
+			uart->stat.dma_errCntr++;
+		}
+	}
+
+	return 0;
+}
+
+
+static int uart_dmaChanIntr(unsigned int n, void *arg)
+{
+	uart_t *uart = (uart_t *)arg;
+
+	UART_STAT_ADD(uart, irqs, 1);
+
+	/* Line is shared by two channels, thread checks the state of both */
+	edma_clear_interrupt(uart->dma.rxChan);
+	edma_clear_interrupt(uart->dma.txChan);
+
+	return 1;
+}
+
+
+static int uart_dmaHandleIntr(unsigned int n, void *arg)
+{
+	uart_t *uart = (uart_t *)arg;
+	uint32_t status = *(uart->base + statr);
+
+	UART_STAT_ADD(uart, irqs, 1);
+
+	/* Transmission complete is level triggered, reenabled in uart_dmaThread */
+	*(uart->base + ctrlr) &= ~(1 << 22);
+
+	if ((status & (1uL << 19u)) != 0u) {
+		uart->stat.hw_overrunCntr++;
+	}
+
+	/* Clear errors: parity, framing, noise, overrun and idle flag */
+	*(uart->base + statr) = (status & (0x1fuL << 16));
+
+	return 1;
+}
+
+
+static size_t uart_dmaRxHead(uart_t *uart)
+{
+	volatile struct edma_tcd_s tcd;
+
+	edma_read_tcd(&tcd, uart->dma.rxChan);
+
+	return (tcd.daddr - (uint32_t)uart->dma.rxBuf) % UART_DMA_RXBUFSZ;
+}
+
+
+static void uart_dmaTxStart(uart_t *uart, const uint8_t *data, size_t len)
+{
+	volatile struct edma_tcd_s tcd;
+	platformctl_t pctl;
+
+	/* TX fifo and zero-copy segments are cached memory */
+	pctl.action = pctl_set;
+	pctl.type = pctl_cleanInvalDCache;
+	pctl.cleanInvalDCache.addr = (void *)data;
+	pctl.cleanInvalDCache.sz = len;
+	platformctl(&pctl);
+
+	tcd.saddr = (uint32_t)data;
+	tcd.soff = 1;
+	tcd.attr = (edma_get_tcd_attr_xsize(1) << 8) | edma_get_tcd_attr_xsize(1);
+	tcd.nbytes_mlno = 1;
+	tcd.slast = 0;
+	tcd.daddr = (uint32_t)(uart->base + datar);
+	tcd.doff = 0;
+	tcd.citer_elinkno = len;
+	tcd.biter_elinkno = len;
+	tcd.dlast_sga = 0;
+	tcd.csr = TCD_CSR_INTMAJOR | TCD_CSR_DREQ;
+
+	uart->dma.txLen = len;
+	edma_install_tcd(&tcd, uart->dma.txChan);
+	edma_channel_enable(uart->dma.txChan);
+}
+
+
+static void uart_dmaThread(void *arg)
+{
+	uart_t *uart = (uart_t *)arg;
+	const uint8_t *data;
+	uint8_t mask;
+	size_t head, tail, i, n;
+	int rxActive = 1;
+
+	for (;;) {
+		mutexLock(uart->lock);
+		for (;;) {
+			head = uart_dmaRxHead(uart);
+			if (head != uart->dma.rxTail) { /* RX data or idle line */
+				break;
+			}
+
+			if (uart->dma.txLen != 0) {
+				if (edma_channel_is_done(uart->dma.txChan) > 0) { /* TX span sent */
+					break;
+				}
+			}
+			else if (libtty_txready(&uart->tty_common)) { /* something to TX */
+				break;
+			}
+			else if ((uart->halfDuplexAction.port != 0) && (rxActive == 0)) {
+				if ((*(uart->base + statr) & (1 << 22)) != 0u) {
+					/* Transmission finished, activate RX */
+					uart_performHalfDuplexAction(&uart->halfDuplexAction, 0);
+					*(uart->base + ctrlr) |= (1 << 18);
+					rxActive = 1;
+				}
+				else {
+					*(uart->base + ctrlr) |= (1 << 22);
+				}
+			}
+
+			condWait(uart->cond, uart->lock, 0);
+		}
+
+		if ((uart->tty_common.term.c_cflag & CSIZE) == CS7) {
+			mask = 0x7f;
+		}
+		else {
+			mask = 0xff;
+		}
+
+		mutexUnlock(uart->lock);
+
+		/* RX - pass the ring to libtty in at most two contiguous chunks */
+#if UART_STATS
+		uart_statRx(uart, (head + UART_DMA_RXBUFSZ - uart->dma.rxTail) % UART_DMA_RXBUFSZ);
+#endif
+		tail = uart->dma.rxTail;
+		while (tail != head) {
+			n = (head > tail) ? (head - tail) : (UART_DMA_RXBUFSZ - tail);
+			if (mask != 0xff) {
+				for (i = 0; i < n; i++) {
+					uart->dma.rxBuf[tail + i] &= mask;
+				}
+			}
+			libtty_putchars(&uart->tty_common, uart->dma.rxBuf + tail, n, NULL);
+			tail = (tail + n) % UART_DMA_RXBUFSZ;
+		}
+		uart->dma.rxTail = tail;
+
+		/* TX - span stays in libtty fifo until the channel is done with it */
+		if ((uart->dma.txLen != 0) && (edma_channel_is_done(uart->dma.txChan) > 0)) {
+			libtty_tx_consume(&uart->tty_common, uart->dma.txLen, NULL);
+			UART_STAT_ADD(uart, txBytes, uart->dma.txLen);
+			uart->dma.txLen = 0;
+		}
+
+		if ((uart->dma.txLen == 0) && libtty_txready(&uart->tty_common)) {
+			n = libtty_tx_span(&uart->tty_common, &data);
+			if (n > TCD_CITER_MAX) {
+				n = TCD_CITER_MAX;
+			}
+
+			if (n != 0) {
+				if ((uart->halfDuplexAction.port != 0) && (rxActive != 0)) {
+					*(uart->base + ctrlr) &= ~(1 << 18);
+					uart_performHalfDuplexAction(&uart->halfDuplexAction, 1);
+					rxActive = 0;
+				}
+
+				uart_dmaTxStart(uart, data, n);
+			}
+		}
+	}
+}
+
+
+static int uart_dmaInit(uart_t *uart, int dev)
+{
+	volatile struct edma_tcd_s tcd;
+	int res;
+
+	uart->dma.rxBuf = mmap(NULL, (UART_DMA_RXBUFSZ + _PAGE_SIZE - 1) & ~(_PAGE_SIZE - 1), PROT_READ | PROT_WRITE, MAP_UNCACHED | MAP_ANONYMOUS, -1, 0);
+	if (uart->dma.rxBuf == MAP_FAILED) {
+		uart->dma.rxBuf = NULL;
+		return -ENOMEM;
+	}
+
+	if ((res = edma_channel_alloc(EDMA_CHANNEL_ANY)) < 0) {
+		return res;
+	}
+	uart->dma.rxChan = res;
+
+	if ((res = edma_channel_alloc(EDMA_CHANNEL_ANY)) < 0) {
+		return res;
+	}
+	uart->dma.txChan = res;
+
+	/* RX runs continuously, interrupts on half and full ring drain it before overwrite */
+	tcd.saddr = (uint32_t)(uart->base + datar);
+	tcd.soff = 0;
+	tcd.attr = (edma_get_tcd_attr_xsize(1) << 8) | edma_get_tcd_attr_xsize(1);
+	tcd.nbytes_mlno = 1;
+	tcd.slast = 0;
+	tcd.daddr = (uint32_t)uart->dma.rxBuf;
+	tcd.doff = 1;
+	tcd.citer_elinkno = UART_DMA_RXBUFSZ;
+	tcd.biter_elinkno = UART_DMA_RXBUFSZ;
+	tcd.dlast_sga = (uint32_t)(-UART_DMA_RXBUFSZ);
+	tcd.csr = TCD_CSR_INTMAJOR | TCD_CSR_INTHALF;
+	edma_install_tcd(&tcd, uart->dma.rxChan);
+
+	interrupt(EDMA_CHANNEL_IRQ(uart->dma.rxChan), uart_dmaChanIntr, uart, uart->cond, NULL);
+	interrupt(EDMA_CHANNEL_IRQ(uart->dma.txChan), uart_dmaChanIntr, uart, uart->cond, NULL);
+
+	dmamux_set_source(uart->dma.rxChan, uart_dmaSource(dev, 0));
+	dmamux_channel_enable(uart->dma.rxChan);
+	edma_channel_enable(uart->dma.rxChan);
+
+	/* TX requests are enabled per span */
+	dmamux_set_source(uart->dma.txChan, uart_dmaSource(dev, 1));
+	dmamux_channel_enable(uart->dma.txChan);
+
+	return EOK;
+}
+
+#endif
+
+
 static void signal_txready(void *_uart)
 {
 	uart_t *uartptr = (uart_t *)_uart;
@@ -441,13 +792,14 @@ int uart_handleMsg(msg_t *msg, int dev)
 	pid_t pid;
 	int err;
 	uart_t *uart;
+	uart_stats_t stats;
 
 	dev -= id_uart1;
 
-	if ((dev < 0) || (dev >= (sizeof(uart_preConfig) / sizeof(uart_preConfig[0]))) || (uart_preConfig[dev].active == 0))
+	if ((dev < 0) || (dev >= sizeof(uart_pos)) || (uart_pos[dev] < 0))
 		return -EINVAL;
 
-	uart = &uart_common.uarts[uart_preConfig[dev].pos];
+	uart = &uart_common.uarts[uart_pos[dev]];
 
 	switch (msg->type) {
 		case mtWrite:
@@ -484,6 +836,15 @@ int uart_handleMsg(msg_t *msg, int dev)
 				err = -EINVAL;
 #endif
 			}
+			else if (request == UART_GETSTATS) {
+				uart_getStats(uart, &stats);
+				out_data = &stats;
+				err = EOK;
+			}
+			else if (request == UART_CLRSTATS) {
+				uart_clrStats(uart);
+				err = EOK;
+			}
 			else {
 				err = libtty_ioctl(&uart->tty_common, pid, request, in_data, &out_data);
 			}
@@ -930,10 +1291,12 @@ static void uart_initPins(void)
 #endif
 
 
-void uart_klogCblk(const char *data, size_t size)
+ssize_t uart_klogCblk(const char *data, size_t size)
 {
 #if !ISEMPTY(UART_CONSOLE_USER)
-	libtty_write(&uart_common.uarts[uart_preConfig[UART_CONSOLE_USER - 1].pos].tty_common, data, size, 0);
+	return libtty_write(&uart_common.uarts[uart_pos[UART_CONSOLE_USER - 1]].tty_common, data, size, O_NONBLOCK);
+#else
+	return size;
 #endif
 }
 
@@ -952,21 +1315,26 @@ int uart_init(void)
 
 	const uint32_t default_baud[] = { UART_BAUDRATES };
 	const uint32_t tty_bufsz[] = { UART_BUFSIZES };
+#if UART_DMA
+	const uint8_t use_dma[] = { UART_DMAS };
 
-	for (i = 0, dev = 0; dev < (sizeof(uart_preConfig) / sizeof(uart_preConfig[0])); ++dev) {
-		if (uart_preConfig[dev].active == 0) {
-			continue;
-		}
+	if (edma_init(uart_dmaErrorIntr) < 0) {
+		return -1;
+	}
+#endif
 
-		uart = &uart_common.uarts[i++];
-		uart->base = uart_preConfig[dev].base;
+	for (i = 0; i < UART_CNT; ++i) {
+		dev = uart_desc[i].dev;
+
+		uart = &uart_common.uarts[i];
+		uart->base = uart_desc[i].base;
 		uart->dev_no = dev;
-		uart->halfDuplexAction = uart_preConfig[dev].halfDuplexAction;
+		uart->halfDuplexAction = uart_desc[i].halfDuplexAction;
 
 #ifdef __CPU_IMXRT117X
-		common_setClock(uart_preConfig[dev].clk, -1, -1, -1, -1, 1);
+		common_setClock(uart_desc[i].clk, -1, -1, -1, -1, 1);
 #else
-		common_setClock(uart_preConfig[dev].clk, clk_state_run);
+		common_setClock(uart_desc[i].clk, clk_state_run);
 #endif
 		if (condCreate(&uart->cond) < 0 || mutexCreate(&uart->lock) < 0)
 			return -1;
@@ -1020,8 +1388,24 @@ int uart_init(void)
 		uart->rxFifoSz = fifoSzLut[*(uart->base + fifor) & 0x7];
 		uart->txFifoSz = fifoSzLut[(*(uart->base + fifor) >> 4) & 0x7];
 
-		/* Enable overrun, noise, framing error and receiver interrupts */
-		*(uart->base + ctrlr) |= (1 << 27) | (1 << 26) | (1 << 25) | (1 << 21);
+#if UART_DMA
+		if (use_dma[dev] != 0) {
+			if (uart_dmaInit(uart, dev) < 0) {
+				return -1;
+			}
+
+			/* Enable RX and TX DMA requests */
+			*(uart->base + baudr) |= (1 << 23) | (1 << 21);
+
+			/* Enable overrun, noise, framing error and idle line (counted after stop bit) interrupts */
+			*(uart->base + ctrlr) |= (1 << 27) | (1 << 26) | (1 << 25) | (1 << 20) | (1 << 2);
+		}
+		else
+#endif
+		{
+			/* Enable overrun, noise, framing error and receiver interrupts */
+			*(uart->base + ctrlr) |= (1 << 27) | (1 << 26) | (1 << 25) | (1 << 21);
+		}
 
 		if (uart->halfDuplexAction.port != 0) {
 			const uart_halfDuplexAction_t *action = &uart->halfDuplexAction;
@@ -1035,8 +1419,15 @@ int uart_init(void)
 		/* Enable TX and RX */
 		*(uart->base + ctrlr) |= (1 << 19) | (1 << 18);
 
+#if UART_DMA
+		if (uart->dma.rxBuf != NULL) {
+			beginthread(uart_dmaThread, IMXRT_MULTI_PRIO, &uart->stack, sizeof(uart->stack), uart);
+			interrupt(uart_desc[i].irq, uart_dmaHandleIntr, (void *)uart, uart->cond, NULL);
+			continue;
+		}
+#endif
 		beginthread(uart_intrThread, IMXRT_MULTI_PRIO, &uart->stack, sizeof(uart->stack), uart);
-		interrupt(uart_preConfig[dev].irq, uart_handleIntr, (void *)uart, uart->cond, NULL);
+		interrupt(uart_desc[i].irq, uart_handleIntr, (void *)uart, uart->cond, NULL);
 	}
 
 	return 0;
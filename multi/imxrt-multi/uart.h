@@ -16,12 +16,13 @@
 
 #include <stddef.h>
 #include <sys/msg.h>
+#include <sys/types.h>
 
 
 int uart_handleMsg(msg_t *msg, int dev);
 
 
-void uart_klogCblk(const char *data, size_t size);
+ssize_t uart_klogCblk(const char *data, size_t size);
 
 
 int uart_init(void);
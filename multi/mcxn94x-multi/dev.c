@@ -13,7 +13,9 @@
 
 #include <stddef.h>
 #include <errno.h>
+#include <stdint.h>
 #include <sys/msg.h>
+#include <sys/threads.h>
 #include <posix/utils.h>
 
 #include "common.h"
@@ -26,6 +28,7 @@
 static struct {
 	oid_t oid;
 	devHandler *devices[MAJOR_MAX];
+	uint32_t ports[MAJOR_MAX]; /* port the major's files are registered on */
 } dev_common = { .devices = { NULL } };
 
 
@@ -61,6 +64,10 @@ int dev_registerFile(const char *fname, unsigned int major, unsigned int minor)
 {
 	oid_t oid = { .port = dev_common.oid.port };
 
+	if (major < NELEMS(dev_common.ports)) {
+		oid.port = dev_common.ports[major];
+	}
+
 	dev_mm2oid(&oid, major, minor);
 
 	return create_dev(&oid, fname);
@@ -73,7 +80,7 @@ int dev_msgReceive(msg_t *msg, msg_rid_t *rid)
 }
 
 
-void dev_handle(msg_t *msg, msg_rid_t rid)
+static void _dev_handle(uint32_t port, msg_t *msg, msg_rid_t rid)
 {
 	unsigned int major, minor;
 
@@ -84,14 +91,66 @@ void dev_handle(msg_t *msg, msg_rid_t rid)
 	}
 	else {
 		msg->o.err = -ENOSYS;
-		msgRespond(dev_common.oid.port, msg, rid);
+		msgRespond(port, msg, rid);
 	}
 }
 
 
+void dev_handle(msg_t *msg, msg_rid_t rid)
+{
+	_dev_handle(dev_common.oid.port, msg, rid);
+}
+
+
 void dev_register(devHandler *handler, unsigned int major)
 {
 	dev_common.devices[major] = handler;
+	dev_common.ports[major] = dev_common.oid.port;
+}
+
+
+static void dev_thread(void *arg)
+{
+	uint32_t port = dev_common.ports[(uintptr_t)arg];
+	msg_rid_t rid;
+	msg_t msg;
+
+	for (;;) {
+		if (msgRecv(port, &msg, &rid) < 0) {
+			continue;
+		}
+
+		_dev_handle(port, &msg, rid);
+	}
+}
+
+
+/* To be used only in constructors, before registering files of the major */
+int dev_registerThreaded(devHandler *handler, unsigned int major, int prio, void *stacks, size_t stacksz, unsigned int nthreads)
+{
+	unsigned int i;
+	int err;
+
+	if ((major >= NELEMS(dev_common.devices)) || (nthreads == 0)) {
+		return -EINVAL;
+	}
+
+	err = portCreate(&dev_common.ports[major]);
+	if (err < 0) {
+		return err;
+	}
+
+	dev_common.devices[major] = handler;
+
+	for (i = 0; i < nthreads; ++i) {
+		err = beginthread(dev_thread, prio, (char *)stacks + i * stacksz, stacksz, (void *)(uintptr_t)major);
+		if (err < 0) {
+			/* Threads already started keep serving the port */
+			return (i == 0) ? err : 0;
+		}
+	}
+
+	return 0;
 }
 
 
@@ -14,6 +14,7 @@
 #ifndef MULTI_DEV_H_
 #define MULTI_DEV_H_
 
+#include <stddef.h>
 #include <sys/msg.h>
 
 typedef void devHandler(msg_t *msg, msg_rid_t rid, unsigned int major, unsigned int minor);
@@ -33,4 +34,9 @@ void dev_handle(msg_t *msg, msg_rid_t rid);
 
 void dev_register(devHandler *handler, unsigned int major);
 
+
+/* Serves the major on its own port by nthreads dedicated threads,
+ * stacks points to nthreads * stacksz bytes */
+int dev_registerThreaded(devHandler *handler, unsigned int major, int prio, void *stacks, size_t stacksz, unsigned int nthreads);
+
 #endif /* MULTI_DEV_H_ */
@@ -56,6 +56,27 @@
 #define UART_RXFIFOSIZE 128
 #endif
 
+/* Interrupt on RX/TX FIFO half full/empty instead of every character,
+ * the remainder of a burst is flushed after one idle character */
+#ifndef UART_FIFO_WATERMARK
+#define UART_FIFO_WATERMARK 0
+#endif
+
+/* Serve UART messages by dedicated threads instead of the common pool */
+#ifndef UART_MSGTHREADS
+#define UART_MSGTHREADS 0
+#endif
+
+#ifndef UART_MSGTHREAD_PRIO
+#define UART_MSGTHREAD_PRIO 2
+#endif
+
+#ifndef UART_MSGTHREAD_STACKSZ
+#define UART_MSGTHREAD_STACKSZ 1024
+#endif
+
+#define UART_RXCHUNK 32
+
 
 typedef struct uart_s {
 	char stack[1024] __attribute__ ((aligned(8)));
@@ -89,6 +110,9 @@ static struct {
 	uart_t uarts[UART_CNT];
 	unsigned int major;
 	unsigned int ttyminor;
+#if UART_MSGTHREADS
+	char stacks[UART_MSGTHREADS][UART_MSGTHREAD_STACKSZ] __attribute__ ((aligned(8)));
+#endif
 } uart_common;
 
 
@@ -150,8 +174,10 @@ static int uart_handleIntr(unsigned int n, void *arg)
 static void uart_intrThread(void *arg)
 {
 	uart_t *uart = (uart_t *)arg;
+	uint8_t buf[UART_RXCHUNK];
+	const uint8_t *data;
+	size_t len, i, space;
 	uint8_t mask;
-	uint8_t c;
 
 	for (;;) {
 		/* wait for character or transmit data */
@@ -181,13 +207,31 @@ static void uart_intrThread(void *arg)
 		mutexUnlock(uart->lock);
 
 		/* RX */
-		while (lf_fifo_pop(&uart->rxFifoCtx, &c) != 0) {
-			libtty_putchar(&uart->tty_common, c & mask, NULL);
+		while (lf_fifo_empty(&uart->rxFifoCtx) == 0) {
+			len = lf_fifo_pop_bulk(&uart->rxFifoCtx, buf, sizeof(buf));
+			if (mask != 0xff) {
+				for (i = 0; i < len; ++i) {
+					buf[i] &= mask;
+				}
+			}
+			libtty_putchars(&uart->tty_common, buf, len, NULL);
 		}
 
 		/* TX */
-		while (libtty_txready(&uart->tty_common) && uart_getTXcount(uart) < uart->txFifoSz) {
-			*(uart->base + datar) = libtty_getchar(&uart->tty_common, NULL);
+		while ((space = uart->txFifoSz - uart_getTXcount(uart)) != 0) {
+			len = libtty_tx_span(&uart->tty_common, &data);
+			if (len == 0) {
+				break;
+			}
+
+			if (len > space) {
+				len = space;
+			}
+
+			for (i = 0; i < len; ++i) {
+				*(uart->base + datar) = data[i];
+			}
+			libtty_tx_consume(&uart->tty_common, len, NULL);
 		}
 	}
 }
@@ -491,6 +535,14 @@ static int uart_init(unsigned int minor)
 	uart->rxFifoSz = fifoSzLut[*(uart->base + fifor) & 0x7];
 	uart->txFifoSz = fifoSzLut[(*(uart->base + fifor) >> 4) & 0x7];
 
+#if UART_FIFO_WATERMARK
+	/* RX interrupt above half full, TX below half empty */
+	*(uart->base + waterr) = ((uint32_t)(uart->rxFifoSz / 2) << 16) | (uart->txFifoSz / 2);
+
+	/* Assert RDRF for the data below watermark after 1 idle character */
+	*(uart->base + fifor) = (*(uart->base + fifor) & ~(0x7 << 10)) | (0x1 << 10);
+#endif
+
 	/* Enable overrun, noise, framing error and receiver interrupts */
 	*(uart->base + ctrlr) |= (1 << 27) | (1 << 26) | (1 << 25) | (1 << 21);
 
@@ -511,7 +563,14 @@ static void __attribute__((constructor)) uart_register(void)
 		return;
 	}
 
+#if UART_MSGTHREADS
+	if (dev_registerThreaded(uart_handleMsg, uart_common.major, UART_MSGTHREAD_PRIO,
+			uart_common.stacks, sizeof(uart_common.stacks[0]), UART_MSGTHREADS) < 0) {
+		dev_register(uart_handleMsg, uart_common.major);
+	}
+#else
 	dev_register(uart_handleMsg, uart_common.major);
+#endif
 
 	for (unsigned int minor = 0; minor < UART_MAX; ++minor) {
 		char fname[8];
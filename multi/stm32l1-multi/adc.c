@@ -18,6 +18,8 @@
 #include <sys/platform.h>
 
 #include "common.h"
+#include "adc.h"
+#include "dma.h"
 #include "rcc.h"
 
 
@@ -102,6 +104,86 @@ unsigned short adc_conversion(char channel)
 }
 
 
+static void adc_setSequence(const unsigned char *channels, int count)
+{
+	/* SQ1..SQ6 in SQR5, SQ7..SQ12 in SQR4 and so on down to SQ25..SQ28 in SQR1 */
+	static const unsigned char sqr[] = { sqr5, sqr4, sqr3, sqr2, sqr1 };
+	unsigned int t, i, reg, shift;
+
+	for (i = 0; i < count; ++i) {
+		reg = sqr[i / 6];
+		shift = (i % 6) * 5;
+		t = *(adc_common.base + reg) & ~(0x1f << shift);
+		*(adc_common.base + reg) = t | ((channels[i] & 0x1f) << shift);
+	}
+
+	t = *(adc_common.base + sqr1) & ~(0x1f << 20);
+	*(adc_common.base + sqr1) = t | ((count - 1) << 20);
+}
+
+
+int adc_sequence(const unsigned char *channels, int count, unsigned short *out)
+{
+	unsigned int t;
+	int i, internal = 0;
+
+	if ((count < 1) || (count > ADC_SEQUENCE_MAX))
+		return -EINVAL;
+
+	/* Bank selection is common for the whole sequence */
+	for (i = 0; i < count; ++i) {
+		if ((channels[i] & 0x20) != (channels[0] & 0x20))
+			return -EINVAL;
+
+		if (channels[i] == 16 || channels[i] == 17)
+			internal = 1;
+	}
+
+	if (!ADC_DMA) {
+		for (i = 0; i < count; ++i)
+			out[i] = adc_conversion(channels[i]);
+
+		return count;
+	}
+
+	mutexLock(adc_common.lock);
+
+	rcc_setHsi(1);
+
+	*(adc_common.base + cr2) |= 1;
+	while (!(*(adc_common.base + sr) & (1 << 6)));
+
+	if (internal)
+		*(adc_common.base + ccr) |= 1 << 23;
+
+	t = *(adc_common.base + cr2) & ~(!(channels[0] & 0x20) << 2);
+	*(adc_common.base + cr2) = t | (!!(channels[0] & 0x20) << 2);
+
+	adc_setSequence(channels, count);
+
+	/* Scan mode, no EOC interrupts, DMA moves each conversion */
+	*(adc_common.base + sr) &= ~((1 << 5) | (1 << 2) | (1 << 1));
+	*(adc_common.base + cr1) |= 1 << 8;
+	*(adc_common.base + cr2) |= 1 << 8;
+
+	*(adc_common.base + cr2) |= 1 << 30;
+	dma_transfer_adc(out, count);
+
+	*(adc_common.base + cr2) &= ~(1 << 8);
+	*(adc_common.base + cr1) &= ~(1 << 8);
+	*(adc_common.base + sqr1) &= ~(0x1f << 20);
+
+	*(adc_common.base + ccr) &= ~(1 << 23);
+	*(adc_common.base + cr2) &= ~1;
+
+	rcc_setHsi(0);
+
+	mutexUnlock(adc_common.lock);
+
+	return count;
+}
+
+
 int adc_init(void)
 {
 	int i = 0;
@@ -148,5 +230,9 @@ int adc_init(void)
 	/* Register end of conversion interrupt */
 	interrupt(adc1_irq, adc_irqEoc, NULL, adc_common.cond, NULL);
 
+	/* 16-bit data register to 16-bit memory */
+	if (ADC_DMA)
+		dma_configure_adc(0x1, (void *)(adc_common.base + dr), 0x1, 0x1);
+
 	return EOK;
 }
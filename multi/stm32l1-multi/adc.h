@@ -15,9 +15,16 @@
 #define _ADC_H_
 
 
+#define ADC_SEQUENCE_MAX 28
+
+
 unsigned short adc_conversion(char channel);
 
 
+/* Converts channels (all from one bank) in a single scan, returns count or negative error */
+int adc_sequence(const unsigned char *channels, int count, unsigned short *out);
+
+
 int adc_init(void);
 
 
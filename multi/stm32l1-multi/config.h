@@ -53,6 +53,19 @@
 #define LCD 1
 #endif
 
+/* I2C2 DMA channels are shared with SPI2 */
+#ifndef I2C_DMA
+#define I2C_DMA (!SPI2)
+#endif
+
+#if I2C_DMA && SPI2
+#error "I2C_DMA cannot be used together with SPI2!"
+#endif
+
+#ifndef ADC_DMA
+#define ADC_DMA 1
+#endif
+
 #ifndef FLASH_PROGRAM_1_ADDR
 #define FLASH_PROGRAM_1_ADDR 0x08000000
 #endif
@@ -19,11 +19,11 @@
 #include "rcc.h"
 
 
-#define DMA1_CH1 0
+#define DMA1_CH1 (ADC_DMA)
 #define DMA1_CH2 (SPI1)
 #define DMA1_CH3 (SPI1)
-#define DMA1_CH4 (SPI2)
-#define DMA1_CH5 (SPI2)
+#define DMA1_CH4 (SPI2 || I2C_DMA)
+#define DMA1_CH5 (SPI2 || I2C_DMA)
 #define DMA1_CH6 0
 #define DMA1_CH7 0
 
@@ -76,6 +76,13 @@ static const struct dma_map {
 };
 
 
+/* I2C2, ADC1 (per2mem only) */
+static const struct dma_map i2cChanMap = { dma1, { 4, 3 } };
+
+
+static const struct dma_map adcChanMap = { dma1, { 0, 0 } };
+
+
 enum { isr = 0, ifcr };
 
 
@@ -183,6 +190,34 @@ static int _transfer(int dma, int rx_channel, int tx_channel, void *rx_maddr, vo
 }
 
 
+int dma_configure_i2c(int dir, int priority, void *paddr, int msize, int psize, int minc, int pinc)
+{
+	_configure_channel(i2cChanMap.dma, i2cChanMap.channel[dir], dir, priority, paddr, msize, psize, minc, pinc);
+
+	return 0;
+}
+
+
+int dma_transfer_i2c(void *rx_maddr, void *tx_maddr, size_t len)
+{
+	return _transfer(i2cChanMap.dma, i2cChanMap.channel[dma_per2mem], i2cChanMap.channel[dma_mem2per], rx_maddr, tx_maddr, len);
+}
+
+
+int dma_configure_adc(int priority, void *paddr, int msize, int psize)
+{
+	_configure_channel(adcChanMap.dma, adcChanMap.channel[dma_per2mem], dma_per2mem, priority, paddr, msize, psize, 1, 0);
+
+	return 0;
+}
+
+
+int dma_transfer_adc(void *rx_maddr, size_t len)
+{
+	return _transfer(adcChanMap.dma, adcChanMap.channel[dma_per2mem], adcChanMap.channel[dma_mem2per], rx_maddr, NULL, len);
+}
+
+
 int dma_transfer_spi(int num, void *rx_maddr, void *tx_maddr, size_t len)
 {
 	int pos;
@@ -24,6 +24,19 @@ int dma_configure_spi(int num, int dir, int priority, void *paddr, int msize, in
 int dma_transfer_spi(int num, void *rx_maddr, void *tx_maddr, size_t len);
 
 
+/* Either rx_maddr or tx_maddr may be NULL */
+int dma_configure_i2c(int dir, int priority, void *paddr, int msize, int psize, int minc, int pinc);
+
+
+int dma_transfer_i2c(void *rx_maddr, void *tx_maddr, size_t len);
+
+
+int dma_configure_adc(int priority, void *paddr, int msize, int psize);
+
+
+int dma_transfer_adc(void *rx_maddr, size_t len);
+
+
 int dma_init(void);
 
 
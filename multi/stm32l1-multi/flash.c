@@ -88,27 +88,37 @@ static void _eeprom_unlock(void)
 }
 
 
-static int _eeprom_eraseByte(uint32_t addr)
+/* With FTDW cleared the word is erased automatically only if it isn't erased already */
+static inline void _eeprom_clearFtdw(void)
+{
+	*(flash_common.flash + flash_pecr) &= ~(1 << 8);
+	dataBarier();
+}
+
+
+static int _eeprom_writeByte(uint32_t addr, char value)
 {
 	int err;
 
 	_flash_clearFlags();
 
-	if ((err = _flash_wait()) == 0)
-		*(volatile uint8_t *) addr = 0x0;
+	if ((err = _flash_wait()) == 0) {
+		*(volatile uint8_t *) addr = value;
+		err = _flash_wait();
+	}
 
 	return err;
 }
 
 
-static int _eeprom_writeByte(uint32_t addr, char value)
+static int _eeprom_writeWord(uint32_t addr, uint32_t value)
 {
 	int err;
 
 	_flash_clearFlags();
 
 	if ((err = _flash_wait()) == 0) {
-		*(volatile uint8_t *) addr = value;
+		*(volatile uint32_t *) addr = value;
 		err = _flash_wait();
 	}
 
@@ -132,13 +142,29 @@ static size_t eeprom_readData(uint32_t offset, char *buff, size_t size)
 static size_t eeprom_writeData(uint32_t offset, const char *buff, size_t size)
 {
 	unsigned int i;
+	uint32_t word;
+	int err = 0;
 
 	mutexLock(flash_common.lock);
 	_eeprom_unlock();
-	for (i = 0; i < size; ++i) {
-		_eeprom_eraseByte(offset + i);
-		if (buff[i] != 0)
-			_eeprom_writeByte(offset + i, buff[i]);
+	_eeprom_clearFtdw();
+	for (i = 0; (i < size) && (err == 0); ) {
+		/* Program whole aligned words, skip the ones already holding the data */
+		if ((((offset + i) & 0x3) == 0) && ((size - i) >= sizeof(word))) {
+			memcpy(&word, buff + i, sizeof(word));
+			if (*(volatile uint32_t *) (offset + i) != word)
+				err = _eeprom_writeWord(offset + i, word);
+
+			if (err == 0)
+				i += sizeof(word);
+		}
+		else {
+			if (*((volatile uint8_t *) offset + i) != (uint8_t) buff[i])
+				err = _eeprom_writeByte(offset + i, buff[i]);
+
+			if (err == 0)
+				++i;
+		}
 	}
 	_eeprom_lock();
 	mutexUnlock(flash_common.lock);
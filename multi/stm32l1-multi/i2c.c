@@ -19,6 +19,7 @@
 
 #include "stm32l1-multi.h"
 #include "common.h"
+#include "dma.h"
 #include "gpio.h"
 #include "i2c.h"
 #include "rcc.h"
@@ -27,6 +28,10 @@
 enum { cr1 = 0, cr2, oar1, oar2, dr, sr1, sr2, ccr, trise };
 
 
+/* Shorter transfers are moved by CPU */
+#define I2C_DMA_MINLEN 4
+
+
 struct {
 	volatile unsigned int *base;
 
@@ -91,6 +96,7 @@ static void i2c_hwinit(void)
 unsigned int i2c_transaction(char op, char addr, char reg, void *buff, unsigned int count)
 {
 	int i;
+	int usedma = (I2C_DMA && (count >= I2C_DMA_MINLEN)) ? 1 : 0;
 
 	if (count < 1 || (op != _i2c_read && op != _i2c_write))
 		return 0;
@@ -127,12 +133,24 @@ unsigned int i2c_transaction(char op, char addr, char reg, void *buff, unsigned
 		while (!(*(i2c_common.base + sr1) & 1))
 			i2c_waitForIrq();
 
+		/* DMA requests, NACK after the last DMA byte - have to be set before ADDR is cleared */
+		if (usedma)
+			*(i2c_common.base + cr2) |= (1 << 12) | (1 << 11);
+
 		*(i2c_common.base + dr) = (addr << 1) | 1;
 
 		while (!((*(i2c_common.base + sr1) & 2) && (*(i2c_common.base + sr2) & 1)))
 			i2c_waitForIrq();
 
-		for (i = 0; i < count; ++i) {
+		if (usedma) {
+			/* No buffer interrupts while DMA serves RXNE */
+			*(i2c_common.base + cr2) &= ~(1 << 10);
+			dma_transfer_i2c(buff, NULL, count);
+			*(i2c_common.base + cr2) &= ~((1 << 12) | (1 << 11));
+			*(i2c_common.base + cr1) &= ~(1 << 10);
+		}
+
+		for (i = usedma ? count : 0; i < count; ++i) {
 			while (!(*(i2c_common.base + sr1) & (1 << 6)))
 				i2c_waitForIrq();
 
@@ -142,6 +160,16 @@ unsigned int i2c_transaction(char op, char addr, char reg, void *buff, unsigned
 			((char *)buff)[i] = *(i2c_common.base + dr);
 		}
 	}
+	else if (usedma) {
+		*(i2c_common.base + cr2) &= ~(1 << 10);
+		*(i2c_common.base + cr2) |= (1 << 11);
+		dma_transfer_i2c(NULL, buff, count);
+		*(i2c_common.base + cr2) &= ~(1 << 11);
+		i = count;
+
+		while (!(*(i2c_common.base + sr1) & (1 << 7)))
+			i2c_waitForIrq();
+	}
 	else {
 		for (i = 0; i < count; ++i) {
 			while (!(*(i2c_common.base + sr1) & (1 << 7)))
@@ -180,5 +208,10 @@ int i2c_init(void)
 
 	interrupt(49, i2c_irq, NULL, i2c_common.irqcond, &i2c_common.inth);
 
+	if (I2C_DMA) {
+		dma_configure_i2c(dma_mem2per, 0x1, (void *)(i2c_common.base + dr), 0x0, 0x0, 0x1, 0x0);
+		dma_configure_i2c(dma_per2mem, 0x1, (void *)(i2c_common.base + dr), 0x0, 0x0, 0x1, 0x0);
+	}
+
 	return EOK;
 }
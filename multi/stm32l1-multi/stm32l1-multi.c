@@ -59,6 +59,14 @@ static void handleMsg(msg_t *msg)
 			omsg->adc_val = adc_conversion(imsg->adc_channel);
 			break;
 
+		case adc_scan:
+			if (msg->o.size < imsg->adc_scan.count * sizeof(unsigned short)) {
+				err = -EINVAL;
+				break;
+			}
+			err = adc_sequence(imsg->adc_scan.channels, imsg->adc_scan.count, msg->o.data);
+			break;
+
 		case rtc_setcal:
 			rtc_setCalib(imsg->rtc_calib);
 			break;
@@ -19,7 +19,7 @@
 
 enum { adc_get = 0, rtc_setcal, rtc_get, rtc_set, lcd_get, lcd_set, i2c_get,
 	i2c_set, gpio_def, gpio_get, gpio_set, uart_def, uart_get, uart_set,
-	flash_get, flash_set, spi_get, spi_set, spi_rw, spi_def, exti_def, exti_map };
+	flash_get, flash_set, spi_get, spi_set, spi_rw, spi_def, exti_def, exti_map, adc_scan };
 
 /* RTC */
 
@@ -85,6 +85,15 @@ typedef struct {
 } __attribute__((packed)) lcdmsg_t;
 
 
+/* ADC */
+
+
+typedef struct {
+	unsigned char count;
+	unsigned char channels[28];
+} __attribute__((packed)) adcscan_t;
+
+
 /* I2C */
 
 
@@ -215,6 +224,7 @@ typedef struct {
 
 	union {
 		int adc_channel;
+		adcscan_t adc_scan;
 		int rtc_calib;
 		rtctimestamp_t rtc_timestamp;
 		lcdmsg_t lcd_msg;
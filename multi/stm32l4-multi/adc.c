@@ -13,15 +13,24 @@
 
 
 #include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <sys/threads.h>
 #include <sys/platform.h>
 #include <sys/pwman.h>
 
+#include <libmulti/libdma.h>
+
 #include "common.h"
+#include "config.h"
 #include "rcc.h"
 #include "stm32l4-multi.h"
 
+
+#define ADC_SCAN_MAXCHANS 16
+#define ADC_SCAN_TIMEOUT  (1000 * 1000)
+
 enum { adc1_offs = 0, adc2_offs = 64, adc3_offs = 128, common_offs = 192 };
 
 enum { isr = 0, ier, cr, cfgr, cfgr2, smpr1, smpr2, tr1 = smpr2 + 2, tr2, tr3, sqr1 = tr3 + 2, sqr2, sqr3, sqr4, dr,
@@ -41,6 +50,18 @@ struct {
 	unsigned int calibration[3];
 
 	handle_t lock[3];
+
+	struct {
+		const struct libdma_per *per;
+		uint16_t *buf;
+		unsigned int nchans;
+		unsigned int scale; /* mV at full scale */
+		unsigned int full;
+		volatile unsigned int half;
+		volatile unsigned int seq;
+		int active;
+		handle_t cond;
+	} scan[3];
 } adc_common;
 
 
@@ -64,11 +85,18 @@ static int adc_getOffs(int adc)
 }
 
 
-static void adc_wakeup(int adc)
+static int adc_wakeup(int adc)
 {
 	volatile unsigned int *base = adc_common.base + adc_getOffs(adc);
 
 	mutexLock(adc_common.lock[adc]);
+
+	/* Scanning ADC is owned by the DMA until adc_scanStop() */
+	if (adc_common.scan[adc].active != 0) {
+		mutexUnlock(adc_common.lock[adc]);
+		return -EBUSY;
+	}
+
 	keepidle(1);
 
 	/* Exit deep power down */
@@ -83,6 +111,8 @@ static void adc_wakeup(int adc)
 	*(base + cfgr) = (1 << 31) | (1 << 12);
 	*(base + smpr1) = 0xbfffffff;
 	*(base + smpr2) = 0x07ffffff;
+
+	return EOK;
 }
 
 
@@ -167,17 +197,26 @@ static void adc_enable(int adc)
 }
 
 
-unsigned short adc_conversion(int adc, char chan)
+int adc_conversion(int adc, char chan)
 {
 	unsigned short vref, val;
 	unsigned int out;
 
-	adc_wakeup(adc);
+	if ((adc < adc1) || (adc > adc3)) {
+		return -EINVAL;
+	}
+
+	if (adc_wakeup(adc) < 0) {
+		return -EBUSY;
+	}
 	adc_calibration(adc);
 	adc_enable(adc);
 
 	if (adc != adc1) {
-		adc_wakeup(adc1);
+		if (adc_wakeup(adc1) < 0) {
+			adc_disable(adc);
+			return -EBUSY;
+		}
 		adc_calibration(adc1);
 		adc_enable(adc1);
 	}
@@ -201,6 +240,218 @@ unsigned short adc_conversion(int adc, char chan)
 }
 
 
+static void adc_scanIrq(void *arg, int type)
+{
+	unsigned int adc = (uintptr_t)arg;
+
+	/* Half transfer - first half of the frames is complete, transfer complete - the second one */
+	adc_common.scan[adc].half = ((type & dma_tc) != 0) ? 1 : 0;
+	++adc_common.scan[adc].seq;
+}
+
+
+int adc_scanStart(int adc, const unsigned char *chans, unsigned int nchans, unsigned int ovs, unsigned int smp)
+{
+	volatile unsigned int *base;
+	unsigned int i, pos, shift, smpr, sqr[4];
+	unsigned short vref;
+	int err;
+
+	if ((adc < adc1) || (adc > adc3) || (nchans == 0) || (nchans > ADC_SCAN_MAXCHANS) || (ovs > 8) || (smp > 7) ||
+			(ADC_SCAN_FRAMES < 2)) {
+		return -EINVAL;
+	}
+
+	for (i = 0; i < nchans; ++i) {
+		if (chans[i] > 18) {
+			return -EINVAL;
+		}
+	}
+
+	base = adc_common.base + adc_getOffs(adc);
+
+	if (adc_wakeup(adc) < 0) {
+		return -EBUSY;
+	}
+
+	if (adc_common.scan[adc].per == NULL) {
+		err = libdma_init();
+		if (err == 0) {
+			err = libdma_acquirePeripheral(dma_adc, adc, &adc_common.scan[adc].per);
+		}
+		if (err < 0) {
+			adc_common.scan[adc].per = NULL;
+			adc_disable(adc);
+			return err;
+		}
+
+		libdma_configurePeripheral(adc_common.scan[adc].per, dma_per2mem, dma_priorityMedium, (void *)(base + dr), 0x1, 0x1, 0x1, 0x0,
+			&adc_common.scan[adc].cond);
+	}
+
+	adc_common.scan[adc].buf = malloc(ADC_SCAN_FRAMES * nchans * sizeof(uint16_t));
+	if (adc_common.scan[adc].buf == NULL) {
+		adc_disable(adc);
+		return -ENOMEM;
+	}
+
+	adc_calibration(adc);
+	adc_enable(adc);
+
+	/* Reference is measured once, scanned channel 0 of ADC1 can't be used for it anymore */
+	if (adc != adc1) {
+		if (adc_wakeup(adc1) < 0) {
+			free(adc_common.scan[adc].buf);
+			adc_common.scan[adc].buf = NULL;
+			adc_disable(adc);
+			return -EBUSY;
+		}
+		adc_calibration(adc1);
+		adc_enable(adc1);
+	}
+
+	vref = adc_probeChannel(adc1, 0);
+
+	if (adc != adc1) {
+		adc_disable(adc1);
+	}
+
+	/* Oversampled result is kept within 16 bits */
+	shift = (ovs > 4) ? (ovs - 4) : 0;
+	adc_common.scan[adc].scale = (3000 * (*vrefint)) / vref;
+	adc_common.scan[adc].full = (1 << (12 + ovs - shift)) - 1;
+	adc_common.scan[adc].nchans = nchans;
+	adc_common.scan[adc].half = 0;
+	adc_common.scan[adc].seq = 0;
+
+	*(base + cfgr2) = (ovs != 0) ? ((shift << 5) | ((ovs - 1) << 2) | 1) : 0;
+
+	for (i = 0, smpr = 0; i < 10; ++i) {
+		smpr |= smp << (3 * i);
+	}
+	*(base + smpr1) = (1u << 31) | smpr;
+	*(base + smpr2) = smpr & 0x07ffffff;
+
+	sqr[0] = nchans - 1;
+	sqr[1] = 0;
+	sqr[2] = 0;
+	sqr[3] = 0;
+	for (i = 0; i < nchans; ++i) {
+		pos = i + 1;
+		sqr[pos / 5] |= (unsigned int)chans[i] << ((pos % 5) * 6);
+	}
+	*(base + sqr1) = sqr[0];
+	*(base + sqr2) = sqr[1];
+	*(base + sqr3) = sqr[2];
+	*(base + sqr4) = sqr[3];
+
+	/* Continuous conversion, overrun overwrites, circular DMA */
+	*(base + cfgr) = (1 << 31) | (1 << 13) | (1 << 12) | (1 << 1) | 1;
+	*(base + isr) |= 0x7ff;
+	dataBarier();
+
+	libdma_infiniteRxAsync(adc_common.scan[adc].per, adc_common.scan[adc].buf, ADC_SCAN_FRAMES * nchans, adc_scanIrq, (void *)(uintptr_t)adc);
+
+	adc_common.scan[adc].active = 1;
+
+	*(base + cr) |= 1 << 2;
+	dataBarier();
+
+	/* ADC stays awake (keepidle) until adc_scanStop() */
+	mutexUnlock(adc_common.lock[adc]);
+
+	return EOK;
+}
+
+
+int adc_scanStop(int adc)
+{
+	volatile unsigned int *base;
+
+	if ((adc < adc1) || (adc > adc3)) {
+		return -EINVAL;
+	}
+
+	base = adc_common.base + adc_getOffs(adc);
+
+	mutexLock(adc_common.lock[adc]);
+
+	if (adc_common.scan[adc].active == 0) {
+		mutexUnlock(adc_common.lock[adc]);
+		return -EINVAL;
+	}
+
+	*(base + cr) |= 1 << 4;
+	dataBarier();
+
+	while (*(base + cr) & (1 << 2))
+		usleep(0);
+
+	libdma_infiniteStop(adc_common.scan[adc].per, dma_per2mem);
+
+	*(base + cfgr) = (1 << 31) | (1 << 12);
+	*(base + cfgr2) = 0;
+
+	free(adc_common.scan[adc].buf);
+	adc_common.scan[adc].buf = NULL;
+	adc_common.scan[adc].active = 0;
+	condBroadcast(adc_common.scan[adc].cond);
+
+	/* Drops keepidle and the lock taken by adc_scanStart() */
+	adc_disable(adc);
+
+	return EOK;
+}
+
+
+/* Waits for the next half of the DMA buffer and returns its frames in mV, one value per scanned channel */
+int adc_scanRead(int adc, void *data, size_t size)
+{
+	unsigned short *out = data;
+	const uint16_t *in;
+	unsigned int seq, i, n;
+	int err = EOK;
+
+	if ((adc < adc1) || (adc > adc3) || (data == NULL)) {
+		return -EINVAL;
+	}
+
+	mutexLock(adc_common.lock[adc]);
+
+	seq = adc_common.scan[adc].seq;
+	while ((adc_common.scan[adc].active != 0) && (seq == adc_common.scan[adc].seq)) {
+		if (condWait(adc_common.scan[adc].cond, adc_common.lock[adc], ADC_SCAN_TIMEOUT) == -ETIME) {
+			err = -ETIME;
+			break;
+		}
+	}
+
+	if (adc_common.scan[adc].active == 0) {
+		err = -EINVAL;
+	}
+
+	if (err == EOK) {
+		n = (ADC_SCAN_FRAMES / 2) * adc_common.scan[adc].nchans;
+		if (n > size / sizeof(*out)) {
+			/* Whole frames only */
+			n = size / sizeof(*out) - (size / sizeof(*out)) % adc_common.scan[adc].nchans;
+		}
+
+		/* The other half is being written by the DMA meanwhile */
+		in = adc_common.scan[adc].buf + adc_common.scan[adc].half * (ADC_SCAN_FRAMES / 2) * adc_common.scan[adc].nchans;
+		for (i = 0; i < n; ++i) {
+			out[i] = (adc_common.scan[adc].scale * in[i]) / adc_common.scan[adc].full;
+		}
+
+		err = n * sizeof(*out);
+	}
+
+	mutexUnlock(adc_common.lock[adc]);
+
+	return err;
+}
+
+
 int adc_init(void)
 {
 	int i;
@@ -212,6 +463,7 @@ int adc_init(void)
 
 	for (i = adc1; i <= adc3; ++i) {
 		mutexCreate(&adc_common.lock[i]);
+		condCreate(&adc_common.scan[i].cond);
 		adc_wakeup(i);
 		adc_calibration(i);
 		adc_disable(i);
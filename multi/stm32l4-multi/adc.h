@@ -14,8 +14,23 @@
 #ifndef ADC_H_
 #define ADC_H_
 
+#include <stddef.h>
 
-unsigned short adc_conversion(int adc, char chan);
+
+/* Returns mV or negative error (-EBUSY if the ADC is scanning) */
+int adc_conversion(int adc, char chan);
+
+
+/* Starts continuous scan of nchans (max. 16) channels into a circular DMA buffer,
+ * ovs - log2 of the hardware oversampling ratio (0 - disabled), smp - sampling time code */
+int adc_scanStart(int adc, const unsigned char *chans, unsigned int nchans, unsigned int ovs, unsigned int smp);
+
+
+int adc_scanStop(int adc);
+
+
+/* Returns the latest completed frames in mV, size in bytes */
+int adc_scanRead(int adc, void *data, size_t size);
 
 
 int adc_init(void);
@@ -187,6 +187,49 @@
 #define TTY5_LIBTTY_BUFSZ 512
 #endif
 
+/* Low power DMA mode - RX thread is woken only on idle line or character match,
+ * RX DMA FIFO has to fit the longest frame */
+#ifndef TTY1_LOWPOWER
+#define TTY1_LOWPOWER 0
+#endif
+
+#ifndef TTY2_LOWPOWER
+#define TTY2_LOWPOWER 0
+#endif
+
+#ifndef TTY3_LOWPOWER
+#define TTY3_LOWPOWER 0
+#endif
+
+#ifndef TTY4_LOWPOWER
+#define TTY4_LOWPOWER 0
+#endif
+
+#ifndef TTY5_LOWPOWER
+#define TTY5_LOWPOWER 0
+#endif
+
+/* Character that ends a frame in low power mode (e.g. '\n'), -1 disables matching */
+#ifndef TTY1_CHARMATCH
+#define TTY1_CHARMATCH -1
+#endif
+
+#ifndef TTY2_CHARMATCH
+#define TTY2_CHARMATCH -1
+#endif
+
+#ifndef TTY3_CHARMATCH
+#define TTY3_CHARMATCH -1
+#endif
+
+#ifndef TTY4_CHARMATCH
+#define TTY4_CHARMATCH -1
+#endif
+
+#ifndef TTY5_CHARMATCH
+#define TTY5_CHARMATCH -1
+#endif
+
 #ifndef UART1_RXFIFOSZ
 #define UART1_RXFIFOSZ 64
 #endif
@@ -251,6 +294,28 @@
 #define I2C4 0
 #endif
 
+#ifndef I2C1_USEDMA
+#define I2C1_USEDMA 0
+#endif
+
+#ifndef I2C2_USEDMA
+#define I2C2_USEDMA 0
+#endif
+
+#ifndef I2C3_USEDMA
+#define I2C3_USEDMA 0
+#endif
+
+#ifndef I2C4_USEDMA
+#define I2C4_USEDMA 0
+#endif
+
+
+/* ADC scan DMA buffer length in frames (two halves, min. 2) */
+#ifndef ADC_SCAN_FRAMES
+#define ADC_SCAN_FRAMES 8
+#endif
+
 
 /* dummyfs */
 #ifndef BUILTIN_DUMMYFS
@@ -189,14 +189,35 @@ static int _program_erasePage(uint32_t addr)
 }
 
 
-static int _program_dblWords(volatile uint32_t *addr, const char *buff, size_t size)
+static int _program_isErased(uint32_t addr, size_t size)
+{
+	const volatile uint32_t *p = (void *)addr;
+	size_t i;
+
+	for (i = 0; i < size / sizeof(uint32_t); ++i) {
+		if (p[i] != 0xffffffffu) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+
+/* skipErased - destination is erased, all ones double words don't have to be programmed */
+static int _program_dblWords(volatile uint32_t *addr, const char *buff, size_t size, int skipErased)
 {
 	int pos = 0;
 	uint32_t value[2];
 
 	for (pos = 0; pos < size; pos += 2 * sizeof(uint32_t)) {
-		*(flash_common.flash + flash_cr) |= 1;
 		memcpy(value, buff + pos, 2 * sizeof(uint32_t));
+		if ((skipErased != 0) && (value[0] == 0xffffffffu) && (value[1] == 0xffffffffu)) {
+			addr += 2;
+			continue;
+		}
+
+		*(flash_common.flash + flash_cr) |= 1;
 		*(addr++) = value[0];
 		dataBarier();
 		*(addr++) = value[1];
@@ -231,7 +252,7 @@ static int _program_writePage(uint32_t offset)
 
 	_flash_clearFlags();
 
-	ret = _program_dblWords((void *)offset, flash_common.page, FLASH_PAGE_SIZE);
+	ret = _program_dblWords((void *)offset, flash_common.page, FLASH_PAGE_SIZE, 1);
 	if (ret < FLASH_PAGE_SIZE) {
 		return -1;
 	}
@@ -243,7 +264,8 @@ static int _program_writePage(uint32_t offset)
 size_t flash_writeData(uint32_t offset, const char *buff, size_t size)
 {
 	size_t towrite = size, chunk;
-	uint32_t coffset = offset, cpage, missalign;
+	uint32_t coffset = offset, cpage, missalign, dstart, dend;
+	int ret;
 
 	if (!program_isValidAddress(offset, size))
 		return 0;
@@ -257,6 +279,21 @@ size_t flash_writeData(uint32_t offset, const char *buff, size_t size)
 		missalign = coffset - cpage;
 		chunk = (towrite > FLASH_PAGE_SIZE - missalign) ? FLASH_PAGE_SIZE - missalign : towrite;
 
+		/* Erased destination (e.g. appended logs) is programmed in place,
+		 * only the unaligned head and tail double words are padded with ones */
+		dstart = coffset & ~(2 * sizeof(uint32_t) - 1);
+		dend = (coffset + chunk + 2 * sizeof(uint32_t) - 1) & ~(2 * sizeof(uint32_t) - 1);
+		if (_program_isErased(dstart, dend - dstart) != 0) {
+			memset(flash_common.page, 0xff, dend - dstart);
+			memcpy(flash_common.page + (coffset - dstart), buff + size - towrite, chunk);
+			ret = _program_dblWords((void *)dstart, flash_common.page, dend - dstart, 1);
+			if ((ret < 0) || ((size_t)ret < dend - dstart))
+				break;
+			towrite -= chunk;
+			coffset += chunk;
+			continue;
+		}
+
 		if (chunk != FLASH_PAGE_SIZE) {
 			if (_program_readData(cpage, flash_common.page, FLASH_PAGE_SIZE) != FLASH_PAGE_SIZE)
 				break;
@@ -292,7 +329,7 @@ ssize_t flash_writeOtp(uint32_t offset, const char *buff, size_t size)
 
 	ret = _flash_wait();
 	if (ret == 0) {
-		ret = _program_dblWords(ptr, buff, size);
+		ret = _program_dblWords(ptr, buff, size, 0);
 	}
 
 	_program_lock();
@@ -330,7 +367,7 @@ ssize_t flash_writeRaw(uint32_t offset, const char *buff, size_t size)
 	ret = _flash_wait();
 	if (ret == 0) {
 		_flash_clearFlags();
-		ret = _program_dblWords((void *)offset, buff, size);
+		ret = _program_dblWords((void *)offset, buff, size, 0);
 	}
 
 	_program_lock();
@@ -44,6 +44,9 @@ static const int i2cConfig[] = { I2C1, I2C2, I2C3, I2C4 };
 static const int i2cPos[] = { I2C1_POS, I2C2_POS, I2C3_POS, I2C4_POS };
 
 
+static const int i2cUseDma[] = { I2C1_USEDMA, I2C2_USEDMA, I2C3_USEDMA, I2C4_USEDMA };
+
+
 
 ssize_t i2c_read(int i2c, unsigned char addr, void *buff, size_t len)
 {
@@ -115,5 +118,8 @@ void i2c_init(void)
 
 		mutexCreate(&i2c_lock[i2cPos[i2c]]);
 		libi2c_init(&i2c_ctx[i2cPos[i2c]], i2c);
+		if (i2cUseDma[i2c] != 0) {
+			libi2c_initDma(&i2c_ctx[i2cPos[i2c]], i2c);
+		}
 	}
 }
@@ -13,11 +13,18 @@
 #ifndef LIBAES_H_
 #define LIBAES_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
+
+#define LIBAES_BLOCKSZ 16
+#define LIBAES_TAGSZ   16
+
 
 enum { aes_128 = 0, aes_256 = 1 };
 
 
-enum { aes_ecb = 0, aes_cbc = 1, aes_ctr = 2 };
+enum { aes_ecb = 0, aes_cbc = 1, aes_ctr = 2, aes_gcm = 3 };
 
 
 enum { aes_encrypt = 0, aes_decrypt = 2 };
@@ -47,6 +54,46 @@ void libaes_unprepare(void);
 void libaes_processBlock(const unsigned char *in, unsigned char *out);
 
 
+/* Processes len bytes (multiple of LIBAES_BLOCKSZ) in the mode set by libaes_prepare().
+ * Word aligned buffers are transferred by DMA, returns len or negative error. */
+int libaes_process(const unsigned char *in, unsigned char *out, size_t len);
+
+
+/* Streaming API - keeps the whole state in the context, so streams may be interleaved.
+ * Hardware is reloaded on each call, a single call should cover as much data as possible. */
+
+
+typedef struct {
+	unsigned int cr;
+	int mode;
+	int keylen;
+	int state;
+	unsigned char key[32];
+	unsigned char iv[LIBAES_BLOCKSZ];
+	uint32_t susp[8];
+	uint64_t aadlen;
+	uint64_t len;
+} libaes_ctx_t;
+
+
+/* iv: NULL for ECB, 16 bytes for CBC and CTR (initial counter block), 12 bytes for GCM */
+int libaes_start(libaes_ctx_t *ctx, int mode, int dir, const unsigned char *key, int keylen, const unsigned char *iv);
+
+
+/* GCM additional authenticated data, has to precede libaes_update().
+ * len has to be a multiple of LIBAES_BLOCKSZ except for the last call. */
+int libaes_aad(libaes_ctx_t *ctx, const unsigned char *aad, size_t len);
+
+
+/* len has to be a multiple of LIBAES_BLOCKSZ, except for the last call in CTR and GCM */
+int libaes_update(libaes_ctx_t *ctx, const unsigned char *in, unsigned char *out, size_t len);
+
+
+/* GCM (GMAC if no payload was processed) writes LIBAES_TAGSZ bytes tag, which
+ * after decryption has to be compared by the caller. Done context may be discarded. */
+int libaes_finish(libaes_ctx_t *ctx, unsigned char *tag);
+
+
 int libaes_init(void);
 
 
@@ -0,0 +1,64 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Multidrv-lib: asynchronous bus transaction queue
+ *
+ * Copyright 2024 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+
+#ifndef LIBBUSQ_H_
+#define LIBBUSQ_H_
+
+#include <stddef.h>
+#include <sys/threads.h>
+
+
+/* clang-format off */
+enum { busq_idle = 0, busq_queued, busq_running, busq_done };
+/* clang-format on */
+
+
+typedef struct _libbusq_req_t {
+	struct _libbusq_req_t *next;
+	int prio; /* Lower value runs first, FIFO within the same priority */
+	volatile int state;
+	int result;
+
+	/* Performs the transaction in the queue thread */
+	int (*run)(struct _libbusq_req_t *req);
+	/* Optional, called from the queue thread after run(), may resubmit the request */
+	void (*done)(struct _libbusq_req_t *req, int result);
+	void *arg;
+} libbusq_req_t;
+
+
+typedef struct {
+	handle_t lock;
+	handle_t cond;
+	handle_t donecond;
+	libbusq_req_t *head;
+} libbusq_t;
+
+
+/* Queue thread is the only user of the bus, synchronous calls must not be mixed with it */
+int libbusq_init(libbusq_t *q, void *stack, size_t stacksz, int prio);
+
+
+/* Request memory is owned by the queue until it's done */
+int libbusq_submit(libbusq_t *q, libbusq_req_t *req);
+
+
+/* Removes request that has not been started yet, returns -EBUSY otherwise */
+int libbusq_cancel(libbusq_t *q, libbusq_req_t *req);
+
+
+/* Waits for completion, returns result of the transaction */
+int libbusq_wait(libbusq_t *q, libbusq_req_t *req);
+
+
+#endif
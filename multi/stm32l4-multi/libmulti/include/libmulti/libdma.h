@@ -25,7 +25,7 @@
 enum { dma_per2mem = 0, dma_mem2per };
 
 
-enum { dma_spi = 0, dma_uart };
+enum { dma_spi = 0, dma_uart, dma_aes, dma_hash, dma_i2c, dma_adc };
 
 
 enum { dma_ht = (1 << 0), dma_tc = (1 << 1) };
@@ -75,6 +75,17 @@ int libdma_rxAsync(const struct libdma_per *per, void *rxMAddr, size_t len, vola
 int libdma_infiniteRxAsync(const struct libdma_per *per, void *rxMAddr, size_t len, void fn(void *arg, int type), void *arg);
 
 
+/* Transmit circular buffer infinitely, fn is called as for libdma_infiniteRxAsync().
+ * Used as ping-pong: on dma_ht the first half may be refilled, on dma_tc the second one.
+ * Both flags set at once mean the callback was late and one half was sent (or received) again.
+ */
+int libdma_infiniteTxAsync(const struct libdma_per *per, const void *txMAddr, size_t len, void fn(void *arg, int type), void *arg);
+
+
+/* Stop infinite transfer in given direction */
+void libdma_infiniteStop(const struct libdma_per *per, int dir);
+
+
 /* UTILITY FUNCTIONS */
 
 
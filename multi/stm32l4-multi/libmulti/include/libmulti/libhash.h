@@ -26,10 +26,26 @@
 typedef enum { libhash_sha1, libhash_sha224, libhash_sha256, libhash_md5 } libhash_algo_t;
 /* clang-format on */
 
+
+typedef struct {
+	const void *buff;
+	size_t size;
+} libhash_buf_t;
+
+
 int libhash_start(libhash_algo_t algorithm);
 
 
-ssize_t libhash_feed(void *buff, size_t size);
+/* HMAC, key has to stay valid until libhash_finish() */
+int libhash_startHmac(libhash_algo_t algorithm, const uint8_t *key, size_t keylen);
+
+
+/* Word aligned parts of large buffers are fed by DMA */
+ssize_t libhash_feed(const void *buff, size_t size);
+
+
+/* Feeds fragmented input without staging copies */
+ssize_t libhash_feedv(const libhash_buf_t *bufs, size_t count);
 
 
 ssize_t libhash_finish(uint8_t *digest);
@@ -17,6 +17,8 @@
 
 #include <stdint.h>
 #include <sys/types.h>
+#include "libmulti/libbusq.h"
+#include "libmulti/libdma.h"
 
 
 typedef struct {
@@ -26,12 +28,29 @@ typedef struct {
 
 	handle_t irqlock;
 	handle_t irqcond;
+
+	const struct libdma_per *per;
 } libi2c_ctx_t;
 
 
 enum { i2c1 = 0, i2c2, i2c3, i2c4 };
 
 
+enum { i2c_opRead = 0, i2c_opReadReg, i2c_opWrite, i2c_opWriteReg };
+
+
+/* Asynchronous transaction, req.prio, req.done and req.arg are set by the caller */
+typedef struct {
+	libbusq_req_t req;
+	libi2c_ctx_t *ctx;
+	int op;
+	unsigned char addr;
+	unsigned char reg;
+	void *buff;
+	size_t len;
+} libi2c_xfer_t;
+
+
 ssize_t libi2c_read(libi2c_ctx_t *ctx, unsigned char addr, void *buff, size_t len);
 
 
@@ -47,4 +66,12 @@ ssize_t libi2c_writeReg(libi2c_ctx_t *ctx, unsigned char addr, unsigned char reg
 int libi2c_init(libi2c_ctx_t *ctx, int i2c);
 
 
+/* Transfers bodies of LIBI2C_DMA_MINLEN bytes and more by DMA */
+int libi2c_initDma(libi2c_ctx_t *ctx, int i2c);
+
+
+/* Queues transaction, result (as of synchronous call) is passed to req.done */
+int libi2c_submit(libbusq_t *q, libi2c_xfer_t *xfer);
+
+
 #endif
@@ -18,6 +18,7 @@
 
 #include <stddef.h>
 #include <sys/threads.h>
+#include "libmulti/libbusq.h"
 #include "libmulti/libdma.h"
 
 
@@ -51,9 +52,27 @@ int libspi_transaction(libspi_ctx_t *ctx, int dir, unsigned char cmd, unsigned i
 	unsigned char *ibuff, const unsigned char *obuff, size_t bufflen);
 
 
+/* Asynchronous transaction, req.prio, req.done and req.arg are set by the caller */
+typedef struct {
+	libbusq_req_t req;
+	libspi_ctx_t *ctx;
+	int dir;
+	unsigned char cmd;
+	unsigned char flags;
+	unsigned int addr;
+	unsigned char *ibuff;
+	const unsigned char *obuff;
+	size_t bufflen;
+} libspi_xfer_t;
+
+
 int libspi_configure(libspi_ctx_t *ctx, char mode, char bdiv, int enable);
 
 
+/* Queues transaction, result (as of synchronous call) is passed to req.done */
+int libspi_submit(libbusq_t *q, libspi_xfer_t *xfer);
+
+
 int libspi_init(libspi_ctx_t *ctx, unsigned int spi, int useDma);
 
 
@@ -9,15 +9,33 @@
  * %LICENSE%
  */
 
+#include <errno.h>
+#include <string.h>
+
 #include "../common.h"
 #include "libmulti/libaes.h"
+#include "libmulti/libdma.h"
+
+
+/* Shorter buffers are fed by CPU, DMA setup would cost more */
+#define AES_DMA_MINLEN 64
+
+/* Bytes per DMA transfer, whole blocks within DMA_MAX_LEN words */
+#define AES_DMA_MAXLEN ((DMA_MAX_LEN * 4) & ~(LIBAES_BLOCKSZ - 1))
 
 
 enum { cr = 0, sr, dinr, doutr, keyr0, ivr0 = keyr0 + 4, keyr4 = ivr0 + 4, susp0r = keyr4 + 4 };
 
 
+enum { aes_ctxInit = 0, aes_ctxAad, aes_ctxPayload, aes_ctxDone };
+
+
+enum { aes_phaseInit = 0, aes_phaseHeader, aes_phasePayload, aes_phaseFinal };
+
+
 static struct {
 	volatile unsigned int *base;
+	const struct libdma_per *per;
 } common;
 
 
@@ -143,7 +161,7 @@ void libaes_unprepare(void)
 }
 
 
-void libaes_processBlock(const unsigned char *in, unsigned char *out)
+static void libaes_writeBlock(const unsigned char *in)
 {
 	int i;
 	unsigned int tmp;
@@ -158,6 +176,13 @@ void libaes_processBlock(const unsigned char *in, unsigned char *out)
 
 	while ((*(common.base + sr) & 0x1) == 0)
 		;
+}
+
+
+static void libaes_readBlock(unsigned char *out)
+{
+	int i;
+	unsigned int tmp;
 
 	for (i = 0; i < 4; i++) {
 		tmp = *(common.base + doutr);
@@ -166,11 +191,263 @@ void libaes_processBlock(const unsigned char *in, unsigned char *out)
 		*out++ = tmp >> 16;
 		*out++ = tmp >> 24;
 	}
+}
+
+
+void libaes_processBlock(const unsigned char *in, unsigned char *out)
+{
+	libaes_writeBlock(in);
+	libaes_readBlock(out);
 
 	*(common.base + cr) |= (1 << 7);
 }
 
 
+int libaes_process(const unsigned char *in, unsigned char *out, size_t len)
+{
+	size_t done, chunk;
+
+	if ((len % LIBAES_BLOCKSZ) != 0) {
+		return -EINVAL;
+	}
+
+	if ((common.per == NULL) || (len < AES_DMA_MINLEN) || ((((uintptr_t)in | (uintptr_t)out) & 0x3) != 0)) {
+		for (done = 0; done < len; done += LIBAES_BLOCKSZ) {
+			libaes_processBlock(in + done, out + done);
+		}
+
+		return len;
+	}
+
+	/* DMAINEN, DMAOUTEN - CCF is not used in DMA mode */
+	*(common.base + cr) |= (1 << 11) | (1 << 12);
+
+	for (done = 0; done < len; done += chunk) {
+		chunk = min(len - done, AES_DMA_MAXLEN);
+		(void)libdma_transfer(common.per, out + done, in + done, chunk / 4);
+	}
+
+	*(common.base + cr) &= ~((1 << 11) | (1 << 12));
+	*(common.base + cr) |= (1 << 7);
+
+	return len;
+}
+
+
+static void libaes_ctxLoad(libaes_ctx_t *ctx, unsigned int phase)
+{
+	int i;
+
+	libaes_disable();
+
+	*(common.base + cr) = ctx->cr | (phase << 13);
+	libaes_setKey(ctx->key, ctx->keylen);
+
+	if (ctx->mode != aes_ecb) {
+		storeVector4(ivr0, ctx->iv);
+	}
+
+	/* GHASH state and hash subkey */
+	if ((ctx->mode == aes_gcm) && (ctx->state != aes_ctxInit)) {
+		for (i = 0; i < 8; i++) {
+			*(common.base + susp0r + i) = ctx->susp[i];
+		}
+	}
+
+	libaes_enable();
+}
+
+
+static void libaes_ctxSave(libaes_ctx_t *ctx)
+{
+	int i;
+
+	if (ctx->mode == aes_gcm) {
+		for (i = 0; i < 8; i++) {
+			ctx->susp[i] = *(common.base + susp0r + i);
+		}
+	}
+
+	libaes_disable();
+
+	if (ctx->mode != aes_ecb) {
+		retrieveVector4(ivr0, ctx->iv);
+	}
+}
+
+
+int libaes_start(libaes_ctx_t *ctx, int mode, int dir, const unsigned char *key, int keylen, const unsigned char *iv)
+{
+	int op = dir;
+
+	if ((mode < aes_ecb) || (mode > aes_gcm) || ((dir != aes_encrypt) && (dir != aes_decrypt)) ||
+		((keylen != aes_128) && (keylen != aes_256)) || ((mode != aes_ecb) && (iv == NULL))) {
+		return -EINVAL;
+	}
+
+	/* ECB and CBC decryption derive the decryption key on each enable */
+	if ((dir == aes_decrypt) && ((mode == aes_ecb) || (mode == aes_cbc))) {
+		op = 0x3;
+	}
+
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->mode = mode;
+	ctx->keylen = keylen;
+	/* byte swap */
+	ctx->cr = (0x2 << 1) | (op << 3) | (mode << 5) | ((keylen == aes_256) ? (1 << 18) : 0);
+	memcpy(ctx->key, key, (keylen == aes_256) ? 32 : 16);
+
+	if (mode == aes_gcm) {
+		/* Initial counter block for the payload is IV || 2 */
+		memcpy(ctx->iv, iv, 12);
+		ctx->iv[15] = 0x2;
+
+		/* Init phase computes hash subkey */
+		ctx->state = aes_ctxInit;
+		libaes_ctxLoad(ctx, aes_phaseInit);
+		while ((*(common.base + sr) & 0x1) == 0)
+			;
+		*(common.base + cr) |= (1 << 7);
+
+		ctx->state = aes_ctxAad;
+		libaes_ctxSave(ctx);
+	}
+	else {
+		if (iv != NULL) {
+			memcpy(ctx->iv, iv, LIBAES_BLOCKSZ);
+		}
+		ctx->state = aes_ctxPayload;
+	}
+
+	return EOK;
+}
+
+
+int libaes_aad(libaes_ctx_t *ctx, const unsigned char *aad, size_t len)
+{
+	unsigned char block[LIBAES_BLOCKSZ];
+	size_t done;
+
+	if ((ctx->mode != aes_gcm) || (ctx->state != aes_ctxAad) || ((ctx->aadlen % LIBAES_BLOCKSZ) != 0)) {
+		return -EINVAL;
+	}
+
+	if (len == 0) {
+		return 0;
+	}
+
+	libaes_ctxLoad(ctx, aes_phaseHeader);
+
+	for (done = 0; (len - done) >= LIBAES_BLOCKSZ; done += LIBAES_BLOCKSZ) {
+		libaes_writeBlock(aad + done);
+		*(common.base + cr) |= (1 << 7);
+	}
+
+	if (done < len) {
+		memset(block, 0, sizeof(block));
+		memcpy(block, aad + done, len - done);
+		libaes_writeBlock(block);
+		*(common.base + cr) |= (1 << 7);
+	}
+
+	libaes_ctxSave(ctx);
+	ctx->aadlen += len;
+
+	return len;
+}
+
+
+/* Last incomplete block of CTR or GCM stream */
+static void libaes_partialBlock(libaes_ctx_t *ctx, const unsigned char *in, unsigned char *out, size_t len)
+{
+	unsigned char block[LIBAES_BLOCKSZ], tmp[LIBAES_BLOCKSZ];
+
+	memset(block, 0, sizeof(block));
+	memcpy(block, in, len);
+
+	if ((ctx->mode == aes_gcm) && ((ctx->cr & (0x3 << 3)) == (aes_encrypt << 3))) {
+		/* GHASH is computed over output, so encrypting zero padding would hash keystream bytes.
+		 * Get the keystream tail first, then redo the block from saved state padded with it. */
+		libaes_ctxSave(ctx);
+		libaes_ctxLoad(ctx, aes_phasePayload);
+		libaes_processBlock(block, tmp);
+		memcpy(block + len, tmp + len, LIBAES_BLOCKSZ - len);
+		libaes_ctxLoad(ctx, aes_phasePayload);
+	}
+
+	libaes_processBlock(block, block);
+	memcpy(out, block, len);
+}
+
+
+int libaes_update(libaes_ctx_t *ctx, const unsigned char *in, unsigned char *out, size_t len)
+{
+	size_t full = len & ~(LIBAES_BLOCKSZ - 1);
+
+	if ((ctx->state == aes_ctxInit) || (ctx->state == aes_ctxDone) || ((ctx->len % LIBAES_BLOCKSZ) != 0)) {
+		return -EINVAL;
+	}
+
+	if ((full != len) && (ctx->mode != aes_ctr) && (ctx->mode != aes_gcm)) {
+		return -EINVAL;
+	}
+
+	if (len == 0) {
+		return 0;
+	}
+
+	ctx->state = aes_ctxPayload;
+	libaes_ctxLoad(ctx, (ctx->mode == aes_gcm) ? aes_phasePayload : 0);
+
+	(void)libaes_process(in, out, full);
+	if (full != len) {
+		libaes_partialBlock(ctx, in + full, out + full, len - full);
+	}
+
+	libaes_ctxSave(ctx);
+	ctx->len += len;
+
+	return len;
+}
+
+
+int libaes_finish(libaes_ctx_t *ctx, unsigned char *tag)
+{
+	unsigned char block[LIBAES_BLOCKSZ];
+	uint64_t bits[2];
+	int i, j;
+
+	if ((ctx->state == aes_ctxInit) || (ctx->state == aes_ctxDone)) {
+		return -EINVAL;
+	}
+
+	if (ctx->mode == aes_gcm) {
+		if (tag == NULL) {
+			return -EINVAL;
+		}
+
+		/* len(A) || len(C) in bits, big endian */
+		bits[0] = ctx->aadlen * 8;
+		bits[1] = ctx->len * 8;
+		for (i = 0; i < 2; i++) {
+			for (j = 0; j < 8; j++) {
+				block[i * 8 + j] = bits[i] >> (56 - 8 * j);
+			}
+		}
+
+		libaes_ctxLoad(ctx, aes_phaseFinal);
+		libaes_processBlock(block, tag);
+		libaes_disable();
+	}
+
+	ctx->state = aes_ctxDone;
+	memset(ctx->key, 0, sizeof(ctx->key));
+	memset(ctx->susp, 0, sizeof(ctx->susp));
+
+	return EOK;
+}
+
+
 int libaes_init(void)
 {
 	common.base = (void *)0x50060000;
@@ -179,5 +456,12 @@ int libaes_init(void)
 
 	libaes_disable();
 
+	/* DMA is optional, CPU feeds the peripheral if channels are taken */
+	common.per = NULL;
+	if ((libdma_init() == 0) && (libdma_acquirePeripheral(dma_aes, 0, &common.per) == 0)) {
+		libdma_configurePeripheral(common.per, dma_mem2per, dma_priorityHigh, (void *)(common.base + dinr), 0x2, 0x2, 0x1, 0x0, NULL);
+		libdma_configurePeripheral(common.per, dma_per2mem, dma_priorityHigh, (void *)(common.base + doutr), 0x2, 0x2, 0x1, 0x0, NULL);
+	}
+
 	return 0;
 }
@@ -0,0 +1,151 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Multidrv-lib: asynchronous bus transaction queue
+ *
+ * Copyright 2024 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+
+#include <errno.h>
+#include <sys/threads.h>
+
+#include "libmulti/libbusq.h"
+
+
+static void libbusq_thread(void *arg)
+{
+	libbusq_t *q = (libbusq_t *)arg;
+	libbusq_req_t *req;
+
+	for (;;) {
+		mutexLock(q->lock);
+		while (q->head == NULL) {
+			condWait(q->cond, q->lock, 0);
+		}
+
+		req = q->head;
+		q->head = req->next;
+		req->next = NULL;
+		req->state = busq_running;
+		mutexUnlock(q->lock);
+
+		req->result = req->run(req);
+
+		mutexLock(q->lock);
+		req->state = busq_done;
+		condBroadcast(q->donecond);
+		mutexUnlock(q->lock);
+
+		if (req->done != NULL) {
+			req->done(req, req->result);
+		}
+	}
+}
+
+
+int libbusq_submit(libbusq_t *q, libbusq_req_t *req)
+{
+	libbusq_req_t **p;
+
+	if ((req == NULL) || (req->run == NULL)) {
+		return -EINVAL;
+	}
+
+	mutexLock(q->lock);
+
+	if ((req->state == busq_queued) || (req->state == busq_running)) {
+		mutexUnlock(q->lock);
+		return -EBUSY;
+	}
+
+	p = &q->head;
+	while ((*p != NULL) && ((*p)->prio <= req->prio)) {
+		p = &(*p)->next;
+	}
+
+	req->next = *p;
+	*p = req;
+	req->state = busq_queued;
+
+	condSignal(q->cond);
+	mutexUnlock(q->lock);
+
+	return EOK;
+}
+
+
+int libbusq_cancel(libbusq_t *q, libbusq_req_t *req)
+{
+	libbusq_req_t **p;
+	int err = -EBUSY;
+
+	mutexLock(q->lock);
+
+	if (req->state == busq_queued) {
+		for (p = &q->head; *p != NULL; p = &(*p)->next) {
+			if (*p == req) {
+				*p = req->next;
+				req->next = NULL;
+				req->state = busq_idle;
+				err = EOK;
+				break;
+			}
+		}
+	}
+
+	mutexUnlock(q->lock);
+
+	return err;
+}
+
+
+int libbusq_wait(libbusq_t *q, libbusq_req_t *req)
+{
+	mutexLock(q->lock);
+	while ((req->state == busq_queued) || (req->state == busq_running)) {
+		condWait(q->donecond, q->lock, 0);
+	}
+	mutexUnlock(q->lock);
+
+	return req->result;
+}
+
+
+int libbusq_init(libbusq_t *q, void *stack, size_t stacksz, int prio)
+{
+	int err;
+
+	q->head = NULL;
+
+	err = mutexCreate(&q->lock);
+	if (err < 0) {
+		return err;
+	}
+
+	err = condCreate(&q->cond);
+	if (err < 0) {
+		resourceDestroy(q->lock);
+		return err;
+	}
+
+	err = condCreate(&q->donecond);
+	if (err < 0) {
+		resourceDestroy(q->cond);
+		resourceDestroy(q->lock);
+		return err;
+	}
+
+	err = beginthread(libbusq_thread, prio, stack, stacksz, q);
+	if (err < 0) {
+		resourceDestroy(q->donecond);
+		resourceDestroy(q->cond);
+		resourceDestroy(q->lock);
+	}
+
+	return err;
+}
@@ -77,6 +77,35 @@ static const struct libdma_per libdma_persUart[] = {
 };
 
 
+/* AES_OUT, AES_IN */
+static const struct libdma_per libdma_persAes[] = {
+	{ dma2, { 2, 4 }, 0x6 }, // or { dma2, { 1, 0 }, 0x6 }
+};
+
+
+/* I2C RX, TX */
+static const struct libdma_per libdma_persI2c[] = {
+	{ dma1, { 6, 5 }, 0x3 },
+	{ dma1, { 4, 3 }, 0x3 },
+	{ dma1, { 2, 1 }, 0x3 },
+	{ dma2, { 0, 1 }, 0x0 },
+};
+
+
+/* HASH_IN only, per2mem is not used */
+static const struct libdma_per libdma_persHash[] = {
+	{ dma2, { 6, 6 }, 0x6 },
+};
+
+
+/* ADC1, ADC2, ADC3, per2mem only */
+static const struct libdma_per libdma_persAdc[] = {
+	{ dma1, { 0, 0 }, 0x0 },
+	{ dma2, { 3, 3 }, 0x0 },
+	{ dma2, { 4, 4 }, 0x0 },
+};
+
+
 static const struct {
 	uintptr_t base;
 	int irqBase;
@@ -377,10 +406,10 @@ int libdma_rxAsync(const struct libdma_per *per, void *rxMAddr, size_t len, vola
 }
 
 
-int libdma_infiniteRxAsync(const struct libdma_per *per, void *rxMAddr, size_t len, void fn(void *arg, int type), void *arg)
+static int libdma_infiniteAsync(const struct libdma_per *per, int dir, void *maddr, size_t len, void fn(void *arg, int type), void *arg)
 {
 	int dma = per->dma;
-	int channel = per->channel[dma_per2mem];
+	int channel = per->channel[dir];
 
 	if (DMA_MAX_LEN < len) {
 		return -EINVAL;
@@ -391,13 +420,35 @@ int libdma_infiniteRxAsync(const struct libdma_per *per, void *rxMAddr, size_t l
 	dma_transfers[dma][channel].inf.fn = fn;
 	dma_transfers[dma][channel].inf.arg = arg;
 
-	if ((rxMAddr != NULL) && (len > 0)) {
-		libdma_prepareTransfer(dma, channel, rxMAddr, len, DMA_TCIE_FLAG | DMA_HTIE_FLAG | DMA_CIRCULAR_FLAG);
+	if ((maddr != NULL) && (len > 0)) {
+		libdma_prepareTransfer(dma, channel, maddr, len, DMA_TCIE_FLAG | DMA_HTIE_FLAG | DMA_CIRCULAR_FLAG);
 	}
 	return 0;
 }
 
 
+int libdma_infiniteRxAsync(const struct libdma_per *per, void *rxMAddr, size_t len, void fn(void *arg, int type), void *arg)
+{
+	return libdma_infiniteAsync(per, dma_per2mem, rxMAddr, len, fn, arg);
+}
+
+
+int libdma_infiniteTxAsync(const struct libdma_per *per, const void *txMAddr, size_t len, void fn(void *arg, int type), void *arg)
+{
+	return libdma_infiniteAsync(per, dma_mem2per, (void *)txMAddr, len, fn, arg);
+}
+
+
+void libdma_infiniteStop(const struct libdma_per *per, int dir)
+{
+	int dma = per->dma;
+	int channel = per->channel[dir];
+
+	libdma_unprepareTransfer(dma, channel);
+	dma_transfers[dma][channel].type = dma_transferNull;
+}
+
+
 int libdma_transfer(const struct libdma_per *per, void *rxMAddr, const void *txMAddr, size_t len)
 {
 	int res;
@@ -479,6 +530,26 @@ int libdma_acquirePeripheral(int per, unsigned int num, const struct libdma_per
 			p = &libdma_persUart[num];
 		}
 	}
+	else if (per == dma_aes) {
+		if (num < sizeof(libdma_persAes) / sizeof(libdma_persAes[0])) {
+			p = &libdma_persAes[num];
+		}
+	}
+	else if (per == dma_i2c) {
+		if (num < sizeof(libdma_persI2c) / sizeof(libdma_persI2c[0])) {
+			p = &libdma_persI2c[num];
+		}
+	}
+	else if (per == dma_hash) {
+		if (num < sizeof(libdma_persHash) / sizeof(libdma_persHash[0])) {
+			p = &libdma_persHash[num];
+		}
+	}
+	else if (per == dma_adc) {
+		if (num < sizeof(libdma_persAdc) / sizeof(libdma_persAdc[0])) {
+			p = &libdma_persAdc[num];
+		}
+	}
 
 	if (p == NULL) {
 		return -EINVAL;
@@ -16,6 +16,7 @@
 #include <string.h>
 #include <sys/threads.h>
 #include "include/libmulti/libhash.h"
+#include "include/libmulti/libdma.h"
 #include "../common.h"
 
 /* IP registers */
@@ -26,17 +27,31 @@
 #define HASH_SR  9
 #define HASH_HR0 196
 
+/* Shorter buffers are fed by CPU */
+#define HASH_DMA_MINLEN 64
+
+/* Bytes per DMA transfer, DMA_MAX_LEN words */
+#define HASH_DMA_MAXLEN (DMA_MAX_LEN * 4)
+
+/* HMAC keys longer than a block are hashed first */
+#define HASH_HMAC_BLOCKSZ 64
+
 static struct {
 	volatile uint32_t *base;
+	const struct libdma_per *per;
 	size_t remsz;
 	libhash_algo_t algorithm;
 	uint8_t rem[4];
+
+	const uint8_t *key;
+	size_t keylen;
 } libhash_common;
 
 
-static inline uint32_t libhash_pack(uint8_t *in)
+/* Data is written with byte swapping (DATATYPE = 10), so words are packed as in memory */
+static inline uint32_t libhash_pack(const uint8_t *in)
 {
-	return ((uint32_t)(in[0]) << 24) | ((uint32_t)(in[1]) << 16) | ((uint32_t)(in[2]) << 8) | (uint32_t)(in[3]);
+	return ((uint32_t)(in[3]) << 24) | ((uint32_t)(in[2]) << 16) | ((uint32_t)(in[1]) << 8) | (uint32_t)(in[0]);
 }
 
 
@@ -49,7 +64,7 @@ static inline void libhash_unpack(uint8_t *out, uint32_t in)
 }
 
 
-int libhash_start(libhash_algo_t algorithm)
+static int libhash_setup(libhash_algo_t algorithm, uint32_t flags)
 {
 	uint32_t t;
 
@@ -75,77 +90,151 @@ int libhash_start(libhash_algo_t algorithm)
 			return -EINVAL;
 	}
 
+	/* Byte swap, multiple DMA transfers - digest is started only by libhash_finish() */
+	t |= (0x2 << 4) | (1 << 13) | flags;
+
 	*(libhash_common.base + HASH_CR) = t | (1 << 2);
 	libhash_common.remsz = 0;
 	libhash_common.algorithm = algorithm;
+	libhash_common.key = NULL;
+	libhash_common.keylen = 0;
+
+	return EOK;
+}
+
+
+int libhash_start(libhash_algo_t algorithm)
+{
+	return libhash_setup(algorithm, 0);
+}
+
+
+/* Pushes the incomplete word and starts digest calculation of the data written so far */
+static void libhash_close(void)
+{
+	uint32_t t;
+
+	t = *(libhash_common.base + HASH_STR) & ~(0x11fU);
+
+	if (libhash_common.remsz != 0) {
+		*(libhash_common.base + HASH_DIN) = libhash_pack(libhash_common.rem);
+		t |= libhash_common.remsz * 8;
+	}
+
+	*(libhash_common.base + HASH_STR) = t;
+	*(libhash_common.base + HASH_STR) |= 1 << 8;
+	libhash_common.remsz = 0;
+}
+
+
+int libhash_startHmac(libhash_algo_t algorithm, const uint8_t *key, size_t keylen)
+{
+	int err;
+
+	if ((key == NULL) || (keylen == 0)) {
+		return -EINVAL;
+	}
+
+	/* MODE = HMAC, LKEY */
+	err = libhash_setup(algorithm, (1 << 6) | ((keylen > HASH_HMAC_BLOCKSZ) ? (1 << 16) : 0));
+	if (err < 0) {
+		return err;
+	}
+
+	/* Inner key phase */
+	(void)libhash_feed(key, keylen);
+	libhash_close();
+
+	while ((*(libhash_common.base + HASH_SR) & (1 << 3)) != 0)
+		;
+
+	libhash_common.key = key;
+	libhash_common.keylen = keylen;
 
 	return EOK;
 }
 
 
-ssize_t libhash_feed(void *buff, size_t size)
+static size_t libhash_dmaFeed(const uint8_t *data, size_t size)
+{
+	size_t done, chunk;
+
+	*(libhash_common.base + HASH_CR) |= 1 << 3;
+
+	for (done = 0; done < size; done += chunk) {
+		chunk = min(size - done, HASH_DMA_MAXLEN);
+		(void)libdma_tx(libhash_common.per, data + done, chunk / 4, dma_modeNormal, 0);
+	}
+
+	*(libhash_common.base + HASH_CR) &= ~(1 << 3);
+
+	return size;
+}
+
+
+ssize_t libhash_feed(const void *buff, size_t size)
 {
-	size_t chunk, written = 0, i;
-	uint8_t *data = buff;
+	size_t chunk, written = size;
+	const uint8_t *data = buff;
 
 	if (size == 0) {
 		return 0;
 	}
 
+	/* Complete the word started by the previous feed */
 	if (libhash_common.remsz != 0) {
-		if (libhash_common.remsz + size >= sizeof(uint32_t)) {
-			for (i = libhash_common.remsz; i < sizeof(uint32_t); ++i) {
-				libhash_common.rem[i] = data[i];
-			}
+		chunk = min(size, sizeof(uint32_t) - libhash_common.remsz);
+		memcpy(libhash_common.rem + libhash_common.remsz, data, chunk);
+		libhash_common.remsz += chunk;
+		data += chunk;
+		size -= chunk;
 
+		if (libhash_common.remsz == sizeof(uint32_t)) {
 			*(libhash_common.base + HASH_DIN) = libhash_pack(libhash_common.rem);
-
-			written = sizeof(uint32_t) - libhash_common.remsz;
-			data += written;
-			size -= written;
 			libhash_common.remsz = 0;
 		}
-		else {
-			memcpy(libhash_common.rem + libhash_common.remsz, data, size);
-			written = size;
-			libhash_common.remsz += size;
-			size = 0;
-		}
 	}
 
-	while (size != 0) {
-		if (size >= sizeof(uint32_t)) {
-			chunk = sizeof(uint32_t);
-			*(libhash_common.base + HASH_DIN) = libhash_pack(data + written);
-		}
-		else {
-			chunk = size;
-			memcpy(libhash_common.rem, data + written, chunk);
-			libhash_common.remsz = chunk;
-		}
-
-		written += chunk;
+	if ((libhash_common.per != NULL) && (size >= HASH_DMA_MINLEN) && (((uintptr_t)data & 0x3) == 0)) {
+		chunk = libhash_dmaFeed(data, size & ~(sizeof(uint32_t) - 1));
+		data += chunk;
 		size -= chunk;
 	}
 
+	for (; size >= sizeof(uint32_t); size -= sizeof(uint32_t)) {
+		*(libhash_common.base + HASH_DIN) = libhash_pack(data);
+		data += sizeof(uint32_t);
+	}
+
+	if (size != 0) {
+		memcpy(libhash_common.rem, data, size);
+		libhash_common.remsz = size;
+	}
+
 	return written;
 }
 
 
-ssize_t libhash_finish(uint8_t *digest)
+ssize_t libhash_feedv(const libhash_buf_t *bufs, size_t count)
 {
-	size_t diglen, i;
-	uint32_t t;
+	size_t i;
+	ssize_t ret, written = 0;
 
-	t = *(libhash_common.base + HASH_STR) & ~(0x11fU);
-
-	if (libhash_common.remsz != 0) {
-		*(libhash_common.base + HASH_DIN) = libhash_pack(libhash_common.rem);
-		t |= libhash_common.remsz * 8;
+	for (i = 0; i < count; ++i) {
+		ret = libhash_feed(bufs[i].buff, bufs[i].size);
+		if (ret < 0) {
+			return ret;
+		}
+		written += ret;
 	}
 
-	*(libhash_common.base + HASH_STR) = t;
-	*(libhash_common.base + HASH_STR) |= 1 << 8;
+	return written;
+}
+
+
+ssize_t libhash_finish(uint8_t *digest)
+{
+	size_t diglen, i;
 
 	switch (libhash_common.algorithm) {
 		case libhash_md5:
@@ -168,6 +257,18 @@ ssize_t libhash_finish(uint8_t *digest)
 			return -EINVAL;
 	}
 
+	libhash_close();
+
+	/* Outer key phase of HMAC */
+	if (libhash_common.key != NULL) {
+		while ((*(libhash_common.base + HASH_SR) & (1 << 3)) != 0)
+			;
+
+		(void)libhash_feed(libhash_common.key, libhash_common.keylen);
+		libhash_close();
+		libhash_common.key = NULL;
+	}
+
 	while (!(*(libhash_common.base + HASH_SR) & (1 << 1)))
 		;
 
@@ -185,5 +286,11 @@ int libhash_init(void)
 
 	devClk(pctl_hash, 3);
 
+	/* DMA is optional, CPU feeds the peripheral if the channel is taken */
+	libhash_common.per = NULL;
+	if ((libdma_init() == 0) && (libdma_acquirePeripheral(dma_hash, 0, &libhash_common.per) == 0)) {
+		libdma_configurePeripheral(libhash_common.per, dma_mem2per, dma_priorityMedium, (void *)(libhash_common.base + HASH_DIN), 0x2, 0x2, 0x1, 0x0, NULL);
+	}
+
 	return EOK;
 }
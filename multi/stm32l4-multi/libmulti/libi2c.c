@@ -22,6 +22,9 @@
 
 #define TIMEOUT (100 * 1000)
 
+/* Shorter bodies are moved by CPU */
+#define LIBI2C_DMA_MINLEN 8
+
 
 static const struct {
 	void *base;
@@ -123,6 +126,33 @@ static void libi2c_transactionStart(libi2c_ctx_t *ctx, unsigned char address, in
 }
 
 
+/* Body is moved by DMA while waiting for transfer complete (or NACK) */
+static ssize_t libi2c_dmaBody(libi2c_ctx_t *ctx, int dir, void *buff, size_t len)
+{
+	int ret;
+	unsigned int dmaen = (dir == dir_read) ? (1 << 15) : (1 << 14);
+
+	*(ctx->base + cr1) |= dmaen;
+	dataBarier();
+
+	if (dir == dir_read) {
+		ret = libdma_rx(ctx->per, buff, len, dma_modeNormal, TIMEOUT);
+	}
+	else {
+		ret = libdma_tx(ctx->per, buff, len, dma_modeNormal, TIMEOUT);
+	}
+
+	if ((ret == (int)len) && (libi2c_waitForIrq(ctx) < 0)) {
+		ret = -1;
+	}
+
+	*(ctx->base + cr1) &= ~dmaen;
+	dataBarier();
+
+	return ((ret == (int)len) && (ctx->err == 0)) ? ret : -1;
+}
+
+
 static ssize_t _libi2c_read(libi2c_ctx_t *ctx, unsigned char addr, void *buff, size_t len)
 {
 	ssize_t i;
@@ -133,6 +163,10 @@ static ssize_t _libi2c_read(libi2c_ctx_t *ctx, unsigned char addr, void *buff, s
 
 	libi2c_transactionStart(ctx, addr, dir_read, len);
 
+	if ((ctx->per != NULL) && (len >= LIBI2C_DMA_MINLEN)) {
+		return libi2c_dmaBody(ctx, dir_read, buff, len);
+	}
+
 	for (i = 0; i < len && !ctx->err; ++i) {
 		if (libi2c_waitForIrq(ctx) < 0) {
 			return -1;
@@ -194,6 +228,10 @@ static ssize_t _libi2c_write(libi2c_ctx_t *ctx, unsigned char addr, unsigned cha
 		libi2c_transactionStart(ctx, addr, dir_write, len);
 	}
 
+	if ((ctx->per != NULL) && (len >= LIBI2C_DMA_MINLEN)) {
+		return libi2c_dmaBody(ctx, dir_write, (void *)buff, len);
+	}
+
 	for (i = 0; i < (ssize_t)len && !ctx->err; ++i) {
 		*(ctx->base + txdr) = ((const unsigned char *)buff)[i];
 		if (libi2c_waitForIrq(ctx) < 0) {
@@ -231,6 +269,59 @@ ssize_t libi2c_writeReg(libi2c_ctx_t *ctx, unsigned char addr, unsigned char reg
 }
 
 
+static int libi2c_xferRun(libbusq_req_t *req)
+{
+	libi2c_xfer_t *xfer = (libi2c_xfer_t *)req;
+
+	switch (xfer->op) {
+		case i2c_opRead:
+			return libi2c_read(xfer->ctx, xfer->addr, xfer->buff, xfer->len);
+
+		case i2c_opReadReg:
+			return libi2c_readReg(xfer->ctx, xfer->addr, xfer->reg, xfer->buff, xfer->len);
+
+		case i2c_opWrite:
+			return libi2c_write(xfer->ctx, xfer->addr, xfer->buff, xfer->len);
+
+		case i2c_opWriteReg:
+			return libi2c_writeReg(xfer->ctx, xfer->addr, xfer->reg, xfer->buff, xfer->len);
+
+		default:
+			return -EINVAL;
+	}
+}
+
+
+int libi2c_submit(libbusq_t *q, libi2c_xfer_t *xfer)
+{
+	xfer->req.run = libi2c_xferRun;
+
+	return libbusq_submit(q, &xfer->req);
+}
+
+
+int libi2c_initDma(libi2c_ctx_t *ctx, int i2c)
+{
+	int err;
+
+	if ((i2c < i2c1) || (i2c > i2c4) || (ctx == NULL)) {
+		return -1;
+	}
+
+	libdma_init();
+	err = libdma_acquirePeripheral(dma_i2c, i2c - i2c1, &ctx->per);
+	if (err < 0) {
+		ctx->per = NULL;
+		return err;
+	}
+
+	libdma_configurePeripheral(ctx->per, dma_mem2per, dma_priorityMedium, (void *)(ctx->base + txdr), 0x0, 0x0, 0x1, 0x0, NULL);
+	libdma_configurePeripheral(ctx->per, dma_per2mem, dma_priorityMedium, (void *)(ctx->base + rxdr), 0x0, 0x0, 0x1, 0x0, NULL);
+
+	return 0;
+}
+
+
 int libi2c_init(libi2c_ctx_t *ctx, int i2c)
 {
 	int cpuclk = getCpufreq(), presc;
@@ -244,6 +335,7 @@ int libi2c_init(libi2c_ctx_t *ctx, int i2c)
 
 	ctx->base = i2cinfo[i2c].base;
 	ctx->clk = i2cinfo[i2c].clk;
+	ctx->per = NULL;
 
 	devClk(ctx->clk, 1);
 
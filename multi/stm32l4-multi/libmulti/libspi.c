@@ -159,6 +159,22 @@ int libspi_transaction(libspi_ctx_t *ctx, int dir, unsigned char cmd, unsigned i
 }
 
 
+static int libspi_xferRun(libbusq_req_t *req)
+{
+	libspi_xfer_t *xfer = (libspi_xfer_t *)req;
+
+	return libspi_transaction(xfer->ctx, xfer->dir, xfer->cmd, xfer->addr, xfer->flags, xfer->ibuff, xfer->obuff, xfer->bufflen);
+}
+
+
+int libspi_submit(libbusq_t *q, libspi_xfer_t *xfer)
+{
+	xfer->req.run = libspi_xferRun;
+
+	return libbusq_submit(q, &xfer->req);
+}
+
+
 int libspi_configure(libspi_ctx_t *ctx, char mode, char bdiv, int enable)
 {
 	unsigned int t;
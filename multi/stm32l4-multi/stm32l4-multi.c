@@ -157,7 +157,25 @@ static void handleMsg(msg_t *msg)
 			break;
 
 		case adc_get:
-			omsg->adc_valmv = adc_conversion(imsg->adc_get.adcno, imsg->adc_get.channel);
+			err = adc_conversion(imsg->adc_get.adcno, imsg->adc_get.channel);
+			if (err >= 0) {
+				omsg->adc_valmv = err;
+				err = EOK;
+			}
+			break;
+
+		case adc_scanDef:
+			if (imsg->adc_scan.nchans == 0) {
+				err = adc_scanStop(imsg->adc_scan.adcno);
+			}
+			else {
+				err = adc_scanStart(imsg->adc_scan.adcno, imsg->adc_scan.channels, imsg->adc_scan.nchans,
+					imsg->adc_scan.oversampling, imsg->adc_scan.sampling);
+			}
+			break;
+
+		case adc_scanGet:
+			err = adc_scanRead(imsg->adc_get.adcno, msg->o.data, msg->o.size);
 			break;
 
 		case spi_get:
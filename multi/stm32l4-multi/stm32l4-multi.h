@@ -29,7 +29,7 @@ enum { adc_get = 0, rtc_setcal, rtc_get, rtc_set, rtc_setalarm, i2c_get, i2c_get
 	i2c_set, i2c_setwreg, gpio_def, gpio_get, gpio_set, uart_def, uart_get, uart_set,
 	flash_get, flash_set, flash_info, spi_get, spi_set, spi_rw, spi_def, exti_def,
 	exti_map, otp_get, otp_set, rtc_setBackup, rtc_getBackup, flash_setRaw, flash_erase,
-	rng_get };
+	rng_get, adc_scanDef, adc_scanGet };
 /* clang-format on */
 
 /* RTC */
@@ -163,6 +163,16 @@ typedef struct {
 } adcget_t;
 
 
+/* Continuous scan, nchans == 0 stops it */
+typedef struct {
+	int adcno;
+	unsigned char nchans;
+	unsigned char oversampling; /* log2 of the hardware oversampling ratio, 0 - disabled */
+	unsigned char sampling;     /* SMPx sampling time code, 0 - 7 */
+	unsigned char channels[16];
+} adcscan_t;
+
+
 /* FLASH */
 
 
@@ -191,6 +201,7 @@ typedef struct {
 
 	union {
 		adcget_t adc_get;
+		adcscan_t adc_scan;
 		int rtc_calib;
 		rtctimestamp_t rtc_timestamp;
 		i2cmsg_t i2c_msg;
@@ -69,6 +69,11 @@
 #error "DMA mode cannot be enabled on a disabled TTY!"
 #endif
 
+#if (TTY1_LOWPOWER && !TTY1_DMA) || (TTY2_LOWPOWER && !TTY2_DMA) || (TTY3_LOWPOWER && !TTY3_DMA) || \
+	(TTY4_LOWPOWER && !TTY4_DMA) || (TTY5_LOWPOWER && !TTY5_DMA)
+#error "Low power mode requires DMA mode!"
+#endif
+
 typedef struct {
 	char stack[512] __attribute__((aligned(8)));
 
@@ -108,6 +113,10 @@ typedef struct {
 			volatile unsigned int readPos;
 			lf_fifo_t rxFifo;
 
+			int lowpower;
+			int charmatch;
+			handle_t rxcond; /* Never waited on, silences RX DMA HT/TC wakeups in low power mode */
+
 			struct {
 				size_t droppedBytes;
 			} debug;
@@ -132,12 +141,14 @@ static const struct {
 	size_t dmaBufSizeTx;
 	int pos;
 	size_t libttyBufSize;
+	int lowpower;
+	int charmatch;
 } ttySetup[] = {
-	{ TTY1, TTY1_DMA, TTY1_DMA_RXSZ, TTY1_DMA_RXFIFOSZ, TTY1_DMA_TXSZ, TTY1_POS, TTY1_LIBTTY_BUFSZ },
-	{ TTY2, TTY2_DMA, TTY2_DMA_RXSZ, TTY2_DMA_RXFIFOSZ, TTY2_DMA_TXSZ, TTY2_POS, TTY2_LIBTTY_BUFSZ },
-	{ TTY3, TTY3_DMA, TTY3_DMA_RXSZ, TTY3_DMA_RXFIFOSZ, TTY3_DMA_TXSZ, TTY3_POS, TTY3_LIBTTY_BUFSZ },
-	{ TTY4, TTY4_DMA, TTY4_DMA_RXSZ, TTY4_DMA_RXFIFOSZ, TTY4_DMA_TXSZ, TTY4_POS, TTY4_LIBTTY_BUFSZ },
-	{ TTY5, TTY5_DMA, TTY5_DMA_RXSZ, TTY5_DMA_RXFIFOSZ, TTY5_DMA_TXSZ, TTY5_POS, TTY5_LIBTTY_BUFSZ },
+	{ TTY1, TTY1_DMA, TTY1_DMA_RXSZ, TTY1_DMA_RXFIFOSZ, TTY1_DMA_TXSZ, TTY1_POS, TTY1_LIBTTY_BUFSZ, TTY1_LOWPOWER, TTY1_CHARMATCH },
+	{ TTY2, TTY2_DMA, TTY2_DMA_RXSZ, TTY2_DMA_RXFIFOSZ, TTY2_DMA_TXSZ, TTY2_POS, TTY2_LIBTTY_BUFSZ, TTY2_LOWPOWER, TTY2_CHARMATCH },
+	{ TTY3, TTY3_DMA, TTY3_DMA_RXSZ, TTY3_DMA_RXFIFOSZ, TTY3_DMA_TXSZ, TTY3_POS, TTY3_LIBTTY_BUFSZ, TTY3_LOWPOWER, TTY3_CHARMATCH },
+	{ TTY4, TTY4_DMA, TTY4_DMA_RXSZ, TTY4_DMA_RXFIFOSZ, TTY4_DMA_TXSZ, TTY4_POS, TTY4_LIBTTY_BUFSZ, TTY4_LOWPOWER, TTY4_CHARMATCH },
+	{ TTY5, TTY5_DMA, TTY5_DMA_RXSZ, TTY5_DMA_RXFIFOSZ, TTY5_DMA_TXSZ, TTY5_POS, TTY5_LIBTTY_BUFSZ, TTY5_LOWPOWER, TTY5_CHARMATCH },
 };
 
 
@@ -199,13 +210,21 @@ static void tty_dmaCallback(void *arg, int type)
 static int tty_irqHandlerDMA(unsigned int n, void *arg)
 {
 	tty_ctx_t *ctx = (tty_ctx_t *)arg;
+	unsigned int status = *(ctx->base + isr);
+
+	/* Wakeup from Stop only restarts clocks, idle line or character match follows */
+	if ((status & (1 << 20)) != 0) {
+		*(ctx->base + icr) |= (1 << 20);
+	}
 
-	/* Check for the idle line. */
-	if ((*(ctx->base + isr) & ((1 << 4))) == 0) {
+	/* Check for the idle line or character match. */
+	if ((status & ((1 << 17) | (1 << 4))) == 0) {
 		return -1;
 	}
-	/* Clear idle line bit */
-	*(ctx->base + icr) |= (1 << 4);
+	/* Clear idle line and character match bits */
+	*(ctx->base + icr) |= (status & ((1 << 17) | (1 << 4)));
+
+	/* On character match the matched byte may still be in flight, idle line picks it up */
 
 	if (libdma_leftToRx(ctx->data.dma.per) != 0) {
 		tty_dmaCallback(ctx, -1);
@@ -359,6 +378,31 @@ static void tty_signalTxReady(void *ctx)
 }
 
 
+/* CR1 interrupt flags of low power mode, CR2/CR3 fields are written while UART is disabled */
+static unsigned int tty_lowpowerFlags(tty_ctx_t *ctx)
+{
+	unsigned int flags = 0;
+
+	if (ctx->data.dma.lowpower == 0) {
+		return 0;
+	}
+
+	if (ctx->data.dma.charmatch >= 0) {
+		/* Character match address (ADD) */
+		*(ctx->base + cr2) = (*(ctx->base + cr2) & ~(0xffu << 24)) | ((unsigned int)ctx->data.dma.charmatch << 24);
+		/* Character match interrupt enable (CMIE) */
+		flags |= (1 << 14);
+	}
+
+	/* Wakeup from Stop on start bit (WUS = 10, WUFIE, UCESM), effective with HSI16/LSE as kernel clock */
+	*(ctx->base + cr3) = (*(ctx->base + cr3) & ~(3 << 20)) | (2 << 20) | (1 << 22) | (1 << 23);
+	/* USART enable in Stop mode (UESM) */
+	flags |= (1 << 1);
+
+	return flags;
+}
+
+
 static int _tty_configure(tty_ctx_t *ctx, char bits, char parity, char enable)
 {
 	int err = EOK;
@@ -418,6 +462,7 @@ static int _tty_configure(tty_ctx_t *ctx, char bits, char parity, char enable)
 			if (ctx->type == tty_dma) {
 				/* Idle line interrupt enable. */
 				flags |= (1 << 4);
+				flags |= tty_lowpowerFlags(ctx);
 			}
 			*(ctx->base + cr1) |= flags;
 
@@ -491,6 +536,7 @@ static void tty_setBaudrate(void *uart, speed_t baud)
 		if (ctx->type == tty_dma) {
 			/* Idle line interrupt enable. */
 			flags |= (1 << 4);
+			flags |= tty_lowpowerFlags(ctx);
 		}
 		*(ctx->base + cr1) |= flags;
 		dataBarier();
@@ -688,7 +734,14 @@ int tty_init(void)
 			}
 			/* Configure dma for tx and rx, medium priority, transfer size 8bits, increment memory address by 1 after each transfer. */
 			libdma_configurePeripheral(ctx->data.dma.per, dma_mem2per, 0x1, (void *)(ctx->base + tdr), 0x0, 0x0, 0x1, 0x0, &ctx->cond);
-			libdma_configurePeripheral(ctx->data.dma.per, dma_per2mem, 0x1, (void *)(ctx->base + rdr), 0x0, 0x0, 0x1, 0x0, &ctx->cond);
+			ctx->data.dma.lowpower = ttySetup[tty].lowpower;
+			ctx->data.dma.charmatch = (ttySetup[tty].charmatch < 0) ? -1 : (ttySetup[tty].charmatch & 0xff);
+			if (ctx->data.dma.lowpower != 0) {
+				/* HT/TC only move data to rxFifo, thread is woken by idle line or character match */
+				condCreate(&ctx->data.dma.rxcond);
+			}
+			libdma_configurePeripheral(ctx->data.dma.per, dma_per2mem, 0x1, (void *)(ctx->base + rdr), 0x0, 0x0, 0x1, 0x0,
+				(ctx->data.dma.lowpower != 0) ? &ctx->data.dma.rxcond : &ctx->cond);
 			*(ctx->base + cr3) |= (1 << 7) | (1 << 6); /* Enable DMA for transmission and reception. */
 
 			ctx->data.dma.txDoneFlag = 1;
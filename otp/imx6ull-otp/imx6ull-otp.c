@@ -79,9 +79,27 @@ otp_t otp = { 0 };
 #define OTP_RELOAD	0x400
 #define OTP_WR_UNLOCK (0x3e77 << 16)
 
+/* otp timing, see i.MX 6ULL RM OCOTP_TIMING */
+#define OTP_TIMING_RELAX_NS       17
+#define OTP_TIMING_STROBE_READ_NS 37
+#define OTP_TIMING_STROBE_PROG_US 10
+#define OTP_TIMING_MASK           0x3fffff
+
+/* controller busy polling */
+#define OTP_POLL_US    10
+#define OTP_TIMEOUT_US 1000000
+
+#define OTP_BATCH_MAX 16
+
 
 #define READ_ADDR_UNDEFINED 0xffff
 
+
+typedef struct {
+	unsigned addr;
+	uint32_t data;
+} otp_word_t;
+
 static struct {
 	int blow_boot;
 	int get_uid;
@@ -93,6 +111,9 @@ static struct {
 	int dry_run;
 
 	uint32_t read_addr;
+
+	otp_word_t batch[OTP_BATCH_MAX];
+	size_t nbatch;
 } common = {
 	.read_addr = READ_ADDR_UNDEFINED,
 };
@@ -106,11 +127,27 @@ static int otp_check_err(void)
 }
 
 
+static int otp_wait(unsigned extra_fl)
+{
+	unsigned t = 0;
+
+	while (*(otp.base + ocotp_ctrl) & (OTP_BUSY | extra_fl)) {
+		if (t >= OTP_TIMEOUT_US) {
+			printf("OTP controller timeout\n");
+			return -ETIMEDOUT;
+		}
+		usleep(OTP_POLL_US);
+		t += OTP_POLL_US;
+	}
+
+	return 0;
+}
+
+
 static void otp_clear_err(void)
 {
 	*(otp.base + ocotp_ctrl_clr) = OTP_ERROR;
-	while (*(otp.base + ocotp_ctrl) & (OTP_BUSY | OTP_ERROR)) usleep(10000);
-	usleep(100000);
+	otp_wait(OTP_ERROR);
 }
 
 
@@ -124,22 +161,28 @@ static int otp_cnc_err(void)
 }
 
 
-static void otp_wait(unsigned extra_fl)
+/* programming and shadow reload timing derived from ipg clock, required before writing fuses */
+static void otp_set_timing(void)
 {
-	while (*(otp.base + ocotp_ctrl) & (OTP_BUSY | extra_fl)) usleep(10000);
-	usleep(100000);
+	uint32_t relax, strobe_read, strobe_prog;
+
+	relax = (IPG_CLK_RATE / 1000 * OTP_TIMING_RELAX_NS + 999999) / 1000000 - 1;
+	strobe_read = (IPG_CLK_RATE / 1000 * OTP_TIMING_STROBE_READ_NS + 999999) / 1000000 + 2 * (relax + 1) - 1;
+	strobe_prog = (IPG_CLK_RATE / 1000 * OTP_TIMING_STROBE_PROG_US + 500) / 1000 + 2 * (relax + 1) - 1;
+
+	*(otp.base + ocotp_timing) = (*(otp.base + ocotp_timing) & ~OTP_TIMING_MASK) |
+		(strobe_prog & 0xfff) | ((relax & 0xf) << 12) | ((strobe_read & 0x3f) << 16);
 }
 
 
+/* single word, controller timing has to be set, shadow registers are not updated until reload */
 static int otp_write(unsigned addr, unsigned data)
 {
 	int ret = 0;
 
-	if (common.dry_run == 1)
-		return 0;
-
 	/* check busy */
-	otp_wait(OTP_NONE);
+	if (otp_wait(OTP_NONE) < 0)
+		return -1;
 
 	/* clear error */
 	otp_cnc_err();
@@ -154,21 +197,19 @@ static int otp_write(unsigned addr, unsigned data)
 	*(otp.base + ocotp_ctrl_set) = addr | OTP_WR_UNLOCK;
 	*(otp.base + ocotp_data) = data;
 
+	/* wait for completion */
+	if (otp_wait(OTP_NONE) < 0)
+		ret = -1;
+
 	/* check and clear error */
 	if (otp_cnc_err()) {
 		printf("Write at 0x%x failed\n", addr);
 		ret = -1;
 	}
 
-	/* wait for completion */
-	otp_wait(OTP_NONE);
-
 	/* clear address */
 	*(otp.base + ocotp_ctrl_clr) = addr | OTP_WR_UNLOCK;
 
-	/* wait for completion */
-	otp_wait(OTP_NONE);
-
 	return ret;
 }
 
@@ -191,24 +232,46 @@ static int otp_reload(void)
 	}
 
 	/*wait for completion */
-	otp_wait(OTP_RELOAD);
-
-	return 0;
+	return otp_wait(OTP_RELOAD);
 }
 
 
-static int otp_write_reload(unsigned addr, unsigned data)
+/* programs all words with one timing setup and a single shadow reload at the end */
+static int otp_write_batch(const otp_word_t *words, size_t n)
 {
-	return otp_write(addr, data) ? -1 : otp_reload();
+	int ret = 0;
+	size_t i;
+
+	for (i = 0; i < n; ++i) {
+		if (words[i].addr & ~0x3f) {
+			printf("invalid address 0x%x\n", words[i].addr);
+			return -1;
+		}
+	}
+
+	if (common.dry_run == 1)
+		return 0;
+
+	otp_set_timing();
+
+	for (i = 0; (i < n) && (ret == 0); ++i)
+		ret = otp_write(words[i].addr, words[i].data);
+
+	if (otp_reload() < 0)
+		ret = -1;
+
+	return ret;
 }
 
 
 static int blow_boot_fuses(void)
 {
-	if (otp_write(0x5, 0x1090)) /* set nand options (64 pages per block, 4 fcb)*/
-		return -1;
+	const otp_word_t words[] = {
+		{ 0x5, 0x1090 }, /* set nand options (64 pages per block, 4 fcb)*/
+		{ 0x6, 0x10 },   /* set internal boot fuse */
+	};
 
-	if (otp_write_reload(0x6, 0x10)) /* set internal boot fuse */
+	if (otp_write_batch(words, sizeof(words) / sizeof(words[0])))
 		return -1;
 
 	printf("Boot fuses blown\n");
@@ -372,14 +435,15 @@ static int write_mac(char *mac1_str, char *mac2_str, char *mac3_str)
 			sscanf(mac3[i], "%X", &m3[i]);
 		}
 
-		ret |= otp_write(OTP_ADDR_MAC0, (unsigned)(m1[5] | m1[4] << 8 | m1[3] << 16 | m1[2] << 24));
-		ret |= otp_write(OTP_ADDR_MAC1, (unsigned)(m1[1] | m1[0] << 8 | m2[5] << 16 | m2[4] << 24));
-		ret |= otp_write(OTP_ADDR_MAC2, (unsigned)(m2[3] | m2[2] << 8 | m2[1] << 16 | m2[0] << 24));
+		const otp_word_t words[] = {
+			{ OTP_ADDR_MAC0, (unsigned)(m1[5] | m1[4] << 8 | m1[3] << 16 | m1[2] << 24) },
+			{ OTP_ADDR_MAC1, (unsigned)(m1[1] | m1[0] << 8 | m2[5] << 16 | m2[4] << 24) },
+			{ OTP_ADDR_MAC2, (unsigned)(m2[3] | m2[2] << 8 | m2[1] << 16 | m2[0] << 24) },
+			{ OTP_ADDR_PLC_MAC0, (unsigned)(m3[5] | m3[4] << 8 | m3[3] << 16 | m3[2] << 24) },
+			{ OTP_ADDR_PLC_MAC1, (unsigned)(m3[1] | m3[0] << 8) & 0xFFFF },
+		};
 
-		ret |= otp_write(OTP_ADDR_PLC_MAC0, (unsigned)(m3[5] | m3[4] << 8 | m3[3] << 16 | m3[2] << 24));
-		ret |= otp_write(OTP_ADDR_PLC_MAC1, (unsigned)(m3[1] | m3[0] << 8) & 0xFFFF);
-
-		otp_reload();
+		ret = otp_write_batch(words, sizeof(words) / sizeof(words[0]));
 	}
 
 	for (i = 0; i < 6; i++) {
@@ -442,7 +506,6 @@ static int read_sn(int silent, int raw)
 	char sn[20] = { 0 };
 	int i;
 
-	otp_reload();
 	lock = *(otp.base + ocotp_lock);
 	if ((lock >> 31) & 0x1) {
 		printf("Reading S/N is locked\n");
@@ -534,19 +597,20 @@ static int write_sn(const char *sn, int raw)
 	sn3 |= (buf[i++] << 8) & (0xFF << 8);
 	sn3 |= buf[i++] & 0xFF;
 
-	otp_reload();
 	lock = *(otp.base + ocotp_lock);
 	if ((lock >> 15) & 0x1) {
 		printf("Writing S/N is locked\n");
 		return -1;
 	}
 
-	ret |= otp_write(OTP_ADDR_SN0, sn0);
-	ret |= otp_write(OTP_ADDR_SN1, sn1);
-	ret |= otp_write(OTP_ADDR_SN2, sn2);
-	ret |= otp_write(OTP_ADDR_SN3, sn3);
+	const otp_word_t words[] = {
+		{ OTP_ADDR_SN0, sn0 },
+		{ OTP_ADDR_SN1, sn1 },
+		{ OTP_ADDR_SN2, sn2 },
+		{ OTP_ADDR_SN3, sn3 },
+	};
 
-	otp_reload();
+	ret = otp_write_batch(words, sizeof(words) / sizeof(words[0]));
 
 	if (ret)
 		printf("Writing S/N failed\n");
@@ -581,13 +645,9 @@ static int write_hwrev(uint8_t hw_rev)
 
 	/* NOTE: no need to read current plc1 word, HW does it automatically */
 	/* NOTE: keeping (hw_rev - 1) in FUSE bits */
-	uint32_t hwrev32 = (uint32_t)(hw_rev - 1) << 24;
+	const otp_word_t word = { OTP_ADDR_PLC_MAC1, (uint32_t)(hw_rev - 1) << 24 };
 
-	otp_reload();
-
-	int ret = otp_write(OTP_ADDR_PLC_MAC1, hwrev32);
-
-	otp_reload();
+	int ret = otp_write_batch(&word, 1);
 
 	if (ret) {
 		printf("Writing hw rev failed\n");
@@ -614,6 +674,7 @@ static void usage(const char *progname)
 	printf("\t-e [byte]                write HW revision (0-255)\n");
 	printf("\t-E                       read HW revision\n");
 	printf("\t-X [addr]                read raw 32bit value from OTP [addr]\n");
+	printf("\t-w [addr]=[value]        write raw 32bit value to OTP [addr], may be repeated (up to %d), written in one batch\n", OTP_BATCH_MAX);
 	printf("\t-f                       force OTP writing even if already written\n");
 	printf("\t-n                       dry run - perform all checks apart from real OTP writing\n");
 	printf("\t-h                       this help message\n");
@@ -628,8 +689,9 @@ int main(int argc, char **argv)
 	char *sn = NULL;
 	char *endptr;
 	unsigned long hw_rev = 0;
+	otp_word_t *word;
 
-	while ((res = getopt(argc, argv, "r:RSs:buMm:fnX:Ee:h")) >= 0) {
+	while ((res = getopt(argc, argv, "r:RSs:buMm:fnX:Ee:w:h")) >= 0) {
 		switch (res) {
 		case 'b':
 			common.blow_boot = 1;
@@ -704,6 +766,25 @@ int main(int argc, char **argv)
 				return EXIT_FAILURE;
 			}
 			break;
+		case 'w':
+			if (common.nbatch >= OTP_BATCH_MAX) {
+				printf("%s: too many OTP words to write\n", argv[0]);
+				return EXIT_FAILURE;
+			}
+			word = &common.batch[common.nbatch];
+			word->addr = strtoul(optarg, &endptr, 0);
+			if ((endptr == optarg) || (*endptr != '=') || (word->addr > 0x3f)) {
+				printf("%s: invalid OTP address value (%s)\n", argv[0], optarg);
+				return EXIT_FAILURE;
+			}
+			optarg = endptr + 1;
+			word->data = strtoul(optarg, &endptr, 0);
+			if ((endptr == optarg) || (*endptr != '\0')) {
+				printf("%s: invalid OTP data value (%s)\n", argv[0], optarg);
+				return EXIT_FAILURE;
+			}
+			common.nbatch++;
+			break;
 		case 'f':
 			common.force = 1;
 			break;
@@ -719,7 +800,7 @@ int main(int argc, char **argv)
 		}
 	}
 
-	if (!common.blow_boot && !common.get_uid && !common.rw_mac && !common.rw_sn && common.rw_revision == 0 && common.read_addr == READ_ADDR_UNDEFINED) {
+	if (!common.blow_boot && !common.get_uid && !common.rw_mac && !common.rw_sn && common.rw_revision == 0 && common.read_addr == READ_ADDR_UNDEFINED && common.nbatch == 0) {
 		printf("Nothing to do\n");
 		usage(argv[0]);
 		return EXIT_FAILURE;
@@ -737,6 +818,12 @@ int main(int argc, char **argv)
 		return EXIT_FAILURE;
 	}
 
+	/* reads are served from the shadow registers, make them reflect fuses once, writes reload them again */
+	if (otp_reload() < 0) {
+		munmap((void *)otp.base, 0x1000);
+		return EXIT_FAILURE;
+	}
+
 	res = 0;
 	if (common.rw_sn == OTP_OP_WRITE)
 		res |= write_sn(sn, raw);
@@ -747,6 +834,13 @@ int main(int argc, char **argv)
 	if (common.blow_boot)
 		res |= blow_boot_fuses();
 
+	if (common.nbatch != 0) {
+		if (otp_write_batch(common.batch, common.nbatch) != 0) {
+			printf("Writing OTP words failed\n");
+			res |= -1;
+		}
+	}
+
 	if (common.get_uid)
 		res |= get_unique_id();
 
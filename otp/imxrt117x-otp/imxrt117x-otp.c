@@ -19,11 +19,21 @@
 #include <stdint.h>
 #include <errno.h>
 #include <string.h>
+#include <unistd.h>
 
 #define FUSE_MIN 0x800
 #define FUSE_MAX 0x18F0
 #define OTP_BASE ((void *)0x40cac000)
 
+#define FUSE_STEP  0x10
+#define FUSE_WORDS (((FUSE_MAX - FUSE_MIN) / FUSE_STEP) + 1)
+
+/* Controller busy polling */
+#define OTP_POLL_US    10
+#define OTP_TIMEOUT_US (100 * 1000)
+
+#define OTP_RANGES_MAX 16
+
 enum { otp_ctrl = 0, otp_ctrl_set, otp_ctrl_clr, otp_ctrl_tog, otp_pdn,
 	otp_data = 8, otp_read_ctrl = 12, otp_out_status = 36, otp_out_status_set, otp_out_status_clr,
 	otp_out_status_tog, otp_version = 44, otp_read_fuse_data0 = 64, otp_read_fuse_data1 = 68,
@@ -34,6 +44,8 @@ enum { otp_ctrl = 0, otp_ctrl_set, otp_ctrl_clr, otp_ctrl_tog, otp_pdn,
 
 struct {
 	volatile uint32_t *base;
+	uint32_t cache[FUSE_WORDS];
+	uint32_t cached[(FUSE_WORDS + 31) / 32];
 } otp_common;
 
 
@@ -44,13 +56,22 @@ void otp_clrError(void)
 }
 
 
-void otp_waitBusy(void)
+int otp_waitBusy(void)
 {
-	while (*(otp_common.base + otp_ctrl) & (1 << 10))
-		usleep(100 * 1000);
+	unsigned int waited = 0;
+
+	while (*(otp_common.base + otp_ctrl) & (1 << 10)) {
+		if (waited >= OTP_TIMEOUT_US)
+			return -ETIMEDOUT;
+
+		usleep(OTP_POLL_US);
+		waited += OTP_POLL_US;
+	}
 
 	/* Wait some more (at least 2 us) */
-	usleep(1000);
+	usleep(2);
+
+	return 0;
 }
 
 
@@ -62,10 +83,17 @@ unsigned int fuse2addr(int fuse)
 
 int read_fuse(int fuse, uint32_t *val)
 {
-	unsigned int t;
+	unsigned int t, idx = fuse2addr(fuse);
+
+	/* Fuse values don't change unless written by us */
+	if (otp_common.cached[idx / 32] & (1u << (idx % 32))) {
+		*val = otp_common.cache[idx];
+		return 0;
+	}
 
 	otp_clrError();
-	otp_waitBusy();
+	if (otp_waitBusy() < 0)
+		return -ETIMEDOUT;
 
 	/* Set fuse address */
 	t = *(otp_common.base + otp_ctrl) & ~0x3ff;
@@ -75,7 +103,8 @@ int read_fuse(int fuse, uint32_t *val)
 	t = *(otp_common.base + otp_read_ctrl) & ~0x1f;
 	*(otp_common.base + otp_read_ctrl) = t | 0x7;
 
-	otp_waitBusy();
+	if (otp_waitBusy() < 0)
+		return -ETIMEDOUT;
 
 	*val = *(otp_common.base + otp_read_fuse_data0);
 
@@ -85,6 +114,25 @@ int read_fuse(int fuse, uint32_t *val)
 		return -EIO;
 	}
 
+	otp_common.cache[idx] = *val;
+	otp_common.cached[idx / 32] |= 1u << (idx % 32);
+
+	return 0;
+}
+
+
+/* Reads count consecutive fuse words starting at fuse */
+int read_fuses(int fuse, uint32_t *buf, unsigned int count)
+{
+	unsigned int i;
+	int res;
+
+	for (i = 0; i < count; i++) {
+		res = read_fuse(fuse + i * FUSE_STEP, &buf[i]);
+		if (res < 0)
+			return res;
+	}
+
 	return 0;
 }
 
@@ -95,7 +143,11 @@ int write_fuse(int fuse, uint32_t val)
 	unsigned int t;
 
 	otp_clrError();
-	otp_waitBusy();
+	if (otp_waitBusy() < 0)
+		return -ETIMEDOUT;
+
+	/* Programmed value is read back from the fuse next time */
+	otp_common.cached[fuse2addr(fuse) / 32] &= ~(1u << (fuse2addr(fuse) % 32));
 
 	/* Set fuse address and unlock write */
 	t = *(otp_common.base + otp_ctrl) & ~0xffff03ff;
@@ -104,7 +156,8 @@ int write_fuse(int fuse, uint32_t val)
 	/* Program word */
 	*(otp_common.base + otp_data) = val;
 
-	otp_waitBusy();
+	if (otp_waitBusy() < 0)
+		return -ETIMEDOUT;
 
 	t = *(otp_common.base + otp_out_status);
 
@@ -121,10 +174,22 @@ int write_fuse(int fuse, uint32_t val)
 }
 
 
+static int check_range(int fuse, unsigned int count)
+{
+	return (fuse >= FUSE_MIN) && (fuse <= FUSE_MAX) && ((fuse & (FUSE_STEP - 1)) == 0) && (count >= 1) &&
+		(count <= (FUSE_MAX - fuse) / FUSE_STEP + 1);
+}
+
+
 int main(int argc, char *argv[])
 {
-	int opt, read = 0, write = 0, fuse = -1, usage = 0, res;
-	uint32_t val = 0;
+	struct {
+		int fuse;
+		unsigned int count;
+	} ranges[OTP_RANGES_MAX];
+	int opt, read = 0, write = 0, usage = 0, res, i, nranges = 0;
+	uint32_t val = 0, buf[FUSE_WORDS];
+	unsigned int j;
 
 	otp_common.base = OTP_BASE;
 
@@ -132,10 +197,24 @@ int main(int argc, char *argv[])
 	if (argc == 1)
 		return 0;
 
-	while ((opt = getopt(argc, argv, "f:rw:")) >= 0) {
+	while ((opt = getopt(argc, argv, "f:n:rw:")) >= 0) {
 		switch (opt) {
 		case 'f':
-			fuse = (int)strtoul(optarg, NULL, 0);
+			if (nranges == OTP_RANGES_MAX) {
+				usage = 1;
+				break;
+			}
+			ranges[nranges].fuse = (int)strtoul(optarg, NULL, 0);
+			ranges[nranges].count = 1;
+			nranges++;
+			break;
+
+		case 'n':
+			/* Applies to the preceding -f */
+			if (nranges == 0)
+				usage = 1;
+			else
+				ranges[nranges - 1].count = (unsigned int)strtoul(optarg, NULL, 0);
 			break;
 
 		case 'r':
@@ -153,27 +232,37 @@ int main(int argc, char *argv[])
 		}
 	}
 
-	if (!(read ^ write) || fuse < FUSE_MIN || fuse > FUSE_MAX || usage) {
+	for (i = 0; i < nranges; i++) {
+		if (!check_range(ranges[i].fuse, ranges[i].count))
+			usage = 1;
+	}
+
+	if (!(read ^ write) || (nranges == 0) || (write && ((nranges != 1) || (ranges[0].count != 1))) || usage) {
 		fprintf(stderr, "Tool for management otp of i.MX RT117x MCU. Usage:\n");
-		fprintf(stderr, "%s [-r | -w value] -f fuse\n", argv[0]);
+		fprintf(stderr, "%s [-r | -w value] -f fuse [-n count] [-f fuse [-n count] ...]\n", argv[0]);
 		fprintf(stderr, "\t-r\t\tRead fuse\n");
 		fprintf(stderr, "\t-w val\t\tWrite fuse with value [val] (32-bit number)\n");
 		fprintf(stderr, "\t-f fuse\t\tSelect fuse to read/write\n");
+		fprintf(stderr, "\t-n count\tRead count consecutive fuse words starting at preceding -f\n");
 
 		return 1;
 	}
 
 	if (read) {
-		if ((res = read_fuse(fuse, &val)) < 0) {
-			fprintf(stderr, "Fuse reading failed! (%s)\n", strerror(res));
-			return -1;
+		/* One value per line, in order of ranges */
+		for (i = 0; i < nranges; i++) {
+			if ((res = read_fuses(ranges[i].fuse, buf, ranges[i].count)) < 0) {
+				fprintf(stderr, "Fuse reading failed! (%s)\n", strerror(-res));
+				return -1;
+			}
+
+			for (j = 0; j < ranges[i].count; j++)
+				printf("0x%08x\n", buf[j]);
 		}
-
-		printf("0x%08x\n", val);
 	}
 	else if (write) {
-		if ((res = write_fuse(fuse, val)) < 0) {
-			fprintf(stderr, "Fuse write failed! (%s)\n", strerror(res));
+		if ((res = write_fuse(ranges[0].fuse, val)) < 0) {
+			fprintf(stderr, "Fuse write failed! (%s)\n", strerror(-res));
 			return -1;
 		}
 	}
@@ -16,7 +16,10 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
+#include <unistd.h>
 #include <sys/time.h>
+#include <sys/threads.h>
 
 #include <sys/msg.h>
 #include <sys/ioctl.h>
@@ -31,8 +34,23 @@
  *  - we configure / use TSR2 register to hold First Timestamp the RTC switched to battery operation (real "POWERFAIL" event?)
  *  - we use battery-backed generic RTC RAM memory to check if battery supply has failed in the meantime
  *  - RTC alarm generation with interrupt pin is not used as we're not planning on putting main CPU to sleep
+ *  - RTC time is read at start (aligned to the seconds edge) and then every RTC_RESYNC_S, reads in between are
+ *    interpolated from the monotonic clock corrected by the measured drift, returned time never goes back
  */
 
+/* period of RTC time re-reads [s] */
+#ifndef RTC_RESYNC_S
+#define RTC_RESYNC_S 600
+#endif
+
+/* minimal baseline for drift measurement [s], RTC reads are exact to 1 s only */
+#ifndef RTC_DRIFT_MIN_S
+#define RTC_DRIFT_MIN_S (6 * 3600)
+#endif
+
+/* larger drift means the RTC was changed behind our back [ppb] */
+#define RTC_DRIFT_MAX 500000
+
 static const uint8_t DEV_ADDR = 0x51u;             /* PCF85363A */
 static const uint8_t RTC_TIME_REG_ADDR = 0x01;     /* RTC time: seconds register */
 static const uint8_t RTC_TSR2_REG_ADDR = 0x17;     /* RTC event (2): seconds register */
@@ -47,6 +65,17 @@ enum { dev_id_rtc, dev_id_first_powerfail, dev_id_last_powerfail, dev_id_batt_po
 
 static struct {
 	unsigned int battery_failed;
+
+	struct {
+		int valid;
+		time_t mono;       /* anchor monotonic time [us] */
+		int64_t wall;      /* wall time at the anchor [us] */
+		int64_t drift;     /* RTC rate relative to the monotonic clock [ppb] */
+		time_t syncMono;   /* last RTC read [us] */
+		time_t firstMono;  /* drift baseline start [us] */
+		int64_t firstWall; /* wall time at the baseline start [us] */
+		time_t last;       /* last returned time [s] */
+	} cache;
 } common;
 
 
@@ -121,6 +150,138 @@ static int rtc_set_time(const struct rtc_time *rtc_time)
 }
 
 
+static time_t rtc_time_to_unix(const struct rtc_time *rtc_time);
+
+
+static void rtc_time_from_unix(time_t unix_time, struct rtc_time *rtc_time)
+{
+	struct tm t;
+
+	/* inverse of mktime() used for RTC -> unix conversion */
+	localtime_r(&unix_time, &t);
+
+	rtc_time->tm_sec = t.tm_sec;
+	rtc_time->tm_min = t.tm_min;
+	rtc_time->tm_hour = t.tm_hour;
+	rtc_time->tm_mday = t.tm_mday;
+	rtc_time->tm_mon = t.tm_mon;
+	rtc_time->tm_year = t.tm_year;
+	rtc_time->tm_wday = t.tm_wday;
+	rtc_time->tm_yday = t.tm_yday;
+	rtc_time->tm_isdst = 0;
+}
+
+
+static int64_t cache_predict(time_t mono)
+{
+	int64_t elapsed = mono - common.cache.mono;
+
+	return common.cache.wall + elapsed + elapsed * common.cache.drift / 1000000000;
+}
+
+
+static void cache_anchor(time_t mono, int64_t wall)
+{
+	common.cache.mono = mono;
+	common.cache.wall = wall;
+	common.cache.firstMono = mono;
+	common.cache.firstWall = wall;
+	common.cache.syncMono = mono;
+	common.cache.valid = 1;
+}
+
+
+static int rtc_read_unix(time_t *unix_time)
+{
+	struct rtc_time rtc_time;
+	int res;
+
+	if ((res = rtc_get_time(&rtc_time, RTC_TIME_REG_ADDR, 0)) < 0)
+		return res;
+
+	*unix_time = rtc_time_to_unix(&rtc_time);
+	return 0;
+}
+
+
+/* first read waits for the seconds change (up to 1 s) to anchor precisely */
+static int rtc_resync(void)
+{
+	time_t rtc, next, mono;
+	int64_t lo, hi, pred, elapsed, drift;
+	int i;
+
+	if (rtc_read_unix(&rtc) < 0)
+		return -EIO;
+	gettime(&mono, NULL);
+
+	if (!common.cache.valid) {
+		for (i = 0; i < 1100; ++i) {
+			usleep(1000);
+			if (rtc_read_unix(&next) < 0)
+				return -EIO;
+			gettime(&mono, NULL);
+
+			if (next != rtc)
+				break;
+		}
+
+		if (next != rtc)
+			cache_anchor(mono, (int64_t)next * 1000000);
+		else
+			cache_anchor(mono, (int64_t)rtc * 1000000 + 500000);
+
+		return 0;
+	}
+
+	lo = (int64_t)rtc * 1000000;
+	hi = lo + 999999;
+	pred = cache_predict(mono);
+
+	elapsed = mono - common.cache.firstMono;
+	if (elapsed >= (int64_t)RTC_DRIFT_MIN_S * 1000000) {
+		drift = (((lo + 500000) - common.cache.firstWall) - elapsed) * 1000 / (elapsed / 1000000);
+		if ((drift <= RTC_DRIFT_MAX) && (drift >= -RTC_DRIFT_MAX))
+			common.cache.drift = drift;
+	}
+
+	/* re-anchor inside the second reported by RTC */
+	if (pred < lo)
+		pred = lo;
+	else if (pred > hi)
+		pred = hi;
+
+	common.cache.mono = mono;
+	common.cache.wall = pred;
+	common.cache.syncMono = mono;
+
+	return 0;
+}
+
+
+static int rtc_cached_time(time_t *unix_time)
+{
+	time_t mono, t;
+
+	gettime(&mono, NULL);
+	if (!common.cache.valid || (mono - common.cache.syncMono >= (time_t)RTC_RESYNC_S * 1000000)) {
+		/* keep interpolating on I2C failure, retry on the next read */
+		if ((rtc_resync() < 0) && !common.cache.valid)
+			return -EIO;
+		gettime(&mono, NULL);
+	}
+
+	t = cache_predict(mono) / 1000000;
+	if (t < common.cache.last)
+		t = common.cache.last;
+
+	common.cache.last = t;
+	*unix_time = t;
+
+	return 0;
+}
+
+
 static void dev_ctl(msg_t *msg)
 {
 	unsigned long request;
@@ -128,6 +289,7 @@ static void dev_ctl(msg_t *msg)
 	id_t id;
 	const void *data = ioctl_unpack(msg, &request, &id);
 	struct rtc_time time;
+	time_t unix_time, mono;
 
 	if (id != dev_id_rtc) {
 		printf("rtc: this device does not support ioctls: id=%llu\n", id);
@@ -137,13 +299,22 @@ static void dev_ctl(msg_t *msg)
 
 	switch (request) {
 		case RTC_RD_TIME:
-			res = rtc_get_time(&time, RTC_TIME_REG_ADDR, 0);
+			memset(&time, 0, sizeof(time));
+			res = rtc_cached_time(&unix_time);
+			if (res == 0)
+				rtc_time_from_unix(unix_time, &time);
 			ioctl_setResponse(msg, request, res, &time);
 			break;
 
 		case RTC_SET_TIME:
 			memcpy(&time, data, sizeof(struct rtc_time));
 			res = rtc_set_time(&time);
+			if (res == EOK) {
+				/* new anchor, drift is a property of the crystals and is kept */
+				gettime(&mono, NULL);
+				cache_anchor(mono, (int64_t)rtc_time_to_unix(&time) * 1000000);
+				common.cache.last = 0;
+			}
 			ioctl_setResponse(msg, request, res, NULL);
 			break;
 
@@ -183,20 +354,24 @@ static int dev_read(oid_t *oid, off_t offs, size_t len, void *data)
 	int res;
 
 	if (oid->id >= dev_id_rtc && oid->id <= dev_id_last_powerfail) {
-		if (oid->id == dev_id_rtc)
-			res = rtc_get_time(&rtc_time, RTC_TIME_REG_ADDR, 0);
-		else if (oid->id == dev_id_first_powerfail)
-			res = rtc_get_time(&rtc_time, RTC_TSR2_REG_ADDR, 1);
-		else if (oid->id == dev_id_last_powerfail)
-			res = rtc_get_time(&rtc_time, RTC_TSR3_REG_ADDR, 1);
-		else
-			return -EINVAL;
+		if (oid->id == dev_id_rtc) {
+			res = rtc_cached_time(&unix_time);
+		}
+		else {
+			if (oid->id == dev_id_first_powerfail)
+				res = rtc_get_time(&rtc_time, RTC_TSR2_REG_ADDR, 1);
+			else if (oid->id == dev_id_last_powerfail)
+				res = rtc_get_time(&rtc_time, RTC_TSR3_REG_ADDR, 1);
+			else
+				return -EINVAL;
+
+			if (res == 0)
+				unix_time = rtc_time_to_unix(&rtc_time);
+		}
 
 		if (res < 0)
 			return res;
 
-
-		unix_time = rtc_time_to_unix(&rtc_time);
 		snprintf(buf, sizeof(buf), "%llu\n", unix_time);
 	}
 	else if (oid->id == dev_id_batt_powerfail) {
@@ -368,6 +543,9 @@ int main(int argc, char **argv)
 
 	setup_rtc();
 
+	if (rtc_resync() < 0)
+		printf("rtc: failed to read RTC time, retrying on first read\n");
+
 	puts("rtc: initialized");
 	thread((void *)port);
 
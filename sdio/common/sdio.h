@@ -33,6 +33,10 @@ typedef enum {
 typedef void (*sdio_event_handler_t)(void *arg);
 
 
+/* asynchronous transfer completion callback, result is 0 or negative error code */
+typedef void (*sdio_xfer_cb_t)(int result, void *arg);
+
+
 /* Enables SDIO module */
 extern int sdio_init(void);
 
@@ -49,11 +53,26 @@ extern void sdio_free(void);
 extern int sdio_transferDirect(sdio_dir_t dir, uint32_t address, uint8_t area, uint8_t *data);
 
 
-/* Transfers to/from device synchronously */
+/* Transfers to/from device synchronously, transfers longer than one command allows are split */
 extern int sdio_transferBulk(sdio_dir_t dir, int blockMode, uint32_t address, uint8_t area,
 	uint8_t *data, size_t len);
 
 
+/* Allocates a buffer which is transferred by DMA directly, without copying */
+extern void *sdio_dmaAlloc(size_t size);
+
+
+extern void sdio_dmaFree(void *ptr, size_t size);
+
+
+/*
+ * Queues a single bulk command, data has to be a (4-byte aligned) part of sdio_dmaAlloc() buffer.
+ * Returns -EAGAIN if the queue is full, cb is called from the driver's transfer thread.
+ */
+extern int sdio_transferBulkAsync(sdio_dir_t dir, int blockMode, uint32_t address, uint8_t area,
+	uint8_t *data, size_t len, sdio_xfer_cb_t cb, void *arg);
+
+
 /* Registers an interrupt event handler */
 extern int sdio_eventRegister(uint8_t event, sdio_event_handler_t handler, void *arg);
 
@@ -57,10 +57,26 @@
 #define SDIO_STATUS_DMA_ERROR      (1UL << 28) /* DMA transfer failed      */
 
 /* configuration values */
-#define DMA_BUFFER_SIZE   2048
+#define DMA_BUFFER_SIZE   16384 /* bounce buffer for transfers from/to regular memory */
 #define THREAD_STACK_SIZE 1024
 #define SDHC_RETRIES      10
 
+/* asynchronous transfers */
+#define SDIO_XFER_QUEUE      8
+#define SDIO_ADMA_DESCS      64 /* per queued transfer, all tables fit in one page */
+#define SDIO_DMA_BUFS        16 /* sdio_dmaAlloc() allocations */
+#define SDIO_XFER_TIMEOUT_US 100000
+#define SDIO_XFER_POLL_US    10000
+
+/* ADMA2 descriptor attributes */
+#define ADMA_VALID    (1UL << 0)
+#define ADMA_END      (1UL << 1)
+#define ADMA_ACT_TRAN (0x2UL << 4)
+#define ADMA_MAX_LEN  0xf000
+
+/* R5 response flags: COM_CRC_ERROR, ILLEGAL_COMMAND, ERROR, FUNCTION_NUMBER, OUT_OF_RANGE */
+#define SDIO_R5_ERRORS (0xcbUL << 8)
+
 /* hardware platform specific */
 #define USDHC2_ADDR             0x2194000
 #define USDHC2_IRQ              (32 + 23)
@@ -73,6 +89,11 @@
 #define SDHC_SYSCTL_RESERVED    0xf
 #define SDHC_INTERRUPT_DEFAULTS 0x107f000f
 #define SDHC_CMD_ERROR          0x107f0000
+#define SDHC_PROT_DMASEL_MASK   (0x3UL << 8)
+#define SDHC_PROT_DMASEL_ADMA2  (0x2UL << 8)
+
+/* data transfer completion interrupts, command complete is implied by transfer complete */
+#define SDIO_XFER_IRQ (SDIO_STATUS_RW_DONE | SDHC_CMD_ERROR)
 
 #define ARRAY_LENGTH(array) (sizeof(array) / sizeof(array[0]))
 
@@ -88,6 +109,24 @@ enum { reg_ds_addr = 0, reg_blk_att, reg_cmd_arg, reg_cmd_xfer_typ, reg_cmd_rsp0
 	reg_vend_spec2, reg_tuning_ctrl };
 /* clang-format on */
 
+typedef struct {
+	uint32_t attr;
+	uint32_t addr;
+} sdio_admaDesc_t;
+
+
+typedef struct {
+	uint32_t arg;
+	uint32_t cmd;
+	uint32_t mix;
+	uint32_t blk;
+	sdio_admaDesc_t *desc;
+	addr_t descPhys;
+	sdio_xfer_cb_t cb;
+	void *cbArg;
+} sdio_xfer_t;
+
+
 static struct {
 	volatile uint32_t *base;
 	handle_t cmdLock;
@@ -95,7 +134,25 @@ static struct {
 
 	/* DMA */
 	void *dmaptr;
-	addr_t dmaphys;
+	handle_t bounceLock;
+	struct {
+		void *ptr;
+		size_t size;
+	} dmaBufs[SDIO_DMA_BUFS];
+
+	/* bulk transfer queue, protected by cmdLock */
+	struct {
+		sdio_xfer_t queue[SDIO_XFER_QUEUE];
+		unsigned int head;
+		unsigned int count;
+		int active; /* oldest queued transfer is on the bus */
+		time_t started;
+		void *descs;
+		handle_t cond; /* signalled by sdio_xferIsr */
+		handle_t done; /* broadcast after each completion */
+		handle_t isrHandle;
+		uint8_t stack[THREAD_STACK_SIZE] __attribute__((aligned(8)));
+	} xfer;
 
 	/* API flags */
 	int sdioInitialized;
@@ -259,18 +316,34 @@ static int sdio_isr(unsigned int n, void *arg)
 {
 	/* clear Card Interrupt signal enable only
 	 * i.MX 6ULL documentation, page 4042 */
-	if (*(sdio_common.base + reg_int_status) & SDIO_STATUS_CARD_IRQ) {
+	uint32_t val = *(sdio_common.base + reg_int_status);
+
+	if (val & SDIO_STATUS_CARD_IRQ) {
 		*(sdio_common.base + reg_int_signal_en) &= ~SDIO_STATUS_CARD_IRQ;
 	}
 
+	/* transfer completions are served by sdio_xferIsr */
+	return ((val & sdio_common.enabledEvents) != 0) ? 0 : -1;
+}
+
+
+static int sdio_xferIsr(unsigned int n, void *arg)
+{
+	if ((*(sdio_common.base + reg_int_status) & SDIO_XFER_IRQ) == 0) {
+		return -1;
+	}
+
+	/* masked until the transfer thread takes care of it */
+	*(sdio_common.base + reg_int_signal_en) &= ~SDIO_XFER_IRQ;
+
 	return 0;
 }
 
 
-static void *sdio_dmammap(void)
+static void *sdio_dmammap(size_t size)
 {
 	void *p;
-	size_t sz = (DMA_BUFFER_SIZE + _PAGE_SIZE - 1) & ~(_PAGE_SIZE - 1);
+	size_t sz = (size + _PAGE_SIZE - 1) & ~(_PAGE_SIZE - 1);
 
 	p = mmap(NULL, sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_UNCACHED, -1, 0);
 	if (p == MAP_FAILED) {
@@ -307,30 +380,50 @@ static addr_t sdio_mphys(void *p, size_t *psz)
 }
 
 
+/* bounce buffer doesn't have to be physically contiguous, ADMA descriptors cover each chunk */
 static int sdio_allocDMA(void)
 {
-	size_t psize = DMA_BUFFER_SIZE;
-
-	sdio_common.dmaptr = sdio_dmammap();
+	sdio_common.dmaptr = sdio_dmammap(DMA_BUFFER_SIZE);
 	if (sdio_common.dmaptr == NULL) {
 		return -1;
 	}
 
-	sdio_common.dmaphys = sdio_mphys(sdio_common.dmaptr, &psize);
-
-	if (DMA_BUFFER_SIZE != psize) {
+	sdio_common.xfer.descs = sdio_dmammap(SDIO_XFER_QUEUE * SDIO_ADMA_DESCS * sizeof(sdio_admaDesc_t));
+	if (sdio_common.xfer.descs == NULL) {
 		munmap(sdio_common.dmaptr, DMA_BUFFER_SIZE);
 		sdio_common.dmaptr = NULL;
 		return -1;
 	}
 
-	if (sdio_common.dmaphys & 3) {
-		munmap(sdio_common.dmaptr, DMA_BUFFER_SIZE);
-		sdio_common.dmaptr = NULL;
-		return -1;
+	return 0;
+}
+
+
+/* Returns number of descriptors used or -EINVAL if the buffer is too fragmented */
+static int sdio_admaBuild(sdio_admaDesc_t *desc, uint8_t *data, size_t len)
+{
+	size_t chunk;
+	int n = 0;
+
+	while (len > 0) {
+		if (n == SDIO_ADMA_DESCS) {
+			return -EINVAL;
+		}
+
+		chunk = (len > ADMA_MAX_LEN) ? ADMA_MAX_LEN : len;
+		desc[n].addr = sdio_mphys(data, &chunk);
+		desc[n].attr = (chunk << 16) | ADMA_ACT_TRAN | ADMA_VALID;
+
+		data += chunk;
+		len -= chunk;
+		n++;
 	}
 
-	return 0;
+	if (n > 0) {
+		desc[n - 1].attr |= ADMA_END;
+	}
+
+	return n;
 }
 
 
@@ -351,7 +444,8 @@ static void sdio_eventThread(void *arg)
 				if (sdioEvents[i] == SDIO_STATUS_CARD_IRQ) {
 					*(sdio_common.base + reg_int_status_en) &= ~SDIO_STATUS_CARD_IRQ;
 				}
-				*(sdio_common.base + reg_int_status) |= sdioEvents[i];
+				/* write 1 to clear only this event, not pending transfer status */
+				*(sdio_common.base + reg_int_status) = sdioEvents[i];
 				if (sdio_common.eventHandlers[i] != NULL) {
 					sdio_common.eventHandlers[i](sdio_common.eventHandlerArgs[i]);
 				}
@@ -463,6 +557,10 @@ static int sdio_cmdSend(uint8_t cmd, uint32_t arg, uint32_t *res)
 	int rslt;
 
 	mutexLock(sdio_common.cmdLock);
+	/* commands can't be issued while bulk transfer is in progress */
+	while (sdio_common.xfer.count != 0) {
+		condWait(sdio_common.xfer.done, sdio_common.cmdLock, 0);
+	}
 	rslt = _sdio_cmdSend(cmd, arg, res);
 	mutexUnlock(sdio_common.cmdLock);
 
@@ -494,12 +592,106 @@ static int sdio_cardInit(void)
 }
 
 
+static void _sdio_xferStart(void)
+{
+	sdio_xfer_t *x = &sdio_common.xfer.queue[(sdio_common.xfer.head + SDIO_XFER_QUEUE - sdio_common.xfer.count) % SDIO_XFER_QUEUE];
+
+	*(sdio_common.base + reg_int_status) = 0xb | SDHC_CMD_ERROR;
+	*(sdio_common.base + reg_int_signal_en) |= SDIO_XFER_IRQ;
+
+	*(sdio_common.base + reg_mix_ctrl) = x->mix;
+	*(sdio_common.base + reg_blk_att) = x->blk;
+	*(sdio_common.base + reg_adma_sys_addr) = x->descPhys;
+	*(sdio_common.base + reg_cmd_arg) = x->arg;
+	*(sdio_common.base + reg_cmd_xfer_typ) = x->cmd;
+
+	gettime(&sdio_common.xfer.started, NULL);
+	sdio_common.xfer.active = 1;
+}
+
+
+static void sdio_xferThread(void *arg)
+{
+	sdio_xfer_t *x;
+	sdio_xfer_cb_t cb;
+	void *cbArg;
+	uint32_t val;
+	time_t now;
+	int rslt;
+
+	mutexLock(sdio_common.cmdLock);
+	for (;;) {
+		/* poll as well, signal enable may race with events RMW */
+		condWait(sdio_common.xfer.cond, sdio_common.cmdLock, (sdio_common.xfer.active != 0) ? SDIO_XFER_POLL_US : 0);
+		if (sdio_common.xfer.active == 0) {
+			continue;
+		}
+
+		val = *(sdio_common.base + reg_int_status);
+		if ((val & SDHC_CMD_ERROR) != 0) {
+			rslt = -EIO;
+		}
+		else if ((val & SDIO_STATUS_RW_DONE) != 0) {
+			rslt = ((*(sdio_common.base + reg_cmd_rsp0) & SDIO_R5_ERRORS) != 0) ? -EIO : 0;
+		}
+		else {
+			gettime(&now, NULL);
+			if (now - sdio_common.xfer.started < SDIO_XFER_TIMEOUT_US) {
+				*(sdio_common.base + reg_int_signal_en) |= SDIO_XFER_IRQ;
+				continue;
+			}
+			rslt = -ETIMEDOUT;
+		}
+
+		if (rslt < 0) {
+			sdhc_reset(SDHC_SYSCTL_RESET_CMD);
+			sdhc_reset(SDHC_SYSCTL_RESET_DATA);
+		}
+
+		/* clear status flags */
+		*(sdio_common.base + reg_int_status) = 0xb | SDHC_CMD_ERROR; /* DINT=1 TC=1 CC=1 */
+
+		x = &sdio_common.xfer.queue[(sdio_common.xfer.head + SDIO_XFER_QUEUE - sdio_common.xfer.count) % SDIO_XFER_QUEUE];
+		cb = x->cb;
+		cbArg = x->cbArg;
+
+		sdio_common.xfer.count--;
+		sdio_common.xfer.active = 0;
+
+		/* next command goes out back-to-back */
+		if (sdio_common.xfer.count != 0) {
+			_sdio_xferStart();
+		}
+
+		if (cb != NULL) {
+			mutexUnlock(sdio_common.cmdLock);
+			cb(rslt, cbArg);
+			mutexLock(sdio_common.cmdLock);
+		}
+
+		condBroadcast(sdio_common.xfer.done);
+	}
+}
+
+
 static int sdio_startEventThread(void)
 {
 	if (sdio_common.eventThreadStarted == 1) {
 		return 0;
 	}
 
+	if (condCreate(&sdio_common.xfer.cond) < 0) {
+		return -1;
+	}
+	if (condCreate(&sdio_common.xfer.done) < 0) {
+		resourceDestroy(sdio_common.xfer.cond);
+		return -1;
+	}
+	interrupt(USDHC2_IRQ, sdio_xferIsr, NULL, sdio_common.xfer.cond, &sdio_common.xfer.isrHandle);
+	if (beginthread(sdio_xferThread, 4, &sdio_common.xfer.stack, THREAD_STACK_SIZE, NULL) < 0) {
+		return -1;
+	}
+
 	sdio_common.eventLock = -1;
 	if (mutexCreate(&sdio_common.eventLock) < 0) {
 		return -1;
@@ -540,14 +732,13 @@ static void _sdio_free(void)
 	sdio_common.sdioInitialized = 0;
 	sdio_common.blocksz = 0;
 
-	if (sdio_common.cmdLock >= 0) {
-		resourceDestroy(sdio_common.cmdLock);
-		sdio_common.cmdLock = (handle_t)NULL;
-	}
 	if (sdio_common.dmaptr != NULL) {
 		munmap(sdio_common.dmaptr, DMA_BUFFER_SIZE);
 		sdio_common.dmaptr = NULL;
-		sdio_common.dmaphys = (addr_t)NULL;
+	}
+	if (sdio_common.xfer.descs != NULL) {
+		munmap(sdio_common.xfer.descs, SDIO_XFER_QUEUE * SDIO_ADMA_DESCS * sizeof(sdio_admaDesc_t));
+		sdio_common.xfer.descs = NULL;
 	}
 
 	*(sdio_common.base + reg_int_status_en) = 0;
@@ -591,11 +782,19 @@ int sdio_init(void)
 		return -ENOMEM;
 	}
 
-	sdio_common.cmdLock = -1;
-	if (mutexCreate(&sdio_common.cmdLock) < 0) {
+	/* kept on free, the transfer thread keeps using it */
+	if ((sdio_common.eventThreadStarted == 0) && (mutexCreate(&sdio_common.cmdLock) < 0)) {
+		_sdio_free();
+		return -ENOMEM;
+	}
+	if ((sdio_common.eventThreadStarted == 0) && (mutexCreate(&sdio_common.bounceLock) < 0)) {
 		_sdio_free();
 		return -ENOMEM;
 	}
+	for (i = 0; i < SDIO_XFER_QUEUE; i++) {
+		sdio_common.xfer.queue[i].desc = (sdio_admaDesc_t *)sdio_common.xfer.descs + i * SDIO_ADMA_DESCS;
+		sdio_common.xfer.queue[i].descPhys = va2pa(sdio_common.xfer.queue[i].desc);
+	}
 
 	if (platform_configure() < 0) {
 		_sdio_free();
@@ -613,6 +812,9 @@ int sdio_init(void)
 	 * i.MX 6ULL Reference manual rev.1, page 4072. */
 	*(sdio_common.base + reg_vend_spec) |= (1UL << 5);
 
+	/* scatter-gather DMA */
+	*(sdio_common.base + reg_prot_ctrl) = (*(sdio_common.base + reg_prot_ctrl) & ~SDHC_PROT_DMASEL_MASK) | SDHC_PROT_DMASEL_ADMA2;
+
 	*(sdio_common.base + reg_int_status_en) = SDHC_INTERRUPT_DEFAULTS;
 
 	for (i = 0; i < 5; i++) {
@@ -717,105 +919,246 @@ int sdio_transferDirect(sdio_dir_t dir, uint32_t address, uint8_t area, uint8_t
 }
 
 
-static int _sdio_transferBulk(sdio_dir_t dir, int blockMode, uint32_t address,
-	uint8_t area, uint8_t *data, size_t len)
+static int _sdio_isDmaBuf(const uint8_t *data, size_t len)
 {
-	uint32_t val, cmd, mix, blk;
-	uint32_t arg = 0;
-	uint16_t count;
+	unsigned int i;
 
-	count = (blockMode != 0) ? (len / sdio_common.blocksz) : len;
+	for (i = 0; i < SDIO_DMA_BUFS; i++) {
+		if ((sdio_common.dmaBufs[i].ptr != NULL) && (data >= (uint8_t *)sdio_common.dmaBufs[i].ptr) &&
+			(data + len <= (uint8_t *)sdio_common.dmaBufs[i].ptr + sdio_common.dmaBufs[i].size)) {
+			return 1;
+		}
+	}
 
-	/* construct argument */
-	arg |= (dir << 31);
-	arg |= ((area & 0x7) << 28);
-	arg |= ((address & 0x1ffff) << 9);
-	arg |= (count & 0x1ff);
-	arg |= ((blockMode != 0) << 27);
-	arg |= (1UL << 26);
+	return 0;
+}
 
-	val = *(sdio_common.base + reg_pres_state);
-	if (val & 0x7) {
-		return -EBUSY;
-	}
 
-	val = *(sdio_common.base + reg_int_status);
-	if (val & 0x2) {
-		return -EIO;
+static int _sdio_xferSubmit(sdio_dir_t dir, int blockMode, uint32_t address,
+	uint8_t area, uint8_t *data, size_t len, sdio_xfer_cb_t cb, void *arg)
+{
+	sdio_xfer_t *x;
+	uint32_t count;
+
+	if (sdio_common.xfer.count == SDIO_XFER_QUEUE) {
+		return -EAGAIN;
 	}
 
-	if (dir == sdio_write) {
-		memcpy(sdio_common.dmaptr, data, len);
+	/* count 0 stands for 512 blocks/bytes, which is not used for blocks to keep the 511 limit */
+	count = (blockMode != 0) ? (len / sdio_common.blocksz) : len;
+	if ((len == 0) || (count > ((blockMode != 0) ? 511 : 512))) {
+		return -EINVAL;
 	}
 
-	cmd = SDIO_CMD_RW_EXTENDED << 24;
-	cmd |= 1UL << 21; /* DPSEL=1 */
-	cmd |= 1UL << 20; /* CICEN=1 */
-	cmd |= 1UL << 19; /* CCCEN=1 */
-	cmd |= 0x2 << 16; /* RSPTYP=2 */
+	x = &sdio_common.xfer.queue[sdio_common.xfer.head];
+	if (sdio_admaBuild(x->desc, data, len) < 0) {
+		return -EINVAL;
+	}
 
-	mix = (1U << 31) | (1UL << 0); /* DMAEN=1 */
+	/* construct argument */
+	x->arg = (dir << 31);
+	x->arg |= ((area & 0x7) << 28);
+	x->arg |= ((address & 0x1ffff) << 9);
+	x->arg |= (count & 0x1ff);
+	x->arg |= ((blockMode != 0) << 27);
+	x->arg |= (1UL << 26);
+
+	x->cmd = SDIO_CMD_RW_EXTENDED << 24;
+	x->cmd |= 1UL << 21; /* DPSEL=1 */
+	x->cmd |= 1UL << 20; /* CICEN=1 */
+	x->cmd |= 1UL << 19; /* CCCEN=1 */
+	x->cmd |= 0x2 << 16; /* RSPTYP=2 */
+
+	x->mix = (1U << 31) | (1UL << 0); /* DMAEN=1 */
 	if (dir == sdio_read) {
-		mix |= 1UL << 4; /* DTDSEL=1 */
+		x->mix |= 1UL << 4; /* DTDSEL=1 */
 	}
 
 	if (blockMode != 0) {
-		mix |= (1UL << 5); /* MSBSEL=1 */
-		mix |= (1UL << 1); /* BCEN=1 */
+		x->mix |= (1UL << 5); /* MSBSEL=1 */
+		x->mix |= (1UL << 1); /* BCEN=1 */
 
-		blk = (count << 16) | sdio_common.blocksz;
+		x->blk = (count << 16) | sdio_common.blocksz;
 	}
 	else {
-		blk = (1UL << 16) | len;
+		x->blk = (1UL << 16) | len;
 	}
 
-	*(sdio_common.base + reg_mix_ctrl) = mix;
-	*(sdio_common.base + reg_blk_att) = blk;
-	*(sdio_common.base + reg_ds_addr) = sdio_common.dmaphys;
-	*(sdio_common.base + reg_cmd_arg) = arg;
-	*(sdio_common.base + reg_cmd_xfer_typ) = cmd;
+	x->cb = cb;
+	x->cbArg = arg;
 
-	/* wait 1 ms max */
-	if (sdhc_cmdWait(0xb, 10, 100) < 0) {
-		sdhc_reset(SDHC_SYSCTL_RESET_CMD);
-		sdhc_reset(SDHC_SYSCTL_RESET_DATA);
-		return -ETIMEDOUT;
+	sdio_common.xfer.head = (sdio_common.xfer.head + 1) % SDIO_XFER_QUEUE;
+	sdio_common.xfer.count++;
+
+	if (sdio_common.xfer.active == 0) {
+		_sdio_xferStart();
 	}
 
-	/* clear status flags */
-	*(sdio_common.base + reg_int_status) = 0xb; /* DINT=1 TC=1 CC=1 */
+	return 0;
+}
 
-	if (dir == sdio_read) {
-		memcpy(data, sdio_common.dmaptr, len);
+
+typedef struct {
+	volatile int done;
+	int rslt;
+} sdio_syncCtx_t;
+
+
+static void sdio_syncCb(int result, void *arg)
+{
+	sdio_syncCtx_t *ctx = arg;
+
+	ctx->rslt = result;
+	ctx->done = 1;
+}
+
+
+static int _sdio_transferChunk(sdio_dir_t dir, int blockMode, uint32_t address,
+	uint8_t area, uint8_t *data, size_t len)
+{
+	sdio_syncCtx_t ctx = { 0 };
+	int rslt;
+
+	while ((rslt = _sdio_xferSubmit(dir, blockMode, address, area, data, len, sdio_syncCb, &ctx)) == -EAGAIN) {
+		condWait(sdio_common.xfer.done, sdio_common.cmdLock, 0);
 	}
 
-	/* retrieve response */
-	val = *(sdio_common.base + reg_cmd_rsp0);
+	if (rslt < 0) {
+		return rslt;
+	}
 
-	return 0;
+	while (ctx.done == 0) {
+		condWait(sdio_common.xfer.done, sdio_common.cmdLock, 0);
+	}
+
+	return ctx.rslt;
 }
 
 
 int sdio_transferBulk(sdio_dir_t dir, int blockMode, uint32_t address,
 	uint8_t area, uint8_t *data, size_t len)
 {
-	int rslt;
+	int rslt = 0, direct;
+	size_t chunk, max;
+
+	if (blockMode != 0 && (sdio_common.blocksz == 0 || len % sdio_common.blocksz != 0)) {
+		return -EINVAL;
+	}
+
+	mutexLock(sdio_common.cmdLock);
+	direct = (((uintptr_t)data & 3) == 0) && (_sdio_isDmaBuf(data, len) != 0);
+	mutexUnlock(sdio_common.cmdLock);
 
-	if (len > DMA_BUFFER_SIZE) {
+	if (blockMode == 0 && len > 512) {
 		return -EINVAL;
 	}
+
+	/* longer block transfers are split into multiple commands, the address is incremented by the card */
+	max = (blockMode != 0) ? 511 * sdio_common.blocksz : 512;
+	if (direct == 0) {
+		if (max > DMA_BUFFER_SIZE) {
+			max = (DMA_BUFFER_SIZE / sdio_common.blocksz) * sdio_common.blocksz;
+		}
+		mutexLock(sdio_common.bounceLock);
+	}
+
+	mutexLock(sdio_common.cmdLock);
+	while ((len > 0) && (rslt == 0)) {
+		chunk = (len > max) ? max : len;
+
+		if (direct != 0) {
+			rslt = _sdio_transferChunk(dir, blockMode, address, area, data, chunk);
+		}
+		else {
+			if (dir == sdio_write) {
+				memcpy(sdio_common.dmaptr, data, chunk);
+			}
+			rslt = _sdio_transferChunk(dir, blockMode, address, area, sdio_common.dmaptr, chunk);
+			if ((rslt == 0) && (dir == sdio_read)) {
+				memcpy(data, sdio_common.dmaptr, chunk);
+			}
+		}
+
+		data += chunk;
+		address += chunk;
+		len -= chunk;
+	}
+	mutexUnlock(sdio_common.cmdLock);
+
+	if (direct == 0) {
+		mutexUnlock(sdio_common.bounceLock);
+	}
+
+	return rslt;
+}
+
+
+int sdio_transferBulkAsync(sdio_dir_t dir, int blockMode, uint32_t address,
+	uint8_t area, uint8_t *data, size_t len, sdio_xfer_cb_t cb, void *arg)
+{
+	int rslt;
+
 	if (blockMode != 0 && (sdio_common.blocksz == 0 || len % sdio_common.blocksz != 0)) {
 		return -EINVAL;
 	}
+	if (((uintptr_t)data & 3) != 0) {
+		return -EINVAL;
+	}
 
 	mutexLock(sdio_common.cmdLock);
-	rslt = _sdio_transferBulk(dir, blockMode, address, area, data, len);
+	if (_sdio_isDmaBuf(data, len) == 0) {
+		rslt = -EINVAL;
+	}
+	else {
+		rslt = _sdio_xferSubmit(dir, blockMode, address, area, data, len, cb, arg);
+	}
 	mutexUnlock(sdio_common.cmdLock);
 
 	return rslt;
 }
 
 
+void *sdio_dmaAlloc(size_t size)
+{
+	unsigned int i;
+	void *p;
+
+	mutexLock(sdio_common.cmdLock);
+	for (i = 0; i < SDIO_DMA_BUFS; i++) {
+		if (sdio_common.dmaBufs[i].ptr == NULL) {
+			break;
+		}
+	}
+
+	if ((i == SDIO_DMA_BUFS) || ((p = sdio_dmammap(size)) == NULL)) {
+		mutexUnlock(sdio_common.cmdLock);
+		return NULL;
+	}
+
+	sdio_common.dmaBufs[i].ptr = p;
+	sdio_common.dmaBufs[i].size = size;
+	mutexUnlock(sdio_common.cmdLock);
+
+	return p;
+}
+
+
+void sdio_dmaFree(void *ptr, size_t size)
+{
+	unsigned int i;
+
+	mutexLock(sdio_common.cmdLock);
+	for (i = 0; i < SDIO_DMA_BUFS; i++) {
+		if (sdio_common.dmaBufs[i].ptr == ptr) {
+			sdio_common.dmaBufs[i].ptr = NULL;
+			munmap(ptr, (size + _PAGE_SIZE - 1) & ~(_PAGE_SIZE - 1));
+			break;
+		}
+	}
+	mutexUnlock(sdio_common.cmdLock);
+}
+
+
 int sdio_eventRegister(uint8_t event, sdio_event_handler_t handler, void *arg)
 {
 	if (event >= ARRAY_LENGTH(sdioEvents)) {
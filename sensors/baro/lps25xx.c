@@ -49,14 +49,24 @@
 /* control register 2 */
 #define REG_CTRL_REG2 0x21
 #define VAL_BOOT      0x80
+#define VAL_FIFO_EN   0x40
+
+/* status register */
+#define REG_STATUS 0x27
+#define VAL_P_DA   0x02
+
+/* FIFO control register */
+#define REG_FIFO_CTRL  0x2e
+#define VAL_FMODE_MEAN 0xc0
+#define VAL_WTM_MEAN32 0x1f /* moving average of 32 samples */
 
 /* data storage addresses */
 #define REG_DATA_OUT         0x28
 #define SPI_READ_BIT         0x80
 #define SPI_AUTOADDRINCR_BIT 0x40
 
-/* sensors data sizes */
-#define SENSOR_OUTPUT_SIZE 5
+/* sensors data sizes, status register is read together with outputs */
+#define SENSOR_OUTPUT_SIZE 6
 
 /* conversions */
 #define SENSOR_CONV_PASCALS 0.024414062F /* conversion from sensor value to pascals; = (100 * 1/4096) */
@@ -137,8 +147,17 @@ static int lps25xx_hwSetup(lps25xx_ctx_t *ctx)
 	}
 	usleep(1000 * 100); /* Arbitrary wait */
 
-	/* Internal averaging configuration. Lowest noise settings */
-	if (spiWriteReg(ctx, REG_RES_CONF, VAL_AVGT_64 | VAL_AVGP_512) < 0) {
+	/* Internal averaging is reduced, noise is filtered by FIFO mean mode instead (AVGP 512 is not allowed at 25 Hz ODR) */
+	if (spiWriteReg(ctx, REG_RES_CONF, VAL_AVGT_16 | VAL_AVGP_32) < 0) {
+		return -1;
+	}
+
+	/* Hardware moving average of pressure over 32 samples */
+	if (spiWriteReg(ctx, REG_FIFO_CTRL, VAL_FMODE_MEAN | VAL_WTM_MEAN32) < 0) {
+		return -1;
+	}
+
+	if (spiWriteReg(ctx, REG_CTRL_REG2, VAL_FIFO_EN) < 0) {
 		return -1;
 	}
 	usleep(1000 * 100); /* Arbitrary wait */
@@ -156,19 +175,24 @@ static void lps25xx_publishthr(void *data)
 	uint8_t obuf;
 
 	while (1) {
-		/* ODR set to 25Hz */
-		usleep(40 * 1000);
-
-		obuf = REG_DATA_OUT | SPI_READ_BIT | SPI_AUTOADDRINCR_BIT;
+		/* Status and outputs are read in one burst, STATUS_REG is followed by output registers */
+		obuf = REG_STATUS | SPI_READ_BIT | SPI_AUTOADDRINCR_BIT;
 		err = sensorsspi_xfer(&ctx->spiCtx, &ctx->spiSS, &obuf, sizeof(obuf), ibuf, sizeof(ibuf), sizeof(obuf));
 
-		if (err >= 0) {
-			gettime(&(ctx->evtBaro.timestamp), NULL);
-			ctx->evtBaro.baro.pressure = translatePress(ibuf[0], ibuf[1], ibuf[2]);
-			ctx->evtBaro.baro.temp = translateTemp(ibuf[4], ibuf[3]);
-
-			sensors_publish(info->id, &ctx->evtBaro);
+		if ((err < 0) || ((ibuf[0] & VAL_P_DA) == 0)) {
+			/* No new pressure sample yet, poll again shortly */
+			usleep(5 * 1000);
+			continue;
 		}
+
+		gettime(&(ctx->evtBaro.timestamp), NULL);
+		ctx->evtBaro.baro.pressure = translatePress(ibuf[1], ibuf[2], ibuf[3]);
+		ctx->evtBaro.baro.temp = translateTemp(ibuf[5], ibuf[4]);
+
+		sensors_publish(info->id, &ctx->evtBaro);
+
+		/* ODR set to 25Hz, the next sample won't be ready earlier */
+		usleep(35 * 1000);
 	}
 }
 
@@ -56,6 +56,11 @@
 #define RESET_SLEEP  3000 /* Datasheet says 2800. It seems some data may be lost with such sleep */
 #define HW_ERROR_REP 10
 
+/* Temperature is converted once per this many pressure conversions */
+#ifndef MS5611_TEMP_DIV
+#define MS5611_TEMP_DIV 10
+#endif
+
 
 typedef struct {
 	spimsg_ctx_t spiCtx;
@@ -99,19 +104,23 @@ uint8_t ms5611_crc4(const uint16_t *prom)
 }
 
 
-/* Sends conversion request `convCmd`, waits `usDelat` for conversion and reads ADC to `res` */
-static int ms5611_measure(ms5611_ctx_t *ctx, uint8_t convCmd, time_t usDelay, uint32_t *res)
+static int ms5611_convStart(ms5611_ctx_t *ctx, uint8_t convCmd)
 {
-	static const uint8_t readCmd = CMD_READ_ADC;
-	uint32_t tmp;
-	uint8_t val[3];
-
 	if (sensorsspi_xfer(&ctx->spiCtx, &ctx->spiSS, &convCmd, sizeof(convCmd), NULL, 0, 0) < 0) {
 		fprintf(stderr, "ms5611: failed conv. request\n");
 		return -1;
 	}
 
-	usleep(usDelay);
+	return 0;
+}
+
+
+/* Reads result of the finished conversion to `res` */
+static int ms5611_adcRead(ms5611_ctx_t *ctx, uint32_t *res)
+{
+	static const uint8_t readCmd = CMD_READ_ADC;
+	uint32_t tmp;
+	uint8_t val[3];
 
 	if (sensorsspi_xfer(&ctx->spiCtx, &ctx->spiSS, &readCmd, sizeof(readCmd), val, sizeof(val), sizeof(readCmd)) < 0) {
 		fprintf(stderr, "ms5611: adc read failed\n");
@@ -131,12 +140,28 @@ static int ms5611_measure(ms5611_ctx_t *ctx, uint8_t convCmd, time_t usDelay, ui
 }
 
 
+/* Sends conversion request `convCmd`, waits `usDelat` for conversion and reads ADC to `res` */
+static int ms5611_measure(ms5611_ctx_t *ctx, uint8_t convCmd, time_t usDelay, uint32_t *res)
+{
+	if (ms5611_convStart(ctx, convCmd) < 0) {
+		return -1;
+	}
+
+	usleep(usDelay);
+
+	return ms5611_adcRead(ctx, res);
+}
+
+
 static void ms5611_publishthr(void *data)
 {
 	sensor_info_t *info = (sensor_info_t *)data;
 	ms5611_ctx_t *ctx = info->ctx;
 	int32_t temp, press, cnt = 0;
-	time_t now;
+	unsigned int n = 0;
+	time_t now, start;
+	uint8_t conv, next;
+	uint32_t adc;
 
 	/* breaking naming convention on purpose to match datasheet notation 1:1 */
 	uint32_t D1 = 0, D2 = 0;
@@ -157,26 +182,54 @@ static void ms5611_publishthr(void *data)
 	dT = (int32_t)D2 - (((int32_t)ctx->prom[5]) << 8);  /* dT = D2 - C5 * 2^8 */
 	temp = 2000 + ((dT * (int64_t)ctx->prom[6]) >> 23); /* TEMP = 2000 + dT * C6 / 2^23 */
 
+	/*
+	 * Conversions are pipelined: the next one is started right after reading the ADC result of
+	 * the previous one, so calculations and publishing overlap with conversion time
+	 */
+	conv = CMD_CVRT_PRESS | CVRT_OSR_4096;
+	while (ms5611_convStart(ctx, conv) < 0) {
+		usleep(10000);
+	}
+	gettime(&start, NULL);
+
 	while (1) {
-		/* Read pressure */
-		if (ms5611_measure(ctx, (CMD_CVRT_PRESS | CVRT_OSR_4096), OSR_4096_SLEEP, &D1) < 0) {
-			usleep(1000);
+		gettime(&now, NULL);
+		if (now - start < OSR_4096_SLEEP) {
+			usleep(OSR_4096_SLEEP - (now - start));
+		}
+
+		next = ((++n % MS5611_TEMP_DIV) == 0) ? (CMD_CVRT_TEMP | CVRT_OSR_4096) : (CMD_CVRT_PRESS | CVRT_OSR_4096);
+
+		if ((ms5611_adcRead(ctx, &adc) < 0) || (ms5611_convStart(ctx, next) < 0)) {
 			if (++cnt >= HW_ERROR_REP) {
 				cnt = 0;
-				fprintf(stderr, "ms5611: pressure read errors\n");
+				fprintf(stderr, "ms5611: conversion errors\n");
+			}
+			usleep(1000);
+
+			/* Restart the pipeline, result of an interrupted conversion is lost */
+			conv = CMD_CVRT_PRESS | CVRT_OSR_4096;
+			if (ms5611_convStart(ctx, conv) == 0) {
+				gettime(&start, NULL);
 			}
 			continue;
 		}
 
-		gettime(&now, NULL);
+		gettime(&start, NULL);
+
+		if ((conv & CMD_CVRT_TEMP) == CMD_CVRT_TEMP) {
+			D2 = adc;
+			conv = next;
 
-		/* Read temperature. Does not repeat failed read - fall back to old temperature */
-		if (ms5611_measure(ctx, (CMD_CVRT_TEMP | CVRT_OSR_1024), OSR_1024_SLEEP, &D2) == 0) {
 			/* Translate temperature */
 			dT = (int32_t)D2 - (((int32_t)ctx->prom[5]) << 8);  /* dT = D2 - C5 * 2^8 */
 			temp = 2000 + ((dT * (int64_t)ctx->prom[6]) >> 23); /* TEMP = 2000 + dT * C6 / 2^23 */
+			continue;
 		}
 
+		D1 = adc;
+		conv = next;
+
 		/* Translate press */
 		off = ((int64_t)ctx->prom[2] << 16) + ((dT * (int64_t)ctx->prom[4]) >> 7);  /* OFF = C2 * 2^16 + (C4 * dT) / 2^7 */
 		sens = ((int64_t)ctx->prom[1] << 15) + ((dT * (int64_t)ctx->prom[3]) >> 8); /* SENS = C1 * 2^15 + (C4 * dT) / 2^8 */
@@ -184,7 +237,7 @@ static void ms5611_publishthr(void *data)
 
 		/* MS5611 operating ranges: temperature from -40C to +80C, and pressure: 45000Pa, 110000 Pa */
 		if (press > 45000 && press < 120000 && temp > -4000 && temp < 8500) {
-			ctx->evtBaro.timestamp = now;
+			ctx->evtBaro.timestamp = start;
 			ctx->evtBaro.baro.pressure = press;
 			ctx->evtBaro.baro.temp = (temp + 27315 + 50) / 100;
 
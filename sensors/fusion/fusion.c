@@ -0,0 +1,414 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Sensor fusion of IMU, magnetometer and barometer events
+ * published as SENSOR_TYPE_SENSEKF at IMU rate
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/threads.h>
+
+#include "../sensors.h"
+
+
+#define FUSION_NAME "fusion"
+
+#define FUSION_ANY ((unsigned int)-1) /* source device not selected, the first publishing one is used */
+
+#define FUSION_G       9.80665f
+#define FUSION_KP      0.5f    /* attitude correction gain [1/s] */
+#define FUSION_KP_INIT 10.0f   /* attitude correction gain until FUSION_INIT_US passes */
+#define FUSION_KI      0.02f   /* gyro bias estimation gain [1/s^2] */
+#define FUSION_INIT_US 2000000 /* fast attitude alignment after start [us] */
+#define FUSION_DT_MAX  100000  /* longer IMU gap restarts integration [us] */
+#define FUSION_ALT_K1  0.05f   /* altitude correction gain per barometer sample */
+#define FUSION_ALT_K2  0.01f   /* vertical velocity correction gain per barometer sample [1/s] */
+#define FUSION_VEL_K   0.2f    /* horizontal velocity correction gain per GPS sample */
+
+
+typedef struct {
+	handle_t lock;
+
+	/* Source devices */
+	unsigned int imuId;
+	unsigned int magId;
+	unsigned int baroId;
+	unsigned int gpsId;
+
+	/* Latest inputs */
+	float accel[3]; /* specific force in body frame [m/s^2] */
+	float mag[3];   /* field direction in body frame */
+	float baroAlt;  /* altitude relative to the first barometer sample [m] */
+	float gpsVel[3];
+	float p0;
+	uint32_t press;
+	uint32_t temp;
+	uint8_t accelValid;
+	uint8_t magValid;
+	uint8_t baroNew;
+	uint8_t gpsNew;
+
+	/* State, ENU earth frame */
+	float q[4];    /* body to earth rotation */
+	float bias[3]; /* gyro bias correction [rad/s] */
+	float pos[3];
+	float vel[3];
+	int status;
+	time_t start;
+	time_t last;
+
+	sensor_event_t evt;
+} fusion_ctx_t;
+
+
+/* Claims the source device on its first event, returns 1 if event comes from the source */
+static int fusion_isSource(unsigned int *src, unsigned int devId)
+{
+	if (*src == FUSION_ANY) {
+		*src = devId;
+	}
+
+	return (*src == devId) ? 1 : 0;
+}
+
+
+static void fusion_normalize(float *v, unsigned int n)
+{
+	float norm = 0.0f;
+	unsigned int i;
+
+	for (i = 0; i < n; ++i) {
+		norm += v[i] * v[i];
+	}
+
+	if (norm > 0.0f) {
+		norm = 1.0f / sqrtf(norm);
+		for (i = 0; i < n; ++i) {
+			v[i] *= norm;
+		}
+	}
+}
+
+
+/* out = R(q) * v, rotation from body to earth frame */
+static void fusion_toEarth(const float *q, const float *v, float *out)
+{
+	out[0] = (1.0f - 2.0f * (q[2] * q[2] + q[3] * q[3])) * v[0] + 2.0f * (q[1] * q[2] - q[0] * q[3]) * v[1] + 2.0f * (q[1] * q[3] + q[0] * q[2]) * v[2];
+	out[1] = 2.0f * (q[1] * q[2] + q[0] * q[3]) * v[0] + (1.0f - 2.0f * (q[1] * q[1] + q[3] * q[3])) * v[1] + 2.0f * (q[2] * q[3] - q[0] * q[1]) * v[2];
+	out[2] = 2.0f * (q[1] * q[3] - q[0] * q[2]) * v[0] + 2.0f * (q[2] * q[3] + q[0] * q[1]) * v[1] + (1.0f - 2.0f * (q[1] * q[1] + q[2] * q[2])) * v[2];
+}
+
+
+/* out = R(q)^T * v, rotation from earth to body frame */
+static void fusion_toBody(const float *q, const float *v, float *out)
+{
+	out[0] = (1.0f - 2.0f * (q[2] * q[2] + q[3] * q[3])) * v[0] + 2.0f * (q[1] * q[2] + q[0] * q[3]) * v[1] + 2.0f * (q[1] * q[3] - q[0] * q[2]) * v[2];
+	out[1] = 2.0f * (q[1] * q[2] - q[0] * q[3]) * v[0] + (1.0f - 2.0f * (q[1] * q[1] + q[3] * q[3])) * v[1] + 2.0f * (q[2] * q[3] + q[0] * q[1]) * v[2];
+	out[2] = 2.0f * (q[1] * q[3] + q[0] * q[2]) * v[0] + 2.0f * (q[2] * q[3] - q[0] * q[1]) * v[1] + (1.0f - 2.0f * (q[1] * q[1] + q[2] * q[2])) * v[2];
+}
+
+
+static void fusion_cross(const float *a, const float *b, float *out)
+{
+	out[0] = a[1] * b[2] - a[2] * b[1];
+	out[1] = a[2] * b[0] - a[0] * b[2];
+	out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+
+/* Complementary (Mahony) attitude filter step, w - body rates [rad/s] corrected in place */
+static void fusion_attitude(fusion_ctx_t *ctx, float *w, float dt, time_t now)
+{
+	static const float up[3] = { 0.0f, 0.0f, 1.0f };
+	float a[3], m[3], v[3], h[3], e[3] = { 0.0f, 0.0f, 0.0f }, t[3], dq[4];
+	float kp = ((now - ctx->start) < FUSION_INIT_US) ? FUSION_KP_INIT : FUSION_KP;
+	float *q = ctx->q;
+	unsigned int i;
+
+	if (ctx->accelValid != 0) {
+		/* Measured and estimated up direction */
+		memcpy(a, ctx->accel, sizeof(a));
+		fusion_normalize(a, 3);
+		fusion_toBody(q, up, v);
+		fusion_cross(a, v, e);
+		ctx->status |= SENSEKF_STATUS_ATTITUDE;
+	}
+
+	if (ctx->magValid != 0) {
+		/* Horizontal field projected onto north (earth y axis) */
+		memcpy(m, ctx->mag, sizeof(m));
+		fusion_normalize(m, 3);
+		fusion_toEarth(q, m, h);
+		h[1] = sqrtf(h[0] * h[0] + h[1] * h[1]);
+		h[0] = 0.0f;
+		fusion_toBody(q, h, v);
+		fusion_cross(m, v, t);
+		for (i = 0; i < 3; ++i) {
+			e[i] += t[i];
+		}
+		ctx->status |= SENSEKF_STATUS_HEADING;
+	}
+
+	for (i = 0; i < 3; ++i) {
+		ctx->bias[i] += FUSION_KI * e[i] * dt;
+		w[i] += kp * e[i] + ctx->bias[i];
+	}
+
+	/* q += 0.5 * q x (0, w) * dt */
+	dq[0] = -q[1] * w[0] - q[2] * w[1] - q[3] * w[2];
+	dq[1] = q[0] * w[0] + q[2] * w[2] - q[3] * w[1];
+	dq[2] = q[0] * w[1] - q[1] * w[2] + q[3] * w[0];
+	dq[3] = q[0] * w[2] + q[1] * w[1] - q[2] * w[0];
+	for (i = 0; i < 4; ++i) {
+		q[i] += 0.5f * dq[i] * dt;
+	}
+	fusion_normalize(q, 4);
+}
+
+
+/* Integrates earth frame acceleration, corrected by barometer altitude and GPS velocity */
+static void fusion_navigation(fusion_ctx_t *ctx, float *acc, float dt)
+{
+	float err;
+	unsigned int i;
+
+	fusion_toEarth(ctx->q, ctx->accel, acc);
+	acc[2] -= FUSION_G;
+
+	for (i = 0; i < 3; ++i) {
+		ctx->pos[i] += ctx->vel[i] * dt + 0.5f * acc[i] * dt * dt;
+		ctx->vel[i] += acc[i] * dt;
+	}
+
+	if (ctx->baroNew != 0) {
+		err = ctx->baroAlt - ctx->pos[2];
+		ctx->pos[2] += FUSION_ALT_K1 * err;
+		ctx->vel[2] += FUSION_ALT_K2 * err;
+		ctx->baroNew = 0;
+		ctx->status |= SENSEKF_STATUS_ALTITUDE;
+	}
+
+	if (ctx->gpsNew != 0) {
+		for (i = 0; i < 3; ++i) {
+			ctx->vel[i] += FUSION_VEL_K * (ctx->gpsVel[i] - ctx->vel[i]);
+		}
+		ctx->gpsNew = 0;
+		ctx->status |= SENSEKF_STATUS_VELOCITY;
+	}
+}
+
+
+static void fusion_fill(fusion_ctx_t *ctx, unsigned int devId, const float *w, const float *acc, time_t now)
+{
+	sensEkf_data_t *out = &ctx->evt.sensEkf;
+	const float *q = ctx->q;
+	float sinp;
+
+	ctx->evt.type = SENSOR_TYPE_SENSEKF;
+	ctx->evt.timestamp = now;
+
+	out->devId = devId;
+	out->status = ctx->status;
+
+	out->enuX = ctx->pos[0];
+	out->enuY = ctx->pos[1];
+	out->enuZ = ctx->pos[2];
+	out->veloX = ctx->vel[0];
+	out->veloY = ctx->vel[1];
+	out->veloZ = ctx->vel[2];
+
+	sinp = 2.0f * (q[0] * q[2] - q[3] * q[1]);
+	sinp = (sinp > 1.0f) ? 1.0f : ((sinp < -1.0f) ? -1.0f : sinp);
+	out->roll = atan2f(2.0f * (q[0] * q[1] + q[2] * q[3]), 1.0f - 2.0f * (q[1] * q[1] + q[2] * q[2]));
+	out->pitch = asinf(sinp);
+	out->yaw = atan2f(2.0f * (q[0] * q[3] + q[1] * q[2]), 1.0f - 2.0f * (q[2] * q[2] + q[3] * q[3]));
+	out->q0 = q[0];
+	out->q1 = q[1];
+	out->q2 = q[2];
+	out->q3 = q[3];
+
+	out->rollDot = w[0];
+	out->pitchDot = w[1];
+	out->yawDot = w[2];
+
+	out->accelX = acc[0];
+	out->accelY = acc[1];
+	out->accelZ = acc[2];
+	out->accelBiasZ = 0.0f;
+
+	out->pressStat = (float)ctx->press;
+	out->pressTot = 0.0f;
+	out->temp = (float)ctx->temp;
+	out->airspeed = 0.0f;
+
+	out->stateTime = now;
+	out->imuTime = now;
+}
+
+
+static void fusion_step(sensor_info_t *info, fusion_ctx_t *ctx, const gyro_data_t *gyro, time_t now)
+{
+	float w[3], acc[3], dt;
+
+	if ((ctx->last == 0) || (now <= ctx->last) || ((now - ctx->last) > FUSION_DT_MAX)) {
+		if (ctx->start == 0) {
+			ctx->start = now;
+		}
+		ctx->last = now;
+		return;
+	}
+
+	dt = (now - ctx->last) * 1e-6f;
+	ctx->last = now;
+
+	w[0] = gyro->gyroX * 1e-3f;
+	w[1] = gyro->gyroY * 1e-3f;
+	w[2] = gyro->gyroZ * 1e-3f;
+
+	fusion_attitude(ctx, w, dt, now);
+	fusion_navigation(ctx, acc, dt);
+	fusion_fill(ctx, info->id, w, acc, now);
+
+	sensors_publish(info->id, &ctx->evt);
+}
+
+
+static void fusion_consume(sensor_info_t *info, unsigned int devId, const sensor_event_t *event)
+{
+	fusion_ctx_t *ctx = (fusion_ctx_t *)info->ctx;
+
+	mutexLock(ctx->lock);
+
+	switch (event->type) {
+		case SENSOR_TYPE_ACCEL:
+			if (fusion_isSource(&ctx->imuId, devId) != 0) {
+				ctx->accel[0] = event->accels.accelX * 1e-3f;
+				ctx->accel[1] = event->accels.accelY * 1e-3f;
+				ctx->accel[2] = event->accels.accelZ * 1e-3f;
+				ctx->accelValid = 1;
+			}
+			break;
+
+		case SENSOR_TYPE_GYRO:
+			/* Fused state is published at gyro rate */
+			if (fusion_isSource(&ctx->imuId, devId) != 0) {
+				fusion_step(info, ctx, &event->gyro, event->timestamp);
+			}
+			break;
+
+		case SENSOR_TYPE_MAG:
+			if (fusion_isSource(&ctx->magId, devId) != 0) {
+				ctx->mag[0] = event->mag.magX;
+				ctx->mag[1] = event->mag.magY;
+				ctx->mag[2] = event->mag.magZ;
+				ctx->magValid = ((event->mag.magX != 0) || (event->mag.magY != 0) || (event->mag.magZ != 0)) ? 1 : 0;
+			}
+			break;
+
+		case SENSOR_TYPE_BARO:
+			if ((fusion_isSource(&ctx->baroId, devId) != 0) && (event->baro.pressure != 0)) {
+				if (ctx->p0 == 0.0f) {
+					ctx->p0 = event->baro.pressure;
+				}
+				ctx->baroAlt = 44330.0f * (1.0f - powf(event->baro.pressure / ctx->p0, 0.190295f));
+				ctx->press = event->baro.pressure;
+				ctx->temp = event->baro.temp;
+				ctx->baroNew = 1;
+			}
+			break;
+
+		case SENSOR_TYPE_GPS:
+			if ((fusion_isSource(&ctx->gpsId, devId) != 0) && (event->gps.fix != 0)) {
+				ctx->gpsVel[0] = event->gps.velEast * 1e-3f;
+				ctx->gpsVel[1] = event->gps.velNorth * 1e-3f;
+				ctx->gpsVel[2] = -event->gps.velDown * 1e-3f;
+				ctx->gpsNew = 1;
+			}
+			break;
+
+		default:
+			break;
+	}
+
+	mutexUnlock(ctx->lock);
+}
+
+
+static int fusion_start(sensor_info_t *info)
+{
+	(void)info;
+
+	printf("fusion: publishing fused state\n");
+
+	return EOK;
+}
+
+
+/* args: [imu[:mag[:baro[:gps]]]] - source device identifiers, empty - the first publishing device */
+static int fusion_alloc(sensor_info_t *info, const char *args)
+{
+	unsigned int *src[4];
+	fusion_ctx_t *ctx;
+	const char *p = args;
+	char *end;
+	unsigned int i;
+
+	ctx = calloc(1, sizeof(fusion_ctx_t));
+	if (ctx == NULL) {
+		return -ENOMEM;
+	}
+
+	if (mutexCreate(&ctx->lock) < 0) {
+		free(ctx);
+		return -ENOMEM;
+	}
+
+	src[0] = &ctx->imuId;
+	src[1] = &ctx->magId;
+	src[2] = &ctx->baroId;
+	src[3] = &ctx->gpsId;
+
+	for (i = 0; i < sizeof(src) / sizeof(src[0]); ++i) {
+		*src[i] = FUSION_ANY;
+		if ((p != NULL) && (*p != '\0') && (*p != ':')) {
+			*src[i] = strtoul(p, &end, 10);
+			p = end;
+		}
+		if ((p != NULL) && (*p == ':')) {
+			++p;
+		}
+		else {
+			p = NULL;
+		}
+	}
+
+	ctx->q[0] = 1.0f;
+
+	info->ctx = ctx;
+	info->types = SENSOR_TYPE_SENSEKF;
+
+	return EOK;
+}
+
+
+void __attribute__((constructor)) fusion_register(void)
+{
+	static sensor_drv_t sensor = {
+		.name = FUSION_NAME,
+		.alloc = fusion_alloc,
+		.start = fusion_start,
+		.consume = fusion_consume,
+	};
+
+	sensors_register(&sensor);
+}
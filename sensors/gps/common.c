@@ -23,12 +23,26 @@
 #include "../sensors.h"
 #include "common.h"
 #include "nmea.h"
+#include "ubx.h"
 
 
 #define DEG2RAD     0.0174532925
 #define DEG2MILIRAD 17.4532925 /* 1 degree -> 1 milliradian conversion parameter */
 #define KMH2MMS     277.7778   /* 1 km/h -> mm/s conversion parameter */
 
+/* UBX messages payload length */
+#define UBX_NAV_PVT_LEN 92
+#define UBX_NAV_DOP_LEN 18
+
+/* UBX-NAV-PVT flags */
+#define UBX_PVT_GNSSFIXOK 0x01
+#define UBX_PVT_DIFFSOLN  0x02
+#define UBX_PVT_CARRSOLN  0xc0
+
+
+enum { parser_sync, parser_nmeaAddr, parser_nmeaBody, parser_nmeaCk1, parser_nmeaCk2,
+	parser_ubxSync, parser_ubxCls, parser_ubxId, parser_ubxLen1, parser_ubxLen2, parser_ubxPayload, parser_ubxCk1, parser_ubxCk2 };
+
 
 /*
 * Sets correct termios parameters for gps device under `fd` with baudrate specified with `baud`.
@@ -158,6 +172,243 @@ int gps_recv(int fd, gps_receiver_t *rcv)
 }
 
 
+static inline uint32_t gps_le32(const char *p)
+{
+	const uint8_t *b = (const uint8_t *)p;
+
+	return (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+
+static inline uint16_t gps_le16(const char *p)
+{
+	const uint8_t *b = (const uint8_t *)p;
+
+	return (uint16_t)b[0] | ((uint16_t)b[1] << 8);
+}
+
+
+/* Decodes UBX-NAV-PVT payload directly from the parser buffer */
+static void gps_ubxNavPvt(const char *pvt, sensor_event_t *evtGps)
+{
+	uint8_t flags = pvt[21];
+	int32_t headMot;
+
+	if ((flags & UBX_PVT_GNSSFIXOK) == 0) {
+		evtGps->gps.fix = gga_fix_invalid;
+	}
+	else if ((flags & UBX_PVT_CARRSOLN) != 0) {
+		evtGps->gps.fix = gga_fix_rtkinematic;
+	}
+	else {
+		evtGps->gps.fix = ((flags & UBX_PVT_DIFFSOLN) != 0) ? gga_fix_dpgs : gga_fix_gnss;
+	}
+
+	/* same hhmmss.ssssss representation as GPGGA */
+	evtGps->gps.utc = ((uint64_t)pvt[8] * 10000 + (uint64_t)pvt[9] * 100 + (uint64_t)pvt[10]) * 1000000 + (int32_t)gps_le32(&pvt[16]) / 1000;
+	evtGps->gps.satsNb = pvt[23];
+	evtGps->gps.lon = (int64_t)(int32_t)gps_le32(&pvt[24]) * 100; /* 1e-7 deg -> 1e-9 deg */
+	evtGps->gps.lat = (int64_t)(int32_t)gps_le32(&pvt[28]) * 100;
+	evtGps->gps.altEllipsoid = gps_le32(&pvt[32]);
+	evtGps->gps.alt = gps_le32(&pvt[36]);
+	evtGps->gps.eph = gps_le32(&pvt[40]);
+	evtGps->gps.epv = gps_le32(&pvt[44]);
+	evtGps->gps.velNorth = gps_le32(&pvt[48]);
+	evtGps->gps.velEast = gps_le32(&pvt[52]);
+	evtGps->gps.velDown = gps_le32(&pvt[56]);
+	evtGps->gps.groundSpeed = gps_le32(&pvt[60]);
+	evtGps->gps.evel = gps_le32(&pvt[68]);
+
+	/* 1e-5 deg -> mrad */
+	headMot = gps_le32(&pvt[64]);
+	evtGps->gps.heading = headMot * (DEG2MILIRAD / 100000);
+
+	gettime(&evtGps->timestamp, NULL);
+}
+
+
+static void gps_ubxNavDop(const char *dop, sensor_event_t *evtGps)
+{
+	evtGps->gps.vdop = gps_le16(&dop[10]);
+	evtGps->gps.hdop = gps_le16(&dop[12]);
+}
+
+
+static inline int gps_hex(char c)
+{
+	if ((c >= '0') && (c <= '9')) {
+		return c - '0';
+	}
+	else if ((c >= 'A') && (c <= 'F')) {
+		return c - 'A' + 10;
+	}
+	else if ((c >= 'a') && (c <= 'f')) {
+		return c - 'a' + 10;
+	}
+
+	return -1;
+}
+
+
+static inline void gps_ubxCk(gps_parser_t *p, uint8_t c)
+{
+	p->ck[0] += c;
+	p->ck[1] += p->ck[0];
+}
+
+
+void gps_parserInit(gps_parser_t *p)
+{
+	p->state = parser_sync;
+	p->len = 0;
+	p->dop = 0;
+}
+
+
+int gps_parse(gps_parser_t *p, const void *data, size_t len, sensor_event_t *evtGps, float posStdev, float velStdev)
+{
+	const uint8_t *b = data;
+	nmea_t message;
+	int update = 0, val;
+	uint8_t c;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		c = b[i];
+
+		/* NMEA start character can't occur inside of an NMEA sentence, resynchronize */
+		if ((c == '$') && (p->state <= parser_nmeaCk2)) {
+			p->state = parser_nmeaAddr;
+			p->buf[0] = '$';
+			p->len = 1;
+			p->ck[0] = 0;
+			continue;
+		}
+
+		switch (p->state) {
+			case parser_sync:
+				if (c == UBX_SYNC1) {
+					p->state = parser_ubxSync;
+				}
+				break;
+
+			case parser_nmeaAddr:
+				p->buf[p->len++] = c;
+				p->ck[0] ^= c;
+				if (p->len == 7) {
+					/* Address field complete, skip sentences which are not interpreted */
+					p->state = ((c == ',') && (nmea_type(&p->buf[1]) != nmea_unknown)) ? parser_nmeaBody : parser_sync;
+				}
+				break;
+
+			case parser_nmeaBody:
+				if (c == '*') {
+					p->state = parser_nmeaCk1;
+				}
+				else if ((c < 0x20) || (p->len >= sizeof(p->buf) - 1)) {
+					p->state = parser_sync;
+				}
+				else {
+					p->buf[p->len++] = c;
+					p->ck[0] ^= c;
+				}
+				break;
+
+			case parser_nmeaCk1:
+				val = gps_hex(c);
+				p->rxCk = val << 4;
+				p->state = (val < 0) ? parser_sync : parser_nmeaCk2;
+				break;
+
+			case parser_nmeaCk2:
+				val = gps_hex(c);
+				p->state = parser_sync;
+				if ((val >= 0) && ((p->rxCk | val) == p->ck[0])) {
+					p->buf[p->len] = '\0';
+					nmea_interpreter(p->buf, &message);
+					update |= gps_updateEvt(&message, evtGps, posStdev, velStdev);
+				}
+				break;
+
+			case parser_ubxSync:
+				p->state = (c == UBX_SYNC2) ? parser_ubxCls : parser_sync;
+				p->ck[0] = 0;
+				p->ck[1] = 0;
+				break;
+
+			case parser_ubxCls:
+				p->cls = c;
+				gps_ubxCk(p, c);
+				p->state = parser_ubxId;
+				break;
+
+			case parser_ubxId:
+				p->id = c;
+				gps_ubxCk(p, c);
+				p->state = parser_ubxLen1;
+				break;
+
+			case parser_ubxLen1:
+				p->need = c;
+				gps_ubxCk(p, c);
+				p->state = parser_ubxLen2;
+				break;
+
+			case parser_ubxLen2:
+				p->need |= (size_t)c << 8;
+				gps_ubxCk(p, c);
+				p->len = 0;
+				p->keep = ((p->cls == UBX_CLS_NAV) &&
+						  (((p->id == UBX_ID_NAV_PVT) && (p->need == UBX_NAV_PVT_LEN)) || ((p->id == UBX_ID_NAV_DOP) && (p->need == UBX_NAV_DOP_LEN)))) ? 1 : 0;
+				p->state = (p->need == 0) ? parser_ubxCk1 : parser_ubxPayload;
+				break;
+
+			case parser_ubxPayload:
+				/* Payloads of other messages are only checksummed */
+				if (p->keep != 0) {
+					p->buf[p->len] = c;
+				}
+				gps_ubxCk(p, c);
+				if (++p->len == p->need) {
+					p->state = parser_ubxCk1;
+				}
+				break;
+
+			case parser_ubxCk1:
+				p->state = (c == p->ck[0]) ? parser_ubxCk2 : parser_sync;
+				break;
+
+			case parser_ubxCk2:
+				p->state = parser_sync;
+				if ((c != p->ck[1]) || (p->keep == 0)) {
+					break;
+				}
+
+				if (p->id == UBX_ID_NAV_PVT) {
+					gps_ubxNavPvt(p->buf, evtGps);
+
+					/* PVT carries position DOP only, use it until NAV-DOP is received */
+					if (p->dop == 0) {
+						evtGps->gps.hdop = gps_le16(&p->buf[76]);
+					}
+				}
+				else {
+					gps_ubxNavDop(p->buf, evtGps);
+					p->dop = 1;
+				}
+				update = 1;
+				break;
+
+			default:
+				p->state = parser_sync;
+				break;
+		}
+	}
+
+	return update;
+}
+
+
 /* Returns 1 if `gpsEvt` was updated with data from `message`. Otherwise returns 0. */
 int gps_updateEvt(nmea_t *message, sensor_event_t *evtGps, float posStdev, float velStdev)
 {
@@ -16,6 +16,7 @@
 #define _GPS_COMMON_H_
 
 
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <termios.h>
@@ -47,6 +48,36 @@ typedef struct {
 } gps_receiver_t;
 
 
+/* NMEA sentence is no longer than 82 characters, UBX-NAV-PVT payload is 92 bytes */
+#define GPS_PARSER_BUFSZ 96
+
+
+/* Byte stream parser state, only interpreted messages are buffered */
+typedef struct {
+	int state;
+	uint8_t ck[2];  /* NMEA checksum in ck[0], UBX Fletcher checksum */
+	uint8_t rxCk;   /* received NMEA checksum */
+	uint8_t cls;    /* UBX message class */
+	uint8_t id;     /* UBX message id */
+	int keep;       /* UBX payload is buffered */
+	int dop;        /* UBX-NAV-DOP has been received */
+	size_t len;     /* bytes buffered (NMEA) or UBX payload bytes received */
+	size_t need;    /* UBX payload length */
+	char buf[GPS_PARSER_BUFSZ];
+} gps_parser_t;
+
+
+/* Resets byte stream parser */
+void gps_parserInit(gps_parser_t *p);
+
+
+/*
+ * Feeds `len` bytes of receiver output to the parser. NMEA and UBX checksums are computed on the fly and
+ * sentences which are not interpreted are skipped without buffering. Returns 1 if `gpsEvt` was updated.
+ */
+int gps_parse(gps_parser_t *p, const void *data, size_t len, sensor_event_t *evtGps, float posStdev, float velStdev);
+
+
 /*
 * Sets correct termios parameters for gps device under `fd` with baudrate specified with `baud`.
 * Original termios structure read from `fd` is copied to `backup` (if it is not NULL).
@@ -266,21 +266,51 @@ static void nmea_parsermc(char *str, nmea_t *out)
 }
 
 
-void nmea_interpreter(char *str, nmea_t *out)
+int nmea_type(const char *addr)
 {
-	if (strncmp(str, "$GPGSA", 6) == 0) {
-		nmea_parsegsa(str, out);
+	/* multi-constellation receivers use GN (combined), GL, GA, GB talkers */
+	if ((addr[0] != 'G') || (addr[1] < 'A') || (addr[1] > 'Z')) {
+		return nmea_unknown;
+	}
+
+	if (strncmp(addr + 2, "GSA", 3) == 0) {
+		return nmea_gsa;
 	}
-	else if (strncmp(str, "$GPVTG", 6) == 0) {
-		nmea_parsevtg(str, out);
+	else if (strncmp(addr + 2, "VTG", 3) == 0) {
+		return nmea_vtg;
 	}
-	else if (strncmp(str, "$GPGGA", 6) == 0) {
-		nmea_parsegga(str, out);
+	else if (strncmp(addr + 2, "GGA", 3) == 0) {
+		return nmea_gga;
 	}
-	else if (strncmp(str, "$GPRMC", 6) == 0) {
-		nmea_parsermc(str, out);
+	else if (strncmp(addr + 2, "RMC", 3) == 0) {
+		return nmea_rmc;
 	}
-	else {
-		out->type = nmea_unknown;
+
+	return nmea_unknown;
+}
+
+
+void nmea_interpreter(char *str, nmea_t *out)
+{
+	switch ((str[0] == '$') ? nmea_type(str + 1) : nmea_unknown) {
+		case nmea_gsa:
+			nmea_parsegsa(str, out);
+			break;
+
+		case nmea_vtg:
+			nmea_parsevtg(str, out);
+			break;
+
+		case nmea_gga:
+			nmea_parsegga(str, out);
+			break;
+
+		case nmea_rmc:
+			nmea_parsermc(str, out);
+			break;
+
+		default:
+			out->type = nmea_unknown;
+			break;
 	}
 }
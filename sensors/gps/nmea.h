@@ -98,6 +98,10 @@ typedef struct {
 } nmea_t;
 
 
+/* returns type of sentence with address field `addr` (talker and formatter, without '$'), any talker is accepted */
+extern int nmea_type(const char *addr);
+
+
 /* interpret one line of gps output into nmea message */
 extern void nmea_interpreter(char *str, nmea_t *out);
 
@@ -44,7 +44,8 @@
 typedef struct {
 	sensor_event_t evtGps;
 	int filedes;
-	gps_receiver_t receiver;
+	gps_receiver_t receiver; /* used for configuration */
+	gps_parser_t parser;
 	char stack[1024] __attribute__((aligned(8)));
 } pa6h_ctx_t;
 
@@ -165,19 +166,19 @@ static void pa6h_threadPublish(void *data)
 	sensor_info_t *info = (sensor_info_t *)data;
 	struct __errno_t errnoNew;
 	pa6h_ctx_t *ctx = info->ctx;
-	nmea_t message;
-	unsigned int i, inbocCap, update;
+	unsigned int update;
+	ssize_t len;
 
 	/* errno is currently not thread-safe. Rediricting to local errno structure */
 	_errno_new(&errnoNew);
 
-	while (1) {
-		inbocCap = gps_recv(ctx->filedes, &ctx->receiver);
+	gps_parserInit(&ctx->parser);
 
+	while (1) {
+		/* Drain the nonblocking tty, the receiver buffer serves as a read buffer */
 		update = 0;
-		for (i = 0; i < inbocCap; i++) {
-			nmea_interpreter(ctx->receiver.inbox[i].msg, &message);
-			update |= gps_updateEvt(&message, &ctx->evtGps, PA6H_POS_ACCURACY, PA6H_VEL_ACCURACY);
+		while ((len = read(ctx->filedes, ctx->receiver.buf, ctx->receiver.bufSz)) > 0) {
+			update |= gps_parse(&ctx->parser, ctx->receiver.buf, len, &ctx->evtGps, PA6H_POS_ACCURACY, PA6H_VEL_ACCURACY);
 		}
 
 		if (update != 0) {
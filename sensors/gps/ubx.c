@@ -36,14 +36,35 @@
 #define UBX_POS_ACCURACY 2.547f
 #define UBX_VEL_ACCURACY 0.0849f
 
-#define REC_BUF_SZ 1024
-#define INBOX_SIZE 3
+#define REC_BUF_SZ 256
+
+/* Configure receiver to binary UBX output with NAV-PVT only, otherwise NMEA GGA/GSA/VTG are used */
+#ifndef UBX_NAV_PVT
+#define UBX_NAV_PVT 1
+#endif
+
+/* Defaults of binary mode, overridable with arguments */
+#define UBX_DEFAULT_RATE 10     /* [Hz] */
+#define UBX_DEFAULT_BAUD 115200
+#define UBX_MAX_RATE     25
+
+
+static const struct {
+	unsigned int baud;
+	speed_t speed;
+} ubx_bauds[] = {
+	{ 9600, B9600 }, { 19200, B19200 }, { 38400, B38400 }, { 57600, B57600 }, { 115200, B115200 }, { 230400, B230400 }, { 460800, B460800 }
+};
 
 
 typedef struct {
 	sensor_event_t evtGps;
 	int filedes;
-	gps_receiver_t receiver;
+	unsigned int rate; /* navigation solution rate [Hz] */
+	unsigned int baud;
+	int dop;           /* NAV-DOP output enabled */
+	gps_parser_t parser;
+	uint8_t buf[REC_BUF_SZ];
 	char stack[2048] __attribute__((aligned(8)));
 } ubx_ctx_t;
 
@@ -53,22 +74,20 @@ static void ubx_threadPublish(void *data)
 	sensor_info_t *info = (sensor_info_t *)data;
 	struct __errno_t errnoNew;
 	ubx_ctx_t *ctx = info->ctx;
-	nmea_t message;
-	unsigned int i, inbocCap, update;
+	ssize_t len;
 
 	/* Redirecting errno to keep backward compatibility (in case of errno not working correctly) */
 	_errno_new(&errnoNew);
 
-	while (1) {
-		inbocCap = gps_recv(ctx->filedes, &ctx->receiver);
+	gps_parserInit(&ctx->parser);
 
-		update = 0;
-		for (i = 0; i < inbocCap; i++) {
-			nmea_interpreter(ctx->receiver.inbox[i].msg, &message);
-			update |= gps_updateEvt(&message, &ctx->evtGps, UBX_POS_ACCURACY, UBX_VEL_ACCURACY);
+	while (1) {
+		len = read(ctx->filedes, ctx->buf, sizeof(ctx->buf));
+		if (len <= 0) {
+			continue;
 		}
 
-		if (update != 0) {
+		if (gps_parse(&ctx->parser, ctx->buf, len, &ctx->evtGps, UBX_POS_ACCURACY, UBX_VEL_ACCURACY) != 0) {
 			sensors_publish(info->id, &ctx->evtGps);
 		}
 	}
@@ -95,23 +114,120 @@ static int ubx_start(sensor_info_t *info)
 }
 
 
-static int ubx_parse(const char *args, const char **path)
+static speed_t ubx_speed(unsigned int baud)
 {
-	int err = EOK;
+	unsigned int i;
 
-	if (!(args == NULL || strchr(args, ':'))) {
-		*path = args;
+	for (i = 0; i < sizeof(ubx_bauds) / sizeof(ubx_bauds[0]); i++) {
+		if (ubx_bauds[i].baud == baud) {
+			return ubx_bauds[i].speed;
+		}
 	}
-	else {
+
+	return B0;
+}
+
+
+/* Arguments: path[:rate[:baud[:dop]]] */
+static int ubx_parse(const char *args, const char **path, ubx_ctx_t *ctx)
+{
+	char *opt;
+
+	ctx->rate = UBX_DEFAULT_RATE;
+	ctx->baud = UBX_DEFAULT_BAUD;
+	ctx->dop = 0;
+
+	if ((args == NULL) || (args[0] == '\0') || (args[0] == ':')) {
 		fprintf(
 			stderr,
 			"%s Wrong arguments\n"
-			"Please specify the path to source device instance, for example: /dev/uart0\n",
+			"Please specify the path to source device instance, for example: /dev/uart0[:rate[:baud[:dop]]]\n",
 			ubx_STR);
-		err = -EINVAL;
+		return -EINVAL;
 	}
+	*path = args;
 
-	return err;
+	opt = strchr(args, ':');
+	if (opt != NULL) {
+		*(opt++) = '\0';
+		ctx->rate = strtoul(opt, &opt, 10);
+
+		if (*opt == ':') {
+			ctx->baud = strtoul(opt + 1, &opt, 10);
+		}
+
+		if (*opt == ':') {
+			ctx->dop = (strcmp(opt + 1, "dop") == 0) ? 1 : 0;
+		}
+	}
+
+	if ((ctx->rate == 0) || (ctx->rate > UBX_MAX_RATE) || (ubx_speed(ctx->baud) == B0)) {
+		fprintf(stderr, "%s Wrong rate %u or baud %u\n", ubx_STR, ctx->rate, ctx->baud);
+		return -EINVAL;
+	}
+
+	return EOK;
+}
+
+
+static void ubx_send(int fd, uint8_t cls, uint8_t id, const uint8_t *payload, uint16_t len)
+{
+	uint8_t frame[32];
+	uint8_t cka = 0, ckb = 0;
+	size_t i, n;
+
+	if (len > sizeof(frame) - 8) {
+		return;
+	}
+
+	frame[0] = UBX_SYNC1;
+	frame[1] = UBX_SYNC2;
+	frame[2] = cls;
+	frame[3] = id;
+	frame[4] = len & 0xff;
+	frame[5] = len >> 8;
+	memcpy(&frame[6], payload, len);
+	n = 6 + len;
+
+	for (i = 2; i < n; i++) {
+		cka += frame[i];
+		ckb += cka;
+	}
+	frame[n++] = cka;
+	frame[n++] = ckb;
+
+	write(fd, frame, n);
+	tcdrain(fd);
+}
+
+
+static void ubx_cfgPrt(ubx_ctx_t *ctx)
+{
+	/* UART1, 8N1, UBX and NMEA in, UBX only out */
+	const uint8_t prt[20] = {
+		UBX_PRT_UART1, 0, 0, 0,
+		UBX_PRT_MODE_8N1 & 0xff, (UBX_PRT_MODE_8N1 >> 8) & 0xff, 0, 0,
+		ctx->baud & 0xff, (ctx->baud >> 8) & 0xff, (ctx->baud >> 16) & 0xff, (ctx->baud >> 24) & 0xff,
+		UBX_PRT_PROTO_UBX | UBX_PRT_PROTO_NMEA, 0,
+		UBX_PRT_PROTO_UBX, 0,
+		0, 0, 0, 0
+	};
+
+	ubx_send(ctx->filedes, UBX_CLS_CFG, UBX_ID_CFG_PRT, prt, sizeof(prt));
+}
+
+
+static void ubx_cfgOutput(ubx_ctx_t *ctx)
+{
+	const uint16_t measRate = 1000 / ctx->rate;
+	const uint8_t pvt[3] = { UBX_CLS_NAV, UBX_ID_NAV_PVT, 1 };
+	const uint8_t dop[3] = { UBX_CLS_NAV, UBX_ID_NAV_DOP, (ctx->dop != 0) ? 1 : 0 };
+	const uint8_t rate[6] = { measRate & 0xff, measRate >> 8, 1, 0, 1, 0 }; /* navRate 1, GPS time reference */
+
+	/* Message rates in the 3-byte form apply to the port the command was received on */
+	ubx_send(ctx->filedes, UBX_CLS_CFG, UBX_ID_CFG_MSG, pvt, sizeof(pvt));
+	ubx_send(ctx->filedes, UBX_CLS_CFG, UBX_ID_CFG_MSG, dop, sizeof(dop));
+	ubx_send(ctx->filedes, UBX_CLS_CFG, UBX_ID_CFG_RATE, rate, sizeof(rate));
 }
 
 
@@ -129,19 +245,12 @@ static int ubx_alloc(sensor_info_t *info, const char *args)
 
 	info->types = SENSOR_TYPE_GPS;
 
-	err = ubx_parse(args, &path);
+	err = ubx_parse(args, &path, ctx);
 	if (err != EOK) {
 		free(ctx);
 		return err;
 	}
 
-	/* Preparing receiver */
-	err = gps_recvInit(&ctx->receiver, REC_BUF_SZ, INBOX_SIZE);
-	if (err < 0) {
-		free(ctx);
-		return -1;
-	}
-
 	/* Opening serial device */
 	do {
 		ctx->filedes = open(path, O_RDWR | O_NOCTTY);
@@ -153,7 +262,6 @@ static int ubx_alloc(sensor_info_t *info, const char *args)
 			if (cnt > 10000) {
 				fprintf(stderr, "%s Can't open %s: %s\n", ubx_STR, path, strerror(errno));
 				err = -errno;
-				gps_recvDone(&ctx->receiver);
 				free(ctx);
 				return err;
 			}
@@ -163,7 +271,6 @@ static int ubx_alloc(sensor_info_t *info, const char *args)
 	if (isatty(ctx->filedes) != 1) {
 		fprintf(stderr, "%s %s not a tty\n", ubx_STR, path);
 		close(ctx->filedes);
-		gps_recvDone(&ctx->receiver);
 		free(ctx);
 		return -1;
 	}
@@ -172,12 +279,28 @@ static int ubx_alloc(sensor_info_t *info, const char *args)
 	if (gps_serialSetup(ctx->filedes, B9600, &termBackup) < 0) {
 		fprintf(stderr, "%s cannot set baud %d\n", ubx_STR, 9600);
 		close(ctx->filedes);
-		gps_recvDone(&ctx->receiver);
 		free(ctx);
 		return -1;
 	}
 	usleep(100 * 1000);
 
+#if UBX_NAV_PVT
+	/* Binary output at requested baudrate, sent again after the switch in case receiver already used it */
+	ubx_cfgPrt(ctx);
+	usleep(100 * 1000);
+
+	if (gps_serialSetup(ctx->filedes, ubx_speed(ctx->baud), NULL) < 0) {
+		fprintf(stderr, "%s cannot set baud %u\n", ubx_STR, ctx->baud);
+		close(ctx->filedes);
+		free(ctx);
+		return -1;
+	}
+	usleep(100 * 1000);
+
+	ubx_cfgPrt(ctx);
+	ubx_cfgOutput(ctx);
+	usleep(100 * 1000);
+#else
 	/* baudrate setting to 115200 */
 	write(ctx->filedes, UBX_PREMADE_BAUD_115200, sizeof(UBX_PREMADE_BAUD_115200));
 	usleep(100 * 1000);
@@ -186,7 +309,6 @@ static int ubx_alloc(sensor_info_t *info, const char *args)
 	if (gps_serialSetup(ctx->filedes, B115200, NULL) < 0) {
 		fprintf(stderr, "%s cannot set baud %d\n", ubx_STR, 115200);
 		close(ctx->filedes);
-		gps_recvDone(&ctx->receiver);
 		free(ctx);
 		return -1;
 	}
@@ -203,6 +325,7 @@ static int ubx_alloc(sensor_info_t *info, const char *args)
 	/* set output rate to 10Hz */
 	write(ctx->filedes, UBX_PREMADE_FIX_10HZ, sizeof(UBX_PREMADE_FIX_10HZ));
 	usleep(100 * 1000);
+#endif
 
 	info->ctx = ctx;
 
@@ -35,4 +35,23 @@
 /* Premade command that sets baudrate to 115200 */
 #define UBX_PREMADE_BAUD_115200 "\xb5\x62\x06\x00\x14\x00\x01\x00\x00\x00\xd0\x08\x00\x00\x00\xc2\x01\x00\x07\x00\x07\x00\x00\x00\x00\x00\xc4\x96\xb5\x62\x06\x00\x01"
 
+/* UBX frame */
+#define UBX_SYNC1 0xb5
+#define UBX_SYNC2 0x62
+
+/* UBX messages class and id */
+#define UBX_CLS_NAV     0x01
+#define UBX_CLS_CFG     0x06
+#define UBX_ID_NAV_DOP  0x04
+#define UBX_ID_NAV_PVT  0x07
+#define UBX_ID_CFG_PRT  0x00
+#define UBX_ID_CFG_MSG  0x01
+#define UBX_ID_CFG_RATE 0x08
+
+/* UBX-CFG-PRT UART settings */
+#define UBX_PRT_UART1      1
+#define UBX_PRT_MODE_8N1   0x000008d0
+#define UBX_PRT_PROTO_UBX  0x0001
+#define UBX_PRT_PROTO_NMEA 0x0002
+
 #endif
@@ -79,6 +79,10 @@
 /* control register 8 */
 #define REG_CTRL_REG8 0x22
 
+/* INT1_A/G pin control */
+#define REG_INT1_CTRL        0x0c
+#define VAL_INT1_CTRL_DRDY_G 0x02
+
 /* control register 9 */
 #define REG_CTRL_REG9         0x23
 #define VAL_CTRL_REK9_I2C_DIS 0x04
@@ -91,20 +95,25 @@
 
 /* sensors data sizes */
 #define SENSOR_OUTPUT_SIZE 6
+#define SENSOR_BURST_SIZE  (REG_DATA_OUT_ACCL + SENSOR_OUTPUT_SIZE - REG_DATA_OUT_TEMP) /* temperature to accelerometer */
 #define GYR_OVERFLOW       26820 /* if gyro returns more than this, the sensorhub result will overflow */
 
 /* conversions */
 #define GYR2000DPS_CONV_MRAD 1.221730475f /* convert gyroscope value (at scale 2000DPS) to mrad/s */
 #define ACC8G_CONV_MG        0.244F       /* convert accelerations (at 8G scale) [m/s^2] */
 #define MG_CONV_MMS2         9.80665f     /* convert milli G to [mm/s^2] */
+#define TEMP_SCALER          16           /* temperature register scaler */
+#define TEMP_OFFSET          298150       /* 25 celsius in millikelvins */
 
 
 typedef struct {
 	spimsg_ctx_t spiCtx;
 	oid_t spiSS;
+	oid_t drdy;
+	int useDrdy;
 	sensor_event_t evtAccel;
 	sensor_event_t evtGyro;
-	char stack[512] __attribute__((aligned(8)));
+	char stack[1024] __attribute__((aligned(8)));
 } lsm9dsxx_ctx_t;
 
 
@@ -126,6 +135,15 @@ static int32_t translateAcc(uint8_t hbyte, uint8_t lbyte)
 }
 
 
+static uint32_t translateTemp(uint8_t hbyte, uint8_t lbyte)
+{
+	/* MISRA incompliant - casting u16 to s16 with no regard to sign */
+	int16_t val = ((uint16_t)hbyte << 8) | (uint16_t)lbyte;
+
+	return (1000 * (int32_t)val) / TEMP_SCALER + TEMP_OFFSET; /* sensor value to [millikelvins] */
+}
+
+
 static int spiWriteReg(lsm9dsxx_ctx_t *ctx, uint8_t regAddr, uint8_t regVal)
 {
 	unsigned char cmd[2] = { (regAddr & 0x7F), regVal }; /* write bit set to regAddr */
@@ -184,10 +202,76 @@ static int lsm9dsxx_hwSetup(lsm9dsxx_ctx_t *ctx)
 	}
 	usleep(1000 * 100);
 
+	/* gyroscope data-ready on INT1_A/G, accelerometer runs at the same ODR */
+	if ((ctx->useDrdy != 0) && (spiWriteReg(ctx, REG_INT1_CTRL, VAL_INT1_CTRL_DRDY_G) < 0)) {
+		return -1;
+	}
+
 	return 0;
 }
 
 
+static void lsm9dsxx_threadDrdy(sensor_info_t *info, lsm9dsxx_ctx_t *ctx, time_t lastGyroTime)
+{
+	uint32_t dAngleX = 0, dAngleY = 0, dAngleZ = 0;
+	int32_t lastGyroX = 0, lastGyroY = 0, lastGyroZ = 0;
+
+	const uint8_t obuf = REG_DATA_OUT_TEMP | SPI_READ_BIT;
+	uint8_t ibuf[SENSOR_BURST_SIZE];
+	const uint8_t *gyro = ibuf + (REG_DATA_OUT_GYRO - REG_DATA_OUT_TEMP);
+	const uint8_t *accl = ibuf + (REG_DATA_OUT_ACCL - REG_DATA_OUT_TEMP);
+	time_t tstamp;
+	float step;
+	int retry = 0;
+
+	for (;;) {
+		/* DRDY stays high until the data is read, so after a failed read don't wait for the next edge */
+		if ((retry == 0) && (sensorsspi_waitDrdy(&ctx->drdy, &tstamp) < 0)) {
+			usleep(1000);
+			continue;
+		}
+
+		/* temperature, gyroscope and accelerometer in one transfer, auto increment is enabled */
+		retry = (sensorsspi_xfer(&ctx->spiCtx, &ctx->spiSS, &obuf, sizeof(obuf), ibuf, sizeof(ibuf), sizeof(obuf)) < 0) ? 1 : 0;
+		if (retry != 0) {
+			continue;
+		}
+
+		ctx->evtAccel.accels.temp = translateTemp(ibuf[1], ibuf[0]);
+		ctx->evtGyro.gyro.temp = ctx->evtAccel.accels.temp;
+
+		/* minus accounts for non right-handness of lsm9dsxx frame of reference */
+		ctx->evtAccel.accels.accelX = -translateAcc(accl[1], accl[0]);
+		ctx->evtAccel.accels.accelY = translateAcc(accl[3], accl[2]);
+		ctx->evtAccel.accels.accelZ = translateAcc(accl[5], accl[4]);
+		ctx->evtAccel.timestamp = tstamp;
+
+		ctx->evtGyro.gyro.gyroX = -translateGyr(gyro[1], gyro[0]);
+		ctx->evtGyro.gyro.gyroY = translateGyr(gyro[3], gyro[2]);
+		ctx->evtGyro.gyro.gyroZ = translateGyr(gyro[5], gyro[4]);
+		ctx->evtGyro.timestamp = tstamp;
+
+		/* Integration of current measurement */
+		step = (tstamp - lastGyroTime) / 2000.f; /* dividing by (1000 * 2) for correct unit and avg. of current and last measurement */
+		dAngleX += (uint32_t)((ctx->evtGyro.gyro.gyroX + lastGyroX) * step);
+		dAngleY += (uint32_t)((ctx->evtGyro.gyro.gyroY + lastGyroY) * step);
+		dAngleZ += (uint32_t)((ctx->evtGyro.gyro.gyroZ + lastGyroZ) * step);
+
+		ctx->evtGyro.gyro.dAngleX = dAngleX;
+		ctx->evtGyro.gyro.dAngleY = dAngleY;
+		ctx->evtGyro.gyro.dAngleZ = dAngleZ;
+
+		lastGyroTime = tstamp;
+		lastGyroX = ctx->evtGyro.gyro.gyroX;
+		lastGyroY = ctx->evtGyro.gyro.gyroY;
+		lastGyroZ = ctx->evtGyro.gyro.gyroZ;
+
+		sensors_publish(info->id, &ctx->evtAccel);
+		sensors_publish(info->id, &ctx->evtGyro);
+	}
+}
+
+
 static void lsm9dsxx_threadPublish(void *data)
 {
 	static uint32_t dAngleX = 0, dAngleY = 0, dAngleZ = 0;
@@ -199,8 +283,11 @@ static void lsm9dsxx_threadPublish(void *data)
 	float step;
 	sensor_info_t *info = (sensor_info_t *)data;
 	lsm9dsxx_ctx_t *ctx = info->ctx;
-	uint8_t ibuf[SENSOR_OUTPUT_SIZE] = { 0 };
-	uint8_t obuf;
+	uint8_t accl[SENSOR_OUTPUT_SIZE] = { 0 }, gyro[SENSOR_OUTPUT_SIZE] = { 0 };
+	const sensorsspi_block_t blocks[] = {
+		{ .cmd = REG_DATA_OUT_ACCL | SPI_READ_BIT, .len = sizeof(accl), .buf = accl },
+		{ .cmd = REG_DATA_OUT_GYRO | SPI_READ_BIT, .len = sizeof(gyro), .buf = gyro },
+	};
 
 	gettime(&lastGyroTime, NULL);
 
@@ -211,34 +298,31 @@ static void lsm9dsxx_threadPublish(void *data)
 	ctx->evtAccel.accels.temp = 0;
 	ctx->evtGyro.gyro.temp = 0;
 
+	if (ctx->useDrdy != 0) {
+		lsm9dsxx_threadDrdy(info, ctx, lastGyroTime);
+	}
+
 	while (1) {
 		/* odr is set to 952, thus 1ms wait is satisfactory */
 		usleep(1000);
 
-		/* accel read */
-		obuf = REG_DATA_OUT_ACCL | SPI_READ_BIT;
-		err = sensorsspi_xfer(&ctx->spiCtx, &ctx->spiSS, &obuf, sizeof(obuf), ibuf, sizeof(ibuf), sizeof(obuf));
+		/* accel and gyroscope read in one message */
+		err = sensorsspi_readRegs(&ctx->spiCtx, ctx->spiCtx.speed, &ctx->spiSS, blocks, sizeof(blocks) / sizeof(blocks[0]));
 		gettime(&tstamp_accl, NULL);
+		tstamp_gyro = tstamp_accl;
 
 		if (err >= 0) {
 			/* minus accounts for non right-handness of lsm9dsxx accelerometer frame of reference */
-			ctx->evtAccel.accels.accelX = -translateAcc(ibuf[1], ibuf[0]);
-			ctx->evtAccel.accels.accelY = translateAcc(ibuf[3], ibuf[2]);
-			ctx->evtAccel.accels.accelZ = translateAcc(ibuf[5], ibuf[4]);
+			ctx->evtAccel.accels.accelX = -translateAcc(accl[1], accl[0]);
+			ctx->evtAccel.accels.accelY = translateAcc(accl[3], accl[2]);
+			ctx->evtAccel.accels.accelZ = translateAcc(accl[5], accl[4]);
 			ctx->evtAccel.timestamp = tstamp_accl;
 			sensors_publish(info->id, &ctx->evtAccel);
-		}
-
-		/* gyroscope read */
-		obuf = REG_DATA_OUT_GYRO | SPI_READ_BIT;
-		err = sensorsspi_xfer(&ctx->spiCtx, &ctx->spiSS, &obuf, sizeof(obuf), ibuf, sizeof(ibuf), sizeof(obuf));
-		gettime(&tstamp_gyro, NULL);
 
-		if (err >= 0) {
 			/* minus accounts for non right-handness of lsm9dsxx gyroscope frame of reference */
-			ctx->evtGyro.gyro.gyroX = -translateGyr(ibuf[1], ibuf[0]);
-			ctx->evtGyro.gyro.gyroY = translateGyr(ibuf[3], ibuf[2]);
-			ctx->evtGyro.gyro.gyroZ = translateGyr(ibuf[5], ibuf[4]);
+			ctx->evtGyro.gyro.gyroX = -translateGyr(gyro[1], gyro[0]);
+			ctx->evtGyro.gyro.gyroY = translateGyr(gyro[3], gyro[2]);
+			ctx->evtGyro.gyro.gyroZ = translateGyr(gyro[5], gyro[4]);
 			ctx->evtGyro.timestamp = tstamp_gyro;
 
 			/* Integration of current measurement */
@@ -279,11 +363,11 @@ static int lsm9dsxx_start(sensor_info_t *info)
 static int lsm9dsxx_alloc(sensor_info_t *info, const char *args)
 {
 	lsm9dsxx_ctx_t *ctx;
-	char *ss;
+	char *ss, *drdy = NULL;
 	int err;
 
 	/* sensor context allocation */
-	ctx = malloc(sizeof(lsm9dsxx_ctx_t));
+	ctx = calloc(1, sizeof(lsm9dsxx_ctx_t));
 	if (ctx == NULL) {
 		return -ENOMEM;
 	}
@@ -303,6 +387,11 @@ static int lsm9dsxx_alloc(sensor_info_t *info, const char *args)
 	ss = strchr(args, ':');
 	if (ss != NULL) {
 		*(ss++) = '\0';
+
+		drdy = strchr(ss, ':');
+		if (drdy != NULL) {
+			*(drdy++) = '\0';
+		}
 	}
 
 	/* initialize SPI device communication */
@@ -313,6 +402,17 @@ static int lsm9dsxx_alloc(sensor_info_t *info, const char *args)
 		return err;
 	}
 
+	/* optional data-ready interrupt pin */
+	if (drdy != NULL) {
+		err = sensorsspi_openDrdy(drdy, &ctx->drdy);
+		if (err < 0) {
+			printf("lsm9dsxx: Can`t initialize data-ready pin\n");
+			free(ctx);
+			return err;
+		}
+		ctx->useDrdy = 1;
+	}
+
 	/* hardware setup of imu */
 	if (lsm9dsxx_hwSetup(ctx) < 0) {
 		printf("lsm9dsxx: failed to setup device\n");
@@ -28,12 +28,15 @@
 
 #define SPI_READ_BIT 0x80
 
-#define REG_USER_CTRL            0x6a
-#define VAL_USER_CTRL_I2C_IF_DIS 0x10 /* disable I2C bit */
+#define REG_USER_CTRL             0x6a
+#define VAL_USER_CTRL_I2C_IF_DIS  0x10 /* disable I2C bit */
+#define VAL_USER_CTRL_FIFO_EN     0x40
+#define VAL_USER_CTRL_FIFO_RESET  0x04
 
 /* Sample rate divider accepts all values 0-255. Providing only div=1 macro */
 #define REG_SMPRT_DIV   0x19
 #define VAL_SMPRT_DIV_1 0x00 /* sample rate divider = 1 */
+#define VAL_SMPRT_DIV_8 0x07 /* sample rate divider = 8 */
 
 #define REG_CONFIG                0x1a
 #define VAL_CONFIG_DLPF_CFG_NONE  0x07 /* no LPF, 8KHz gyro sampling */
@@ -67,9 +70,33 @@
 #define VAL_PWR_MGMT_1_SLEEP        0x64
 #define VAL_PWR_MGMT_1_CLKSEL_PLL_Z 0x03
 
+/* Interrupts */
+#define REG_INT_PIN_CFG          0x37 /* reset value: active high, push-pull, 50us pulse */
+#define REG_INT_ENABLE           0x38
+#define VAL_INT_ENABLE_DATA_RDY  0x01
+
+/* FIFO, frame layout is the same as data registers layout */
+#define REG_FIFO_EN         0x23
+#define VAL_FIFO_EN_ALL     0xf8 /* temperature, gyroscope and accelerometer */
+#define REG_FIFO_COUNTH     0x72
+#define REG_FIFO_R_W        0x74
+#define FIFO_SIZE           1024
+
 #define REG_DATA_OUT_ALL   0x3b
 #define SENSOR_OUTPUT_SIZE 14
 
+/* Max FIFO frames read in one SPI transfer */
+#ifndef MPU6000_FIFO_BURST
+#define MPU6000_FIFO_BURST 8
+#endif
+
+/* SPI clock: MPU6000 accepts <1MHz writes, but <20MHz reads */
+#define SPI_SPEED_WRITE 1000000
+#define SPI_SPEED_READ  20000000
+
+/* Sampling period with data-ready interrupt [us] */
+#define SAMPLE_PERIOD 1000
+
 /* conversions */
 #define GYR2000DPS_CONV_MRAD 1.064225152f     /* convert gyroscope value (at scale 2000DPS) to mrad/s */
 #define ACC8G_CONV_MG        0.24414f         /* convert accelerations (at 8G scale) [m/s^2] */
@@ -80,10 +107,19 @@
 typedef struct {
 	spimsg_ctx_t spiCtx;
 	oid_t spiSS;
+	oid_t drdy;
+	int useDrdy;
 	sensor_event_t evtAccel;
 	sensor_event_t evtGyro;
 	uint8_t lpfSel;
-	char stack[512] __attribute__((aligned(8)));
+
+	/* Gyroscope integration */
+	uint32_t dAngleX, dAngleY, dAngleZ;
+	int32_t lastGyroX, lastGyroY, lastGyroZ;
+	time_t tStampLast;
+
+	uint8_t fifo[MPU6000_FIFO_BURST * SENSOR_OUTPUT_SIZE];
+	char stack[1024] __attribute__((aligned(8)));
 } mpu6000_ctx_t;
 
 
@@ -131,7 +167,7 @@ static int mpu6000_whoamiCheck(mpu6000_ctx_t *ctx)
 
 	cmd = REG_WHOAMI | SPI_READ_BIT;
 	val = 0;
-	err = sensorsspi_xfer(&ctx->spiCtx, &ctx->spiSS, &cmd, sizeof(cmd), &val, sizeof(val), sizeof(cmd));
+	err = sensorsspi_xferAt(&ctx->spiCtx, SPI_SPEED_READ, &ctx->spiSS, &cmd, sizeof(cmd), &val, sizeof(val), sizeof(cmd));
 	if ((err < 0) || (val != VAL_WHOAMI)) {
 		return -1;
 	}
@@ -172,7 +208,13 @@ static int mpu6000_hwSetup(mpu6000_ctx_t *ctx)
 		return -1;
 	}
 
-	if (spiWriteReg(ctx, REG_SMPRT_DIV, VAL_SMPRT_DIV_1) < 0) {
+	/* With data-ready interrupt the sample rate is exactly 1kHz, 8kHz gyro output is divided by 8 */
+	if ((ctx->useDrdy != 0) && ((ctx->lpfSel == VAL_CONFIG_DLPF_CFG_256HZ) || (ctx->lpfSel == VAL_CONFIG_DLPF_CFG_NONE))) {
+		if (spiWriteReg(ctx, REG_SMPRT_DIV, VAL_SMPRT_DIV_8) < 0) {
+			return -1;
+		}
+	}
+	else if (spiWriteReg(ctx, REG_SMPRT_DIV, VAL_SMPRT_DIV_1) < 0) {
 		return -1;
 	}
 
@@ -185,72 +227,133 @@ static int mpu6000_hwSetup(mpu6000_ctx_t *ctx)
 		return -1;
 	}
 
+	if (ctx->useDrdy != 0) {
+		/* Samples are buffered in FIFO, data-ready interrupt signals each new sample */
+		if (spiWriteReg(ctx, REG_FIFO_EN, VAL_FIFO_EN_ALL) < 0) {
+			return -1;
+		}
+
+		if (spiWriteReg(ctx, REG_USER_CTRL, VAL_USER_CTRL_I2C_IF_DIS | VAL_USER_CTRL_FIFO_EN | VAL_USER_CTRL_FIFO_RESET) < 0) {
+			return -1;
+		}
+
+		if (spiWriteReg(ctx, REG_INT_ENABLE, VAL_INT_ENABLE_DATA_RDY) < 0) {
+			return -1;
+		}
+	}
+
 	return 0;
 }
 
 
-static void mpu6000_threadPublish(void *data)
+static void mpu6000_publishFrame(sensor_info_t *info, mpu6000_ctx_t *ctx, const uint8_t *ibuf, time_t tStamp)
 {
-	static uint32_t dAngleX = 0, dAngleY = 0, dAngleZ = 0;
-	static int32_t lastGyroX = 0, lastGyroY = 0, lastGyroZ = 0;
-	static time_t tStampLast;
+	float step;
+
+	/* Common package: gyro and accel utilize the same temperature reading */
+	ctx->evtAccel.accels.temp = translateTemp(ibuf[6], ibuf[7]);
+	ctx->evtGyro.gyro.temp = ctx->evtAccel.accels.temp;
+
+	ctx->evtAccel.accels.accelX = translateAcc(ibuf[0], ibuf[1]);
+	ctx->evtAccel.accels.accelY = translateAcc(ibuf[2], ibuf[3]);
+	ctx->evtAccel.accels.accelZ = translateAcc(ibuf[4], ibuf[5]);
+	ctx->evtAccel.timestamp = tStamp;
+
+	ctx->evtGyro.gyro.gyroX = translateGyr(ibuf[8], ibuf[9]);
+	ctx->evtGyro.gyro.gyroY = translateGyr(ibuf[10], ibuf[11]);
+	ctx->evtGyro.gyro.gyroZ = translateGyr(ibuf[12], ibuf[13]);
+	ctx->evtGyro.timestamp = tStamp;
+
+	/* Integration of current measurement */
+	step = (tStamp - ctx->tStampLast) / 2000.f; /* dividing by (1000 * 2) for correct unit and avg. of current and last measurement */
+	ctx->dAngleX += (uint32_t)((ctx->evtGyro.gyro.gyroX + ctx->lastGyroX) * step);
+	ctx->dAngleY += (uint32_t)((ctx->evtGyro.gyro.gyroY + ctx->lastGyroY) * step);
+	ctx->dAngleZ += (uint32_t)((ctx->evtGyro.gyro.gyroZ + ctx->lastGyroZ) * step);
+
+	ctx->evtGyro.gyro.dAngleX = ctx->dAngleX;
+	ctx->evtGyro.gyro.dAngleY = ctx->dAngleY;
+	ctx->evtGyro.gyro.dAngleZ = ctx->dAngleZ;
+
+	ctx->tStampLast = tStamp;
+	ctx->lastGyroX = ctx->evtGyro.gyro.gyroX;
+	ctx->lastGyroY = ctx->evtGyro.gyro.gyroY;
+	ctx->lastGyroZ = ctx->evtGyro.gyro.gyroZ;
+
+	sensors_publish(info->id, &ctx->evtGyro);
+	sensors_publish(info->id, &ctx->evtAccel);
+}
 
+
+static void mpu6000_threadDrdy(sensor_info_t *info, mpu6000_ctx_t *ctx)
+{
+	const uint8_t cntCmd = REG_FIFO_COUNTH | SPI_READ_BIT, fifoCmd = REG_FIFO_R_W | SPI_READ_BIT;
+	uint8_t cnt[2];
+	unsigned int frames, n, i;
+	time_t tStamp;
+
+	for (;;) {
+		if (sensorsspi_waitDrdy(&ctx->drdy, &tStamp) < 0) {
+			usleep(SAMPLE_PERIOD);
+			continue;
+		}
+
+		if (sensorsspi_xferAt(&ctx->spiCtx, SPI_SPEED_READ, &ctx->spiSS, &cntCmd, sizeof(cntCmd), cnt, sizeof(cnt), sizeof(cntCmd)) < 0) {
+			continue;
+		}
+
+		/* FIFO count: upper 5 bits in COUNTH */
+		frames = ((((unsigned int)cnt[0] & 0x1f) << 8) | cnt[1]);
+		if (frames > FIFO_SIZE - SENSOR_OUTPUT_SIZE) {
+			/* Overflow, frames are no longer aligned - start over */
+			spiWriteReg(ctx, REG_USER_CTRL, VAL_USER_CTRL_I2C_IF_DIS | VAL_USER_CTRL_FIFO_EN | VAL_USER_CTRL_FIFO_RESET);
+			continue;
+		}
+		frames /= SENSOR_OUTPUT_SIZE;
+
+		/* Newest frame was sampled at the interrupt, older ones at the sampling period before */
+		while (frames > 0) {
+			n = (frames > MPU6000_FIFO_BURST) ? MPU6000_FIFO_BURST : frames;
+			if (sensorsspi_xferAt(&ctx->spiCtx, SPI_SPEED_READ, &ctx->spiSS, &fifoCmd, sizeof(fifoCmd), ctx->fifo, n * SENSOR_OUTPUT_SIZE, sizeof(fifoCmd)) < 0) {
+				break;
+			}
+
+			for (i = 0; i < n; ++i) {
+				--frames;
+				mpu6000_publishFrame(info, ctx, ctx->fifo + i * SENSOR_OUTPUT_SIZE, tStamp - (time_t)frames * SAMPLE_PERIOD);
+			}
+		}
+	}
+}
+
+
+static void mpu6000_threadPublish(void *data)
+{
 	const uint8_t obuf = REG_DATA_OUT_ALL | SPI_READ_BIT;
 	sensor_info_t *info = (sensor_info_t *)data;
 	mpu6000_ctx_t *ctx = info->ctx;
 	uint8_t ibuf[SENSOR_OUTPUT_SIZE] = { 0 };
 	time_t tStamp;
-	float step;
 	int err;
 
-	gettime(&tStampLast, NULL);
+	gettime(&ctx->tStampLast, NULL);
 
-	/* TODO: SPI speed bottleneck: MPU6000 SPI accepts <1MHz CLK writes, but <20MHz CLK reads; runtime SPI CLK setup unavailable */
-	ctx->spiCtx.speed = 10000000;
+	if (ctx->useDrdy != 0) {
+		mpu6000_threadDrdy(info, ctx);
+	}
 
 	while (1) {
 		/* odr is set to 952, thus 1ms wait is satisfactory */
 		usleep(1000);
 
 		/* data read */
-		err = sensorsspi_xfer(&ctx->spiCtx, &ctx->spiSS, &obuf, sizeof(obuf), ibuf, sizeof(ibuf), sizeof(obuf));
+		err = sensorsspi_xferAt(&ctx->spiCtx, SPI_SPEED_READ, &ctx->spiSS, &obuf, sizeof(obuf), ibuf, sizeof(ibuf), sizeof(obuf));
 		gettime(&tStamp, NULL);
 
 		if (err < 0) {
 			continue;
 		}
 
-		/* Common package: gyro and accel utilize the same temperature reading */
-		ctx->evtAccel.accels.temp = translateTemp(ibuf[6], ibuf[7]);
-		ctx->evtGyro.gyro.temp = ctx->evtAccel.accels.temp;
-
-		ctx->evtAccel.accels.accelX = translateAcc(ibuf[0], ibuf[1]);
-		ctx->evtAccel.accels.accelY = translateAcc(ibuf[2], ibuf[3]);
-		ctx->evtAccel.accels.accelZ = translateAcc(ibuf[4], ibuf[5]);
-		ctx->evtAccel.timestamp = tStamp;
-
-		ctx->evtGyro.gyro.gyroX = translateGyr(ibuf[8], ibuf[9]);
-		ctx->evtGyro.gyro.gyroY = translateGyr(ibuf[10], ibuf[11]);
-		ctx->evtGyro.gyro.gyroZ = translateGyr(ibuf[12], ibuf[13]);
-		ctx->evtGyro.timestamp = tStamp;
-
-		/* Integration of current measurement */
-		step = (tStamp - tStampLast) / 2000.f; /* dividing by (1000 * 2) for correct unit and avg. of current and last measurement */
-		dAngleX += (uint32_t)((ctx->evtGyro.gyro.gyroX + lastGyroX) * step);
-		dAngleY += (uint32_t)((ctx->evtGyro.gyro.gyroY + lastGyroY) * step);
-		dAngleZ += (uint32_t)((ctx->evtGyro.gyro.gyroZ + lastGyroZ) * step);
-
-		ctx->evtGyro.gyro.dAngleX = dAngleX;
-		ctx->evtGyro.gyro.dAngleY = dAngleY;
-		ctx->evtGyro.gyro.dAngleZ = dAngleZ;
-
-		tStampLast = tStamp;
-		lastGyroX = ctx->evtGyro.gyro.gyroX;
-		lastGyroY = ctx->evtGyro.gyro.gyroY;
-		lastGyroZ = ctx->evtGyro.gyro.gyroZ;
-
-		sensors_publish(info->id, &ctx->evtGyro);
-		sensors_publish(info->id, &ctx->evtAccel);
+		mpu6000_publishFrame(info, ctx, ibuf, tStamp);
 	}
 }
 
@@ -272,12 +375,12 @@ static int mpu6000_start(sensor_info_t *info)
 static int mpu6000_alloc(sensor_info_t *info, const char *args)
 {
 	mpu6000_ctx_t *ctx;
-	char *ss, *lpfChr;
+	char *ss, *lpfChr, *drdy = NULL;
 	int err;
 	unsigned long lpfSel = 0;
 
 	/* sensor context allocation */
-	ctx = malloc(sizeof(mpu6000_ctx_t));
+	ctx = calloc(1, sizeof(mpu6000_ctx_t));
 	if (ctx == NULL) {
 		return -ENOMEM;
 	}
@@ -292,7 +395,7 @@ static int mpu6000_alloc(sensor_info_t *info, const char *args)
 	info->types = SENSOR_TYPE_ACCEL | SENSOR_TYPE_GYRO;
 
 	ctx->spiCtx.mode = SPI_MODE3;
-	ctx->spiCtx.speed = 1000000;
+	ctx->spiCtx.speed = SPI_SPEED_WRITE; /* reads use SPI_SPEED_READ */
 
 	ss = strchr(args, ':');
 	if (ss != NULL) {
@@ -302,6 +405,11 @@ static int mpu6000_alloc(sensor_info_t *info, const char *args)
 		if (lpfChr != NULL) {
 			*(lpfChr++) = '\0';
 
+			drdy = strchr(lpfChr, ':');
+			if (drdy != NULL) {
+				*(drdy++) = '\0';
+			}
+
 			errno = EOK;
 			lpfSel = strtoul(lpfChr, NULL, 10);
 			if (lpfSel > 7 || (lpfSel == 0 && errno != EOK)) {
@@ -321,6 +429,17 @@ static int mpu6000_alloc(sensor_info_t *info, const char *args)
 		return err;
 	}
 
+	/* optional data-ready interrupt pin */
+	if (drdy != NULL) {
+		err = sensorsspi_openDrdy(drdy, &ctx->drdy);
+		if (err < 0) {
+			printf("mpu6000: Can`t initialize data-ready pin\n");
+			free(ctx);
+			return err;
+		}
+		ctx->useDrdy = 1;
+	}
+
 	/* hardware setup of imu */
 	if (mpu6000_hwSetup(ctx) < 0) {
 		printf("mpu6000: failed to setup device\n");
@@ -15,6 +15,7 @@
 #define _LIBSENSORS_H_
 
 #include <stdint.h>
+#include <string.h>
 #include <sys/ioctl.h>
 #include <time.h>
 
@@ -122,6 +123,13 @@ typedef struct {
 } diffBaro_data_t;
 
 
+/* sensEkf_data_t status flags */
+#define SENSEKF_STATUS_ATTITUDE (1 << 0) /* attitude corrected by accelerometer */
+#define SENSEKF_STATUS_HEADING  (1 << 1) /* heading corrected by magnetometer */
+#define SENSEKF_STATUS_ALTITUDE (1 << 2) /* vertical channel corrected by barometer */
+#define SENSEKF_STATUS_VELOCITY (1 << 3) /* velocity corrected by GPS */
+
+
 typedef struct {
 	uint32_t devId;
 
@@ -197,6 +205,14 @@ typedef struct {
 } sensors_data_t;
 
 
+/* Structure of events passed to the client with the event queue enabled */
+typedef struct {
+	size_t size;
+	uint32_t drops;            /* number of events lost due to queue overflow since the last read */
+	sensor_event_t events[];   /* events in publishing order */
+} sensors_qdata_t;
+
+
 /* Options setting by the client _IOWR */
 typedef struct {
 	sensor_type_t types; /* in: sensor types defined by the client */
@@ -204,8 +220,93 @@ typedef struct {
 } sensors_ops_t;
 
 
+/* Per-client event queue setting _IOWR */
+typedef struct {
+	unsigned int depth; /* in: queue length in events, 0 - latest values only (sensors_data_t) */
+	uint32_t drops;     /* out: events dropped since the last read */
+} sensors_queue_t;
+
+
+/* Event slot, evt[seq & 1] holds the latest event. Publisher fills the other
+ * copy and then flips seq, readers retry if seq changed during the copy. */
+typedef struct {
+	uint32_t seq;
+	uint32_t reserved;
+	sensor_event_t evt[2];
+} sensors_slot_t;
+
+
+#define SENSORS_SHM_MAGIC 0x53534d31 /* "SSM1" */
+#define SENSORS_SHM_TYPES (sizeof(sensor_type_t) * 8)
+
+/* Snapshot of all slots shared with clients (SMIOC_SENSORSMAP) */
+typedef struct {
+	uint32_t magic;
+	uint32_t size;                         /* size of the whole snapshot in bytes */
+	uint32_t slotOffs[SENSORS_SHM_TYPES];  /* offset of the first slot of a type (index: bit of the type) */
+	uint8_t slotNb[SENSORS_SHM_TYPES];     /* number of slots of a type */
+} sensors_shm_t;
+
+
+/* Snapshot location, to be mapped read-only with MAP_PHYSMEM */
+typedef struct {
+	uint64_t addr; /* physical address */
+	size_t size;
+} sensors_map_t;
+
+
+#define SENSORS_AGE_BINS 8
+
+/* Publishing statistics of a device for one sensor type (SMIOC_SENSORSSTATS) _IOWR */
+typedef struct {
+	uint32_t devId;                 /* in: device identifier */
+	sensor_type_t type;             /* in: single sensor type */
+	uint32_t cnt;                   /* out: number of published events */
+	uint32_t intervalMin;           /* out: interval between published event timestamps [us] */
+	uint32_t intervalAvg;           /* out: average interval [us] */
+	uint32_t intervalMax;           /* out: maximal interval [us] */
+	uint32_t lockMax;               /* out: longest event queues update in sensors_publish() [us] */
+	uint32_t age[SENSORS_AGE_BINS]; /* out: age of read events, bin n counts ages below 2^n ms, the last one older */
+} sensors_stats_t;
+
+
+/* Calibration applied by the driver (SMIOC_SENSORSCALIB) _IOW, out = matrix * (raw - offs) */
+typedef struct {
+	uint32_t devId;     /* device identifier */
+	sensor_type_t type; /* calibrated sensor type, currently SENSOR_TYPE_MAG only */
+	int32_t offs[3];    /* hard-iron offset in output units */
+	int32_t matrix[9];  /* soft-iron correction, row major, Q16 fixed point (65536 = 1.0) */
+} sensors_calib_t;
+
+
 #define SENSORS_IOCTL_BASE 'S'
 #define SMIOC_SENSORSSET   _IOWR(SENSORS_IOCTL_BASE, 1, sensors_ops_t) /* set sensor types and get events number */
 #define SMIOC_SENSORSAVAIL _IOR(SENSORS_IOCTL_BASE, 2, sensor_type_t)  /* get available sensor types */
+#define SMIOC_SENSORSMAP   _IOR(SENSORS_IOCTL_BASE, 3, sensors_map_t)  /* get shared snapshot location */
+#define SMIOC_SENSORSQUEUE _IOWR(SENSORS_IOCTL_BASE, 4, sensors_queue_t) /* set client event queue, read() returns sensors_qdata_t */
+#define SMIOC_SENSORSSTATS _IOWR(SENSORS_IOCTL_BASE, 5, sensors_stats_t) /* get device publishing statistics */
+#define SMIOC_SENSORSCALIB _IOW(SENSORS_IOCTL_BASE, 6, sensors_calib_t)  /* set device calibration */
+
+
+static inline const sensors_slot_t *sensors_shmSlots(const sensors_shm_t *shm, unsigned int typeBit)
+{
+	if ((typeBit >= SENSORS_SHM_TYPES) || (shm->slotNb[typeBit] == 0)) {
+		return NULL;
+	}
+
+	return (const sensors_slot_t *)((const uint8_t *)shm + shm->slotOffs[typeBit]);
+}
+
+
+static inline void sensors_slotRead(const sensors_slot_t *slot, sensor_event_t *event)
+{
+	uint32_t seq;
+
+	do {
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		memcpy(event, (const void *)&slot->evt[seq & 1], sizeof(sensor_event_t));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq);
+}
 
 #endif
@@ -53,6 +53,69 @@ int sensorsspi_xfer(const spimsg_ctx_t *ctx, oid_t *ss, const void *out, size_t
 }
 
 
+int sensorsspi_xferAt(const spimsg_ctx_t *ctx, unsigned int speed, oid_t *ss, const void *out, size_t olen, void *in, size_t ilen, size_t iskip)
+{
+	spimsg_ctx_t tmp = *ctx;
+
+	tmp.speed = speed;
+
+	return sensorsspi_xfer(&tmp, ss, out, olen, in, ilen, iskip);
+}
+
+
+int sensorsspi_readRegs(const spimsg_ctx_t *ctx, unsigned int speed, oid_t *ss, const sensorsspi_block_t *blocks, size_t n)
+{
+	spimsg_seg_t segs[SPIMSG_BATCH_SEGS];
+	uint8_t cmds[SPIMSG_BATCH_SEGS], ibuf[SPIMSG_BATCH_SIZE];
+	spimsg_ctx_t tmp = *ctx;
+	size_t i, len = 0;
+	uint8_t *p;
+	int ret;
+
+	tmp.speed = speed;
+
+	/* External SS line can't be toggled between segments of a batch */
+	if ((ctx->oid.id == SPI_SS_EXTERNAL) || (n > SPIMSG_BATCH_SEGS)) {
+		for (i = 0; i < n; i++) {
+			ret = sensorsspi_xfer(&tmp, ss, &blocks[i].cmd, sizeof(blocks[i].cmd), blocks[i].buf, blocks[i].len, sizeof(blocks[i].cmd));
+			if (ret < 0) {
+				return ret;
+			}
+		}
+
+		return EOK;
+	}
+
+	for (i = 0; i < n; i++) {
+		cmds[i] = blocks[i].cmd;
+		segs[i].olen = sizeof(cmds[i]);
+		segs[i].ilen = blocks[i].len;
+		segs[i].iskip = sizeof(cmds[i]);
+		segs[i].flags = 0;
+		segs[i].delay = 0;
+		len += blocks[i].len;
+	}
+
+	if (len > sizeof(ibuf)) {
+		return -EINVAL;
+	}
+
+	mutexLock(sensorsspi_common.lock);
+	ret = spimsg_batch(&tmp, segs, n, cmds, ibuf);
+	mutexUnlock(sensorsspi_common.lock);
+
+	if (ret < 0) {
+		return ret;
+	}
+
+	for (i = 0, p = ibuf; i < n; p += blocks[i].len, i++) {
+		memcpy(blocks[i].buf, p, blocks[i].len);
+	}
+
+	return EOK;
+}
+
+
 int sensorsspi_open(const char *devSPI, const char *devSS, oid_t *spi, oid_t *ss)
 {
 	char *path, *dir, *base;
@@ -151,6 +214,74 @@ int sensorsspi_open(const char *devSPI, const char *devSS, oid_t *spi, oid_t *ss
 }
 
 
+int sensorsspi_openDrdy(const char *devDrdy, oid_t *drdy)
+{
+	char *path, *dir, *base;
+	unsigned int pin;
+	int err, ntries;
+	oid_t oid;
+
+	if ((devDrdy == NULL) || (drdy == NULL)) {
+		return -EINVAL;
+	}
+
+	ntries = 10;
+	while (lookup(devDrdy, NULL, drdy) < 0) {
+		ntries--;
+		if (ntries == 0) {
+			return -ETIMEDOUT;
+		}
+		usleep(10 * 1000);
+	}
+
+	path = strdup(devDrdy);
+	if (path == NULL) {
+		return -ENOMEM;
+	}
+
+	/* Get pin number */
+	base = basename(path);
+	if (strncmp(base, "pin", 3)) {
+		free(path);
+		return -EINVAL;
+	}
+	pin = strtoul(base + 3, NULL, 0);
+
+	/* Configure pin as input */
+	dir = dirname(path);
+	strcat(dir, "/dir");
+
+	ntries = 10;
+	while (lookup(dir, NULL, &oid) < 0) {
+		ntries--;
+		if (ntries == 0) {
+			free(path);
+			return -ETIMEDOUT;
+		}
+		usleep(10 * 1000);
+	}
+
+	err = gpiomsg_writeDir(&oid, 0, 1 << pin);
+	free(path);
+
+	return err;
+}
+
+
+int sensorsspi_waitDrdy(oid_t *drdy, time_t *time)
+{
+	uint32_t cnt;
+	int err;
+
+	err = gpiomsg_waitPin(drdy, 1, &cnt, time);
+	if (err < 0) {
+		return err;
+	}
+
+	return cnt;
+}
+
+
 int sensorsspi_init(void)
 {
 	int err;
@@ -0,0 +1,78 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Magnetometers common code
+ *
+ * Copyright 2024 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/threads.h>
+
+#include "common.h"
+
+
+static int16_t mag_saturate(int64_t val)
+{
+	if (val > INT16_MAX) {
+		return INT16_MAX;
+	}
+	else if (val < INT16_MIN) {
+		return INT16_MIN;
+	}
+
+	return val;
+}
+
+
+int mag_calibInit(mag_calib_t *calib)
+{
+	memset(calib->offs, 0, sizeof(calib->offs));
+	memset(calib->matrix, 0, sizeof(calib->matrix));
+	calib->matrix[0] = 1 << 16;
+	calib->matrix[4] = 1 << 16;
+	calib->matrix[8] = 1 << 16;
+
+	return mutexCreate(&calib->lock);
+}
+
+
+int mag_calibSet(mag_calib_t *calib, const sensors_calib_t *cal)
+{
+	if (cal->type != SENSOR_TYPE_MAG) {
+		return -EINVAL;
+	}
+
+	mutexLock(calib->lock);
+	memcpy(calib->offs, cal->offs, sizeof(calib->offs));
+	memcpy(calib->matrix, cal->matrix, sizeof(calib->matrix));
+	mutexUnlock(calib->lock);
+
+	return EOK;
+}
+
+
+void mag_calibApply(mag_calib_t *calib, const int32_t raw[3], mag_data_t *mag)
+{
+	int64_t v[3], out[3];
+	int i;
+
+	mutexLock(calib->lock);
+	for (i = 0; i < 3; ++i) {
+		v[i] = raw[i] - calib->offs[i];
+	}
+
+	for (i = 0; i < 3; ++i) {
+		out[i] = (calib->matrix[3 * i] * v[0] + calib->matrix[3 * i + 1] * v[1] + calib->matrix[3 * i + 2] * v[2]) >> 16;
+	}
+	mutexUnlock(calib->lock);
+
+	mag->magX = mag_saturate(out[0]);
+	mag->magY = mag_saturate(out[1]);
+	mag->magZ = mag_saturate(out[2]);
+}
@@ -0,0 +1,42 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Magnetometers common code
+ *
+ * Copyright 2024 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+
+#ifndef _MAG_COMMON_H_
+#define _MAG_COMMON_H_
+
+
+#include <stdint.h>
+
+#include "../sensors.h"
+
+
+/* Hard/soft-iron calibration, written by the message thread and applied by the publishing thread */
+typedef struct {
+	handle_t lock;
+	int32_t offs[3];
+	int32_t matrix[9]; /* Q16 */
+} mag_calib_t;
+
+
+/* Initializes `calib` to identity transformation */
+extern int mag_calibInit(mag_calib_t *calib);
+
+
+extern int mag_calibSet(mag_calib_t *calib, const sensors_calib_t *cal);
+
+
+/* Stores calibrated `raw` axes values (in 1E-7 [T]) in `mag` */
+extern void mag_calibApply(mag_calib_t *calib, const int32_t raw[3], mag_data_t *mag);
+
+
+#endif
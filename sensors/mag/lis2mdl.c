@@ -21,6 +21,7 @@
 #include <string.h>
 
 #include "../sensors.h"
+#include "common.h"
 
 /* self-identification register of magnetometer */
 #define REG_WHOAMI 0x4f
@@ -46,17 +47,28 @@
 #define VAL_CFG_REG_C_4WSPI   0x04
 #define VAL_CFG_REG_C_I2C_DIS 0x20
 
-#define REG_DATA_OUT       0x68
-#define SENSOR_OUTPUT_SIZE 6
+#define REG_STATUS       0x67
+#define VAL_STATUS_ZYXDA 0x08
+
+/* Status, axes and temperature are read in one burst (address is auto-incremented) */
+#define SENSOR_OUTPUT_SIZE 9
+
+/* Temperature is published once per this many magnetometer samples */
+#ifndef LIS2MDL_TEMP_DIV
+#define LIS2MDL_TEMP_DIV 10
+#endif
 
 #define MAG_CONV_MGAUSS 1.5F  /* conversion from sensor value to milligauss (equal to 10^-7 T) */
 #define MAG_OVERFLOW    21843 /* sensorhub will overflow if lis2mdl returns abs(raw) > MAG_OVERFLOW */
+#define TEMP_LSB_PER_C  8     /* temperature sensitivity, 0 at 25 C */
 
 
 typedef struct {
 	spimsg_ctx_t spiCtx;
 	oid_t spiSS;
 	sensor_event_t evt;
+	sensor_event_t evtTemp;
+	mag_calib_t calib;
 	char stack[512] __attribute__((aligned(8)));
 } lis2mdl_ctx_t;
 
@@ -137,24 +149,46 @@ static void lis2mdl_threadPublish(void *data)
 	sensor_info_t *info = (sensor_info_t *)data;
 	lis2mdl_ctx_t *ctx = info->ctx;
 	uint8_t ibuf[SENSOR_OUTPUT_SIZE] = { 0 };
-	const uint8_t obuf = REG_DATA_OUT | SPI_READ_BIT;
+	const uint8_t obuf = REG_STATUS | SPI_READ_BIT;
+	unsigned int cnt = 0;
+	int32_t raw[3];
+	int16_t temp;
 
 	while (1) {
-		usleep(100 * 1000);
+		/* ODR set to 100Hz */
+		usleep(10 * 1000);
 
 		err = sensorsspi_xfer(&ctx->spiCtx, &ctx->spiSS, &obuf, sizeof(obuf), ibuf, sizeof(ibuf), sizeof(obuf));
 
-		if (err >= 0) {
-			gettime(&(ctx->evt.timestamp), NULL);
-			ctx->evt.mag.magX = translateMag(ibuf[1], ibuf[0]);
-			ctx->evt.mag.magY = -translateMag(ibuf[3], ibuf[2]); /* minus accounts for non right-handness of measurement */
-			ctx->evt.mag.magZ = translateMag(ibuf[5], ibuf[4]);
-			sensors_publish(info->id, &ctx->evt);
+		if ((err < 0) || ((ibuf[0] & VAL_STATUS_ZYXDA) == 0)) {
+			continue;
+		}
+
+		gettime(&(ctx->evt.timestamp), NULL);
+		raw[0] = translateMag(ibuf[2], ibuf[1]);
+		raw[1] = -translateMag(ibuf[4], ibuf[3]); /* minus accounts for non right-handness of measurement */
+		raw[2] = translateMag(ibuf[6], ibuf[5]);
+		mag_calibApply(&ctx->calib, raw, &ctx->evt.mag);
+		sensors_publish(info->id, &ctx->evt);
+
+		if ((++cnt % LIS2MDL_TEMP_DIV) == 0) {
+			temp = ((uint16_t)ibuf[8] << 8) | ibuf[7];
+			ctx->evtTemp.timestamp = ctx->evt.timestamp;
+			ctx->evtTemp.temp.temp = (temp * 100 / TEMP_LSB_PER_C + 2500 + 27315 + 50) / 100;
+			sensors_publish(info->id, &ctx->evtTemp);
 		}
 	}
 }
 
 
+static int lis2mdl_calib(sensor_info_t *info, const sensors_calib_t *cal)
+{
+	lis2mdl_ctx_t *ctx = (lis2mdl_ctx_t *)info->ctx;
+
+	return mag_calibSet(&ctx->calib, cal);
+}
+
+
 static int lis2mdl_start(sensor_info_t *info)
 {
 	int err;
@@ -183,10 +217,17 @@ static int lis2mdl_alloc(sensor_info_t *info, const char *args)
 
 	ctx->evt.type = SENSOR_TYPE_MAG;
 	ctx->evt.accels.devId = info->id;
+	ctx->evtTemp.type = SENSOR_TYPE_TEMP;
+	ctx->evtTemp.temp.devId = info->id;
+
+	if (mag_calibInit(&ctx->calib) < 0) {
+		free(ctx);
+		return -ENOMEM;
+	}
 
 	/* filling sensor info structure */
 	info->ctx = ctx;
-	info->types = SENSOR_TYPE_MAG;
+	info->types = SENSOR_TYPE_MAG | SENSOR_TYPE_TEMP;
 
 	ctx->spiCtx.mode = SPI_MODE3;
 	ctx->spiCtx.speed = 10000000;
@@ -200,6 +241,7 @@ static int lis2mdl_alloc(sensor_info_t *info, const char *args)
 	err = sensorsspi_open(args, ss, &ctx->spiCtx.oid, &ctx->spiSS);
 	if (err < 0) {
 		printf("lis2mdl: Can`t initialize SPI device\n");
+		resourceDestroy(ctx->calib.lock);
 		free(ctx);
 		return err;
 	}
@@ -207,6 +249,7 @@ static int lis2mdl_alloc(sensor_info_t *info, const char *args)
 	/* hardware setup of imu */
 	if (lis2mdl_hwSetup(ctx) < 0) {
 		printf("lis2mdl: failed to setup device\n");
+		resourceDestroy(ctx->calib.lock);
 		free(ctx);
 		return -1;
 	}
@@ -220,7 +263,8 @@ void __attribute__((constructor)) lis2mdl_mag_register(void)
 	static sensor_drv_t sensor = {
 		.name = "lis2mdl",
 		.alloc = lis2mdl_alloc,
-		.start = lis2mdl_start
+		.start = lis2mdl_start,
+		.calib = lis2mdl_calib
 	};
 
 	sensors_register(&sensor);
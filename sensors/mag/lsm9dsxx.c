@@ -26,6 +26,7 @@
 #include <string.h>
 
 #include "../sensors.h"
+#include "common.h"
 
 /* self-identification register of magnetometer */
 #define REG_WHOAMI     0x0f
@@ -68,8 +69,8 @@
 #define SPI_READ_BIT         0x80
 #define SPI_AUTOADDRINCR_BIT 0x40
 
-/* sensors data sizes */
-#define SENSOR_OUTPUT_SIZE 6
+/* sensors data sizes, status register is read together with outputs */
+#define SENSOR_OUTPUT_SIZE 7
 
 /* conversions */
 #define MAG4G_CONV_MGAUSS 0.14F /* conversion from sensor (at +-4 gauss scale) value to milligauss (equal to 10^-7 T) */
@@ -79,6 +80,7 @@ typedef struct {
 	spimsg_ctx_t spiCtx;
 	oid_t spiSS;
 	sensor_event_t evt;
+	mag_calib_t calib;
 	char stack[512] __attribute__((aligned(8)));
 } lsm9dsxx_ctx_t;
 
@@ -156,25 +158,38 @@ static void lsm9dsxx_threadPublish(void *data)
 	lsm9dsxx_ctx_t *ctx = info->ctx;
 	uint8_t ibuf[SENSOR_OUTPUT_SIZE] = { 0 };
 	uint8_t obuf;
+	int32_t raw[3];
 
 	while (1) {
 		usleep(1000 * 1000 / 64);
 
-		obuf = REG_DATA_OUT | SPI_READ_BIT | SPI_AUTOADDRINCR_BIT;
+		/* STATUS_REG_M is followed by output registers */
+		obuf = REG_STATUS_REG_M | SPI_READ_BIT | SPI_AUTOADDRINCR_BIT;
 		err = sensorsspi_xfer(&ctx->spiCtx, &ctx->spiSS, &obuf, sizeof(obuf), ibuf, sizeof(ibuf), sizeof(obuf));
 
-		if (err >= 0) {
-			gettime(&(ctx->evt.timestamp), NULL);
-			ctx->evt.mag.magX = translateMag(ibuf[1], ibuf[0]);
-			ctx->evt.mag.magY = translateMag(ibuf[3], ibuf[2]);
-			ctx->evt.mag.magZ = translateMag(ibuf[5], ibuf[4]);
-
-			sensors_publish(info->id, &ctx->evt);
+		if ((err < 0) || ((ibuf[0] & VAL_STATUS_REG_M_ZYXDA) == 0)) {
+			continue;
 		}
+
+		gettime(&(ctx->evt.timestamp), NULL);
+		raw[0] = translateMag(ibuf[2], ibuf[1]);
+		raw[1] = translateMag(ibuf[4], ibuf[3]);
+		raw[2] = translateMag(ibuf[6], ibuf[5]);
+		mag_calibApply(&ctx->calib, raw, &ctx->evt.mag);
+
+		sensors_publish(info->id, &ctx->evt);
 	}
 }
 
 
+static int lsm9dsxx_calib(sensor_info_t *info, const sensors_calib_t *cal)
+{
+	lsm9dsxx_ctx_t *ctx = (lsm9dsxx_ctx_t *)info->ctx;
+
+	return mag_calibSet(&ctx->calib, cal);
+}
+
+
 static int lsm9dsxx_start(sensor_info_t *info)
 {
 	int err;
@@ -204,6 +219,11 @@ static int lsm9dsxx_alloc(sensor_info_t *info, const char *args)
 	ctx->evt.type = SENSOR_TYPE_MAG;
 	ctx->evt.accels.devId = info->id;
 
+	if (mag_calibInit(&ctx->calib) < 0) {
+		free(ctx);
+		return -ENOMEM;
+	}
+
 	/* filling sensor info structure */
 	info->ctx = ctx;
 	info->types = SENSOR_TYPE_MAG;
@@ -220,6 +240,7 @@ static int lsm9dsxx_alloc(sensor_info_t *info, const char *args)
 	err = sensorsspi_open(args, ss, &ctx->spiCtx.oid, &ctx->spiSS);
 	if (err < 0) {
 		printf("lps25xx: Can`t initialize SPI device\n");
+		resourceDestroy(ctx->calib.lock);
 		free(ctx);
 		return err;
 	}
@@ -227,6 +248,7 @@ static int lsm9dsxx_alloc(sensor_info_t *info, const char *args)
 	/* hardware setup of imu */
 	if (lsm9dsxx_hwSetup(ctx) < 0) {
 		printf("lsm9dsxx_mag: failed to setup device\n");
+		resourceDestroy(ctx->calib.lock);
 		free(ctx);
 		return -1;
 	}
@@ -240,7 +262,8 @@ void __attribute__((constructor)) lsm9dsxx_mag_register(void)
 	static sensor_drv_t sensor = {
 		.name = "lsm9dsxx_mag",
 		.alloc = lsm9dsxx_alloc,
-		.start = lsm9dsxx_start
+		.start = lsm9dsxx_start,
+		.calib = lsm9dsxx_calib
 	};
 
 	sensors_register(&sensor);
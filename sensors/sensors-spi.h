@@ -14,18 +14,43 @@
 #ifndef _SENSORS_SPI_H_
 #define _SENSORS_SPI_H_
 
+#include <time.h>
 #include <spi.h>
 #include <spi-msg.h>
 
 
+/* Register block read by sensorsspi_readRegs() */
+typedef struct {
+	uint8_t cmd; /* register address with read bit */
+	uint8_t len;
+	void *buf;
+} sensorsspi_block_t;
+
+
 /* Performs SPI transfer with a sensor */
 extern int sensorsspi_xfer(const spimsg_ctx_t *ctx, oid_t *ss, const void *out, size_t olen, void *in, size_t ilen, size_t iskip);
 
 
+/* Performs SPI transfer with a sensor at given clock speed, ctx->speed is left unchanged */
+extern int sensorsspi_xferAt(const spimsg_ctx_t *ctx, unsigned int speed, oid_t *ss, const void *out, size_t olen, void *in, size_t ilen, size_t iskip);
+
+
+/* Reads register blocks at given clock speed, each block is a separate transaction sent in one message if possible */
+extern int sensorsspi_readRegs(const spimsg_ctx_t *ctx, unsigned int speed, oid_t *ss, const sensorsspi_block_t *blocks, size_t n);
+
+
 /* Initializes SPI sensor device communication */
 extern int sensorsspi_open(const char *devSPI, const char *devSS, oid_t *spi, oid_t *ss);
 
 
+/* Initializes sensor data-ready interrupt GPIO pin */
+extern int sensorsspi_openDrdy(const char *devDrdy, oid_t *drdy);
+
+
+/* Waits for sensor data-ready rising edge, returns number of edges since the last call and time of the last one */
+extern int sensorsspi_waitDrdy(oid_t *drdy, time_t *time);
+
+
 /* Initializes SPI sensors communication */
 extern int sensorsspi_init(void);
 
@@ -18,6 +18,7 @@
 #include <sys/msg.h>
 #include <sys/stat.h>
 #include <sys/list.h>
+#include <sys/mman.h>
 #include <sys/threads.h>
 #include <posix/utils.h>
 #include <sys/threads.h>
@@ -25,17 +26,45 @@
 #include <sensors-spi.h>
 
 #include "sensors.h"
+#include "simsensor_common/event_queue.h"
 
 #define CLIENT_SET_ID(id) (id + 1)
 #define CLIENT_GET_ID(id) (id - 1)
 
 #define NB_SENSOR_TYPES (sizeof(sensor_type_t) * 8)
 
+#ifndef SENSORS_QUEUE_MAX
+#define SENSORS_QUEUE_MAX 1024
+#endif
 
+#define THREAD_PRIORITY_STATS 6
+
+#define SENSORS_CONSUMERS_MAX 4
+
+
+/* Statistics of a single event slot, counters are updated without locking */
 typedef struct {
+	unsigned int devId;
+	time_t last;  /* timestamp of the last published event */
+	uint64_t sum; /* sum of intervals */
+	uint32_t cnt;
+	uint32_t min;
+	uint32_t max;
+	uint32_t lockMax;
+	uint32_t age[SENSORS_AGE_BINS];
+} slot_stats_t;
+
+
+typedef struct _sensor_client_t {
 	sensors_ops_t ops;
 	int refs;
 	idnode_t node;
+
+	/* Event queue, protected by sensors_common.qLock */
+	struct _sensor_client_t *next, *prev;
+	event_queue_t queue;
+	uint32_t drops;
+	int queued;
 } sensor_client_t;
 
 
@@ -44,24 +73,145 @@ struct {
 	idtree_t infos;   /* driver instances */
 	idtree_t clients; /* set of clients */
 
-	handle_t cLock;                          /* client's tree lock */
-	handle_t locks[NB_SENSOR_TYPES];         /* locks for each sensor type */
+	handle_t cLock;                         /* client's tree lock */
+	handle_t qLock;                         /* clients' event queues lock */
+	sensor_client_t *qClients;              /* clients with event queue enabled */
 	uint8_t evtNb[NB_SENSOR_TYPES];          /* number of events from all sensors */
-	sensor_event_t *events[NB_SENSOR_TYPES]; /* each row defines set of events of the same type */
+	sensors_slot_t *events[NB_SENSOR_TYPES]; /* each row defines set of events of the same type, in shm */
+	sensors_shm_t *shm;                      /* snapshot shared with clients */
+	slot_stats_t *stats[NB_SENSOR_TYPES];    /* statistics of events, same layout as events */
 
 	uint8_t **devEvents; /* events assign to each device */
+	unsigned int devNb;
+
+	/* in-server consumers of published events (e.g. fusion), set before drivers start */
+	struct {
+		sensor_info_t *info;
+		const sensor_drv_t *drv;
+	} consumers[SENSORS_CONSUMERS_MAX];
+	unsigned int consumerNb;
+
+	unsigned int statsPeriod; /* statistics logging period [s], 0 - disabled */
+	char statsStack[1024] __attribute__((aligned(8)));
 
 	oid_t oid;
 } sensors_common;
 
 
+/* Statistics */
+
+static void sensors_statsPublish(slot_stats_t *stats, time_t timestamp)
+{
+	time_t dt;
+
+	if (stats->cnt != 0) {
+		dt = timestamp - stats->last;
+		if (dt < 0) {
+			dt = 0;
+		}
+		else if (dt > UINT32_MAX) {
+			dt = UINT32_MAX;
+		}
+
+		if ((stats->cnt == 1) || (dt < stats->min)) {
+			stats->min = dt;
+		}
+		if (dt > stats->max) {
+			stats->max = dt;
+		}
+		stats->sum += dt;
+	}
+
+	stats->last = timestamp;
+	stats->cnt++;
+}
+
+
+static void sensors_statsAge(slot_stats_t *stats, const sensor_event_t *event, time_t now)
+{
+	time_t ms = (now - event->timestamp) / 1000;
+	unsigned int bin = 0;
+
+	if (ms > 0) {
+		bin = (ms >= (1 << (SENSORS_AGE_BINS - 1))) ? (SENSORS_AGE_BINS - 1) : (32 - __builtin_clz(ms));
+	}
+
+	stats->age[bin]++;
+}
+
+
+/* Returns statistics of the slot of `devId` for `type`, NULL if the device does not publish it */
+static slot_stats_t *sensors_statsFind(unsigned int devId, sensor_type_t type)
+{
+	uint8_t id = __builtin_ffs(type);
+	slot_stats_t *stats;
+
+	if ((id == 0) || (devId >= sensors_common.devNb) || (sensors_common.stats[--id] == NULL)) {
+		return NULL;
+	}
+
+	/* devEvents is 0 also for types not supported by the device */
+	stats = &sensors_common.stats[id][sensors_common.devEvents[devId][id]];
+
+	return (stats->devId == devId) ? stats : NULL;
+}
+
+
+static void sensors_statsThread(void *arg)
+{
+	int i, j;
+	const slot_stats_t *stats;
+
+	while (1) {
+		sleep(sensors_common.statsPeriod);
+
+		for (i = 0; i < NB_SENSOR_TYPES; ++i) {
+			for (j = 0; j < sensors_common.evtNb[i]; ++j) {
+				stats = &sensors_common.stats[i][j];
+				printf("sensors: dev %u type 0x%x: %u events, interval %u/%u/%u us, lock %u us\n",
+					stats->devId, 1u << i, stats->cnt, stats->min,
+					(stats->cnt > 1) ? (uint32_t)(stats->sum / (stats->cnt - 1)) : 0, stats->max, stats->lockMax);
+			}
+		}
+	}
+}
+
+
 /* Update data from sensors */
 
+static void sensors_queuePublish(const sensor_event_t *event)
+{
+	sensor_client_t *client;
+	sensor_event_t old;
+
+	mutexLock(sensors_common.qLock);
+	client = sensors_common.qClients;
+	if (client != NULL) {
+		do {
+			if ((client->ops.types & event->type) != 0) {
+				/* Drop the oldest event, the newest ones are more relevant */
+				if (eventQueue_full(&client->queue)) {
+					eventQueue_dequeue(&client->queue, &old);
+					client->drops++;
+				}
+				eventQueue_enqueue(&client->queue, event);
+			}
+			client = client->next;
+		} while (client != sensors_common.qClients);
+	}
+	mutexUnlock(sensors_common.qLock);
+}
+
+
 int sensors_publish(unsigned int devId, const sensor_event_t *event)
 {
-	int err = EOK;
 	uint8_t id = __builtin_ffs(event->type);
 	uint8_t evtId;
+	sensors_slot_t *slot;
+	slot_stats_t *stats;
+	uint32_t seq;
+	time_t start, end;
+	unsigned int i;
 
 	/*__builtin_ffs returns one plus the index of the least significant, otherwise 0 */
 	if (id == 0) {
@@ -71,19 +221,56 @@ int sensors_publish(unsigned int devId, const sensor_event_t *event)
 	--id;
 	evtId = sensors_common.devEvents[devId][id];
 
-	mutexLock(sensors_common.locks[id]);
-	if (id >= NB_SENSOR_TYPES || sensors_common.events[id] == NULL || sensors_common.evtNb[id] < evtId) {
-		err = -EINVAL;
+	if (id >= NB_SENSOR_TYPES || sensors_common.events[id] == NULL || sensors_common.evtNb[id] <= evtId) {
+		return -EINVAL;
 	}
-	memcpy(&sensors_common.events[id][evtId], event, sizeof(sensor_event_t));
-	mutexUnlock(sensors_common.locks[id]);
 
-	return err;
+	/* Slot is written only by its device, readers never wait for a preempted publisher */
+	slot = &sensors_common.events[id][evtId];
+	seq = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED) + 1;
+
+	/* smp_wmb: keep previous seq store ahead of overwriting the slot a reader may still be copying */
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(&slot->evt[seq & 1], event, sizeof(sensor_event_t));
+	__atomic_store_n(&slot->seq, seq, __ATOMIC_RELEASE);
+
+	stats = &sensors_common.stats[id][evtId];
+	sensors_statsPublish(stats, event->timestamp);
+
+	if (__atomic_load_n(&sensors_common.qClients, __ATOMIC_RELAXED) != NULL) {
+		gettime(&start, NULL);
+		sensors_queuePublish(event);
+		gettime(&end, NULL);
+
+		if (end - start > stats->lockMax) {
+			stats->lockMax = end - start;
+		}
+	}
+
+	/* Consumers may publish their own events from here, they don't get them back */
+	for (i = 0; i < sensors_common.consumerNb; ++i) {
+		if (sensors_common.consumers[i].info->id != devId) {
+			sensors_common.consumers[i].drv->consume(sensors_common.consumers[i].info, devId, event);
+		}
+	}
+
+	return EOK;
 }
 
 
 /* Handle messages */
 
+static const sensor_drv_t *sensors_getDrv(const char *name)
+{
+	sensor_drv_t drv;
+
+	strncpy(drv.name, name, sizeof(drv.name));
+	drv.name[sizeof(drv.name) - 1] = '\0';
+
+	return lib_treeof(sensor_drv_t, node, lib_rbFind(&sensors_common.drvs, &drv.node));
+}
+
+
 static sensor_client_t *sensors_clientFind(id_t id)
 {
 	sensor_client_t *client;
@@ -111,11 +298,88 @@ static void sensors_clientPut(sensor_client_t *client)
 	mutexUnlock(sensors_common.cLock);
 
 	if (refs <= 0) {
+		mutexLock(sensors_common.qLock);
+		if (client->queued != 0) {
+			LIST_REMOVE(&sensors_common.qClients, client);
+		}
+		mutexUnlock(sensors_common.qLock);
+
+		eventQueue_free(&client->queue);
 		free(client);
 	}
 }
 
 
+static int sensors_queueSet(sensor_client_t *client, sensors_queue_t *q)
+{
+	event_queue_t queue, old;
+
+	if (q->depth > SENSORS_QUEUE_MAX) {
+		return -EINVAL;
+	}
+
+	memset(&queue, 0, sizeof(queue));
+	if ((q->depth != 0) && (eventQueue_init(&queue, q->depth) < 0)) {
+		return -ENOMEM;
+	}
+
+	mutexLock(sensors_common.qLock);
+	old = client->queue;
+	client->queue = queue;
+	q->drops = client->drops;
+	client->drops = 0;
+
+	if ((q->depth != 0) && (client->queued == 0)) {
+		LIST_ADD(&sensors_common.qClients, client);
+		client->queued = 1;
+	}
+	else if ((q->depth == 0) && (client->queued != 0)) {
+		LIST_REMOVE(&sensors_common.qClients, client);
+		client->queued = 0;
+	}
+	mutexUnlock(sensors_common.qLock);
+
+	eventQueue_free(&old);
+
+	return EOK;
+}
+
+
+static ssize_t sensors_queueRead(sensor_client_t *client, sensors_qdata_t *data, size_t sz)
+{
+	size_t n = 0, i, max;
+	slot_stats_t *stats;
+	time_t now;
+
+	if (sz < sizeof(sensors_qdata_t)) {
+		return -EINVAL;
+	}
+
+	max = (sz - sizeof(sensors_qdata_t)) / sizeof(sensor_event_t);
+
+	mutexLock(sensors_common.qLock);
+	while ((n < max) && (eventQueue_dequeue(&client->queue, &data->events[n]) == 0)) {
+		++n;
+	}
+	data->drops = client->drops;
+	client->drops = 0;
+	mutexUnlock(sensors_common.qLock);
+
+	gettime(&now, NULL);
+	for (i = 0; i < n; ++i) {
+		/* devId is the first member of all event data types */
+		stats = sensors_statsFind(data->events[i].accels.devId, data->events[i].type);
+		if (stats != NULL) {
+			sensors_statsAge(stats, &data->events[i], now);
+		}
+	}
+
+	data->size = n;
+
+	return sizeof(sensors_qdata_t) + n * sizeof(sensor_event_t);
+}
+
+
 static int sensors_open(void)
 {
 	int res;
@@ -162,9 +426,10 @@ static ssize_t sensors_read(sensors_data_t *data, size_t sz, id_t clientID)
 	uint8_t id;
 	ssize_t res = -EINVAL;
 	sensor_type_t types;
-	size_t tempSz = 0, evtNb, chunkSz;
+	size_t tempSz = 0, evtNb, chunkSz, i;
 	sensor_client_t *client;
 	sensor_event_t *events;
+	time_t now;
 
 	if (data == NULL) {
 		return res;
@@ -178,8 +443,13 @@ static ssize_t sensors_read(sensors_data_t *data, size_t sz, id_t clientID)
 	events = data->events;
 
 	client = sensors_clientFind(clientID);
-	if (client != NULL) {
+	if ((client != NULL) && (client->queued != 0)) {
+		res = sensors_queueRead(client, (sensors_qdata_t *)data, sz);
+		sensors_clientPut(client);
+	}
+	else if (client != NULL) {
 		types = client->ops.types;
+		gettime(&now, NULL);
 		/* Iterate only through available sensors for a client */
 		for (id = __builtin_ffs(types); id != 0; types &= ~(1 << (id - 1)), id = __builtin_ffs(types)) {
 			evtNb = sensors_common.evtNb[id - 1];
@@ -188,9 +458,10 @@ static ssize_t sensors_read(sensors_data_t *data, size_t sz, id_t clientID)
 				break;
 			}
 
-			mutexLock(sensors_common.locks[id - 1]);
-			memcpy(events, sensors_common.events[id - 1], chunkSz);
-			mutexUnlock(sensors_common.locks[id - 1]);
+			for (i = 0; i < evtNb; ++i) {
+				sensors_slotRead(&sensors_common.events[id - 1][i], &events[i]);
+				sensors_statsAge(&sensors_common.stats[id - 1][i], &events[i], now);
+			}
 
 			events += evtNb;
 			tempSz += chunkSz;
@@ -244,6 +515,13 @@ static void sensors_ioctl(msg_t *msg)
 	sensors_ops_t ops;
 	sensor_type_t types = 0;
 	sensor_client_t *client;
+	sensors_map_t map;
+	sensors_queue_t queue;
+	sensors_stats_t stats;
+	const slot_stats_t *slotStats;
+	const sensors_calib_t *calib;
+	sensor_info_t *info;
+	const sensor_drv_t *drv;
 	void *outData = NULL;
 
 	const void *inData = ioctl_unpack(msg, &req, &id);
@@ -272,6 +550,51 @@ static void sensors_ioctl(msg_t *msg)
 				outData = (void *)&types;
 				break;
 
+			case SMIOC_SENSORSMAP:
+				if (sensors_common.shm == NULL) {
+					err = -ENOMEM;
+					break;
+				}
+				map.addr = va2pa(sensors_common.shm);
+				map.size = sensors_common.shm->size;
+				outData = (void *)&map;
+				break;
+
+			case SMIOC_SENSORSQUEUE:
+				queue = *(const sensors_queue_t *)inData;
+				err = sensors_queueSet(client, &queue);
+				outData = (void *)&queue;
+				break;
+
+			case SMIOC_SENSORSSTATS:
+				stats = *(const sensors_stats_t *)inData;
+				slotStats = sensors_statsFind(stats.devId, stats.type);
+				if ((slotStats == NULL) || ((stats.type & (stats.type - 1)) != 0)) {
+					err = -EINVAL;
+					break;
+				}
+
+				stats.cnt = slotStats->cnt;
+				stats.intervalMin = slotStats->min;
+				stats.intervalAvg = (slotStats->cnt > 1) ? (uint32_t)(slotStats->sum / (slotStats->cnt - 1)) : 0;
+				stats.intervalMax = slotStats->max;
+				stats.lockMax = slotStats->lockMax;
+				memcpy(stats.age, slotStats->age, sizeof(stats.age));
+				outData = (void *)&stats;
+				break;
+
+			case SMIOC_SENSORSCALIB:
+				calib = (const sensors_calib_t *)inData;
+				info = lib_treeof(sensor_info_t, node, idtree_find(&sensors_common.infos, calib->devId));
+				if ((info == NULL) || ((info->types & calib->type) == 0)) {
+					err = -EINVAL;
+					break;
+				}
+
+				drv = sensors_getDrv(info->drv);
+				err = ((drv != NULL) && (drv->calib != NULL)) ? drv->calib(info, calib) : -ENOTSUP;
+				break;
+
 			default:
 				break;
 		}
@@ -334,17 +657,6 @@ static int sensors_cmpDrvs(rbnode_t *n1, rbnode_t *n2)
 }
 
 
-static const sensor_drv_t *sensors_getDrv(const char *name)
-{
-	sensor_drv_t drv;
-
-	strncpy(drv.name, name, sizeof(drv.name));
-	drv.name[sizeof(drv.name) - 1] = '\0';
-
-	return lib_treeof(sensor_drv_t, node, lib_rbFind(&sensors_common.drvs, &drv.node));
-}
-
-
 void sensors_register(const sensor_drv_t *drv)
 {
 	if (lib_rbInsert(&sensors_common.drvs, (rbnode_t *)&drv->node) != NULL) {
@@ -359,6 +671,25 @@ static void sensors_run(void)
 	sensor_info_t *info;
 	const sensor_drv_t *drv;
 
+	/* Consumers list is read without locking, complete it before any driver publishes */
+	for (node = lib_rbMinimum(sensors_common.infos.root); node != NULL; node = lib_rbNext(node)) {
+		info = lib_treeof(sensor_info_t, node, node);
+
+		drv = sensors_getDrv(info->drv);
+		if ((drv == NULL) || (drv->consume == NULL)) {
+			continue;
+		}
+
+		if (sensors_common.consumerNb >= SENSORS_CONSUMERS_MAX) {
+			fprintf(stderr, "sensors: too many event consumers, %s ignored\n", info->drv);
+			continue;
+		}
+
+		sensors_common.consumers[sensors_common.consumerNb].info = info;
+		sensors_common.consumers[sensors_common.consumerNb].drv = drv;
+		sensors_common.consumerNb++;
+	}
+
 	for (node = lib_rbMinimum(sensors_common.infos.root); node != NULL; node = lib_rbNext(node)) {
 		info = lib_treeof(sensor_info_t, node, node);
 
@@ -381,16 +712,19 @@ static void sensors_help(const char *prog)
 	printf("\t-s <name:args>          - initialize new sensor\n");
 	printf("\t\tname:    name of the sensor driver\n");
 	printf("\t\targs:    arguments passed to the sensor driver\n");
+	printf("\t-t <period>             - log publishing statistics every period seconds\n");
 	printf("\t-h                      - print this help message\n");
 }
 
 
 static int sensors_initEvts(int devsz)
 {
-	int i, j, res;
+	int i, j;
 	unsigned int id;
 	rbnode_t *node;
 	const sensor_info_t *info;
+	sensors_shm_t *shm;
+	size_t size, offs;
 
 	if (devsz <= 0) {
 		fprintf(stderr, "sensors: wrong device number\n");
@@ -426,22 +760,53 @@ static int sensors_initEvts(int devsz)
 		}
 	}
 
-	/* Allocate memory for events tables */
+	/* Allocate events tables in one snapshot shared with clients */
+	size = (sizeof(sensors_shm_t) + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
+	for (i = 0; i < NB_SENSOR_TYPES; ++i) {
+		size += sensors_common.evtNb[i] * sizeof(sensors_slot_t);
+	}
+
+	shm = mmap(NULL, (size + _PAGE_SIZE - 1) & ~(_PAGE_SIZE - 1), PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_CONTIGUOUS, -1, 0);
+	if (shm == MAP_FAILED) {
+		fprintf(stderr, "sensors: cannot allocate memory for events\n");
+		return -ENOMEM;
+	}
+
+	memset(shm, 0, size);
+	shm->magic = SENSORS_SHM_MAGIC;
+	shm->size = size;
+
+	offs = (sizeof(sensors_shm_t) + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
+	for (i = 0; i < NB_SENSOR_TYPES; ++i) {
+		if (sensors_common.evtNb[i] != 0) {
+			sensors_common.events[i] = (sensors_slot_t *)((uint8_t *)shm + offs);
+			shm->slotOffs[i] = offs;
+			shm->slotNb[i] = sensors_common.evtNb[i];
+			offs += sensors_common.evtNb[i] * sizeof(sensors_slot_t);
+		}
+	}
+	sensors_common.shm = shm;
+
 	for (i = 0; i < NB_SENSOR_TYPES; ++i) {
 		if (sensors_common.evtNb[i] != 0) {
-			sensors_common.events[i] = malloc(sizeof(sensor_event_t) * sensors_common.evtNb[i]);
-			if (sensors_common.events[i] == NULL) {
-				fprintf(stderr, "sensors: cannot allocate memory for events\n");
-				continue;
+			sensors_common.stats[i] = calloc(sensors_common.evtNb[i], sizeof(slot_stats_t));
+			if (sensors_common.stats[i] == NULL) {
+				fprintf(stderr, "sensors: cannot allocate memory for statistics\n");
+				return -ENOMEM;
 			}
+		}
+	}
+
+	for (node = lib_rbMinimum(sensors_common.infos.root), i = 0; node != NULL; node = lib_rbNext(node), ++i) {
+		info = lib_treeof(sensor_info_t, node, node);
 
-			res = mutexCreate(&sensors_common.locks[i]);
-			if (res < 0) {
-				free(sensors_common.events[i]);
-				fprintf(stderr, "sensors: cannot create lock\n");
+		for (j = 0; j < NB_SENSOR_TYPES; ++j) {
+			if ((info->types & (1 << j)) != 0) {
+				sensors_common.stats[j][sensors_common.devEvents[i][j]].devId = info->id;
 			}
 		}
 	}
+	sensors_common.devNb = devsz;
 
 	return EOK;
 }
@@ -492,7 +857,7 @@ static int sensors_parseArgs(int argc, char **argv)
 	char *args;
 	const char *name;
 
-	while ((c = getopt(argc, argv, "s:h")) != -1) {
+	while ((c = getopt(argc, argv, "s:t:h")) != -1) {
 		switch (c) {
 			case 's': /* <sensor:args> */
 				name = optarg;
@@ -508,6 +873,10 @@ static int sensors_parseArgs(int argc, char **argv)
 				}
 				break;
 
+			case 't':
+				sensors_common.statsPeriod = strtoul(optarg, NULL, 10);
+				break;
+
 			case 'h':
 				sensors_help(argv[0]);
 				return 0;
@@ -565,16 +934,18 @@ void sensors_cleanup(size_t devsz)
 		free(sensors_common.devEvents);
 	}
 
-	/* Free sensor table and destroy mutexex */
+	/* Free sensor tables */
+	if (sensors_common.shm != NULL) {
+		munmap(sensors_common.shm, (sensors_common.shm->size + _PAGE_SIZE - 1) & ~(_PAGE_SIZE - 1));
+		sensors_common.shm = NULL;
+	}
 	for (i = 0; i < NB_SENSOR_TYPES; ++i) {
-		if (sensors_common.events[i] != NULL) {
-			free(sensors_common.events[i]);
-		}
-
-		if (sensors_common.evtNb[i] != 0) {
-			resourceDestroy(sensors_common.locks[i]);
-		}
+		sensors_common.events[i] = NULL;
+		free(sensors_common.stats[i]);
+		sensors_common.stats[i] = NULL;
 	}
+	sensors_common.devNb = 0;
+	sensors_common.consumerNb = 0;
 
 	/* Free sensor information data */
 	for (node = lib_rbMinimum(sensors_common.infos.root); node != NULL; node = lib_rbNext(node)) {
@@ -589,9 +960,12 @@ void sensors_cleanup(size_t devsz)
 		client = lib_treeof(sensor_client_t, node, node);
 
 		idtree_remove(&sensors_common.clients, &client->node);
+		eventQueue_free(&client->queue);
 		free(client);
 	}
+	sensors_common.qClients = NULL;
 
+	resourceDestroy(sensors_common.qLock);
 	resourceDestroy(sensors_common.cLock);
 }
 
@@ -606,6 +980,12 @@ int main(int argc, char **argv)
 		return EXIT_FAILURE;
 	}
 
+	res = mutexCreate(&sensors_common.qLock);
+	if (res < 0) {
+		sensors_cleanup(0);
+		return EXIT_FAILURE;
+	}
+
 	res = sensorsspi_init();
 	if (res < 0) {
 		sensors_cleanup(0);
@@ -629,6 +1009,11 @@ int main(int argc, char **argv)
 	priority(THREAD_PRIORITY_MSGSRV);
 
 	sensors_run();
+
+	if (sensors_common.statsPeriod != 0) {
+		beginthread(sensors_statsThread, THREAD_PRIORITY_STATS, sensors_common.statsStack, sizeof(sensors_common.statsStack), NULL);
+	}
+
 	sensors_msgThread();
 
 	return EXIT_SUCCESS;
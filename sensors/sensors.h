@@ -37,9 +37,13 @@ typedef struct {
 
 /* Basic operations on sensors */
 typedef struct {
-	char name[16];                                       /* device name */
-	int (*alloc)(sensor_info_t *info, const char *args); /* alloc sensor and initialize driver */
-	int (*start)(sensor_info_t *info);                   /* start measurement thread */
+	char name[16];                                                 /* device name */
+	int (*alloc)(sensor_info_t *info, const char *args);           /* alloc sensor and initialize driver */
+	int (*start)(sensor_info_t *info);                             /* start measurement thread */
+	int (*calib)(sensor_info_t *info, const sensors_calib_t *cal); /* optional, apply calibration in driver */
+
+	/* optional, called in the publisher's context with events of all other devices */
+	void (*consume)(sensor_info_t *info, unsigned int devId, const sensor_event_t *event);
 	rbnode_t node;
 } sensor_drv_t;
 
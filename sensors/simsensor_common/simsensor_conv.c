@@ -0,0 +1,31 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Converts text simsensor scenario into binary one, which is mapped by simsensors without parsing
+ *
+ * Copyright 2024 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <stdio.h>
+
+#include "simsensor_reader.h"
+
+
+int main(int argc, char **argv)
+{
+	if (argc != 3) {
+		fprintf(stderr, "Usage: %s <scenario.csv> <scenario.bin>\n", argv[0]);
+		return 1;
+	}
+
+	if (reader_convert(argv[1], argv[2]) != 0) {
+		fprintf(stderr, "%s: conversion of %s failed\n", argv[0], argv[1]);
+		return 1;
+	}
+
+	return 0;
+}
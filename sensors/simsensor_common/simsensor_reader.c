@@ -19,6 +19,8 @@
 #include <sys/types.h>
 #include <string.h>
 #include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "simsensor_reader.h"
 
@@ -298,6 +300,87 @@ static int reader_tempDataParse(const char *data, time_t timestamp, sensor_event
 }
 
 
+static int reader_dataParse(sensor_type_t sensorID, const char *data, time_t timestamp, sensor_event_t *result)
+{
+	switch (sensorID) {
+		case SENSOR_TYPE_ACCEL:
+			return reader_accelDataParse(data, timestamp, result);
+		case SENSOR_TYPE_BARO:
+			return reader_baroDataParse(data, timestamp, result);
+		case SENSOR_TYPE_GPS:
+			return reader_gpsDataParse(data, timestamp, result);
+		case SENSOR_TYPE_GYRO:
+			return reader_gyroDataParse(data, timestamp, result);
+		case SENSOR_TYPE_MAG:
+			return reader_magDataParse(data, timestamp, result);
+		case SENSOR_TYPE_TEMP:
+			return reader_tempDataParse(data, timestamp, result);
+		default:
+			fprintf(stderr, "%s: Unknown sensor type: %d\n", __FUNCTION__, sensorID);
+			return -1;
+	}
+}
+
+
+/* Updates reader timeline with scenario `timestamp`, returns it shifted to the current time */
+static time_t reader_timeline(simsens_reader_t *rd, time_t timestamp)
+{
+	/* Increasing timeOffset on scenario timestamp decrease (as on file loop) */
+	if (timestamp < rd->timeLast && rd->timeLast != READER_TIMESTAMP_NOT_SET) {
+		rd->timeOffset += rd->timeLast - timestamp;
+	}
+	rd->timeLast = timestamp;
+
+	return timestamp + rd->timeOffset;
+}
+
+
+/* Copies events from mapped binary scenario, no parsing is needed */
+static int reader_binRead(simsens_reader_t *rd, event_queue_t *queue)
+{
+	const sensor_event_t *evt;
+	size_t skipped = 0;
+	time_t timestamp, timeStart = READER_TIMESTAMP_NOT_SET;
+	sensor_event_t event;
+
+	while ((eventQueue_full(queue) == 0) && (skipped < rd->binCnt)) {
+		if (rd->binPos >= rd->binCnt) {
+			rd->binPos = 0;
+		}
+
+		evt = &rd->binEvts[rd->binPos];
+
+		if ((evt->type & rd->sensorTypes) == 0) {
+			if (evt->type == READER_STOP_EVENT) {
+				return eventQueue_enqueue(queue, evt);
+			}
+			rd->binPos++;
+			skipped++;
+
+			continue;
+		}
+
+		timestamp = reader_timeline(rd, evt->timestamp);
+		if (timeStart == READER_TIMESTAMP_NOT_SET) {
+			timeStart = timestamp;
+		}
+
+		if (timestamp - timeStart > rd->timeHorizon) {
+			break;
+		}
+
+		event = *evt;
+		event.timestamp = timestamp;
+		if (eventQueue_enqueue(queue, &event) < 0) {
+			return -1;
+		}
+		rd->binPos++;
+	}
+
+	return 0;
+}
+
+
 int reader_read(simsens_reader_t *rd, event_queue_t *queue)
 {
 	const char *actField;
@@ -312,6 +395,10 @@ int reader_read(simsens_reader_t *rd, event_queue_t *queue)
 		return -1;
 	}
 
+	if (rd->binEvts != NULL) {
+		return reader_binRead(rd, queue);
+	}
+
 	while ((eventQueue_full(queue) == 0) && (emptyIter > 0)) {
 		lineLen = getline(&rd->lineBuf, &rd->bufLen, rd->scenarioFile);
 		if (lineLen == -1) {
@@ -358,14 +445,7 @@ int reader_read(simsens_reader_t *rd, event_queue_t *queue)
 			err = -1;
 			break;
 		}
-		timestamp = tmp;
-
-		/* Increasing timeOffset on scenario timestamp decrease (as on file loop) */
-		if (timestamp < rd->timeLast && rd->timeLast != READER_TIMESTAMP_NOT_SET) {
-			rd->timeOffset += rd->timeLast - timestamp;
-		}
-		rd->timeLast = timestamp;
-		timestamp += rd->timeOffset;
+		timestamp = reader_timeline(rd, tmp);
 
 		if (timeStart == READER_TIMESTAMP_NOT_SET) {
 			timeStart = timestamp;
@@ -379,31 +459,7 @@ int reader_read(simsens_reader_t *rd, event_queue_t *queue)
 			break;
 		}
 
-		switch (sensorID) {
-			case SENSOR_TYPE_ACCEL:
-				err = reader_accelDataParse(actField, timestamp, &parsed);
-				break;
-			case SENSOR_TYPE_BARO:
-				err = reader_baroDataParse(actField, timestamp, &parsed);
-				break;
-			case SENSOR_TYPE_GPS:
-				err = reader_gpsDataParse(actField, timestamp, &parsed);
-				break;
-			case SENSOR_TYPE_GYRO:
-				err = reader_gyroDataParse(actField, timestamp, &parsed);
-				break;
-			case SENSOR_TYPE_MAG:
-				err = reader_magDataParse(actField, timestamp, &parsed);
-				break;
-			case SENSOR_TYPE_TEMP:
-				err = reader_tempDataParse(actField, timestamp, &parsed);
-				break;
-			default:
-				fprintf(stderr, "%s: Unknown sensor type: %d\n", __FUNCTION__, sensorID);
-				err = -1;
-				break;
-		}
-
+		err = reader_dataParse(sensorID, actField, timestamp, &parsed);
 		if (err != 0) {
 			break;
 		}
@@ -429,16 +485,61 @@ void reader_close(simsens_reader_t *reader)
 		reader->scenarioFile = NULL;
 	}
 
+	if (reader->binMap != NULL) {
+		munmap(reader->binMap, reader->binMapLen);
+		reader->binMap = NULL;
+		reader->binEvts = NULL;
+	}
+
 	free(reader->lineBuf);
 	reader->lineBuf = NULL;
 }
 
 
+static int reader_binOpen(simsens_reader_t *rd, const simsens_binhdr_t *hdr)
+{
+	struct stat st;
+	time_t act_time;
+	void *map;
+
+	if (hdr->version != READER_BIN_VERSION || hdr->evtSize != sizeof(sensor_event_t) || hdr->cnt == 0) {
+		fprintf(stderr, "simsensor: incompatible binary scenario\n");
+		return -1;
+	}
+
+	if (fstat(fileno(rd->scenarioFile), &st) < 0 || st.st_size < sizeof(*hdr) + (size_t)hdr->cnt * sizeof(sensor_event_t)) {
+		fprintf(stderr, "simsensor: truncated binary scenario\n");
+		return -1;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fileno(rd->scenarioFile), 0);
+	if (map == MAP_FAILED) {
+		return -1;
+	}
+
+	/* Mapping stays valid after the file is closed */
+	fclose(rd->scenarioFile);
+	rd->scenarioFile = NULL;
+
+	rd->binMap = map;
+	rd->binMapLen = st.st_size;
+	rd->binEvts = (const sensor_event_t *)((const uint8_t *)map + sizeof(*hdr));
+	rd->binCnt = hdr->cnt;
+	rd->binPos = 0;
+
+	gettime(&act_time, NULL);
+	rd->timeOffset = act_time - rd->binEvts[0].timestamp;
+
+	return 0;
+}
+
+
 int reader_open(simsens_reader_t *rd, const char *path, sensor_type_t sensorTypes, time_t timeHorizon)
 {
 	ssize_t lineLen;
 	time_t act_time;
 	const char *p;
+	simsens_binhdr_t hdr;
 
 	if (rd == NULL || path == NULL) {
 		return -1;
@@ -455,6 +556,18 @@ int reader_open(simsens_reader_t *rd, const char *path, sensor_type_t sensorType
 	rd->timeHorizon = timeHorizon;
 	rd->timeLast = READER_TIMESTAMP_NOT_SET;
 	rd->headerLen = 0;
+	rd->binMap = NULL;
+	rd->binEvts = NULL;
+
+	if (fread(&hdr, sizeof(hdr), 1, rd->scenarioFile) == 1 && hdr.magic == READER_BIN_MAGIC) {
+		if (reader_binOpen(rd, &hdr) != 0) {
+			reader_close(rd);
+			return -1;
+		}
+
+		return 0;
+	}
+	rewind(rd->scenarioFile);
 
 	lineLen = getline(&rd->lineBuf, &rd->bufLen, rd->scenarioFile);
 	if (lineLen < 1) {
@@ -499,3 +612,88 @@ int reader_open(simsens_reader_t *rd, const char *path, sensor_type_t sensorType
 
 	return 0;
 }
+
+
+int reader_convert(const char *src, const char *dst)
+{
+	FILE *in, *out;
+	char *line = NULL;
+	size_t len = 0;
+	ssize_t lineLen;
+	const char *actField;
+	long long tmp;
+	sensor_type_t sensorID;
+	sensor_event_t parsed;
+	simsens_binhdr_t hdr = {
+		.magic = READER_BIN_MAGIC,
+		.version = READER_BIN_VERSION,
+		.evtSize = sizeof(sensor_event_t),
+		.cnt = 0
+	};
+	int err = 0;
+
+	in = fopen(src, "r");
+	if (in == NULL) {
+		return -1;
+	}
+
+	out = fopen(dst, "w");
+	if (out == NULL) {
+		fclose(in);
+		return -1;
+	}
+
+	/* Header is rewritten with final count at the end */
+	if (fwrite(&hdr, sizeof(hdr), 1, out) != 1) {
+		err = -1;
+	}
+
+	while (err == 0 && (lineLen = getline(&line, &len, in)) > 0) {
+		/* Omitting file header */
+		if (line[0] == 's' || line[0] == 'S') {
+			continue;
+		}
+
+		actField = line;
+		if (reader_getFieldLLong(&actField, &tmp) < 0) {
+			err = -1;
+			break;
+		}
+		sensorID = tmp;
+
+		memset(&parsed, 0, sizeof(parsed));
+		if (sensorID == READER_END_SCENARIO_INDICATOR) {
+			parsed.type = READER_STOP_EVENT;
+		}
+		else if (reader_getFieldLLong(&actField, &tmp) < 0 || reader_dataParse(sensorID, actField, tmp, &parsed) < 0) {
+			err = -1;
+			break;
+		}
+
+		if (fwrite(&parsed, sizeof(parsed), 1, out) != 1) {
+			err = -1;
+			break;
+		}
+		hdr.cnt++;
+
+		if (sensorID == READER_END_SCENARIO_INDICATOR) {
+			break;
+		}
+	}
+
+	if (err == 0 && !feof(in) && ferror(in)) {
+		err = -1;
+	}
+
+	if (err == 0 && (fseek(out, 0, SEEK_SET) != 0 || fwrite(&hdr, sizeof(hdr), 1, out) != 1)) {
+		err = -1;
+	}
+
+	free(line);
+	fclose(in);
+	if (fclose(out) != 0) {
+		err = -1;
+	}
+
+	return err;
+}
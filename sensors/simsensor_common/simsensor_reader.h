@@ -15,18 +15,37 @@
 #ifndef SIMSENSOR_READER_H
 #define SIMSENSOR_READER_H
 
+#include <stdint.h>
 #include <time.h>
 
 #include "event_queue.h"
 
 #define READER_STOP_EVENT 0
 
+/* Binary scenario: header followed by `cnt` packed sensor_event_t records in timestamp order */
+#define READER_BIN_MAGIC   0x31455353 /* "SSE1" */
+#define READER_BIN_VERSION 1
+
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t evtSize; /* sizeof(sensor_event_t) of the converter */
+	uint32_t cnt;
+} simsens_binhdr_t;
+
 
 typedef struct {
 	FILE *scenarioFile;
 	ssize_t headerLen;
 	sensor_type_t sensorTypes;
 
+	void *binMap; /* Mapped binary scenario, NULL for text scenario */
+	size_t binMapLen;
+	const sensor_event_t *binEvts;
+	size_t binCnt;
+	size_t binPos;
+
 	time_t timeHorizon;
 
 	char *lineBuf; /* Buffer for storing line from file */
@@ -43,7 +62,8 @@ typedef struct {
  * `sensorType` tells what types of readings are parsed from test file. Argument can be a logical or of different types
  * `timeHorizon` - max difference between first and last reader timestamp in single `reader_read` execution
  *
- * Successful open initialises timeline of sensor reader
+ * Successful open initialises timeline of sensor reader.
+ * Binary scenario (see `reader_convert`) is recognised by its magic and mapped into memory.
  */
 extern int reader_open(simsens_reader_t *rd, const char *path, sensor_type_t sensorTypes, time_t timeHorizon);
 
@@ -56,4 +76,11 @@ extern void reader_close(simsens_reader_t *reader);
 extern int reader_read(simsens_reader_t *rd, event_queue_t *queue);
 
 
+/*
+ * Converts text scenario `src` into binary scenario `dst`, which `reader_open` maps instead of parsing.
+ * Timestamps are stored as in the source file. On success returns 0, on error returns -1.
+ */
+extern int reader_convert(const char *src, const char *dst);
+
+
 #endif
@@ -75,6 +75,162 @@ int spimsg_xfer(const spimsg_ctx_t *ctx, const void *out, size_t olen, void *in,
 }
 
 
+int spimsg_batch(const spimsg_ctx_t *ctx, const spimsg_seg_t *segs, size_t nsegs, const void *out, void *in)
+{
+	msg_t msg;
+	spi_devctl_t *idevctl = (spi_devctl_t *)msg.i.raw;
+	unsigned char buff[SPIMSG_BATCH_SIZE];
+	size_t i, olen = 0, ilen = 0;
+	int err;
+
+	if ((ctx == NULL) || (segs == NULL) || (nsegs == 0) || (nsegs > SPIMSG_BATCH_SEGS)) {
+		return -EINVAL;
+	}
+
+	for (i = 0; i < nsegs; i++) {
+		olen += segs[i].olen;
+		ilen += segs[i].ilen;
+	}
+
+	if (nsegs * sizeof(spimsg_seg_t) + olen > sizeof(buff)) {
+		return -EINVAL;
+	}
+
+	/* Segments are followed by the output data */
+	memcpy(buff, segs, nsegs * sizeof(spimsg_seg_t));
+	if (olen > 0) {
+		memcpy(buff + nsegs * sizeof(spimsg_seg_t), out, olen);
+	}
+
+	msg.type = mtDevCtl;
+	msg.i.data = buff;
+	msg.i.size = nsegs * sizeof(spimsg_seg_t) + olen;
+	msg.o.data = in;
+	msg.o.size = ilen;
+	msg.oid = ctx->oid;
+
+	idevctl->i.type = spi_devctl_batch;
+	idevctl->i.ctx = *ctx;
+	idevctl->i.batch.nsegs = nsegs;
+	idevctl->i.batch.isize = msg.i.size;
+	idevctl->i.batch.osize = ilen;
+
+	err = msgSend(ctx->oid.port, &msg);
+	if (err < 0) {
+		return err;
+	}
+
+	return msg.o.err;
+}
+
+
+int spimsg_xferv(const spimsg_ctx_t *ctx, const spimsg_iov_t *iov, size_t n)
+{
+	msg_t msg;
+	spi_devctl_t *idevctl = (spi_devctl_t *)msg.i.raw;
+	unsigned char ibuff[SPIMSG_BATCH_SIZE], obuff[SPIMSG_BATCH_SIZE];
+	unsigned char *idata = ibuff, *odata = obuff, *p;
+	spimsg_seg_t *segs;
+	size_t i, olen = 0, ilen = 0, nin = 0, isize;
+	void *in = NULL;
+	int err;
+
+	if ((ctx == NULL) || (iov == NULL) || (n == 0) || (n > SPIMSG_BATCH_SEGS)) {
+		return -EINVAL;
+	}
+
+	/* Single transaction goes through the plain transfer */
+	if ((n == 1) && (iov[0].flags == 0) && (iov[0].delay == 0)) {
+		return spimsg_xfer(ctx, iov[0].out, iov[0].olen, iov[0].in, iov[0].ilen, iov[0].iskip);
+	}
+
+	for (i = 0; i < n; i++) {
+		if ((iov[i].olen > UINT16_MAX) || (iov[i].ilen > UINT16_MAX) || (iov[i].iskip > UINT16_MAX) || (iov[i].delay > UINT16_MAX)) {
+			return -EINVAL;
+		}
+		olen += iov[i].olen;
+		ilen += iov[i].ilen;
+		if (iov[i].ilen != 0) {
+			in = iov[i].in;
+			nin++;
+		}
+	}
+
+	isize = n * sizeof(spimsg_seg_t) + olen;
+	if (isize > sizeof(ibuff)) {
+		idata = malloc(isize);
+		if (idata == NULL) {
+			return -ENOMEM;
+		}
+	}
+
+	/* Input of a single reading segment doesn't need scattering */
+	if (nin == 1) {
+		odata = in;
+	}
+	else if (ilen > sizeof(obuff)) {
+		odata = malloc(ilen);
+		if (odata == NULL) {
+			if (idata != ibuff) {
+				free(idata);
+			}
+			return -ENOMEM;
+		}
+	}
+
+	/* Segments are followed by the output data */
+	segs = (spimsg_seg_t *)idata;
+	p = idata + n * sizeof(spimsg_seg_t);
+	for (i = 0; i < n; i++) {
+		segs[i].olen = iov[i].olen;
+		segs[i].ilen = iov[i].ilen;
+		segs[i].iskip = iov[i].iskip;
+		segs[i].flags = iov[i].flags;
+		segs[i].delay = iov[i].delay;
+		if (iov[i].olen != 0) {
+			memcpy(p, iov[i].out, iov[i].olen);
+			p += iov[i].olen;
+		}
+	}
+
+	msg.type = mtDevCtl;
+	msg.i.data = idata;
+	msg.i.size = isize;
+	msg.o.data = (ilen != 0) ? odata : NULL;
+	msg.o.size = ilen;
+	msg.oid = ctx->oid;
+
+	idevctl->i.type = spi_devctl_batch;
+	idevctl->i.ctx = *ctx;
+	idevctl->i.batch.nsegs = n;
+	idevctl->i.batch.isize = isize;
+	idevctl->i.batch.osize = ilen;
+
+	err = msgSend(ctx->oid.port, &msg);
+	if (err >= 0) {
+		err = msg.o.err;
+	}
+
+	if ((err >= 0) && (nin > 1)) {
+		for (i = 0, p = odata; i < n; p += iov[i].ilen, i++) {
+			if (iov[i].ilen != 0) {
+				memcpy(iov[i].in, p, iov[i].ilen);
+			}
+		}
+	}
+
+	if (idata != ibuff) {
+		free(idata);
+	}
+
+	if ((odata != obuff) && (nin != 1)) {
+		free(odata);
+	}
+
+	return err;
+}
+
+
 int spimsg_close(const spimsg_ctx_t *ctx)
 {
 	if (ctx == NULL) {
@@ -15,6 +15,7 @@
 #define _PHOENIX_SPI_MSG_H_
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include <sys/msg.h>
 #include <sys/types.h>
@@ -22,9 +23,42 @@
 
 enum {
 	spi_devctl_xfer = 0, /* input: *ctx, *out, olen, *in, ilen, iskip */
+	spi_devctl_batch,    /* input: *ctx, nsegs, segments followed by *out, *in */
 };
 
 
+/* Max number of segments in a batch */
+#define SPIMSG_BATCH_SEGS 16
+
+/* Max size of batch input data (segments and output data) */
+#define SPIMSG_BATCH_SIZE 256
+
+/* Batch segment flags */
+#define SPIMSG_SEG_CSHOLD (1 << 0) /* Keep slave selected, next segment continues the transaction */
+
+
+/* Batch segment, performed as a separate transaction (slave is deselected in between) unless SPIMSG_SEG_CSHOLD is set */
+typedef struct {
+	uint16_t olen;  /* Output data length */
+	uint16_t ilen;  /* Input data length */
+	uint16_t iskip; /* Number of bytes to skip from MISO */
+	uint16_t flags; /* SPIMSG_SEG_* flags */
+	uint16_t delay; /* Delay after the segment (in us) */
+} spimsg_seg_t;
+
+
+/* Vectored transfer segment */
+typedef struct {
+	const void *out;    /* Output data */
+	size_t olen;        /* Output data length */
+	void *in;           /* Input data */
+	size_t ilen;        /* Input data length */
+	size_t iskip;       /* Number of bytes to skip from MISO */
+	unsigned int flags; /* SPIMSG_SEG_* flags */
+	unsigned int delay; /* Delay after the segment (in us) */
+} spimsg_iov_t;
+
+
 typedef struct {
 	oid_t oid;          /* SPI slave oid, initialized by spimsg_open() */
 	unsigned char mode; /* SPI clock mode (phase and polarity), should be set by the user */
@@ -36,11 +70,19 @@ typedef struct {
 	struct {
 		unsigned int type; /* Devctl type */
 		spimsg_ctx_t ctx;  /* SPI context */
-		struct {
-			size_t isize; /* Size of input data */
-			size_t osize; /* Size of output data */
-			size_t iskip; /* Number of bytes to skip from MISO */
-		} xfer;
+		union {
+			struct {
+				size_t isize; /* Size of input data */
+				size_t osize; /* Size of output data */
+				size_t iskip; /* Number of bytes to skip from MISO */
+			} xfer;
+
+			struct {
+				size_t nsegs; /* Number of segments at the beginning of input data */
+				size_t isize; /* Size of input data (segments and output data) */
+				size_t osize; /* Size of output data (concatenated segments input) */
+			} batch;
+		};
 	} i;
 
 	unsigned char payload[0];
@@ -51,6 +93,18 @@ typedef struct {
 extern int spimsg_xfer(const spimsg_ctx_t *ctx, const void *out, size_t olen, void *in, size_t ilen, size_t iskip);
 
 
+/* Performs SPI transactions in one message, out and in hold concatenated segments data */
+extern int spimsg_batch(const spimsg_ctx_t *ctx, const spimsg_seg_t *segs, size_t nsegs, const void *out, void *in);
+
+
+/*
+ * Performs SPI transfer segments in one message. Input is written directly to the caller
+ * buffer if only one segment reads data, payloads above SPIMSG_BATCH_SIZE are not limited
+ * by the batch buffer (allocated instead).
+ */
+extern int spimsg_xferv(const spimsg_ctx_t *ctx, const spimsg_iov_t *iov, size_t n);
+
+
 /* Closes SPI message context */
 extern int spimsg_close(const spimsg_ctx_t *ctx);
 
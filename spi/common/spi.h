@@ -33,6 +33,10 @@
 extern int spi_xfer(unsigned int dev, unsigned int ss, const void *out, size_t olen, void *in, size_t ilen, size_t iskip);
 
 
+/* Performs SPI transaction, slave is left selected if hold is set (the next transfer continues the transaction) */
+extern int spi_xferHold(unsigned int dev, unsigned int ss, const void *out, size_t olen, void *in, size_t ilen, size_t iskip, int hold);
+
+
 /* Returns SPI clock speed (in Hz) */
 extern int spi_getSpeed(unsigned int dev, unsigned int *speed);
 
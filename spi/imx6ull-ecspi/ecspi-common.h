@@ -0,0 +1,23 @@
+/*
+ * Phoenix-RTOS
+ *
+ * i.MX 6ULL ECSPI lib internals
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * %LICENSE%
+ */
+
+#ifndef IMX6ULL_ECSPI_COMMON_H
+#define IMX6ULL_ECSPI_COMMON_H
+
+#include <stdint.h>
+
+
+enum { rxdata = 0, txdata, conreg, configreg, intreg, dmareg, statreg, periodreg, testreg, msgdata = 16 };
+
+
+/* Waits until the previous transaction has ended, returns registers of the instance */
+volatile uint32_t *ecspi_syncBegin(int dev_no);
+
+#endif /* IMX6ULL_ECSPI_COMMON_H */
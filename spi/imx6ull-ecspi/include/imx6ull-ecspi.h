@@ -18,9 +18,15 @@
 #include <sys/threads.h>
 #include <phoenix/arch/armv7a/imx6ull/imx6ull.h>
 
+#include <sdma.h>
+
 enum { ecspi1 = 1, ecspi2, ecspi3, ecspi4 };
 
 
+/* Longest SDMA exchange kept in a single burst (BURST_LENGTH limit), SS is asserted for its whole duration */
+#define ECSPI_DMA_BURST 512
+
+
 typedef int ecspi_writerProc_t(const uint8_t *rx, size_t len, uint8_t *out);
 
 
@@ -33,10 +39,28 @@ typedef struct {
 	uint8_t *in_periodical;
 	unsigned int prev_wait_states;
 
+	uint8_t *ring;              /* Periodical ring of ring_cnt buffers, NULL - in_periodical is used */
+	size_t ring_cnt;
+	volatile size_t ring_head;  /* Number of periodical transactions stored in the ring */
+
 	ecspi_writerProc_t *writer_proc;
 } ecspi_ctx_t;
 
 
+typedef struct {
+	int dev_no;
+	unsigned int wml; /* Watermark the channel contexts are set for (words) */
+
+	sdma_t rx;
+	sdma_chain_t rx_chain;
+	uint32_t *rx_buf;
+
+	sdma_t tx;
+	sdma_chain_t tx_chain;
+	uint32_t *tx_buf;
+} ecspi_dma_t;
+
+
 int ecspi_init(int dev_no, uint8_t chan_msk);
 int ecspi_registerContext(int dev_no, ecspi_ctx_t *ctx, handle_t cond);
 
@@ -52,8 +76,13 @@ int ecspi_setSSDelay(int dev_no, uint16_t delay);
 int ecspi_writeAsync(ecspi_ctx_t *ctx, const uint8_t *out, size_t len);
 int ecspi_exchangeAsync(ecspi_ctx_t *ctx, const uint8_t *out, size_t len);
 int ecspi_exchangePeriodically(ecspi_ctx_t *ctx, uint8_t *out, uint8_t *in, size_t len, unsigned int wait_states, ecspi_writerProc_t writer_proc);
+int ecspi_exchangePeriodicallyRing(ecspi_ctx_t *ctx, uint8_t *out, uint8_t *ring, size_t ring_cnt, size_t len, unsigned int wait_states, ecspi_writerProc_t writer_proc);
 int ecspi_readFifo(ecspi_ctx_t *ctx, uint8_t *buf, size_t len);
 
+/* channel - SDMA channel for RX, TX uses the next one */
+int ecspi_dmaInit(ecspi_dma_t *dma, int dev_no, int channel);
+int ecspi_exchangeDma(ecspi_dma_t *dma, const uint8_t *out, uint8_t *in, size_t len);
+
 addr_t ecspi_getTxFifoPAddr(int dev_no);
 addr_t ecspi_getRxFifoPAddr(int dev_no);
 
@@ -0,0 +1,263 @@
+/*
+ * Phoenix-RTOS
+ *
+ * i.MX 6ULL ECSPI lib - SDMA exchanges
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * %LICENSE%
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include "imx6ull-ecspi.h"
+#include "ecspi-common.h"
+
+
+#define DMA_PRIORITY 6
+
+/* DMA register */
+#define DMA_TEDEN (1 << 7)
+#define DMA_RXDEN (1 << 23)
+
+
+/* SDMA events of RX and TX DMA requests */
+static const uint8_t ecspi_sdma_event[4][2] = { { 3, 4 }, { 5, 6 }, { 7, 8 }, { 9, 10 } };
+
+
+static int ecspi_dmaChannel(sdma_t *s, sdma_chain_t *c, int channel, unsigned int event)
+{
+	char name[sizeof("/dev/sdma/chXX")];
+
+	snprintf(name, sizeof(name), "/dev/sdma/ch%02d", channel);
+	if (sdma_open(s, name) < 0) {
+		printf("ecspi: failed to open %s\n", name);
+		return -ENODEV;
+	}
+
+	if (sdma_chain_init(c, s, 1, 0) < 0) {
+		return -ENOMEM;
+	}
+
+	/* Channel context is set on first use, once the watermark is known */
+	return sdma_chain_configure(c, sdma_trig__event, event, DMA_PRIORITY);
+}
+
+
+static int ecspi_dmaContext(sdma_t *s, uint16_t script, unsigned int event, addr_t fifo, unsigned int wml)
+{
+	sdma_context_t ctx;
+
+	sdma_context_init(&ctx);
+	sdma_context_set_pc(&ctx, script);
+	if (event < 32) {
+		ctx.gr[1] = 1 << event;
+	}
+	else {
+		ctx.gr[0] = 1 << (event - 32);
+	}
+	ctx.gr[6] = fifo;
+	ctx.gr[7] = wml * sizeof(uint32_t);
+
+	return sdma_context_set(s, &ctx);
+}
+
+
+/* Both channels move whole watermarks, so transfer has to be a multiple of it (no RX tail handling) */
+static int ecspi_dmaWatermark(ecspi_dma_t *dma, size_t words)
+{
+	unsigned int wml = 16;
+	const uint8_t *event = ecspi_sdma_event[dma->dev_no - 1];
+
+	while ((words % wml) != 0) {
+		wml >>= 1;
+	}
+
+	if (wml == dma->wml) {
+		return EOK;
+	}
+
+	if ((ecspi_dmaContext(&dma->rx, sdma_script__ap_2_mcu, event[0], ecspi_getRxFifoPAddr(dma->dev_no), wml) < 0) ||
+			(ecspi_dmaContext(&dma->tx, sdma_script__mcu_2_ap, event[1], ecspi_getTxFifoPAddr(dma->dev_no), wml) < 0)) {
+		dma->wml = 0;
+		return -EIO;
+	}
+
+	dma->wml = wml;
+
+	return EOK;
+}
+
+
+/* Word layout is the same as of writeFifo(): leading partial word first, then big-endian words */
+static void ecspi_dmaPack(uint32_t *buf, const uint8_t *out, size_t len)
+{
+	uint32_t word;
+	size_t fill_len = len % 4;
+
+	if (out == NULL) {
+		memset(buf, 0, ((len + 3) / 4) * sizeof(uint32_t));
+		return;
+	}
+
+	if (fill_len > 0) {
+		word = 0;
+		for (; fill_len > 0; fill_len--, len--) {
+			word = (word << 8) | *out++;
+		}
+		*buf++ = word;
+	}
+
+	for (; len > 0; len -= 4, out += 4) {
+		*buf++ = out[3] | ((uint32_t)out[2] << 8) | ((uint32_t)out[1] << 16) | ((uint32_t)out[0] << 24);
+	}
+}
+
+
+static void ecspi_dmaUnpack(uint8_t *in, const uint32_t *buf, size_t len)
+{
+	uint32_t word;
+	size_t fill_len = len % 4;
+	int i;
+
+	if (fill_len > 0) {
+		word = *buf++;
+		for (i = fill_len; i >= 1; i--) {
+			*in++ = (word >> ((i - 1) * 8)) & 0xff;
+		}
+		len -= fill_len;
+	}
+
+	for (; len > 0; len -= 4) {
+		word = *buf++;
+		*in++ = (word >> 24) & 0xff;
+		*in++ = (word >> 16) & 0xff;
+		*in++ = (word >> 8) & 0xff;
+		*in++ = word & 0xff;
+	}
+}
+
+
+static int ecspi_dmaBurst(ecspi_dma_t *dma, const uint8_t *out, uint8_t *in, size_t len)
+{
+	volatile uint32_t *base;
+	struct iovec iov;
+	size_t words = (len + 3) / 4;
+	uint32_t cnt;
+	int res;
+
+	ecspi_dmaPack(dma->tx_buf, out, len);
+
+	if ((res = ecspi_dmaWatermark(dma, words)) < 0) {
+		return res;
+	}
+
+	base = ecspi_syncBegin(dma->dev_no);
+
+	/* Single burst of len bytes, started as soon as TXFIFO gets data */
+	*(base + configreg) &= ~(0xf << 8);
+	*(base + conreg) = (*(base + conreg) & ~(0xfff << 20)) | ((len * 8 - 1) << 20) | (1 << 3);
+	/* Clear Transfer Completed bit. */
+	*(base + statreg) |= (1 << 7);
+
+	iov.iov_base = dma->rx_buf;
+	iov.iov_len = words * sizeof(uint32_t);
+	res = sdma_chain_submit(&dma->rx_chain, &iov, 1, SDMA_CMD_MODE_32_BIT, 1);
+
+	if (res >= 0) {
+		iov.iov_base = dma->tx_buf;
+		res = sdma_chain_submit(&dma->tx_chain, &iov, 1, SDMA_CMD_MODE_32_BIT, 0);
+	}
+
+	if (res >= 0) {
+		/* TX requests while TXFIFO holds no more than a watermark, RX once it holds one */
+		*(base + dmareg) = dma->wml | DMA_TEDEN | ((dma->wml - 1) << 16) | DMA_RXDEN;
+
+		/* RX completes last, all words have been shifted by then */
+		while ((res = sdma_chain_reap(&dma->rx_chain)) > 0) {
+			sdma_wait_for_intr(&dma->rx, &cnt);
+		}
+
+		while (sdma_chain_reap(&dma->tx_chain) > 0) {
+			;
+		}
+	}
+
+	*(base + dmareg) = 0;
+	*(base + conreg) &= ~(1 << 3);
+	*(base + statreg) |= (1 << 7);
+
+	if (res < 0) {
+		return -EIO;
+	}
+
+	if (in != NULL) {
+		ecspi_dmaUnpack(in, dma->rx_buf, len);
+	}
+
+	return EOK;
+}
+
+
+int ecspi_exchangeDma(ecspi_dma_t *dma, const uint8_t *out, uint8_t *in, size_t len)
+{
+	size_t chunk;
+	int res;
+
+	if (dma->dev_no < 1 || dma->dev_no > 4) {
+		return -1;
+	}
+
+	if (len == 0) {
+		return -2;
+	}
+
+	/* Bursts longer than ECSPI_DMA_BURST are split, SS is negated between them */
+	while (len > 0) {
+		chunk = (len > ECSPI_DMA_BURST) ? ECSPI_DMA_BURST : len;
+
+		if ((res = ecspi_dmaBurst(dma, out, in, chunk)) < 0) {
+			return res;
+		}
+
+		if (out != NULL) {
+			out += chunk;
+		}
+		if (in != NULL) {
+			in += chunk;
+		}
+		len -= chunk;
+	}
+
+	return 0;
+}
+
+
+int ecspi_dmaInit(ecspi_dma_t *dma, int dev_no, int channel)
+{
+	addr_t paddr;
+
+	if (dev_no < 1 || dev_no > 4) {
+		return -1;
+	}
+
+	memset(dma, 0, sizeof(*dma));
+	dma->dev_no = dev_no;
+
+	if ((ecspi_dmaChannel(&dma->rx, &dma->rx_chain, channel, ecspi_sdma_event[dev_no - 1][0]) < 0) ||
+			(ecspi_dmaChannel(&dma->tx, &dma->tx_chain, channel + 1, ecspi_sdma_event[dev_no - 1][1]) < 0)) {
+		return -EIO;
+	}
+
+	/* Bounce buffers, page aligned so that each one fits a single buffer descriptor */
+	dma->rx_buf = sdma_alloc_uncached(&dma->rx, ECSPI_DMA_BURST, &paddr, 0);
+	dma->tx_buf = sdma_alloc_uncached(&dma->tx, ECSPI_DMA_BURST, &paddr, 0);
+	if ((dma->rx_buf == NULL) || (dma->tx_buf == NULL)) {
+		return -ENOMEM;
+	}
+
+	return EOK;
+}
@@ -19,6 +19,7 @@
 #include <phoenix/arch/armv7a/imx6ull/imx6ull.h>
 
 #include "imx6ull-ecspi.h"
+#include "ecspi-common.h"
 
 
 #define BYTES_2_RXTHRESHOLD(LEN) (((LEN) + 3) / 4 - 1)
@@ -26,8 +27,6 @@
 #define GET_BURST_IN_BYTES(ECSPI) (BITS_2_BYTES_ROUND_UP((*((ECSPI)->base + conreg) >> 20) + 1))
 
 
-enum { rxdata = 0, txdata, conreg, configreg, intreg, dmareg, statreg, periodreg, testreg, msgdata = 16 };
-
 typedef enum { mode_sync_exchange, mode_async_write, mode_async_exchange, mode_async_periodical } ecspi_mode_t;
 
 typedef struct {
@@ -113,6 +112,7 @@ static int ecspi_irqHandlerAsync(unsigned int n, void *arg)
 	(void) n;
 
 	size_t count;
+	uint8_t *in;
 	int res = -1;
 	int res_writer;
 
@@ -146,9 +146,18 @@ static int ecspi_irqHandlerAsync(unsigned int n, void *arg)
 		}
 		else if (e->mode == mode_async_periodical) {
 			count = GET_BURST_IN_BYTES(e);
+			in = ctx->in_periodical;
+
+			if (ctx->ring != NULL) {
+				in = ctx->ring + (ctx->ring_head % ctx->ring_cnt) * count;
+			}
 
-			readFifo(ctx->dev_no, ctx->in_periodical, count);
-			res_writer = ctx->writer_proc(ctx->in_periodical, count, ctx->out_periodical);
+			readFifo(ctx->dev_no, in, count);
+			res_writer = ctx->writer_proc(in, count, ctx->out_periodical);
+
+			if (ctx->ring != NULL) {
+				ctx->ring_head++;
+			}
 
 			if (res_writer < 0) {
 				/* Disable Transfer Completed interrupt. */
@@ -160,7 +169,8 @@ static int ecspi_irqHandlerAsync(unsigned int n, void *arg)
 			} else {
 				writeFifo(ctx->dev_no, ctx->out_periodical, count);
 				*(e->base + conreg) |= (1 << 2);
-				res = -1;
+				/* Ring consumers are woken up after every transaction */
+				res = (ctx->ring != NULL) ? 1 : -1;
 			}
 		}
 	}
@@ -542,20 +552,12 @@ int ecspi_exchangeAsync(ecspi_ctx_t *ctx, const uint8_t *out, size_t len)
 }
 
 
-int ecspi_exchangePeriodically(ecspi_ctx_t *ctx, uint8_t *out, uint8_t *in, size_t len, unsigned int wait_states, ecspi_writerProc_t writer_proc)
+static int exchangePeriodically(ecspi_ctx_t *ctx, uint8_t *out, uint8_t *in, uint8_t *ring, size_t ring_cnt, size_t len, unsigned int wait_states, ecspi_writerProc_t writer_proc)
 {
 	ecspi_t *e;
 	uint8_t txfifo_word_cnt;
 	size_t written = 0;
 
-	if (ctx->dev_no < 1 || ctx->dev_no > 4) {
-		return -1;
-	}
-
-	if (len > (64 * 4)) {
-		return -2;
-	}
-
 	e = &ecspi[ctx->dev_no - 1];
 	txfifo_word_cnt = *(e->base + testreg) & 0x7F;
 
@@ -567,6 +569,9 @@ int ecspi_exchangePeriodically(ecspi_ctx_t *ctx, uint8_t *out, uint8_t *in, size
 		ctx->writer_proc = writer_proc;
 		ctx->out_periodical = out;
 		ctx->in_periodical = in;
+		ctx->ring = ring;
+		ctx->ring_cnt = ring_cnt;
+		ctx->ring_head = 0;
 
 		/* One burst mode */
 		*(e->base + configreg) &= ~(0xF << 8);
@@ -585,6 +590,34 @@ int ecspi_exchangePeriodically(ecspi_ctx_t *ctx, uint8_t *out, uint8_t *in, size
 }
 
 
+int ecspi_exchangePeriodically(ecspi_ctx_t *ctx, uint8_t *out, uint8_t *in, size_t len, unsigned int wait_states, ecspi_writerProc_t writer_proc)
+{
+	if (ctx->dev_no < 1 || ctx->dev_no > 4) {
+		return -1;
+	}
+
+	if (len > (64 * 4)) {
+		return -2;
+	}
+
+	return exchangePeriodically(ctx, out, in, NULL, 0, len, wait_states, writer_proc);
+}
+
+
+int ecspi_exchangePeriodicallyRing(ecspi_ctx_t *ctx, uint8_t *out, uint8_t *ring, size_t ring_cnt, size_t len, unsigned int wait_states, ecspi_writerProc_t writer_proc)
+{
+	if (ctx->dev_no < 1 || ctx->dev_no > 4) {
+		return -1;
+	}
+
+	if (len > (64 * 4) || ring == NULL || ring_cnt == 0) {
+		return -2;
+	}
+
+	return exchangePeriodically(ctx, out, NULL, ring, ring_cnt, len, wait_states, writer_proc);
+}
+
+
 int ecspi_writeAsync(ecspi_ctx_t *ctx, const uint8_t *out, size_t len)
 {
 	ecspi_t *e;
@@ -634,6 +667,21 @@ int ecspi_writeAsync(ecspi_ctx_t *ctx, const uint8_t *out, size_t len)
 }
 
 
+volatile uint32_t *ecspi_syncBegin(int dev_no)
+{
+	ecspi_t *e = &ecspi[dev_no - 1];
+
+	/* Wait until the previous transaction has ended. */
+	while ((*(e->base + conreg) & (1 << 2)) || (*(e->base + testreg) & 0x7F) != 0) {
+		;
+	}
+
+	e->mode = mode_sync_exchange;
+
+	return e->base;
+}
+
+
 addr_t ecspi_getTxFifoPAddr(int dev_no)
 {
 	return ecspi_addr[dev_no - 1] + txdata * 4;
@@ -35,6 +35,8 @@ typedef struct {
 	addr_t ahbAddr;
 	uint8_t slPortMask;
 	size_t slFlashSz[4];
+	int ahbStale; /* AHB RX buffer may hold data from before program/erase */
+	uint8_t ahbSeq; /* LUT sequence programmed for AHB reads */
 } qspi_t;
 
 
@@ -60,7 +62,8 @@ struct xferOp {
 };
 
 
-/* Execute a transfer using lookup table of QSPI sequences */
+/* Execute a transfer using lookup table of QSPI sequences,
+ * reads larger than QSPI_RXBUFSIZE are done through the AHB memory mapped window */
 extern ssize_t qspi_xferExec(qspi_t *qspi, struct xferOp *xfer);
 
 
@@ -39,7 +39,9 @@
 #define QSPI_MCR_SWRSTSD  (0x01u)
 #define QSPI_MCR_SWRSTHD  (0x01u << 1)
 
-#define QSPI_BFGENCR (0x20u / sizeof(uint32_t))
+#define QSPI_BFGENCR           (0x20u / sizeof(uint32_t))
+#define QSPI_BFGENCR_SEQID(n)  (((n) & 0x0fu) << 12)
+#define QSPI_BFGENCR_SEQID_MSK (0x0fu << 12)
 
 #define QSPI_SPTRCLR     (0x16cu / sizeof(uint32_t))
 #define QSPI_SPTRCLR_IP  (1u << 8)
@@ -50,6 +52,11 @@
 #define QSPI_BUFCR(n) ((0x10u + (4u * (n))) / sizeof(uint32_t))
 
 #define QSPI_BUFCR_INVALID_MASTER (0xeu)
+#define QSPI_BUFCR_ALLMST         (0x01u << 31)
+#define QSPI_BUFCR_ADATSZ(sz)     ((((sz) / 8u) & 0xffu) << 8)
+
+/* AHB RX buffer size, all of it is given to buffer 3 used by all masters */
+#define QSPI_AHBBUFSIZE 1024u
 
 #define QSPI_SR        (0x15cu / sizeof(uint32_t))
 #define QSPI_SR_BUSY   (0x01u)
@@ -113,16 +120,57 @@ static addr_t qspi_getAddressByPort(qspi_t *qspi, uint8_t port, addr_t addr)
 }
 
 
+/* Writing IPCR triggers the sequence, the value is composed without reading the register back (PAR_EN is never used) */
 static void qspi_setIPCR(qspi_t *qspi, unsigned int seq_num, size_t idatsz)
 {
-	uint32_t reg = qspi->base[QSPI_IPCR];
+	qspi->base[QSPI_SPTRCLR] |= QSPI_SPTRCLR_IP;
+	qspi->base[QSPI_IPCR] = ((seq_num & 0x0fu) << 24) | (idatsz & 0xffffu);
+}
 
-	reg = (reg & ~(0x0fu << 24)) | ((seq_num & 0x0fu) << 24);
-	reg = (reg & ~(0xffffu)) | (idatsz & 0xffffu);
 
+/* Reset AHB and serial flash domains to drop AHB RX buffer content */
+static void qspi_ahbInvalidate(qspi_t *qspi)
+{
+	volatile int i;
 
-	qspi->base[QSPI_SPTRCLR] |= QSPI_SPTRCLR_IP;
-	qspi->base[QSPI_IPCR] = reg;
+	qspi->base[QSPI_MCR] |= (QSPI_MCR_SWRSTSD | QSPI_MCR_SWRSTHD);
+	for (i = 0; i < 100; i++) { }
+
+	qspi->base[QSPI_MCR] |= QSPI_MCR_CLR_MDIS;
+	qspi->base[QSPI_MCR] &= ~(QSPI_MCR_SWRSTSD | QSPI_MCR_SWRSTHD);
+	qspi->base[QSPI_MCR] &= ~QSPI_MCR_CLR_MDIS;
+
+	qspi->ahbStale = 0;
+}
+
+
+/* AHB reads use the AHB sequence from BFGENCR, it is reprogrammed only when a read uses a different one */
+static void qspi_ahbSetSeq(qspi_t *qspi, uint8_t seqIdx)
+{
+	if (qspi->ahbSeq == seqIdx) {
+		return;
+	}
+
+	qspi->base[QSPI_BFGENCR] = (qspi->base[QSPI_BFGENCR] & ~QSPI_BFGENCR_SEQID_MSK) | QSPI_BFGENCR_SEQID(seqIdx);
+	qspi->ahbSeq = seqIdx;
+
+	/* Prefetched data was read with the previous sequence */
+	qspi->ahbStale = 1;
+}
+
+
+/* Prefetch into a single buffer spanning whole AHB RX buffer, sequential reads then hit prefetched data */
+static void qspi_ahbConfig(qspi_t *qspi)
+{
+	unsigned int i;
+
+	for (i = 0; i < 3u; i++) {
+		qspi->base[QSPI_BUFCR(i)] = QSPI_BUFCR_INVALID_MASTER;
+		qspi->base[QSPI_BUFIND(i)] = 0;
+	}
+	qspi->base[QSPI_BUFCR(3)] = QSPI_BUFCR_ALLMST | QSPI_BUFCR_ADATSZ(QSPI_AHBBUFSIZE);
+
+	qspi->ahbSeq = (qspi->base[QSPI_BFGENCR] & QSPI_BFGENCR_SEQID_MSK) >> 12;
 }
 
 
@@ -139,7 +187,6 @@ static ssize_t qspi_opRead(qspi_t *qspi, struct xferOp *xfer)
 		}
 		retries++;
 
-		qspi->base[QSPI_RBCT] = ((qspi->base[QSPI_RBCT] & ~(0x1fu)) | WATERMARK);
 		qspi->base[QSPI_SFAR] = xfer->addr;
 		qspi->base[QSPI_MCR] |= QSPI_MCR_CLR_RXF;
 
@@ -243,10 +290,16 @@ ssize_t qspi_xferExec(qspi_t *qspi, struct xferOp *xfer)
 			if (xfer->data.write.sz > 0xffffu) {
 				return -EPERM;
 			}
+			qspi->ahbStale = 1;
 			res = qspi_opWrite(qspi, xfer);
 			break;
 		case xfer_opRead:
-			if (xfer->data.read.sz > 0xffffu) {
+			/* IP reads are polled word by word through the RX buffer, AHB reads are done by the controller */
+			if (xfer->data.read.sz > QSPI_RXBUFSIZE) {
+				qspi_ahbSetSeq(qspi, xfer->seqIdx);
+				if (qspi->ahbStale != 0) {
+					qspi_ahbInvalidate(qspi);
+				}
 				/* Clear buffers. */
 				qspi->base[QSPI_MCR] |= (QSPI_MCR_CLR_RXF | QSPI_MCR_CLR_TXF);
 				(void)memcpy(xfer->data.read.ptr, (const void *)(qspi->ahbBase + (xfer->addr - qspi->ahbAddr)), xfer->data.read.sz);
@@ -255,6 +308,8 @@ ssize_t qspi_xferExec(qspi_t *qspi, struct xferOp *xfer)
 			res = qspi_opRead(qspi, xfer);
 			break;
 		case xfer_opCommand:
+			/* Erase or status/configuration change */
+			qspi->ahbStale = 1;
 			xfer->data.read.sz = 0;
 			xfer->data.read.ptr = NULL;
 			res = qspi_opRead(qspi, xfer);
@@ -298,5 +353,11 @@ int qspi_init(qspi_t *qspi)
 	qspi->slFlashSz[2] = qspi->base[QSPI_SFB1AD] - qspi->base[QSPI_SFA2AD];
 	qspi->slFlashSz[3] = qspi->base[QSPI_SFB2AD] - qspi->base[QSPI_SFB1AD];
 
+	/* RX watermark is the same for every IP read */
+	qspi->base[QSPI_RBCT] = ((qspi->base[QSPI_RBCT] & ~(0x1fu)) | WATERMARK);
+
+	qspi_ahbConfig(qspi);
+	qspi->ahbStale = 1;
+
 	return EOK;
 }
@@ -0,0 +1,484 @@
+/*
+ * Phoenix-RTOS
+ *
+ * SPI benchmark
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/msg.h>
+
+#include <bench.h>
+#include <spi.h>
+#include <spi-msg.h>
+
+#if defined(__CPU_IMXRT105X) || defined(__CPU_IMXRT106X) || defined(__CPU_IMXRT117X)
+#define BENCH_MULTI
+#include <imxrt-multi.h>
+#endif
+
+
+#define BENCH_DEF_OPS   1000   /* Default number of transactions per result */
+#define BENCH_DEF_SPEED 1000000
+#define BENCH_MAX_LEN   4096   /* Max transaction length */
+#define BENCH_GAP_SEGS  8      /* Transactions in CS-to-CS gap batch */
+#define BENCH_RATE_LEN  2      /* Small transaction length for rate test */
+
+
+/* Benchmark tests */
+enum { SIZE, RATE, GAP, NTESTS };
+
+
+static const char *const bench_names[NTESTS] = { "size", "rate", "gap" };
+
+
+static const size_t bench_defSizes[] = { 1, 4, 16, 64, 256, 1024, 4096 };
+
+
+static struct {
+	/* Configuration */
+	unsigned int dev;      /* SPI bus number */
+	unsigned int ss;       /* Slave select */
+	int multi;             /* Use imxrt-multi devctl instead of spimsg */
+	int loop;              /* MOSI-MISO loopback, received data is verified */
+	unsigned int nops;     /* Transactions per result */
+	size_t sizes[16];      /* Size test transaction lengths */
+	unsigned int nsizes;
+
+	spimsg_ctx_t ctx;      /* spimsg backend */
+#ifdef BENCH_MULTI
+	oid_t oid;             /* imxrt-multi backend */
+	unsigned int prescaler;
+	unsigned int sckDiv;
+#endif
+
+	uint8_t tx[BENCH_MAX_LEN];
+	uint8_t rx[BENCH_MAX_LEN];
+	uint8_t batch[BENCH_GAP_SEGS * 32 + BENCH_MAX_LEN];
+	uint32_t *lat;         /* Transactions latencies (us) */
+} bench_common;
+
+
+#ifdef BENCH_MULTI
+
+static int bench_multiSend(msg_t *msg)
+{
+	int err;
+
+	msg->type = mtDevCtl;
+	msg->oid = bench_common.oid;
+
+	if ((err = msgSend(bench_common.oid.port, msg)) < 0) {
+		return err;
+	}
+
+	return (msg->o.err < 0) ? msg->o.err : 0;
+}
+
+
+static int bench_multiOpen(unsigned char mode)
+{
+	char devName[16];
+	msg_t msg = { 0 };
+	multi_i_t *idevctl = (multi_i_t *)msg.i.raw;
+
+	snprintf(devName, sizeof(devName), "/dev/spi%u", bench_common.dev);
+	if (lookup(devName, NULL, &bench_common.oid) < 0) {
+		return -ENOENT;
+	}
+
+	idevctl->spi.type = spi_config;
+	idevctl->spi.config.cs = bench_common.ss;
+	idevctl->spi.config.endian = spi_msb;
+	idevctl->spi.config.mode = mode;
+	idevctl->spi.config.prescaler = bench_common.prescaler;
+	idevctl->spi.config.sckDiv = bench_common.sckDiv;
+
+	return bench_multiSend(&msg);
+}
+
+#endif
+
+
+static int bench_xfer(size_t len)
+{
+#ifdef BENCH_MULTI
+	msg_t msg = { 0 };
+	multi_i_t *idevctl = (multi_i_t *)msg.i.raw;
+
+	if (bench_common.multi != 0) {
+		msg.i.data = bench_common.tx;
+		msg.i.size = len;
+		msg.o.data = bench_common.rx;
+		msg.o.size = len;
+		idevctl->spi.type = spi_transaction;
+		idevctl->spi.transaction.frameSize = len;
+		idevctl->spi.transaction.cs = bench_common.ss;
+
+		return bench_multiSend(&msg);
+	}
+#endif
+
+	return spimsg_xfer(&bench_common.ctx, bench_common.tx, len, bench_common.rx, len, 0);
+}
+
+
+/* cnt separate transactions of len bytes in a single request */
+static int bench_batch(size_t len, unsigned int cnt)
+{
+	spimsg_iov_t iov[BENCH_GAP_SEGS];
+	unsigned int i;
+
+#ifdef BENCH_MULTI
+	msg_t msg = { 0 };
+	multi_i_t *idevctl = (multi_i_t *)msg.i.raw;
+	spi_batch_t *b = (spi_batch_t *)bench_common.batch;
+
+	if (bench_common.multi != 0) {
+		for (i = 0; i < cnt; i++) {
+			b[i].txOffs = cnt * sizeof(*b) + i * len;
+			b[i].rxOffs = i * len;
+			b[i].len = len;
+			b[i].delayUs = 0;
+			b[i].cs = bench_common.ss;
+			b[i].flags = 0;
+		}
+		memcpy(bench_common.batch + cnt * sizeof(*b), bench_common.tx, cnt * len);
+
+		msg.i.data = bench_common.batch;
+		msg.i.size = cnt * (sizeof(*b) + len);
+		msg.o.data = bench_common.rx;
+		msg.o.size = cnt * len;
+		idevctl->spi.type = spi_batch;
+		idevctl->spi.batch.count = cnt;
+
+		return bench_multiSend(&msg);
+	}
+#endif
+
+	for (i = 0; i < cnt; i++) {
+		iov[i].out = bench_common.tx + i * len;
+		iov[i].olen = len;
+		iov[i].in = bench_common.rx + i * len;
+		iov[i].ilen = len;
+		iov[i].iskip = 0;
+		iov[i].flags = 0;
+		iov[i].delay = 0;
+	}
+
+	return spimsg_xferv(&bench_common.ctx, iov, cnt);
+}
+
+
+static void bench_fill(size_t len, unsigned int seq)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		bench_common.tx[i] = (uint8_t)(seq + i * 7);
+	}
+	memset(bench_common.rx, 0, len);
+}
+
+
+/* Runs nops len byte transactions, fills latencies, returns number of loopback mismatches or error */
+static int bench_loop(size_t len, uint64_t *usec)
+{
+	uint64_t start, t0;
+	unsigned int i;
+	int err, bad = 0;
+
+	t0 = bench_nowUs();
+	for (i = 0; i < bench_common.nops; i++) {
+		bench_fill(len, i);
+
+		start = bench_nowUs();
+		if ((err = bench_xfer(len)) < 0) {
+			return err;
+		}
+		bench_common.lat[i] = (uint32_t)(bench_nowUs() - start);
+
+		if ((bench_common.loop != 0) && (memcmp(bench_common.tx, bench_common.rx, len) != 0)) {
+			bad++;
+		}
+	}
+	*usec = bench_nowUs() - t0;
+
+	if (*usec == 0) {
+		*usec = 1;
+	}
+
+	bench_sort(bench_common.lat, bench_common.nops);
+
+	return bad;
+}
+
+
+static void bench_begin(bench_report_t *r, const char *test)
+{
+	bench_reportBegin(r);
+	bench_reportUint(r, "dev", bench_common.dev);
+	bench_reportUint(r, "ss", bench_common.ss);
+	bench_reportStr(r, "test", test);
+}
+
+
+static void bench_err(const char *test, size_t len, int err)
+{
+	bench_report_t r;
+
+	bench_begin(&r, test);
+	bench_reportUint(&r, "len", len);
+	bench_reportInt(&r, "err", err);
+	bench_reportEnd(&r);
+}
+
+
+static void bench_result(const char *test, size_t len, uint64_t usec, int bad)
+{
+	double tps = (double)bench_common.nops * 1000000 / usec;
+	bench_report_t r;
+
+	bench_begin(&r, test);
+	bench_reportUint(&r, "len", len);
+	bench_reportUint(&r, "ops", bench_common.nops);
+	bench_reportU64(&r, "usec", usec);
+	bench_reportDouble(&r, "bps", tps * len, 0);
+	bench_reportDouble(&r, "tps", tps, 0);
+	bench_reportUint(&r, "p50_us", bench_percentile(bench_common.lat, bench_common.nops, 50));
+	bench_reportUint(&r, "p99_us", bench_percentile(bench_common.lat, bench_common.nops, 99));
+	bench_reportUint(&r, "max_us", bench_percentile(bench_common.lat, bench_common.nops, 100));
+	bench_reportInt(&r, "mismatch", bad);
+	bench_reportEnd(&r);
+}
+
+
+static int bench_run(int test)
+{
+	uint64_t usec, start, tb, ts;
+	bench_report_t r;
+	unsigned int i, n;
+	int32_t gap;
+	int ret = 0, err, bad;
+
+	switch (test) {
+		case SIZE:
+			for (i = 0; i < bench_common.nsizes; i++) {
+				if ((bad = bench_loop(bench_common.sizes[i], &usec)) < 0) {
+					bench_err(bench_names[test], bench_common.sizes[i], bad);
+					ret = bad;
+					continue;
+				}
+				bench_result(bench_names[test], bench_common.sizes[i], usec, bad);
+				if (bad != 0) {
+					ret = -EIO;
+				}
+			}
+			break;
+
+		case RATE:
+			if ((bad = bench_loop(BENCH_RATE_LEN, &usec)) < 0) {
+				bench_err(bench_names[test], BENCH_RATE_LEN, bad);
+				return bad;
+			}
+			bench_result(bench_names[test], BENCH_RATE_LEN, usec, bad);
+			ret = (bad != 0) ? -EIO : 0;
+			break;
+
+		default:
+			/* Batch of separate 1-byte transactions vs single transaction of the same total length,
+			 * the difference spread over the gaps taken, IPC overhead is the same in both */
+			bench_fill(BENCH_GAP_SEGS, 0);
+			for (i = 0, n = bench_common.nops; i < n; i++) {
+				start = bench_nowUs();
+				err = bench_batch(1, BENCH_GAP_SEGS);
+				tb = bench_nowUs() - start;
+
+				if (err >= 0) {
+					start = bench_nowUs();
+					err = bench_xfer(BENCH_GAP_SEGS);
+					ts = bench_nowUs() - start;
+				}
+
+				if (err < 0) {
+					bench_err(bench_names[test], 1, err);
+					return err;
+				}
+
+				/* gap may be negative within time measurement noise */
+				gap = ((int32_t)tb - (int32_t)ts) / (BENCH_GAP_SEGS - 1);
+				bench_common.lat[i] = (gap > 0) ? (uint32_t)gap : 0;
+			}
+			bench_sort(bench_common.lat, n);
+
+			bench_begin(&r, bench_names[test]);
+			bench_reportUint(&r, "segs", BENCH_GAP_SEGS);
+			bench_reportUint(&r, "ops", n);
+			bench_reportUint(&r, "gap_p50_us", bench_percentile(bench_common.lat, n, 50));
+			bench_reportUint(&r, "gap_p99_us", bench_percentile(bench_common.lat, n, 99));
+			bench_reportEnd(&r);
+			break;
+	}
+
+	return ret;
+}
+
+
+static void bench_usage(const char *prog)
+{
+	printf("Usage: %s [options] <dev>\n", prog);
+	printf("\t-c <ss>     - slave select (default 0)\n");
+	printf("\t-M <mode>   - SPI mode 0-3 (default 0)\n");
+	printf("\t-f <hz>     - clock speed (default %u)\n", BENCH_DEF_SPEED);
+#ifdef BENCH_MULTI
+	printf("\t-m          - use imxrt-multi devctl instead of spimsg\n");
+	printf("\t-p <pre>    - imxrt-multi clock prescaler (default 0)\n");
+	printf("\t-d <div>    - imxrt-multi clock divider (default 64)\n");
+#endif
+	printf("\t-n <ops>    - transactions per result (default %u)\n", BENCH_DEF_OPS);
+	printf("\t-s <sizes>  - comma separated size test lengths (default 1,4,16,64,256,1024,4096), max %u\n", BENCH_MAX_LEN);
+	printf("\t-t <tests>  - comma separated tests: size,rate,gap (default all)\n");
+	printf("\t-L          - MOSI-MISO loopback, verify received data\n");
+	printf("\t-h          - shows this help message\n");
+}
+
+
+int main(int argc, char **argv)
+{
+	static const unsigned char modes[] = { SPI_MODE0, SPI_MODE1, SPI_MODE2, SPI_MODE3 };
+	unsigned int tests = (1 << SIZE) | (1 << RATE) | (1 << GAP), mode = 0, speed = BENCH_DEF_SPEED;
+	int c, i, err = EXIT_SUCCESS;
+	const char *bad;
+	char *tok, *arg;
+
+	bench_common.nops = BENCH_DEF_OPS;
+	bench_common.nsizes = sizeof(bench_defSizes) / sizeof(bench_defSizes[0]);
+	memcpy(bench_common.sizes, bench_defSizes, sizeof(bench_defSizes));
+#ifdef BENCH_MULTI
+	bench_common.sckDiv = 64;
+#endif
+
+	while ((c = getopt(argc, argv, "c:M:f:mp:d:n:s:t:Lh")) != -1) {
+		switch (c) {
+			case 'c':
+				bench_common.ss = strtoul(optarg, NULL, 0);
+				break;
+
+			case 'M':
+				mode = strtoul(optarg, NULL, 0);
+				break;
+
+			case 'f':
+				speed = strtoul(optarg, NULL, 0);
+				break;
+
+#ifdef BENCH_MULTI
+			case 'm':
+				bench_common.multi = 1;
+				break;
+
+			case 'p':
+				bench_common.prescaler = strtoul(optarg, NULL, 0);
+				break;
+
+			case 'd':
+				bench_common.sckDiv = strtoul(optarg, NULL, 0);
+				break;
+#endif
+
+			case 'n':
+				bench_common.nops = strtoul(optarg, NULL, 0);
+				break;
+
+			case 's':
+				bench_common.nsizes = 0;
+				for (arg = optarg; (tok = strtok(arg, ",")) != NULL; arg = NULL) {
+					if (bench_common.nsizes == sizeof(bench_common.sizes) / sizeof(bench_common.sizes[0])) {
+						break;
+					}
+					bench_common.sizes[bench_common.nsizes] = strtoul(tok, NULL, 0);
+					if ((bench_common.sizes[bench_common.nsizes] == 0) || (bench_common.sizes[bench_common.nsizes] > BENCH_MAX_LEN)) {
+						fprintf(stderr, "spi-bench: invalid size %s\n", tok);
+						return EXIT_FAILURE;
+					}
+					bench_common.nsizes++;
+				}
+				break;
+
+			case 't':
+				if (bench_parseTests(optarg, bench_names, NTESTS, &tests, &bad) < 0) {
+					fprintf(stderr, "spi-bench: unknown test %s\n", bad);
+					return EXIT_FAILURE;
+				}
+				break;
+
+			case 'L':
+				bench_common.loop = 1;
+				break;
+
+			case 'h':
+			default:
+				bench_usage(argv[0]);
+				return EXIT_SUCCESS;
+		}
+	}
+
+	if (optind != argc - 1) {
+		bench_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	bench_common.dev = strtoul(argv[optind], NULL, 0);
+
+	if ((mode > 3) || (bench_common.nops == 0) || (bench_common.nsizes == 0)) {
+		fprintf(stderr, "spi-bench: invalid mode, number of transactions or sizes\n");
+		return EXIT_FAILURE;
+	}
+
+#ifdef BENCH_MULTI
+	if (bench_common.multi != 0) {
+		if (bench_multiOpen(mode) < 0) {
+			fprintf(stderr, "spi-bench: failed to configure /dev/spi%u\n", bench_common.dev);
+			return EXIT_FAILURE;
+		}
+	}
+	else
+#endif
+	{
+		if (spimsg_open(bench_common.dev, bench_common.ss, &bench_common.ctx) < 0) {
+			fprintf(stderr, "spi-bench: failed to open /dev/spi%u.%u\n", bench_common.dev, bench_common.ss);
+			return EXIT_FAILURE;
+		}
+		bench_common.ctx.mode = modes[mode];
+		bench_common.ctx.speed = speed;
+	}
+
+	bench_common.lat = malloc(bench_common.nops * sizeof(bench_common.lat[0]));
+	if (bench_common.lat == NULL) {
+		fprintf(stderr, "spi-bench: out of memory\n");
+		return EXIT_FAILURE;
+	}
+
+	for (i = 0; i < NTESTS; i++) {
+		if (((tests & (1 << i)) != 0) && (bench_run(i) < 0)) {
+			err = EXIT_FAILURE;
+		}
+	}
+
+	free(bench_common.lat);
+	if (bench_common.multi == 0) {
+		spimsg_close(&bench_common.ctx);
+	}
+
+	return err;
+}
@@ -303,7 +303,7 @@ static void spi_select(spi_t *spi, unsigned int ss, unsigned int state)
 }
 
 
-int spi_xfer(unsigned int dev, unsigned int ss, const void *out, size_t olen, void *in, size_t ilen, size_t iskip)
+int spi_xferHold(unsigned int dev, unsigned int ss, const void *out, size_t olen, void *in, size_t ilen, size_t iskip, int hold)
 {
 	const unsigned char *obuff = out;
 	unsigned char data, *ibuff = in;
@@ -319,7 +319,12 @@ int spi_xfer(unsigned int dev, unsigned int ss, const void *out, size_t olen, vo
 		return -EINVAL;
 	}
 
+	/* Empty transfer ends transaction held by the previous one */
 	if (len == 0) {
+		if (hold == 0) {
+			*(spi->base + SPI_ER) = 0;
+			spi_select(spi, ss, 1);
+		}
 		return EOK;
 	}
 
@@ -367,13 +372,21 @@ int spi_xfer(unsigned int dev, unsigned int ss, const void *out, size_t olen, vo
 	}
 
 	/* Disable controller and deselect slave */
-	*(spi->base + SPI_ER) = 0;
-	spi_select(spi, ss, 1);
+	if (hold == 0) {
+		*(spi->base + SPI_ER) = 0;
+		spi_select(spi, ss, 1);
+	}
 
 	return EOK;
 }
 
 
+int spi_xfer(unsigned int dev, unsigned int ss, const void *out, size_t olen, void *in, size_t ilen, size_t iskip)
+{
+	return spi_xferHold(dev, ss, out, olen, in, ilen, iskip, 0);
+}
+
+
 static int spi_setPin(int pin, unsigned int cfg)
 {
 	platformctl_t pctl;
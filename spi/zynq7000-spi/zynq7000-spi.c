@@ -37,9 +37,88 @@ static const int devs[][SPI_COUNT] = {
 
 static struct {
 	unsigned int dev;
+
+	/* Currently programmed controller configuration */
+	int cfgValid;
+	unsigned char mode;
+	unsigned int speed;
 } spisrv_common;
 
 
+/* Programs clock mode and speed of the context, unless they are already set */
+static int spisrv_config(const spimsg_ctx_t *ctx)
+{
+	int err;
+
+	if ((spisrv_common.cfgValid != 0) && (spisrv_common.mode == ctx->mode) && (spisrv_common.speed == ctx->speed)) {
+		return EOK;
+	}
+
+	spisrv_common.cfgValid = 0;
+
+	err = spi_setMode(spisrv_common.dev, ctx->mode);
+	if (err < 0) {
+		return err;
+	}
+
+	err = spi_setSpeed(spisrv_common.dev, ctx->speed);
+	if (err < 0) {
+		return err;
+	}
+
+	spisrv_common.mode = ctx->mode;
+	spisrv_common.speed = ctx->speed;
+	spisrv_common.cfgValid = 1;
+
+	return EOK;
+}
+
+
+static int spisrv_batch(msg_t *msg, const spi_devctl_t *in)
+{
+	const spimsg_seg_t *segs = msg->i.data;
+	const unsigned char *idata;
+	unsigned char *odata = msg->o.data;
+	size_t i, olen = 0, ilen = 0, nsegs = in->i.batch.nsegs;
+	int err, hold;
+
+	if ((nsegs == 0) || (nsegs > SPIMSG_BATCH_SEGS) || (msg->i.data == NULL) || (msg->i.size < in->i.batch.isize) ||
+			(in->i.batch.isize < nsegs * sizeof(spimsg_seg_t)) || (msg->o.size < in->i.batch.osize)) {
+		return -EINVAL;
+	}
+
+	for (i = 0; i < nsegs; i++) {
+		olen += segs[i].olen;
+		ilen += segs[i].ilen;
+	}
+
+	if ((olen > in->i.batch.isize - nsegs * sizeof(spimsg_seg_t)) || (ilen > in->i.batch.osize) || ((ilen != 0) && (odata == NULL))) {
+		return -EINVAL;
+	}
+
+	idata = (const unsigned char *)(segs + nsegs);
+	for (i = 0; i < nsegs; i++) {
+		/* The last segment always releases the slave */
+		hold = ((segs[i].flags & SPIMSG_SEG_CSHOLD) != 0) && (i + 1 < nsegs);
+
+		err = spi_xferHold(spisrv_common.dev, in->i.ctx.oid.id, idata, segs[i].olen, odata, segs[i].ilen, segs[i].iskip, hold);
+		if (err < 0) {
+			/* Release slave possibly held by previous segments */
+			spi_xfer(spisrv_common.dev, in->i.ctx.oid.id, NULL, 0, NULL, 0, 0);
+			return err;
+		}
+
+		if (segs[i].delay != 0) {
+			usleep(segs[i].delay);
+		}
+		idata += segs[i].olen;
+		odata += segs[i].ilen;
+	}
+
+	return EOK;
+}
+
+
 static void spisrv_devctl(msg_t *msg)
 {
 	spi_devctl_t *in = (spi_devctl_t *)msg->i.raw;
@@ -49,12 +128,7 @@ static void spisrv_devctl(msg_t *msg)
 
 	switch (in->i.type) {
 		case spi_devctl_xfer:
-			msg->o.err = spi_setMode(spisrv_common.dev, in->i.ctx.mode);
-			if (msg->o.err < 0) {
-				break;
-			}
-
-			msg->o.err = spi_setSpeed(spisrv_common.dev, in->i.ctx.speed);
+			msg->o.err = spisrv_config(&in->i.ctx);
 			if (msg->o.err < 0) {
 				break;
 			}
@@ -71,6 +145,15 @@ static void spisrv_devctl(msg_t *msg)
 			msg->o.err = spi_xfer(spisrv_common.dev, in->i.ctx.oid.id, idata, in->i.xfer.isize, odata, in->i.xfer.osize, in->i.xfer.iskip);
 			break;
 
+		case spi_devctl_batch:
+			msg->o.err = spisrv_config(&in->i.ctx);
+			if (msg->o.err < 0) {
+				break;
+			}
+
+			msg->o.err = spisrv_batch(msg, in);
+			break;
+
 		default:
 			msg->o.err = -EINVAL;
 			break;
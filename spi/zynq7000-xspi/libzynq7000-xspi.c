@@ -41,6 +41,15 @@
 #define SPI_ISR   8  /* Interrupt status register */
 #define SPI_IER   10 /* Interrupt enable register */
 
+/* SPI status register bits */
+#define SPI_SR_RXEMPTY (1 << 0)
+#define SPI_SR_TXEMPTY (1 << 2)
+#define SPI_SR_TXFULL  (1 << 3)
+
+/* SPI interrupt bits */
+#define SPI_INT_DTREMPTY (1 << 2) /* TX FIFO empty */
+#define SPI_INT_TXHALF   (1 << 6) /* TX FIFO half empty */
+
 /* SPI definitions */
 #define SPI_FIFO_SIZE 256 /* SPI TX and RX FIFO size */
 
@@ -85,14 +94,19 @@ static spi_t *spi_get(unsigned int dev)
 static int spi_isr(unsigned int n, void *arg)
 {
 	spi_t *spi = arg;
+	uint32_t status = *(spi->base + SPI_ISR);
 
-	/* TX FIFO empty */
-	if (*(spi->base + SPI_ISR) & (1 << 2)) {
-		return 1;
+	if ((status & (SPI_INT_DTREMPTY | SPI_INT_TXHALF)) == 0) {
+		/* Should never happen */
+		return -1;
 	}
 
-	/* Should never happen */
-	return -1;
+	/* Interrupt is enabled again by the waiting thread, status bits are cleared by toggling */
+	*(spi->base + SPI_IER) = 0;
+	*(spi->base + SPI_ISR) = status;
+	spi_dmb();
+
+	return 1;
 }
 
 
@@ -178,11 +192,11 @@ static void spi_select(spi_t *spi, unsigned int ss, unsigned int state)
 }
 
 
-int spi_xfer(unsigned int dev, unsigned int ss, const void *out, size_t olen, void *in, size_t ilen, size_t iskip)
+int spi_xferHold(unsigned int dev, unsigned int ss, const void *out, size_t olen, void *in, size_t ilen, size_t iskip, int hold)
 {
 	const unsigned char *obuff = out;
 	unsigned char data, *ibuff = in;
-	size_t n, len = max(olen, iskip + ilen);
+	size_t txcnt = 0, rxcnt = 0, len = max(olen, iskip + ilen);
 	spi_t *spi;
 
 	spi = spi_get(dev);
@@ -194,25 +208,40 @@ int spi_xfer(unsigned int dev, unsigned int ss, const void *out, size_t olen, vo
 		return -EINVAL;
 	}
 
+	/* Empty transfer ends transaction held by the previous one */
 	if (len == 0) {
+		if (hold == 0) {
+			spi_select(spi, ss, 1);
+		}
 		return 0;
 	}
 
+	/* FIFO reset */
+	*(spi->base + SPI_CR) |= (1 << 6) | (1 << 5);
+	spi_dmb();
+
 	spi_select(spi, ss, 0);
 
-	while (len > 0) {
-		/* FIFO reset, master inhibit */
-		*(spi->base + SPI_CR) |= (1 << 6) | (1 << 5) | (1 << 8);
-		spi_dmb();
+	/* Master is not inhibited, SCLK runs as long as TX FIFO is refilled on time */
+	*(spi->base + SPI_CR) &= ~(1 << 8);
+	spi_dmb();
 
-		/* Write to TX FIFO */
-		for (n = 0; (n < SPI_FIFO_SIZE) && (len > 0); len--, n++) {
-			if ((*(spi->base + SPI_SR) & (1 << 3)) != 0) {
-				printf("Full\n");
-				/* TX full */
-				break;
+	while (rxcnt < len) {
+		/* Read from RX FIFO, each sent byte produces one received byte */
+		while ((rxcnt < txcnt) && ((*(spi->base + SPI_SR) & SPI_SR_RXEMPTY) == 0)) {
+			data = *(spi->base + SPI_DRR) & 0xff;
+			if (iskip > 0) {
+				iskip--;
+			}
+			else if ((ibuff != NULL) && (ilen > 0)) {
+				*(ibuff++) = data;
+				ilen--;
 			}
+			rxcnt++;
+		}
 
+		/* Write to TX FIFO, bytes in flight never exceed RX FIFO size */
+		while ((txcnt < len) && (txcnt - rxcnt < SPI_FIFO_SIZE) && ((*(spi->base + SPI_SR) & SPI_SR_TXFULL) == 0)) {
 			if ((obuff != NULL) && (olen > 0)) {
 				data = *(obuff++);
 				olen--;
@@ -221,43 +250,50 @@ int spi_xfer(unsigned int dev, unsigned int ss, const void *out, size_t olen, vo
 				data = 0;
 			}
 			*(spi->base + SPI_DTR) = data;
-			spi_dmb();
+			txcnt++;
 		}
-
-		/* Clear status */
-		*(spi->base + SPI_ISR) = *(spi->base + SPI_ISR);
-		spi_dmb();
-
-		/* Start master xfer */
-		*(spi->base + SPI_CR) &= ~(1 << 8);
 		spi_dmb();
 
-		/* Wait until TX FIFO is empty */
-		/* spi->lock mutex is locked in spi_init() */
-		while (!(*(spi->base + SPI_ISR) & (1 << 2))) {
-			condWait(spi->cond, spi->lock, 0);
+		if (rxcnt == len) {
+			break;
 		}
 
-		/* Read from RX FIFO */
-		while (n > 0) {
-			data = *(spi->base + SPI_DRR) & 0xff;
-			if (iskip > 0) {
-				iskip--;
+		/* Refill at half of TX FIFO, wait for TX FIFO empty after the last byte */
+		/* spi->lock mutex is locked in spi_init() */
+		if (txcnt < len) {
+			*(spi->base + SPI_IER) = SPI_INT_TXHALF;
+			spi_dmb();
+			while (((*(spi->base + SPI_SR) & SPI_SR_TXEMPTY) == 0) && (*(spi->base + SPI_TFIFO) + 1 > SPI_FIFO_SIZE / 2)) {
+				condWait(spi->cond, spi->lock, 0);
 			}
-			else if ((ibuff != NULL) && (ilen > 0)) {
-				*(ibuff++) = data;
-				ilen--;
+		}
+		else {
+			*(spi->base + SPI_IER) = SPI_INT_DTREMPTY;
+			spi_dmb();
+			while ((*(spi->base + SPI_SR) & SPI_SR_TXEMPTY) == 0) {
+				condWait(spi->cond, spi->lock, 0);
 			}
-			n--;
 		}
+		*(spi->base + SPI_IER) = 0;
 	}
 
-	spi_select(spi, ss, 1);
+	*(spi->base + SPI_CR) |= (1 << 8);
+	spi_dmb();
+
+	if (hold == 0) {
+		spi_select(spi, ss, 1);
+	}
 
 	return EOK;
 }
 
 
+int spi_xfer(unsigned int dev, unsigned int ss, const void *out, size_t olen, void *in, size_t ilen, size_t iskip)
+{
+	return spi_xferHold(dev, ss, out, olen, in, ilen, iskip, 0);
+}
+
+
 int spi_init(unsigned int dev)
 {
 	spi_t *spi;
@@ -295,8 +331,8 @@ int spi_init(unsigned int dev)
 	*(spi->base + SPI_CR) = (1 << 7) | (1 << 6) | (1 << 5) | (1 << 2) | (1 << 1);
 	spi_dmb();
 
-	/* Disable all interrupts and enable global interrupt gate */
-	*(spi->base + SPI_IER) = 1 << 2;
+	/* Disable all interrupts and enable global interrupt gate, interrupts are enabled while waiting for FIFO */
+	*(spi->base + SPI_IER) = 0;
 	*(spi->base + SPI_DGIER) = 1U << 31;
 	spi_dmb();
 
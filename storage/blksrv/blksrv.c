@@ -0,0 +1,302 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Block device server core
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/list.h>
+#include <sys/msg.h>
+#include <sys/threads.h>
+
+#include "blksrv.h"
+
+
+struct _blksrv_req_t {
+	msg_t msg;                 /* Request msg */
+	msg_rid_t rid;             /* Request receiving context */
+	blksrv_req_t *prev, *next; /* Doubly linked list */
+};
+
+
+static int blksrv_cmpfs(rbnode_t *node1, rbnode_t *node2)
+{
+	blksrv_fs_t *fs1 = lib_treeof(blksrv_fs_t, node, node1);
+	blksrv_fs_t *fs2 = lib_treeof(blksrv_fs_t, node, node2);
+
+	return strcmp(fs1->name, fs2->name);
+}
+
+
+int blksrv_registerfs(blksrv_t *srv, const char *name, uint8_t type, blksrv_fsMount_t mount, blksrv_fsUnmount_t unmount, blksrv_fsHandler_t handler)
+{
+	blksrv_fs_t *fs;
+
+	if (strlen(name) >= sizeof(fs->name)) {
+		return -EINVAL;
+	}
+
+	fs = malloc(sizeof(blksrv_fs_t));
+	if (fs == NULL) {
+		return -ENOMEM;
+	}
+
+	strcpy(fs->name, name);
+	fs->type = type;
+	fs->mount = mount;
+	fs->unmount = unmount;
+	fs->handler = handler;
+	lib_rbInsert(&srv->fss, &fs->node);
+
+	return EOK;
+}
+
+
+blksrv_fs_t *blksrv_getfs(blksrv_t *srv, const char *name)
+{
+	blksrv_fs_t fs;
+
+	if (strlen(name) >= sizeof(fs.name)) {
+		return NULL;
+	}
+	strcpy(fs.name, name);
+
+	return lib_treeof(blksrv_fs_t, node, lib_rbFind(&srv->fss, &fs.node));
+}
+
+
+blksrv_fs_t *blksrv_findfs(blksrv_t *srv, uint8_t type)
+{
+	rbnode_t *node;
+	blksrv_fs_t *fs;
+
+	for (node = lib_rbMinimum(srv->fss.root); node != NULL; node = lib_rbNext(node)) {
+		fs = lib_treeof(blksrv_fs_t, node, node);
+		if (fs->type == type) {
+			return fs;
+		}
+	}
+
+	return NULL;
+}
+
+
+/* Receives filesystem requests, the mount is queued for the pool when it has work */
+static void blksrv_mntthr(void *arg)
+{
+	blksrv_mnt_t *mnt = (blksrv_mnt_t *)arg;
+	blksrv_t *srv = mnt->srv;
+	blksrv_req_t *req;
+	int umount;
+
+	for (;;) {
+		req = malloc(sizeof(blksrv_req_t));
+		if (req == NULL) {
+			continue;
+		}
+
+		while (msgRecv(mnt->port, &req->msg, &req->rid) < 0) {
+		}
+
+		umount = (req->msg.type == mtUmount) ? 1 : 0;
+
+		mutexLock(srv->lock);
+		LIST_ADD(&mnt->rqueue, req);
+		if (++mnt->queued > mnt->maxQueued) {
+			mnt->maxQueued = mnt->queued;
+		}
+		if (++srv->queued > srv->maxQueued) {
+			srv->maxQueued = srv->queued;
+		}
+
+		if (mnt->active == 0) {
+			mnt->active = 1;
+			LIST_ADD(&srv->ready, mnt);
+			condSignal(srv->cond);
+		}
+		mutexUnlock(srv->lock);
+
+		if (umount != 0) {
+			endthread();
+		}
+	}
+}
+
+
+/* Handles one request of the oldest ready mount at a time, a mount is never handled by two threads at once */
+static void blksrv_poolthr(void *arg)
+{
+	blksrv_t *srv = (blksrv_t *)arg;
+	blksrv_mnt_t *mnt;
+	blksrv_req_t *req;
+
+	mutexLock(srv->lock);
+	for (;;) {
+		while (srv->ready == NULL) {
+			condWait(srv->cond, srv->lock, 0);
+		}
+
+		mnt = srv->ready;
+		LIST_REMOVE(&srv->ready, mnt);
+		req = mnt->rqueue;
+		LIST_REMOVE(&mnt->rqueue, req);
+		mnt->queued--;
+		srv->queued--;
+		srv->busy++;
+		mutexUnlock(srv->lock);
+
+		if (req->msg.type == mtUmount) {
+			req->msg.o.err = mnt->fs->unmount(mnt->fdata);
+			mnt->fs = NULL;
+			mnt->fdata = NULL;
+		}
+		else {
+			mnt->fs->handler(mnt->fdata, &req->msg);
+		}
+
+		msgRespond(mnt->port, &req->msg, req->rid);
+		free(req);
+
+		mutexLock(srv->lock);
+		srv->busy--;
+		mnt->requests++;
+
+		/* Back to the end of the ready list, other mounts go first */
+		if (mnt->rqueue != NULL) {
+			LIST_ADD(&srv->ready, mnt);
+		}
+		else {
+			mnt->active = 0;
+		}
+	}
+}
+
+
+int blksrv_mount(blksrv_t *srv, blksrv_mnt_t *mnt, blksrv_fs_t *fs, unsigned int sectorsz, oid_t *oid)
+{
+	int err;
+
+	if (mnt->fs != NULL) {
+		return -EEXIST;
+	}
+
+	mnt->srv = srv;
+	mnt->rqueue = NULL;
+	mnt->active = 0;
+	mnt->queued = 0;
+	mnt->maxQueued = 0;
+	mnt->requests = 0;
+	mnt->fs = fs;
+
+	err = fs->mount(oid, sectorsz, srv->read, srv->write, &mnt->fdata);
+	if (err < 0) {
+		mnt->fs = NULL;
+		mnt->fdata = NULL;
+		return err;
+	}
+	oid->id = err;
+
+	err = beginthread(blksrv_mntthr, 4, mnt->stack, sizeof(mnt->stack), mnt);
+	if (err < 0) {
+		fs->unmount(mnt->fdata);
+		mnt->fs = NULL;
+		mnt->fdata = NULL;
+		return err;
+	}
+
+	return EOK;
+}
+
+
+int blksrv_stats(blksrv_t *srv, blksrv_mnt_t *mnt, msg_t *msg)
+{
+	blksrv_stats_t *stats = (blksrv_stats_t *)msg->o.raw;
+
+	memset(stats, 0, sizeof(*stats));
+
+	mutexLock(srv->lock);
+	stats->threads = srv->nthreads;
+	stats->busy = srv->busy;
+	stats->queued = srv->queued;
+	stats->maxQueued = srv->maxQueued;
+	if ((mnt != NULL) && (mnt->fs != NULL)) {
+		stats->mntQueued = mnt->queued;
+		stats->mntMaxQueued = mnt->maxQueued;
+		stats->mntRequests = mnt->requests;
+	}
+	mutexUnlock(srv->lock);
+
+	return EOK;
+}
+
+
+int blksrv_run(blksrv_t *srv, unsigned int nthreads, int prio)
+{
+	unsigned int i;
+	int err;
+
+	if (nthreads == 0) {
+		nthreads = BLKSRV_THREADS;
+	}
+
+	srv->stacks = malloc(nthreads * sizeof(*srv->stacks));
+	if (srv->stacks == NULL) {
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < nthreads; i++) {
+		err = beginthread(blksrv_poolthr, prio, srv->stacks[i], sizeof(srv->stacks[i]), srv);
+		if (err < 0) {
+			/* Already started threads keep serving */
+			if (i == 0) {
+				free(srv->stacks);
+				srv->stacks = NULL;
+			}
+			return err;
+		}
+
+		mutexLock(srv->lock);
+		srv->nthreads++;
+		mutexUnlock(srv->lock);
+	}
+
+	return EOK;
+}
+
+
+int blksrv_init(blksrv_t *srv, blksrv_read_t read, blksrv_write_t write)
+{
+	int err;
+
+	err = mutexCreate(&srv->lock);
+	if (err < 0) {
+		return err;
+	}
+
+	err = condCreate(&srv->cond);
+	if (err < 0) {
+		resourceDestroy(srv->lock);
+		return err;
+	}
+
+	lib_rbInit(&srv->fss, blksrv_cmpfs, NULL);
+	srv->ready = NULL;
+	srv->read = read;
+	srv->write = write;
+	srv->nthreads = 0;
+	srv->busy = 0;
+	srv->queued = 0;
+	srv->maxQueued = 0;
+	srv->stacks = NULL;
+
+	return EOK;
+}
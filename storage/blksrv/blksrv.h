@@ -0,0 +1,147 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Block device server core
+ *
+ * Filesystem registry, per-mount request queues and worker pool
+ * shared by the block device servers (pc-ata, umass)
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _BLKSRV_H_
+#define _BLKSRV_H_
+
+#include <stdint.h>
+#include <sys/msg.h>
+#include <sys/rb.h>
+#include <sys/types.h>
+
+
+/* Devctl type, the first word of msg.i.raw, recognized by all block servers using this core */
+#define BLKSRV_DEVCTL_STATS 0x42530000
+
+/* Default number of pool threads */
+#ifndef BLKSRV_THREADS
+#define BLKSRV_THREADS 4
+#endif
+
+/* Pool and mount receiving threads stack size */
+#ifndef BLKSRV_STACKSZ
+#define BLKSRV_STACKSZ (4 * _PAGE_SIZE)
+#endif
+
+
+/* Device access callbacks passed to the filesystems */
+typedef ssize_t (*blksrv_read_t)(id_t id, off_t offs, char *buff, size_t len);
+typedef ssize_t (*blksrv_write_t)(id_t id, off_t offs, const char *buff, size_t len);
+
+
+/* Filesystem callbacks types */
+typedef int (*blksrv_fsHandler_t)(void *, msg_t *);
+typedef int (*blksrv_fsUnmount_t)(void *);
+typedef int (*blksrv_fsMount_t)(oid_t *, unsigned int, blksrv_read_t, blksrv_write_t, void **);
+
+
+typedef struct {
+	rbnode_t node;              /* RBTree node */
+	char name[16];              /* Filesystem name */
+	uint8_t type;               /* Compatible partition type */
+	blksrv_fsHandler_t handler; /* Message handler callback */
+	blksrv_fsUnmount_t unmount; /* Unmount callback */
+	blksrv_fsMount_t mount;     /* Mount callback */
+} blksrv_fs_t;
+
+
+typedef struct _blksrv_t blksrv_t;
+typedef struct _blksrv_req_t blksrv_req_t;
+
+
+/* Mounted filesystem, its requests are handled in order by one pool thread at a time */
+typedef struct _blksrv_mnt_t {
+	struct _blksrv_mnt_t *prev, *next; /* Ready list */
+	blksrv_t *srv;
+	unsigned int port;    /* Filesystem port, created by the caller */
+	blksrv_fs_t *fs;      /* Mounted filesystem, NULL if none */
+	void *fdata;          /* Mounted filesystem data */
+
+	blksrv_req_t *rqueue; /* Requests FIFO queue */
+	int active;           /* Queued on the ready list or being handled */
+	uint32_t queued;
+	uint32_t maxQueued;
+	uint64_t requests;
+
+	/* Filesystem receiving thread stack */
+	char stack[BLKSRV_STACKSZ] __attribute__((aligned(8)));
+} blksrv_mnt_t;
+
+
+struct _blksrv_t {
+	rbtree_t fss;          /* Registered filesystems */
+	handle_t lock, cond;   /* Requests synchronization */
+	blksrv_mnt_t *ready;   /* Mounts with queued requests, round robin */
+	blksrv_read_t read;
+	blksrv_write_t write;
+	unsigned int nthreads; /* Pool threads */
+	unsigned int busy;     /* Pool threads handling a request */
+	uint32_t queued;       /* Requests queued on all mounts */
+	uint32_t maxQueued;
+	char (*stacks)[BLKSRV_STACKSZ];
+};
+
+
+typedef struct {
+	unsigned int type; /* BLKSRV_DEVCTL_STATS */
+} __attribute__((packed)) blksrv_i_devctl_t;
+
+
+/* Request queue statistics, returned in msg.o.raw */
+typedef struct {
+	uint32_t threads;      /* Pool threads */
+	uint32_t busy;         /* Pool threads handling a request */
+	uint32_t queued;       /* Requests waiting on all mounts */
+	uint32_t maxQueued;    /* High watermark of queued */
+	uint32_t mntQueued;    /* Requests waiting on the device's mount, 0 if not mounted */
+	uint32_t mntMaxQueued; /* High watermark of mntQueued */
+	uint64_t mntRequests;  /* Requests handled on the device's mount */
+} __attribute__((packed)) blksrv_stats_t;
+
+
+static inline int blksrv_isStats(const msg_t *msg)
+{
+	return (((const blksrv_i_devctl_t *)msg->i.raw)->type == BLKSRV_DEVCTL_STATS) ? 1 : 0;
+}
+
+
+/* Initializes server, read and write are passed to mounted filesystems */
+extern int blksrv_init(blksrv_t *srv, blksrv_read_t read, blksrv_write_t write);
+
+
+/* Starts nthreads pool threads (0 - BLKSRV_THREADS) */
+extern int blksrv_run(blksrv_t *srv, unsigned int nthreads, int prio);
+
+
+extern int blksrv_registerfs(blksrv_t *srv, const char *name, uint8_t type, blksrv_fsMount_t mount, blksrv_fsUnmount_t unmount, blksrv_fsHandler_t handler);
+
+
+/* Returns filesystem registered under name */
+extern blksrv_fs_t *blksrv_getfs(blksrv_t *srv, const char *name);
+
+
+/* Returns first filesystem compatible with partition type */
+extern blksrv_fs_t *blksrv_findfs(blksrv_t *srv, uint8_t type);
+
+
+/* Mounts fs on mnt, oid->port and oid->id (device id) are set by the caller, oid->id returns filesystem root */
+extern int blksrv_mount(blksrv_t *srv, blksrv_mnt_t *mnt, blksrv_fs_t *fs, unsigned int sectorsz, oid_t *oid);
+
+
+/* Fills msg.o.raw with blksrv_stats_t for mnt (NULL - server totals only), returns value for msg.o.err */
+extern int blksrv_stats(blksrv_t *srv, blksrv_mnt_t *mnt, msg_t *msg);
+
+
+#endif
@@ -13,6 +13,12 @@
  * %LICENSE%
  */
 
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/minmax.h>
+#include <sys/threads.h>
+
 #include <flashdrv/common.h>
 
 
@@ -26,3 +32,244 @@ bool common_isValidAddress(size_t memsz, off_t offs, size_t len)
 {
 	return ((offs < memsz) && ((offs + len) <= memsz));
 }
+
+
+static bool common_isErased(const uint8_t *data, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		if (data[i] != 0xffu) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+static int _common_cacheFlushLine(common_cache_t *cache, common_cacheLine_t *line)
+{
+	const storage_mtdops_t *ops = cache->strg->dev->mtd->ops;
+	const size_t chunksz = cache->strg->dev->mtd->writeBuffsz;
+	size_t retlen;
+
+	if (!line->dirty) {
+		return 0;
+	}
+
+	int res = ops->read(cache->strg, line->offs, cache->scratch, cache->sectorsz, &retlen);
+	if (res < 0) {
+		return res;
+	}
+
+	/* Erase only if some bits have to be changed from 0 to 1 */
+	bool erase = false;
+	for (size_t i = 0; i < cache->sectorsz; i++) {
+		if ((cache->scratch[i] & line->data[i]) != line->data[i]) {
+			erase = true;
+			break;
+		}
+	}
+
+	if (erase) {
+		res = ops->erase(cache->strg, line->offs, cache->sectorsz);
+		if (res < 0) {
+			return res;
+		}
+	}
+
+	for (size_t i = 0; i < cache->sectorsz; i += chunksz) {
+		/* Skip unchanged chunks or erased chunks after sector erase */
+		if (erase) {
+			if (common_isErased(line->data + i, chunksz)) {
+				continue;
+			}
+		}
+		else if (memcmp(cache->scratch + i, line->data + i, chunksz) == 0) {
+			continue;
+		}
+
+		res = ops->write(cache->strg, line->offs + i, line->data + i, chunksz, &retlen);
+		if (res < 0) {
+			return res;
+		}
+	}
+
+	line->dirty = false;
+
+	return 0;
+}
+
+
+static common_cacheLine_t *_common_cacheFind(common_cache_t *cache, off_t offs)
+{
+	for (size_t i = 0; i < cache->nlines; i++) {
+		if (cache->lines[i].offs == offs) {
+			cache->lines[i].used = ++cache->tick;
+			return &cache->lines[i];
+		}
+	}
+
+	return NULL;
+}
+
+
+static common_cacheLine_t *_common_cacheGet(common_cache_t *cache, off_t offs, bool fill)
+{
+	common_cacheLine_t *line = _common_cacheFind(cache, offs);
+	if (line != NULL) {
+		return line;
+	}
+
+	/* Pick unused or least recently used line */
+	line = &cache->lines[0];
+	for (size_t i = 0; (i < cache->nlines) && (line->offs >= 0); i++) {
+		if ((cache->lines[i].offs < 0) || (cache->lines[i].used < line->used)) {
+			line = &cache->lines[i];
+		}
+	}
+
+	if ((line->offs >= 0) && (_common_cacheFlushLine(cache, line) < 0)) {
+		return NULL;
+	}
+
+	line->offs = -1;
+
+	if (fill) {
+		size_t retlen;
+		if (cache->strg->dev->mtd->ops->read(cache->strg, offs, line->data, cache->sectorsz, &retlen) < 0) {
+			return NULL;
+		}
+	}
+
+	line->offs = offs;
+	line->used = ++cache->tick;
+	line->dirty = false;
+
+	return line;
+}
+
+
+int common_cacheInit(common_cache_t *cache, storage_t *strg, size_t nlines)
+{
+	const storage_mtd_t *mtd = strg->dev->mtd;
+
+	if ((nlines == 0) || (mtd == NULL) || (mtd->ops->read == NULL) || (mtd->ops->write == NULL) || (mtd->ops->erase == NULL)) {
+		return -EINVAL;
+	}
+
+	cache->strg = strg;
+	cache->sectorsz = mtd->erasesz;
+	cache->nlines = nlines;
+	cache->tick = 0;
+
+	cache->lines = calloc(nlines, sizeof(common_cacheLine_t));
+	cache->scratch = malloc((nlines + 1) * cache->sectorsz);
+	if ((cache->lines == NULL) || (cache->scratch == NULL)) {
+		free(cache->lines);
+		free(cache->scratch);
+		return -ENOMEM;
+	}
+
+	if (mutexCreate(&cache->lock) < 0) {
+		free(cache->lines);
+		free(cache->scratch);
+		return -ENOMEM;
+	}
+
+	for (size_t i = 0; i < nlines; i++) {
+		cache->lines[i].offs = -1;
+		cache->lines[i].data = cache->scratch + (i + 1) * cache->sectorsz;
+	}
+
+	return 0;
+}
+
+
+void common_cacheDone(common_cache_t *cache)
+{
+	(void)common_cacheSync(cache);
+
+	(void)resourceDestroy(cache->lock);
+	free(cache->lines);
+	free(cache->scratch);
+}
+
+
+ssize_t common_cacheRead(common_cache_t *cache, off_t offs, void *buf, size_t size)
+{
+	uint8_t *dst = buf;
+	size_t done = 0, retlen;
+	int res = 0;
+
+	mutexLock(cache->lock);
+	while (done < size) {
+		off_t sector = common_getSectorOffset(cache->sectorsz, offs + done);
+		size_t pos = offs + done - sector;
+		size_t chunk = min(cache->sectorsz - pos, size - done);
+
+		/* Only written sectors are cached, underlying driver caches reads */
+		common_cacheLine_t *line = _common_cacheFind(cache, sector);
+		if (line != NULL) {
+			memcpy(dst + done, line->data + pos, chunk);
+		}
+		else {
+			res = cache->strg->dev->mtd->ops->read(cache->strg, offs + done, dst + done, chunk, &retlen);
+			if (res < 0) {
+				break;
+			}
+		}
+
+		done += chunk;
+	}
+	mutexUnlock(cache->lock);
+
+	return (res < 0) ? res : (ssize_t)done;
+}
+
+
+ssize_t common_cacheWrite(common_cache_t *cache, off_t offs, const void *buf, size_t size)
+{
+	const uint8_t *src = buf;
+	size_t done = 0;
+	int res = 0;
+
+	mutexLock(cache->lock);
+	while (done < size) {
+		off_t sector = common_getSectorOffset(cache->sectorsz, offs + done);
+		size_t pos = offs + done - sector;
+		size_t chunk = min(cache->sectorsz - pos, size - done);
+
+		common_cacheLine_t *line = _common_cacheGet(cache, sector, chunk != cache->sectorsz);
+		if (line == NULL) {
+			res = -EIO;
+			break;
+		}
+
+		memcpy(line->data + pos, src + done, chunk);
+		line->dirty = true;
+
+		done += chunk;
+	}
+	mutexUnlock(cache->lock);
+
+	return (res < 0) ? res : (ssize_t)done;
+}
+
+
+int common_cacheSync(common_cache_t *cache)
+{
+	int res = 0;
+
+	mutexLock(cache->lock);
+	for (size_t i = 0; i < cache->nlines; i++) {
+		if (cache->lines[i].offs >= 0) {
+			int err = _common_cacheFlushLine(cache, &cache->lines[i]);
+			if (err < 0) {
+				res = err;
+			}
+		}
+	}
+	mutexUnlock(cache->lock);
+
+	return res;
+}
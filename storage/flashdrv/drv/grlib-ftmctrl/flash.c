@@ -31,6 +31,10 @@
 
 #define FLASH_DEVICES 2
 
+/* Erase status poll interval limits in us */
+#define FLASH_POLL_MIN_US 100
+#define FLASH_POLL_MAX_US 10000
+
 
 typedef union {
 	uint8_t b;
@@ -45,8 +49,8 @@ static struct {
 } common;
 
 
-/* Timeout in us */
-static int flash_statusPoll(const struct _storage_devCtx_t *ctx, const flash_word_t src, volatile uint8_t *dst, time_t timeout)
+/* Timeout and interval in us, interval 0 polls without sleeping */
+static int flash_statusPoll(const struct _storage_devCtx_t *ctx, const flash_word_t src, volatile uint8_t *dst, time_t timeout, time_t interval)
 {
 	bool ready;
 	time_t start;
@@ -80,14 +84,16 @@ static int flash_statusPoll(const struct _storage_devCtx_t *ctx, const flash_wor
 			}
 		}
 
-		usleep(100);
+		if (interval > 0) {
+			usleep(interval);
+		}
 	}
 
 	return 0;
 }
 
 
-static int flash_statusWait(const struct _storage_devCtx_t *ctx, time_t timeout)
+static int flash_statusWait(const struct _storage_devCtx_t *ctx, time_t timeout, time_t interval)
 {
 	time_t start;
 	(void)gettime(&start, NULL);
@@ -100,13 +106,32 @@ static int flash_statusWait(const struct _storage_devCtx_t *ctx, time_t timeout)
 				return -ETIME;
 			}
 		}
-		usleep(100);
+
+		if (interval > 0) {
+			usleep(interval);
+		}
 	}
 
 	return 0;
 }
 
 
+/* Erase takes milliseconds, sleep between polls for a fraction of the typical time */
+static time_t flash_eraseInterval(uint8_t typical)
+{
+	time_t interval = ((time_t)1 << typical) * 1000 / 16;
+
+	if (interval < FLASH_POLL_MIN_US) {
+		interval = FLASH_POLL_MIN_US;
+	}
+	else if (interval > FLASH_POLL_MAX_US) {
+		interval = FLASH_POLL_MAX_US;
+	}
+
+	return interval;
+}
+
+
 static uint16_t flash_deserialize16(uint16_t value)
 {
 	return ((value & 0xff) << 8) | ((value >> 8) & 0xff);
@@ -169,6 +194,7 @@ int ftmctrl_flash_writeBuffer(const struct _storage_devCtx_t *ctx, off_t offs, c
 
 	ctx->dev->ops->issueWriteConfirm(common.base, sectorOffs);
 
+	/* Buffer program completes in hundreds of us, sleeping would take much longer */
 	int res;
 	if (ctx->dev->usePolling != 0) {
 		flash_word_t word;
@@ -184,10 +210,10 @@ int ftmctrl_flash_writeBuffer(const struct _storage_devCtx_t *ctx, off_t offs, c
 			default:
 				return -EINVAL;
 		}
-		res = flash_statusPoll(ctx, word, common.base + offs + len - (portWidth / 8), timeout);
+		res = flash_statusPoll(ctx, word, common.base + offs + len - (portWidth / 8), timeout, 0);
 	}
 	else {
-		res = flash_statusWait(ctx, timeout);
+		res = flash_statusWait(ctx, timeout, 0);
 	}
 
 	int status = ctx->dev->ops->statusCheck(common.base, "write buffer");
@@ -202,6 +228,7 @@ int ftmctrl_flash_sectorErase(const struct _storage_devCtx_t *ctx, off_t sectorO
 {
 	ctx->dev->ops->issueSectorErase(common.base, sectorOffs);
 
+	const time_t interval = flash_eraseInterval(ctx->cfi.toutTypical.blkErase);
 	int res;
 	if (ctx->dev->usePolling != 0) {
 		flash_word_t word;
@@ -218,10 +245,10 @@ int ftmctrl_flash_sectorErase(const struct _storage_devCtx_t *ctx, off_t sectorO
 			default:
 				return -EINVAL;
 		}
-		res = flash_statusPoll(ctx, word, common.base + sectorOffs + ctx->sectorsz - (portWidth / 8), timeout);
+		res = flash_statusPoll(ctx, word, common.base + sectorOffs + ctx->sectorsz - (portWidth / 8), timeout, interval);
 	}
 	else {
-		res = flash_statusWait(ctx, timeout);
+		res = flash_statusWait(ctx, timeout, interval);
 	}
 
 	int status = ctx->dev->ops->statusCheck(common.base, "sector erase");
@@ -240,7 +267,7 @@ int ftmctrl_flash_chipErase(const struct _storage_devCtx_t *ctx, time_t timeout)
 
 	ctx->dev->ops->issueChipErase(common.base);
 
-	int res = flash_statusWait(ctx, timeout);
+	int res = flash_statusWait(ctx, timeout, FLASH_POLL_MAX_US);
 
 	int status = ctx->dev->ops->statusCheck(common.base, "chip erase");
 
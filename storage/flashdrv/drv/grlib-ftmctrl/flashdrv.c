@@ -110,13 +110,11 @@ static int _flashdrv_mtdWrite(storage_t *strg, off_t offs, const void *buff, siz
 	int res = 0;
 	const size_t writeBuffsz = strg->dev->mtd->writeBuffsz;
 
+	ftmctrl_WrEn(ctx->ftmctrl);
 	while (doneBytes < len) {
 		size_t chunk = min(writeBuffsz - (offs % writeBuffsz), len - doneBytes);
 
-		ftmctrl_WrEn(ctx->ftmctrl);
 		res = ftmctrl_flash_writeBuffer(ctx, offs, src, chunk, CFI_TIMEOUT_MAX_PROGRAM(ctx->cfi.toutTypical.bufWrite, ctx->cfi.toutMax.bufWrite) * 2);
-		ftmctrl_WrDis(ctx->ftmctrl);
-
 		if (res < 0) {
 			break;
 		}
@@ -125,6 +123,7 @@ static int _flashdrv_mtdWrite(storage_t *strg, off_t offs, const void *buff, siz
 		src += chunk;
 		offs += chunk;
 	}
+	ftmctrl_WrDis(ctx->ftmctrl);
 
 	*retlen = doneBytes;
 
@@ -13,6 +13,7 @@
 
 #include <errno.h>
 #include <string.h>
+#include <unistd.h>
 #include <sys/mman.h>
 #include <sys/time.h>
 
@@ -30,6 +31,10 @@
 #define VID_MACRONIX 0xc2u
 #define VID_SPANSION 0x01u
 
+/* Erase status poll interval limits in us */
+#define FLASH_POLL_MIN_US 100
+#define FLASH_POLL_MAX_US 10000
+
 /* clang-format off */
 
 enum { write_disable = 0, write_enable };
@@ -67,7 +72,8 @@ static int flash_readStatus(const struct flash_dev *dev, struct spimctrl *spimct
 }
 
 
-static int flash_waitBusy(const struct flash_dev *dev, struct spimctrl *spimctrl, time_t timeout)
+/* Timeout in ms, interval in us, interval 0 polls without sleeping */
+static int flash_waitBusy(const struct flash_dev *dev, struct spimctrl *spimctrl, time_t timeout, time_t interval)
 {
 	int res;
 	uint8_t status = 0;
@@ -76,22 +82,46 @@ static int flash_waitBusy(const struct flash_dev *dev, struct spimctrl *spimctrl
 
 	end += timeout * 1000;
 
-	do {
+	for (;;) {
 		res = flash_readStatus(dev, spimctrl, &status);
 		if (res < 0) {
 			return res;
 		}
 
+		if ((status & FLASH_SR_WIP) == 0) {
+			break;
+		}
+
 		(void)gettime(&now, NULL);
 		if ((timeout > 0) && (now > end)) {
 			return -ETIME;
 		}
-	} while ((status & FLASH_SR_WIP) != 0);
+
+		if (interval > 0) {
+			usleep(interval);
+		}
+	}
 
 	return 0;
 }
 
 
+/* Erase takes milliseconds, sleep between polls for a fraction of the typical time */
+static time_t flash_eraseInterval(uint8_t typical)
+{
+	time_t interval = ((time_t)1 << typical) * 1000 / 16;
+
+	if (interval < FLASH_POLL_MIN_US) {
+		interval = FLASH_POLL_MIN_US;
+	}
+	else if (interval > FLASH_POLL_MAX_US) {
+		interval = FLASH_POLL_MAX_US;
+	}
+
+	return interval;
+}
+
+
 static int flash_writeEnable(const struct flash_dev *dev, struct spimctrl *spimctrl, int enable)
 {
 	int res;
@@ -99,7 +129,7 @@ static int flash_writeEnable(const struct flash_dev *dev, struct spimctrl *spimc
 	uint8_t status = 0;
 	const uint8_t cmd = (enable == 1) ? dev->cmds->wren : dev->cmds->wrdi;
 
-	res = flash_waitBusy(dev, spimctrl, 0);
+	res = flash_waitBusy(dev, spimctrl, 0, 0);
 	if (res < 0) {
 		return res;
 	}
@@ -211,7 +241,7 @@ int spimctrl_flash_chipErase(const struct _storage_devCtx_t *ctx, time_t timeout
 		return res;
 	}
 
-	return flash_waitBusy(ctx->dev, ctx->spimctrl, timeout);
+	return flash_waitBusy(ctx->dev, ctx->spimctrl, timeout, FLASH_POLL_MAX_US);
 }
 
 
@@ -256,7 +286,7 @@ int spimctrl_flash_sectorErase(const struct _storage_devCtx_t *ctx, addr_t addr,
 			return res;
 		}
 
-		res = flash_waitBusy(ctx->dev, ctx->spimctrl, timeout);
+		res = flash_waitBusy(ctx->dev, ctx->spimctrl, timeout, flash_eraseInterval(ctx->cfi.toutTypical.blkErase));
 		if (res < 0) {
 			return res;
 		}
@@ -297,7 +327,7 @@ int spimctrl_flash_pageProgram(const struct _storage_devCtx_t *ctx, addr_t addr,
 		return res;
 	}
 
-	res = flash_waitBusy(ctx->dev, ctx->spimctrl, timeout);
+	res = flash_waitBusy(ctx->dev, ctx->spimctrl, timeout, 0);
 
 	return res;
 }
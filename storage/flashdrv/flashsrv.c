@@ -30,17 +30,22 @@
 #include <ptable.h>
 #include <storage/storage.h>
 
+#include <flashdrv/common.h>
 #include <flashdrv/flashsrv.h>
 
 #define STRG_PATH "mtd0"
 
 #define MAX_DRIVERS 4
 
+/* Partition table is read with a single flash access if it fits in PTABLE_READSZ bytes */
+#define PTABLE_READSZ 512
+
 
 struct flashsrv_opts {
 	const struct flash_driver *driver;
 	addr_t mctrlBase;
 	addr_t flashBase;
+	size_t cacheSectors;
 	struct {
 		char *partname;
 		char *fs;
@@ -51,6 +56,9 @@ struct flashsrv_opts {
 static struct {
 	const struct flash_driver *registry[MAX_DRIVERS];
 	size_t ndrivers;
+
+	common_cache_t cache; /* Sector cache for device file writes */
+	bool cached;
 } common;
 
 
@@ -67,6 +75,10 @@ static ssize_t flashsrv_read(storage_t *strg, off_t offs, void *buf, size_t size
 		return 0;
 	}
 
+	if (common.cached) {
+		return common_cacheRead(&common.cache, offs, buf, size);
+	}
+
 	storage_mtd_t *mtd = strg->dev->mtd;
 	if ((mtd != NULL) && (mtd->ops != NULL) && (mtd->ops->read != NULL)) {
 		size_t retlen;
@@ -91,6 +103,10 @@ static ssize_t flashsrv_write(storage_t *strg, off_t offs, const void *buf, size
 		return 0;
 	}
 
+	if (common.cached) {
+		return common_cacheWrite(&common.cache, offs, buf, size);
+	}
+
 	storage_mtd_t *mtd = strg->dev->mtd;
 	if ((mtd != NULL) && (mtd->ops != NULL) && (mtd->ops->write != NULL)) {
 		size_t retlen;
@@ -111,13 +127,21 @@ static int flashsrv_sync(storage_t *strg)
 		return -EINVAL;
 	}
 
+	int res = -EINVAL;
+	if (common.cached) {
+		res = common_cacheSync(&common.cache);
+		if (res < 0) {
+			return res;
+		}
+	}
+
 	storage_mtd_t *mtd = strg->dev->mtd;
 	if ((mtd != NULL) && (mtd->ops != NULL) && (mtd->ops->sync != NULL)) {
 		mtd->ops->sync(strg);
 		return 0;
 	}
 
-	return -EINVAL;
+	return res;
 }
 
 
@@ -247,6 +271,8 @@ static void flashsrv_help(const char *prog)
 	printf("\t-c <addr>    - use <addr> as memory controller base address (required)\n");
 	printf("\t-m <addr>    - use <addr> as flash memory base address (required)\n");
 	printf("\t-d <driver>  - use <driver> for flash memory (required)\n");
+	printf("\t-s <count>   - cache <count> erase sectors written through device files\n");
+	printf("\t               with read-modify-write, flushed on sync (default 0 - disabled)\n");
 	printf("\t               available drivers: \n");
 	printf("\t               ");
 
@@ -259,7 +285,7 @@ static void flashsrv_help(const char *prog)
 static int flashsrv_parseInitArgs(int argc, char **argv, struct flashsrv_opts *opts)
 {
 	for (;;) {
-		int c = getopt(argc, argv, "r:d:c:m:h");
+		int c = getopt(argc, argv, "r:d:c:m:s:h");
 		if (c == -1) {
 			return 0;
 		}
@@ -314,6 +340,10 @@ static int flashsrv_parseInitArgs(int argc, char **argv, struct flashsrv_opts *o
 				}
 				break;
 
+			case 's':
+				opts->cacheSectors = strtoul(optarg, NULL, 0);
+				break;
+
 			default:
 				LOG_ERROR("Unknown option: %c", c);
 				return -1;
@@ -340,37 +370,49 @@ void flashsrv_register(const struct flash_driver *driver)
 
 static ptable_t *flashsrv_ptableRead(storage_t *strg)
 {
-	uint32_t count;
-	off_t offs = strg->size - strg->dev->mtd->erasesz;
-	/* Read number of partitions */
-	if (flashsrv_read(strg, offs, &count, sizeof(count)) != sizeof(count)) {
-		return NULL;
-	}
-	count = le32toh(count);
+	ptable_t *ptable, *tmp;
+	off_t offs;
+	uint32_t count, size, readsz;
 
-	/* Verify ptable size */
-	uint32_t size = ptable_size(count);
-	if (size > strg->dev->mtd->erasesz) {
+	/* Read number of partitions along with the beginning of the table */
+	offs = strg->size - strg->dev->mtd->erasesz;
+	readsz = (strg->dev->mtd->erasesz < PTABLE_READSZ) ? strg->dev->mtd->erasesz : PTABLE_READSZ;
+
+	ptable = malloc(readsz);
+	if (ptable == NULL) {
 		return NULL;
 	}
 
-	/* Verify magic signature */
-	uint8_t magic[sizeof(ptable_magic)];
-	if (flashsrv_read(strg, offs + size - sizeof(magic), magic, sizeof(magic)) != sizeof(magic)) {
+	if (flashsrv_read(strg, offs, ptable, readsz) != readsz) {
+		free(ptable);
 		return NULL;
 	}
+	count = le32toh(ptable->count);
 
-	if (memcmp(magic, ptable_magic, sizeof(magic)) != 0) {
+	/* Verify partition table size */
+	size = ptable_size(count);
+	if (size > strg->dev->mtd->erasesz) {
+		free(ptable);
 		return NULL;
 	}
 
-	ptable_t *ptable = malloc(size);
-	if (ptable == NULL) {
-		return NULL;
+	/* Read the rest of the table only if it didn't fit */
+	if (size > readsz) {
+		tmp = realloc(ptable, size);
+		if (tmp == NULL) {
+			free(ptable);
+			return NULL;
+		}
+		ptable = tmp;
+
+		if (flashsrv_read(strg, offs + readsz, (uint8_t *)ptable + readsz, size - readsz) != size - readsz) {
+			free(ptable);
+			return NULL;
+		}
 	}
 
-	/* Read partition table */
-	if (flashsrv_read(strg, offs, ptable, size) != size) {
+	/* Verify magic signature */
+	if (memcmp((uint8_t *)ptable + size - sizeof(ptable_magic), ptable_magic, sizeof(ptable_magic)) != 0) {
 		free(ptable);
 		return NULL;
 	}
@@ -520,6 +562,7 @@ int main(int argc, char **argv)
 		.driver = NULL,
 		.mctrlBase = (addr_t)-1,
 		.flashBase = (addr_t)-1,
+		.cacheSectors = 0,
 		.root = { 0 }
 	};
 
@@ -561,6 +604,17 @@ int main(int argc, char **argv)
 		exit(EXIT_FAILURE);
 	}
 
+	if (opts.cacheSectors != 0) {
+		err = common_cacheInit(&common.cache, strg, opts.cacheSectors);
+		if (err < 0) {
+			LOG_ERROR("failed to initialize sector cache (%d)", err);
+			storage_remove(strg);
+			opts.driver->destroy(strg);
+			exit(EXIT_FAILURE);
+		}
+		common.cached = true;
+	}
+
 	if ((opts.root.partname != NULL) && (opts.root.fs != NULL)) {
 		if (flashsrv_mountRoot(opts.root.partname, opts.root.fs) < 0) {
 			storage_remove(strg);
@@ -573,6 +627,11 @@ int main(int argc, char **argv)
 	kill(getppid(), SIGUSR1);
 	err = storage_run(1, 2 * _PAGE_SIZE);
 
+	if (common.cached) {
+		common.cached = false;
+		common_cacheDone(&common.cache);
+	}
+
 	storage_remove(strg);
 	opts.driver->destroy(strg);
 
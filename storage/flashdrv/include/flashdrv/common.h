@@ -18,13 +18,53 @@
 
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <storage/storage.h>
 
 
+typedef struct {
+	off_t offs;        /* Sector offset, -1 if line is unused */
+	unsigned int used; /* Last use timestamp */
+	bool dirty;
+	uint8_t *data;
+} common_cacheLine_t;
+
+
+/* Write back cache of erase sectors, provides read-modify-write on top of the MTD interface */
+typedef struct {
+	storage_t *strg;
+	size_t sectorsz;
+	size_t nlines;
+	unsigned int tick;
+	common_cacheLine_t *lines;
+	uint8_t *scratch;
+	handle_t lock;
+} common_cache_t;
+
+
 off_t common_getSectorOffset(size_t sectorsz, off_t offs);
 
 
 bool common_isValidAddress(size_t memsz, off_t offs, size_t len);
 
 
+/* Initializes cache of nlines erase sectors of the strg MTD device */
+int common_cacheInit(common_cache_t *cache, storage_t *strg, size_t nlines);
+
+
+/* Writes back dirty sectors and frees cache resources */
+void common_cacheDone(common_cache_t *cache);
+
+
+ssize_t common_cacheRead(common_cache_t *cache, off_t offs, void *buf, size_t size);
+
+
+/* Updates cached sectors, least recently used dirty sectors are written back on eviction */
+ssize_t common_cacheWrite(common_cache_t *cache, off_t offs, const void *buf, size_t size);
+
+
+/* Writes back all dirty sectors */
+int common_cacheSync(common_cache_t *cache);
+
+
 #endif
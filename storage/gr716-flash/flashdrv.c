@@ -16,13 +16,26 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <unistd.h>
 #include <sys/minmax.h>
+#include <sys/time.h>
 
 #include "flashdrv.h"
 #include "spimctrl.h"
+#include "nor/flash.h"
 #include "nor/nor.h"
 
 
+/* Suspend sector erase for reads, 0 - reads wait for erase completion */
+#ifndef GR716_FLASH_SUSPEND
+#define GR716_FLASH_SUSPEND 1
+#endif
+
+#define FLASH_ERASE_POLL_US      1000 /* Sector erase status poll interval */
+#define FLASH_SUSPEND_MIN_RUN_US 1000 /* Erase progress guaranteed between suspends, so that constant reads don't starve it */
+#define FLASH_SUSPEND_TIMEOUT_MS 1
+
+
 /* Helper functions */
 
 
@@ -48,9 +61,109 @@ static int flash_isValidAddress(size_t memsz, addr_t offs, size_t len)
 }
 
 
+void flash_readRequest(flash_context_t *ctx, int inc)
+{
+	(void)__atomic_add_fetch(&ctx->readReqs, (inc > 0) ? 1 : -1, __ATOMIC_SEQ_CST);
+}
+
+
+/* Erases sector, suspends the erase for waiting reads */
+static int flash_eraseSector(flash_context_t *ctx, addr_t offs)
+{
+	time_t now, end, resumed;
+	uint8_t status;
+	int res;
+
+	res = nor_eraseSectorStart(&ctx->spimctrl, offs);
+	if (res < EOK) {
+		return res;
+	}
+
+	(void)gettime(&now, NULL);
+	resumed = now;
+	end = now + ctx->properties->tSE * 1000;
+
+	for (;;) {
+		res = nor_readStatus(&ctx->spimctrl, &status);
+		if (res < EOK) {
+			return res;
+		}
+
+		if ((status & FLASH_SR_WIP) == 0) {
+			return EOK;
+		}
+
+		(void)gettime(&now, NULL);
+		if (now > end) {
+			return -ETIME;
+		}
+
+		if ((GR716_FLASH_SUSPEND != 0) && (ctx->properties->suspend != 0) && (ctx->suspendYield != NULL) &&
+				(ctx->readReqs > 0) && ((now - resumed) >= FLASH_SUSPEND_MIN_RUN_US)) {
+			res = nor_suspend(&ctx->spimctrl, FLASH_SUSPEND_TIMEOUT_MS);
+			if (res <= 0) {
+				/* Error or erase already finished */
+				return res;
+			}
+
+			ctx->suspendAddr = offs;
+			ctx->suspended = 1;
+			do {
+				ctx->suspendYield(ctx->suspendArg);
+			} while (ctx->readReqs > 0);
+			ctx->suspended = 0;
+
+			res = nor_resume(&ctx->spimctrl);
+			if (res < EOK) {
+				return res;
+			}
+
+			/* Time spent suspended doesn't count to the erase timeout */
+			(void)gettime(&resumed, NULL);
+			end += resumed - now;
+			continue;
+		}
+
+		(void)usleep(FLASH_ERASE_POLL_US);
+	}
+}
+
+
+/* Reads with sector erase suspended: EAR can't be changed and the sector being erased reads as erased */
+static ssize_t flash_readSuspended(flash_context_t *ctx, addr_t offs, uint8_t *buff, size_t len)
+{
+	const addr_t eraseEnd = ctx->suspendAddr + ctx->properties->sectorSz;
+	size_t chunk, doneBytes;
+	ssize_t res;
+
+	for (doneBytes = 0; doneBytes < len; doneBytes += chunk) {
+		chunk = len - doneBytes;
+
+		if ((offs >= ctx->suspendAddr) && (offs < eraseEnd)) {
+			chunk = min(chunk, eraseEnd - offs);
+			(void)memset(buff + doneBytes, NOR_ERASED_STATE, chunk);
+		}
+		else {
+			if (offs < ctx->suspendAddr) {
+				chunk = min(chunk, ctx->suspendAddr - offs);
+			}
+
+			res = nor_readDataFixedEar(&ctx->spimctrl, offs, buff + doneBytes, chunk);
+			if (res < 0) {
+				return res;
+			}
+		}
+
+		offs += chunk;
+	}
+
+	return (ssize_t)doneBytes;
+}
+
+
 static ssize_t flash_directSectorWrite(flash_context_t *ctx, addr_t offs, const uint8_t *src)
 {
-	int res = nor_eraseSector(&ctx->spimctrl, offs, ctx->properties->tSE);
+	int res = flash_eraseSector(ctx, offs);
 	if (res < 0) {
 		return res;
 	}
@@ -96,7 +209,12 @@ ssize_t flash_readData(flash_context_t *ctx, addr_t offs, void *buff, size_t len
 		len -= doneBytes;
 	}
 
-	res = nor_readData(&ctx->spimctrl, offs, buff, len);
+	if (ctx->suspended != 0) {
+		res = flash_readSuspended(ctx, offs, buff, len);
+	}
+	else {
+		res = nor_readData(&ctx->spimctrl, offs, buff, len);
+	}
 
 	return (res < 0) ? res : (ssize_t)(doneBytes + res);
 }
@@ -222,7 +340,7 @@ int flash_sectorErase(flash_context_t *ctx, addr_t offs)
 		ctx->sectorBufAddr = (addr_t)-1;
 	}
 
-	return nor_eraseSector(&ctx->spimctrl, offs, ctx->properties->tSE);
+	return flash_eraseSector(ctx, offs);
 }
 
 
@@ -245,6 +363,11 @@ int flash_init(flash_context_t *ctx, int instance)
 	ctx->sectorBufAddr = (addr_t)-1;
 	ctx->sectorBufDirty = 0;
 	ctx->sectorBuf = NULL;
+	ctx->suspended = 0;
+	ctx->readReqs = 0;
+	ctx->suspendAddr = (addr_t)-1;
+	ctx->suspendYield = NULL;
+	ctx->suspendArg = NULL;
 
 	res = spimctrl_init(&ctx->spimctrl, instance);
 	if (res != EOK) {
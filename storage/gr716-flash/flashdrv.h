@@ -33,9 +33,21 @@ typedef struct {
 	addr_t sectorBufAddr;
 	uint8_t sectorBufDirty;
 	uint8_t *sectorBuf;
+
+	/* Sector erase suspend for reads, see flash_readRequest() */
+	volatile uint8_t suspended;
+	volatile int readReqs;
+	addr_t suspendAddr;
+	void (*suspendYield)(void *arg); /* called with erase suspended, lets the waiting reads run */
+	void *suspendArg;
 } flash_context_t;
 
 
+/* Registers (inc > 0) or unregisters read waiting for the memory. While there are waiting reads, sector erase
+ * in progress is suspended and ctx->suspendYield() is called until there are no more waiting reads. */
+void flash_readRequest(flash_context_t *ctx, int inc);
+
+
 ssize_t flash_readData(flash_context_t *ctx, addr_t offs, void *buff, size_t len);
 
 
@@ -13,6 +13,7 @@
 
 #include <endian.h>
 #include <errno.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -41,6 +42,9 @@
 
 #define GR716_FLASH_PRIO 3
 
+/* Partition table is read with a single flash access if it fits in PTABLE_READSZ bytes */
+#define PTABLE_READSZ 512
+
 
 typedef struct {
 	ptable_part_t *pHeader;
@@ -105,6 +109,51 @@ static int flashsrv_fsEraseSectorf0(struct _meterfs_devCtx_t *devCtx, off_t offs
 }
 
 
+/*
+ * Memory locking: reads suspend sector erase in progress (see flash_readRequest()), the same scheme
+ * as in storage/imxrt-flash/flashsrv.c (documented there) - keep both in sync. The sector being erased
+ * reads as erased while the erase is suspended (flash_readSuspended()).
+ */
+
+
+static void flashsrv_suspendYield(void *arg)
+{
+	flash_memory_t *memory = (flash_memory_t *)arg;
+
+	/* Erase owner holds the lock, hand it over to the waiting reads */
+	mutexUnlock(memory->lock);
+	mutexLock(memory->lock);
+}
+
+
+static void flashsrv_lock(flash_memory_t *memory, bool read)
+{
+	if (read) {
+		flash_readRequest(&memory->ctx, 1);
+		mutexLock(memory->lock);
+		return;
+	}
+
+	mutexLock(memory->lock);
+
+	/* Memory can't be modified while erase is suspended, let its owner continue */
+	while (memory->ctx.suspended != 0) {
+		mutexUnlock(memory->lock);
+		mutexLock(memory->lock);
+	}
+}
+
+
+static void flashsrv_unlock(flash_memory_t *memory, bool read)
+{
+	if (read) {
+		flash_readRequest(&memory->ctx, -1);
+	}
+
+	mutexUnlock(memory->lock);
+}
+
+
 /* Device control */
 
 
@@ -239,63 +288,80 @@ static void flashsrv_rawCtl(flash_memory_t *memory, msg_t *msg)
 /* Threads */
 
 
+static int flashsrv_initMeterfs(flashsrv_partition_t *part);
+
+
 static void flashsrv_meterfsThread(void *arg)
 {
 	msg_t msg;
 	msg_rid_t rid;
 
 	flashsrv_partition_t *part = (flashsrv_partition_t *)arg;
+	flash_memory_t *memory = &flashsrv_common.flash_memories[part->fID];
 
 	meterfs_i_devctl_t *idevctl = (meterfs_i_devctl_t *)msg.i.raw;
 	meterfs_o_devctl_t *odevctl = (meterfs_o_devctl_t *)msg.o.raw;
 
+	/* Partition's device is already visible, requests wait in its port until meterfs is initialized */
+	if (flashsrv_initMeterfs(part) < 0) {
+		LOG_ERROR("partition %s at flash %u is not mounted.", part->pHeader->name, part->fID);
+		free(part->fsCtx);
+		part->fsCtx = NULL;
+	}
+
 	for (;;) {
 		while (msgRecv(part->oid.port, &msg, &rid) < 0) {
 		}
 
+		if (part->fsCtx == NULL) {
+			msg.o.err = -ENODEV;
+			msgRespond(part->oid.port, &msg, rid);
+			continue;
+		}
+
 		switch (msg.type) {
 			case mtRead:
-				mutexLock(flashsrv_common.flash_memories[part->fID].lock);
-				flashsrv_common.flash_memories[part->fID].currPart = part->oid.id;
+				flashsrv_lock(memory, true);
+				memory->currPart = part->oid.id;
 				msg.o.err = meterfs_readFile(msg.oid.id, msg.i.io.offs, msg.o.data, msg.o.size, (meterfs_ctx_t *)part->fsCtx);
-				mutexUnlock(flashsrv_common.flash_memories[part->fID].lock);
+				flashsrv_unlock(memory, true);
 				break;
 
 			case mtWrite:
-				mutexLock(flashsrv_common.flash_memories[part->fID].lock);
-				flashsrv_common.flash_memories[part->fID].currPart = part->oid.id;
+				flashsrv_lock(memory, false);
+				memory->currPart = part->oid.id;
 				msg.o.err = meterfs_writeFile(msg.oid.id, msg.i.data, msg.i.size, (meterfs_ctx_t *)part->fsCtx);
-				mutexUnlock(flashsrv_common.flash_memories[part->fID].lock);
+				flashsrv_unlock(memory, false);
 				break;
 
 			case mtLookup:
-				mutexLock(flashsrv_common.flash_memories[part->fID].lock);
-				flashsrv_common.flash_memories[part->fID].currPart = part->oid.id;
+				flashsrv_lock(memory, false);
+				memory->currPart = part->oid.id;
 				msg.o.err = meterfs_lookup(msg.i.data, &msg.o.lookup.fil.id, (meterfs_ctx_t *)part->fsCtx);
 				msg.o.lookup.fil.port = part->oid.port;
-				mutexUnlock(flashsrv_common.flash_memories[part->fID].lock);
+				flashsrv_unlock(memory, false);
 				(void)memcpy(&msg.o.lookup.dev, &msg.o.lookup.fil, sizeof(oid_t));
 				break;
 
 			case mtOpen:
-				mutexLock(flashsrv_common.flash_memories[part->fID].lock);
-				flashsrv_common.flash_memories[part->fID].currPart = part->oid.id;
+				flashsrv_lock(memory, false);
+				memory->currPart = part->oid.id;
 				msg.o.err = meterfs_open(msg.oid.id, (meterfs_ctx_t *)part->fsCtx);
-				mutexUnlock(flashsrv_common.flash_memories[part->fID].lock);
+				flashsrv_unlock(memory, false);
 				break;
 
 			case mtClose:
-				mutexLock(flashsrv_common.flash_memories[part->fID].lock);
-				flashsrv_common.flash_memories[part->fID].currPart = part->oid.id;
+				flashsrv_lock(memory, false);
+				memory->currPart = part->oid.id;
 				msg.o.err = meterfs_close(msg.oid.id, (meterfs_ctx_t *)part->fsCtx);
-				mutexUnlock(flashsrv_common.flash_memories[part->fID].lock);
+				flashsrv_unlock(memory, false);
 				break;
 
 			case mtDevCtl:
-				mutexLock(flashsrv_common.flash_memories[part->fID].lock);
-				flashsrv_common.flash_memories[part->fID].currPart = part->oid.id;
+				flashsrv_lock(memory, false);
+				memory->currPart = part->oid.id;
 				msg.o.err = meterfs_devctl(idevctl, odevctl, (meterfs_ctx_t *)part->fsCtx);
-				mutexUnlock(flashsrv_common.flash_memories[part->fID].lock);
+				flashsrv_unlock(memory, false);
 				break;
 
 			default:
@@ -346,9 +412,9 @@ static void flashsrv_rawThread(void *arg)
 					}
 
 					startAddr = memory->parts[msg.oid.id].pHeader->offset;
-					mutexLock(memory->lock);
+					flashsrv_lock(memory, true);
 					msg.o.err = flash_readData(&memory->ctx, startAddr + msg.i.io.offs, msg.o.data, msg.o.size);
-					mutexUnlock(memory->lock);
+					flashsrv_unlock(memory, true);
 					break;
 
 				case mtWrite:
@@ -358,15 +424,15 @@ static void flashsrv_rawThread(void *arg)
 					}
 
 					startAddr = memory->parts[msg.oid.id].pHeader->offset;
-					mutexLock(memory->lock);
+					flashsrv_lock(memory, false);
 					msg.o.err = flash_bufferedWrite(&memory->ctx, startAddr + msg.i.io.offs, msg.i.data, msg.i.size);
-					mutexUnlock(memory->lock);
+					flashsrv_unlock(memory, false);
 					break;
 
 				case mtDevCtl:
-					mutexLock(memory->lock);
+					flashsrv_lock(memory, false);
 					flashsrv_rawCtl(memory, &msg);
-					mutexUnlock(memory->lock);
+					flashsrv_unlock(memory, false);
 					break;
 
 				case mtOpen:
@@ -374,16 +440,16 @@ static void flashsrv_rawThread(void *arg)
 					break;
 
 				case mtClose:
-					mutexLock(memory->lock);
+					flashsrv_lock(memory, false);
 					(void)flash_sync(&memory->ctx);
-					mutexUnlock(memory->lock);
+					flashsrv_unlock(memory, false);
 					msg.o.err = 0;
 					break;
 
 				case mtSync:
-					mutexLock(memory->lock);
+					flashsrv_lock(memory, false);
 					msg.o.err = flash_sync(&memory->ctx);
-					mutexUnlock(memory->lock);
+					flashsrv_unlock(memory, false);
 					break;
 
 				case mtGetAttr:
@@ -418,21 +484,21 @@ static void flashsrv_devThread(void *arg)
 
 		switch (msg.type) {
 			case mtRead:
-				mutexLock(memory->lock);
+				flashsrv_lock(memory, true);
 				msg.o.err = flash_readData(&memory->ctx, msg.i.io.offs, msg.o.data, msg.o.size);
-				mutexUnlock(memory->lock);
+				flashsrv_unlock(memory, true);
 				break;
 
 			case mtWrite:
-				mutexLock(memory->lock);
+				flashsrv_lock(memory, false);
 				msg.o.err = flash_bufferedWrite(&memory->ctx, msg.i.io.offs, msg.i.data, msg.i.size);
-				mutexUnlock(memory->lock);
+				flashsrv_unlock(memory, false);
 				break;
 
 			case mtDevCtl:
-				mutexLock(memory->lock);
+				flashsrv_lock(memory, false);
 				flashsrv_devCtl(memory, &msg);
-				mutexUnlock(memory->lock);
+				flashsrv_unlock(memory, false);
 				break;
 
 			case mtOpen:
@@ -464,6 +530,7 @@ static void flashsrv_devThread(void *arg)
 
 static int flashsrv_initMeterfs(flashsrv_partition_t *part)
 {
+	int res;
 	meterfs_ctx_t *ctx;
 
 	part->fsCtx = calloc(1, sizeof(meterfs_ctx_t));
@@ -484,7 +551,11 @@ static int flashsrv_initMeterfs(flashsrv_partition_t *part)
 
 	ctx->keyInit = false;
 
-	if (meterfs_init(ctx) < 0) {
+	flashsrv_lock(&flashsrv_common.flash_memories[part->fID], false);
+	res = meterfs_init(ctx);
+	flashsrv_unlock(&flashsrv_common.flash_memories[part->fID], false);
+
+	if (res < 0) {
 		LOG_ERROR("failed to initialize meterfs at flash: %u, partition: %u", part->fID, part->oid.id);
 		return -1;
 	}
@@ -502,13 +573,8 @@ static int flashsrv_mountPart(flashsrv_partition_t *part)
 	(void)snprintf(path, sizeof(path), "flash%u.%s", part->fID, part->pHeader->name);
 
 	switch (part->pHeader->type) {
-		/* Each meterfs partition is handled by separate thread */
+		/* Each meterfs partition is handled by separate thread, which also initializes it */
 		case ptable_meterfs:
-			res = flashsrv_initMeterfs(part);
-			if (res < 0) {
-				return res;
-			}
-
 			portCreate(&part->oid.port);
 			portRegister(part->oid.port, path, NULL);
 
@@ -560,39 +626,48 @@ static int flashsrv_mountPart(flashsrv_partition_t *part)
 
 static ptable_t *flashsrv_ptableRead(flash_memory_t *memory)
 {
-	ptable_t *ptable;
-	uint32_t offs, count, size;
-	uint8_t magic[sizeof(ptable_magic)];
+	ptable_t *ptable, *tmp;
+	uint32_t offs, count, size, readsz;
 
-	/* Read number of partitions */
+	/* Read number of partitions along with the beginning of the table */
 	offs = memory->ctx.properties->totalSz - memory->ctx.properties->sectorSz;
-	if (flash_readData(&memory->ctx, offs, &count, sizeof(count)) != sizeof(count)) {
-		return NULL;
-	}
-	count = le32toh(count);
+	readsz = (memory->ctx.properties->sectorSz < PTABLE_READSZ) ? memory->ctx.properties->sectorSz : PTABLE_READSZ;
 
-	/* Verify partition table size */
-	size = ptable_size(count);
-	if (size > memory->ctx.properties->sectorSz) {
+	ptable = malloc(readsz);
+	if (ptable == NULL) {
 		return NULL;
 	}
 
-	/* Read magic signature */
-	if (flash_readData(&memory->ctx, offs + size - sizeof(magic), magic, sizeof(magic)) != sizeof(magic)) {
+	if (flash_readData(&memory->ctx, offs, ptable, readsz) != readsz) {
+		free(ptable);
 		return NULL;
 	}
+	count = le32toh(ptable->count);
 
-	/* Verify magic signature */
-	if (memcmp(magic, ptable_magic, sizeof(magic)) != 0) {
+	/* Verify partition table size */
+	size = ptable_size(count);
+	if (size > memory->ctx.properties->sectorSz) {
+		free(ptable);
 		return NULL;
 	}
 
-	ptable = malloc(size);
-	if (ptable == NULL) {
-		return NULL;
+	/* Read the rest of the table only if it didn't fit */
+	if (size > readsz) {
+		tmp = realloc(ptable, size);
+		if (tmp == NULL) {
+			free(ptable);
+			return NULL;
+		}
+		ptable = tmp;
+
+		if (flash_readData(&memory->ctx, offs + readsz, (uint8_t *)ptable + readsz, size - readsz) != size - readsz) {
+			free(ptable);
+			return NULL;
+		}
 	}
 
-	if (flash_readData(&memory->ctx, offs, ptable, size) != size) {
+	/* Verify magic signature */
+	if (memcmp((uint8_t *)ptable + size - sizeof(ptable_magic), ptable_magic, sizeof(ptable_magic)) != 0) {
 		free(ptable);
 		return NULL;
 	}
@@ -642,7 +717,10 @@ static int flashsrv_partsInit(void)
 			}
 		}
 
+		/* Meterfs partitions may be initializing already */
+		flashsrv_lock(memory, false);
 		res = flash_sync(&memory->ctx);
+		flashsrv_unlock(memory, false);
 		if (res < 0) {
 			return res;
 		}
@@ -711,6 +789,9 @@ static int flashsrv_memoryInit(void)
 			LOG_ERROR("could not initialize flash memory %s", path);
 			return res;
 		}
+
+		memory->ctx.suspendYield = flashsrv_suspendYield;
+		memory->ctx.suspendArg = memory;
 	}
 
 	return EOK;
@@ -22,6 +22,10 @@
 #define FLASH_SR_WIP 0x01u /* Write in progress */
 #define FLASH_SR_WEL 0x02u /* Write enable latch */
 
+/* Security register */
+
+#define FLASH_SCUR_ESB 0x08u /* Erase suspended */
+
 /* ID */
 
 #define FLASH_CMD_RDID 0x9Fu /* Read Identification */
@@ -56,6 +60,7 @@
 /* Read */
 
 #define FLASH_CMD_READ     0x03u /* Read */
+#define FLASH_CMD_READ4B   0x13u /* Read (4-byte address) */
 #define FLASH_CMD_FASTREAD 0x0Bu /* Fast Read */
 #define FLASH_CMD_RDSFDP   0x5Au /* Read SFDP */
 
@@ -67,10 +72,12 @@
 
 /* Erase */
 
-#define FLASH_CMD_SE    0x20u /* Sector Erase */
-#define FLASH_CMD_BE32K 0x52u /* Block Erase 32kB */
-#define FLASH_CMD_BE    0xD8u /* Block Erase */
-#define FLASH_CMD_CE    0x60u /* Chip Erase */
+#define FLASH_CMD_SE        0x20u /* Sector Erase */
+#define FLASH_CMD_BE32K     0x52u /* Block Erase 32kB */
+#define FLASH_CMD_BE        0xD8u /* Block Erase */
+#define FLASH_CMD_CE        0x60u /* Chip Erase */
+#define FLASH_CMD_PGM_ERS_S 0xB0u /* Program / Erase Suspend */
+#define FLASH_CMD_PGM_ERS_R 0x30u /* Program / Erase Resume */
 
 /* Mode setting */
 
@@ -12,13 +12,19 @@
  */
 
 #include <errno.h>
+#include <stdint.h>
 #include <string.h>
+#include <sys/minmax.h>
 #include <sys/time.h>
 
 #include "flash.h"
 #include "nor.h"
 
 
+/* AHB window part addressed without EAR */
+#define NOR_EAR_SEGMENT (1u << 24)
+
+
 /* clang-format off */
 #define FLASH_ID(vid, pid) (((((vid) & 0xffu) << 16) | ((pid) & 0xff00u) | ((pid) & 0xffu)) << 8)
 
@@ -38,7 +44,7 @@ static const char *nor_vendors[] = {
 
 static const struct nor_info flashInfo[] = {
 	/* Macronix (MXIX) */
-	{ FLASH_ID(0xc2u, 0x2019u), "MX25L25635F", 32 * 1024 * 1024, 0x100, 0x1000, 2, 120, 150 * 1000 },
+	{ FLASH_ID(0xc2u, 0x2019u), "MX25L25635F", 32 * 1024 * 1024, 0x100, 0x1000, 2, 120, 150 * 1000, 1 },
 };
 
 
@@ -57,7 +63,7 @@ static int nor_readId(spimctrl_t *spimctrl, uint32_t *id)
 }
 
 
-static int nor_readStatus(spimctrl_t *spimctrl, uint8_t *status)
+int nor_readStatus(spimctrl_t *spimctrl, uint8_t *status)
 {
 	struct xferOp xfer;
 	const uint8_t cmd = FLASH_CMD_RDSR;
@@ -72,6 +78,35 @@ static int nor_readStatus(spimctrl_t *spimctrl, uint8_t *status)
 }
 
 
+static int nor_readSecurity(spimctrl_t *spimctrl, uint8_t *status)
+{
+	struct xferOp xfer;
+	const uint8_t cmd = FLASH_CMD_RDSCUR;
+
+	xfer.type = xfer_opRead;
+	xfer.cmd = &cmd;
+	xfer.cmdLen = 1;
+	xfer.rxData = status;
+	xfer.dataLen = 1;
+
+	return spimctrl_xfer(spimctrl, &xfer);
+}
+
+
+static int nor_cmd(spimctrl_t *spimctrl, uint8_t cmd)
+{
+	struct xferOp xfer;
+
+	xfer.type = xfer_opWrite;
+	xfer.cmd = &cmd;
+	xfer.cmdLen = 1;
+	xfer.txData = NULL;
+	xfer.dataLen = 0;
+
+	return spimctrl_xfer(spimctrl, &xfer);
+}
+
+
 static int nor_writeEnable(spimctrl_t *spimctrl, int enable)
 {
 	int res;
@@ -220,7 +255,7 @@ int nor_eraseChip(spimctrl_t *spimctrl, time_t timeout)
 }
 
 
-int nor_eraseSector(spimctrl_t *spimctrl, addr_t addr, time_t timeout)
+int nor_eraseSectorStart(spimctrl_t *spimctrl, addr_t addr)
 {
 	int res;
 	struct xferOp xfer;
@@ -242,14 +277,48 @@ int nor_eraseSector(spimctrl_t *spimctrl, addr_t addr, time_t timeout)
 	xfer.txData = NULL;
 	xfer.dataLen = 0;
 
-	res = spimctrl_xfer(spimctrl, &xfer);
+	return spimctrl_xfer(spimctrl, &xfer);
+}
+
+
+int nor_eraseSector(spimctrl_t *spimctrl, addr_t addr, time_t timeout)
+{
+	int res = nor_eraseSectorStart(spimctrl, addr);
 	if (res < EOK) {
 		return res;
 	}
 
+	return nor_waitBusy(spimctrl, timeout);
+}
+
+
+int nor_suspend(spimctrl_t *spimctrl, time_t timeout)
+{
+	uint8_t status = 0;
+	int res = nor_cmd(spimctrl, FLASH_CMD_PGM_ERS_S);
+	if (res < EOK) {
+		return res;
+	}
+
+	/* Suspend latency (tESL) */
 	res = nor_waitBusy(spimctrl, timeout);
+	if (res < EOK) {
+		return res;
+	}
 
-	return res;
+	res = nor_readSecurity(spimctrl, &status);
+	if (res < EOK) {
+		return res;
+	}
+
+	/* Erase could have finished before suspend command */
+	return ((status & FLASH_SCUR_ESB) != 0) ? 1 : 0;
+}
+
+
+int nor_resume(spimctrl_t *spimctrl)
+{
+	return nor_cmd(spimctrl, FLASH_CMD_PGM_ERS_R);
 }
 
 
@@ -285,28 +354,56 @@ int nor_pageProgram(spimctrl_t *spimctrl, addr_t addr, const void *src, size_t l
 }
 
 
-static ssize_t nor_readCmd(spimctrl_t *spimctrl, addr_t addr, void *data, size_t size)
+ssize_t nor_readData4B(spimctrl_t *spimctrl, addr_t addr, void *data, size_t size)
 {
 	struct xferOp xfer;
-	const uint8_t cmd[4] = { FLASH_CMD_READ, (addr >> 16) & 0xff, (addr >> 8) & 0xff, addr & 0xff };
-
-	int res = nor_validateEar(spimctrl, addr);
-	if (res < EOK) {
-		return res;
-	}
+	const uint8_t cmd[5] = { FLASH_CMD_READ4B, (addr >> 24) & 0xff, (addr >> 16) & 0xff, (addr >> 8) & 0xff, addr & 0xff };
 
 	xfer.type = xfer_opRead;
 	xfer.cmd = cmd;
-	xfer.cmdLen = 4;
+	xfer.cmdLen = 5;
 	xfer.rxData = data;
 	xfer.dataLen = size;
 
-	res = spimctrl_xfer(spimctrl, &xfer);
+	int res = spimctrl_xfer(spimctrl, &xfer);
 
 	return res < EOK ? res : (ssize_t)size;
 }
 
 
+/* Copies from the AHB window with word accesses, each one is a single prefetched SPI burst */
+static void nor_ahbCopy(uint8_t *dst, const volatile uint8_t *src, size_t size)
+{
+	uint32_t word;
+
+	while ((size > 0u) && (((uintptr_t)src & 3u) != 0u)) {
+		*dst++ = *src++;
+		size--;
+	}
+
+	if (((uintptr_t)dst & 3u) == 0u) {
+		for (; size >= sizeof(word); size -= sizeof(word)) {
+			*(uint32_t *)dst = *(const volatile uint32_t *)src;
+			dst += sizeof(word);
+			src += sizeof(word);
+		}
+	}
+	else {
+		for (; size >= sizeof(word); size -= sizeof(word)) {
+			word = *(const volatile uint32_t *)src;
+			(void)memcpy(dst, &word, sizeof(word));
+			dst += sizeof(word);
+			src += sizeof(word);
+		}
+	}
+
+	while (size > 0u) {
+		*dst++ = *src++;
+		size--;
+	}
+}
+
+
 static ssize_t nor_readAhb(spimctrl_t *spimctrl, addr_t addr, void *data, size_t size)
 {
 	int res = nor_validateEar(spimctrl, addr);
@@ -314,24 +411,51 @@ static ssize_t nor_readAhb(spimctrl_t *spimctrl, addr_t addr, void *data, size_t
 		return res;
 	}
 
-	(void)memcpy(data, (void *)addr + spimctrl->ahbStartAddr, size);
+	nor_ahbCopy(data, (const volatile uint8_t *)(spimctrl->ahbStartAddr + addr), size);
 
-	return (res < EOK) ? res : (ssize_t)size;
+	return (ssize_t)size;
 }
 
 
 ssize_t nor_readData(spimctrl_t *spimctrl, addr_t addr, void *data, size_t size)
 {
-	if (((addr & 0xff000000) == 0) && (((addr + size) & 0xff000000) != 0)) {
-		/* If we'd have to change EAR register during read,
-		 * read data through command (can be read without EAR change)
-		 */
-		return nor_readCmd(spimctrl, addr, data, size);
+	size_t chunk, done;
+	ssize_t res;
+
+	/* Split at EAR segment boundaries, each part is copied directly from the AHB window */
+	for (done = 0; done < size; done += chunk) {
+		chunk = min(size - done, NOR_EAR_SEGMENT - ((addr + done) & (NOR_EAR_SEGMENT - 1u)));
+
+		res = nor_readAhb(spimctrl, addr + done, (uint8_t *)data + done, chunk);
+		if (res < 0) {
+			return res;
+		}
 	}
-	else {
-		/* Direct copy */
-		return nor_readAhb(spimctrl, addr, data, size);
+
+	return (ssize_t)size;
+}
+
+
+ssize_t nor_readDataFixedEar(spimctrl_t *spimctrl, addr_t addr, void *data, size_t size)
+{
+	size_t chunk, done;
+	ssize_t res;
+
+	for (done = 0; done < size; done += chunk) {
+		chunk = min(size - done, NOR_EAR_SEGMENT - ((addr + done) & (NOR_EAR_SEGMENT - 1u)));
+
+		if ((((addr + done) >> 24) & 0xffu) == spimctrl->ear) {
+			nor_ahbCopy((uint8_t *)data + done, (const volatile uint8_t *)(spimctrl->ahbStartAddr + addr + done), chunk);
+		}
+		else {
+			res = nor_readData4B(spimctrl, addr + done, (uint8_t *)data + done, chunk);
+			if (res < 0) {
+				return res;
+			}
+		}
 	}
+
+	return (ssize_t)size;
 }
 
 
@@ -30,24 +30,46 @@ struct nor_info {
 	time_t tPP;
 	time_t tSE;
 	time_t tCE;
+	uint8_t suspend; /* Sector erase suspend / resume supported */
 };
 
 
+extern int nor_readStatus(spimctrl_t *spimctrl, uint8_t *status);
+
+
 extern int nor_waitBusy(spimctrl_t *spimctrl, time_t timeout);
 
 
 extern int nor_eraseChip(spimctrl_t *spimctrl, time_t timeout);
 
 
+extern int nor_eraseSectorStart(spimctrl_t *spimctrl, addr_t addr);
+
+
 extern int nor_eraseSector(spimctrl_t *spimctrl, addr_t addr, time_t timeout);
 
 
+/* Suspends sector erase in progress, returns 1 if suspended, 0 if erase has already finished */
+extern int nor_suspend(spimctrl_t *spimctrl, time_t timeout);
+
+
+extern int nor_resume(spimctrl_t *spimctrl);
+
+
 extern int nor_pageProgram(spimctrl_t *spimctrl, addr_t addr, const void *src, size_t len, time_t timeout);
 
 
 extern ssize_t nor_readData(spimctrl_t *spimctrl, addr_t addr, void *buff, size_t len);
 
 
+/* Reads through 4-byte address command, doesn't use EAR (which can't be written with erase suspended) */
+extern ssize_t nor_readData4B(spimctrl_t *spimctrl, addr_t addr, void *buff, size_t len);
+
+
+/* Reads without writing EAR: the current EAR segment through the AHB window, the rest through 4-byte command */
+extern ssize_t nor_readDataFixedEar(spimctrl_t *spimctrl, addr_t addr, void *buff, size_t len);
+
+
 extern int nor_probe(spimctrl_t *spimctrl, const struct nor_info **nor, const char **pVendor);
 
 
@@ -9,17 +9,23 @@
  * %LICENSE%
  */
 
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <time.h>
 
 #include "host-flash.h"
 
 
+#define HOSTFLASH_PAGESZ 256
+
+
 struct _meterfs_devCtx_t {
 	volatile int state;
 };
@@ -27,22 +33,45 @@ struct _meterfs_devCtx_t {
 
 static struct {
 	int filefd;
+	uint8_t *map;
 	size_t flashsz;
 	size_t sectorsz;
 	struct _meterfs_devCtx_t devCtx;
-} hostflash_common;
 
+	hostflash_config_t config;
+	hostflash_stats_t stats;
+	unsigned int *eraseCnt;
+} hostflash_common = {
+	.config = { .mmap = 1 }
+};
 
-ssize_t hostflash_read(struct _meterfs_devCtx_t *devCtx, off_t offs, void *buff, size_t bufflen)
+
+static void hostflash_delay(unsigned int us)
 {
-	ssize_t stat;
-	int readsz = 0;
+	struct timespec ts;
 
-	(void)devCtx;
+	if (us == 0) {
+		return;
+	}
 
-	if ((devCtx == NULL) || (devCtx->state == 0) || ((offs + bufflen) > hostflash_common.flashsz)) {
-		return -EINVAL;
+	hostflash_common.stats.busyUs += us;
+
+	if (hostflash_common.config.sleep != 0) {
+		ts.tv_sec = us / (1000 * 1000);
+		ts.tv_nsec = (us % (1000 * 1000)) * 1000;
+		while (nanosleep(&ts, &ts) < 0) {
+			if (errno != EINTR) {
+				break;
+			}
+		}
 	}
+}
+
+
+static ssize_t hostflash_fileRead(off_t offs, void *buff, size_t bufflen)
+{
+	ssize_t stat;
+	int readsz = 0;
 
 	while ((stat = pread(hostflash_common.filefd, (void *)((char *)buff + readsz), bufflen - readsz, offs + readsz)) != 0) {
 		if (stat < 0) {
@@ -63,10 +92,31 @@ ssize_t hostflash_read(struct _meterfs_devCtx_t *devCtx, off_t offs, void *buff,
 }
 
 
+ssize_t hostflash_read(struct _meterfs_devCtx_t *devCtx, off_t offs, void *buff, size_t bufflen)
+{
+	(void)devCtx;
+
+	if ((devCtx == NULL) || (devCtx->state == 0) || ((offs + bufflen) > hostflash_common.flashsz)) {
+		return -EINVAL;
+	}
+
+	hostflash_common.stats.reads++;
+	hostflash_common.stats.readBytes += bufflen;
+	hostflash_delay(hostflash_common.config.tRead);
+
+	if (hostflash_common.map != NULL) {
+		(void)memcpy(buff, hostflash_common.map + offs, bufflen);
+		return (ssize_t)bufflen;
+	}
+
+	return hostflash_fileRead(offs, buff, bufflen);
+}
+
+
 ssize_t hostflash_write(struct _meterfs_devCtx_t *devCtx, off_t offs, const void *buff, size_t bufflen)
 {
 	char tempTab[256];
-	size_t wrote = 0, i;
+	size_t wrote = 0, i, pages;
 	int len;
 	ssize_t stat, readsz;
 
@@ -74,6 +124,23 @@ ssize_t hostflash_write(struct _meterfs_devCtx_t *devCtx, off_t offs, const void
 		return -EINVAL;
 	}
 
+	if (bufflen != 0) {
+		/* Every page touched by the write is programmed */
+		pages = (offs + bufflen - 1) / HOSTFLASH_PAGESZ - offs / HOSTFLASH_PAGESZ + 1;
+		hostflash_common.stats.programs += pages;
+		hostflash_common.stats.programBytes += bufflen;
+		hostflash_delay(hostflash_common.config.tPP * pages);
+	}
+
+	if (hostflash_common.map != NULL) {
+		/* Programming can only clear bits */
+		for (i = 0; i < bufflen; i++) {
+			hostflash_common.map[offs + i] &= *((const uint8_t *)buff + i);
+		}
+
+		return (ssize_t)bufflen;
+	}
+
 	while (wrote != bufflen) {
 		if ((bufflen - wrote) >= sizeof(tempTab)) {
 			len = sizeof(tempTab);
@@ -82,7 +149,7 @@ ssize_t hostflash_write(struct _meterfs_devCtx_t *devCtx, off_t offs, const void
 			len = bufflen - wrote;
 		}
 
-		readsz = hostflash_read(devCtx, offs + wrote, tempTab, len);
+		readsz = hostflash_fileRead(offs + wrote, tempTab, len);
 		if (readsz <= 0) {
 			return readsz;
 		}
@@ -113,7 +180,7 @@ int hostflash_sectorErase(struct _meterfs_devCtx_t *devCtx, off_t offs)
 {
 	char tempTab[256];
 	ssize_t len = sizeof(tempTab);
-	size_t erased = 0;
+	size_t erased = 0, sector;
 	unsigned int sectorAddr;
 	int stat;
 
@@ -121,9 +188,21 @@ int hostflash_sectorErase(struct _meterfs_devCtx_t *devCtx, off_t offs)
 		return -EINVAL;
 	}
 
-	(void)memset(tempTab, 0xff, sizeof(tempTab));
+	sector = offs / hostflash_common.sectorsz;
+	sectorAddr = sector * hostflash_common.sectorsz;
 
-	sectorAddr = (offs / hostflash_common.sectorsz) * hostflash_common.sectorsz;
+	hostflash_common.stats.erases++;
+	if (++hostflash_common.eraseCnt[sector] > hostflash_common.stats.maxEraseCnt) {
+		hostflash_common.stats.maxEraseCnt = hostflash_common.eraseCnt[sector];
+	}
+	hostflash_delay(hostflash_common.config.tSE);
+
+	if (hostflash_common.map != NULL) {
+		(void)memset(hostflash_common.map + sectorAddr, 0xff, hostflash_common.sectorsz);
+		return 0;
+	}
+
+	(void)memset(tempTab, 0xff, sizeof(tempTab));
 
 	while (erased != hostflash_common.sectorsz) {
 		stat = pwrite(hostflash_common.filefd, tempTab, len, sectorAddr + erased);
@@ -159,9 +238,42 @@ struct _meterfs_devCtx_t *hostflash_devCtx(void)
 }
 
 
+void hostflash_configure(const hostflash_config_t *config)
+{
+	hostflash_common.config = *config;
+}
+
+
+void hostflash_getStats(hostflash_stats_t *stats)
+{
+	*stats = hostflash_common.stats;
+}
+
+
+void hostflash_resetStats(void)
+{
+	(void)memset(&hostflash_common.stats, 0, sizeof(hostflash_common.stats));
+
+	if (hostflash_common.eraseCnt != NULL) {
+		(void)memset(hostflash_common.eraseCnt, 0, (hostflash_common.flashsz / hostflash_common.sectorsz) * sizeof(unsigned int));
+	}
+}
+
+
+unsigned int hostflash_eraseCount(off_t offs)
+{
+	if ((hostflash_common.eraseCnt == NULL) || (offs < 0) || (offs >= hostflash_common.flashsz)) {
+		return 0;
+	}
+
+	return hostflash_common.eraseCnt[offs / hostflash_common.sectorsz];
+}
+
+
 int hostflash_init(size_t *flashsz, size_t *sectorsz, const char *fileName)
 {
 	int stat;
+	void *map;
 
 	if ((*sectorsz % 2) || (*flashsz % *sectorsz) || (*sectorsz > *flashsz) || (*sectorsz < 256) || (*flashsz == 0)) {
 		return -EINVAL;
@@ -170,14 +282,36 @@ int hostflash_init(size_t *flashsz, size_t *sectorsz, const char *fileName)
 	hostflash_common.devCtx.state = 1;
 	hostflash_common.flashsz = *flashsz;
 	hostflash_common.sectorsz = *sectorsz;
+	hostflash_common.map = NULL;
+	(void)memset(&hostflash_common.stats, 0, sizeof(hostflash_common.stats));
+
+	free(hostflash_common.eraseCnt);
+	hostflash_common.eraseCnt = calloc(hostflash_common.flashsz / hostflash_common.sectorsz, sizeof(unsigned int));
+	if (hostflash_common.eraseCnt == NULL) {
+		return -ENOMEM;
+	}
+
 	hostflash_common.filefd = open(fileName, O_CREAT | O_RDWR, 0666);
 	if (hostflash_common.filefd < 0) {
+		free(hostflash_common.eraseCnt);
+		hostflash_common.eraseCnt = NULL;
 		return hostflash_common.filefd;
 	}
 	stat = ftruncate(hostflash_common.filefd, hostflash_common.flashsz);
 	if (stat < 0) {
 		close(hostflash_common.filefd);
+		free(hostflash_common.eraseCnt);
+		hostflash_common.eraseCnt = NULL;
 		return stat;
 	}
+
+	if (hostflash_common.config.mmap != 0) {
+		/* Shared mapping keeps the file up to date, fall back to read/write calls if it can't be set up */
+		map = mmap(NULL, hostflash_common.flashsz, PROT_READ | PROT_WRITE, MAP_SHARED, hostflash_common.filefd, 0);
+		if (map != MAP_FAILED) {
+			hostflash_common.map = map;
+		}
+	}
+
 	return 0;
 }
@@ -12,10 +12,33 @@
 #ifndef HOST_FLASH_H
 #define HOST_FLASH_H
 
+#include <stdint.h>
 #include <sys/types.h>
 #include <meterfs.h>
 
 
+typedef struct {
+	int mmap;  /* Access backing file through shared mapping instead of read/write calls (default) */
+	int sleep; /* Wait for modeled operation time, otherwise it's only accounted in stats */
+
+	/* Timing model in microseconds, 0 - no delay */
+	unsigned int tRead; /* Read operation */
+	unsigned int tPP;   /* Page (256 B) program */
+	unsigned int tSE;   /* Sector erase */
+} hostflash_config_t;
+
+
+typedef struct {
+	uint64_t reads;
+	uint64_t readBytes;
+	uint64_t programs; /* Programmed pages */
+	uint64_t programBytes;
+	uint64_t erases;
+	uint64_t busyUs;          /* Modeled device busy time */
+	unsigned int maxEraseCnt; /* Erase count of the most worn sector */
+} hostflash_stats_t;
+
+
 ssize_t hostflash_read(struct _meterfs_devCtx_t *devCtx, off_t offs, void *buff, size_t bufflen);
 
 
@@ -31,6 +54,20 @@ void hostflash_powerCtrl(struct _meterfs_devCtx_t *devCtx, int state);
 struct _meterfs_devCtx_t *hostflash_devCtx(void);
 
 
+/* Sets emulation mode and timing model, mode has to be set before hostflash_init() */
+void hostflash_configure(const hostflash_config_t *config);
+
+
+void hostflash_getStats(hostflash_stats_t *stats);
+
+
+/* Resets stats and sector erase counts */
+void hostflash_resetStats(void);
+
+
+unsigned int hostflash_eraseCount(off_t offs);
+
+
 int hostflash_init(size_t *flashsz, size_t *sectorsz, const char *fileName);
 
 #endif
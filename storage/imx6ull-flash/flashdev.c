@@ -25,7 +25,7 @@
 #include "imx6ull-flashdrv.h"
 
 #define ECC_GF                13  /* Galois field */
-#define ECC_BITFLIP_THRESHOLD 10  /* Min number of bitflips for page rewrite */
+#define ECC_BITFLIP_THRESHOLD FLASHDEV_FLIPS_REFRESH /* Min number of bitflips for page rewrite */
 #define ECC0_BITFLIP_STRENGHT 16  /* ECC strength for metadata chunk */
 #define ECCN_BITFLIP_STRENGHT 14  /* ECC strength for data chunk */
 #define ECCN_DATA_SIZE        512 /* Data chunk size */
@@ -33,6 +33,12 @@
 #define CHUNK_IS_META(chunkidx) ((chunkidx) == 0)
 
 
+static struct {
+	uint8_t *blockFlips; /* max bitflips per erase block, see flashdev_blockFlips() */
+	unsigned int nblocks;
+} flashdev_common;
+
+
 /* Auxiliary functions */
 static inline int chunk_is_uncorrectable(unsigned int chunkidx, unsigned int flips)
 {
@@ -111,6 +117,21 @@ static unsigned int _flashmtd_checkErased(const void *buff, size_t boffs, size_t
 }
 
 
+static void _flashmtd_flipsRecord(struct _storage_t *strg, uint32_t pageaddr, unsigned int flips)
+{
+	unsigned int eb = pageaddr / (strg->dev->mtd->erasesz / strg->dev->mtd->writesz);
+
+	if ((flashdev_common.blockFlips == NULL) || (eb >= flashdev_common.nblocks)) {
+		return;
+	}
+
+	flips = min(flips, FLASHDEV_FLIPS_UNKNOWN - 1);
+	if ((flashdev_common.blockFlips[eb] == FLASHDEV_FLIPS_UNKNOWN) || (flashdev_common.blockFlips[eb] < flips)) {
+		flashdev_common.blockFlips[eb] = flips;
+	}
+}
+
+
 static void _flashmtd_chunkCorrect(struct _storage_t *strg, unsigned int chunkidx, unsigned int nflips)
 {
 	flashdrv_meta_t *meta = strg->dev->ctx->metabuf;
@@ -232,6 +253,8 @@ static int _flashmtd_checkECC(struct _storage_t *strg, uint32_t pageaddr, int nc
 		maxflips = max(nflips, maxflips);
 	}
 
+	_flashmtd_flipsRecord(strg, pageaddr, maxflips);
+
 	if (ret < 0) {
 		/* flash_uncorrectable has been detected on some chunks, return -EBADMSG */
 		return ret;
@@ -284,6 +307,9 @@ static int flashmtd_erase(struct _storage_t *strg, off_t offs, size_t size)
 			}
 		}
 		else {
+			if ((flashdev_common.blockFlips != NULL) && (eb < flashdev_common.nblocks)) {
+				flashdev_common.blockFlips[eb] = FLASHDEV_FLIPS_UNKNOWN;
+			}
 			++erased;
 		}
 	}
@@ -306,8 +332,16 @@ static int flashmtd_read(struct _storage_t *strg, off_t offs, void *data, size_t
 
 	mutexLock(strg->dev->ctx->lock);
 	while (tempsz < len) {
+		chunksz = min(len - tempsz, strg->dev->mtd->writesz - offs);
+
 		/* TODO: should we skip badblocks ? */
-		err = flashdrv_read(strg->dev->ctx->dma, paddr, strg->dev->ctx->databuf, meta);
+		if (chunksz < strg->dev->mtd->writesz) {
+			/* Small reads (node headers) decode only the subpage they touch */
+			err = flashdrv_readsub(strg->dev->ctx->dma, paddr, strg->dev->ctx->databuf, meta, offs, chunksz);
+		}
+		else {
+			err = flashdrv_readseq(strg->dev->ctx->dma, paddr, strg->dev->ctx->databuf, meta, (tempsz + chunksz) < len);
+		}
 		if (err < 0) {
 			ret = -EIO;
 			break;
@@ -327,7 +361,6 @@ static int flashmtd_read(struct _storage_t *strg, off_t offs, void *data, size_t
 			break;
 		}
 
-		chunksz = min(len - tempsz, strg->dev->mtd->writesz - offs);
 		memcpy((unsigned char *)data + tempsz, (unsigned char *)strg->dev->ctx->databuf + offs, chunksz);
 		offs = 0;
 		tempsz += chunksz;
@@ -356,7 +389,7 @@ static int flashmtd_write(struct _storage_t *strg, off_t offs, const void *data,
 		memcpy(strg->dev->ctx->databuf, (unsigned char *)data + tempsz, strg->dev->mtd->writesz);
 
 		pageID = offs / strg->dev->mtd->writesz;
-		res = flashdrv_write(strg->dev->ctx->dma, pageID, strg->dev->ctx->databuf, NULL);
+		res = flashdrv_writeseq(strg->dev->ctx->dma, pageID, strg->dev->ctx->databuf, NULL, (tempsz + strg->dev->mtd->writesz) < len);
 		if (res < 0) {
 			res = -EIO;
 			break;
@@ -505,7 +538,7 @@ static int flashmtd_blockMaxBitflips(struct _storage_t *strg, off_t offs)
 
 	/* Read one block, page by page */
 	while (tempsz < mtd->erasesz) {
-		err = flashdrv_read(ctx->dma, paddr, ctx->databuf, meta);
+		err = flashdrv_readseq(ctx->dma, paddr, ctx->databuf, meta, (tempsz + mtd->writesz) < mtd->erasesz);
 		if (err < 0) {
 			break;
 		}
@@ -516,6 +549,7 @@ static int flashmtd_blockMaxBitflips(struct _storage_t *strg, off_t offs)
 			break;
 		}
 
+		_flashmtd_flipsRecord(strg, paddr, err);
 		maxBitFlips = max(maxBitFlips, err);
 		tempsz += mtd->writesz;
 		paddr++;
@@ -554,10 +588,26 @@ static const storage_mtdops_t mtdOps = {
 };
 
 
+int flashdev_blockFlips(unsigned int eb)
+{
+	if ((flashdev_common.blockFlips == NULL) || (eb >= flashdev_common.nblocks)) {
+		return -EINVAL;
+	}
+
+	return flashdev_common.blockFlips[eb];
+}
+
+
 /* Initialization functions */
 
 int flashdev_done(storage_t *strg)
 {
+	if ((strg->parent == NULL) && (flashdev_common.blockFlips != NULL)) {
+		free(flashdev_common.blockFlips);
+		flashdev_common.blockFlips = NULL;
+		flashdev_common.nblocks = 0;
+	}
+
 	/* Free device context */
 	munmap(strg->dev->ctx->metabuf, strg->dev->mtd->writesz);
 	munmap(strg->dev->ctx->databuf, 2 * strg->dev->mtd->writesz);
@@ -584,6 +634,17 @@ int flashdev_init(storage_t *strg)
 	if (strg->parent == NULL) {
 		strg->start = 0;
 		strg->size = info->size;
+
+		/* Statistics are kept for the whole memory, partitions share them */
+		if (flashdev_common.blockFlips == NULL) {
+			flashdev_common.nblocks = info->size / info->erasesz;
+			flashdev_common.blockFlips = malloc(flashdev_common.nblocks);
+			if (flashdev_common.blockFlips == NULL) {
+				flashdev_common.nblocks = 0;
+				return -ENOMEM;
+			}
+			memset(flashdev_common.blockFlips, FLASHDEV_FLIPS_UNKNOWN, flashdev_common.nblocks);
+		}
 	}
 
 	/* Initialize device structure */
@@ -190,6 +190,16 @@ static const flashdrv_command_t commands[flash_num_commands] = {
 typedef struct _flashdrv_dma_t {
 	dma_t *last;
 	dma_t *first;
+
+	/* Chain last built by read, write or erase, reused if the next one has the same shape */
+	struct {
+		uint32_t key;      /* see flashdrv_tmplKey(), 0 => none */
+		dma_t *first, *last;
+		uint8_t *addr;     /* row address bytes in the command buffer, NULL => no address */
+		void *ecc;         /* BCH descriptor (gpmi_dma6_t), NULL => none */
+		void *data, *aux;  /* buffers the BCH descriptor points to */
+	} tmpl;
+
 	char buffer[];
 } flashdrv_dma_t;
 
@@ -201,6 +211,43 @@ typedef struct {
 } __attribute__((packed)) flash_id_t;
 
 
+/* Cache operation (or block erase) pending on a chip */
+enum { seq_none = 0, seq_read, seq_program, seq_erase };
+
+
+/* Block erase status polling period (typical tBERS is 2 - 3 ms) */
+#define ERASE_POLL_US 500
+
+
+/* BCH data chunks: 512 bytes + ECC14 (GF13) parity, bit-packed after the metadata chunk. Parity takes 182 bits,
+ * so chunks start on a byte boundary only every 4 chunks - subpage reads are done in such units */
+#define BCH_CHUNKSZ        512
+#define BCH_CHUNKBITS      (BCH_CHUNKSZ * 8 + 14 * 13)
+#define BCH_SUBPAGE_CHUNKS 4
+
+
+/* Erase blocks at the end of the flash reserved for the bad block table copies */
+#ifndef FLASHDRV_BBT_BLOCKS
+#define FLASHDRV_BBT_BLOCKS 4
+#endif
+
+#define FLASHDRV_BBT_MAGIC    0x30544242u /* "BBT0" */
+#define FLASHDRV_BBT_METAOFFS (_PAGE_SIZE + _PAGE_SIZE / 2)
+
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t nblocks;
+	uint32_t crc; /* CRC32 of the map */
+	uint8_t map[];
+} flashdrv_bbtHdr_t;
+
+
+/* ONFI parameter page: optional commands supported */
+enum { onfi_cache_program = 1 << 0, onfi_cache_read = 1 << 1 };
+
+
 struct {
 	volatile uint32_t *gpmi;
 	volatile uint32_t *bch;
@@ -215,6 +262,28 @@ struct {
 
 	uint8_t *uncached_buf;
 	flashdrv_info_t info;
+
+	/* Cache read / program sequences, see flashdrv_readseq() and flashdrv_writeseq() */
+	int cacheread, cacheprogram;
+	struct {
+		int op;
+		uint32_t paddr; /* next page expected in the sequence */
+		int status;     /* status register after the last erase, see flashdrv_erase() */
+	} seq[2];
+	handle_t eraselock[2];
+	flashdrv_dma_t *seqdma;
+	uint8_t *seqstatus;
+
+	/* Bad block table, see flashdrv_bbtInit() */
+	struct {
+		handle_t lock;
+		uint8_t *map;     /* 1 bit per erase block, set => bad or reserved for the table, NULL => not loaded */
+		uint32_t nblocks;
+		uint32_t version;
+		uint32_t resbad;  /* reserved blocks found bad */
+		int copy[2];      /* erase blocks holding main and mirror copy, -1 => none */
+		uint8_t *buf;     /* page buffer, metadata at FLASHDRV_BBT_METAOFFS */
+	} bbt;
 } flashdrv_common;
 
 
@@ -432,6 +501,74 @@ static int nand_w4ready(gpmi_dma1_t *cmd)
 }
 
 
+enum { tmpl_read = 1, tmpl_write, tmpl_erase };
+
+
+static inline uint32_t flashdrv_tmplKey(int op, int chip, int flags)
+{
+	return (uint32_t)op | ((uint32_t)chip << 4) | ((uint32_t)flags << 8);
+}
+
+
+static inline void *flashdrv_next(flashdrv_dma_t *dma)
+{
+	return (dma->last != NULL) ? (void *)dma->last + dma_size(dma->last) : (void *)dma->buffer;
+}
+
+
+/* Builders starting a new chain overwrite the template */
+static inline void flashdrv_tmplDrop(flashdrv_dma_t *dma)
+{
+	if (dma->last == NULL) {
+		dma->tmpl.key = 0;
+	}
+}
+
+
+/* Patches the template for the operation instead of building the chain again (va2pa() per descriptor) */
+static int flashdrv_tmplReuse(flashdrv_dma_t *dma, uint32_t key, uint32_t paddr, void *data, void *aux)
+{
+	gpmi_dma6_t *ecc = dma->tmpl.ecc;
+
+	if (dma->tmpl.key != key) {
+		return 0;
+	}
+
+	if (dma->tmpl.addr != NULL) {
+		memcpy(dma->tmpl.addr, &paddr, 3);
+	}
+
+	if (ecc != NULL) {
+		if ((data != NULL) && (data != dma->tmpl.data)) {
+			ecc->payload = (uint32_t)va2pa(data);
+			dma->tmpl.data = data;
+		}
+
+		if (aux != dma->tmpl.aux) {
+			ecc->auxiliary = (uint32_t)va2pa(aux);
+			dma->tmpl.aux = aux;
+		}
+	}
+
+	dma->first = dma->tmpl.first;
+	dma->last = dma->tmpl.last;
+
+	return 1;
+}
+
+
+static void flashdrv_tmplSave(flashdrv_dma_t *dma, uint32_t key, uint8_t *addr, void *ecc, void *data, void *aux)
+{
+	dma->tmpl.key = key;
+	dma->tmpl.first = dma->first;
+	dma->tmpl.last = dma->last;
+	dma->tmpl.addr = addr;
+	dma->tmpl.ecc = ecc;
+	dma->tmpl.data = data;
+	dma->tmpl.aux = aux;
+}
+
+
 static int flashdrv_addrPrep(uint32_t *paddr, int *bank)
 {
 	*bank = *paddr >> flashdrv_common.info.pbits;
@@ -463,6 +600,7 @@ flashdrv_dma_t *flashdrv_dmanew(void)
 	if (dma != MAP_FAILED) {
 		dma->last = NULL;
 		dma->first = NULL;
+		dma->tmpl.key = 0;
 	}
 
 	return dma;
@@ -483,6 +621,8 @@ int flashdrv_wait4ready(flashdrv_dma_t *dma, int err)
 	int sz;
 	dma_t *terminator;
 
+	flashdrv_tmplDrop(dma);
+
 	if (next != NULL)
 		next += dma_size(dma->last);
 	else
@@ -515,6 +655,8 @@ int flashdrv_disablebch(flashdrv_dma_t *dma, int chip)
 {
 	void *next = dma->last;
 
+	flashdrv_tmplDrop(dma);
+
 	if (next != NULL)
 		next += dma_size(dma->last);
 	else
@@ -535,6 +677,8 @@ int flashdrv_finish(flashdrv_dma_t *dma)
 {
 	void *next = dma->last;
 
+	flashdrv_tmplDrop(dma);
+
 	if (next != NULL)
 		next += dma_size(dma->last);
 	else
@@ -556,6 +700,8 @@ int flashdrv_issue(flashdrv_dma_t *dma, int c, int chip, void *addr, unsigned da
 	int sz;
 	char *cmdaddr;
 
+	flashdrv_tmplDrop(dma);
+
 	if (next != NULL)
 		next += dma_size(dma->last);
 	else
@@ -610,6 +756,8 @@ int flashdrv_readback(flashdrv_dma_t *dma, int chip, int bufsz, void *buf, void
 {
 	void *next = dma->last;
 
+	flashdrv_tmplDrop(dma);
+
 	if (next != NULL)
 		next += dma_size(dma->last);
 	else
@@ -636,6 +784,8 @@ int flashdrv_readcompare(flashdrv_dma_t *dma, int chip, uint16_t mask, uint16_t
 	void *next = dma->last, *terminator;
 	int sz;
 
+	flashdrv_tmplDrop(dma);
+
 	if (next != NULL)
 		next += dma_size(dma->last);
 	else
@@ -661,6 +811,89 @@ int flashdrv_readcompare(flashdrv_dma_t *dma, int chip, uint16_t mask, uint16_t
 }
 
 
+static int _flashdrv_run(flashdrv_dma_t *dma)
+{
+	int channel = 0;
+
+	flashdrv_common.result = 1;
+	dma_run((dma_t *)dma->first, channel);
+
+	mutexLock(flashdrv_common.wait_mutex);
+	while (flashdrv_common.result > 0)
+		condWait(flashdrv_common.dma_cond, flashdrv_common.wait_mutex, 0);
+	mutexUnlock(flashdrv_common.wait_mutex);
+
+	return flashdrv_common.result;
+}
+
+
+/* Returns chip status register (mutex must be locked) */
+static int _flashdrv_status(int chip)
+{
+	flashdrv_dma_t *dma = flashdrv_common.seqdma;
+	int err;
+
+	dma->first = NULL;
+	dma->last = NULL;
+
+	flashdrv_issue(dma, flash_read_status, chip, NULL, 0, NULL, NULL);
+	flashdrv_readback(dma, chip, 1, flashdrv_common.seqstatus, NULL);
+	flashdrv_disablebch(dma, chip);
+	flashdrv_finish(dma);
+	err = _flashdrv_run(dma);
+
+	return (err < 0) ? err : *flashdrv_common.seqstatus;
+}
+
+
+/* Ends cache operation pending on chip, so that other command can be issued (mutex must be locked) */
+static void _flashdrv_seqend(int chip)
+{
+	flashdrv_dma_t *dma = flashdrv_common.seqdma;
+	int err;
+
+	switch (flashdrv_common.seq[chip].op) {
+		case seq_read:
+			/* Move the last page to cache register, its data is discarded */
+			dma->first = NULL;
+			dma->last = NULL;
+
+			flashdrv_issue(dma, flash_read_page_cache_last, chip, NULL, 0, NULL, NULL);
+			flashdrv_wait4ready(dma, EOK);
+			flashdrv_finish(dma);
+			_flashdrv_run(dma);
+			break;
+
+		case seq_program:
+			/* R/B# only signals free cache register, poll ARDY until the array is done with the last page */
+			do {
+				err = _flashdrv_status(chip);
+			} while ((err >= 0) && ((err & (1 << 5)) == 0));
+			break;
+
+		case seq_erase:
+			/* Wait for the erase started by flashdrv_erase(), its status is passed back there */
+			do {
+				err = _flashdrv_status(chip);
+			} while ((err >= 0) && ((err & (1 << 6)) == 0));
+			flashdrv_common.seq[chip].status = err;
+			break;
+
+		default:
+			break;
+	}
+
+	flashdrv_common.seq[chip].op = seq_none;
+}
+
+
+static inline int flashdrv_seqallowed(uint32_t paddr)
+{
+	/* Don't pipeline across erase block boundary */
+	return ((paddr + 1) % (flashdrv_common.info.erasesz / flashdrv_common.info.writesz)) != 0;
+}
+
+
 int flashdrv_reset(flashdrv_dma_t *dma, int chip)
 {
 	int channel = 0, err;
@@ -671,6 +904,11 @@ int flashdrv_reset(flashdrv_dma_t *dma, int chip)
 	flashdrv_finish(dma);
 
 	mutexLock(flashdrv_common.mutex);
+	/* Reset aborts any pending cache operation or erase */
+	if (flashdrv_common.seq[chip].op == seq_erase) {
+		flashdrv_common.seq[chip].status = -1;
+	}
+	flashdrv_common.seq[chip].op = seq_none;
 	flashdrv_common.result = 1;
 	dma_run((dma_t *)dma->first, channel);
 
@@ -718,16 +956,21 @@ static int flashdrv_readid(flashdrv_dma_t *dma, int chip, flash_id_t *flash_id)
 }
 
 
-int flashdrv_write(flashdrv_dma_t *dma, uint32_t paddr, void *data, char *aux)
+int flashdrv_writeseq(flashdrv_dma_t *dma, uint32_t paddr, void *data, char *aux, int more)
 {
 	int chip = 0, channel = 0, sz;
 	char addr[5] = { 0 };
 	int skipMeta = 0, err;
+	uint32_t key;
+	uint8_t *cmd;
 
 	if (flashdrv_addrPrep(&paddr, &chip) < 0) {
 		return -1;
 	}
 
+	/* Metadata only programming reconfigures BCH layout, keep it out of cache sequences */
+	more = more && (data != NULL) && flashdrv_common.cacheprogram && flashdrv_seqallowed(paddr);
+
 	memcpy(addr + 2, &paddr, 3);
 
 	if (data == NULL) {
@@ -741,18 +984,32 @@ int flashdrv_write(flashdrv_dma_t *dma, uint32_t paddr, void *data, char *aux)
 		}
 	}
 
-	dma->first = NULL;
-	dma->last = NULL;
+	key = flashdrv_tmplKey(tmpl_write, chip, (more != 0) | ((data != NULL) << 1) | (skipMeta << 2) | ((aux != NULL) << 3));
+	if (!flashdrv_tmplReuse(dma, key, paddr, data, aux)) {
+		dma->first = NULL;
+		dma->last = NULL;
 
-	flashdrv_wait4ready(dma, EOK);
-	flashdrv_issue(dma, flash_program_page, chip, addr, sz, data, aux);
-	flashdrv_wait4ready(dma, EOK);
-	flashdrv_issue(dma, flash_read_status, chip, NULL, 0, NULL, NULL);
-	flashdrv_readcompare(dma, chip, 0x3, 0, -1);
-	flashdrv_finish(dma);
+		/* With cache program R/B# returns ready as soon as the cache register is free, status bits cover previous pages */
+		flashdrv_wait4ready(dma, EOK);
+		cmd = flashdrv_next(dma);
+		flashdrv_issue(dma, more ? flash_program_page_cache : flash_program_page, chip, addr, sz, data, aux);
+		flashdrv_wait4ready(dma, EOK);
+		flashdrv_issue(dma, flash_read_status, chip, NULL, 0, NULL, NULL);
+		flashdrv_readcompare(dma, chip, 0x3, 0, -1);
+		flashdrv_finish(dma);
+
+		/* Command buffer (8 bytes) and command descriptor precede the BCH one, raw transfers aren't kept */
+		if (aux != NULL) {
+			flashdrv_tmplSave(dma, key, cmd + 3, cmd + 8 + sizeof(gpmi_dma3_t), data, aux);
+		}
+	}
 
 	mutexLock(flashdrv_common.mutex);
 
+	if ((flashdrv_common.seq[chip].op != seq_program) || (flashdrv_common.seq[chip].paddr != paddr)) {
+		_flashdrv_seqend(chip);
+	}
+
 	if (data == NULL) {
 		/* Trick BCH controller into thinking that the whole page consists of just the metadata block */
 		*(flashdrv_common.bch + bch_flash0layout0) &= ~(0xff << 24);
@@ -779,6 +1036,9 @@ int flashdrv_write(flashdrv_dma_t *dma, uint32_t paddr, void *data, char *aux)
 
 	err = flashdrv_common.result;
 
+	flashdrv_common.seq[chip].op = (more && (err >= 0)) ? seq_program : seq_none;
+	flashdrv_common.seq[chip].paddr = paddr + 1;
+
 	if (data == NULL) {
 		*(flashdrv_common.bch + bch_flash0layout0) |= 8 << 24;
 
@@ -796,15 +1056,26 @@ int flashdrv_write(flashdrv_dma_t *dma, uint32_t paddr, void *data, char *aux)
 }
 
 
-int flashdrv_read(flashdrv_dma_t *dma, uint32_t paddr, void *data, flashdrv_meta_t *aux)
+int flashdrv_write(flashdrv_dma_t *dma, uint32_t paddr, void *data, char *aux)
+{
+	return flashdrv_writeseq(dma, paddr, data, aux, 0);
+}
+
+
+int flashdrv_readseq(flashdrv_dma_t *dma, uint32_t paddr, void *data, flashdrv_meta_t *aux, int more)
 {
-	int chip = 0, channel = 0, sz = 0, result;
+	int chip = 0, channel = 0, sz = 0, result, cont;
 	char addr[5] = { 0 };
+	uint32_t key;
+	uint8_t *cmd = NULL;
+	void *ecc;
 
 	if (flashdrv_addrPrep(&paddr, &chip) < 0) {
 		return -1;
 	}
 
+	more = more && flashdrv_common.cacheread && flashdrv_seqallowed(paddr);
+
 	memcpy(addr + 2, &paddr, 3);
 
 	if (data != NULL)
@@ -812,17 +1083,42 @@ int flashdrv_read(flashdrv_dma_t *dma, uint32_t paddr, void *data, flashdrv_meta
 	else
 		sz = flashdrv_common.rawmetasz;
 
-	dma->first = NULL;
-	dma->last = NULL;
+	mutexLock(flashdrv_common.mutex);
 
-	flashdrv_wait4ready(dma, EOK);
-	flashdrv_issue(dma, flash_read_page, chip, addr, 0, NULL, NULL);
-	flashdrv_wait4ready(dma, EOK);
-	flashdrv_readback(dma, chip, sz, data, aux);
-	flashdrv_disablebch(dma, chip);
-	flashdrv_finish(dma);
+	cont = (flashdrv_common.seq[chip].op == seq_read) && (flashdrv_common.seq[chip].paddr == paddr);
+	if (!cont) {
+		_flashdrv_seqend(chip);
+	}
+
+	key = flashdrv_tmplKey(tmpl_read, chip, (more != 0) | (cont << 1) | ((data != NULL) << 2) | ((aux != NULL) << 3));
+	if (!flashdrv_tmplReuse(dma, key, paddr, data, aux)) {
+		dma->first = NULL;
+		dma->last = NULL;
+
+		if (!cont) {
+			flashdrv_wait4ready(dma, EOK);
+			cmd = flashdrv_next(dma);
+			flashdrv_issue(dma, flash_read_page, chip, addr, 0, NULL, NULL);
+			flashdrv_wait4ready(dma, EOK);
+		}
+
+		/* Page is already in the data register (cont) or in the array, cache commands move it to cache register
+		 * and start loading the next page, which overlaps with data output and BCH decoding of this one */
+		if (cont || more) {
+			flashdrv_issue(dma, more ? flash_read_page_cache_sequential : flash_read_page_cache_last, chip, NULL, 0, NULL, NULL);
+			flashdrv_wait4ready(dma, EOK);
+		}
+
+		ecc = flashdrv_next(dma);
+		flashdrv_readback(dma, chip, sz, data, aux);
+		flashdrv_disablebch(dma, chip);
+		flashdrv_finish(dma);
+
+		if (aux != NULL) {
+			flashdrv_tmplSave(dma, key, (cmd != NULL) ? cmd + 3 : NULL, ecc, data, aux);
+		}
+	}
 
-	mutexLock(flashdrv_common.mutex);
 	flashdrv_common.result = 1;
 	flashdrv_common.bch_done = 0;
 	dma_run((dma_t *)dma->first, channel);
@@ -835,6 +1131,9 @@ int flashdrv_read(flashdrv_dma_t *dma, uint32_t paddr, void *data, flashdrv_meta
 		condWait(flashdrv_common.dma_cond, flashdrv_common.wait_mutex, 0);
 	mutexUnlock(flashdrv_common.wait_mutex);
 
+	flashdrv_common.seq[chip].op = (more && (flashdrv_common.result >= 0)) ? seq_read : seq_none;
+	flashdrv_common.seq[chip].paddr = paddr + 1;
+
 	result = flashdrv_common.bch_status;
 	mutexUnlock(flashdrv_common.mutex);
 
@@ -842,39 +1141,171 @@ int flashdrv_read(flashdrv_dma_t *dma, uint32_t paddr, void *data, flashdrv_meta
 }
 
 
-int flashdrv_erase(flashdrv_dma_t *dma, uint32_t paddr)
+int flashdrv_read(flashdrv_dma_t *dma, uint32_t paddr, void *data, flashdrv_meta_t *aux)
+{
+	return flashdrv_readseq(dma, paddr, data, aux, 0);
+}
+
+
+int flashdrv_readsub(flashdrv_dma_t *dma, uint32_t paddr, void *data, flashdrv_meta_t *aux, unsigned int offs, size_t len)
 {
+	const unsigned int nchunks = flashdrv_common.info.writesz / BCH_CHUNKSZ;
+	unsigned int first, last, col, sz, i;
 	int chip = 0, channel = 0, result;
-	dma->first = NULL;
-	dma->last = NULL;
+	uint32_t layout0, layout1;
+	uint8_t status[sizeof(aux->errors)];
+	char addr[5] = { 0 };
+
+	if ((data == NULL) || (aux == NULL) || (len == 0) || (offs + len > flashdrv_common.info.writesz)) {
+		return -EINVAL;
+	}
+
+	first = (offs / BCH_CHUNKSZ) & ~(BCH_SUBPAGE_CHUNKS - 1u);
+	last = (offs + len + BCH_CHUNKSZ - 1) / BCH_CHUNKSZ;
+	last = (last + BCH_SUBPAGE_CHUNKS - 1) & ~(BCH_SUBPAGE_CHUNKS - 1u);
+	if ((first == 0) && (last >= nchunks)) {
+		return flashdrv_read(dma, paddr, data, aux);
+	}
 
 	if (flashdrv_addrPrep(&paddr, &chip) < 0) {
 		return -1;
 	}
 
+	/* Whole subpages are byte aligned, metadata chunk goes only with the first one */
+	col = (first == 0) ? 0 : flashdrv_common.rawmetasz + (first * BCH_CHUNKBITS) / 8;
+	sz = ((last - first) * BCH_CHUNKBITS) / 8;
+	if (first == 0) {
+		/* 16 bytes metadata, ECC16, data chunks after it */
+		layout0 = (last - first) << 24 | 16 << 16 | 8 << 11 | 0 << 10 | 0;
+		sz += flashdrv_common.rawmetasz;
+	}
+	else {
+		/* No metadata, first data chunk is block 0 with the data chunks ECC14 */
+		layout0 = (last - first - 1) << 24 | 0 << 16 | 7 << 11 | 0 << 10 | (BCH_CHUNKSZ / 4);
+	}
+	layout1 = sz << 16 | 7 << 11 | 0 << 10 | (BCH_CHUNKSZ / 4);
+
+	addr[0] = col & 0xff;
+	addr[1] = (col >> 8) & 0xff;
+	memcpy(addr + 2, &paddr, 3);
+
+	dma->first = NULL;
+	dma->last = NULL;
+
 	flashdrv_wait4ready(dma, EOK);
-	flashdrv_issue(dma, flash_erase_block, chip, &paddr, 0, NULL, NULL);
+	flashdrv_issue(dma, flash_read_page, chip, addr, 0, NULL, NULL);
 	flashdrv_wait4ready(dma, EOK);
-	flashdrv_issue(dma, flash_read_status, chip, NULL, 0, NULL, NULL);
-	flashdrv_readcompare(dma, chip, 0x1, 0, -1);
+	flashdrv_readback(dma, chip, sz, (uint8_t *)data + first * BCH_CHUNKSZ, aux);
+	flashdrv_disablebch(dma, chip);
 	flashdrv_finish(dma);
 
 	mutexLock(flashdrv_common.mutex);
+	_flashdrv_seqend(chip);
+
+	*(flashdrv_common.bch + bch_flash0layout0) = layout0;
+	*(flashdrv_common.bch + bch_flash0layout1) = layout1;
+
 	flashdrv_common.result = 1;
+	flashdrv_common.bch_done = 0;
 	dma_run((dma_t *)dma->first, channel);
 
 	mutexLock(flashdrv_common.wait_mutex);
+	while (!flashdrv_common.bch_done)
+		condWait(flashdrv_common.bch_cond, flashdrv_common.wait_mutex, 0);
+
 	while (flashdrv_common.result > 0)
 		condWait(flashdrv_common.dma_cond, flashdrv_common.wait_mutex, 0);
 	mutexUnlock(flashdrv_common.wait_mutex);
 
-	result = flashdrv_common.result;
+	*(flashdrv_common.bch + bch_flash0layout0) = 8 << 24 | 16 << 16 | 8 << 11 | 0 << 10 | 0;
+	*(flashdrv_common.bch + bch_flash0layout1) = (flashdrv_common.info.writesz + flashdrv_common.info.metasz) << 16 | 7 << 11 | 0 << 10 | 128;
+
+	result = flashdrv_common.bch_status;
 	mutexUnlock(flashdrv_common.mutex);
 
+	/* Without metadata BCH puts the chunks status at the start of the auxiliary buffer */
+	if (first != 0) {
+		memcpy(status, aux->metadata, last - first);
+		memset(aux->metadata, 0xff, sizeof(aux->metadata));
+		memset(aux->errors, flash_no_errors, sizeof(aux->errors));
+		memcpy(aux->errors + 1 + first, status, last - first);
+	}
+	else {
+		for (i = 1 + last; i < sizeof(aux->errors); ++i) {
+			aux->errors[i] = flash_no_errors;
+		}
+	}
+
 	return result;
 }
 
 
+int flashdrv_erase(flashdrv_dma_t *dma, uint32_t paddr)
+{
+	int chip = 0, result, status, done;
+	uint32_t key;
+	uint8_t *cmd;
+
+	if (flashdrv_addrPrep(&paddr, &chip) < 0) {
+		return -1;
+	}
+
+	key = flashdrv_tmplKey(tmpl_erase, chip, 0);
+	if (!flashdrv_tmplReuse(dma, key, paddr, NULL, NULL)) {
+		dma->first = NULL;
+		dma->last = NULL;
+
+		flashdrv_wait4ready(dma, EOK);
+		cmd = flashdrv_next(dma);
+		flashdrv_issue(dma, flash_erase_block, chip, &paddr, 0, NULL, NULL);
+		flashdrv_finish(dma);
+
+		flashdrv_tmplSave(dma, key, cmd + 1, NULL, NULL, NULL);
+	}
+
+	/* One erase per chip at a time, seq[chip].status belongs to it */
+	mutexLock(flashdrv_common.eraselock[chip]);
+
+	mutexLock(flashdrv_common.mutex);
+	_flashdrv_seqend(chip);
+	result = _flashdrv_run(dma);
+	if (result >= 0) {
+		flashdrv_common.seq[chip].op = seq_erase;
+	}
+	mutexUnlock(flashdrv_common.mutex);
+
+	/* Don't hold the controller for tBERS, other chips may be accessed meanwhile.
+	 * Command issued to this chip ends the erase in _flashdrv_seqend() and leaves its status for us. */
+	done = (result < 0);
+	while (!done) {
+		usleep(ERASE_POLL_US);
+
+		mutexLock(flashdrv_common.mutex);
+		if (flashdrv_common.seq[chip].op == seq_erase) {
+			status = _flashdrv_status(chip);
+			if ((status < 0) || ((status & (1 << 6)) != 0)) {
+				flashdrv_common.seq[chip].op = seq_none;
+				flashdrv_common.seq[chip].status = status;
+			}
+		}
+
+		if (flashdrv_common.seq[chip].op != seq_erase) {
+			result = flashdrv_common.seq[chip].status;
+			done = 1;
+		}
+		mutexUnlock(flashdrv_common.mutex);
+	}
+
+	mutexUnlock(flashdrv_common.eraselock[chip]);
+
+	if (result < 0) {
+		return result;
+	}
+
+	return ((result & 0x1) != 0) ? -1 : EOK;
+}
+
+
 int flashdrv_writeraw(flashdrv_dma_t *dma, uint32_t paddr, void *data, int sz)
 {
 	int chip = 0, channel = 0, err;
@@ -897,6 +1328,7 @@ int flashdrv_writeraw(flashdrv_dma_t *dma, uint32_t paddr, void *data, int sz)
 	flashdrv_finish(dma);
 
 	mutexLock(flashdrv_common.mutex);
+	_flashdrv_seqend(chip);
 	flashdrv_common.result = 1;
 	dma_run((dma_t *)dma->first, channel);
 
@@ -935,6 +1367,7 @@ int flashdrv_readraw(flashdrv_dma_t *dma, uint32_t paddr, void *data, int sz)
 	flashdrv_finish(dma);
 
 	mutexLock(flashdrv_common.mutex);
+	_flashdrv_seqend(chip);
 	flashdrv_common.result = 1;
 	dma_run((dma_t *)dma->first, channel);
 
@@ -951,7 +1384,7 @@ int flashdrv_readraw(flashdrv_dma_t *dma, uint32_t paddr, void *data, int sz)
 
 
 /* valid addresses are only the beginning of erase block */
-int flashdrv_isbad(flashdrv_dma_t *dma, uint32_t paddr)
+static int flashdrv_scanbad(flashdrv_dma_t *dma, uint32_t paddr)
 {
 	int chip = 0, channel = 0, isbad = 0;
 	uint8_t *data = flashdrv_common.uncached_buf;
@@ -978,6 +1411,7 @@ int flashdrv_isbad(flashdrv_dma_t *dma, uint32_t paddr)
 	flashdrv_finish(dma);
 
 	mutexLock(flashdrv_common.mutex);
+	_flashdrv_seqend(chip);
 	flashdrv_common.result = 1;
 	dma_run((dma_t *)dma->first, channel);
 
@@ -997,7 +1431,7 @@ int flashdrv_isbad(flashdrv_dma_t *dma, uint32_t paddr)
 }
 
 
-int flashdrv_markbad(flashdrv_dma_t *dma, uint32_t paddr)
+static int flashdrv_markraw(flashdrv_dma_t *dma, uint32_t paddr)
 {
 	int chip = 0, channel = 0, err;
 	uint8_t *data = flashdrv_common.uncached_buf;
@@ -1024,6 +1458,7 @@ int flashdrv_markbad(flashdrv_dma_t *dma, uint32_t paddr)
 	flashdrv_finish(dma);
 
 	mutexLock(flashdrv_common.mutex);
+	_flashdrv_seqend(chip);
 
 	memset(data, 0xff, flashdrv_common.info.writesz + flashdrv_common.info.metasz);
 	memset(data, 0x0, metasz);
@@ -1043,10 +1478,338 @@ int flashdrv_markbad(flashdrv_dma_t *dma, uint32_t paddr)
 }
 
 
+/* Bad block table
+ *
+ * Scanning bad block markers reads raw page 0 of every erase block, which takes seconds on a full chip.
+ * Table (1 bit per erase block) is kept in RAM instead and stored in page 0 of two of the last
+ * FLASHDRV_BBT_BLOCKS erase blocks with ECC, main and mirror copy. Reserved blocks are reported as bad,
+ * so they are never used for data. Full scan is done only if no valid copy is found. */
+
+static uint32_t flashdrv_crc32(const uint8_t *buf, size_t len)
+{
+	uint32_t crc = 0xffffffffu;
+	size_t i;
+	int j;
+
+	for (i = 0; i < len; ++i) {
+		crc ^= buf[i];
+		for (j = 0; j < 8; ++j) {
+			crc = (crc & 1u) ? (crc >> 1) ^ 0xedb88320u : crc >> 1;
+		}
+	}
+
+	return ~crc;
+}
+
+
+static inline uint32_t flashdrv_bbtPages(void)
+{
+	return flashdrv_common.info.erasesz / flashdrv_common.info.writesz;
+}
+
+
+static inline size_t flashdrv_bbtMapsz(void)
+{
+	return (flashdrv_common.bbt.nblocks + 7) / 8;
+}
+
+
+static inline uint32_t flashdrv_bbtFirst(void)
+{
+	return flashdrv_common.bbt.nblocks - FLASHDRV_BBT_BLOCKS;
+}
+
+
+static int _flashdrv_bbtSpare(int other)
+{
+	uint32_t blk;
+
+	for (blk = flashdrv_bbtFirst(); blk < flashdrv_common.bbt.nblocks; ++blk) {
+		if (((int)blk != other) && ((flashdrv_common.bbt.resbad & (1u << (blk - flashdrv_bbtFirst()))) == 0)) {
+			return (int)blk;
+		}
+	}
+
+	return -1;
+}
+
+
+static int flashdrv_bbtWrite(flashdrv_dma_t *dma, int blk)
+{
+	flashdrv_bbtHdr_t *hdr = (flashdrv_bbtHdr_t *)flashdrv_common.bbt.buf;
+	char *meta = (char *)flashdrv_common.bbt.buf + FLASHDRV_BBT_METAOFFS;
+	uint32_t paddr = (uint32_t)blk * flashdrv_bbtPages();
+	int err;
+
+	err = flashdrv_erase(dma, paddr);
+	if (err < 0) {
+		return err;
+	}
+
+	memset(hdr, 0xff, flashdrv_common.info.writesz + flashdrv_common.info.metasz);
+	hdr->magic = FLASHDRV_BBT_MAGIC;
+	hdr->version = flashdrv_common.bbt.version;
+	hdr->nblocks = flashdrv_common.bbt.nblocks;
+	memcpy(hdr->map, flashdrv_common.bbt.map, flashdrv_bbtMapsz());
+	hdr->crc = flashdrv_crc32(hdr->map, flashdrv_bbtMapsz());
+
+	/* Erased metadata, so that raw bad block marker check doesn't see the block as bad */
+	memset(meta, 0xff, sizeof(((flashdrv_meta_t *)0)->metadata));
+
+	return flashdrv_write(dma, paddr, hdr, meta);
+}
+
+
+/* Rewrites both copies with a new version, bbt.lock held */
+static int _flashdrv_bbtStore(flashdrv_dma_t *dma)
+{
+	int i, stored = 0;
+
+	flashdrv_common.bbt.version++;
+
+	/* Mirror first, main copy still holds the previous version if power is lost meanwhile */
+	for (i = 1; i >= 0; --i) {
+		for (;;) {
+			if (flashdrv_common.bbt.copy[i] < 0) {
+				flashdrv_common.bbt.copy[i] = _flashdrv_bbtSpare(flashdrv_common.bbt.copy[i ^ 1]);
+				if (flashdrv_common.bbt.copy[i] < 0) {
+					break;
+				}
+			}
+
+			if (flashdrv_bbtWrite(dma, flashdrv_common.bbt.copy[i]) >= 0) {
+				stored++;
+				break;
+			}
+
+			/* Table block went bad, move the copy to another reserved block */
+			flashdrv_common.bbt.resbad |= 1u << (flashdrv_common.bbt.copy[i] - flashdrv_bbtFirst());
+			flashdrv_markraw(dma, (uint32_t)flashdrv_common.bbt.copy[i] * flashdrv_bbtPages());
+			flashdrv_common.bbt.copy[i] = -1;
+		}
+	}
+
+	return (stored > 0) ? EOK : -EIO;
+}
+
+
+/* Reads and validates a copy, map is updated if take != 0 */
+static int flashdrv_bbtLoad(flashdrv_dma_t *dma, int blk, uint32_t *version, int take)
+{
+	flashdrv_bbtHdr_t *hdr = (flashdrv_bbtHdr_t *)flashdrv_common.bbt.buf;
+	flashdrv_meta_t *meta = (flashdrv_meta_t *)(flashdrv_common.bbt.buf + FLASHDRV_BBT_METAOFFS);
+	size_t i;
+
+	if (flashdrv_read(dma, (uint32_t)blk * flashdrv_bbtPages(), hdr, meta) < 0) {
+		return -EIO;
+	}
+
+	for (i = 0; i < sizeof(meta->errors) / sizeof(meta->errors[0]); ++i) {
+		if ((meta->errors[i] == flash_uncorrectable) || (meta->errors[i] == flash_erased)) {
+			return -EBADMSG;
+		}
+	}
+
+	if ((hdr->magic != FLASHDRV_BBT_MAGIC) || (hdr->nblocks != flashdrv_common.bbt.nblocks) ||
+			(hdr->crc != flashdrv_crc32(hdr->map, flashdrv_bbtMapsz()))) {
+		return -EBADMSG;
+	}
+
+	*version = hdr->version;
+	if (take != 0) {
+		memcpy(flashdrv_common.bbt.map, hdr->map, flashdrv_bbtMapsz());
+	}
+
+	return EOK;
+}
+
+
+static void flashdrv_bbtInit(void)
+{
+	flashdrv_dma_t *dma;
+	uint8_t *map;
+	uint32_t blk, first, nbad = 0, version, ver[FLASHDRV_BBT_BLOCKS];
+	int i, valid[FLASHDRV_BBT_BLOCKS], best = -1, mirror = -1;
+
+	flashdrv_common.bbt.map = NULL;
+	flashdrv_common.bbt.nblocks = (uint32_t)(flashdrv_common.info.size / flashdrv_common.info.erasesz);
+	flashdrv_common.bbt.version = 0;
+	flashdrv_common.bbt.resbad = 0;
+	flashdrv_common.bbt.copy[0] = -1;
+	flashdrv_common.bbt.copy[1] = -1;
+
+	if ((flashdrv_common.bbt.nblocks <= FLASHDRV_BBT_BLOCKS) ||
+			(sizeof(flashdrv_bbtHdr_t) + flashdrv_bbtMapsz() > flashdrv_common.info.writesz) ||
+			(flashdrv_common.info.writesz + flashdrv_common.info.metasz > FLASHDRV_BBT_METAOFFS)) {
+		return;
+	}
+
+	dma = flashdrv_dmanew();
+	map = calloc(1, flashdrv_bbtMapsz());
+	flashdrv_common.bbt.buf = mmap(NULL, 2 * _PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_UNCACHED | MAP_CONTIGUOUS | MAP_ANONYMOUS, -1, 0);
+	if ((dma == MAP_FAILED) || (map == NULL) || (flashdrv_common.bbt.buf == MAP_FAILED)) {
+		if (flashdrv_common.bbt.buf != MAP_FAILED) {
+			munmap(flashdrv_common.bbt.buf, 2 * _PAGE_SIZE);
+		}
+		free(map);
+		flashdrv_dmadestroy(dma);
+		printf("imx6ull-flash: no memory for bad block table, using bad block markers\n");
+		return;
+	}
+	flashdrv_common.bbt.map = map;
+
+	first = flashdrv_bbtFirst();
+	for (i = 0; i < FLASHDRV_BBT_BLOCKS; ++i) {
+		valid[i] = 0;
+		if (flashdrv_scanbad(dma, (first + i) * flashdrv_bbtPages()) != 0) {
+			flashdrv_common.bbt.resbad |= 1u << i;
+		}
+		else if (flashdrv_bbtLoad(dma, first + i, &ver[i], 0) == EOK) {
+			valid[i] = 1;
+			if ((best < 0) || (ver[i] > ver[best])) {
+				best = i;
+			}
+		}
+	}
+
+	if ((best >= 0) && (flashdrv_bbtLoad(dma, first + best, &version, 1) == EOK)) {
+		for (i = 0; i < FLASHDRV_BBT_BLOCKS; ++i) {
+			if ((i != best) && (valid[i] != 0) && ((mirror < 0) || (ver[i] > ver[mirror]))) {
+				mirror = i;
+			}
+		}
+
+		flashdrv_common.bbt.version = version;
+		flashdrv_common.bbt.copy[0] = first + best;
+		flashdrv_common.bbt.copy[1] = (mirror >= 0) ? (int)(first + mirror) : -1;
+
+		/* Repair missing or stale mirror */
+		if ((mirror < 0) || (ver[mirror] != version)) {
+			_flashdrv_bbtStore(dma);
+		}
+	}
+	else {
+		for (blk = 0; blk < first; ++blk) {
+			if (flashdrv_scanbad(dma, blk * flashdrv_bbtPages()) != 0) {
+				map[blk / 8] |= 1u << (blk % 8);
+				nbad++;
+			}
+		}
+
+		for (blk = first; blk < flashdrv_common.bbt.nblocks; ++blk) {
+			map[blk / 8] |= 1u << (blk % 8);
+		}
+
+		printf("imx6ull-flash: bad block table not found, %u of %u blocks bad\n", nbad, first);
+
+		if (_flashdrv_bbtStore(dma) < 0) {
+			printf("imx6ull-flash: failed to store bad block table\n");
+		}
+	}
+
+	flashdrv_dmadestroy(dma);
+}
+
+
+int flashdrv_isbad(flashdrv_dma_t *dma, uint32_t paddr)
+{
+	uint32_t blk = paddr / flashdrv_bbtPages();
+	int isbad;
+
+	if ((flashdrv_common.bbt.map == NULL) || (blk >= flashdrv_common.bbt.nblocks)) {
+		return flashdrv_scanbad(dma, paddr);
+	}
+
+	mutexLock(flashdrv_common.bbt.lock);
+	isbad = (flashdrv_common.bbt.map[blk / 8] & (1u << (blk % 8))) != 0;
+	mutexUnlock(flashdrv_common.bbt.lock);
+
+	return isbad;
+}
+
+
+int flashdrv_markbad(flashdrv_dma_t *dma, uint32_t paddr)
+{
+	uint32_t blk = paddr / flashdrv_bbtPages();
+	int err, res = -1;
+
+	/* Marker is still written, raw scan finds the block bad if the table is lost */
+	err = flashdrv_markraw(dma, paddr);
+
+	if ((flashdrv_common.bbt.map == NULL) || (blk >= flashdrv_common.bbt.nblocks)) {
+		return err;
+	}
+
+	mutexLock(flashdrv_common.bbt.lock);
+	if ((flashdrv_common.bbt.map[blk / 8] & (1u << (blk % 8))) == 0) {
+		flashdrv_common.bbt.map[blk / 8] |= 1u << (blk % 8);
+		res = _flashdrv_bbtStore(dma);
+	}
+	else {
+		res = EOK;
+	}
+	mutexUnlock(flashdrv_common.bbt.lock);
+
+	return (res == EOK) ? EOK : err;
+}
+
+
+static uint16_t onfi_crc16(const uint8_t *buf, size_t len)
+{
+	uint16_t crc = 0x4f4e;
+	size_t i;
+	int bit;
+
+	for (i = 0; i < len; i++) {
+		crc ^= (uint16_t)buf[i] << 8;
+		for (bit = 0; bit < 8; bit++)
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x8005 : crc << 1;
+	}
+
+	return crc;
+}
+
+
+/* Returns ONFI optional commands bitmap or 0 if the chip has no valid ONFI parameter page */
+static int flashdrv_onfiCommands(flashdrv_dma_t *dma, int chip)
+{
+	uint8_t *page = flashdrv_common.uncached_buf;
+	char addr[1] = { 0 };
+	int i, err;
+
+	dma->first = NULL;
+	dma->last = NULL;
+
+	/* Parameter page is stored in (at least) 3 redundant copies of 256 bytes */
+	flashdrv_wait4ready(dma, EOK);
+	flashdrv_issue(dma, flash_read_parameter_page, chip, addr, 0, NULL, NULL);
+	flashdrv_wait4ready(dma, EOK);
+	flashdrv_readback(dma, chip, 3 * 256, page, NULL);
+	flashdrv_disablebch(dma, chip);
+	flashdrv_wait4ready(dma, EOK);
+	flashdrv_finish(dma);
+
+	mutexLock(flashdrv_common.mutex);
+	err = _flashdrv_run(dma);
+	mutexUnlock(flashdrv_common.mutex);
+
+	if (err < 0)
+		return 0;
+
+	for (i = 0; i < 3; i++, page += 256) {
+		if ((memcmp(page, "ONFI", 4) == 0) && (onfi_crc16(page, 254) == (page[254] | (page[255] << 8))))
+			return page[8] | (page[9] << 8);
+	}
+
+	return 0;
+}
+
+
 static void setup_flash_info(void)
 {
 	flash_id_t *flash_id = (flash_id_t *)flashdrv_common.uncached_buf;
 	flashdrv_dma_t *dma = flashdrv_dmanew();
+	int onfi;
 
 	memset(flash_id, 0, sizeof(*flash_id));
 
@@ -1102,6 +1865,12 @@ static void setup_flash_info(void)
 		flashdrv_common.info.pbits = 18;
 	}
 
+	if ((dma != MAP_FAILED) && (flashdrv_common.seqdma != MAP_FAILED)) {
+		onfi = flashdrv_onfiCommands(dma, 0);
+		flashdrv_common.cacheread = (onfi & onfi_cache_read) != 0;
+		flashdrv_common.cacheprogram = (onfi & onfi_cache_program) != 0;
+	}
+
 	flashdrv_dmadestroy(dma);
 }
 
@@ -1123,6 +1892,16 @@ void flashdrv_init(void)
 	condCreate(&flashdrv_common.dma_cond);
 	mutexCreate(&flashdrv_common.mutex);
 	mutexCreate(&flashdrv_common.wait_mutex);
+	mutexCreate(&flashdrv_common.eraselock[0]);
+	mutexCreate(&flashdrv_common.eraselock[1]);
+	mutexCreate(&flashdrv_common.bbt.lock);
+	flashdrv_common.bbt.map = NULL;
+
+	/* Private chain for ending cache sequences, status byte is kept in its unused tail */
+	flashdrv_common.seqdma = flashdrv_dmanew();
+	flashdrv_common.seqstatus = (uint8_t *)flashdrv_common.seqdma + _PAGE_SIZE / 2;
+	flashdrv_common.cacheread = 0;
+	flashdrv_common.cacheprogram = 0;
 
 	flashdrv_setDevClock(pctl_clk_apbhdma, 3);
 	flashdrv_setDevClock(pctl_clk_rawnand_u_gpmi_input_apb, 3);
@@ -1184,6 +1963,8 @@ void flashdrv_init(void)
 	*(flashdrv_common.bch + bch_flash0layout1) = (flashdrv_common.info.writesz + flashdrv_common.info.metasz) << 16 | 7 << 11 | 0 << 10 | 128;
 
 	interrupt(32 + 15, bch_irqHandler, NULL, flashdrv_common.bch_cond, &flashdrv_common.intbch);
+
+	flashdrv_bbtInit();
 }
 
 
@@ -23,6 +23,8 @@
 #include <sys/stat.h>
 #include <sys/threads.h>
 #include <sys/reboot.h>
+#include <sys/list.h>
+#include <sys/minmax.h>
 #include <posix/utils.h>
 
 #include <libjffs2.h>
@@ -56,6 +58,58 @@
 #endif
 
 
+/* Request queues (one per NAND chip) */
+#define FLASHSRV_MAX_CHIPS       2
+#define FLASHSRV_SCHED_PRIO      3
+#define FLASHSRV_SCHED_STACKSZ   (2 * _PAGE_SIZE)
+
+
+/* Background scrubbing: idle blocks are read to find degraded ones before clients hit them */
+#define FLASHSRV_SCRUB_IDLE      10                   /* default quiet period [s] before scrubbing starts */
+#define FLASHSRV_SCRUB_DELAY_US  (100 * 1000)         /* delay between scrubbed blocks */
+#define FLASHSRV_SCRUB_PRIO      6
+#define FLASHSRV_SCRUB_STACKSZ   (2 * _PAGE_SIZE)
+
+
+enum { flashsrv_req_read = 0, flashsrv_req_write, flashsrv_req_erase, flashsrv_req_scrub };
+
+
+typedef struct _flashsrv_req_t {
+	struct _flashsrv_req_t *next, *prev;
+
+	int type;
+	storage_t *strg;
+	off_t offs;        /* absolute NAND address */
+	size_t size;
+	void *data;
+
+	size_t done;       /* bytes already processed */
+	ssize_t ret;       /* accumulated result (bytes or erased blocks) */
+	int pending;
+} flashsrv_req_t;
+
+
+typedef struct {
+	handle_t lock;
+	handle_t cond;     /* new request */
+	handle_t done;     /* request completed */
+	time_t last;       /* last client request submission [us] */
+	flashsrv_req_t *reqs;
+	char stack[FLASHSRV_SCHED_STACKSZ] __attribute__((aligned(8)));
+} flashsrv_queue_t;
+
+
+static struct {
+	flashsrv_queue_t queues[FLASHSRV_MAX_CHIPS];
+	unsigned int nqueues;
+	uint64_t chipsz;
+
+	storage_t *root;
+	unsigned int scrubIdle; /* quiet period [s], 0 disables scrubbing */
+	char scrubStack[FLASHSRV_SCRUB_STACKSZ] __attribute__((aligned(8)));
+} flashsrv_common;
+
+
 /* Auxiliary functions */
 
 static int flash_oidResolve(const char *devPath, oid_t *oid)
@@ -218,6 +272,283 @@ static int flashsrv_ptableWrite(storage_t *strg, const ptable_t *ptable)
 }
 
 
+/* Request queues */
+
+static inline int flashsrv_reqOverlap(const flashsrv_req_t *r1, const flashsrv_req_t *r2)
+{
+	return ((r1->offs + r1->size) > r2->offs) && ((r2->offs + r2->size) > r1->offs);
+}
+
+
+/* Reads go first unless they overlap with earlier write / erase, everything else keeps FIFO order */
+static flashsrv_req_t *_flashsrv_reqPick(flashsrv_queue_t *q)
+{
+	flashsrv_req_t *req, *prev;
+
+	req = q->reqs;
+	if (req == NULL) {
+		return NULL;
+	}
+
+	do {
+		if (req->type == flashsrv_req_read) {
+			for (prev = q->reqs; prev != req; prev = prev->next) {
+				if (flashsrv_reqOverlap(prev, req)) {
+					break;
+				}
+			}
+
+			if (prev == req) {
+				return req;
+			}
+		}
+		req = req->next;
+	} while (req != q->reqs);
+
+	return q->reqs;
+}
+
+
+/* Executes next step of the request, returns 1 when it's finished */
+static int flashsrv_reqStep(flashsrv_req_t *req)
+{
+	const storage_mtd_t *mtd = req->strg->dev->mtd;
+	size_t chunksz, retlen = 0;
+	int res;
+
+	switch (req->type) {
+		case flashsrv_req_read:
+			res = mtd->ops->read(req->strg, req->offs, req->data, req->size, &retlen);
+			/* -EUCLEAN isn't a fatal error (indicates dangerous page degradation but all bitflips were successfully corrected) */
+			req->ret = ((res < 0) && (res != -EUCLEAN)) ? res : retlen;
+			return 1;
+
+		case flashsrv_req_write:
+			/* Write up to the erase block boundary, so that reads may be served in between */
+			chunksz = mtd->erasesz - ((req->offs + req->done) % mtd->erasesz);
+			if (chunksz > (req->size - req->done)) {
+				chunksz = req->size - req->done;
+			}
+
+			res = mtd->ops->write(req->strg, req->offs + req->done, (char *)req->data + req->done, chunksz, &retlen);
+			req->done += retlen;
+			if (res < 0) {
+				req->ret = (req->done > 0) ? req->done : res;
+				return 1;
+			}
+			req->ret = req->done;
+			break;
+
+		case flashsrv_req_erase:
+			/* Erase block by block, so that reads may be served in between */
+			res = mtd->ops->erase(req->strg, req->offs + req->done, mtd->erasesz);
+			if (res < 0) {
+				req->ret = res;
+				return 1;
+			}
+			req->done += mtd->erasesz;
+			req->ret += res;
+			break;
+
+		case flashsrv_req_scrub:
+			/* Read whole block, flashdev updates its bitflips statistics */
+			res = mtd->ops->block_isBad(req->strg, req->offs);
+			if (res == 0) {
+				res = mtd->ops->block_maxBitflips(req->strg, req->offs);
+			}
+			else if (res > 0) {
+				res = 0;
+			}
+			req->ret = res;
+			return 1;
+
+		default:
+			req->ret = -EINVAL;
+			return 1;
+	}
+
+	return (req->done >= req->size) ? 1 : 0;
+}
+
+
+static void flashsrv_schedThread(void *arg)
+{
+	flashsrv_queue_t *q = (flashsrv_queue_t *)arg;
+	flashsrv_req_t *req;
+
+	mutexLock(q->lock);
+	for (;;) {
+		while ((req = _flashsrv_reqPick(q)) == NULL) {
+			condWait(q->cond, q->lock, 0);
+		}
+		mutexUnlock(q->lock);
+
+		if (flashsrv_reqStep(req) != 0) {
+			mutexLock(q->lock);
+			LIST_REMOVE(&q->reqs, req);
+			req->pending = 0;
+			condBroadcast(q->done);
+		}
+		else {
+			mutexLock(q->lock);
+		}
+	}
+}
+
+
+/* Queues request on the chip holding its first byte and waits for its completion */
+static ssize_t flashsrv_reqSubmit(storage_t *strg, int type, off_t offs, void *data, size_t size)
+{
+	flashsrv_req_t req;
+	flashsrv_queue_t *q;
+	unsigned int chip;
+
+	if (size == 0) {
+		return 0;
+	}
+
+	req.type = type;
+	req.strg = strg;
+	req.offs = offs;
+	req.size = size;
+	req.data = data;
+	req.done = 0;
+	req.ret = 0;
+	req.pending = 1;
+
+	chip = offs / flashsrv_common.chipsz;
+	if (chip >= flashsrv_common.nqueues) {
+		chip = flashsrv_common.nqueues - 1;
+	}
+	q = &flashsrv_common.queues[chip];
+
+	mutexLock(q->lock);
+	if (type != flashsrv_req_scrub) {
+		gettime(&q->last, NULL);
+	}
+	LIST_ADD(&q->reqs, &req);
+	condSignal(q->cond);
+
+	while (req.pending != 0) {
+		condWait(q->done, q->lock, 0);
+	}
+	mutexUnlock(q->lock);
+
+	return req.ret;
+}
+
+
+/* Returns 1 if no client request has been submitted for the quiet period */
+static int flashsrv_idle(void)
+{
+	flashsrv_queue_t *q;
+	unsigned int i;
+	int idle = 1;
+	time_t now;
+
+	gettime(&now, NULL);
+
+	for (i = 0; (i < flashsrv_common.nqueues) && (idle != 0); i++) {
+		q = &flashsrv_common.queues[i];
+
+		mutexLock(q->lock);
+		idle = (q->reqs == NULL) && ((now - q->last) >= (time_t)flashsrv_common.scrubIdle * 1000 * 1000);
+		mutexUnlock(q->lock);
+	}
+
+	return idle;
+}
+
+
+static void flashsrv_scrubThread(void *arg)
+{
+	storage_t *strg = flashsrv_common.root;
+	const size_t erasesz = strg->dev->mtd->erasesz;
+	const unsigned int nblocks = strg->size / erasesz;
+	unsigned int eb = 0;
+	ssize_t res;
+
+	for (;;) {
+		usleep(FLASHSRV_SCRUB_DELAY_US);
+
+		if (flashsrv_idle() == 0) {
+			continue;
+		}
+
+		res = flashsrv_reqSubmit(strg, flashsrv_req_scrub, (off_t)eb * erasesz, NULL, erasesz);
+		if (res < 0) {
+			LOG_ERROR("scrub: failed to read block %u, err: %zd", eb, res);
+		}
+		else if (res >= FLASHDEV_FLIPS_REFRESH) {
+			LOG("scrub: block %u needs refresh, %zd bitflips corrected", eb, res);
+		}
+
+		eb = (eb + 1) % nblocks;
+	}
+}
+
+
+static int flashsrv_scrubInit(storage_t *strg)
+{
+	flashsrv_common.root = strg;
+
+	if (flashsrv_common.scrubIdle == 0) {
+		return EOK;
+	}
+
+	return beginthread(flashsrv_scrubThread, FLASHSRV_SCRUB_PRIO, flashsrv_common.scrubStack, sizeof(flashsrv_common.scrubStack), NULL);
+}
+
+
+static int flashsrv_queuesInit(void)
+{
+	const flashdrv_info_t *info = flashdrv_info();
+	flashsrv_queue_t *q;
+	unsigned int i;
+	int err;
+
+	flashsrv_common.nqueues = (info->chips > FLASHSRV_MAX_CHIPS) ? FLASHSRV_MAX_CHIPS : info->chips;
+	if (flashsrv_common.nqueues == 0) {
+		flashsrv_common.nqueues = 1;
+	}
+	flashsrv_common.chipsz = info->size / flashsrv_common.nqueues;
+
+	for (i = 0; i < flashsrv_common.nqueues; i++) {
+		q = &flashsrv_common.queues[i];
+		q->reqs = NULL;
+		gettime(&q->last, NULL);
+
+		err = mutexCreate(&q->lock);
+		if (err < 0) {
+			return err;
+		}
+
+		err = condCreate(&q->cond);
+		if (err < 0) {
+			resourceDestroy(q->lock);
+			return err;
+		}
+
+		err = condCreate(&q->done);
+		if (err < 0) {
+			resourceDestroy(q->cond);
+			resourceDestroy(q->lock);
+			return err;
+		}
+
+		err = beginthread(flashsrv_schedThread, FLASHSRV_SCHED_PRIO, q->stack, sizeof(q->stack), q);
+		if (err < 0) {
+			resourceDestroy(q->done);
+			resourceDestroy(q->cond);
+			resourceDestroy(q->lock);
+			return err;
+		}
+	}
+
+	return EOK;
+}
+
+
 /* Device control functions */
 
 static int flashsrv_devInfo(flash_o_devctl_t *odevctl)
@@ -260,7 +591,11 @@ static int flashsrv_devErase(id_t id, const flash_i_devctl_t *idevctl)
 		size = strg->size - offs;
 	}
 
-	return strg->dev->mtd->ops->erase(strg, strg->start + offs, size);
+	if ((offs % strg->dev->mtd->erasesz) != 0 || (size % strg->dev->mtd->erasesz) != 0) {
+		return -EINVAL;
+	}
+
+	return flashsrv_reqSubmit(strg, flashsrv_req_erase, strg->start + offs, NULL, size);
 }
 
 
@@ -448,6 +783,55 @@ static int flashsrv_devMaxBitflips(id_t id, const flash_i_devctl_t *idevctl)
 }
 
 
+static int flashsrv_devBitflips(id_t id, const flash_i_devctl_t *idevctl, flash_o_devctl_t *odevctl, uint8_t *data, size_t datasz)
+{
+	size_t addr = idevctl->bitflips.address;
+	size_t size = idevctl->bitflips.size;
+	storage_t *strg = storage_get(id);
+	flashsrv_bitflips_t stats;
+	unsigned int eb, start, nblocks;
+	int flips;
+
+	if (strg == NULL || strg->dev == NULL || strg->dev->mtd == NULL || (addr + size) > strg->size ||
+			(addr % strg->dev->mtd->erasesz) != 0 || (size % strg->dev->mtd->erasesz) != 0) {
+		return -EINVAL;
+	}
+
+	if (size == 0) {
+		size = strg->size - addr;
+	}
+
+	start = (strg->start + addr) / strg->dev->mtd->erasesz;
+	nblocks = size / strg->dev->mtd->erasesz;
+
+	memset(&stats, 0, sizeof(stats));
+	for (eb = 0; eb < nblocks; eb++) {
+		flips = flashdev_blockFlips(start + eb);
+		if (flips < 0) {
+			return flips;
+		}
+
+		if ((data != NULL) && (eb < datasz)) {
+			data[eb] = flips;
+		}
+
+		if (flips == FLASHDEV_FLIPS_UNKNOWN) {
+			stats.unknown++;
+			continue;
+		}
+
+		stats.hist[min((flips + 1) / 2, FLASHSRV_FLIPS_BUCKETS - 1)]++;
+		if (flips >= FLASHDEV_FLIPS_REFRESH) {
+			stats.refresh++;
+		}
+	}
+
+	memcpy(&odevctl->bitflips, &stats, sizeof(stats));
+
+	return nblocks;
+}
+
+
 static int flashsrv_devPtableRead(id_t id, const flash_i_devctl_t *idevctl, ptable_t *ptable)
 {
 	storage_t *strg = storage_get(id);
@@ -478,8 +862,6 @@ static int flashsrv_devPtableWrite(id_t id, const flash_i_devctl_t *idevctl, con
 
 static ssize_t flashsrv_read(oid_t *oid, size_t offs, char *data, size_t size)
 {
-	int res;
-	size_t retlen;
 	storage_t *strg = storage_get(oid->id);
 
 	TRACE("Read off: %d, size: %d.", offs, size);
@@ -489,20 +871,12 @@ static ssize_t flashsrv_read(oid_t *oid, size_t offs, char *data, size_t size)
 		return -EINVAL;
 	}
 
-	res = strg->dev->mtd->ops->read(strg, strg->start + offs, data, size, &retlen);
-	/* -EUCLEAN isn't a fatal error (indicates dangerous page degradation but all bitflips were successfully corrected) */
-	if ((res < 0) && (res != -EUCLEAN)) {
-		return res;
-	}
-
-	return retlen;
+	return flashsrv_reqSubmit(strg, flashsrv_req_read, strg->start + offs, data, size);
 }
 
 
 static ssize_t flashsrv_write(oid_t *oid, size_t offs, const char *data, size_t size)
 {
-	int res;
-	size_t retlen;
 	storage_t *strg = storage_get(oid->id);
 
 	TRACE("Write off: %d, size: %d, ptr: %p", offs, size, data);
@@ -512,12 +886,7 @@ static ssize_t flashsrv_write(oid_t *oid, size_t offs, const char *data, size_t
 		return -EINVAL;
 	}
 
-	res = strg->dev->mtd->ops->write(strg, strg->start + offs, data, size, &retlen);
-	if (res >= 0) {
-		res = retlen;
-	}
-
-	return res;
+	return flashsrv_reqSubmit(strg, flashsrv_req_write, strg->start + offs, (void *)data, size);
 }
 
 
@@ -603,6 +972,10 @@ static void flashsrv_devCtrl(msg_t *msg)
 			msg->o.err = flashsrv_devPtableWrite(msg->oid.id, idevctl, msg->i.data);
 			break;
 
+		case flashsrv_devctl_bitflips:
+			msg->o.err = flashsrv_devBitflips(msg->oid.id, idevctl, odevctl, msg->o.data, msg->o.size);
+			break;
+
 		default:
 			msg->o.err = -EINVAL;
 			break;
@@ -845,7 +1218,7 @@ static int flashsrv_parseOpts(int argc, char **argv, const char **fs, int *rootf
 	char *p, *partName;
 	int err, c;
 
-	while ((c = getopt(argc, argv, "r:p:")) != -1) {
+	while ((c = getopt(argc, argv, "r:p:s:")) != -1) {
 		switch (c) {
 			case 'r': /* fs_name:rootfs_part_id[:secondary_rootfs_part_id] */
 
@@ -889,6 +1262,10 @@ static int flashsrv_parseOpts(int argc, char **argv, const char **fs, int *rootf
 				}
 				break;
 
+			case 's': /* scrub quiet period [s], 0 disables scrubbing */
+				flashsrv_common.scrubIdle = strtoul(optarg, NULL, 10);
+				break;
+
 			default:
 				break;
 		}
@@ -1018,11 +1395,25 @@ int main(int argc, char **argv)
 		return EXIT_FAILURE;
 	}
 
+	/* Read / write / erase requests are scheduled per chip */
+	err = flashsrv_queuesInit();
+	if (err < 0) {
+		LOG_ERROR("failed to initialize request queues, err: %d", err);
+		return EXIT_FAILURE;
+	}
+
 	/* Based on args, create new partitions and get rootfs index */
+	flashsrv_common.scrubIdle = FLASHSRV_SCRUB_IDLE;
 	if (flashsrv_parseOpts(argc, argv, &fs, &rootfs1, &rootfs2) < 0) {
 		return EXIT_FAILURE;
 	}
 
+	err = flashsrv_scrubInit(strg);
+	if (err < 0) {
+		LOG_ERROR("failed to start scrubbing, err: %d", err);
+		return EXIT_FAILURE;
+	}
+
 	/* No partitions defined in args, check for partition table */
 	if (strg->parts == NULL) {
 		ptable = malloc(strg->dev->mtd->writesz);
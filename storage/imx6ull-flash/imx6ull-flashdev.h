@@ -18,6 +18,11 @@
 #include "imx6ull-flashdrv.h"
 
 
+/* Erase block bitflips statistics */
+#define FLASHDEV_FLIPS_UNKNOWN 0xff /* block hasn't been read since its erase */
+#define FLASHDEV_FLIPS_REFRESH 10   /* block should be rewritten (reads return -EUCLEAN) */
+
+
 /* Storage device context definition */
 typedef struct _storage_devCtx_t {
 	flashdrv_dma_t *dma;
@@ -27,6 +32,11 @@ typedef struct _storage_devCtx_t {
 } storage_devCtx_t;
 
 
+/* Returns max number of bitflips corrected by BCH in a page of erase block eb (absolute index)
+ * since the block was erased or FLASHDEV_FLIPS_UNKNOWN, negative value for invalid block */
+extern int flashdev_blockFlips(unsigned int eb);
+
+
 extern int flashdev_done(storage_t *strg);
 
 
@@ -15,6 +15,7 @@
 #ifndef _IMX6ULL_FLASHDRV_H_
 #define _IMX6ULL_FLASHDRV_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
 typedef struct _flashdrv_dma_t flashdrv_dma_t;
@@ -79,6 +80,21 @@ extern int flashdrv_write(flashdrv_dma_t *dma, uint32_t paddr, void *data, char
 extern int flashdrv_read(flashdrv_dma_t *dma, uint32_t paddr, void *data, flashdrv_meta_t *meta);
 
 
+/* Sequential page access: more != 0 announces that the next call accesses paddr + 1, which lets the chip
+ * load / program it (CACHE READ / CACHE PROGRAM) while this page is transferred. Sequence must be ended with
+ * more == 0, otherwise the next command waits for the chip to finish it. Used only if the chip supports it. */
+extern int flashdrv_writeseq(flashdrv_dma_t *dma, uint32_t paddr, void *data, char *metadata, int more);
+
+
+extern int flashdrv_readseq(flashdrv_dma_t *dma, uint32_t paddr, void *data, flashdrv_meta_t *meta, int more);
+
+
+/* Reads and decodes only the ECC chunks covering data bytes [offs, offs + len), rounded to 2 KiB subpages.
+ * Data lands at its page offset, meta->errors[] of the chunks not read are flash_no_errors and metadata
+ * is read only with the first subpage (0xff otherwise). */
+extern int flashdrv_readsub(flashdrv_dma_t *dma, uint32_t paddr, void *data, flashdrv_meta_t *meta, unsigned int offs, size_t len);
+
+
 extern int flashdrv_erase(flashdrv_dma_t *dma, uint32_t paddr);
 
 
@@ -88,6 +104,7 @@ extern int flashdrv_writeraw(flashdrv_dma_t *dma, uint32_t paddr, void *data, in
 extern int flashdrv_readraw(flashdrv_dma_t *dma, uint32_t paddr, void *data, int sz);
 
 
+/* Answered from the bad block table once flashdrv_init() loaded it, blocks reserved for the table are reported bad */
 extern int flashdrv_isbad(flashdrv_dma_t *dma, uint32_t paddr);
 
 
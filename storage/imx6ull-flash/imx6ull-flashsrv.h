@@ -21,7 +21,7 @@
 
 enum { flashsrv_devctl_info = 0, flashsrv_devctl_erase, flashsrv_devctl_writeraw, flashsrv_devctl_writemeta,
 	 flashsrv_devctl_readraw, flashsrv_devctl_readmeta, flashsrv_devctl_isbad, flashsrv_devctl_markbad, flashsrv_devctl_maxbitflips,
-	 flashsrv_devctl_readptable, flashsrv_devctl_writeptable };
+	 flashsrv_devctl_readptable, flashsrv_devctl_writeptable, flashsrv_devctl_bitflips };
 
 /* information about NAND flash configuration */
 typedef struct {
@@ -32,6 +32,16 @@ typedef struct {
 	uint32_t erasesz; /* erase block size in bytes (multiply of writesize) */
 } flashsrv_info_t;
 
+
+/* erase blocks bitflips statistics */
+#define FLASHSRV_FLIPS_BUCKETS 9
+
+typedef struct {
+	uint32_t hist[FLASHSRV_FLIPS_BUCKETS]; /* blocks by max corrected bitflips in a page: 0, 1-2, 3-4, ..., 15+ */
+	uint32_t unknown;                      /* blocks not read since their erase */
+	uint32_t refresh;                      /* blocks which should be rewritten */
+} flashsrv_bitflips_t;
+
 /* message to /dev/flashX   - chip operation - absolute address
  * message to /dev/flashXpY - partition operation - address relative to the beginning of the partition
  */
@@ -67,12 +77,20 @@ typedef struct {
 		struct {
 			uint32_t address; /* multiply of erasesz */
 		} maxbitflips;
+
+		/* bitflips: statistics of blocks read so far (by clients or background scrubbing), returns blocks count,
+		 * optional output data receives max bitflips per block (0xff - block not read since its erase) */
+		struct {
+			uint32_t address; /* multiply of erasesz */
+			uint32_t size;    /* multiply of erasesz, 0 == till the end of partition / device */
+		} bitflips;
 	};
 } __attribute__((packed)) flash_i_devctl_t;
 
 
-typedef struct {
-	flashsrv_info_t info; /* valid only for flashsrv_devctl_info */
+typedef union {
+	flashsrv_info_t info;         /* valid only for flashsrv_devctl_info */
+	flashsrv_bitflips_t bitflips; /* valid only for flashsrv_devctl_bitflips */
 } __attribute__((packed)) flash_o_devctl_t;
 
 #endif
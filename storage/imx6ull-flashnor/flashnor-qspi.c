@@ -49,9 +49,8 @@ static ssize_t flashnor_qspiRead(int ndev, off_t offs, void *buff, size_t buffle
 
 	(void)mutexLock(flashnor_common.lock);
 	for (len = 0; len < bufflen; len += res) {
-		/* Limit read size to QSPI_RXBUFSIZE to prevent buffer overflow in case of time quant end. */
-		/* TODO rewrite QSPI handler to use DMA. */
-		size = MIN(bufflen - len, QSPI_RXBUFSIZE);
+		/* Reads larger than QSPI_RXBUFSIZE go through AHB window, IP reads are limited to IPDATSZ */
+		size = MIN(bufflen - len, 0xffffu);
 		res = nor_readData(&dev->qspi, dev->port, offs + len, ((uint8_t *)buff) + len, size, dev->timeout);
 		if (res < 0) {
 			(void)mutexUnlock(flashnor_common.lock);
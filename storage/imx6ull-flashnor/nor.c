@@ -16,6 +16,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
+#include <unistd.h>
 
 #include "imx6ull-nor.h"
 
@@ -24,6 +25,10 @@
 #define LUT_SEQIDX(code)   (code)
 #define LUT_SEQNUM(code)   (0)
 
+/* Status poll intervals of erase operations in us */
+#define NOR_ERASE_POLL_US     1000
+#define NOR_CHIPERASE_POLL_US 10000
+
 static const char *nor_vendors[] = {
 	"\xef" " Winbond",
 	"\x20" " Micron",
@@ -92,22 +97,37 @@ int nor_readStatus(qspi_t *qspi, uint8_t port, uint8_t *statusByte, time_t timeo
 }
 
 
-int nor_waitBusy(qspi_t *qspi, uint8_t port, time_t timeout)
+static int nor_waitBusySleep(qspi_t *qspi, uint8_t port, time_t timeout, useconds_t interval)
 {
 	int res;
 	uint8_t status = 0;
 
-	do {
+	for (;;) {
 		res = nor_readStatus(qspi, port, &status, timeout);
 		if (res < EOK) {
 			return res;
 		}
-	} while ((status & 1) != 0);
+
+		if ((status & 1) == 0) {
+			break;
+		}
+
+		/* Erase takes tens of ms or more, don't occupy CPU and QSPI bus meanwhile */
+		if (interval != 0) {
+			usleep(interval);
+		}
+	}
 
 	return EOK;
 }
 
 
+int nor_waitBusy(qspi_t *qspi, uint8_t port, time_t timeout)
+{
+	return nor_waitBusySleep(qspi, port, timeout, 0);
+}
+
+
 int nor_writeEnable(qspi_t *qspi, uint8_t port, int enable, time_t timeout)
 {
 	struct xferOp xfer;
@@ -165,7 +185,7 @@ int nor_eraseSector(qspi_t *qspi, uint8_t port, addr_t addr, time_t timeout)
 		return res;
 	}
 
-	return nor_waitBusy(qspi, port, timeout);
+	return nor_waitBusySleep(qspi, port, timeout, NOR_ERASE_POLL_US);
 }
 
 
@@ -189,7 +209,7 @@ int nor_eraseBlock(qspi_t *qspi, uint8_t port, addr_t addr, time_t timeout)
 		return res;
 	}
 
-	return nor_waitBusy(qspi, port, timeout);
+	return nor_waitBusySleep(qspi, port, timeout, NOR_ERASE_POLL_US);
 }
 
 
@@ -213,7 +233,7 @@ int nor_eraseChip(qspi_t *qspi, uint8_t port, time_t timeout)
 		return res;
 	}
 
-	return nor_waitBusy(qspi, port, timeout);
+	return nor_waitBusySleep(qspi, port, timeout, NOR_CHIPERASE_POLL_US);
 }
 
 
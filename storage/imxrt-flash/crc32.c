@@ -0,0 +1,101 @@
+/*
+ * Phoenix-RTOS
+ *
+ * i.MX RT flash CRC32 (IEEE 802.3, reflected)
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <endian.h>
+
+#include "crc32.h"
+
+#define CRC32_POLY 0xedb88320
+
+/* CRC32 implementation: 0 - bitwise, 1 - byte lookup table (1 KB), 8 - slice-by-8 lookup tables (8 KB) */
+#ifndef IMXRT_FLASH_CRC32_TABLES
+#define IMXRT_FLASH_CRC32_TABLES 8
+#endif
+
+#if (IMXRT_FLASH_CRC32_TABLES != 0) && (IMXRT_FLASH_CRC32_TABLES != 1) && (IMXRT_FLASH_CRC32_TABLES != 8)
+#error "IMXRT_FLASH_CRC32_TABLES must be 0, 1 or 8"
+#endif
+
+
+#if IMXRT_FLASH_CRC32_TABLES > 0
+static uint32_t crc32Tab[IMXRT_FLASH_CRC32_TABLES][256];
+#endif
+
+
+void flash_crc32Init(void)
+{
+#if IMXRT_FLASH_CRC32_TABLES > 0
+	unsigned int i, j;
+	uint32_t crc32;
+
+	for (i = 0; i < 256; i++) {
+		crc32 = i;
+		for (j = 0; j < 8; j++) {
+			crc32 = (crc32 >> 1) ^ ((crc32 & 1) ? CRC32_POLY : 0);
+		}
+		crc32Tab[0][i] = crc32;
+	}
+
+	/* crc32Tab[j][i] - CRC of byte i followed by j zero bytes */
+	for (j = 1; j < IMXRT_FLASH_CRC32_TABLES; j++) {
+		for (i = 0; i < 256; i++) {
+			crc32 = crc32Tab[j - 1][i];
+			crc32Tab[j][i] = (crc32 >> 8) ^ crc32Tab[0][crc32 & 0xff];
+		}
+	}
+#endif
+}
+
+
+uint32_t flash_crc32Update(uint32_t crc32, const void *buff, size_t len)
+{
+	const uint8_t *data = buff;
+#if IMXRT_FLASH_CRC32_TABLES == 0
+	unsigned int i;
+
+	while (len--) {
+		crc32 ^= *data++;
+		for (i = 0; i < 8; i++) {
+			crc32 = (crc32 >> 1) ^ ((crc32 & 1) ? CRC32_POLY : 0);
+		}
+	}
+#else
+	uint32_t (*tab)[256] = crc32Tab;
+
+#if IMXRT_FLASH_CRC32_TABLES == 8
+	uint32_t lo, hi;
+
+	while ((len > 0) && (((uintptr_t)data & (sizeof(uint32_t) - 1)) != 0)) {
+		crc32 = (crc32 >> 8) ^ tab[0][(crc32 ^ *data++) & 0xff];
+		len--;
+	}
+
+	/* Slice-by-8: 8 bytes per iteration, 8 independent lookups */
+	while (len >= 8) {
+		lo = le32toh(*(const uint32_t *)data) ^ crc32;
+		hi = le32toh(*(const uint32_t *)(data + 4));
+
+		crc32 = tab[7][lo & 0xff] ^ tab[6][(lo >> 8) & 0xff] ^ tab[5][(lo >> 16) & 0xff] ^ tab[4][lo >> 24] ^
+			tab[3][hi & 0xff] ^ tab[2][(hi >> 8) & 0xff] ^ tab[1][(hi >> 16) & 0xff] ^ tab[0][hi >> 24];
+
+		data += 8;
+		len -= 8;
+	}
+#endif
+
+	while (len--) {
+		crc32 = (crc32 >> 8) ^ tab[0][(crc32 ^ *data++) & 0xff];
+	}
+#endif
+
+	return crc32;
+}
@@ -0,0 +1,28 @@
+/*
+ * Phoenix-RTOS
+ *
+ * i.MX RT flash CRC32 (IEEE 802.3, reflected)
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _IMXRT_FLASH_CRC32_H_
+#define _IMXRT_FLASH_CRC32_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/* Builds lookup tables, has to be called before flash_crc32Update() */
+void flash_crc32Init(void);
+
+
+/* Updates crc32 with data, no initial value or final XOR is applied (standard CRC32 is ~update(~0, ...)) */
+uint32_t flash_crc32Update(uint32_t crc32, const void *data, size_t len);
+
+
+#endif
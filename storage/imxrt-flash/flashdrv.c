@@ -14,6 +14,7 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "fspi.h"
@@ -24,6 +25,20 @@
 #define LOG_INFO(fmt, ...) printf("imxrt-flash: " fmt "\n", ##__VA_ARGS__);
 
 
+/* Read non-XIP memories through AHB window with prefetch, 0 - use IP commands only */
+#ifndef IMXRT_FLASH_AHB_READ
+#define IMXRT_FLASH_AHB_READ 1
+#endif
+
+/* Suspend sector erase / page program for reads, 0 - reads wait for completion */
+#ifndef IMXRT_FLASH_SUSPEND
+#define IMXRT_FLASH_SUSPEND 1
+#endif
+
+/* Erase / program progress guaranteed between suspends, so that constant reads don't starve it */
+#define FLASH_SUSPEND_MIN_RUN_MS 1
+
+
 static inline int get_sectorIdFromAddress(flash_context_t *ctx, uint32_t addr)
 {
 	return addr / ctx->properties.sector_size;
@@ -36,6 +51,101 @@ static inline addr_t get_sectorAddress(flash_context_t *ctx, uint32_t addr)
 }
 
 
+static time_t flash_timeMs(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (time_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+void flash_readRequest(flash_context_t *ctx, int inc)
+{
+	(void)__atomic_add_fetch(&ctx->readReqs, (inc > 0) ? 1 : -1, __ATOMIC_SEQ_CST);
+}
+
+
+/* Waits for started sector erase / page program, suspends it for waiting reads */
+static int flash_waitSuspendable(flash_context_t *ctx, uint32_t offset, size_t size)
+{
+	time_t resumed = flash_timeMs();
+	uint8_t status;
+	int res;
+
+	for (;;) {
+		res = nor_readStatus(&ctx->fspi, ctx->port, &status, ctx->timeout);
+		if (res < EOK) {
+			return res;
+		}
+
+		if ((status & 1) == 0) {
+			return EOK;
+		}
+
+		if ((ctx->suspendCap != 0) && (ctx->suspendYield != NULL) && (ctx->readReqs > 0) &&
+				((flash_timeMs() - resumed) >= FLASH_SUSPEND_MIN_RUN_MS)) {
+			res = nor_suspend(&ctx->fspi, ctx->port, ctx->timeout);
+			if (res < EOK) {
+				return res;
+			}
+
+			ctx->suspendAddr = offset;
+			ctx->suspendSize = size;
+			ctx->suspended = 1;
+			do {
+				ctx->suspendYield(ctx->suspendArg);
+			} while (ctx->readReqs > 0);
+			ctx->suspended = 0;
+
+			res = nor_resume(&ctx->fspi, ctx->port, ctx->timeout);
+			if (res < EOK) {
+				return res;
+			}
+
+			resumed = flash_timeMs();
+			continue;
+		}
+
+		flexspi_schedYield(&ctx->fspi);
+	}
+}
+
+
+static int flash_eraseSector(flash_context_t *ctx, uint32_t offset)
+{
+	int res = nor_eraseSectorStart(&ctx->fspi, ctx->port, offset, ctx->timeout);
+	if (res < EOK) {
+		return res;
+	}
+
+	return flash_waitSuspendable(ctx, offset, ctx->properties.sector_size);
+}
+
+
+static int flash_pageProgram(flash_context_t *ctx, uint32_t offset, const void *buff, size_t size)
+{
+	int res = nor_pageProgramStart(&ctx->fspi, ctx->port, offset, buff, size, ctx->timeout);
+	if (res < EOK) {
+		return res;
+	}
+
+	return flash_waitSuspendable(ctx, offset, size);
+}
+
+
+/* Data under suspended erase / program is undefined, overlapping read withdraws its request and waits for completion */
+static void flash_waitSuspendedRange(flash_context_t *ctx, uint32_t offset, size_t size)
+{
+	while ((ctx->suspended != 0) && (offset < ctx->suspendAddr + ctx->suspendSize) && (ctx->suspendAddr < offset + size)) {
+		flash_readRequest(ctx, -1);
+		ctx->suspendYield(ctx->suspendArg);
+		flash_readRequest(ctx, 1);
+	}
+}
+
+
 static int flash_isValidAddress(flash_context_t *context, addr_t addr, size_t size)
 {
 	if ((addr + size) <= context->properties.size) {
@@ -52,14 +162,31 @@ ssize_t flash_directRead(flash_context_t *ctx, uint32_t offset, void *buff, size
 		return -1;
 	}
 
+	flash_waitSuspendedRange(ctx, offset, size);
+
+	if (ctx->ahbRead != 0) {
+		return flexspi_ahbRead(&ctx->fspi, ctx->port, offset, buff, size);
+	}
+
 	return nor_readData(&ctx->fspi, ctx->port, offset, buff, size, ctx->timeout);
 }
 
 
+static int flash_ahbInvalidate(flash_context_t *ctx, uint32_t offset, size_t size)
+{
+	if (ctx->ahbRead == 0) {
+		return EOK;
+	}
+
+	return flexspi_ahbInvalidate(&ctx->fspi, ctx->port, offset, size);
+}
+
+
 ssize_t flash_directWrite(flash_context_t *ctx, uint32_t offset, const void *buff, size_t size)
 {
 	int err;
 	size_t chunk, len = size;
+	uint32_t start = offset;
 
 	while (len) {
 		chunk = ctx->properties.page_size - (offset & (ctx->properties.page_size - 1));
@@ -67,8 +194,9 @@ ssize_t flash_directWrite(flash_context_t *ctx, uint32_t offset, const void *buf
 			chunk = len;
 		}
 
-		err = nor_pageProgram(&ctx->fspi, ctx->port, offset, buff, chunk, ctx->timeout);
+		err = flash_pageProgram(ctx, offset, buff, chunk);
 		if (err < 0) {
+			(void)flash_ahbInvalidate(ctx, start, size - len);
 			return err;
 		}
 
@@ -77,6 +205,11 @@ ssize_t flash_directWrite(flash_context_t *ctx, uint32_t offset, const void *buf
 		buff = (char *)buff + chunk;
 	}
 
+	err = flash_ahbInvalidate(ctx, start, size);
+	if (err < 0) {
+		return err;
+	}
+
 	return size - len;
 }
 
@@ -106,7 +239,7 @@ static ssize_t bufferSync(flash_context_t *ctx, uint32_t dstAddr, int isLast)
 			return -EIO;
 		}
 
-		res = nor_readData(&ctx->fspi, ctx->port, get_sectorAddress(ctx, dstAddr), ctx->buff, ctx->properties.sector_size, ctx->timeout);
+		res = flash_directRead(ctx, get_sectorAddress(ctx, dstAddr), ctx->buff, ctx->properties.sector_size);
 		if (res < 0) {
 			return res;
 		}
@@ -206,15 +339,23 @@ ssize_t flash_bufferedWrite(flash_context_t *ctx, uint32_t dstAddr, const void *
 
 int flash_chipErase(flash_context_t *ctx)
 {
-	return nor_eraseChip(&ctx->fspi, ctx->port, ctx->timeout);
+	int res = nor_eraseChip(&ctx->fspi, ctx->port, ctx->timeout);
+	int err = flash_ahbInvalidate(ctx, 0, ctx->properties.size);
+
+	return (res < 0) ? res : err;
 }
 
 
 int flash_sectorErase(flash_context_t *ctx, uint32_t offset)
 {
+	int res, err;
+
 	offset &= ~(ctx->properties.sector_size - 1);
 
-	return nor_eraseSector(&ctx->fspi, ctx->port, offset, ctx->timeout);
+	res = flash_eraseSector(ctx, offset);
+	err = flash_ahbInvalidate(ctx, offset, ctx->properties.sector_size);
+
+	return (res < 0) ? res : err;
 }
 
 
@@ -243,7 +384,7 @@ int flash_sync(flash_context_t *ctx)
 
 	/* ... then erase may be skipped */
 	if (pos != ctx->properties.sector_size) {
-		res = nor_eraseSector(&ctx->fspi, ctx->port, sectorAddr, ctx->timeout);
+		res = flash_eraseSector(ctx, sectorAddr);
 		if (res < 0) {
 			return res;
 		}
@@ -262,16 +403,17 @@ int flash_sync(flash_context_t *ctx)
 			continue;
 		}
 
-		res = nor_pageProgram(&ctx->fspi, ctx->port, sectorAddr + ofs, ctx->buff + ofs, ctx->properties.page_size, ctx->timeout);
+		res = flash_pageProgram(ctx, sectorAddr + ofs, ctx->buff + ofs, ctx->properties.page_size);
 		if (res < 0) {
 			return res;
 		}
 	}
 
-	/* FIXME: unable to call e.g.: hal_cpuInvCache(hal_cpuDCache, sectorAddr, ctx->properties.sector_size); from userspace,
-	 * but FlexSPI driver use IP bus for read and write operations, so it's not necessary to invalidate cache, until it comes
-	 * to AHB reads during XIP which is cached, and the cache should be invalidated.
-	 */
+	/* IP commands bypass AHB buffers and D-cache, drop the stale sector from them */
+	res = flash_ahbInvalidate(ctx, sectorAddr, ctx->properties.sector_size);
+	if (res < 0) {
+		return res;
+	}
 
 	ctx->isDirty = 0;
 
@@ -320,7 +462,15 @@ int flash_init(flash_context_t *ctx)
 
 	ctx->prevAddr = (uint32_t)-1;
 	ctx->isDirty = 0;
+	ctx->ahbRead = 0;
 	ctx->buff = NULL;
+	ctx->suspendCap = 0;
+	ctx->suspended = 0;
+	ctx->suspendAddr = 0;
+	ctx->suspendSize = 0;
+	ctx->readReqs = 0;
+	ctx->suspendYield = NULL;
+	ctx->suspendArg = NULL;
 
 	res = flash_defineFlexSPI(ctx);
 	if (res < 0) {
@@ -347,6 +497,16 @@ int flash_init(flash_context_t *ctx)
 	ctx->fspi.slFlashSz[ctx->port] = pInfo->totalSz;
 	ctx->buff = buff;
 
+	/* AHB buffers of XIP memory can't be flushed safely after program / erase, keep IP reads there */
+	if ((IMXRT_FLASH_AHB_READ != 0) && (ctx->fspi.xip == 0)) {
+		flexspi_ahbPrefetch(&ctx->fspi);
+		ctx->ahbRead = 1;
+	}
+
+	if ((IMXRT_FLASH_SUSPEND != 0) && (nor_suspendInit(&ctx->fspi, pInfo->jedecId) == EOK)) {
+		ctx->suspendCap = 1;
+	}
+
 	return res;
 }
 
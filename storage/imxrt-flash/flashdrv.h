@@ -34,6 +34,7 @@ typedef struct {
 	flexspi_t fspi;
 	uint8_t port;
 	uint8_t isDirty;
+	uint8_t ahbRead; /* reads through memory mapped AHB window instead of IP commands */
 
 	uint32_t address;
 	time_t timeout;
@@ -41,6 +42,15 @@ typedef struct {
 	uint32_t prevAddr;
 
 	uint8_t *buff;
+
+	/* Erase / program suspend for reads, see flash_readRequest() */
+	uint8_t suspendCap;
+	volatile uint8_t suspended;
+	uint32_t suspendAddr; /* range of the suspended erase / program */
+	size_t suspendSize;
+	volatile int readReqs;
+	void (*suspendYield)(void *arg); /* called with erase / program suspended, lets the waiting reads run */
+	void *suspendArg;
 } flash_context_t;
 
 
@@ -59,6 +69,12 @@ ssize_t flash_bufferedWrite(flash_context_t *ctx, uint32_t offset, const void *b
 int flash_sync(flash_context_t *ctx);
 
 
+/* Announces read waiting for the memory (inc > 0) or its completion (inc < 0). Sector erase or page program
+ * in progress is suspended and ctx->suspendYield() is called until there are no more waiting reads. Reads
+ * overlapping the suspended range wait in flash_directRead() until the operation completes. */
+void flash_readRequest(flash_context_t *ctx, int inc);
+
+
 int flash_chipErase(flash_context_t *ctx);
 
 
@@ -28,6 +28,7 @@
 #include <ptable.h>
 #include <board_config.h>
 
+#include "crc32.h"
 #include "fspi.h"
 #include "flashdrv.h"
 #include "imxrt-flashsrv.h"
@@ -42,6 +43,9 @@
 #define THREAD_STACKSZ    1024
 #define FLASH_MEMORIES_NO (FLEXSPI_COUNT)
 
+/* Partition table is read with a single flash access if it fits in PTABLE_READSZ bytes */
+#define PTABLE_READSZ 512
+
 #ifndef IMXRT_FLASH_PRIO
 /*
  * Threads/processes including and below this priority must be run only from RAM to avoid preempting imxrt-flash
@@ -171,21 +175,6 @@ static int flashsrv_chipErase(uint8_t fID)
 }
 
 
-static uint32_t flashsrv_crc32Update(uint32_t crc32, const uint8_t *data, size_t len)
-{
-	unsigned int i;
-
-	while (len--) {
-		crc32 ^= *data++;
-		for (i = 0; i < 8; i++) {
-			crc32 = (crc32 >> 1) ^ ((crc32 & 1) ? 0xedb88320 : 0);
-		}
-	}
-
-	return crc32;
-}
-
-
 static int flashsrv_calcCrc32(uint8_t fID, size_t offset, size_t len, uint32_t *crc32)
 {
 	flashsrv_memory_t *mem;
@@ -207,7 +196,7 @@ static int flashsrv_calcCrc32(uint8_t fID, size_t offset, size_t len, uint32_t *
 			return res;
 		}
 
-		tmp = flashsrv_crc32Update(tmp, buf, res);
+		tmp = flash_crc32Update(tmp, buf, res);
 
 		offset += res;
 		len -= res;
@@ -285,6 +274,52 @@ static int flashsrv_fsEraseSectorf1(struct _meterfs_devCtx_t *devCtx, off_t offs
 }
 
 
+/*
+ * Memory locking: reads suspend sector erase / page program in progress (see flash_readRequest()).
+ * A read announces itself before taking the lock, the erase / program owner suspends the operation
+ * and hands the lock over in flashsrv_suspendYield() until no reads are announced. Reads overlapping
+ * the suspended range withdraw and wait in flash_directRead(), other requests can't modify the memory
+ * and hand the lock back until the operation completes. storage/gr716-flash uses the same scheme.
+ */
+
+static void flashsrv_suspendYield(void *arg)
+{
+	flashsrv_memory_t *memory = (flashsrv_memory_t *)arg;
+
+	/* Erase / program owner holds the lock, hand it over to the waiting reads */
+	mutexUnlock(memory->lock);
+	mutexLock(memory->lock);
+}
+
+
+static void flashsrv_lock(flashsrv_memory_t *memory, bool read)
+{
+	if (read) {
+		flash_readRequest(&memory->ctx, 1);
+		mutexLock(memory->lock);
+		return;
+	}
+
+	mutexLock(memory->lock);
+
+	/* Memory can't be modified while erase / program is suspended, let its owner continue */
+	while (memory->ctx.suspended != 0) {
+		mutexUnlock(memory->lock);
+		mutexLock(memory->lock);
+	}
+}
+
+
+static void flashsrv_unlock(flashsrv_memory_t *memory, bool read)
+{
+	if (read) {
+		flash_readRequest(&memory->ctx, -1);
+	}
+
+	mutexUnlock(memory->lock);
+}
+
+
 static inline bool hasAccess(flashsrv_partition_t *part, pid_t pid)
 {
 	return part->authProcPid == 0 || part->authProcPid == pid;
@@ -502,7 +537,15 @@ static void flashsrv_rawCtl(flashsrv_memory_t *memory, msg_t *msg)
 }
 
 
-/* Threads */
+/* Threads
+ *
+ * Each flash memory is served independently: it has its own lock, device port with flashsrv_devThread(),
+ * raw partitions port with flashsrv_rawThread() and a flashsrv_meterfsThread() per meterfs partition.
+ * Memories sit on separate FlexSPI controllers (see flash_defineFlexSPI()), so erase or program on one
+ * of them never holds requests to the other. Don't share locks or workers between memories. */
+
+static int flashsrv_initMeterfs(flashsrv_partition_t *part);
+
 
 static void flashsrv_meterfsThread(void *arg)
 {
@@ -514,12 +557,26 @@ static void flashsrv_meterfsThread(void *arg)
 	meterfs_i_devctl_t *idevctl = (meterfs_i_devctl_t *)msg.i.raw;
 	meterfs_o_devctl_t *odevctl = (meterfs_o_devctl_t *)msg.o.raw;
 
+	/* Partition's device is already visible, requests wait in its port until meterfs is initialized */
+	if (flashsrv_initMeterfs(part) < 0) {
+		LOG_ERROR("imxrt-flashsrv: partition %s at flash %u is not mounted.", part->pHeader->name, part->fID);
+		part->pStatus = flashsrv_memory_inactive;
+		free(part->fsCtx);
+		part->fsCtx = NULL;
+	}
+
 	for (;;) {
 		if (msgRecv(part->oid.port, &msg, &rid) < 0) {
 			continue;
 		}
 
-		mutexLock(flashsrv_common.flash_memories[part->fID].lock);
+		if (part->fsCtx == NULL) {
+			msg.o.err = -ENODEV;
+			msgRespond(part->oid.port, &msg, rid);
+			continue;
+		}
+
+		flashsrv_lock(&flashsrv_common.flash_memories[part->fID], msg.type == mtRead);
 
 		switch (msg.type) {
 			case mtRead:
@@ -553,7 +610,7 @@ static void flashsrv_meterfsThread(void *arg)
 				break;
 		}
 
-		mutexUnlock(flashsrv_common.flash_memories[part->fID].lock);
+		flashsrv_unlock(&flashsrv_common.flash_memories[part->fID], msg.type == mtRead);
 
 		msgRespond(part->oid.port, &msg, rid);
 	}
@@ -586,6 +643,7 @@ static void flashsrv_rawThread(void *arg)
 	msg_t msg;
 	msg_rid_t rid;
 	uint32_t beginAddr;
+	bool read;
 
 	flashsrv_memory_t *memory = (flashsrv_memory_t *)arg;
 
@@ -594,7 +652,8 @@ static void flashsrv_rawThread(void *arg)
 			continue;
 		}
 
-		mutexLock(memory->lock);
+		read = (msg.type == mtRead);
+		flashsrv_lock(memory, read);
 
 		if (msg.oid.id >= memory->pCnt) {
 			msg.o.err = -EINVAL;
@@ -664,7 +723,7 @@ static void flashsrv_rawThread(void *arg)
 			}
 		}
 
-		mutexUnlock(memory->lock);
+		flashsrv_unlock(memory, read);
 
 		msgRespond(memory->rawPort, &msg, rid);
 	}
@@ -675,6 +734,7 @@ static void flashsrv_devThread(void *arg)
 {
 	msg_t msg;
 	msg_rid_t rid;
+	bool read;
 
 	flashsrv_memory_t *memory = (flashsrv_memory_t *)arg;
 
@@ -683,7 +743,8 @@ static void flashsrv_devThread(void *arg)
 			continue;
 		}
 
-		mutexLock(memory->lock);
+		read = (msg.type == mtRead);
+		flashsrv_lock(memory, read);
 		switch (msg.type) {
 			case mtRead:
 				msg.o.err = flashsrv_bufferedRead(memory->fOid.id, msg.i.io.offs, msg.o.data, msg.o.size);
@@ -721,7 +782,7 @@ static void flashsrv_devThread(void *arg)
 				break;
 		}
 
-		mutexUnlock(memory->lock);
+		flashsrv_unlock(memory, read);
 
 		msgRespond(memory->fOid.port, &msg, rid);
 	}
@@ -760,9 +821,9 @@ static int flashsrv_initMeterfs(flashsrv_partition_t *part)
 
 	ctx->keyInit = false;
 
-	mutexLock(flashsrv_common.flash_memories[part->fID].lock);
+	flashsrv_lock(&flashsrv_common.flash_memories[part->fID], false);
 	res = meterfs_init(ctx);
-	mutexUnlock(flashsrv_common.flash_memories[part->fID].lock);
+	flashsrv_unlock(&flashsrv_common.flash_memories[part->fID], false);
 
 	if (res < 0) {
 		LOG_ERROR("imxrt-flashsrv: init meterfs at flash: %u, partition: %u.", part->fID, part->oid.id);
@@ -782,13 +843,8 @@ static int flashsrv_mountPart(flashsrv_partition_t *part)
 	snprintf(path, sizeof(path), "/dev/flash%u.%s", part->fID, part->pHeader->name);
 
 	switch (part->pHeader->type) {
-		/* Each meterfs partition is handled by separate thread */
+		/* Each meterfs partition is handled by separate thread, which also initializes it */
 		case ptable_meterfs:
-			res = flashsrv_initMeterfs(part);
-			if (res < 0) {
-				return res;
-			}
-
 			res = portCreate(&part->oid.port);
 			if (res < 0) {
 				LOG_ERROR("imxrt-flashsrv: portCreate %s - err: %d", path, res);
@@ -845,39 +901,48 @@ static int flashsrv_mountPart(flashsrv_partition_t *part)
 
 static ptable_t *flashsrv_ptableRead(flashsrv_memory_t *memory)
 {
-	ptable_t *ptable;
-	uint32_t offs, count, size;
-	uint8_t magic[sizeof(ptable_magic)];
+	ptable_t *ptable, *tmp;
+	uint32_t offs, count, size, readsz;
 
-	/* Read number of partitions */
+	/* Read number of partitions along with the beginning of the table */
 	offs = memory->ctx.properties.size - memory->ctx.properties.sector_size;
-	if (flash_directRead(&memory->ctx, offs, &count, sizeof(count)) != sizeof(count)) {
-		return NULL;
-	}
-	count = le32toh(count);
+	readsz = (memory->ctx.properties.sector_size < PTABLE_READSZ) ? memory->ctx.properties.sector_size : PTABLE_READSZ;
 
-	/* Verify partition table size */
-	size = ptable_size(count);
-	if (size > memory->ctx.properties.sector_size) {
+	ptable = malloc(readsz);
+	if (ptable == NULL) {
 		return NULL;
 	}
 
-	/* Read magic signature */
-	if (flash_directRead(&memory->ctx, offs + size - sizeof(magic), magic, sizeof(magic)) != sizeof(magic)) {
+	if (flash_directRead(&memory->ctx, offs, ptable, readsz) != readsz) {
+		free(ptable);
 		return NULL;
 	}
+	count = le32toh(ptable->count);
 
-	/* Verify magic signature */
-	if (memcmp(magic, ptable_magic, sizeof(magic)) != 0) {
+	/* Verify partition table size */
+	size = ptable_size(count);
+	if (size > memory->ctx.properties.sector_size) {
+		free(ptable);
 		return NULL;
 	}
 
-	ptable = malloc(size);
-	if (ptable == NULL) {
-		return NULL;
+	/* Read the rest of the table only if it didn't fit */
+	if (size > readsz) {
+		tmp = realloc(ptable, size);
+		if (tmp == NULL) {
+			free(ptable);
+			return NULL;
+		}
+		ptable = tmp;
+
+		if (flash_directRead(&memory->ctx, offs + readsz, (uint8_t *)ptable + readsz, size - readsz) != size - readsz) {
+			free(ptable);
+			return NULL;
+		}
 	}
 
-	if (flash_directRead(&memory->ctx, offs, ptable, size) != size) {
+	/* Verify magic signature */
+	if (memcmp((uint8_t *)ptable + size - sizeof(ptable_magic), ptable_magic, sizeof(ptable_magic)) != 0) {
 		free(ptable);
 		return NULL;
 	}
@@ -932,7 +997,10 @@ static int flashsrv_partsInit(void)
 			}
 		}
 
+		/* Meterfs partitions may be initializing already */
+		flashsrv_lock(memory, false);
 		res = flash_sync(&memory->ctx);
+		flashsrv_unlock(memory, false);
 		if (res < 0) {
 			return res;
 		}
@@ -996,6 +1064,8 @@ static int flashsrv_flashMemoriesInit(void)
 
 		err = flash_init(&memory->ctx);
 		if (err == EOK) {
+			memory->ctx.suspendYield = flashsrv_suspendYield;
+			memory->ctx.suspendArg = memory;
 			memory->fStatus = flashsrv_memory_active;
 		}
 		else {
@@ -1078,6 +1148,8 @@ int main(int argc, char **argv)
 
 	priority(IMXRT_FLASH_PRIO);
 
+	flash_crc32Init();
+
 	if (flashsrv_flashMemoriesInit() != EOK) {
 		LOG_ERROR("imxrt-flashsrv: flash memories were not initialized correctly.\n");
 		return EXIT_FAILURE;
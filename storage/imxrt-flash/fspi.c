@@ -17,6 +17,7 @@
 #include <string.h>
 #include <sys/types.h>
 #include <sys/time.h>
+#include <sys/platform.h>
 #include <unistd.h>
 #include "fspi.h"
 
@@ -229,8 +230,7 @@ ssize_t flexspi_xferExec(flexspi_t *fspi, struct xferOp *xfer)
 	if (xfer->op == xfer_opRead) {
 		/* For >64k read out the data directly from the AHB buffer (data may be cached) */
 		if (xfer->data.read.sz > 0xffffu) {
-			memcpy(xfer->data.read.ptr, fspi->ahbAddr + xfer->addr, xfer->data.read.sz);
-			return (ssize_t)xfer->data.read.sz;
+			return flexspi_ahbRead(fspi, xfer->port, xfer->addr, xfer->data.read.ptr, xfer->data.read.sz);
 		}
 
 		dataSize = xfer->data.read.sz & 0xffffu;
@@ -296,3 +296,76 @@ ssize_t flexspi_xferExec(flexspi_t *fspi, struct xferOp *xfer)
 
 	return flexspi_checkFlags(fspi);
 }
+
+
+void flexspi_lutSet(flexspi_t *fspi, uint8_t seqIdx, const uint32_t *lut)
+{
+	unsigned int i;
+
+	/* Unlock LUT */
+	*(fspi->base + lutkey) = 0x5af05af0u;
+	*(fspi->base + lutcr) = 2u;
+
+	for (i = 0u; i < 4u; ++i) {
+		*(fspi->base + lut64 + 4u * (seqIdx & 0xfu) + i) = lut[i];
+	}
+
+	/* Lock LUT */
+	*(fspi->base + lutkey) = 0x5af05af0u;
+	*(fspi->base + lutcr) = 1u;
+}
+
+
+ssize_t flexspi_ahbRead(flexspi_t *fspi, uint8_t port, uint32_t addr, void *ptr, size_t sz)
+{
+	memcpy(ptr, fspi->ahbAddr + flexspi_getAddressByPort(fspi, port, addr), sz);
+
+	return (ssize_t)sz;
+}
+
+
+void flexspi_ahbPrefetch(flexspi_t *fspi)
+{
+	unsigned int i;
+
+	for (i = 0u; i < FLEXSPI_AHBRXBUF_COUNT; ++i) {
+		*(fspi->base + ahbrxbuf0cr0 + i) |= 1u << 31u;
+	}
+
+	*(fspi->base + ahbcr) |= 1u << 5u;
+}
+
+
+int flexspi_ahbInvalidate(flexspi_t *fspi, uint8_t port, uint32_t addr, size_t sz)
+{
+	platformctl_t pctl;
+	int res;
+
+	/* Don't touch AHB buffers used for code fetch, XIP reads below may return stale data until they're reused */
+	if (fspi->xip == 0) {
+		res = flexspi_poll(fspi, fspi->base + sts0, 3u, 3u, flexspi_timerGetMillis(), 1000, 0);
+		if (res != EOK) {
+			return res;
+		}
+
+#if defined(__CPU_IMXRT117X)
+		/* Clear AHB RX buffers */
+		*(fspi->base + ahbcr) |= 1u << 1u;
+		*(fspi->base + ahbcr) &= ~(1u << 1u);
+#else
+		/* No AHB buffers clear on this FlexSPI version, software reset flushes them, configuration is preserved */
+		*(fspi->base + mcr0) |= 1u;
+		res = flexspi_poll(fspi, fspi->base + mcr0, 1u, 0u, flexspi_timerGetMillis(), 1000, 0);
+		if (res != EOK) {
+			return res;
+		}
+#endif
+	}
+
+	pctl.action = pctl_set;
+	pctl.type = pctl_cleanInvalDCache;
+	pctl.cleanInvalDCache.addr = fspi->ahbAddr + flexspi_getAddressByPort(fspi, port, addr);
+	pctl.cleanInvalDCache.sz = sz;
+
+	return platformctl(&pctl);
+}
@@ -27,8 +27,14 @@ enum { flexspi_slBusA1 = 0x1, flexspi_slBusA2 = 0x2, flexspi_slBusB1 = 0x4, flex
 /* Select particular slave bus during xferExec */
 enum { flexspi_portA1 = 0, flexspi_portA2, flexspi_portB1, flexspi_portB2 };
 
+/* LUT instructions */
+enum { flexspi_lutStop = 0x00, flexspi_lutCmdSdr = 0x01 };
+
 /* clang-format on */
 
+#define FLEXSPI_LUT_INSTR(opcode, pads, operand) ((((opcode) & 0x3fu) << 10u) | (((pads) & 0x3u) << 8u) | ((operand) & 0xffu))
+#define FLEXSPI_LUT_WORD(instr0, instr1)         (((uint32_t)(instr1) << 16u) | (uint32_t)(instr0))
+
 
 #if defined(__CPU_IMXRT106X)
 
@@ -36,6 +42,8 @@ enum { flexspi_portA1 = 0, flexspi_portA2, flexspi_portB1, flexspi_portB2 };
 #define FLEXSPI_COUNT 2
 #endif
 
+#define FLEXSPI_AHBRXBUF_COUNT 4
+
 #define FLEXSPI1_BASE     ((addr_t)0x402a8000)
 #define FLEXSPI2_BASE     ((addr_t)0x402a4000)
 #define FLEXSPI1_AHB_ADDR ((addr_t)0x60000000)
@@ -66,6 +74,8 @@ enum { flexspi_portA1 = 0, flexspi_portA2, flexspi_portB1, flexspi_portB2 };
 #define FLEXSPI_COUNT 1
 #endif
 
+#define FLEXSPI_AHBRXBUF_COUNT 8
+
 #define FLEXSPI1_BASE     ((addr_t)0x400cc000)
 #define FLEXSPI2_BASE     ((addr_t)0x400d0000)
 #define FLEXSPI1_AHB_ADDR ((addr_t)0x30000000)
@@ -155,4 +165,20 @@ static inline void flexspi_schedYield(flexspi_t *fspi)
 extern ssize_t flexspi_xferExec(flexspi_t *fspi, struct xferOp *xfer);
 
 
+/* Program LUT sequence seqIdx (4 words), used for commands not configured by plo */
+extern void flexspi_lutSet(flexspi_t *fspi, uint8_t seqIdx, const uint32_t *lut);
+
+
+/* Read data through the AHB (memory mapped) window */
+extern ssize_t flexspi_ahbRead(flexspi_t *fspi, uint8_t port, uint32_t addr, void *ptr, size_t sz);
+
+
+/* Enable prefetch of consecutive data to AHB RX buffers (buffers are configured by plo) */
+extern void flexspi_ahbPrefetch(flexspi_t *fspi);
+
+
+/* Drop stale AHB RX buffers and D-cache lines after the range has been programmed or erased using IP commands */
+extern int flexspi_ahbInvalidate(flexspi_t *fspi, uint8_t port, uint32_t addr, size_t sz);
+
+
 #endif /* _FLEXSPI_H_ */
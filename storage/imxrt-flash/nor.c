@@ -157,7 +157,7 @@ int nor_writeEnable(flexspi_t *fspi, uint8_t port, int enable, time_t timeout)
 }
 
 
-int nor_eraseSector(flexspi_t *fspi, uint8_t port, addr_t addr, time_t timeout)
+int nor_eraseSectorStart(flexspi_t *fspi, uint8_t port, addr_t addr, time_t timeout)
 {
 	struct xferOp xfer;
 
@@ -173,7 +173,13 @@ int nor_eraseSector(flexspi_t *fspi, uint8_t port, addr_t addr, time_t timeout)
 	xfer.seqIdx = LUT_SEQIDX(fspi_eraseSector);
 	xfer.seqNum = LUT_SEQNUM(fspi_eraseSector);
 
-	res = flexspi_xferExec(fspi, &xfer);
+	return flexspi_xferExec(fspi, &xfer);
+}
+
+
+int nor_eraseSector(flexspi_t *fspi, uint8_t port, addr_t addr, time_t timeout)
+{
+	int res = nor_eraseSectorStart(fspi, port, addr, timeout);
 	if (res < EOK) {
 		return res;
 	}
@@ -207,7 +213,7 @@ int nor_eraseChip(flexspi_t *fspi, uint8_t port, time_t timeout)
 }
 
 
-int nor_pageProgram(flexspi_t *fspi, uint8_t port, addr_t dstAddr, const void *src, size_t pageSz, time_t timeout)
+int nor_pageProgramStart(flexspi_t *fspi, uint8_t port, addr_t dstAddr, const void *src, size_t pageSz, time_t timeout)
 {
 	struct xferOp xfer;
 
@@ -227,14 +233,87 @@ int nor_pageProgram(flexspi_t *fspi, uint8_t port, addr_t dstAddr, const void *s
 
 	res = flexspi_xferExec(fspi, &xfer);
 
+	return (res < EOK) ? res : EOK;
+}
+
+
+int nor_pageProgram(flexspi_t *fspi, uint8_t port, addr_t dstAddr, const void *src, size_t pageSz, time_t timeout)
+{
+	int res = nor_pageProgramStart(fspi, port, dstAddr, src, pageSz, timeout);
+	if (res < EOK) {
+		return res;
+	}
+
+	return nor_waitBusy(fspi, port, timeout);
+}
+
+
+static int nor_command(flexspi_t *fspi, uint8_t port, int seqCode, time_t timeout)
+{
+	struct xferOp xfer;
+
+	xfer.op = xfer_opCommand;
+	xfer.port = port;
+	xfer.timeout = timeout;
+	xfer.addr = 0;
+	xfer.seqIdx = LUT_SEQIDX(seqCode);
+	xfer.seqNum = LUT_SEQNUM(seqCode);
+
+	return flexspi_xferExec(fspi, &xfer);
+}
+
+
+int nor_suspendInit(flexspi_t *fspi, uint32_t jedecId)
+{
+	uint32_t lut[4] = { 0 };
+	uint8_t suspend, resume;
+
+	switch (jedecId & 0xff) {
+		case 0xef: /* Winbond */
+		case 0x20: /* Micron */
+		case 0x9d: /* ISSI */
+			suspend = 0x75;
+			resume = 0x7a;
+			break;
+
+		case 0xc2: /* Macronix */
+			suspend = 0xb0;
+			resume = 0x30;
+			break;
+
+		default:
+			return -ENOTSUP;
+	}
+
+	lut[0] = FLEXSPI_LUT_WORD(FLEXSPI_LUT_INSTR(flexspi_lutCmdSdr, 0, suspend), FLEXSPI_LUT_INSTR(flexspi_lutStop, 0, 0));
+	flexspi_lutSet(fspi, fspi_suspend, lut);
+
+	lut[0] = FLEXSPI_LUT_WORD(FLEXSPI_LUT_INSTR(flexspi_lutCmdSdr, 0, resume), FLEXSPI_LUT_INSTR(flexspi_lutStop, 0, 0));
+	flexspi_lutSet(fspi, fspi_resume, lut);
+
+	return EOK;
+}
+
+
+int nor_suspend(flexspi_t *fspi, uint8_t port, time_t timeout)
+{
+	int res = nor_command(fspi, port, fspi_suspend, timeout);
 	if (res < EOK) {
 		return res;
 	}
 
+	/* WIP clears after tSUS, when memory accepts reads */
 	return nor_waitBusy(fspi, port, timeout);
 }
 
 
+int nor_resume(flexspi_t *fspi, uint8_t port, time_t timeout)
+{
+	/* Resume is ignored if erase / program finished before it was suspended */
+	return nor_command(fspi, port, fspi_resume, timeout);
+}
+
+
 ssize_t nor_readData(flexspi_t *fspi, uint8_t port, addr_t addr, void *data, size_t size, time_t timeout)
 {
 	struct xferOp xfer;
@@ -54,6 +54,9 @@ enum { fspi_readData,
 	fspi_eraseChip,
 	fspi_programQPP,
 	fspi_readID,
+	/* Not configured by plo, programmed by nor_suspendInit() */
+	fspi_suspend = 14,
+	fspi_resume = 15,
 };
 
 
@@ -78,6 +81,24 @@ extern int nor_eraseChip(flexspi_t *fspi, uint8_t port, time_t timeout);
 extern int nor_pageProgram(flexspi_t *fspi, uint8_t port, addr_t dstAddr, const void *src, size_t pageSz, time_t timeout);
 
 
+/* Starts sector erase / page program, completion is left to the caller (nor_waitBusy() or suspend / resume) */
+extern int nor_eraseSectorStart(flexspi_t *fspi, uint8_t port, addr_t addr, time_t timeout);
+
+
+extern int nor_pageProgramStart(flexspi_t *fspi, uint8_t port, addr_t dstAddr, const void *src, size_t pageSz, time_t timeout);
+
+
+/* Programs erase / program suspend and resume commands for the memory, -ENOTSUP if unknown */
+extern int nor_suspendInit(flexspi_t *fspi, uint32_t jedecId);
+
+
+/* Suspends erase / program in progress, returns when memory is ready for reads */
+extern int nor_suspend(flexspi_t *fspi, uint8_t port, time_t timeout);
+
+
+extern int nor_resume(flexspi_t *fspi, uint8_t port, time_t timeout);
+
+
 extern ssize_t nor_readData(flexspi_t *fspi, uint8_t port, addr_t addr, void *data, size_t size, time_t timeout);
 
 
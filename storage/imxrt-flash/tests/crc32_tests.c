@@ -0,0 +1,124 @@
+/*
+ * Phoenix-RTOS
+ *
+ * i.MX RT flash CRC32 tests
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "../crc32.h"
+
+
+#define LOG_ERROR(str, ...) do { fprintf(stderr, __FILE__  ":%d error: " str "\n", __LINE__, ##__VA_ARGS__); } while (0)
+
+#define CRC32_TEST_BUFSZ 64
+
+
+/* Bitwise reference, independent of the lookup tables */
+static uint32_t crc32_reference(const uint8_t *data, size_t len)
+{
+	uint32_t crc32 = 0xffffffff;
+	unsigned int i;
+
+	while (len--) {
+		crc32 ^= *data++;
+		for (i = 0; i < 8; i++) {
+			crc32 = (crc32 >> 1) ^ ((crc32 & 1) ? 0xedb88320 : 0);
+		}
+	}
+
+	return ~crc32;
+}
+
+
+static void crc32_fill(uint8_t *buff, size_t len)
+{
+	uint32_t x = 0x12345678;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		x = x * 1103515245 + 12345;
+		buff[i] = x >> 24;
+	}
+}
+
+
+int test_crc32_knownAnswer(void)
+{
+	static const char check[] = "123456789";
+	uint32_t crc32;
+
+	flash_crc32Init();
+
+	crc32 = ~flash_crc32Update(0xffffffff, check, sizeof(check) - 1);
+	if (crc32 != 0xcbf43926) {
+		LOG_ERROR("CRC32(\"123456789\") = 0x%08x, expected 0xcbf43926", (unsigned int)crc32);
+		return -1;
+	}
+
+	/* Empty buffer leaves the value unchanged */
+	if (flash_crc32Update(0xffffffff, check, 0) != 0xffffffff) {
+		LOG_ERROR("zero length update changed CRC");
+		return -1;
+	}
+
+	return EOK;
+}
+
+
+/* Every start alignment and odd / even length through the slice-by-8 head, body and tail paths */
+int test_crc32_unalignedOddLength(void)
+{
+	static uint8_t buff[CRC32_TEST_BUFSZ + 8] __attribute__((aligned(8)));
+	uint32_t crc32, ref;
+	size_t offs, len;
+
+	flash_crc32Init();
+	crc32_fill(buff, sizeof(buff));
+
+	for (offs = 0; offs < 8; offs++) {
+		for (len = 0; len <= CRC32_TEST_BUFSZ; len++) {
+			ref = crc32_reference(buff + offs, len);
+			crc32 = ~flash_crc32Update(0xffffffff, buff + offs, len);
+			if (crc32 != ref) {
+				LOG_ERROR("offs %zu len %zu: CRC32 0x%08x, expected 0x%08x", offs, len, (unsigned int)crc32, (unsigned int)ref);
+				return -1;
+			}
+		}
+	}
+
+	return EOK;
+}
+
+
+/* Updates split at any point give the same result as a single update */
+int test_crc32_chained(void)
+{
+	static uint8_t buff[CRC32_TEST_BUFSZ + 1];
+	uint32_t crc32, ref;
+	size_t split;
+
+	flash_crc32Init();
+	crc32_fill(buff, sizeof(buff));
+	ref = crc32_reference(buff + 1, CRC32_TEST_BUFSZ);
+
+	for (split = 0; split <= CRC32_TEST_BUFSZ; split++) {
+		crc32 = flash_crc32Update(0xffffffff, buff + 1, split);
+		crc32 = ~flash_crc32Update(crc32, buff + 1 + split, CRC32_TEST_BUFSZ - split);
+		if (crc32 != ref) {
+			LOG_ERROR("split %zu: CRC32 0x%08x, expected 0x%08x", split, (unsigned int)crc32, (unsigned int)ref);
+			return -1;
+		}
+	}
+
+	return EOK;
+}
@@ -41,6 +41,14 @@ int main(int argc, char **argv)
 	TEST_CASE(write_pTable(INTERNAL_FLASH_PATH));
 #endif
 
+	/* No flash access */
+	TEST_CATEGORY("CRC32 TESTS");
+
+	TEST_CASE(test_crc32_knownAnswer());
+	TEST_CASE(test_crc32_unalignedOddLength());
+	TEST_CASE(test_crc32_chained());
+
+
 #if TESTS_INTERNAL_FLASH_DRIVER
 	TEST_CATEGORY("FLASHDRV TESTS: internal flash");
 
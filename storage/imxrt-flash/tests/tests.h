@@ -42,6 +42,12 @@ extern int test_flashdrv_iterativeRead(uint32_t addr);
 extern int test_flashdrv_eraseChip(uint32_t addr);
 
 
+/* CRC32 tests */
+extern int test_crc32_knownAnswer(void);
+extern int test_crc32_unalignedOddLength(void);
+extern int test_crc32_chained(void);
+
+
 /* Flashsrv tests */
 extern int test_flashsrv_getFlashProperties(void);
 extern int test_flashsrv_writeAndReadFlashPage(void);
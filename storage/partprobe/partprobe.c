@@ -0,0 +1,460 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Partition table probing (MBR with extended partitions, GPT)
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "partprobe.h"
+
+
+#define MBR_MAGIC_OFFS 0x1fe
+#define MBR_PENT_OFFS  0x1be
+#define MBR_PENT_SIZE  16
+#define MBR_PENTS      4
+
+#define MBR_TYPE_PROTECTIVE 0xee
+
+/* Extended partition chain length limit, guards against loops */
+#define EBR_MAX 64
+
+#define GPT_SIG         "EFI PART"
+#define GPT_HDR_MIN     92
+#define GPT_ENTRY_MIN   128
+#define GPT_ENTRIES_MAX 1024
+#define GPT_ENTRIES_LBA 2
+
+/* Size of the usual GPT entries array (128 x 128 bytes) read together with the headers */
+#define GPT_ARRAY_SIZE 16384
+
+
+static const uint8_t gptLinux[16] = { 0xaf, 0x3d, 0xc6, 0x0f, 0x83, 0x84, 0x72, 0x47, 0x8e, 0x79, 0x3d, 0x69, 0xd8, 0x47, 0x7d, 0xe4 };
+static const uint8_t gptBasic[16] = { 0xa2, 0xa0, 0xd0, 0xeb, 0xe5, 0xb9, 0x33, 0x44, 0x87, 0xc0, 0x68, 0xb6, 0xb7, 0x26, 0x99, 0xc7 };
+static const uint8_t gptEfi[16] = { 0x28, 0x73, 0x2a, 0xc1, 0x1f, 0xf8, 0xd2, 0x11, 0xba, 0x4b, 0x00, 0xa0, 0xc9, 0x3e, 0xc9, 0x3b };
+
+
+static struct {
+	struct {
+		int valid;
+		uint32_t key;
+		unsigned int sectorsz;
+		uint64_t sectors;
+		partprobe_table_t table;
+	} cache[PARTPROBE_CACHE_SIZE];
+	unsigned int next; /* Cache slot replaced next */
+} partprobe_common;
+
+
+static uint32_t partprobe_le32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+
+static uint64_t partprobe_le64(const uint8_t *p)
+{
+	return (uint64_t)partprobe_le32(p) | ((uint64_t)partprobe_le32(p + 4) << 32);
+}
+
+
+static uint32_t partprobe_crc32(const uint8_t *buff, size_t len)
+{
+	uint32_t crc = 0xffffffffu;
+	size_t i;
+	int j;
+
+	for (i = 0; i < len; i++) {
+		crc ^= buff[i];
+		for (j = 0; j < 8; j++) {
+			crc = (crc >> 1) ^ (0xedb88320u & -(crc & 1));
+		}
+	}
+
+	return ~crc;
+}
+
+
+static int partprobe_isZero(const uint8_t *buff, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		if (buff[i] != 0) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+
+static int partprobe_isExtended(uint8_t type)
+{
+	return ((type == 0x05) || (type == 0x0f) || (type == 0x85)) ? 1 : 0;
+}
+
+
+static int partprobe_read(partprobe_read_t read, void *arg, uint64_t lba, unsigned int sectorsz, void *buff, size_t len)
+{
+	ssize_t ret = read(arg, (off_t)(lba * sectorsz), buff, len);
+
+	if (ret < 0) {
+		return (int)ret;
+	}
+
+	return ((size_t)ret == len) ? EOK : -EIO;
+}
+
+
+static int partprobe_add(partprobe_table_t *table, uint64_t start, uint64_t sectors, uint64_t total, uint8_t type, int logical, const uint8_t *guid)
+{
+	partprobe_part_t *part;
+
+	if ((sectors == 0) || ((total != 0) && ((start >= total) || (sectors > total - start)))) {
+		/* Empty or out of the device, skip */
+		return EOK;
+	}
+
+	if (table->nparts == PARTPROBE_MAX_PARTS) {
+		return -ENOSPC;
+	}
+
+	part = &table->parts[table->nparts++];
+	part->start = start;
+	part->sectors = sectors;
+	part->type = type;
+	part->logical = (uint8_t)logical;
+	if (guid != NULL) {
+		memcpy(part->guid, guid, sizeof(part->guid));
+	}
+	else {
+		memset(part->guid, 0, sizeof(part->guid));
+	}
+
+	return EOK;
+}
+
+
+/* Follows the extended partition chain, entry offsets are relative to the extended partition start */
+static int partprobe_ebr(partprobe_read_t read, void *arg, unsigned int sectorsz, uint64_t total, uint64_t extStart, uint8_t *buff, partprobe_table_t *table)
+{
+	uint64_t ebr = extStart;
+	const uint8_t *pent;
+	unsigned int i;
+	int err;
+
+	for (i = 0; i < EBR_MAX; i++) {
+		err = partprobe_read(read, arg, ebr, sectorsz, buff, sectorsz);
+		if (err < 0) {
+			return err;
+		}
+
+		if ((buff[MBR_MAGIC_OFFS] != 0x55) || (buff[MBR_MAGIC_OFFS + 1] != 0xaa)) {
+			return EOK;
+		}
+
+		/* First entry - logical partition relative to this EBR */
+		pent = buff + MBR_PENT_OFFS;
+		if ((pent[4] != 0) && !partprobe_isExtended(pent[4])) {
+			err = partprobe_add(table, ebr + partprobe_le32(pent + 8), partprobe_le32(pent + 12), total, pent[4], 1, NULL);
+			if (err < 0) {
+				return err;
+			}
+		}
+
+		/* Second entry - next EBR */
+		pent += MBR_PENT_SIZE;
+		if (!partprobe_isExtended(pent[4]) || (partprobe_le32(pent + 8) == 0)) {
+			return EOK;
+		}
+		ebr = extStart + partprobe_le32(pent + 8);
+	}
+
+	return EOK;
+}
+
+
+static int partprobe_mbr(partprobe_read_t read, void *arg, unsigned int sectorsz, uint64_t total, uint8_t *buff, partprobe_table_t *table)
+{
+	uint8_t pents[MBR_PENTS * MBR_PENT_SIZE];
+	const uint8_t *pent;
+	unsigned int i;
+	int err;
+
+	/* buff is reused for the EBRs */
+	memcpy(pents, buff + MBR_PENT_OFFS, sizeof(pents));
+	table->scheme = partprobe_schemeMbr;
+
+	for (i = 0; i < MBR_PENTS; i++) {
+		pent = pents + i * MBR_PENT_SIZE;
+		if (pent[4] == 0) {
+			continue;
+		}
+
+		if (partprobe_isExtended(pent[4])) {
+			err = partprobe_ebr(read, arg, sectorsz, total, partprobe_le32(pent + 8), buff, table);
+		}
+		else {
+			err = partprobe_add(table, partprobe_le32(pent + 8), partprobe_le32(pent + 12), total, pent[4], 0, NULL);
+		}
+
+		if (err < 0) {
+			return err;
+		}
+	}
+
+	return EOK;
+}
+
+
+static uint8_t partprobe_gptType(const uint8_t *guid)
+{
+	if (memcmp(guid, gptLinux, sizeof(gptLinux)) == 0) {
+		return partprobe_typeLinux;
+	}
+
+	if (memcmp(guid, gptBasic, sizeof(gptBasic)) == 0) {
+		return partprobe_typeFat32;
+	}
+
+	if (memcmp(guid, gptEfi, sizeof(gptEfi)) == 0) {
+		return partprobe_typeEfi;
+	}
+
+	return partprobe_typeOther;
+}
+
+
+/* Validates GPT header in hdr (one sector), returns entries array size or 0 if invalid */
+static size_t partprobe_gptHeader(uint8_t *hdr, unsigned int sectorsz, uint64_t lba, uint64_t *entriesLba)
+{
+	uint32_t hdrsz = partprobe_le32(hdr + 12), crc = partprobe_le32(hdr + 16);
+	uint32_t nentries = partprobe_le32(hdr + 80), entrysz = partprobe_le32(hdr + 84);
+	uint8_t saved[4];
+
+	if ((memcmp(hdr, GPT_SIG, 8) != 0) || (hdrsz < GPT_HDR_MIN) || (hdrsz > sectorsz) || (partprobe_le64(hdr + 24) != lba)) {
+		return 0;
+	}
+
+	memcpy(saved, hdr + 16, sizeof(saved));
+	memset(hdr + 16, 0, sizeof(saved));
+	if (partprobe_crc32(hdr, hdrsz) != crc) {
+		memcpy(hdr + 16, saved, sizeof(saved));
+		return 0;
+	}
+	memcpy(hdr + 16, saved, sizeof(saved));
+
+	if ((entrysz < GPT_ENTRY_MIN) || ((entrysz % 8) != 0) || (nentries == 0) || (nentries > GPT_ENTRIES_MAX)) {
+		return 0;
+	}
+
+	*entriesLba = partprobe_le64(hdr + 72);
+
+	return (size_t)nentries * entrysz;
+}
+
+
+static int partprobe_gptEntries(const uint8_t *hdr, const uint8_t *entries, uint64_t total, partprobe_table_t *table)
+{
+	uint32_t nentries = partprobe_le32(hdr + 80), entrysz = partprobe_le32(hdr + 84);
+	const uint8_t *e;
+	uint64_t first, last;
+	uint32_t i;
+	int err;
+
+	if (partprobe_crc32(entries, (size_t)nentries * entrysz) != partprobe_le32(hdr + 88)) {
+		return -EBADMSG;
+	}
+
+	table->scheme = partprobe_schemeGpt;
+	table->nparts = 0;
+
+	for (i = 0; i < nentries; i++) {
+		e = entries + (size_t)i * entrysz;
+		if (partprobe_isZero(e, 16)) {
+			continue;
+		}
+
+		first = partprobe_le64(e + 32);
+		last = partprobe_le64(e + 40);
+		if (last < first) {
+			continue;
+		}
+
+		err = partprobe_add(table, first, last - first + 1, total, partprobe_gptType(e), 0, e);
+		if (err < 0) {
+			return err;
+		}
+	}
+
+	return EOK;
+}
+
+
+/* Tries GPT header at lba, its entries are taken from buff when they're within the first len bytes */
+static int partprobe_gpt(partprobe_read_t read, void *arg, unsigned int sectorsz, uint64_t total, uint64_t lba, uint8_t *buff, size_t len, partprobe_table_t *table)
+{
+	uint8_t *hdr, *entries, *tmp = NULL;
+	uint64_t entriesLba;
+	size_t size;
+	int err;
+
+	if ((lba + 1) * sectorsz <= len) {
+		hdr = buff + lba * sectorsz;
+	}
+	else {
+		tmp = malloc(sectorsz);
+		if (tmp == NULL) {
+			return -ENOMEM;
+		}
+
+		err = partprobe_read(read, arg, lba, sectorsz, tmp, sectorsz);
+		if (err < 0) {
+			free(tmp);
+			return err;
+		}
+		hdr = tmp;
+	}
+
+	size = partprobe_gptHeader(hdr, sectorsz, lba, &entriesLba);
+	if (size == 0) {
+		free(tmp);
+		return -EBADMSG;
+	}
+
+	if ((entriesLba * sectorsz + size) <= len) {
+		err = partprobe_gptEntries(hdr, buff + entriesLba * sectorsz, total, table);
+	}
+	else if ((entries = malloc(size)) == NULL) {
+		err = -ENOMEM;
+	}
+	else {
+		err = partprobe_read(read, arg, entriesLba, sectorsz, entries, size);
+		if (err == EOK) {
+			err = partprobe_gptEntries(hdr, entries, total, table);
+		}
+		free(entries);
+	}
+
+	free(tmp);
+
+	return err;
+}
+
+
+int partprobe_scan(partprobe_read_t read, void *arg, unsigned int sectorsz, uint64_t sectors, partprobe_table_t *table)
+{
+	size_t len = (size_t)GPT_ENTRIES_LBA * sectorsz + GPT_ARRAY_SIZE;
+	unsigned int i;
+	uint8_t *buff;
+	int err, gpt = 0;
+
+	table->scheme = partprobe_schemeNone;
+	table->nparts = 0;
+
+	if ((sectorsz < 512) || ((sectorsz & (sectorsz - 1)) != 0)) {
+		return -EINVAL;
+	}
+
+	/* MBR, GPT header and the entries array at once */
+	if ((sectors != 0) && (len > sectors * sectorsz)) {
+		len = sectors * sectorsz;
+	}
+	len -= len % sectorsz;
+
+	buff = malloc(len);
+	if (buff == NULL) {
+		return -ENOMEM;
+	}
+
+	err = partprobe_read(read, arg, 0, sectorsz, buff, len);
+	if (err < 0) {
+		free(buff);
+		return err;
+	}
+
+	if ((buff[MBR_MAGIC_OFFS] != 0x55) || (buff[MBR_MAGIC_OFFS + 1] != 0xaa)) {
+		free(buff);
+		return EOK;
+	}
+
+	for (i = 0; i < MBR_PENTS; i++) {
+		if (buff[MBR_PENT_OFFS + i * MBR_PENT_SIZE + 4] == MBR_TYPE_PROTECTIVE) {
+			gpt = 1;
+		}
+	}
+
+	if (gpt != 0) {
+		err = partprobe_gpt(read, arg, sectorsz, sectors, 1, buff, len, table);
+		if ((err == -EBADMSG) && (sectors > 1)) {
+			/* Primary table damaged, try the backup one */
+			err = partprobe_gpt(read, arg, sectorsz, sectors, sectors - 1, buff, len, table);
+		}
+		if (err == -EBADMSG) {
+			/* No valid GPT, nothing to report for a protective MBR */
+			table->scheme = partprobe_schemeNone;
+			table->nparts = 0;
+			err = EOK;
+		}
+	}
+	else {
+		err = partprobe_mbr(read, arg, sectorsz, sectors, buff, table);
+	}
+
+	free(buff);
+
+	return err;
+}
+
+
+int partprobe_scanCached(uint32_t key, partprobe_read_t read, void *arg, unsigned int sectorsz, uint64_t sectors, partprobe_table_t *table)
+{
+	unsigned int i;
+	int err;
+
+	for (i = 0; i < PARTPROBE_CACHE_SIZE; i++) {
+		if ((partprobe_common.cache[i].valid != 0) && (partprobe_common.cache[i].key == key)) {
+			if ((partprobe_common.cache[i].sectorsz == sectorsz) && (partprobe_common.cache[i].sectors == sectors)) {
+				*table = partprobe_common.cache[i].table;
+				return EOK;
+			}
+			partprobe_common.cache[i].valid = 0;
+		}
+	}
+
+	err = partprobe_scan(read, arg, sectorsz, sectors, table);
+	if (err < 0) {
+		return err;
+	}
+
+	i = partprobe_common.next;
+	partprobe_common.next = (i + 1) % PARTPROBE_CACHE_SIZE;
+	partprobe_common.cache[i].valid = 1;
+	partprobe_common.cache[i].key = key;
+	partprobe_common.cache[i].sectorsz = sectorsz;
+	partprobe_common.cache[i].sectors = sectors;
+	partprobe_common.cache[i].table = *table;
+
+	return EOK;
+}
+
+
+void partprobe_invalidate(uint32_t key)
+{
+	unsigned int i;
+
+	for (i = 0; i < PARTPROBE_CACHE_SIZE; i++) {
+		if (partprobe_common.cache[i].key == key) {
+			partprobe_common.cache[i].valid = 0;
+		}
+	}
+}
@@ -0,0 +1,79 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Partition table probing (MBR with extended partitions, GPT)
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _PARTPROBE_H_
+#define _PARTPROBE_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+
+/* Maximum number of partitions reported */
+#ifndef PARTPROBE_MAX_PARTS
+#define PARTPROBE_MAX_PARTS 16
+#endif
+
+/* Number of devices remembered by partprobe_scanCached() */
+#ifndef PARTPROBE_CACHE_SIZE
+#define PARTPROBE_CACHE_SIZE 4
+#endif
+
+
+enum { partprobe_schemeNone = 0, partprobe_schemeMbr, partprobe_schemeGpt };
+
+
+/* MBR partition types reported for the known GPT partition types */
+enum {
+	partprobe_typeFat32 = 0x0c,
+	partprobe_typeLinux = 0x83,
+	partprobe_typeEfi = 0xef,
+	partprobe_typeOther = 0xda, /* Unknown GPT type (non-FS data) */
+};
+
+
+typedef struct {
+	uint64_t start;   /* First sector (LBA) */
+	uint64_t sectors; /* Number of sectors */
+	uint8_t type;     /* MBR partition type, GPT types are mapped to the closest MBR one */
+	uint8_t logical;  /* MBR logical partition (from the extended partition chain) */
+	uint8_t guid[16]; /* GPT partition type GUID (on-disk byte order), zeros for MBR */
+} partprobe_part_t;
+
+
+typedef struct {
+	unsigned int scheme; /* partprobe_scheme* */
+	unsigned int nparts;
+	partprobe_part_t parts[PARTPROBE_MAX_PARTS];
+} partprobe_table_t;
+
+
+/* Reads len bytes at byte offset offs, returns number of bytes read */
+typedef ssize_t (*partprobe_read_t)(void *arg, off_t offs, void *buff, size_t len);
+
+
+/* Probes the partition table. MBR, GPT header and the usual GPT entries area are read in one request,
+ * further reads are needed only for the extended partition chain, a relocated entries array or the backup GPT.
+ * sectors - device size used to validate entries and locate the backup GPT (0 - unknown).
+ * Returns EOK (also with scheme partprobe_schemeNone if there is no valid table) or negative error code. */
+extern int partprobe_scan(partprobe_read_t read, void *arg, unsigned int sectorsz, uint64_t sectors, partprobe_table_t *table);
+
+
+/* partprobe_scan() with the result remembered under key (e.g. device number), while the device size matches.
+ * The cache isn't locked, callers serialize partition discovery. */
+extern int partprobe_scanCached(uint32_t key, partprobe_read_t read, void *arg, unsigned int sectorsz, uint64_t sectors, partprobe_table_t *table);
+
+
+/* Forgets the cached table, e.g. on media change or after repartitioning */
+extern void partprobe_invalidate(uint32_t key);
+
+
+#endif
@@ -21,6 +21,9 @@
 
 #include <sys/io.h>
 #include <sys/list.h>
+#include <sys/minmax.h>
+#include <sys/mman.h>
+#include <sys/interrupt.h>
 #include <sys/threads.h>
 
 #include <sys/platform.h>
@@ -28,7 +31,10 @@
 
 #include "ata.h"
 
-#define ATA_SECTORSZ_MAX 4096 /* Max supported sector size */
+#define ATA_SECTORSZ_MAX 4096                           /* Max supported sector size */
+#define ATA_MAXXFER      (256 * 512)                    /* Max transfer length per command */
+#define ATA_PRDT_SIZE    (_PAGE_SIZE / sizeof(ata_prd_t)) /* Number of PRD table entries */
+#define ATA_DMA_TIMEOUT  (5 * 1000 * 1000)              /* DMA transfer completion timeout (us) */
 
 
 ata_common_t ata_common;
@@ -160,9 +166,28 @@ static int ata_wait(ata_bus_t *bus, uint8_t clear, uint8_t set, uint8_t err)
 }
 
 
+/* Sets transfer mode, returns 1 if the device aborted the command */
+static int ata_setmode(ata_bus_t *bus, uint8_t mode)
+{
+	void *base = bus->base;
+	int err;
+
+	/* Write features - set transfer mode */
+	ata_writereg(base, REG_FEATURES, 0x03, 1);
+	ata_writereg(base, REG_NSECTORS, mode, 1);
+
+	/* Send set features command */
+	ata_writereg(base, REG_CMD, CMD_SET_FEATUERS, 1);
+	/* Wait until BSY clears (ignore error status bit) */
+	if ((err = ata_wait(bus, STATUS_BSY, 0, STATUS_DF)) < 0)
+		return err;
+
+	return (ata_readreg(base, REG_STATUS, 1) & STATUS_ERR) ? 1 : 0;
+}
+
+
 static int ata_select(ata_dev_t *dev, uint64_t lba, uint16_t sectors, uint8_t mode)
 {
-	static ata_dev_t *ldev = NULL;
 	ata_bus_t *bus = dev->bus;
 	void *base = bus->base;
 	uint16_t c = 0, h = 0, s = 0;
@@ -186,25 +211,28 @@ static int ata_select(ata_dev_t *dev, uint64_t lba, uint16_t sectors, uint8_t mo
 		break;
 	}
 
-	if (dev != ldev) {
+	if (dev != bus->sel) {
 		/* Select the device */
 		ata_writereg(base, REG_DEVSEL, (h & 0xff) | (dev == bus->devs[SLAVE]) * DEVSEL_DEVNUM | DEVSEL_SET0 | DEVSEL_SET1, 1);
 		/* Wait for the device to push its status onto the bus */
 		ata_delay(bus);
 
-		/* Write features - set PIO mode */
-		ata_writereg(base, REG_FEATURES, 0x03, 1);
-		ata_writereg(base, REG_NSECTORS, dev->pio, 1);
-
-		/* Send set features command */
-		ata_writereg(base, REG_CMD, CMD_SET_FEATUERS, 1);
-		/* Wait until BSY clears (ignore error status bit) */
-		if ((err = ata_wait(bus, STATUS_BSY, 0, STATUS_DF)) < 0)
+		/* Set PIO mode */
+		if ((err = ata_setmode(bus, dev->pio)) < 0)
 			return err;
 
-		/* Don't update ldev on device initialization */
+		/* Set UDMA mode, fall back to PIO if the device rejects it */
+		if (dev->udma != UDMA_NONE) {
+			if ((err = ata_setmode(bus, dev->udma)) < 0)
+				return err;
+
+			if (err > 0)
+				dev->udma = UDMA_NONE;
+		}
+
+		/* Don't update bus->sel on device initialization */
 		if (mode != -1)
-			ldev = dev;
+			bus->sel = dev;
 	}
 
 	/* Write other registers */
@@ -223,41 +251,65 @@ static int ata_select(ata_dev_t *dev, uint64_t lba, uint16_t sectors, uint8_t mo
 }
 
 
+/* Transfers PIO data block */
+static void ata_piodata(void *base, uint8_t *buff, size_t len, uint8_t dir)
+{
+	uintptr_t port = ((uintptr_t)base & ~0x3) + REG_DATA;
+	size_t n = len / 2, j;
+	uint16_t data;
+
+	if ((uintptr_t)base & 0x1) {
+		/* Move the whole block with string IO */
+		switch (dir) {
+		case READ:
+			__asm__ volatile ("cld; rep insw" : "+D" (buff), "+c" (n) : "d" ((uint16_t)port) : "memory");
+			break;
+
+		case WRITE:
+			__asm__ volatile ("cld; rep outsw" : "+S" (buff), "+c" (n) : "d" ((uint16_t)port) : "memory");
+			break;
+		}
+		return;
+	}
+
+	switch (dir) {
+	case READ:
+		for (j = 0; j < len; j += 2) {
+			data = (uint16_t)ata_readreg(base, REG_DATA, 2);
+			buff[j + 0] = (data >> 0) & 0xff;
+			buff[j + 1] = (data >> 8) & 0xff;
+		}
+		break;
+
+	case WRITE:
+		for (j = 0; j < len; j += 2) {
+			data  = buff[j + 0] << 0;
+			data |= buff[j + 1] << 8;
+			ata_writereg(base, REG_DATA, data, 2);
+		}
+		break;
+	}
+}
+
+
 static ssize_t ata_pio(ata_dev_t *dev, uint16_t sectors, uint8_t *buff, uint8_t dir)
 {
 	ata_bus_t *bus = dev->bus;
 	void *base = bus->base;
 	ssize_t ret = 0;
-	uint16_t data, i;
-	uint32_t j;
+	uint16_t i, n;
 	int err;
 
-	for (i = 0; i < sectors; i++) {
+	/* Device requests data in blocks of dev->multiple sectors (last one may be shorter) */
+	for (i = 0; i < sectors; i += n) {
+		n = min(dev->multiple, sectors - i);
+
 		/* Wait until BSY clears and DRQ sets */
 		if ((err = ata_wait(bus, STATUS_BSY, STATUS_DRQ, STATUS_ERR | STATUS_DF)) < 0)
 			return err;
 
-		switch (dir) {
-		case READ:
-			/* Read one sector */
-			for (j = 0; j < dev->sectorsz; j += 2) {
-				data = (uint16_t)ata_readreg(base, REG_DATA, 2);
-				(buff + ret)[j + 0] = (data >> 0) & 0xff;
-				(buff + ret)[j + 1] = (data >> 8) & 0xff;
-			}
-			break;
-
-		case WRITE:
-			/* Write one sector */
-			for (j = 0; j < dev->sectorsz; j += 2) {
-				data  = (buff + ret)[j + 0] << 0;
-				data |= (buff + ret)[j + 1] << 8;
-				ata_writereg(base, REG_DATA, data, 2);
-			}
-			break;
-		}
-
-		ret += dev->sectorsz;
+		ata_piodata(base, buff + ret, (size_t)n * dev->sectorsz, dir);
+		ret += (size_t)n * dev->sectorsz;
 	}
 
 	/* Wait until DRQ clears and RDY sets */
@@ -268,11 +320,215 @@ static ssize_t ata_pio(ata_dev_t *dev, uint16_t sectors, uint8_t *buff, uint8_t
 }
 
 
+/* Returns READ/WRITE MULTIPLE counterpart of the PIO command */
+static uint8_t ata_multcmd(uint8_t cmd)
+{
+	switch (cmd) {
+	case CMD_READ_PIO:
+		return CMD_READ_MULT;
+
+	case CMD_READ_PIO_EXT:
+		return CMD_READ_MULT_EXT;
+
+	case CMD_WRITE_PIO:
+		return CMD_WRITE_MULT;
+
+	case CMD_WRITE_PIO_EXT:
+		return CMD_WRITE_MULT_EXT;
+	}
+
+	return cmd;
+}
+
+
+static int ata_irqHandler(unsigned int n, void *arg)
+{
+	ata_bus_t *bus = (ata_bus_t *)arg;
+	uint8_t status = (uint8_t)ata_readreg(bus->bmbase, BM_STATUS, 1);
+
+	(void)n;
+
+	/* Shared interrupt line, not our device */
+	if (!(status & BMSTATUS_IRQ))
+		return -1;
+
+	/* Acknowledge device interrupt and clear bus master interrupt/error bits */
+	ata_readreg(bus->base, REG_STATUS, 1);
+	ata_writereg(bus->bmbase, BM_STATUS, status, 1);
+	bus->irqStatus = status;
+
+	return 1;
+}
+
+
+/* Returns DMA counterpart of the PIO command or CMD_NOP if the transfer can't use DMA */
+static uint8_t ata_dmacmd(ata_dev_t *dev, uint8_t cmd, const uint8_t *buff)
+{
+	/* PRD regions must be word aligned */
+	if ((dev->udma == UDMA_NONE) || (dev->bus->bmbase == NULL) || ((uintptr_t)buff & 0x1))
+		return CMD_NOP;
+
+	switch (cmd) {
+	case CMD_READ_PIO:
+		return CMD_READ_DMA;
+
+	case CMD_READ_PIO_EXT:
+		return CMD_READ_DMA_EXT;
+
+	case CMD_WRITE_PIO:
+		return CMD_WRITE_DMA;
+
+	case CMD_WRITE_PIO_EXT:
+		return CMD_WRITE_DMA_EXT;
+	}
+
+	return CMD_NOP;
+}
+
+
+/* Builds PRD table describing the buffer pages */
+static int ata_prdt(ata_bus_t *bus, uint8_t *buff, size_t len)
+{
+	ata_prd_t *prd = NULL;
+	size_t chunk, rlen = 0;
+	unsigned int n = 0;
+	addr_t pa;
+
+	while (len > 0) {
+		pa = va2pa(buff);
+		chunk = _PAGE_SIZE - ((uintptr_t)buff & (_PAGE_SIZE - 1));
+		if (chunk > len)
+			chunk = len;
+
+		/* Extend current region if physically contiguous and within the same 64 KB window */
+		if ((prd != NULL) && (prd->addr + rlen == pa) && (pa & 0xffff)) {
+			rlen += chunk;
+		}
+		else {
+			if (n == ATA_PRDT_SIZE)
+				return -E2BIG;
+
+			prd = bus->prdt + n++;
+			prd->addr = (uint32_t)pa;
+			prd->flags = 0;
+			rlen = chunk;
+		}
+		prd->len = (uint16_t)rlen;
+
+		buff += chunk;
+		len -= chunk;
+	}
+
+	if (prd == NULL)
+		return -EINVAL;
+
+	prd->flags = PRD_EOT;
+
+	return EOK;
+}
+
+
+static ssize_t ata_dma(ata_dev_t *dev, uint16_t sectors, uint8_t cmd, uint8_t *buff, uint8_t dir)
+{
+	ata_bus_t *bus = dev->bus;
+	void *bmbase = bus->bmbase;
+	size_t len = (size_t)sectors * dev->sectorsz;
+	uint8_t bmcmd = (dir == READ) ? BMCMD_READ : 0;
+	uint8_t status;
+	int err;
+
+	if ((err = ata_prdt(bus, buff, len)) < 0)
+		return err;
+
+	/* Stop the engine, clear interrupt/error bits and load the PRD table */
+	ata_writereg(bmbase, BM_CMD, bmcmd, 1);
+	ata_writereg(bmbase, BM_STATUS, ata_readreg(bmbase, BM_STATUS, 1) | BMSTATUS_IRQ | BMSTATUS_ERR, 1);
+	ata_writereg(bmbase, BM_PRDT, (uint32_t)bus->prdtPhys, 4);
+
+	mutexLock(bus->irqLock);
+	bus->irqStatus = 0;
+	mutexUnlock(bus->irqLock);
+
+	/* Enable device interrupt, send the command and start the engine */
+	ata_writereg(bus->ctrl, REG_CTRL, 0, 1);
+	ata_writereg(bus->base, REG_CMD, cmd, 1);
+	ata_writereg(bmbase, BM_CMD, bmcmd | BMCMD_START, 1);
+
+	/* Wait for the completion interrupt */
+	mutexLock(bus->irqLock);
+	while (!bus->irqStatus) {
+		if (condWait(bus->irqCond, bus->irqLock, ATA_DMA_TIMEOUT) == -ETIME)
+			break;
+	}
+	status = bus->irqStatus;
+	mutexUnlock(bus->irqLock);
+
+	/* Stop the engine and mask device interrupt again */
+	ata_writereg(bmbase, BM_CMD, bmcmd, 1);
+	ata_writereg(bus->ctrl, REG_CTRL, CTRL_NIEN, 1);
+
+	if (!status) {
+		/* Don't retry DMA on unresponsive device */
+		dev->udma = UDMA_NONE;
+		return -ETIMEDOUT;
+	}
+
+	if (status & BMSTATUS_ERR)
+		return -EIO;
+
+	/* Wait until BSY and DRQ clear and RDY sets */
+	if ((err = ata_wait(bus, STATUS_BSY | STATUS_DRQ, STATUS_RDY, STATUS_ERR | STATUS_DF)) < 0)
+		return err;
+
+	return len;
+}
+
+
+static int _ata_flush(ata_dev_t *dev)
+{
+	ata_bus_t *bus = dev->bus;
+	int err;
+
+	/* Wait until BSY clears (ignore error status bit) */
+	if ((err = ata_wait(bus, STATUS_BSY, 0, STATUS_DF)) < 0)
+		return err;
+
+	if ((err = ata_select(dev, 0, 0, dev->mode)) < 0)
+		return err;
+
+	/* Flush the hardware cache and wait for completion */
+	ata_writereg(bus->base, REG_CMD, (dev->mode == LBA48) ? CMD_CACHE_FLUSH_EXT : CMD_CACHE_FLUSH, 1);
+	if ((err = ata_wait(bus, STATUS_BSY, STATUS_RDY, STATUS_ERR | STATUS_DF)) < 0)
+		return -EIO;
+
+	dev->dirty = 0;
+
+	return EOK;
+}
+
+
 static ssize_t _ata_access(ata_dev_t *dev, uint64_t lba, uint16_t sectors, uint8_t cmd, uint8_t *buff)
 {
 	ata_bus_t *bus = dev->bus;
 	void *base = bus->base;
+	uint8_t dir, dmacmd;
 	ssize_t ret;
+	int err;
+
+	switch (cmd) {
+	case CMD_READ_PIO:
+	case CMD_READ_PIO_EXT:
+		dir = READ;
+		break;
+
+	case CMD_WRITE_PIO:
+	case CMD_WRITE_PIO_EXT:
+		dir = WRITE;
+		break;
+
+	default:
+		return -EINVAL;
+	}
 
 	/* Wait until BSY clears (ignore error status bit) */
 	if ((ret = ata_wait(bus, STATUS_BSY, 0, STATUS_DF)) < 0)
@@ -282,25 +538,24 @@ static ssize_t _ata_access(ata_dev_t *dev, uint64_t lba, uint16_t sectors, uint8
 	if ((ret = ata_select(dev, lba, sectors, dev->mode)) < 0)
 		return ret;
 
-	/* Send the command */
-	ata_writereg(base, REG_CMD, cmd, 1);
-
-	/* Do the transfer */
-	switch (cmd) {
-	case CMD_READ_PIO:
-	case CMD_READ_PIO_EXT:
-		ret = ata_pio(dev, sectors, buff, READ);
-		break;
+	/* Do the transfer, prefer bus master DMA */
+	if ((dmacmd = ata_dmacmd(dev, cmd, buff)) != CMD_NOP) {
+		ret = ata_dma(dev, sectors, dmacmd, buff, dir);
+	}
+	else {
+		/* Send the command */
+		ata_writereg(base, REG_CMD, (dev->multiple > 1) ? ata_multcmd(cmd) : cmd, 1);
+		ret = ata_pio(dev, sectors, buff, dir);
+	}
 
-	case CMD_WRITE_PIO:
-	case CMD_WRITE_PIO_EXT:
-		if ((ret = ata_pio(dev, sectors, buff, WRITE)) < 0)
-			break;
+	if ((ret >= 0) && (dir == WRITE)) {
+		dev->dirty = 1;
 
-		/* Flush the hardware cache */
-		cmd = (dev->mode == LBA48) ? CMD_CACHE_FLUSH_EXT : CMD_CACHE_FLUSH;
-		ata_writereg(base, REG_CMD, cmd, 1);
-		break;
+		/* Write-through policy, flush the hardware cache now */
+		if (!ata_common.writeback) {
+			if ((err = _ata_flush(dev)) < 0)
+				return err;
+		}
 	}
 
 	return ret;
@@ -358,9 +613,13 @@ ssize_t _ata_byteAccess(ata_dev_t *dev, off_t offs, char *buff, size_t len, uint
 		cnt += chunk;
 	}
 
-	/* Handle aligned part */
-	size_t lenAligned = len - (len % (size_t)dev->sectorsz);
-	if (lenAligned > 0) {
+	/* Handle aligned part, one command transfers at most ATA_MAXXFER bytes */
+	while (len >= dev->sectorsz) {
+		size_t lenAligned = len - (len % (size_t)dev->sectorsz);
+		if (lenAligned > ATA_MAXXFER) {
+			lenAligned = ATA_MAXXFER - (ATA_MAXXFER % dev->sectorsz);
+		}
+
 		ret = _ata_access(dev, offs / (off_t)dev->sectorsz, lenAligned / dev->sectorsz, cmd, (uint8_t *)buff);
 		if (ret < 0) {
 			return ret;
@@ -458,6 +717,19 @@ ssize_t ata_write(ata_dev_t *dev, off_t offs, const char *buff, size_t len)
 }
 
 
+int ata_sync(ata_dev_t *dev)
+{
+	int err = EOK;
+
+	mutexLock(dev->bus->lock);
+	if (dev->dirty)
+		err = _ata_flush(dev);
+	mutexUnlock(dev->bus->lock);
+
+	return err;
+}
+
+
 static int ata_initdev(ata_bus_t *bus, ata_dev_t *dev)
 {
 	void *base = bus->base;
@@ -466,6 +738,9 @@ static int ata_initdev(ata_bus_t *bus, ata_dev_t *dev)
 	int err, i;
 
 	dev->pio = PIO_DEFAULT;
+	dev->udma = UDMA_NONE;
+	dev->multiple = 1;
+	dev->dirty = 0;
 	dev->bus = bus;
 
 	/* Select the device */
@@ -515,6 +790,33 @@ static int ata_initdev(ata_bus_t *bus, ata_dev_t *dev)
 		}
 	}
 
+	/* Enable multiple sector PIO blocks (power of 2 sectors) */
+	if ((info[95] > 1) && !(info[95] & (info[95] - 1))) {
+		ata_writereg(base, REG_NSECTORS, info[95], 1);
+		ata_writereg(base, REG_CMD, CMD_SET_MULT, 1);
+		/* Wait until BSY clears (ignore error status bit) */
+		if ((err = ata_wait(bus, STATUS_BSY, 0, STATUS_DF)) < 0)
+			return err;
+
+		if (!(ata_readreg(base, REG_STATUS, 1) & STATUS_ERR))
+			dev->multiple = info[95];
+	}
+
+	/* Check DMA support and pick the fastest UDMA mode */
+	if ((info[98] & 1) && (info[107] & 4)) {
+		for (i = 6; i >= 0; i--) {
+			if (info[177] & (1 << i))
+				break;
+		}
+
+		/* UDMA modes above 2 require 80-conductor cable */
+		if ((i > 2) && !(info[186] & 0x20))
+			i = 2;
+
+		if (i >= 0)
+			dev->udma = UDMA_0 + i;
+	}
+
 	dev->mode = ((info[98] >> 1) & 1) + ((info[166] >> 2) & 1);
 	dev->cylinders = (info[3]   << 0) | (info[2]   << 8);
 	dev->heads     = (info[7]   << 0) | (info[6]   << 8);
@@ -567,6 +869,8 @@ static int ata_initbus(void *base, void *ctrl, ata_bus_t *bus)
 
 	bus->base = base;
 	bus->ctrl = ctrl;
+	bus->bmbase = NULL;
+	bus->sel = NULL;
 
 	/* Floating bus check */
 	if (ata_readreg(base, REG_STATUS, 1) == 0xff)
@@ -618,6 +922,94 @@ static int ata_initbus(void *base, void *ctrl, ata_bus_t *bus)
 }
 
 
+static int ata_initdmabus(ata_bus_t *bus, void *bmbase, unsigned int irq)
+{
+	int err;
+
+	bus->prdt = mmap(NULL, _PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_UNCACHED | MAP_ANONYMOUS | MAP_CONTIGUOUS, -1, 0);
+	if (bus->prdt == MAP_FAILED)
+		return -ENOMEM;
+	bus->prdtPhys = va2pa(bus->prdt);
+
+	if ((err = mutexCreate(&bus->irqLock)) < 0) {
+		munmap(bus->prdt, _PAGE_SIZE);
+		return err;
+	}
+
+	if ((err = condCreate(&bus->irqCond)) < 0) {
+		resourceDestroy(bus->irqLock);
+		munmap(bus->prdt, _PAGE_SIZE);
+		return err;
+	}
+
+	/* Stop the engine and clear pending interrupt/error bits */
+	ata_writereg(bmbase, BM_CMD, 0, 1);
+	ata_writereg(bmbase, BM_STATUS, ata_readreg(bmbase, BM_STATUS, 1) | BMSTATUS_IRQ | BMSTATUS_ERR, 1);
+	bus->irqStatus = 0;
+	bus->bmbase = bmbase;
+
+	if ((err = interrupt(irq, ata_irqHandler, bus, bus->irqCond, &bus->inth)) < 0) {
+		bus->bmbase = NULL;
+		resourceDestroy(bus->irqCond);
+		resourceDestroy(bus->irqLock);
+		munmap(bus->prdt, _PAGE_SIZE);
+		return err;
+	}
+
+	return EOK;
+}
+
+
+/* Enables bus master DMA on the buses of the first PCI IDE controller, buses without it use PIO */
+static void ata_initdma(ata_bus_t *bus1, ata_bus_t *bus2)
+{
+	platformctl_t pctl = { .action = pctl_get, .type = pctl_pci };
+	ata_bus_t *bus[2] = { bus1, bus2 };
+	pci_dev_t pcidev;
+	unsigned int irq;
+	int i;
+
+	pctl.pci.id.vendor = PCI_ANY;
+	pctl.pci.id.device = PCI_ANY;
+	pctl.pci.id.subvendor = PCI_ANY;
+	pctl.pci.id.subdevice = PCI_ANY;
+	pctl.pci.id.cl = pci_devClasses[0];
+	pctl.pci.dev.bus = 0;
+	pctl.pci.dev.dev = 0;
+	pctl.pci.dev.func = 0;
+	pctl.pci.caps = NULL;
+
+	if (platformctl(&pctl) < 0)
+		return;
+
+	/* Bus master IDE registers are in BAR4 (8 bytes per bus) */
+	if (!(pctl.pci.dev.progif & 0x80) || (pctl.pci.dev.resources[4].base == 0))
+		return;
+
+	pcidev = pctl.pci.dev;
+	pctl.action = pctl_set;
+	pctl.type = pctl_pcicfg;
+	pctl.pcicfg.dev.bus = pcidev.bus;
+	pctl.pcicfg.dev.dev = pcidev.dev;
+	pctl.pcicfg.dev.func = pcidev.func;
+	pctl.pcicfg.cfg = pci_cfg_busmaster;
+	pctl.pcicfg.enable = 1;
+
+	/* No bus mastering, fall back to PIO */
+	if (platformctl(&pctl) < 0)
+		return;
+
+	for (i = 0; i < 2; i++) {
+		if (bus[i] == NULL)
+			continue;
+
+		/* Native mode buses use PCI interrupt, compatibility mode ones legacy IRQs */
+		irq = (pcidev.progif & (1 << (2 * i))) ? pcidev.irq : ATA1_IRQ + i;
+		ata_initdmabus(bus[i], (void *)((pcidev.resources[4].base + 8 * i) | 0x1), irq);
+	}
+}
+
+
 int ata_init(void)
 {
 	int i, err;
@@ -691,6 +1083,8 @@ int ata_init(void)
 		}
 	}
 
+	ata_initdma(bus1Found ? bus1 : NULL, bus2Found ? bus2 : NULL);
+
 	if (!bus1Found) {
 		free(bus1);
 	}
@@ -33,6 +33,10 @@
 #define ATA4_BASE (ATA3_BASE - PORT_OFFSET)
 #define ATA4_CTRL (ATA3_CTRL - PORT_OFFSET)
 
+/* ATA legacy (compatibility mode) IRQs */
+#define ATA1_IRQ 14
+#define ATA2_IRQ 15
+
 
 /* ATA bus devices */
 enum { MASTER, SLAVE };
@@ -57,17 +61,35 @@ enum {
 };
 
 
+/* ATA UDMA transfer modes */
+enum {
+	UDMA_NONE           = 0x00, /* DMA not supported, use PIO */
+	UDMA_0              = 0x40, /* max 16,7 MB/s */
+	UDMA_1              = 0x41, /* max 25,0 MB/s */
+	UDMA_2              = 0x42, /* max 33,3 MB/s */
+	UDMA_3              = 0x43, /* max 44,4 MB/s */
+	UDMA_4              = 0x44, /* max 66,7 MB/s */
+	UDMA_5              = 0x45, /* max 100  MB/s */
+	UDMA_6              = 0x46  /* max 133  MB/s */
+};
+
+
 /* ATA commands */
 enum {
 	CMD_NOP             = 0x00,
 	CMD_READ_PIO        = 0x20,
 	CMD_READ_PIO_EXT    = 0x24,
 	CMD_READ_DMA_EXT    = 0x25,
+	CMD_READ_MULT_EXT   = 0x29,
 	CMD_WRITE_PIO       = 0x30,
 	CMD_WRITE_PIO_EXT   = 0x34,
 	CMD_WRITE_DMA_EXT   = 0x35,
+	CMD_WRITE_MULT_EXT  = 0x39,
 	CMD_PACKET          = 0xa0,
 	CMD_IDENTIFY_PACKET = 0xa1,
+	CMD_READ_MULT       = 0xc4,
+	CMD_WRITE_MULT      = 0xc5,
+	CMD_SET_MULT        = 0xc6,
 	CMD_READ_DMA        = 0xc8,
 	CMD_WRITE_DMA       = 0xca,
 	CMD_CACHE_FLUSH     = 0xe7,
@@ -123,6 +145,42 @@ enum {
 };
 
 
+/* Bus master IDE registers (per channel) */
+enum {
+	BM_CMD              = 0x0, /* Command register */
+	BM_STATUS           = 0x2, /* Status register */
+	BM_PRDT             = 0x4  /* PRD table physical address */
+};
+
+
+/* BM_CMD layout */
+enum {
+	BMCMD_START         = 0x01, /* Start/stop bus master operation */
+	BMCMD_READ          = 0x08  /* 0: memory to device, 1: device to memory */
+};
+
+
+/* BM_STATUS layout */
+enum {
+	BMSTATUS_ACTIVE     = 0x01, /* Bus master operation in progress */
+	BMSTATUS_ERR        = 0x02, /* DMA transfer error */
+	BMSTATUS_IRQ        = 0x04, /* Device interrupt asserted */
+	BMSTATUS_DRV0       = 0x20, /* Master device DMA capable */
+	BMSTATUS_DRV1       = 0x40  /* Slave device DMA capable */
+};
+
+
+/* Physical Region Descriptor */
+typedef struct {
+	uint32_t addr;          /* Region physical address (word aligned) */
+	uint16_t len;           /* Region byte count (0 => 64 KB) */
+	uint16_t flags;         /* Bit 15: last PRD in the table */
+} __attribute__((packed)) ata_prd_t;
+
+
+#define PRD_EOT 0x8000
+
+
 typedef struct _ata_dev_t ata_dev_t;
 typedef struct _ata_bus_t ata_bus_t;
 
@@ -130,7 +188,10 @@ typedef struct _ata_bus_t ata_bus_t;
 struct _ata_dev_t {
 	/* Device configuration */
 	uint8_t pio;            /* PIO mode: PIO_DEFAULT, PIO_0, PIO_1, PIO_2, PIO_3, PIO_4 */
+	uint8_t udma;           /* UDMA mode: UDMA_NONE, UDMA_0, ..., UDMA_6 */
 	uint8_t mode;           /* Addressing mode: CHS, LBA28, LBA48 */
+	uint8_t multiple;       /* Sectors per PIO data block (READ/WRITE MULTIPLE if > 1) */
+	uint8_t dirty;          /* Device write cache holds unflushed data */
 
 	/* Device geometry */
 	uint16_t cylinders;     /* Number of cylinders */
@@ -148,18 +209,29 @@ struct _ata_bus_t {
 	/* ATA registers access */
 	void *base;             /* ATA bus base registers */
 	void *ctrl;             /* ATA bus control registers */
+	void *bmbase;           /* Bus master IDE registers (NULL => no DMA) */
+
+	/* Bus master DMA */
+	ata_prd_t *prdt;        /* PRD table (single page) */
+	addr_t prdtPhys;        /* PRD table physical address */
+	volatile uint8_t irqStatus; /* BM_STATUS latched by the interrupt handler */
+	handle_t irqLock;       /* Interrupt mutex */
+	handle_t irqCond;       /* Interrupt condition */
+	handle_t inth;          /* Interrupt handle */
 
 	ata_dev_t *devs[2];     /* ATA devices attached to the bus */
+	ata_dev_t *sel;         /* Device with configured transfer modes selected last */
 	ata_bus_t *prev, *next; /* Doubly linked list */
 
 	/* Synchronization */
-	handle_t lock;          /* Access mutex */
+	handle_t lock;          /* Access mutex, buses (channels) are accessed independently */
 };
 
 
 typedef struct {
 	unsigned int ndevs;    /* Number of detected ATA devices */
 	ata_dev_t *devs;       /* Detected ATA devices */
+	int writeback;         /* Defer write cache flushes until ata_sync() */
 } ata_common_t;
 
 
@@ -174,6 +246,10 @@ extern ssize_t ata_read(ata_dev_t *dev, off_t offs, char *buff, size_t len);
 extern ssize_t ata_write(ata_dev_t *dev, off_t offs, const char *buff, size_t len);
 
 
+/* Flushes ATA device write cache */
+extern int ata_sync(ata_dev_t *dev);
+
+
 /* Initializes ATA devices */
 extern int ata_init(void);
 
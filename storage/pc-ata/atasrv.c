@@ -21,7 +21,6 @@
 #include <sys/file.h>
 #include <sys/list.h>
 #include <sys/msg.h>
-#include <sys/rb.h>
 #include <sys/threads.h>
 #include <sys/types.h>
 
@@ -29,13 +28,16 @@
 #include <posix/utils.h>
 
 #include <libext2.h>
+#include <blksrv.h>
+#include <partprobe.h>
 
 #include "ata.h"
-#include "mbr.h"
 
 
 /* Misc definitions */
-#define HDD_BASE "/dev/hd" /* Base name for HDD devices */
+#define HDD_BASE     "/dev/hd"         /* Base name for HDD devices */
+#define MAX_CHANNELS 2                 /* Primary and secondary channel */
+#define CHAN_STACKSZ (4 * _PAGE_SIZE)  /* Channel message thread stack size */
 
 
 /* ATA server device types */
@@ -45,31 +47,9 @@ enum {
 };
 
 
-/* ATA device access callbacks */
-static ssize_t atasrv_read(id_t id, off_t offs, char *buff, size_t len);
-static ssize_t atasrv_write(id_t id, off_t offs, const char *buff, size_t len);
-
-
-/* Filesystem callbacks types */
-typedef int (*fs_handler)(void *, msg_t *);
-typedef int (*fs_unmount)(void *);
-typedef int (*fs_mount)(oid_t *, unsigned int, typeof(atasrv_read) *, typeof(atasrv_write) *, void **);
-
-
-typedef struct {
-	rbnode_t node;              /* RBTree node */
-	char name[16];              /* Filesystem name */
-	uint8_t type;               /* Compatible partition type */
-	fs_handler handler;         /* Message handler callback */
-	fs_unmount unmount;         /* Unmount callback */
-	fs_mount mount;             /* Mount callback */
-} atasrv_fs_t;
-
-
 typedef struct _atasrv_dev_t  atasrv_dev_t;
 typedef struct _atasrv_base_t atasrv_base_t;
 typedef struct _atasrv_part_t atasrv_part_t;
-typedef struct _atasrv_req_t  atasrv_req_t;
 
 
 struct _atasrv_dev_t {
@@ -94,153 +74,33 @@ struct _atasrv_base_t {
 struct _atasrv_part_t {
 	/* Partition data */
 	unsigned int idx;           /* Partition index */
-	unsigned int port;          /* Partition port */
 	uint8_t type;               /* Partition type */
 	uint32_t start;             /* Partition start (LBA) */
 	uint32_t sectors;           /* Number of sectors */
 	atasrv_dev_t *bdev;         /* ATA device the partition is part of */
 
-	/* Filesystem data */
-	atasrv_fs_t *fs;            /* Mounted filesystem */
-	void *fdata;                /* Mounted filesystem data */
-
-	/* Partition filesystem thread stack */
-	char pstack[4 * _PAGE_SIZE] __attribute__((aligned(8)));
+	/* Filesystem data, mnt.port is the partition port */
+	blksrv_mnt_t mnt;
 };
 
 
-struct _atasrv_req_t {
-	msg_t msg;                  /* Request msg */
-	msg_rid_t rid;              /* Request receiving context */
-	atasrv_part_t *part;        /* Request receiver partition */
-	atasrv_req_t *prev, *next;  /* Doubly linked list */
-};
+/* Devices of each channel (ATA bus) are served by the channel own port and thread */
+typedef struct {
+	ata_bus_t *bus;             /* ATA bus */
+	unsigned int port;          /* Channel devices port */
+	char *stack;                /* Message thread stack (NULL => served by main thread) */
+} atasrv_chan_t;
 
 
 struct {
-	unsigned int port;          /* ATA server port */
+	atasrv_chan_t chans[MAX_CHANNELS];
+	unsigned int nchans;        /* Number of channels with ATA devices */
 	unsigned int ndevs;         /* Number of registered ATA devices */
 	idtree_t sdevs;             /* Registered ATA server devices */
-	rbtree_t fss;               /* Registered filesystems */
-	atasrv_req_t *rqueue;       /* Requests FIFO queue */
-	handle_t rlock, rcond;      /* Requests synchronization */
-
-	/* Pool threads stacks */
-	char pstacks[4][4 * _PAGE_SIZE] __attribute__((aligned(8)));
+	blksrv_t srv;               /* Filesystems and pool threads */
 } atasrv_common;
 
 
-static int atasrv_registerfs(const char *name, uint8_t type, fs_mount mount, fs_unmount unmount, fs_handler handler)
-{
-	atasrv_fs_t *fs;
-
-	if ((fs = (atasrv_fs_t *)malloc(sizeof(atasrv_fs_t))) == NULL)
-		return -ENOMEM;
-
-	strcpy(fs->name, name);
-	fs->type = type;
-	fs->mount = mount;
-	fs->unmount = unmount;
-	fs->handler = handler;
-	lib_rbInsert(&atasrv_common.fss, &fs->node);
-
-	return EOK;
-}
-
-
-static int atasrv_cmpfs(rbnode_t *node1, rbnode_t *node2)
-{
-	atasrv_fs_t *fs1 = lib_treeof(atasrv_fs_t, node, node1);
-	atasrv_fs_t *fs2 = lib_treeof(atasrv_fs_t, node, node2);
-
-	return strcmp(fs1->name, fs2->name);
-}
-
-
-static atasrv_fs_t *atasrv_getfs(const char *name)
-{
-	atasrv_fs_t fs;
-
-	strcpy(fs.name, name);
-
-	return lib_treeof(atasrv_fs_t, node, lib_rbFind(&atasrv_common.fss, &fs.node));
-}
-
-
-static atasrv_fs_t *atasrv_findfs(uint8_t type)
-{
-	rbnode_t *node;
-	atasrv_fs_t *fs;
-
-	for (node = lib_rbMinimum(atasrv_common.fss.root); node != NULL; node = lib_rbNext(node)) {
-		fs = lib_treeof(atasrv_fs_t, node, node);
-
-		if (fs->type == type)
-			return fs;
-	}
-
-	return NULL;
-}
-
-
-static void atasrv_fsthr(void *arg)
-{
-	atasrv_part_t *part = (atasrv_part_t *)arg;
-	atasrv_req_t *req;
-	int umount = 0;
-
-	for (;;) {
-		if ((req = (atasrv_req_t *)malloc(sizeof(atasrv_req_t))) == NULL)
-			continue;
-
-		req->part = part;
-		while (msgRecv(req->part->port, &req->msg, &req->rid) < 0);
-
-		if (req->msg.type == mtUmount)
-			umount = 1;
-
-		mutexLock(atasrv_common.rlock);
-
-		LIST_ADD(&atasrv_common.rqueue, req);
-
-		mutexUnlock(atasrv_common.rlock);
-		condSignal(atasrv_common.rcond);
-
-		if (umount)
-			endthread();
-	}
-}
-
-
-static void atasrv_poolthr(void *arg)
-{
-	atasrv_req_t *req;
-
-	for (;;) {
-		mutexLock(atasrv_common.rlock);
-
-		while (atasrv_common.rqueue == NULL)
-			condWait(atasrv_common.rcond, atasrv_common.rlock, 0);
-		req = atasrv_common.rqueue->prev;
-		LIST_REMOVE(&atasrv_common.rqueue, req);
-
-		mutexUnlock(atasrv_common.rlock);
-
-		if (req->msg.type == mtUmount) {
-			req->part->fs->unmount(req->part->fdata);
-			req->part->fs = NULL;
-			req->part->fdata = NULL;
-		}
-		else {
-			req->part->fs->handler(req->part->fdata, &req->msg);
-		}
-
-		msgRespond(req->part->port, &req->msg, req->rid);
-		free(req);
-	}
-}
-
-
 static int atasrv_initbase(ata_dev_t *dev)
 {
 	atasrv_dev_t *sdev;
@@ -282,7 +142,7 @@ static int atasrv_initpart(atasrv_dev_t *bdev, uint8_t type, uint32_t start, uin
 		return -ENOMEM;
 	}
 
-	if ((err = portCreate(&pdev->part->port)) < 0) {
+	if ((err = portCreate(&pdev->part->mnt.port)) < 0) {
 		free(pdev->part);
 		free(pdev);
 		return err;
@@ -294,8 +154,8 @@ static int atasrv_initpart(atasrv_dev_t *bdev, uint8_t type, uint32_t start, uin
 	pdev->part->type = type;
 	pdev->part->start = start;
 	pdev->part->sectors = sectors;
-	pdev->part->fs = NULL;
-	pdev->part->fdata = NULL;
+	pdev->part->mnt.fs = NULL;
+	pdev->part->mnt.fdata = NULL;
 	pdev->part->bdev = bdev;
 	pdev->part->idx = bdev->base->npdevs++;
 	idtree_alloc(&atasrv_common.sdevs, &pdev->node);
@@ -377,11 +237,30 @@ static ssize_t atasrv_write(id_t id, off_t offs, const char *buff, size_t len)
 }
 
 
+static int atasrv_sync(id_t id)
+{
+	atasrv_dev_t *sdev;
+
+	if ((sdev = lib_treeof(atasrv_dev_t, node, idtree_find(&atasrv_common.sdevs, id))) == NULL)
+		return -ENODEV;
+
+	switch (sdev->type) {
+	case DEV_BASE:
+		return ata_sync(sdev->base->dev);
+
+	case DEV_PART:
+		return ata_sync(sdev->part->bdev->base->dev);
+
+	default:
+		return -1;
+	}
+}
+
+
 static int atasrv_mount(id_t id, const char *name, oid_t *oid)
 {
 	atasrv_dev_t *pdev;
-	atasrv_fs_t *fs;
-	int err;
+	blksrv_fs_t *fs;
 
 	if ((pdev = lib_treeof(atasrv_dev_t, node, idtree_find(&atasrv_common.sdevs, id))) == NULL)
 		return -ENODEV;
@@ -389,30 +268,19 @@ static int atasrv_mount(id_t id, const char *name, oid_t *oid)
 	if (pdev->type != DEV_PART)
 		return -EINVAL;
 
-	if (pdev->part->fs != NULL)
+	if (pdev->part->mnt.fs != NULL)
 		return -EEXIST;
 
-	if ((pdev->part->fs = fs = (name == NULL) ? atasrv_findfs(pdev->part->type) : atasrv_getfs(name)) == NULL)
+	if ((fs = (name == NULL) ? blksrv_findfs(&atasrv_common.srv, pdev->part->type) : blksrv_getfs(&atasrv_common.srv, name)) == NULL)
 		return -ENOENT;
 
 	if (fs->type != pdev->part->type)
 		return -EINVAL;
 
-	oid->port = pdev->part->port;
+	oid->port = pdev->part->mnt.port;
 	oid->id = id;
 
-	if ((err = fs->mount(oid, pdev->part->bdev->base->dev->sectorsz, atasrv_read, atasrv_write, &pdev->part->fdata)) < 0)
-		return err;
-	oid->id = err;
-
-	if ((err = beginthread(atasrv_fsthr, 4, pdev->part->pstack, sizeof(pdev->part->pstack), pdev->part)) < 0) {
-		pdev->part->fs->unmount(pdev->part->fdata);
-		pdev->part->fs = NULL;
-		pdev->part->fdata = NULL;
-		return err;
-	}
-
-	return EOK;
+	return blksrv_mount(&atasrv_common.srv, &pdev->part->mnt, fs, pdev->part->bdev->base->dev->sectorsz, oid);
 }
 
 
@@ -444,10 +312,65 @@ static int atasrv_getattr(id_t id, int type, long long *attr)
 }
 
 
+static ssize_t atasrv_probeRead(void *arg, off_t offs, void *buff, size_t len)
+{
+	return ata_read((ata_dev_t *)arg, offs, buff, len);
+}
+
+
+/* Registers partitions found in the device partition table */
+static int atasrv_initparts(atasrv_dev_t *bdev)
+{
+	ata_dev_t *dev = bdev->base->dev;
+	partprobe_table_t *table;
+	partprobe_part_t *part;
+	unsigned int i;
+	int err;
+
+	if ((table = (partprobe_table_t *)malloc(sizeof(partprobe_table_t))) == NULL)
+		return -ENOMEM;
+
+	if ((err = partprobe_scanCached(bdev->base->idx, atasrv_probeRead, dev, dev->sectorsz, dev->size / dev->sectorsz, table)) < 0) {
+		free(table);
+		return err;
+	}
+
+	for (i = 0; i < table->nparts; i++) {
+		part = &table->parts[i];
+
+		/* Partition LBA is 32-bit */
+		if ((part->start + part->sectors) > UINT32_MAX) {
+			fprintf(stderr, "pc-ata: partition %u from device %u exceeds 32-bit LBA, skipping\n", i, bdev->base->idx);
+			continue;
+		}
+
+		if (atasrv_initpart(bdev, part->type, (uint32_t)part->start, (uint32_t)part->sectors) < 0)
+			fprintf(stderr, "pc-ata: failed to register partition %u from device %u\n", i, bdev->base->idx);
+	}
+	free(table);
+
+	return EOK;
+}
+
+
+static int atasrv_devctl(id_t id, msg_t *msg)
+{
+	atasrv_dev_t *sdev;
+
+	if ((sdev = lib_treeof(atasrv_dev_t, node, idtree_find(&atasrv_common.sdevs, id))) == NULL)
+		return -ENODEV;
+
+	if (!blksrv_isStats(msg))
+		return -ENOSYS;
+
+	return blksrv_stats(&atasrv_common.srv, (sdev->type == DEV_PART) ? &sdev->part->mnt : NULL, msg);
+}
+
+
 static void atasrv_msgloop(void *arg)
 {
 	msg_rid_t rid;
-	unsigned port = *(unsigned int *)arg;
+	unsigned port = ((atasrv_chan_t *)arg)->port;
 	mount_i_msg_t *imnt;
 	mount_o_msg_t *omnt;
 	msg_t msg;
@@ -479,7 +402,7 @@ static void atasrv_msgloop(void *arg)
 				break;
 
 			case mtSync:
-				msg.o.err = -ENOSYS;
+				msg.o.err = atasrv_sync(msg.oid.id);
 				break;
 
 			case mtRead:
@@ -494,6 +417,10 @@ static void atasrv_msgloop(void *arg)
 				msg.o.err = atasrv_getattr(msg.oid.id, msg.i.attr.type, &msg.o.attr.val);
 				break;
 
+			case mtDevCtl:
+				msg.o.err = atasrv_devctl(msg.oid.id, &msg);
+				break;
+
 			default:
 				msg.o.err = -ENOSYS;
 				break;
@@ -504,6 +431,56 @@ static void atasrv_msgloop(void *arg)
 }
 
 
+/* Returns channel of the ATA bus, creates its port on first use */
+static atasrv_chan_t *atasrv_chan(ata_bus_t *bus)
+{
+	atasrv_chan_t *chan;
+	unsigned int i;
+
+	for (i = 0; i < atasrv_common.nchans; i++) {
+		if (atasrv_common.chans[i].bus == bus)
+			return &atasrv_common.chans[i];
+	}
+
+	if (atasrv_common.nchans == MAX_CHANNELS)
+		return NULL;
+
+	chan = &atasrv_common.chans[atasrv_common.nchans];
+	if (portCreate(&chan->port) < 0)
+		return NULL;
+
+	chan->bus = bus;
+	chan->stack = NULL;
+	atasrv_common.nchans++;
+
+	return chan;
+}
+
+
+/* Starts message threads of the channels other than the first one, which is served by the main thread */
+static int atasrv_runchans(void)
+{
+	atasrv_chan_t *chan;
+	unsigned int i;
+	int err;
+
+	for (i = 1; i < atasrv_common.nchans; i++) {
+		chan = &atasrv_common.chans[i];
+
+		if ((chan->stack = malloc(CHAN_STACKSZ)) == NULL)
+			return -ENOMEM;
+
+		if ((err = beginthread(atasrv_msgloop, 4, chan->stack, CHAN_STACKSZ, chan)) < 0) {
+			free(chan->stack);
+			chan->stack = NULL;
+			return err;
+		}
+	}
+
+	return EOK;
+}
+
+
 static void atasrv_usage(const char *prog)
 {
 	printf("Usage: %s [options] or no args to mount first MBR partition as root\n", prog);
@@ -514,6 +491,8 @@ static void atasrv_usage(const char *prog)
 	printf("\t\tsize:  partition size in sectors\n");
 	printf("\t-r <id>                       - mounts root partition\n");
 	printf("\t\tid:    partition id starting at 0\n");
+	printf("\t-t <threads>                  - number of filesystem pool threads (default %d)\n", BLKSRV_THREADS);
+	printf("\t-w                            - write-back mode, flush device cache on sync only\n");
 	printf("\t-h                            - shows this help message\n");
 }
 
@@ -529,9 +508,8 @@ int main(int argc, char **argv)
 	atasrv_dev_t *sdev, *bdev;
 	ata_dev_t *dev;
 	rbnode_t *node;
-	mbr_t *mbr;
-	unsigned int i, j, type, start, sectors;
-	int err, c, argn, id, pid, mroot = 0;
+	unsigned int i, type, start, sectors;
+	int err, c, argn, id, pid, mroot = 0, mbrparts = 1, nthreads = 0;
 	oid_t oid;
 	char path[32];
 
@@ -569,28 +547,18 @@ int main(int argc, char **argv)
 	}
 
 	/* Init common server data */
-	if ((err = portCreate(&atasrv_common.port)) < 0) {
-		fprintf(stderr, "pc-ata: failed to create server port\n");
-		return err;
-	}
-
-	if ((err = mutexCreate(&atasrv_common.rlock)) < 0) {
-		fprintf(stderr, "pc-ata: failed to create server requests mutex\n");
-		return err;
-	}
+	atasrv_common.nchans = 0;
 
-	if ((err = condCreate(&atasrv_common.rcond)) < 0) {
-		fprintf(stderr, "pc-ata: failed to create server requests condition variable\n");
+	if ((err = blksrv_init(&atasrv_common.srv, atasrv_read, atasrv_write)) < 0) {
+		fprintf(stderr, "pc-ata: failed to initialize server requests queue\n");
 		return err;
 	}
 
 	atasrv_common.ndevs = 0;
-	atasrv_common.rqueue = NULL;
 	idtree_init(&atasrv_common.sdevs);
-	lib_rbInit(&atasrv_common.fss, atasrv_cmpfs, NULL);
 
 	/* Register filesystems */
-	if (atasrv_registerfs(LIBEXT2_NAME, LIBEXT2_TYPE, LIBEXT2_MOUNT, LIBEXT2_UNMOUNT, LIBEXT2_HANDLER) < 0)
+	if (blksrv_registerfs(&atasrv_common.srv, LIBEXT2_NAME, LIBEXT2_TYPE, LIBEXT2_MOUNT, LIBEXT2_UNMOUNT, LIBEXT2_HANDLER) < 0)
 		fprintf(stderr, "pc-ata: failed to register ext2 filesystem\n");
 
 	/* Init base ATA devices - process the list in FIFO order */
@@ -600,13 +568,20 @@ int main(int argc, char **argv)
 			fprintf(stderr, "pc-ata: failed to initialize ATA device %d\n", i);
 			return err;
 		}
+
+		if (atasrv_chan(dev->bus) == NULL) {
+			fprintf(stderr, "pc-ata: failed to create server port\n");
+			return -ENOMEM;
+		}
 	}
 
 	if (argc > 1) {
 		/* Process command line options */
-		while ((c = getopt(argc, argv, "p:r:h")) != -1) {
+		while ((c = getopt(argc, argv, "p:r:t:wh")) != -1) {
 			switch (c) {
 			case 'p':
+				mbrparts = 0;
+
 				if ((argn = optind - 1) > argc - 4) {
 					fprintf(stderr, "pc-ata: missing arg(s) for -p option\n");
 					return -EINVAL;
@@ -630,6 +605,7 @@ int main(int argc, char **argv)
 				break;
 
 			case 'r':
+				mbrparts = 0;
 				id = strtoul(optarg, NULL, 0);
 
 				if (mroot) {
@@ -645,6 +621,17 @@ int main(int argc, char **argv)
 				mroot = 1;
 				break;
 
+			case 't':
+				if ((nthreads = strtol(optarg, NULL, 0)) <= 0) {
+					fprintf(stderr, "pc-ata: invalid number of pool threads (%s)\n", optarg);
+					return -EINVAL;
+				}
+				break;
+
+			case 'w':
+				ata_common.writeback = 1;
+				break;
+
 			case 'h':
 			default:
 				atasrv_usage(argv[0]);
@@ -652,33 +639,25 @@ int main(int argc, char **argv)
 			}
 		}
 	}
-	else {
-		/* Init partitions from MBR */
-		if ((mbr = (mbr_t *)malloc(sizeof(mbr_t))) == NULL)
-			return -ENOMEM;
 
+	if (mbrparts) {
+		/* Init partitions from MBR or GPT */
 		for (i = 0; i < atasrv_common.ndevs; i++) {
 			if ((bdev = lib_treeof(atasrv_dev_t, node, idtree_find(&atasrv_common.sdevs, i))) == NULL)
 				return -ENODEV;
 
-			if ((err = mbr_read(bdev->base->dev, mbr)) < 0) {
-				if (err == -ENOENT)
-					continue;
+			if ((err = atasrv_initparts(bdev)) < 0) {
+				fprintf(stderr, "pc-ata: failed to read partition table of device %u\n", i);
 				return err;
 			}
-
-			for (j = 0; j < sizeof(mbr->pent) / sizeof(mbr->pent[0]); j++) {
-				if (!(mbr->pent[j].type))
-					continue;
-				if (atasrv_initpart(bdev, mbr->pent[j].type, mbr->pent[j].start, mbr->pent[j].sectors) < 0)
-					fprintf(stderr, "pc-ata: failed to register MBR partition %u from device %u\n", j, i);
-			}
 		}
-		free(mbr);
 
-		/* Mount first detected MBR partition as root */
-		if (atasrv_mount(atasrv_common.ndevs, NULL, &oid) < 0)
-			fprintf(stderr, "pc-ata: failed to mount root MBR partition\n");
+		/* Mount first detected partition with a known filesystem as root (skips e.g. GPT EFI system partition) */
+		for (id = atasrv_common.ndevs; (err = atasrv_mount(id, NULL, &oid)) == -ENOENT; id++)
+			;
+
+		if (err < 0)
+			fprintf(stderr, "pc-ata: failed to mount root partition\n");
 		else
 			mroot = 1;
 	}
@@ -695,26 +674,31 @@ int main(int argc, char **argv)
 	}
 
 	/* Run pool threads */
-	for (i = 0; i < sizeof(atasrv_common.pstacks) / sizeof(atasrv_common.pstacks[0]); i++) {
-		if ((err = beginthread(atasrv_poolthr, 4, atasrv_common.pstacks[i], sizeof(atasrv_common.pstacks[i]), NULL)) < 0) {
-			fprintf(stderr, "pc-ata: failed to start pool thread %d\n", i);
-			return err;
-		}
+	if ((err = blksrv_run(&atasrv_common.srv, nthreads, 4)) < 0) {
+		fprintf(stderr, "pc-ata: failed to start pool threads\n");
+		return err;
+	}
+
+	/* Run channels message threads */
+	if ((err = atasrv_runchans()) < 0) {
+		fprintf(stderr, "pc-ata: failed to start channel threads\n");
+		return err;
 	}
 
-	/* Register devices */
+	/* Register devices, requests are routed to the device channel port */
 	for (node = lib_rbMinimum(atasrv_common.sdevs.root); node != NULL; node = lib_rbNext(node)) {
 		sdev = lib_treeof(atasrv_dev_t, node, lib_treeof(idnode_t, linkage, node));
-		oid.port = atasrv_common.port;
 		oid.id = idtree_id(&sdev->node);
 
 		switch (sdev->type) {
 		case DEV_BASE:
 			sprintf(path, "%s%c", HDD_BASE, 'a' + sdev->base->idx);
+			oid.port = atasrv_chan(sdev->base->dev->bus)->port;
 			break;
 
 		case DEV_PART:
 			sprintf(path, "%s%c%d", HDD_BASE, 'a' + sdev->part->bdev->base->idx, sdev->part->idx);
+			oid.port = atasrv_chan(sdev->part->bdev->base->dev->bus)->port;
 			break;
 		}
 
@@ -725,7 +709,7 @@ int main(int argc, char **argv)
 	/* Finished server initialization - kill parent */
 	kill(getppid(), SIGUSR1);
 
-	atasrv_msgloop(&atasrv_common.port);
+	atasrv_msgloop(&atasrv_common.chans[0]);
 
 	return EOK;
 }
@@ -16,8 +16,6 @@
 
 #include <stdint.h>
 
-#include "ata.h"
-
 
 /* Misc definitions */
 #define MBR_MAGIC 0xaa55
@@ -47,8 +45,4 @@ typedef struct {
 } __attribute__((packed)) mbr_t;
 
 
-/* Reads MBR */
-int mbr_read(ata_dev_t *dev, mbr_t *mbr);
-
-
 #endif
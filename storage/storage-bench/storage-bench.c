@@ -0,0 +1,321 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Block device benchmark
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+#include <sys/threads.h>
+
+#include <bench.h>
+
+
+#define BENCH_DEF_BS    4096                 /* Default block size */
+#define BENCH_DEF_QD    1                    /* Default queue depth */
+#define BENCH_DEF_LEN   (16 * 1024 * 1024)   /* Default number of bytes transferred per test */
+#define BENCH_MAX_QD    32                   /* Max queue depth */
+#define BENCH_STACKSZ   (2 * _PAGE_SIZE)     /* Worker thread stack size */
+
+
+/* Benchmark tests */
+enum { SEQREAD, SEQWRITE, RANDREAD, RANDWRITE, NTESTS };
+
+
+static const char *const bench_names[NTESTS] = { "seqread", "seqwrite", "randread", "randwrite" };
+
+
+typedef struct {
+	unsigned int seed;  /* Random offsets seed */
+	char *buff;         /* Transfer buffer */
+	int err;            /* First error */
+	char stack[BENCH_STACKSZ] __attribute__((aligned(8)));
+} bench_worker_t;
+
+
+static struct {
+	/* Configuration */
+	const char *path;   /* Device path */
+	int fd;             /* Device file descriptor */
+	off_t offs;         /* Tested area start */
+	off_t size;         /* Tested area size */
+	size_t bs;          /* Block size */
+	unsigned int qd;    /* Queue depth (concurrent requests) */
+	unsigned int nops;  /* Number of requests per test */
+
+	/* Current test */
+	int test;           /* Test type */
+	bench_counter_t reqs;
+	uint32_t *lat;      /* Requests latencies (us) */
+} bench_common;
+
+
+static void bench_worker(void *arg)
+{
+	bench_worker_t *w = (bench_worker_t *)arg;
+	off_t nblks = bench_common.size / (off_t)bench_common.bs, blk;
+	uint64_t start;
+	ssize_t ret;
+	int req;
+
+	while ((req = bench_counterNext(&bench_common.reqs)) >= 0) {
+		switch (bench_common.test) {
+			case SEQREAD:
+			case SEQWRITE:
+				blk = req % nblks;
+				break;
+
+			default:
+				blk = rand_r(&w->seed) % nblks;
+				break;
+		}
+
+		start = bench_nowUs();
+		switch (bench_common.test) {
+			case SEQREAD:
+			case RANDREAD:
+				ret = pread(bench_common.fd, w->buff, bench_common.bs, bench_common.offs + blk * (off_t)bench_common.bs);
+				break;
+
+			default:
+				ret = pwrite(bench_common.fd, w->buff, bench_common.bs, bench_common.offs + blk * (off_t)bench_common.bs);
+				break;
+		}
+		bench_common.lat[req] = (uint32_t)(bench_nowUs() - start);
+
+		if (ret != (ssize_t)bench_common.bs) {
+			w->err = (ret < 0) ? -errno : -EIO;
+			break;
+		}
+	}
+
+	endthread();
+}
+
+
+static int bench_run(int test, bench_worker_t *workers)
+{
+	bench_report_t r;
+	uint64_t start, usec;
+	unsigned int i;
+	double mbps, iops;
+	int err = 0;
+
+	bench_common.test = test;
+	bench_counterReset(&bench_common.reqs, bench_common.nops);
+
+	start = bench_nowUs();
+	for (i = 0; i < bench_common.qd; i++) {
+		workers[i].err = 0;
+		if ((err = beginthread(bench_worker, 4, workers[i].stack, sizeof(workers[i].stack), &workers[i])) < 0) {
+			break;
+		}
+	}
+
+	while (i > 0) {
+		threadJoin(-1, 0);
+		i--;
+	}
+	usec = bench_nowUs() - start;
+
+	if ((test == SEQWRITE) || (test == RANDWRITE)) {
+		fsync(bench_common.fd);
+	}
+
+	for (i = 0; (err == 0) && (i < bench_common.qd); i++) {
+		err = workers[i].err;
+	}
+
+	bench_reportBegin(&r);
+	bench_reportStr(&r, "dev", bench_common.path);
+	bench_reportStr(&r, "test", bench_names[test]);
+
+	if (err < 0) {
+		bench_reportInt(&r, "err", err);
+		bench_reportEnd(&r);
+		return err;
+	}
+
+	bench_sort(bench_common.lat, bench_common.nops);
+
+	if (usec == 0) {
+		usec = 1;
+	}
+	iops = (double)bench_common.nops * 1000000 / usec;
+	mbps = iops * bench_common.bs / (1024 * 1024);
+
+	bench_reportUint(&r, "bs", bench_common.bs);
+	bench_reportUint(&r, "qd", bench_common.qd);
+	bench_reportUint(&r, "ops", bench_common.nops);
+	bench_reportU64(&r, "usec", usec);
+	bench_reportDouble(&r, "mbps", mbps, 2);
+	bench_reportDouble(&r, "iops", iops, 0);
+	bench_reportUint(&r, "p50_us", bench_percentile(bench_common.lat, bench_common.nops, 50));
+	bench_reportUint(&r, "p99_us", bench_percentile(bench_common.lat, bench_common.nops, 99));
+	bench_reportEnd(&r);
+
+	return 0;
+}
+
+
+static void bench_usage(const char *prog)
+{
+	printf("Usage: %s [options] <device>\n", prog);
+	printf("\t-b <size>   - block size (default %u)\n", BENCH_DEF_BS);
+	printf("\t-q <depth>  - queue depth, number of concurrent requests (default %u, max %u)\n", BENCH_DEF_QD, BENCH_MAX_QD);
+	printf("\t-l <len>    - bytes transferred per test (default %u)\n", BENCH_DEF_LEN);
+	printf("\t-o <offs>   - tested area offset (default 0)\n");
+	printf("\t-s <size>   - tested area size (default device size - offset)\n");
+	printf("\t-t <tests>  - comma separated tests: seqread,seqwrite,randread,randwrite (default read tests)\n");
+	printf("\t-w          - allow write tests, destroys data in the tested area\n");
+	printf("\t-h          - shows this help message\n");
+}
+
+
+int main(int argc, char **argv)
+{
+	bench_worker_t *workers;
+	unsigned int tests = (1 << SEQREAD) | (1 << RANDREAD);
+	unsigned long long len = BENCH_DEF_LEN;
+	int c, i, wr = 0, err = EXIT_SUCCESS;
+	const char *bad;
+	struct stat st;
+
+	bench_common.bs = BENCH_DEF_BS;
+	bench_common.qd = BENCH_DEF_QD;
+	bench_common.offs = 0;
+	bench_common.size = 0;
+
+	while ((c = getopt(argc, argv, "b:q:l:o:s:t:wh")) != -1) {
+		switch (c) {
+			case 'b':
+				bench_common.bs = strtoul(optarg, NULL, 0);
+				break;
+
+			case 'q':
+				bench_common.qd = strtoul(optarg, NULL, 0);
+				break;
+
+			case 'l':
+				len = strtoull(optarg, NULL, 0);
+				break;
+
+			case 'o':
+				bench_common.offs = strtoull(optarg, NULL, 0);
+				break;
+
+			case 's':
+				bench_common.size = strtoull(optarg, NULL, 0);
+				break;
+
+			case 't':
+				if (bench_parseTests(optarg, bench_names, NTESTS, &tests, &bad) < 0) {
+					fprintf(stderr, "storage-bench: unknown test %s\n", bad);
+					return EXIT_FAILURE;
+				}
+				break;
+
+			case 'w':
+				wr = 1;
+				break;
+
+			case 'h':
+			default:
+				bench_usage(argv[0]);
+				return EXIT_SUCCESS;
+		}
+	}
+
+	if (optind != argc - 1) {
+		bench_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	bench_common.path = argv[optind];
+
+	if ((tests & ((1 << SEQWRITE) | (1 << RANDWRITE))) && !wr) {
+		fprintf(stderr, "storage-bench: write tests require -w option\n");
+		return EXIT_FAILURE;
+	}
+
+	if ((bench_common.bs == 0) || (bench_common.qd == 0) || (bench_common.qd > BENCH_MAX_QD)) {
+		fprintf(stderr, "storage-bench: invalid block size or queue depth\n");
+		return EXIT_FAILURE;
+	}
+
+	if ((bench_common.fd = open(bench_common.path, wr ? O_RDWR : O_RDONLY)) < 0) {
+		fprintf(stderr, "storage-bench: failed to open %s\n", bench_common.path);
+		return EXIT_FAILURE;
+	}
+
+	if (bench_common.size == 0) {
+		if ((fstat(bench_common.fd, &st) < 0) || (st.st_size <= bench_common.offs)) {
+			fprintf(stderr, "storage-bench: failed to get %s size, use -s option\n", bench_common.path);
+			close(bench_common.fd);
+			return EXIT_FAILURE;
+		}
+		bench_common.size = st.st_size - bench_common.offs;
+	}
+
+	if (bench_common.size < (off_t)bench_common.bs) {
+		fprintf(stderr, "storage-bench: tested area smaller than block size\n");
+		close(bench_common.fd);
+		return EXIT_FAILURE;
+	}
+
+	bench_common.nops = (len + bench_common.bs - 1) / bench_common.bs;
+	if (bench_common.nops == 0) {
+		bench_common.nops = 1;
+	}
+
+	bench_common.lat = malloc(bench_common.nops * sizeof(bench_common.lat[0]));
+	workers = calloc(bench_common.qd, sizeof(*workers));
+	if ((bench_common.lat == NULL) || (workers == NULL) || (bench_counterInit(&bench_common.reqs) < 0)) {
+		fprintf(stderr, "storage-bench: out of memory\n");
+		free(bench_common.lat);
+		free(workers);
+		close(bench_common.fd);
+		return EXIT_FAILURE;
+	}
+
+	for (i = 0; i < (int)bench_common.qd; i++) {
+		workers[i].seed = (unsigned int)bench_nowUs() + i;
+		if ((workers[i].buff = malloc(bench_common.bs)) == NULL) {
+			break;
+		}
+		memset(workers[i].buff, 0xa5 ^ i, bench_common.bs);
+	}
+
+	if (i < (int)bench_common.qd) {
+		fprintf(stderr, "storage-bench: out of memory\n");
+		err = EXIT_FAILURE;
+	}
+
+	for (c = 0; (err == EXIT_SUCCESS) && (c < NTESTS); c++) {
+		if ((tests & (1 << c)) && (bench_run(c, workers) < 0)) {
+			err = EXIT_FAILURE;
+		}
+	}
+
+	while (i > 0) {
+		free(workers[--i].buff);
+	}
+	bench_counterDone(&bench_common.reqs);
+	free(workers);
+	free(bench_common.lat);
+	close(bench_common.fd);
+
+	return err;
+}
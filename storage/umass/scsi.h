@@ -21,6 +21,12 @@
 /* Opcodes */
 #define SCSI_REQUEST_SENSE 0x03
 #define SCSI_INQUIRY       0x12
+#define SCSI_READ10        0x28
+#define SCSI_WRITE10       0x2a
+
+/* Vital product data pages */
+#define SCSI_VPD_SUPPORTED_PAGES 0x00
+#define SCSI_VPD_BLOCK_LIMITS    0xb0
 
 
 typedef struct {
@@ -60,4 +66,25 @@ typedef struct {
 } __attribute__((packed)) scsi_inquiry_t;
 
 
+typedef struct {
+	uint8_t qualifier_devicetype; /* [8:5] qualifier, [5:0] devicetype */
+	uint8_t pagecode;
+	uint16_t pagelen;
+	uint8_t pages[]; /* Supported page codes, ascending */
+} __attribute__((packed)) scsi_vpd_pages_t;
+
+
+typedef struct {
+	uint8_t qualifier_devicetype; /* [8:5] qualifier, [5:0] devicetype */
+	uint8_t pagecode;
+	uint16_t pagelen;
+	uint8_t misc0;
+	uint8_t maxcmpwrite;
+	uint16_t optxfergran; /* Optimal transfer length granularity */
+	uint32_t maxxfer;     /* Maximum transfer length (blocks) */
+	uint32_t optxfer;     /* Optimal transfer length (blocks) */
+	uint8_t misc1[48];
+} __attribute__((packed)) scsi_vpd_blocklimits_t;
+
+
 #endif
@@ -13,6 +13,8 @@
  * %LICENSE%
  */
 
+#include <stdlib.h>
+
 #include "umass.h"
 #include <usbprocdriver.h>
 
@@ -22,6 +24,8 @@ static void printHelp(const char *name)
 	fprintf(stderr,
 			"Usage: %s [opts]\n"
 			"  -r   Mount as rootfs\n"
+			"  -c   Enable write-back block cache\n"
+			"  -t n Number of filesystem pool threads\n"
 			"  -h   Print this help\n",
 			name);
 }
@@ -31,7 +35,7 @@ int main(int argc, char *argv[])
 {
 	int ret;
 	char c;
-	umass_args_t umass_args = { .mount_root = false };
+	umass_args_t umass_args = { .mount_root = false, .cache = false, .threads = 0 };
 	usb_driver_t *driver = usb_registeredDriverPop();
 
 	if (driver == NULL) {
@@ -47,7 +51,7 @@ int main(int argc, char *argv[])
 	if (argc > 1) {
 		/* Process command line options */
 		for (;;) {
-			c = getopt(argc, argv, "hr");
+			c = getopt(argc, argv, "hrct:");
 			if (c == -1) {
 				break;
 			}
@@ -55,6 +59,12 @@ int main(int argc, char *argv[])
 				case 'r':
 					umass_args.mount_root = true;
 					break;
+				case 'c':
+					umass_args.cache = true;
+					break;
+				case 't':
+					umass_args.threads = (unsigned int)strtoul(optarg, NULL, 0);
+					break;
 				case 'h':
 				default:
 					printHelp(argv[0]);
@@ -0,0 +1,97 @@
+/*
+ * Phoenix-RTOS
+ *
+ * USB Mass Storage class driver
+ *
+ * USB Attached SCSI (UAS) information units definitions header
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * %LICENSE%
+ */
+
+
+#ifndef _UAS_H_
+#define _UAS_H_
+
+#include <stdint.h>
+
+
+#define USB_PROTOCOL_UAS 0x62
+
+/* Pipe usage class-specific endpoint descriptor */
+#define UAS_DESC_PIPE_USAGE 0x24
+
+/* Pipe IDs */
+#define UAS_PIPE_CMD     1
+#define UAS_PIPE_STATUS  2
+#define UAS_PIPE_DATAIN  3
+#define UAS_PIPE_DATAOUT 4
+
+/* Information unit IDs */
+#define UAS_IU_CMD         0x01
+#define UAS_IU_SENSE       0x03
+#define UAS_IU_RESPONSE    0x04
+#define UAS_IU_TASKMGMT    0x05
+#define UAS_IU_READ_READY  0x06
+#define UAS_IU_WRITE_READY 0x07
+
+/* SCSI status in sense IU */
+#define UAS_STATUS_GOOD            0x00
+#define UAS_STATUS_CHECK_CONDITION 0x02
+
+/* Task attributes */
+#define UAS_TASK_SIMPLE 0x00
+
+
+typedef struct {
+	uint8_t bLength;
+	uint8_t bDescriptorType;
+	uint8_t bPipeID;
+	uint8_t reserved;
+} __attribute__((packed)) uas_pipeUsageDesc_t;
+
+
+/* Common header of the IUs received on the status pipe */
+typedef struct {
+	uint8_t id;
+	uint8_t reserved;
+	uint16_t tag; /* big endian */
+} __attribute__((packed)) uas_iuHdr_t;
+
+
+typedef struct {
+	uint8_t id;
+	uint8_t reserved0;
+	uint16_t tag;
+	uint8_t prio_attr; /* [7:3] priority, [2:0] task attribute */
+	uint8_t reserved1;
+	uint8_t addlen; /* [7:2] additional CDB length in dwords */
+	uint8_t reserved2;
+	uint8_t lun[8];
+	uint8_t cdb[16];
+} __attribute__((packed)) uas_cmdIu_t;
+
+
+typedef struct {
+	uint8_t id;
+	uint8_t reserved0;
+	uint16_t tag;
+	uint16_t qualifier;
+	uint8_t status;
+	uint8_t reserved1[7];
+	uint16_t len;
+	uint8_t sense[18];
+} __attribute__((packed)) uas_senseIu_t;
+
+
+typedef struct {
+	uint8_t id;
+	uint8_t reserved0;
+	uint16_t tag;
+	uint8_t info[3];
+	uint8_t code;
+} __attribute__((packed)) uas_responseIu_t;
+
+
+#endif
@@ -14,13 +14,14 @@
 
 #include <arpa/inet.h>
 #include <errno.h>
-#include <sys/list.h>
 #include <sys/msg.h>
 #include <sys/minmax.h>
 #include <sys/types.h>
 #include <sys/file.h>
 #include <sys/threads.h>
+#include <sys/time.h>
 #include <posix/utils.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -34,24 +35,50 @@
 #include <libext2.h>
 #endif
 
+#ifdef UMASS_BLKCACHE
+#include <cache.h>
+#endif
+
 #include <usb.h>
 #include <usbdriver.h>
+#include <blksrv.h>
 
 #include "../pc-ata/mbr.h"
 #include "umass.h"
+#include "umasssrv.h"
 #include "scsi.h"
+#include "uas.h"
 
-#define UMASS_N_MSG_THREADS  2
-#define UMASS_N_POOL_THREADS 4
+#define UMASS_N_MSG_THREADS 2
+
+#define UMASS_BRINGUP_STACKSZ (4 * _PAGE_SIZE) /* Per-device bring-up thread, runs the root mount too */
 
 #define UMASS_TRANSMIT_RETRIES 3
 #define UMASS_INIT_RETRIES     10
 
 #define UMASS_SECTOR_SIZE 512
 
+/* Per-command transfer length used when device doesn't report Block Limits */
+#define UMASS_DEF_XFER_SECTORS 128
+/* READ(10)/WRITE(10) transfer length limit */
+#define UMASS_MAX_XFER_SECTORS 0xffff
+
+#define UMASS_CACHE_LINESZ (8 * UMASS_SECTOR_SIZE) /* Size of cache line (must be multiple of UMASS_SECTOR_SIZE) */
+#define UMASS_CACHE_LINES  64                      /* Number of cache lines */
+#define UMASS_CACHE_BYPASS (4 * UMASS_CACHE_LINESZ) /* Requests of this size or larger go directly to device */
+#define UMASS_RA_SIZE      (8 * UMASS_CACHE_LINESZ) /* Sequential read-ahead window */
+
+#define UMASS_UAS_TAGS      16 /* UAS commands in flight per device */
+#define UMASS_UAS_REQ_DEPTH 8  /* UAS commands in flight per request */
+#define UMASS_UAS_STATUSSZ  64 /* Status pipe transfer size, fits the largest IU */
+
 #define UMASS_WRITE 0
 #define UMASS_READ  0x80
 
+#define UMASS_BOT_RESET          0xff /* Bulk-Only Mass Storage Reset class request */
+
+#define UMASS_VPD_LISTSZ 64 /* Supported VPD Pages list transfer size */
+
 #define CBW_SIG 0x43425355
 #define CSW_SIG 0x53425355
 
@@ -91,49 +118,63 @@ static ssize_t umass_write(id_t id, off_t offs, const char *buf, size_t len);
 
 
 /* Thread types */
-static void umass_fsthr(void *arg);
-static void umass_poolthr(void *arg);
 static void umass_msgthr(void *arg);
 
 
-/* Filesystem callbacks types */
-typedef int (*fs_handler_t)(void *, msg_t *);
-typedef int (*fs_unmount_t)(void *);
-typedef int (*fs_mount_t)(oid_t *, unsigned int, typeof(umass_read) *, typeof(umass_write) *, void **);
-
-
-typedef struct {
-	rbnode_t node;      /* RBTree node */
-	char name[16];      /* Filesystem name */
-	uint8_t type;       /* Compatible partition type */
-	fs_handler_t handler; /* Message handler callback */
-	fs_unmount_t unmount; /* Unmount callback */
-	fs_mount_t mount;     /* Mount callback */
-} umass_fs_t;
-
-
 typedef struct _umass_part_t {
 	/* Partition data */
 	unsigned int idx;  /* Partition index */
-	unsigned int port; /* Partition port */
 	uint32_t start;    /* Partition start */
 	uint32_t sectors;  /* Number of sectors */
 
-	/* Filesystem data */
-	umass_fs_t *fs; /* Mounted filesystem */
-	void *fdata;    /* Mounted filesystem data */
-
-	/* Partition filesystem thread stack */
-	char fsstack[4 * _PAGE_SIZE] __attribute__((aligned(8)));
+	/* Filesystem data, mnt.port is the partition port */
+	blksrv_mnt_t mnt;
 } umass_part_t;
 
 
-typedef struct _umass_req_t {
-	msg_t msg;                        /* Request msg */
-	msg_rid_t rid;                    /* Request receiving context */
-	umass_part_t *part;               /* Request receiver partition */
-	struct _umass_req_t *prev, *next; /* Doubly linked list */
-} umass_req_t;
+#ifdef UMASS_BLKCACHE
+struct cache_devCtx_s {
+	struct umass_dev *dev;
+	/* cache_deinit tries to flush cache, which fails on unplugged device.
+	 * noFlush makes all cache callbacks "succeed" and behave as no-op.
+	 */
+	bool noFlush;
+};
+#endif
+
+
+enum { uas_tagFree = 0, uas_tagQueued, uas_tagDone };
+
+
+typedef struct {
+	uas_cmdIu_t iu;
+	char *data;
+	size_t len;
+	int dir;
+	int state;
+	int xfer; /* Data phase result */
+	int ret;  /* Command result, -EAGAIN on CHECK CONDITION */
+} umass_uasTag_t;
+
+
+/* USB Attached SCSI transport, status pipe is served by a thread which also runs the data phases */
+typedef struct {
+	usb_driver_t *drv;
+	int pipeCmd;
+	int pipeStatus;
+	int pipeDataIn;
+	int pipeDataOut;
+
+	handle_t lock;
+	handle_t cond;
+	handle_t cmdLock;
+	handle_t tid;
+	bool dead; /* Status pipe failed, device is gone */
+
+	umass_uasTag_t tags[UMASS_UAS_TAGS];
+	uint8_t status[UMASS_UAS_STATUSSZ];
+	char stack[2 * _PAGE_SIZE] __attribute__((aligned(8)));
+} umass_uas_t;
 
 
 typedef struct umass_dev {
@@ -145,13 +186,32 @@ typedef struct umass_dev {
 	int pipeCtrl;
 	int pipeIn;
 	int pipeOut;
+	uint8_t epIn;  /* Bulk-Only Transport endpoint addresses (0 - unknown), for halt clearing */
+	uint8_t epOut;
 	int fileId;
 	int tag;
 	unsigned port;
+	size_t maxXfer; /* Maximum number of bytes transferred by single command */
 	handle_t lock;
+	umass_uas_t *uas; /* NULL - Bulk-Only Transport */
+
+	/* SCSI bring-up and mount run on a per-device thread, joined on removal */
+	char *bringupStack;
+	handle_t bringupTid;
 
 	umass_part_t part; /* TODO extend for more partitions */
 
+#ifdef UMASS_BLKCACHE
+	/* Block cache (device LBA addressed, shared by all partitions) */
+	cachectx_t *cache;
+	cache_devCtx_t cacheCtx;
+	handle_t cacheLock;
+	off_t raNext;  /* Offset expected by next sequential read */
+	bool inRa;     /* Read-ahead in progress */
+	umass_cachestats_t stats;
+	char *raBuff; /* Read-ahead sink of UMASS_RA_SIZE, allocated on first sequential read */
+#endif
+
 	usb_driver_t *drv;
 } umass_dev_t;
 
@@ -162,65 +222,65 @@ static struct {
 
 	unsigned msgport;
 	handle_t lock;
-	rbtree_t fss; /* Registered filesystems */
-
-	umass_req_t *rqueue;   /* Requests FIFO queue */
-	handle_t rlock, rcond; /* Requests synchronization */
+	blksrv_t srv; /* Filesystems and pool threads */
 
 	bool mount_root;
+	bool cache;
+	unsigned int threads;
 
 	/* Message threads stacks */
 	char mstacks[UMASS_N_MSG_THREADS][2 * _PAGE_SIZE] __attribute__((aligned(8)));
-
-	/* Pool threads stacks */
-	char pstacks[UMASS_N_POOL_THREADS][4 * _PAGE_SIZE] __attribute__((aligned(8)));
 } umass_common;
 
 
 static const usb_device_id_t filters[] = {
 	{ USBDRV_ANY, USBDRV_ANY, USB_CLASS_MASS_STORAGE, USB_SUBCLASS_SCSI, USB_PROTOCOL_BULK },
+	{ USBDRV_ANY, USBDRV_ANY, USB_CLASS_MASS_STORAGE, USB_SUBCLASS_SCSI, USB_PROTOCOL_UAS },
 };
 
 
-#ifdef UMASS_MOUNT_EXT2
-static int umass_registerfs(const char *name, uint8_t type, fs_mount_t mount, fs_unmount_t unmount, fs_handler_t handler)
+static int umass_scsiRequestSense(umass_dev_t *dev, char *odata);
+
+
+/* Library call also resets the host side data toggle of the endpoint, a raw CLEAR_FEATURE would leave it stale */
+static int umass_clearHalt(umass_dev_t *dev, uint8_t ep)
 {
-	umass_fs_t *fs = malloc(sizeof(umass_fs_t));
-	if (fs == NULL) {
-		return -ENOMEM;
+	if (ep == 0) {
+		return -ENOENT;
 	}
 
-	strcpy(fs->name, name);
-	fs->type = type;
-	fs->mount = mount;
-	fs->unmount = unmount;
-	fs->handler = handler;
-	lib_rbInsert(&umass_common.fss, &fs->node);
-
-	return EOK;
+	return usb_clearFeatureHalt(dev->drv, dev->pipeCtrl, ep);
 }
-#endif
 
 
-static int umass_cmpfs(rbnode_t *node1, rbnode_t *node2)
+/* Reset Recovery (BOT 5.3.4): Bulk-Only Mass Storage Reset, then clear halt on both bulk endpoints */
+static int umass_botResetRecovery(umass_dev_t *dev)
 {
-	umass_fs_t *fs1 = lib_treeof(umass_fs_t, node, node1);
-	umass_fs_t *fs2 = lib_treeof(umass_fs_t, node, node2);
-
-	return strcmp(fs1->name, fs2->name);
-}
+	usb_setup_packet_t setup = {
+		.bmRequestType = REQUEST_DIR_HOST2DEV | REQUEST_TYPE_CLASS | REQUEST_RECIPIENT_INTERFACE,
+		.bRequest = UMASS_BOT_RESET,
+		.wValue = 0,
+		.wIndex = dev->instance.interface,
+		.wLength = 0,
+	};
+	int ret;
 
+	ret = usb_transferControl(dev->drv, dev->pipeCtrl, &setup, NULL, 0, usb_dir_out);
+	(void)umass_clearHalt(dev, dev->epIn);
+	(void)umass_clearHalt(dev, dev->epOut);
 
-static int umass_scsiRequestSense(umass_dev_t *dev, char *odata);
+	return (ret < 0) ? -EIO : 0;
+}
 
 
-static int _umass_transmit(umass_dev_t *dev, void *cmd, size_t clen, char *data, size_t dlen, int dir)
+static int _umass_botTransmit(umass_dev_t *dev, void *cmd, size_t clen, char *data, size_t dlen, int dir)
 {
 	scsi_sense_t *sense;
 	umass_cbw_t cbw = { 0 };
 	umass_csw_t csw = { 0 };
 	int ret = -1, bytes = 0;
 	int dataPipe;
+	bool dataErr;
 	int i;
 
 	if (clen > 16)
@@ -239,22 +299,32 @@ static int _umass_transmit(umass_dev_t *dev, void *cmd, size_t clen, char *data,
 		ret = usb_transferBulk(dev->drv, dev->pipeOut, &cbw, sizeof(cbw), usb_dir_out);
 		if (ret != sizeof(cbw)) {
 			fprintf(stderr, "umass_transmit: usb_transferBulk OUT failed\n");
+			(void)umass_botResetRecovery(dev);
 			return -EIO;
 		}
 
-		/* Optional data transfer */
+		/* Optional data transfer, stalled data stage is followed by the status (BOT 6.7) */
+		dataErr = false;
 		if (dlen > 0) {
 			ret = usb_transferBulk(dev->drv, dataPipe, data, dlen, dir);
 			if (ret < 0) {
-				fprintf(stderr, "umass_transmit: umass_transmit data transfer failed\n");
-				return ret;
+				DEBUG("data transfer failed: %d", ret);
+				(void)umass_clearHalt(dev, (dir == usb_dir_out) ? dev->epOut : dev->epIn);
+				dataErr = true;
+				ret = 0;
 			}
 			bytes = ret;
 		}
 
 		ret = usb_transferBulk(dev->drv, dev->pipeIn, &csw, sizeof(csw), usb_dir_in);
+		if (ret != sizeof(csw)) {
+			/* Stalled status stage is retried once after clearing the halt */
+			(void)umass_clearHalt(dev, dev->epIn);
+			ret = usb_transferBulk(dev->drv, dev->pipeIn, &csw, sizeof(csw), usb_dir_in);
+		}
 		if (ret != sizeof(csw)) {
 			fprintf(stderr, "umass_transmit: usb_transferBulk IN transfer failed\n");
+			(void)umass_botResetRecovery(dev);
 			return -EIO;
 		}
 
@@ -278,15 +348,204 @@ static int _umass_transmit(umass_dev_t *dev, void *cmd, size_t clen, char *data,
 			else {
 				DEBUG("transfer incorrect.\n csw.sig=0x%x, csw.tag=0x%x, cbw.tag=0x%x, csw.status=%d\n", csw.sig, csw.tag,
 						cbw.tag, csw.status);
+				/* Invalid CSW or phase error */
+				(void)umass_botResetRecovery(dev);
 				return -EIO;
 			}
 		}
+
+		/* Good status after a failed data stage, data in the buffer can't be trusted */
+		if (dataErr) {
+			return -EIO;
+		}
+	}
+
+	/* Retries exhausted on CHECK CONDITION */
+	if (ret < 0) {
+		return -EIO;
 	}
 
 	return bytes;
 }
 
 
+static void umass_uasStatusThr(void *arg)
+{
+	umass_uas_t *uas = (umass_uas_t *)arg;
+	uas_iuHdr_t *hdr = (uas_iuHdr_t *)uas->status;
+	uas_senseIu_t *sense = (uas_senseIu_t *)uas->status;
+	umass_uasTag_t *t;
+	int len, ret, idx;
+
+	for (;;) {
+		len = usb_transferBulk(uas->drv, uas->pipeStatus, uas->status, sizeof(uas->status), usb_dir_in);
+		if (len < (int)sizeof(*hdr)) {
+			break;
+		}
+
+		idx = ntohs(hdr->tag) - 1;
+		mutexLock(uas->lock);
+		t = ((idx >= 0) && (idx < UMASS_UAS_TAGS) && (uas->tags[idx].state == uas_tagQueued)) ? &uas->tags[idx] : NULL;
+		mutexUnlock(uas->lock);
+
+		if (t == NULL) {
+			DEBUG("unexpected IU 0x%x for tag %d", hdr->id, idx + 1);
+			continue;
+		}
+
+		switch (hdr->id) {
+			case UAS_IU_READ_READY:
+			case UAS_IU_WRITE_READY:
+				/* No streams on USB 2.0, data phases run one at a time in the order requested by the device */
+				t->xfer = usb_transferBulk(uas->drv, (t->dir == usb_dir_in) ? uas->pipeDataIn : uas->pipeDataOut, t->data, t->len, t->dir);
+				continue;
+
+			case UAS_IU_SENSE:
+				if (len < offsetof(uas_senseIu_t, len)) {
+					ret = -EIO;
+				}
+				else if (sense->status == UAS_STATUS_GOOD) {
+					ret = (t->xfer < 0) ? -EIO : t->xfer;
+				}
+				else if (sense->status == UAS_STATUS_CHECK_CONDITION) {
+					DEBUG("tag %d CHECK CONDITION, sense key code=0x%x", idx + 1, (len > 18) ? (sense->sense[2] & 0xf) : 0);
+					ret = -EAGAIN;
+				}
+				else {
+					DEBUG("tag %d status 0x%x", idx + 1, sense->status);
+					ret = -EIO;
+				}
+				break;
+
+			default:
+				/* Response IU, command rejected by the device */
+				DEBUG("tag %d IU 0x%x response code=0x%x", idx + 1, hdr->id, (len >= sizeof(uas_responseIu_t)) ? ((uas_responseIu_t *)hdr)->code : 0);
+				ret = -EIO;
+				break;
+		}
+
+		mutexLock(uas->lock);
+		t->ret = ret;
+		t->state = uas_tagDone;
+		condBroadcast(uas->cond);
+		mutexUnlock(uas->lock);
+	}
+
+	mutexLock(uas->lock);
+	uas->dead = true;
+	condBroadcast(uas->cond);
+	mutexUnlock(uas->lock);
+
+	endthread();
+}
+
+
+/* Sends the command IU, returns tag index to wait for */
+static int _umass_uasSubmit(umass_uas_t *uas, void *cmd, size_t clen, char *data, size_t dlen, int dir)
+{
+	umass_uasTag_t *t;
+	int i, ret;
+
+	if (clen > sizeof(t->iu.cdb)) {
+		return -EINVAL;
+	}
+
+	mutexLock(uas->lock);
+	for (;;) {
+		for (i = 0; (i < UMASS_UAS_TAGS) && (uas->tags[i].state != uas_tagFree); i++) {
+		}
+
+		if (uas->dead || (i < UMASS_UAS_TAGS)) {
+			break;
+		}
+		condWait(uas->cond, uas->lock, 0);
+	}
+
+	if (uas->dead) {
+		mutexUnlock(uas->lock);
+		return -EIO;
+	}
+
+	t = &uas->tags[i];
+	t->state = uas_tagQueued;
+	t->data = data;
+	t->len = dlen;
+	t->dir = dir;
+	t->xfer = 0;
+	t->ret = -EIO;
+
+	memset(&t->iu, 0, sizeof(t->iu));
+	t->iu.id = UAS_IU_CMD;
+	t->iu.tag = htons(i + 1);
+	t->iu.prio_attr = UAS_TASK_SIMPLE;
+	memcpy(t->iu.cdb, cmd, clen);
+	mutexUnlock(uas->lock);
+
+	mutexLock(uas->cmdLock);
+	ret = usb_transferBulk(uas->drv, uas->pipeCmd, &t->iu, sizeof(t->iu), usb_dir_out);
+	mutexUnlock(uas->cmdLock);
+
+	if (ret != sizeof(t->iu)) {
+		mutexLock(uas->lock);
+		t->state = uas_tagFree;
+		condBroadcast(uas->cond);
+		mutexUnlock(uas->lock);
+		return -EIO;
+	}
+
+	return i;
+}
+
+
+static int umass_uasWait(umass_uas_t *uas, int tag)
+{
+	umass_uasTag_t *t = &uas->tags[tag];
+	int ret;
+
+	mutexLock(uas->lock);
+	while ((t->state != uas_tagDone) && !uas->dead) {
+		condWait(uas->cond, uas->lock, 0);
+	}
+
+	ret = (t->state == uas_tagDone) ? t->ret : -EIO;
+	t->state = uas_tagFree;
+	condBroadcast(uas->cond);
+	mutexUnlock(uas->lock);
+
+	return ret;
+}
+
+
+static int _umass_uasTransmit(umass_uas_t *uas, void *cmd, size_t clen, char *data, size_t dlen, int dir)
+{
+	int ret = -EIO, tag, i;
+
+	for (i = 0; i < UMASS_TRANSMIT_RETRIES; i++) {
+		tag = _umass_uasSubmit(uas, cmd, clen, data, dlen, dir);
+		if (tag < 0) {
+			return tag;
+		}
+
+		ret = umass_uasWait(uas, tag);
+		if (ret != -EAGAIN) {
+			break;
+		}
+	}
+
+	return (ret == -EAGAIN) ? -EIO : ret;
+}
+
+
+static int _umass_transmit(umass_dev_t *dev, void *cmd, size_t clen, char *data, size_t dlen, int dir)
+{
+	if (dev->uas != NULL) {
+		return _umass_uasTransmit(dev->uas, cmd, clen, data, dlen, dir);
+	}
+
+	return _umass_botTransmit(dev, cmd, clen, data, dlen, dir);
+}
+
+
 /* Left commented out: can be useful when handling devices of other types than direct-access
  * (non-zero "Peripheral Device Type" in INQUIRY) */
 #if 0
@@ -354,6 +613,57 @@ static int umass_scsiInquiry(umass_dev_t *dev, char *odata)
 }
 
 
+/* Returns nonzero if the VPD page is listed in Supported VPD Pages, devices may stall on unsupported ones */
+static int _umass_scsiVpdSupported(umass_dev_t *dev, uint8_t page)
+{
+	scsi_vpd_pages_t *pages = (scsi_vpd_pages_t *)dev->buffer;
+	scsi_cdb6_t inquiryCmd = {
+		.opcode = SCSI_INQUIRY,
+		.misc0 = { 0x01, SCSI_VPD_SUPPORTED_PAGES, 0x00 },
+		.length = UMASS_VPD_LISTSZ,
+	};
+	int ret, i, n;
+
+	ret = _umass_transmit(dev, &inquiryCmd, sizeof(inquiryCmd), dev->buffer, UMASS_VPD_LISTSZ, usb_dir_in);
+	if ((ret < 4) || (pages->pagecode != SCSI_VPD_SUPPORTED_PAGES)) {
+		return 0;
+	}
+
+	n = min(ntohs(pages->pagelen), ret - 4);
+	for (i = 0; i < n; i++) {
+		if (pages->pages[i] == page) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+
+/* Sets per-command transfer size basing on Block Limits VPD page (if supported) */
+static void _umass_scsiBlockLimits(umass_dev_t *dev)
+{
+	scsi_vpd_blocklimits_t *limits = (scsi_vpd_blocklimits_t *)dev->buffer;
+	scsi_cdb6_t inquiryCmd = {
+		.opcode = SCSI_INQUIRY,
+		.misc0 = { 0x01, SCSI_VPD_BLOCK_LIMITS, 0x00 },
+		.length = sizeof(scsi_vpd_blocklimits_t),
+	};
+	uint32_t sectors = UMASS_DEF_XFER_SECTORS;
+	int ret;
+
+	if (_umass_scsiVpdSupported(dev, SCSI_VPD_BLOCK_LIMITS) != 0) {
+		ret = _umass_transmit(dev, &inquiryCmd, sizeof(inquiryCmd), dev->buffer, sizeof(scsi_vpd_blocklimits_t), usb_dir_in);
+		if ((ret >= 12) && (limits->pagecode == SCSI_VPD_BLOCK_LIMITS) && (limits->maxxfer != 0)) {
+			sectors = min(ntohl(limits->maxxfer), UMASS_MAX_XFER_SECTORS);
+		}
+	}
+
+	dev->maxXfer = (size_t)sectors * UMASS_SECTOR_SIZE;
+	DEBUG("max transfer length: %zu bytes", dev->maxXfer);
+}
+
+
 static int _umass_scsiInit(umass_dev_t *dev)
 {
 	int ret;
@@ -393,7 +703,7 @@ static int _umass_scsiInit(umass_dev_t *dev)
 static int _umass_check(umass_dev_t *dev)
 {
 	scsi_cdb10_t readcmd = {
-		.opcode = 0x28,
+		.opcode = SCSI_READ10,
 		.length = htons(0x1)
 	};
 	mbr_t *mbr;
@@ -415,8 +725,8 @@ static int _umass_check(umass_dev_t *dev)
 	/* Read only the first partition */
 	dev->part.start = mbr->pent[0].start;
 	dev->part.sectors = mbr->pent[0].sectors;
-	dev->part.fs = NULL;
-	dev->part.fdata = NULL;
+	dev->part.mnt.fs = NULL;
+	dev->part.mnt.fdata = NULL;
 	dev->part.idx = 0;
 
 	DEBUG("part.start=0x%x, part.sectors=0x%x", dev->part.start, dev->part.sectors);
@@ -425,261 +735,446 @@ static int _umass_check(umass_dev_t *dev)
 }
 
 
-static umass_fs_t *umass_getfs(const char *name)
+/* UAS variant of umass_xferDev, commands of the request are queued at once and may complete in any order */
+static int umass_uasXferDev(umass_dev_t *dev, uint8_t opcode, off_t offs, char *buf, size_t len, int dir)
 {
-	umass_fs_t fs;
-
-	strcpy(fs.name, name);
-
-	return lib_treeof(umass_fs_t, node, lib_rbFind(&umass_common.fss, &fs.node));
-}
-
+	scsi_cdb10_t cmd = { .opcode = opcode };
+	struct {
+		int tag;
+		size_t offs;
+		size_t len;
+	} q[UMASS_UAS_REQ_DEPTH], *e;
+	size_t queued = 0, done = 0;
+	unsigned int first = 0, n = 0;
+	int ret, err = 0;
+
+	while ((n > 0) || ((queued < len) && (err == 0))) {
+		if ((queued < len) && (err == 0) && (n < UMASS_UAS_REQ_DEPTH)) {
+			e = &q[(first + n) % UMASS_UAS_REQ_DEPTH];
+			e->offs = queued;
+			e->len = min(len - queued, dev->maxXfer);
+
+			cmd.lba = htonl((offs + e->offs) / UMASS_SECTOR_SIZE);
+			cmd.length = htons((uint16_t)(e->len / UMASS_SECTOR_SIZE));
+			e->tag = _umass_uasSubmit(dev->uas, &cmd, sizeof(cmd), buf + e->offs, e->len, dir);
+			if (e->tag < 0) {
+				err = e->tag;
+			}
+			else {
+				queued += e->len;
+				n++;
+			}
+			continue;
+		}
 
-/* TODO: handle mounting other filesystems than ext2 */
-#if 0
-static umass_fs_t *umass_findfs(uint8_t type)
-{
-	rbnode_t *node;
-	umass_fs_t *fs;
+		/* Completions are collected in order, so done is always a contiguous prefix */
+		e = &q[first];
+		first = (first + 1) % UMASS_UAS_REQ_DEPTH;
+		n--;
 
-	for (node = lib_rbMinimum(umass_common.fss.root); node != NULL; node = lib_rbNext(node)) {
-		fs = lib_treeof(umass_fs_t, node, node);
+		ret = umass_uasWait(dev->uas, e->tag);
+		if (ret == -EAGAIN) {
+			cmd.lba = htonl((offs + e->offs) / UMASS_SECTOR_SIZE);
+			cmd.length = htons((uint16_t)(e->len / UMASS_SECTOR_SIZE));
+			ret = _umass_uasTransmit(dev->uas, &cmd, sizeof(cmd), buf + e->offs, e->len, dir);
+		}
 
-		if (fs->type == type) {
-			return fs;
+		if (err == 0) {
+			if (ret > 0) {
+				done += ret;
+			}
+			if (ret != e->len) {
+				err = (ret < 0) ? ret : -EIO;
+			}
 		}
 	}
 
-	return NULL;
+	return (done > 0) ? (int)done : err;
 }
-#endif
 
 
-static int umass_readFromDev(umass_dev_t *dev, off_t offs, char *buf, size_t len)
+/* Transfers data between caller buffer and device (offs is absolute), splitting it into commands of at most dev->maxXfer bytes */
+static int umass_xferDev(umass_dev_t *dev, uint8_t opcode, off_t offs, char *buf, size_t len, int dir)
 {
-	scsi_cdb10_t readcmd = { .opcode = 0x28 };
-	int ret;
+	scsi_cdb10_t cmd = { .opcode = opcode };
+	size_t done = 0, chunk;
+	int ret = 0;
 
-	if ((offs % UMASS_SECTOR_SIZE) || (len % UMASS_SECTOR_SIZE)) {
-		return -EINVAL;
+	if (dev->uas != NULL) {
+		return umass_uasXferDev(dev, opcode, offs, buf, len, dir);
 	}
 
-	if (offs + len > dev->part.sectors * UMASS_SECTOR_SIZE) {
-		return -EINVAL;
-	}
+	while (done < len) {
+		chunk = min(len - done, dev->maxXfer);
 
-	len = min(len, sizeof(dev->buffer));
+		cmd.lba = htonl((offs + done) / UMASS_SECTOR_SIZE);
+		cmd.length = htons((uint16_t)(chunk / UMASS_SECTOR_SIZE));
 
-	readcmd.lba = htonl(offs / UMASS_SECTOR_SIZE + dev->part.start);
-	readcmd.length = htons((uint16_t)(len / UMASS_SECTOR_SIZE));
+		/* Data phase goes straight to/from caller buffer */
+		mutexLock(dev->lock);
+		ret = _umass_transmit(dev, &cmd, sizeof(cmd), buf + done, chunk, dir);
+		mutexUnlock(dev->lock);
+		if (ret <= 0) {
+			break;
+		}
 
-	mutexLock(dev->lock);
-	ret = _umass_transmit(dev, &readcmd, sizeof(readcmd), dev->buffer, len, usb_dir_in);
-	if (ret > 0) {
-		memcpy(buf, dev->buffer, len);
+		done += ret;
+		if (ret != chunk) {
+			break;
+		}
 	}
-	else if (len > 0) {
-		printf("read transmit failed for offs: %lld\n", offs);
+
+	/* Nothing transferred is an error, callers would take it as end of media */
+	if (done == 0) {
+		return (ret < 0) ? ret : -EIO;
 	}
-	mutexUnlock(dev->lock);
 
-	return ret;
+	return (int)done;
 }
 
 
-static int umass_writeToDev(umass_dev_t *dev, off_t offs, const char *buf, size_t len)
+#ifdef UMASS_BLKCACHE
+static ssize_t umass_cacheReadCb(uint64_t offs, void *buff, size_t len, cache_devCtx_t *ctx)
 {
-	scsi_cdb10_t writecmd = { .opcode = 0x2a };
-	int ret;
+	umass_dev_t *dev = ctx->dev;
 
-	if ((offs % UMASS_SECTOR_SIZE) || (len % UMASS_SECTOR_SIZE)) {
-		return -EINVAL;
+	if (ctx->noFlush) {
+		return len;
 	}
 
-	if (offs + len > dev->part.sectors * UMASS_SECTOR_SIZE) {
-		return -EINVAL;
+	if (dev->inRa) {
+		dev->stats.readahead++;
+	}
+	else {
+		dev->stats.misses++;
 	}
 
-	len = min(len, sizeof(dev->buffer));
+	return umass_xferDev(dev, SCSI_READ10, offs, buff, len, usb_dir_in);
+}
 
-	writecmd.lba = htonl(offs / UMASS_SECTOR_SIZE + dev->part.start);
-	writecmd.length = htons((uint16_t)(len / UMASS_SECTOR_SIZE));
 
-	mutexLock(dev->lock);
-	memcpy(dev->buffer, buf, len);
-	ret = _umass_transmit(dev, &writecmd, sizeof(writecmd), dev->buffer, len, usb_dir_out);
-	mutexUnlock(dev->lock);
-	if (ret < 0) {
-		fprintf(stderr, "write transmit failed for offs: %lld\n", offs);
+static ssize_t umass_cacheWriteCb(uint64_t offs, const void *buff, size_t len, cache_devCtx_t *ctx)
+{
+	if (ctx->noFlush) {
+		return len;
 	}
 
-	return ret;
+	return umass_xferDev(ctx->dev, SCSI_WRITE10, offs, (char *)buff, len, usb_dir_out);
 }
 
 
-static int umass_getattr(umass_dev_t *dev, int type, long long int *attr)
+static int umass_cacheInit(umass_dev_t *dev)
 {
-	if (type != atSize)
-		return -EINVAL;
+	cache_ops_t cacheOps;
 
-	*attr = dev->part.sectors * UMASS_SECTOR_SIZE;
+	dev->cache = NULL;
+	dev->raBuff = NULL;
+	if (!umass_common.cache) {
+		return 0;
+	}
 
-	return EOK;
-}
+	if (mutexCreate(&dev->cacheLock) < 0) {
+		return -ENOMEM;
+	}
 
+	dev->cacheCtx.dev = dev;
+	dev->cacheCtx.noFlush = false;
+	dev->raNext = -1;
+	dev->inRa = false;
+	memset(&dev->stats, 0, sizeof(dev->stats));
+
+	cacheOps.readCb = umass_cacheReadCb;
+	cacheOps.writeCb = umass_cacheWriteCb;
+	cacheOps.ctx = &dev->cacheCtx;
+	dev->cache = cache_init((uint64_t)(dev->part.start + dev->part.sectors) * UMASS_SECTOR_SIZE, UMASS_CACHE_LINESZ, UMASS_CACHE_LINES, &cacheOps);
+	if (dev->cache == NULL) {
+		resourceDestroy(dev->cacheLock);
+		return -ENOMEM;
+	}
 
-static umass_dev_t *_umass_devFind(id_t id)
-{
-	return lib_treeof(umass_dev_t, node, idtree_find(&umass_common.devices, id));
+	return 0;
 }
 
 
-static ssize_t umass_read(id_t id, off_t offs, char *buf, size_t len)
+static void umass_cacheDestroy(umass_dev_t *dev)
 {
-	mutexLock(umass_common.lock);
-	umass_dev_t *dev = _umass_devFind(id);
-	mutexUnlock(umass_common.lock);
-	if (dev == NULL) {
-		return -ENODEV;
+	if (dev->cache == NULL) {
+		return;
 	}
-	return umass_readFromDev(dev, offs, buf, len);
-}
 
-
-static ssize_t umass_write(id_t id, off_t offs, const char *buf, size_t len)
-{
-	mutexLock(umass_common.lock);
-	umass_dev_t *dev = _umass_devFind(id);
-	mutexUnlock(umass_common.lock);
-	if (dev == NULL) {
-		return -ENODEV;
+	mutexLock(dev->cacheLock);
+	if (cache_flush(dev->cache, 0, (uint64_t)(dev->part.start + dev->part.sectors) * UMASS_SECTOR_SIZE) < 0) {
+		LOG_ERROR("%s: failed to flush cache, dirty data lost", dev->path);
 	}
-	return umass_writeToDev(dev, offs, buf, len);
+	dev->cacheCtx.noFlush = true;
+	cache_deinit(dev->cache);
+	dev->cache = NULL;
+	free(dev->raBuff);
+	dev->raBuff = NULL;
+	mutexUnlock(dev->cacheLock);
+
+	resourceDestroy(dev->cacheLock);
 }
 
 
-static int umass_mountFromDev(umass_dev_t *dev, const char *name, oid_t *oid)
+static int umass_cachedRead(umass_dev_t *dev, off_t offs, char *buf, size_t len)
 {
-	umass_fs_t *fs;
-	int err;
+	ssize_t ret;
+	off_t end = (off_t)(dev->part.start + dev->part.sectors) * UMASS_SECTOR_SIZE;
 
-	if (dev == NULL) {
-		return -ENODEV;
-	}
+	mutexLock(dev->cacheLock);
 
-	if (dev->part.fs != NULL) {
-		return -EEXIST;
+	if (len >= UMASS_CACHE_BYPASS) {
+		/* Write back dirty lines of the range before reading it from device */
+		ret = cache_flush(dev->cache, offs, offs + len);
+		if (ret >= 0) {
+			ret = umass_xferDev(dev, SCSI_READ10, offs, buf, len, usb_dir_in);
+		}
+		if (ret > 0) {
+			dev->stats.bypassed += ret;
+		}
 	}
+	else {
+		dev->stats.lookups += (offs + len + UMASS_CACHE_LINESZ - 1) / UMASS_CACHE_LINESZ - offs / UMASS_CACHE_LINESZ;
+		ret = cache_read(dev->cache, offs, buf, len);
 
-	fs = umass_getfs(name);
-	if (fs == NULL) {
-		return -ENOENT;
+		/* Sequential access detected, fetch following lines into cache */
+		if ((ret == len) && (offs == dev->raNext) && (offs + len < end)) {
+			if (dev->raBuff == NULL) {
+				dev->raBuff = malloc(UMASS_RA_SIZE);
+			}
+			/* Skip read-ahead if the buffer cannot be allocated, retry on next sequential read */
+			if (dev->raBuff != NULL) {
+				dev->inRa = true;
+				(void)cache_read(dev->cache, offs + len, dev->raBuff, min((off_t)UMASS_RA_SIZE, end - (offs + len)));
+				dev->inRa = false;
+			}
+		}
 	}
-	dev->part.fs = fs;
+	dev->raNext = offs + len;
 
-	err = portCreate(&dev->part.port);
-	if (err != 0) {
-		fprintf(stderr, "umass: Can't create partition port!\n");
-		return 1;
+	mutexUnlock(dev->cacheLock);
+
+	return ret;
+}
+
+
+static int umass_cachedWrite(umass_dev_t *dev, off_t offs, const char *buf, size_t len)
+{
+	ssize_t ret;
+
+	mutexLock(dev->cacheLock);
+
+	if (len >= UMASS_CACHE_BYPASS) {
+		/* Partially covered dirty lines have to reach device before their lines are dropped */
+		ret = cache_flush(dev->cache, offs, offs + len);
+		if (ret >= 0) {
+			ret = umass_xferDev(dev, SCSI_WRITE10, offs, (char *)buf, len, usb_dir_out);
+		}
+		if (ret > 0) {
+			dev->stats.bypassed += ret;
+		}
+		(void)cache_invalidate(dev->cache, offs, offs + len);
+	}
+	else {
+		ret = cache_write(dev->cache, offs, buf, len, LIBCACHE_WRITE_BACK);
 	}
 
-	oid->port = dev->part.port;
-	oid->id = dev->fileId;
+	mutexUnlock(dev->cacheLock);
 
-	err = fs->mount(oid, UMASS_SECTOR_SIZE, umass_read, umass_write, &dev->part.fdata);
-	if (err < 0) {
-		return err;
+	return ret;
+}
+#endif
+
+
+static int umass_sync(umass_dev_t *dev)
+{
+	int ret = EOK;
+
+#ifdef UMASS_BLKCACHE
+	if (dev->cache != NULL) {
+		mutexLock(dev->cacheLock);
+		ret = cache_flush(dev->cache, 0, (uint64_t)(dev->part.start + dev->part.sectors) * UMASS_SECTOR_SIZE);
+		mutexUnlock(dev->cacheLock);
 	}
-	oid->id = err;
+#endif
 
-	err = beginthread(umass_fsthr, 4, dev->part.fsstack, sizeof(dev->part.fsstack), &dev->part);
-	if (err < 0) {
-		dev->part.fs->unmount(dev->part.fdata);
-		dev->part.fs = NULL;
-		dev->part.fdata = NULL;
-		return err;
+	return (ret < 0) ? ret : EOK;
+}
+
+
+static int umass_devCtl(umass_dev_t *dev, msg_t *msg)
+{
+	const umass_i_devctl_t *idevctl = (const umass_i_devctl_t *)msg->i.raw;
+	umass_o_devctl_t *odevctl = (umass_o_devctl_t *)msg->o.raw;
+
+	if (blksrv_isStats(msg)) {
+		return blksrv_stats(&umass_common.srv, &dev->part.mnt, msg);
 	}
 
-	return EOK;
+	switch (idevctl->type) {
+		case umass_devctl_cacheStats:
+#ifdef UMASS_BLKCACHE
+			if (dev->cache != NULL) {
+				mutexLock(dev->cacheLock);
+				odevctl->cacheStats = dev->stats;
+				mutexUnlock(dev->cacheLock);
+				return EOK;
+			}
+#endif
+			(void)odevctl;
+			return -ENOSYS;
+
+		default:
+			return -ENOSYS;
+	}
 }
 
 
-static int umass_mount(id_t id, const char *name, oid_t *oid)
+static int umass_readFromDev(umass_dev_t *dev, off_t offs, char *buf, size_t len)
 {
-	umass_dev_t *dev;
+	int ret;
 
-	mutexLock(umass_common.lock);
-	dev = _umass_devFind(id);
-	mutexUnlock(umass_common.lock);
+	if ((offs % UMASS_SECTOR_SIZE) || (len % UMASS_SECTOR_SIZE)) {
+		return -EINVAL;
+	}
 
-	return umass_mountFromDev(dev, name, oid);
+	if (offs + len > dev->part.sectors * UMASS_SECTOR_SIZE) {
+		return -EINVAL;
+	}
+
+	offs += (off_t)dev->part.start * UMASS_SECTOR_SIZE;
+
+#ifdef UMASS_BLKCACHE
+	if (dev->cache != NULL) {
+		ret = umass_cachedRead(dev, offs, buf, len);
+	}
+	else
+#endif
+	{
+		ret = umass_xferDev(dev, SCSI_READ10, offs, buf, len, usb_dir_in);
+	}
+	if ((ret <= 0) && (len > 0)) {
+		printf("read transmit failed for offs: %lld\n", offs);
+	}
+
+	return ret;
 }
 
 
-static void umass_fsthr(void *arg)
+static int umass_writeToDev(umass_dev_t *dev, off_t offs, const char *buf, size_t len)
 {
-	umass_part_t *part = (umass_part_t *)arg;
-	umass_req_t *req;
-	int umount = 0, ret;
+	int ret;
 
-	for (;;) {
-		req = (umass_req_t *)malloc(sizeof(umass_req_t));
-		if (req == NULL) {
-			continue;
-		}
+	if ((offs % UMASS_SECTOR_SIZE) || (len % UMASS_SECTOR_SIZE)) {
+		return -EINVAL;
+	}
 
-		req->part = part;
+	if (offs + len > dev->part.sectors * UMASS_SECTOR_SIZE) {
+		return -EINVAL;
+	}
 
-		ret = -1;
-		while (ret < 0) {
-			ret = msgRecv(req->part->port, &req->msg, &req->rid);
-		}
+	offs += (off_t)dev->part.start * UMASS_SECTOR_SIZE;
 
-		if (req->msg.type == mtUmount) {
-			umount = 1;
-		}
+#ifdef UMASS_BLKCACHE
+	if (dev->cache != NULL) {
+		ret = umass_cachedWrite(dev, offs, buf, len);
+	}
+	else
+#endif
+	{
+		ret = umass_xferDev(dev, SCSI_WRITE10, offs, (char *)buf, len, usb_dir_out);
+	}
+	if (ret < 0) {
+		fprintf(stderr, "write transmit failed for offs: %lld\n", offs);
+	}
+
+	return ret;
+}
+
+
+static int umass_getattr(umass_dev_t *dev, int type, long long int *attr)
+{
+	if (type != atSize)
+		return -EINVAL;
 
-		mutexLock(umass_common.rlock);
+	*attr = dev->part.sectors * UMASS_SECTOR_SIZE;
 
-		LIST_ADD(&umass_common.rqueue, req);
+	return EOK;
+}
 
-		mutexUnlock(umass_common.rlock);
-		condSignal(umass_common.rcond);
 
-		if (umount != 0) {
-			endthread();
-		}
+static umass_dev_t *_umass_devFind(id_t id)
+{
+	return lib_treeof(umass_dev_t, node, idtree_find(&umass_common.devices, id));
+}
+
+
+static ssize_t umass_read(id_t id, off_t offs, char *buf, size_t len)
+{
+	mutexLock(umass_common.lock);
+	umass_dev_t *dev = _umass_devFind(id);
+	mutexUnlock(umass_common.lock);
+	if (dev == NULL) {
+		return -ENODEV;
 	}
+	return umass_readFromDev(dev, offs, buf, len);
 }
 
 
-static void umass_poolthr(void *arg)
+static ssize_t umass_write(id_t id, off_t offs, const char *buf, size_t len)
 {
-	umass_req_t *req;
+	mutexLock(umass_common.lock);
+	umass_dev_t *dev = _umass_devFind(id);
+	mutexUnlock(umass_common.lock);
+	if (dev == NULL) {
+		return -ENODEV;
+	}
+	return umass_writeToDev(dev, offs, buf, len);
+}
 
-	for (;;) {
-		mutexLock(umass_common.rlock);
 
-		while (umass_common.rqueue == NULL) {
-			condWait(umass_common.rcond, umass_common.rlock, 0);
-		}
-		req = umass_common.rqueue->prev;
-		LIST_REMOVE(&umass_common.rqueue, req);
+static int umass_mountFromDev(umass_dev_t *dev, const char *name, oid_t *oid)
+{
+	blksrv_fs_t *fs;
+	int err;
 
-		mutexUnlock(umass_common.rlock);
+	if (dev == NULL) {
+		return -ENODEV;
+	}
 
-		if (req->msg.type == mtUmount) {
-			req->part->fs->unmount(req->part->fdata);
-			req->part->fs = NULL;
-			req->part->fdata = NULL;
-		}
-		else {
-			req->part->fs->handler(req->part->fdata, &req->msg);
-		}
+	if (dev->part.mnt.fs != NULL) {
+		return -EEXIST;
+	}
+
+	/* TODO: handle mounting other filesystems than ext2 */
+	fs = blksrv_getfs(&umass_common.srv, name);
+	if (fs == NULL) {
+		return -ENOENT;
+	}
 
-		msgRespond(req->part->port, &req->msg, req->rid);
-		free(req);
+	err = portCreate(&dev->part.mnt.port);
+	if (err != 0) {
+		fprintf(stderr, "umass: Can't create partition port!\n");
+		return 1;
 	}
+
+	oid->port = dev->part.mnt.port;
+	oid->id = dev->fileId;
+
+	return blksrv_mount(&umass_common.srv, &dev->part.mnt, fs, UMASS_SECTOR_SIZE, oid);
+}
+
+
+static int umass_mount(id_t id, const char *name, oid_t *oid)
+{
+	umass_dev_t *dev;
+
+	mutexLock(umass_common.lock);
+	dev = _umass_devFind(id);
+	mutexUnlock(umass_common.lock);
+
+	return umass_mountFromDev(dev, name, oid);
 }
 
 
@@ -736,6 +1231,14 @@ static void umass_msgthr(void *arg)
 				msg.o.err = umass_getattr(dev, msg.i.attr.type, &msg.o.attr.val);
 				break;
 
+			case mtSync:
+				msg.o.err = umass_sync(dev);
+				break;
+
+			case mtDevCtl:
+				msg.o.err = umass_devCtl(dev, &msg);
+				break;
+
 			default:
 				msg.o.err = -ENOSYS;
 				break;
@@ -753,7 +1256,7 @@ static umass_dev_t *umass_devAlloc(void)
 	umass_dev_t *dev;
 	int rv;
 
-	dev = malloc(sizeof(umass_dev_t));
+	dev = calloc(1, sizeof(umass_dev_t));
 	if (dev == NULL) {
 		fprintf(stderr, "umass: Not enough memory\n");
 		return NULL;
@@ -770,6 +1273,7 @@ static umass_dev_t *umass_devAlloc(void)
 
 	rv = snprintf(dev->path, sizeof(dev->path), "/dev/umass%d", dev->fileId);
 	if (rv < 0) {
+		idtree_remove(&umass_common.devices, &dev->node);
 		resourceDestroy(dev->lock);
 		free(dev);
 		return NULL;
@@ -779,6 +1283,247 @@ static umass_dev_t *umass_devAlloc(void)
 }
 
 
+/* Frees device which failed before its bring-up thread was started */
+static void umass_devFree(umass_dev_t *dev)
+{
+	mutexLock(umass_common.lock);
+	idtree_remove(&umass_common.devices, &dev->node);
+	mutexUnlock(umass_common.lock);
+
+	resourceDestroy(dev->lock);
+	free(dev->bringupStack);
+	free(dev);
+}
+
+
+static int umass_setInterface(umass_dev_t *dev, int iface, int alt)
+{
+	usb_setup_packet_t setup = {
+		.bmRequestType = REQUEST_DIR_HOST2DEV | REQUEST_TYPE_STANDARD | REQUEST_RECIPIENT_INTERFACE,
+		.bRequest = REQ_SET_INTERFACE,
+		.wValue = alt,
+		.wIndex = iface,
+		.wLength = 0,
+	};
+
+	return usb_transferControl(dev->drv, dev->pipeCtrl, &setup, NULL, 0, usb_dir_out);
+}
+
+
+/* Reads configuration descriptor with all interface and endpoint descriptors into dev->buffer */
+static int _umass_configDesc(umass_dev_t *dev, size_t *total)
+{
+	usb_setup_packet_t setup = {
+		.bmRequestType = REQUEST_DIR_DEV2HOST | REQUEST_TYPE_STANDARD | REQUEST_RECIPIENT_DEVICE,
+		.bRequest = REQ_GET_DESCRIPTOR,
+		.wValue = USB_DESC_CONFIG << 8,
+		.wIndex = 0,
+		.wLength = sizeof(usb_configuration_desc_t),
+	};
+	const usb_configuration_desc_t *conf = (const usb_configuration_desc_t *)dev->buffer;
+
+	if (usb_transferControl(dev->drv, dev->pipeCtrl, &setup, dev->buffer, setup.wLength, usb_dir_in) != setup.wLength) {
+		return -EIO;
+	}
+
+	*total = min(conf->wTotalLength, sizeof(dev->buffer));
+	setup.wLength = *total;
+	if (usb_transferControl(dev->drv, dev->pipeCtrl, &setup, dev->buffer, *total, usb_dir_in) != (int)*total) {
+		return -EIO;
+	}
+
+	return 0;
+}
+
+
+/* Finds bulk endpoint addresses of the interface default setting, used for Bulk-Only Transport halt clearing */
+static void _umass_botFindEndpoints(umass_dev_t *dev, int iface)
+{
+	const usb_interface_desc_t *intf;
+	const usb_endpoint_desc_t *ep;
+	const uint8_t *desc;
+	size_t offs, total;
+	bool found = false;
+
+	dev->epIn = 0;
+	dev->epOut = 0;
+
+	if (_umass_configDesc(dev, &total) < 0) {
+		return;
+	}
+
+	for (offs = 0; offs + 2 <= total; offs += desc[0]) {
+		desc = (const uint8_t *)dev->buffer + offs;
+		if ((desc[0] < 2) || (offs + desc[0] > total)) {
+			break;
+		}
+
+		if (desc[1] == USB_DESC_INTERFACE) {
+			if (found) {
+				break;
+			}
+
+			intf = (const usb_interface_desc_t *)desc;
+			found = (intf->bInterfaceNumber == iface) && (intf->bAlternateSetting == 0);
+		}
+		else if (found && (desc[1] == USB_DESC_ENDPOINT) && (desc[0] >= sizeof(usb_endpoint_desc_t))) {
+			ep = (const usb_endpoint_desc_t *)desc;
+			if ((ep->bmAttributes & 0x3) == 0x2) {
+				if ((ep->bEndpointAddress & 0x80) != 0) {
+					dev->epIn = ep->bEndpointAddress;
+				}
+				else {
+					dev->epOut = ep->bEndpointAddress;
+				}
+			}
+		}
+	}
+}
+
+
+/* Finds the UAS alternate setting of the interface, fills pipe directions in endpoint descriptors order */
+static int _umass_uasFindAlt(umass_dev_t *dev, int iface, uint8_t pipeIds[4])
+{
+	const usb_interface_desc_t *intf;
+	const uint8_t *desc;
+	size_t offs, total;
+	int alt = -1, n = 0;
+
+	if (_umass_configDesc(dev, &total) < 0) {
+		return -EIO;
+	}
+
+	for (offs = 0; offs + 2 <= total; offs += desc[0]) {
+		desc = (const uint8_t *)dev->buffer + offs;
+		if ((desc[0] < 2) || (offs + desc[0] > total)) {
+			break;
+		}
+
+		if (desc[1] == USB_DESC_INTERFACE) {
+			if (alt >= 0) {
+				break;
+			}
+
+			intf = (const usb_interface_desc_t *)desc;
+			if ((intf->bInterfaceNumber == iface) && (intf->bInterfaceClass == USB_CLASS_MASS_STORAGE) &&
+					(intf->bInterfaceSubClass == USB_SUBCLASS_SCSI) && (intf->bInterfaceProtocol == USB_PROTOCOL_UAS)) {
+				alt = intf->bAlternateSetting;
+			}
+		}
+		else if ((alt >= 0) && (desc[1] == USB_DESC_ENDPOINT) && (n < 4)) {
+			pipeIds[n++] = 0;
+		}
+		else if ((alt >= 0) && (desc[1] == UAS_DESC_PIPE_USAGE) && (n > 0)) {
+			pipeIds[n - 1] = ((const uas_pipeUsageDesc_t *)desc)->bPipeID;
+		}
+	}
+
+	return (n == 4) ? alt : -ENOENT;
+}
+
+
+/* Switches the interface to UAS if the device supports it, -ENOENT - the device stays on Bulk-Only Transport */
+static int umass_uasProbe(umass_dev_t *dev, usb_devinfo_t *insertion)
+{
+	uint8_t pipeIds[4];
+	int pipes[UAS_PIPE_DATAOUT + 1] = { -1, -1, -1, -1, -1 };
+	umass_uas_t *uas;
+	int alt, i, err;
+
+	alt = _umass_uasFindAlt(dev, insertion->interface, pipeIds);
+	if (alt < 0) {
+		return -ENOENT;
+	}
+
+	if ((alt != 0) && (umass_setInterface(dev, insertion->interface, alt) < 0)) {
+		return -ENOENT;
+	}
+
+	/* Pipes of the same type and direction are assumed to be opened in endpoint descriptors order */
+	for (i = 0; i < 4; i++) {
+		if ((pipeIds[i] < UAS_PIPE_CMD) || (pipeIds[i] > UAS_PIPE_DATAOUT) || (pipes[pipeIds[i]] >= 0)) {
+			break;
+		}
+
+		pipes[pipeIds[i]] = usb_open(dev->drv, insertion, usb_transfer_bulk,
+				((pipeIds[i] == UAS_PIPE_CMD) || (pipeIds[i] == UAS_PIPE_DATAOUT)) ? usb_dir_out : usb_dir_in);
+		if (pipes[pipeIds[i]] < 0) {
+			break;
+		}
+	}
+
+	if ((i != 4) || (pipes[UAS_PIPE_CMD] == pipes[UAS_PIPE_DATAOUT]) || (pipes[UAS_PIPE_STATUS] == pipes[UAS_PIPE_DATAIN])) {
+		LOG_ERROR("%s: can't open UAS pipes, falling back to Bulk-Only Transport", dev->path);
+		(void)umass_setInterface(dev, insertion->interface, 0);
+		return -ENOENT;
+	}
+
+	if ((uas = calloc(1, sizeof(*uas))) == NULL) {
+		(void)umass_setInterface(dev, insertion->interface, 0);
+		return -ENOMEM;
+	}
+
+	uas->drv = dev->drv;
+	uas->pipeCmd = pipes[UAS_PIPE_CMD];
+	uas->pipeStatus = pipes[UAS_PIPE_STATUS];
+	uas->pipeDataIn = pipes[UAS_PIPE_DATAIN];
+	uas->pipeDataOut = pipes[UAS_PIPE_DATAOUT];
+
+	do {
+		if ((err = mutexCreate(&uas->lock)) < 0) {
+			break;
+		}
+
+		if ((err = mutexCreate(&uas->cmdLock)) < 0) {
+			resourceDestroy(uas->lock);
+			break;
+		}
+
+		if ((err = condCreate(&uas->cond)) < 0) {
+			resourceDestroy(uas->cmdLock);
+			resourceDestroy(uas->lock);
+			break;
+		}
+
+		if ((err = beginthreadex(umass_uasStatusThr, 4, uas->stack, sizeof(uas->stack), uas, &uas->tid)) < 0) {
+			resourceDestroy(uas->cond);
+			resourceDestroy(uas->cmdLock);
+			resourceDestroy(uas->lock);
+			break;
+		}
+	} while (0);
+
+	if (err < 0) {
+		free(uas);
+		(void)umass_setInterface(dev, insertion->interface, 0);
+		return err;
+	}
+
+	dev->uas = uas;
+	DEBUG("%s: UAS transport, alt setting %d", dev->path, alt);
+
+	return EOK;
+}
+
+
+/* Called after device removal, when the status pipe transfer has failed */
+static void umass_uasDestroy(umass_dev_t *dev)
+{
+	umass_uas_t *uas = dev->uas;
+
+	if (uas == NULL) {
+		return;
+	}
+
+	threadJoin(uas->tid, 0);
+	resourceDestroy(uas->cond);
+	resourceDestroy(uas->cmdLock);
+	resourceDestroy(uas->lock);
+	free(uas);
+	dev->uas = NULL;
+}
+
+
 static int umass_mountRoot(umass_dev_t *dev)
 {
 #ifdef UMASS_MOUNT_EXT2
@@ -802,117 +1547,212 @@ static int umass_mountRoot(umass_dev_t *dev)
 }
 
 
+/* Returns time since *last [ms] and moves *last to now */
+static unsigned int umass_phase(time_t *last)
+{
+	time_t now, ret;
+
+	gettime(&now, NULL);
+	ret = now - *last;
+	*last = now;
+
+	return (unsigned int)(ret / 1000);
+}
+
+
+static void umass_bringupThr(void *arg)
+{
+	umass_dev_t *dev = (umass_dev_t *)arg;
+	unsigned int tinit = 0, tlimits = 0, tcheck = 0, tcache = 0, tmount = 0;
+	time_t start, last;
+	bool mountRoot;
+	oid_t oid;
+	int err;
+
+	gettime(&start, NULL);
+	last = start;
+
+	do {
+		err = _umass_scsiInit(dev);
+		tinit = umass_phase(&last);
+		if (err < 0) {
+			fprintf(stderr, "umass: %s: device didn't initialize properly after scsi init sequence\n", dev->path);
+			break;
+		}
+
+		_umass_scsiBlockLimits(dev);
+		tlimits = umass_phase(&last);
+
+		err = _umass_check(dev);
+		tcheck = umass_phase(&last);
+		if (err < 0) {
+			fprintf(stderr, "umass: %s: umass_check failed\n", dev->path);
+			break;
+		}
+
+#ifdef UMASS_BLKCACHE
+		err = umass_cacheInit(dev);
+		tcache = umass_phase(&last);
+		if (err < 0) {
+			fprintf(stderr, "umass: %s: cache init failed\n", dev->path);
+			break;
+		}
+#endif
+
+		oid.port = umass_common.msgport;
+		oid.id = dev->fileId;
+		err = create_dev(&oid, dev->path);
+		if (err != 0) {
+			fprintf(stderr, "usb: Can't create dev!\n");
+			break;
+		}
+
+		printf("umass: New USB Mass Storage device: %s sectors: %d%s\n", dev->path, dev->part.sectors, (dev->uas != NULL) ? " (UAS)" : "");
+
+		/* Root is mounted from the first device which brings it up */
+		mutexLock(umass_common.lock);
+		mountRoot = umass_common.mount_root;
+		umass_common.mount_root = false;
+		mutexUnlock(umass_common.lock);
+
+		if (mountRoot) {
+			(void)umass_phase(&last);
+			err = umass_mountRoot(dev);
+			tmount = umass_phase(&last);
+			if (err < 0) {
+				fprintf(stderr, "umass: failed to mount root partition\n");
+				mutexLock(umass_common.lock);
+				umass_common.mount_root = true;
+				mutexUnlock(umass_common.lock);
+			}
+		}
+	} while (0);
+
+	printf("umass: %s: bring-up %s in %u ms (init %u, limits %u, check %u, cache %u, mount %u)\n", dev->path,
+		(err < 0) ? "failed" : "done", umass_phase(&start), tinit, tlimits, tcheck, tcache, tmount);
+
+	endthread();
+}
+
+
 static int umass_handleInsertion(usb_driver_t *drv, usb_devinfo_t *insertion)
 {
 	int err;
 	umass_dev_t *dev;
-	oid_t oid;
-	int ret;
 
 	fprintf(stderr, "umass: pending insertion\n");
 
 	mutexLock(umass_common.lock);
+	dev = umass_devAlloc();
+	mutexUnlock(umass_common.lock);
 
-	if ((dev = umass_devAlloc()) == NULL) {
+	if (dev == NULL) {
 		fprintf(stderr, "umass: devAlloc failed\n");
 		return -ENOMEM;
 	}
 
+	/* Slow media (TEST UNIT READY polling) must not delay the other devices */
+	dev->bringupStack = malloc(UMASS_BRINGUP_STACKSZ);
+	if (dev->bringupStack == NULL) {
+		umass_devFree(dev);
+		return -ENOMEM;
+	}
+
 	dev->drv = drv;
 	dev->instance = *insertion;
 	dev->pipeCtrl = usb_open(drv, insertion, usb_transfer_control, 0);
 	if (dev->pipeCtrl < 0) {
-		free(dev);
+		umass_devFree(dev);
 		fprintf(stderr, "umass: usb_open failed\n");
 		return -EINVAL;
 	}
 
 	err = usb_setConfiguration(drv, dev->pipeCtrl, 1);
 	if (err != 0) {
-		free(dev);
+		umass_devFree(dev);
 		fprintf(stderr, "umass: setConfiguration failed\n");
 		return -EINVAL;
 	}
 
-	dev->pipeIn = usb_open(drv, insertion, usb_transfer_bulk, usb_dir_in);
-	if (dev->pipeIn < 0) {
-		fprintf(stderr, "umass: pipe open failed \n");
-		free(dev);
-		return -EINVAL;
-	}
+	/* UAS if the interface has an alternate setting for it, Bulk-Only Transport otherwise */
+	dev->uas = NULL;
+	if (umass_uasProbe(dev, insertion) < 0) {
+		dev->pipeIn = usb_open(drv, insertion, usb_transfer_bulk, usb_dir_in);
+		if (dev->pipeIn < 0) {
+			fprintf(stderr, "umass: pipe open failed \n");
+			umass_devFree(dev);
+			return -EINVAL;
+		}
 
-	dev->pipeOut = usb_open(drv, insertion, usb_transfer_bulk, usb_dir_out);
-	if (dev->pipeOut < 0) {
-		fprintf(stderr, "umass: pipe open failed\n");
-		free(dev);
-		return -EINVAL;
-	}
-	dev->tag = 0;
+		dev->pipeOut = usb_open(drv, insertion, usb_transfer_bulk, usb_dir_out);
+		if (dev->pipeOut < 0) {
+			fprintf(stderr, "umass: pipe open failed\n");
+			umass_devFree(dev);
+			return -EINVAL;
+		}
 
-	ret = _umass_scsiInit(dev);
-	if (ret < 0) {
-		fprintf(stderr, "umass: device didn't initialize properly after scsi init sequence\n");
-		free(dev);
-		return -EINVAL;
+		_umass_botFindEndpoints(dev, insertion->interface);
 	}
+	dev->tag = 0;
 
-	ret = _umass_check(dev);
-	if (ret < 0) {
-		fprintf(stderr, "umass: umass_check failed\n");
-		free(dev);
-		return -EINVAL;
+	err = beginthreadex(umass_bringupThr, 4, dev->bringupStack, UMASS_BRINGUP_STACKSZ, dev, &dev->bringupTid);
+	if (err < 0) {
+		/* UAS status thread doesn't reference dev, its state is left until the device is unplugged */
+		fprintf(stderr, "umass: fail to beginthread ret: %d\n", err);
+		umass_devFree(dev);
+		return err;
 	}
 
-	oid.port = umass_common.msgport;
-	oid.id = dev->fileId;
-	err = create_dev(&oid, dev->path);
-	if (err != 0) {
-		free(dev);
-		fprintf(stderr, "usb: Can't create dev!\n");
-		return -EINVAL;
-	}
+	return 0;
+}
 
-	printf("umass: New USB Mass Storage device: %s sectors: %d\n", dev->path, dev->part.sectors);
 
-	mutexUnlock(umass_common.lock);
+static umass_dev_t *_umass_devFindInstance(usb_deletion_t *del)
+{
+	rbnode_t *node;
+	umass_dev_t *dev;
 
-	if (umass_common.mount_root) {
-		err = umass_mountRoot(dev);
-		if (err < 0) {
-			fprintf(stderr, "umass: failed to mount root partition\n");
-			return err;
+	for (node = lib_rbMinimum(umass_common.devices.root); node != NULL; node = lib_rbNext(node)) {
+		dev = lib_treeof(umass_dev_t, node, lib_treeof(idnode_t, linkage, node));
+		if (dev->instance.bus == del->bus && dev->instance.dev == del->dev &&
+				dev->instance.interface == del->interface) {
+			return dev;
 		}
-		umass_common.mount_root = false; /* don't try to mount root again */
 	}
 
-	return 0;
+	return NULL;
 }
 
 
 static int umass_handleDeletion(usb_driver_t *drv, usb_deletion_t *del)
 {
 	umass_dev_t *dev;
-	rbnode_t *node, *next;
-
-	mutexLock(umass_common.lock);
 
-	node = lib_rbMinimum(umass_common.devices.root);
-	while (node != NULL) {
-		next = lib_rbNext(node);
+	for (;;) {
+		mutexLock(umass_common.lock);
+		dev = _umass_devFindInstance(del);
+		if (dev != NULL) {
+			idtree_remove(&umass_common.devices, &dev->node);
+		}
+		mutexUnlock(umass_common.lock);
 
-		dev = lib_treeof(umass_dev_t, node, lib_treeof(idnode_t, linkage, node));
-		if (dev->instance.bus == del->bus && dev->instance.dev == del->dev &&
-				dev->instance.interface == del->interface) {
-			resourceDestroy(dev->lock);
-			remove(dev->path);
-			fprintf(stderr, "umass: Device removed: %s\n", dev->path);
-			free(dev);
+		if (dev == NULL) {
+			break;
 		}
 
-		node = next;
-	}
+		/* Bring-up fails quickly once the device is gone, it takes umass_common.lock */
+		threadJoin(dev->bringupTid, 0);
+		free(dev->bringupStack);
 
-	mutexUnlock(umass_common.lock);
+#ifdef UMASS_BLKCACHE
+		umass_cacheDestroy(dev);
+#endif
+		umass_uasDestroy(dev);
+		resourceDestroy(dev->lock);
+		remove(dev->path);
+		fprintf(stderr, "umass: Device removed: %s\n", dev->path);
+		free(dev);
+	}
 
 	return 0;
 }
@@ -931,31 +1771,27 @@ static int umass_init(usb_driver_t *drv, void *args)
 
 	if (umass_args != NULL) {
 		umass_common.mount_root = umass_args->mount_root;
+		umass_common.cache = umass_args->cache;
+		umass_common.threads = umass_args->threads;
 	}
 	else {
 		umass_common.mount_root = true;
+		umass_common.cache = false;
+		umass_common.threads = 0;
 	}
 
 	do {
-		ret = mutexCreate(&umass_common.rlock);
-		if (ret < 0) {
-			fprintf(stderr, "umass: failed to create server requests mutex\n");
-			break;
-		}
-
-		ret = condCreate(&umass_common.rcond);
+		ret = blksrv_init(&umass_common.srv, umass_read, umass_write);
 		if (ret < 0) {
-			fprintf(stderr, "umass: failed to create server requests condition variable\n");
+			fprintf(stderr, "umass: failed to initialize server requests queue\n");
 			break;
 		}
 
-		umass_common.rqueue = NULL;
 		idtree_init(&umass_common.devices);
-		lib_rbInit(&umass_common.fss, umass_cmpfs, NULL);
 
 #ifdef UMASS_MOUNT_EXT2
 		/* Register filesystems */
-		ret = umass_registerfs(LIBEXT2_NAME, LIBEXT2_TYPE, LIBEXT2_MOUNT, LIBEXT2_UNMOUNT, LIBEXT2_HANDLER);
+		ret = blksrv_registerfs(&umass_common.srv, LIBEXT2_NAME, LIBEXT2_TYPE, LIBEXT2_MOUNT, LIBEXT2_UNMOUNT, LIBEXT2_HANDLER);
 		if (ret < 0) {
 			fprintf(stderr, "umass: failed to register ext2 filesystem\n");
 			break;
@@ -985,12 +1821,10 @@ static int umass_init(usb_driver_t *drv, void *args)
 		}
 
 		/* Run pool threads */
-		for (i = 0; i < sizeof(umass_common.pstacks) / sizeof(umass_common.pstacks[0]); i++) {
-			ret = beginthread(umass_poolthr, 4, umass_common.pstacks[i], sizeof(umass_common.pstacks[i]), NULL);
-			if (ret < 0) {
-				fprintf(stderr, "umass: failed to start pool thread %d\n", i);
-				break;
-			}
+		ret = blksrv_run(&umass_common.srv, umass_common.threads, 4);
+		if (ret < 0) {
+			fprintf(stderr, "umass: failed to start pool threads\n");
+			break;
 		}
 
 		ret = EOK;
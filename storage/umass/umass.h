@@ -24,6 +24,8 @@
 
 typedef struct {
 	bool mount_root;
+	bool cache;           /* Enable write-back block cache */
+	unsigned int threads; /* Filesystem pool threads, 0 - default */
 } umass_args_t;
 
 
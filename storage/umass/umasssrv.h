@@ -0,0 +1,48 @@
+/*
+ * Phoenix-RTOS
+ *
+ * USB Mass Storage class driver
+ *
+ * Device control interface
+ *
+ * Copyright 2024 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _UMASSSRV_H_
+#define _UMASSSRV_H_
+
+#include <stdint.h>
+
+
+/* Request queue statistics are read with BLKSRV_DEVCTL_STATS (blksrv.h) */
+
+/* clang-format off */
+
+enum { umass_devctl_cacheStats = 0 };
+
+/* clang-format on */
+
+
+typedef struct {
+	int type;
+} __attribute__((packed)) umass_i_devctl_t;
+
+
+typedef struct {
+	uint64_t lookups;   /* Number of cache lines looked up by reads */
+	uint64_t misses;    /* Number of cache lines fetched from device on demand */
+	uint64_t readahead; /* Number of cache lines fetched from device by read-ahead */
+	uint64_t bypassed;  /* Number of bytes transferred around the cache (large requests) */
+} umass_cachestats_t;
+
+
+typedef struct {
+	umass_cachestats_t cacheStats; /* valid only for umass_devctl_cacheStats */
+} __attribute__((packed)) umass_o_devctl_t;
+
+
+#endif
@@ -17,11 +17,38 @@
 
 #include <sys/mman.h>
 #include <sys/types.h>
+#include <sys/interrupt.h>
 #include <sys/threads.h>
 
 #include "vblk.h"
 
 
+/* Virtqueue size */
+#define VBLK_QUEUE_SIZE 128
+
+/* Average number of descriptors used by a single request (header, data, footer) */
+#define VBLK_REQ_SEGS 3
+
+/* Maximum number of data segments (page fragments) described by a single request */
+#define VBLK_DATA_SEGS 16
+
+/* Caller buffer alignment required for zero-copy transfers */
+#define VBLK_DMA_ALIGN sizeof(uint32_t)
+
+/* Request types */
+#define VBLK_T_IN           0
+#define VBLK_T_OUT          1
+#define VBLK_T_FLUSH        4
+#define VBLK_T_DISCARD      11
+#define VBLK_T_WRITE_ZEROES 13
+
+/* Device configuration registers */
+#define VBLK_CFG_CAPACITY         0x00
+#define VBLK_CFG_NUM_QUEUES       0x22
+#define VBLK_CFG_MAX_DISCARD      0x24
+#define VBLK_CFG_MAX_WRITE_ZEROES 0x30
+
+
 typedef struct _virtioblk_req_t {
 	/* Request buffers (accessible by device) */
 	struct {
@@ -34,19 +61,45 @@ typedef struct _virtioblk_req_t {
 		volatile uint8_t status; /* Returned status */
 	} __attribute__((packed)) descr;
 
+	/* Discard/write zeroes range (device read-only) */
+	struct {
+		uint64_t sector;  /* Starting sector (512-byte offset) */
+		uint32_t sectors; /* Number of sectors */
+		uint32_t flags;   /* Range flags (bit 0 - unmap) */
+	} __attribute__((packed)) range;
+
 	/* VirtIO request segments */
-	virtio_seg_t hdr;  /* Header segment */
-	virtio_seg_t data; /* Data segment */
-	virtio_seg_t ftr;  /* Footer segment */
-	virtio_req_t vreq; /* VirtIO request */
+	virtio_seg_t hdr;                  /* Header segment */
+	virtio_seg_t data[VBLK_DATA_SEGS]; /* Data segments */
+	virtio_seg_t ftr;                  /* Footer segment */
+	virtio_req_t vreq;                 /* VirtIO request */
+	unsigned int nsegs;                /* Number of descriptors used by request */
 
 	/* Custom helper fields */
-	volatile unsigned int len; /* Number of bytes written to request buffers */
-	size_t buffsz;             /* Size of physicallly contiguous data buffer */
-	void *buff;                /* Physically contiguous data buffer */
+	volatile unsigned int len;     /* Number of bytes written to request buffers */
+	volatile int done;             /* Request completed by device */
+	handle_t cond;                 /* Request completion condition */
+	size_t buffsz;                 /* Size of physicallly contiguous data buffer */
+	void *buff;                    /* Physically contiguous data buffer */
+	struct _virtioblk_req_t *next; /* Next free request slot */
+	vblk_queue_t *q;               /* Owning queue */
 } virtioblk_req_t;
 
 
+/* Handler threads bound to queues, see vblk_threadBind() */
+static struct {
+	int tids[VBLK_MAX_QUEUES];  /* Bound thread IDs (0 - free) */
+	volatile unsigned int next; /* Next queue for requests from unbound threads */
+} vblk_common;
+
+
+/* Returns size of request slots pool mapping */
+static size_t vblk_poolSize(unsigned int nreqs)
+{
+	return (nreqs * sizeof(virtioblk_req_t) + _PAGE_SIZE - 1) & ~(_PAGE_SIZE - 1);
+}
+
+
 /* Resizes physically contiguous request data buffer */
 static int _vblk_resizeBuff(virtioblk_req_t *req, size_t len)
 {
@@ -60,7 +113,9 @@ static int _vblk_resizeBuff(virtioblk_req_t *req, size_t len)
 			return -ENOMEM;
 		}
 
-		munmap(req->buff, req->buffsz);
+		if (req->buff != NULL) {
+			munmap(req->buff, req->buffsz);
+		}
 		req->buffsz = buffsz;
 		req->buff = buff;
 	}
@@ -69,125 +124,372 @@ static int _vblk_resizeBuff(virtioblk_req_t *req, size_t len)
 }
 
 
-/* Opens request context */
-virtioblk_req_t *vblk_open(void)
+/* Destroys request slots pool, only the first nreqs slots are initialized */
+static void vblk_poolDestroy(vblk_queue_t *q)
 {
-	virtioblk_req_t *req;
-	req = mmap(NULL, (sizeof(virtioblk_req_t) + _PAGE_SIZE - 1) & ~(_PAGE_SIZE - 1), PROT_READ | PROT_WRITE, MAP_UNCACHED | MAP_ANONYMOUS | MAP_CONTIGUOUS, -1, 0);
-	if (req == MAP_FAILED) {
-		return NULL;
+	for (unsigned int i = 0; i < q->nreqs; i++) {
+		virtioblk_req_t *req = &q->reqs[i];
+
+		resourceDestroy(req->cond);
+		if (req->buff != NULL) {
+			munmap(req->buff, req->buffsz);
+		}
 	}
 
-	req->buffsz = _PAGE_SIZE;
-	req->buff = mmap(NULL, req->buffsz, PROT_READ | PROT_WRITE, MAP_UNCACHED | MAP_ANONYMOUS | MAP_CONTIGUOUS, -1, 0);
-	if (req->buff == MAP_FAILED) {
-		munmap(req, (sizeof(virtioblk_req_t) + _PAGE_SIZE - 1) & ~(_PAGE_SIZE - 1));
-		return NULL;
+	munmap(q->reqs, q->poolsz);
+	q->reqs = NULL;
+	q->poolsz = 0;
+	q->free = NULL;
+	q->nreqs = 0;
+}
+
+
+/* Creates request slots pool (one slot per VBLK_REQ_SEGS virtqueue descriptors) */
+static int vblk_poolInit(vblk_queue_t *q, unsigned int nreqs)
+{
+	size_t poolsz = vblk_poolSize(nreqs);
+	virtioblk_req_t *reqs = mmap(NULL, poolsz, PROT_READ | PROT_WRITE, MAP_UNCACHED | MAP_ANONYMOUS | MAP_CONTIGUOUS, -1, 0);
+	if (reqs == MAP_FAILED) {
+		return -ENOMEM;
 	}
 
-	req->hdr.buff = &req->descr.type;
-	req->hdr.len = 0x10;
-	req->hdr.prev = &req->ftr;
-	req->hdr.next = &req->data;
-	req->data.prev = &req->hdr;
-	req->data.next = &req->ftr;
-	req->ftr.buff = (void *)&req->descr.status;
-	req->ftr.len = 0x01;
-	req->ftr.prev = &req->data;
+	q->reqs = reqs;
+	q->poolsz = poolsz;
+	q->free = NULL;
+	q->nreqs = 0;
+
+	for (unsigned int i = 0; i < nreqs; i++) {
+		virtioblk_req_t *req = &reqs[i];
+
+		if (condCreate(&req->cond) < 0) {
+			vblk_poolDestroy(q);
+			return -ENOMEM;
+		}
+
+		/* Buffers are allocated on first use */
+		req->buffsz = 0;
+		req->buff = NULL;
+
+		req->hdr.buff = &req->descr.type;
+		req->hdr.len = 0x10;
+		req->ftr.buff = (void *)&req->descr.status;
+		req->ftr.len = 0x01;
+		req->vreq.segs = &req->hdr;
+		req->q = q;
+
+		req->next = q->free;
+		q->free = req;
+		q->nreqs++;
+	}
+
+	return EOK;
+}
+
+
+/* Links request segments (header, ndata data segments and footer) into virtio segments ring */
+static void _vblk_linkSegs(virtioblk_req_t *req, unsigned int ndata)
+{
+	virtio_seg_t *prev = &req->hdr;
+
+	for (unsigned int i = 0; i < ndata; i++) {
+		req->data[i].prev = prev;
+		prev->next = &req->data[i];
+		prev = &req->data[i];
+	}
+	req->ftr.prev = prev;
+	prev->next = &req->ftr;
 	req->ftr.next = &req->hdr;
-	req->vreq.segs = &req->hdr;
+	req->hdr.prev = &req->ftr;
+	req->nsegs = ndata + 2;
+}
+
+
+/* Describes caller buffer as page fragments, returns number of data segments */
+static unsigned int _vblk_mapData(virtioblk_req_t *req, void *buff, size_t len)
+{
+	uintptr_t addr = (uintptr_t)buff;
+	unsigned int n;
+
+	for (n = 0; (len > 0) && (n < VBLK_DATA_SEGS); n++) {
+		size_t seglen = _PAGE_SIZE - (addr & (_PAGE_SIZE - 1));
+		if (seglen > len) {
+			seglen = len;
+		}
+		req->data[n].buff = (void *)addr;
+		req->data[n].len = seglen;
+		addr += seglen;
+		len -= seglen;
+	}
+
+	return n;
+}
+
+
+/* Returns number of bytes (whole sectors) of caller buffer that fit into a single zero-copy request */
+static size_t vblk_chunkLen(const void *buff, size_t len)
+{
+	size_t max = VBLK_DATA_SEGS * _PAGE_SIZE - ((uintptr_t)buff & (_PAGE_SIZE - 1));
+
+	return (len > max) ? (max & ~(size_t)(512 - 1)) : len;
+}
+
+
+void vblk_threadBind(unsigned int idx)
+{
+	if (idx < VBLK_MAX_QUEUES) {
+		vblk_common.tids[idx] = gettid();
+	}
+}
+
+
+/* Returns queue index bound to the calling thread, requests from other threads are spread over queues */
+static unsigned int vblk_threadQueue(void)
+{
+	int tid = gettid();
+
+	for (unsigned int i = 0; i < VBLK_MAX_QUEUES; i++) {
+		if (vblk_common.tids[i] == tid) {
+			return i;
+		}
+	}
+
+	return __atomic_fetch_add(&vblk_common.next, 1, __ATOMIC_RELAXED);
+}
+
+
+/* Takes free request slot of the queue bound to the calling thread, waits if all slots are in flight */
+static virtioblk_req_t *vblk_reqGet(struct _storage_devCtx_t *vblk)
+{
+	vblk_queue_t *q = &vblk->queues[vblk_threadQueue() % vblk->nqueues];
+	virtioblk_req_t *req;
+
+	mutexLock(q->lock);
+	while (q->free == NULL) {
+		condWait(q->cond, q->lock, 0);
+	}
+	req = q->free;
+	q->free = req->next;
+	mutexUnlock(q->lock);
 
 	return req;
 }
 
 
-/* Closes request context */
-void vblk_close(virtioblk_req_t *req)
+/* Returns request slot to the pool */
+static void vblk_reqPut(virtioblk_req_t *req)
 {
-	munmap(req->buff, req->buffsz);
-	munmap(req, (sizeof(virtioblk_req_t) + _PAGE_SIZE - 1) & ~(_PAGE_SIZE - 1));
+	vblk_queue_t *q = req->q;
+
+	mutexLock(q->lock);
+	req->next = q->free;
+	q->free = req;
+	condSignal(q->cond);
+	mutexUnlock(q->lock);
 }
 
 
-/* Sends request to device */
-static int _vblk_send(struct _storage_devCtx_t *vblk, virtioblk_req_t *req)
+/* Notifies device about enqueued requests */
+static void _vblk_kick(struct _storage_devCtx_t *vblk, vblk_queue_t *q)
+{
+	if (q->unkicked != 0) {
+		virtqueue_notify(&vblk->vdev, &q->vq);
+		q->unkicked = 0;
+	}
+}
+
+
+/* Sends request to device and waits for its completion */
+static int vblk_send(struct _storage_devCtx_t *vblk, virtioblk_req_t *req)
 {
 	virtio_dev_t *vdev = &vblk->vdev;
+	vblk_queue_t *q = req->q;
 	int err;
 
+	/* Notification (VM exit) is left to the last of concurrently submitting threads */
+	(void)__atomic_add_fetch(&q->submitters, 1, __ATOMIC_SEQ_CST);
+
+	mutexLock(q->lock);
+
+	/* Requests with many data segments may not fit into virtqueue at once */
+	while (q->ndescs < req->nsegs) {
+		/* Waiting thread can't be relied on to notify, descriptors are freed only by requests the device knows about */
+		(void)__atomic_sub_fetch(&q->submitters, 1, __ATOMIC_SEQ_CST);
+		_vblk_kick(vblk, q);
+		condWait(q->descCond, q->lock, 0);
+		(void)__atomic_add_fetch(&q->submitters, 1, __ATOMIC_SEQ_CST);
+	}
+
 	req->len = 0;
-	err = virtqueue_enqueue(vdev, &vblk->vq, &req->vreq);
+	req->done = 0;
+	err = virtqueue_enqueue(vdev, &q->vq, &req->vreq);
+	if (err >= 0) {
+		q->ndescs -= req->nsegs;
+		q->unkicked = 1;
+	}
+
+	if (__atomic_sub_fetch(&q->submitters, 1, __ATOMIC_SEQ_CST) == 0) {
+		_vblk_kick(vblk, q);
+	}
+
 	if (err < 0) {
+		mutexUnlock(q->lock);
 		return err;
 	}
 
-	virtqueue_notify(vdev, &vblk->vq);
-
-	unsigned int len;
-	do {
-		req = virtqueue_dequeue(vdev, &vblk->vq, &len);
-	} while (req == NULL);
+	while (req->done == 0) {
+		condWait(req->cond, q->lock, 0);
+	}
 
-	req->len = len;
+	mutexUnlock(q->lock);
 
 	return (req->descr.status != 0) ? -EFAULT : EOK;
 }
 
 
-/* Reads data from device */
-static ssize_t vblk_read(storage_t *strg, off_t offs, void *buff, size_t len)
+/* Completes requests returned by device, returns number of completed requests */
+static unsigned int _vblk_complete(struct _storage_devCtx_t *vblk, vblk_queue_t *q)
 {
-	if (len == 0) {
-		return 0;
+	virtioblk_req_t *req;
+	unsigned int len, n = 0;
+
+	while ((req = virtqueue_dequeue(&vblk->vdev, &q->vq, &len)) != NULL) {
+		req->len = len;
+		req->done = 1;
+		q->ndescs += req->nsegs;
+		condSignal(req->cond);
+		n++;
 	}
 
-	struct _storage_devCtx_t *vblk = strg->dev->ctx;
-	if (offs + len > vblk->size) {
-		if (offs > vblk->size) {
-			return -EINVAL;
-		}
-		len = vblk->size - offs;
+	if (n != 0) {
+		condBroadcast(q->descCond);
 	}
 
-	if (((offs % 512) != 0) || ((len % 512) != 0)) {
-		return -EINVAL;
+	return n;
+}
+
+
+static int vblk_irqHandler(unsigned int n, void *arg)
+{
+	struct _storage_devCtx_t *vblk = (struct _storage_devCtx_t *)arg;
+	unsigned int isr = virtio_isr(&vblk->vdev);
+
+	(void)n;
+
+	/* Used buffer notification, mask further notifications until the queues are drained */
+	if ((isr & (1 << 0)) != 0) {
+		for (unsigned int i = 0; i < vblk->nqueues; i++) {
+			virtqueue_disableIRQ(&vblk->vdev, &vblk->queues[i].vq);
+		}
 	}
+	vblk->isr |= isr;
+
+	return 1;
+}
+
+
+static void vblk_irqThread(void *arg)
+{
+	struct _storage_devCtx_t *vblk = (struct _storage_devCtx_t *)arg;
 
 	mutexLock(vblk->lock);
+	for (;;) {
+		while (((vblk->isr & (1 << 0)) == 0) && (vblk->stop == 0)) {
+			condWait(vblk->irqCond, vblk->lock, 0);
+		}
 
-	virtioblk_req_t *req = vblk->req;
-	ssize_t ret = _vblk_resizeBuff(req, len);
+		if (vblk->stop != 0) {
+			break;
+		}
 
-	if (ret < 0) {
+		vblk->isr &= ~(1 << 0);
 		mutexUnlock(vblk->lock);
+
+		for (unsigned int i = 0; i < vblk->nqueues; i++) {
+			vblk_queue_t *q = &vblk->queues[i];
+
+			mutexLock(q->lock);
+			(void)_vblk_complete(vblk, q);
+			virtqueue_enableIRQ(&vblk->vdev, &q->vq);
+
+			/* Catch requests completed before notifications were unmasked */
+			(void)_vblk_complete(vblk, q);
+			mutexUnlock(q->lock);
+		}
+
+		mutexLock(vblk->lock);
+	}
+	mutexUnlock(vblk->lock);
+
+	endthread();
+}
+
+
+/* Transfers data directly from/to caller buffer */
+static ssize_t vblk_xferDirect(struct _storage_devCtx_t *vblk, virtioblk_req_t *req, uint32_t type, off_t offs, void *buff, size_t len)
+{
+	size_t done = 0;
+
+	while (done < len) {
+		uint8_t *chunk = (uint8_t *)buff + done;
+		size_t chunksz = vblk_chunkLen(chunk, len - done);
+		unsigned int ndata = _vblk_mapData(req, chunk, chunksz);
+
+		_vblk_linkSegs(req, ndata);
+		req->descr.type = virtio_gtov32(&vblk->vdev, type);
+		req->descr.sector = virtio_gtov64(&vblk->vdev, (offs + done) / 512);
+		req->vreq.rsegs = (type == 0) ? 1 : (ndata + 1);
+		req->vreq.wsegs = (type == 0) ? (ndata + 1) : 1;
+
+		if (vblk_send(vblk, req) < 0) {
+			return -EIO;
+		}
+		done += chunksz;
+	}
+
+	return len;
+}
+
+
+/* Transfers data through request bounce buffer */
+static ssize_t vblk_xferCopy(struct _storage_devCtx_t *vblk, virtioblk_req_t *req, uint32_t type, off_t offs, void *buff, size_t len)
+{
+	ssize_t ret = _vblk_resizeBuff(req, len);
+	if (ret < 0) {
 		return ret;
 	}
 
-	req->descr.type = virtio_gtov32(&vblk->vdev, 0);
+	_vblk_linkSegs(req, 1);
+	req->descr.type = virtio_gtov32(&vblk->vdev, type);
 	req->descr.sector = virtio_gtov64(&vblk->vdev, offs / 512);
-	req->data.buff = req->buff;
-	req->data.len = len;
-	req->vreq.rsegs = 1;
-	req->vreq.wsegs = 2;
+	req->data[0].buff = req->buff;
+	req->data[0].len = len;
+	req->vreq.rsegs = (type == 0) ? 1 : 2;
+	req->vreq.wsegs = (type == 0) ? 2 : 1;
 
-	if (_vblk_send(vblk, req) < 0) {
-		ret = -EIO;
+	if (type != 0) {
+		memcpy(req->buff, buff, len);
 	}
-	else {
-		ret = req->len - 1;
-		memcpy(buff, req->buff, ret);
+
+	if (vblk_send(vblk, req) < 0) {
+		return -EIO;
 	}
 
-	mutexUnlock(vblk->lock);
+	if (type == 0) {
+		len = req->len - 1;
+		memcpy(buff, req->buff, len);
+	}
 
-	return ret;
+	mutexLock(req->q->lock);
+	req->q->copied += len;
+	mutexUnlock(req->q->lock);
+
+	return len;
 }
 
 
-/* Writes data to device */
-static ssize_t vblk_write(storage_t *strg, off_t offs, const void *buff, size_t len)
+/* Transfers data from/to device */
+static ssize_t vblk_xfer(struct _storage_devCtx_t *vblk, uint32_t type, off_t offs, void *buff, size_t len)
 {
-	struct _storage_devCtx_t *vblk = strg->dev->ctx;
 	if (offs + len > vblk->size) {
 		if (offs > vblk->size) {
 			return -EINVAL;
@@ -199,35 +501,136 @@ static ssize_t vblk_write(storage_t *strg, off_t offs, const void *buff, size_t
 		return -EINVAL;
 	}
 
-	mutexLock(vblk->lock);
+	if (len == 0) {
+		return 0;
+	}
 
-	virtioblk_req_t *req = vblk->req;
-	ssize_t ret = _vblk_resizeBuff(req, len);
-	if (ret < 0) {
-		mutexUnlock(vblk->lock);
-		return ret;
+	virtioblk_req_t *req = vblk_reqGet(vblk);
+	ssize_t ret;
+
+	/* Physical pages of aligned caller buffers are described to the device directly */
+	if ((vblk->zerocopy != 0) && (((uintptr_t)buff & (VBLK_DMA_ALIGN - 1)) == 0)) {
+		ret = vblk_xferDirect(vblk, req, type, offs, buff, len);
+	}
+	else {
+		ret = vblk_xferCopy(vblk, req, type, offs, buff, len);
 	}
 
-	req->descr.type = virtio_gtov32(&vblk->vdev, 1);
-	req->descr.sector = virtio_gtov64(&vblk->vdev, offs / 512);
-	req->data.buff = req->buff;
-	req->data.len = len;
-	req->vreq.rsegs = 2;
+	vblk_reqPut(req);
+
+	return ret;
+}
+
+
+/* Reads data from device */
+static ssize_t vblk_read(storage_t *strg, off_t offs, void *buff, size_t len)
+{
+	return vblk_xfer(strg->dev->ctx, VBLK_T_IN, offs, buff, len);
+}
+
+
+/* Writes data to device */
+static ssize_t vblk_write(storage_t *strg, off_t offs, const void *buff, size_t len)
+{
+	return vblk_xfer(strg->dev->ctx, VBLK_T_OUT, offs, (void *)buff, len);
+}
+
+
+/* Flushes device volatile write cache */
+static int vblk_sync(storage_t *strg)
+{
+	struct _storage_devCtx_t *vblk = strg->dev->ctx;
+	int ret;
+
+	/* Devices without VIRTIO_BLK_F_FLUSH feature are write-through */
+	if ((vblk->features & VBLK_F_FLUSH) == 0) {
+		return EOK;
+	}
+
+	virtioblk_req_t *req = vblk_reqGet(vblk);
+
+	_vblk_linkSegs(req, 0);
+	req->descr.type = virtio_gtov32(&vblk->vdev, VBLK_T_FLUSH);
+	req->descr.sector = 0;
+	req->vreq.rsegs = 1;
 	req->vreq.wsegs = 1;
-	memcpy(req->buff, buff, len);
 
-	ret = (_vblk_send(vblk, req) < 0) ? -EIO : len;
+	ret = (vblk_send(vblk, req) < 0) ? -EIO : EOK;
 
-	mutexUnlock(vblk->lock);
+	vblk_reqPut(req);
 
 	return ret;
 }
 
 
+/* Sends discard or write zeroes requests for sectors range */
+static int vblk_range(struct _storage_devCtx_t *vblk, uint32_t type, uint32_t maxSectors, off_t offs, size_t len, uint32_t flags)
+{
+	if (((offs % 512) != 0) || ((len % 512) != 0) || (offs + len > vblk->size)) {
+		return -EINVAL;
+	}
+
+	virtioblk_req_t *req = vblk_reqGet(vblk);
+	uint64_t sector = offs / 512;
+	uint64_t sectors = len / 512;
+	int ret = EOK;
+
+	while (sectors > 0) {
+		uint32_t n = (sectors > maxSectors) ? maxSectors : sectors;
+
+		_vblk_linkSegs(req, 1);
+		req->descr.type = virtio_gtov32(&vblk->vdev, type);
+		req->descr.sector = 0;
+		req->range.sector = virtio_gtov64(&vblk->vdev, sector);
+		req->range.sectors = virtio_gtov32(&vblk->vdev, n);
+		req->range.flags = virtio_gtov32(&vblk->vdev, flags);
+		req->data[0].buff = &req->range;
+		req->data[0].len = sizeof(req->range);
+		req->vreq.rsegs = 2;
+		req->vreq.wsegs = 1;
+
+		if (vblk_send(vblk, req) < 0) {
+			ret = -EIO;
+			break;
+		}
+		sector += n;
+		sectors -= n;
+	}
+
+	vblk_reqPut(req);
+
+	return ret;
+}
+
+
+int vblk_discard(storage_t *strg, off_t offs, size_t len)
+{
+	struct _storage_devCtx_t *vblk = strg->dev->ctx;
+
+	if ((vblk->features & VBLK_F_DISCARD) == 0) {
+		return -ENOSYS;
+	}
+
+	return vblk_range(vblk, VBLK_T_DISCARD, vblk->maxDiscard, offs, len, 0);
+}
+
+
+int vblk_writeZeroes(storage_t *strg, off_t offs, size_t len, int unmap)
+{
+	struct _storage_devCtx_t *vblk = strg->dev->ctx;
+
+	if ((vblk->features & VBLK_F_WRITE_ZEROES) == 0) {
+		return -ENOSYS;
+	}
+
+	return vblk_range(vblk, VBLK_T_WRITE_ZEROES, vblk->maxWriteZeroes, offs, len, (unmap != 0) ? (1 << 0) : 0);
+}
+
+
 static const storage_blkops_t blkOps = {
 	.read = vblk_read,
 	.write = vblk_write,
-	.sync = NULL
+	.sync = vblk_sync
 };
 
 
@@ -237,13 +640,86 @@ const storage_blkops_t *vblk_getBlkOps(void)
 }
 
 
+/* Destroys device queue */
+static void vblk_queueDestroy(struct _storage_devCtx_t *vblk, vblk_queue_t *q)
+{
+	vblk_poolDestroy(q);
+	resourceDestroy(q->descCond);
+	resourceDestroy(q->cond);
+	resourceDestroy(q->lock);
+	virtqueue_destroy(&vblk->vdev, &q->vq);
+}
+
+
+/* Initializes device queue */
+static int vblk_queueInit(struct _storage_devCtx_t *vblk, vblk_queue_t *q, unsigned int idx)
+{
+	int ret = virtqueue_init(&vblk->vdev, &q->vq, idx, VBLK_QUEUE_SIZE);
+	if (ret < 0) {
+		return ret;
+	}
+	q->ndescs = VBLK_QUEUE_SIZE;
+	q->copied = 0;
+	q->submitters = 0;
+	q->unkicked = 0;
+
+	do {
+		ret = mutexCreate(&q->lock);
+		if (ret < 0) {
+			break;
+		}
+
+		ret = condCreate(&q->cond);
+		if (ret < 0) {
+			resourceDestroy(q->lock);
+			break;
+		}
+
+		ret = condCreate(&q->descCond);
+		if (ret < 0) {
+			resourceDestroy(q->cond);
+			resourceDestroy(q->lock);
+			break;
+		}
+
+		ret = vblk_poolInit(q, VBLK_QUEUE_SIZE / VBLK_REQ_SEGS);
+		if (ret < 0) {
+			resourceDestroy(q->descCond);
+			resourceDestroy(q->cond);
+			resourceDestroy(q->lock);
+			break;
+		}
+	} while (0);
+
+	if (ret < 0) {
+		virtqueue_destroy(&vblk->vdev, &q->vq);
+		return ret;
+	}
+
+	return EOK;
+}
+
+
 /* Destroys device */
 void vblk_ctxDestroy(struct _storage_devCtx_t *ctx)
 {
 	virtio_dev_t *vdev = &ctx->vdev;
 
+	mutexLock(ctx->lock);
+	ctx->stop = 1;
+	condSignal(ctx->irqCond);
+	mutexUnlock(ctx->lock);
+	threadJoin(ctx->tid, 0);
+
+	for (unsigned int i = 0; i < ctx->nqueues; i++) {
+		virtqueue_disableIRQ(vdev, &ctx->queues[i].vq);
+	}
+	resourceDestroy(ctx->inth);
+	for (unsigned int i = 0; i < ctx->nqueues; i++) {
+		vblk_queueDestroy(ctx, &ctx->queues[i]);
+	}
+	resourceDestroy(ctx->irqCond);
 	resourceDestroy(ctx->lock);
-	virtqueue_destroy(vdev, &ctx->vq);
 	virtio_destroyDev(vdev);
 	free(ctx);
 }
@@ -256,40 +732,101 @@ int vblk_ctxInit(struct _storage_devCtx_t **ctx, virtio_dev_t *vdev)
 		return ret;
 	}
 
-	ret = virtio_writeFeatures(vdev, 0);
+	/*
+	 * VIRTIO_RING_F_EVENT_IDX and VIRTIO_RING_F_INDIRECT_DESC are deliberately not negotiated: the split ring
+	 * is maintained by libvirtio, whose virtqueue API maintains neither used_event/avail_event nor indirect
+	 * descriptor tables. Notifications are coalesced by the driver instead (see vblk_send()).
+	 */
+	uint64_t features = virtio_readFeatures(vdev) & (VBLK_F_MQ | VBLK_F_FLUSH | VBLK_F_DISCARD | VBLK_F_WRITE_ZEROES);
+	ret = virtio_writeFeatures(vdev, features);
 	if (ret < 0) {
 		virtio_writeStatus(vdev, virtio_readStatus(vdev) | (1 << 7));
 		virtio_destroyDev(vdev);
 		return ret;
 	}
 
-	*ctx = malloc(sizeof(struct _storage_devCtx_t));
-	if (*ctx == NULL) {
+	struct _storage_devCtx_t *vblk = calloc(1, sizeof(struct _storage_devCtx_t));
+	if (vblk == NULL) {
 		return -ENOMEM;
 	}
+	vblk->vdev = *vdev;
+	vdev = &vblk->vdev;
+
+	vblk->nqueues = 1;
+	if ((features & VBLK_F_MQ) != 0) {
+		vblk->nqueues = virtio_readConfig16(vdev, VBLK_CFG_NUM_QUEUES);
+		if (vblk->nqueues > VBLK_MAX_QUEUES) {
+			vblk->nqueues = VBLK_MAX_QUEUES;
+		}
+		else if (vblk->nqueues == 0) {
+			vblk->nqueues = 1;
+		}
+	}
 
-	ret = virtqueue_init(vdev, &(*ctx)->vq, 0, 128);
-	if (ret < 0) {
-		virtio_writeStatus(vdev, virtio_readStatus(vdev) | (1 << 7));
-		virtio_destroyDev(vdev);
-		free(*ctx);
-		return ret;
+	for (unsigned int i = 0; i < vblk->nqueues; i++) {
+		ret = vblk_queueInit(vblk, &vblk->queues[i], i);
+		if (ret < 0) {
+			while (i-- > 0) {
+				vblk_queueDestroy(vblk, &vblk->queues[i]);
+			}
+			virtio_writeStatus(vdev, virtio_readStatus(vdev) | (1 << 7));
+			virtio_destroyDev(vdev);
+			free(vblk);
+			return ret;
+		}
+	}
+
+	vblk->sectorsz = 512;
+	vblk->size = 512 * virtio_readConfig64(vdev, VBLK_CFG_CAPACITY);
+	vblk->features = features;
+	if ((features & VBLK_F_DISCARD) != 0) {
+		vblk->maxDiscard = virtio_readConfig32(vdev, VBLK_CFG_MAX_DISCARD);
+		if (vblk->maxDiscard == 0) {
+			vblk->features &= ~VBLK_F_DISCARD;
+		}
+	}
+	if ((features & VBLK_F_WRITE_ZEROES) != 0) {
+		vblk->maxWriteZeroes = virtio_readConfig32(vdev, VBLK_CFG_MAX_WRITE_ZEROES);
+		if (vblk->maxWriteZeroes == 0) {
+			vblk->features &= ~VBLK_F_WRITE_ZEROES;
+		}
 	}
+	vblk->zerocopy = 1;
 
-	(*ctx)->sectorsz = 512;
-	(*ctx)->size = 512 * virtio_readConfig64(vdev, 0x00);
+	do {
+		ret = mutexCreate(&vblk->lock);
+		if (ret < 0) {
+			break;
+		}
+
+		ret = condCreate(&vblk->irqCond);
+		if (ret < 0) {
+			resourceDestroy(vblk->lock);
+			break;
+		}
+
+		ret = beginthreadex(vblk_irqThread, 4, vblk->stack, sizeof(vblk->stack), vblk, &vblk->tid);
+		if (ret < 0) {
+			resourceDestroy(vblk->irqCond);
+			resourceDestroy(vblk->lock);
+			break;
+		}
+	} while (0);
 
-	ret = mutexCreate(&(*ctx)->lock);
 	if (ret < 0) {
-		virtqueue_destroy(vdev, &(*ctx)->vq);
+		for (unsigned int i = 0; i < vblk->nqueues; i++) {
+			vblk_queueDestroy(vblk, &vblk->queues[i]);
+		}
 		virtio_writeStatus(vdev, virtio_readStatus(vdev) | (1 << 7));
 		virtio_destroyDev(vdev);
-		free(*ctx);
+		free(vblk);
 		return ret;
 	}
 
-	virtqueue_disableIRQ(&(*ctx)->vdev, &(*ctx)->vq);
+	interrupt(vdev->info.irq, vblk_irqHandler, vblk, vblk->irqCond, &vblk->inth);
 	virtio_writeStatus(vdev, virtio_readStatus(vdev) | (1 << 2));
 
+	*ctx = vblk;
+
 	return EOK;
 }
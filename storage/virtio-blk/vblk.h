@@ -16,19 +16,67 @@
 
 
 #include <stdio.h>
+#include <stdint.h>
 #include <virtio.h>
 #include <storage/storage.h>
 
 
+/* Negotiated device features */
+#define VBLK_F_FLUSH        (1ULL << 9)
+#define VBLK_F_MQ           (1ULL << 12)
+#define VBLK_F_DISCARD      (1ULL << 13)
+#define VBLK_F_WRITE_ZEROES (1ULL << 14)
+
+
+/* Maximum number of device virtqueues */
+#define VBLK_MAX_QUEUES 8
+
+
+typedef struct {
+	virtqueue_t vq; /* Device virtqueue */
+
+	/* Request slots */
+	struct _virtioblk_req_t *reqs; /* Request slots pool */
+	struct _virtioblk_req_t *free; /* Free request slots list */
+	unsigned int nreqs;            /* Number of request slots */
+	size_t poolsz;                 /* Size of request slots pool mapping */
+	handle_t cond;                 /* Free request slot condition */
+	unsigned int ndescs;           /* Number of free virtqueue descriptors */
+	handle_t descCond;             /* Free virtqueue descriptors condition */
+	handle_t lock;
+
+	/* Device notification coalescing, see vblk_send() */
+	volatile unsigned int submitters; /* Number of threads submitting requests */
+	int unkicked;                     /* Requests enqueued without device notification */
+
+	unsigned long long copied; /* Number of bytes transferred through bounce buffers */
+} vblk_queue_t;
+
+
 struct _storage_devCtx_t {
 	/* Device data */
 	virtio_dev_t vdev;       /* VirtIO device */
-	virtqueue_t vq;          /* Device virtqueue */
 	unsigned int sectorsz;   /* Device sector size */
 	unsigned long long size; /* Device storage size */
-
-	struct _virtioblk_req_t *req; /* Request buffers */
-	handle_t lock;
+	uint64_t features;       /* Negotiated device features */
+	uint32_t maxDiscard;     /* Maximum number of sectors per discard request */
+	uint32_t maxWriteZeroes; /* Maximum number of sectors per write zeroes request */
+
+	/* Request queues (handler threads are bound to queues with vblk_threadBind()) */
+	vblk_queue_t queues[VBLK_MAX_QUEUES];
+	unsigned int nqueues;
+
+	/* Data path */
+	int zerocopy; /* Describe aligned caller buffers to device directly */
+
+	/* Interrupt handling */
+	volatile unsigned int isr; /* Pending interrupt status */
+	volatile int stop;         /* Completion thread exit request */
+	handle_t irqCond;          /* Interrupt condition */
+	handle_t inth;             /* Interrupt handle */
+	handle_t lock;             /* Interrupt state lock */
+	int tid;                   /* Completion thread ID */
+	uint8_t stack[2048] __attribute__((aligned(8)));
 };
 
 
@@ -39,15 +87,20 @@ struct _storage_devCtx_t {
 /* clang-format on */
 
 
-/* Opens request context */
-struct _virtioblk_req_t *vblk_open(void);
+const storage_blkops_t *vblk_getBlkOps(void);
 
 
-/* Closes request context */
-void vblk_close(struct _virtioblk_req_t *rctx);
+/* Binds calling thread to queue idx (modulo number of queues) of every device, requests
+ * from unbound threads (e.g. filesystem threads) are spread over the queues round-robin */
+void vblk_threadBind(unsigned int idx);
 
 
-const storage_blkops_t *vblk_getBlkOps(void);
+/* Discards device sectors (offs and len are absolute and sector aligned) */
+int vblk_discard(storage_t *strg, off_t offs, size_t len);
+
+
+/* Writes zeroes to device sectors, optionally letting device deallocate them */
+int vblk_writeZeroes(storage_t *strg, off_t offs, size_t len, int unmap);
 
 
 /* Initializes device context */
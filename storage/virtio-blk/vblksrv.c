@@ -20,21 +20,32 @@
 
 #include <posix/utils.h>
 #include <sys/file.h>
+#include <sys/msg.h>
 #include <sys/threads.h>
 
-#include <mbr.h>
 #include <libext2.h>
+#include <partprobe.h>
 
 #include "vblk.h"
+#include "vblksrv.h"
 
 
 typedef struct {
 	bool root;
+	bool copy;
 	char *diskId;
 	char *partId;
 } vblksrv_args_t;
 
 
+/* Device request handler threads, one per queue of the device with most queues */
+#define VBLKSRV_THREAD_STACK_SIZE (2 * _PAGE_SIZE)
+
+static struct {
+	uint32_t port; /* Device requests port */
+} vblksrv_common;
+
+
 /* VirtIO block devices descriptors */
 static const virtio_devinfo_t info[] = {
 	{ .type = vdevPCI, .id = 0x1001 },
@@ -114,6 +125,64 @@ static int vblksrv_getAttr(storage_t *strg, int type, long long *attr)
 }
 
 
+static int vblksrv_sync(storage_t *strg)
+{
+	if ((strg == NULL) || (strg->dev == NULL)) {
+		return -EINVAL;
+	}
+
+	storage_blk_t *blk = strg->dev->blk;
+	if ((blk != NULL) && (blk->ops != NULL) && (blk->ops->sync != NULL)) {
+		return blk->ops->sync(strg);
+	}
+
+	return EOK;
+}
+
+
+static int vblksrv_devCtl(storage_t *strg, msg_t *msg)
+{
+	const vblksrv_i_devctl_t *idevctl = (const vblksrv_i_devctl_t *)msg->i.raw;
+	vblksrv_o_devctl_t *odevctl = (vblksrv_o_devctl_t *)msg->o.raw;
+
+	if ((strg == NULL) || (strg->dev == NULL)) {
+		return -EINVAL;
+	}
+
+	struct _storage_devCtx_t *ctx = strg->dev->ctx;
+
+	switch (idevctl->type) {
+		case vblksrv_devctl_info:
+			odevctl->info.size = strg->size;
+			odevctl->info.sectorsz = ctx->sectorsz;
+			odevctl->info.caps = 0;
+			if ((ctx->features & VBLK_F_FLUSH) != 0) {
+				odevctl->info.caps |= VBLKSRV_CAP_FLUSH;
+			}
+			if ((ctx->features & VBLK_F_DISCARD) != 0) {
+				odevctl->info.caps |= VBLKSRV_CAP_DISCARD;
+			}
+			if ((ctx->features & VBLK_F_WRITE_ZEROES) != 0) {
+				odevctl->info.caps |= VBLKSRV_CAP_WRITE_ZEROES;
+			}
+			return EOK;
+
+		case vblksrv_devctl_discard:
+		case vblksrv_devctl_writeZeroes:
+			if ((idevctl->range.offs > strg->size) || (idevctl->range.len > (strg->size - idevctl->range.offs))) {
+				return -EINVAL;
+			}
+			if (idevctl->type == vblksrv_devctl_discard) {
+				return vblk_discard(strg, strg->start + idevctl->range.offs, idevctl->range.len);
+			}
+			return vblk_writeZeroes(strg, strg->start + idevctl->range.offs, idevctl->range.len, idevctl->range.unmap);
+
+		default:
+			return -ENOSYS;
+	}
+}
+
+
 /* Message handler */
 
 
@@ -143,7 +212,13 @@ static void vblk_msgHandler(void *arg, msg_t *msg)
 			break;
 
 		case mtSync:
-			msg->o.err = -ENOSYS;
+			strg = storage_get(msg->oid.id);
+			msg->o.err = vblksrv_sync(strg);
+			break;
+
+		case mtDevCtl:
+			strg = storage_get(msg->oid.id);
+			msg->o.err = vblksrv_devCtl(strg, msg);
 			break;
 
 		case mtGetAttr:
@@ -201,7 +276,6 @@ static int vblksrv_devInit(storage_t *strg, struct _storage_devCtx_t *ctx)
 	/* No MTD interface */
 	strg->dev->mtd = NULL;
 
-	ctx->req = vblk_open();
 	strg->dev->ctx = ctx;
 
 	return EOK;
@@ -221,17 +295,9 @@ static void vblksrv_devDestroy(storage_t *strg)
 /* Partition initialization */
 
 
-static int vblksrv_mbrRead(storage_t *strg, mbr_t *mbr)
+static ssize_t vblksrv_probeRead(void *arg, off_t offs, void *buff, size_t len)
 {
-	if (vblksrv_read(strg, 0, (void *)mbr, sizeof(mbr_t)) != sizeof(mbr_t)) {
-		return -EIO;
-	}
-
-	if (mbr_deserialize(mbr) < 0) {
-		return -ENOENT;
-	}
-
-	return EOK;
+	return vblksrv_read((storage_t *)arg, offs, buff, len);
 }
 
 
@@ -271,6 +337,8 @@ static int vblksrv_partAdd(storage_t *parent, char *parentPath, storage_t **newP
 		return -ENAMETOOLONG;
 	}
 
+	/* Device requests are served by queue bound handler threads */
+	oid.port = vblksrv_common.port;
 	res = create_dev(&oid, path);
 	if (res < 0) {
 		LOG_ERROR("failed to create partition device");
@@ -290,25 +358,33 @@ static int vblksrv_partAdd(storage_t *parent, char *parentPath, storage_t **newP
 
 static int vblksrv_partsInit(storage_t *parent, char *parentPath)
 {
-	mbr_t mbr;
-	int ret = vblksrv_mbrRead(parent, &mbr);
+	size_t sectorsz = parent->dev->ctx->sectorsz;
+	partprobe_table_t *table = malloc(sizeof(partprobe_table_t));
+	if (table == NULL) {
+		return -ENOMEM;
+	}
+
+	int ret = partprobe_scan(vblksrv_probeRead, parent, sectorsz, parent->size / sectorsz, table);
 	if (ret < 0) {
+		free(table);
 		return ret;
 	}
 
-	size_t partId = 0;
-	for (size_t i = 0; i < MBR_PARTITIONS; i++) {
+	if (table->scheme == partprobe_schemeNone) {
+		free(table);
+		return -ENOENT;
+	}
+
+	for (size_t i = 0; i < table->nparts; i++) {
 		storage_t *part;
-		if (mbr.pent[i].type == PENTRY_EMPTY) {
-			continue;
-		}
-		ret = vblksrv_partAdd(parent, parentPath, &part, partId, mbr.pent[i].start, mbr.pent[i].sectors);
+		ret = vblksrv_partAdd(parent, parentPath, &part, i, table->parts[i].start, table->parts[i].sectors);
 		if (ret < 0) {
 			LOG_ERROR("failed to initialize partition %zu on %s", i, parentPath);
+			free(table);
 			return ret;
 		}
-		partId++;
 	}
+	free(table);
 
 	return EOK;
 }
@@ -351,7 +427,7 @@ static int vblksrv_mountRoot(const char *disk, const char *part)
 /* Server initialization */
 
 
-static int vblksrv_init(virtio_dev_t *vdev, unsigned int idx)
+static int vblksrv_init(virtio_dev_t *vdev, unsigned int idx, const vblksrv_args_t *args, unsigned int *nqueues)
 {
 	struct _storage_devCtx_t *ctx;
 	int ret = vblk_ctxInit(&ctx, vdev);
@@ -362,7 +438,8 @@ static int vblksrv_init(virtio_dev_t *vdev, unsigned int idx)
 		return ret;
 	}
 
-	ctx->vdev = *vdev;
+	ctx->zerocopy = (args->copy) ? 0 : 1;
+	*nqueues = ctx->nqueues;
 
 	storage_t *strg = calloc(1, sizeof(storage_t));
 	if (strg == NULL) {
@@ -391,6 +468,8 @@ static int vblksrv_init(virtio_dev_t *vdev, unsigned int idx)
 
 	char path[8];
 	(void)snprintf(path, sizeof(path), "vblk%u", idx);
+	/* Device requests are served by queue bound handler threads */
+	oid.port = vblksrv_common.port;
 	ret = create_dev(&oid, path);
 	if (ret < 0) {
 		LOG_ERROR("failed to create device");
@@ -403,7 +482,7 @@ static int vblksrv_init(virtio_dev_t *vdev, unsigned int idx)
 
 	TRACE("initialized device %s", path);
 
-	/* Read MBR and initialize partitions */
+	/* Read partition table and initialize partitions */
 	ret = vblksrv_partsInit(strg, path);
 	if ((ret < 0) && (ret != -ENOENT)) {
 		LOG_ERROR("failed to initialize partitions");
@@ -418,6 +497,45 @@ static int vblksrv_init(virtio_dev_t *vdev, unsigned int idx)
 }
 
 
+static void vblksrv_handlerThread(void *arg)
+{
+	msg_rid_t rid;
+	msg_t msg;
+
+	vblk_threadBind((unsigned int)(uintptr_t)arg);
+
+	for (;;) {
+		if (msgRecv(vblksrv_common.port, &msg, &rid) < 0) {
+			continue;
+		}
+
+		vblk_msgHandler(NULL, &msg);
+		msgRespond(vblksrv_common.port, &msg, rid);
+	}
+}
+
+
+static int vblksrv_runHandlers(unsigned int nthreads)
+{
+	void *stack;
+
+	for (unsigned int i = 0; i < nthreads; i++) {
+		stack = malloc(VBLKSRV_THREAD_STACK_SIZE);
+		if (stack == NULL) {
+			return -ENOMEM;
+		}
+
+		/* Queue index is given to the thread explicitly, thread IDs aren't dense */
+		if (beginthread(vblksrv_handlerThread, 4, stack, VBLKSRV_THREAD_STACK_SIZE, (void *)(uintptr_t)i) < 0) {
+			free(stack);
+			return -ENOMEM;
+		}
+	}
+
+	return EOK;
+}
+
+
 static void vblksrv_signalExit(int sig)
 {
 	(void)sig;
@@ -429,7 +547,8 @@ static void vblksrv_help(const char *prog)
 {
 	printf("Usage: %s [options]\n", prog);
 	printf("\t-r <diskId:partId> - mount partition <partId> on disk <diskId> as root\n");
-	printf("\t                     partitions are read as MBR\n");
+	printf("\t                     partitions are read as MBR or GPT\n");
+	printf("\t-c                 - copy all transfers through bounce buffers\n");
 	printf("\t-h                 - print this message\n");
 }
 
@@ -437,7 +556,7 @@ static void vblksrv_help(const char *prog)
 static int vblksrv_parseArgs(int argc, char **argv, vblksrv_args_t *args)
 {
 	for (;;) {
-		int c = getopt(argc, argv, "r:h");
+		int c = getopt(argc, argv, "r:ch");
 		if (c == -1) {
 			return 0;
 		}
@@ -455,6 +574,10 @@ static int vblksrv_parseArgs(int argc, char **argv, vblksrv_args_t *args)
 				args->root = true;
 				break;
 
+			case 'c':
+				args->copy = true;
+				break;
+
 			case 'h':
 				vblksrv_help(argv[0]);
 				return -1;
@@ -513,18 +636,26 @@ int main(int argc, char **argv)
 		exit(EXIT_FAILURE);
 	}
 
+	err = portCreate(&vblksrv_common.port);
+	if (err < 0) {
+		LOG_ERROR("failed to create device requests port (%d)", err);
+		exit(EXIT_FAILURE);
+	}
+
 	virtio_init();
 
-	unsigned int devs = 0;
+	unsigned int devs = 0, nthreads = 1;
 
 	/* Detect and initialize VirtIO block devices */
 	for (size_t i = 0; info[i].type != vdevNONE; i++) {
 		virtio_dev_t vdev;
 		virtio_ctx_t vctx = { .reset = 1 };
 
+		unsigned int nqueues = 1;
+
 		err = virtio_find(&info[i], &vdev, &vctx);
 		if (err == 0) {
-			err = vblksrv_init(&vdev, devs);
+			err = vblksrv_init(&vdev, devs, &args, &nqueues);
 		}
 
 		if (err < 0) {
@@ -535,9 +666,19 @@ int main(int argc, char **argv)
 			exit(EXIT_FAILURE);
 		}
 
+		/* Run one request handler thread per device queue */
+		if (nqueues > nthreads) {
+			nthreads = nqueues;
+		}
 		devs++;
 	}
 
+	err = vblksrv_runHandlers(nthreads);
+	if (err < 0) {
+		LOG_ERROR("failed to start request handlers (%d)", err);
+		exit(EXIT_FAILURE);
+	}
+
 	if (args.root) {
 		if (vblksrv_mountRoot(args.diskId, args.partId) < 0) {
 			LOG_ERROR("Failed to mount root filesystem");
@@ -548,7 +689,8 @@ int main(int argc, char **argv)
 	LOG("initialized");
 
 	kill(getppid(), SIGUSR1);
-	storage_run(1, 2 * _PAGE_SIZE);
+	/* Filesystem requests */
+	storage_run(nthreads, 2 * _PAGE_SIZE);
 
 	return EXIT_SUCCESS;
 }
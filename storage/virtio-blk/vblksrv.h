@@ -0,0 +1,59 @@
+/*
+ * Phoenix-RTOS
+ *
+ * VirtIO block device server interface
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _VBLKSRV_H_
+#define _VBLKSRV_H_
+
+
+#include <stdint.h>
+
+
+/* clang-format off */
+
+enum { vblksrv_devctl_info = 0, vblksrv_devctl_discard, vblksrv_devctl_writeZeroes };
+
+/* clang-format on */
+
+
+/* Device capabilities (vblksrv_info_t.caps) */
+#define VBLKSRV_CAP_FLUSH        (1 << 0)
+#define VBLKSRV_CAP_DISCARD      (1 << 1)
+#define VBLKSRV_CAP_WRITE_ZEROES (1 << 2)
+
+
+typedef struct {
+	int type;
+
+	union {
+		/* discard, writeZeroes (offsets relative to the partition, sector aligned) */
+		struct {
+			uint64_t offs;
+			uint64_t len;
+			uint32_t unmap; /* writeZeroes only: allow device to deallocate the range */
+		} range;
+	};
+} __attribute__((packed)) vblksrv_i_devctl_t;
+
+
+typedef struct {
+	uint64_t size;     /* Partition size */
+	uint32_t sectorsz; /* Device sector size */
+	uint32_t caps;     /* Device capabilities */
+} vblksrv_info_t;
+
+
+typedef struct {
+	vblksrv_info_t info; /* valid only for vblksrv_devctl_info */
+} __attribute__((packed)) vblksrv_o_devctl_t;
+
+
+#endif
@@ -16,6 +16,7 @@
 #include "qspi.h"
 
 #include <errno.h>
+#include <stddef.h>
 #include <string.h>
 #include <sys/time.h>
 
@@ -47,10 +48,17 @@
 #define FLASH_CMD_SE         0xd8 /* 64KB sector erase*/
 #define FLASH_CMD_4SE        0xdc /* 4-byte 64KB sector erase*/
 #define FLASH_CMD_BE         0x60 /* Chip erase */
+#define FLASH_CMD_RDSR2      0x35 /* Read Status Register - 2 */
+#define FLASH_CMD_WRSR2      0x31 /* Write Status Register - 2 */
+#define FLASH_CMD_RDSFDP     0x5a /* Read SFDP parameters */
 
 #define FLASH_TIMEOUT_CMD_MS 1000
 #define FLASH_TIMEOUT_WIP_MS 1000
 
+#define SFDP_SIGNATURE   0x50444653u /* "SFDP" */
+#define SFDP_CMD_SZ      5           /* opcode, 3-byte address, dummy byte */
+#define SFDP_BFPT_DWORDS 16
+
 
 static const flash_cmd_t flash_defCmds[flash_cmd_end] = {
 	{ FLASH_CMD_RDID, 1, 24, 1 },
@@ -479,6 +487,272 @@ static void flashcfg_winbond(flash_info_t *info)
 }
 
 
+/* Serial Flash Discoverable Parameters (JESD216), used for parts without a static configuration */
+
+static inline uint32_t flashcfg_le32(const uint8_t *buf)
+{
+	return (uint32_t)buf[0] | ((uint32_t)buf[1] << 8) | ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+
+static int flashcfg_sfdpRead(uint32_t addr, uint8_t *buf, size_t len)
+{
+	int res;
+	uint8_t tx[SFDP_CMD_SZ + SFDP_BFPT_DWORDS * 4];
+	uint8_t rx[sizeof(tx)];
+
+	if (len > sizeof(tx) - SFDP_CMD_SZ) {
+		return -EINVAL;
+	}
+
+	/* 3-byte address and 8 dummy cycles on a single line */
+	memset(tx, 0, sizeof(tx));
+	tx[0] = FLASH_CMD_RDSFDP;
+	tx[1] = (addr >> 16) & 0xff;
+	tx[2] = (addr >> 8) & 0xff;
+	tx[3] = addr & 0xff;
+
+	qspi_start();
+	res = qspi_transfer(tx, rx, SFDP_CMD_SZ + len, FLASH_TIMEOUT_CMD_MS);
+	qspi_stop();
+
+	if (res < 0) {
+		return res;
+	}
+
+	memcpy(buf, rx + SFDP_CMD_SZ, len);
+
+	return EOK;
+}
+
+
+/* Takes fast read mode described by 16-bit BFPT field: [4:0] dummy clocks, [7:5] mode clocks, [15:8] opcode */
+static int flashcfg_sfdpReadMode(flash_info_t *info, int supported, uint16_t field, int cmd, int cmd4)
+{
+	const uint8_t opCode = field >> 8;
+	const uint8_t cycles = (field & 0x1f) + ((field >> 5) & 0x7);
+
+	/* Controller selects data lines by the opcode, keep the standard ones only */
+	if ((supported == 0) || (opCode != info->cmds[cmd].opCode)) {
+		return 0;
+	}
+
+	/* Data RXed due to dummy cycles has to be byte aligned (see flashdrv_init) */
+	if (((cycles * info->cmds[cmd].dataLines) % 8) != 0) {
+		return 0;
+	}
+
+	info->cmds[cmd].dummyCyc = cycles;
+	info->cmds[cmd4].dummyCyc = cycles;
+
+	return 1;
+}
+
+
+static int flashcfg_sfdpInit(const flash_info_t *info)
+{
+	int res;
+	uint8_t tx[3], sr1 = 0, sr2 = 0;
+
+	if ((info->cmds[info->readCmd].dataLines != 4) && (info->cmds[info->ppCmd].dataLines != 4)) {
+		return EOK;
+	}
+
+	res = flashcfg_statusRegGet(info, &sr1);
+	if ((res >= 0) && ((info->sfdpQer == 5) || (info->sfdpQer == 6))) {
+		tx[0] = FLASH_CMD_RDSR2;
+		tx[1] = 0;
+		qspi_start();
+		res = qspi_transfer(tx, tx, 2, FLASH_TIMEOUT_CMD_MS);
+		qspi_stop();
+		sr2 = tx[1];
+	}
+
+	if (res < 0) {
+		return res;
+	}
+
+	res = flashcfg_wren(info);
+	if (res < 0) {
+		return res;
+	}
+
+	switch (info->sfdpQer) {
+		/* QE is bit 1 of SR2, written along with SR1 */
+		case 1:
+		case 4:
+		case 5:
+			tx[0] = 0x1;
+			tx[1] = sr1;
+			tx[2] = sr2 | (1 << 1);
+			qspi_start();
+			res = qspi_transfer(tx, NULL, 3, FLASH_TIMEOUT_CMD_MS);
+			qspi_stop();
+			break;
+
+		/* QE is bit 6 of SR1 */
+		case 2:
+			tx[0] = 0x1;
+			tx[1] = sr1 | (1 << 6);
+			qspi_start();
+			res = qspi_transfer(tx, NULL, 2, FLASH_TIMEOUT_CMD_MS);
+			qspi_stop();
+			break;
+
+		/* QE is bit 1 of SR2, written separately */
+		case 6:
+			tx[0] = FLASH_CMD_WRSR2;
+			tx[1] = sr2 | (1 << 1);
+			qspi_start();
+			res = qspi_transfer(tx, NULL, 2, FLASH_TIMEOUT_CMD_MS);
+			qspi_stop();
+			break;
+
+		/* No QE bit */
+		default:
+			return EOK;
+	}
+
+	if (res < 0) {
+		return res;
+	}
+
+	return flashcfg_wipCheck(info, FLASH_TIMEOUT_WIP_MS);
+}
+
+
+static int flashcfg_sfdp(flash_info_t *info)
+{
+	int res, quad;
+	uint8_t buf[SFDP_BFPT_DWORDS * 4];
+	uint32_t dw[SFDP_BFPT_DWORDS], ptp, sectSz = 0;
+	unsigned int ndw, i, sizeExp;
+	uint8_t opCode;
+
+	/* SFDP header followed by the first parameter header - basic flash parameter table (BFPT) */
+	res = flashcfg_sfdpRead(0, buf, 16);
+	if (res < 0) {
+		return res;
+	}
+
+	if ((flashcfg_le32(buf) != SFDP_SIGNATURE) || (buf[8] != 0) || (buf[15] != 0xff) || (buf[10] != 1)) {
+		return -ENODEV;
+	}
+
+	ndw = (buf[11] < SFDP_BFPT_DWORDS) ? buf[11] : SFDP_BFPT_DWORDS;
+	ptp = flashcfg_le32(buf + 12) & 0xffffff;
+	if (ndw < 9) {
+		return -ENODEV;
+	}
+
+	res = flashcfg_sfdpRead(ptp, buf, ndw * 4);
+	if (res < 0) {
+		return res;
+	}
+
+	memset(dw, 0, sizeof(dw));
+	for (i = 0; i < ndw; ++i) {
+		dw[i] = flashcfg_le32(buf + i * 4);
+	}
+
+	/* DWORD 2: density in bits */
+	if ((dw[1] & (1u << 31)) != 0) {
+		sizeExp = (dw[1] & 0x7fffffff) - 3;
+	}
+	else {
+		for (sizeExp = 0; ((dw[1] + 1) >> 3) > (1u << sizeExp); ++sizeExp) {
+		}
+	}
+
+	if ((sizeExp < 16) || (sizeExp > 31)) {
+		return -ENODEV;
+	}
+
+	memcpy(info->cmds, flash_defCmds, sizeof(flash_defCmds));
+
+	/* DWORD 8-9: erase types, [7:0] size exponent, [15:8] opcode. Driver erases 64 KB or 4 KB sectors. */
+	for (i = 0; i < 4; ++i) {
+		const uint16_t type = dw[7 + i / 2] >> ((i % 2) * 16);
+		opCode = type >> 8;
+
+		if (((type & 0xff) == 16) && (opCode == info->cmds[flash_cmd_p64e].opCode)) {
+			sectSz = 0x10000;
+		}
+		else if (((type & 0xff) == 12) && (opCode == info->cmds[flash_cmd_p4e].opCode) && (sectSz == 0)) {
+			sectSz = 0x1000;
+		}
+	}
+
+	/* Regions count sectors on 16 bits */
+	if ((sectSz == 0) || (((1u << sizeExp) / sectSz) > 0x10000)) {
+		return -ENODEV;
+	}
+
+	/* No CFI, typical-ish timeouts as for the tabled parts */
+	memset(&info->cfi.timeoutTypical, 0, sizeof(info->cfi) - offsetof(flash_cfi_t, timeoutTypical));
+	info->cfi.timeoutTypical.byteWrite = 0x6;
+	info->cfi.timeoutTypical.pageWrite = 0x9;
+	info->cfi.timeoutTypical.sectorErase = 0x8;
+	info->cfi.timeoutTypical.chipErase = 0xf;
+	info->cfi.timeoutMax.byteWrite = 0x2;
+	info->cfi.timeoutMax.pageWrite = 0x2;
+	info->cfi.timeoutMax.sectorErase = 0x3;
+	info->cfi.timeoutMax.chipErase = 0x3;
+	info->cfi.chipSize = sizeExp;
+	info->cfi.fdiDesc = 0x0102;
+	/* DWORD 11: page size exponent */
+	info->cfi.pageSize = (ndw >= 11) ? ((dw[10] >> 4) & 0xf) : 0x08;
+	info->cfi.regsCount = 1;
+	info->cfi.regs[0].count = ((1u << sizeExp) / sectSz) - 1;
+	info->cfi.regs[0].size = sectSz / 0x100;
+
+	info->addrMode = (info->cfi.chipSize > 0x18) ? flash_4byteAddr : flash_3byteAddr;
+
+	/* DWORD 1: [18:17] address bytes, 3-byte only parts can't address more than 16 MB */
+	if ((info->addrMode == flash_4byteAddr) && (((dw[0] >> 17) & 0x3) == 0)) {
+		return -ENODEV;
+	}
+
+	/* DWORD 15: quad enable requirements, quad modes are used only if the QE bit is known */
+	info->sfdpQer = (ndw >= 15) ? ((dw[14] >> 20) & 0x7) : 0xff;
+	quad = (info->sfdpQer != 0xff) && (info->sfdpQer != 3) && (info->sfdpQer != 7);
+
+	/* Fastest mode first. DTR modes are not supported by the controller. */
+	info->cmds[flash_cmd_fast_read].dummyCyc = 8;
+	info->cmds[flash_cmd_4fast_read].dummyCyc = 8;
+	info->readCmd = flash_cmd_fast_read;
+	if (flashcfg_sfdpReadMode(info, quad && ((dw[0] & (1u << 21)) != 0), dw[2] & 0xffff, flash_cmd_qior, flash_cmd_4qior) != 0) {
+		info->readCmd = flash_cmd_qior;
+	}
+	if ((flashcfg_sfdpReadMode(info, quad && ((dw[0] & (1u << 22)) != 0), dw[2] >> 16, flash_cmd_qor, flash_cmd_4qor) != 0) &&
+			(info->readCmd == flash_cmd_fast_read)) {
+		info->readCmd = flash_cmd_qor;
+	}
+	if ((flashcfg_sfdpReadMode(info, (dw[0] & (1u << 20)) != 0, dw[3] >> 16, flash_cmd_dior, flash_cmd_4dior) != 0) &&
+			(info->readCmd == flash_cmd_fast_read)) {
+		info->readCmd = flash_cmd_dior;
+	}
+	if ((flashcfg_sfdpReadMode(info, (dw[0] & (1u << 16)) != 0, dw[3] & 0xffff, flash_cmd_dor, flash_cmd_4dor) != 0) &&
+			(info->readCmd == flash_cmd_fast_read)) {
+		info->readCmd = flash_cmd_dor;
+	}
+
+	/* BFPT doesn't describe quad page program, use it along with quad read only */
+	info->ppCmd = (info->cmds[info->readCmd].dataLines == 4) ? flash_cmd_qpp : flash_cmd_pp;
+
+	if (info->addrMode == flash_4byteAddr) {
+		/* 4-byte address variants directly follow the 3-byte ones */
+		info->readCmd++;
+		info->ppCmd++;
+	}
+
+	info->name = "SFDP NOR flash";
+	info->init = flashcfg_sfdpInit;
+
+	return EOK;
+}
+
+
 void flashcfg_jedecIDGet(flash_cmd_t *cmd)
 {
 	*cmd = flash_defCmds[flash_cmd_rdid];
@@ -489,6 +763,7 @@ int flashcfg_infoResolve(flash_info_t *info)
 {
 	int res = EOK;
 
+	/* Known parts use static configuration, SFDP describes the other ones */
 	/* Spansion s25fl256s1 */
 	if ((info->cfi.vendorData[0] == 0x1) && (info->cfi.vendorData[2] == 0x19)) {
 		flashcfg_spansion(info);
@@ -505,6 +780,9 @@ int flashcfg_infoResolve(flash_info_t *info)
 	else if ((info->cfi.vendorData[0] == 0xef) && (info->cfi.vendorData[1] == 0x40) && (info->cfi.vendorData[2] == 0x18)) {
 		flashcfg_winbond(info);
 	}
+	else if (flashcfg_sfdp(info) == EOK) {
+		return EOK;
+	}
 	else {
 		info->name = "Unknown";
 		res = -EINVAL;
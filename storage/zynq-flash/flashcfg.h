@@ -108,6 +108,8 @@ typedef struct flash_info {
 	int readCmd; /* Default read command define for specific flash memory */
 	int ppCmd;   /* Default page program command define for specific flash memory */
 
+	uint8_t sfdpQer; /* SFDP quad enable requirements, 0xff if unknown */
+
 	const char *name;
 	/* clang-format off */
 	enum { flash_3byteAddr, flash_4byteAddr } addrMode;
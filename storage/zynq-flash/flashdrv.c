@@ -21,6 +21,7 @@
 #include <string.h>
 #include <sys/time.h>
 #include <sys/threads.h>
+#include <sys/minmax.h>
 #include <cache.h>
 
 /* Value determined empirically, contains time for communication via qspi and system calls invocations. */
@@ -31,6 +32,11 @@
 
 #define BLK_CACHE_SECNUM 16 /* Maximum number of cached sectors in a region */
 
+/* Read through QSPI linear mode window instead of I/O mode FIFO transfers */
+#ifndef ZYNQ_FLASH_LINEAR_READ
+#define ZYNQ_FLASH_LINEAR_READ 1
+#endif
+
 
 /* Cached device context definition */
 struct cache_devCtx_s {
@@ -46,6 +52,7 @@ typedef struct {
 
 	handle_t lock;
 	off_t start;
+	uint8_t *sectBuf; /* Sector content buffer for write back */
 
 	cachectx_t *cache;
 	cache_devCtx_t cacheCtx;
@@ -57,6 +64,7 @@ struct {
 
 	flash_info_t info;     /* CFI structure for NOR flash memory */
 	unsigned int initRegs; /* Number of initialized regions */
+	size_t linearSz;       /* Size of the memory readable in linear mode */
 } fdrv_common;
 
 
@@ -335,9 +343,25 @@ static int _flashdrv_chipErase(unsigned int id)
 static ssize_t _flashdrv_read(unsigned int id, addr_t offs, void *buff, size_t len)
 {
 	ssize_t res;
-	size_t cmdSz, dataSz, transferSz, paddedCmdSz, dummySz;
+	size_t cmdSz, dataSz, transferSz, paddedCmdSz, dummySz, linearSz = 0;
 	const flash_cmd_t cmd = fdrv_common.info.cmds[fdrv_common.info.readCmd];
 
+	if (offs < fdrv_common.linearSz) {
+		res = qspi_linearRead(offs, buff, len);
+		if (res < 0) {
+			return res;
+		}
+
+		linearSz = res;
+		if (linearSz == len) {
+			return len;
+		}
+
+		offs += linearSz;
+		buff = (uint8_t *)buff + linearSz;
+		len -= linearSz;
+	}
+
 	flashdrv_serializeTxCmd(fdrv_common.regs[id].cmdTx, cmd, offs);
 
 	dummySz = (cmd.dummyCyc * cmd.dataLines) / 8;
@@ -365,7 +389,35 @@ static ssize_t _flashdrv_read(unsigned int id, addr_t offs, void *buff, size_t l
 	res = qspi_transfer(NULL, (uint8_t *)buff + dataSz, len - dataSz, TIMEOUT_CMD_MS * len);
 	qspi_stop();
 
-	return (res < 0) ? res : (res + dataSz);
+	return (res < 0) ? res : (res + dataSz + linearSz);
+}
+
+
+static void flashdrv_linearInit(void)
+{
+	ssize_t res;
+	unsigned int i;
+	const flash_info_t *info = &fdrv_common.info;
+	const flash_cmd_t readCmd = info->cmds[info->readCmd];
+	/* Controller supports only 3-byte address commands with address sent on a single line */
+	static const int cmds[] = { flash_cmd_qor, flash_cmd_dor, flash_cmd_fast_read, flash_cmd_read };
+
+	fdrv_common.linearSz = 0;
+
+	for (i = 0; i < sizeof(cmds) / sizeof(cmds[0]); ++i) {
+		const flash_cmd_t cmd = info->cmds[cmds[i]];
+
+		/* Quad and dual reads require configuration done for the default read command */
+		if ((cmd.dataLines > readCmd.dataLines) || (cmd.dummyCyc == CFI_DUMMY_CYCLES_NOT_SET) || ((cmd.dummyCyc % 8) != 0)) {
+			continue;
+		}
+
+		res = qspi_linearInit(CFI_SIZE_FLASH(info->cfi.chipSize), cmd.opCode, cmd.dummyCyc / 8);
+		if (res > 0) {
+			fdrv_common.linearSz = min(res, CFI_SIZE_FLASH(info->cfi.chipSize));
+		}
+		break;
+	}
 }
 
 
@@ -377,13 +429,44 @@ static ssize_t _flashdrv_readCb(uint64_t offs, void *buff, size_t len, cache_dev
 
 /* Block device interface */
 
+/* Returns 1 if data can be programmed over the current content without erase */
+static int flashdrv_isProgrammable(const uint8_t *curr, const uint8_t *data, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; ++i) {
+		if ((curr[i] & data[i]) != data[i]) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+
+static int flashdrv_isErased(const uint8_t *data, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; ++i) {
+		if (data[i] != 0xff) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+
 /* cache_writeCb_t */
 static ssize_t _flashdrv_writeCb(uint64_t offs, const void *buff, size_t len, cache_devCtx_t *ctx)
 {
-	uint8_t *src;
+	const uint8_t *src;
+	uint8_t *curr;
 	addr_t dst;
 	ssize_t res;
 	unsigned int i, regID = ctx->id, pgNb;
+	int erase;
 
 	size_t pageSz, sectSz;
 	const flash_cfi_t *cfi = &fdrv_common.info.cfi;
@@ -392,14 +475,38 @@ static ssize_t _flashdrv_writeCb(uint64_t offs, const void *buff, size_t len, ca
 	sectSz = CFI_SIZE_SECTION(cfi->regs[regID].size);
 	pageSz = CFI_SIZE_PAGE(cfi->pageSize);
 	pgNb = sectSz / pageSz;
+	curr = fdrv_common.regs[regID].sectBuf;
 
 	offs += ctx->start;
 
-	res = _flashdrv_sectorErase(regID, offs);
+	/* Write back rewrites whole sectors, mostly with only a few bytes changed */
+	res = _flashdrv_read(regID, offs, curr, sectSz);
+	if (res < 0) {
+		return res;
+	}
+
+	/* Skip erase if only 1 -> 0 bit changes are needed (e.g. sector already erased) */
+	erase = (res != sectSz) || (flashdrv_isProgrammable(curr, buff, sectSz) == 0);
+	if (erase != 0) {
+		res = _flashdrv_sectorErase(regID, offs);
+		if (res < 0) {
+			return res;
+		}
+	}
 
 	for (i = 0; i < pgNb; ++i) {
 		dst = offs + i * pageSz;
-		src = (uint8_t *)buff + i * pageSz;
+		src = (const uint8_t *)buff + i * pageSz;
+
+		/* Skip pages with unchanged content or erased pages after sector erase */
+		if (erase != 0) {
+			if (flashdrv_isErased(src, pageSz) != 0) {
+				continue;
+			}
+		}
+		else if (memcmp(curr + i * pageSz, src, pageSz) == 0) {
+			continue;
+		}
 
 		res = _flashdrv_pageProgram(regID, dst, src, pageSz);
 		if (res < 0) {
@@ -613,6 +720,7 @@ int flashdrv_done(storage_t *strg)
 			return res;
 		}
 		fdrv_common.regs[strg->dev->ctx->id].cache = NULL;
+		free(fdrv_common.regs[strg->dev->ctx->id].sectBuf);
 
 		resourceDestroy(fdrv_common.regs[strg->dev->ctx->id].lock);
 		free(strg->dev->mtd);
@@ -666,16 +774,24 @@ int flashdrv_devInit(storage_t *strg)
 	secSz = CFI_SIZE_SECTION(info->cfi.regs[id].size);
 	reg->start = flashdrv_regStart(id);
 
+	reg->sectBuf = malloc(secSz);
+	if (reg->sectBuf == NULL) {
+		resourceDestroy(reg->lock);
+		return -ENOMEM;
+	}
+
 	/* Initialize dev structure for new region */
 	strg->dev = malloc(sizeof(storage_dev_t));
 	if (strg->dev == NULL) {
 		resourceDestroy(reg->lock);
+		free(reg->sectBuf);
 		return -ENOMEM;
 	}
 
 	strg->dev->ctx = malloc(sizeof(storage_devCtx_t));
 	if (strg->dev->ctx == NULL) {
 		resourceDestroy(reg->lock);
+		free(reg->sectBuf);
 		free(strg->dev);
 		return -ENOMEM;
 	}
@@ -689,6 +805,7 @@ int flashdrv_devInit(storage_t *strg)
 	strg->dev->mtd = malloc(sizeof(storage_mtd_t));
 	if (strg->dev->mtd == NULL) {
 		resourceDestroy(reg->lock);
+		free(reg->sectBuf);
 		free(strg->dev->ctx);
 		free(strg->dev);
 		return -ENOMEM;
@@ -717,6 +834,7 @@ int flashdrv_devInit(storage_t *strg)
 	strg->dev->blk = malloc(sizeof(storage_blk_t));
 	if (strg->dev->blk == NULL) {
 		resourceDestroy(reg->lock);
+		free(reg->sectBuf);
 		free(strg->dev->ctx);
 		free(strg->dev->mtd);
 		free(strg->dev);
@@ -734,6 +852,7 @@ int flashdrv_devInit(storage_t *strg)
 	reg->cache = cache_init(strg->size, secSz, BLK_CACHE_SECNUM, &cacheOps);
 	if (reg->cache == NULL) {
 		resourceDestroy(reg->lock);
+		free(reg->sectBuf);
 		free(strg->dev->mtd);
 		free(strg->dev->blk);
 		free(strg->dev);
@@ -791,6 +910,10 @@ int flashdrv_init(storage_t *strg)
 		if (fdrv_common.regs == NULL) {
 			return -ENOMEM;
 		}
+
+		if (ZYNQ_FLASH_LINEAR_READ != 0) {
+			flashdrv_linearInit();
+		}
 	}
 
 	/* All regions are initialized */
@@ -28,15 +28,20 @@
 
 #define QSPI_INTERRUPT 51
 #define QSPI_BASE      0xe000d000
+#define QSPI_LINEAR    0xfc000000
 #elif defined(__CPU_ZYNQMP)
 #include <phoenix/arch/aarch64/zynqmp/zynqmp.h>
 
 #define QSPI_INTERRUPT 47
 #define QSPI_BASE      0x00ff0f0000
+#define QSPI_LINEAR    0x00c0000000
 #else
 #error "Unsupported platform"
 #endif
 
+/* Linear mode uses 3-byte addressing of a single memory */
+#define QSPI_LINEAR_MAXSZ 0x1000000
+
 
 /* clang-format off */
 enum { cr = 0, sr, ier, idr, imr, er, dr, txd00, rxd, sicr, txth, rxth, gpio,
@@ -50,6 +55,11 @@ struct {
 	handle_t cond;
 	handle_t inth;
 	handle_t irqLock;
+
+	volatile uint8_t *linear; /* Linear mode window */
+	size_t linearSz;
+	uint32_t linearCr;        /* Linear mode configuration */
+	int linearOn;
 } qspi_common;
 
 
@@ -94,8 +104,15 @@ void qspi_stop(void)
 }
 
 
+static void qspi_IOMode(void);
+
+
 void qspi_start(void)
 {
+	if (qspi_common.linearOn != 0) {
+		qspi_IOMode();
+	}
+
 	*(qspi_common.base + rxth) = 0x1;
 	*(qspi_common.base + cr) &= ~(1 << 10);
 	qspi_dataMemoryBarrier();
@@ -264,9 +281,9 @@ ssize_t qspi_transfer(const uint8_t *txBuff, uint8_t *rxBuff, size_t size, time_
 /* Linear mode allows only for reading data.
  * 03h command is recommended, otherwise first word = 0 (internal bug) :
  * https://support.xilinx.com/s/article/60803?language=en_US
+ * Faster commands are used as well, the first word read after the mode switch is discarded.
  */
-#if 0
-static int qspi_linearMode(void)
+static void qspi_linearMode(void)
 {
 	/* Disable QSPI */
 	*(qspi_common.base + er) &= ~0x1;
@@ -275,31 +292,73 @@ static int qspi_linearMode(void)
 	/* Disable IRQs */
 	*(qspi_common.base + idr) = 0x7d;
 
-	/* Disable linear mode */
-	*(qspi_common.base + lqspi_cr) = 0;
-
-	*(qspi_common.base + cr) = (1 << 14);
-	*(qspi_common.base + cr) = (1 << 10);
+	/* Set master mode, not Legacy mode, automatic CS and start */
+	*(qspi_common.base + cr) = 0x1 | (1u << 31);
 
+	/* Set baud rate to 100 MHz: 200 MHz / 2 */
 	*(qspi_common.base + cr) &= ~(0x7 << 3);
-	*(qspi_common.base + cr) |= (0x3 << 3);
-
-	*(qspi_common.base + cr) |= 0x1;
-	*(qspi_common.base + cr) |= (1 << 31);
-	*(qspi_common.base + cr) &= ~(1 << 26);
+	if ((QSPI_FCLK < 0) || ((qspi_common.linearCr & 0xff) == 0x03)) {
+		/* Set baud rate to 50 MHz: 200 MHz / 4, read data (03h) is not specified for higher frequencies */
+		*(qspi_common.base + cr) |= (0x1 << 3);
+	}
 
-	*(qspi_common.base + cr) |= (0x3 << 6);
-	*(qspi_common.base + cr) &= ~(0x3 << 1);
-	*(qspi_common.base + cr) |= (0x1 << 19);
+	/* Set little endian, FIFO width 32 bits, clock phase and polarity, HOLD and WP driven */
+	*(qspi_common.base + cr) &= ~((1 << 26) | (0x3 << 1));
+	*(qspi_common.base + cr) |= (0x3 << 6) | (1 << 19);
 
-	*(qspi_common.base + lqspi_cr) =  0x80000003;
+	*(qspi_common.base + lqspi_cr) = qspi_common.linearCr;
+	qspi_dataMemoryBarrier();
 
 	*(qspi_common.base + er) = 0x1;
 	qspi_dataMemoryBarrier();
 
-	return EOK;
+	(void)*(volatile uint32_t *)qspi_common.linear;
+	qspi_dataMemoryBarrier();
+
+	qspi_common.linearOn = 1;
+}
+
+
+ssize_t qspi_linearRead(size_t offs, void *buff, size_t len)
+{
+	if ((qspi_common.linear == NULL) || (offs >= qspi_common.linearSz)) {
+		return -EINVAL;
+	}
+
+	len = min(len, qspi_common.linearSz - offs);
+
+	if (qspi_common.linearOn == 0) {
+		qspi_linearMode();
+	}
+
+	memcpy(buff, (const void *)(qspi_common.linear + offs), len);
+	qspi_dataMemoryBarrier();
+
+	return len;
+}
+
+
+ssize_t qspi_linearInit(size_t size, uint8_t opCode, uint8_t dummyBytes)
+{
+	void *linear;
+
+	if (dummyBytes > 0x7) {
+		return -EINVAL;
+	}
+
+	size = (min(size, QSPI_LINEAR_MAXSZ) + _PAGE_SIZE - 1) & ~(_PAGE_SIZE - 1);
+
+	linear = mmap(NULL, size, PROT_READ, MAP_UNCACHED | MAP_PHYSMEM | MAP_ANONYMOUS, -1, QSPI_LINEAR);
+	if (linear == MAP_FAILED) {
+		return -ENOMEM;
+	}
+
+	qspi_common.linear = linear;
+	qspi_common.linearSz = size;
+	qspi_common.linearCr = (1u << 31) | ((uint32_t)dummyBytes << 8) | opCode;
+
+	return size;
 }
-#endif
 
 
 static void qspi_IOMode(void)
@@ -345,6 +404,8 @@ static void qspi_IOMode(void)
 	/* Disable linear mode */
 	*(qspi_common.base + lqspi_cr) = 0;
 	qspi_dataMemoryBarrier();
+
+	qspi_common.linearOn = 0;
 }
 
 
@@ -516,6 +577,12 @@ int qspi_deinit(void)
 	resourceDestroy(qspi_common.cond);
 	resourceDestroy(qspi_common.irqLock);
 
+	if (qspi_common.linear != NULL) {
+		munmap((void *)qspi_common.linear, qspi_common.linearSz);
+		qspi_common.linear = NULL;
+		qspi_common.linearSz = 0;
+	}
+
 	munmap((void *)qspi_common.base, _PAGE_SIZE);
 
 	return qspi_activateClock(0);
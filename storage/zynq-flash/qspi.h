@@ -17,6 +17,7 @@
 
 #include <stdint.h>
 #include <time.h>
+#include <sys/types.h>
 
 
 /* NOTE: All synchronization and exclusion must be done externally.  */
@@ -35,6 +36,16 @@ extern void qspi_start(void);
 extern void qspi_stop(void);
 
 
+/* Map linear mode window of the memory for reads with the given 3-byte address read command,
+ * returns mapped size (at most 16 MB) on success or <0 on error */
+extern ssize_t qspi_linearInit(size_t size, uint8_t opCode, uint8_t dummyBytes);
+
+
+/* Read data through linear mode window, switches controller to linear mode,
+ * qspi_start() switches it back to I/O mode. Returns number of bytes read or <0 on error */
+extern ssize_t qspi_linearRead(size_t offs, void *buff, size_t len);
+
+
 /* Switch off clocks and qspi controller */
 extern int qspi_deinit(void);
 
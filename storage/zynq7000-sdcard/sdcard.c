@@ -70,6 +70,8 @@
 
 #define ARRAY_LENGTH(array) (sizeof(array) / sizeof(array[0]))
 
+#define DMA_BUFFER_PAGES (SDCARD_MAX_TRANSFER / _PAGE_SIZE)
+
 typedef struct {
 	/* Relative Card Address of the card. Needed for selecting the card so it can use the data bus. */
 	uint32_t rca;
@@ -81,6 +83,14 @@ typedef struct {
 	uint32_t commandTimeouts;
 	/* Whether the card supports SDHC protocol (requires slightly different handling) */
 	bool highCapacity;
+	/* Bus mode negotiated with the card */
+	sdcard_busMode_t busMode;
+	/* Data bus width in bits */
+	uint32_t busWidth;
+	/* Actual SD clock frequency in Hz */
+	uint32_t clockHz;
+	/* Whether multi-block transfers are pre-defined with CMD23 instead of stopped with CMD12 */
+	bool setBlockCount;
 } sdcard_cardMetadata_t;
 
 typedef struct {
@@ -94,6 +104,11 @@ typedef struct {
 	void *dmaBuffer;
 	/* Address of DMA buffer in physical memory (for access by the SD Host Controller) */
 	addr_t dmaBufferPhys;
+	/* Physical addresses of DMA buffer pages (buffer doesn't have to be physically contiguous) */
+	addr_t dmaPagesPhys[DMA_BUFFER_PAGES];
+	/* ADMA2 descriptor table describing DMA buffer, NULL if the host only supports SDMA */
+	sdhost_adma2_desc_t *admaTable;
+	addr_t admaTablePhys;
 
 	bool sdioInitialized;
 	bool isCDPinSupported;
@@ -156,25 +171,70 @@ static inline bool sdcard_isWriteProtected(sdcard_hostData_t *host)
 
 static int sdhost_allocDMA(sdcard_hostData_t *host)
 {
-	if (SDCARD_MAX_TRANSFER > _PAGE_SIZE) {
-		return -ENOMEM;
-	}
-
-	void *p = mmap(NULL, SDCARD_MAX_TRANSFER, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_UNCACHED | MAP_CONTIGUOUS, -1, 0);
+	void *p = mmap(NULL, SDCARD_MAX_TRANSFER, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_UNCACHED, -1, 0);
 	if (p == MAP_FAILED) {
 		return -ENOMEM;
 	}
 
 	host->dmaBuffer = p;
-	if (host->dmaBuffer == NULL) {
-		return -ENOMEM;
+	for (int i = 0; i < DMA_BUFFER_PAGES; i++) {
+		host->dmaPagesPhys[i] = va2pa((char *)host->dmaBuffer + i * _PAGE_SIZE);
+	}
+
+	/* SDMA transfers use only the first page (single transfer must not cross SDMA boundary) */
+	host->dmaBufferPhys = host->dmaPagesPhys[0];
+
+	host->admaTable = NULL;
+	if ((*(host->base + SDHOST_REG_CAPABILITIES) & CAPABILITIES_ADMA2) != 0) {
+		p = mmap(NULL, _PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_UNCACHED | MAP_CONTIGUOUS, -1, 0);
+		if (p != MAP_FAILED) {
+			host->admaTable = p;
+			host->admaTablePhys = va2pa(host->admaTable);
+		}
 	}
 
-	host->dmaBufferPhys = va2pa(host->dmaBuffer);
 	return 0;
 }
 
 
+/* Returns maximum length of a single data transfer the host can do */
+static inline size_t sdhost_maxTransfer(sdcard_hostData_t *host)
+{
+	return (host->admaTable != NULL) ? SDCARD_MAX_TRANSFER : _PAGE_SIZE;
+}
+
+
+/* Fills ADMA2 descriptor table with DMA buffer pages covering `len` bytes */
+static void sdhost_setupADMA(sdcard_hostData_t *host, size_t len)
+{
+	sdhost_adma2_desc_t *desc = host->admaTable;
+	size_t descLen = 0;
+
+	for (int i = 0; (i < DMA_BUFFER_PAGES) && (len > 0); i++) {
+		size_t chunk = (len > _PAGE_SIZE) ? _PAGE_SIZE : len;
+		addr_t pa = host->dmaPagesPhys[i];
+
+		/* Merge physically contiguous pages into one descriptor line */
+		if ((descLen == 0) || (desc->addr + descLen != pa) || (descLen + chunk > ADMA2_MAX_LEN)) {
+			if (descLen != 0) {
+				desc++;
+			}
+
+			desc->addr = pa;
+			desc->attr = ADMA2_ATTR_VALID | ADMA2_ATTR_ACT_TRAN;
+			descLen = 0;
+		}
+
+		descLen += chunk;
+		/* Length 0 encodes ADMA2_MAX_LEN */
+		desc->len = (uint16_t)descLen;
+		len -= chunk;
+	}
+
+	desc->attr |= ADMA2_ATTR_END;
+}
+
+
 static int sdhost_isr(unsigned int n, void *arg)
 {
 	/* SD Host controller interrupts are triggered by level, not by edge.
@@ -256,6 +316,21 @@ static int _sdio_cmdSend(sdcard_hostData_t *host, uint8_t cmd, uint32_t arg, uin
 		return -EINVAL;
 	}
 
+	/* NOTE: Auto CMD23 was introduced in SD Host Controller spec 3.00, on this host CMD23 is sent separately */
+	bool autoCmd12 = true;
+	if (((dataType == CMD_READ_MULTI) || (dataType == CMD_WRITE_MULTI)) && host->card.setBlockCount) {
+		uint32_t resp = 0;
+		int ret = _sdio_cmdSend(host, SDIO_CMD23_SET_BLOCK_COUNT, blockCount, &resp, 0, false);
+		if ((ret == 0) && ((resp & CARD_STATUS_ERRORS) == 0)) {
+			/* Card ends the transfer by itself after blockCount blocks */
+			autoCmd12 = false;
+		}
+		else {
+			LOG_ERROR("set block count failed %d %08x, using stop transmission", ret, resp);
+			host->card.setBlockCount = false;
+		}
+	}
+
 	val = *(host->base + SDHOST_REG_PRES_STATE) & PRES_STATE_BUSY_FLAGS;
 	if (val != 0) {
 		TRACE("busy %x", val);
@@ -291,7 +366,13 @@ static int _sdio_cmdSend(sdcard_hostData_t *host, uint8_t cmd, uint32_t arg, uin
 					break;
 			}
 
-			*(host->base + SDHOST_REG_SDMA_ADDRESS) = host->dmaBufferPhys;
+			if (host->admaTable != NULL) {
+				sdhost_setupADMA(host, (size_t)blockCount * blockLength);
+				*(host->base + SDHOST_REG_ADMA_ADDR_1) = host->admaTablePhys;
+			}
+			else {
+				*(host->base + SDHOST_REG_SDMA_ADDRESS) = host->dmaBufferPhys;
+			}
 			sdio_dataBarrier();
 			*(host->base + SDHOST_REG_TRANSFER_BLOCK) =
 				((uint32_t)blockCount << 16) |
@@ -308,7 +389,7 @@ static int _sdio_cmdSend(sdcard_hostData_t *host, uint8_t cmd, uint32_t arg, uin
 
 		if ((dataType == CMD_READ_MULTI) || (dataType == CMD_WRITE_MULTI)) {
 			cmdFrame.multiBlock = 1;
-			cmdFrame.autoCmd12Enable = 1;
+			cmdFrame.autoCmd12Enable = autoCmd12 ? 1 : 0;
 		}
 	}
 
@@ -479,8 +560,11 @@ int sdcard_initCard(unsigned int slot, bool fallbackMode)
 	}
 
 	host->card.commandTimeouts = 0;
+	host->card.busMode = sdcard_busModeNone;
+	host->card.setBlockCount = false;
 	/* Switch off 4-bit mode, because card will be in 1-bit mode after CMD0 */
 	*(host->base + SDHOST_REG_HOST_CONTROL) &= ~HOST_CONTROL_4_BIT_MODE;
+	host->card.busWidth = 1;
 	sdcard_configClockAndPower(host, SD_FREQ_INITIAL);
 	/* Before we know the card's RCA, set to 0 to send to all cards */
 	host->card.rca = 0;
@@ -588,7 +672,12 @@ int sdcard_initCard(unsigned int slot, bool fallbackMode)
 		return -EIO;
 	}
 
-	return fallbackMode ? 0 : sdcard_wideAndFast(host);
+	if (fallbackMode) {
+		host->card.busMode = sdcard_busModeFallback;
+		return 0;
+	}
+
+	return sdcard_wideAndFast(host);
 }
 
 
@@ -640,6 +729,7 @@ static int sdcard_wideAndFast(sdcard_hostData_t *host)
 	}
 
 	bool cmd6Supported = SCR_SD_SPEC(bigRegs) >= SCR_SD_SPEC_V1_10;
+	bool cmd23Supported = SCR_CMD23_SUPPORT(bigRegs) != 0;
 	/* In theory all SD cards should support 4-bit, but make sure */
 	if ((SCR_BUS_WIDTHS(bigRegs) & SCR_BUS_WIDTHS_4_BIT) != 0) {
 		if (sdio_cmdSend(host, SDIO_ACMD6_SET_BUS_WIDTH, 2, NULL) < 0) {
@@ -658,10 +748,16 @@ static int sdcard_wideAndFast(sdcard_hostData_t *host)
 			LOG_ERROR("bus widening failed");
 			return -EIO;
 		}
+
+		host->card.busWidth = 4;
 	}
 
+	/* NOTE: UHS-I modes (SDR50, SDR104, DDR50) need 1.8V signalling and the Host Control 2 register
+	 * introduced in SD Host Controller spec 3.00. This host implements spec 2.00, so High Speed is the fastest mode.
+	 */
 	bool isHighSpeedSupported = false;
-	if (cmd6Supported && sdcard_hasHighSpeedFunction(host, bigRegs)) {
+	bool hostHighSpeed = (*(host->base + SDHOST_REG_CAPABILITIES) & CAPABILITIES_HIGH_SPEED) != 0;
+	if (hostHighSpeed && cmd6Supported && sdcard_hasHighSpeedFunction(host, bigRegs)) {
 		uint32_t switchFunctionArg = SDIO_SWITCH_FUNC_SET | SDIO_SWITCH_FUNC_HIGH_SPEED;
 		if (sdio_cmdSendEx(host, SDIO_CMD6_SWITCH_FUNC, switchFunctionArg, NULL, false, bigRegs) == 0) {
 			if (sdcard_extractFunctionSwitchResult(bigRegs, SDCARD_FUNCTION_GROUP_ACCESS_MODE) == 1) {
@@ -691,6 +787,9 @@ static int sdcard_wideAndFast(sdcard_hostData_t *host)
 		return -EIO;
 	}
 
+	host->card.busMode = isHighSpeedSupported ? sdcard_busModeHighSpeed : sdcard_busModeDefault;
+	host->card.setBlockCount = cmd23Supported;
+	TRACE("CMD23 %ssupported", cmd23Supported ? "" : "not ");
 	return 0;
 }
 
@@ -740,6 +839,12 @@ static void _sdcard_free(sdcard_hostData_t *host)
 		host->dmaBufferPhys = (addr_t)NULL;
 	}
 
+	if (host->admaTable != NULL) {
+		munmap(host->admaTable, _PAGE_SIZE);
+		host->admaTable = NULL;
+		host->admaTablePhys = (addr_t)NULL;
+	}
+
 	*(host->base + SDHOST_REG_INTR_STATUS_ENABLE) = 0;
 	*(host->base + SDHOST_REG_INTR_SIGNAL_ENABLE) = 0;
 	*(host->base + SDHOST_REG_CLOCK_CONTROL) = 0;
@@ -829,6 +934,10 @@ int sdcard_initHost(unsigned int slot)
 		return -EIO;
 	}
 
+	if (host->admaTable != NULL) {
+		*(host->base + SDHOST_REG_HOST_CONTROL) |= HOST_CONTROL_DMA_SELECT_ADMA32;
+	}
+
 	if (sdcard_configClockAndPower(host, SD_FREQ_INITIAL) < 0) {
 		_sdcard_free(host);
 		return -EIO;
@@ -897,6 +1006,9 @@ static int sdcard_configClockAndPower(sdcard_hostData_t *host, uint32_t freq)
 		*(host->base + SDHOST_REG_HOST_CONTROL) &= ~HOST_CONTROL_HIGH_SPEED;
 	}
 
+	uint32_t divisor = ((divRegValue & CLOCK_CONTROL_DIV_MASK) >> 8) * 2;
+	host->card.clockHz = (divisor == 0) ? host->refclkFrequency : (host->refclkFrequency / divisor);
+
 	/* This looks weird because we may set the "divisor" to 0, but this is intended */
 	*(host->base + SDHOST_REG_CLOCK_CONTROL) = divRegValue | CLOCK_CONTROL_START_INTERNAL_CLOCK;
 	sdio_dataBarrier();
@@ -915,7 +1027,7 @@ static int sdcard_configClockAndPower(sdcard_hostData_t *host, uint32_t freq)
 }
 
 
-static int _sdcard_transferBlocks(sdcard_hostData_t *host, sdio_dir_t dir, uint32_t blockOffset, void *data, size_t len)
+static int _sdcard_transferChunk(sdcard_hostData_t *host, sdio_dir_t dir, uint32_t blockOffset, void *data, size_t len)
 {
 	uint8_t cmd;
 
@@ -965,6 +1077,27 @@ static int _sdcard_transferBlocks(sdcard_hostData_t *host, sdio_dir_t dir, uint3
 }
 
 
+static int _sdcard_transferBlocks(sdcard_hostData_t *host, sdio_dir_t dir, uint32_t blockOffset, void *data, size_t len)
+{
+	size_t maxLen = sdhost_maxTransfer(host);
+
+	/* With ADMA2 the whole transfer is a single command */
+	while (len > 0) {
+		size_t chunk = (len > maxLen) ? maxLen : len;
+		int ret = _sdcard_transferChunk(host, dir, blockOffset, data, chunk);
+		if (ret < 0) {
+			return ret;
+		}
+
+		blockOffset += chunk / SDCARD_BLOCKLEN;
+		data = (uint8_t *)data + chunk;
+		len -= chunk;
+	}
+
+	return 0;
+}
+
+
 int sdcard_transferBlocks(unsigned int slot, sdio_dir_t dir, uint32_t blockOffset, void *data, size_t len)
 {
 	sdcard_hostData_t *host = sdcard_getHostForSlot(slot);
@@ -1078,8 +1211,8 @@ int sdcard_writeFF(unsigned int slot, uint32_t blockOffset, uint32_t nBlocks)
 	}
 
 	mutexLock(host->cmdLock);
-	uint32_t erasePerIteration = SDCARD_MAX_TRANSFER / SDCARD_BLOCKLEN;
-	memset(host->dmaBuffer, 0xff, SDCARD_MAX_TRANSFER);
+	uint32_t erasePerIteration = sdhost_maxTransfer(host) / SDCARD_BLOCKLEN;
+	memset(host->dmaBuffer, 0xff, sdhost_maxTransfer(host));
 	while (nBlocks > 0) {
 		if (nBlocks < erasePerIteration) {
 			erasePerIteration = nBlocks;
@@ -1131,6 +1264,20 @@ uint32_t sdcard_getEraseSizeBlocks(unsigned int slot)
 }
 
 
+int sdcard_getBusInfo(unsigned int slot, sdcard_busInfo_t *info)
+{
+	sdcard_hostData_t *host = sdcard_getHostForSlot(slot);
+	if ((host == NULL) || (info == NULL)) {
+		return -EINVAL;
+	}
+
+	info->mode = host->card.busMode;
+	info->width = host->card.busWidth;
+	info->clockHz = (host->card.busMode == sdcard_busModeNone) ? 0 : host->card.clockHz;
+	return 0;
+}
+
+
 sdcard_insertion_t sdcard_isInserted(unsigned int slot)
 {
 	sdcard_hostData_t *host = sdcard_getHostForSlot(slot);
@@ -18,8 +18,8 @@
 #include <stdint.h>
 #include <stddef.h>
 
-#define SDCARD_MAX_TRANSFER 4096 /* Maximum size of a single transfer in bytes */
-#define SDCARD_BLOCKLEN     512  /* Block size in bytes used for sdcard_transferBlocks */
+#define SDCARD_MAX_TRANSFER (256 * 1024) /* Maximum size of a single transfer in bytes */
+#define SDCARD_BLOCKLEN     512          /* Block size in bytes used for sdcard_transferBlocks */
 
 typedef enum {
 	sdio_read,
@@ -32,6 +32,19 @@ typedef enum SDCARD_INSERTION {
 	SDCARD_INSERTION_IN = 1,
 } sdcard_insertion_t;
 
+typedef enum {
+	sdcard_busModeNone = 0,  /* Card not initialized */
+	sdcard_busModeFallback,  /* 1-bit bus, initialization clock */
+	sdcard_busModeDefault,   /* Default Speed, up to 25 MHz */
+	sdcard_busModeHighSpeed, /* High Speed, up to 50 MHz */
+} sdcard_busMode_t;
+
+typedef struct {
+	sdcard_busMode_t mode;
+	uint32_t width;   /* Data bus width in bits */
+	uint32_t clockHz; /* Actual SD clock frequency */
+} sdcard_busInfo_t;
+
 typedef int (*sdcard_event_handler_t)(unsigned int);
 
 
@@ -56,6 +69,10 @@ extern uint32_t sdcard_getSizeBlocks(unsigned int slot);
 extern uint32_t sdcard_getEraseSizeBlocks(unsigned int slot);
 
 
+/* Returns bus mode negotiated with the card during sdcard_initCard() */
+extern int sdcard_getBusInfo(unsigned int slot, sdcard_busInfo_t *info);
+
+
 /* On SD cards erase is not necessary to write blocks.
  * State after erase is dependent on implementation of the SD card.
  */
@@ -32,6 +32,7 @@ enum SDIO_CMD {
 	SDIO_CMD16_SET_BLOCKLEN = 16,         /* set block length for data transfers (non-SDHC cards only) */
 	SDIO_CMD17_READ_SINGLE_BLOCK = 17,    /* read single block */
 	SDIO_CMD18_READ_MULTIPLE_BLOCK = 18,  /* read multiple blocks */
+	SDIO_CMD23_SET_BLOCK_COUNT = 23,      /* set number of blocks of the following multi-block transfer */
 	SDIO_CMD24_WRITE_SINGLE_BLOCK = 24,   /* write single block */
 	SDIO_CMD25_WRITE_MULTIPLE_BLOCK = 25, /* write multiple blocks */
 	SDIO_CMD32_ERASE_WR_BLK_START = 32,   /* set start address for erase operation */
@@ -154,6 +155,34 @@ enum HOST_CONTROL {
 
 };
 
+enum CAPABILITIES {
+	CAPABILITIES_ADMA2 = 1UL << 19,       /* ADMA2 supported */
+	CAPABILITIES_HIGH_SPEED = 1UL << 21,  /* High Speed supported */
+	CAPABILITIES_SDMA = 1UL << 22,        /* SDMA supported */
+	CAPABILITIES_VOLTAGE_3V3 = 1UL << 24, /* 3.3V bus voltage supported */
+	CAPABILITIES_VOLTAGE_3V0 = 1UL << 25, /* 3.0V bus voltage supported */
+	CAPABILITIES_VOLTAGE_1V8 = 1UL << 26, /* 1.8V bus voltage supported */
+};
+
+/* ADMA2 descriptor attributes */
+enum ADMA2_ATTR {
+	ADMA2_ATTR_VALID = 1U << 0,       /* Descriptor line is valid */
+	ADMA2_ATTR_END = 1U << 1,         /* Last descriptor in the table */
+	ADMA2_ATTR_INT = 1U << 2,         /* Generate DMA interrupt after this descriptor */
+	ADMA2_ATTR_ACT_NOP = 0b00U << 4,  /* No operation */
+	ADMA2_ATTR_ACT_TRAN = 0b10U << 4, /* Transfer data of one descriptor line */
+	ADMA2_ATTR_ACT_LINK = 0b11U << 4, /* Link to another descriptor table */
+};
+
+#define ADMA2_MAX_LEN 0x10000 /* Max length of a single descriptor line (encoded as 0) */
+
+/* ADMA2 32-bit descriptor */
+typedef struct {
+	uint16_t attr;
+	uint16_t len;
+	uint32_t addr;
+} __attribute__((packed)) sdhost_adma2_desc_t;
+
 enum CLOCK_CONTROL {
 	CLOCK_CONTROL_START_INTERNAL_CLOCK = 1UL << 0,  /* Flag to start internal clock for SD host */
 	CLOCK_CONTROL_INTERNAL_CLOCK_STABLE = 1UL << 1, /* Flag to check if the internal clock is stable and can be used */
@@ -313,6 +342,7 @@ static const cmd_metadata_t sdCmdMetadata[MAX_SD_COMMANDS] = {
 	[SDIO_CMD16_SET_BLOCKLEN] = RESPONSE_METADATA_R1(CMD_NO_DATA),
 	[SDIO_CMD17_READ_SINGLE_BLOCK] = RESPONSE_METADATA_R1(CMD_READ),
 	[SDIO_CMD18_READ_MULTIPLE_BLOCK] = RESPONSE_METADATA_R1(CMD_READ_MULTI),
+	[SDIO_CMD23_SET_BLOCK_COUNT] = RESPONSE_METADATA_R1(CMD_NO_DATA),
 	[SDIO_CMD24_WRITE_SINGLE_BLOCK] = RESPONSE_METADATA_R1(CMD_WRITE),
 	[SDIO_CMD25_WRITE_MULTIPLE_BLOCK] = RESPONSE_METADATA_R1(CMD_WRITE_MULTI),
 	[SDIO_CMD32_ERASE_WR_BLK_START] = RESPONSE_METADATA_R1(CMD_NO_DATA),
@@ -347,6 +377,8 @@ static const cmd_metadata_t sdCmdMetadata[MAX_SD_COMMANDS] = {
 #define SCR_BUS_WIDTHS_1_BIT (1 << 0)
 #define SCR_BUS_WIDTHS_4_BIT (1 << 2)
 
+#define SCR_CMD23_SUPPORT(x) ((x[3] >> 1) & 1)
+
 #define SCR_SD_SPEC(x)    (x[0] & 0xf)
 #define SCR_SD_SPEC_V1_01 (0)
 #define SCR_SD_SPEC_V1_10 (1)
@@ -32,7 +32,7 @@
 #include <cache.h>
 #include <mtd/mtd.h>
 #include <storage/storage.h>
-#include <mbr.h>
+#include <partprobe.h>
 
 #include "sdcard.h"
 
@@ -42,9 +42,25 @@
 #define TRACE(str, ...)     do { if (0) fprintf(stderr, LOG_TAG " trace: " str "\n", ##__VA_ARGS__); } while (0)
 /* clang-format on */
 
-#define BLK_CACHE_SECSIZE   (2 * SDCARD_BLOCKLEN) /* Size of cache sector (must be multiple of SDCARD_BLOCKLEN) */
-#define BLK_CACHE_SECNUM    16                    /* Maximum number of cached sectors in a region */
-#define MTD_DEFAULT_ERASESZ 0x10000
+#define BLK_CACHE_SECSIZE     (2 * SDCARD_BLOCKLEN) /* Default size of cache sector (must be multiple of SDCARD_BLOCKLEN) */
+#define BLK_CACHE_SECNUM      16                    /* Default maximum number of cached sectors in a region */
+#define BLK_CACHE_FLUSH_AGE   1000                  /* Default age (ms) of dirty data written back by the flusher */
+#define BLK_CACHE_FLUSH_WMARK 50                    /* Default dirty data watermark (% of cache capacity) waking up the flusher */
+#define BLK_CACHE_CFG_SLOTS   4                     /* Number of slots with individual cache configuration */
+#define MTD_DEFAULT_ERASESZ   0x10000
+
+#define FLUSHER_THREAD_STACK_SIZE 2048
+#define SLOT_THREAD_STACK_SIZE    (2 * _PAGE_SIZE)
+#define SLOTS_MAX                 4 /* Maximum number of SD hosts with own request port */
+
+/* Server threads of each slot, a long transfer on one card doesn't stall requests of the other cards */
+#ifndef SDSTORAGE_SLOT_THREADS
+#define SDSTORAGE_SLOT_THREADS 2
+#endif
+#define FLUSHER_TICK_US           (100 * 1000)
+
+#define DISCARD_QUEUE_LEN    16   /* Maximum number of pending discard ranges per card */
+#define DISCARD_BATCH_BLOCKS 8192 /* Maximum number of blocks erased by the flusher at a time */
 
 #define MTD_DEV_FORMAT   "mmcmtd%u"
 #define BLOCK_DEV_FORMAT "mmcblk%u"
@@ -56,8 +72,14 @@ typedef struct {
 	blockSize_t sizeBl;
 } sdcard_partition_t;
 
+typedef struct {
+	blockSize_t start;
+	blockSize_t end; /* exclusive */
+} sdcard_range_t;
+
 struct cache_devCtx_s {
 	unsigned int id;
+	struct _storage_devCtx_t *owner;
 	/* cache_deinit tries to flush cache and if writing fails it stops freeing up resources.
 	 * As a workaround, noFlushShutdown makes all operations "succeed" and behave as no-op.
 	 */
@@ -65,22 +87,48 @@ struct cache_devCtx_s {
 };
 
 typedef struct _storage_devCtx_t {
+	struct _storage_devCtx_t *next, *prev;
 	unsigned int id;
 	handle_t lock;
-	int cachePolicy;
+	uint64_t size;
+	sdstorage_cache_t cacheCfg;
 	cachectx_t *cache;
 	cache_devCtx_t devCtxForCache;
+	/* Write back dirty data accounting for the flusher, dirty lines are tracked so that
+	 * rewriting a dirty line doesn't count again (see _sdstorage_dirtyMark())
+	 */
+	size_t dirtyBytes;
+	time_t dirtySince;
+	uint64_t *dirtyLines;   /* Open addressing set of dirty line offsets, DIRTY_LINE_NONE - empty */
+	unsigned int dirtyMask; /* Number of dirtyLines slots - 1 */
+	/* Pending discards, sorted and aligned to eraseSizeBl */
+	blockSize_t eraseSizeBl;
+	sdcard_range_t discards[DISCARD_QUEUE_LEN];
+	unsigned int nDiscards;
 } storage_devCtx_t;
 
 static struct {
 	bool commonInit;
 	handle_t lock;
-	mbr_t mbr_temp;
-	int defaultCachePolicy;
+	sdstorage_cache_t defaultCacheCfg;
+	sdstorage_cache_t slotCacheCfg[BLK_CACHE_CFG_SLOTS];
+	/* Inserted cards, protected by lock */
+	storage_devCtx_t *devices;
+	handle_t flushCond;
+	/* Card written back by the flusher outside of lock, removal waits on flushIdleCond */
+	storage_devCtx_t *flushing;
+	handle_t flushIdleCond;
+	/* Request ports of the slots' device files */
+	uint32_t slotPorts[SLOTS_MAX];
+	unsigned int nSlots;
+	void (*handler)(void *arg, msg_t *msg);
 } sdcard_common = { .commonInit = false };
 
+#define DIRTY_LINE_NONE ((uint64_t)-1)
+
 #define PRESENCE_THREAD_STACK_SIZE 1024
 static char presenceThreadStack[PRESENCE_THREAD_STACK_SIZE] __attribute__((aligned(8)));
+static char flusherThreadStack[FLUSHER_THREAD_STACK_SIZE] __attribute__((aligned(8)));
 
 
 static size_t calculateSizeWithSaturation(blockSize_t sizeBlocks)
@@ -102,6 +150,126 @@ static size_t calculateSizeWithSaturation(blockSize_t sizeBlocks)
 }
 
 
+static uint64_t *sdstorage_dirtySetAlloc(uint32_t lineCnt, unsigned int *mask)
+{
+	unsigned int size = 2;
+	uint64_t *set;
+
+	/* At most lineCnt lines are dirty, keep the set at most half full */
+	while (size < 2 * lineCnt) {
+		size <<= 1;
+	}
+
+	set = malloc(size * sizeof(*set));
+	if (set != NULL) {
+		for (unsigned int i = 0; i < size; i++) {
+			set[i] = DIRTY_LINE_NONE;
+		}
+		*mask = size - 1;
+	}
+
+	return set;
+}
+
+
+static unsigned int _sdstorage_dirtyHash(storage_devCtx_t *ctx, uint64_t line)
+{
+	return (unsigned int)((line / ctx->cacheCfg.lineSize) * 2654435761u) & ctx->dirtyMask;
+}
+
+
+/* Returns true if the line was clean */
+static bool _sdstorage_dirtyAdd(storage_devCtx_t *ctx, uint64_t line)
+{
+	unsigned int i = _sdstorage_dirtyHash(ctx, line);
+
+	while (ctx->dirtyLines[i] != DIRTY_LINE_NONE) {
+		if (ctx->dirtyLines[i] == line) {
+			return false;
+		}
+		i = (i + 1) & ctx->dirtyMask;
+	}
+
+	/* Keep a free slot, lines not stored are counted on every write */
+	if ((ctx->dirtyBytes / ctx->cacheCfg.lineSize) < ctx->dirtyMask) {
+		ctx->dirtyLines[i] = line;
+	}
+
+	return true;
+}
+
+
+/* Returns true if the line was dirty */
+static bool _sdstorage_dirtyRemove(storage_devCtx_t *ctx, uint64_t line)
+{
+	unsigned int i = _sdstorage_dirtyHash(ctx, line), j, k;
+
+	while (ctx->dirtyLines[i] != line) {
+		if (ctx->dirtyLines[i] == DIRTY_LINE_NONE) {
+			return false;
+		}
+		i = (i + 1) & ctx->dirtyMask;
+	}
+
+	/* Backward shift deletion keeps the probe sequences of the remaining lines intact */
+	for (j = i;;) {
+		j = (j + 1) & ctx->dirtyMask;
+		if (ctx->dirtyLines[j] == DIRTY_LINE_NONE) {
+			break;
+		}
+
+		k = _sdstorage_dirtyHash(ctx, ctx->dirtyLines[j]);
+		if ((i <= j) ? ((i < k) && (k <= j)) : ((i < k) || (k <= j))) {
+			continue;
+		}
+
+		ctx->dirtyLines[i] = ctx->dirtyLines[j];
+		i = j;
+	}
+	ctx->dirtyLines[i] = DIRTY_LINE_NONE;
+
+	return true;
+}
+
+
+/* Accounts clean to dirty transitions of the lines written */
+static void _sdstorage_dirtyMark(storage_devCtx_t *ctx, uint64_t offs, size_t len)
+{
+	uint32_t lineSize = ctx->cacheCfg.lineSize;
+
+	for (uint64_t line = offs - (offs % lineSize); line < offs + len; line += lineSize) {
+		if (_sdstorage_dirtyAdd(ctx, line)) {
+			ctx->dirtyBytes += lineSize;
+		}
+	}
+}
+
+
+static void _sdstorage_dirtyClear(storage_devCtx_t *ctx, uint64_t offs, size_t len)
+{
+	uint32_t lineSize = ctx->cacheCfg.lineSize;
+
+	if (ctx->dirtyBytes == 0) {
+		return;
+	}
+
+	for (uint64_t line = offs - (offs % lineSize); line < offs + len; line += lineSize) {
+		if (_sdstorage_dirtyRemove(ctx, line) && (ctx->dirtyBytes >= lineSize)) {
+			ctx->dirtyBytes -= lineSize;
+		}
+	}
+}
+
+
+static void _sdstorage_dirtyReset(storage_devCtx_t *ctx)
+{
+	for (unsigned int i = 0; i <= ctx->dirtyMask; i++) {
+		ctx->dirtyLines[i] = DIRTY_LINE_NONE;
+	}
+	ctx->dirtyBytes = 0;
+}
+
+
 static int sdcard_readCb(uint64_t offs, void *buff, size_t len, cache_devCtx_t *ctx)
 {
 	if (ctx->noFlushShutdown) {
@@ -135,7 +303,162 @@ static int sdcard_writeCb(uint64_t offs, const void *buff, size_t len, cache_dev
 	len = min(len, SDCARD_MAX_TRANSFER);
 
 	int ret = sdcard_transferBlocks(ctx->id, sdio_write, lba, (void *)buff, len);
-	return ret < 0 ? ret : len;
+	if (ret < 0) {
+		return ret;
+	}
+
+	/* Called with the card's lock held (cache operations), written back lines are clean */
+	_sdstorage_dirtyClear(ctx->owner, offs, len);
+
+	return len;
+}
+
+
+static cachectx_t *sdstorage_cacheCreate(storage_devCtx_t *ctx, const sdstorage_cache_t *cfg)
+{
+	cache_ops_t cacheOps;
+	cacheOps.readCb = sdcard_readCb;
+	cacheOps.writeCb = sdcard_writeCb;
+	cacheOps.ctx = &ctx->devCtxForCache;
+
+	return cache_init(ctx->size, cfg->lineSize, cfg->lineCnt, &cacheOps);
+}
+
+
+static bool _sdstorage_overWatermark(storage_devCtx_t *ctx)
+{
+	uint64_t capacity = (uint64_t)ctx->cacheCfg.lineSize * ctx->cacheCfg.lineCnt;
+
+	return (ctx->cacheCfg.flushWmark != 0) && ((uint64_t)ctx->dirtyBytes * 100 >= capacity * ctx->cacheCfg.flushWmark);
+}
+
+
+static int _sdstorage_flushAll(storage_devCtx_t *ctx)
+{
+	int res = cache_flush(ctx->cache, 0, ctx->size);
+	if (res >= 0) {
+		_sdstorage_dirtyReset(ctx);
+	}
+
+	return res;
+}
+
+
+/* Adds range to the queue merging it with overlapping and adjacent ranges, returns -ENOSPC if the queue is full */
+static int _sdstorage_discardQueue(storage_devCtx_t *ctx, blockSize_t start, blockSize_t end)
+{
+	sdcard_range_t *q = ctx->discards;
+	unsigned int i, j;
+
+	for (i = 0; (i < ctx->nDiscards) && (q[i].end < start); i++) {
+	}
+
+	for (j = i; (j < ctx->nDiscards) && (q[j].start <= end); j++) {
+		start = min(start, q[j].start);
+		end = max(end, q[j].end);
+	}
+
+	if (i == j) {
+		if (ctx->nDiscards == DISCARD_QUEUE_LEN) {
+			return -ENOSPC;
+		}
+
+		memmove(&q[i + 1], &q[i], (ctx->nDiscards - i) * sizeof(q[0]));
+		ctx->nDiscards++;
+	}
+	else {
+		memmove(&q[i + 1], &q[j], (ctx->nDiscards - j) * sizeof(q[0]));
+		ctx->nDiscards -= j - i - 1;
+	}
+
+	q[i].start = start;
+	q[i].end = end;
+
+	return EOK;
+}
+
+
+/* Removes erase sectors overlapping byte range from the queue, so written data is not erased afterwards */
+static void _sdstorage_discardCancel(storage_devCtx_t *ctx, uint64_t offs, uint64_t len)
+{
+	sdcard_range_t *q = ctx->discards;
+	blockSize_t start, end;
+	unsigned int i = 0;
+
+	if ((ctx->nDiscards == 0) || (len == 0)) {
+		return;
+	}
+
+	start = offs / SDCARD_BLOCKLEN;
+	start -= start % ctx->eraseSizeBl;
+	end = (offs + len + SDCARD_BLOCKLEN - 1) / SDCARD_BLOCKLEN;
+	end += (ctx->eraseSizeBl - end % ctx->eraseSizeBl) % ctx->eraseSizeBl;
+
+	while (i < ctx->nDiscards) {
+		if ((q[i].end <= start) || (q[i].start >= end)) {
+			i++;
+		}
+		else if ((q[i].start < start) && (q[i].end > end)) {
+			/* Split, tail is dropped if there is no space for it */
+			if (ctx->nDiscards < DISCARD_QUEUE_LEN) {
+				memmove(&q[i + 2], &q[i + 1], (ctx->nDiscards - i - 1) * sizeof(q[0]));
+				q[i + 1].start = end;
+				q[i + 1].end = q[i].end;
+				ctx->nDiscards++;
+			}
+			q[i].end = start;
+			break;
+		}
+		else if (q[i].start < start) {
+			q[i++].end = start;
+		}
+		else if (q[i].end > end) {
+			q[i++].start = end;
+		}
+		else {
+			memmove(&q[i], &q[i + 1], (ctx->nDiscards - i - 1) * sizeof(q[0]));
+			ctx->nDiscards--;
+		}
+	}
+}
+
+
+static int _sdstorage_discardErase(storage_devCtx_t *ctx, blockSize_t start, blockSize_t nBlocks)
+{
+	/* Discarded data doesn't have to be written back */
+	int res = cache_invalidate(ctx->cache, (uint64_t)start * SDCARD_BLOCKLEN, (uint64_t)(start + nBlocks) * SDCARD_BLOCKLEN);
+	if (res < 0) {
+		return res;
+	}
+
+	return sdcard_eraseBlocks(ctx->id, start, nBlocks);
+}
+
+
+/* Erases next batch of the first queued range */
+static void _sdstorage_discardRun(storage_devCtx_t *ctx)
+{
+	sdcard_range_t *q = ctx->discards;
+	blockSize_t n = min(q[0].end - q[0].start, DISCARD_BATCH_BLOCKS);
+	int res;
+
+	n -= n % ctx->eraseSizeBl;
+	if (n == 0) {
+		n = ctx->eraseSizeBl;
+	}
+
+	res = _sdstorage_discardErase(ctx, q[0].start, n);
+	if (res < 0) {
+		/* Discard is only a hint, drop the whole range */
+		LOG_ERROR("discard failed: %d", res);
+		n = q[0].end - q[0].start;
+	}
+
+	q[0].start += n;
+	if (q[0].start >= q[0].end) {
+		memmove(&q[0], &q[1], (ctx->nDiscards - 1) * sizeof(q[0]));
+		ctx->nDiscards--;
+	}
 }
 
 
@@ -156,7 +479,18 @@ static ssize_t sdstorage_cachedWrite(struct _storage_t *strg, off_t start, const
 	ssize_t res;
 	storage_devCtx_t *ctx = strg->dev->ctx;
 	mutexLock(ctx->lock);
-	res = cache_write(ctx->cache, start, data, size, ctx->cachePolicy);
+	_sdstorage_discardCancel(ctx, start, size);
+	res = cache_write(ctx->cache, start, data, size, ctx->cacheCfg.policy);
+	if ((res > 0) && (ctx->cacheCfg.policy == LIBCACHE_WRITE_BACK)) {
+		if (ctx->dirtyBytes == 0) {
+			gettime(&ctx->dirtySince, NULL);
+		}
+
+		_sdstorage_dirtyMark(ctx, start, res);
+		if (_sdstorage_overWatermark(ctx)) {
+			condSignal(sdcard_common.flushCond);
+		}
+	}
 	mutexUnlock(ctx->lock);
 
 	return res;
@@ -168,7 +502,13 @@ static int sdstorage_cachedFlush(struct _storage_t *strg)
 	ssize_t res;
 	storage_devCtx_t *ctx = strg->dev->ctx;
 	mutexLock(ctx->lock);
-	res = cache_flush(ctx->cache, strg->start, strg->start + strg->size);
+	if (strg->parent == NULL) {
+		res = _sdstorage_flushAll(ctx);
+	}
+	else {
+		/* Written back lines are accounted in sdcard_writeCb() */
+		res = cache_flush(ctx->cache, strg->start, strg->start + strg->size);
+	}
 	mutexUnlock(ctx->lock);
 
 	return res;
@@ -191,6 +531,7 @@ static int sdstorage_mtdErase(struct _storage_t *strg, off_t offs, size_t size)
 	}
 
 	mutexLock(strg->dev->ctx->lock);
+	_sdstorage_discardCancel(strg->dev->ctx, offs, size);
 	res = sdcard_writeFF(strg->dev->ctx->id, offs / SDCARD_BLOCKLEN, size / SDCARD_BLOCKLEN);
 	if (res < 0) {
 		mutexUnlock(strg->dev->ctx->lock);
@@ -254,7 +595,7 @@ const static storage_mtdops_t mtdOps = {
 };
 
 
-static storage_devCtx_t *sdstorage_devCtxAlloc(void)
+static storage_devCtx_t *sdstorage_devCtxAlloc(unsigned int slot)
 {
 	storage_devCtx_t *dev = malloc(sizeof(storage_devCtx_t));
 	if (dev == NULL) {
@@ -267,8 +608,17 @@ static storage_devCtx_t *sdstorage_devCtxAlloc(void)
 	}
 
 	dev->cache = NULL;
+	dev->devCtxForCache.owner = dev;
 	dev->devCtxForCache.noFlushShutdown = false;
-	dev->cachePolicy = sdcard_common.defaultCachePolicy;
+	dev->cacheCfg = (slot < BLK_CACHE_CFG_SLOTS) ? sdcard_common.slotCacheCfg[slot] : sdcard_common.defaultCacheCfg;
+	dev->dirtyBytes = 0;
+	dev->nDiscards = 0;
+	dev->dirtyLines = sdstorage_dirtySetAlloc(dev->cacheCfg.lineCnt, &dev->dirtyMask);
+	if (dev->dirtyLines == NULL) {
+		resourceDestroy(dev->lock);
+		free(dev);
+		return NULL;
+	}
 
 	return dev;
 }
@@ -285,6 +635,7 @@ static void sdstorage_devCtxFree(storage_devCtx_t *dev, bool noFlush)
 		cache_deinit(dev->cache);
 	}
 
+	free(dev->dirtyLines);
 	resourceDestroy(dev->lock);
 	free(dev);
 }
@@ -336,6 +687,9 @@ static int sdstorage_createDevices(const storage_t *strg, oid_t *oid)
 		}
 	}
 
+	/* Requests to the card's devices are queued and served per slot */
+	oid->port = sdcard_common.slotPorts[parentID];
+
 	/* Add mtdchar device */
 	if (strg->dev->mtd != NULL) {
 		oid->id &= ~DEVTYPE_MASK;
@@ -395,29 +749,54 @@ static int sdstorage_addPartition(storage_t *parent, sdcard_partition_t part)
 }
 
 
-/* Returns number of valid MBR partitions or < 0 if an error occurred while reading.
- * If MBR is malformed it does not count as an error and 0 is returned.
+static ssize_t sdstorage_probeRead(void *arg, off_t offs, void *buff, size_t len)
+{
+	unsigned int slot = (unsigned int)(uintptr_t)arg;
+	size_t done = 0;
+
+	while (done < len) {
+		size_t chunk = ((len - done) > SDCARD_MAX_TRANSFER) ? SDCARD_MAX_TRANSFER : (len - done);
+		if (sdcard_transferBlocks(slot, sdio_read, (offs + done) / SDCARD_BLOCKLEN, (uint8_t *)buff + done, chunk) < 0) {
+			return -EIO;
+		}
+
+		done += chunk;
+	}
+
+	return done;
+}
+
+
+/* Returns number of valid MBR/GPT partitions or < 0 if an error occurred while reading.
+ * If there is no valid partition table it does not count as an error and 0 is returned.
+ * Card can be swapped at any time, so the table is always probed from the medium.
  */
-static int sdstorage_checkMBR(unsigned int slot, sdcard_partition_t parts[4])
+static int sdstorage_checkParts(unsigned int slot, sdcard_partition_t parts[PARTPROBE_MAX_PARTS])
 {
-	mbr_t *mbr = &sdcard_common.mbr_temp;
-	if (sdcard_transferBlocks(slot, sdio_read, 0, mbr, SDCARD_BLOCKLEN) < 0) {
-		LOG_ERROR("mbr read failed");
-		return -EIO;
+	partprobe_table_t *table = malloc(sizeof(partprobe_table_t));
+	if (table == NULL) {
+		return -ENOMEM;
 	}
 
-	if (mbr_deserialize(mbr) < 0) {
-		return 0;
+	if (partprobe_scan(sdstorage_probeRead, (void *)(uintptr_t)slot, SDCARD_BLOCKLEN, sdcard_getSizeBlocks(slot), table) < 0) {
+		LOG_ERROR("partition table read failed");
+		free(table);
+		return -EIO;
 	}
 
 	int partNum = 0;
-	for (int i = 0; i < 4; i++) {
-		if (mbr->pent[i].sectors != 0) {
-			parts[partNum].offsetBl = mbr->pent[i].start;
-			parts[partNum].sizeBl = mbr->pent[i].sectors;
-			partNum++;
+	for (unsigned int i = 0; i < table->nparts; i++) {
+		/* Partition offsets are kept in 32-bit blocks */
+		if ((table->parts[i].start + table->parts[i].sectors) > UINT32_MAX) {
+			LOG_ERROR("partition %u exceeds 32-bit block address, skipping", i + 1);
+			continue;
 		}
+
+		parts[partNum].offsetBl = table->parts[i].start;
+		parts[partNum].sizeBl = table->parts[i].sectors;
+		partNum++;
 	}
+	free(table);
 
 	return partNum;
 }
@@ -445,10 +824,10 @@ int sdstorage_handleInsertion(unsigned int slot)
 		return ret;
 	}
 
-	sdcard_partition_t parts[4];
-	int nParts = sdstorage_checkMBR(slot, parts);
+	sdcard_partition_t parts[PARTPROBE_MAX_PARTS];
+	int nParts = sdstorage_checkParts(slot, parts);
 	if (nParts < 0) {
-		LOG_ERROR("check MBR failed");
+		LOG_ERROR("check partitions failed");
 		mutexUnlock(sdcard_common.lock);
 		return -EIO;
 	}
@@ -483,7 +862,7 @@ int sdstorage_handleInsertion(unsigned int slot)
 		return -ENOMEM;
 	}
 
-	strg->dev->ctx = sdstorage_devCtxAlloc();
+	strg->dev->ctx = sdstorage_devCtxAlloc(slot);
 	if (strg->dev->ctx == NULL) {
 		free(strg->dev->mtd);
 		free(strg->dev->blk);
@@ -497,12 +876,9 @@ int sdstorage_handleInsertion(unsigned int slot)
 	size_t sizeBytes = calculateSizeWithSaturation(sizeBlocks);
 
 	strg->dev->ctx->devCtxForCache.id = slot;
-
-	cache_ops_t cacheOps;
-	cacheOps.readCb = sdcard_readCb;
-	cacheOps.writeCb = sdcard_writeCb;
-	cacheOps.ctx = &strg->dev->ctx->devCtxForCache;
-	strg->dev->ctx->cache = cache_init(sizeBytes, BLK_CACHE_SECSIZE, BLK_CACHE_SECNUM, &cacheOps);
+	strg->dev->ctx->size = sizeBytes;
+	strg->dev->ctx->eraseSizeBl = max(sdcard_getEraseSizeBlocks(slot), 1);
+	strg->dev->ctx->cache = sdstorage_cacheCreate(strg->dev->ctx, &strg->dev->ctx->cacheCfg);
 	if (strg->dev->ctx->cache == NULL) {
 		LOG_ERROR("cache init failed");
 		sdstorage_devCtxFree(strg->dev->ctx, false);
@@ -554,6 +930,8 @@ int sdstorage_handleInsertion(unsigned int slot)
 		return ret;
 	}
 
+	LIST_ADD(&sdcard_common.devices, strg->dev->ctx);
+
 	for (int i = 0; i < nParts; i++) {
 		ret = sdstorage_addPartition(strg, parts[i]);
 		if (ret < 0) {
@@ -663,6 +1041,11 @@ int sdstorage_handleRemoval(unsigned int slot)
 		return EOK;
 	}
 
+	/* Card can't be freed under the flusher */
+	while (sdcard_common.flushing == strg->dev->ctx) {
+		condWait(sdcard_common.flushIdleCond, sdcard_common.lock, 0);
+	}
+
 	storage_dev_t *dev = strg->dev;
 	int totalPartitions = 0;
 	while (strg->parts != NULL) {
@@ -682,6 +1065,7 @@ int sdstorage_handleRemoval(unsigned int slot)
 		return ret;
 	}
 
+	LIST_REMOVE(&sdcard_common.devices, dev->ctx);
 	sdstorage_devCtxFree(dev->ctx, true);
 	free(dev->mtd);
 	free(dev->blk);
@@ -715,6 +1099,110 @@ static void sdstorage_presenceThread(void *arg)
 }
 
 
+static bool _sdstorage_flushDue(storage_devCtx_t *ctx, time_t now)
+{
+	if (ctx->dirtyBytes == 0) {
+		return false;
+	}
+
+	if ((ctx->cacheCfg.flushAge != 0) && ((now - ctx->dirtySince) >= (time_t)ctx->cacheCfg.flushAge * 1000)) {
+		return true;
+	}
+
+	return _sdstorage_overWatermark(ctx);
+}
+
+
+/* Writes back dirty data of write back caches when it gets too old or when too much of it accumulates,
+ * erases queued discards in batches
+ */
+static void sdstorage_flusherThread(void *arg)
+{
+	storage_devCtx_t *ctx;
+	time_t now;
+	int res;
+
+	mutexLock(sdcard_common.lock);
+	for (;;) {
+		condWait(sdcard_common.flushCond, sdcard_common.lock, FLUSHER_TICK_US);
+		gettime(&now, NULL);
+
+		ctx = sdcard_common.devices;
+		if (ctx == NULL) {
+			continue;
+		}
+
+		do {
+			/* Card I/O runs under the card's lock only, so other slots aren't held up by the write back */
+			sdcard_common.flushing = ctx;
+			mutexUnlock(sdcard_common.lock);
+
+			mutexLock(ctx->lock);
+			if (_sdstorage_flushDue(ctx, now)) {
+				TRACE("flushing slot %u, %zu bytes dirty", ctx->id, ctx->dirtyBytes);
+				res = _sdstorage_flushAll(ctx);
+				if (res < 0) {
+					LOG_ERROR("background flush failed: %d", res);
+					/* Retry when the data gets old again */
+					ctx->dirtySince = now;
+				}
+			}
+
+			if (ctx->nDiscards != 0) {
+				_sdstorage_discardRun(ctx);
+			}
+			mutexUnlock(ctx->lock);
+
+			mutexLock(sdcard_common.lock);
+			sdcard_common.flushing = NULL;
+			condBroadcast(sdcard_common.flushIdleCond);
+
+			ctx = ctx->next;
+		} while (ctx != sdcard_common.devices);
+	}
+}
+
+
+static void sdstorage_slotThread(void *arg)
+{
+	uint32_t port = (uint32_t)(uintptr_t)arg;
+	msg_rid_t rid;
+	msg_t msg;
+
+	for (;;) {
+		if (msgRecv(port, &msg, &rid) < 0) {
+			continue;
+		}
+
+		sdcard_common.handler(NULL, &msg);
+		msgRespond(port, &msg, rid);
+	}
+}
+
+
+int sdstorage_runSlots(void (*handler)(void *arg, msg_t *msg))
+{
+	void *stack;
+
+	sdcard_common.handler = handler;
+	for (unsigned int slot = 0; slot < sdcard_common.nSlots; slot++) {
+		for (int i = 0; i < SDSTORAGE_SLOT_THREADS; i++) {
+			stack = malloc(SLOT_THREAD_STACK_SIZE);
+			if (stack == NULL) {
+				return -ENOMEM;
+			}
+
+			if (beginthread(sdstorage_slotThread, 4, stack, SLOT_THREAD_STACK_SIZE, (void *)(uintptr_t)sdcard_common.slotPorts[slot]) < 0) {
+				free(stack);
+				return -ENOMEM;
+			}
+		}
+	}
+
+	return EOK;
+}
+
+
 int sdstorage_runPresenceDetection(void)
 {
 	sdcard_handlePresence(sdstorage_handleInsertion, NULL);
@@ -730,15 +1218,252 @@ int sdstorage_initHost(unsigned int slot)
 			return -ENOMEM;
 		}
 
-		sdcard_common.defaultCachePolicy = LIBCACHE_WRITE_THROUGH;
+		if (condCreate(&sdcard_common.flushCond) < 0) {
+			LOG_ERROR("Can't create cond");
+			resourceDestroy(sdcard_common.lock);
+			return -ENOMEM;
+		}
+
+		if (condCreate(&sdcard_common.flushIdleCond) < 0) {
+			LOG_ERROR("Can't create cond");
+			resourceDestroy(sdcard_common.flushCond);
+			resourceDestroy(sdcard_common.lock);
+			return -ENOMEM;
+		}
+
+		sdcard_common.defaultCacheCfg.lineSize = BLK_CACHE_SECSIZE;
+		sdcard_common.defaultCacheCfg.lineCnt = BLK_CACHE_SECNUM;
+		sdcard_common.defaultCacheCfg.policy = LIBCACHE_WRITE_THROUGH;
+		sdcard_common.defaultCacheCfg.flushAge = BLK_CACHE_FLUSH_AGE;
+		sdcard_common.defaultCacheCfg.flushWmark = BLK_CACHE_FLUSH_WMARK;
+		for (int i = 0; i < BLK_CACHE_CFG_SLOTS; i++) {
+			sdcard_common.slotCacheCfg[i] = sdcard_common.defaultCacheCfg;
+		}
+
+		sdcard_common.devices = NULL;
+		sdcard_common.flushing = NULL;
+		sdcard_common.nSlots = 0;
+
+		if (beginthread(sdstorage_flusherThread, 4, flusherThreadStack, FLUSHER_THREAD_STACK_SIZE, NULL) < 0) {
+			LOG_ERROR("Can't start flusher thread");
+			resourceDestroy(sdcard_common.flushIdleCond);
+			resourceDestroy(sdcard_common.flushCond);
+			resourceDestroy(sdcard_common.lock);
+			return -ENOMEM;
+		}
+
 		sdcard_common.commonInit = true;
 	}
 
+	if (slot >= SLOTS_MAX) {
+		LOG_ERROR("Too many hosts");
+		return -EINVAL;
+	}
+
+	if (portCreate(&sdcard_common.slotPorts[slot]) < 0) {
+		LOG_ERROR("Can't create slot %u port", slot);
+		return -ENOMEM;
+	}
+	sdcard_common.nSlots = slot + 1;
+
 	return sdcard_initHost(slot);
 }
 
 
 void sdstorage_setDefaultCachePolicy(int cachePolicy)
 {
-	sdcard_common.defaultCachePolicy = cachePolicy;
+	mutexLock(sdcard_common.lock);
+	sdcard_common.defaultCacheCfg.policy = cachePolicy;
+	for (int i = 0; i < BLK_CACHE_CFG_SLOTS; i++) {
+		sdcard_common.slotCacheCfg[i].policy = cachePolicy;
+	}
+	mutexUnlock(sdcard_common.lock);
+}
+
+
+static int sdstorage_checkCacheConfig(const sdstorage_cache_t *cfg)
+{
+	if ((cfg->lineSize == 0) ||
+		((cfg->lineSize % SDCARD_BLOCKLEN) != 0) ||
+		(cfg->lineSize > SDCARD_MAX_TRANSFER) ||
+		(cfg->lineCnt == 0) ||
+		((cfg->policy != LIBCACHE_WRITE_BACK) && (cfg->policy != LIBCACHE_WRITE_THROUGH)) ||
+		(cfg->flushWmark > 100)) {
+		return -EINVAL;
+	}
+
+	return EOK;
+}
+
+
+int sdstorage_getCacheConfig(int slot, sdstorage_cache_t *cfg)
+{
+	if ((slot >= BLK_CACHE_CFG_SLOTS) || (cfg == NULL)) {
+		return -EINVAL;
+	}
+
+	mutexLock(sdcard_common.lock);
+	*cfg = (slot < 0) ? sdcard_common.defaultCacheCfg : sdcard_common.slotCacheCfg[slot];
+	mutexUnlock(sdcard_common.lock);
+
+	return EOK;
+}
+
+
+int sdstorage_setCacheConfig(int slot, const sdstorage_cache_t *cfg)
+{
+	if ((slot >= BLK_CACHE_CFG_SLOTS) || (cfg == NULL) || (sdstorage_checkCacheConfig(cfg) < 0)) {
+		return -EINVAL;
+	}
+
+	mutexLock(sdcard_common.lock);
+	if (slot < 0) {
+		sdcard_common.defaultCacheCfg = *cfg;
+		for (int i = 0; i < BLK_CACHE_CFG_SLOTS; i++) {
+			sdcard_common.slotCacheCfg[i] = *cfg;
+		}
+	}
+	else {
+		sdcard_common.slotCacheCfg[slot] = *cfg;
+	}
+	mutexUnlock(sdcard_common.lock);
+
+	return EOK;
+}
+
+
+int sdstorage_getInfo(id_t id, sdstorage_info_t *info)
+{
+	storage_t *strg = storage_get(GET_STORAGE_ID(id));
+	sdcard_busInfo_t busInfo;
+	int res;
+
+	if ((strg == NULL) || (strg->dev == NULL) || (strg->dev->ctx == NULL) || (info == NULL)) {
+		return -EINVAL;
+	}
+
+	mutexLock(strg->dev->ctx->lock);
+	res = sdcard_getBusInfo(strg->dev->ctx->id, &busInfo);
+	if (res == 0) {
+		info->size = strg->size;
+		info->blockSize = SDCARD_BLOCKLEN;
+		info->eraseSize = sdcard_getEraseSizeBlocks(strg->dev->ctx->id) * SDCARD_BLOCKLEN;
+		info->busMode = busInfo.mode;
+		info->busWidth = busInfo.width;
+		info->clockHz = busInfo.clockHz;
+	}
+	mutexUnlock(strg->dev->ctx->lock);
+
+	return res;
+}
+
+
+int sdstorage_getCache(id_t id, sdstorage_cache_t *cfg)
+{
+	storage_t *strg = storage_get(GET_STORAGE_ID(id));
+
+	if ((strg == NULL) || (strg->dev == NULL) || (strg->dev->ctx == NULL) || (cfg == NULL)) {
+		return -EINVAL;
+	}
+
+	mutexLock(strg->dev->ctx->lock);
+	*cfg = strg->dev->ctx->cacheCfg;
+	mutexUnlock(strg->dev->ctx->lock);
+
+	return EOK;
+}
+
+
+int sdstorage_setCache(id_t id, const sdstorage_cache_t *cfg)
+{
+	storage_t *strg = storage_get(GET_STORAGE_ID(id));
+	storage_devCtx_t *ctx;
+	cachectx_t *cache;
+	uint64_t *dirtyLines;
+	unsigned int dirtyMask;
+	int res;
+
+	if ((strg == NULL) || (strg->dev == NULL) || (strg->dev->ctx == NULL) || (cfg == NULL)) {
+		return -EINVAL;
+	}
+
+	res = sdstorage_checkCacheConfig(cfg);
+	if (res < 0) {
+		return res;
+	}
+
+	ctx = strg->dev->ctx;
+	mutexLock(ctx->lock);
+	res = _sdstorage_flushAll(ctx);
+	if ((res >= 0) && ((cfg->lineSize != ctx->cacheCfg.lineSize) || (cfg->lineCnt != ctx->cacheCfg.lineCnt))) {
+		/* No dirty lines after the flush, the new set starts empty */
+		dirtyLines = sdstorage_dirtySetAlloc(cfg->lineCnt, &dirtyMask);
+		cache = (dirtyLines != NULL) ? sdstorage_cacheCreate(ctx, cfg) : NULL;
+		if (cache == NULL) {
+			free(dirtyLines);
+			res = -ENOMEM;
+		}
+		else {
+			cache_deinit(ctx->cache);
+			ctx->cache = cache;
+			free(ctx->dirtyLines);
+			ctx->dirtyLines = dirtyLines;
+			ctx->dirtyMask = dirtyMask;
+		}
+	}
+
+	if (res >= 0) {
+		ctx->cacheCfg = *cfg;
+	}
+	mutexUnlock(ctx->lock);
+
+	if (res < 0) {
+		return res;
+	}
+
+	/* Keep the configuration after the card is reinserted */
+	if (ctx->id < BLK_CACHE_CFG_SLOTS) {
+		sdstorage_setCacheConfig(ctx->id, cfg);
+	}
+
+	return EOK;
+}
+
+
+int sdstorage_discard(id_t id, uint64_t offs, uint64_t len)
+{
+	storage_t *strg = storage_get(GET_STORAGE_ID(id));
+	storage_devCtx_t *ctx;
+	blockSize_t start, end;
+	int res;
+
+	if ((strg == NULL) || (strg->dev == NULL) || (strg->dev->ctx == NULL) || (offs > strg->size) || (len > strg->size - offs)) {
+		return -EINVAL;
+	}
+
+	ctx = strg->dev->ctx;
+	offs += strg->start;
+
+	/* Only whole erase sectors within the range can be erased */
+	start = (offs + SDCARD_BLOCKLEN - 1) / SDCARD_BLOCKLEN;
+	start += (ctx->eraseSizeBl - start % ctx->eraseSizeBl) % ctx->eraseSizeBl;
+	end = (offs + len) / SDCARD_BLOCKLEN;
+	end -= end % ctx->eraseSizeBl;
+	if (start >= end) {
+		return EOK;
+	}
+
+	mutexLock(ctx->lock);
+	res = _sdstorage_discardQueue(ctx, start, end);
+	if (res == -ENOSPC) {
+		TRACE("discard queue full");
+		res = _sdstorage_discardErase(ctx, start, end - start);
+	}
+	mutexUnlock(ctx->lock);
+
+	if (res >= 0) {
+		condSignal(sdcard_common.flushCond);
+	}
+
+	return (res < 0) ? res : EOK;
 }
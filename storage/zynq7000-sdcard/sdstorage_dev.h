@@ -14,6 +14,11 @@
 #ifndef _SDSTORAGE_DEV_H_
 #define _SDSTORAGE_DEV_H_
 
+#include <sys/msg.h>
+#include <sys/types.h>
+
+#include "sdstorage_srv.h"
+
 #define DEVTYPE_POS   (29)
 #define DEVTYPE_MASK  (3 << DEVTYPE_POS)
 #define DEVTYPE_MTD   (1 << DEVTYPE_POS)
@@ -36,6 +41,31 @@ int sdstorage_initHost(unsigned int slot);
 int sdstorage_runPresenceDetection(void);
 
 
+/* Starts servers of the slots' request ports, requests are passed to the handler */
+int sdstorage_runSlots(void (*handler)(void *arg, msg_t *msg));
+
+
 void sdstorage_setDefaultCachePolicy(int cachePolicy);
 
+
+/* Cache configuration used for cards inserted into slot, slot < 0 selects all slots */
+int sdstorage_getCacheConfig(int slot, sdstorage_cache_t *cfg);
+
+
+int sdstorage_setCacheConfig(int slot, const sdstorage_cache_t *cfg);
+
+
+int sdstorage_getInfo(id_t id, sdstorage_info_t *info);
+
+
+int sdstorage_getCache(id_t id, sdstorage_cache_t *cfg);
+
+
+/* Reconfigures cache of an inserted card, dirty data is written back first */
+int sdstorage_setCache(id_t id, const sdstorage_cache_t *cfg);
+
+
+/* Queues erase of whole erase sectors within the range, writes to the range cancel the pending erase */
+int sdstorage_discard(id_t id, uint64_t offs, uint64_t len);
+
 #endif /* _SDSTORAGE_DEV_H_ */
@@ -161,6 +161,44 @@ static int storage_getAttr(id_t id, int type, long long *attr)
 }
 
 
+static void storage_devCtl(msg_t *msg)
+{
+	const sdstorage_i_devctl_t *idevctl = (const sdstorage_i_devctl_t *)msg->i.raw;
+	sdstorage_o_devctl_t *odevctl = (sdstorage_o_devctl_t *)msg->o.raw;
+	sdstorage_info_t info;
+	sdstorage_cache_t cache;
+
+	switch (idevctl->type) {
+		case sdstorage_devctl_info:
+			msg->o.err = sdstorage_getInfo(msg->oid.id, &info);
+			if (msg->o.err == EOK) {
+				odevctl->info = info;
+			}
+			break;
+
+		case sdstorage_devctl_getcache:
+			msg->o.err = sdstorage_getCache(msg->oid.id, &cache);
+			if (msg->o.err == EOK) {
+				odevctl->cache = cache;
+			}
+			break;
+
+		case sdstorage_devctl_setcache:
+			cache = idevctl->cache;
+			msg->o.err = sdstorage_setCache(msg->oid.id, &cache);
+			break;
+
+		case sdstorage_devctl_discard:
+			msg->o.err = sdstorage_discard(msg->oid.id, idevctl->discard.offs, idevctl->discard.len);
+			break;
+
+		default:
+			msg->o.err = -EINVAL;
+			break;
+	}
+}
+
+
 static void sdcard_msgHandler(void *arg, msg_t *msg)
 {
 	storage_t *strg;
@@ -190,6 +228,10 @@ static void sdcard_msgHandler(void *arg, msg_t *msg)
 			msg->o.err = storage_getAttr(msg->oid.id, msg->i.attr.type, &msg->o.attr.val);
 			break;
 
+		case mtDevCtl:
+			storage_devCtl(msg);
+			break;
+
 		case mtMount:
 			msg->o.err = storage_mountfs(storage_get(GET_STORAGE_ID(msg->oid.id)), imnt->fstype, msg->i.data, imnt->mode, &imnt->mnt, &omnt->oid);
 			break;
@@ -233,6 +275,13 @@ static void flash_help(const char *prog)
 {
 	printf("Usage: %s [options] or no args to automatically detect and initialize SD cards\n", prog);
 	printf("\t-c {0,1}    - Cache setting: 0 - write back, 1 - write through (default)\n");
+	printf("\t-C [slot:]linesz,lines,policy,age,wmark - cache configuration, empty fields keep defaults\n");
+	printf("\t\tslot:   slot number, all slots if omitted\n");
+	printf("\t\tlinesz: cache line size in bytes, multiple of 512\n");
+	printf("\t\tlines:  number of cache lines\n");
+	printf("\t\tpolicy: 0 - write back, 1 - write through\n");
+	printf("\t\tage:    write back: flush dirty data older than age ms, 0 - disabled\n");
+	printf("\t\twmark:  write back: flush when dirty data exceeds wmark %% of cache, 0 - disabled\n");
 	printf("\t-r <dev:fs> - mount root filesystem\n");
 	printf("\t\tdev:    device name\n");
 	printf("\t\tfs:     filesystem name\n");
@@ -240,10 +289,15 @@ static void flash_help(const char *prog)
 }
 
 
+#define MAX_CACHE_OPTS 8
+
+
 typedef struct {
 	int cachePolicy;
 	char rootDev[32];
 	char rootFsName[32];
+	char *cacheOpts[MAX_CACHE_OPTS];
+	int nCacheOpts;
 } options_parsed_t;
 
 
@@ -254,9 +308,10 @@ static int sdstorage_optsParse(int argc, char **argv, options_parsed_t *opts)
 	opts->rootDev[0] = '\0';
 	opts->rootFsName[0] = '\0';
 	opts->cachePolicy = LIBCACHE_WRITE_THROUGH;
+	opts->nCacheOpts = 0;
 
 	do {
-		c = getopt(argc, argv, "c:r:h");
+		c = getopt(argc, argv, "c:C:r:h");
 		switch (c) {
 			case 'c':
 				if ((optarg[0] != '\0') && (optarg[1] == '\0')) {
@@ -273,6 +328,16 @@ static int sdstorage_optsParse(int argc, char **argv, options_parsed_t *opts)
 				LOG_ERROR("unrecognized cache option: %s", optarg);
 				return -EINVAL;
 
+			case 'C':
+				/* Applied after host initialization when default configuration is known */
+				if (opts->nCacheOpts >= MAX_CACHE_OPTS) {
+					LOG_ERROR("too many cache options");
+					return -EINVAL;
+				}
+
+				opts->cacheOpts[opts->nCacheOpts++] = optarg;
+				break;
+
 			case 'r': { /* <dev:fs> */
 				devPath = optarg;
 				arg = strchr(optarg, ':');
@@ -305,6 +370,46 @@ static int sdstorage_optsParse(int argc, char **argv, options_parsed_t *opts)
 }
 
 
+/* Parses [slot:]linesz,lines,policy,age,wmark, empty fields are left unchanged */
+static int sdstorage_cacheOptApply(char *arg)
+{
+	sdstorage_cache_t cfg;
+	uint32_t *fields[] = { &cfg.lineSize, &cfg.lineCnt, &cfg.policy, &cfg.flushAge, &cfg.flushWmark };
+	char *tok, *end;
+	unsigned int i;
+	int slot = -1;
+
+	tok = strchr(arg, ':');
+	if (tok != NULL) {
+		slot = strtol(arg, &end, 0);
+		if ((end != tok) || (slot < 0)) {
+			return -EINVAL;
+		}
+
+		arg = tok + 1;
+	}
+
+	if (sdstorage_getCacheConfig(slot, &cfg) < 0) {
+		return -EINVAL;
+	}
+
+	for (i = 0; (tok = strsep(&arg, ",")) != NULL; i++) {
+		if (i >= sizeof(fields) / sizeof(fields[0])) {
+			return -EINVAL;
+		}
+
+		if (*tok != '\0') {
+			*fields[i] = strtoul(tok, &end, 0);
+			if (*end != '\0') {
+				return -EINVAL;
+			}
+		}
+	}
+
+	return sdstorage_setCacheConfig(slot, &cfg);
+}
+
+
 static int sdstorage_mountRootFs(options_parsed_t *opts)
 {
 	if (opts->rootDev[0] == '\0') {
@@ -378,6 +483,13 @@ int main(int argc, char *argv[])
 	} while (ret > 0);
 
 	sdstorage_setDefaultCachePolicy(opts.cachePolicy);
+	for (int i = 0; i < opts.nCacheOpts; i++) {
+		ret = sdstorage_cacheOptApply(opts.cacheOpts[i]);
+		if (ret < 0) {
+			LOG_ERROR("invalid cache configuration: %s", opts.cacheOpts[i]);
+			exit(EXIT_FAILURE);
+		}
+	}
 
 	ret = storage_init(sdcard_msgHandler, 16);
 	if (ret < 0) {
@@ -397,6 +509,12 @@ int main(int argc, char *argv[])
 		exit(EXIT_FAILURE);
 	}
 
+	ret = sdstorage_runSlots(sdcard_msgHandler);
+	if (ret < 0) {
+		LOG_ERROR("failed to start slot servers, err: %d", ret);
+		exit(EXIT_FAILURE);
+	}
+
 	ret = sdstorage_runPresenceDetection();
 	if (ret < 0) {
 		LOG_ERROR("failed to start presence detection thread");
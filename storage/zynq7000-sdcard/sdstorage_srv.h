@@ -0,0 +1,66 @@
+/*
+ * Phoenix-RTOS
+ *
+ * SD Card libstorage-based server interface
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _SDSTORAGE_SRV_H_
+#define _SDSTORAGE_SRV_H_
+
+#include <stdint.h>
+
+
+enum { sdstorage_devctl_info = 0, sdstorage_devctl_getcache, sdstorage_devctl_setcache, sdstorage_devctl_discard };
+
+
+/* Information about SD card and bus configuration */
+typedef struct {
+	uint64_t size;      /* device or partition size in bytes */
+	uint32_t blockSize; /* transfer block size in bytes */
+	uint32_t eraseSize; /* erase sector size in bytes */
+	uint32_t busMode;   /* negotiated bus mode, one of sdcard_busMode_t */
+	uint32_t busWidth;  /* data bus width in bits */
+	uint32_t clockHz;   /* SD clock frequency in Hz */
+} sdstorage_info_t;
+
+
+/* Block cache configuration, shared by the card and all of its partitions */
+typedef struct {
+	uint32_t lineSize;   /* cache line size in bytes, multiple of 512 */
+	uint32_t lineCnt;    /* number of cache lines */
+	uint32_t policy;     /* 0 - write back, 1 - write through */
+	uint32_t flushAge;   /* write back: flush dirty data older than this (ms), 0 - no age trigger */
+	uint32_t flushWmark; /* write back: flush when dirty data exceeds this % of cache capacity, 0 - no watermark trigger */
+} sdstorage_cache_t;
+
+
+typedef struct {
+	int type;
+
+	union {
+		/* setcache */
+		sdstorage_cache_t cache;
+
+		/* discard: range is shrunk to whole erase sectors and erased in background */
+		struct {
+			uint64_t offs; /* offset relative to the device / partition in bytes */
+			uint64_t len;  /* length in bytes */
+		} discard;
+	};
+} __attribute__((packed)) sdstorage_i_devctl_t;
+
+
+typedef struct {
+	union {
+		sdstorage_info_t info;   /* valid only for sdstorage_devctl_info */
+		sdstorage_cache_t cache; /* valid only for sdstorage_devctl_getcache */
+	};
+} __attribute__((packed)) sdstorage_o_devctl_t;
+
+#endif /* _SDSTORAGE_SRV_H_ */
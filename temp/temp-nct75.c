@@ -16,8 +16,10 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <unistd.h>
 
 #include <sys/msg.h>
+#include <sys/threads.h>
 #include <posix/utils.h>
 
 #include <i2c.h>
@@ -28,6 +30,18 @@ static const int32_t INVALID_TEMP = -1000 * 1000;
 static const uint8_t DEV_ADDR = 0x48u;      /* NCT75 */
 static const uint8_t TEMP_REG_ADDR = 0x00u; /* stored temperature value - 16bit */
 
+/* Default background sampling period, readers get the last sample */
+#define SAMPLE_MS 1000
+
+
+static struct {
+	handle_t lock;
+	int32_t temp;
+	time_t stamp;
+	unsigned int periodMs;
+	char stack[1024] __attribute__((aligned(8)));
+} common;
+
 
 /* returns temperature in miliCelsius */
 static int32_t getTemp(void)
@@ -44,6 +58,46 @@ static int32_t getTemp(void)
 }
 
 
+static void sampler(void *arg)
+{
+	int32_t temp;
+	time_t now;
+
+	for (;;) {
+		temp = getTemp();
+		gettime(&now, NULL);
+
+		mutexLock(common.lock);
+		common.temp = temp;
+		common.stamp = now;
+		mutexUnlock(common.lock);
+
+		usleep(common.periodMs * 1000);
+	}
+}
+
+
+/* Sample not older than two periods, the sensor is read directly otherwise */
+static int32_t getCachedTemp(void)
+{
+	int32_t temp;
+	time_t now;
+
+	gettime(&now, NULL);
+
+	mutexLock(common.lock);
+	temp = common.temp;
+	if ((temp == INVALID_TEMP) || (now - common.stamp >= 2 * (time_t)common.periodMs * 1000)) {
+		temp = getTemp();
+		common.temp = temp;
+		common.stamp = now;
+	}
+	mutexUnlock(common.lock);
+
+	return temp;
+}
+
+
 static void thread(void *arg)
 {
 	uint32_t port = (uint32_t)arg;
@@ -74,7 +128,7 @@ static void thread(void *arg)
 					msg.o.err = 0; /* EOF */
 				}
 				else {
-					msg.o.err = snprintf(msg.o.data, msg.o.size, "%d\n", getTemp());
+					msg.o.err = snprintf(msg.o.data, msg.o.size, "%d\n", getCachedTemp());
 				}
 				break;
 			default:
@@ -89,7 +143,7 @@ static void thread(void *arg)
 
 static void print_usage(const char *progname)
 {
-	printf("Usage: %s [i2c_bus_no <1,4>] [temp_device_no]\n", progname);
+	printf("Usage: %s [i2c_bus_no <1,4>] [temp_device_no] [sample_period_ms, default %d]\n", progname, SAMPLE_MS);
 }
 
 
@@ -100,7 +154,13 @@ int main(int argc, char **argv)
 	oid_t dev;
 	char devname[sizeof("tempX")];
 
-	if (argc != 3) {
+	if ((argc != 3) && (argc != 4)) {
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	common.periodMs = (argc == 4) ? atoi(argv[3]) : SAMPLE_MS;
+	if (common.periodMs == 0) {
 		print_usage(argv[0]);
 		return 1;
 	}
@@ -124,6 +184,12 @@ int main(int argc, char **argv)
 		return 3;
 	}
 
+	common.temp = INVALID_TEMP;
+	if ((mutexCreate(&common.lock) != EOK) || (beginthread(sampler, 4, common.stack, sizeof(common.stack), NULL) != EOK)) {
+		printf("temp: could not start sampling\n");
+		return 4;
+	}
+
 	puts("temp: initialized");
 	thread((void *)port);
 
@@ -0,0 +1,507 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Interrupt latency and ISR-to-thread wakeup benchmark
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <sys/interrupt.h>
+#include <sys/mman.h>
+#include <sys/platform.h>
+#include <sys/threads.h>
+
+#include <bench.h>
+
+
+#define BENCH_DEF_OPS    10000
+#define BENCH_DEF_PERIOD 1000 /* Timer period (us) */
+#define BENCH_WARMUP     16   /* Periods skipped before sampling */
+#define BENCH_HIST       12   /* Histogram bucket n holds latencies below 256 << n ns */
+
+
+/*
+ * Timer backends. Each one runs a periodic hardware timer whose counter is also
+ * the time source: elapsed counts since the period boundary, when the interrupt
+ * was asserted, can be read both in the ISR and the woken up thread without any
+ * clock synchronization. The counter rate is measured against CLOCK_MONOTONIC
+ * over the whole run, the nominal rate only sets the period.
+ */
+
+#if defined(__CPU_IMXRT105X) || defined(__CPU_IMXRT106X) || defined(__CPU_IMXRT117X)
+
+/* PIT channel 3, down counter reloaded from LDVAL */
+#define BENCH_TIMER "pit"
+#define PIT_CH      3
+
+#ifdef __CPU_IMXRT117X
+#include <phoenix/arch/armv7m/imxrt/11xx/imxrt1170.h>
+
+#define BENCH_TARGET "imxrt117x"
+#define PIT_BASE     ((void *)0x400d8000) /* PIT1 */
+#define PIT_IRQ      (155 + 16)
+#define PIT_HZ       240000000 /* BUS clock root */
+#else
+#include <phoenix/arch/armv7m/imxrt/10xx/imxrt10xx.h>
+
+#ifdef __CPU_IMXRT105X
+#define BENCH_TARGET "imxrt105x"
+#else
+#define BENCH_TARGET "imxrt106x"
+#endif
+#define PIT_BASE     ((void *)0x40084000)
+#define PIT_IRQ      (122 + 16)
+#define PIT_HZ       24000000 /* PERCLK */
+#endif
+
+#define BENCH_IRQ      PIT_IRQ
+#define BENCH_NOMINAL  PIT_HZ
+#define BENCH_MAXCOUNT 0xffffffffU
+
+
+enum { pit_mcr = 0, pit_ldval = (0x100 + 0x10 * PIT_CH) / 4, pit_cval, pit_tctrl, pit_tflg };
+
+
+static volatile uint32_t *timer_base;
+
+
+static int timer_init(void)
+{
+#ifndef __CPU_IMXRT117X
+	platformctl_t pctl;
+
+	pctl.action = pctl_set;
+	pctl.type = pctl_devclock;
+	pctl.devclock.dev = pctl_clk_pit;
+	pctl.devclock.state = clk_state_run;
+
+	if (platformctl(&pctl) < 0) {
+		return -EIO;
+	}
+#endif
+
+	timer_base = PIT_BASE;
+
+	/* Module enabled, stopped in debug mode */
+	*(timer_base + pit_mcr) = 1;
+	*(timer_base + pit_tctrl) = 0;
+	*(timer_base + pit_tflg) = 1;
+
+	return 0;
+}
+
+
+static void timer_start(uint32_t counts)
+{
+	*(timer_base + pit_ldval) = counts - 1;
+	*(timer_base + pit_tflg) = 1;
+	*(timer_base + pit_tctrl) = 0x3;
+}
+
+
+static void timer_stop(void)
+{
+	*(timer_base + pit_tctrl) = 0;
+	*(timer_base + pit_tflg) = 1;
+}
+
+
+static inline uint32_t timer_elapsed(void)
+{
+	return *(timer_base + pit_ldval) - *(timer_base + pit_cval);
+}
+
+
+static inline void timer_ack(void)
+{
+	*(timer_base + pit_tflg) = 1;
+	/* Flag clear has to reach the peripheral before the NVIC samples the line again */
+	(void)*(timer_base + pit_tflg);
+}
+
+#elif defined(__CPU_IMX6ULL)
+
+#include <phoenix/arch/armv7a/imx6ull/imx6ull.h>
+
+/* EPIT2 (EPIT1 is the system timer), down counter reloaded from LR, compare on reload */
+#define BENCH_TARGET   "imx6ull"
+#define BENCH_TIMER    "epit2"
+#define EPIT2_BASE     0x020d4000
+#define BENCH_IRQ      (32 + 57)
+#define BENCH_NOMINAL  66000000 /* ipg_clk */
+#define BENCH_MAXCOUNT 0xffffffffU
+
+
+enum { epit_cr = 0, epit_sr, epit_lr, epit_cmpr, epit_cnr };
+
+
+static volatile uint32_t *timer_base;
+
+
+static int timer_init(void)
+{
+	platformctl_t pctl;
+
+	pctl.action = pctl_set;
+	pctl.type = pctl_devclock;
+	pctl.devclock.dev = pctl_clk_epit2;
+	pctl.devclock.state = 3;
+
+	if (platformctl(&pctl) < 0) {
+		return -EIO;
+	}
+
+	timer_base = mmap(NULL, _PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_DEVICE | MAP_PHYSMEM | MAP_ANONYMOUS, -1, EPIT2_BASE);
+	if (timer_base == MAP_FAILED) {
+		return -ENOMEM;
+	}
+
+	*(timer_base + epit_cr) = 0;
+	*(timer_base + epit_sr) = 1;
+
+	return 0;
+}
+
+
+static void timer_start(uint32_t counts)
+{
+	*(timer_base + epit_lr) = counts - 1;
+	*(timer_base + epit_cmpr) = counts - 1;
+	*(timer_base + epit_sr) = 1;
+
+	/* ipg_clk, no prescaler, stopped in debug, reload mode, compare interrupt, counter loaded from LR on enable */
+	*(timer_base + epit_cr) = (1 << 24) | (1 << 17) | (1 << 3) | (1 << 2) | (1 << 1);
+	*(timer_base + epit_cr) |= 1;
+}
+
+
+static void timer_stop(void)
+{
+	*(timer_base + epit_cr) = 0;
+	*(timer_base + epit_sr) = 1;
+}
+
+
+static inline uint32_t timer_elapsed(void)
+{
+	return *(timer_base + epit_lr) - *(timer_base + epit_cnr);
+}
+
+
+static inline void timer_ack(void)
+{
+	*(timer_base + epit_sr) = 1;
+	(void)*(timer_base + epit_sr);
+}
+
+#elif defined(__CPU_ZYNQ7000)
+
+/* TTC1 timer 0 (TTC0 is the system timer), 16-bit up counter in interval mode */
+#define BENCH_TARGET   "zynq7000"
+#define BENCH_TIMER    "ttc1"
+#define TTC1_BASE      0xf8002000
+#define BENCH_IRQ      69
+#define TTC_PS         3                     /* Prescaler 2 ^ (TTC_PS + 1) */
+#define BENCH_NOMINAL  (111111111 >> (TTC_PS + 1)) /* CPU_1x */
+#define BENCH_MAXCOUNT 0xffffU
+
+
+enum { ttc_clkctrl = 0, ttc_cntctrl = 3, ttc_cntval = 6, ttc_interval = 9, ttc_isr = 21, ttc_ier = 24 };
+
+
+static volatile uint32_t *timer_base;
+
+
+static int timer_init(void)
+{
+	timer_base = mmap(NULL, _PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_DEVICE | MAP_PHYSMEM | MAP_ANONYMOUS, -1, TTC1_BASE);
+	if (timer_base == MAP_FAILED) {
+		return -ENOMEM;
+	}
+
+	*(timer_base + ttc_cntctrl) = 1;
+	*(timer_base + ttc_ier) = 0;
+	(void)*(timer_base + ttc_isr);
+
+	return 0;
+}
+
+
+static void timer_start(uint32_t counts)
+{
+	*(timer_base + ttc_clkctrl) = (TTC_PS << 1) | 1;
+	*(timer_base + ttc_interval) = counts - 1;
+	(void)*(timer_base + ttc_isr);
+	*(timer_base + ttc_ier) = 1;
+
+	/* Interval mode, counter reset, enabled */
+	*(timer_base + ttc_cntctrl) = (1 << 4) | (1 << 1);
+}
+
+
+static void timer_stop(void)
+{
+	*(timer_base + ttc_cntctrl) = 1;
+	*(timer_base + ttc_ier) = 0;
+	(void)*(timer_base + ttc_isr);
+}
+
+
+static inline uint32_t timer_elapsed(void)
+{
+	return *(timer_base + ttc_cntval) & 0xffff;
+}
+
+
+static inline void timer_ack(void)
+{
+	/* Interrupt register is cleared on read */
+	(void)*(timer_base + ttc_isr);
+}
+
+#else
+
+#define BENCH_NO_TIMER
+
+#endif
+
+
+#ifndef BENCH_NO_TIMER
+
+static struct {
+	/* Configuration */
+	unsigned int nops;    /* Samples */
+	unsigned int period;  /* Timer period (us) */
+	int prio;             /* Waiting thread priority, -1 - unchanged */
+
+	uint32_t counts;      /* Timer period (timer counts) */
+	handle_t lock, cond, inth;
+
+	volatile uint32_t seq;    /* Interrupts taken */
+	volatile uint32_t isrLat; /* Counts since the period start at ISR entry */
+
+	uint32_t *isr;        /* Samples (timer counts) */
+	uint32_t *wake;
+} bench_common;
+
+
+static int bench_isr(unsigned int n, void *arg)
+{
+	uint32_t lat = timer_elapsed();
+
+	(void)n;
+	(void)arg;
+
+	timer_ack();
+
+	bench_common.isrLat = lat;
+	bench_common.seq++;
+
+	return 0;
+}
+
+
+/* Samples of the same period are taken only if the thread woke up before the next one started */
+static int bench_sample(unsigned int *missed, uint64_t *hz)
+{
+	uint32_t last, cur, t, isr;
+	uint64_t start = 0, nsec;
+	unsigned int i = 0, periods = 0;
+
+	*missed = 0;
+
+	mutexLock(bench_common.lock);
+	last = bench_common.seq;
+
+	while (i < bench_common.nops) {
+		while (bench_common.seq == last) {
+			if (condWait(bench_common.cond, bench_common.lock, 1000 * 1000) == -ETIME) {
+				mutexUnlock(bench_common.lock);
+				return -ETIME;
+			}
+		}
+
+		t = timer_elapsed();
+		cur = bench_common.seq;
+		isr = bench_common.isrLat;
+
+		if (start == 0) {
+			if (cur - last >= BENCH_WARMUP) {
+				start = bench_nowNs();
+				periods = cur;
+			}
+			last = cur;
+			continue;
+		}
+
+		/* Interrupts taken while the thread was not waiting, or the next period started before reading t */
+		if ((cur != last + 1) || (t < isr)) {
+			(*missed)++;
+		}
+		else {
+			bench_common.isr[i] = isr;
+			bench_common.wake[i] = t;
+			i++;
+		}
+		last = cur;
+	}
+
+	nsec = bench_nowNs() - start;
+	periods = last - periods;
+
+	mutexUnlock(bench_common.lock);
+
+	/* Timer counts per second measured over the whole run */
+	*hz = (uint64_t)((double)bench_common.counts * periods * 1e9 / nsec);
+
+	return 0;
+}
+
+
+static void bench_print(bench_report_t *r, const char *name, uint32_t *lat, uint64_t hz)
+{
+	unsigned int hist[BENCH_HIST] = { 0 };
+	unsigned int i, n = bench_common.nops;
+	char key[16];
+
+	bench_sort(lat, n);
+
+	for (i = 0; i < n; i++) {
+		lat[i] = (uint32_t)((uint64_t)lat[i] * 1000 * 1000 * 1000 / hz);
+		hist[bench_histBucket(lat[i], 256, BENCH_HIST)]++;
+	}
+
+	snprintf(key, sizeof(key), "%s_", name);
+	bench_reportLatency(r, key, "ns", lat, n);
+	snprintf(key, sizeof(key), "%s_hist", name);
+	bench_reportArray(r, key, hist, BENCH_HIST);
+}
+
+
+static void bench_usage(const char *prog)
+{
+	printf("Usage: %s [options]\n", prog);
+	printf("\t-n <ops>    - samples (default %u)\n", BENCH_DEF_OPS);
+	printf("\t-p <us>     - timer period (default %u)\n", BENCH_DEF_PERIOD);
+	printf("\t-P <prio>   - waiting thread priority (default unchanged)\n");
+	printf("\t-h          - shows this help message\n");
+}
+
+
+int main(int argc, char **argv)
+{
+	unsigned int missed;
+	uint64_t counts, hz = 0;
+	bench_report_t r;
+	int c, err;
+
+	bench_common.nops = BENCH_DEF_OPS;
+	bench_common.period = BENCH_DEF_PERIOD;
+	bench_common.prio = -1;
+
+	while ((c = getopt(argc, argv, "n:p:P:h")) != -1) {
+		switch (c) {
+			case 'n':
+				bench_common.nops = strtoul(optarg, NULL, 0);
+				break;
+
+			case 'p':
+				bench_common.period = strtoul(optarg, NULL, 0);
+				break;
+
+			case 'P':
+				bench_common.prio = strtol(optarg, NULL, 0);
+				break;
+
+			case 'h':
+				bench_usage(argv[0]);
+				return EXIT_SUCCESS;
+
+			default:
+				bench_usage(argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	counts = (uint64_t)BENCH_NOMINAL * bench_common.period / (1000 * 1000);
+	if ((bench_common.nops == 0) || (counts < 2) || (counts > BENCH_MAXCOUNT)) {
+		fprintf(stderr, "irq-bench: invalid arguments\n");
+		return EXIT_FAILURE;
+	}
+	bench_common.counts = counts;
+
+	bench_common.isr = malloc(2 * bench_common.nops * sizeof(uint32_t));
+	if (bench_common.isr == NULL) {
+		fprintf(stderr, "irq-bench: out of memory\n");
+		return EXIT_FAILURE;
+	}
+	bench_common.wake = bench_common.isr + bench_common.nops;
+
+	if ((mutexCreate(&bench_common.lock) < 0) || (condCreate(&bench_common.cond) < 0)) {
+		fprintf(stderr, "irq-bench: failed to create synchronization primitives\n");
+		return EXIT_FAILURE;
+	}
+
+	if ((err = timer_init()) < 0) {
+		fprintf(stderr, "irq-bench: timer init failed (%d)\n", err);
+		return EXIT_FAILURE;
+	}
+
+	if (bench_common.prio >= 0) {
+		priority(bench_common.prio);
+	}
+
+	if (interrupt(BENCH_IRQ, bench_isr, NULL, bench_common.cond, &bench_common.inth) < 0) {
+		fprintf(stderr, "irq-bench: failed to attach interrupt %u\n", BENCH_IRQ);
+		return EXIT_FAILURE;
+	}
+
+	timer_start(bench_common.counts);
+	err = bench_sample(&missed, &hz);
+	timer_stop();
+
+	bench_reportBegin(&r);
+	bench_reportStr(&r, "target", BENCH_TARGET);
+	bench_reportStr(&r, "timer", BENCH_TIMER);
+	bench_reportUint(&r, "irq", BENCH_IRQ);
+
+	if (err < 0) {
+		bench_reportInt(&r, "err", err);
+		bench_reportEnd(&r);
+		return EXIT_FAILURE;
+	}
+
+	bench_reportInt(&r, "prio", bench_common.prio);
+	bench_reportUint(&r, "period_us", bench_common.period);
+	bench_reportUint(&r, "ops", bench_common.nops);
+	bench_reportUint(&r, "missed", missed);
+	bench_reportU64(&r, "timer_hz", hz);
+	bench_print(&r, "isr", bench_common.isr, hz);
+	bench_print(&r, "wake", bench_common.wake, hz);
+	bench_reportEnd(&r);
+
+	return EXIT_SUCCESS;
+}
+
+#else
+
+int main(int argc, char **argv)
+{
+	(void)argc;
+
+	fprintf(stderr, "%s: no timer backend for this target\n", argv[0]);
+
+	return EXIT_FAILURE;
+}
+
+#endif
@@ -1,6 +0,0 @@
-#ifndef _USB_SERIAL_H_
-#define _USB_SERIAL_H_
-
-extern int usb_serialInit(void);
-
-#endif
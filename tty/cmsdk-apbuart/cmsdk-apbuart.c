@@ -42,6 +42,8 @@
 /* UART state bits */
 #define TX_BUF_FULL (1 << 0)
 #define RX_BUF_FULL (1 << 1)
+#define TX_OVR      (1 << 2)
+#define RX_OVR      (1 << 3)
 
 /* UART control bits */
 #define TX_EN     (1 << 0)
@@ -81,6 +83,9 @@ typedef struct {
 	lf_fifo_t rxFifoCtx;
 	uint8_t rxFifoData[UART_RXFIFOSIZE];
 
+	/* TX has no interrupt, retry after one character time (us) when TX buffer is full */
+	time_t txWait;
+
 	uint8_t stack[UART_STACKSZ] __attribute__((aligned(8)));
 } uart_t;
 
@@ -108,55 +113,65 @@ static int uart_interrupt(unsigned int n, void *arg)
 {
 	uart_t *uart = (uart_t *)arg;
 	uint32_t status;
-	uint8_t c;
 
-	status = *(uart->base + state);
+	if ((*(uart->base + intstatus) & RX_INT) == 0) {
+		return -1;
+	}
 
-	if ((status & RX_INT) != 0) {
-		while ((*(uart->base + state) & RX_BUF_FULL) != 0) {
-			c = *(uart->base + data) & 0xff;
-			lf_fifo_push(&uart->rxFifoCtx, c);
-		}
-		*(uart->base + intstatus) = RX_INT;
+	/* Clear before draining, character received meanwhile raises interrupt again */
+	*(uart->base + intstatus) = RX_INT;
 
-		return 1;
+	while (((status = *(uart->base + state)) & RX_BUF_FULL) != 0) {
+		(void)lf_fifo_push(&uart->rxFifoCtx, *(uart->base + data) & 0xff);
 	}
 
-	return -1;
+	/* Overrun blocks further reception until cleared */
+	if ((status & RX_OVR) != 0) {
+		*(uart->base + state) = RX_OVR;
+	}
+
+	return 1;
 }
 
 
 static void uart_intThread(void *arg)
 {
 	uart_t *uart = (uart_t *)arg;
+	uint8_t buf[UART_RXFIFOSIZE];
+	const uint8_t *txData;
+	size_t len, i;
+	unsigned int n;
+	bool txPending;
 
 	for (;;) {
+		mutexLock(uart->lock);
 		while (lf_fifo_empty(&uart->rxFifoCtx) != 0) { /* nothing to RX */
-			if (libtty_txready(&uart->tty) != 0) {     /* something to TX */
-				if ((*(uart->base + state) & TX_BUF_FULL) == 0) {
-					break;
-				}
+			txPending = (libtty_txready(&uart->tty) != 0);
+			if (txPending && ((*(uart->base + state) & TX_BUF_FULL) == 0)) { /* something to TX */
+				break;
 			}
-			mutexLock(uart->lock);
-			condWait(uart->cond, uart->lock, 0);
-			mutexUnlock(uart->lock);
+			condWait(uart->cond, uart->lock, txPending ? uart->txWait : 0);
 		}
+		mutexUnlock(uart->lock);
 
-		/* RX */
-		uint8_t c;
-		while (lf_fifo_pop(&uart->rxFifoCtx, &c) != 0) {
-			libtty_putchar(&uart->tty, c, NULL);
+		/* RX, whole fifo at once */
+		while ((n = lf_fifo_pop_bulk(&uart->rxFifoCtx, buf, sizeof(buf))) != 0) {
+			libtty_putchars(&uart->tty, buf, n, NULL);
 		}
 
-		/* TX */
-		bool wake = false;
-		while ((libtty_txready(&uart->tty) != 0) && ((*(uart->base + state) & TX_BUF_FULL) == 0)) {
-			*(uart->base + data) = libtty_popchar(&uart->tty);
-			wake = true;
-		}
+		/* TX, straight from libtty span until the TX buffer fills up */
+		while ((len = libtty_tx_span(&uart->tty, &txData)) != 0) {
+			for (i = 0; (i < len) && ((*(uart->base + state) & TX_BUF_FULL) == 0); i++) {
+				*(uart->base + data) = txData[i];
+			}
+
+			if (i != 0) {
+				libtty_tx_consume(&uart->tty, i, NULL);
+			}
 
-		if (wake) {
-			libtty_wake_writer(&uart->tty);
+			if (i < len) {
+				break;
+			}
 		}
 	}
 
@@ -167,9 +182,13 @@ static void uart_intThread(void *arg)
 static void uart_setBaudrate(void *data, speed_t speed)
 {
 	uart_t *uart = (uart_t *)data;
-	uint32_t div = UART_CLK / libtty_baudrate_to_int(speed);
+	int baud = libtty_baudrate_to_int(speed);
+	uint32_t div = UART_CLK / baud;
 
 	*(uart->base + bauddiv) = div;
+
+	/* 10 bits per character */
+	uart->txWait = (10 * 1000 * 1000 + baud - 1) / baud;
 }
 
 
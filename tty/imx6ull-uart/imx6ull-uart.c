@@ -36,6 +36,8 @@
 #include <libtty-lf-fifo.h>
 #include <libklog.h>
 
+#include <sdma.h>
+
 #include <phoenix/arch/armv7a/imx6ull/imx6ull.h>
 
 #define KMSG_CTRL_ID 100
@@ -51,6 +53,13 @@
 
 #define RX_SW_FIFO_SIZE 256
 
+/* SDMA mode: RX ring of buffers closed by watermark or aging (idle line), TX bounce buffer */
+#define DMA_RX_BUFS     8
+#define DMA_RX_BUFSZ    512
+#define DMA_TX_BUFSZ    _PAGE_SIZE
+#define DMA_WATERMARK   8
+#define DMA_PRIORITY    6
+
 /* interrupt flags */
 #define RX_DONE        (1 << 0)
 #define TX_DONE        (1 << 1)
@@ -69,6 +78,9 @@
 #define UTS_TXFULL     (1 << 4)
 #define UTS_SOFTRST    (1 << 0)
 #define UCR1_UARTEN    (1 << 0)
+#define UCR1_ATDMAEN   (1 << 2)
+#define UCR1_TXDMAEN   (1 << 3)
+#define UCR1_RXDMAEN   (1 << 8)
 #define UCR1_RRDYEN    (1 << 9)
 #define UCR1_TRDYEN    (1 << 13)
 #define UCR2_SRST      (1 << 0)
@@ -125,6 +137,11 @@ static uart_pctl_t uart_pctl_isel[8][2] = {
 
 static unsigned uart_intr_number[8] = { 58, 59, 60, 61, 62, 49, 71, 72 };
 
+/* SDMA events { RX, TX } */
+static const uint8_t uart_sdma_event[8][2] = {
+	{ 25, 26 }, { 27, 28 }, { 29, 30 }, { 31, 32 }, { 33, 34 }, { 0, 1 }, { 43, 44 }, { 45, 46 }
+};
+
 typedef struct {
 	volatile uint32_t *base;
 	uint32_t mode;
@@ -155,6 +172,19 @@ typedef struct {
 	lf_fifo_t rx_sw_fifo;
 	uint8_t rx_sw_fifo_data[RX_SW_FIFO_SIZE];
 
+	struct {
+		int channel; /* RX channel, TX uses the next one, 0 - FIFO interrupts mode */
+
+		sdma_t rx;
+		sdma_chain_t rx_chain;
+		uint8_t *rx_buf;
+
+		sdma_t tx;
+		sdma_chain_t tx_chain;
+		uint8_t *tx_buf;
+		size_t tx_len; /* bytes in flight, protected by lock */
+	} dma;
+
 	libtty_common_t tty_common;
 } uart_t;
 
@@ -213,7 +243,9 @@ static int uart_open(int flags)
 
 		/* start RX */
 		*(uart.base + ucr2) |= UCR2_RXEN;
-		*(uart.base + ucr1) |= UCR1_RRDYEN;
+		if (uart.dma.channel == 0) {
+			*(uart.base + ucr1) |= UCR1_RRDYEN;
+		}
 
 		uart.reader_busy = 1;
 
@@ -379,10 +411,44 @@ static void uart_process_rx(void)
 }
 
 
+static void uart_dma_process_tx(void)
+{
+	struct iovec iov;
+	const uint8_t *data;
+	size_t len;
+
+	if ((uart.dma.tx_len != 0) || (libtty_txready(&uart.tty_common) == 0)) {
+		return;
+	}
+
+	/* SDMA can't snoop caches, so the span is copied to the uncached bounce buffer */
+	len = libtty_tx_span(&uart.tty_common, &data);
+	if (len > DMA_TX_BUFSZ) {
+		len = DMA_TX_BUFSZ;
+	}
+	if (len == 0) {
+		return;
+	}
+	memcpy(uart.dma.tx_buf, data, len);
+
+	iov.iov_base = uart.dma.tx_buf;
+	iov.iov_len = len;
+
+	if (sdma_chain_submit(&uart.dma.tx_chain, &iov, 1, SDMA_CMD_MODE_8_BIT, 1) > 0) {
+		uart.dma.tx_len = len;
+	}
+}
+
+
 static void uart_process_tx(void)
 {
 	int wake = 0;
 
+	if (uart.dma.channel != 0) {
+		uart_dma_process_tx();
+		return;
+	}
+
 	while (libtty_txready(&uart.tty_common) != 0) {
 		if ((*(uart.base + uts) & UTS_TXFULL) != 0) {
 			*(uart.base + ucr1) |= UCR1_TRDYEN;
@@ -426,6 +492,139 @@ static void uart_intrthr(void *arg)
 }
 
 
+static void uart_dmatxthr(void *arg)
+{
+	uint32_t cnt;
+	int wake = 0;
+
+	for (;;) {
+		/* Timeout is not an error, the chain is checked anyway */
+		sdma_wait_for_intr(&uart.dma.tx, &cnt);
+
+		mutexLock(uart.lock);
+		if ((uart.dma.tx_len != 0) && (sdma_chain_reap(&uart.dma.tx_chain) == 0)) {
+			libtty_tx_consume(&uart.tty_common, uart.dma.tx_len, &wake);
+			uart.dma.tx_len = 0;
+
+			/* Next span is submitted by uart_intrthr */
+			condSignal(uart.cond);
+		}
+		mutexUnlock(uart.lock);
+
+		if (wake != 0) {
+			libtty_wake_writer(&uart.tty_common);
+			wake = 0;
+		}
+	}
+}
+
+
+static void uart_dmarxthr(void *arg)
+{
+	volatile sdma_buffer_desc_t *bd;
+	struct iovec iov[DMA_RX_BUFS];
+	sdma_chain_t *c = &uart.dma.rx_chain;
+	unsigned int n;
+	uint32_t cnt;
+
+	for (;;) {
+		sdma_wait_for_intr(&uart.dma.rx, &cnt);
+
+		/* Buffers complete in order, each one is closed by SDMA after DMA_RX_BUFSZ bytes
+		 * or on aging timeout (RX line idle), count holds the number of bytes received */
+		for (n = 0; (c->used > 0) && ((c->bd[c->tail].flags & SDMA_BD_DONE) == 0); n++) {
+			bd = &c->bd[c->tail];
+			if ((bd->flags & SDMA_BD_ERR) != 0) {
+				uart.counters.hw_overrun++;
+			}
+
+			iov[n].iov_base = uart.dma.rx_buf + c->tail * DMA_RX_BUFSZ;
+			iov[n].iov_len = DMA_RX_BUFSZ;
+
+			if (bd->count != 0) {
+				libtty_putchars(&uart.tty_common, iov[n].iov_base, bd->count, NULL);
+			}
+
+			c->tail = (c->tail + 1) % c->cnt;
+			c->used--;
+		}
+
+		/* Hand the buffers back in one go, this also restarts the channel if it ran out of buffers */
+		if ((n != 0) && (sdma_chain_submit(c, iov, n, SDMA_CMD_MODE_8_BIT, 1) < 0)) {
+			log_printf(LOG_ERR, "failed to resubmit RX buffers\n");
+		}
+	}
+}
+
+
+static int uart_dma_channel(sdma_t *s, sdma_chain_t *c, int channel, uint16_t script, unsigned int event, uint32_t fifo)
+{
+	char name[sizeof("/dev/sdma/chXX")];
+	sdma_context_t ctx;
+
+	snprintf(name, sizeof(name), "/dev/sdma/ch%02d", channel);
+	if (sdma_open(s, name) < 0) {
+		log_printf(LOG_ERR, "failed to open %s\n", name);
+		return -ENODEV;
+	}
+
+	if (sdma_chain_init(c, s, (script == sdma_script__uart_2_mcu) ? DMA_RX_BUFS : 1, 0) < 0) {
+		return -ENOMEM;
+	}
+
+	sdma_context_init(&ctx);
+	sdma_context_set_pc(&ctx, script);
+	if (event < 32) {
+		ctx.gr[1] = 1 << event;
+	}
+	else {
+		ctx.gr[0] = 1 << (event - 32);
+	}
+	ctx.gr[6] = fifo;
+	ctx.gr[7] = DMA_WATERMARK;
+
+	if ((sdma_context_set(s, &ctx) < 0) || (sdma_chain_configure(c, sdma_trig__event, event, DMA_PRIORITY) < 0)) {
+		return -EIO;
+	}
+
+	return EOK;
+}
+
+
+static int uart_dma_init(void)
+{
+	uint32_t base = uart_addr[uart.dev_no - 1];
+	struct iovec iov[DMA_RX_BUFS];
+	addr_t paddr;
+	int i;
+
+	if ((uart_dma_channel(&uart.dma.rx, &uart.dma.rx_chain, uart.dma.channel, sdma_script__uart_2_mcu,
+			uart_sdma_event[uart.dev_no - 1][0], base + urxd * sizeof(uint32_t)) < 0) ||
+			(uart_dma_channel(&uart.dma.tx, &uart.dma.tx_chain, uart.dma.channel + 1, sdma_script__mcu_2_ap,
+			uart_sdma_event[uart.dev_no - 1][1], base + utxd * sizeof(uint32_t)) < 0)) {
+		return -EIO;
+	}
+
+	uart.dma.rx_buf = sdma_alloc_uncached(&uart.dma.rx, DMA_RX_BUFS * DMA_RX_BUFSZ, &paddr, 0);
+	uart.dma.tx_buf = sdma_alloc_uncached(&uart.dma.tx, DMA_TX_BUFSZ, &paddr, 0);
+	if ((uart.dma.rx_buf == NULL) || (uart.dma.tx_buf == NULL)) {
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < DMA_RX_BUFS; i++) {
+		iov[i].iov_base = uart.dma.rx_buf + i * DMA_RX_BUFSZ;
+		iov[i].iov_len = DMA_RX_BUFSZ;
+	}
+
+	/* RX buffers are owned by SDMA from now on, data flows once RXEN is set */
+	if (sdma_chain_submit(&uart.dma.rx_chain, iov, DMA_RX_BUFS, SDMA_CMD_MODE_8_BIT, 1) < 0) {
+		return -EIO;
+	}
+
+	return EOK;
+}
+
+
 static void set_clk(int dev_no)
 {
 	platformctl_t uart_clk;
@@ -564,10 +763,12 @@ static void signal_txready(void *_uart)
 
 char __attribute__((aligned(8))) stack[2048];
 char __attribute__((aligned(8))) stack0[2048];
+char __attribute__((aligned(8))) stack1[2048];
+char __attribute__((aligned(8))) stack2[2048];
 
 static void print_usage(const char *progname)
 {
-	printf("Usage: %s [mode device speed parity use_rts_cts [-t] [-e] [-s]]\n", progname);
+	printf("Usage: %s [mode device speed parity use_rts_cts [-t] [-e] [-s] [-d channel]]\n", progname);
 	printf("\tmode: 0 - raw, 1 - cooked (default cooked)\n");
 	printf("\tdevice: 1 to 8 (default 1)\n");
 	printf("\tspeed: baud_rate (default 115200)\n");
@@ -576,6 +777,7 @@ static void print_usage(const char *progname)
 	printf("\t-t - make it a default console device, might be empty (default yes)\n");
 	printf("\t-e - report UART errors (default no)\n");
 	printf("\t-s - use syslog for logs (default no)\n");
+	printf("\t-d - use SDMA channels channel (RX) and channel + 1 (TX) instead of FIFO interrupts (default no)\n");
 }
 
 
@@ -612,7 +814,7 @@ int main(int argc, char **argv)
 		uart.dev_no = 1;
 		is_console = 1;
 	}
-	else if ((argc >= 6) && (argc <= 8)) {
+	else if ((argc >= 6) && (argc <= 11)) {
 		is_cooked = atoi(argv[1]);
 		uart.dev_no = atoi(argv[2]);
 		baud = libtty_int_to_baudrate(atoi(argv[3]));
@@ -629,6 +831,14 @@ int main(int argc, char **argv)
 			else if (strcmp(argv[num], "-s") == 0) {
 				uart.use_syslog = 1;
 			}
+			else if ((strcmp(argv[num], "-d") == 0) && (num + 1 < argc)) {
+				uart.dma.channel = atoi(argv[++num]);
+				if ((uart.dma.channel <= 0) || (uart.dma.channel >= 31)) {
+					printf("Invalid SDMA channel!\n");
+					print_usage(argv[0]);
+					return 1;
+				}
+			}
 			else {
 				print_usage(argv[0]);
 				return 0;
@@ -707,7 +917,13 @@ int main(int argc, char **argv)
 	interrupt(uart_intr_number[uart.dev_no - 1], uart_intr, NULL, uart.cond, &uart.inth);
 
 	/* set TX & RX FIFO watermark, DCE mode */
-	*(uart.base + ufcr) = (0x04 << 10) | (0 << 6) | (0x1);
+	if (uart.dma.channel != 0) {
+		/* DMA request per DMA_WATERMARK bytes */
+		*(uart.base + ufcr) = (DMA_WATERMARK << 10) | (0 << 6) | DMA_WATERMARK;
+	}
+	else {
+		*(uart.base + ufcr) = (0x04 << 10) | (0 << 6) | (0x1);
+	}
 
 	/* set Reference Frequency Divider */
 	*(uart.base + ufcr) &= ~(0b111 << 7);
@@ -722,9 +938,23 @@ int main(int argc, char **argv)
 	/* set muxed mode */
 	*(uart.base + ucr3) |= UCR3_RXDMUXSEL;
 
+	if (uart.dma.channel != 0) {
+		if (uart_dma_init() < 0) {
+			log_printf(LOG_ERR, "SDMA initialization failed\n");
+			return 2;
+		}
+
+		/* RX requests on watermark and aging timer (line idle for 8 characters) */
+		*(uart.base + ucr1) |= UCR1_RXDMAEN | UCR1_ATDMAEN | UCR1_TXDMAEN;
+	}
+
 	/* enable UART */
 	*(uart.base + ucr1) |= UCR1_UARTEN;
 
+	if (uart.dma.channel != 0) {
+		beginthread(uart_dmarxthr, 3, &stack1, 2048, NULL);
+		beginthread(uart_dmatxthr, 3, &stack2, 2048, NULL);
+	}
 	beginthread(uart_intrthr, 3, &stack0, 2048, NULL);
 	beginthread(uart_thr, 3, &stack, 2048, (void *)port);
 
@@ -1,6 +1,9 @@
 #ifndef _LIBTTY_FIFO_H
 #define _LIBTTY_FIFO_H
 
+#include <stdint.h>
+#include <string.h>
+
 typedef struct fifo_s fifo_t;
 
 struct fifo_s {
@@ -84,6 +87,47 @@ static inline uint8_t fifo_peek_front(fifo_t *f)
 	return ret;
 }
 
+/* copies up to len bytes into fifo (as much as fits), returns number of bytes copied */
+static inline unsigned int fifo_write_bulk(fifo_t *f, const void *data, unsigned int len)
+{
+	unsigned int space = fifo_freespace(f), part;
+
+	if (len > space)
+		len = space;
+
+	/* span up to the end of the buffer, then the rest from the beginning */
+	part = f->size_mask + 1 - f->head;
+	if (part > len)
+		part = len;
+
+	memcpy(&f->data[f->head], data, part);
+	memcpy(&f->data[0], (const uint8_t *)data + part, len - part);
+	f->head = (f->head + len) & f->size_mask;
+
+	return len;
+}
+
+
+/* copies up to len bytes out of fifo, returns number of bytes copied */
+static inline unsigned int fifo_read_bulk(fifo_t *f, void *data, unsigned int len)
+{
+	unsigned int count = fifo_count(f), part;
+
+	if (len > count)
+		len = count;
+
+	part = f->size_mask + 1 - f->tail;
+	if (part > len)
+		part = len;
+
+	memcpy(data, &f->data[f->tail], part);
+	memcpy((uint8_t *)data + part, &f->data[0], len - part);
+	f->tail = (f->tail + len) & f->size_mask;
+
+	return len;
+}
+
+
 static inline int fifo_has_char(fifo_t *f, char byte)
 {
 	unsigned int tail = f->tail;
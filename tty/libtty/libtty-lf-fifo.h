@@ -19,6 +19,7 @@
 
 
 #include <stdint.h>
+#include <string.h>
 #include <stdatomic.h>
 
 
@@ -93,6 +94,38 @@ static inline int lf_fifo_pop(lf_fifo_t *f, uint8_t *byte)
 }
 
 
+/* pops up to len bytes at once (consumer side), returns number of bytes popped,
+ * 0 also if an overrun happened meanwhile - the copied data is discarded then */
+static inline unsigned int lf_fifo_pop_bulk(lf_fifo_t *f, uint8_t *data, unsigned int len)
+{
+	unsigned int headPos = atomic_load_explicit(&f->headPos, memory_order_seq_cst);
+	unsigned int tail = atomic_fetch_or_explicit(&f->tail, 1, memory_order_seq_cst) | 1;
+	unsigned int tailPos = tail >> 1;
+	unsigned int count = (headPos - tailPos) & f->sizeMask;
+	unsigned int part, newTail;
+
+	if (len > count) {
+		len = count;
+	}
+
+	if (len == 0) {
+		return 0;
+	}
+
+	part = f->sizeMask + 1 - tailPos;
+	if (part > len) {
+		part = len;
+	}
+
+	memcpy(data, &f->data[tailPos], part);
+	memcpy(data + part, &f->data[0], len - part);
+
+	newTail = (((tailPos + len) & f->sizeMask) << 1) | 1;
+
+	return atomic_compare_exchange_strong_explicit(&f->tail, &tail, newTail, memory_order_seq_cst, memory_order_seq_cst) ? len : 0;
+}
+
+
 static inline int lf_fifo_empty(lf_fifo_t *f)
 {
 	unsigned int headPos = atomic_load_explicit(&f->headPos, memory_order_seq_cst);
@@ -73,6 +73,7 @@
 #endif
 
 #define TX_FIFO_NOTFULL_WATERMARK 16 /* amount of free space in fifo before we will wake up the writer */
+#define TXSEG_MINLEN              64 /* shorter writes are cheaper to copy into TX fifo */
 
 static void termios_optimize(libtty_common_t *tty)
 {
@@ -94,6 +95,11 @@ static void termios_optimize(libtty_common_t *tty)
 		if (libttydisc_rx_have_breakchar(tty))
 			tty->t_flags |= TF_HAVEBREAK;
 	}
+
+	/* no input processing - received chars can be copied to RX FIFO as they are */
+	tty->t_flags &= ~TF_BYPASS;
+	if (!CMP_FLAG(i, ISTRIP | INLCR | IGNCR | ICRNL) && !CMP_FLAG(l, ISIG | ICANON | IEXTEN | ECHO | ECHONL))
+		tty->t_flags |= TF_BYPASS;
 }
 
 static void termios_init(struct termios *term, speed_t speed)
@@ -178,10 +184,67 @@ ssize_t libtty_read_nonblock(libtty_common_t *tty, char *data, size_t size, unsi
 }
 
 
+/* head segment fully sent - remove it and notify the owner */
+static void txseg_done(libtty_common_t *tty)
+{
+	libtty_txseg_t *seg;
+
+	mutexLock(tty->tx_mutex);
+	seg = tty->txseg_head;
+	__atomic_store_n(&tty->txseg_head, seg->next, __ATOMIC_RELEASE);
+	if (seg->next == NULL)
+		tty->txseg_tail = NULL;
+	condBroadcast(tty->tx_waitq);
+	mutexUnlock(tty->tx_mutex);
+
+	tty->cb.tx_done(tty->cb.arg, seg, seg->len);
+}
+
+
+/* drops queued segments except the head which may be in use by the driver, tx_mutex has to be locked */
+static libtty_txseg_t *txseg_drop(libtty_common_t *tty)
+{
+	libtty_txseg_t *head = tty->txseg_head, *dropped;
+
+	if (head == NULL)
+		return NULL;
+
+	dropped = head->next;
+	head->next = NULL;
+	tty->txseg_tail = head;
+
+	return dropped;
+}
+
+
+static void txseg_dropped(libtty_common_t *tty, libtty_txseg_t *seg)
+{
+	libtty_txseg_t *next;
+
+	while (seg != NULL) {
+		next = seg->next;
+		tty->cb.tx_done(tty->cb.arg, seg, -EPIPE);
+		seg = next;
+	}
+}
+
+
+static unsigned char txseg_pop(libtty_common_t *tty)
+{
+	libtty_txseg_t *seg = __atomic_load_n(&tty->txseg_head, __ATOMIC_ACQUIRE);
+	unsigned char c = seg->data[seg->pos++];
+
+	if (seg->pos == seg->len)
+		txseg_done(tty);
+
+	return c;
+}
+
+
 /* writer wake up is done outside of libtty if wake_writer is not NULL */
 unsigned char libtty_getchar(libtty_common_t *tty, int *wake_writer)
 {
-	unsigned char c = fifo_pop_back(tty->tx_fifo);
+	unsigned char c = fifo_is_empty(tty->tx_fifo) ? txseg_pop(tty) : fifo_pop_back(tty->tx_fifo);
 
 	if (wake_writer != NULL) {
 		*wake_writer = fifo_freespace(tty->tx_fifo) >= TX_FIFO_NOTFULL_WATERMARK;
@@ -196,10 +259,62 @@ unsigned char libtty_getchar(libtty_common_t *tty, int *wake_writer)
 
 unsigned char libtty_popchar(libtty_common_t *tty)
 {
+	if (fifo_is_empty(tty->tx_fifo))
+		return txseg_pop(tty);
+
 	return fifo_pop_back(tty->tx_fifo);
 }
 
 
+size_t libtty_tx_span(libtty_common_t *tty, const uint8_t **data)
+{
+	fifo_t *f = tty->tx_fifo;
+	unsigned int head = f->head;
+	libtty_txseg_t *seg;
+
+	/* TX fifo goes first - writes wait for queued segments (see libtty_write), so it holds data written before them (or echo) */
+	if (head != f->tail) {
+		tty->tx_span_seg = NULL;
+		*data = &f->data[f->tail];
+
+		return ((head > f->tail) ? head : (f->size_mask + 1)) - f->tail;
+	}
+
+	seg = __atomic_load_n(&tty->txseg_head, __ATOMIC_ACQUIRE);
+	tty->tx_span_seg = seg;
+	if (seg == NULL)
+		return 0;
+
+	*data = seg->data + seg->pos;
+
+	return seg->len - seg->pos;
+}
+
+
+void libtty_tx_consume(libtty_common_t *tty, size_t len, int *wake_writer)
+{
+	libtty_txseg_t *seg = tty->tx_span_seg;
+
+	if (seg == NULL) {
+		tty->tx_fifo->tail = (tty->tx_fifo->tail + len) & tty->tx_fifo->size_mask;
+	}
+	else {
+		seg->pos += len;
+		if (seg->pos == seg->len) {
+			tty->tx_span_seg = NULL;
+			txseg_done(tty);
+		}
+	}
+
+	if (wake_writer != NULL) {
+		*wake_writer = fifo_freespace(tty->tx_fifo) >= TX_FIFO_NOTFULL_WATERMARK;
+	}
+	else {
+		libtty_wake_writer(tty);
+	}
+}
+
+
 void libtty_wake_writer(libtty_common_t *tty)
 {
 	if (fifo_freespace(tty->tx_fifo) >= TX_FIFO_NOTFULL_WATERMARK) {
@@ -254,8 +369,11 @@ int libtty_init(libtty_common_t *tty, libtty_callbacks_t *callbacks, unsigned in
 
 int libtty_close(libtty_common_t *tty)
 {
+	libtty_txseg_t *dropped;
+
 	mutexLock2(tty->tx_mutex, tty->rx_mutex);
 	tty->t_flags |= TF_CLOSING;
+	dropped = txseg_drop(tty);
 
 	condBroadcast(tty->tx_waitq);
 	condBroadcast(tty->rx_waitq);
@@ -263,6 +381,8 @@ int libtty_close(libtty_common_t *tty)
 	mutexUnlock(tty->tx_mutex);
 	mutexUnlock(tty->rx_mutex);
 
+	txseg_dropped(tty, dropped);
+
 	return 0;
 }
 
@@ -285,6 +405,7 @@ int libtty_destroy(libtty_common_t *tty)
 ssize_t libtty_write(libtty_common_t *tty, const char *data, size_t size, unsigned mode)
 {
 	ssize_t len = 0;
+	size_t chunk;
 
 	/* short path */
 	if (tty->t_flags & TF_CLOSING)
@@ -296,6 +417,17 @@ ssize_t libtty_write(libtty_common_t *tty, const char *data, size_t size, unsign
 
 	mutexLock(tty->tx_mutex);
 
+	/* TX fifo is sent ahead of queued segments - wait for them, so that writes keep their order */
+	while (tty->txseg_head != NULL) {
+		if (tty->t_flags & TF_CLOSING)
+			goto exit;
+
+		if (mode & O_NONBLOCK)
+			goto exit;
+
+		condWait(tty->tx_waitq, tty->tx_mutex, 0);
+	}
+
 	int fifo_freespace_for_single_char = CMP_FLAG(o, OPOST) ? LIBTTYDISC_WRITE_OPROC_MAXLEN : 1;
 
 	/* write contents of the buffer */
@@ -313,13 +445,24 @@ ssize_t libtty_write(libtty_common_t *tty, const char *data, size_t size, unsign
 
 		if (CMP_FLAG(o, OPOST) && (CTL_VALID(*data))) { /* we need to process this char */
 			libttydisc_write_oproc(tty, *data);
+			chunk = 1;
 		}
 		else {
-			fifo_push(tty->tx_fifo, *data);
+			/* copy the span up to the next char to be processed at once */
+			chunk = 1;
+			if (CMP_FLAG(o, OPOST)) {
+				while ((len + chunk < size) && !CTL_VALID(data[chunk]))
+					chunk++;
+			}
+			else {
+				chunk = size - len;
+			}
+
+			chunk = fifo_write_bulk(tty->tx_fifo, data, chunk);
 		}
 
-		len += 1;
-		data += 1;
+		len += chunk;
+		data += chunk;
 	}
 
 	/* DEBUG_CHAR('W'); */
@@ -342,6 +485,46 @@ exit:
 	return len;
 }
 
+
+int libtty_write_segment(libtty_common_t *tty, libtty_txseg_t *seg, unsigned mode)
+{
+	size_t i;
+
+	if (tty->t_flags & TF_CLOSING)
+		return -EPIPE;
+
+	/* non-blocking writers can't wait for the data to be sent */
+	if ((tty->cb.tx_done == NULL) || (mode & O_NONBLOCK) || (seg->len < TXSEG_MINLEN))
+		return 0;
+
+	if (CMP_FLAG(o, OPOST)) {
+		for (i = 0; i < seg->len; i++) {
+			if (CTL_VALID(seg->data[i]))
+				return 0;
+		}
+	}
+
+	seg->pos = 0;
+	seg->next = NULL;
+
+	mutexLock(tty->tx_mutex);
+	if (tty->t_flags & TF_CLOSING) {
+		mutexUnlock(tty->tx_mutex);
+		return -EPIPE;
+	}
+
+	if (tty->txseg_tail != NULL)
+		tty->txseg_tail->next = seg;
+	else
+		__atomic_store_n(&tty->txseg_head, seg, __ATOMIC_RELEASE);
+	tty->txseg_tail = seg;
+
+	CALLBACK(signal_txready);
+	mutexUnlock(tty->tx_mutex);
+
+	return 1;
+}
+
 int libtty_txready(libtty_common_t *tty)
 {
 #if 0
@@ -352,7 +535,7 @@ int libtty_txready(libtty_common_t *tty)
 		DEBUG_CHAR('F');
 #endif
 
-	return !fifo_is_empty(tty->tx_fifo);
+	return !fifo_is_empty(tty->tx_fifo) || (__atomic_load_n(&tty->txseg_head, __ATOMIC_ACQUIRE) != NULL);
 }
 
 int libtty_txfull(libtty_common_t *tty)
@@ -398,13 +581,15 @@ void libtty_signal_pgrp(libtty_common_t *tty, int signal)
 void libtty_drain(libtty_common_t *tty)
 {
 	mutexLock(tty->tx_mutex);
-	while (!fifo_is_empty(tty->tx_fifo))
+	while (!fifo_is_empty(tty->tx_fifo) || (tty->txseg_head != NULL))
 		condWait(tty->tx_waitq, tty->tx_mutex, 0);
 
 	mutexUnlock(tty->tx_mutex);
 }
 void libtty_flush(libtty_common_t *tty, int type)
 {
+	libtty_txseg_t *dropped;
+
 	if (type == TCIFLUSH || type == TCIOFLUSH) {
 		mutexLock(tty->rx_mutex);
 		fifo_remove_all(tty->rx_fifo);
@@ -416,7 +601,10 @@ void libtty_flush(libtty_common_t *tty, int type)
 		/* undefined behaviour if writer is in the middle of operation */
 		mutexLock(tty->tx_mutex);
 		fifo_remove_all_but_one(tty->tx_fifo);
+		dropped = txseg_drop(tty);
 		mutexUnlock(tty->tx_mutex);
+
+		txseg_dropped(tty, dropped);
 	}
 
 	/* check for breakchars, etc. */
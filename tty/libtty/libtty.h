@@ -26,6 +26,15 @@ typedef struct libtty_common_s libtty_common_t;
 typedef struct libtty_callbacks_s libtty_callbacks_t;
 typedef struct fifo_s fifo_t;
 typedef struct libtty_read_state_s libtty_read_state_t;
+typedef struct libtty_txseg_s libtty_txseg_t;
+
+/* TX segment - caller's buffer sent directly by the driver (see libtty_write_segment) */
+struct libtty_txseg_s {
+	const uint8_t *data;
+	size_t len;
+	size_t pos; /* bytes already taken by the driver */
+	libtty_txseg_t *next;
+};
 
 struct libtty_callbacks_s {
 	void *arg; /* argument to be passed to each of the callbacks */
@@ -36,6 +45,9 @@ struct libtty_callbacks_s {
 
 	/* at least one character ready to be sent */
 	void (*signal_txready)(void *arg);
+
+	/* TX segment sent (ret = len) or dropped (ret < 0), called from the driver thread */
+	void (*tx_done)(void *arg, libtty_txseg_t *seg, ssize_t ret);
 };
 
 struct libtty_common_s {
@@ -47,6 +59,11 @@ struct libtty_common_s {
 	fifo_t *tx_fifo;
 	fifo_t *rx_fifo;
 
+	/* TX segments queued after tx_fifo contents, head is consumed by the driver */
+	libtty_txseg_t *txseg_head;
+	libtty_txseg_t *txseg_tail;
+	libtty_txseg_t *tx_span_seg; /* source of the span returned by libtty_tx_span */
+
 	handle_t tx_waitq;
 	handle_t rx_waitq;
 
@@ -56,6 +73,7 @@ struct libtty_common_s {
 	/* cached optimizations */
 	char breakchars[4]; /* enough to hold \n, VEOF and VEOL. */
 	unsigned int t_flags;
+	unsigned int rx_wake_thr; /* RX chars needed by non-canonical reader to make progress (0 - any) */
 
 	/* TODO: remove */
 	volatile uint32_t *debug;
@@ -88,6 +106,9 @@ int libtty_close(libtty_common_t *tty);
 /* external (message) interface */
 ssize_t libtty_read(libtty_common_t *tty, char *data, size_t size, unsigned mode);
 ssize_t libtty_write(libtty_common_t *tty, const char *data, size_t size, unsigned mode);
+/* queues seg to be sent without copying to TX fifo, returns 1 if queued (cb.tx_done will be called),
+ * 0 if not applicable (short, O_NONBLOCK or OPOST processing needed - use libtty_write), -EPIPE if closing */
+int libtty_write_segment(libtty_common_t *tty, libtty_txseg_t *seg, unsigned mode);
 int libtty_poll_status(libtty_common_t *tty);
 int libtty_ioctl(libtty_common_t *tty, pid_t sender_pid, unsigned int cmd, const void *in_arg, const void **out_arg);
 
@@ -107,9 +128,14 @@ void libtty_putchar_lock(libtty_common_t *tty);
 void libtty_putchar_unlock(libtty_common_t *tty);
 void libtty_wake_reader(libtty_common_t *tty);
 int libtty_putchar_unlocked(libtty_common_t *tty, unsigned char c, int *wake_reader);
+/* pushes len chars taking rx lock and waking the reader once per call (reader wake up is done outside of libtty if wake_reader is not NULL) */
+int libtty_putchars(libtty_common_t *tty, const unsigned char *data, size_t len, int *wake_reader);
 /* writer wake up is done outside of libtty if wake_writer is not NULL */
 unsigned char libtty_getchar(libtty_common_t *tty, int *wake_writer);
 unsigned char libtty_popchar(libtty_common_t *tty);
+/* returns contiguous span of data to be sent, has to be followed by libtty_tx_consume() */
+size_t libtty_tx_span(libtty_common_t *tty, const uint8_t **data);
+void libtty_tx_consume(libtty_common_t *tty, size_t len, int *wake_writer);
 void libtty_wake_writer(libtty_common_t *tty);
 void libtty_signal_pgrp(libtty_common_t *tty, int signal);
 
@@ -112,6 +112,32 @@ static int tx_write_ifspace(libtty_common_t *tty, const char *data, size_t len)
 	return len - (data_end - data);
 }
 
+/* check if waiting reader can make progress with RX FIFO contents */
+static int libttydisc_rx_wakeup(libtty_common_t *tty)
+{
+	if (CMP_FLAG(l, ICANON))
+		return (tty->t_flags & TF_HAVEBREAK) != 0;
+
+	return fifo_count(tty->rx_fifo) >= tty->rx_wake_thr;
+}
+
+
+/* set wake up threshold for non-canonical reader having len chars of size requested */
+static void libttydisc_rx_set_wake_thr(libtty_common_t *tty, size_t len, size_t size)
+{
+	size_t vmin = tty->term.c_cc[VMIN], thr = 0;
+
+	/* VTIME is an interbyte timer if VMIN > 0 - every char restarts it, so wake up on each one */
+	if ((tty->term.c_cc[VTIME] == 0) && (len < vmin)) {
+		thr = ((vmin < size) ? vmin : size) - len;
+		if (thr > tty->rx_fifo->size_mask)
+			thr = tty->rx_fifo->size_mask;
+	}
+
+	tty->rx_wake_thr = thr;
+}
+
+
 static int libttydisc_echo(libtty_common_t *tty, char c)
 {
 	/*
@@ -321,7 +347,7 @@ processed:
 			}
 		}
 	}
-	else {
+	else if (libttydisc_rx_wakeup(tty)) {
 		if (wake_reader != NULL) {
 			*wake_reader = 1;
 		}
@@ -351,7 +377,8 @@ void libtty_putchar_lock(libtty_common_t *tty)
 
 void libtty_wake_reader(libtty_common_t *tty)
 {
-	condSignal(tty->rx_waitq);
+	if (libttydisc_rx_wakeup(tty))
+		condSignal(tty->rx_waitq);
 }
 
 
@@ -367,6 +394,56 @@ int libtty_putchar_unlocked(libtty_common_t *tty, unsigned char c, int *wake_rea
 }
 
 
+int libtty_putchars(libtty_common_t *tty, const unsigned char *data, size_t len, int *wake_reader)
+{
+	fifo_t *f = tty->rx_fifo;
+	unsigned int space;
+	int wake = 0, w;
+	size_t i;
+
+	if (len == 0) {
+		if (wake_reader != NULL) {
+			*wake_reader = 0;
+		}
+		return 0;
+	}
+
+	mutexLock(tty->rx_mutex);
+	if ((tty->t_flags & (TF_BYPASS | TF_LITERAL)) == TF_BYPASS) {
+		/* keep the newest chars on overrun, as libtty_putchar() does */
+		if (len > f->size_mask) {
+			data += len - f->size_mask;
+			len = f->size_mask;
+		}
+
+		space = fifo_freespace(f);
+		if (len > space) {
+			log_warn("RX OVERRUN!");
+			f->tail = (f->tail + (len - space)) & f->size_mask;
+		}
+
+		fifo_write_bulk(f, data, len);
+		wake = libttydisc_rx_wakeup(tty);
+	}
+	else {
+		for (i = 0; i < len; i++) {
+			libtty_putchar_helper(tty, data[i], &w, 0);
+			wake |= w;
+		}
+	}
+
+	if (wake_reader != NULL) {
+		*wake_reader = wake;
+	}
+	else if (wake != 0) {
+		condSignal(tty->rx_waitq);
+	}
+	mutexUnlock(tty->rx_mutex);
+
+	return 0;
+}
+
+
 int libttydisc_write_oproc(libtty_common_t *tty, char c)
 {
 	int ret = 0;
@@ -490,6 +567,7 @@ ssize_t libttydisc_read_raw(libtty_common_t *tty, char *data, size_t size, unsig
 	time_t vtime = (time_t)tty->term.c_cc[VTIME] * 100; /* deciseconds to ms */
 	time_t first_char_timeout = (vmin == 0) ? vtime : 0;
 	ssize_t len = 0;
+	size_t chunk;
 
 	if (st && st->timeout_ms >= 0) { /* continuing previous read */
 		int we_wanted_to_sleep_ms = (st->prevlen == 0) ? first_char_timeout : vtime;
@@ -508,6 +586,7 @@ ssize_t libttydisc_read_raw(libtty_common_t *tty, char *data, size_t size, unsig
 		st->timeout_ms = -1; /* default (finished) */
 		len = st->prevlen;
 		data += st->prevlen;
+		tty->rx_wake_thr = 0;
 	}
 
 	while (len < size) {
@@ -526,22 +605,27 @@ ssize_t libttydisc_read_raw(libtty_common_t *tty, char *data, size_t size, unsig
 					if (st) { /* non-blocking wait */
 						st->prevlen = len;
 						st->timeout_ms = (len == 0) ? first_char_timeout : vtime;
+						libttydisc_rx_set_wake_thr(tty, len, size);
 						return 0;
 					}
 					else { /* blocking wait */
 						mutexLock(tty->rx_mutex);
-						while (fifo_is_empty(tty->rx_fifo)) {
+						libttydisc_rx_set_wake_thr(tty, len, size);
+						while (fifo_is_empty(tty->rx_fifo) || !libttydisc_rx_wakeup(tty)) {
 							if (tty->t_flags & TF_CLOSING) {
+								tty->rx_wake_thr = 0;
 								mutexUnlock(tty->rx_mutex);
 								return len;
 							}
 
 							int ret = condWait(tty->rx_waitq, tty->rx_mutex, ((len == 0) ? first_char_timeout : vtime) * 1000);
 							if (ret == -ETIME) {
+								tty->rx_wake_thr = 0;
 								mutexUnlock(tty->rx_mutex);
 								return len; /* timer expired */
 							}
 						}
+						tty->rx_wake_thr = 0;
 						mutexUnlock(tty->rx_mutex);
 					}
 				}
@@ -550,8 +634,9 @@ ssize_t libttydisc_read_raw(libtty_common_t *tty, char *data, size_t size, unsig
 			}
 		}
 
-		*data++ = fifo_pop_back(tty->rx_fifo);
-		len += 1;
+		chunk = fifo_read_bulk(tty->rx_fifo, data, size - len);
+		data += chunk;
+		len += chunk;
 	}
 
 	return len;
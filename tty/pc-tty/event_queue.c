@@ -47,23 +47,26 @@ int event_queue_init(event_queue_t *eq)
 }
 
 
-int event_queue_put(event_queue_t *eq, unsigned char event, unsigned int notify_cnt)
+int event_queue_put(event_queue_t *eq, const unsigned char *events, unsigned int len)
 {
-	if (eq == NULL) {
+	unsigned int bytes, chunk;
+
+	if (eq == NULL || events == NULL) {
 		return -EINVAL;
 	}
 
-	int bytes = 0;
-
 	mutexLock(eq->mutex);
-	if (eq->cnt < TTYPC_EQBUF_SIZE) {
-		eq->buf[eq->w] = event;
-		eq->w = (eq->w + 1u) % TTYPC_EQBUF_SIZE;
-		eq->cnt++;
-		if (eq->cnt >= notify_cnt) {
-			condSignal(eq->waitq);
-		}
-		bytes = 1;
+	bytes = min(len, TTYPC_EQBUF_SIZE - eq->cnt);
+	chunk = min(bytes, TTYPC_EQBUF_SIZE - eq->w);
+
+	(void)memcpy(eq->buf + eq->w, events, chunk);
+	(void)memcpy(eq->buf, events + chunk, bytes - chunk);
+
+	eq->w = (eq->w + bytes) % TTYPC_EQBUF_SIZE;
+	eq->cnt += bytes;
+
+	if (eq->wait != 0u && eq->cnt >= eq->wait) {
+		condSignal(eq->waitq);
 	}
 	mutexUnlock(eq->mutex);
 
@@ -81,8 +84,10 @@ static int _event_queue_get(event_queue_t *eq, void *dest, unsigned int size, un
 	}
 
 	while (eq->cnt < minsize) {
+		eq->wait = minsize;
 		condWait(eq->waitq, eq->mutex, 0);
 	}
+	eq->wait = 0;
 
 	if (size > eq->cnt) {
 		size = eq->cnt;
@@ -150,6 +155,15 @@ int event_queue_get_mouse(event_queue_t *meq, char *dest, unsigned int size, uns
 
 	mutexLock(meq->mutex);
 
+	/* Blocking read waits for at least one whole packet */
+	if ((flags & O_NONBLOCK) == 0) {
+		while (meq->cnt < 3) {
+			meq->wait = 3;
+			condWait(meq->waitq, meq->mutex, 0);
+		}
+		meq->wait = 0;
+	}
+
 	if (size > meq->cnt) {
 		size = meq->cnt;
 	}
@@ -166,7 +180,7 @@ int event_queue_get_mouse(event_queue_t *meq, char *dest, unsigned int size, uns
 				mutexUnlock(meq->mutex);
 				return res;
 			}
-		} while ((dest[0] & (1 << 3)) == 0);
+		} while ((dest[total] & (1 << 3)) == 0);
 
 		/* found the first byte, get the other two */
 		res = _event_queue_get(meq, dest + total + 1, 2, 2, flags);
@@ -24,6 +24,7 @@ typedef struct _event_queue_t {
 	unsigned int cnt;
 	unsigned int r;
 	unsigned int w;
+	unsigned int wait; /* Bytes needed by blocked reader, 0 if none */
 	handle_t mutex;
 	handle_t waitq;
 } event_queue_t;
@@ -33,8 +34,8 @@ typedef struct _event_queue_t {
 extern int event_queue_init(event_queue_t *eq);
 
 
-/* Puts a byte into event queue */
-extern int event_queue_put(event_queue_t *eq, unsigned char event, unsigned int notify_cnt);
+/* Puts len bytes into event queue, wakes up reader only if its request can be satisfied */
+extern int event_queue_put(event_queue_t *eq, const unsigned char *events, unsigned int len);
 
 
 /* Reads data from event queue */
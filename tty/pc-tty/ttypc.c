@@ -32,6 +32,7 @@
 
 #include "ttypc.h"
 #include "ttypc_bioskbd.h"
+#include "ttypc_fbcon.h"
 #include "ttypc_kbd.h"
 #include "ttypc_vga.h"
 
@@ -122,9 +123,9 @@ static void ttypc_poolthr(void *arg)
 }
 
 
-static void ttypc_klogClbk(const char *data, size_t size)
+static ssize_t ttypc_klogClbk(const char *data, size_t size)
 {
-	libtty_write(&ttypc_common.vts[0].tty, data, size, 0);
+	return libtty_write(&ttypc_common.vts[0].tty, data, size, O_NONBLOCK);
 }
 
 
@@ -187,12 +188,14 @@ int main(int argc, char **argv)
 		/* If fbcon is unsupported, retrieve the cursor so we don't overwrite the tty as
 		 * some earlier component might have written something to the text mode buffer (i.e. plo) */
 		_ttypc_vga_getcursor(ttypc_common.vt);
+		_ttypc_vga_load(ttypc_common.vt);
 	}
 	/* else: In case of fbcon, we don't care about the text mode buffer, because we're
 	 * in the graphic mode already and the text mode buffer may contain garbage */
 
 	/* Set default cursor color */
 	_ttypc_vga_set(ttypc_common.vt, ttypc_common.vt->cpos, FG_LIGHTGREY << 8, ttypc_common.vt->rows * ttypc_common.vt->cols - ttypc_common.vt->cpos);
+	_ttypc_fbcon_flush(ttypc_common.vt);
 
 	/* Run pool threads */
 	if ((err = beginthread(ttypc_poolthr, 1, ttypc_common.pstack, sizeof(ttypc_common.pstack), &ttypc_common)) < 0)
@@ -216,7 +219,7 @@ int main(int argc, char **argv)
 		usleep(10000);
 
 	if (isconsole != 0) {
-		libklog_init(ttypc_klogClbk);
+		libklog_initNb(ttypc_klogClbk);
 		oid.port = ttypc_common.port;
 		oid.id = 0;
 		if (create_dev(&oid, _PATH_CONSOLE) < 0) {
@@ -227,7 +230,7 @@ int main(int argc, char **argv)
 		libklog_ctrlRegister(&kmsgctrl);
 	}
 	else {
-		libklog_initNoDev(ttypc_klogClbk);
+		libklog_initNbNoDev(ttypc_klogClbk);
 	}
 
 	/* Register devices */
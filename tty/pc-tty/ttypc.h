@@ -26,6 +26,12 @@
 #define NVTS 4
 
 
+/* PS/2 bytes buffered between interrupt handlers and control thread (power of 2) */
+#ifndef TTYPC_KMBUF_SIZE
+#define TTYPC_KMBUF_SIZE 64u
+#endif
+
+
 /* Keyboard types */
 enum { KBD_BIOS,
 	KBD_PS2 };
@@ -64,6 +70,12 @@ struct _ttypc_t {
 	handle_t kmcond;       /* Kbd/mouse interrupt condition variable */
 	handle_t kmlock;       /* Kbd/mouse interrupt mutex */
 
+	/* Kbd/mouse bytes drained by interrupt handlers, free running indexes */
+	uint16_t kmbuf[TTYPC_KMBUF_SIZE];
+	unsigned int kmr;    /* Read by control thread */
+	unsigned int kmw;    /* Written by drain */
+	int kmbusy;          /* Controller is being drained */
+
 	unsigned int kirq; /* Kbd interrupt number */
 	handle_t kinth;    /* Kbd interrupt handle */
 
@@ -107,6 +119,14 @@ struct _ttypc_t {
 	uint16_t fbpitch;      /* Pitch (framebuffer line length)*/
 	volatile void *fbaddr; /* Framebuffer address */
 	uint32_t fbmemsz;      /* Framebuffer memory size */
+	uint16_t *fbtext;      /* Shadow text buffer (cells to be drawn) */
+	uint16_t *fbcells;     /* Cells currently drawn on the framebuffer */
+	uint32_t fbtextsz;     /* Shadow text buffers memory size */
+	int16_t fbdtop;        /* First dirty row */
+	int16_t fbdbottom;     /* Last dirty row (fbdtop > fbdbottom if there are no dirty rows) */
+	int16_t fbstop;        /* Pending scroll region first row */
+	int16_t fbsbottom;     /* Pending scroll region last row */
+	int16_t fbsn;          /* Pending scroll rows count (> 0 up, < 0 down) */
 };
 
 
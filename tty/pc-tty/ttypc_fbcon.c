@@ -90,41 +90,152 @@ color_t colors[16] = {
 #define COLOR_T_TO_RGB32(color) (((((uint32_t)0xffU) << 24U) | (((uint32_t)(color).red) << 16U) | (((uint32_t)(color).green) << 8U) | ((uint32_t)(color).blue)))
 
 
-static void _drawPixel(ttypc_vt_t *vt, uint16_t x, uint16_t y, uint32_t color)
+/* Font rows expanded to pixel masks, pixel = bg ^ ((fg ^ bg) & mask) */
+static uint32_t fbcon_rowmask[256][TTYPC_FBFONT_W];
+
+
+/* Palette converted to framebuffer pixels */
+static uint32_t fbcon_palette[16];
+
+
+static inline int _ttypc_fbcon_active(ttypc_vt_t *vt)
 {
-	ttypc_t *ttypc = vt->ttypc;
-	*(volatile uint32_t *)((char *)ttypc->fbaddr + (x * (ttypc->fbbpp / 8U)) + (y * ttypc->fbpitch)) = color;
+	/* if this vt is not the current vt or the fbcon is disabled/unsupported, don't draw anything */
+	return (vt->ttypc->vt == vt) && (vt->fbmode == FBCON_ENABLED) && (vt->ttypc->fbtext != NULL);
+}
+
+
+static void _ttypc_fbcon_dirty(ttypc_t *ttypc, int16_t top, int16_t bottom)
+{
+	if (top < ttypc->fbdtop) {
+		ttypc->fbdtop = top;
+	}
+
+	if (bottom > ttypc->fbdbottom) {
+		ttypc->fbdbottom = bottom;
+	}
+}
+
+
+static void _ttypc_fbcon_blit(ttypc_t *ttypc, uint16_t col, uint16_t row, uint16_t val)
+{
+	uint32_t fg = fbcon_palette[(val >> 8U) & 0xfU], bg = fbcon_palette[(val >> 12U) & 0xfU], diff = fg ^ bg;
+	const uint8_t *data = ttypc_fbcon_fbfont + (TTYPC_FBFONT_BYTES_PER_GLYPH * (val & 0xffU));
+	volatile uint32_t *dst = (volatile uint32_t *)((volatile char *)ttypc->fbaddr + (row * TTYPC_FBFONT_H * ttypc->fbpitch) + (col * TTYPC_FBFONT_W * sizeof(uint32_t)));
+	const uint32_t *mask;
+	unsigned int x, y;
+
+	for (y = 0U; y < TTYPC_FBFONT_H; y++) {
+		/* Glyph row is written with consecutive word stores, no per pixel address calculation */
+		mask = fbcon_rowmask[*data];
+		for (x = 0U; x < TTYPC_FBFONT_W; x++) {
+			dst[x] = bg ^ (diff & mask[x]);
+		}
+		data += TTYPC_FBFONT_W_BYTES;
+		dst = (volatile uint32_t *)((volatile char *)dst + ttypc->fbpitch);
+	}
+}
+
+
+static void _ttypc_fbcon_flushscroll(ttypc_t *ttypc)
+{
+	size_t rowsz = TTYPC_FBFONT_H * ttypc->fbpitch, cols = ttypc->fbmaxcols;
+	char *fb = (char *)ttypc->fbaddr;
+	int16_t h = ttypc->fbsbottom - ttypc->fbstop + 1, n = ttypc->fbsn;
+
+	ttypc->fbsn = 0;
+
+	/* Scrolled out region is redrawn from the shadow buffer. Otherwise framebuffer and
+	 * drawn cells are moved together, vacated rows keep old content in both of them */
+	if ((n > 0) && (n < h)) {
+		memmove(fb + ttypc->fbstop * rowsz, fb + (ttypc->fbstop + n) * rowsz, (h - n) * rowsz);
+		memmove(ttypc->fbcells + ttypc->fbstop * cols, ttypc->fbcells + (ttypc->fbstop + n) * cols, (h - n) * cols * sizeof(uint16_t));
+	}
+	else if ((n < 0) && (-n < h)) {
+		memmove(fb + (ttypc->fbstop - n) * rowsz, fb + ttypc->fbstop * rowsz, (h + n) * rowsz);
+		memmove(ttypc->fbcells + (ttypc->fbstop - n) * cols, ttypc->fbcells + ttypc->fbstop * cols, (h + n) * cols * sizeof(uint16_t));
+	}
+}
+
+
+static void _ttypc_fbcon_update(ttypc_t *ttypc)
+{
+	uint16_t *text, *cells;
+	int16_t row, col;
+
+	if (ttypc->fbsn != 0) {
+		_ttypc_fbcon_flushscroll(ttypc);
+	}
+
+	for (row = ttypc->fbdtop; row <= ttypc->fbdbottom; row++) {
+		text = ttypc->fbtext + row * ttypc->fbmaxcols;
+		cells = ttypc->fbcells + row * ttypc->fbmaxcols;
+
+		for (col = 0; col < ttypc->fbmaxcols; col++) {
+			if (text[col] != cells[col]) {
+				_ttypc_fbcon_blit(ttypc, col, row, text[col]);
+				cells[col] = text[col];
+			}
+		}
+	}
+
+	ttypc->fbdtop = ttypc->fbmaxrows;
+	ttypc->fbdbottom = -1;
 }
 
 
 void _ttypc_fbcon_drawChar(ttypc_vt_t *vt, uint16_t col, uint16_t row, uint16_t val)
 {
-	size_t i;
-	uint16_t charPixY;
+	ttypc_t *ttypc = vt->ttypc;
+
+	if (!_ttypc_fbcon_active(vt) || (col >= ttypc->fbmaxcols) || (row >= ttypc->fbmaxrows)) {
+		return;
+	}
+
+	ttypc->fbtext[row * ttypc->fbmaxcols + col] = val;
+	_ttypc_fbcon_dirty(ttypc, row, row);
+}
 
-	uint8_t fgColor = (uint8_t)((val >> 8U) & 0xfU), bg_color = (uint8_t)((val >> 12U) & 0xfU);
-	const uint32_t arr[2] = { COLOR_T_TO_RGB32(colors[fgColor]), COLOR_T_TO_RGB32(colors[bg_color]) };
 
-	uint8_t c = (uint8_t)(val & 0xffU);
-	uint8_t *data = ttypc_fbcon_fbfont + (TTYPC_FBFONT_BYTES_PER_GLYPH * c);
-	uint16_t x = col * TTYPC_FBFONT_W, y = row * TTYPC_FBFONT_H;
+void _ttypc_fbcon_move(ttypc_vt_t *vt, uint16_t drow, uint16_t srow, uint16_t nrows)
+{
+	ttypc_t *ttypc = vt->ttypc;
+	int16_t top = min(drow, srow), bottom = max(drow, srow) + nrows - 1, n = srow - drow;
+	size_t cols = min(vt->cols, ttypc->fbmaxcols);
+	uint16_t row;
 
-	if ((vt->ttypc->vt != vt) || (vt->fbmode != FBCON_ENABLED)) {
-		/* if this vt is not the current vt or the fbcon is disabled/unsupported, don't draw anything */
+	if (!_ttypc_fbcon_active(vt) || (nrows == 0) || (n == 0) || (bottom >= ttypc->fbmaxrows)) {
 		return;
 	}
 
-	for (charPixY = y; charPixY < (y + TTYPC_FBFONT_H); charPixY++) {
-		for (i = 0U; i < 8U; i++) {
-			_drawPixel(vt, x + (7U - i), charPixY, arr[!(*data & (1U << i))]);
-		}
-		data += TTYPC_FBFONT_W_BYTES;
+	/* Only scrolls of the same region in the same direction are accumulated */
+	if ((ttypc->fbsn != 0) && ((ttypc->fbstop != top) || (ttypc->fbsbottom != bottom) || ((ttypc->fbsn > 0) != (n > 0)))) {
+		_ttypc_fbcon_update(ttypc);
+	}
+
+	/* Copy from text memory, the shadow buffer holds cursor cell with inverted colors */
+	for (row = drow; row < drow + nrows; row++) {
+		memcpy(ttypc->fbtext + row * ttypc->fbmaxcols, (const uint16_t *)vt->vram + row * vt->cols, cols * sizeof(uint16_t));
+	}
+
+	ttypc->fbstop = top;
+	ttypc->fbsbottom = bottom;
+	ttypc->fbsn = (n > 0) ? min(ttypc->fbsn + n, bottom - top + 1) : max(ttypc->fbsn + n, top - bottom - 1);
+	_ttypc_fbcon_dirty(ttypc, top, bottom);
+}
+
+
+void _ttypc_fbcon_flush(ttypc_vt_t *vt)
+{
+	if (_ttypc_fbcon_active(vt)) {
+		_ttypc_fbcon_update(vt->ttypc);
 	}
 }
 
 
 int ttypc_fbcon_init(ttypc_t *ttypc)
 {
+	unsigned int i, x;
 	int err;
 
 	platformctl_t pctl = { .action = pctl_get, .type = pctl_graphmode };
@@ -153,11 +264,38 @@ int ttypc_fbcon_init(ttypc_t *ttypc)
 	ttypc->fbmaxcols = ttypc->fbw / TTYPC_FBFONT_W;
 	ttypc->fbmaxrows = ttypc->fbh / TTYPC_FBFONT_H;
 
+	/* Shadow text buffer followed by drawn cells buffer */
+	ttypc->fbtextsz = (2 * ttypc->fbmaxcols * ttypc->fbmaxrows * sizeof(uint16_t) + _PAGE_SIZE - 1) & ~(_PAGE_SIZE - 1);
+	ttypc->fbtext = mmap(NULL, ttypc->fbtextsz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ttypc->fbtext == MAP_FAILED) {
+		ttypc->fbtext = NULL;
+		munmap((void *)ttypc->fbaddr, ttypc->fbmemsz);
+		return -ENOMEM;
+	}
+	ttypc->fbcells = ttypc->fbtext + ttypc->fbmaxcols * ttypc->fbmaxrows;
+	ttypc->fbdtop = ttypc->fbmaxrows;
+	ttypc->fbdbottom = -1;
+	ttypc->fbsn = 0;
+
+	for (i = 0U; i < 256U; i++) {
+		for (x = 0U; x < TTYPC_FBFONT_W; x++) {
+			fbcon_rowmask[i][x] = ((i & (0x80U >> x)) != 0U) ? 0xffffffffU : 0U;
+		}
+	}
+
+	for (i = 0U; i < sizeof(colors) / sizeof(colors[0]); i++) {
+		fbcon_palette[i] = COLOR_T_TO_RGB32(colors[i]);
+	}
+
 	return EOK;
 }
 
 
 void ttypc_fbcon_destroy(ttypc_t *ttypc)
 {
+	if (ttypc->fbtext != NULL) {
+		munmap(ttypc->fbtext, ttypc->fbtextsz);
+		ttypc->fbtext = NULL;
+	}
 	munmap((void *)ttypc->fbaddr, ttypc->fbmemsz);
 }
@@ -19,13 +19,22 @@
 #include "ttypc.h"
 
 
+/* Updates character cell in the shadow text buffer, the framebuffer is updated by _ttypc_fbcon_flush() */
 extern void _ttypc_fbcon_drawChar(ttypc_vt_t *vt, uint16_t col, uint16_t row, uint16_t val);
 
 
+/* Moves nrows text rows from srow to drow (already moved in vt->vram), the framebuffer is scrolled on flush */
+extern void _ttypc_fbcon_move(ttypc_vt_t *vt, uint16_t drow, uint16_t srow, uint16_t nrows);
+
+
+/* Draws pending scroll and changed character cells */
+extern void _ttypc_fbcon_flush(ttypc_vt_t *vt);
+
+
 extern int ttypc_fbcon_init(ttypc_t *ttypc);
 
 
-extern int ttypc_fbcon_destroy(ttypc_t *ttypc);
+extern void ttypc_fbcon_destroy(ttypc_t *ttypc);
 
 
 #endif
@@ -221,11 +221,6 @@ static char *_ttypc_kbd_get(ttypc_t *ttypc, unsigned char dt)
 	static unsigned char ext = 0, lkey = 0, lkeyup = 0, lext = 0;
 	char *s = NULL;
 
-#if PC_TTY_CREATE_PS2_VDEVS
-	/* Copy this event in raw form to queue */
-	(void)event_queue_put(&ttypc->keq, dt, 1);
-#endif
-
 	/* Extended scan code */
 	if (scodes[dt & 0x7f].type == KB_EXT) {
 		ext = 1;
@@ -426,16 +421,11 @@ static char *_ttypc_kbd_get(ttypc_t *ttypc, unsigned char dt)
 /* Keyboard interrupt handler */
 static int _ttypc_kbd_interrupt(unsigned int n, void *arg)
 {
-	return 0;
+	/* Wake up control thread only if there is something new */
+	return (ttypc_ps2_drain((ttypc_t *)arg) != 0) ? 0 : -1;
 }
 
 
-/* Macros for distinguishing the origin of pending output */
-#define OUTPUT_PENDING(status)       (((status) & (1u << 0u)) != 0)
-#define KBD_OUTPUT_PENDING(status)   (((status) & (1u << 5u)) == 0)
-#define MOUSE_OUTPUT_PENDING(status) (((status) & (1u << 5u)) != 0)
-
-
 static void ttypc_kbd_handle_event(ttypc_t *ttypc, unsigned char b)
 {
 	ttypc_vt_t *cvt = ttypc->vt;
@@ -525,23 +515,46 @@ static void ttypc_kbd_handle_event(ttypc_t *ttypc, unsigned char b)
 static void ttypc_ps2_ctlthr(void *arg)
 {
 	ttypc_t *ttypc = (ttypc_t *)arg;
-	unsigned char dt;
-	unsigned char status;
+	unsigned char kbuf[TTYPC_KMBUF_SIZE], mbuf[TTYPC_KMBUF_SIZE];
+	unsigned int r, w, i, kn, mn;
+	uint16_t ev;
 
 	mutexLock(ttypc->kmlock);
 	for (;;) {
-		status = ttypc_ps2_read_ctrl(ttypc);
-		if (OUTPUT_PENDING(status)) {
-			dt = inb((void *)ttypc->kbd);
-			if (KBD_OUTPUT_PENDING(status)) {
-				ttypc_kbd_handle_event(ttypc, dt);
+		/* Collect bytes left in the controller when the ring was full */
+		(void)ttypc_ps2_drain(ttypc);
+
+		r = ttypc->kmr;
+		w = __atomic_load_n(&ttypc->kmw, __ATOMIC_ACQUIRE);
+		if (r == w) {
+			condWait(ttypc->kmcond, ttypc->kmlock, 0);
+			continue;
+		}
+
+		/* Split the batch by device */
+		for (kn = mn = 0; r != w; r++) {
+			ev = ttypc->kmbuf[r % TTYPC_KMBUF_SIZE];
+			if ((ev & TTYPC_PS2_MOUSE) != 0) {
+				mbuf[mn++] = (unsigned char)ev;
 			}
-			else if (MOUSE_OUTPUT_PENDING(status)) {
-				ttypc_mouse_handle_event(ttypc, dt);
+			else {
+				kbuf[kn++] = (unsigned char)ev;
 			}
 		}
-		else {
-			condWait(ttypc->kmcond, ttypc->kmlock, 0);
+		__atomic_store_n(&ttypc->kmr, r, __ATOMIC_RELEASE);
+
+		if (kn != 0) {
+#if PC_TTY_CREATE_PS2_VDEVS
+			/* Copy events in raw form to queue */
+			(void)event_queue_put(&ttypc->keq, kbuf, kn);
+#endif
+			for (i = 0; i < kn; i++) {
+				ttypc_kbd_handle_event(ttypc, kbuf[i]);
+			}
+		}
+
+		if (mn != 0) {
+			(void)ttypc_mouse_handle_events(ttypc, mbuf, mn);
 		}
 	}
 }
@@ -718,15 +731,15 @@ int ttypc_kbd_init(ttypc_t *ttypc)
 		}
 #endif
 
-		/* Attach KIRQ1 (kbd event) interrupt handle */
-		ttypc->kirq = 1;
-		err = interrupt(ttypc->kirq, _ttypc_kbd_interrupt, ttypc, ttypc->kmcond, &ttypc->kinth);
+		/* Initialize mouse before kbd interrupt starts draining controller output (setup polls for responses) */
+		err = ttypc_mouse_init(ttypc);
 		if (err < 0) {
 			break;
 		}
 
-		/* Initialize mouse */
-		err = ttypc_mouse_init(ttypc);
+		/* Attach KIRQ1 (kbd event) interrupt handle */
+		ttypc->kirq = 1;
+		err = interrupt(ttypc->kirq, _ttypc_kbd_interrupt, ttypc, ttypc->kmcond, &ttypc->kinth);
 		if (err < 0) {
 			break;
 		}
@@ -207,7 +207,8 @@ static void ttypc_mouse_poolthr(void *arg)
 /* Mouse interrupt handler */
 static int _ttypc_mouse_interrupt(unsigned int n, void *arg)
 {
-	return 0;
+	/* Drain whole packet (and kbd bytes queued meanwhile) at once, wake up control thread once */
+	return (ttypc_ps2_drain((ttypc_t *)arg) != 0) ? 0 : -1;
 }
 
 
@@ -293,10 +294,10 @@ int ttypc_mouse_init(ttypc_t *ttypc)
 }
 
 
-int ttypc_mouse_handle_event(ttypc_t *ttypc, unsigned char b)
+int ttypc_mouse_handle_events(ttypc_t *ttypc, const unsigned char *b, unsigned int n)
 {
 #if PC_TTY_CREATE_PS2_VDEVS
-	return event_queue_put(&ttypc->meq, b, 3);
+	return event_queue_put(&ttypc->meq, b, n);
 #else
 	return EOK;
 #endif
@@ -314,9 +315,9 @@ void ttypc_mouse_destroy(ttypc_t *ttypc)
 
 #else /* PC_TTY_ENABLE_MOUSE */
 
-int ttypc_mouse_handle_event(ttypc_t *ttypc, unsigned char b)
+int ttypc_mouse_handle_events(ttypc_t *ttypc, const unsigned char *b, unsigned int n)
 {
-	fprintf(stderr, "pc-tty: ttypc_mouse_handle_event() called while mouse disabled\n");
+	fprintf(stderr, "pc-tty: ttypc_mouse_handle_events() called while mouse disabled\n");
 	return -1;
 }
 
@@ -22,7 +22,8 @@ extern int ttypc_mouse_init(ttypc_t *ttypc);
 
 
 /* Reads a mouse event from I/O buffer and handles it */
-extern int ttypc_mouse_handle_event(ttypc_t *ttypc, unsigned char b);
+/* Passes a batch of bytes received from mouse */
+extern int ttypc_mouse_handle_events(ttypc_t *ttypc, const unsigned char *b, unsigned int n);
 
 
 /* Destroys PS/2 mouse */
@@ -18,6 +18,7 @@
 #include <sys/minmax.h>
 
 #include "ttypc_vt.h"
+#include "ttypc_ps2.h"
 
 
 #define SLEEP_MS               10u
@@ -98,3 +99,37 @@ unsigned char ttypc_ps2_read_ctrl(ttypc_t *ttypc)
 {
 	return inb((void *)((uintptr_t)ttypc->kbd + 4u));
 }
+
+
+unsigned int ttypc_ps2_drain(ttypc_t *ttypc)
+{
+	unsigned int w, n = 0;
+	unsigned char status;
+
+	/* Kbd and mouse interrupts and the control thread may drain concurrently, the one already draining collects everything */
+	if (__atomic_exchange_n(&ttypc->kmbusy, 1, __ATOMIC_ACQUIRE) != 0) {
+		return 0;
+	}
+
+	w = ttypc->kmw;
+	for (;;) {
+		/* Ring full, the rest stays in the controller until the control thread catches up */
+		if ((w - __atomic_load_n(&ttypc->kmr, __ATOMIC_ACQUIRE)) >= TTYPC_KMBUF_SIZE) {
+			break;
+		}
+
+		status = inb((void *)((uintptr_t)ttypc->kbd + 4u));
+		if (!OUTPUT_PENDING(status)) {
+			break;
+		}
+
+		ttypc->kmbuf[w % TTYPC_KMBUF_SIZE] = inb((void *)ttypc->kbd) | (MOUSE_OUTPUT_PENDING(status) ? TTYPC_PS2_MOUSE : 0u);
+		w++;
+		n++;
+	}
+
+	__atomic_store_n(&ttypc->kmw, w, __ATOMIC_RELEASE);
+	__atomic_store_n(&ttypc->kmbusy, 0, __ATOMIC_RELEASE);
+
+	return n;
+}
@@ -17,6 +17,15 @@
 #include "ttypc_vt.h"
 
 
+/* Macros for distinguishing the origin of pending output */
+#define OUTPUT_PENDING(status)       (((status) & (1u << 0u)) != 0)
+#define KBD_OUTPUT_PENDING(status)   (((status) & (1u << 5u)) == 0)
+#define MOUSE_OUTPUT_PENDING(status) (((status) & (1u << 5u)) != 0)
+
+/* Marks mouse byte in the drained events ring */
+#define TTYPC_PS2_MOUSE 0x100u
+
+
 /* Writes a byte to PS/2 control buffer */
 extern int ttypc_ps2_write_ctrl(ttypc_t *ttypc, unsigned char byte);
 
@@ -33,4 +42,9 @@ extern int ttypc_ps2_write(ttypc_t *ttypc, unsigned char byte);
 extern unsigned char ttypc_ps2_read_ctrl(ttypc_t *ttypc);
 
 
+/* Moves all pending controller output to ttypc->kmbuf, safe to call from interrupt handlers.
+ * Returns number of bytes moved */
+extern unsigned int ttypc_ps2_drain(ttypc_t *ttypc);
+
+
 #endif
@@ -61,27 +61,18 @@ static void _ttypc_vga_setctype(ttypc_t *ttypc, uint8_t from, uint8_t to)
 }
 
 
-ssize_t _ttypc_vga_read(ttypc_vt_t *vt, size_t offs, uint16_t *buff, size_t n)
+/* Writes buff to screen buffer of active VT only, VT memory is left intact */
+static void _ttypc_vga_show(ttypc_vt_t *vt, size_t offs, const uint16_t *buff, size_t n)
 {
 	size_t i;
+	int col, row;
 	volatile uint16_t *vga = vt->vram + offs;
 
-	for (i = 0; i < n; i++)
-		*(buff + i) = *(vga + i);
-
-	return n;
-}
-
-
-ssize_t _ttypc_vga_write(ttypc_vt_t *vt, size_t offs, uint16_t *buff, size_t n)
-{
-	size_t i;
-	int pos, col, row;
-	volatile uint16_t *vga = vt->vram + offs;
+	if (vt->vram == vt->mem)
+		return;
 
-	pos = vga - vt->vram;
-	col = pos % vt->cols;
-	row = pos / vt->cols;
+	col = offs % vt->cols;
+	row = offs / vt->cols;
 
 	for (i = 0; i < n; i++) {
 		*(vga + i) = *(buff + i);
@@ -95,88 +86,74 @@ ssize_t _ttypc_vga_write(ttypc_vt_t *vt, size_t offs, uint16_t *buff, size_t n)
 			row++;
 		}
 	}
+}
+
+
+ssize_t _ttypc_vga_read(ttypc_vt_t *vt, size_t offs, uint16_t *buff, size_t n)
+{
+	memcpy(buff, vt->mem + offs, n * sizeof(*buff));
 
 	return n;
 }
 
 
-volatile uint16_t *_ttypc_vga_set(ttypc_vt_t *vt, size_t offs, uint16_t val, size_t n)
+ssize_t _ttypc_vga_write(ttypc_vt_t *vt, size_t offs, uint16_t *buff, size_t n)
 {
-	size_t i;
-	int pos, col, row;
-	volatile uint16_t *vga = vt->vram + offs;
+	memcpy(vt->mem + offs, buff, n * sizeof(*buff));
+	_ttypc_vga_show(vt, offs, vt->mem + offs, n);
 
-	pos = vga - vt->vram;
-	col = pos % vt->cols;
-	row = pos / vt->cols;
+	return n;
+}
 
-	for (i = 0; i < n; i++) {
-		*(vga + i) = val;
 
-		_ttypc_fbcon_drawChar(vt, col, row, val);
-		if (col < vt->cols - 1) {
-			col++;
-		}
-		else {
-			col = 0;
-			row++;
-		}
-	}
+volatile uint16_t *_ttypc_vga_set(ttypc_vt_t *vt, size_t offs, uint16_t val, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		vt->mem[offs + i] = val;
+	_ttypc_vga_show(vt, offs, vt->mem + offs, n);
 
-	return vga;
+	return vt->vram + offs;
 }
 
 
 volatile uint16_t *_ttypc_vga_move(ttypc_vt_t *vt, size_t doffs, size_t soffs, size_t n)
 {
-	size_t i;
-	int pos, col, row;
 	volatile uint16_t *dvga = vt->vram + doffs, *svga = vt->vram + soffs;
 
-	if (dvga < svga) {
-		pos = dvga - vt->vram;
-		col = pos % vt->cols;
-		row = pos / vt->cols;
-
-		for (i = 0; i < n; i++) {
-			dvga[i] = svga[i];
-
-			_ttypc_fbcon_drawChar(vt, col, row, svga[i]);
-			if (col < vt->cols - 1) {
-				col++;
-			}
-			else {
-				col = 0;
-				row++;
-			}
-		}
-	}
-	else {
-		pos = dvga - vt->vram + n;
-		col = pos % vt->cols;
-		row = pos / vt->cols;
-
-		for (i = n; i--;) {
-			dvga[i] = svga[i];
-
-			_ttypc_fbcon_drawChar(vt, col, row, svga[i]);
-			if (col > 0) {
-				col--;
-			}
-			else {
-				if (row == 0) {
-					break;
-				}
-				col = vt->cols - 1;
-				row--;
-			}
-		}
+	memmove(vt->mem + doffs, vt->mem + soffs, n * sizeof(*vt->mem));
+
+	if ((vt->fbmode == FBCON_ENABLED) && (vt == vt->ttypc->vt) && ((doffs % vt->cols) == 0) && ((soffs % vt->cols) == 0) && ((n % vt->cols) == 0)) {
+		/* Whole rows move, fbcon text memory is general purpose memory and the framebuffer is scrolled at once on flush */
+		memmove((void *)dvga, (void *)svga, n * sizeof(*dvga));
+		_ttypc_fbcon_move(vt, doffs / vt->cols, soffs / vt->cols, n / vt->cols);
+
+		return dvga;
 	}
 
+	/* Moved cells are written from VT memory, screen memory is never read back */
+	_ttypc_vga_show(vt, doffs, vt->mem + doffs, n);
+
 	return dvga;
 }
 
 
+void _ttypc_vga_flush(ttypc_vt_t *vt, size_t offs, size_t n)
+{
+	_ttypc_vga_show(vt, offs, vt->mem + offs, n);
+}
+
+
+void _ttypc_vga_load(ttypc_vt_t *vt)
+{
+	size_t i;
+
+	for (i = 0; i < vt->rows * vt->cols; i++)
+		vt->mem[i] = vt->vram[i];
+}
+
+
 void _ttypc_vga_switch(ttypc_vt_t *vt)
 {
 	ttypc_t *ttypc = vt->ttypc;
@@ -185,8 +162,8 @@ void _ttypc_vga_switch(ttypc_vt_t *vt)
 	if (vt == cvt)
 		return;
 
-	/* VGA memory -> VT memory */
-	_ttypc_vga_read(cvt, 0, cvt->mem, cvt->rows * cvt->cols);
+	/* VT memory is always up to date, just detach the screen */
+	_ttypc_vga_scrollcancel(cvt);
 	cvt->vram = cvt->mem;
 
 	/* Set active VT, do it before writes to unlock access to the fb */
@@ -200,11 +177,12 @@ void _ttypc_vga_switch(ttypc_vt_t *vt)
 	mutexLock(vt->lock);
 	/* VT memory -> VGA memory */
 	vt->vram = ttypc->vga;
-	_ttypc_vga_write(vt, 0, vt->mem, vt->rows * vt->cols);
+	_ttypc_vga_flush(vt, 0, vt->rows * vt->cols);
 	/* Set cursor position... */
 	_ttypc_vga_setcursor(vt);
 	/* ... and visibility */
 	_ttypc_vga_togglecursor(vt, vt->cst);
+	_ttypc_fbcon_flush(vt);
 	mutexUnlock(vt->lock);
 }
 
@@ -216,13 +194,19 @@ static unsigned int _ttypc_vga_scrollbackcapacity(ttypc_vt_t *vt)
 }
 
 
-/* Makes space for n new lines in the scrollback buffer */
+uint16_t *_ttypc_vga_scrbline(ttypc_vt_t *vt, unsigned int line)
+{
+	return vt->scrb + ((vt->scrbhead + line) % _ttypc_vga_scrollbackcapacity(vt)) * vt->cols;
+}
+
+
+/* Makes space for n new lines in the scrollback buffer (drops the oldest ones if full) */
 static void _ttypc_vga_allocscrollback(ttypc_vt_t *vt, unsigned int n)
 {
 	unsigned int scrbcap = _ttypc_vga_scrollbackcapacity(vt);
 
 	if (vt->scrbsz + n > scrbcap) {
-		memmove(vt->scrb, vt->scrb + (vt->scrbsz + n - scrbcap) * vt->cols, (scrbcap - n) * vt->cols * CHR_VGA);
+		vt->scrbhead = (vt->scrbhead + vt->scrbsz + n - scrbcap) % scrbcap;
 		vt->scrbsz = scrbcap;
 	}
 	else {
@@ -233,11 +217,12 @@ static void _ttypc_vga_allocscrollback(ttypc_vt_t *vt, unsigned int n)
 
 void _ttypc_vga_rollup(ttypc_vt_t *vt, unsigned int n)
 {
-	unsigned int k = min(n, _ttypc_vga_scrollbackcapacity(vt));
+	unsigned int i, k = min(n, _ttypc_vga_scrollbackcapacity(vt));
 
 	/* Update scrollback buffer */
 	_ttypc_vga_allocscrollback(vt, k);
-	_ttypc_vga_read(vt, (vt->top + n - k) * vt->cols, vt->scrb + (vt->scrbsz - k) * vt->cols, k * vt->cols);
+	for (i = 0; i < k; i++)
+		_ttypc_vga_read(vt, (vt->top + n - k + i) * vt->cols, _ttypc_vga_scrbline(vt, vt->scrbsz - k + i), vt->cols);
 
 	/* Roll up */
 	if (n < vt->bottom - vt->top) {
@@ -249,7 +234,7 @@ void _ttypc_vga_rollup(ttypc_vt_t *vt, unsigned int n)
 
 void _ttypc_vga_rolldown(ttypc_vt_t *vt, unsigned int n)
 {
-	unsigned int k, l;
+	unsigned int i, k, l;
 
 	/* Roll down */
 	if (vt->bottom > vt->crow) {
@@ -257,7 +242,8 @@ void _ttypc_vga_rolldown(ttypc_vt_t *vt, unsigned int n)
 		l = min(k, vt->scrbsz);
 		_ttypc_vga_move(vt, (vt->top + k) * vt->cols, vt->top * vt->cols, (vt->bottom - vt->top + 1 - k) * vt->cols);
 		_ttypc_vga_set(vt, vt->top * vt->cols, vt->attr | ' ', (k - l) * vt->cols);
-		_ttypc_vga_write(vt, (vt->top + k - l) * vt->cols, vt->scrb + (vt->scrbsz - l) * vt->cols, l * vt->cols);
+		for (i = 0; i < l; i++)
+			_ttypc_vga_write(vt, (vt->top + k - l + i) * vt->cols, _ttypc_vga_scrbline(vt, vt->scrbsz - l + i), vt->cols);
 		vt->scrbsz -= l;
 	}
 }
@@ -265,6 +251,8 @@ void _ttypc_vga_rolldown(ttypc_vt_t *vt, unsigned int n)
 
 void _ttypc_vga_scroll(ttypc_vt_t *vt, int n)
 {
+	unsigned int i;
+
 	if (n > vt->scrbsz - vt->scrbpos)
 		n = vt->scrbsz - vt->scrbpos;
 	else if (n < -vt->scrbpos)
@@ -277,17 +265,14 @@ void _ttypc_vga_scroll(ttypc_vt_t *vt, int n)
 	vt->cpos += n * vt->cols;
 	vt->crow += n;
 
-	/* Save scroll origin */
-	if (!vt->scrbpos)
-		_ttypc_vga_read(vt, 0, vt->scro, vt->rows * vt->cols);
-
-	/* Copy scrollback */
+	/* Show scrollback, VT memory keeps the scroll origin */
 	vt->scrbpos += n;
-	_ttypc_vga_write(vt, 0, vt->scrb + (vt->scrbsz - vt->scrbpos) * vt->cols, min(vt->scrbpos, vt->rows) * vt->cols);
+	for (i = 0; i < min(vt->scrbpos, vt->rows); i++)
+		_ttypc_vga_show(vt, i * vt->cols, _ttypc_vga_scrbline(vt, vt->scrbsz - vt->scrbpos + i), vt->cols);
 
-	/* Copy scroll origin */
+	/* Show scroll origin */
 	if (vt->scrbpos < vt->rows) {
-		_ttypc_vga_write(vt, vt->scrbpos * vt->cols, vt->scro, (vt->rows - vt->scrbpos) * vt->cols);
+		_ttypc_vga_show(vt, vt->scrbpos * vt->cols, vt->mem, (vt->rows - vt->scrbpos) * vt->cols);
 
 		if ((vt == vt->ttypc->vt) && vt->cst) {
 			/* Show cursor */
@@ -299,6 +284,8 @@ void _ttypc_vga_scroll(ttypc_vt_t *vt, int n)
 		/* Hide cursor */
 		_ttypc_vga_togglecursor(vt, 0);
 	}
+
+	_ttypc_fbcon_flush(vt);
 }
 
 
@@ -308,7 +295,7 @@ void _ttypc_vga_scrollcancel(ttypc_vt_t *vt)
 		return;
 
 	/* Restore scroll origin */
-	_ttypc_vga_write(vt, 0, vt->scro, vt->rows * vt->cols);
+	_ttypc_vga_flush(vt, 0, vt->rows * vt->cols);
 
 	/* Restore cursor position... */
 	vt->cpos -= vt->scrbpos * vt->cols;
@@ -158,22 +158,36 @@ enum {
 
 /* clang-format off */
 
-/* Copies VGA screen buffer to buff */
+/* VT memory (vt->mem) holds the screen contents, changes are written through to the screen buffer of the active VT */
+
+/* Copies VT screen to buff */
 extern ssize_t _ttypc_vga_read(ttypc_vt_t *vt, size_t offs, uint16_t *buff, size_t n);
 
 
-/* Copies buff to VGA screen buffer */
+/* Copies buff to VT screen */
 extern ssize_t _ttypc_vga_write(ttypc_vt_t* vt, size_t offs, uint16_t *buff, size_t n);
 
 
-/* Sets VGA screen buffer characters to val */
+/* Sets VT screen characters to val */
 extern volatile uint16_t *_ttypc_vga_set(ttypc_vt_t *vt, size_t offs, uint16_t val, size_t n);
 
 
-/* Moves VGA screen memory */
+/* Moves VT screen memory */
 extern volatile uint16_t *_ttypc_vga_move(ttypc_vt_t *vt, size_t doffs, size_t soffs, size_t n);
 
 
+/* Writes VT memory changed directly to the screen buffer */
+extern void _ttypc_vga_flush(ttypc_vt_t *vt, size_t offs, size_t n);
+
+
+/* Loads VT memory from the screen buffer (contents left by earlier boot stages) */
+extern void _ttypc_vga_load(ttypc_vt_t *vt);
+
+
+/* Returns scrollback line, 0 is the oldest one */
+extern uint16_t *_ttypc_vga_scrbline(ttypc_vt_t *vt, unsigned int line);
+
+
 /* Switches to another VT */
 extern void _ttypc_vga_switch(ttypc_vt_t *vt);
 
@@ -17,6 +17,7 @@
 #include <string.h>
 #include <signal.h>
 
+#include <sys/minmax.h>
 #include <sys/mman.h>
 #include <sys/threads.h>
 
@@ -28,18 +29,61 @@
 #include "ttypc_vtf.h"
 
 
-/* Writes character to screen buffer */
-static void _ttypc_vt_sdraw(ttypc_vt_t *vt, char c)
+/* Maximum printable characters run written at once */
+#define SRUN_LEN 128
+
+
+/* CSI sequence final character handlers */
+static void (*const ttypc_vt_csi['~' - '@' + 1])(ttypc_vt_t *vt) = {
+	['@' - '@'] = _ttypc_vtf_ic,        /* Insert char */
+	['A' - '@'] = _ttypc_vtf_cuu,       /* Cursor up */
+	['B' - '@'] = _ttypc_vtf_cud,       /* Cursor down */
+	['C' - '@'] = _ttypc_vtf_cuf,       /* Cursor forward */
+	['D' - '@'] = _ttypc_vtf_cub,       /* Cursor backward */
+	['H' - '@'] = _ttypc_vtf_curadr,    /* Direct cursor addressing */
+	['J' - '@'] = _ttypc_vtf_clreos,    /* Erase screen */
+	['K' - '@'] = _ttypc_vtf_clreol,    /* Erase line */
+	['L' - '@'] = _ttypc_vtf_il,        /* Insert line */
+	['M' - '@'] = _ttypc_vtf_dl,        /* Delete line */
+	['P' - '@'] = _ttypc_vtf_dch,       /* Delete character */
+	['S' - '@'] = _ttypc_vtf_su,        /* Scroll up */
+	['T' - '@'] = _ttypc_vtf_sd,        /* Scroll down */
+	['X' - '@'] = _ttypc_vtf_ech,       /* Erase character */
+	['c' - '@'] = _ttypc_vtf_da,        /* Device attributes */
+	['f' - '@'] = _ttypc_vtf_curadr,    /* Direct cursor addressing */
+	['g' - '@'] = _ttypc_vtf_clrtab,    /* Clear tabs */
+	['h' - '@'] = _ttypc_vtf_setansi,   /* Set ANSI modes */
+	['i' - '@'] = _ttypc_vtf_mc,        /* Media copy */
+	['l' - '@'] = _ttypc_vtf_resetansi, /* Reset ANSI modes */
+	['m' - '@'] = _ttypc_vtf_sgr,       /* Select graphic rendition */
+	['n' - '@'] = _ttypc_vtf_dsr,       /* Reports */
+	['r' - '@'] = _ttypc_vtf_stbm,      /* Set scrolling region */
+	['x' - '@'] = _ttypc_vtf_reqtparm,  /* Request/report parameters */
+	['y' - '@'] = _ttypc_vtf_tst,       /* Invoke selftest(s) */
+};
+
+
+/* Translates character through active character sets */
+static char _ttypc_vt_schar(ttypc_vt_t *vt, char c)
 {
-	int pos, col, row;
-
 	if ((c >= 0x20) && (c <= 0x7f))
 		c = (vt->ss) ? (*vt->Gs)[c - 0x20] : (*vt->GL)[c - 0x20];
 	else if (c >= 0xa0)
 		c = (*vt->GR)[c - 0xa0];
+	vt->ss = 0;
+
+	return c;
+}
+
+
+/* Writes character to screen buffer */
+static void _ttypc_vt_sdraw(ttypc_vt_t *vt, char c)
+{
+	int pos, col, row;
 
+	c = _ttypc_vt_schar(vt, c);
+	*(vt->mem + vt->cpos) = vt->attr | c;
 	*(vt->vram + vt->cpos) = vt->attr | c;
-	vt->ss = 0;
 
 	pos = vt->cpos;
 	col = pos % vt->cols;
@@ -48,6 +92,22 @@ static void _ttypc_vt_sdraw(ttypc_vt_t *vt, char c)
 }
 
 
+/* Updates screen, scrollback buffer and cursor after character output */
+static void _ttypc_vt_supdate(ttypc_vt_t *vt)
+{
+	/* Update screen and scrollback buffer */
+	if (vt->cpos >= (vt->bottom + 1) * vt->cols) {
+		_ttypc_vga_rollup(vt, 1);
+		vt->cpos -= vt->cols;
+	}
+	vt->crow = vt->cpos / vt->cols;
+
+	/* Update cursor */
+	if (vt == vt->ttypc->vt)
+		_ttypc_vga_setcursor(vt);
+}
+
+
 static void _ttypc_vt_sput(ttypc_vt_t *vt, char c)
 {
 	/* Cancel scrolling */
@@ -384,11 +444,6 @@ static void _ttypc_vt_sput(ttypc_vt_t *vt, char c)
 				vt->escst = ESC_CSIQM;
 				break;
 
-			case '@':   /* Insert char */
-				_ttypc_vtf_ic(vt);
-				vt->escst = ESC_INIT;
-				break;
-
 			case '"':   /* Select char attribute */
 				vt->escst = ESC_SCA;
 				break;
@@ -397,127 +452,9 @@ static void _ttypc_vt_sput(ttypc_vt_t *vt, char c)
 				vt->escst = ESC_STR;
 				break;
 
-			case 'A':   /* Cursor up */
-				_ttypc_vtf_cuu(vt);
-				vt->escst = ESC_INIT;
-				break;
-
-			case 'B':   /* Cursor down */
-				_ttypc_vtf_cud(vt);
-				vt->escst = ESC_INIT;
-				break;
-
-			case 'C':   /* Cursor forward */
-				_ttypc_vtf_cuf(vt);
-				vt->escst = ESC_INIT;
-				break;
-
-			case 'D':   /* Cursor backward */
-				_ttypc_vtf_cub(vt);
-				vt->escst = ESC_INIT;
-				break;
-
-			case 'H':   /* Direct cursor addressing */
-				_ttypc_vtf_curadr(vt);
-				vt->escst = ESC_INIT;
-				break;
-
-			case 'J':   /* Erase screen */
-				_ttypc_vtf_clreos(vt);
-				vt->escst = ESC_INIT;
-				break;
-
-			case 'K':   /* Erase line */
-				_ttypc_vtf_clreol(vt);
-				vt->escst = ESC_INIT;
-				break;
-
-			case 'L':   /* Insert line */
-				_ttypc_vtf_il(vt);
-				vt->escst = ESC_INIT;
-				break;
-
-			case 'M':   /* Delete line */
-				_ttypc_vtf_dl(vt);
-				vt->escst = ESC_INIT;
-				break;
-
-			case 'P':   /* Delete character */
-				_ttypc_vtf_dch(vt);
-				vt->escst = ESC_INIT;
-				break;
-
-			case 'S':   /* Scroll up */
-				_ttypc_vtf_su(vt);
-				vt->escst = ESC_INIT;
-				break;
-
-			case 'T':   /* Scroll down */
-				_ttypc_vtf_sd(vt);
-				vt->escst = ESC_INIT;
-				break;
-
-			case 'X':   /* Erase character */
-				_ttypc_vtf_ech(vt);
-				vt->escst = ESC_INIT;
-				break;
-
-			case 'c':   /* Device attributes */
-				_ttypc_vtf_da(vt);
-				vt->escst = ESC_INIT;
-				break;
-
-			case 'f':   /* Direct cursor addressing */
-				_ttypc_vtf_curadr(vt);
-				vt->escst = ESC_INIT;
-				break;
-
-			case 'g':   /* Clear tabs */
-				_ttypc_vtf_clrtab(vt);
-				vt->escst = ESC_INIT;
-				break;
-
-			case 'h':   /* Set ANSI modes */
-				_ttypc_vtf_setansi(vt);
-				vt->escst = ESC_INIT;
-				break;
-
-			case 'i':   /* Media copy */
-				_ttypc_vtf_mc(vt);
-				vt->escst = ESC_INIT;
-				break;
-
-			case 'l':   /* Reset ANSI modes */
-				_ttypc_vtf_resetansi(vt);
-				vt->escst = ESC_INIT;
-				break;
-
-			case 'm':   /* Select graphic rendition */
-				_ttypc_vtf_sgr(vt);
-				vt->escst = ESC_INIT;
-				break;
-
-			case 'n':   /* Reports */
-				_ttypc_vtf_dsr(vt);
-				vt->escst = ESC_INIT;
-				break;
-
-			case 'r':   /* Set scrolling region */
-				_ttypc_vtf_stbm(vt);
-				vt->escst = ESC_INIT;
-				break;
-
-			case 'x':   /* Request/report parameters */
-				_ttypc_vtf_reqtparm(vt);
-				vt->escst = ESC_INIT;
-				break;
-
-			case 'y':   /* Invoke selftest(s) */
-				_ttypc_vtf_tst(vt);
-				vt->escst = ESC_INIT;
-				break;
-
-			default:
+			default:    /* Final character */
+				if ((c >= '@') && (c <= '~') && (ttypc_vt_csi[c - '@'] != NULL))
+					ttypc_vt_csi[c - '@'](vt);
 				vt->escst = ESC_INIT;
 				break;
 			}
@@ -610,16 +547,50 @@ static void _ttypc_vt_sput(ttypc_vt_t *vt, char c)
 		}
 	}
 
-	/* Update screen and scrollback buffer */
-	if (vt->cpos >= (vt->bottom + 1) * vt->cols) {
-		_ttypc_vga_rollup(vt, 1);
-		vt->cpos -= vt->cols;
+	_ttypc_vt_supdate(vt);
+}
+
+
+/* Writes run of printable characters in normal state, returns number of processed characters */
+static size_t _ttypc_vt_sputs(ttypc_vt_t *vt, const uint8_t *data, size_t len)
+{
+	uint16_t run[SRUN_LEN];
+	size_t n = 0, k, i;
+
+	while ((n < len) && (vt->escst == ESC_INIT) && !vt->irm) {
+		/* Run is written up to the end of the current line */
+		k = min(min(len - n, (size_t)(vt->cols - vt->ccol)), SRUN_LEN);
+		for (i = 0; (i < k) && (data[n + i] >= 0x20) && (data[n + i] < 0x7f); i++)
+			run[i] = vt->attr | _ttypc_vt_schar(vt, (char)data[n + i]);
+
+		if (i == 0)
+			break;
+
+		_ttypc_vga_scrollcancel(vt);
+		_ttypc_vga_write(vt, vt->cpos, run, i);
+
+		vt->lc = 0;
+		if (vt->ccol + i < vt->cols) {
+			vt->ccol += i;
+			vt->cpos += i;
+		}
+		else if (vt->awm) {
+			vt->ccol = 0;
+			vt->cpos += i;
+			vt->lc = 1;
+		}
+		else {
+			vt->ccol = vt->cols - 1;
+			vt->cpos += i - 1;
+		}
+
+		_ttypc_vt_supdate(vt);
+		n += i;
+		if (i < k)
+			break;
 	}
-	vt->crow = vt->cpos / vt->cols;
 
-	/* Update cursor */
-	if (vt == vt->ttypc->vt)
-		_ttypc_vga_setcursor(vt);
+	return n;
 }
 
 
@@ -683,10 +654,8 @@ int ttypc_vt_ioctl(ttypc_vt_t *vt, pid_t pid, unsigned int cmd, const void *idat
 void ttypc_vt_destroy(ttypc_vt_t *vt)
 {
 	libtty_destroy(&vt->tty);
-	if (SCRB_PAGES) {
+	if (SCRB_PAGES)
 		munmap(vt->scrb, SCRB_PAGES * _PAGE_SIZE);
-		munmap(vt->scro, _PAGE_SIZE);
-	}
 	munmap(vt->mem, _PAGE_SIZE);
 	resourceDestroy(vt->lock);
 }
@@ -707,9 +676,23 @@ static void _ttypc_vt_setcflag(void *arg, tcflag_t *cflag)
 static void _ttypc_vt_signaltxready(void *arg)
 {
 	ttypc_vt_t *vt = (ttypc_vt_t *)arg;
+	const uint8_t *data;
+	size_t n;
+	int wake;
+
+	while (libtty_txready(&vt->tty)) {
+		/* Printable runs are written directly from TX buffer, anything else goes through the parser.
+		 * Responses to escape sequences may be echoed back, so the span isn't held across _ttypc_vt_sput() */
+		n = libtty_tx_span(&vt->tty, &data);
+		n = _ttypc_vt_sputs(vt, data, n);
+		if (n > 0)
+			libtty_tx_consume(&vt->tty, n, &wake);
+		else
+			_ttypc_vt_sput(vt, (char)libtty_popchar(&vt->tty));
+	}
 
-	while (libtty_txready(&vt->tty))
-		_ttypc_vt_sput(vt, (char)libtty_popchar(&vt->tty));
+	/* Draw all pending changes at once */
+	_ttypc_fbcon_flush(vt);
 
 	libtty_wake_writer(&vt->tty);
 }
@@ -721,6 +704,13 @@ void ttypc_vt_resize(ttypc_vt_t *vt, uint8_t cols, uint8_t rows)
 	vt->tty.ws.ws_row = rows;
 	libtty_signal_pgrp(&vt->tty, SIGWINCH);
 
+	/* Scrollback lines are stored with the old width */
+	if (cols != vt->cols) {
+		_ttypc_vga_scrollcancel(vt);
+		vt->scrbhead = 0;
+		vt->scrbsz = 0;
+	}
+
 	vt->cols = cols;
 	vt->rows = rows;
 	_ttypc_vtf_str(vt);
@@ -748,17 +738,10 @@ int ttypc_vt_init(ttypc_t *ttypc, unsigned int ttybuffsz, ttypc_vt_t *vt)
 	vt->vram = vt->mem;
 
 	if (SCRB_PAGES) {
-		vt->scro = mmap(NULL, ttybuffsz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-		if (vt->scro == MAP_FAILED) {
-			resourceDestroy(vt->lock);
-			munmap(vt->mem, ttybuffsz);
-			return -ENOMEM;
-		}
 		vt->scrb = mmap(NULL, SCRB_PAGES * ttybuffsz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
 		if (vt->scrb == MAP_FAILED) {
 			resourceDestroy(vt->lock);
 			munmap(vt->mem, ttybuffsz);
-			munmap(vt->scro, ttybuffsz);
 			return -ENOMEM;
 		}
 	}
@@ -766,10 +749,8 @@ int ttypc_vt_init(ttypc_t *ttypc, unsigned int ttybuffsz, ttypc_vt_t *vt)
 	if ((err = libtty_init(&vt->tty, &cb, ttybuffsz, TTYDEF_SPEED)) < 0) {
 		resourceDestroy(vt->lock);
 		munmap(vt->mem, ttybuffsz);
-		if (SCRB_PAGES) {
-			munmap(vt->scro, ttybuffsz);
+		if (SCRB_PAGES)
 			munmap(vt->scrb, SCRB_PAGES * ttybuffsz);
-		}
 		return err;
 	}
 
@@ -65,7 +65,7 @@ typedef struct {
 
 	/* Screen */
 	volatile uint16_t *vram; /* Screen buffer address (if VT is active points to ttypc->vga, mem otherwise) */
-	uint16_t *mem;           /* Screen memory buffer */
+	uint16_t *mem;           /* Screen memory buffer (always up to date, vram is never read back) */
 	uint8_t rows;            /* Screen height - number of rows */
 	uint8_t cols;            /* Screen width - number of columns */
 	uint8_t top;             /* Screen top margin */
@@ -80,8 +80,8 @@ typedef struct {
 	int16_t dpos;            /* Drawn cursor position offset */
 
 	/* Scrollback */
-	uint16_t *scro;          /* Scroll origin buffer */
-	uint16_t *scrb;          /* Scrollback buffer */
+	uint16_t *scrb;          /* Scrollback buffer (ring of lines) */
+	uint16_t scrbhead;       /* Scrollback oldest line index */
 	uint16_t scrbsz;         /* Scrollback size (in lines) */
 	uint16_t scrbpos;        /* Scrollback position offset */
 
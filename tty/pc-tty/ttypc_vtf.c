@@ -565,6 +565,7 @@ void _ttypc_vtf_ris(ttypc_vt_t *vt)
 	vt->cpos = 0;
 	vt->ccol = 0;
 	vt->crow = 0;
+	vt->scrbhead = 0;
 	vt->scrbsz = 0;
 	vt->scrbpos = 0;
 
@@ -860,16 +861,22 @@ static void _ttypc_vtf_applyattr(ttypc_vt_t *vt, volatile uint16_t *begin, volat
 /* Applies SGR mode globally */
 static void _ttypc_vtf_applysgr(ttypc_vt_t *vt, uint8_t sgr)
 {
+	unsigned int i;
+	uint16_t *line;
+
 	vt->sgr = sgr;
 	vt->attr = ((vt->ttypc->color) ? csgr[sgr] : msgr[sgr]) << 8;
 
-	/* Apply attr to vram */
-	_ttypc_vtf_applyattr(vt, vt->vram, vt->vram + vt->rows * vt->cols, vt->attr);
+	/* Apply attr to screen */
+	_ttypc_vtf_applyattr(vt, vt->mem, vt->mem + vt->rows * vt->cols, vt->attr);
 	/* Apply attr to scrollback */
-	_ttypc_vtf_applyattr(vt, vt->scrb, vt->scrb + vt->scrbsz * vt->cols, vt->attr);
-	/* Apply attr to scroll origin */
-	if (vt->scrbpos)
-		_ttypc_vtf_applyattr(vt, vt->scro, vt->scro + vt->rows * vt->cols, vt->attr);
+	for (i = 0; i < vt->scrbsz; i++) {
+		line = _ttypc_vga_scrbline(vt, i);
+		_ttypc_vtf_applyattr(vt, line, line + vt->cols, vt->attr);
+	}
+	/* Scrolled back screen is redrawn on scroll cancel */
+	if (!vt->scrbpos)
+		_ttypc_vga_flush(vt, 0, vt->rows * vt->cols);
 }
 
 
@@ -0,0 +1,932 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Prolific PL2303 USB-serial driver
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * %LICENSE%
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/list.h>
+#include <sys/msg.h>
+#include <sys/types.h>
+#include <sys/file.h>
+#include <sys/threads.h>
+#include <sys/minmax.h>
+#include <posix/utils.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <usb.h>
+#include <usbdriver.h>
+#include <libtty.h>
+
+#include "../libtty/fifo.h"
+
+
+#ifndef PL2303_N_MSG_THREADS
+#define PL2303_N_MSG_THREADS 4
+#endif
+
+/* libtty TX/RX buffer size, power of 2 */
+#ifndef PL2303_BUFSZ
+#define PL2303_BUFSZ 8192
+#endif
+
+#ifndef PL2303_N_URBS
+#define PL2303_N_URBS 4
+#endif
+
+/* Max outstanding bulk OUT transfers */
+#ifndef PL2303_N_TX_URBS
+#define PL2303_N_TX_URBS 4
+#endif
+
+#ifndef PL2303_MSG_PRIO
+#define PL2303_MSG_PRIO 3
+#endif
+
+#define PL2303_BULK_SZ 512
+
+#if (PL2303_BUFSZ & (PL2303_BUFSZ - 1)) != 0 || PL2303_BUFSZ <= PL2303_N_URBS * PL2303_BULK_SZ
+#error "PL2303_BUFSZ must be a power of 2 larger than PL2303_N_URBS * PL2303_BULK_SZ"
+#endif
+
+/* Requests */
+#define PL2303_REQ_VENDOR           0x01
+#define PL2303_REQ_SET_LINE_CODING  0x20
+#define PL2303_REQ_SET_CONTROL_LINE 0x22
+
+#define PL2303_CONTROL_DTR 0x01
+#define PL2303_CONTROL_RTS 0x02
+
+/* clang-format off */
+#define TRACE(fmt, ...) if (0) printf("pl2303: " fmt "\n", ##__VA_ARGS__)
+
+enum { RxStopped = 0, RxRunning = 1, RxDisconnected = -1 };
+/* clang-format on */
+
+typedef struct _pl2303_dev {
+	struct _pl2303_dev *prev, *next;
+	usb_devinfo_t instance;
+
+	/* USB HOST related */
+	int pipeCtrl;
+	int pipeIntIN;
+	int pipeBulkIN;
+	int pipeBulkOUT;
+	int urbs[PL2303_N_URBS];
+	int hx; /* PL2303HX chip revision */
+
+	char path[32];
+	unsigned int id; /* tty id (/dev/ttyUSB[ID]) */
+	int fileId;      /* oid.id */
+
+	volatile int rfcnt; /* protected by pl2303_common.lock */
+	int nopen;          /* protected by pl2303_common.lock */
+
+	libtty_common_t tty;
+	uint8_t coding[7]; /* CDC line coding: rate, stop bits, parity, data bits */
+
+	/* READ state - protected by rxLock */
+	unsigned int rxInflight; /* bulk IN urbs submitted */
+	unsigned int rxNparked;  /* completed urbs waiting for free space in tty */
+	int rxParked[PL2303_N_URBS];
+	handle_t rxLock;
+	int rxState;
+
+	/* WRITE state - protected by txLock */
+	unsigned int txInflight; /* bulk OUT urbs submitted */
+	int txDisconnected;
+	handle_t txLock;
+
+	usb_driver_t *drv;
+} pl2303_dev_t;
+
+
+static struct {
+	char msgstack[PL2303_N_MSG_THREADS][2048] __attribute__((aligned(8)));
+	pl2303_dev_t *devices;
+	unsigned msgport;
+	handle_t lock;
+	int lastId;
+	pl2303_dev_t *devicesToFree;
+} pl2303_common;
+
+
+static const usb_device_id_t filters[] = {
+	/* Prolific PL2303 */
+	{ 0x067b, 0x2303, USBDRV_ANY, USBDRV_ANY, USBDRV_ANY },
+	/* ATEN UC-232A */
+	{ 0x0557, 0x2008, USBDRV_ANY, USBDRV_ANY, USBDRV_ANY },
+};
+
+
+static int pl2303_vendorRead(pl2303_dev_t *dev, uint16_t value)
+{
+	usb_setup_packet_t setup;
+	uint8_t buf;
+
+	setup.bmRequestType = REQUEST_DIR_DEV2HOST | REQUEST_TYPE_VENDOR | REQUEST_RECIPIENT_DEVICE;
+	setup.bRequest = PL2303_REQ_VENDOR;
+	setup.wValue = value;
+	setup.wIndex = 0;
+	setup.wLength = 1;
+
+	return usb_transferControl(dev->drv, dev->pipeCtrl, &setup, &buf, 1, usb_dir_in);
+}
+
+
+static int pl2303_vendorWrite(pl2303_dev_t *dev, uint16_t value, uint16_t index)
+{
+	usb_setup_packet_t setup;
+
+	setup.bmRequestType = REQUEST_DIR_HOST2DEV | REQUEST_TYPE_VENDOR | REQUEST_RECIPIENT_DEVICE;
+	setup.bRequest = PL2303_REQ_VENDOR;
+	setup.wValue = value;
+	setup.wIndex = index;
+	setup.wLength = 0;
+
+	return usb_transferControl(dev->drv, dev->pipeCtrl, &setup, NULL, 0, usb_dir_out);
+}
+
+
+static int pl2303_startup(pl2303_dev_t *dev)
+{
+	/* Initialization sequence of the vendor driver */
+	if ((pl2303_vendorRead(dev, 0x8484) < 0) || (pl2303_vendorWrite(dev, 0x0404, 0) < 0) ||
+			(pl2303_vendorRead(dev, 0x8484) < 0) || (pl2303_vendorRead(dev, 0x8383) < 0) ||
+			(pl2303_vendorRead(dev, 0x8484) < 0) || (pl2303_vendorWrite(dev, 0x0404, 1) < 0) ||
+			(pl2303_vendorRead(dev, 0x8484) < 0) || (pl2303_vendorRead(dev, 0x8383) < 0) ||
+			(pl2303_vendorWrite(dev, 0, 1) < 0) || (pl2303_vendorWrite(dev, 1, 0) < 0) ||
+			(pl2303_vendorWrite(dev, 2, dev->hx ? 0x44 : 0x24) < 0)) {
+		return -EIO;
+	}
+
+	/* Reset upstream and downstream data pipes */
+	if ((pl2303_vendorWrite(dev, 8, 0) < 0) || (pl2303_vendorWrite(dev, 9, 0) < 0)) {
+		return -EIO;
+	}
+
+	return 0;
+}
+
+
+static int pl2303_setLineCoding(pl2303_dev_t *dev)
+{
+	usb_setup_packet_t setup;
+
+	setup.bmRequestType = REQUEST_DIR_HOST2DEV | REQUEST_TYPE_CLASS | REQUEST_RECIPIENT_INTERFACE;
+	setup.bRequest = PL2303_REQ_SET_LINE_CODING;
+	setup.wValue = 0;
+	setup.wIndex = dev->instance.interface;
+	setup.wLength = sizeof(dev->coding);
+
+	return usb_transferControl(dev->drv, dev->pipeCtrl, &setup, dev->coding, sizeof(dev->coding), usb_dir_out);
+}
+
+
+static int pl2303_setControlLines(pl2303_dev_t *dev, uint16_t lines)
+{
+	usb_setup_packet_t setup;
+
+	setup.bmRequestType = REQUEST_DIR_HOST2DEV | REQUEST_TYPE_CLASS | REQUEST_RECIPIENT_INTERFACE;
+	setup.bRequest = PL2303_REQ_SET_CONTROL_LINE;
+	setup.wValue = lines;
+	setup.wIndex = dev->instance.interface;
+	setup.wLength = 0;
+
+	return usb_transferControl(dev->drv, dev->pipeCtrl, &setup, NULL, 0, usb_dir_out);
+}
+
+
+/* Rates above the libtty table, the chip takes the rate directly */
+static int pl2303_baudrateToInt(speed_t speed)
+{
+	switch (speed) {
+#ifdef B921600
+		case B921600: return 921600;
+#endif
+#ifdef B1000000
+		case B1000000: return 1000000;
+#endif
+#ifdef B1500000
+		case B1500000: return 1500000;
+#endif
+#ifdef B2000000
+		case B2000000: return 2000000;
+#endif
+#ifdef B3000000
+		case B3000000: return 3000000;
+#endif
+		default: return libtty_baudrate_to_int(speed);
+	}
+}
+
+
+static void pl2303_setBaudrate(void *arg, speed_t speed)
+{
+	pl2303_dev_t *dev = (pl2303_dev_t *)arg;
+	int baud = pl2303_baudrateToInt(speed);
+
+	if (baud <= 0) {
+		return;
+	}
+
+	dev->coding[0] = baud & 0xff;
+	dev->coding[1] = (baud >> 8) & 0xff;
+	dev->coding[2] = (baud >> 16) & 0xff;
+	dev->coding[3] = (baud >> 24) & 0xff;
+
+	if (pl2303_setLineCoding(dev) < 0) {
+		fprintf(stderr, "pl2303: %s: failed to set baudrate %d\n", dev->path, baud);
+	}
+}
+
+
+static void pl2303_setCFlag(void *arg, tcflag_t *cflag)
+{
+	pl2303_dev_t *dev = (pl2303_dev_t *)arg;
+
+	switch (*cflag & CSIZE) {
+		case CS5: dev->coding[6] = 5; break;
+		case CS6: dev->coding[6] = 6; break;
+		case CS7: dev->coding[6] = 7; break;
+		default: dev->coding[6] = 8; break;
+	}
+
+	/* 0 - 1 stop bit, 2 - 2 stop bits */
+	dev->coding[4] = (*cflag & CSTOPB) ? 2 : 0;
+
+	/* 0 - none, 1 - odd, 2 - even */
+	if (*cflag & PARENB) {
+		dev->coding[5] = (*cflag & PARODD) ? 1 : 2;
+	}
+	else {
+		dev->coding[5] = 0;
+	}
+
+	if (pl2303_setLineCoding(dev) < 0) {
+		fprintf(stderr, "pl2303: %s: failed to set line coding\n", dev->path);
+	}
+
+#ifdef CRTSCTS
+	pl2303_vendorWrite(dev, 0, (*cflag & CRTSCTS) ? (dev->hx ? 0x61 : 0x41) : 0);
+#endif
+}
+
+
+/* called always under dev->rxLock */
+static int _pl2303_rxSubmit(pl2303_dev_t *dev, int urb)
+{
+	/* Space for data of all urbs in flight is reserved in tty, so no completion is dropped */
+	if ((dev->rxState != RxRunning) || (fifo_freespace(dev->tty.rx_fifo) < (dev->rxInflight + 1) * PL2303_BULK_SZ)) {
+		dev->rxParked[dev->rxNparked++] = urb;
+		return 0;
+	}
+
+	if (usb_transferAsync(dev->drv, dev->pipeBulkIN, urb, PL2303_BULK_SZ, NULL) < 0) {
+		dev->rxParked[dev->rxNparked++] = urb;
+		return -EIO;
+	}
+	dev->rxInflight++;
+
+	return 0;
+}
+
+
+/* called always under dev->rxLock */
+static void _pl2303_rxResume(pl2303_dev_t *dev)
+{
+	while ((dev->rxNparked > 0) && (dev->rxState == RxRunning) &&
+			(fifo_freespace(dev->tty.rx_fifo) >= (dev->rxInflight + 1) * PL2303_BULK_SZ)) {
+		if (_pl2303_rxSubmit(dev, dev->rxParked[--dev->rxNparked]) < 0) {
+			dev->rxState = RxStopped;
+		}
+	}
+}
+
+
+/* called always under dev->rxLock */
+static int _pl2303_rxStart(pl2303_dev_t *dev)
+{
+	int i;
+
+	dev->rxState = RxRunning;
+	dev->rxInflight = 0;
+	dev->rxNparked = 0;
+	for (i = 0; i < PL2303_N_URBS; i++) {
+		if (_pl2303_rxSubmit(dev, dev->urbs[i]) < 0) {
+			dev->rxState = RxStopped;
+			return -EIO;
+		}
+	}
+
+	return 0;
+}
+
+
+/* called always under dev->txLock, queues tty data until all write urbs are in flight */
+static void _pl2303_txKick(pl2303_dev_t *dev)
+{
+	const uint8_t *data;
+	size_t len;
+	int urb;
+
+	while ((dev->txInflight < PL2303_N_TX_URBS) && !dev->txDisconnected) {
+		len = libtty_tx_span(&dev->tty, &data);
+		if (len == 0) {
+			break;
+		}
+		len = min(len, PL2303_BULK_SZ * 4);
+
+		/* Data is taken by the urb, so the span is consumed right away */
+		urb = usb_urbAlloc(dev->drv, dev->pipeBulkOUT, (void *)data, usb_dir_out, len, usb_transfer_bulk);
+		if (urb < 0) {
+			break;
+		}
+
+		if (usb_transferAsync(dev->drv, dev->pipeBulkOUT, urb, len, NULL) < 0) {
+			usb_urbFree(dev->drv, dev->pipeBulkOUT, urb);
+			break;
+		}
+
+		dev->txInflight++;
+		libtty_tx_consume(&dev->tty, len, NULL);
+	}
+}
+
+
+static void pl2303_signalTxReady(void *arg)
+{
+	pl2303_dev_t *dev = (pl2303_dev_t *)arg;
+
+	mutexLock(dev->txLock);
+	_pl2303_txKick(dev);
+	mutexUnlock(dev->txLock);
+}
+
+
+static pl2303_dev_t *pl2303_getByPipe(int pipe)
+{
+	pl2303_dev_t *tmp, *dev = NULL;
+
+	mutexLock(pl2303_common.lock);
+	tmp = pl2303_common.devices;
+	if (tmp != NULL) {
+		do {
+			if (tmp->pipeBulkIN == pipe || tmp->pipeBulkOUT == pipe || tmp->pipeIntIN == pipe) {
+				dev = tmp;
+				dev->rfcnt++;
+				break;
+			}
+			tmp = tmp->next;
+		} while (tmp != pl2303_common.devices);
+	}
+	mutexUnlock(pl2303_common.lock);
+
+	return dev;
+}
+
+
+static pl2303_dev_t *pl2303_get(int id)
+{
+	pl2303_dev_t *tmp, *dev = NULL;
+
+	mutexLock(pl2303_common.lock);
+	tmp = pl2303_common.devices;
+	if (tmp != NULL) {
+		do {
+			if (tmp->fileId == id) {
+				dev = tmp;
+				dev->rfcnt++;
+				break;
+			}
+			tmp = tmp->next;
+		} while (tmp != pl2303_common.devices);
+	}
+	mutexUnlock(pl2303_common.lock);
+
+	return dev;
+}
+
+
+static void pl2303_free(pl2303_dev_t *dev)
+{
+	fprintf(stdout, "pl2303: Device removed: %s\n", dev->path);
+	remove(dev->path);
+
+	libtty_destroy(&dev->tty);
+	resourceDestroy(dev->txLock);
+	resourceDestroy(dev->rxLock);
+	free(dev);
+}
+
+
+static void pl2303_freeAll(pl2303_dev_t **devices)
+{
+	pl2303_dev_t *next, *dev = *devices;
+
+	if (dev != NULL) {
+		do {
+			next = dev->next;
+			pl2303_free(dev);
+			dev = next;
+		} while (dev != *devices);
+	}
+
+	*devices = NULL;
+}
+
+
+static int _pl2303_put(pl2303_dev_t *dev)
+{
+	if (--dev->rfcnt == 0) {
+		LIST_REMOVE(&pl2303_common.devices, dev);
+	}
+	return dev->rfcnt;
+}
+
+
+static void pl2303_put(pl2303_dev_t *dev)
+{
+	int rfcnt;
+
+	mutexLock(pl2303_common.lock);
+	rfcnt = _pl2303_put(dev);
+	mutexUnlock(pl2303_common.lock);
+
+	if (rfcnt == 0) {
+		pl2303_free(dev);
+	}
+}
+
+
+static int pl2303_handleCompletion(usb_driver_t *drv, usb_completion_t *c, const char *data, size_t len)
+{
+	pl2303_dev_t *dev;
+
+	dev = pl2303_getByPipe(c->pipeid);
+	if (dev == NULL) {
+		return -1;
+	}
+	TRACE("handleCompletion: c->err=%d, len=%u", c->err, len);
+
+	if (c->pipeid == dev->pipeBulkOUT) {
+		/* Write urbs are allocated per transfer */
+		usb_urbFree(drv, dev->pipeBulkOUT, c->urbid);
+
+		mutexLock(dev->txLock);
+		dev->txInflight--;
+		if (c->err == 0) {
+			_pl2303_txKick(dev);
+		}
+		mutexUnlock(dev->txLock);
+
+		pl2303_put(dev);
+		return (c->err != 0) ? -1 : 0;
+	}
+
+	if (c->pipeid != dev->pipeBulkIN) {
+		pl2303_put(dev);
+		return -1;
+	}
+
+	mutexLock(dev->rxLock);
+	if (dev->rxInflight > 0) {
+		dev->rxInflight--;
+	}
+
+	if (c->err != 0) {
+		if (dev->rxState == RxRunning) {
+			dev->rxState = RxStopped;
+		}
+	}
+	else if (dev->rxState == RxRunning) {
+		/* Fits, as space was reserved on submission */
+		libtty_putchars(&dev->tty, (const unsigned char *)data, len, NULL);
+		if (_pl2303_rxSubmit(dev, c->urbid) < 0) {
+			dev->rxState = RxStopped;
+		}
+	}
+	mutexUnlock(dev->rxLock);
+
+	pl2303_put(dev);
+
+	return (c->err != 0) ? -1 : 0;
+}
+
+
+static int _pl2303_open(pl2303_dev_t *dev)
+{
+	TRACE("open: nopen=%d", dev->nopen);
+
+	/* Assert DTR and RTS on first open */
+	if ((dev->nopen == 0) && (pl2303_setControlLines(dev, PL2303_CONTROL_DTR | PL2303_CONTROL_RTS) < 0)) {
+		return -EIO;
+	}
+	dev->nopen++;
+
+	return EOK;
+}
+
+
+static void _pl2303_close(pl2303_dev_t *dev)
+{
+	TRACE("close: nopen=%d", dev->nopen);
+
+	if (dev->nopen == 0) {
+		return;
+	}
+
+	if ((--dev->nopen == 0) && (dev->tty.term.c_cflag & HUPCL)) {
+		pl2303_setControlLines(dev, 0);
+	}
+}
+
+
+static void pl2303_msgthr(void *arg)
+{
+	pl2303_dev_t *dev;
+	msg_rid_t rid;
+	unsigned long req;
+	const void *inData, *outData;
+	msg_t msg;
+	int err;
+
+	for (;;) {
+		if (msgRecv(pl2303_common.msgport, &msg, &rid) < 0) {
+			fprintf(stderr, "pl2303: msgRecv returned with err\n");
+			break;
+		}
+
+		/* Ignore this msg, as it might have been sent by us after deletion event */
+		if (msg.type == mtUnlink) {
+			msg.o.err = EOK;
+			msgRespond(pl2303_common.msgport, &msg, rid);
+			continue;
+		}
+
+		if ((dev = pl2303_get(msg.oid.id)) == NULL) {
+			msg.o.err = -ENOENT;
+			msgRespond(pl2303_common.msgport, &msg, rid);
+			continue;
+		}
+
+		switch (msg.type) {
+			case mtOpen:
+				mutexLock(pl2303_common.lock);
+				msg.o.err = _pl2303_open(dev);
+				mutexUnlock(pl2303_common.lock);
+				break;
+
+			case mtClose:
+				mutexLock(pl2303_common.lock);
+				_pl2303_close(dev);
+				mutexUnlock(pl2303_common.lock);
+				msg.o.err = EOK;
+				break;
+
+			case mtRead:
+				msg.o.err = libtty_read(&dev->tty, msg.o.data, msg.o.size, msg.i.io.mode);
+
+				/* Space was freed, continue receiving */
+				mutexLock(dev->rxLock);
+				_pl2303_rxResume(dev);
+				mutexUnlock(dev->rxLock);
+				break;
+
+			case mtWrite:
+				msg.o.err = libtty_write(&dev->tty, msg.i.data, msg.i.size, msg.i.io.mode);
+				break;
+
+			case mtGetAttr:
+				if (msg.i.attr.type == atPollStatus) {
+					msg.o.attr.val = libtty_poll_status(&dev->tty);
+					msg.o.err = EOK;
+				}
+				else {
+					msg.o.err = -EINVAL;
+				}
+				break;
+
+			case mtDevCtl:
+				outData = NULL;
+				inData = ioctl_unpack(&msg, &req, NULL);
+				err = libtty_ioctl(&dev->tty, ioctl_getSenderPid(&msg), req, inData, &outData);
+				ioctl_setResponse(&msg, req, err, outData);
+				break;
+
+			default:
+				msg.o.err = -ENOSYS;
+				break;
+		}
+		pl2303_put(dev);
+		msgRespond(pl2303_common.msgport, &msg, rid);
+	}
+
+	endthread();
+}
+
+
+static pl2303_dev_t *pl2303_devAlloc(void)
+{
+	pl2303_dev_t *dev;
+
+	if ((dev = calloc(1, sizeof(pl2303_dev_t))) == NULL) {
+		fprintf(stderr, "pl2303: Not enough memory\n");
+		return NULL;
+	}
+
+	mutexLock(pl2303_common.lock);
+	/* Get next device number */
+	if (pl2303_common.devices == NULL)
+		dev->id = 0;
+	else
+		dev->id = pl2303_common.devices->prev->id + 1;
+
+	dev->fileId = pl2303_common.lastId++;
+	dev->rfcnt = 1;
+
+	/* add this device prematurely to devices list, to mitigate race condition on
+	 * multiple concurrent insertions */
+	LIST_ADD(&pl2303_common.devices, dev);
+	mutexUnlock(pl2303_common.lock);
+
+	snprintf(dev->path, sizeof(dev->path), "/dev/ttyUSB%u", dev->id);
+
+	return dev;
+}
+
+
+static int _pl2303_urbsAlloc(pl2303_dev_t *dev)
+{
+	int i, j;
+
+	for (i = 0; i < PL2303_N_URBS; i++) {
+		dev->urbs[i] = usb_urbAlloc(dev->drv, dev->pipeBulkIN, NULL, usb_dir_in, PL2303_BULK_SZ, usb_transfer_bulk);
+		if (dev->urbs[i] < 0) {
+			for (j = i - 1; j >= 0; j--) {
+				usb_urbFree(dev->drv, dev->pipeBulkIN, dev->urbs[j]);
+				dev->urbs[j] = 0;
+			}
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+
+static int pl2303_handleInsertion(usb_driver_t *drv, usb_devinfo_t *insertion)
+{
+	libtty_callbacks_t callbacks;
+	pl2303_dev_t *dev;
+	oid_t oid;
+	int err, i;
+
+	TRACE("handleInsertion");
+
+	if ((dev = pl2303_devAlloc()) == NULL)
+		return -ENOMEM;
+
+	dev->instance = *insertion;
+	dev->drv = drv;
+
+	/* Same detection as the vendor driver: HX has 64-byte control endpoint and isn't a CDC device */
+	dev->hx = (insertion->descriptor.bDeviceClass != 0x02) && (insertion->descriptor.bMaxPacketSize0 == 0x40);
+
+	callbacks.arg = dev;
+	callbacks.set_baudrate = pl2303_setBaudrate;
+	callbacks.set_cflag = pl2303_setCFlag;
+	callbacks.signal_txready = pl2303_signalTxReady;
+	callbacks.tx_done = NULL;
+
+	do {
+		dev->pipeCtrl = usb_open(drv, insertion, usb_transfer_control, 0);
+		if (dev->pipeCtrl < 0) {
+			fprintf(stderr, "pl2303: Fail to open control pipe\n");
+			err = -EINVAL;
+			break;
+		}
+
+		err = usb_setConfiguration(drv, dev->pipeCtrl, 1);
+		if (err != 0) {
+			fprintf(stderr, "pl2303: Fail to set configuration\n");
+			err = -EINVAL;
+			break;
+		}
+
+		dev->pipeBulkIN = usb_open(drv, insertion, usb_transfer_bulk, usb_dir_in);
+		if (dev->pipeBulkIN < 0) {
+			err = -EINVAL;
+			break;
+		}
+
+		dev->pipeBulkOUT = usb_open(drv, insertion, usb_transfer_bulk, usb_dir_out);
+		if (dev->pipeBulkOUT < 0) {
+			err = -EINVAL;
+			break;
+		}
+
+		/* Interrupt pipe (modem status) is not used */
+		dev->pipeIntIN = usb_open(drv, insertion, usb_transfer_interrupt, usb_dir_in);
+
+		if (pl2303_startup(dev) < 0) {
+			fprintf(stderr, "pl2303: Fail to initialize the chip\n");
+			err = -EIO;
+			break;
+		}
+
+		err = mutexCreate(&dev->rxLock);
+		if (err != 0) {
+			err = -ENOMEM;
+			break;
+		}
+
+		err = mutexCreate(&dev->txLock);
+		if (err != 0) {
+			resourceDestroy(dev->rxLock);
+			err = -ENOMEM;
+			break;
+		}
+
+		if (libtty_init(&dev->tty, &callbacks, PL2303_BUFSZ, B115200) < 0) {
+			resourceDestroy(dev->txLock);
+			resourceDestroy(dev->rxLock);
+			err = -ENOMEM;
+			break;
+		}
+
+		/* 115200 8N1 */
+		pl2303_setBaudrate(dev, B115200);
+		pl2303_setCFlag(dev, &dev->tty.term.c_cflag);
+
+		if (_pl2303_urbsAlloc(dev) < 0) {
+			libtty_destroy(&dev->tty);
+			resourceDestroy(dev->txLock);
+			resourceDestroy(dev->rxLock);
+			err = -ENOMEM;
+			break;
+		}
+
+		/* Receiving runs until the device is removed, data is kept in tty like from an UART */
+		mutexLock(dev->rxLock);
+		err = _pl2303_rxStart(dev);
+		mutexUnlock(dev->rxLock);
+		if (err < 0) {
+			for (i = 0; i < PL2303_N_URBS; i++) {
+				usb_urbFree(dev->drv, dev->pipeBulkIN, dev->urbs[i]);
+			}
+			libtty_destroy(&dev->tty);
+			resourceDestroy(dev->txLock);
+			resourceDestroy(dev->rxLock);
+			break;
+		}
+
+		oid.port = pl2303_common.msgport;
+		oid.id = dev->fileId;
+
+		err = create_dev(&oid, dev->path);
+		if (err != 0) {
+			mutexLock(dev->rxLock);
+			dev->rxState = RxStopped;
+			mutexUnlock(dev->rxLock);
+			for (i = 0; i < PL2303_N_URBS; i++) {
+				usb_urbFree(dev->drv, dev->pipeBulkIN, dev->urbs[i]);
+			}
+			libtty_destroy(&dev->tty);
+			resourceDestroy(dev->txLock);
+			resourceDestroy(dev->rxLock);
+			fprintf(stderr, "pl2303: Can't create dev: %s\n", dev->path);
+			err = -EINVAL;
+		}
+	} while (0);
+
+	if (err < 0) {
+		mutexLock(pl2303_common.lock);
+		/* remove the device from list, as it has been added there in devAlloc */
+		LIST_REMOVE(&pl2303_common.devices, dev);
+		mutexUnlock(pl2303_common.lock);
+		free(dev);
+		return err;
+	}
+
+	fprintf(stdout, "pl2303: New device: %s%s\n", dev->path, dev->hx ? " (HX)" : "");
+
+	return 0;
+}
+
+
+static int pl2303_handleDeletion(usb_driver_t *drv, usb_deletion_t *del)
+{
+	pl2303_dev_t *next, *dev = pl2303_common.devices;
+	int cont = 1;
+
+	if (dev == NULL)
+		return 0;
+
+	TRACE("handleDeletion");
+
+	mutexLock(pl2303_common.lock);
+
+	do {
+		next = dev->next;
+		if (dev->instance.bus == del->bus && dev->instance.dev == del->dev &&
+				dev->instance.interface == del->interface) {
+			if (dev == next)
+				cont = 0;
+
+			/* reject new transfers, wake up blocked readers and writers */
+			mutexLock(dev->rxLock);
+			dev->rxState = RxDisconnected;
+			mutexUnlock(dev->rxLock);
+
+			mutexLock(dev->txLock);
+			dev->txDisconnected = 1;
+			mutexUnlock(dev->txLock);
+
+			libtty_close(&dev->tty);
+
+			if (_pl2303_put(dev) == 0) {
+				LIST_ADD(&pl2303_common.devicesToFree, dev);
+			}
+			if (!cont)
+				break;
+		}
+		dev = next;
+	} while (dev != pl2303_common.devices);
+
+	pl2303_freeAll(&pl2303_common.devicesToFree);
+
+	mutexUnlock(pl2303_common.lock);
+
+	return 0;
+}
+
+
+static int pl2303_init(usb_driver_t *drv, void *args)
+{
+	int ret;
+	int i;
+
+	pl2303_common.devicesToFree = NULL;
+
+	/* Port for communication with driver clients */
+	if (portCreate(&pl2303_common.msgport) != 0) {
+		fprintf(stderr, "pl2303: Can't create port!\n");
+		return 1;
+	}
+
+	if (mutexCreate(&pl2303_common.lock)) {
+		fprintf(stderr, "pl2303: Can't create mutex!\n");
+		return 1;
+	}
+
+	pl2303_common.lastId = 1;
+
+	for (i = 0; i < PL2303_N_MSG_THREADS; i++) {
+		ret = beginthread(pl2303_msgthr, PL2303_MSG_PRIO, pl2303_common.msgstack[i], sizeof(pl2303_common.msgstack[i]), NULL);
+		if (ret < 0) {
+			fprintf(stderr, "pl2303: fail to beginthread ret: %d\n", ret);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+
+static int pl2303_destroy(usb_driver_t *drv)
+{
+	/* TODO */
+	return EOK;
+}
+
+
+static usb_driver_t pl2303_driver = {
+	.name = "pl2303",
+	.handlers = {
+		.insertion = pl2303_handleInsertion,
+		.deletion = pl2303_handleDeletion,
+		.completion = pl2303_handleCompletion,
+	},
+	.ops = {
+		.init = pl2303_init,
+		.destroy = pl2303_destroy,
+	},
+	.filters = filters,
+	.nfilters = sizeof(filters) / sizeof(filters[0]),
+	.priv = (void *)&pl2303_common,
+};
+
+
+__attribute__((constructor)) static void pl2303_register(void)
+{
+	usb_driverRegister(&pl2303_driver);
+}
@@ -0,0 +1,33 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Prolific PL2303 USB-serial driver
+ *
+ * Device driver server
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * %LICENSE%
+ */
+
+
+#include <usbdriver.h>
+#include <usbprocdriver.h>
+
+
+int main(int argc, char *argv[])
+{
+	int ret;
+	usb_driver_t *driver = usb_registeredDriverPop();
+	if (driver == NULL) {
+		fprintf(stderr, "pl2303: no driver registered!");
+		return 1;
+	}
+
+	ret = usb_driverProcRun(driver, NULL);
+	if (ret < 0) {
+		fprintf(stderr, "pl2303: failed to start server: %d\n", ret);
+	}
+
+	return ret == 0 ? 0 : 1;
+}
@@ -19,6 +19,7 @@
 #include <posix/utils.h>
 #include <sys/file.h>
 #include <sys/io.h>
+#include <sys/minmax.h>
 #include <sys/msg.h>
 #include <sys/threads.h>
 #include <sys/types.h>
@@ -28,6 +29,15 @@
 
 #define KMSG_CTRL_ID 100
 
+/* HTIF console input polling period (us), shortened after input and backed off when idle */
+#ifndef SPIKETTY_POLL_MIN
+#define SPIKETTY_POLL_MIN 1000
+#endif
+
+#ifndef SPIKETTY_POLL_MAX
+#define SPIKETTY_POLL_MAX 50000
+#endif
+
 
 typedef struct {
 	int active;
@@ -74,9 +84,16 @@ static void set_cflag(void *arg, tcflag_t *cflag)
 static void signal_txready(void *arg)
 {
 	spiketty_t *spiketty = (spiketty_t *)arg;
-
-	while (libtty_txready(&spiketty->tty))
-		sbi_putchar(libtty_popchar(&spiketty->tty));
+	const uint8_t *data;
+	size_t len, i;
+	int wake;
+
+	/* Output straight from libtty buffer, writer is woken up once */
+	while ((len = libtty_tx_span(&spiketty->tty, &data)) != 0) {
+		for (i = 0; i < len; i++)
+			sbi_putchar(data[i]);
+		libtty_tx_consume(&spiketty->tty, len, &wake);
+	}
 
 	libtty_wake_writer(&spiketty->tty);
 }
@@ -175,12 +192,27 @@ static void poolthr(void *arg)
 static void spiketty_thr(void *arg)
 {
 	spiketty_t *spiketty = (spiketty_t *)arg;
+	useconds_t delay = SPIKETTY_POLL_MAX;
+	unsigned char buf[32];
+	size_t n;
 	int c;
 
 	for (;;) {
-		if ((c = sbi_getchar()) > 0)
-			libtty_putchar(&spiketty->tty, c, NULL);
-		usleep(50000);
+		/* Collect all pending input and push it at once */
+		for (n = 0; (n < sizeof(buf)) && ((c = sbi_getchar()) > 0); n++)
+			buf[n] = c;
+
+		if (n != 0) {
+			libtty_putchars(&spiketty->tty, buf, n, NULL);
+			delay = SPIKETTY_POLL_MIN;
+			if (n == sizeof(buf))
+				continue;
+		}
+		else {
+			delay = min(2 * delay, SPIKETTY_POLL_MAX);
+		}
+
+		usleep(delay);
 	}
 }
 
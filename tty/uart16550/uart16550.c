@@ -41,6 +41,9 @@ typedef struct {
 
 	unsigned int init;
 	unsigned int clk;
+	unsigned int fifosz; /* FIFO depth */
+	unsigned int txload; /* Bytes written per THRE interrupt */
+	uint8_t fcr;
 
 	handle_t mutex;
 	handle_t intcond;
@@ -53,6 +56,14 @@ typedef struct {
 } uart_t;
 
 
+/* write sent directly from the message buffer, responded when done */
+typedef struct {
+	libtty_txseg_t seg;
+	msg_t msg;
+	msg_rid_t rid;
+} uart_txreq_t;
+
+
 static struct {
 	uart_t uarts[4];
 	char stack[1024] __attribute__((aligned(8)));
@@ -147,6 +158,9 @@ uart_interrupt(unsigned int n, void *arg)
 static void uart_intthr(void *arg)
 {
 	uart_t *uart = (uart_t *)arg;
+	uint8_t buf[128];
+	const uint8_t *data;
+	size_t n, len;
 	uint8_t iir;
 
 	mutexLock(uart->mutex);
@@ -157,15 +171,29 @@ static void uart_intthr(void *arg)
 
 		/* Receive */
 		if (iir & IIR_DR) {
-			while (uarthw_read(uart->hwctx, REG_LSR) & 0x1) {
-				libtty_putchar(&uart->tty, uarthw_read(uart->hwctx, REG_RBR), NULL);
+			while ((n = uarthw_readRx(uart->hwctx, buf, sizeof(buf))) != 0) {
+				libtty_putchars(&uart->tty, buf, n, NULL);
+				if (n < sizeof(buf)) {
+					break;
+				}
 			}
 		}
 
-		/* Transmit */
+		/* Transmit, THRE means TX FIFO is empty so it can be refilled up to its depth */
 		if (iir & IIR_THRE) {
 			if (libtty_txready(&uart->tty)) {
-				uarthw_write(uart->hwctx, REG_THR, libtty_getchar(&uart->tty, NULL));
+				for (n = uart->txload; n != 0; n -= len) {
+					len = libtty_tx_span(&uart->tty, &data);
+					if (len == 0) {
+						break;
+					}
+					if (len > n) {
+						len = n;
+					}
+
+					uarthw_writeTx(uart->hwctx, data, len);
+					libtty_tx_consume(&uart->tty, len, NULL);
+				}
 			}
 			else {
 				uarthw_write(uart->hwctx, REG_IMR, IMR_DR);
@@ -175,6 +203,47 @@ static void uart_intthr(void *arg)
 }
 
 
+static void tx_done(void *arg, libtty_txseg_t *seg, ssize_t ret)
+{
+	uart_t *uart = (uart_t *)arg;
+	uart_txreq_t *req = (uart_txreq_t *)seg;
+
+	req->msg.o.err = ret;
+	msgRespond(uart->oid.port, &req->msg, req->rid);
+	free(req);
+}
+
+
+/* returns 1 if the response is deferred until the data is sent */
+static int uart_write(uart_t *uart, msg_t *msg, msg_rid_t rid)
+{
+	uart_txreq_t *req = malloc(sizeof(*req));
+	int err;
+
+	if (req != NULL) {
+		req->seg.data = msg->i.data;
+		req->seg.len = msg->i.size;
+		req->msg = *msg;
+		req->rid = rid;
+
+		err = libtty_write_segment(&uart->tty, &req->seg, msg->i.io.mode);
+		if (err > 0) {
+			return 1;
+		}
+
+		free(req);
+		if (err < 0) {
+			msg->o.err = err;
+			return 0;
+		}
+	}
+
+	msg->o.err = libtty_write(&uart->tty, msg->i.data, msg->i.size, msg->i.io.mode);
+
+	return 0;
+}
+
+
 static void uart_ioctl(unsigned int port, msg_t *msg)
 {
 	const void *idata, *odata = NULL;
@@ -249,8 +318,8 @@ static void poolthr(void *arg)
 				if (uart == NULL) {
 					msg.o.err = -EINVAL;
 				}
-				else {
-					msg.o.err = libtty_write(&uart->tty, msg.i.data, msg.i.size, msg.i.io.mode);
+				else if (uart_write(uart, &msg, rid) != 0) {
+					continue;
 				}
 				break;
 
@@ -278,9 +347,9 @@ static void poolthr(void *arg)
 }
 
 
-static void uart_klogClbk(const char *data, size_t size)
+static ssize_t uart_klogClbk(const char *data, size_t size)
 {
-	libtty_write(&uart_common.uarts[UART16550_CONSOLE_USER].tty, data, size, 0);
+	return libtty_write(&uart_common.uarts[UART16550_CONSOLE_USER].tty, data, size, O_NONBLOCK);
 }
 
 
@@ -302,7 +371,7 @@ static void _uart_mkDev(uint32_t port, int isconsole)
 
 			if (i == UART16550_CONSOLE_USER) {
 				if (isconsole != 0) {
-					libklog_init(uart_klogClbk);
+					libklog_initNb(uart_klogClbk);
 					if (create_dev(&uart_common.uarts[i].oid, _PATH_CONSOLE) < 0) {
 						fprintf(stderr, "uart16550: failed to register %s\n", _PATH_CONSOLE);
 						return;
@@ -312,7 +381,7 @@ static void _uart_mkDev(uint32_t port, int isconsole)
 					libklog_ctrlRegister(&kmsgctrl);
 				}
 				else {
-					libklog_initNoDev(uart_klogClbk);
+					libklog_initNbNoDev(uart_klogClbk);
 				}
 			}
 		}
@@ -320,6 +389,76 @@ static void _uart_mkDev(uint32_t port, int isconsole)
 }
 
 
+static uint8_t uart_icrRead(uart_t *uart, uint8_t idx)
+{
+	uint8_t val;
+
+	uarthw_write(uart->hwctx, REG_SPR, ICR_ACR);
+	uarthw_write(uart->hwctx, REG_ICR, ACR_ICRRD);
+	uarthw_write(uart->hwctx, REG_SPR, idx);
+	val = uarthw_read(uart->hwctx, REG_ICR);
+	uarthw_write(uart->hwctx, REG_SPR, ICR_ACR);
+	uarthw_write(uart->hwctx, REG_ICR, 0);
+
+	return val;
+}
+
+
+/* Detects FIFO depth and enables FIFOs, called with LCR = LCR_D8N1 */
+static void uart_initFifo(uart_t *uart)
+{
+	uint8_t iir, efr;
+
+	uarthw_write(uart->hwctx, REG_FCR, FCR_ENABLE);
+	if ((uarthw_read(uart->hwctx, REG_IIR) & IIR_FIFOEN) != IIR_FIFOEN) {
+		/* 8250/16450 or 16550 with broken FIFO */
+		uarthw_write(uart->hwctx, REG_FCR, 0);
+		uart->fifosz = 1;
+		uart->txload = 1;
+		uart->fcr = 0;
+		return;
+	}
+
+	uart->fifosz = 16;
+	uart->txload = 16;
+	uart->fcr = FCR_ENABLE | FCR_TRIG_10; /* RX trigger at 8 bytes */
+
+	/* EFR is accessible with LCR_CONF_B and reads 0 after reset, 16550 returns IIR there */
+	uarthw_write(uart->hwctx, REG_LCR, LCR_CONF_B);
+	efr = uarthw_read(uart->hwctx, REG_EFR);
+	if (efr == 0) {
+		/* 16C950 - 128 byte FIFOs in enhanced mode */
+		uarthw_write(uart->hwctx, REG_EFR, EFR_ECB);
+		uarthw_write(uart->hwctx, REG_LCR, LCR_D8N1);
+
+		if ((uart_icrRead(uart, ICR_ID1) == 0x16) && (uart_icrRead(uart, ICR_ID2) == 0xc9) && (uart_icrRead(uart, ICR_ID3) == 0x50)) {
+			uart->fifosz = 128;
+			uart->txload = 128 - 16; /* THRE fires at TX trigger level (16) in enhanced mode */
+			uart->fcr = FCR_ENABLE | FCR_TRIG_01; /* RX trigger at 32 bytes */
+			return;
+		}
+
+		uarthw_write(uart->hwctx, REG_LCR, LCR_CONF_B);
+		uarthw_write(uart->hwctx, REG_EFR, 0);
+	}
+
+	/* 16750 - 64 byte FIFOs can be enabled only with DLAB set */
+	uarthw_write(uart->hwctx, REG_LCR, LCR_DLAB);
+	uarthw_write(uart->hwctx, REG_FCR, FCR_ENABLE | FCR_FIFO64);
+	iir = uarthw_read(uart->hwctx, REG_IIR);
+	uarthw_write(uart->hwctx, REG_LCR, LCR_D8N1);
+
+	if ((iir & (IIR_FIFO64 | IIR_FIFOEN)) == (IIR_FIFO64 | IIR_FIFOEN)) {
+		uart->fifosz = 64;
+		uart->txload = 64;
+		uart->fcr |= FCR_FIFO64; /* RX trigger at 32 bytes */
+	}
+	else {
+		uarthw_write(uart->hwctx, REG_FCR, FCR_ENABLE);
+	}
+}
+
+
 static int _uart_init(uart_t *uart, unsigned int uartn, unsigned int speed)
 {
 	unsigned int divisor;
@@ -336,6 +475,7 @@ static int _uart_init(uart_t *uart, unsigned int uartn, unsigned int speed)
 	callbacks.set_baudrate = set_baudrate;
 	callbacks.set_cflag = set_cflag;
 	callbacks.signal_txready = signal_txready;
+	callbacks.tx_done = tx_done;
 
 	err = libtty_init(&uart->tty, &callbacks, _PAGE_SIZE, libtty_int_to_baudrate(speed));
 	if (err < 0) {
@@ -357,7 +497,16 @@ static int _uart_init(uart_t *uart, unsigned int uartn, unsigned int speed)
 	uarthw_write(uart->hwctx, REG_LCR, LCR_D8N1);
 
 	/* Enable and configure FIFOs */
-	uarthw_write(uart->hwctx, REG_FCR, 0xa7);
+	uart_initFifo(uart);
+	if (uart->fcr & FCR_FIFO64) {
+		/* 16750 FCR_FIFO64 is writable only with DLAB set */
+		uarthw_write(uart->hwctx, REG_LCR, LCR_D8N1 | LCR_DLAB);
+		uarthw_write(uart->hwctx, REG_FCR, uart->fcr | FCR_CLRRX | FCR_CLRTX);
+		uarthw_write(uart->hwctx, REG_LCR, LCR_D8N1);
+	}
+	else {
+		uarthw_write(uart->hwctx, REG_FCR, uart->fcr | FCR_CLRRX | FCR_CLRTX);
+	}
 
 	/* Enable hardware interrupts */
 	uarthw_write(uart->hwctx, REG_MCR, MCR_OUT2);
@@ -32,6 +32,15 @@
 #define REG_LSB 0
 #define REG_MSB 1
 #define REG_FCR 2
+#define REG_EFR 2 /* LCR = LCR_CONF_B */
+#define REG_SPR 7
+#define REG_ICR 5 /* indexed by SPR */
+
+/* 16C950 indexed control registers */
+#define ICR_ACR 0x00
+#define ICR_ID1 0x08
+#define ICR_ID2 0x09
+#define ICR_ID3 0x0a
 
 
 /* Register bits */
@@ -41,10 +50,24 @@
 #define IIR_IRQPEND 0x01
 #define IIR_THRE    0x02
 #define IIR_DR      0x04
+#define IIR_FIFO64  0x20
+#define IIR_FIFOEN  0xc0
 
 #define LCR_DLAB 0x80
 #define LCR_D8N1 0x03
 #define LCR_D8N2 0x07
+#define LCR_CONF_B 0xbf
+
+#define FCR_ENABLE  0x01
+#define FCR_CLRRX   0x02
+#define FCR_CLRTX   0x04
+#define FCR_FIFO64  0x20
+#define FCR_TRIG_01 0x40
+#define FCR_TRIG_10 0x80
+
+#define EFR_ECB 0x10
+
+#define ACR_ICRRD 0x40
 
 #define MCR_OUT2 0x08
 
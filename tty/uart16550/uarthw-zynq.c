@@ -75,6 +75,30 @@ void uarthw_write(void *hwctx, unsigned int reg, uint8_t val)
 }
 
 
+size_t uarthw_readRx(void *hwctx, uint8_t *buf, size_t sz)
+{
+	volatile uint32_t *base = ((uarthw_ctx_t *)hwctx)->base;
+	size_t n;
+
+	for (n = 0; (n < sz) && ((base[REG_LSR] & LSR_DR) != 0); n++) {
+		buf[n] = (uint8_t)base[REG_RBR];
+	}
+
+	return n;
+}
+
+
+void uarthw_writeTx(void *hwctx, const uint8_t *buf, size_t n)
+{
+	volatile uint32_t *base = ((uarthw_ctx_t *)hwctx)->base;
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		base[REG_THR] = buf[i];
+	}
+}
+
+
 char *uarthw_dump(void *hwctx, char *s, size_t sz)
 {
 	snprintf(s, sz, "base=0x%p irq=%u", (volatile void *)(((uarthw_ctx_t *)hwctx)->base), ((uarthw_ctx_t *)hwctx)->irq);
@@ -25,6 +25,14 @@ extern uint8_t uarthw_read(void *hwctx, unsigned int reg);
 extern void uarthw_write(void *hwctx, unsigned int reg, uint8_t val);
 
 
+/* Reads up to sz bytes from RX FIFO while data is ready, returns number of bytes read */
+extern size_t uarthw_readRx(void *hwctx, uint8_t *buf, size_t sz);
+
+
+/* Writes n bytes to TX FIFO, caller makes sure they fit */
+extern void uarthw_writeTx(void *hwctx, const uint8_t *buf, size_t n);
+
+
 extern char *uarthw_dump(void *hwctx, char *s, size_t sz);
 
 
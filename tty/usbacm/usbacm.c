@@ -36,12 +36,18 @@
 #define USBACM_N_MSG_THREADS 2
 #endif
 
+/* RX ring size, power of 2 */
 #ifndef RX_FIFO_SIZE
-#define RX_FIFO_SIZE 8192
+#define RX_FIFO_SIZE 16384
 #endif
 
 #ifndef USBACM_N_URBS
-#define USBACM_N_URBS 2
+#define USBACM_N_URBS 4
+#endif
+
+/* Max outstanding bulk OUT transfers */
+#ifndef USBACM_N_TX_URBS
+#define USBACM_N_TX_URBS 4
 #endif
 
 #ifndef USBACM_MSG_PRIO
@@ -54,6 +60,13 @@
 
 #define USBACM_BULK_SZ 2048
 
+/* Writes of multiple of this size are terminated with ZLP, full-speed bulk max packet size divides the high-speed one */
+#define USBACM_ZLP_ALIGN 64
+
+#if (RX_FIFO_SIZE & (RX_FIFO_SIZE - 1)) != 0 || RX_FIFO_SIZE <= USBACM_N_URBS * USBACM_BULK_SZ
+#error "RX_FIFO_SIZE must be a power of 2 larger than USBACM_N_URBS * USBACM_BULK_SZ"
+#endif
+
 /* clang-format off */
 #define TRACE(fmt, ...) if (0) printf("usbacm: " fmt "\n", ##__VA_ARGS__)
 
@@ -82,14 +95,22 @@ typedef struct _usbacm_dev {
 
 	volatile int rfcnt; /* protected by usbacm_common.lock */
 
-	/* blocking/nonblocking READ state - protected by rxLock */
-	char *rxptr;
-	size_t rxbuflen;
+	/* READ state - protected by rxLock */
 	fifo_t *fifo;
+	unsigned int rxInflight;      /* bulk IN urbs submitted */
+	unsigned int rxNparked;       /* completed urbs waiting for free space in fifo */
+	int rxParked[USBACM_N_URBS];
 	handle_t rxLock;
 	handle_t rxCond;
 	int rxState;
 
+	/* WRITE state - protected by txLock */
+	unsigned int txInflight; /* bulk OUT urbs submitted */
+	int txErr;               /* error of a transfer queued by previous write */
+	int txDisconnected;
+	handle_t txLock;
+	handle_t txCond;
+
 	usb_driver_t *drv;
 } usbacm_dev_t;
 
@@ -151,14 +172,34 @@ static int _usbacm_rxStop(usbacm_dev_t *dev)
 }
 
 
-static void usbacm_fifoPush(usbacm_dev_t *dev, const char *data, size_t size)
+/* called always under dev->rxLock */
+static int _usbacm_rxSubmit(usbacm_dev_t *dev, int urb)
 {
-	unsigned i;
+	/* Space for data of all urbs in flight is reserved in fifo, so no completion is dropped */
+	if ((dev->rxState != RxRunning) || (fifo_freespace(dev->fifo) < (dev->rxInflight + 1) * USBACM_BULK_SZ)) {
+		dev->rxParked[dev->rxNparked++] = urb;
+		return 0;
+	}
 
-	mutexLock(dev->rxLock);
-	for (i = 0; i < size; i++)
-		fifo_push(dev->fifo, data[i]);
-	mutexUnlock(dev->rxLock);
+	if (usb_transferAsync(dev->drv, dev->pipeBulkIN, urb, USBACM_BULK_SZ, NULL) < 0) {
+		dev->rxParked[dev->rxNparked++] = urb;
+		return -EIO;
+	}
+	dev->rxInflight++;
+
+	return 0;
+}
+
+
+/* called always under dev->rxLock */
+static void _usbacm_rxResume(usbacm_dev_t *dev)
+{
+	while ((dev->rxNparked > 0) && (dev->rxState == RxRunning) &&
+			(fifo_freespace(dev->fifo) >= (dev->rxInflight + 1) * USBACM_BULK_SZ)) {
+		if (_usbacm_rxSubmit(dev, dev->rxParked[--dev->rxNparked]) < 0) {
+			dev->rxState = RxStopped;
+		}
+	}
 }
 
 
@@ -212,6 +253,8 @@ static void usbacm_free(usbacm_dev_t *dev)
 	remove(dev->path);
 
 	free(dev->fifo);
+	resourceDestroy(dev->txCond);
+	resourceDestroy(dev->txLock);
 	resourceDestroy(dev->rxCond);
 	resourceDestroy(dev->rxLock);
 	free(dev);
@@ -260,25 +303,27 @@ static void usbacm_put(usbacm_dev_t *dev)
 static int usbacm_handleCompletion(usb_driver_t *drv, usb_completion_t *c, const char *data, size_t len)
 {
 	usbacm_dev_t *dev;
-	size_t bytes;
 
 	dev = usbacm_getByPipe(c->pipeid);
 	if (dev == NULL) {
 		return -1;
 	}
-	TRACE("handleCompletion: c->err=%d, len=%u, rxbuflen=%u", c->err, len, dev->rxbuflen);
+	TRACE("handleCompletion: c->err=%d, len=%u", c->err, len);
 
-	if (c->err != 0) {
-		/* Error, stop receiving */
-		mutexLock(dev->rxLock);
-		dev->rxState = RxStopped;
-		if ((dev->flags & O_NONBLOCK) == 0) {
-			/* Stop the blocking read in progress */
-			condSignal(dev->rxCond);
+	if (c->pipeid == dev->pipeBulkOUT) {
+		/* Write urbs are allocated per transfer */
+		usb_urbFree(drv, dev->pipeBulkOUT, c->urbid);
+
+		mutexLock(dev->txLock);
+		dev->txInflight--;
+		if (c->err != 0) {
+			dev->txErr = -EIO;
 		}
-		mutexUnlock(dev->rxLock);
+		condSignal(dev->txCond);
+		mutexUnlock(dev->txLock);
+
 		usbacm_put(dev);
-		return -1;
+		return (c->err != 0) ? -1 : 0;
 	}
 
 	if (c->pipeid != dev->pipeBulkIN) {
@@ -286,32 +331,30 @@ static int usbacm_handleCompletion(usb_driver_t *drv, usb_completion_t *c, const
 		return -1;
 	}
 
-	if (dev->flags & O_NONBLOCK) {
-		usbacm_fifoPush(dev, data, len);
-		/* assume rxState == RxRunning unless the device was ejected */
+	mutexLock(dev->rxLock);
+	if (dev->rxInflight > 0) {
+		dev->rxInflight--;
 	}
-	else if (dev->rxptr != NULL) {
-		mutexLock(dev->rxLock);
 
-		bytes = min(len, dev->rxbuflen);
-		memcpy(dev->rxptr, data, bytes);
-		dev->rxptr += bytes;
-		dev->rxbuflen -= bytes;
-
-		if (dev->rxbuflen == 0) {
+	if (c->err != 0) {
+		/* Error, stop receiving and the blocking read in progress */
+		if (dev->rxState == RxRunning) {
 			dev->rxState = RxStopped;
-			condSignal(dev->rxCond);
 		}
-		mutexUnlock(dev->rxLock);
 	}
-
-	if (dev->rxState == RxRunning) {
-		usb_transferAsync(drv, dev->pipeBulkIN, c->urbid, USBACM_BULK_SZ, NULL);
+	else if (dev->fifo != NULL) {
+		/* Fits, as space was reserved on submission */
+		fifo_write_bulk(dev->fifo, data, len);
+		if (_usbacm_rxSubmit(dev, c->urbid) < 0) {
+			dev->rxState = RxStopped;
+		}
 	}
+	condSignal(dev->rxCond);
+	mutexUnlock(dev->rxLock);
 
 	usbacm_put(dev);
 
-	return 0;
+	return (c->err != 0) ? -1 : 0;
 }
 
 
@@ -332,83 +375,120 @@ static int _usbacm_rxStart(usbacm_dev_t *dev)
 		return -EIO;
 	}
 
+	dev->rxState = RxRunning;
+	dev->rxInflight = 0;
+	dev->rxNparked = 0;
 	for (i = 0; i < USBACM_N_URBS; i++) {
-		ret = usb_transferAsync(dev->drv, dev->pipeBulkIN, dev->urbs[i], USBACM_BULK_SZ, NULL);
-		if (ret < 0) {
+		if (_usbacm_rxSubmit(dev, dev->urbs[i]) < 0) {
+			dev->rxState = RxStopped;
 			return -EIO;
 		}
 	}
 
-	dev->rxState = RxRunning;
 	return 0;
 }
 
 
 static int usbacm_read(usbacm_dev_t *dev, char *data, size_t len)
 {
+	size_t done = 0;
 	int ret;
 
-	if ((dev->flags & (O_RDONLY | O_RDWR)) == 0) {
+	if (((dev->flags & (O_RDONLY | O_RDWR)) == 0) || (dev->fifo == NULL)) {
 		return -EPERM;
 	}
 	TRACE("read: len=%u, flags=%u, rxState=%d", len, dev->flags, dev->rxState);
 
+	/* Receiving runs since open, read only drains the fifo */
 	mutexLock(dev->rxLock);
-	do {
-		if ((dev->flags & O_NONBLOCK) && (dev->rxState == RxRunning)) {
-			for (ret = 0; ret < len && !fifo_is_empty(dev->fifo); ret++) {
-				data[ret] = fifo_pop_back(dev->fifo);
-			}
+	for (;;) {
+		done += fifo_read_bulk(dev->fifo, data + done, len - done);
+		_usbacm_rxResume(dev);
+
+		/* Blocking read waits until len bytes is received or an error occurs */
+		if ((done == len) || (dev->flags & O_NONBLOCK) || (dev->rxState != RxRunning)) {
+			break;
 		}
-		else if ((dev->flags & O_NONBLOCK) == 0 && (dev->rxState == RxStopped)) {
-			dev->rxptr = data;
-			dev->rxbuflen = len;
+		condWait(dev->rxCond, dev->rxLock, 0);
+	}
 
-			ret = _usbacm_rxStart(dev);
-			if (ret != 0) {
-				TRACE("rxStart error: %d", ret);
-				break;
-			}
+	ret = ((done == 0) && (len > 0) && (dev->rxState != RxRunning)) ? -EIO : (int)done;
+	mutexUnlock(dev->rxLock);
 
-			/* Block until len bytes is received or an error occurs */
-			while ((dev->rxbuflen > 0) && (dev->rxState == RxRunning)) {
-				condWait(dev->rxCond, dev->rxLock, 0);
-			}
+	return ret;
+}
+
+
+static int usbacm_write(usbacm_dev_t *dev, const char *data, size_t len)
+{
+	size_t done = 0, chunk;
+	int urb, ret = 0, zlp;
+
+	TRACE("write: len=%u, flags=%u", len, dev->flags);
+
+	/* Transfers are queued in USBACM_BULK_SZ chunks, write returns without waiting for completion */
+	zlp = (len > 0) && ((len % USBACM_ZLP_ALIGN) == 0);
+
+	mutexLock(dev->txLock);
+	if (dev->txDisconnected) {
+		mutexUnlock(dev->txLock);
+		return -EIO;
+	}
+
+	if (dev->txErr < 0) {
+		ret = dev->txErr;
+		dev->txErr = 0;
+		mutexUnlock(dev->txLock);
+		fprintf(stderr, "usbacm: write failed\n");
+		return ret;
+	}
 
-			ret = _usbacm_rxStop(dev);
-			if (ret != 0) {
-				TRACE("rxStop error: %d", ret);
+	while ((done < len) || zlp) {
+		while ((dev->txInflight >= USBACM_N_TX_URBS) && !dev->txDisconnected) {
+			/* ZLP is always sent after the data queued */
+			if ((dev->flags & O_NONBLOCK) && (done < len)) {
 				break;
 			}
-
-			ret = len - dev->rxbuflen;
+			condWait(dev->txCond, dev->txLock, 0);
 		}
-		else {
+
+		if (dev->txDisconnected) {
 			ret = -EIO;
+			break;
 		}
-	} while (0);
 
-	dev->rxbuflen = 0;
-	dev->rxptr = NULL;
-	mutexUnlock(dev->rxLock);
+		if (dev->txInflight >= USBACM_N_TX_URBS) {
+			ret = -EWOULDBLOCK;
+			break;
+		}
 
-	return ret;
-}
+		chunk = min(len - done, USBACM_BULK_SZ);
+		if (chunk == 0) {
+			zlp = 0;
+		}
 
+		urb = usb_urbAlloc(dev->drv, dev->pipeBulkOUT, (void *)(data + done), usb_dir_out, chunk, usb_transfer_bulk);
+		if (urb < 0) {
+			ret = -ENOMEM;
+			break;
+		}
 
-static int usbacm_write(usbacm_dev_t *dev, const char *data, size_t len)
-{
-	int ret = 0;
+		if (usb_transferAsync(dev->drv, dev->pipeBulkOUT, urb, chunk, NULL) < 0) {
+			usb_urbFree(dev->drv, dev->pipeBulkOUT, urb);
+			ret = -EIO;
+			break;
+		}
 
-	TRACE("write: len=%u, flags=%u", len, dev->flags);
+		dev->txInflight++;
+		done += chunk;
+	}
+	mutexUnlock(dev->txLock);
 
-	ret = usb_transferBulk(dev->drv, dev->pipeBulkOUT, (void *)data, len, usb_dir_out);
-	if (ret <= 0) {
+	if ((ret < 0) && (ret != -EWOULDBLOCK)) {
 		fprintf(stderr, "usbacm: write failed\n");
-		ret = -EIO;
 	}
 
-	return ret;
+	return (done > 0) ? (int)done : ret;
 }
 
 
@@ -468,12 +548,11 @@ static int _usbacm_urbsAlloc(usbacm_dev_t *dev)
 }
 
 
-static int _usbacm_openNonblock(usbacm_dev_t *dev)
+static int _usbacm_rxOpen(usbacm_dev_t *dev)
 {
-	/* TODO: switch to lf-fifo */
 	fifo_t *fifo;
 	int ret = 0;
-	TRACE("openNonblock");
+	TRACE("rxOpen");
 
 	if (dev->fifo != NULL) {
 		fifo = dev->fifo;
@@ -506,11 +585,19 @@ static void _usbacm_close(usbacm_dev_t *dev)
 	int i;
 	TRACE("close: flags=%u", dev->flags);
 
+	/* Let queued writes complete */
+	mutexLock(dev->txLock);
+	while ((dev->txInflight > 0) && !dev->txDisconnected && (dev->txErr == 0)) {
+		condWait(dev->txCond, dev->txLock, 0);
+	}
+	dev->txErr = 0;
+	mutexUnlock(dev->txLock);
+
 	for (i = 0; i < USBACM_N_URBS; i++) {
 		usb_urbFree(dev->drv, dev->pipeBulkIN, dev->urbs[i]);
 	}
 
-	if (dev->flags & O_NONBLOCK) {
+	if (dev->flags & (O_RDONLY | O_RDWR)) {
 		mutexLock(dev->rxLock);
 		_usbacm_rxStop(dev);
 		mutexUnlock(dev->rxLock);
@@ -536,12 +623,11 @@ static int _usbacm_open(usbacm_dev_t *dev, int flags, pid_t pid)
 			return -EPERM;
 		}
 
-		if (flags & O_NONBLOCK) {
-			/* Start receiving data */
-			if (_usbacm_openNonblock(dev) < 0) {
-				_usbacm_close(dev);
-				return -EPERM;
-			}
+		/* Start receiving data, it is kept running until close */
+		if (_usbacm_rxOpen(dev) < 0) {
+			dev->flags = flags;
+			_usbacm_close(dev);
+			return -EPERM;
 		}
 	}
 
@@ -618,7 +704,7 @@ static void usbacm_msgthr(void *arg)
 			case mtGetAttr:
 				if (msg.i.attr.type == atPollStatus) {
 					msg.o.attr.val = POLLOUT;
-					if (((dev->flags & O_NONBLOCK) != 0) && fifo_is_empty(dev->fifo)) {
+					if ((dev->fifo != NULL) && !fifo_is_empty(dev->fifo)) {
 						msg.o.attr.val |= POLLIN;
 					}
 					msg.o.err = EOK;
@@ -697,8 +783,25 @@ static int usbacm_handleInsertion(usb_driver_t *drv, usb_devinfo_t *insertion)
 			break;
 		}
 
-		condCreate(&dev->rxCond);
+		err = condCreate(&dev->rxCond);
+		if (err != 0) {
+			resourceDestroy(dev->rxLock);
+			err = -ENOMEM;
+			break;
+		}
+
+		err = mutexCreate(&dev->txLock);
+		if (err != 0) {
+			resourceDestroy(dev->rxCond);
+			resourceDestroy(dev->rxLock);
+			err = -ENOMEM;
+			break;
+		}
+
+		err = condCreate(&dev->txCond);
 		if (err != 0) {
+			resourceDestroy(dev->txLock);
+			resourceDestroy(dev->rxCond);
 			resourceDestroy(dev->rxLock);
 			err = -ENOMEM;
 			break;
@@ -709,6 +812,8 @@ static int usbacm_handleInsertion(usb_driver_t *drv, usb_devinfo_t *insertion)
 
 		err = create_dev(&oid, dev->path);
 		if (err != 0) {
+			resourceDestroy(dev->txCond);
+			resourceDestroy(dev->txLock);
 			resourceDestroy(dev->rxCond);
 			resourceDestroy(dev->rxLock);
 			fprintf(stderr, "usbacm: Can't create dev: %s\n", dev->path);
@@ -757,6 +862,11 @@ static int usbacm_handleDeletion(usb_driver_t *drv, usb_deletion_t *del)
 			condSignal(dev->rxCond);
 			mutexUnlock(dev->rxLock);
 
+			mutexLock(dev->txLock);
+			dev->txDisconnected = 1;
+			condSignal(dev->txCond);
+			mutexUnlock(dev->txLock);
+
 			if (_usbacm_put(dev) == 0) {
 				LIST_ADD(&usbacm_common.devicesToFree, dev);
 			}
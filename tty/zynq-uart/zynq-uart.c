@@ -35,6 +35,8 @@
 #include <libklog.h>
 #include <posix/utils.h>
 
+#include "zynq-uart.h"
+
 #include <phoenix/ioctl.h>
 #if defined(__CPU_ZYNQ7000)
 #include <phoenix/arch/armv7a/zynq7000/zynq7000.h>
@@ -50,6 +52,16 @@
 
 #define KMSG_CTRL_ID 100
 
+/* RX interrupts */
+#define UART_IRQ_RTRIG (1 << 0)
+#define UART_IRQ_ROVR  (1 << 5)
+#define UART_IRQ_TOUT  (1 << 8)
+
+/* RX trigger level adaptation, max level leaves FIFO headroom for interrupt latency */
+#define UART_RXWM_MIN     1
+#define UART_RXWM_MAX     48
+#define UART_ADAPT_WINDOW 32 /* RX interrupts per adjustment */
+
 
 typedef struct {
 	volatile uint32_t *base;
@@ -60,6 +72,15 @@ typedef struct {
 	handle_t lock;
 	libtty_common_t tty;
 
+	struct {
+		int fixed;          /* Trigger level set by user, no adaptation */
+		unsigned int irqs;  /* RX interrupts in current window */
+		unsigned int touts; /* RX timeout interrupts in current window */
+		unsigned int ovrs;  /* RX overruns in current window */
+		unsigned int bytes; /* Bytes received in current window */
+	} adapt;
+	zynquart_stats_t stats;
+
 	uint8_t stack[_PAGE_SIZE] __attribute__((aligned(16)));
 } uart_t;
 
@@ -110,18 +131,83 @@ static int uart_interrupt(unsigned int n, void *arg)
 {
 	uart_t *uart = (uart_t *)arg;
 
-	/* RX Trigger IRQ occurred */
-	if (*(uart->base + isr) & (1 << 0)) {
-		*(uart->base + idr) = (1 << 0); /* Disable IRQ to not receive more interrupts */
+	/* RX Trigger or RX timeout IRQ occurred */
+	if (*(uart->base + isr) & (UART_IRQ_RTRIG | UART_IRQ_TOUT)) {
+		*(uart->base + idr) = UART_IRQ_RTRIG | UART_IRQ_TOUT; /* Disable IRQs to not receive more interrupts */
+		uart->stats.irqs++;
 	}
 
 	return 1;
 }
 
 
+static void uart_setRxTrigger(uart_t *uart, unsigned int level)
+{
+	/* Timeout only delays the tail of a burst, keep it short at low levels.
+	 * At high levels the peer is streaming, a longer timeout rides over its short gaps */
+	uart->stats.rxwm = level;
+	uart->stats.rxtout = 2 + level / 8;
+
+	*(uart->base + rxwm) = uart->stats.rxwm;
+	*(uart->base + rxtout) = uart->stats.rxtout;
+}
+
+
+/* Tunes RX trigger level from interrupt causes and bytes per interrupt observed in a window */
+static void uart_adaptRx(uart_t *uart, uint32_t status)
+{
+	unsigned int level = uart->stats.rxwm;
+
+	uart->adapt.irqs++;
+	if (status & UART_IRQ_TOUT) {
+		uart->adapt.touts++;
+		uart->stats.rxTimeouts++;
+	}
+	if (status & UART_IRQ_ROVR) {
+		uart->adapt.ovrs++;
+		uart->stats.rxOverruns++;
+	}
+
+	if (uart->adapt.fixed || ((uart->adapt.irqs < UART_ADAPT_WINDOW) && (uart->adapt.ovrs == 0))) {
+		return;
+	}
+
+	if (uart->adapt.ovrs != 0) {
+		/* FIFO filled up before being serviced - trigger earlier */
+		level /= 2;
+	}
+	else if ((uart->adapt.touts * 4) < uart->adapt.irqs) {
+		/* Sustained stream, FIFO reaches the trigger level almost every time */
+		level *= 2;
+	}
+	else if ((uart->adapt.bytes * 2) < (uart->adapt.irqs * level)) {
+		/* Mostly short bursts closed by the timeout */
+		level /= 2;
+	}
+
+	if (level < UART_RXWM_MIN) {
+		level = UART_RXWM_MIN;
+	}
+	else if (level > UART_RXWM_MAX) {
+		level = UART_RXWM_MAX;
+	}
+
+	if (level != uart->stats.rxwm) {
+		uart_setRxTrigger(uart, level);
+	}
+
+	uart->adapt.irqs = 0;
+	uart->adapt.touts = 0;
+	uart->adapt.ovrs = 0;
+	uart->adapt.bytes = 0;
+}
+
+
 static void uart_intThread(void *arg)
 {
 	uart_t *uart = (uart_t *)arg;
+	uint32_t status;
+	unsigned int n;
 	int wake;
 
 	mutexLock(uart->lock);
@@ -132,14 +218,17 @@ static void uart_intThread(void *arg)
 		}
 
 		/* Receive data until RX FIFO is not empty */
-		while (!(*(uart->base + sr) & (1 << 1))) {
+		for (n = 0; !(*(uart->base + sr) & (1 << 1)); n++) {
 			libtty_putchar(&uart->tty, *(uart->base + fifo), NULL);
 		}
+		uart->adapt.bytes += n;
+		uart->stats.rxBytes += n;
 
 		/* Transmit data until TX TTY buffer is empty or TX FIFO is full */
 		wake = 0;
 		while (libtty_txready(&uart->tty) && !(*(uart->base + sr) & (1 << 4))) {
 			*(uart->base + fifo) = libtty_popchar(&uart->tty);
+			uart->stats.txBytes++;
 			wake = 1;
 		}
 
@@ -147,10 +236,16 @@ static void uart_intThread(void *arg)
 			libtty_wake_writer(&uart->tty);
 		}
 
-		/* RX Trigger IRQ occurred and turned off the interrupt */
-		if ((*(uart->base + imr) & (1 << 0)) == 0) {
-			*(uart->base + isr) = (1 << 0); /* RX Trigger status can be cleared after getting data from RX FIFO */
-			*(uart->base + ier) = (1 << 0); /* Enable RX Trigger irq which has been disabled in uart irq handler */
+		/* RX IRQ occurred and turned off the interrupts */
+		if ((*(uart->base + imr) & UART_IRQ_RTRIG) == 0) {
+			/* RX status can be cleared after getting data from RX FIFO */
+			status = *(uart->base + isr) & (UART_IRQ_RTRIG | UART_IRQ_TOUT | UART_IRQ_ROVR);
+			*(uart->base + isr) = status;
+
+			uart_adaptRx(uart, status);
+
+			/* Enable RX irqs which have been disabled in uart irq handler */
+			*(uart->base + ier) = UART_IRQ_RTRIG | UART_IRQ_TOUT;
 		}
 	}
 
@@ -263,11 +358,20 @@ static void uart_ioctl(unsigned port, msg_t *msg)
 	pid_t pid;
 	unsigned long req;
 	const void *inData, *outData = NULL;
+	zynquart_stats_t stats;
 
 	inData = ioctl_unpack(msg, &req, NULL);
 	pid = ioctl_getSenderPid(msg);
 
-	if (req == KIOEN) {
+	if (req == ZYNQUART_GETSTATS) {
+		mutexLock(uart_common.uart.lock);
+		stats = uart_common.uart.stats;
+		mutexUnlock(uart_common.uart.lock);
+
+		outData = &stats;
+		err = EOK;
+	}
+	else if (req == KIOEN) {
 		/*
 		 * TODO: if adding support for multiple uarts, one should check here whether
 		 * the ioctl is done on console uart (check if dev id == UART_CONSOLE_USER)
@@ -342,9 +446,9 @@ static void uart_dispatchMsg(void *arg)
 }
 
 
-static void uart_klogClbk(const char *data, size_t size)
+static ssize_t uart_klogClbk(const char *data, size_t size)
 {
-	libtty_write(&uart_common.uart.tty, data, size, 0);
+	return libtty_write(&uart_common.uart.tty, data, size, O_NONBLOCK);
 }
 
 
@@ -358,7 +462,7 @@ static void uart_mkDev(unsigned int id)
 	}
 
 	if (id == UART_CONSOLE_USER) {
-		libklog_init(uart_klogClbk);
+		libklog_initNb(uart_klogClbk);
 
 		if (create_dev(&uart_common.uart.oid, _PATH_CONSOLE) < 0) {
 			debug("zynq-uart: cannot create device file\n");
@@ -505,7 +609,7 @@ static int uart_initClk(int n)
 #endif
 
 
-static int uart_init(unsigned int n, speed_t baud, int raw)
+static int uart_init(unsigned int n, speed_t baud, int raw, int level)
 {
 	libtty_callbacks_t callbacks;
 	uart_t *uart = &uart_common.uart;
@@ -562,11 +666,12 @@ static int uart_init(unsigned int n, speed_t baud, int raw)
 	/* normal mode, 1 stop bit, no parity, 8 bits */
 	uart_setCFlag(uart, &uart->tty.term.c_cflag);
 
-	/* Set trigger level, range: 1-63 */
-	*(uart->base + rxwm) = 1;
+	/* Set trigger level, range: 1-63, and RX timeout. Start low, adaptation raises it under load */
+	uart->adapt.fixed = (level > 0);
+	uart_setRxTrigger(uart, (level > 0) ? level : UART_RXWM_MIN);
 
-	/* Enable RX FIFO trigger */
-	*(uart->base + ier) = (1 << 0);
+	/* Enable RX FIFO trigger and RX timeout */
+	*(uart->base + ier) = UART_IRQ_RTRIG | UART_IRQ_TOUT;
 
 	uart->tty.term.c_ispeed = uart->tty.term.c_ospeed = baud;
 	uart_setBaudrate(uart, baud);
@@ -585,6 +690,7 @@ static void uart_help(const char *progname)
 	printf("\t-b <baudrate>   - baudrate\n");
 	printf("\t-n <id>         - uart controller ID\n");
 	printf("\t-r              - set raw mode (default cooked)\n");
+	printf("\t-w <level>      - fixed RX FIFO trigger level 1-63 (default adaptive)\n");
 	printf("\t-h              - print this message\n");
 }
 
@@ -594,10 +700,10 @@ int main(int argc, char **argv)
 	/* Default console configuration */
 	int uartn = UART_CONSOLE_USER;
 	speed_t baud = B115200;
-	int c, raw = 0;
+	int c, raw = 0, level = 0;
 
 	if (argc > 1) {
-		while ((c = getopt(argc, argv, "n:b:rh")) != -1) {
+		while ((c = getopt(argc, argv, "n:b:rw:h")) != -1) {
 			switch (c) {
 				case 'b':
 					baud = libtty_int_to_baudrate(atoi(optarg));
@@ -619,6 +725,14 @@ int main(int argc, char **argv)
 					raw = 1;
 					break;
 
+				case 'w':
+					level = atoi(optarg);
+					if ((level < 1) || (level > 63)) {
+						debug("zynq-uart: wrong RX trigger level\n");
+						return EXIT_FAILURE;
+					}
+					break;
+
 				case 'h':
 					uart_help(argv[0]);
 					return EXIT_SUCCESS;
@@ -642,7 +756,7 @@ int main(int argc, char **argv)
 
 	portCreate(&uart_common.uart.oid.port);
 
-	if (uart_init(uartn, baud, raw) < 0) {
+	if (uart_init(uartn, baud, raw, level) < 0) {
 		debug("zynq-uart: cannot initialize uart\n");
 		return EXIT_FAILURE;
 	}
@@ -0,0 +1,35 @@
+/*
+ * Phoenix-RTOS
+ *
+ * Zynq - 7000 UART driver interface
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _ZYNQ_UART_H_
+#define _ZYNQ_UART_H_
+
+#include <stdint.h>
+#include <sys/ioctl.h>
+
+
+typedef struct {
+	uint32_t irqs;       /* RX interrupts (trigger and timeout) */
+	uint32_t rxBytes;    /* Received bytes */
+	uint32_t txBytes;    /* Transmitted bytes */
+	uint32_t rxTimeouts; /* RX interrupts caused by RX timeout */
+	uint32_t rxOverruns; /* RX FIFO overruns */
+	uint32_t rxwm;       /* Current RX FIFO trigger level (1 - 63) */
+	uint32_t rxtout;     /* Current RX timeout (4 bit periods units) */
+} zynquart_stats_t;
+
+
+/* Returns driver statistics, interrupts per byte = irqs / rxBytes */
+#define ZYNQUART_GETSTATS _IOR('u', 0x01, zynquart_stats_t)
+
+
+#endif
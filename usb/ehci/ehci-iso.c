@@ -0,0 +1,533 @@
+/*
+ * Phoenix-RTOS
+ *
+ * ehci isochronous transfers (iTD/siTD)
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sys/list.h>
+#include <sys/minmax.h>
+#include <sys/mman.h>
+#include <sys/threads.h>
+
+#include <hcd.h>
+#include "ehci.h"
+
+
+static unsigned int ehci_isoNow(ehci_t *ehci)
+{
+	return (*(ehci->opbase + frindex) >> 3) & (EHCI_PERIODIC_SIZE - 1);
+}
+
+
+/* Returns non-zero if the frame has already been processed by the controller */
+static int ehci_isoFramePassed(ehci_t *ehci, unsigned int frame)
+{
+	unsigned int d = (ehci_isoNow(ehci) - frame) & (EHCI_PERIODIC_SIZE - 1);
+
+	/* Descriptors are scheduled at most half of the periodic list ahead */
+	return (d > 0) && (d < EHCI_PERIODIC_SIZE / 2);
+}
+
+
+static ehci_iso_t *ehci_isoCreate(ehci_t *ehci, usb_pipe_t *pipe, usb_transfer_t *t, int *err)
+{
+	ehci_iso_t *iso;
+	unsigned int interval = max(pipe->interval, 1), puframes, nshifts, n, u;
+
+	if ((iso = calloc(1, sizeof(*iso))) == NULL) {
+		*err = -ENOMEM;
+		return NULL;
+	}
+
+	iso->hs = (pipe->dev->speed == usb_high_speed);
+	iso->in = (t->direction == usb_dir_in);
+	iso->devaddr = pipe->dev->address;
+	iso->ep = pipe->num;
+	iso->maxp = pipe->maxPacketLen & 0x7ff;
+
+	if (iso->hs) {
+		/* High-bandwidth endpoints transfer up to 3 packets per microframe */
+		iso->mult = ((pipe->maxPacketLen >> 11) & 0x3) + 1;
+		iso->pktsz = iso->maxp * iso->mult;
+		puframes = 1U << min(interval - 1, 15);
+
+		if (puframes < 8) {
+			/* Every frame, packets every puframes microframes */
+			iso->band.period = 1;
+			for (u = 0; u < 8; u += puframes)
+				iso->band.umask |= 1 << u;
+			iso->pktStride = puframes;
+			iso->tdPkts = 8 / puframes;
+			nshifts = puframes;
+		}
+		else {
+			iso->band.period = puframes / 8;
+			iso->band.umask = 0x01;
+			iso->pktStride = 8;
+			iso->tdPkts = 1;
+			nshifts = 8;
+		}
+		iso->band.hsCost = iso->mult * (iso->maxp + EHCI_HS_OVERHEAD);
+	}
+	else {
+		/* Full-speed endpoints behind the (embedded) transaction translator, one packet per frame */
+		iso->mult = 1;
+		iso->pktsz = iso->maxp;
+		iso->band.period = 1U << min(interval - 1, 15);
+		iso->tdPkts = 1;
+
+		/* Split transactions carry up to 188 bytes per microframe */
+		n = max((iso->maxp + SPLIT_MAX_BYTES - 1) / SPLIT_MAX_BYTES, 1);
+		if (iso->in) {
+			iso->smask = 0x01;
+			iso->cmask = (((1 << (n + 1)) - 1) << 2) & 0xfc;
+		}
+		else {
+			iso->smask = (1 << n) - 1;
+			iso->cmask = 0;
+		}
+
+		iso->band.umask = iso->smask | iso->cmask;
+		iso->band.cmask = iso->cmask;
+		/* Full-speed data moves on the TT bus in the microframes following the start-split */
+		iso->band.ttmask = (((1 << n) - 1) << 1) & 0xff;
+		iso->band.hsCost = min(iso->maxp, SPLIT_MAX_BYTES) + EHCI_HS_OVERHEAD;
+		iso->band.fsCost = iso->maxp + EHCI_FS_OVERHEAD;
+		nshifts = 1;
+	}
+	iso->tdStride = iso->band.period;
+
+	if ((iso->pktsz == 0) || (iso->band.period > EHCI_BAND_FRAMES)) {
+		free(iso);
+		*err = -ENOTSUP;
+		return NULL;
+	}
+
+	mutexLock(ehci->periodicLock);
+	if (!iso->hs && (iso->band.tt = ehci_ttGet(ehci, pipe->dev, &iso->ttaddr, &iso->ttport)) == NULL) {
+		*err = -ENOMEM;
+	}
+	else {
+		*err = ehci_bandAlloc(ehci, &iso->band, nshifts);
+		if (*err == 0)
+			ehci_bandUpdate(ehci, &iso->band, 1);
+		else if (iso->band.tt != NULL)
+			ehci_ttPut(ehci, iso->band.tt);
+	}
+	mutexUnlock(ehci->periodicLock);
+
+	if (*err < 0) {
+		log_error("no periodic bandwidth for isochronous endpoint %u", iso->ep);
+		free(iso);
+		return NULL;
+	}
+
+	return iso;
+}
+
+
+static void ehci_isoTdsFree(ehci_isotd_t *td, int hs)
+{
+	ehci_isotd_t *n;
+
+	for (; td != NULL; td = n) {
+		n = td->tnext;
+		if (hs)
+			usb_free((void *)td->hw.itd, sizeof(struct itd));
+		else
+			usb_free((void *)td->hw.sitd, sizeof(struct sitd));
+		free(td);
+	}
+}
+
+
+static int ehci_isoItdFill(ehci_iso_t *iso, ehci_isotd_t *td, char *data, size_t *remaining, uint8_t umask)
+{
+	volatile struct itd *itd = td->hw.itd;
+	size_t offs = (uintptr_t)data & (EHCI_PAGE_SIZE - 1), len, pos = offs;
+	unsigned int u, pg;
+	char *page = data - offs;
+
+	memset((void *)itd, 0, sizeof(*itd));
+
+	for (u = 0; (u < 8) && (*remaining > 0); u++) {
+		if ((umask & (1 << u)) == 0)
+			continue;
+
+		len = min(*remaining, iso->pktsz);
+		itd->transaction[u] = ITD_ACTIVE | (len << 16) | ((pos >> 12) << 12) | (pos & 0xfff);
+		pos += len;
+		*remaining -= len;
+		td->npkts++;
+	}
+
+	/* Up to 8 packets of 3072 bytes span at most 7 pages */
+	for (pg = 0; pg < 7 && (pg * EHCI_PAGE_SIZE) < pos; pg++)
+		itd->buf[pg] = va2pa(page + pg * EHCI_PAGE_SIZE) & ~0xfff;
+
+	itd->buf[0] |= (iso->ep << 8) | iso->devaddr;
+	itd->buf[1] |= (iso->in ? ITD_IN : 0) | iso->maxp;
+	itd->buf[2] |= iso->mult;
+
+	return pos - offs;
+}
+
+
+static int ehci_isoSitdFill(ehci_iso_t *iso, ehci_isotd_t *td, char *data, size_t *remaining)
+{
+	volatile struct sitd *sitd = td->hw.sitd;
+	size_t len = min(*remaining, iso->pktsz);
+	unsigned int n = max((len + SPLIT_MAX_BYTES - 1) / SPLIT_MAX_BYTES, 1);
+
+	memset((void *)sitd, 0, sizeof(*sitd));
+
+	sitd->epchar = (iso->in ? SITD_IN : 0) | (iso->ttport << 24) | (iso->ttaddr << 16) | (iso->ep << 8) | iso->devaddr;
+	sitd->uframe = (iso->cmask << 8) | iso->smask;
+	sitd->status = (len << 16) | SITD_ACTIVE;
+	sitd->buf[0] = va2pa(data);
+	sitd->buf[1] = va2pa(data + len) & ~0xfff;
+	if (!iso->in)
+		sitd->buf[1] |= ((n > 1) ? SITD_TP_BEGIN : SITD_TP_ALL) | n;
+	sitd->back = SITD_BACK_INVALID;
+
+	*remaining -= len;
+	td->npkts = 1;
+
+	return len;
+}
+
+
+static ehci_isoreq_t *ehci_isoReqAlloc(ehci_iso_t *iso, usb_transfer_t *t, int *err)
+{
+	ehci_isoreq_t *req;
+	ehci_isotd_t *td;
+	size_t remaining = t->size, hwsz = iso->hs ? sizeof(struct itd) : sizeof(struct sitd);
+	char *data = t->buffer;
+	unsigned int ntds;
+
+	ntds = (((t->size + iso->pktsz - 1) / iso->pktsz) + iso->tdPkts - 1) / iso->tdPkts;
+	if ((ntds == 0) || (ntds * iso->tdStride + EHCI_ISO_SLOP >= EHCI_PERIODIC_SIZE / 2)) {
+		*err = -EINVAL;
+		return NULL;
+	}
+
+	if ((req = calloc(1, sizeof(*req))) == NULL) {
+		*err = -ENOMEM;
+		return NULL;
+	}
+	req->iso = iso;
+	req->transfer = t;
+
+	while (remaining > 0) {
+		if ((td = calloc(1, sizeof(*td))) == NULL) {
+			break;
+		}
+
+		if ((td->hw.itd = usb_alloc(hwsz)) == NULL) {
+			free(td);
+			break;
+		}
+
+		if (req->last == NULL)
+			req->tds = td;
+		else
+			req->last->tnext = td;
+		req->last = td;
+
+		if (iso->hs)
+			data += ehci_isoItdFill(iso, td, data, &remaining, iso->band.umask);
+		else
+			data += ehci_isoSitdFill(iso, td, data, &remaining);
+	}
+
+	if (remaining > 0) {
+		ehci_isoTdsFree(req->tds, iso->hs);
+		free(req);
+		*err = -ENOMEM;
+		return NULL;
+	}
+
+	/* Interrupt on the last packet only */
+	if (iso->hs)
+		req->last->hw.itd->transaction[31 - __builtin_clz(iso->band.umask & ((1 << (req->last->npkts * iso->pktStride)) - 1))] |= ITD_IOC;
+	else
+		req->last->hw.sitd->status |= SITD_IOC;
+
+	return req;
+}
+
+
+/* Links request descriptors in front of the frames qhs, called with hcd->transLock taken */
+static void ehci_isoLink(ehci_t *ehci, ehci_isoreq_t *req)
+{
+	ehci_iso_t *iso = req->iso;
+	unsigned int frame, d;
+	ehci_isotd_t *td;
+
+	/* Continue the stream if its schedule is still ahead, start a new one otherwise */
+	d = (iso->nextFrame - ehci_isoNow(ehci)) & (EHCI_PERIODIC_SIZE - 1);
+	if ((iso->pending == NULL) || (d < EHCI_ISO_SLOP) || (d >= EHCI_PERIODIC_SIZE / 2)) {
+		frame = ehci_isoNow(ehci) + EHCI_ISO_SLOP;
+		frame += (iso->band.phase - frame) & (iso->band.period - 1);
+	}
+	else {
+		frame = iso->nextFrame;
+	}
+
+	mutexLock(ehci->periodicLock);
+	for (td = req->tds; td != NULL; td = td->tnext) {
+		td->frame = frame & (EHCI_PERIODIC_SIZE - 1);
+
+		if (iso->hs) {
+			td->hw.itd->next = ehci->periodicList[td->frame];
+			ehci_memDmb();
+			ehci->periodicList[td->frame] = ITD_PTR(td);
+		}
+		else {
+			td->hw.sitd->next = ehci->periodicList[td->frame];
+			ehci_memDmb();
+			ehci->periodicList[td->frame] = SITD_PTR(td);
+		}
+
+		td->next = ehci->isoNodes[td->frame];
+		ehci->isoNodes[td->frame] = td;
+		frame += iso->tdStride;
+	}
+	ehci_memDmb();
+	mutexUnlock(ehci->periodicLock);
+
+	iso->nextFrame = frame & (EHCI_PERIODIC_SIZE - 1);
+}
+
+
+static void ehci_isoUnlink(ehci_t *ehci, ehci_isoreq_t *req)
+{
+	ehci_isotd_t *td, *prev;
+
+	/* Link pointer is the first word of both iTD and siTD */
+	mutexLock(ehci->periodicLock);
+	for (td = req->tds; td != NULL; td = td->tnext) {
+		prev = ehci->isoNodes[td->frame];
+		if (prev == td) {
+			ehci->periodicList[td->frame] = td->hw.itd->next;
+			ehci->isoNodes[td->frame] = td->next;
+		}
+		else {
+			while (prev->next != td)
+				prev = prev->next;
+
+			prev->hw.itd->next = td->hw.itd->next;
+			prev->next = td->next;
+		}
+	}
+	ehci_memDmb();
+	mutexUnlock(ehci->periodicLock);
+}
+
+
+static int ehci_isoTdActive(ehci_iso_t *iso, ehci_isotd_t *td)
+{
+	unsigned int u;
+
+	if (!iso->hs)
+		return (td->hw.sitd->status & SITD_ACTIVE) != 0;
+
+	for (u = 0; u < 8; u++) {
+		if (td->hw.itd->transaction[u] & ITD_ACTIVE)
+			return 1;
+	}
+
+	return 0;
+}
+
+
+static void ehci_isoDeactivate(ehci_iso_t *iso, ehci_isoreq_t *req)
+{
+	ehci_isotd_t *td;
+	unsigned int u;
+
+	for (td = req->tds; td != NULL; td = td->tnext) {
+		if (iso->hs) {
+			for (u = 0; u < 8; u++)
+				td->hw.itd->transaction[u] &= ~ITD_ACTIVE;
+		}
+		else {
+			td->hw.sitd->status &= ~SITD_ACTIVE;
+		}
+	}
+	ehci_memDmb();
+}
+
+
+/* Returns number of bytes transferred, received packets are packed at the beginning of the buffer */
+static int ehci_isoStatus(ehci_iso_t *iso, ehci_isoreq_t *req)
+{
+	usb_transfer_t *t = req->transfer;
+	size_t offs = 0, done = 0, len, req_len;
+	ehci_isotd_t *td;
+	unsigned int u, k, errors = 0, pkts = 0;
+	uint32_t st;
+
+	for (td = req->tds; td != NULL; td = td->tnext) {
+		for (u = 0, k = 0; k < td->npkts; u++) {
+			if (iso->hs) {
+				if ((iso->band.umask & (1 << u)) == 0)
+					continue;
+				st = td->hw.itd->transaction[u];
+				req_len = min(t->size - offs, iso->pktsz);
+				len = (st & (ITD_ACTIVE | ITD_ERRMASK)) ? 0 : ITD_LEN(st);
+				if (!iso->in && len != 0)
+					len = req_len;
+				errors += (st & ITD_ERRMASK) ? 1 : 0;
+			}
+			else {
+				st = td->hw.sitd->status;
+				req_len = min(t->size - offs, iso->pktsz);
+				len = (st & (SITD_ACTIVE | SITD_ERRMASK)) ? 0 : req_len - SITD_LEN(st);
+				errors += (st & SITD_ERRMASK) ? 1 : 0;
+			}
+
+			if (iso->in && len > 0 && done != offs)
+				memmove(t->buffer + done, t->buffer + offs, len);
+
+			done += len;
+			offs += req_len;
+			k++;
+			pkts++;
+		}
+	}
+
+	/* Lost packets are normal for isochronous streams, fail only if nothing got through */
+	if ((errors == pkts) && (errors > 0))
+		return -EIO;
+
+	return done;
+}
+
+
+void ehci_isoUpdate(hcd_t *hcd)
+{
+	ehci_t *ehci = (ehci_t *)hcd->priv;
+	ehci_isoreq_t *req, **link, *prev;
+	ehci_iso_t *iso;
+	int status;
+
+	for (iso = ehci->isoStreams; iso != NULL; iso = iso->next) {
+		prev = NULL;
+		link = &iso->pending;
+		while ((req = *link) != NULL) {
+			/* Missed frames are never processed, they'd wait for the next periodic list wrap */
+			if (!req->cancel && ehci_isoTdActive(iso, req->last) && !ehci_isoFramePassed(ehci, req->last->frame)) {
+				prev = req;
+				link = &req->next;
+				continue;
+			}
+
+			*link = req->next;
+			if (iso->pendingTail == req)
+				iso->pendingTail = prev;
+
+			ehci_isoDeactivate(iso, req);
+			ehci_isoUnlink(ehci, req);
+			status = ehci_isoStatus(iso, req);
+
+			req->transfer->hcdpriv = NULL;
+			usb_transferFinished(req->transfer, status);
+			ehci_isoTdsFree(req->tds, iso->hs);
+			free(req);
+		}
+	}
+}
+
+
+int ehci_isoEnqueue(hcd_t *hcd, usb_transfer_t *t, usb_pipe_t *pipe)
+{
+	ehci_t *ehci = (ehci_t *)hcd->priv;
+	ehci_iso_t *iso;
+	ehci_isoreq_t *req;
+	int err = 0;
+
+	mutexLock(hcd->transLock);
+	if ((iso = pipe->hcdpriv) == NULL) {
+		if ((iso = ehci_isoCreate(ehci, pipe, t, &err)) == NULL) {
+			mutexUnlock(hcd->transLock);
+			return err;
+		}
+
+		iso->next = ehci->isoStreams;
+		ehci->isoStreams = iso;
+		pipe->hcdpriv = iso;
+	}
+
+	if ((req = ehci_isoReqAlloc(iso, t, &err)) == NULL) {
+		mutexUnlock(hcd->transLock);
+		return err;
+	}
+
+	ehci_isoLink(ehci, req);
+
+	if (iso->pendingTail == NULL)
+		iso->pending = req;
+	else
+		iso->pendingTail->next = req;
+	iso->pendingTail = req;
+	t->hcdpriv = req;
+	mutexUnlock(hcd->transLock);
+
+	return 0;
+}
+
+
+void ehci_isoDequeue(hcd_t *hcd, usb_transfer_t *t)
+{
+	ehci_isoreq_t *req;
+
+	mutexLock(hcd->transLock);
+	if ((req = t->hcdpriv) != NULL) {
+		req->cancel = 1;
+		ehci_isoUpdate(hcd);
+	}
+	mutexUnlock(hcd->transLock);
+}
+
+
+void ehci_isoDestroy(hcd_t *hcd, usb_pipe_t *pipe)
+{
+	ehci_t *ehci = (ehci_t *)hcd->priv;
+	ehci_iso_t *iso = pipe->hcdpriv, **link;
+	ehci_isoreq_t *req;
+
+	mutexLock(hcd->transLock);
+	for (req = iso->pending; req != NULL; req = req->next)
+		req->cancel = 1;
+	ehci_isoUpdate(hcd);
+
+	for (link = &ehci->isoStreams; *link != NULL; link = &(*link)->next) {
+		if (*link == iso) {
+			*link = iso->next;
+			break;
+		}
+	}
+	mutexUnlock(hcd->transLock);
+
+	mutexLock(ehci->periodicLock);
+	ehci_bandUpdate(ehci, &iso->band, -1);
+	if (iso->band.tt != NULL)
+		ehci_ttPut(ehci, iso->band.tt);
+	mutexUnlock(ehci->periodicLock);
+
+	pipe->hcdpriv = NULL;
+	free(iso);
+}
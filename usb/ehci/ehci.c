@@ -37,25 +37,15 @@
 
 #include "ehci.h"
 
-#ifdef EHCI_IMX
-#define EHCI_PERIODIC_SIZE 128
-#else
-#define EHCI_PERIODIC_SIZE 1024
-#endif
-
 #ifndef EHCI_PRIO
 #define EHCI_PRIO 2
 #endif
 
+/* Max completed transfers reported at once */
+#define EHCI_DONE_BATCH 16
 
-static inline void ehci_memDmb(void)
-{
-#ifdef EHCI_IMX
-	asm volatile("dmb" ::: "memory");
-#else
-	__sync_synchronize();
-#endif
-}
+/* Async advance doorbell timeout [us], the schedule is stopped if the controller doesn't answer */
+#define EHCI_IAA_TIMEOUT (100 * 1000)
 
 
 static void ehci_startAsync(hcd_t *hcd)
@@ -81,6 +71,53 @@ static void ehci_stopAsync(hcd_t *hcd)
 }
 
 
+static void ehci_itcSet(ehci_t *ehci, unsigned int uframes)
+{
+	if (ehci->itc == uframes)
+		return;
+
+	/* usbcmd is also modified by async schedule start/stop and the doorbell */
+	mutexLock(ehci->asyncLock);
+	*(ehci->opbase + usbcmd) = (*(ehci->opbase + usbcmd) & ~USBCMD_ITCMASK) | USBCMD_ITC(uframes);
+	ehci->itc = uframes;
+	mutexUnlock(ehci->asyncLock);
+}
+
+
+/* Adjusts adaptive interrupt threshold after a completion pass, called with hcd->transLock taken */
+static void ehci_itcAdapt(ehci_t *ehci, unsigned int nbulk, unsigned int nother)
+{
+	if (!ehci->itcAdaptive)
+		return;
+
+	if (nother > 0) {
+		ehci->itcRamp = 0;
+		ehci_itcSet(ehci, 1);
+	}
+	else if ((nbulk > 0) && (ehci->itc < EHCI_ITC_ADAPT_MAX) && (++ehci->itcRamp >= EHCI_ITC_ADAPT_RAMP)) {
+		ehci->itcRamp = 0;
+		ehci_itcSet(ehci, ehci->itc << 1);
+	}
+}
+
+
+int ehci_intrThreshold(hcd_t *hcd, unsigned int uframes)
+{
+	ehci_t *ehci = (ehci_t *)hcd->priv;
+
+	if ((uframes > EHCI_ITC_MAX) || ((uframes & (uframes - 1)) != 0))
+		return -EINVAL;
+
+	mutexLock(hcd->transLock);
+	ehci->itcAdaptive = (uframes == 0);
+	ehci->itcRamp = 0;
+	ehci_itcSet(ehci, (uframes == 0) ? 1 : uframes);
+	mutexUnlock(hcd->transLock);
+
+	return 0;
+}
+
+
 static void ehci_qtdLink(ehci_qtd_t *prev, ehci_qtd_t *next)
 {
 	prev->hw->next = next->paddr;
@@ -131,43 +168,128 @@ static void ehci_continue(ehci_t *ehci, ehci_qh_t *qh, ehci_qtd_t *last)
 }
 
 
-static ehci_qtd_t *ehci_qtdGet(ehci_t *ehci)
+static int ehci_poolInit(ehci_pool_t *pool, unsigned int n)
 {
-	ehci_qtd_t *qtd;
+	unsigned int i;
+
+	if ((pool->next = malloc(n * sizeof(*pool->next))) == NULL)
+		return -ENOMEM;
+
+	for (i = 0; i < n; i++)
+		pool->next[i] = (i + 1 < n) ? i + 2 : 0;
+
+	pool->head = (n > 0) ? 1 : 0;
+	pool->misses = 0;
+
+	return 0;
+}
+
+
+/* Returns index of a free arena entry or -1 if the arena is exhausted */
+static int ehci_poolGet(ehci_pool_t *pool)
+{
+	uint32_t head, nhead;
+
+	head = __atomic_load_n(&pool->head, __ATOMIC_ACQUIRE);
+	do {
+		if ((head & 0xffff) == 0) {
+			__atomic_fetch_add(&pool->misses, 1, __ATOMIC_RELAXED);
+			return -1;
+		}
+
+		/* Tag is bumped on every update, so a stale next link fails the exchange */
+		nhead = ((head + 0x10000) & 0xffff0000) | pool->next[(head & 0xffff) - 1];
+	} while (!__atomic_compare_exchange_n(&pool->head, &head, nhead, true, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+	return (int)(head & 0xffff) - 1;
+}
 
-	mutexLock(ehci->asyncLock);
-	qtd = ehci->qtdPool;
 
-	if (qtd != NULL) {
-		LIST_REMOVE(&ehci->qtdPool, qtd);
-		ehci->nqtds--;
+static void ehci_poolPut(ehci_pool_t *pool, unsigned int idx)
+{
+	uint32_t head, nhead;
+
+	head = __atomic_load_n(&pool->head, __ATOMIC_RELAXED);
+	do {
+		pool->next[idx] = head & 0xffff;
+		nhead = ((head + 0x10000) & 0xffff0000) | (idx + 1);
+	} while (!__atomic_compare_exchange_n(&pool->head, &head, nhead, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+
+static int ehci_arenaInit(ehci_t *ehci)
+{
+	int i;
+
+	ehci->qtds = calloc(EHCI_QTD_ARENA, sizeof(ehci_qtd_t));
+	ehci->qhs = calloc(EHCI_QH_ARENA, sizeof(ehci_qh_t));
+	if ((ehci->qtds == NULL) || (ehci->qhs == NULL))
+		return -ENOMEM;
+
+	ehci->qtdsHw = usb_allocAligned(EHCI_QTD_ARENA * sizeof(struct qtd), EHCI_PAGE_SIZE);
+	ehci->qhsHw = usb_allocAligned(EHCI_QH_ARENA * sizeof(struct qh), EHCI_PAGE_SIZE);
+	if ((ehci->qtdsHw == NULL) || (ehci->qhsHw == NULL))
+		return -ENOMEM;
+
+	if ((ehci_poolInit(&ehci->qtdPool, EHCI_QTD_ARENA) < 0) || (ehci_poolInit(&ehci->qhPool, EHCI_QH_ARENA) < 0))
+		return -ENOMEM;
+
+	for (i = 0; i < EHCI_QTD_ARENA; i++) {
+		ehci->qtds[i].hw = ehci->qtdsHw + i;
+		ehci->qtds[i].paddr = QTD_PTR(&ehci->qtds[i]);
 	}
-	mutexUnlock(ehci->asyncLock);
 
-	return qtd;
+	for (i = 0; i < EHCI_QH_ARENA; i++)
+		ehci->qhs[i].hw = ehci->qhsHw + i;
+
+	return 0;
+}
+
+
+static void ehci_arenaFree(ehci_t *ehci)
+{
+	if (ehci->qtdsHw != NULL)
+		usb_freeAligned((void *)ehci->qtdsHw, EHCI_QTD_ARENA * sizeof(struct qtd));
+
+	if (ehci->qhsHw != NULL)
+		usb_freeAligned((void *)ehci->qhsHw, EHCI_QH_ARENA * sizeof(struct qh));
+
+	free(ehci->qtdPool.next);
+	free(ehci->qhPool.next);
+	free(ehci->qtds);
+	free(ehci->qhs);
+}
+
+
+static ehci_qtd_t *ehci_qtdGet(ehci_t *ehci)
+{
+	int idx;
+
+	if ((idx = ehci_poolGet(&ehci->qtdPool)) < 0) {
+		log_debug("qtd arena exhausted (%u misses)", ehci->qtdPool.misses);
+		return NULL;
+	}
+
+	return &ehci->qtds[idx];
 }
 
 
 static void ehci_qtdsPut(ehci_t *ehci, ehci_qtd_t **head)
 {
-	ehci_qtd_t *q, *t;
+	ehci_qtd_t *q;
 
-	mutexLock(ehci->asyncLock);
 	while ((q = *head) != NULL) {
 		LIST_REMOVE(head, q);
+		q->qh = NULL;
 
-		if (ehci->nqtds >= EHCI_MAX_QTD_POOL) {
-			t = ehci->qtdPool;
-			LIST_REMOVE(&ehci->qtdPool, t);
-			usb_free((void *)t->hw, sizeof(*t->hw));
-			free(t);
-			ehci->nqtds--;
+		if ((q >= ehci->qtds) && (q < ehci->qtds + EHCI_QTD_ARENA)) {
+			ehci_poolPut(&ehci->qtdPool, q - ehci->qtds);
+		}
+		else {
+			usb_free((void *)q->hw, sizeof(*q->hw));
+			free(q);
 		}
-		LIST_ADD(&ehci->qtdPool, q);
-		q->qh = NULL;
-		ehci->nqtds++;
 	}
-	mutexUnlock(ehci->asyncLock);
 }
 
 
@@ -258,38 +380,26 @@ static ehci_qtd_t *ehci_qtdAlloc(ehci_t *ehci, int pid, size_t maxpacksz, char *
 
 static ehci_qh_t *ehci_qhGet(ehci_t *ehci)
 {
-	ehci_qh_t *qh;
-
-	mutexLock(ehci->asyncLock);
-	qh = ehci->qhPool;
+	int idx;
 
-	if (qh != NULL) {
-		LIST_REMOVE(&ehci->qhPool, qh);
-		ehci->nqhs--;
+	if ((idx = ehci_poolGet(&ehci->qhPool)) < 0) {
+		log_debug("qh arena exhausted (%u misses)", ehci->qhPool.misses);
+		return NULL;
 	}
-	mutexUnlock(ehci->asyncLock);
 
-	return qh;
+	return &ehci->qhs[idx];
 }
 
 
 static void ehci_qhPut(ehci_t *ehci, ehci_qh_t *qh)
 {
-	ehci_qh_t *t;
-
-	mutexLock(ehci->asyncLock);
-
-	if (ehci->nqhs >= EHCI_MAX_QH_POOL) {
-		t = ehci->qhPool;
-		LIST_REMOVE(&ehci->qhPool, t);
-		usb_free((void *)t->hw, sizeof(*t->hw));
-		free(t);
-		ehci->nqhs--;
+	if ((qh >= ehci->qhs) && (qh < ehci->qhs + EHCI_QH_ARENA)) {
+		ehci_poolPut(&ehci->qhPool, qh - ehci->qhs);
+	}
+	else {
+		usb_free((void *)qh->hw, sizeof(*qh->hw));
+		free(qh);
 	}
-
-	LIST_ADD(&ehci->qhPool, qh);
-	ehci->nqhs++;
-	mutexUnlock(ehci->asyncLock);
 }
 
 
@@ -322,6 +432,11 @@ static ehci_qh_t *ehci_qhAlloc(ehci_t *ehci)
 	qh->uframe = 0;
 	qh->phase = 0;
 	qh->lastQtd = NULL;
+	qh->pending = NULL;
+	qh->pendingTail = NULL;
+	qh->anext = NULL;
+	qh->active = 0;
+	qh->scanAll = 0;
 
 	for (i = 0; i < EHCI_QH_NBUFS; i++) {
 		qh->hw->buf[i] = 0;
@@ -332,8 +447,23 @@ static ehci_qh_t *ehci_qhAlloc(ehci_t *ehci)
 }
 
 
+/* Returns the device attached to the hub with the TT, low/full-speed hubs don't have one */
+static usb_dev_t *ehci_ttDev(usb_dev_t *dev, unsigned int *hubaddr, unsigned int *port)
+{
+	while (!usb_isRoothub(dev->hub) && dev->hub->speed != usb_high_speed)
+		dev = dev->hub;
+
+	*hubaddr = usb_isRoothub(dev->hub) ? 0 : dev->hub->address;
+	*port = dev->port;
+
+	return dev;
+}
+
+
 static void ehci_qhConf(ehci_qh_t *qh, usb_pipe_t *pipe)
 {
+	unsigned int hubaddr, port;
+
 	qh->hw->info[0] = pipe->dev->address;
 	qh->hw->info[0] |= (pipe->num << 8);
 	qh->hw->info[0] |= (pipe->dev->speed << 12);
@@ -346,6 +476,12 @@ static void ehci_qhConf(ehci_qh_t *qh, usb_pipe_t *pipe)
 	qh->hw->info[0] |= (3 << 28); /* NAK count reload */
 	qh->hw->info[1] = 0;
 
+	if (pipe->dev->speed != usb_high_speed) {
+		/* Split transactions go to the TT hub port, the embedded TT ignores these */
+		ehci_ttDev(pipe->dev, &hubaddr, &port);
+		qh->hw->info[1] = (hubaddr << 16) | (port << 23);
+	}
+
 	if (pipe->type == usb_transfer_interrupt) {
 		if (pipe->dev->speed == usb_high_speed) {
 			qh->period = ((1 << (pipe->interval - 1))) >> 3;
@@ -362,62 +498,219 @@ static void ehci_qhConf(ehci_qh_t *qh, usb_pipe_t *pipe)
 }
 
 
-static void ehci_bandAlloc(ehci_t *ehci, ehci_qh_t *qh)
+/* Full-speed bytes in each of the TT microframes */
+static unsigned int ehci_ttCost(const ehci_band_t *band)
 {
-	ehci_qh_t *tmp;
-	unsigned int i, n, best;
-	unsigned int ucnt[8] = { 0 };
+	unsigned int n = __builtin_popcount(band->ttmask);
 
-	best = (unsigned)-1;
-	qh->phase = 0;
-	qh->uframe = 0xff;
+	return (n != 0) ? (band->fsCost + n - 1) / n : 0;
+}
 
-	/* Find the best periodicList index (phase) to begin Qh linking */
-	for (i = 0; i < qh->period && i < EHCI_PERIODIC_SIZE; i++) {
-		n = 0;
-		/* Count Qhs linked to this periodic index */
-		tmp = ehci->periodicNodes[i];
-		while (tmp != NULL) {
-			n++;
-			tmp = tmp->next;
+
+int ehci_bandAlloc(ehci_t *ehci, ehci_band_t *band, unsigned int nshifts)
+{
+	unsigned int period = min(band->period, EHCI_BAND_FRAMES);
+	unsigned int phase, shift, f, u, hs, fs, tt, frame, score, best = (unsigned)-1;
+	unsigned int bestPhase = 0, bestShift = 0, ttCost = ehci_ttCost(band);
+	uint8_t umask, ttmask;
+
+	for (phase = 0; phase < period; phase++) {
+		for (shift = 0; shift < nshifts; shift++) {
+			umask = band->umask << shift;
+			ttmask = band->ttmask << shift;
+			hs = 0;
+			fs = 0;
+			tt = 0;
+
+			/* Peak load of the frames and microframes used by the reservation */
+			for (f = phase; f < EHCI_BAND_FRAMES; f += period) {
+				frame = 0;
+				for (u = 0; u < 8; u++) {
+					if ((umask & (1 << u)) != 0)
+						hs = max(hs, ehci->hsLoad[f][u] + band->hsCost);
+
+					if (band->tt != NULL) {
+						frame += band->tt->load[f][u];
+						if ((ttmask & (1 << u)) != 0)
+							tt = max(tt, band->tt->load[f][u] + ttCost);
+					}
+				}
+				fs = max(fs, frame + band->fsCost);
+			}
+
+			/* Score is the most loaded bus in per mille of its budget */
+			score = max(hs * 1000 / EHCI_HS_UFRAME_BYTES, fs * 1000 / EHCI_FS_FRAME_BYTES);
+			score = max(score, tt * 1000 / EHCI_TT_UFRAME_BYTES);
+			if (score < best) {
+				best = score;
+				bestPhase = phase;
+				bestShift = shift;
+			}
+		}
+	}
+
+	band->phase = bestPhase;
+	band->umask <<= bestShift;
+	band->cmask <<= bestShift;
+	band->ttmask <<= bestShift;
+
+	return (best > 1000) ? -ENOSPC : 0;
+}
+
+
+void ehci_bandUpdate(ehci_t *ehci, const ehci_band_t *band, int sign)
+{
+	unsigned int period = min(band->period, EHCI_BAND_FRAMES);
+	unsigned int f, u, ttCost = ehci_ttCost(band);
+
+	for (f = band->phase; f < EHCI_BAND_FRAMES; f += period) {
+		for (u = 0; u < 8; u++) {
+			if ((band->umask & (1 << u)) != 0)
+				ehci->hsLoad[f][u] += sign * band->hsCost;
+			if (band->tt != NULL && (band->ttmask & (1 << u)) != 0)
+				band->tt->load[f][u] += sign * ttCost;
 		}
+	}
+}
 
-		if (n < best) {
-			best = n;
-			qh->phase = i;
+
+ehci_tt_t *ehci_ttGet(ehci_t *ehci, usb_dev_t *dev, unsigned int *hubaddr, unsigned int *port)
+{
+	ehci_tt_t *tt;
+	int ttport;
+
+	dev = ehci_ttDev(dev, hubaddr, port);
+
+	/* Embedded TT is per root port, external hubs are assumed to have a single TT */
+	ttport = usb_isRoothub(dev->hub) ? dev->port : 0;
+
+	for (tt = ehci->tts; tt != NULL; tt = tt->next) {
+		if (tt->hub == dev->hub && tt->port == ttport) {
+			tt->refs++;
+			return tt;
 		}
 	}
 
-	/* Find the best microframe in a frame. For periods equal to 1, send it every microframe */
-	if ((qh->hw->info[0] & QH_HIGH_SPEED) && qh->period > 1) {
-		for (tmp = ehci->periodicNodes[qh->phase]; tmp != NULL; tmp = tmp->next) {
-			if (tmp->uframe != 0xff)
-				ucnt[tmp->uframe]++;
+	if ((tt = calloc(1, sizeof(*tt))) == NULL)
+		return NULL;
+
+	tt->hub = dev->hub;
+	tt->port = ttport;
+	tt->refs = 1;
+	tt->next = ehci->tts;
+	ehci->tts = tt;
+
+	return tt;
+}
+
+
+void ehci_ttPut(ehci_t *ehci, ehci_tt_t *tt)
+{
+	ehci_tt_t **link;
+
+	if (--tt->refs > 0)
+		return;
+
+	for (link = &ehci->tts; *link != NULL; link = &(*link)->next) {
+		if (*link == tt) {
+			*link = tt->next;
+			break;
 		}
+	}
+	free(tt);
+}
 
-		best = (unsigned)-1;
-		qh->uframe = 0;
-		for (i = 0; i < 8; i++) {
-			if (ucnt[i] < best) {
-				qh->uframe = i;
-				best = ucnt[i];
-			}
+
+volatile uint32_t *ehci_periodicLink(ehci_t *ehci, unsigned int frame)
+{
+	ehci_isotd_t *td = ehci->isoNodes[frame];
+
+	if (td == NULL)
+		return &ehci->periodicList[frame];
+
+	while (td->next != NULL)
+		td = td->next;
+
+	/* Isochronous descriptors 'next' link is the first word of both itd and sitd */
+	return (volatile uint32_t *)td->hw.itd;
+}
+
+
+static int ehci_qhBandAlloc(ehci_t *ehci, ehci_qh_t *qh, usb_dev_t *dev)
+{
+	unsigned int maxp = QH_PACKLEN(qh->hw->info[0]), nshifts = 1, n, hubaddr, port;
+
+	qh->band.period = qh->period;
+	qh->band.umask = 0;
+	qh->band.cmask = 0;
+	qh->band.ttmask = 0;
+	qh->band.hsCost = 0;
+	qh->band.fsCost = 0;
+	qh->band.tt = NULL;
+
+	if (qh->hw->info[0] & QH_HIGH_SPEED) {
+		/* For periods equal to 1, send it every microframe */
+		qh->band.umask = (qh->period > 1) ? 0x01 : 0xff;
+		nshifts = (qh->period > 1) ? 8 : 1;
+		qh->band.hsCost = maxp + EHCI_HS_OVERHEAD;
+
+		/* High-speed interrupt endpoints are linked even if over budget, as before the bandwidth accounting */
+		if (ehci_bandAlloc(ehci, &qh->band, nshifts) < 0)
+			log_debug("periodic bandwidth exceeded");
+	}
+	else {
+		qh->band.fsCost = (maxp + EHCI_FS_OVERHEAD) * ((qh->hw->info[0] & QH_LOW_SPEED) ? 8 : 1);
+
+		/* Start-split in microframe N, transaction on the TT bus from N + 1, three complete-splits after it */
+		n = (qh->band.fsCost + EHCI_TT_UFRAME_BYTES - 1) / EHCI_TT_UFRAME_BYTES;
+		if (n > 4)
+			return -ENOSPC;
+
+		qh->band.ttmask = ((1 << n) - 1) << 1;
+		qh->band.cmask = ((1 << (n + 2)) - 1) << 2;
+		qh->band.umask = 0x01 | qh->band.cmask;
+		qh->band.hsCost = min(maxp, SPLIT_MAX_BYTES) + EHCI_HS_OVERHEAD;
+		nshifts = 5 - n;
+
+		if ((qh->band.tt = ehci_ttGet(ehci, dev, &hubaddr, &port)) == NULL)
+			return -ENOMEM;
+
+		if (ehci_bandAlloc(ehci, &qh->band, nshifts) < 0) {
+			log_error("no split transactions bandwidth for interrupt endpoint %u", QH_EPNUM(qh->hw->info[0]));
+			ehci_ttPut(ehci, qh->band.tt);
+			qh->band.tt = NULL;
+			return -ENOSPC;
 		}
 	}
+	ehci_bandUpdate(ehci, &qh->band, 1);
+
+	qh->phase = qh->band.phase;
+	qh->uframe = (qh->band.umask == 0xff || qh->band.umask == 0) ? 0xff : __builtin_ctz(qh->band.umask);
+
+	return 0;
 }
 
 
-static void ehci_qhLinkPeriodic(hcd_t *hcd, ehci_qh_t *qh)
+static int ehci_qhLinkPeriodic(hcd_t *hcd, ehci_qh_t *qh, usb_dev_t *dev)
 {
 	ehci_t *ehci = (ehci_t *)hcd->priv;
 	ehci_qh_t *t;
-	int i;
+	int i, err;
 
 	mutexLock(ehci->periodicLock);
-	ehci_bandAlloc(ehci, qh);
-	qh->hw->info[1] = (qh->uframe != 0xff) ? (1 << qh->uframe) : QH_SMASK;
-	qh->hw->info[1] |= QH_CMASK;
-	/* TODO: Handle SPLIT transactions */
+	if ((err = ehci_qhBandAlloc(ehci, qh, dev)) < 0) {
+		mutexUnlock(ehci->periodicLock);
+		return err;
+	}
+
+	qh->hw->info[1] &= (QH_HUBADDR | QH_HUBPORT);
+	if (qh->band.tt != NULL) {
+		qh->hw->info[1] |= (qh->band.umask & ~qh->band.cmask) | (qh->band.cmask << 8);
+	}
+	else {
+		qh->hw->info[1] |= (qh->uframe != 0xff) ? (1 << qh->uframe) : QH_SMASK;
+		qh->hw->info[1] |= QH_CMASK;
+	}
 
 	t = ehci->periodicNodes[qh->phase];
 	while (t != NULL && t->next != NULL && t->next->period >= qh->period)
@@ -426,10 +719,12 @@ static void ehci_qhLinkPeriodic(hcd_t *hcd, ehci_qh_t *qh)
 	if (t == NULL || t->period < qh->period) {
 		/* New first element */
 		qh->next = ehci->periodicNodes[qh->phase];
+		if (qh->next != NULL)
+			qh->hw->horizontal = QH_PTR(qh->next);
 
 		for (i = qh->phase; i < EHCI_PERIODIC_SIZE; i += qh->period) {
 			ehci->periodicNodes[i] = qh;
-			ehci->periodicList[i] = QH_PTR(qh);
+			*ehci_periodicLink(ehci, i) = QH_PTR(qh);
 		}
 	}
 	else {
@@ -446,6 +741,8 @@ static void ehci_qhLinkPeriodic(hcd_t *hcd, ehci_qh_t *qh)
 	}
 	ehci_memDmb();
 	mutexUnlock(ehci->periodicLock);
+
+	return EOK;
 }
 
 
@@ -475,6 +772,10 @@ static void ehci_qtdsDeactivate(ehci_qtd_t *qtds)
 	ehci_qtd_t *e = qtds;
 
 	if (e != NULL) {
+		/* Deactivated transfer may be queued behind an unfinished one */
+		if (e->qh != NULL)
+			e->qh->scanAll = 1;
+
 		do {
 			e->hw->token &= ~QTD_ACTIVE;
 		} while ((e = e->next) != qtds);
@@ -483,20 +784,74 @@ static void ehci_qtdsDeactivate(ehci_qtd_t *qtds)
 }
 
 
+/* Called with asyncLock taken */
+static void ehci_iaaRing(ehci_t *ehci)
+{
+	ehci->iaaRung = 1;
+	*(ehci->opbase + usbcmd) |= USBCMD_IAA;
+}
+
+
+/* Doorbell answered, the controller dropped cached qhs unlinked before it was rung */
+static void ehci_iaaDoneHandle(ehci_t *ehci)
+{
+	mutexLock(ehci->asyncLock);
+	if (ehci->iaaRung) {
+		ehci->iaaDone++;
+		ehci->iaaRung = 0;
+
+		/* Unlinks made while it was in progress are covered by the next one */
+		if ((int)(ehci->iaaWant - ehci->iaaDone) > 0)
+			ehci_iaaRing(ehci);
+
+		condBroadcast(ehci->asyncCond);
+	}
+	mutexUnlock(ehci->asyncLock);
+}
+
+
+/*
+ * The qh is removed from the schedule without stopping it, traffic of other
+ * devices keeps going. Before the qh and its qtds may be reused the controller
+ * has to drop its cached copy, which is confirmed by the async advance doorbell.
+ * Unlinks done at the same time share a doorbell.
+ */
 static void ehci_qhUnlinkAsync(hcd_t *hcd, ehci_qh_t *qh)
 {
 	ehci_t *ehci = (ehci_t *)hcd->priv;
+	unsigned int want;
 
 	mutexLock(ehci->asyncLock);
 
-	ehci_stopAsync(hcd);
+	/* qh keeps its horizontal link, the controller may still be walking through it */
 	qh->prev->hw->horizontal = qh->hw->horizontal;
-	ehci_startAsync(hcd);
 	ehci_memDmb();
 
 	qh->prev->next = qh->next;
 	qh->next->prev = qh->prev;
 
+	/* Doorbell in progress might have been rung before the unlink */
+	want = ehci->iaaDone + (ehci->iaaRung ? 2 : 1);
+	if ((int)(want - ehci->iaaWant) > 0)
+		ehci->iaaWant = want;
+
+	if (!ehci->iaaRung)
+		ehci_iaaRing(ehci);
+
+	while ((int)(want - ehci->iaaDone) > 0) {
+		if (condWait(ehci->asyncCond, ehci->asyncLock, EHCI_IAA_TIMEOUT) == -ETIME) {
+			/* Doorbell lost, stopped schedule guarantees no qh is cached */
+			log_error("async advance doorbell timeout");
+			ehci_stopAsync(hcd);
+			ehci_startAsync(hcd);
+			*(ehci->opbase + usbsts) = USBSTS_IAA;
+			ehci->iaaDone = ehci->iaaWant;
+			ehci->iaaRung = 0;
+			condBroadcast(ehci->asyncCond);
+			break;
+		}
+	}
+
 	mutexUnlock(ehci->asyncLock);
 }
 
@@ -515,10 +870,10 @@ void ehci_qhUnlinkPeriodic(hcd_t *hcd, ehci_qh_t *qh)
 
 		if (tmp == qh) {
 			if (qh->next != NULL) {
-				ehci->periodicList[i] = QH_PTR(qh->next);
+				*ehci_periodicLink(ehci, i) = QH_PTR(qh->next);
 			}
 			else {
-				ehci->periodicList[i] = QH_PTR_INVALID;
+				*ehci_periodicLink(ehci, i) = QH_PTR_INVALID;
 			}
 			ehci->periodicNodes[i] = qh->next;
 		}
@@ -537,6 +892,11 @@ void ehci_qhUnlinkPeriodic(hcd_t *hcd, ehci_qh_t *qh)
 			}
 		}
 	}
+	ehci_bandUpdate(ehci, &qh->band, -1);
+	if (qh->band.tt != NULL) {
+		ehci_ttPut(ehci, qh->band.tt);
+		qh->band.tt = NULL;
+	}
 	ehci_memDmb();
 	mutexUnlock(ehci->periodicLock);
 }
@@ -594,33 +954,121 @@ static int ehci_qtdsCheck(hcd_t *hcd, usb_transfer_t *t, int *status)
 }
 
 
+static void ehci_transFinish(usb_transfer_t **done, int *status, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		usb_transferFinished(done[i], status[i]);
+}
+
+
 static void ehci_transUpdate(hcd_t *hcd)
 {
-	ehci_qh_t *qh;
-	ehci_qtd_t *qtd;
-	usb_transfer_t *t, *n;
-	int cont;
-	int status;
+	ehci_t *ehci = (ehci_t *)hcd->priv;
+	usb_transfer_t *t, *done[EHCI_DONE_BATCH];
+	int status[EHCI_DONE_BATCH];
+	ehci_qtd_t *qtd, *prev, **plink;
+	ehci_qh_t *qh, **alink;
+	unsigned int nbulk = 0, nother = 0;
+	int n = 0, st;
+
+	/* Transfers on a qh are processed in order, only the first unfinished one has to be checked */
+	alink = &ehci->activeQhs;
+	while ((qh = *alink) != NULL) {
+		prev = NULL;
+		plink = &qh->pending;
+		while ((qtd = *plink) != NULL) {
+			t = qtd->transfer;
+
+			if (!ehci_qtdsCheck(hcd, t, &st)) {
+				if (!qh->scanAll)
+					break;
+
+				prev = qtd;
+				plink = &qtd->pnext;
+				continue;
+			}
 
-	if ((t = hcd->transfers) == NULL)
-		return;
+			*plink = qtd->pnext;
+			if (qh->pendingTail == qtd)
+				qh->pendingTail = prev;
 
-	do {
-		qtd = (ehci_qtd_t *)t->hcdpriv;
-		qh = qtd->qh;
-		cont = 0;
-		n = t->next;
-
-		if (ehci_qtdsCheck(hcd, t, &status)) {
-			ehci_continue(hcd->priv, qh, qtd->prev);
-			ehci_qtdsPut(hcd->priv, &qtd);
+			ehci_continue(ehci, qh, qtd->prev);
+			ehci_qtdsPut(ehci, &qtd);
 			LIST_REMOVE(&hcd->transfers, t);
 			t->hcdpriv = NULL;
-			usb_transferFinished(t, status);
-			if (n != t)
-				cont = 1;
+
+			if (t->type == usb_transfer_bulk)
+				nbulk++;
+			else
+				nother++;
+
+			/* Completions are reported in batches after descriptors bookkeeping */
+			done[n] = t;
+			status[n++] = st;
+			if (n == EHCI_DONE_BATCH) {
+				ehci_transFinish(done, status, n);
+				n = 0;
+			}
+		}
+		qh->scanAll = 0;
+
+		if (qh->pending == NULL) {
+			*alink = qh->anext;
+			qh->anext = NULL;
+			qh->active = 0;
+		}
+		else {
+			alink = &qh->anext;
 		}
-	} while (hcd->transfers && ((t = n) != hcd->transfers || cont));
+	}
+
+	ehci_transFinish(done, status, n);
+	ehci_isoUpdate(hcd);
+	ehci_itcAdapt(ehci, nbulk, nother);
+}
+
+
+/* Adds transfer to the qh pending transfers, called with hcd->transLock taken */
+static void ehci_transPending(ehci_t *ehci, ehci_qh_t *qh, ehci_qtd_t *qtds, usb_transfer_t *t)
+{
+	qtds->transfer = t;
+	qtds->pnext = NULL;
+
+	if (qh->pendingTail == NULL)
+		qh->pending = qtds;
+	else
+		qh->pendingTail->pnext = qtds;
+	qh->pendingTail = qtds;
+
+	if (!qh->active) {
+		qh->active = 1;
+		qh->anext = ehci->activeQhs;
+		ehci->activeQhs = qh;
+	}
+}
+
+
+/* Removes qh from the active list, called with hcd->transLock taken */
+static void ehci_transRemoveQh(ehci_t *ehci, ehci_qh_t *qh)
+{
+	ehci_qh_t **alink;
+
+	if (!qh->active)
+		return;
+
+	for (alink = &ehci->activeQhs; *alink != NULL; alink = &(*alink)->anext) {
+		if (*alink == qh) {
+			*alink = qh->anext;
+			break;
+		}
+	}
+
+	qh->anext = NULL;
+	qh->active = 0;
+	qh->pending = NULL;
+	qh->pendingTail = NULL;
 }
 
 
@@ -691,6 +1139,11 @@ static void ehci_irqThread(void *arg)
 			mutexUnlock(hcd->transLock);
 		}
 
+		if (ehci->status & USBSTS_IAA) {
+			ehci->status &= ~USBSTS_IAA;
+			ehci_iaaDoneHandle(ehci);
+		}
+
 		if (ehci->status & USBSTS_PCI) {
 			ehci->status &= ~USBSTS_PCI;
 			ehci_portStatusChanged(hcd);
@@ -718,6 +1171,11 @@ static int ehci_qtdAdd(ehci_t *ehci, ehci_qtd_t **list, int token, size_t maxpac
 
 static void ehci_transferDequeue(hcd_t *hcd, usb_transfer_t *t)
 {
+	if (t->type == usb_transfer_isochronous) {
+		ehci_isoDequeue(hcd, t);
+		return;
+	}
+
 	mutexLock(hcd->transLock);
 	/* note: not tested for interrupt transfers */
 	if (t->hcdpriv != NULL)
@@ -731,22 +1189,28 @@ static int ehci_transferEnqueue(hcd_t *hcd, usb_transfer_t *t, usb_pipe_t *pipe)
 {
 	ehci_qh_t *qh;
 	ehci_qtd_t *qtds = NULL;
-	int token = t->direction == usb_dir_in ? in_token : out_token;
+	int token = t->direction == usb_dir_in ? in_token : out_token, err;
 
 	if (usb_isRoothub(pipe->dev))
 		return ehci_roothubReq(pipe->dev, t);
 
+	if (pipe->type == usb_transfer_isochronous)
+		return ehci_isoEnqueue(hcd, t, pipe);
+
 	if (pipe->hcdpriv == NULL) {
 		if ((qh = ehci_qhAlloc(hcd->priv)) == NULL)
 			return -ENOMEM;
 
 		ehci_qhConf(qh, pipe);
-		pipe->hcdpriv = qh;
 
-		if (t->type == usb_transfer_bulk || t->type == usb_transfer_control)
+		if (t->type == usb_transfer_bulk || t->type == usb_transfer_control) {
 			ehci_qhLinkAsync(hcd, qh);
-		else
-			ehci_qhLinkPeriodic(hcd, qh);
+		}
+		else if ((err = ehci_qhLinkPeriodic(hcd, qh, pipe->dev)) < 0) {
+			ehci_qhPut(hcd->priv, qh);
+			return err;
+		}
+		pipe->hcdpriv = qh;
 	}
 	else {
 		qh = (ehci_qh_t *)pipe->hcdpriv;
@@ -803,6 +1267,7 @@ static int ehci_transferEnqueue(hcd_t *hcd, usb_transfer_t *t, usb_pipe_t *pipe)
 
 	mutexLock(hcd->transLock);
 	LIST_ADD(&hcd->transfers, t);
+	ehci_transPending(hcd->priv, qh, qtds, t);
 	ehci_enqueue(hcd, qh, qtds, qtds->prev);
 	mutexUnlock(hcd->transLock);
 
@@ -819,6 +1284,11 @@ static void ehci_pipeDestroy(hcd_t *hcd, usb_pipe_t *pipe)
 	if (pipe->hcdpriv == NULL)
 		return;
 
+	if (pipe->type == usb_transfer_isochronous) {
+		ehci_isoDestroy(hcd, pipe);
+		return;
+	}
+
 	qh = (ehci_qh_t *)pipe->hcdpriv;
 
 	if (pipe->type == usb_transfer_bulk || pipe->type == usb_transfer_control)
@@ -838,6 +1308,7 @@ static void ehci_pipeDestroy(hcd_t *hcd, usb_pipe_t *pipe)
 		} while (t != hcd->transfers);
 		ehci_transUpdate(hcd);
 	}
+	ehci_transRemoveQh(hcd->priv, qh);
 	mutexUnlock(hcd->transLock);
 
 	pipe->hcdpriv = NULL;
@@ -859,6 +1330,11 @@ static void ehci_free(ehci_t *ehci)
 	if (ehci->asyncLock != 0)
 		resourceDestroy(ehci->asyncLock);
 
+	if (ehci->asyncCond != 0)
+		resourceDestroy(ehci->asyncCond);
+
+	ehci_arenaFree(ehci);
+	free(ehci->isoNodes);
 	free(ehci->periodicNodes);
 	free(ehci);
 }
@@ -887,6 +1363,18 @@ static int ehci_init(hcd_t *hcd)
 		return -ENOMEM;
 	}
 
+	if ((ehci->isoNodes = calloc(EHCI_PERIODIC_SIZE, sizeof(ehci_isotd_t *))) == NULL) {
+		log_error("Out of memory!");
+		ehci_free(ehci);
+		return -ENOMEM;
+	}
+
+	if (ehci_arenaInit(ehci) < 0) {
+		log_error("Out of memory!");
+		ehci_free(ehci);
+		return -ENOMEM;
+	}
+
 	hcd->priv = ehci;
 
 	if (phy_init(hcd) != 0) {
@@ -913,6 +1401,12 @@ static int ehci_init(hcd_t *hcd)
 		return -ENOMEM;
 	}
 
+	if (condCreate(&ehci->asyncCond) < 0) {
+		log_error("Out of memory!");
+		ehci_free(ehci);
+		return -ENOMEM;
+	}
+
 	if (mutexCreate(&ehci->periodicLock) < 0) {
 		log_error("Out of memory!");
 		ehci_free(ehci);
@@ -989,7 +1483,7 @@ static int ehci_init(hcd_t *hcd)
 #endif
 
 	/* Enable interrupts */
-	*(ehci->opbase + usbintr) = USBSTS_UI | USBSTS_UEI | USBSTS_SEI;
+	*(ehci->opbase + usbintr) = USBSTS_UI | USBSTS_UEI | USBSTS_SEI | USBSTS_IAA;
 
 	/* Set periodic frame list */
 	*(ehci->opbase + periodiclistbase) = va2pa(ehci->periodicList);
@@ -1000,7 +1494,11 @@ static int ehci_init(hcd_t *hcd)
 #endif
 
 	/* Turn the controller on, enable periodic scheduling */
-	*(ehci->opbase + usbcmd) &= ~(USBCMD_LRESET | USBCMD_ASE);
+	*(ehci->opbase + usbcmd) &= ~(USBCMD_LRESET | USBCMD_ASE | USBCMD_ITCMASK);
+
+	ehci->itcAdaptive = (EHCI_ITC == 0);
+	ehci->itc = (EHCI_ITC == 0) ? 1 : EHCI_ITC;
+	*(ehci->opbase + usbcmd) |= USBCMD_ITC(ehci->itc);
 
 	*(ehci->opbase + usbcmd) |= (USBCMD_PSE | USBCMD_RUN);
 	while ((*(ehci->opbase + usbsts) & (USBSTS_HCH)) != 0)
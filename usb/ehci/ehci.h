@@ -41,7 +41,7 @@
 #define USBSTS_UEI   (1 << 1)
 #define USBSTS_UI    (1 << 0)
 
-#define EHCI_INTRMASK (USBSTS_SEI | USBSTS_PCI | USBSTS_UEI | USBSTS_UI)
+#define EHCI_INTRMASK (USBSTS_IAA | USBSTS_SEI | USBSTS_PCI | USBSTS_UEI | USBSTS_UI)
 
 #define USBCMD_RUN     (1 << 0)
 #define USBCMD_HCRESET (1 << 1)
@@ -49,6 +49,17 @@
 #define USBCMD_ASE     (1 << 5)
 #define USBCMD_IAA     (1 << 6)
 #define USBCMD_LRESET  (1 << 7)
+#define USBCMD_ITC(n)  ((n) << 16)
+#define USBCMD_ITCMASK (0xff << 16)
+
+/* Interrupt threshold [microframes], 0 selects adaptive mode */
+#ifndef EHCI_ITC
+#define EHCI_ITC 0
+#endif
+
+#define EHCI_ITC_MAX        64
+#define EHCI_ITC_ADAPT_MAX  16 /* Max threshold of the adaptive mode */
+#define EHCI_ITC_ADAPT_RAMP 8  /* Bulk only completion passes before the threshold is doubled */
 
 #define PORTSC_PTS_1 (3 << 30)
 #define PORTSC_STS   (1 << 29)
@@ -100,11 +111,39 @@
 #define QTD_PTR(addr)   ((uint32_t)va2pa((void *)(addr)->hw) & ~0x1f)
 #define QTD_PTR_INVALID 0x1
 
+#define ITD_ACTIVE    (1U << 31)
+#define ITD_BUFERR    (1 << 30)
+#define ITD_BABBLE    (1 << 29)
+#define ITD_XACT      (1 << 28)
+#define ITD_ERRMASK   (ITD_BUFERR | ITD_BABBLE | ITD_XACT)
+#define ITD_LEN(tr)   (((tr) >> 16) & 0xfff)
+#define ITD_IOC       (1 << 15)
+#define ITD_IN        (1 << 11)
+#define ITD_PTR(addr) (((uint32_t)va2pa((void *)(addr)->hw.itd) & ~0x1f) | 0x0)
+
+#define SITD_IN        (1U << 31)
+#define SITD_IOC       (1U << 31)
+#define SITD_LEN(st)   (((st) >> 16) & 0x3ff)
+#define SITD_ACTIVE    (1 << 7)
+#define SITD_ERR       (1 << 6)
+#define SITD_BUFERR    (1 << 5)
+#define SITD_BABBLE    (1 << 4)
+#define SITD_XACT      (1 << 3)
+#define SITD_MISSED    (1 << 2)
+#define SITD_ERRMASK   (SITD_ERR | SITD_BUFERR | SITD_BABBLE | SITD_XACT | SITD_MISSED)
+#define SITD_TP_ALL    (0 << 3)
+#define SITD_TP_BEGIN  (1 << 3)
+#define SITD_PTR(addr) (((uint32_t)va2pa((void *)(addr)->hw.sitd) & ~0x1f) | 0x4)
+#define SITD_BACK_INVALID 0x1
+
+#define SPLIT_MAX_BYTES 188 /* Full-speed bytes per microframe */
+
 #define EHCI_TRANS_ERRORS 3
 
 #define QH_CTRL           (1 << 27)
 #define QH_PACKLEN(info0) (((info0) >> 16) & 0x7ff)
 #define QH_DEVADDR(info0) ((info0) & 0x7f)
+#define QH_EPNUM(info0)   (((info0) >> 8) & 0xf)
 #define QH_HEAD           (1 << 15)
 #define QH_DT             (1 << 14)
 #define QH_HIGH_SPEED     (2 << 12)
@@ -127,12 +166,33 @@
 #define HCCPARAMS_64BIT_ADDRS (1 << 0)
 
 
+#ifdef EHCI_IMX
+#define EHCI_PERIODIC_SIZE 128
+#else
+#define EHCI_PERIODIC_SIZE 1024
+#endif
+
 #define EHCI_PAGE_SIZE        4096
 #define EHCI_PERIODIC_ALIGN   4096
 #define EHCI_MAX_QTD_BUF_SIZE (4 * EHCI_PAGE_SIZE)
 
-#define EHCI_MAX_QTD_POOL 20
-#define EHCI_MAX_QH_POOL  10
+/* Periodic bandwidth is accounted over EHCI_BAND_FRAMES frames, longer periods are treated as this one */
+#define EHCI_BAND_FRAMES     32
+#define EHCI_HS_UFRAME_BYTES 6000 /* 80% of a high-speed microframe */
+#define EHCI_FS_FRAME_BYTES  1350 /* 90% of a full-speed frame */
+#define EHCI_HS_OVERHEAD     38   /* Protocol overhead per high-speed transaction [bytes] */
+#define EHCI_FS_OVERHEAD     13   /* Protocol overhead per full-speed transaction [bytes] */
+#define EHCI_TT_UFRAME_BYTES 188  /* Full-speed bytes a transaction translator moves per microframe */
+#define EHCI_ISO_SLOP        4    /* Min frames between now and the first frame of a new schedule */
+
+/* Preallocated descriptors, allocations beyond them fall back to the allocator */
+#ifndef EHCI_QTD_ARENA
+#define EHCI_QTD_ARENA 256
+#endif
+
+#ifndef EHCI_QH_ARENA
+#define EHCI_QH_ARENA 32
+#endif
 
 
 /* clang-format off */
@@ -179,18 +239,63 @@ enum {
 /* TODO: buf_hi is required only on ia32 if hcd is capable of 64-bit addressing
  * Shrink it on smaller targets to save memory? */
 
+/* Power of 2 sizes keep the arena descriptors within a page */
 struct qtd {
 	uint32_t next;
 	uint32_t altnext;
 	uint32_t token;
 	uint32_t buf[5];
 	uint32_t buf_hi[5];
-};
+} __attribute__((aligned(64)));
 
 
 #define EHCI_QH_NBUFS 5
 
 
+/* High-speed isochronous transfer descriptor */
+struct itd {
+	uint32_t next;
+	uint32_t transaction[8];
+	uint32_t buf[7];
+	uint32_t buf_hi[7];
+} __attribute__((aligned(128)));
+
+
+/* Split transaction isochronous transfer descriptor */
+struct sitd {
+	uint32_t next;
+	uint32_t epchar;
+	uint32_t uframe;
+	uint32_t status;
+	uint32_t buf[2];
+	uint32_t back;
+	uint32_t buf_hi[2];
+} __attribute__((aligned(64)));
+
+
+/* Transaction translator of full/low-speed devices, the (embedded) root hub port or a high-speed hub */
+typedef struct _ehci_tt {
+	struct _ehci_tt *next;
+	usb_dev_t *hub;
+	int port;                               /* Root hub port, 0 for external hubs (single TT) */
+	unsigned int refs;
+	uint16_t load[EHCI_BAND_FRAMES][8];     /* Reserved full-speed bytes per microframe */
+} ehci_tt_t;
+
+
+/* Periodic bandwidth reservation */
+typedef struct {
+	unsigned int period; /* [frames] */
+	unsigned int phase;  /* [frames] */
+	uint8_t umask;       /* Microframes used in every scheduled frame */
+	uint8_t cmask;       /* Complete-split microframes (subset of umask), shifted with umask */
+	uint8_t ttmask;      /* Microframes of the full-speed transaction behind the TT */
+	uint16_t hsCost;     /* High-speed bytes per used microframe */
+	uint16_t fsCost;     /* Full-speed bytes per scheduled frame */
+	ehci_tt_t *tt;       /* Full/low-speed only, the TT the split transactions go through */
+} ehci_band_t;
+
+
 struct qh {
 	uint32_t horizontal;
 	uint32_t info[2];
@@ -202,7 +307,7 @@ struct qh {
 	uint32_t token;
 	uint32_t buf[EHCI_QH_NBUFS];
 	uint32_t buf_hi[EHCI_QH_NBUFS];
-};
+} __attribute__((aligned(128)));
 
 
 typedef struct _ehci_qtd {
@@ -211,6 +316,10 @@ typedef struct _ehci_qtd {
 	struct _ehci_qh *qh;
 	uint32_t paddr;
 	size_t bytes;
+
+	/* First qtd of a transfer only */
+	struct _ehci_qtd *pnext; /* First qtd of the next pending transfer on the qh */
+	usb_transfer_t *transfer;
 } ehci_qtd_t;
 
 
@@ -221,9 +330,68 @@ typedef struct _ehci_qh {
 	unsigned period; /* [ms], interrupt transfer only */
 	unsigned phase;  /* [ms], interrupt transfer only */
 	unsigned uframe; /* interrupt transfer and high-speed only */
+
+	/* Pending transfers in submission order, their last (IOC) qtd is pending->prev */
+	struct _ehci_qtd *pending, *pendingTail;
+	struct _ehci_qh *anext; /* Next qh with pending transfers */
+	int active;             /* qh is on the active list */
+	int scanAll;            /* Transfers have been deactivated, check all of them */
+
+	ehci_band_t band; /* interrupt transfer only */
 } ehci_qh_t;
 
 
+typedef struct _ehci_isotd {
+	struct _ehci_isotd *next;  /* Next isochronous descriptor linked in the same frame */
+	struct _ehci_isotd *tnext; /* Next descriptor of the transfer */
+	union {
+		volatile struct itd *itd;
+		volatile struct sitd *sitd;
+	} hw;
+	unsigned int frame;
+	unsigned int npkts;
+} ehci_isotd_t;
+
+
+typedef struct _ehci_isoreq {
+	struct _ehci_isoreq *next;
+	struct _ehci_iso *iso;
+	usb_transfer_t *transfer;
+	ehci_isotd_t *tds, *last;
+	int cancel;
+} ehci_isoreq_t;
+
+
+/* Isochronous endpoint stream */
+typedef struct _ehci_iso {
+	struct _ehci_iso *next;
+	ehci_isoreq_t *pending, *pendingTail;
+	ehci_band_t band;
+	int hs;
+	int in;
+	unsigned int devaddr;
+	unsigned int ep;
+	unsigned int maxp;
+	unsigned int mult;
+	unsigned int pktsz;     /* Max bytes per (micro)frame */
+	unsigned int pktStride; /* [microframes] high-speed, packets interval within frame */
+	unsigned int tdStride;  /* [frames] between descriptors */
+	unsigned int tdPkts;    /* Max packets per descriptor */
+	uint8_t smask, cmask;   /* Split transactions masks, full-speed only */
+	unsigned int ttaddr;    /* Split transactions hub address and port, full-speed only */
+	unsigned int ttport;
+	unsigned int nextFrame;
+} ehci_iso_t;
+
+
+/* Lock-free free list of arena descriptors */
+typedef struct {
+	uint32_t head;       /* ABA tag (upper 16 bits), index + 1 of the first free entry (0 - empty) */
+	uint16_t *next;      /* Index + 1 of the next free entry for each entry */
+	unsigned int misses; /* Allocations which didn't fit in the arena */
+} ehci_pool_t;
+
+
 typedef struct {
 	char stack[1024] __attribute__((aligned(8)));
 
@@ -231,12 +399,29 @@ typedef struct {
 	ehci_qh_t *asyncList;
 	ehci_qh_t **periodicNodes;
 
-	ehci_qh_t *qhPool;
-	size_t nqhs;
-	ehci_qtd_t *qtdPool;
-	size_t nqtds;
-
-	handle_t irqCond, irqHandle, irqLock, asyncLock, periodicLock;
+	ehci_pool_t qhPool;
+	ehci_qh_t *qhs;              /* QH arena */
+	volatile struct qh *qhsHw;   /* QH arena hardware descriptors */
+	ehci_pool_t qtdPool;
+	ehci_qtd_t *qtds;            /* qTD arena */
+	volatile struct qtd *qtdsHw; /* qTD arena hardware descriptors */
+	ehci_qh_t *activeQhs;        /* qhs with pending transfers, protected by hcd->transLock */
+	ehci_iso_t *isoStreams;      /* Isochronous streams, protected by hcd->transLock */
+	ehci_isotd_t **isoNodes;     /* Isochronous descriptors linked in front of qhs in each frame */
+
+	uint16_t hsLoad[EHCI_BAND_FRAMES][8]; /* Reserved high-speed bytes per microframe */
+	ehci_tt_t *tts;                       /* Transaction translators in use, protected by periodicLock */
+
+	unsigned int itc;      /* Current interrupt threshold [microframes] */
+	int itcAdaptive;       /* Threshold follows the traffic */
+	unsigned int itcRamp;  /* Consecutive bulk only completion passes */
+
+	/* Async advance doorbell, protected by asyncLock */
+	unsigned int iaaDone;  /* Completed doorbells */
+	unsigned int iaaWant;  /* Doorbells needed by unlinked qhs */
+	int iaaRung;           /* Doorbell in progress */
+
+	handle_t irqCond, irqHandle, irqLock, asyncLock, asyncCond, periodicLock;
 	volatile unsigned portResetChange;
 	volatile unsigned status;
 
@@ -245,6 +430,16 @@ typedef struct {
 } ehci_t;
 
 
+static inline void ehci_memDmb(void)
+{
+#ifdef EHCI_IMX
+	asm volatile("dmb" ::: "memory");
+#else
+	__sync_synchronize();
+#endif
+}
+
+
 int phy_init(hcd_t *hcd);
 
 
@@ -257,4 +452,42 @@ int ehci_roothubReq(usb_dev_t *hub, usb_transfer_t *t);
 uint32_t ehci_getHubStatus(usb_dev_t *hub);
 
 
+/* Sets interrupt threshold (1, 2, 4, ..., 64 microframes), 0 selects adaptive mode:
+ * raised under sustained bulk traffic, lowered to 1 on interrupt and control completions */
+int ehci_intrThreshold(hcd_t *hcd, unsigned int uframes);
+
+
+/* Finds the least loaded phase and umask shift (< nshifts) for the reservation, -ENOSPC if it doesn't fit,
+ * split reservations (band->tt != NULL) must also fit in their TT microframe and frame budget */
+int ehci_bandAlloc(ehci_t *ehci, ehci_band_t *band, unsigned int nshifts);
+
+
+/* Adds (sign > 0) or removes bandwidth reservation */
+void ehci_bandUpdate(ehci_t *ehci, const ehci_band_t *band, int sign);
+
+
+/* Returns the TT of a full/low-speed device and its hub address and port, called with ehci->periodicLock taken */
+ehci_tt_t *ehci_ttGet(ehci_t *ehci, usb_dev_t *dev, unsigned int *hubaddr, unsigned int *port);
+
+
+void ehci_ttPut(ehci_t *ehci, ehci_tt_t *tt);
+
+
+/* Returns the frame link pointing to the first qh, called with ehci->periodicLock taken */
+volatile uint32_t *ehci_periodicLink(ehci_t *ehci, unsigned int frame);
+
+
+int ehci_isoEnqueue(hcd_t *hcd, usb_transfer_t *t, usb_pipe_t *pipe);
+
+
+void ehci_isoDequeue(hcd_t *hcd, usb_transfer_t *t);
+
+
+/* Completes finished isochronous transfers, called with hcd->transLock taken */
+void ehci_isoUpdate(hcd_t *hcd);
+
+
+void ehci_isoDestroy(hcd_t *hcd, usb_pipe_t *pipe);
+
+
 #endif /* _USB_EHCI_H_ */
@@ -38,18 +38,15 @@ struct {
 } imx_common;
 
 
-int usbclient_send(int endpt, const void *data, unsigned int len)
+static int usbclient_sendEndp0(const void *data, unsigned int len)
 {
 	dtd_t *res;
 
 	if (len > USB_BUFFER_SIZE)
 		return -1;
 
-	if (!imx_common.data.endpts[endpt].caps[USB_ENDPT_DIR_IN].init)
-		return -1;
-
-	memcpy(imx_common.data.endpts[endpt].buf[USB_ENDPT_DIR_IN].vBuffer, data, len);
-	res = ctrl_execTransfer(endpt, imx_common.data.endpts[endpt].buf[USB_ENDPT_DIR_IN].pBuffer, len, USB_ENDPT_DIR_IN);
+	memcpy(imx_common.data.endpts[0].buf[USB_ENDPT_DIR_IN].vBuffer, data, len);
+	res = ctrl_execTransfer(0, imx_common.data.endpts[0].buf[USB_ENDPT_DIR_IN].pBuffer, len, USB_ENDPT_DIR_IN);
 
 	if (res == NULL || DTD_ERROR(res))
 		return -1;
@@ -58,6 +55,105 @@ int usbclient_send(int endpt, const void *data, unsigned int len)
 }
 
 
+static usb_xfer_t *usbclient_xferFind(int endpt, int dir, const void *buf)
+{
+	usb_xfer_t *xfer = imx_common.data.endpts[endpt].xfer[dir];
+	int i;
+
+	for (i = 0; i < USB_XFER_BUFS; ++i) {
+		if (xfer[i].vBuffer == buf)
+			return &xfer[i];
+	}
+
+	return NULL;
+}
+
+
+void *usbclient_getBuff(int endpt, unsigned int *size)
+{
+	endpt_data_t *ep;
+	usb_xfer_t *xfer;
+	int res;
+
+	if ((endpt <= 0) || (endpt >= ENDPOINTS_NUMBER))
+		return NULL;
+
+	ep = &imx_common.data.endpts[endpt];
+	if (!ep->caps[USB_ENDPT_DIR_IN].init)
+		return NULL;
+
+	/* Wait until the buffer sent before the previous one is free */
+	xfer = &ep->xfer[USB_ENDPT_DIR_IN][ep->xferNext[USB_ENDPT_DIR_IN]];
+	if (xfer->dtd != NULL) {
+		res = ctrl_waitTransfer(endpt, USB_ENDPT_DIR_IN, xfer->dtd);
+		xfer->dtd = NULL;
+
+		/* Report failure of the earlier transfer */
+		if (res < 0)
+			return NULL;
+	}
+
+	*size = USB_XFER_SIZE;
+
+	return xfer->vBuffer;
+}
+
+
+int usbclient_sendBuff(int endpt, void *buf, unsigned int len)
+{
+	endpt_data_t *ep;
+	usb_xfer_t *xfer;
+
+	if ((endpt <= 0) || (endpt >= ENDPOINTS_NUMBER) || (len > USB_XFER_SIZE))
+		return -1;
+
+	ep = &imx_common.data.endpts[endpt];
+	xfer = &ep->xfer[USB_ENDPT_DIR_IN][ep->xferNext[USB_ENDPT_DIR_IN]];
+
+	/* Buffers are sent in the order they are handed out */
+	if ((xfer->vBuffer != buf) || (xfer->dtd != NULL))
+		return -1;
+
+	ep->xferNext[USB_ENDPT_DIR_IN] = (ep->xferNext[USB_ENDPT_DIR_IN] + 1) % USB_XFER_BUFS;
+
+	xfer->len = len;
+	xfer->dtd = ctrl_queueTransfer(endpt, xfer->pBuffer, len, USB_ENDPT_DIR_IN);
+	if (xfer->dtd == NULL)
+		return -1;
+
+	return len;
+}
+
+
+/* Data is split into transfer buffers queued one after another, returns once all of it is queued */
+int usbclient_send(int endpt, const void *data, unsigned int len)
+{
+	unsigned int done = 0, sz;
+	void *buf;
+
+	if ((endpt < 0) || (endpt >= ENDPOINTS_NUMBER) || !imx_common.data.endpts[endpt].caps[USB_ENDPT_DIR_IN].init)
+		return -1;
+
+	if (endpt == 0)
+		return usbclient_sendEndp0(data, len);
+
+	do {
+		if ((buf = usbclient_getBuff(endpt, &sz)) == NULL)
+			return -1;
+
+		sz = MIN(len - done, sz);
+		memcpy(buf, (const char *)data + done, sz);
+
+		if (usbclient_sendBuff(endpt, buf, sz) < 0)
+			return -1;
+
+		done += sz;
+	} while (done < len);
+
+	return len;
+}
+
+
 static int usbclient_rcvEndp0(void *data, unsigned int len)
 {
 	int res = -1;
@@ -81,30 +177,103 @@ static int usbclient_rcvEndp0(void *data, unsigned int len)
 }
 
 
+/* All free transfer buffers are queued, so the host can send while the previous data is processed */
+static int usbclient_rcvPrime(int endpt)
+{
+	endpt_data_t *ep = &imx_common.data.endpts[endpt];
+	usb_xfer_t *xfer;
+	int i;
+
+	for (i = 0; i < USB_XFER_BUFS; ++i) {
+		xfer = &ep->xfer[USB_ENDPT_DIR_OUT][(ep->xferNext[USB_ENDPT_DIR_OUT] + i) % USB_XFER_BUFS];
+		if ((xfer->dtd != NULL) || xfer->held)
+			continue;
+
+		/* The controller fills buffers in the order they are queued */
+		if (i > 0 && ep->xfer[USB_ENDPT_DIR_OUT][(ep->xferNext[USB_ENDPT_DIR_OUT] + i - 1) % USB_XFER_BUFS].held)
+			break;
+
+		xfer->len = USB_XFER_SIZE;
+		xfer->dtd = ctrl_queueTransfer(endpt, xfer->pBuffer, USB_XFER_SIZE, USB_ENDPT_DIR_OUT);
+		if (xfer->dtd == NULL)
+			return -1;
+	}
+
+	return 0;
+}
+
+
+int usbclient_receiveBuff(int endpt, void **buf)
+{
+	endpt_data_t *ep;
+	usb_xfer_t *xfer;
+	int res;
+
+	if ((endpt <= 0) || (endpt >= ENDPOINTS_NUMBER))
+		return -1;
+
+	ep = &imx_common.data.endpts[endpt];
+	if (!ep->caps[USB_ENDPT_DIR_OUT].init)
+		return -1;
+
+	xfer = &ep->xfer[USB_ENDPT_DIR_OUT][ep->xferNext[USB_ENDPT_DIR_OUT]];
+	if (xfer->held || (usbclient_rcvPrime(endpt) < 0))
+		return -1;
+
+	res = ctrl_waitTransfer(endpt, USB_ENDPT_DIR_OUT, xfer->dtd);
+	xfer->dtd = NULL;
+	ep->xferNext[USB_ENDPT_DIR_OUT] = (ep->xferNext[USB_ENDPT_DIR_OUT] + 1) % USB_XFER_BUFS;
+
+	if (res < 0) {
+		usbclient_rcvPrime(endpt);
+		return -1;
+	}
+
+	xfer->held = 1;
+	*buf = xfer->vBuffer;
+
+	return xfer->len - res;
+}
+
+
+void usbclient_releaseBuff(int endpt, void *buf)
+{
+	usb_xfer_t *xfer;
+
+	if ((endpt <= 0) || (endpt >= ENDPOINTS_NUMBER))
+		return;
+
+	if ((xfer = usbclient_xferFind(endpt, USB_ENDPT_DIR_OUT, buf)) == NULL)
+		return;
+
+	/* Give the buffer back to the controller */
+	xfer->held = 0;
+	usbclient_rcvPrime(endpt);
+}
+
+
 int usbclient_receive(int endpt, void *data, unsigned int len)
 {
-	dtd_t *dtd;
+	void *buf;
 	int res;
 
 	if (len > USB_BUFFER_SIZE)
 		return -1;
 
-	if (!imx_common.data.endpts[endpt].caps[USB_ENDPT_DIR_OUT].init)
+	if ((endpt < 0) || (endpt >= ENDPOINTS_NUMBER) || !imx_common.data.endpts[endpt].caps[USB_ENDPT_DIR_OUT].init)
 		return -1;
 
 	if (endpt == 0)
 		return usbclient_rcvEndp0(data, len);
 
-	dtd = ctrl_execTransfer(endpt, imx_common.data.endpts[endpt].buf[USB_ENDPT_DIR_OUT].pBuffer, USB_BUFFER_SIZE, USB_ENDPT_DIR_OUT);
-
-	if (dtd == NULL || DTD_ERROR(dtd))
+	if ((res = usbclient_receiveBuff(endpt, &buf)) < 0)
 		return -1;
 
-	res = USB_BUFFER_SIZE - DTD_SIZE(dtd);
 	if (res > len)
 		res = len;
 
-	memcpy(data, (const char *)imx_common.data.endpts[endpt].buf[USB_ENDPT_DIR_OUT].vBuffer, res);
+	memcpy(data, (const char *)buf, res);
+	usbclient_releaseBuff(endpt, buf);
 
 	return res;
 }
@@ -163,23 +332,28 @@ static void usbclient_irqThread(void *arg)
 
 static void usbclient_cleanData(void)
 {
-	int i;
+	int i, dir;
 
 	usbclient_buffDestory((void *)imx_common.dc.base, USB_BUFFER_SIZE);
 	usbclient_buffDestory((void *)imx_common.data.setupMem, USB_BUFFER_SIZE);
 
-	usbclient_buffDestory((void *)imx_common.dc.dtdMem, USB_BUFFER_SIZE);
+	usbclient_buffDestory((void *)imx_common.dc.dtdMem, DTD_MEM_SIZE);
 	usbclient_buffDestory((void *)imx_common.dc.endptqh, USB_BUFFER_SIZE);
 
 	for (i = 0; i < ENDPOINTS_NUMBER; ++i) {
-		if (imx_common.data.endpts[i].caps[USB_ENDPT_DIR_IN].init) {
-			usbclient_buffDestory((void *)imx_common.data.endpts[i].buf[USB_ENDPT_DIR_IN].vBuffer, USB_BUFFER_SIZE);
-			imx_common.data.endpts[i].buf[USB_ENDPT_DIR_IN].vBuffer = NULL;
-		}
+		for (dir = 0; dir < ENDPOINTS_DIR_NB; ++dir) {
+			if (!imx_common.data.endpts[i].caps[dir].init)
+				continue;
 
-		if (imx_common.data.endpts[i].caps[USB_ENDPT_DIR_OUT].init) {
-			usbclient_buffDestory((void *)imx_common.data.endpts[i].buf[USB_ENDPT_DIR_OUT].vBuffer, USB_BUFFER_SIZE);
-			imx_common.data.endpts[i].buf[USB_ENDPT_DIR_OUT].vBuffer = NULL;
+			if (imx_common.data.endpts[i].buf[dir].vBuffer != NULL) {
+				usbclient_buffDestory((void *)imx_common.data.endpts[i].buf[dir].vBuffer, USB_BUFFER_SIZE);
+				imx_common.data.endpts[i].buf[dir].vBuffer = NULL;
+			}
+
+			if (imx_common.data.endpts[i].xfer[dir][0].vBuffer != NULL) {
+				usbclient_buffDestory((void *)imx_common.data.endpts[i].xfer[dir][0].vBuffer, USB_XFER_BUFS * USB_XFER_SIZE);
+				imx_common.data.endpts[i].xfer[dir][0].vBuffer = NULL;
+			}
 		}
 	}
 }
@@ -18,12 +18,29 @@
 
 #include <usbclient.h>
 
+#include "../usbclient-buf.h"
+
 
 #define USB_BUFFER_SIZE 0x1000
 
 #define ENDPOINTS_NUMBER 8
 #define ENDPOINTS_DIR_NB 2
 
+/* Non control endpoints transfer through USB_XFER_BUFS buffers queued one after another */
+#define USB_XFER_BUFS 2
+
+#ifndef USB_XFER_SIZE
+#define USB_XFER_SIZE (USB_BUFFER_SIZE / USB_XFER_BUFS)
+#endif
+
+#if USB_XFER_SIZE > USB_BUFFER_SIZE
+#error "USB_XFER_SIZE must not exceed USB_BUFFER_SIZE"
+#endif
+
+/* dTDs per non control endpoint queue head */
+#define DTD_RING_SIZE 8
+#define DTD_MEM_SIZE  (ENDPOINTS_NUMBER * ENDPOINTS_DIR_NB * DTD_RING_SIZE * sizeof(dtd_t))
+
 #define MIN(X, Y)           (((X) < (Y)) ? (X) : (Y))
 #define VM_2_PHYM(addr)     ((((uint32_t)va2pa(addr)) & ~0xfff) + ((uint32_t)addr & 0xfff))
 
@@ -143,11 +160,24 @@ typedef struct _usb_buffer_t {
 } usb_buffer_t;
 
 
+typedef struct _usb_xfer_t {
+	uint8_t *vBuffer;
+	addr_t pBuffer;
+
+	volatile dtd_t *dtd; /* queued transfer, NULL if buffer is free */
+	uint32_t len;
+	uint8_t held;        /* received data is owned by the class driver */
+} usb_xfer_t;
+
+
 typedef struct _endpt_data_t {
 	endpt_caps_t caps[ENDPOINTS_DIR_NB];
 	endpt_ctrl_t ctrl[ENDPOINTS_DIR_NB];
 
-	usb_buffer_t buf[ENDPOINTS_DIR_NB];
+	usb_buffer_t buf[ENDPOINTS_DIR_NB]; /* control endpoint only */
+
+	usb_xfer_t xfer[ENDPOINTS_DIR_NB][USB_XFER_BUFS];
+	uint8_t xferNext[ENDPOINTS_DIR_NB]; /* the oldest queued (or the next free) buffer */
 } endpt_data_t;
 
 
@@ -195,6 +225,14 @@ extern int ctrl_hfIrq(void);
 extern dtd_t *ctrl_execTransfer(int endpt, uint32_t paddr, uint32_t sz, int dir);
 
 
+/* Appends a transfer to the endpoint dTD list without waiting for it, returns its dTD */
+extern dtd_t *ctrl_queueTransfer(int endpt, uint32_t paddr, uint32_t sz, int dir);
+
+
+/* Waits for the queued transfer, returns number of bytes not transferred or -1 on error */
+extern int ctrl_waitTransfer(int endpt, int dir, volatile dtd_t *dtd);
+
+
 extern void ctrl_reset(void);
 
 
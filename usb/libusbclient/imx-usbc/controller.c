@@ -24,7 +24,7 @@
 
 
 struct {
-	size_t qtdOffs;
+	volatile dtd_t *last[ENDPOINTS_NUMBER * ENDPOINTS_DIR_NB]; /* the most recently queued dTD */
 
 	usb_dc_t *dc;
 	usb_common_data_t *data;
@@ -69,31 +69,42 @@ static int ctrl_allocBuff(int endpt, int dir)
 }
 
 
-void ctrl_initQtd(void)
+static int ctrl_allocXfer(int endpt, int dir)
 {
-	/*
-	 * Reset qtd offset for non control endpoints everytime device is re/connected to
-	 * host, at any time when desc_setup(REQ_SET_ADDRESS) is initiated
-	 */
+	usb_xfer_t *xfer = ctrl_common.data->endpts[endpt].xfer[dir];
+	uint8_t *mem;
+	int i;
+
+	/* Allocate buffers for the first time (initially vBuffer is NULL) */
+	if (xfer[0].vBuffer == NULL) {
+		mem = usbclient_allocBuff(USB_XFER_BUFS * USB_XFER_SIZE);
+		if (mem == MAP_FAILED)
+			return -ENOMEM;
 
-	ctrl_common.qtdOffs = 0;
-}
+		for (i = 0; i < USB_XFER_BUFS; ++i)
+			xfer[i].vBuffer = mem + i * USB_XFER_SIZE;
+	}
 
+	for (i = 0; i < USB_XFER_BUFS; ++i) {
+		xfer[i].pBuffer = VM_2_PHYM((void *)xfer[i].vBuffer);
+		xfer[i].dtd = NULL;
+		xfer[i].len = 0;
+		xfer[i].held = 0;
+	}
+	ctrl_common.data->endpts[endpt].xferNext[dir] = 0;
 
-static void *ctrl_allocQtdMem(void)
-{
-	if (!ctrl_common.qtdOffs) {
-		/* Allocate buffer for the first time (initially dtdMem is NULL) */
-		if (ctrl_common.dc->dtdMem == NULL)
-			ctrl_common.dc->dtdMem = usbclient_allocBuff(USB_BUFFER_SIZE);
+	return EOK;
+}
 
-		if (ctrl_common.dc->dtdMem == MAP_FAILED)
-			return MAP_FAILED;
 
-		memset(ctrl_common.dc->dtdMem, 0, USB_BUFFER_SIZE);
-	}
+void ctrl_initQtd(void)
+{
+	/*
+	 * Forget queued transfers of non control endpoints everytime device is re/connected to
+	 * host, at any time when desc_setup(REQ_SET_ADDRESS) is initiated
+	 */
 
-	return  (void *)(ctrl_common.dc->dtdMem + 0x40 * (ctrl_common.qtdOffs++));
+	memset(ctrl_common.last, 0, sizeof(ctrl_common.last));
 }
 
 
@@ -105,29 +116,31 @@ static int ctrl_dtdInit(int endpt, int inQH, int outQh)
 	if (endpt == 0)
 		return -EINVAL;
 
-	/* initialize dtd for selected endpoints */
-	if (outQh) {
-		dtd = ctrl_allocQtdMem();
+	/* Allocate dTD rings for the first time (initially dtdMem is NULL) */
+	if (ctrl_common.dc->dtdMem == NULL) {
+		ctrl_common.dc->dtdMem = usbclient_allocBuff(DTD_MEM_SIZE);
 
-		if (dtd == MAP_FAILED)
+		if (ctrl_common.dc->dtdMem == MAP_FAILED)
 			return -ENOMEM;
 
-		ctrl_common.dc->endptqh[qh].base = (((uint32_t)va2pa(dtd)) & ~0xfff);
-		ctrl_common.dc->endptqh[qh].size = 0x40;
-		ctrl_common.dc->endptqh[qh].head = dtd;
-		ctrl_common.dc->endptqh[qh].tail = dtd;
+		memset(ctrl_common.dc->dtdMem, 0, DTD_MEM_SIZE);
 	}
 
-	if (inQH) {
-		dtd = ctrl_allocQtdMem();
+	if (ctrl_common.dc->dtdMem == MAP_FAILED)
+		return -ENOMEM;
 
-		if (dtd == MAP_FAILED)
-			return -ENOMEM;
+	/* Each endpoint direction has its own ring, so queued transfers never share dTDs */
+	for (; qh <= endpt * 2 + 1; ++qh) {
+		if (((qh & 1) == 0 && !outQh) || ((qh & 1) != 0 && !inQH))
+			continue;
 
-		ctrl_common.dc->endptqh[++qh].base = (((uint32_t)va2pa(dtd)) & ~0xfff) + (64 * sizeof(dtd_t));
-		ctrl_common.dc->endptqh[qh].size = 0x40;
-		ctrl_common.dc->endptqh[qh].head = dtd + 64;
-		ctrl_common.dc->endptqh[qh].tail = dtd + 64;
+		dtd = (dtd_t *)ctrl_common.dc->dtdMem + qh * DTD_RING_SIZE;
+
+		ctrl_common.dc->endptqh[qh].base = VM_2_PHYM(dtd);
+		ctrl_common.dc->endptqh[qh].size = DTD_RING_SIZE;
+		ctrl_common.dc->endptqh[qh].head = dtd;
+		ctrl_common.dc->endptqh[qh].tail = dtd;
+		ctrl_common.last[qh] = NULL;
 	}
 
 	return EOK;
@@ -139,7 +152,7 @@ static int ctrl_initEndptQh(int endpt, int dir, endpt_data_t *endpt_init)
 	uint32_t setup = 0;
 	int qh = endpt * 2 + dir;
 
-	if (ctrl_allocBuff(endpt, dir) < 0)
+	if (ctrl_allocXfer(endpt, dir) < 0)
 		return -ENOMEM;
 
 	ctrl_common.dc->endptqh[qh].caps =  endpt_init->caps[dir].max_pkt_len << 16;
@@ -276,6 +289,77 @@ static int ctrl_buildDtd(dtd_t *dtd, uint32_t paddr, uint32_t size)
 }
 
 
+static uint32_t ctrl_dtdAddr(int qh, volatile dtd_t *dtd)
+{
+	return ctrl_common.dc->endptqh[qh].base + ((uint32_t)dtd & ((ctrl_common.dc->endptqh[qh].size * sizeof(dtd_t)) - 1));
+}
+
+
+dtd_t *ctrl_queueTransfer(int endpt, uint32_t paddr, uint32_t sz, int dir)
+{
+	int qh = (endpt << 1) + dir;
+	int shift = endpt + ((qh & 1) ? 16 : 0);
+	volatile dtd_t *dtd, *prev;
+	uint32_t stat;
+
+	if (!ctrl_common.dc->connected || endpt == 0)
+		return NULL;
+
+	dtd = ctrl_getDtd(endpt, dir);
+	if (ctrl_buildDtd((dtd_t *)dtd, paddr, sz) < 0)
+		return NULL;
+
+	prev = ctrl_common.last[qh];
+	ctrl_common.last[qh] = dtd;
+	__sync_synchronize();
+
+	/* Endpoint still busy: link the dTD to the list, the controller continues with it without going idle */
+	if (prev != NULL) {
+		prev->dtd_next = ctrl_dtdAddr(qh, dtd);
+		__sync_synchronize();
+
+		if (*(ctrl_common.dc->base + endptprime) & (1 << shift))
+			return (dtd_t *)dtd;
+
+		/* Add dTD TripWire: read endpoint status consistently with the controller */
+		do {
+			*(ctrl_common.dc->base + usbcmd) |= 1 << 14;
+			stat = *(ctrl_common.dc->base + endptstat) & (1 << shift);
+		} while (!(*(ctrl_common.dc->base + usbcmd) & (1 << 14)));
+		*(ctrl_common.dc->base + usbcmd) &= ~(1 << 14);
+
+		if (stat)
+			return (dtd_t *)dtd;
+	}
+
+	/* Endpoint idle: prime it with the new dTD */
+	ctrl_common.dc->endptqh[qh].dtd_next = ctrl_dtdAddr(qh, dtd) & ~1;
+	ctrl_common.dc->endptqh[qh].dtd_token &= ~((1 << 6) | (1 << 7));
+	__sync_synchronize();
+
+	*(ctrl_common.dc->base + endptprime) |= 1 << shift;
+	while ((*(ctrl_common.dc->base + endptprime) & (1 << shift)) && (*(ctrl_common.dc->base + portsc1) & 1))
+		;
+
+	return (dtd_t *)dtd;
+}
+
+
+int ctrl_waitTransfer(int endpt, int dir, volatile dtd_t *dtd)
+{
+	int qh = (endpt << 1) + dir;
+
+	/* wait to finish transaction while device is attached to the host and the endpoint is not halted */
+	while (DTD_ACTIVE(dtd) && !DTD_ERROR(dtd) && !(ctrl_common.dc->endptqh[qh].dtd_token & (1 << 6)) && (*(ctrl_common.dc->base + portsc1) & 1))
+		;
+
+	if (DTD_ACTIVE(dtd) || DTD_ERROR(dtd))
+		return -1;
+
+	return DTD_SIZE(dtd);
+}
+
+
 /* In case of non dTD error function may return NULL */
 dtd_t *ctrl_execTransfer(int endpt, uint32_t paddr, uint32_t sz, int dir)
 {
@@ -0,0 +1,40 @@
+/*
+ * Phoenix-RTOS
+ *
+ * usbclient - zero-copy endpoint buffers
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _USBCLIENT_BUF_H_
+#define _USBCLIENT_BUF_H_
+
+
+/*
+ * DMA-capable endpoint buffers for non control endpoints, filled and read in place
+ * instead of copying through usbclient_send()/usbclient_receive().
+ * Buffers of an endpoint must not be mixed with its usbclient_send()/usbclient_receive() calls.
+ */
+
+
+/* Returns the next free IN buffer of the endpoint (waits for it if all are queued), *size is set to its capacity */
+extern void *usbclient_getBuff(int endpt, unsigned int *size);
+
+
+/* Queues len bytes of the buffer returned by the last usbclient_getBuff() call, returns len or -1 on error */
+extern int usbclient_sendBuff(int endpt, void *buf, unsigned int len);
+
+
+/* Waits for OUT data, returns its length and the buffer holding it, which must be given back with usbclient_releaseBuff() */
+extern int usbclient_receiveBuff(int endpt, void **buf);
+
+
+/* Gives OUT buffer back to the controller to receive new data into */
+extern void usbclient_releaseBuff(int endpt, void *buf);
+
+
+#endif /* _USBCLIENT_BUF_H_ */
@@ -0,0 +1,1050 @@
+/*
+ * Phoenix-RTOS
+ *
+ * USB Mass Storage client (Bulk-Only Transport, SCSI transparent command set)
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/threads.h>
+
+#include <usb.h>
+#include <usbclient.h>
+#include <usbclient-buf.h>
+
+#include "usbmsc.h"
+
+
+#ifndef USBMSC_VID
+#define USBMSC_VID 0x16f9
+#endif
+
+#ifndef USBMSC_PID
+#define USBMSC_PID 0x0004
+#endif
+
+/* Size of each of the two read-ahead windows, reads are served from one while the other is filled */
+#ifndef USBMSC_RA_SIZE
+#define USBMSC_RA_SIZE (32 * 1024)
+#endif
+
+#define USBMSC_ENDPT    1
+#define USBMSC_PKTSZ    512
+#define USBMSC_PRIO     3
+#define USBMSC_STACKSZ  2048
+#define USBMSC_BLKSZ    512
+
+#define CBW_SIG 0x43425355
+#define CSW_SIG 0x53425355
+#define CBW_LEN 31
+
+#define CBW_DIR_IN 0x80
+
+#define CSW_PASSED 0
+#define CSW_FAILED 1
+#define CSW_PHASE  2
+
+#define USB_SUBCLASS_SCSI 0x06
+#define USB_PROTOCOL_BULK 0x50
+
+/* Class requests */
+#define MSC_REQ_RESET   0xff
+#define MSC_REQ_MAX_LUN 0xfe
+
+/* Opcodes */
+#define SCSI_TEST_UNIT_READY      0x00
+#define SCSI_REQUEST_SENSE        0x03
+#define SCSI_INQUIRY              0x12
+#define SCSI_MODE_SENSE6          0x1a
+#define SCSI_START_STOP           0x1b
+#define SCSI_PREVENT_ALLOW        0x1e
+#define SCSI_READ_FORMAT_CAPACITY 0x23
+#define SCSI_READ_CAPACITY10      0x25
+#define SCSI_READ10               0x28
+#define SCSI_WRITE10              0x2a
+#define SCSI_VERIFY10             0x2f
+#define SCSI_SYNC_CACHE10         0x35
+#define SCSI_MODE_SENSE10         0x5a
+
+/* Sense keys */
+#define SENSE_NONE            0x00
+#define SENSE_MEDIUM_ERROR    0x03
+#define SENSE_ILLEGAL_REQUEST 0x05
+#define SENSE_DATA_PROTECT    0x07
+
+/* Additional sense codes */
+#define ASC_WRITE_FAULT       0x03
+#define ASC_READ_ERROR        0x11
+#define ASC_INVALID_OPCODE    0x20
+#define ASC_LBA_OUT_OF_RANGE  0x21
+#define ASC_INVALID_FIELD     0x24
+#define ASC_WRITE_PROTECTED   0x27
+
+#define LOG(str_, ...)       do { printf("usbmsc: " str_ "\n", ##__VA_ARGS__); } while (0)
+#define LOG_ERROR(str_, ...) LOG("error: " str_, ##__VA_ARGS__)
+
+
+typedef struct {
+	uint32_t sig;
+	uint32_t tag;
+	uint32_t dlen;
+	uint8_t flags;
+	uint8_t lun;
+	uint8_t clen;
+	uint8_t cmd[16];
+} __attribute__((packed)) usbmsc_cbw_t;
+
+
+typedef struct {
+	uint32_t sig;
+	uint32_t tag;
+	uint32_t dr;
+	uint8_t status;
+} __attribute__((packed)) usbmsc_csw_t;
+
+
+enum { ra_empty = 0, ra_loading, ra_valid };
+
+
+typedef struct {
+	char *data;
+	off_t offs;
+	size_t len;
+	int state;
+} usbmsc_win_t;
+
+
+static struct {
+	storage_t *strg;
+	unsigned int blksz;
+	uint32_t nblocks;
+	int readonly;
+
+	struct {
+		uint8_t key;
+		uint8_t asc;
+	} sense;
+
+	/* Serializes storage device access of the command and read-ahead threads */
+	handle_t devLock;
+
+	/* NOR erase block cache, written back before the command status is reported */
+	struct {
+		char *data;
+		off_t offs;
+		int dirty;
+	} eblk;
+
+	handle_t lock;
+	handle_t cond;
+	handle_t raCond;
+	usbmsc_win_t win[2];
+	usbmsc_win_t *cur;
+	usbmsc_win_t *pending;
+	off_t lastEnd;
+
+	volatile int configured;
+	volatile int quit;
+
+	char stack[USBMSC_STACKSZ] __attribute__((aligned(8)));
+	char raStack[USBMSC_STACKSZ] __attribute__((aligned(8)));
+} usbmsc_common;
+
+
+/* clang-format off */
+static usb_device_desc_t ddev = {
+	.bLength = sizeof(usb_device_desc_t), .bDescriptorType = USB_DESC_DEVICE, .bcdUSB = 0x0200,
+	.bDeviceClass = 0, .bDeviceSubClass = 0, .bDeviceProtocol = 0, .bMaxPacketSize0 = 64,
+	.idVendor = USBMSC_VID, .idProduct = USBMSC_PID, .bcdDevice = 0x0100,
+	.iManufacturer = 1, .iProduct = 2, .iSerialNumber = 0, .bNumConfigurations = 1
+};
+
+
+static usb_configuration_desc_t dconfig = {
+	.bLength = 9, .bDescriptorType = USB_DESC_CONFIG,
+	.wTotalLength = sizeof(usb_configuration_desc_t) + sizeof(usb_interface_desc_t) + 2 * sizeof(usb_endpoint_desc_t),
+	.bNumInterfaces = 1, .bConfigurationValue = 1, .iConfiguration = 0, .bmAttributes = 0xc0, .bMaxPower = 50
+};
+
+
+static usb_interface_desc_t diface = {
+	.bLength = 9, .bDescriptorType = USB_DESC_INTERFACE, .bInterfaceNumber = 0, .bAlternateSetting = 0,
+	.bNumEndpoints = 2, .bInterfaceClass = USB_CLASS_MASS_STORAGE, .bInterfaceSubClass = USB_SUBCLASS_SCSI,
+	.bInterfaceProtocol = USB_PROTOCOL_BULK, .iInterface = 0
+};
+
+
+static usb_endpoint_desc_t depIN = {
+	.bLength = 7, .bDescriptorType = USB_DESC_ENDPOINT, .bEndpointAddress = 0x80 | USBMSC_ENDPT,
+	.bmAttributes = 0x02, .wMaxPacketSize = USBMSC_PKTSZ, .bInterval = 0
+};
+
+
+static usb_endpoint_desc_t depOUT = {
+	.bLength = 7, .bDescriptorType = USB_DESC_ENDPOINT, .bEndpointAddress = USBMSC_ENDPT,
+	.bmAttributes = 0x02, .wMaxPacketSize = USBMSC_PKTSZ, .bInterval = 0
+};
+
+
+static usb_string_desc_t dstrman = {
+	.bLength = 2 * 15 + 2, .bDescriptorType = USB_DESC_STRING,
+	.wData = { 'P', 0, 'h', 0, 'o', 0, 'e', 0, 'n', 0, 'i', 0, 'x', 0, ' ', 0, 'S', 0, 'y', 0, 's', 0, 't', 0, 'e', 0, 'm', 0, 's', 0 }
+};
+
+
+static usb_string_desc_t dstr0 = {
+	.bLength = 4, .bDescriptorType = USB_DESC_STRING,
+	.wData = { 0x09, 0x04 } /* English */
+};
+
+
+static usb_string_desc_t dstrprod = {
+	.bLength = 2 * 12 + 2, .bDescriptorType = USB_DESC_STRING,
+	.wData = { 'M', 0, 'a', 0, 's', 0, 's', 0, ' ', 0, 'S', 0, 't', 0, 'o', 0, 'r', 0, 'a', 0, 'g', 0, 'e', 0 }
+};
+/* clang-format on */
+
+
+static usb_desc_list_t dlstrprod = { .next = NULL, .descriptor = (usb_functional_desc_t *)&dstrprod };
+static usb_desc_list_t dlstrman = { .next = &dlstrprod, .descriptor = (usb_functional_desc_t *)&dstrman };
+static usb_desc_list_t dlstr0 = { .next = &dlstrman, .descriptor = (usb_functional_desc_t *)&dstr0 };
+static usb_desc_list_t dlepOUT = { .next = &dlstr0, .descriptor = (usb_functional_desc_t *)&depOUT };
+static usb_desc_list_t dlepIN = { .next = &dlepOUT, .descriptor = (usb_functional_desc_t *)&depIN };
+static usb_desc_list_t dliface = { .next = &dlepIN, .descriptor = (usb_functional_desc_t *)&diface };
+static usb_desc_list_t dlconfig = { .next = &dliface, .descriptor = (usb_functional_desc_t *)&dconfig };
+static usb_desc_list_t dldev = { .next = &dlconfig, .descriptor = (usb_functional_desc_t *)&ddev };
+
+
+static uint32_t usbmsc_get32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+
+static void usbmsc_put32(uint8_t *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+
+static void usbmsc_senseSet(uint8_t key, uint8_t asc)
+{
+	usbmsc_common.sense.key = key;
+	usbmsc_common.sense.asc = asc;
+}
+
+
+/* Storage access */
+
+
+static int usbmsc_isMtd(void)
+{
+	storage_dev_t *dev = usbmsc_common.strg->dev;
+
+	return (dev->blk == NULL) || (dev->blk->ops == NULL);
+}
+
+
+static int usbmsc_devRead(off_t offs, void *buf, size_t len)
+{
+	storage_t *strg = usbmsc_common.strg;
+	size_t retlen = 0;
+	ssize_t res;
+
+	mutexLock(usbmsc_common.devLock);
+	if (usbmsc_isMtd()) {
+		res = strg->dev->mtd->ops->read(strg, strg->start + offs, buf, len, &retlen);
+		if ((res == EOK) && (retlen != len)) {
+			res = -EIO;
+		}
+	}
+	else {
+		res = strg->dev->blk->ops->read(strg, strg->start + offs, buf, len);
+		res = (res == (ssize_t)len) ? EOK : -EIO;
+	}
+	mutexUnlock(usbmsc_common.devLock);
+
+	return res;
+}
+
+
+static int usbmsc_eblkFlush(void)
+{
+	storage_t *strg = usbmsc_common.strg;
+	size_t erasesz = strg->dev->mtd->erasesz, retlen = 0;
+	int res = EOK;
+
+	if (usbmsc_common.eblk.dirty != 0) {
+		mutexLock(usbmsc_common.devLock);
+		res = strg->dev->mtd->ops->erase(strg, strg->start + usbmsc_common.eblk.offs, erasesz);
+		if (res == EOK) {
+			res = strg->dev->mtd->ops->write(strg, strg->start + usbmsc_common.eblk.offs, usbmsc_common.eblk.data, erasesz, &retlen);
+			if ((res == EOK) && (retlen != erasesz)) {
+				res = -EIO;
+			}
+		}
+		mutexUnlock(usbmsc_common.devLock);
+		usbmsc_common.eblk.dirty = 0;
+	}
+
+	return res;
+}
+
+
+/* NOR writes go through the erase block cache, blocks fully covered by [offs, end) are not read back */
+static int usbmsc_mtdWrite(off_t offs, const char *data, size_t len, off_t end)
+{
+	size_t erasesz = usbmsc_common.strg->dev->mtd->erasesz, n;
+	off_t blk;
+	int res;
+
+	while (len > 0) {
+		blk = offs - (offs % erasesz);
+		n = erasesz - (offs - blk);
+		n = (n > len) ? len : n;
+
+		if (usbmsc_common.eblk.offs != blk) {
+			if ((res = usbmsc_eblkFlush()) < 0) {
+				return res;
+			}
+
+			usbmsc_common.eblk.offs = -1;
+			if ((offs != blk) || (end < blk + (off_t)erasesz)) {
+				if ((res = usbmsc_devRead(blk, usbmsc_common.eblk.data, erasesz)) < 0) {
+					return res;
+				}
+			}
+			usbmsc_common.eblk.offs = blk;
+		}
+
+		memcpy(usbmsc_common.eblk.data + (offs - blk), data, n);
+		usbmsc_common.eblk.dirty = 1;
+
+		offs += n;
+		data += n;
+		len -= n;
+	}
+
+	return EOK;
+}
+
+
+static int usbmsc_devWrite(off_t offs, const void *buf, size_t len, off_t end)
+{
+	storage_t *strg = usbmsc_common.strg;
+	ssize_t res;
+
+	if (usbmsc_isMtd()) {
+		return usbmsc_mtdWrite(offs, buf, len, end);
+	}
+
+	mutexLock(usbmsc_common.devLock);
+	res = strg->dev->blk->ops->write(strg, strg->start + offs, buf, len);
+	mutexUnlock(usbmsc_common.devLock);
+
+	return (res == (ssize_t)len) ? EOK : -EIO;
+}
+
+
+static int usbmsc_devSync(void)
+{
+	storage_t *strg = usbmsc_common.strg;
+	int res = EOK;
+
+	if (usbmsc_isMtd()) {
+		res = usbmsc_eblkFlush();
+		if ((res == EOK) && (strg->dev->mtd->ops->sync != NULL)) {
+			mutexLock(usbmsc_common.devLock);
+			strg->dev->mtd->ops->sync(strg);
+			mutexUnlock(usbmsc_common.devLock);
+		}
+	}
+	else if (strg->dev->blk->ops->sync != NULL) {
+		mutexLock(usbmsc_common.devLock);
+		res = strg->dev->blk->ops->sync(strg);
+		mutexUnlock(usbmsc_common.devLock);
+	}
+
+	return res;
+}
+
+
+/* Read-ahead */
+
+
+static void usbmsc_raThread(void *arg)
+{
+	usbmsc_win_t *w;
+	int res;
+
+	mutexLock(usbmsc_common.lock);
+	while (usbmsc_common.quit == 0) {
+		if ((w = usbmsc_common.pending) == NULL) {
+			condWait(usbmsc_common.raCond, usbmsc_common.lock, 0);
+			continue;
+		}
+		usbmsc_common.pending = NULL;
+		mutexUnlock(usbmsc_common.lock);
+
+		res = usbmsc_devRead(w->offs, w->data, w->len);
+
+		mutexLock(usbmsc_common.lock);
+		w->state = (res < 0) ? ra_empty : ra_valid;
+		condBroadcast(usbmsc_common.cond);
+	}
+	mutexUnlock(usbmsc_common.lock);
+
+	endthread();
+}
+
+
+static usbmsc_win_t *usbmsc_raFind(off_t offs)
+{
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		if ((usbmsc_common.win[i].state != ra_empty) && (offs >= usbmsc_common.win[i].offs) && (offs < usbmsc_common.win[i].offs + (off_t)usbmsc_common.win[i].len)) {
+			return &usbmsc_common.win[i];
+		}
+	}
+
+	return NULL;
+}
+
+
+static size_t usbmsc_raLen(off_t offs)
+{
+	off_t sz = (off_t)usbmsc_common.nblocks * usbmsc_common.blksz;
+
+	return (sz - offs > USBMSC_RA_SIZE) ? USBMSC_RA_SIZE : (size_t)(sz - offs);
+}
+
+
+/* Returns data at offs, *avail is set to the number of bytes buffered from there */
+static const char *usbmsc_raGet(off_t offs, size_t *avail, off_t end, int seq)
+{
+	usbmsc_win_t *w, *other;
+	off_t next;
+	int res;
+
+	mutexLock(usbmsc_common.lock);
+	for (;;) {
+		if ((w = usbmsc_raFind(offs)) == NULL) {
+			/* Miss: fill the window not served last, it is free once its load completes */
+			w = (usbmsc_common.cur == &usbmsc_common.win[0]) ? &usbmsc_common.win[1] : &usbmsc_common.win[0];
+			if (w->state == ra_loading) {
+				condWait(usbmsc_common.cond, usbmsc_common.lock, 0);
+				continue;
+			}
+
+			w->offs = offs;
+			w->len = usbmsc_raLen(offs);
+			w->state = ra_loading;
+			mutexUnlock(usbmsc_common.lock);
+
+			res = usbmsc_devRead(w->offs, w->data, w->len);
+
+			mutexLock(usbmsc_common.lock);
+			w->state = (res < 0) ? ra_empty : ra_valid;
+			condBroadcast(usbmsc_common.cond);
+			if (res < 0) {
+				mutexUnlock(usbmsc_common.lock);
+				return NULL;
+			}
+		}
+		else if (w->state == ra_loading) {
+			condWait(usbmsc_common.cond, usbmsc_common.lock, 0);
+			continue;
+		}
+
+		break;
+	}
+
+	usbmsc_common.cur = w;
+	other = (w == &usbmsc_common.win[0]) ? &usbmsc_common.win[1] : &usbmsc_common.win[0];
+	next = w->offs + w->len;
+
+	/* Load the following window in the background for sequential streams and commands extending past this one */
+	if (((seq != 0) || (next < end)) && (other->state != ra_loading) && (next < (off_t)usbmsc_common.nblocks * usbmsc_common.blksz) && (usbmsc_raFind(next) == NULL)) {
+		other->offs = next;
+		other->len = usbmsc_raLen(next);
+		other->state = ra_loading;
+		usbmsc_common.pending = other;
+		condSignal(usbmsc_common.raCond);
+	}
+
+	*avail = w->offs + w->len - offs;
+	mutexUnlock(usbmsc_common.lock);
+
+	return w->data + (offs - w->offs);
+}
+
+
+static void usbmsc_raInvalidate(off_t offs, size_t len)
+{
+	usbmsc_win_t *w;
+	int i;
+
+	mutexLock(usbmsc_common.lock);
+	for (i = 0; i < 2; i++) {
+		w = &usbmsc_common.win[i];
+		while (w->state == ra_loading) {
+			condWait(usbmsc_common.cond, usbmsc_common.lock, 0);
+		}
+
+		if ((w->state == ra_valid) && (offs < w->offs + (off_t)w->len) && (w->offs < offs + (off_t)len)) {
+			w->state = ra_empty;
+		}
+	}
+	mutexUnlock(usbmsc_common.lock);
+}
+
+
+/* Data phase */
+
+
+/* Returns the number of bytes sent or -1 on transfer error */
+static int usbmsc_dataIn(const void *data, uint32_t len)
+{
+	unsigned int size;
+	void *buf;
+
+	if ((buf = usbclient_getBuff(USBMSC_ENDPT, &size)) == NULL) {
+		return -1;
+	}
+
+	len = (len > size) ? size : len;
+	if (len > 0) {
+		memcpy(buf, data, len);
+	}
+
+	return usbclient_sendBuff(USBMSC_ENDPT, buf, len);
+}
+
+
+/* Finishes the data phase when less than requested by the host was transferred */
+static void usbmsc_dataFinish(const usbmsc_cbw_t *cbw, uint32_t done)
+{
+	void *buf;
+	int n;
+
+	if (done >= cbw->dlen) {
+		return;
+	}
+
+	if ((cbw->flags & CBW_DIR_IN) != 0) {
+		/* Terminate the transfer with a short packet */
+		if ((done % USBMSC_PKTSZ) == 0) {
+			usbmsc_dataIn(NULL, 0);
+		}
+	}
+	else {
+		/* Consume the data the host still sends */
+		while (done < cbw->dlen) {
+			if ((n = usbclient_receiveBuff(USBMSC_ENDPT, &buf)) < 0) {
+				break;
+			}
+			usbclient_releaseBuff(USBMSC_ENDPT, buf);
+
+			done += n;
+			if ((n % USBMSC_PKTSZ) != 0) {
+				break;
+			}
+		}
+	}
+}
+
+
+/* SCSI commands, return EOK or -1 with sense data set */
+
+
+static int usbmsc_scsiReply(const usbmsc_cbw_t *cbw, const void *data, uint32_t len, uint32_t alloc, uint32_t *done)
+{
+	int res;
+
+	len = (len > alloc) ? alloc : len;
+	len = (len > cbw->dlen) ? cbw->dlen : len;
+
+	if (len > 0) {
+		if ((res = usbmsc_dataIn(data, len)) < 0) {
+			return -1;
+		}
+		*done = res;
+	}
+
+	return EOK;
+}
+
+
+static int usbmsc_scsiInquiry(const usbmsc_cbw_t *cbw, uint32_t *done)
+{
+	uint8_t resp[36] = { 0 };
+
+	/* Only the supported pages list of vital product data */
+	if ((cbw->cmd[1] & 1) != 0) {
+		if (cbw->cmd[2] != 0) {
+			usbmsc_senseSet(SENSE_ILLEGAL_REQUEST, ASC_INVALID_FIELD);
+			return -1;
+		}
+
+		return usbmsc_scsiReply(cbw, resp, 5, cbw->cmd[4], done);
+	}
+
+	resp[1] = 0x80; /* Removable */
+	resp[2] = 0x04; /* SPC-2 */
+	resp[3] = 0x02;
+	resp[4] = sizeof(resp) - 5;
+	memcpy(&resp[8], "Phoenix ", 8);
+	memcpy(&resp[16], "Mass Storage    ", 16);
+	memcpy(&resp[32], "1.0 ", 4);
+
+	return usbmsc_scsiReply(cbw, resp, sizeof(resp), cbw->cmd[4], done);
+}
+
+
+static int usbmsc_scsiRequestSense(const usbmsc_cbw_t *cbw, uint32_t *done)
+{
+	uint8_t resp[18] = { 0 };
+
+	resp[0] = 0x70;
+	resp[2] = usbmsc_common.sense.key;
+	resp[7] = sizeof(resp) - 8;
+	resp[12] = usbmsc_common.sense.asc;
+	usbmsc_senseSet(SENSE_NONE, 0);
+
+	return usbmsc_scsiReply(cbw, resp, sizeof(resp), cbw->cmd[4], done);
+}
+
+
+static int usbmsc_scsiModeSense(const usbmsc_cbw_t *cbw, uint32_t *done)
+{
+	uint8_t resp[8] = { 0 };
+	uint8_t wp = (usbmsc_common.readonly != 0) ? 0x80 : 0;
+
+	/* Header only, no block descriptors or mode pages */
+	if (cbw->cmd[0] == SCSI_MODE_SENSE6) {
+		resp[0] = 3;
+		resp[2] = wp;
+		return usbmsc_scsiReply(cbw, resp, 4, cbw->cmd[4], done);
+	}
+
+	resp[1] = 6;
+	resp[3] = wp;
+
+	return usbmsc_scsiReply(cbw, resp, 8, ((uint32_t)cbw->cmd[7] << 8) | cbw->cmd[8], done);
+}
+
+
+static int usbmsc_scsiReadCapacity(const usbmsc_cbw_t *cbw, uint32_t *done)
+{
+	uint8_t resp[12] = { 0 };
+
+	if (cbw->cmd[0] == SCSI_READ_FORMAT_CAPACITY) {
+		resp[3] = 8;
+		usbmsc_put32(&resp[4], usbmsc_common.nblocks);
+		usbmsc_put32(&resp[8], usbmsc_common.blksz);
+		resp[8] = 0x02; /* Formatted media */
+		return usbmsc_scsiReply(cbw, resp, 12, ((uint32_t)cbw->cmd[7] << 8) | cbw->cmd[8], done);
+	}
+
+	usbmsc_put32(&resp[0], usbmsc_common.nblocks - 1);
+	usbmsc_put32(&resp[4], usbmsc_common.blksz);
+
+	return usbmsc_scsiReply(cbw, resp, 8, 8, done);
+}
+
+
+static int usbmsc_scsiRange(const usbmsc_cbw_t *cbw, off_t *offs, uint32_t *len)
+{
+	uint32_t lba = usbmsc_get32(&cbw->cmd[2]);
+	uint32_t nblk = ((uint32_t)cbw->cmd[7] << 8) | cbw->cmd[8];
+
+	if ((lba > usbmsc_common.nblocks) || (nblk > usbmsc_common.nblocks - lba)) {
+		usbmsc_senseSet(SENSE_ILLEGAL_REQUEST, ASC_LBA_OUT_OF_RANGE);
+		return -1;
+	}
+
+	*offs = (off_t)lba * usbmsc_common.blksz;
+	*len = nblk * usbmsc_common.blksz;
+
+	/* Host expects less data than the command describes */
+	if (*len > cbw->dlen) {
+		*len = cbw->dlen - (cbw->dlen % usbmsc_common.blksz);
+	}
+
+	return EOK;
+}
+
+
+static int usbmsc_scsiRead(const usbmsc_cbw_t *cbw, uint32_t *done)
+{
+	const char *data;
+	unsigned int size;
+	size_t avail, n;
+	uint32_t len;
+	off_t offs;
+	void *buf;
+	int seq;
+
+	if (usbmsc_scsiRange(cbw, &offs, &len) < 0) {
+		return -1;
+	}
+
+	seq = (offs == usbmsc_common.lastEnd);
+	usbmsc_common.lastEnd = offs + len;
+
+	while (*done < len) {
+		if ((data = usbmsc_raGet(offs + *done, &avail, offs + len, seq)) == NULL) {
+			usbmsc_common.lastEnd = -1;
+			usbmsc_senseSet(SENSE_MEDIUM_ERROR, ASC_READ_ERROR);
+			return -1;
+		}
+
+		while ((avail > 0) && (*done < len)) {
+			if ((buf = usbclient_getBuff(USBMSC_ENDPT, &size)) == NULL) {
+				return -1;
+			}
+
+			n = (avail > size) ? size : avail;
+			n = (n > len - *done) ? len - *done : n;
+			memcpy(buf, data, n);
+
+			if (usbclient_sendBuff(USBMSC_ENDPT, buf, n) < 0) {
+				return -1;
+			}
+
+			data += n;
+			avail -= n;
+			*done += n;
+		}
+	}
+
+	return EOK;
+}
+
+
+static int usbmsc_scsiWrite(const usbmsc_cbw_t *cbw, uint32_t *done)
+{
+	int n, res = EOK;
+	uint32_t len;
+	off_t offs;
+	void *buf;
+
+	if (usbmsc_common.readonly != 0) {
+		usbmsc_senseSet(SENSE_DATA_PROTECT, ASC_WRITE_PROTECTED);
+		return -1;
+	}
+
+	if (usbmsc_scsiRange(cbw, &offs, &len) < 0) {
+		return -1;
+	}
+
+	usbmsc_raInvalidate(offs, len);
+	usbmsc_common.lastEnd = -1;
+
+	/* The other OUT buffer keeps receiving while this one is written */
+	while (*done < len) {
+		if ((n = usbclient_receiveBuff(USBMSC_ENDPT, &buf)) < 0) {
+			return -1;
+		}
+
+		if ((uint32_t)n > len - *done) {
+			n = len - *done;
+		}
+
+		if ((res == EOK) && (usbmsc_devWrite(offs + *done, buf, n, offs + len) < 0)) {
+			res = -1;
+		}
+		usbclient_releaseBuff(USBMSC_ENDPT, buf);
+
+		*done += n;
+		if ((n % USBMSC_PKTSZ) != 0) {
+			break;
+		}
+	}
+
+	if ((res == EOK) && usbmsc_isMtd() && (usbmsc_eblkFlush() < 0)) {
+		res = -1;
+	}
+
+	if (res < 0) {
+		usbmsc_senseSet(SENSE_MEDIUM_ERROR, ASC_WRITE_FAULT);
+	}
+
+	return res;
+}
+
+
+static int usbmsc_scsiSync(const usbmsc_cbw_t *cbw, uint32_t *done)
+{
+	if (usbmsc_devSync() < 0) {
+		usbmsc_senseSet(SENSE_MEDIUM_ERROR, ASC_WRITE_FAULT);
+		return -1;
+	}
+
+	return EOK;
+}
+
+
+static void usbmsc_command(const usbmsc_cbw_t *cbw)
+{
+	usbmsc_csw_t csw;
+	uint32_t done = 0;
+	int res, in;
+
+	switch (cbw->cmd[0]) {
+		case SCSI_TEST_UNIT_READY:
+		case SCSI_START_STOP:
+		case SCSI_PREVENT_ALLOW:
+		case SCSI_VERIFY10:
+			res = EOK;
+			in = -1;
+			break;
+
+		case SCSI_INQUIRY:
+			res = usbmsc_scsiInquiry(cbw, &done);
+			in = 1;
+			break;
+
+		case SCSI_REQUEST_SENSE:
+			res = usbmsc_scsiRequestSense(cbw, &done);
+			in = 1;
+			break;
+
+		case SCSI_MODE_SENSE6:
+		case SCSI_MODE_SENSE10:
+			res = usbmsc_scsiModeSense(cbw, &done);
+			in = 1;
+			break;
+
+		case SCSI_READ_FORMAT_CAPACITY:
+		case SCSI_READ_CAPACITY10:
+			res = usbmsc_scsiReadCapacity(cbw, &done);
+			in = 1;
+			break;
+
+		case SCSI_READ10:
+			in = 1;
+			res = ((cbw->flags & CBW_DIR_IN) != 0) ? usbmsc_scsiRead(cbw, &done) : EOK;
+			break;
+
+		case SCSI_WRITE10:
+			in = 0;
+			res = ((cbw->flags & CBW_DIR_IN) == 0) ? usbmsc_scsiWrite(cbw, &done) : EOK;
+			break;
+
+		case SCSI_SYNC_CACHE10:
+			res = usbmsc_scsiSync(cbw, &done);
+			in = -1;
+			break;
+
+		default:
+			usbmsc_senseSet(SENSE_ILLEGAL_REQUEST, ASC_INVALID_OPCODE);
+			res = -1;
+			in = -1;
+			break;
+	}
+
+	usbmsc_dataFinish(cbw, done);
+
+	csw.sig = CSW_SIG;
+	csw.tag = cbw->tag;
+	csw.dr = cbw->dlen - done;
+
+	/* Data expected in the other direction than the command transfers */
+	if ((in >= 0) && (cbw->dlen > 0) && (in != ((cbw->flags & CBW_DIR_IN) != 0))) {
+		csw.status = CSW_PHASE;
+	}
+	else {
+		csw.status = (res < 0) ? CSW_FAILED : CSW_PASSED;
+	}
+
+	usbmsc_dataIn(&csw, sizeof(csw));
+}
+
+
+static void usbmsc_thread(void *arg)
+{
+	usbmsc_cbw_t cbw;
+	void *buf;
+	int n;
+
+	while (usbmsc_common.quit == 0) {
+		if (usbmsc_common.configured == 0) {
+			usleep(10 * 1000);
+			continue;
+		}
+
+		if ((n = usbclient_receiveBuff(USBMSC_ENDPT, &buf)) < 0) {
+			usleep(10 * 1000);
+			continue;
+		}
+
+		memcpy(&cbw, buf, (n < CBW_LEN) ? n : CBW_LEN);
+		usbclient_releaseBuff(USBMSC_ENDPT, buf);
+
+		/* Not a valid command block, wait for the next one */
+		if ((n != CBW_LEN) || (cbw.sig != CBW_SIG) || (cbw.lun != 0) || (cbw.clen == 0) || (cbw.clen > 16)) {
+			continue;
+		}
+
+		usbmsc_command(&cbw);
+	}
+
+	endthread();
+}
+
+
+static void usbmsc_eventNotify(int evType, void *ctxUser)
+{
+	switch (evType) {
+		case USBCLIENT_EV_CONFIGURED:
+			usbmsc_common.configured = 1;
+			break;
+
+		case USBCLIENT_EV_RESET:
+		case USBCLIENT_EV_DISCONNECT:
+			usbmsc_common.configured = 0;
+			usbmsc_common.lastEnd = -1;
+			break;
+
+		default:
+			break;
+	}
+}
+
+
+static int usbmsc_classSetup(const usb_setup_packet_t *setup, void *buf, unsigned int len, void *ctxUser)
+{
+	switch (setup->bRequest) {
+		case MSC_REQ_RESET:
+			usbmsc_common.lastEnd = -1;
+			return CLASS_SETUP_ACK;
+
+		case MSC_REQ_MAX_LUN:
+			*(uint8_t *)buf = 0;
+			return 1;
+
+		default:
+			return CLASS_SETUP_NOACTION;
+	}
+}
+
+
+static void usbmsc_resourcesFree(void)
+{
+	resourceDestroy(usbmsc_common.raCond);
+	resourceDestroy(usbmsc_common.cond);
+	resourceDestroy(usbmsc_common.lock);
+	resourceDestroy(usbmsc_common.devLock);
+
+	free(usbmsc_common.win[0].data);
+	free(usbmsc_common.win[1].data);
+	free(usbmsc_common.eblk.data);
+}
+
+
+int usbmsc_init(storage_t *strg, const usbmsc_args_t *args)
+{
+	storage_dev_t *dev;
+	int res;
+
+	if ((strg == NULL) || ((dev = strg->dev) == NULL)) {
+		return -EINVAL;
+	}
+
+	memset(&usbmsc_common, 0, sizeof(usbmsc_common));
+	usbmsc_common.strg = strg;
+	usbmsc_common.blksz = ((args != NULL) && (args->blksz != 0)) ? args->blksz : USBMSC_BLKSZ;
+	usbmsc_common.readonly = (args != NULL) ? args->readonly : 0;
+	usbmsc_common.nblocks = strg->size / usbmsc_common.blksz;
+	usbmsc_common.eblk.offs = -1;
+	usbmsc_common.lastEnd = -1;
+
+	if (usbmsc_common.nblocks == 0) {
+		return -EINVAL;
+	}
+
+	if (usbmsc_isMtd()) {
+		/* Bad block management of NAND is not handled */
+		if ((dev->mtd == NULL) || (dev->mtd->ops == NULL) || (dev->mtd->type != mtd_norFlash) || (dev->mtd->ops->read == NULL)) {
+			return -ENOTSUP;
+		}
+
+		if ((dev->mtd->ops->write == NULL) || (dev->mtd->ops->erase == NULL)) {
+			usbmsc_common.readonly = 1;
+		}
+		else if ((usbmsc_common.eblk.data = malloc(dev->mtd->erasesz)) == NULL) {
+			return -ENOMEM;
+		}
+	}
+	else if (dev->blk->ops->read == NULL) {
+		return -ENOTSUP;
+	}
+	else if (dev->blk->ops->write == NULL) {
+		usbmsc_common.readonly = 1;
+	}
+
+	usbmsc_common.win[0].data = malloc(USBMSC_RA_SIZE);
+	usbmsc_common.win[1].data = malloc(USBMSC_RA_SIZE);
+	if ((usbmsc_common.win[0].data == NULL) || (usbmsc_common.win[1].data == NULL)) {
+		usbmsc_resourcesFree();
+		return -ENOMEM;
+	}
+
+	if ((mutexCreate(&usbmsc_common.devLock) != EOK) || (mutexCreate(&usbmsc_common.lock) != EOK) ||
+			(condCreate(&usbmsc_common.cond) != EOK) || (condCreate(&usbmsc_common.raCond) != EOK)) {
+		usbmsc_resourcesFree();
+		return -ENOMEM;
+	}
+
+	usbclient_setUserContext(&usbmsc_common);
+	usbclient_setEventCallback(usbmsc_eventNotify);
+	usbclient_setClassCallback(usbmsc_classSetup);
+
+	if ((res = usbclient_init(&dldev)) != EOK) {
+		LOG_ERROR("couldn't initialize USB client");
+		usbmsc_resourcesFree();
+		return res;
+	}
+
+	beginthread(usbmsc_raThread, USBMSC_PRIO, usbmsc_common.raStack, sizeof(usbmsc_common.raStack), NULL);
+	beginthread(usbmsc_thread, USBMSC_PRIO, usbmsc_common.stack, sizeof(usbmsc_common.stack), NULL);
+
+	LOG("exporting %u blocks of %u bytes%s", usbmsc_common.nblocks, usbmsc_common.blksz, (usbmsc_common.readonly != 0) ? " (read-only)" : "");
+
+	return EOK;
+}
+
+
+void usbmsc_destroy(void)
+{
+	usbmsc_common.quit = 1;
+	usbclient_destroy();
+
+	mutexLock(usbmsc_common.lock);
+	condBroadcast(usbmsc_common.raCond);
+	condBroadcast(usbmsc_common.cond);
+	mutexUnlock(usbmsc_common.lock);
+
+	threadJoin(-1, 0);
+	threadJoin(-1, 0);
+
+	if (usbmsc_isMtd()) {
+		usbmsc_eblkFlush();
+	}
+
+	usbmsc_resourcesFree();
+}
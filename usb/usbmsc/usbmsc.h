@@ -0,0 +1,32 @@
+/*
+ * Phoenix-RTOS
+ *
+ * USB Mass Storage client (Bulk-Only Transport)
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _USBMSC_H_
+#define _USBMSC_H_
+
+#include <storage/storage.h>
+
+
+typedef struct {
+	unsigned int blksz; /* Logical block size reported to the host, 0 selects 512 bytes */
+	int readonly;       /* Report the medium as write protected */
+} usbmsc_args_t;
+
+
+/* Exports the storage as a USB mass storage device, commands are served by the library threads */
+extern int usbmsc_init(storage_t *strg, const usbmsc_args_t *args);
+
+
+extern void usbmsc_destroy(void);
+
+
+#endif
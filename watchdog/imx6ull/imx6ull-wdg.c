@@ -14,6 +14,7 @@
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <sys/ioctl.h>
@@ -29,10 +30,31 @@
 const size_t wdog_addr = 0x20bc000; /* WDOG1 address */
 const int default_timeout = 60;
 
+/* Heartbeat slots check period */
+#ifndef WDOG_HB_PERIOD_MS
+#define WDOG_HB_PERIOD_MS 100
+#endif
+
+#define WDOG_HB_TIMEOUT_MIN (2 * WDOG_HB_PERIOD_MS)
+#define WDOG_HB_TIMEOUT_MAX 128000
+
 struct {
 	volatile uint16_t *base;
 	uint32_t port;
-} wdog;
+	int prio;
+
+	handle_t lock;
+	wdog_hbPage_t *hb;
+	int hbcnt;
+	int stale;          /* Some client missed its timeout, kicking stopped for good */
+	uint32_t hbmask;    /* Registered slots */
+	struct {
+		uint32_t beat;  /* Last seen value */
+		time_t seen;    /* When beat last changed [us] */
+		time_t timeout; /* [us] */
+	} slot[WDOG_HB_SLOTS];
+	uint8_t stack[2048] __attribute__((aligned(8)));
+} wdog = { .prio = 4 };
 
 enum { wcr = 0, wsr, wrsr, wicr, wmcr };
 
@@ -76,18 +98,133 @@ static int wdog_settimeout(int timeout)
 	return timeout;
 }
 
+/* Kicks on IPC only while no heartbeat client is supervised */
+static void wdog_ipcKick(void)
+{
+	mutexLock(wdog.lock);
+	if (wdog.hbcnt == 0)
+		wdog_kick();
+	mutexUnlock(wdog.lock);
+}
+
+
+static int wdog_hbRegister(unsigned int timeout)
+{
+	int i;
+
+	if ((timeout < WDOG_HB_TIMEOUT_MIN) || (timeout > WDOG_HB_TIMEOUT_MAX))
+		return -EINVAL;
+
+	mutexLock(wdog.lock);
+	for (i = 0; i < WDOG_HB_SLOTS; ++i) {
+		if ((wdog.hbmask & (1u << i)) == 0)
+			break;
+	}
+
+	if (i == WDOG_HB_SLOTS) {
+		mutexUnlock(wdog.lock);
+		return -ENOSPC;
+	}
+
+	wdog.hb->beat[i] = 0;
+	wdog.slot[i].beat = 0;
+	wdog.slot[i].timeout = (time_t)timeout * 1000;
+	gettime(&wdog.slot[i].seen, NULL);
+	wdog.hbmask |= 1u << i;
+	wdog.hbcnt++;
+	mutexUnlock(wdog.lock);
+
+	return i;
+}
+
+
+static int wdog_hbUnregister(int slot)
+{
+	int err = -EINVAL;
+
+	mutexLock(wdog.lock);
+	if ((slot >= 0) && (slot < WDOG_HB_SLOTS) && ((wdog.hbmask & (1u << slot)) != 0)) {
+		wdog.hbmask &= ~(1u << slot);
+		wdog.hbcnt--;
+		err = EOK;
+	}
+	mutexUnlock(wdog.lock);
+
+	return err;
+}
+
+
+static void wdog_hbThread(void *arg)
+{
+	time_t now;
+	uint32_t beat;
+	int i, alive;
+
+	(void)arg;
+
+	for (;;) {
+		usleep(WDOG_HB_PERIOD_MS * 1000);
+		gettime(&now, NULL);
+
+		mutexLock(wdog.lock);
+		alive = (wdog.hbcnt != 0) && (wdog.stale == 0);
+		for (i = 0; (i < WDOG_HB_SLOTS) && (alive != 0); ++i) {
+			if ((wdog.hbmask & (1u << i)) == 0)
+				continue;
+
+			beat = wdog.hb->beat[i];
+			if (beat != wdog.slot[i].beat) {
+				wdog.slot[i].beat = beat;
+				wdog.slot[i].seen = now;
+			}
+			else if (now - wdog.slot[i].seen > wdog.slot[i].timeout) {
+				printf("watchdog: heartbeat client %d timed out\n", i);
+				wdog.stale = 1;
+				alive = 0;
+			}
+		}
+
+		if (alive != 0)
+			wdog_kick();
+		mutexUnlock(wdog.lock);
+	}
+}
+
+
 static void op_ioctl(msg_t *msg)
 {
 	const int *data;
 	unsigned long request;
 	int timeout = 0, err = EOK;
+	wdog_hbRegister_t reg;
 	id_t id;
 
 	data = ioctl_unpack(msg, &request, &id);
 
 	switch (request) {
 		case WDIOC_KEEPALIVE:
-			wdog_kick();
+			wdog_ipcKick();
+			break;
+		case WDIOC_HBREGISTER:
+			if (!data) {
+				err = -EINVAL;
+				break;
+			}
+
+			memcpy(&reg, data, sizeof(reg));
+			reg.slot = wdog_hbRegister(reg.timeout);
+			if (reg.slot < 0) {
+				err = reg.slot;
+				data = NULL;
+				break;
+			}
+
+			reg.paddr = va2pa(wdog.hb);
+			data = (const int *)&reg;
+			break;
+		case WDIOC_HBUNREGISTER:
+			err = (data != NULL) ? wdog_hbUnregister(*data) : -EINVAL;
+			data = NULL;
 			break;
 		case WDIOC_SETTIMEOUT:
 			if (!data) {
@@ -130,7 +267,7 @@ void wdog_handle(void)
 				msg.o.err = EOK;
 				break;
 			case mtWrite:
-				wdog_kick();
+				wdog_ipcKick();
 				msg.o.err = msg.i.size;
 				break;
 			case mtDevCtl:
@@ -185,8 +322,26 @@ int wdog_init(void)
 		return -1;
 	}
 
+	/* Uncached, so clients' beats are seen without cache maintenance */
+	wdog.hb = mmap(NULL, _PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_UNCACHED | MAP_ANONYMOUS | MAP_CONTIGUOUS, -1, 0);
+	if (wdog.hb == MAP_FAILED) {
+		puts("watchdog: could not allocate heartbeat page");
+		return -1;
+	}
+	memset((void *)wdog.hb, 0, _PAGE_SIZE);
+
+	if (mutexCreate(&wdog.lock) != EOK) {
+		puts("watchdog: could not create mutex");
+		return -1;
+	}
+
 	wdog_setup();
 
+	if (beginthread(wdog_hbThread, wdog.prio, wdog.stack, sizeof(wdog.stack), NULL) < 0) {
+		puts("watchdog: could not start heartbeat thread");
+		return -1;
+	}
+
 	return EOK;
 }
 
@@ -215,6 +370,7 @@ static int wdog_parseArgs(int argc, char *argv[])
 					return -EINVAL;
 				}
 				priority(prio);
+				wdog.prio = prio;
 				break;
 
 			case 'h':
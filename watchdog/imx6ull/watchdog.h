@@ -1,10 +1,33 @@
 #ifndef IMX6ULL_WATCHDOG
 #define IMX6ULL_WATCHDOG
 
+#include <stdint.h>
 #include <sys/ioctl.h>
 
 #define WATCHDOG_IOCTL_BASE 'W'
 #define WDIOC_KEEPALIVE     _IO(WATCHDOG_IOCTL_BASE, 5)
 #define WDIOC_SETTIMEOUT    _IOWR(WATCHDOG_IOCTL_BASE, 6, int)
+#define WDIOC_HBREGISTER    _IOWR(WATCHDOG_IOCTL_BASE, 7, wdog_hbRegister_t)
+#define WDIOC_HBUNREGISTER  _IOW(WATCHDOG_IOCTL_BASE, 8, int)
+
+
+#define WDOG_HB_SLOTS 32
+
+
+/*
+ * Heartbeat page, clients map it with mmap(MAP_PHYSMEM | MAP_UNCACHED | MAP_ANONYMOUS) at paddr
+ * and increment their slot more often than the registered timeout. While any client is registered
+ * the watchdog is kicked only if all of them are alive, a client that misses its timeout causes reset.
+ */
+typedef struct {
+	volatile uint32_t beat[WDOG_HB_SLOTS];
+} wdog_hbPage_t;
+
+
+typedef struct {
+	unsigned int timeout; /* in: ms */
+	int slot;             /* out */
+	uint64_t paddr;       /* out: heartbeat page physical address */
+} wdog_hbRegister_t;
 
 #endif /* IMX6ULL_WATCHDOG */